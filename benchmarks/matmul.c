@@ -0,0 +1,39 @@
+/* Products and determinants of small matrices with symbolic entries. */
+
+#include "klee/klee.h"
+
+#define N 3
+
+static void matmul(float c[N][N], float a[N][N], float b[N][N]) {
+  unsigned i, j, k;
+  for (i = 0; i != N; ++i)
+    for (j = 0; j != N; ++j) {
+      float sum = 0;
+      for (k = 0; k != N; ++k)
+        sum += a[i][k] * b[k][j];
+      c[i][j] = sum;
+    }
+}
+
+static float det(float m[N][N]) {
+  return m[0][0] * (m[1][1] * m[2][2] - m[1][2] * m[2][1]) -
+         m[0][1] * (m[1][0] * m[2][2] - m[1][2] * m[2][0]) +
+         m[0][2] * (m[1][0] * m[2][1] - m[1][1] * m[2][0]);
+}
+
+int main() {
+  float a[N][N], b[N][N], c[N][N];
+  unsigned i;
+  klee_make_symbolic(a, sizeof a, "a");
+  for (i = 0; i != N * N; ++i)
+    b[i / N][i % N] = (float) (i + 1) / 4;
+  b[1][1] = 0;
+
+  matmul(c, a, b);
+  float d = det(c);
+  if (d == 0)
+    return 1;
+  if (c[0][0] > c[1][1] && c[1][1] > c[2][2])
+    return 2;
+  return d < 0;
+}
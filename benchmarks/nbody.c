@@ -0,0 +1,51 @@
+/* A leapfrog integrator for two bodies under gravity with a symbolic
+   initial velocity. */
+
+#include "klee/klee.h"
+
+#define STEPS 4
+
+struct body {
+  double x, y, vx, vy, m;
+};
+
+static double isqrt3(double r2) {
+  /* 1 / r^3 by Newton's method on 1 / sqrt(r2). */
+  double y = 1.0, r;
+  unsigned i;
+  for (i = 0; i != 6; ++i)
+    y = y * (1.5 - 0.5 * r2 * y * y);
+  r = y * y * y;
+  return r;
+}
+
+static void step(struct body *b, double dt) {
+  double dx = b[1].x - b[0].x, dy = b[1].y - b[0].y;
+  double f = isqrt3(dx * dx + dy * dy);
+  unsigned i;
+  b[0].vx += dt * b[1].m * dx * f;
+  b[0].vy += dt * b[1].m * dy * f;
+  b[1].vx -= dt * b[0].m * dx * f;
+  b[1].vy -= dt * b[0].m * dy * f;
+  for (i = 0; i != 2; ++i) {
+    b[i].x += dt * b[i].vx;
+    b[i].y += dt * b[i].vy;
+  }
+}
+
+int main() {
+  struct body b[2] = { { 0, 0, 0, 0, 1 }, { 1, 0, 0, 1, 0.001 } };
+  double vy;
+  unsigned i;
+  klee_make_symbolic(&vy, sizeof vy, "vy");
+  klee_assume(vy > 0.5);
+  klee_assume(vy < 1.5);
+  b[1].vy = vy;
+
+  for (i = 0; i != STEPS; ++i) {
+    step(b, 0.01);
+    if (b[1].x * b[1].x + b[1].y * b[1].y > 1.0001)
+      return 1;
+  }
+  return 0;
+}
@@ -0,0 +1,24 @@
+/* Square roots by Newton's method, iterated until they converge. */
+
+#include "klee/klee.h"
+
+static float fsqrt(float a) {
+  float x = a > 1 ? a / 2 : 1, last;
+  unsigned i = 0;
+  if (a <= 0)
+    return 0;
+  do {
+    last = x;
+    x = (x + a / x) / 2;
+  } while (x != last && ++i != 8);
+  return x;
+}
+
+int main() {
+  float a;
+  klee_make_symbolic(&a, sizeof a, "a");
+  float r = fsqrt(a);
+  if (r * r > a * 1.001f)
+    return 1;
+  return 0;
+}
@@ -0,0 +1,182 @@
+#!/usr/bin/env python
+# ===-- run-benchmarks.py -------------------------------------------------===##
+#
+#                      The KLEE Symbolic Virtual Machine
+#
+#  This file is distributed under the University of Illinois Open Source
+#  License. See LICENSE.TXT for details.
+#
+# ===----------------------------------------------------------------------===##
+
+"""Run KLEE on the floating point kernels in this directory for a fixed
+budget and compare its performance with a stored baseline."""
+
+from __future__ import division, print_function
+
+import argparse
+import ast
+import glob
+import json
+import os
+import shlex
+import shutil
+import subprocess
+import sys
+import tempfile
+import time
+
+# The metrics of a benchmark, and whether higher values are better.
+Metrics = [
+    ('InstrsPerSec', True),
+    ('QueriesPerSec', True),
+    ('SolverFraction', False),
+    ('PeakRSS', False),
+    ('ICov', True),
+]
+
+
+def readStats(path):
+    """Return the last record of a text run.stats as a dict."""
+    with open(os.path.join(path, 'run.stats')) as f:
+        lines = [l for l in f if l.strip()]
+    names = ast.literal_eval(lines[0])
+    return dict(zip(names, ast.literal_eval(lines[-1])))
+
+
+def runKlee(args, bc, out):
+    """Run KLEE on a bitcode file; return its statistics and its peak
+    resident set size in megabytes."""
+    cmd = [args.klee, '--output-dir=' + out, '--stats-format=text',
+           '--stop-after-n-instructions=%d' % args.instructions,
+           '--max-time=%d' % args.time] + shlex.split(args.klee_args) + [bc]
+    with open(os.path.join(os.path.dirname(out), 'klee.log'), 'w') as log:
+        p = subprocess.Popen(cmd, stdout=log, stderr=subprocess.STDOUT)
+        _, status, usage = os.wait4(p.pid, 0)
+    if status:
+        raise RuntimeError('{0} failed with status {1}'.format(' '.join(cmd),
+                                                              status))
+    return readStats(out), usage.ru_maxrss / 1024.
+
+
+def runBenchmark(args, source, tmp):
+    name = os.path.splitext(os.path.basename(source))[0]
+    work = os.path.join(tmp, name)
+    os.mkdir(work)
+    bc = os.path.join(work, name + '.bc')
+    subprocess.check_call(shlex.split(args.cc) +
+                          ['-emit-llvm', '-c', '-g', '-O0',
+                           '-I', os.path.join(args.source_dir, 'include'),
+                           source, '-o', bc])
+
+    best = None
+    for _ in range(args.repeat):
+        stats, rss = runKlee(args, bc, os.path.join(work, 'klee-out'))
+        shutil.rmtree(os.path.join(work, 'klee-out'))
+        wall = max(stats['WallTime'], 1e-6)
+        covered = stats['CoveredInstructions']
+        total = covered + stats['UncoveredInstructions']
+        result = {
+            'Instructions': stats['Instructions'],
+            'InstrsPerSec': stats['Instructions'] / wall,
+            'QueriesPerSec': stats['NumQueries'] / wall,
+            'SolverFraction': stats['SolverTime'] / wall,
+            'PeakRSS': rss,
+            'ICov': 100. * covered / total if total else 0.,
+        }
+        # The fastest run is the least disturbed by the rest of the system.
+        if best is None or result['InstrsPerSec'] > best['InstrsPerSec']:
+            best = result
+    return name, best
+
+
+def compare(results, baseline, tolerance):
+    """Print the results next to the baseline; return the regressions."""
+    regressions = []
+    print('{0:<10} {1:<15} {2:>14} {3:>14} {4:>8}'.format(
+        'Benchmark', 'Metric', 'Baseline', 'Current', 'Change'))
+    for name in sorted(results):
+        for metric, higherIsBetter in Metrics:
+            current = results[name][metric]
+            base = baseline.get(name, {}).get(metric)
+            if base is None:
+                print('{0:<10} {1:<15} {2:>14} {3:>14.3f}'.format(
+                    name, metric, '-', current))
+                continue
+            change = (current - base) / base if base else 0.
+            print('{0:<10} {1:<15} {2:>14.3f} {3:>14.3f} {4:>+7.1f}%'.format(
+                name, metric, base, current, 100 * change))
+            if (change < -tolerance if higherIsBetter else change > tolerance):
+                regressions.append((name, metric))
+    return regressions
+
+
+def main():
+    here = os.path.dirname(os.path.abspath(__file__))
+    parser = argparse.ArgumentParser(description=__doc__)
+    parser.add_argument('--klee', default='klee', help='the klee binary')
+    parser.add_argument('--cc', default='clang',
+                        help='the bitcode compiler, with its arguments')
+    parser.add_argument('--source-dir', default=os.path.dirname(here),
+                        help='the KLEE source tree, for klee/klee.h')
+    parser.add_argument('--klee-args', default='',
+                        help='further arguments passed to klee')
+    parser.add_argument('--instructions', type=int, default=5000000,
+                        help='instructions each benchmark runs for '
+                        '(default=%(default)s)')
+    parser.add_argument('--time', type=int, default=300,
+                        help='seconds each benchmark runs for at most '
+                        '(default=%(default)s)')
+    parser.add_argument('--repeat', type=int, default=1,
+                        help='runs of each benchmark, of which the fastest '
+                        'counts (default=%(default)s)')
+    parser.add_argument('--baseline',
+                        default=os.path.join(here, 'baseline.json'),
+                        help='the stored results to compare with')
+    parser.add_argument('--save-baseline', action='store_true',
+                        help='store the results as the new baseline')
+    parser.add_argument('--history', metavar='FILE',
+                        help='append the results to FILE, one JSON object '
+                        'per run')
+    parser.add_argument('--tolerance', type=float, default=0.1,
+                        help='relative change of a metric counted as a '
+                        'regression (default=%(default)s)')
+    parser.add_argument('benchmarks', nargs='*',
+                        help='the benchmarks to run (default: all)')
+    args = parser.parse_args()
+
+    sources = sorted(glob.glob(os.path.join(here, '*.c')))
+    if args.benchmarks:
+        sources = [s for s in sources if os.path.splitext(
+            os.path.basename(s))[0] in args.benchmarks]
+
+    tmp = tempfile.mkdtemp(prefix='klee-bench-')
+    try:
+        results = dict(runBenchmark(args, s, tmp) for s in sources)
+    finally:
+        shutil.rmtree(tmp)
+
+    if args.history:
+        with open(args.history, 'a') as f:
+            f.write(json.dumps({'time': time.time(), 'results': results},
+                               sort_keys=True) + '\n')
+
+    baseline = {}
+    if os.path.exists(args.baseline):
+        with open(args.baseline) as f:
+            baseline = json.load(f)
+    regressions = compare(results, baseline, args.tolerance)
+
+    if args.save_baseline:
+        with open(args.baseline, 'w') as f:
+            json.dump(results, f, indent=2, sort_keys=True)
+        return 0
+    if not baseline:
+        print('No baseline in {0}; store one with --save-baseline.'.format(
+            args.baseline))
+    for name, metric in regressions:
+        print('Regression: {0} {1}'.format(name, metric))
+    return 1 if regressions else 0
+
+
+if __name__ == '__main__':
+    sys.exit(main())
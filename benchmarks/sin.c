@@ -0,0 +1,54 @@
+/* A libm-style sine: range reduction to [-pi/4, pi/4] and minimax
+   polynomials for sin and cos on the reduced argument. */
+
+#include "klee/klee.h"
+
+static const double PIO2 = 1.57079632679489661923;
+
+static double sinPoly(double x) {
+  double z = x * x;
+  return x + x * z * (-1.66666666666666324348e-01 +
+             z * (8.33333333332248946124e-03 +
+             z * (-1.98412698298579493134e-04 +
+             z * 2.75573137070700676789e-06)));
+}
+
+static double cosPoly(double x) {
+  double z = x * x;
+  return 1.0 - 0.5 * z + z * z * (4.16666666666666019037e-02 +
+               z * (-1.38888888888741095749e-03 +
+               z * 2.48015872894767294178e-05));
+}
+
+static double ksin(double x) {
+  int neg = 0, n;
+  double r;
+  if (x != x)
+    return x;
+  if (x < 0) {
+    x = -x;
+    neg = 1;
+  }
+  if (x > 1e6)
+    return 0.0;
+  n = (int) (x / PIO2 + 0.5);
+  r = x - n * PIO2;
+  switch (n & 3) {
+  case 0: r = sinPoly(r); break;
+  case 1: r = cosPoly(r); break;
+  case 2: r = -sinPoly(r); break;
+  default: r = -cosPoly(r); break;
+  }
+  return neg ? -r : r;
+}
+
+int main() {
+  double x;
+  klee_make_symbolic(&x, sizeof x, "x");
+  double s = ksin(x);
+  if (s > 0.5)
+    return 1;
+  if (s < -0.5)
+    return 2;
+  return 0;
+}
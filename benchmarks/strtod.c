@@ -0,0 +1,41 @@
+/* Parsing of decimal floating point numbers from a symbolic string. */
+
+#include "klee/klee.h"
+
+#define LEN 6
+
+static double parse(const char *s, int *ok) {
+  double v = 0, scale = 1;
+  int neg = 0, exp = 0, expNeg = 0, digits = 0;
+  if (*s == '-' || *s == '+')
+    neg = *s++ == '-';
+  for (; *s >= '0' && *s <= '9'; ++s, ++digits)
+    v = v * 10 + (*s - '0');
+  if (*s == '.')
+    for (++s; *s >= '0' && *s <= '9'; ++s, ++digits)
+      v += (*s - '0') * (scale /= 10);
+  if (digits && (*s == 'e' || *s == 'E')) {
+    ++s;
+    if (*s == '-' || *s == '+')
+      expNeg = *s++ == '-';
+    for (; *s >= '0' && *s <= '9'; ++s)
+      exp = exp * 10 + (*s - '0');
+    while (exp--)
+      v = expNeg ? v / 10 : v * 10;
+  }
+  *ok = digits && !*s;
+  return neg ? -v : v;
+}
+
+int main() {
+  char s[LEN + 1];
+  int ok;
+  klee_make_symbolic(s, LEN, "s");
+  s[LEN] = 0;
+  double v = parse(s, &ok);
+  if (!ok)
+    return 1;
+  if (v == 2.5)
+    return 2;
+  return v > 100;
+}
@@ -13,13 +13,29 @@ namespace klee {
 
 extern llvm::cl::opt<bool> UseFastCexSolver;
 
+extern llvm::cl::opt<bool> UseFloatTriageSolver;
+
+extern llvm::cl::opt<bool> UseFloatSearchSolver;
+
 extern llvm::cl::opt<bool> UseCexCache;
 
 extern llvm::cl::opt<bool> UseCache;
 
+extern llvm::cl::opt<bool> CanonicalizeArrays;
+
+extern llvm::cl::opt<std::string> PersistentQueryCache;
+
+extern llvm::cl::opt<std::string> SharedQueryCache;
+
+extern llvm::cl::opt<unsigned> SharedQueryCacheSize;
+
 extern llvm::cl::opt<bool> UseIndependentSolver; 
 
+extern llvm::cl::opt<bool> SimplifyFloatQueries;
+
 extern llvm::cl::opt<bool> DebugValidateSolver;
+
+extern llvm::cl::opt<bool> ProfileSolverChain;
   
 extern llvm::cl::opt<int> MinQueryTimeToLog;
 
@@ -34,8 +50,10 @@ enum QueryLoggingSolverType
 {
     ALL_KQUERY,   ///< Log all queries (un-optimised) in .kquery (KQuery) format
     ALL_SMTLIB,   ///< Log all queries (un-optimised)  .smt2 (SMT-LIBv2) format
+    ALL_BINARY,   ///< Log all queries (un-optimised) in the binary query log format
     SOLVER_KQUERY,///< Log queries passed to solver (optimised) in .kquery (KQuery) format
-    SOLVER_SMTLIB ///< Log queries passed to solver (optimised) in .smt2 (SMT-LIBv2) format
+    SOLVER_SMTLIB,///< Log queries passed to solver (optimised) in .smt2 (SMT-LIBv2) format
+    SOLVER_BINARY ///< Log queries passed to solver (optimised) in the binary query log format
 };
 
 /* Using cl::list<> instead of cl::bits<> results in quite a bit of ugliness when it comes to checking
@@ -49,10 +67,14 @@ enum CoreSolverType {
   METASMT_SOLVER,
   DUMMY_SOLVER,
   Z3_SOLVER,
+  BITWUZLA_SOLVER,
+  PORTFOLIO_SOLVER,
   NO_SOLVER
 };
 extern llvm::cl::opt<CoreSolverType> CoreSolverToUse;
 
+extern llvm::cl::list<CoreSolverType> PortfolioSolvers;
+
 extern llvm::cl::opt<CoreSolverType> DebugCrossCheckCoreSolverWith;
 
 #ifdef ENABLE_METASMT
@@ -66,6 +88,8 @@ enum MetaSMTBackendType
 
 extern llvm::cl::opt<klee::MetaSMTBackendType> MetaSMTBackend;
 
+extern llvm::cl::list<klee::MetaSMTBackendType> PortfolioMetaSMTBackends;
+
 #endif /* ENABLE_METASMT */
 
 //A bit of ugliness so we can use cl::list<> like cl::bits<>, see queryLoggingOptions
@@ -11,31 +11,72 @@
 #define KLEE_CONSTRAINTS_H
 
 #include "klee/Expr.h"
+#include "klee/Internal/ADT/ImmutableMap.h"
+#include "klee/util/ExprHashMap.h"
+
+#include <iterator>
+#include <vector>
 
-// FIXME: Currently we use ConstraintManager for two things: to pass
-// sets of constraints around, and to optimize constraints. We should
-// move the first usage into a separate data structure
-// (ConstraintSet?) which ConstraintManager could embed if it likes.
 namespace klee {
 
 class ExprVisitor;
   
+/// ConstraintManager - A list of constraints, simplified as they are added.
+///
+/// The list is persistent: it is a chain of immutable chunks, so that
+/// copies of a manager (such as the constraints of forked states) share the
+/// constraints they have in common, and a copy only costs as much as the
+/// constraints added to it afterwards.
 class ConstraintManager {
+  struct ConstraintChunk;
+
 public:
   typedef std::vector< ref<Expr> > constraints_ty;
-  typedef constraints_ty::iterator iterator;
-  typedef constraints_ty::const_iterator const_iterator;
 
-  ConstraintManager() {}
+  /// const_iterator - Walks the constraints in the order they were added.
+  class const_iterator
+    : public std::iterator<std::forward_iterator_tag, const ref<Expr> > {
+    friend class ConstraintManager;
 
-  // create from constraints with no optimization
-  explicit
-  ConstraintManager(const std::vector< ref<Expr> > &_constraints) :
-    constraints(_constraints) {}
+    /// The chunks of the list, the last one's path.
+    const ConstraintChunk *const *chunks;
+    unsigned numChunks, chunk, index;
+
+    const_iterator(const ConstraintChunk *const *_chunks, unsigned _numChunks,
+                   unsigned _chunk, unsigned _index)
+      : chunks(_chunks), numChunks(_numChunks), chunk(_chunk),
+        index(_index) {}
+
+  public:
+    const_iterator() : chunks(0), numChunks(0), chunk(0), index(0) {}
+
+    const ref<Expr> &operator*() const;
+    const ref<Expr> *operator->() const { return &**this; }
+
+    const_iterator &operator++();
+    const_iterator operator++(int) {
+      const_iterator old(*this);
+      ++*this;
+      return old;
+    }
 
-  ConstraintManager(const ConstraintManager &cs) : constraints(cs.constraints) {}
+    /// operator+ - The iterator \a n constraints further.
+    const_iterator operator+(size_t n) const;
 
-  typedef std::vector< ref<Expr> >::const_iterator constraint_iterator;
+    bool operator==(const const_iterator &other) const {
+      return chunk == other.chunk && index == other.index;
+    }
+    bool operator!=(const const_iterator &other) const {
+      return !(*this == other);
+    }
+  };
+  typedef const_iterator constraint_iterator;
+
+  ConstraintManager() : indexed(true) {}
+
+  // create from constraints with no optimization
+  explicit
+  ConstraintManager(const std::vector< ref<Expr> > &_constraints);
 
   // given a constraint which is known to be valid, attempt to 
   // simplify the existing constraint set
@@ -44,36 +85,120 @@ public:
   ref<Expr> simplifyExpr(ref<Expr> e) const;
 
   void addConstraint(ref<Expr> e);
+
+  /// simplify - Rewrite each constraint under the others and drop the ones
+  /// the others imply, as far as cheap local reasoning shows: constraints
+  /// the others simplify to true, float bounds a tighter bound on the same
+  /// value subsumes, and the classifications of a float its bounds imply.
+  /// The list is rebuilt as a single chunk if anything changed.
+  ///
+  /// \return Whether the list changed.
+  bool simplify();
   
   bool empty() const {
-    return constraints.empty();
-  }
-  ref<Expr> back() const {
-    return constraints.back();
-  }
-  constraint_iterator begin() const {
-    return constraints.begin();
-  }
-  constraint_iterator end() const {
-    return constraints.end();
-  }
-  size_t size() const {
-    return constraints.size();
+    return tail.isNull();
   }
+  ref<Expr> back() const;
+  const_iterator begin() const;
+  const_iterator end() const;
+  size_t size() const;
 
-  bool operator==(const ConstraintManager &other) const {
-    return constraints == other.constraints;
-  }
+  bool operator==(const ConstraintManager &other) const;
   
 private:
-  std::vector< ref<Expr> > constraints;
-
-  // returns true iff the constraints were modified
-  bool rewriteConstraints(ExprVisitor &visitor);
+  /// ConstraintChunk - A run of constraints following those of its parent.
+  /// A chunk only changes while a single list refers to it; a list adding
+  /// to a shared chunk starts a new one.
+  struct ConstraintChunk {
+    unsigned refCount;
+    ref<ConstraintChunk> parent;
+    /// The chunks from the first one of the list up to this one.
+    std::vector<const ConstraintChunk*> path;
+    /// The number of constraints before this chunk.
+    size_t offset;
+    constraints_ty constraints;
+    /// The symbolic arrays each constraint reads, computed on demand.
+    mutable std::vector< std::vector<const Array*> > reads;
+
+    ConstraintChunk(const ref<ConstraintChunk> &_parent);
+  };
+
+  typedef ImmutableMap< ref<Expr>, ref<Expr> > equalities_ty;
+
+  /// SimplifyCache - What simplifyExpr made of each subexpression it met
+  /// under one set of equalities. A cache is shared by the copies of a list
+  /// as long as their equalities are the same, and is only written to while
+  /// they are.
+  struct SimplifyCache {
+    unsigned refCount;
+    ExprHashMap< ref<Expr> > results;
+
+    SimplifyCache() : refCount(0) {}
+  };
+
+  /// The last chunk of the list, or null if it is empty.
+  ref<ConstraintChunk> tail;
+  /// What simplifyExpr replaces: the non-constant side of each equality
+  /// with a constant by the constant, and every other constraint by true.
+  /// It is only built once the constraints are simplified, since most
+  /// lists (the ones solvers build) never are.
+  mutable equalities_ty equalities;
+  mutable bool indexed;
+  /// The simplifications under the equalities, or null.
+  mutable ref<SimplifyCache> simplifyCache;
+
+  /// addEquality - Add what \a e replaces to \a equalities, returning the
+  /// expression replaced.
+  static ref<Expr> addEquality(equalities_ty &equalities, const ref<Expr> &e);
+
+  /// invalidateSimplifyCache - Drop the cached results which replacing \a
+  /// src may change, giving this list a cache of its own if it was shared.
+  void invalidateSimplifyCache(const ref<Expr> &src);
+
+  /// push - Append \a e to the list.
+  void push(const ref<Expr> &e);
+
+  /// rewriteEquality - Replace \a src by the constant \a dst in the
+  /// constraints which may contain it.
+  void rewriteEquality(ref<Expr> src, ref<Expr> dst);
 
   void addConstraintInternal(ref<Expr> e);
 };
 
+inline const ref<Expr> &ConstraintManager::const_iterator::operator*() const {
+  return chunks[chunk]->constraints[index];
+}
+
+inline ConstraintManager::const_iterator &
+ConstraintManager::const_iterator::operator++() {
+  if (++index == chunks[chunk]->constraints.size() && chunk + 1 < numChunks) {
+    ++chunk;
+    index = 0;
+  }
+  return *this;
+}
+
+inline ref<Expr> ConstraintManager::back() const {
+  return tail->constraints.back();
+}
+
+inline ConstraintManager::const_iterator ConstraintManager::begin() const {
+  if (tail.isNull())
+    return const_iterator();
+  return const_iterator(&tail->path[0], tail->path.size(), 0, 0);
+}
+
+inline ConstraintManager::const_iterator ConstraintManager::end() const {
+  if (tail.isNull())
+    return const_iterator();
+  return const_iterator(&tail->path[0], tail->path.size(),
+                        tail->path.size() - 1, tail->constraints.size());
+}
+
+inline size_t ConstraintManager::size() const {
+  return tail.isNull() ? 0 : tail->offset + tail->constraints.size();
+}
+
 }
 
 #endif /* KLEE_CONSTRAINTS_H */
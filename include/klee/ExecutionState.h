@@ -12,10 +12,16 @@
 
 #include "klee/Constraints.h"
 #include "klee/Expr.h"
-#include "klee/Internal/ADT/TreeStream.h"
+#include "klee/Internal/ADT/BranchHistory.h"
+#include "klee/Internal/ADT/CoverageBitmap.h"
+#include "klee/Internal/ADT/ImmutableMap.h"
+#include "klee/Internal/ADT/ImmutableSet.h"
+#include "klee/util/Assignment.h"
+#include "klee/util/ExprHashMap.h"
 
 // FIXME: We do not want to be exposing these? :(
 #include "../../lib/Core/AddressSpace.h"
+#include "klee/Internal/Module/Cell.h"
 #include "klee/Internal/Module/KInstIterator.h"
 
 #include <map>
@@ -24,10 +30,13 @@
 
 #include <fenv.h>
 
+namespace llvm {
+class Function;
+}
+
 namespace klee {
 class Array;
 class CallPathNode;
-struct Cell;
 struct KFunction;
 struct KInstruction;
 class MemoryObject;
@@ -36,13 +45,31 @@ struct InstructionInfo;
 
 llvm::raw_ostream &operator<<(llvm::raw_ostream &os, const MemoryMap &mm);
 
+/// The registers of a stack frame, shared by the copies of the frame made
+/// when forking until one of them writes to a register. Blocks of cells are
+/// kept when freed, for the next frame needing at most as many.
+struct StackLocals {
+  unsigned refCount;
+  /// The number of cells, a power of two.
+  unsigned capacity;
+  Cell *cells;
+};
+
 struct StackFrame {
   KInstIterator caller;
   KFunction *kf;
   CallPathNode *callPathNode;
 
   std::vector<const MemoryObject *> allocas;
-  Cell *locals;
+
+private:
+  StackLocals *locals;
+
+  static StackLocals *allocateLocals(unsigned size);
+  static void releaseLocals(StackLocals *locals, unsigned size);
+  void copyLocals();
+
+public:
 
   /// Minimum distance to an uncovered instruction once the function
   /// returns. This is not a good place for this but is used to
@@ -51,6 +78,12 @@ struct StackFrame {
   /// periodically.
   unsigned minDistToUncoveredOnReturn;
 
+  /// The index of the innermost frame, this one included, of a function
+  /// with a budget that is not called further up the stack, or -1. The
+  /// frames whose functions are charged for the cost of this one are
+  /// chained from there by the budgetFrame of the frame below each.
+  int budgetFrame;
+
   // For vararg functions: arguments not passed via parameter are
   // stored (packed tightly) in a local (alloca) memory object. This
   // is setup to match the way the front-end generates vaarg code (it
@@ -60,7 +93,242 @@ struct StackFrame {
 
   StackFrame(KInstIterator caller, KFunction *kf);
   StackFrame(const StackFrame &s);
+  StackFrame &operator=(const StackFrame &s);
   ~StackFrame();
+
+  const Cell &getLocal(unsigned index) const { return locals->cells[index]; }
+
+  /// Get register \a index for writing, copying the registers first if
+  /// they are shared with another frame.
+  Cell &getWriteableLocal(unsigned index) {
+    if (locals->refCount > 1)
+      copyLocals();
+    return locals->cells[index];
+  }
+};
+
+class ExecutionState;
+
+/// BranchMemo - The branch conditions a state last found to be true or
+/// false, by the instruction branching on them. Constraints are only ever
+/// added to a path, so a decided condition stays decided until the state
+/// is merged; copies of the state inherit the memo.
+class BranchMemo {
+  enum { Slots = 8 };
+
+  struct Entry {
+    const KInstruction *ki;
+    ref<Expr> condition;
+    bool value;
+
+    Entry() : ki(0), value(false) {}
+  };
+
+  Entry entries[Slots];
+
+  static unsigned getSlot(const KInstruction *ki) {
+    return (unsigned) (((uintptr_t) ki >> 4) % Slots);
+  }
+
+public:
+  /// lookup - Set \a value to what \a condition was found to be at \a ki,
+  /// returning false if it is not known.
+  bool lookup(const KInstruction *ki, const ref<Expr> &condition,
+              bool &value) const {
+    const Entry &e = entries[getSlot(ki)];
+    if (e.ki != ki || e.condition != condition)
+      return false;
+    value = e.value;
+    return true;
+  }
+
+  void insert(const KInstruction *ki, const ref<Expr> &condition,
+              bool value) {
+    Entry &e = entries[getSlot(ki)];
+    e.ki = ki;
+    e.condition = condition;
+    e.value = value;
+  }
+
+  void clear() {
+    for (unsigned i = 0; i != Slots; ++i)
+      entries[i] = Entry();
+  }
+};
+
+/// @brief The offsets a state proved in bounds of objects, as intervals of
+/// constant displacements from a symbolic base: an access at base + d of n
+/// bytes is in bounds if [d, d + n) lies in the interval of its object and
+/// base. A proof stays valid as the state gains constraints.
+class BoundsMemo {
+  enum { Slots = 8 };
+
+  struct Entry {
+    unsigned object;
+    ref<Expr> base;
+    int64_t begin, end;
+
+    Entry() : object(0), begin(0), end(0) {}
+  };
+
+  Entry entries[Slots];
+
+  static unsigned getSlot(unsigned object, const ref<Expr> &base) {
+    return (object * 31 + base->hash()) % Slots;
+  }
+
+public:
+  /// lookup - Whether the \a bytes bytes at \a base + \a displacement in
+  /// the object with id \a object were proved in bounds.
+  bool lookup(unsigned object, const ref<Expr> &base, int64_t displacement,
+              unsigned bytes) const {
+    const Entry &e = entries[getSlot(object, base)];
+    return e.object == object && e.base == base &&
+           e.begin <= displacement && displacement + bytes <= e.end;
+  }
+
+  /// insert - Record that the access \a lookup describes is in bounds,
+  /// widening the interval of the object and base if the two touch.
+  void insert(unsigned object, const ref<Expr> &base, int64_t displacement,
+              unsigned bytes) {
+    Entry &e = entries[getSlot(object, base)];
+    int64_t end = displacement + bytes;
+    if (e.object == object && e.base == base && displacement <= e.end &&
+        e.begin <= end) {
+      e.begin = std::min(e.begin, displacement);
+      e.end = std::max(e.end, end);
+      return;
+    }
+    e.object = object;
+    e.base = base;
+    e.begin = displacement;
+    e.end = end;
+  }
+
+  void clear() {
+    for (unsigned i = 0; i != Slots; ++i)
+      entries[i] = Entry();
+  }
+};
+
+/// @brief Values of symbolic arrays satisfying the constraints of a state,
+/// shared by the states forked off it as long as they satisfy theirs too
+/// (see -state-models). Arrays left unbound take whatever values satisfy
+/// the constraints along with the bound ones.
+struct StateModel {
+  unsigned refCount;
+  Assignment assignment;
+
+  StateModel(const std::vector<const Array *> &objects,
+             std::vector<std::vector<unsigned char> > &values)
+    : refCount(0), assignment(objects, values, /*_allowFreeValues=*/true) {}
+
+  /// evaluate - The value of \a e under the model, which is a constant
+  /// unless \a e reads an array the model leaves unbound.
+  ref<Expr> evaluate(const ref<Expr> &e) const {
+    return AssignmentEvaluator(assignment).visit(e);
+  }
+};
+
+/// @brief The objects a state made symbolic, in order, with their arrays.
+/// States forked off each other share the entries made before the fork:
+/// the first of them to add another appends to the shared entries, the
+/// others copy their prefix of them when they add theirs.
+class SymbolicList {
+public:
+  typedef std::pair<const MemoryObject *, const Array *> value_type;
+
+private:
+  /// The entries, holding a reference to each of their objects and arrays.
+  struct Shared {
+    unsigned refCount;
+    std::vector<value_type> entries;
+
+    Shared() : refCount(0) {}
+    ~Shared();
+  };
+
+  ref<Shared> shared;
+  /// The number of the shared entries which belong to this list.
+  unsigned count;
+
+public:
+  SymbolicList() : count(0) {}
+
+  unsigned size() const { return count; }
+  bool empty() const { return count == 0; }
+  const value_type &operator[](unsigned i) const {
+    assert(i < count && "invalid symbolic index");
+    return shared->entries[i];
+  }
+
+  void push_back(const value_type &value);
+
+  bool operator==(const SymbolicList &b) const;
+  bool operator!=(const SymbolicList &b) const { return !(*this == b); }
+};
+
+/// @brief A call of a pure function with concrete arguments, made in a
+/// floating-point environment (see -pure-functions)
+struct PureCall {
+  const llvm::Function *function;
+  std::vector<ref<Expr> > arguments;
+  llvm::APFloat::roundingMode roundingMode;
+  int fpExceptions;
+
+  bool operator<(const PureCall &b) const {
+    if (function != b.function)
+      return function < b.function;
+    if (roundingMode != b.roundingMode)
+      return roundingMode < b.roundingMode;
+    if (fpExceptions != b.fpExceptions)
+      return fpExceptions < b.fpExceptions;
+    return arguments < b.arguments;
+  }
+};
+
+/// @brief The bytes a pure call read and wrote so far, by address, while it
+/// runs to be memoized. A byte the call wrote before reading it is not
+/// among those it read from its caller.
+struct CallRecording {
+  unsigned refCount;
+  PureCall call;
+  /// The size of the stack within the call.
+  unsigned depth;
+  /// The id of the first object allocated in the call. Such objects are
+  /// the call's locals, which it frees, so their bytes are not recorded.
+  unsigned firstObjectId;
+  std::map<uint64_t, uint8_t> reads, writes;
+
+  CallRecording(const PureCall &_call, unsigned _depth,
+                unsigned _firstObjectId)
+    : refCount(0), call(_call), depth(_depth),
+      firstObjectId(_firstObjectId) {}
+
+  void read(uint64_t address, const uint8_t *bytes, unsigned n) {
+    for (unsigned i = 0; i != n; ++i)
+      if (!writes.count(address + i))
+        reads.insert(std::make_pair(address + i, bytes[i]));
+  }
+
+  void write(uint64_t address, const uint8_t *bytes, unsigned n) {
+    for (unsigned i = 0; i != n; ++i)
+      writes[address + i] = bytes[i];
+  }
+
+  size_t size() const { return reads.size() + writes.size(); }
+};
+
+/// @brief A frozen copy of a state, taken between two instructions, from
+/// which the states forked off it later can be recreated by replaying
+/// their path since (see -offload-states)
+struct StateCheckpoint {
+  unsigned refCount;
+  ExecutionState *state;
+
+  explicit StateCheckpoint(ExecutionState *_state)
+    : refCount(0), state(_state) {}
+  ~StateCheckpoint();
 };
 
 /// @brief ExecutionState representing a path under exploration
@@ -72,7 +340,7 @@ private:
   // unsupported, use copy constructor
   ExecutionState &operator=(const ExecutionState &);
 
-  std::map<std::string, std::string> fnAliases;
+  ImmutableMap<std::string, std::string> fnAliases;
 
 public:
   // Execution - Control Flow specific
@@ -99,6 +367,21 @@ public:
   /// @brief Constraints collected so far
   ConstraintManager constraints;
 
+  /// @brief Results of Executor::toUnique under the constraints collected
+  /// so far, dropped whenever a constraint is added
+  mutable ExprHashMap< ref<Expr> > uniqueValues;
+
+  /// @brief Branch conditions Executor::fork decided under the constraints
+  BranchMemo decidedBranches;
+
+  /// @brief Symbolic offsets Executor::executeMemoryOperation proved in
+  /// bounds under the constraints
+  BoundsMemo provenBounds;
+
+  /// @brief A model of the constraints collected so far, if one is known,
+  /// dropped when a constraint it does not satisfy is added
+  ref<StateModel> model;
+
   /// Statistics and information
 
   /// @brief ID unique identifier among all ExecutionStates created via copy
@@ -108,6 +391,17 @@ public:
   /// @brief Costs for all queries issued for this state, in seconds
   mutable double queryCost;
 
+  /// @brief Estimated cost of a query over the constraints collected so far,
+  /// from their size and floating point operators (see nurs:fpcost)
+  double constraintCost;
+
+  /// @brief Number of constraints already accounted for in constraintCost
+  unsigned constraintCostCount;
+
+  /// @brief Number of constraints after Executor::simplifyConstraints last
+  /// simplified them
+  size_t simplifiedConstraints;
+
   /// @brief Weight assigned for importance of this state.  Can be
   /// used for searchers to decide what paths to explore
   double weight;
@@ -117,11 +411,37 @@ public:
 
   /// @brief History of complete path: represents branches taken to
   /// reach/create this state (both concrete and symbolic)
-  TreeOStream pathOS;
+  BranchHistory pathHistory;
 
   /// @brief History of symbolic path: represents symbolic branches
   /// taken to reach/create this state
-  TreeOStream symPathOS;
+  BranchHistory symPathHistory;
+
+  /// @brief Branch decisions to take at the next forks without querying the
+  /// solver, for a state recreated from its path (see -offload-states)
+  std::vector<bool> pathPrefix;
+  unsigned pathPrefixPosition;
+
+  /// @brief Whether the state took a multi-way branch, which is not
+  /// recorded in pathHistory, so the state cannot be recreated from its path
+  bool tookMultiWayBranch;
+  /// @brief The number of branches in pathHistory before the first
+  /// multi-way branch, which the state can be recreated up to
+  unsigned multiWayBranchPosition;
+
+  /// @brief The functions the state entered, each with the number of
+  /// branches in pathHistory when it first did (see
+  /// -write-regression-paths)
+  ImmutableMap<const llvm::Function *, unsigned> firstCalls;
+
+  /// @brief The latest checkpoint this state descends from, if any
+  ref<StateCheckpoint> checkpoint;
+
+  /// @brief The branch condition of a lazy fork (see -lazy-fork), not yet
+  /// known to be feasible nor added to the constraints. A constant when it
+  /// was decided along with the sibling state: false if infeasible, true if
+  /// implied by the constraints.
+  ref<Expr> lazyCondition;
 
   /// @brief Counts how many instructions were executed since the last new
   /// instruction was covered.
@@ -130,34 +450,55 @@ public:
   /// @brief Whether a new instruction was covered in this state
   bool coveredNew;
 
+  /// @brief The branch whose fork last started this state, as its
+  /// instruction id plus one or 0 for none, the fork controller decision
+  /// taken there, and the instructions covered first since
+  unsigned forkSite;
+  unsigned forkDecision;
+  uint64_t newInstructions;
+
   /// @brief Disables forking for this state. Set by user code
   bool forkDisabled;
 
-  /// @brief Set containing which lines in which files are covered by this state
-  std::map<const std::string *, std::set<unsigned> > coveredLines;
+  /// @brief The outermost pure call being recorded on the stack, if any.
+  /// Copies of the state do not record it.
+  ref<CallRecording> recording;
+
+  /// @brief Ids of the instructions this state covered first, shared with
+  /// the states it was copied from until it covers a new one
+  CoverageBitmap coveredInstructions;
+
+  /// @brief The coverage items of the path, with -minimize-tests: the ids
+  /// of the instructions it executed, then two items for each conditional
+  /// branch, one for each direction it took (see getPathCoverage)
+  CoverageBitmap pathCoverage;
 
   /// @brief Pointer to the process tree of the current state
   PTreeNode *ptreeNode;
 
   /// @brief Ordered list of symbolics: used to generate test cases.
-  //
-  // FIXME: Move to a shared list structure (not critical).
-  std::vector<std::pair<const MemoryObject *, const Array *> > symbolics;
+  SymbolicList symbolics;
 
   /// @brief Set of used array names for this state.  Used to avoid collisions.
-  std::set<std::string> arrayNames;
+  ImmutableSet<std::string> arrayNames;
 
   std::string getFnAlias(std::string fn);
+  bool hasFnAliases() const { return !fnAliases.empty(); }
   void addFnAlias(std::string old_fn, std::string new_fn);
   void removeFnAlias(std::string fn);
 
   llvm::APFloat::roundingMode roundingMode;
-  fenv_t fEnv;
+
+  /// @brief The floating-point exceptions raised on the path, as FE_* flags.
+  /// They make up the floating-point environment with roundingMode, which
+  /// is only installed on the host around external calls.
+  int fpExceptions;
 
 private:
-  ExecutionState() : uniqueID(0), ptreeNode(0), roundingMode(llvm::APFloat::rmNearestTiesToEven) {
-    fegetenv(&fEnv);
-  }
+  ExecutionState() : uniqueID(0), constraintCost(0.), constraintCostCount(0),
+                     simplifiedConstraints(0),
+                     ptreeNode(0), roundingMode(llvm::APFloat::rmNearestTiesToEven),
+                     fpExceptions(0) {}
 
 public:
   ExecutionState(KFunction *kf);
@@ -175,8 +516,23 @@ public:
   void pushFrame(KInstIterator caller, KFunction *kf);
   void popFrame();
 
+  void markMultiWayBranch() {
+    if (!tookMultiWayBranch) {
+      tookMultiWayBranch = true;
+      multiWayBranchPosition = pathHistory.size();
+    }
+  }
+
   void addSymbolic(const MemoryObject *mo, const Array *array);
-  void addConstraint(ref<Expr> e) { constraints.addConstraint(e); }
+  void addConstraint(ref<Expr> e) {
+    constraints.addConstraint(e);
+    uniqueValues.clear();
+    if (!model.isNull()) {
+      ConstantExpr *CE = dyn_cast<ConstantExpr>(model->evaluate(e));
+      if (!CE || !CE->isTrue())
+        model = 0;
+    }
+  }
 
   bool merge(const ExecutionState &b);
   void dumpStack(llvm::raw_ostream &out) const;
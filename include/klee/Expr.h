@@ -10,11 +10,13 @@
 #ifndef KLEE_EXPR_H
 #define KLEE_EXPR_H
 
+#include "klee/util/ArrayFootprint.h"
 #include "klee/util/Bits.h"
 #include "klee/util/Ref.h"
 
 #include "llvm/ADT/APInt.h"
 #include "llvm/ADT/APFloat.h"
+#include "llvm/ADT/DenseMap.h"
 #include "llvm/ADT/DenseSet.h"
 #include "llvm/ADT/SmallVector.h"
 #include "llvm/Support/raw_ostream.h"
@@ -35,6 +37,7 @@ class Array;
 class ArrayCache;
 class ConstantExpr;
 class ObjectState;
+class UpdateNode;
 
 template<class T> class ref;
 
@@ -213,8 +216,9 @@ public:
     FRem,
     FMin,
     FMax,
+    FFma,
 
-    LastKind=FMax,
+    LastKind=FFma,
 
     CastKindFirst=ZExt,
     CastKindLast=ExplicitInt,
@@ -243,9 +247,20 @@ public:
 
   unsigned refCount;
 
+private:
+  friend class ArrayFootprint;
+
+  /// The arrays read, built on demand by getFootprint().
+  mutable const ArrayFootprint *footprint;
+
 protected:  
   unsigned hashValue;
 
+  /// hashCombine - Mix \a value into the running hash \a seed. Hashes are
+  /// mixed in 64 bits and folded into 32 by foldHash() to be kept.
+  static uint64_t hashCombine(uint64_t seed, uint64_t value);
+  static unsigned foldHash(uint64_t h) { return (unsigned) (h ^ (h >> 32)); }
+
   /// Compares `b` to `this` Expr and determines how they are ordered
   /// (ignoring their kid expressions - i.e. those returned by `getKid()`).
   ///
@@ -271,8 +286,13 @@ protected:
   virtual int compareContents(const Expr &b) const = 0;
 
 public:
-  Expr() : refCount(0) { Expr::count++; }
-  virtual ~Expr() { Expr::count--; } 
+  /// Nodes come from a size-classed pool, as most of them are short-lived
+  /// temporaries built while solving.
+  static void *operator new(size_t size);
+  static void operator delete(void *p, size_t size);
+
+  Expr() : refCount(0), footprint(0) { incRefCount(Expr::count); }
+  virtual ~Expr();
 
   virtual Kind getKind() const = 0;
   virtual Width getWidth() const = 0;
@@ -288,6 +308,11 @@ public:
   /// Returns the pre-computed hash of the current expression
   virtual unsigned hash() const { return hashValue; }
 
+  /// getFootprint - The symbolic arrays this expression reads. The footprint
+  /// is computed on first use from those of the kids, and kept as long as
+  /// the expression.
+  const ArrayFootprint &getFootprint() const;
+
   /// (Re)computes the hash of the current expression.
   /// Returns the hash value. 
   virtual unsigned computeHash();
@@ -307,6 +332,16 @@ public:
   /// `<` and `>` are binary relations that express the total order.
   int compare(const Expr &b) const;
 
+  /// Returns the expression structurally equal to `e` from the table of
+  /// unique expressions, entering `e` into the table if there is none, so
+  /// that equal expressions share one node. Returns `e` itself unless
+  /// -unique-exprs is set.
+  static Expr *uniquify(Expr *e);
+
+  template <class T> static ref<T> unique(const ref<T> &e) {
+    return static_cast<T *>(uniquify(e.get()));
+  }
+
   // Given an array of new kids return a copy of the expression
   // but using those children. 
   virtual ref<Expr> rebuild(ref<Expr> kids[/* getNumKids() */]) const = 0;
@@ -352,8 +387,14 @@ public:
 
   static bool classof(const Expr *) { return true; }
 
+#ifdef DEBUG
+  /// The comparisons of distinct nodes with equal hashes, and those of them
+  /// which found the nodes different: hash collisions.
+  static uint64_t hashMatches, hashCollisions;
+#endif
+
 private:
-  typedef llvm::DenseSet<std::pair<const Expr *, const Expr *> > ExprEquivSet;
+  class ExprEquivSet;
   int compare(const Expr &b, ExprEquivSet &equivs) const;
 };
 
@@ -503,7 +544,7 @@ public:
   static ref<Expr> alloc(const ref<Expr> &src) {
     ref<Expr> r(new NotOptimizedExpr(src));
     r->computeHash();
-    return r;
+    return unique(r);
   }
   
   static ref<Expr> create(ref<Expr> src);
@@ -533,13 +574,26 @@ public:
 };
 
 
+/// UpdateNodeIndex - Where reads of an update sequence may be satisfied:
+/// the newest update at each constant index, and the updates at other
+/// indices, newest first.
+struct UpdateNodeIndex {
+  llvm::DenseMap<uint64_t, const UpdateNode *> constantUpdates;
+  std::vector<const UpdateNode *> otherUpdates;
+};
+
 /// Class representing a byte update of an array.
 class UpdateNode {
   friend class UpdateList;  
+  friend class ArrayFootprint;
 
   mutable unsigned refCount;
   // cache instead of recalc
   unsigned hashValue;
+  // built on demand by getLookupIndex()
+  mutable UpdateNodeIndex *lookupIndex;
+  // built on demand by getFootprint()
+  mutable const ArrayFootprint *footprint;
 
 public:
   const UpdateNode *next;
@@ -556,11 +610,19 @@ public:
 
   unsigned getSize() const { return size; }
 
+  /// getLookupIndex - Index the updates of the sequence ending at this node.
+  /// The index is built on first use, and kept as long as the node.
+  const UpdateNodeIndex &getLookupIndex() const;
+
+  /// getFootprint - The symbolic arrays the indices and values of the
+  /// sequence ending at this node read, built on first use.
+  const ArrayFootprint &getFootprint() const;
+
   int compare(const UpdateNode &b) const;  
   unsigned hash() const { return hashValue; }
 
 private:
-  UpdateNode() : refCount(0) {}
+  UpdateNode() : refCount(0), lookupIndex(0), footprint(0) {}
   ~UpdateNode();
 
   unsigned computeHash();
@@ -586,6 +648,13 @@ public:
 private:
   unsigned hashValue;
 
+  /// The update lists rooted at this array, and the other holders which
+  /// retained it.
+  mutable unsigned refCount;
+  /// Whether the array has been retained at all, so that an ArrayCache does
+  /// not take an array which is yet to be used for an unreferenced one.
+  mutable bool retained;
+
   // FIXME: Make =delete when we switch to C++11
   Array(const Array& array);
 
@@ -618,6 +687,19 @@ public:
   /// ComputeHash must take into account the name, the size, the domain, and the range
   unsigned computeHash();
   unsigned hash() const { return hashValue; }
+
+  /// retain, release - Take and drop a reference to the array. Update lists
+  /// hold one to their root; a holder of a bare pointer takes one when it
+  /// keeps the array longer than the expressions reading it.
+  void retain() const {
+    incRefCount(refCount);
+    retained = true;
+  }
+  void release() const { decRefCount(refCount); }
+
+  /// isUnreferenced - Whether the array was retained and is no longer.
+  bool isUnreferenced() const { return retained && refCount == 0; }
+
   friend class ArrayCache;
 };
 
@@ -663,7 +745,7 @@ public:
   static ref<Expr> alloc(const UpdateList &updates, const ref<Expr> &index) {
     ref<Expr> r(new ReadExpr(updates, index));
     r->computeHash();
-    return r;
+    return unique(r);
   }
   
   static ref<Expr> create(const UpdateList &updates, ref<Expr> i);
@@ -708,7 +790,7 @@ public:
                          const ref<Expr> &f) {
     ref<Expr> r(new SelectExpr(c, t, f));
     r->computeHash();
-    return r;
+    return unique(r);
   }
   
   static ref<Expr> create(ref<Expr> c, ref<Expr> t, ref<Expr> f);
@@ -771,7 +853,7 @@ public:
   static ref<Expr> alloc(const ref<Expr> &l, const ref<Expr> &r) {
     ref<Expr> c(new ConcatExpr(l, r));
     c->computeHash();
-    return c;
+    return unique(c);
   }
   
   static ref<Expr> create(const ref<Expr> &l, const ref<Expr> &r);
@@ -838,7 +920,7 @@ public:
   static ref<Expr> alloc(const ref<Expr> &e, unsigned o, Width w) {
     ref<Expr> r(new ExtractExpr(e, o, w));
     r->computeHash();
-    return r;
+    return unique(r);
   }
   
   /// Creates an ExtractExpr with the given bit offset and width
@@ -889,7 +971,7 @@ public:
   static ref<Expr> alloc(const ref<Expr> &e) {
     ref<Expr> r(new NotExpr(e));
     r->computeHash();
-    return r;
+    return unique(r);
   }
   
   static ref<Expr> create(const ref<Expr> &e);
@@ -966,7 +1048,7 @@ public:                                                          \
     static ref<Expr> alloc(const ref<Expr> &e, Width w) {        \
       ref<Expr> r(new _class_kind ## Expr(e, w));                \
       r->computeHash();                                          \
-      return r;                                                  \
+      return unique(r);                                          \
     }                                                            \
     static ref<Expr> create(const ref<Expr> &e, Width w);        \
     Kind getKind() const { return _class_kind; }                 \
@@ -997,9 +1079,12 @@ public:
 
   llvm::APFloat::roundingMode getRoundingMode() const { return round; }
 
+  virtual unsigned computeHash();
+
   int compareContents(const Expr &b) const {
     const CastRoundExpr &eb = static_cast<const CastRoundExpr&>(b);
     if (width != eb.width) return width < eb.width ? -1 : 1;
+    if (round != eb.round) return round < eb.round ? -1 : 1;
     return 0;
   }
 
@@ -1020,7 +1105,7 @@ public:
     static ref<Expr> alloc(const ref<Expr> &e, Width w, llvm::APFloat::roundingMode rm) {                \
       ref<Expr> r(new _class_kind ## Expr(e, w, rm));                                                    \
       r->computeHash();                                                                                  \
-      return r;                                                                                          \
+      return unique(r);                                                                                  \
     }                                                                                                    \
     static ref<Expr> create(const ref<Expr> &e, Width w, llvm::APFloat::roundingMode rm);                \
     Kind getKind() const { return _class_kind; }                                                         \
@@ -1067,7 +1152,7 @@ public:                                                 \
     static ref<Expr> alloc(const ref<Expr> &e) {        \
       ref<Expr> r(new _class_kind ## Expr(e));          \
       r->computeHash();                                 \
-      return r;                                         \
+      return unique(r);                                 \
     }                                                   \
     static ref<Expr> create(const ref<Expr> &e);        \
     Width getWidth() const { return sizeof(int) * 8; }  \
@@ -1109,7 +1194,7 @@ UNARY_EXPR_CLASS(FIsInf)
     static ref<Expr> alloc(const ref<Expr> &l, const ref<Expr> &r) {           \
       ref<Expr> res(new _class_kind##Expr(l, r));                              \
       res->computeHash();                                                      \
-      return res;                                                              \
+      return unique(res);                                                      \
     }                                                                          \
     static ref<Expr> create(const ref<Expr> &l, const ref<Expr> &r);           \
     Width getWidth() const { return left->getWidth(); }                        \
@@ -1158,7 +1243,7 @@ ARITHMETIC_EXPR_CLASS(AShr)
     static ref<Expr> alloc(const ref<Expr> &l, const ref<Expr> &r) {           \
       ref<Expr> res(new _class_kind##Expr(l, r));                              \
       res->computeHash();                                                      \
-      return res;                                                              \
+      return unique(res);                                                      \
     }                                                                          \
     static ref<Expr> create(const ref<Expr> &l, const ref<Expr> &r);           \
     Kind getKind() const { return _class_kind; }                               \
@@ -1279,7 +1364,7 @@ public:
   static ref<ConstantExpr> alloc(const llvm::APInt &v) {
     ref<ConstantExpr> r(new ConstantExpr(v));
     r->computeHash();
-    return r;
+    return unique(r);
   }
 
   static ref<ConstantExpr> alloc(uint64_t v, Width w) {
@@ -1416,7 +1501,7 @@ public:                                                          \
     static ref<Expr> alloc(const ref<Expr> &e, Width w) {        \
       ref<Expr> r(new _class_kind ## Expr(e, w));                \
       r->computeHash();                                          \
-      return r;                                                  \
+      return unique(r);                                          \
     }                                                            \
     static ref<Expr> create(const ref<Expr> &e, Width w);        \
     Kind getKind() const { return _class_kind; }                 \
@@ -1444,9 +1529,12 @@ protected:
 public:
   llvm::APFloat::roundingMode getRoundingMode() const { return round; }
 
+  virtual unsigned computeHash();
+
   int compareContents(const Expr &b) const {
     const FCastRoundExpr &eb = static_cast<const FCastRoundExpr&>(b);
     if (width != eb.width) return width < eb.width ? -1 : 1;
+    if (round != eb.round) return round < eb.round ? -1 : 1;
     return 0;
   }
 
@@ -1467,7 +1555,7 @@ public:
     static ref<Expr> alloc(const ref<Expr> &e, Width w, llvm::APFloat::roundingMode rm) {                 \
       ref<Expr> r(new _class_kind ## Expr(e, w, rm));                                                     \
       r->computeHash();                                                                                   \
-      return r;                                                                                           \
+      return unique(r);                                                                                   \
     }                                                                                                     \
     static ref<Expr> create(const ref<Expr> &e, Width w, llvm::APFloat::roundingMode rm);                 \
     Kind getKind() const { return _class_kind; }                                                          \
@@ -1514,7 +1602,7 @@ public:                                                  \
     static ref<Expr> alloc(const ref<Expr> &e) {         \
       ref<Expr> r(new _class_kind ## Expr(e));           \
       r->computeHash();                                  \
-      return r;                                          \
+      return unique(r);                                  \
     }                                                    \
     static ref<Expr> create(const ref<Expr> &e);         \
     Width getWidth() const { return expr->getWidth(); }  \
@@ -1548,6 +1636,8 @@ public:
 
   llvm::APFloat::roundingMode getRoundingMode() const { return round; }
 
+  virtual unsigned computeHash();
+
   static bool classof(const Expr *E) {
     Kind k = E->getKind();
     return Expr::FUnaryRoundKindFirst <= k && k <= Expr::FUnaryRoundKindLast;
@@ -1565,7 +1655,7 @@ public:
     static ref<Expr> alloc(const ref<Expr> &e, llvm::APFloat::roundingMode rm) {                \
       ref<Expr> r(new _class_kind ## Expr(e, rm));                                              \
       r->computeHash();                                                                         \
-      return r;                                                                                 \
+      return unique(r);                                                                         \
     }                                                                                           \
     static ref<Expr> create(const ref<Expr> &e, llvm::APFloat::roundingMode rm);                \
     Width getWidth() const { return expr->getWidth(); }                                         \
@@ -1583,7 +1673,9 @@ public:
 	                                                                                            \
   protected:                                                                                    \
     virtual int compareContents(const Expr &b) const {                                          \
-      /* No attributes to compare. */                                                           \
+      const _class_kind ## Expr &eb = static_cast<const _class_kind ## Expr&>(b);               \
+      if (getRoundingMode() != eb.getRoundingMode())                                            \
+        return getRoundingMode() < eb.getRoundingMode() ? -1 : 1;                               \
       return 0;                                                                                 \
     }                                                                                           \
 };
@@ -1627,7 +1719,7 @@ public:                                                              \
     static ref<Expr> alloc(const ref<Expr> &l, const ref<Expr> &r) { \
       ref<Expr> res(new _class_kind ## Expr (l, r));                 \
       res->computeHash();                                            \
-      return res;                                                    \
+      return unique(res);                                            \
     }                                                                \
     static ref<Expr> create(const ref<Expr> &l, const ref<Expr> &r); \
     Width getWidth() const { return left->getWidth(); }              \
@@ -1663,6 +1755,8 @@ protected:
 public:
   llvm::APFloat::roundingMode getRoundingMode() const { return round; }
 
+  virtual unsigned computeHash();
+
   static bool classof(const Expr *E) {
     Kind k = E->getKind();
     return Expr::FBinaryRoundKindFirst <= k && k <= Expr::FBinaryRoundKindLast;
@@ -1683,7 +1777,7 @@ public:
     static ref<Expr> alloc(const ref<Expr> &l, const ref<Expr> &r, llvm::APFloat::roundingMode rm) { \
       ref<Expr> res(new _class_kind ## Expr (l, r, rm));                                             \
       res->computeHash();                                                                            \
-      return res;                                                                                    \
+      return unique(res);                                                                            \
     }                                                                                                \
     static ref<Expr> create(const ref<Expr> &l, const ref<Expr> &r, llvm::APFloat::roundingMode rm); \
     Width getWidth() const { return left->getWidth(); }                                              \
@@ -1701,7 +1795,9 @@ public:
 	                                                                                                 \
   protected:                                                                                         \
     virtual int compareContents(const Expr &b) const {                                               \
-      /* No attributes to compare. */                                                                \
+      const _class_kind ## Expr &eb = static_cast<const _class_kind ## Expr&>(b);                    \
+      if (getRoundingMode() != eb.getRoundingMode())                                                 \
+        return getRoundingMode() < eb.getRoundingMode() ? -1 : 1;                                    \
       return 0;                                                                                      \
     }                                                                                                \
 };                                                                                                   \
@@ -1712,6 +1808,68 @@ FLOAT_BINARY_RM_EXPR_CLASS(FMul)
 FLOAT_BINARY_RM_EXPR_CLASS(FDiv)
 FLOAT_BINARY_RM_EXPR_CLASS(FRem)
 
+/// Class representing a fused multiply-add, the product of the first two
+/// kids plus the third, rounded once.
+class FFmaExpr : public FNonConstantExpr {
+public:
+  static const Kind kind = FFma;
+  static const unsigned numKids = 3;
+
+public:
+  ref<Expr> left, right, addend;
+  llvm::APFloat::roundingMode round;
+
+public:
+  static ref<Expr> alloc(const ref<Expr> &l, const ref<Expr> &r,
+                         const ref<Expr> &a, llvm::APFloat::roundingMode rm) {
+    ref<Expr> res(new FFmaExpr(l, r, a, rm));
+    res->computeHash();
+    return unique(res);
+  }
+
+  static ref<Expr> create(const ref<Expr> &l, const ref<Expr> &r,
+                          const ref<Expr> &a, llvm::APFloat::roundingMode rm);
+
+  Width getWidth() const { return left->getWidth(); }
+  Kind getKind() const { return FFma; }
+  llvm::APFloat::roundingMode getRoundingMode() const { return round; }
+
+  unsigned getNumKids() const { return numKids; }
+  ref<Expr> getKid(unsigned i) const {
+    switch (i) {
+    case 0: return left;
+    case 1: return right;
+    case 2: return addend;
+    default: return 0;
+    }
+  }
+
+  virtual unsigned computeHash();
+
+  virtual ref<Expr> rebuild(ref<Expr> kids[]) const {
+    return create(kids[0], kids[1], kids[2], round);
+  }
+
+private:
+  FFmaExpr(const ref<Expr> &l, const ref<Expr> &r, const ref<Expr> &a,
+           llvm::APFloat::roundingMode rm)
+    : left(l), right(r), addend(a), round(rm) {}
+
+public:
+  static bool classof(const Expr *E) {
+    return E->getKind() == Expr::FFma;
+  }
+  static bool classof(const FFmaExpr *) { return true; }
+
+protected:
+  virtual int compareContents(const Expr &b) const {
+    const FFmaExpr &eb = static_cast<const FFmaExpr &>(b);
+    if (round != eb.round)
+      return round < eb.round ? -1 : 1;
+    return 0;
+  }
+};
+
 /// Class representing an if-then-else expression.
 class FSelectExpr : public FNonConstantExpr {
 public:
@@ -1726,7 +1884,7 @@ public:
                          const ref<Expr> &f) {
     ref<Expr> r(new FSelectExpr(c, t, f));
     r->computeHash();
-    return r;
+    return unique(r);
   }
 
   static ref<Expr> create(ref<Expr> c, ref<Expr> t, ref<Expr> f);
@@ -1777,38 +1935,35 @@ public:
   static const unsigned numKids = 0;
 
 private:
-  llvm::APFloat value;
+  /// The raw bits of Fl32 and Fl64 values, which are stored without an
+  /// APFloat.
+  uint64_t bits;
+  /// The value of any other width (i.e. Fl80), null for Fl32 and Fl64.
+  llvm::APFloat *wideValue;
+  Width width;
   bool correctHiddenBit = true;
 
-  FConstantExpr(const llvm::APFloat &v) : value(v) {}
+  FConstantExpr(const llvm::APFloat &v);
+
+  /// Return the shared node for +/-0, +/-1, +/-Inf or the canonical NaN of
+  /// the given width, or null if the bits are not one of those.
+  static FConstantExpr *getCommonConstant(Width w, uint64_t bits);
 
 public:
-  ~FConstantExpr() {}
-
-  Width getWidth() const { 
-    // getSizeInBits doesn't exist in our LLVM
-    switch (llvm::APFloat::semanticsPrecision(value.getSemantics()))
-    {
-    case 24:
-      return Fl32;
-    case 53:
-      return Fl64;
-    case 64:
-      return Fl80;
-    default:
-      return 0;
-    }
-  }
+  ~FConstantExpr() { delete wideValue; }
+
+  Width getWidth() const { return width; }
   Kind getKind() const { return FConstant; }
 
   unsigned getNumKids() const { return 0; }
   ref<Expr> getKid(unsigned i) const { return 0; }
 
-  /// getAPValue - Return the arbitrary precision value directly.
+  /// getAPValue - Return the arbitrary precision value. For Fl32 and Fl64 the
+  /// APFloat is materialized from the stored bits on each call.
   ///
   /// Clients should generally not use the APInt value directly and instead use
   /// native FConstantExpr APIs.
-  const llvm::APFloat &getAPValue() const { return value; }
+  llvm::APFloat getAPValue() const;
 
   /// toString - Return the constant value as a string
   /// \param Res specifies the string for the result to be placed in
@@ -1819,9 +1974,13 @@ public:
     const FConstantExpr &cb = static_cast<const FConstantExpr &>(b);
     if (getWidth() != cb.getWidth())
       return getWidth() < cb.getWidth() ? -1 : 1;
-    if (value.bitwiseIsEqual(cb.value) || !correctHiddenBit || !cb.correctHiddenBit)
+    if (!correctHiddenBit || !cb.correctHiddenBit)
+      return 0;
+    if (!wideValue)
+      return bits == cb.bits ? 0 : (bits < cb.bits ? -1 : 1);
+    if (wideValue->bitwiseIsEqual(*cb.wideValue))
       return 0;
-	return value.bitcastToAPInt().ult(cb.value.bitcastToAPInt()) ? -1 : 1;
+    return wideValue->bitcastToAPInt().ult(cb.wideValue->bitcastToAPInt()) ? -1 : 1;
   }
   
   virtual ref<Expr> rebuild(ref<Expr> kids[]) const {
@@ -1834,11 +1993,10 @@ public:
   static ref<Expr> fromMemory(void *address, Width w);
   void toMemory(void *address);
 
-  static ref<FConstantExpr> alloc(const llvm::APFloat &v) {
-    ref<FConstantExpr> r(new FConstantExpr(v));
-    r->computeHash();
-    return r;
-  }
+  /// Not entered into the table of unique expressions, as correctHiddenBit
+  /// may still be set on the new node after allocation. Common Fl32 and Fl64
+  /// values (+/-0, +/-1, +/-Inf and the canonical NaN) are shared instead.
+  static ref<FConstantExpr> alloc(const llvm::APFloat &v);
 
   static bool classof(const Expr *E) { return E->getKind() == Expr::FConstant; }
   static bool classof(const FConstantExpr *) { return true; }
@@ -1859,6 +2017,9 @@ public:
   ref<FConstantExpr> FRem(const ref<FConstantExpr> &RHS, llvm::APFloat::roundingMode RM);
   ref<FConstantExpr> FMin(const ref<FConstantExpr> &RHS);
   ref<FConstantExpr> FMax(const ref<FConstantExpr> &RHS);
+  ref<FConstantExpr> FFma(const ref<FConstantExpr> &RHS,
+                          const ref<FConstantExpr> &Addend,
+                          llvm::APFloat::roundingMode RM);
 
   // Operations that take a float and return an int
   ref<ConstantExpr> FToU(Width W, llvm::APFloat::roundingMode RM);
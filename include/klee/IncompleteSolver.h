@@ -13,6 +13,8 @@
 #include "klee/Solver.h"
 #include "klee/SolverImpl.h"
 
+#include <vector>
+
 namespace klee {
 
 /// IncompleteSolver - Base class for incomplete solver
@@ -82,21 +84,68 @@ public:
                                     bool &hasSolution) = 0;
 };
 
-/// StagedSolver - Adapter class for staging an incomplete solver with
-/// a complete secondary solver, to form an (optimized) complete
-/// solver.
+/// createFastCexStage - The incomplete solver behind createFastCexSolver.
+IncompleteSolver *createFastCexStage();
+
+/// createFloatTriageStage - The incomplete solver behind
+/// createFloatTriageSolver.
+IncompleteSolver *createFloatTriageStage();
+
+/// createFloatSearchStage - The incomplete solver behind
+/// createFloatSearchSolver.
+IncompleteSolver *createFloatSearchStage();
+
+/// StagedSolver - Adapter class for staging a pipeline of incomplete
+/// solvers with a complete secondary solver, to form an (optimized)
+/// complete solver. The stages are tried in order until one answers.
+///
+/// The solver learns which stages pay off: a stage which almost never
+/// answers a class of queries (truths and validities, with or without a
+/// float test at the top, values, initial values) is then only tried on
+/// one in -staged-solver-retry-interval queries of that class.
 class StagedSolverImpl : public SolverImpl {
+public:
+  enum QueryClass {
+    TruthQuery,
+    FloatTruthQuery,
+    ValueQuery,
+    InitialValuesQuery,
+    NumQueryClasses
+  };
+
 private:
-  IncompleteSolver *primary;
+  /// What a stage did on recent queries of one class. Both counts are
+  /// halved from time to time, so that old outcomes fade.
+  struct StageRecord {
+    unsigned attempts, successes;
+    /// Queries of the class the stage skipped since it last tried one.
+    unsigned skipped;
+
+    StageRecord() : attempts(0), successes(0), skipped(0) {}
+  };
+
+  std::vector<IncompleteSolver *> stages;
+  /// The records of stage i on class c are at i * NumQueryClasses + c.
+  std::vector<StageRecord> records;
   Solver *secondary;
-  
+
+  static QueryClass getTruthClass(const Query &query);
+  /// shouldTry - Whether stage \a i is worth trying on a query of class
+  /// \a c.
+  bool shouldTry(unsigned i, QueryClass c);
+  void recordOutcome(unsigned i, QueryClass c, bool success);
+
 public:
   StagedSolverImpl(IncompleteSolver *_primary, Solver *_secondary);
+  StagedSolverImpl(const std::vector<IncompleteSolver *> &_stages,
+                   Solver *_secondary);
   ~StagedSolverImpl();
     
   bool computeTruth(const Query&, bool &isValid);
   bool computeValidity(const Query&, Solver::Validity &result);
   bool computeValue(const Query&, ref<Expr> &result);
+  bool computeRange(const Query&, ref<Expr> &min, ref<Expr> &max);
+  bool computeUniqueValue(const Query&, ref<Expr> &result, bool &isUnique);
   bool computeInitialValues(const Query&,
                             const std::vector<const Array*> &objects,
                             std::vector< std::vector<unsigned char> > &values,
@@ -104,6 +153,9 @@ public:
   SolverRunStatus getOperationStatusCode();
   char *getConstraintLog(const Query&);
   void setCoreSolverTimeout(double timeout);
+  size_t trimCaches(size_t bytes);
+  void releaseArrays(const std::vector<const Array *> &arrays);
+  void interrupt();
 };
 
 }
@@ -0,0 +1,107 @@
+//===-- BranchHistory.h -----------------------------------------*- C++ -*-===//
+//
+//                     The KLEE Symbolic Virtual Machine
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+
+#ifndef KLEE_BRANCHHISTORY_H
+#define KLEE_BRANCHHISTORY_H
+
+#include <stdint.h>
+#include <vector>
+
+namespace klee {
+
+  /// A sequence of branch decisions, one bit each, which shares its prefix
+  /// with the copies it was made from.
+  ///
+  /// Decisions are packed into words. Full words are sealed into immutable,
+  /// reference counted chunks linked back to the chunk before them, so
+  /// copying a history (at a fork) only copies the unsealed word and takes
+  /// a reference to the last chunk.
+  class BranchHistory {
+    static const unsigned wordBits = 64;
+
+    struct Chunk {
+      unsigned refCount;
+      Chunk *prev;
+      uint64_t bits;
+
+      Chunk(Chunk *_prev, uint64_t _bits)
+        : refCount(1), prev(_prev), bits(_bits) {}
+    };
+
+    /// The last sealed chunk, or null.
+    Chunk *last;
+    /// The decisions after the last sealed chunk; decision i is bit i.
+    uint64_t bits;
+    unsigned count;
+
+    static void release(Chunk *c) {
+      // Iterative, as long histories would overflow the stack otherwise.
+      while (c && --c->refCount == 0) {
+        Chunk *prev = c->prev;
+        delete c;
+        c = prev;
+      }
+    }
+
+  public:
+    BranchHistory() : last(0), bits(0), count(0) {}
+    BranchHistory(const BranchHistory &h)
+      : last(h.last), bits(h.bits), count(h.count) {
+      if (last)
+        ++last->refCount;
+    }
+    ~BranchHistory() { release(last); }
+
+    BranchHistory &operator=(const BranchHistory &h) {
+      if (h.last)
+        ++h.last->refCount;
+      release(last);
+      last = h.last;
+      bits = h.bits;
+      count = h.count;
+      return *this;
+    }
+
+    /// The number of decisions recorded.
+    unsigned size() const { return count; }
+    bool empty() const { return count == 0; }
+
+    void push_back(bool taken) {
+      unsigned bit = count % wordBits;
+      if (taken)
+        bits |= (uint64_t) 1 << bit;
+      ++count;
+      if (bit == wordBits - 1) {
+        last = new Chunk(last, bits);
+        bits = 0;
+      }
+    }
+
+    /// Append the decisions in order as '0' and '1' bytes, the format of
+    /// .path files.
+    void read(std::vector<unsigned char> &out) const {
+      std::vector<uint64_t> words;
+      words.reserve(count / wordBits + 1);
+      for (const Chunk *c = last; c; c = c->prev)
+        words.push_back(c->bits);
+
+      std::vector<unsigned char>::size_type pos = out.size();
+      out.resize(pos + count);
+      for (std::vector<uint64_t>::reverse_iterator it = words.rbegin(),
+             ie = words.rend(); it != ie; ++it)
+        for (unsigned i = 0; i != wordBits; ++i)
+          out[pos++] = ((*it >> i) & 1) ? '1' : '0';
+      for (unsigned i = 0, e = count % wordBits; i != e; ++i)
+        out[pos++] = ((bits >> i) & 1) ? '1' : '0';
+    }
+  };
+
+}
+
+#endif
@@ -0,0 +1,104 @@
+//===-- CoverageBitmap.h ----------------------------------------*- C++ -*-===//
+//
+//                     The KLEE Symbolic Virtual Machine
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+
+#ifndef KLEE_COVERAGEBITMAP_H
+#define KLEE_COVERAGEBITMAP_H
+
+#include <stdint.h>
+#include <vector>
+
+namespace klee {
+
+  /// A set of instruction ids, one bit each, which shares its words with the
+  /// copies it was made from until one of them is written.
+  ///
+  /// Copying a bitmap (at a fork) only takes a reference; the words are
+  /// copied on the first write after. They are allocated up to the largest
+  /// id set, so a bitmap with nothing set takes no memory.
+  class CoverageBitmap {
+    static const unsigned wordBits = 64;
+
+    struct Words {
+      unsigned refCount;
+      std::vector<uint64_t> bits;
+
+      Words() : refCount(1) {}
+    };
+
+    /// The words, or null if no bit is set.
+    Words *words;
+
+    static void release(Words *w) {
+      if (w && --w->refCount == 0)
+        delete w;
+    }
+
+  public:
+    CoverageBitmap() : words(0) {}
+    CoverageBitmap(const CoverageBitmap &b) : words(b.words) {
+      if (words)
+        ++words->refCount;
+    }
+    ~CoverageBitmap() { release(words); }
+
+    CoverageBitmap &operator=(const CoverageBitmap &b) {
+      if (b.words)
+        ++b.words->refCount;
+      release(words);
+      words = b.words;
+      return *this;
+    }
+
+    void swap(CoverageBitmap &b) {
+      Words *tmp = words;
+      words = b.words;
+      b.words = tmp;
+    }
+
+    bool empty() const { return !words; }
+
+    bool test(unsigned id) const {
+      return words && id / wordBits < words->bits.size() &&
+             ((words->bits[id / wordBits] >> (id % wordBits)) & 1);
+    }
+
+    void set(unsigned id) {
+      if (test(id))
+        return;
+      if (!words) {
+        words = new Words();
+      } else if (words->refCount > 1) {
+        Words *w = new Words();
+        w->bits = words->bits;
+        release(words);
+        words = w;
+      }
+      if (id / wordBits >= words->bits.size())
+        words->bits.resize(id / wordBits + 1);
+      words->bits[id / wordBits] |= (uint64_t) 1 << (id % wordBits);
+    }
+
+    void clear() {
+      release(words);
+      words = 0;
+    }
+
+    /// Append the ids set to \a ids, in increasing order.
+    void getIds(std::vector<unsigned> &ids) const {
+      if (!words)
+        return;
+      for (unsigned i = 0, e = words->bits.size(); i != e; ++i)
+        for (uint64_t w = words->bits[i]; w; w &= w - 1)
+          ids.push_back(i * wordBits + __builtin_ctzll(w));
+    }
+  };
+
+}
+
+#endif
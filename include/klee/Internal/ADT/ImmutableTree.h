@@ -11,9 +11,54 @@
 #define __UTIL_IMMUTABLETREE_H__
 
 #include <cassert>
+#include <cstddef>
+#include <new>
 #include <vector>
 
 namespace klee {
+  /// NodePool - Allocator for the nodes of one type of tree. Every update
+  /// of a tree copies the path to the updated node, so nodes come and go
+  /// all the time: they are carved out of chunks, which keeps the nodes of
+  /// a tree close together, and freed nodes are kept for reuse rather than
+  /// given back to malloc.
+  template<class T>
+  class NodePool {
+    union Slot {
+      Slot *next;
+      long double align;
+      char object[sizeof(T)];
+    };
+
+    // Enough slots for a chunk to be about a page.
+    enum { SlotsPerChunk = 4096 / sizeof(Slot) > 0 ? 4096 / sizeof(Slot) : 1 };
+
+    static Slot *freeSlots;
+
+  public:
+    static void *allocate() {
+      if (!freeSlots) {
+        Slot *chunk = static_cast<Slot *>(
+            ::operator new(sizeof(Slot) * SlotsPerChunk));
+        for (unsigned i = 0; i != SlotsPerChunk; ++i) {
+          chunk[i].next = freeSlots;
+          freeSlots = &chunk[i];
+        }
+      }
+      Slot *slot = freeSlots;
+      freeSlots = slot->next;
+      return slot;
+    }
+
+    static void deallocate(void *p) {
+      Slot *slot = static_cast<Slot *>(p);
+      slot->next = freeSlots;
+      freeSlots = slot;
+    }
+  };
+
+  template<class T>
+  typename NodePool<T>::Slot *NodePool<T>::freeSlots = 0;
+
   template<class K, class V, class KOV, class CMP>
   class ImmutableTree {
   public:
@@ -85,6 +130,12 @@ namespace klee {
     Node(Node *_left, Node *_right, const value_type &_value);
     ~Node();
 
+    static void *operator new(size_t size) {
+      assert(size == sizeof(Node) && "nodes are never derived from");
+      return NodePool<Node>::allocate();
+    }
+    static void operator delete(void *p) { NodePool<Node>::deallocate(p); }
+
     void decref();
     Node *incref();
 
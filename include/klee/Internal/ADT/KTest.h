@@ -10,6 +10,7 @@
 #ifndef __COMMON_KTEST_H__
 #define __COMMON_KTEST_H__
 
+#include <stdio.h>
 
 #ifdef __cplusplus
 extern "C" {
@@ -49,12 +50,54 @@ extern "C" {
 
   /* returns 1 on success, 0 on (unspecified) error */
   int   kTest_toFile(KTest *, const char *path);
+
+  /* as kTest_fromFile and kTest_toFile, reading from or writing to the
+     current position of an open stream */
+  KTest* kTest_fromStream(FILE *);
+  int   kTest_toStream(KTest *, FILE *);
   
   /* returns total number of object bytes */
   unsigned kTest_numBytes(KTest *);
 
   void  kTest_free(KTest *);
 
+
+  /* A .kpack file holds many tests in a single append-only archive, with
+     identical objects stored once and, if zlib is available, compressed. */
+  typedef struct KTestPackWriter KTestPackWriter;
+  typedef struct KTestPackReader KTestPackReader;
+
+  /* return true iff file at path matches KTest pack header */
+  int   kTest_isKTestPack(const char *path);
+
+  /* returns NULL on (unspecified) error; object bytes are compressed iff
+     compress is set and zlib is available */
+  KTestPackWriter* kTestPack_create(const char *path, int compress);
+
+  /* returns 1 on success, 0 on (unspecified) error */
+  int   kTestPack_append(KTestPackWriter *, KTest *, const char *name);
+
+  /* writes the index and closes the pack; returns 1 on success, 0 on
+     (unspecified) error */
+  int   kTestPack_close(KTestPackWriter *);
+
+  /* closes the pack without writing the index, e.g. in a forked child
+     which shares the file with its parent */
+  void  kTestPack_abandon(KTestPackWriter *);
+
+  /* returns NULL on (unspecified) error; a pack without index (from an
+     interrupted run) is read up to its last complete test */
+  KTestPackReader* kTestPack_open(const char *path);
+
+  unsigned kTestPack_numTests(KTestPackReader *);
+
+  const char* kTestPack_getName(KTestPackReader *, unsigned index);
+
+  /* returns NULL on (unspecified) error; free the result with kTest_free */
+  KTest* kTestPack_get(KTestPackReader *, unsigned index);
+
+  void  kTestPack_free(KTestPackReader *);
+
 #ifdef __cplusplus
 }
 #endif
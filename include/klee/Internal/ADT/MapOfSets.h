@@ -53,6 +53,10 @@ namespace klee {
     template<class Predicate>
     V *findSubset(const std::set<K> &set, const Predicate &p);
 
+    /// removeIf - Remove the entries whose value satisfies \a p.
+    template<class Predicate>
+    void removeIf(const Predicate &p);
+
   private:
     class Node;
 
@@ -80,6 +84,8 @@ namespace klee {
                   typename std::set<K>::iterator begin, 
                   typename std::set<K>::iterator end,
                   const Predicate &p);
+    template<class Predicate>
+    bool removeIf(Node *n, const Predicate &p);
   };
 
   /***/
@@ -372,6 +378,30 @@ namespace klee {
     return findSubset(&root, set.begin(), set.end(), p);
   }
 
+  template<class K, class V>
+  template<class Predicate>
+  bool MapOfSets<K,V>::removeIf(Node *n, const Predicate &p) {
+    if (n->isEndOfSet && p(n->value)) {
+      n->isEndOfSet = false;
+      n->value = V();
+    }
+    for (typename Node::children_ty::iterator it = n->children.begin(),
+           ie = n->children.end(); it != ie;) {
+      if (removeIf(&it->second, p))
+        n->children.erase(it++);
+      else
+        ++it;
+    }
+    // Whether nothing is left below this node.
+    return !n->isEndOfSet && n->children.empty();
+  }
+
+  template<class K, class V>
+  template<class Predicate>
+  void MapOfSets<K,V>::removeIf(const Predicate &p) {
+    removeIf(&root, p);
+  }
+
   template<class K, class V>
   void MapOfSets<K,V>::clear() {
     root.isEndOfSet = false;
@@ -12,11 +12,169 @@
 
 #include <klee/Expr.h>
 
+#include <cassert>
+#include <vector>
+
 namespace klee {
   class MemoryObject;
 
+  /// Cell - A register of the interpreter. It either holds an expression, or
+  /// an immediate integer of up to 64 bits or single or double precision
+  /// float, for which the expression is only built once a client asks for
+  /// it. The interpreter computes concrete results on immediates directly,
+  /// so that it need not allocate a constant expression for each of them.
+  ///
+  /// A vector value may also be held as its lanes, which executing vector
+  /// instructions natively produces. Its expression is then the
+  /// concatenation of the lanes, the first lane in the lowest bits.
   struct Cell {
-    ref<Expr> value;
+  private:
+    /// The value, built on demand for an immediate or lanes.
+    mutable ref<Expr> expr;
+    /// The lanes of a vector value, or null.
+    std::vector< ref<Expr> > *lanes;
+    /// The bits of an immediate.
+    uint64_t bits;
+    /// The width of an immediate, or 0 if the cell holds an expression.
+    Expr::Width width;
+    /// Whether the immediate is a floating point value.
+    bool isFloat;
+
+    ref<Expr> buildValue() const {
+      if (lanes) {
+        std::vector< ref<Expr> > kids;
+        for (unsigned i = lanes->size(); i != 0; --i) {
+          ref<Expr> lane = (*lanes)[i - 1];
+          if (isa<FExpr>(lane))
+            lane = ExplicitIntExpr::create(lane, lane->getWidth());
+          kids.push_back(lane);
+        }
+        return ConcatExpr::createN(kids.size(), kids.data());
+      }
+      if (!isFloat)
+        return ConstantExpr::create(bits, width);
+      const llvm::fltSemantics &sem = width == Expr::Fl32 ?
+        llvm::APFloat::IEEEsingle : llvm::APFloat::IEEEdouble;
+      return FConstantExpr::alloc(llvm::APFloat(sem,
+                                                llvm::APInt(width, bits)));
+    }
+
+    void clearLanes() {
+      delete lanes;
+      lanes = 0;
+    }
+
+  public:
+    Cell() : lanes(0), bits(0), width(0), isFloat(false) {}
+
+    Cell(const Cell &c)
+      : expr(c.expr), lanes(c.lanes ? new std::vector< ref<Expr> >(*c.lanes) : 0),
+        bits(c.bits), width(c.width), isFloat(c.isFloat) {}
+
+    Cell &operator=(const Cell &c) {
+      if (this != &c) {
+        expr = c.expr;
+        clearLanes();
+        if (c.lanes)
+          lanes = new std::vector< ref<Expr> >(*c.lanes);
+        bits = c.bits;
+        width = c.width;
+        isFloat = c.isFloat;
+      }
+      return *this;
+    }
+
+    ~Cell() { delete lanes; }
+
+    /// getValue - The value as an expression; null if the cell was never
+    /// assigned.
+    ref<Expr> getValue() const {
+      if ((width || lanes) && expr.isNull())
+        expr = buildValue();
+      return expr;
+    }
+
+    void setValue(const ref<Expr> &e) {
+      expr = e;
+      clearLanes();
+      width = 0;
+    }
+
+    /// setLanes - Hold the vector value with the given lanes.
+    void setLanes(const std::vector< ref<Expr> > &v) {
+      expr = ref<Expr>();
+      if (lanes)
+        *lanes = v;
+      else
+        lanes = new std::vector< ref<Expr> >(v);
+      width = 0;
+    }
+
+    /// getLanes - The lanes of a vector value, if the cell holds them.
+    const std::vector< ref<Expr> > *getLanes() const { return lanes; }
+
+    /// setConstant - Hold the integer \a v of \a w bits.
+    void setConstant(uint64_t v, Expr::Width w) {
+      assert(w && w <= Expr::Int64 && "invalid immediate width");
+      expr = ref<Expr>();
+      clearLanes();
+      bits = v;
+      width = w;
+      isFloat = false;
+    }
+
+    /// setFloatConstant - Hold the single or double precision float with
+    /// the bit pattern \a v.
+    void setFloatConstant(uint64_t v, Expr::Width w) {
+      assert((w == Expr::Fl32 || w == Expr::Fl64) &&
+             "invalid immediate width");
+      expr = ref<Expr>();
+      clearLanes();
+      bits = v;
+      width = w;
+      isFloat = true;
+    }
+
+    /// getConstant - If the cell holds an integer constant of up to 64 bits,
+    /// immediate or not, return it in \a v and its width in \a w.
+    bool getConstant(uint64_t &v, Expr::Width &w) const {
+      if (width) {
+        if (isFloat)
+          return false;
+        v = bits;
+        w = width;
+        return true;
+      }
+      if (lanes || expr.isNull())
+        return false;
+      const ConstantExpr *ce = dyn_cast<ConstantExpr>(expr);
+      if (!ce || ce->getWidth() > Expr::Int64)
+        return false;
+      v = ce->getZExtValue();
+      w = ce->getWidth();
+      return true;
+    }
+
+    /// getFloatConstant - If the cell holds a single or double precision
+    /// floating point constant, immediate or not, return its bit pattern in
+    /// \a v and its width in \a w.
+    bool getFloatConstant(uint64_t &v, Expr::Width &w) const {
+      if (width) {
+        if (!isFloat)
+          return false;
+        v = bits;
+        w = width;
+        return true;
+      }
+      if (lanes || expr.isNull())
+        return false;
+      const FConstantExpr *ce = dyn_cast<FConstantExpr>(expr);
+      if (!ce || (ce->getWidth() != Expr::Fl32 && ce->getWidth() != Expr::Fl64))
+        return false;
+      v = ce->getAPValue().bitcastToAPInt().getZExtValue();
+      w = ce->getWidth();
+      return true;
+    }
   };
 }
 
@@ -10,9 +10,10 @@
 #ifndef KLEE_LIB_INSTRUCTIONINFOTABLE_H
 #define KLEE_LIB_INSTRUCTIONINFOTABLE_H
 
-#include <map>
+#include "llvm/ADT/DenseMap.h"
+#include "llvm/ADT/StringMap.h"
+
 #include <string>
-#include <set>
 
 namespace llvm {
   class Function;
@@ -42,28 +43,42 @@ namespace klee {
   };
 
   class InstructionInfoTable {
-    struct ltstr { 
-      bool operator()(const std::string *a, const std::string *b) const {
-        return *a<*b;
-      }
-    };
-
     std::string dummyString;
     InstructionInfo dummyInfo;
-    std::map<const llvm::Instruction*, InstructionInfo> infos;
-    std::set<const std::string *, ltstr> internedStrings;
+    /// The information of each instruction, indexed by its id, which
+    /// numbers the instructions of the module in order.
+    InstructionInfo *infos;
+    unsigned numInfos;
+    llvm::DenseMap<const llvm::Instruction*, unsigned> ids;
+    /// The file names, each stored once.
+    llvm::StringMap<std::string*> internedStrings;
 
   private:
-    const std::string *internString(std::string s);
+    InstructionInfoTable();
+    const std::string *internString(const std::string &s);
     bool getInstructionDebugInfo(const llvm::Instruction *I,
                                  const std::string *&File, unsigned &Line);
+    /// Allocate the table for the instructions of \a m and number them.
+    void allocate(llvm::Module *m);
 
   public:
-    InstructionInfoTable(llvm::Module *m);
+    /// Build the table from the debug information of \a m. Assembly lines
+    /// are only computed if \a assembly is given, which receives the
+    /// assembly of the module they refer to; otherwise they are 0.
+    InstructionInfoTable(llvm::Module *m, std::string *assembly = 0);
     ~InstructionInfoTable();
 
+    /// Write the table to \a path, for load. Returns false on failure.
+    bool save(const std::string &path) const;
+    /// Read the table saved for \a m at \a path, or return null if there is
+    /// none or it does not match the module.
+    static InstructionInfoTable *load(llvm::Module *m,
+                                      const std::string &path);
+
     unsigned getMaxID() const;
     const InstructionInfo &getInfo(const llvm::Instruction*) const;
+    /// The information of the instruction numbered \a id.
+    const InstructionInfo &getInfo(unsigned id) const;
     const InstructionInfo &getFunctionInfo(const llvm::Function*) const;
   };
 
@@ -19,6 +19,7 @@
 #include <vector>
 
 namespace llvm {
+  class Function;
   class Instruction;
 }
 
@@ -42,6 +43,15 @@ namespace klee {
     /// Destination register index.
     unsigned dest;
 
+    /// The opcode of the instruction, and the predicate of a comparison,
+    /// decoded once so that executing it need not look at inst.
+    unsigned opcode;
+    unsigned predicate;
+    /// The width of the result in bits, or 0 if it is not sized.
+    unsigned width;
+    /// Whether the result is a vector.
+    bool isVector;
+
   public:
     virtual ~KInstruction();
     void printFileLine(llvm::raw_ostream &);
@@ -59,6 +69,71 @@ namespace klee {
     /// instruction.
     uint64_t offset;
   };
+
+  struct KCallInstruction : KInstruction {
+    /// staticTarget - The function called, through bitcasts and aliases, or
+    /// null if the call is indirect. A state may still redirect it with
+    /// klee_alias_function.
+    llvm::Function *staticTarget;
+
+    /// specialHandler - The SpecialFunctionHandler handler of staticTarget,
+    /// or -1 if it has none.
+    int specialHandler;
+
+    KCallInstruction() : staticTarget(0), specialHandler(-1) {}
+  };
+
+  struct KBranchInstruction : KInstruction {
+    /// exitSuccessor - If the branch is the only exit of a loop the executor
+    /// can summarize (see -loop-summary-bound), the index of the successor
+    /// leaving the loop, otherwise -1. Such a loop is a chain of blocks
+    /// from the other successor back to the branch, which neither writes
+    /// memory nor calls functions, and the branch compares a value computed
+    /// in the loop with one computed before it.
+    int exitSuccessor;
+
+    /// liveOuts - The registers of the values computed in the loop which
+    /// are used after it.
+    std::vector<unsigned> liveOuts;
+
+    KBranchInstruction() : exitSuccessor(-1) {}
+  };
+
+  struct KSwitchInstruction : KInstruction {
+    /// hasCaseTable - Whether the case values, of up to 64 bits, are in one
+    /// of the tables below, to look up concrete conditions in constant time.
+    bool hasCaseTable;
+
+    /// jumpTable - The successor index of the values from jumpBase on, if
+    /// the case values are dense.
+    uint64_t jumpBase;
+    std::vector<unsigned> jumpTable;
+
+    /// hashTable - Otherwise, the case values and their successor indices,
+    /// open addressed with linear probing. Empty slots have successor 0.
+    std::vector< std::pair<uint64_t, unsigned> > hashTable;
+
+    static unsigned hash(uint64_t value, size_t size) {
+      return (unsigned) ((value * 0x9E3779B97F4A7C15ULL) >> 32) & (size - 1);
+    }
+
+    /// getSuccessorIndex - The index of the successor the switch takes for
+    /// the condition \a value: that of its case, or 0 for the default.
+    unsigned getSuccessorIndex(uint64_t value) const {
+      if (!jumpTable.empty()) {
+        uint64_t index = value - jumpBase;
+        return index < jumpTable.size() ? jumpTable[index] : 0;
+      }
+      if (hashTable.empty())
+        return 0;
+      size_t mask = hashTable.size() - 1;
+      for (size_t slot = hash(value, hashTable.size()); hashTable[slot].second;
+           slot = (slot + 1) & mask)
+        if (hashTable[slot].first == value)
+          return hashTable[slot].second;
+      return 0;
+    }
+  };
 }
 
 #endif
@@ -17,6 +17,8 @@
 #include <set>
 #include <vector>
 
+#include <stdint.h>
+
 namespace llvm {
   class BasicBlock;
   class Constant;
@@ -40,6 +42,23 @@ namespace klee {
   class KModule;
   template<class T> class ref;
 
+  /// FunctionCost - The interpreter time, solver time and states spawned
+  /// charged to a function (see -write-function-costs), or a budget of
+  /// them (see -function-budget), in which 0 is no limit.
+  struct FunctionCost {
+    double time, solverTime;
+    uint64_t states;
+
+    FunctionCost() : time(0), solverTime(0), states(0) {}
+
+    /// exceeds - Whether one of the limits of \a budget is exceeded.
+    bool exceeds(const FunctionCost &budget) const {
+      return (budget.time && time > budget.time) ||
+             (budget.solverTime && solverTime > budget.solverTime) ||
+             (budget.states && states > budget.states);
+    }
+  };
+
   struct KFunction {
     llvm::Function *function;
 
@@ -54,6 +73,10 @@ namespace klee {
     /// "coverable" for statistics and search heuristics.
     bool trackCoverage;
 
+    /// The cost of the instructions of this function, and for a function
+    /// with a budget, of the ones it calls as well, and that budget.
+    FunctionCost cost, budget;
+
   private:
     KFunction(const KFunction&);
     KFunction &operator=(const KFunction&);
@@ -117,6 +140,10 @@ namespace klee {
     // Mark function with functionName as part of the KLEE runtime
     void addInternalFunction(const char* functionName);
 
+    /// Instrument, optimize and link the module, and lower it to what the
+    /// interpreter executes.
+    void transform(const Interpreter::ModuleOptions &opts);
+
   public:
     KModule(llvm::Module *_module);
     ~KModule();
@@ -0,0 +1,167 @@
+//===-- BinaryQueryLog.h ----------------------------------------*- C++ -*-===//
+//
+//                     The KLEE Symbolic Virtual Machine
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+
+#ifndef KLEE_BINARYQUERYLOG_H
+#define KLEE_BINARYQUERYLOG_H
+
+#include "klee/Expr.h"
+#include "klee/util/ExprHashMap.h"
+
+#include <map>
+#include <string>
+#include <vector>
+
+#include <stdint.h>
+#include <stdio.h>
+
+namespace llvm {
+  class raw_ostream;
+}
+
+namespace klee {
+  class ArrayCache;
+  struct Query;
+
+  /// The binary query log, written by -use-query-log=all:binary or
+  /// solver:binary and replayed by kleaver -replay-binary.
+  ///
+  /// All integers are little endian. The file starts with the magic "KQLB"
+  /// and a u32 format version, followed by records, each starting with a tag
+  /// byte:
+  ///
+  ///   'Q' u8 type, u64 instructions, nodes, 'X',
+  ///       u32 n, n * u32 constraint, u32 expr, u32 m, m * u32 object
+  ///   'R' u8 success, u64 elapsed, u8 answer
+  ///
+  /// A query is followed by its result, unless the logging process died
+  /// while solving it. Elapsed times are in microseconds; the answer is the
+  /// validity, truth or solvability of the query (Answer), or NoAnswer.
+  ///
+  /// The nodes of a query keep its sharing: every distinct array, update
+  /// and expression is written once, after everything it refers to, and
+  /// referred to by its index among the nodes of its kind in the query:
+  ///
+  ///   'A' u32 length, name, u32 size, u32 domain, u32 range,
+  ///       u32 n, n * APInt constant value
+  ///   'U' u32 array, u32 next update (~0 for none), u32 index, u32 value
+  ///   'E' u8 kind, u32 width, u8 n, n * u32 kid, followed by an APInt for
+  ///       Constant (its value) and FConstant (its bit pattern),
+  ///       u32 array, u32 update (~0 for none) for Read, u32 offset for
+  ///       Extract and u8 rounding mode for rounding expressions.
+  ///
+  /// An APInt is a u32 width and its u64 words, least significant first.
+  namespace binlog {
+    static const uint32_t Version = 1;
+
+    enum QueryType {
+      Truth = 1,
+      Validity,
+      Value,
+      InitialValues
+    };
+
+    enum Answer {
+      False = 0,
+      True = 1,
+      Unknown = 2,
+      NoAnswer = 0xFF
+    };
+
+    const char *getQueryTypeName(QueryType type);
+  }
+
+  /// BinaryQueryWriter - Serializes queries in the binary query log format.
+  class BinaryQueryWriter {
+    llvm::raw_ostream &os;
+    ExprHashMap<uint32_t> exprIds;
+    std::map<const Array*, uint32_t> arrayIds;
+    std::map<const UpdateNode*, uint32_t> updateIds;
+
+    void write8(uint8_t v);
+    void write32(uint32_t v);
+    void write64(uint64_t v);
+    void writeAPInt(const llvm::APInt &v);
+
+    uint32_t writeArray(const Array *array);
+    uint32_t writeUpdates(const UpdateList &updates);
+    uint32_t writeExpr(const ref<Expr> &e);
+
+  public:
+    explicit BinaryQueryWriter(llvm::raw_ostream &_os) : os(_os) {}
+
+    void writeHeader();
+
+    /// writeQuery - Write a query of the given type, asking for the values
+    /// of \a objects, if any.
+    void writeQuery(binlog::QueryType type, uint64_t instructions,
+                    const Query &query,
+                    const std::vector<const Array*> *objects = 0);
+
+    void writeResult(bool success, uint64_t elapsed, binlog::Answer answer);
+  };
+
+  /// BinaryQuery - A query read back from a binary query log.
+  struct BinaryQuery {
+    binlog::QueryType type;
+    uint64_t instructions;
+    std::vector< ref<Expr> > constraints;
+    ref<Expr> expr;
+    std::vector<const Array*> objects;
+
+    /// The logged result, if there is one.
+    bool hasResult;
+    bool success;
+    uint64_t elapsed;
+    binlog::Answer answer;
+  };
+
+  /// BinaryQueryReader - Streams the queries of a binary query log, one at
+  /// a time, without keeping earlier queries. Logs compressed with
+  /// -compress-query-log are read as well when klee is built with zlib.
+  class BinaryQueryReader {
+    struct Stream;
+    Stream *stream;
+    ArrayCache &arrayCache;
+    std::string error;
+    int pendingTag;
+
+    bool read(void *buf, size_t n);
+    bool read8(uint8_t &v);
+    bool read32(uint32_t &v);
+    bool read64(uint64_t &v);
+    bool readAPInt(llvm::APInt &v);
+    bool fail(const std::string &message);
+    bool readHeader();
+    int nextTag();
+
+  public:
+    /// Arrays are created in \a arrayCache, which must outlive the queries.
+    explicit BinaryQueryReader(ArrayCache &arrayCache);
+    ~BinaryQueryReader();
+
+    /// open - Open the log at \a path ("-" for standard input) and check its
+    /// header.
+    bool open(const std::string &path);
+
+    /// open - Read the log from \a file, which is left open. Unlike logs
+    /// opened by path, it is not decompressed, and it is only read as far as
+    /// the queries returned, so that it may be a pipe or socket another
+    /// process writes queries to.
+    bool open(FILE *file);
+
+    /// readQuery - Read the next query and its result. Returns false at the
+    /// end of the log or if it is corrupt, which getError tells apart.
+    bool readQuery(BinaryQuery &query);
+
+    /// getError - The reason reading failed, or empty at the end of the log.
+    const std::string &getError() const { return error; }
+  };
+}
+
+#endif
@@ -15,6 +15,41 @@
 namespace klee {
   namespace util {
     size_t GetTotalMallocUsage();
+
+    /// The parts of klee whose allocators count the bytes they have in use,
+    /// so that their memory can be watched without asking malloc, which is
+    /// slow on fragmented heaps.
+    enum MemoryCategory {
+      ExprMemory,        ///< Expression nodes.
+      ObjectStateMemory, ///< Memory objects, object states and contents.
+      SolverCacheMemory, ///< Query cache entries and the assignments kept
+                         ///< by the counterexample cache.
+      NumMemoryCategories
+    };
+
+    inline size_t *GetMemoryCounters() {
+      static size_t counters[NumMemoryCategories];
+      return counters;
+    }
+
+    inline void CountMemory(MemoryCategory category, size_t bytes) {
+      GetMemoryCounters()[category] += bytes;
+    }
+    inline void UncountMemory(MemoryCategory category, size_t bytes) {
+      GetMemoryCounters()[category] -= bytes;
+    }
+
+    inline size_t GetCountedMemoryUsage(MemoryCategory category) {
+      return GetMemoryCounters()[category];
+    }
+    inline size_t GetCountedMemoryUsage() {
+      size_t total = 0;
+      for (unsigned i = 0; i != NumMemoryCategories; ++i)
+        total += GetMemoryCounters()[i];
+      return total;
+    }
+
+    const char *GetMemoryCategoryName(MemoryCategory category);
   }
 }
 
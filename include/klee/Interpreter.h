@@ -27,7 +27,6 @@ class raw_fd_ostream;
 namespace klee {
 class ExecutionState;
 class Interpreter;
-class TreeStreamWriter;
 
 class InterpreterHandler {
 public:
@@ -44,6 +43,10 @@ public:
   virtual void processTestCase(const ExecutionState &state,
                                const char *err, 
                                const char *suffix) = 0;
+
+  /// setWorker - Called in each process when exploration is split between
+  /// \a count parallel worker processes; \a index identifies this one.
+  virtual void setWorker(unsigned index, unsigned count) {}
 };
 
 class Interpreter {
@@ -79,8 +82,13 @@ public:
     /// symbolic execution on concrete programs.
     unsigned MakeConcreteSymbolic;
 
+    /// Record the instructions and branch directions of each path, for
+    /// getPathCoverage.
+    bool TrackPathCoverage;
+
     InterpreterOptions()
-      : MakeConcreteSymbolic(false)
+      : MakeConcreteSymbolic(false),
+        TrackPathCoverage(false)
     {}
   };
 
@@ -106,14 +114,6 @@ public:
   setModule(llvm::Module *module, 
             const ModuleOptions &opts) = 0;
 
-  // supply a tree stream writer which the interpreter will use
-  // to record the concrete path (as a stream of '0' and '1' bytes).
-  virtual void setPathWriter(TreeStreamWriter *tsw) = 0;
-
-  // supply a tree stream writer which the interpreter will use
-  // to record the symbolic path (as a stream of '0' and '1' bytes).
-  virtual void setSymbolicPathWriter(TreeStreamWriter *tsw) = 0;
-
   // supply a test case to replay from. this can be used to drive the
   // interpretation down a user specified path. use null to reset.
   virtual void setReplayKTest(const struct KTest *out) = 0;
@@ -123,6 +123,11 @@ public:
   // a user specified path. use null to reset.
   virtual void setReplayPath(const std::vector<bool> *path) = 0;
 
+  // supply the paths of the states left by an earlier run (see
+  // -checkpoint-interval), which are recreated by replaying them instead
+  // of starting from scratch. use null to reset.
+  virtual void setResumePaths(const std::vector<std::vector<bool> > *paths) = 0;
+
   // supply a set of symbolic bindings that will be used as "seeds"
   // for the search. use null to reset.
   virtual void useSeeds(const std::vector<struct KTest *> *seeds) = 0;
@@ -140,9 +145,13 @@ public:
 
   /*** State accessor methods ***/
 
-  virtual unsigned getPathStreamID(const ExecutionState &state) = 0;
+  // the branches taken to reach the state, as a stream of '0' and '1'
+  // bytes: all of them, or only the symbolic ones.
+  virtual void getPath(const ExecutionState &state,
+                       std::vector<unsigned char> &res) = 0;
 
-  virtual unsigned getSymbolicPathStreamID(const ExecutionState &state) = 0;
+  virtual void getSymbolicPath(const ExecutionState &state,
+                               std::vector<unsigned char> &res) = 0;
   
   virtual void getConstraintLog(const ExecutionState &state,
                                 std::string &res,
@@ -156,6 +165,12 @@ public:
 
   virtual void getCoveredLines(const ExecutionState &state,
                                std::map<const std::string*, std::set<unsigned> > &res) = 0;
+
+  /// getPathCoverage - The coverage items of the path of \a state, in
+  /// increasing order, with TrackPathCoverage: the instructions it executed
+  /// and the directions it took at conditional branches.
+  virtual void getPathCoverage(const ExecutionState &state,
+                               std::vector<unsigned> &items) = 0;
 };
 
 } // End klee namespace
@@ -13,11 +13,13 @@
 #include "klee/CommandLine.h" // FIXME: This is just for CoreSolverType
 #include "klee/Expr.h"
 
+#include <string>
 #include <vector>
 
 namespace klee {
   class ConstraintManager;
   class Expr;
+  class IncompleteSolver;
   class SolverImpl;
 
   struct Query {
@@ -160,6 +162,31 @@ namespace klee {
     /// \return True on success.
     bool mayBeFalse(const Query&, bool &result);
 
+    /// mustBeTrueMany - Determine for each of a number of expressions whether
+    /// it is provably true given the same constraints. This is equivalent to
+    /// calling mustBeTrue for each expression, but lets the solver share the
+    /// work on the constraints between them.
+    ///
+    /// \param [out] result - On success, result[i] is true iff exprs[i] is
+    /// provably true.
+    ///
+    /// \return True on success.
+    bool mustBeTrueMany(const ConstraintManager &constraints,
+                        const std::vector< ref<Expr> > &exprs,
+                        std::vector<bool> &result);
+
+    /// mayBeTrueMany - Determine for each of a number of expressions whether
+    /// it may be true given the same constraints, as mustBeTrueMany does for
+    /// mustBeTrue.
+    ///
+    /// \param [out] result - On success, result[i] is true iff there is a
+    /// satisfying assignment in which exprs[i] is true.
+    ///
+    /// \return True on success.
+    bool mayBeTrueMany(const ConstraintManager &constraints,
+                       const std::vector< ref<Expr> > &exprs,
+                       std::vector<bool> &result);
+
     /// getValue - Compute one possible value for the given expression.
     ///
     /// \param [out] result - On success, a value for the expression in some
@@ -187,8 +214,20 @@ namespace klee {
                           const std::vector<const Array*> &objects,
                           std::vector< std::vector<unsigned char> > &result);
 
+    /// computeRange - Compute the range getRange returns with a single
+    /// request to the solver, if it supports it (see
+    /// SolverImpl::computeRange).
+    ///
+    /// \return False if the solver does not support it, or failed.
+    bool computeRange(const Query&, ref<Expr> &min, ref<Expr> &max);
+
     /// getRange - Compute a tight range of possible values for a given
-    /// expression.
+    /// expression. Floating point expressions get the range of their
+    /// values other than NaN, -0 counting as just below +0, unless all
+    /// their values are NaNs.
+    ///
+    /// The range is computed by computeRange where the solver supports it,
+    /// and otherwise searched for with a series of queries.
     ///
     /// \return - A pair with (min, max) values for the expression.
     ///
@@ -198,9 +237,41 @@ namespace klee {
     //
     // FIXME: This should go into a helper class, and should handle failure.
     virtual std::pair< ref<Expr>, ref<Expr> > getRange(const Query&);
+
+    /// computeUniqueValue - Compute the answer of getUniqueValue with a
+    /// single request to the solver, if it supports it (see
+    /// SolverImpl::computeUniqueValue).
+    ///
+    /// \return False if the solver does not support it, or failed.
+    bool computeUniqueValue(const Query&, ref<Expr> &result, bool &isUnique);
+
+    /// getUniqueValue - Compute a possible value for the given expression,
+    /// and whether it is the only possible one. Floating point values are
+    /// told apart by their bits, except that all NaNs are the same value
+    /// (see createIsValue).
+    ///
+    /// The answer comes from computeUniqueValue where the solver supports
+    /// it, and otherwise from getValue followed by mustBeTrue.
+    ///
+    /// \return True on success.
+    bool getUniqueValue(const Query&, ref<Expr> &result, bool &isUnique);
     
     virtual char *getConstraintLog(const Query& query);
     virtual void setCoreSolverTimeout(double timeout);
+
+    /// trimCaches - Free about \a bytes of cached results, which can be
+    /// computed again, because memory is short.
+    ///
+    /// \return The bytes freed, as far as they are known.
+    size_t trimCaches(size_t bytes);
+
+    /// releaseArrays - Drop everything kept by \a arrays, which are about
+    /// to be freed.
+    void releaseArrays(const std::vector<const Array *> &arrays);
+
+    /// interrupt - Make the running query fail as soon as possible. Safe to
+    /// call from another thread (see SolverImpl::interrupt).
+    void interrupt();
   };
 
 #ifdef ENABLE_STP
@@ -230,7 +301,11 @@ namespace klee {
   class Z3Solver : public Solver {
   public:
     /// Z3Solver - Construct a new Z3Solver.
-    Z3Solver();
+    ///
+    /// \param useForkedZ3 - Whether Z3 should be run in a separate process,
+    /// so that crashes, timeouts it ignores and runaway memory use do not
+    /// take klee down with it.
+    Z3Solver(bool useForkedZ3 = false);
 
     /// Get the query in SMT-LIBv2 format.
     /// \return A C-style string. The caller is responsible for freeing this.
@@ -240,9 +315,45 @@ namespace klee {
     /// value; 0
     /// is off.
     virtual void setCoreSolverTimeout(double timeout);
+
+    /// getInitialValuesMany - Compute the initial values of \a objects[i]
+    /// for each independent query \a queries[i]. The queries are spread
+    /// over a pool of Z3 contexts (see -z3-context-pool-size), which run in
+    /// parallel when reference counts are atomic.
+    ///
+    /// \param [out] hasSolution - On success, whether each query had a
+    /// solution; \a values[i] is only meaningful if it had.
+    /// \return True on success, false if any query failed.
+    bool getInitialValuesMany(
+        const std::vector<Query> &queries,
+        const std::vector<std::vector<const Array *> > &objects,
+        std::vector<std::vector<std::vector<unsigned char> > > &values,
+        std::vector<bool> &hasSolution);
   };
 #endif // ENABLE_Z3
 
+#ifdef ENABLE_BITWUZLA
+  /// BitwuzlaSolver - A complete solver based on Bitwuzla, which reasons
+  /// about floating point in its own theory of floating point. Only single
+  /// and double precision are supported; queries with other formats fail.
+  class BitwuzlaSolver : public Solver {
+  public:
+    /// BitwuzlaSolver - Construct a new BitwuzlaSolver. Bitwuzla always
+    /// runs in process; its timeout is enforced through a termination
+    /// callback.
+    BitwuzlaSolver();
+
+    /// Get the query in SMT-LIBv2 format.
+    /// \return A C-style string. The caller is responsible for freeing this.
+    virtual char *getConstraintLog(const Query &);
+
+    /// setCoreSolverTimeout - Set constraint solver timeout delay to the given
+    /// value; 0
+    /// is off.
+    virtual void setCoreSolverTimeout(double timeout);
+  };
+#endif // ENABLE_BITWUZLA
+
 #ifdef ENABLE_METASMT
   
   template<typename SolverContext>
@@ -268,6 +379,12 @@ namespace klee {
   /// \param oracle - The solver to check query results against.
   Solver *createValidatingSolver(Solver *s, Solver *oracle);
 
+  /// createProfilingSolver - Create a solver which counts and times the
+  /// queries asked of \a s, and the answers it gives, in a profile named
+  /// \a layer (see getSolverLayerProfiles). Time spent in another profiling
+  /// solver below \a s is not charged to \a layer.
+  Solver *createProfilingSolver(Solver *s, const char *layer);
+
   /// createCachingSolver - Create a solver which will cache the queries in
   /// memory (without eviction).
   ///
@@ -282,6 +399,28 @@ namespace klee {
   /// \param s - The underlying solver to use.
   Solver *createCexCachingSolver(Solver *s);
 
+  /// createPersistentCachingSolver - Create a solver which caches query
+  /// results, including counterexamples, in a file so that they are reused by
+  /// later runs. The file may be shared by concurrent processes and is only
+  /// read when queries arrive.
+  ///
+  /// \param s - The underlying solver to use.
+  /// \param path - The cache file, created if it does not exist.
+  Solver *createPersistentCachingSolver(Solver *s, const std::string &path);
+
+  /// createSharedMemoryCachingSolver - Create a solver which caches query
+  /// results, including counterexamples, in a table of bounded size mapped
+  /// by all the processes using the same file, which see each other's
+  /// results at once. The least recently hit results are evicted once it
+  /// is full.
+  ///
+  /// \param s - The underlying solver to use.
+  /// \param path - The table file, best in memory such as under /dev/shm,
+  /// created if it does not exist.
+  /// \param size - The size in bytes of a table created.
+  Solver *createSharedMemoryCachingSolver(Solver *s, const std::string &path,
+                                          uint64_t size);
+
   /// createFastCexSolver - Create a "fast counterexample solver", which tries
   /// to quickly compute a satisfying assignment for a constraint set using
   /// value propogation and range analysis.
@@ -289,12 +428,53 @@ namespace klee {
   /// \param s - The underlying solver to use.
   Solver *createFastCexSolver(Solver *s);
 
+  /// createFloatTriageSolver - Create a solver which answers the
+  /// floating-point queries that follow from what the constraints say of
+  /// NaN-ness and ranges alone, before propogating the rest to the
+  /// underlying solver.
+  ///
+  /// \param s - The underlying solver to use.
+  Solver *createFloatTriageSolver(Solver *s);
+
+  /// createFloatSearchSolver - Create a solver which looks for models of
+  /// floating-point queries by local search over the float inputs, before
+  /// propogating the queries it finds none for to the underlying solver.
+  ///
+  /// \param s - The underlying solver to use.
+  Solver *createFloatSearchSolver(Solver *s);
+
+  /// createStagedSolver - Create a solver which tries the incomplete
+  /// solvers \a stages in order, skipping those which seldom answer, before
+  /// propogating the query to the underlying solver. The solver takes
+  /// ownership of the stages.
+  ///
+  /// \param stages - The incomplete solvers, e.g. createFastCexStage().
+  /// \param s - The underlying solver to use.
+  Solver *createStagedSolver(const std::vector<IncompleteSolver *> &stages,
+                             Solver *s);
+
   /// createIndependentSolver - Create a solver which will eliminate any
   /// unnecessary constraints before propogating the query to the underlying
   /// solver.
   ///
   /// \param s - The underlying solver to use.
   Solver *createIndependentSolver(Solver *s);
+
+  /// createCanonicalizingSolver - Create a solver which renames the symbolic
+  /// arrays of each query to canonical ones, in the order the query reads
+  /// them, before propogating it to the underlying solver, so that the
+  /// caches below see queries which only differ in array names as one.
+  ///
+  /// \param s - The underlying solver to use.
+  Solver *createCanonicalizingSolver(Solver *s);
+
+  /// createFloatSimplifyingSolver - Create a solver which rewrites
+  /// floating-point expressions using exact IEEE-754 identities (e.g. x * 1.0,
+  /// x - x for finite x, comparisons of exactly converted integers) before
+  /// propogating the query to the underlying solver.
+  ///
+  /// \param s - The underlying solver to use.
+  Solver *createFloatSimplifyingSolver(Solver *s);
   
   /// createKQueryLoggingSolver - Create a solver which will forward all queries
   /// after writing them to the given path in .kquery format.
@@ -306,13 +486,31 @@ namespace klee {
   Solver *createSMTLIBLoggingSolver(Solver *s, std::string path,
                                     int minQueryTimeToLog);
 
+  /// createBinaryQueryLoggingSolver - Create a solver which will forward all
+  /// queries after writing them and their results to the given path in the
+  /// binary query log format.
+  Solver *createBinaryQueryLoggingSolver(Solver *s, std::string path,
+                                         int minQueryTimeToLog);
+
 
   /// createDummySolver - Create a dummy solver implementation which always
   /// fails.
   Solver *createDummySolver();
 
+  /// createPortfolioSolver - Create a solver which races the given solvers on
+  /// every query, each in a forked process, and takes the first answer. The
+  /// remaining runs are killed. The solvers should not fork themselves.
+  ///
+  /// \param solvers - The solvers to race; the portfolio takes ownership.
+  /// \param names - A name for each solver, used to report which one won.
+  Solver *createPortfolioSolver(const std::vector<Solver *> &solvers,
+                                const std::vector<std::string> &names);
+
   // Create a solver based on the supplied ``CoreSolverType``.
   Solver *createCoreSolver(CoreSolverType cst);
+
+  // The name of a ``CoreSolverType`` as given on the command line.
+  const char *getCoreSolverName(CoreSolverType cst);
 }
 
 #endif
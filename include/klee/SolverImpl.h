@@ -10,10 +10,12 @@
 #ifndef KLEE_SOLVERIMPL_H
 #define KLEE_SOLVERIMPL_H
 
+#include <cstddef>
 #include <vector>
 
 namespace klee {
   class Array;
+  class ConstraintManager;
   class ExecutionState;
   class Expr;
   struct Query;
@@ -76,6 +78,22 @@ namespace klee {
     /// \return True on success
     virtual bool computeTruth(const Query& query, bool &isValid) = 0;
 
+    /// computeTruthMany - Determine for each of the given expressions whether
+    /// it is provably true given the same constraints, as computeTruth would.
+    ///
+    /// The expressions are guaranteed to be non-constant and have bool type.
+    ///
+    /// SolverImpl provides a default implementation which calls computeTruth
+    /// once per expression. Solvers which can share work between queries
+    /// over the same constraints should override this.
+    ///
+    /// \param [out] isValid - On success, isValid[i] is the truth of
+    /// exprs[i].
+    /// \return True on success
+    virtual bool computeTruthMany(const ConstraintManager &constraints,
+                                  const std::vector< ref<Expr> > &exprs,
+                                  std::vector<bool> &isValid);
+
     /// computeValue - Compute a feasible value for the expression.
     ///
     /// The query expression is guaranteed to be non-constant.
@@ -91,6 +109,40 @@ namespace klee {
                                         &values,
                                       bool &hasSolution) = 0;
     
+    /// computeRange - Compute the smallest and the largest value of the
+    /// query expression given the constraints, as Solver::getRange does.
+    ///
+    /// The query expression is guaranteed to be non-constant and wider
+    /// than a bit.
+    ///
+    /// SolverImpl provides a default implementation which returns false, in
+    /// which case Solver::getRange searches for the bounds with a series of
+    /// queries. Solvers which can optimize should override this, and
+    /// solvers wrapping others forward it.
+    ///
+    /// \return True on success
+    virtual bool computeRange(const Query& query, ref<Expr> &min,
+                              ref<Expr> &max) {
+      return false;
+    }
+
+    /// computeUniqueValue - Compute a value of the query expression given
+    /// the constraints, and whether it is the only one, as
+    /// Solver::getUniqueValue does.
+    ///
+    /// The query expression is guaranteed to be non-constant.
+    ///
+    /// SolverImpl provides a default implementation which returns false, in
+    /// which case Solver::getUniqueValue asks for a value and then whether
+    /// the expression must have it. Solvers which can answer both at once
+    /// should override this, and solvers wrapping others forward it.
+    ///
+    /// \return True on success
+    virtual bool computeUniqueValue(const Query& query, ref<Expr> &result,
+                                    bool &isUnique) {
+      return false;
+    }
+
     /// getOperationStatusCode - get the status of the last solver operation
     virtual SolverRunStatus getOperationStatusCode() = 0;
 
@@ -104,6 +156,27 @@ namespace klee {
     }
 
     virtual void setCoreSolverTimeout(double timeout) {};
+
+    /// trimCaches - Free about \a bytes held by the caches of this solver
+    /// and of the solvers it wraps, least recently used first, because
+    /// memory is short.
+    ///
+    /// \return The bytes freed, as far as they are known.
+    virtual size_t trimCaches(size_t bytes) { return 0; }
+
+    /// releaseArrays - Drop everything this solver and the solvers it wraps
+    /// keep by \a arrays, which no expression reads any more and which are
+    /// about to be freed. Solvers which key state by the arrays themselves
+    /// must do so, as a new array can take the place of a freed one.
+    virtual void releaseArrays(const std::vector<const Array *> &arrays) {}
+
+    /// interrupt - Make the query this solver, or a solver it wraps, is
+    /// running fail as soon as possible. Queries starting afterwards are
+    /// not affected, and neither is anything if no query is running.
+    ///
+    /// This may be called from another thread than the one running the
+    /// query, but not from a signal handler.
+    virtual void interrupt() {}
 };
 
 }
@@ -0,0 +1,61 @@
+//===-- SolverProfile.h -----------------------------------------*- C++ -*-===//
+//
+//                     The KLEE Symbolic Virtual Machine
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+
+#ifndef KLEE_SOLVERPROFILE_H
+#define KLEE_SOLVERPROFILE_H
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+namespace klee {
+
+  /// SolverLayerProfile - What one layer of the solver chain did with the
+  /// queries it was asked, gathered by a profiling solver wrapped around it
+  /// (see createProfilingSolver).
+  struct SolverLayerProfile {
+    enum QueryKind { Validity, Truth, Value, InitialValues, NumQueryKinds };
+    enum Answer { Yes, No, Unknown, Failed, NumAnswers };
+
+    struct Counts {
+      /// The queries asked of the layer.
+      uint64_t calls;
+      /// The queries the layer passed on to the layers below it.
+      uint64_t passed;
+      /// The time spent in the layer itself, in seconds, not counting the
+      /// time spent in the layers below it.
+      double selfTime;
+      /// The answers given, by kind. Validity maps True, False and Unknown
+      /// to Yes, No and Unknown; truth and initial values map valid and
+      /// satisfiable to Yes; values are Yes, unless a unique value was
+      /// asked for and there is none.
+      uint64_t answers[NumAnswers];
+
+      Counts() : calls(0), passed(0), selfTime(0) {
+        for (unsigned i = 0; i != NumAnswers; ++i)
+          answers[i] = 0;
+      }
+    };
+
+    std::string layer;
+    Counts counts[NumQueryKinds];
+
+    explicit SolverLayerProfile(const std::string &_layer) : layer(_layer) {}
+
+    static const char *getQueryKindName(QueryKind kind);
+    static const char *getAnswerName(Answer answer);
+  };
+
+  /// getSolverLayerProfiles - The profiles of every profiled layer, from the
+  /// core solver outwards.
+  const std::vector<SolverLayerProfile *> &getSolverLayerProfiles();
+
+}
+
+#endif
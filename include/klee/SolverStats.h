@@ -23,10 +23,88 @@ namespace stats {
   extern Statistic queryCacheMisses;
   extern Statistic queryCexCacheHits;
   extern Statistic queryCexCacheMisses;
+  extern Statistic queryCacheEvictions;
+  extern Statistic queryCexCacheEvictions;
   extern Statistic queryConstructTime;
   extern Statistic queryConstructs;
+  extern Statistic queryConstructCacheHits;
+  extern Statistic queryConstructCacheMisses;
+  extern Statistic queryConstructCacheEvictions;
   extern Statistic queryCounterexamples;
+  extern Statistic queryPersistentCacheHits;
+  extern Statistic queryPersistentCacheMisses;
+  extern Statistic querySharedCacheHits;
+  extern Statistic querySharedCacheMisses;
   extern Statistic queryTime;
+
+  /// Number of constraints that were already asserted, or built, in an
+  /// incremental core solver and did not have to be again.
+  extern Statistic queryIncrementalPrefixHits;
+
+  /// Number of constraints that had to be (re-)asserted, or built, in an
+  /// incremental core solver.
+  extern Statistic queryIncrementalPrefixMisses;
+
+  /// Number of queries the Z3 solver answered from a recorded unsatisfiable
+  /// core, without calling Z3.
+  extern Statistic queryUnsatCoreHits;
+
+  /// Number of distinct unsatisfiable cores recorded by the Z3 solver.
+  extern Statistic queryUnsatCores;
+
+  /// Number of queries the Z3 solver classified as using only bit-vectors,
+  /// arrays at symbolic indices, floating point, or both of the latter, for
+  /// -z3-tactic-selection and -z3-model-hints.
+  extern Statistic queryShapeBitVector;
+  extern Statistic queryShapeArray;
+  extern Statistic queryShapeFloat;
+  extern Statistic queryShapeMixed;
+
+  /// Number of floating-point and mixed queries that Z3 did and did not
+  /// solve under the values of the last counterexample (-z3-model-hints),
+  /// and the time spent trying.
+  extern Statistic queryModelHintFloatHits;
+  extern Statistic queryModelHintFloatMisses;
+  extern Statistic queryModelHintMixedHits;
+  extern Statistic queryModelHintMixedMisses;
+  extern Statistic queryModelHintTime;
+
+  /// Number of floating-point rewrites by the float simplifying solver,
+  /// broken down by rule.
+  extern Statistic floatSimplifyIdentity;
+  extern Statistic floatSimplifyCancel;
+  extern Statistic floatSimplifyIntCompare;
+  extern Statistic floatSimplifyExtChain;
+  extern Statistic floatSimplifyClassify;
+  extern Statistic floatSimplifyNarrow;
+
+  /// Number of queries the incomplete stages of staged solvers answered,
+  /// failed to answer, and skipped as they seldom answer such queries.
+  extern Statistic stagedSolverStageHits;
+  extern Statistic stagedSolverStageMisses;
+  extern Statistic stagedSolverStageSkips;
+
+  /// Number of answers checked by -debug-validate-solver and
+  /// -debug-crosscheck-core-solver, and how many of them were wrong.
+  extern Statistic queryValidations;
+  extern Statistic queryValidationMismatches;
+
+  /// Number of queries the float triage solver looked at, and answered.
+  extern Statistic floatTriageQueries;
+  extern Statistic floatTriageDecided;
+
+  /// Number of queries the float search solver searched, and found a model
+  /// for.
+  extern Statistic floatSearchQueries;
+  extern Statistic floatSearchSolved;
+
+  /// Number of queries split into cubes after -z3-cube-threshold, and of
+  /// cubes solved for them.
+  extern Statistic queryCubeSplits;
+  extern Statistic queryCubes;
+
+  /// Number of times -z3-context-memory-budget replaced the Z3 context.
+  extern Statistic solverContextRecycles;
   
 #ifdef DEBUG
   extern Statistic arrayHashTime;
@@ -12,6 +12,8 @@
 
 #include "Statistic.h"
 
+#include "llvm/Support/Mutex.h"
+
 #include <vector>
 #include <string>
 #include <string.h>
@@ -37,35 +39,86 @@ namespace klee {
     StatisticRecord &operator +=(const StatisticRecord &sr);
   };
 
-  class StatisticManager {
-  private:
-    bool enabled;
-    std::vector<Statistic*> stats;
+  /// StatisticShard - The counters written by one thread. Only the owning
+  /// thread writes to a shard, so increments need no atomic operations;
+  /// readers sum over all shards.
+  struct StatisticShard {
     uint64_t *globalStats;
     uint64_t *indexedStats;
     StatisticRecord *contextStats;
     unsigned index;
 
+    StatisticShard()
+      : globalStats(0), indexedStats(0), contextStats(0), index(0) {}
+  };
+
+  class StatisticManager {
+  private:
+    bool enabled;
+    std::vector<Statistic*> stats;
+    unsigned totalIndices;
+    /// The shard of every thread that did not attach one of its own.
+    StatisticShard primary;
+    /// Shards of attached threads, which are kept (and reused) after their
+    /// threads detach so that their counts are not lost.
+    std::vector<StatisticShard*> shards;
+    std::vector<StatisticShard*> idleShards;
+    mutable llvm::sys::Mutex shardsLock;
+
+    static __thread StatisticShard *threadShard;
+
+    StatisticShard &getShard() {
+      return threadShard ? *threadShard : primary;
+    }
+    const StatisticShard &getShard() const {
+      return threadShard ? *threadShard : primary;
+    }
+    void allocateIndexedStats(StatisticShard &shard);
+
+    /// Counters are written only by the thread owning their shard, but read
+    /// by any thread; relaxed accesses make that defined while compiling to
+    /// plain loads and stores.
+    static uint64_t readCounter(const uint64_t &counter) {
+      return __atomic_load_n(&counter, __ATOMIC_RELAXED);
+    }
+    static void addToCounter(uint64_t &counter, uint64_t addend) {
+      __atomic_store_n(&counter, readCounter(counter) + addend,
+                       __ATOMIC_RELAXED);
+    }
+
   public:
     StatisticManager();
     ~StatisticManager();
 
     void useIndexedStats(unsigned totalIndices);
 
+    /// attachThread - Give the calling thread counters of its own, so that
+    /// it can update statistics concurrently with other threads. Until it
+    /// calls detachThread, its index and context are its own as well.
+    /// Threads should attach before others start reading statistics.
+    void attachThread();
+    void detachThread();
+
     StatisticRecord *getContext();
     void setContext(StatisticRecord *sr); /* null to reset */
 
-    void setIndex(unsigned i) { index = i; }
-    unsigned getIndex() { return index; }
+    void setIndex(unsigned i) { getShard().index = i; }
+    unsigned getIndex() { return getShard().index; }
     unsigned getNumStatistics() { return stats.size(); }
     Statistic &getStatistic(unsigned i) { return *stats[i]; }
     
     void registerStatistic(Statistic &s);
     void incrementStatistic(Statistic &s, uint64_t addend);
+    /// getValue - The value of \a s summed over all threads.
     uint64_t getValue(const Statistic &s) const;
     void incrementIndexedValue(const Statistic &s, unsigned index, 
-                               uint64_t addend) const;
+                               uint64_t addend);
+    /// getIndexedValue - The value of \a s at \a index summed over all
+    /// threads.
     uint64_t getIndexedValue(const Statistic &s, unsigned index) const;
+    /// setIndexedValue - Set the value of \a s at \a index, for statistics
+    /// which are computed rather than counted. Those are kept in the primary
+    /// shard only.
     void setIndexedValue(const Statistic &s, unsigned index, uint64_t value);
     int getStatisticID(const std::string &name) const;
     Statistic *getStatisticByName(const std::string &name) const;
@@ -76,20 +129,22 @@ namespace klee {
   inline void StatisticManager::incrementStatistic(Statistic &s, 
                                                    uint64_t addend) {
     if (enabled) {
-      globalStats[s.id] += addend;
-      if (indexedStats) {
-        indexedStats[index*stats.size() + s.id] += addend;
-        if (contextStats)
-          contextStats->data[s.id] += addend;
+      StatisticShard &shard = getShard();
+      addToCounter(shard.globalStats[s.id], addend);
+      if (shard.indexedStats) {
+        addToCounter(shard.indexedStats[shard.index*stats.size() + s.id],
+                     addend);
+        if (shard.contextStats)
+          shard.contextStats->data[s.id] += addend;
       }
     }
   }
 
   inline StatisticRecord *StatisticManager::getContext() {
-    return contextStats;
+    return getShard().contextStats;
   }
   inline void StatisticManager::setContext(StatisticRecord *sr) {
-    contextStats = sr;
+    getShard().contextStats = sr;
   }
 
   inline void StatisticRecord::zero() {
@@ -130,24 +185,34 @@ namespace klee {
   }
 
   inline uint64_t StatisticManager::getValue(const Statistic &s) const {
-    return globalStats[s.id];
+    uint64_t value = readCounter(primary.globalStats[s.id]);
+    llvm::sys::ScopedLock lock(shardsLock);
+    for (unsigned i = 0, e = shards.size(); i != e; ++i)
+      value += readCounter(shards[i]->globalStats[s.id]);
+    return value;
   }
 
   inline void StatisticManager::incrementIndexedValue(const Statistic &s, 
                                                       unsigned index,
-                                                      uint64_t addend) const {
-    indexedStats[index*stats.size() + s.id] += addend;
+                                                      uint64_t addend) {
+    addToCounter(getShard().indexedStats[index*stats.size() + s.id], addend);
   }
 
   inline uint64_t StatisticManager::getIndexedValue(const Statistic &s, 
                                                     unsigned index) const {
-    return indexedStats[index*stats.size() + s.id];
+    unsigned offset = index*stats.size() + s.id;
+    uint64_t value = readCounter(primary.indexedStats[offset]);
+    llvm::sys::ScopedLock lock(shardsLock);
+    for (unsigned i = 0, e = shards.size(); i != e; ++i)
+      value += readCounter(shards[i]->indexedStats[offset]);
+    return value;
   }
 
   inline void StatisticManager::setIndexedValue(const Statistic &s, 
                                                 unsigned index,
                                                 uint64_t value) {
-    indexedStats[index*stats.size() + s.id] = value;
+    __atomic_store_n(&primary.indexedStats[index*stats.size() + s.id], value,
+                     __ATOMIC_RELAXED);
   }
 }
 
@@ -36,6 +36,39 @@ extern "C" {
    */
   void klee_make_symbolic(void *addr, size_t nbytes, const char *name);
 
+  /* The kinds of floating-point values klee_make_symbolic_float makes. */
+  enum klee_float_kind {
+    KLEE_FLOAT = 32,
+    KLEE_DOUBLE = 64
+  };
+
+  /* The restrictions of the values klee_make_symbolic_float makes. */
+  enum klee_float_flags {
+    KLEE_FP_NO_NAN = 1, /* not a NaN */
+    KLEE_FP_NO_INF = 2, /* not an infinity */
+    KLEE_FP_NORMAL = 4, /* a normal number or zero, so neither a NaN, an
+                           infinity nor subnormal */
+    KLEE_FP_RANGE = 8   /* between lo and hi inclusive, so not a NaN */
+  };
+
+  /* klee_make_symbolic_float - Make the contents of the object pointed to by
+   * \arg addr symbolic floating-point values, restricted to a domain. The
+   * domain is a condition on the bits of each value, which the solvers
+   * handle as integers, rather than floating-point assumptions.
+   *
+   * \arg addr - The start of the object.
+   * \arg nbytes - The number of bytes to make symbolic, the entire contents
+   * of the object, a multiple of the size of a value.
+   * \arg name - An optional name, as for klee_make_symbolic.
+   * \arg kind - The kind of the values, KLEE_FLOAT or KLEE_DOUBLE.
+   * \arg flags - The klee_float_flags restricting the values.
+   * \arg lo, hi - The bounds of the values with KLEE_FP_RANGE, rounded
+   * inwards to single precision for KLEE_FLOAT.
+   */
+  void klee_make_symbolic_float(void *addr, size_t nbytes, const char *name,
+                                unsigned kind, unsigned flags, double lo,
+                                double hi);
+
   /* klee_range - Construct a symbolic value in the signed interval
    * [begin,end).
    *
@@ -113,6 +146,12 @@ extern "C" {
   void klee_posix_prefer_cex(void *object, uintptr_t condition);
   void klee_mark_global(void *object);
 
+  /* klee_mark_pure("foo") declares that foo() only reads and writes memory,
+     without calling functions KLEE models (see -pure-functions). Calls of
+     foo() with concrete arguments reading concrete memory are then
+     memoized, on all paths. */
+  void klee_mark_pure(const char *fn_name);
+
   /* Return a possible constant value for the input expression. This
      allows programs to forcibly concretize values on their own. */
 #define KLEE_GET_VALUE_PROTO(suffix, type)	type klee_get_value##suffix(type expr)
@@ -67,6 +67,22 @@ public:
                            Expr::Width _domain = Expr::Int32,
                            Expr::Width _range = Expr::Int8);
 
+  /// The number of distinct symbolic arrays created so far.
+  size_t getNumSymbolicArrays() const { return cachedSymbolicArrays.size(); }
+
+  /// Append the arrays which were referenced and no longer are (see
+  /// Array::isUnreferenced()) to \p arrays.
+  ///
+  /// Only the owner of every bare pointer to the arrays knows when none of
+  /// those is left, so arrays are never reclaimed behind its back: it finds
+  /// them here, drops whatever it keeps by them, and hands them to
+  /// reclaimArrays().
+  void getUnreferencedArrays(std::vector<const Array *> &arrays) const;
+
+  /// Delete \p arrays, found by getUnreferencedArrays(). A symbolic array
+  /// of the same name made afterwards is a new Array object.
+  void reclaimArrays(const std::vector<const Array *> &arrays);
+
 private:
   typedef unordered_set<const Array *, klee::ArrayHashFn,
                         klee::EquivArrayCmpFn> ArrayHashMap;
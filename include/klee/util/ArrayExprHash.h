@@ -15,6 +15,7 @@
 #include "klee/SolverStats.h"
 
 #include <map>
+#include <vector>
 
 #include <ciso646>
 #ifdef _LIBCPP_VERSION
@@ -55,7 +56,7 @@ template<class T>
 class ArrayExprHash {  
 public:
   
-  ArrayExprHash() {};
+  ArrayExprHash() : _num_arrays_hashed(0) {};
   // Note: Extend the class and overload the destructor if the objects of type T
   // that are to be hashed need to be explicitly destroyed
   // As an example, see class STPArrayExprHash
@@ -66,6 +67,15 @@ public:
   
   bool lookupUpdateNodeExpr(const UpdateNode* un, T& exp) const;
   void hashUpdateNodeExpr(const UpdateNode* un, T& exp);  
+
+  /// Drop the entries of \p arrays, which are about to be freed. Updates
+  /// are not hashed by their root, so those over the arrays cannot be told
+  /// from the others: the entries of all updates go with them.
+  virtual void releaseArrays(const std::vector<const Array *> &arrays);
+
+  /// The number of arrays hashed so far, counting those released, to make
+  /// unique names of.
+  unsigned getNumArraysHashed() const { return _num_arrays_hashed; }
   
 protected:
   typedef unordered_map<const Array*, T, ArrayHashFn, ArrayCmpFn> ArrayHash;
@@ -78,6 +88,7 @@ protected:
   
   ArrayHash      _array_hash;
   UpdateNodeHash _update_node_hash;  
+  unsigned       _num_arrays_hashed;
 };
 
 
@@ -106,7 +117,22 @@ void ArrayExprHash<T>::hashArrayExpr(const Array* array, T& exp) {
 #endif
    
    assert(array);
-  _array_hash[array] = exp;
+  std::pair<ArrayHashIter, bool> res =
+      _array_hash.insert(std::make_pair(array, exp));
+  if (res.second)
+    ++_num_arrays_hashed;
+  else
+    res.first->second = exp;
+}
+
+template<class T>
+void ArrayExprHash<T>::releaseArrays(const std::vector<const Array *> &arrays) {
+  if (arrays.empty())
+    return;
+  for (std::vector<const Array *>::const_iterator it = arrays.begin(),
+         ie = arrays.end(); it != ie; ++it)
+    _array_hash.erase(*it);
+  _update_node_hash.clear();
 }
 
 template<class T>
@@ -0,0 +1,71 @@
+//===-- ArrayFootprint.h ----------------------------------------*- C++ -*-===//
+//
+//                     The KLEE Symbolic Virtual Machine
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+
+#ifndef KLEE_UTIL_ARRAYFOOTPRINT_H
+#define KLEE_UTIL_ARRAYFOOTPRINT_H
+
+#include <vector>
+
+namespace klee {
+  class Array;
+  class Expr;
+  class UpdateNode;
+
+  /// ArrayFootprint - The symbolic arrays an expression reads, through its
+  /// reads or the updates they go through, in the order findSymbolicObjects
+  /// finds them. Each expression and update node computes its footprint on
+  /// first use from those of its kids and keeps it; footprints are immutable
+  /// and shared between nodes which read the same arrays.
+  class ArrayFootprint {
+    friend class Expr;
+    friend class UpdateNode;
+
+    mutable unsigned refCount;
+
+    ArrayFootprint(const std::vector<const Array*> &_arrays,
+                   unsigned _refCount = 0)
+      : refCount(_refCount), arrays(_arrays) {}
+
+    /// share - A retained footprint reading \a arrays: one of the
+    /// footprints of the kids, \a parts, if one reads just those.
+    static const ArrayFootprint *
+    share(const std::vector<const Array*> &arrays,
+          const std::vector<const ArrayFootprint*> &parts);
+
+    static void retain(const ArrayFootprint *fp);
+    static void release(const ArrayFootprint *fp);
+
+    /// publish - Store \a fp into the cache \a slot of a node, unless
+    /// another thread got there first, and return what the slot holds.
+    static const ArrayFootprint *publish(const ArrayFootprint *&slot,
+                                         const ArrayFootprint *fp);
+    static const ArrayFootprint *load(const ArrayFootprint *const &slot);
+
+    /// lookup - The footprint of a node, or null if it isn't computed yet.
+    static const ArrayFootprint *lookup(const Expr *e);
+    static const ArrayFootprint *lookup(const UpdateNode *un);
+
+    /// compute - Compute the footprints of \a root, or \a rootUpdate, and
+    /// of everything below it which has none yet.
+    static void compute(const Expr *root, const UpdateNode *rootUpdate);
+
+  public:
+    const std::vector<const Array*> arrays;
+
+    /// getEmpty - The footprint of expressions which read no symbolic array.
+    static const ArrayFootprint &getEmpty();
+
+    bool empty() const { return arrays.empty(); }
+
+    /// intersects - Whether both footprints read some array.
+    bool intersects(const ArrayFootprint &b) const;
+  };
+}
+
+#endif
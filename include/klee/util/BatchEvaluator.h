@@ -0,0 +1,90 @@
+//===-- BatchEvaluator.h ----------------------------------------*- C++ -*-===//
+//
+//                     The KLEE Symbolic Virtual Machine
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+
+#ifndef KLEE_UTIL_BATCHEVALUATOR_H
+#define KLEE_UTIL_BATCHEVALUATOR_H
+
+#include "klee/Expr.h"
+#include "klee/util/ExprHashMap.h"
+
+#include <vector>
+
+namespace klee {
+  class Array;
+  class Assignment;
+
+  /// BatchEvaluator - Evaluate expressions under up to BatchSize assignments
+  /// at once. The expressions are compiled into a flat program over
+  /// registers holding one value per assignment, so that evaluation builds
+  /// no expressions and every instruction is a tight loop over the lanes,
+  /// which the compiler can vectorize.
+  ///
+  /// Only integer operations up to 64 bits, other than division, and single
+  /// and double precision arithmetic rounding to nearest are compiled, as
+  /// are reads at constant indices. add() fails on anything else, leaving it
+  /// to ExprEvaluator. The bits of NaNs may differ from those ExprEvaluator
+  /// gives, so an answer which is relied upon should be confirmed with it.
+  class BatchEvaluator {
+  public:
+    enum { BatchSize = 16 };
+
+  private:
+    struct Instruction {
+      /// The operation, Read loading a byte of an assignment.
+      Expr::Kind kind;
+      /// The width of the result, and of the first operand.
+      Expr::Width width, srcWidth;
+      /// The result and operand registers.
+      unsigned dst, a, b, c;
+      /// The value of a constant, offset of an extract, or index of a read.
+      uint64_t imm;
+    };
+
+    std::vector<Instruction> program;
+    /// The arrays read, a read naming its array by position.
+    std::vector<const Array*> arrays;
+    /// The register holding each compiled expression.
+    ExprHashMap<unsigned> registers;
+    /// The registers, each BatchSize consecutive values.
+    std::vector<uint64_t> values;
+
+    /// compile - Compile \a e, returning its register or -1 if it can't be.
+    int compile(const ref<Expr> &e);
+    int compileRead(const UpdateList &ul, uint64_t index, Expr::Width width);
+    int emit(Expr::Kind kind, Expr::Width width, Expr::Width srcWidth,
+             int a = 0, int b = 0, int c = 0, uint64_t imm = 0);
+
+  public:
+    BatchEvaluator() {}
+
+    /// add - Compile \a e and its subexpressions for evaluation, returning
+    /// false if it can't be.
+    bool add(const ref<Expr> &e);
+
+    /// evaluate - Evaluate everything added under the first \a n of \a
+    /// assignments, \a n being at most BatchSize.
+    void evaluate(const Assignment *const *assignments, unsigned n);
+
+    /// getValue - The value of \a e, an expression added or one of their
+    /// subexpressions, under the assignment in \a lane. Floats are given by
+    /// their bits.
+    uint64_t getValue(const ref<Expr> &e, unsigned lane) const {
+      ExprHashMap<unsigned>::const_iterator it = registers.find(e);
+      assert(it != registers.end() && "expression was not added");
+      assert(lane < BatchSize && "invalid lane");
+      return values[it->second * BatchSize + lane];
+    }
+
+    bool isTrue(const ref<Expr> &e, unsigned lane) const {
+      return getValue(e, lane) != 0;
+    }
+  };
+}
+
+#endif
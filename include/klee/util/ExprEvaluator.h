@@ -11,6 +11,7 @@
 #define KLEE_EXPREVALUATOR_H
 
 #include "klee/Expr.h"
+#include "klee/util/ExprHashMap.h"
 #include "klee/util/ExprVisitor.h"
 
 namespace klee {
@@ -26,6 +27,22 @@ namespace klee {
     Action visitURem(const URemExpr &e);
     Action visitSRem(const SRemExpr &e);
     Action visitExprPost(const Expr& e);
+
+    /// evalNativeFloat - Evaluate a single or double precision expression to
+    /// its bit pattern using host arithmetic, which is much cheaper than
+    /// folding it through APFloat constants. Returns false, leaving the
+    /// expression to the APFloat folder, for x87 operands, rounding modes the
+    /// host can't select, values not known concretely and operations
+    /// producing a NaN (whose payload the host may pick differently).
+    bool evalNativeFloat(const ref<Expr> &e, uint64_t &bits);
+
+    /// evalNativeFloatResult - Evaluate an integer expression over
+    /// floating-point operands (comparison, classification or conversion)
+    /// with evalNativeFloat. Returns null if it can't.
+    ref<Expr> evalNativeFloatResult(const Expr &e);
+
+    // Bit patterns of the floating-point subexpressions evaluated natively.
+    ExprHashMap<uint64_t> nativeFloats;
       
   public:
     ExprEvaluator() {}
@@ -61,6 +61,16 @@ protected:
 
   T evalRead(const UpdateList &ul, T index);
 
+  /// evalFloat - Return a range for a floating-point expression, or for an
+  /// integer computed from floating-point operands (comparisons,
+  /// classification and conversions). Ranges of floating-point expressions
+  /// are over their bit patterns. The default gives up and returns the full
+  /// range.
+  virtual T evalFloat(const ref<Expr> &e) {
+    Expr::Width width = e->getWidth();
+    return T(0, bits64::maxValueOfNBits(width > 64 ? 64 : width));
+  }
+
 public:
   ExprRangeEvaluator() {}
   virtual ~ExprRangeEvaluator() {}
@@ -120,15 +130,61 @@ T ExprRangeEvaluator<T>::evaluate(const ref<Expr> &e) {
     }
   }
 
+  case Expr::FSelect: {
+    const FSelectExpr *se = cast<FSelectExpr>(e);
+    T cond = evaluate(se->cond);
+
+    if (cond.mustEqual(1)) {
+      return evaluate(se->trueExpr);
+    } else if (cond.mustEqual(0)) {
+      return evaluate(se->falseExpr);
+    } else {
+      return evaluate(se->trueExpr).set_union(evaluate(se->falseExpr));
+    }
+  }
+
     // XXX these should be unrolled to ensure nice inline
   case Expr::Concat: {
     const Expr *ep = e.get();
     T res(0);
     for (unsigned i=0; i<ep->getNumKids(); i++)
-      res = res.concat(evaluate(ep->getKid(i)),8);
+      res = res.concat(evaluate(ep->getKid(i)), ep->getKid(i)->getWidth());
     return res;
   }
 
+    // Casting
+
+  case Expr::ZExt:
+    return evaluate(cast<CastExpr>(e)->src);
+
+  case Expr::SExt: {
+    // Sign extension keeps the values without the sign bit set.
+    const CastExpr *ce = cast<CastExpr>(e);
+    T src = evaluate(ce->src);
+    if (src.max() < ((uint64_t) 1 << (ce->src->getWidth() - 1)))
+      return src;
+    break;
+  }
+
+  case Expr::Extract: {
+    // Extracting the low bits keeps the values that fit in them.
+    const ExtractExpr *ee = cast<ExtractExpr>(e);
+    if (ee->offset == 0 && ee->width <= 64) {
+      T src = evaluate(ee->expr);
+      if (src.max() <= bits64::maxValueOfNBits(ee->width))
+        return src;
+    }
+    break;
+  }
+
+  case Expr::ExplicitFloat:
+  case Expr::ExplicitInt: {
+    // Bitcasts between integers and floats keep the bit pattern.
+    if (e->getWidth() <= 64)
+      return evaluate(e->getKid(0));
+    return evalFloat(e);
+  }
+
     // Arithmetic
 
   case Expr::Add: {
@@ -266,6 +322,30 @@ T ExprRangeEvaluator<T>::evaluate(const ref<Expr> &e) {
     break;
   }
 
+    // Floating-point
+
+  case Expr::FToU:
+  case Expr::FToS:
+  case Expr::FpClassify:
+  case Expr::FIsFinite:
+  case Expr::FIsNan:
+  case Expr::FIsInf:
+  case Expr::FOrd:
+  case Expr::FUno:
+  case Expr::FUeq:
+  case Expr::FOeq:
+  case Expr::FUgt:
+  case Expr::FOgt:
+  case Expr::FUge:
+  case Expr::FOge:
+  case Expr::FUlt:
+  case Expr::FOlt:
+  case Expr::FUle:
+  case Expr::FOle:
+  case Expr::FUne:
+  case Expr::FOne:
+    return evalFloat(e);
+
   case Expr::Ne:
   case Expr::Ugt:
   case Expr::Uge:
@@ -274,6 +354,8 @@ T ExprRangeEvaluator<T>::evaluate(const ref<Expr> &e) {
     assert(0 && "invalid expressions (uncanonicalized)");
 
   default:
+    if (isa<FExpr>(e))
+      return evalFloat(e);
     break;
   }
 
@@ -16,6 +16,7 @@
 #include <map>
 #include <klee/Constraints.h>
 #include <klee/Expr.h>
+#include <klee/util/ExprHashMap.h>
 #include <klee/util/PrintContext.h>
 #include <klee/Solver.h>
 
@@ -128,6 +129,10 @@ public:
 
   void setAbbreviationMode(AbbreviationMode am) { abbrMode = am; }
 
+  /// Only abbreviate shared expressions of at least \a n nodes, counted as a
+  /// tree; smaller ones are printed in full at each use.
+  void setAbbreviationMinSize(unsigned n) { abbrMinSize = n; }
+
   /// Create a new printer that will print a query in the SMTLIBv2 language.
   ExprSMTLIBPrinter();
 
@@ -214,7 +219,7 @@ protected:
   std::set<const Array *> usedArrays;
 
   /// Set of expressions seen during scan.
-  std::set<ref<Expr> > seenExprs;
+  ExprHashSet seenExprs;
 
   typedef std::map<const ref<Expr>, int> BindingMap;
 
@@ -346,6 +351,9 @@ protected:
   /// Helper function for scan() that scans the expressions of an update node
   void scanUpdates(const UpdateNode *un);
 
+  // Whether e has at least abbrMinSize nodes
+  bool isWorthAbbreviating(const ref<Expr> &e);
+
   /// Helper printer class
   PrintContext *p;
 
@@ -380,6 +388,7 @@ private:
 
   ConstantDisplayMode cdm;
   AbbreviationMode abbrMode;
+  unsigned abbrMinSize;
 };
 }
 
@@ -10,6 +10,7 @@
 #ifndef KLEE_EXPRUTIL_H
 #define KLEE_EXPRUTIL_H
 
+#include <stdint.h>
 #include <vector>
 
 namespace klee {
@@ -27,7 +28,8 @@ namespace klee {
                  std::vector< ref<ReadExpr> > &result);
   
   /// Return a list of all unique symbolic objects referenced by the given
-  /// expression.
+  /// expression. This is the footprint the expression keeps, so it is only
+  /// computed the first time.
   void findSymbolicObjects(ref<Expr> e,
                            std::vector<const Array*> &results);
 
@@ -38,6 +40,21 @@ namespace klee {
                            InputIterator end,
                            std::vector<const Array*> &results);
 
+  /// Return an integer over the bits of the floating point expression \a e
+  /// which orders the values of \a e, NaNs aside, as they compare, with -0
+  /// just below +0. The sign bit is flipped for positive values, and every
+  /// bit for negative ones.
+  ref<Expr> getFloatOrderKey(ref<Expr> e);
+
+  /// Return the floating point constant of \a width (Fl32 or Fl64) whose
+  /// key (see getFloatOrderKey) is \a key.
+  ref<Expr> getFloatFromOrderKey(uint64_t key, unsigned width);
+
+  /// Return the condition under which \a e has the constant \a value.
+  /// Floats are compared by their bits, so that -0 and +0 differ, except
+  /// that all NaNs count as the same value.
+  ref<Expr> createIsValue(ref<Expr> e, ref<Expr> value);
+
 }
 
 #endif
@@ -41,10 +41,18 @@ namespace klee {
     };
 
   protected:
+    typedef ExprHashMap< ref<Expr> > visited_ty;
+
     explicit
-    ExprVisitor(bool _recursive=false) : recursive(_recursive) {}
+    ExprVisitor(bool _recursive=false)
+      : memo(&visited), recursive(_recursive) {}
     virtual ~ExprVisitor() {}
 
+    /// useMemo - Memoize the visits in \a _memo, which may outlive the
+    /// visitor and be handed to the next one visiting the same way, rather
+    /// than in a map of the visitor's own.
+    void useMemo(visited_ty &_memo) { memo = &_memo; }
+
     virtual Action visitExpr(const Expr&);
     virtual Action visitExprPost(const Expr&);
 
@@ -115,10 +123,11 @@ namespace klee {
     virtual Action visitFRem(const FRemExpr&);
     virtual Action visitFMin(const FMinExpr&);
     virtual Action visitFMax(const FMaxExpr&);
+    virtual Action visitFFma(const FFmaExpr&);
 
   private:
-    typedef ExprHashMap< ref<Expr> > visited_ty;
     visited_ty visited;
+    visited_ty *memo;
     bool recursive;
 
     ref<Expr> visitActual(const ref<Expr> &e);
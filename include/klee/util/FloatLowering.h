@@ -0,0 +1,61 @@
+//===-- FloatLowering.h -----------------------------------------*- C++ -*-===//
+//
+//                     The KLEE Symbolic Virtual Machine
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+
+#ifndef KLEE_FLOATLOWERING_H
+#define KLEE_FLOATLOWERING_H
+
+#include "klee/Expr.h"
+#include "klee/util/ExprHashMap.h"
+
+namespace klee {
+  /// FloatLowering - Rewrite floating-point expressions into bitvector
+  /// expressions over their IEEE-754 encodings, so that solvers without
+  /// floating-point theories (STP, metaSMT) can decide them by bit-blasting.
+  ///
+  /// Arithmetic, square root, rounding to integral and the conversions are
+  /// encoded softfloat-style (unpack, operate on the widened significand,
+  /// normalize, round according to the expression's rounding mode and
+  /// repack), so the result is bit-exact with APFloat constant folding
+  /// except for the payload of NaNs generated by invalid operations, which
+  /// is always the default quiet NaN.
+  ///
+  /// Only single and double precision are supported, and FRem and FFma are
+  /// not; use canLower to check a query before handing it to a bit-blasting
+  /// solver.
+  class FloatLowering {
+    ExprHashMap< ref<Expr> > lowered;
+
+    ref<Expr> lowerFloat(const ref<Expr> &e);
+    ref<Expr> lowerFloatUse(const ref<Expr> &e);
+
+  public:
+    FloatLowering() {}
+
+    /// isFloatKind - Return true if expressions of kind \a k produce or
+    /// consume floating-point values, i.e. need lowering before a bitvector
+    /// solver can handle them.
+    static bool isFloatKind(Expr::Kind k);
+
+    /// canLower - Return true if lower can handle every floating-point
+    /// expression reachable from \a e, including through array updates.
+    static bool canLower(const ref<Expr> &e);
+
+    /// lower - Return a bitvector expression of the same width equivalent to
+    /// \a e, which must be of a floating-point kind. Floating-point values
+    /// are represented by their bit patterns; integer subexpressions are
+    /// left untouched, so callers lower any floating-point expressions
+    /// nested below those when they reach them.
+    ref<Expr> lower(const ref<Expr> &e);
+
+    /// clear - Drop the lowered expressions remembered so far.
+    void clear() { lowered.clear(); }
+  };
+}
+
+#endif
@@ -10,6 +10,8 @@
 #ifndef KLEE_REF_H
 #define KLEE_REF_H
 
+#include "klee/Config/config.h"
+
 #include "llvm/Support/Casting.h"
 using llvm::isa;
 using llvm::cast;
@@ -26,6 +28,28 @@ namespace llvm {
 
 namespace klee {
 
+/// Increment a reference count. With KLEE_ATOMIC_REFCOUNT this is atomic, so
+/// that the objects counted can be shared between threads.
+template<class T>
+inline void incRefCount(T &refCount) {
+#ifdef KLEE_ATOMIC_REFCOUNT
+  __atomic_add_fetch(&refCount, 1, __ATOMIC_RELAXED);
+#else
+  ++refCount;
+#endif
+}
+
+/// Decrement a reference count, returning the new count. The thread dropping
+/// the last reference sees all writes of the others before deleting.
+template<class T>
+inline T decRefCount(T &refCount) {
+#ifdef KLEE_ATOMIC_REFCOUNT
+  return __atomic_sub_fetch(&refCount, 1, __ATOMIC_ACQ_REL);
+#else
+  return --refCount;
+#endif
+}
+
 template<class T>
 class ref {
   T *ptr;
@@ -38,11 +62,11 @@ public:
 private:
   void inc() const {
     if (ptr)
-      ++ptr->refCount;
+      incRefCount(ptr->refCount);
   }
 
   void dec() const {
-    if (ptr && --ptr->refCount == 0)
+    if (ptr && decRefCount(ptr->refCount) == 0)
       delete ptr;
   }
 
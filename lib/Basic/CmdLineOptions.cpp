@@ -21,6 +21,20 @@ UseFastCexSolver("use-fast-cex-solver",
 		 llvm::cl::init(false),
 		 llvm::cl::desc("(default=off)"));
 
+llvm::cl::opt<bool>
+UseFloatTriageSolver("use-float-triage-solver",
+                     llvm::cl::init(false),
+                     llvm::cl::desc("Answer floating-point queries decided "
+                                    "by NaN and range facts alone without "
+                                    "the core solver (default=off)"));
+
+llvm::cl::opt<bool>
+UseFloatSearchSolver("use-float-search-solver",
+                     llvm::cl::init(false),
+                     llvm::cl::desc("Look for models of floating-point "
+                                    "queries by local search before asking "
+                                    "the core solver (default=off)"));
+
 llvm::cl::opt<bool>
 UseCexCache("use-cex-cache",
             llvm::cl::init(true),
@@ -31,14 +45,61 @@ UseCache("use-cache",
          llvm::cl::init(true),
          llvm::cl::desc("Use validity caching (default=on)"));
 
+llvm::cl::opt<bool>
+CanonicalizeArrays("canonicalize-arrays",
+                   llvm::cl::init(false),
+                   llvm::cl::desc("Rename the arrays of each query in the "
+                                  "order it reads them before the caches, "
+                                  "so that queries only differing in array "
+                                  "names share entries (default=off)"));
+
+llvm::cl::opt<std::string>
+PersistentQueryCache("persistent-query-cache",
+                     llvm::cl::init(""),
+                     llvm::cl::desc("Cache solver query results in the given "
+                                    "file, which is reused across runs and "
+                                    "may be shared by concurrent runs "
+                                    "(default=off)"));
+
+llvm::cl::opt<std::string>
+SharedQueryCache("shared-query-cache",
+                 llvm::cl::init(""),
+                 llvm::cl::desc("Cache solver query results in a table in "
+                                "shared memory, mapped from the given file, "
+                                "such as one under /dev/shm, which the runs "
+                                "on the host using the same file consult "
+                                "before their own solver (default=off)"));
+
+llvm::cl::opt<unsigned>
+SharedQueryCacheSize("shared-query-cache-size",
+                     llvm::cl::init(64),
+                     llvm::cl::desc("Size in MB of the table created by "
+                                    "-shared-query-cache, whose least "
+                                    "recently hit results are evicted once "
+                                    "it is full (default=64)"));
+
 llvm::cl::opt<bool>
 UseIndependentSolver("use-independent-solver",
                      llvm::cl::init(true),
                      llvm::cl::desc("Use constraint independence (default=on)"));
 
+llvm::cl::opt<bool>
+SimplifyFloatQueries("simplify-float-queries",
+                     llvm::cl::init(false),
+                     llvm::cl::desc("Rewrite floating-point expressions using "
+                                    "exact IEEE-754 identities before "
+                                    "solving (default=off)"));
+
 llvm::cl::opt<bool>
 DebugValidateSolver("debug-validate-solver",
 		             llvm::cl::init(false));
+
+llvm::cl::opt<bool>
+ProfileSolverChain("profile-solver-chain",
+                   llvm::cl::init(false),
+                   llvm::cl::desc("Count and time the queries at each layer "
+                                  "of the solver chain, written to run.stats "
+                                  "(default=off)"));
   
 llvm::cl::opt<int>
 MinQueryTimeToLog("min-query-time-to-log",
@@ -75,8 +136,10 @@ llvm::cl::list<QueryLoggingSolverType> queryLoggingOptions(
     llvm::cl::values(
         clEnumValN(ALL_KQUERY,"all:kquery","All queries in .kquery (KQuery) format"),
         clEnumValN(ALL_SMTLIB,"all:smt2","All queries in .smt2 (SMT-LIBv2) format"),
+        clEnumValN(ALL_BINARY,"all:binary","All queries in the binary query log format"),
         clEnumValN(SOLVER_KQUERY,"solver:kquery","All queries reaching the solver in .kquery (KQuery) format"),
         clEnumValN(SOLVER_SMTLIB,"solver:smt2","All queries reaching the solver in .smt2 (SMT-LIBv2) format"),
+        clEnumValN(SOLVER_BINARY,"solver:binary","All queries reaching the solver in the binary query log format"),
         clEnumValEnd
 	),
     llvm::cl::CommaSeparated
@@ -106,6 +169,19 @@ llvm::cl::opt<klee::MetaSMTBackendType> MetaSMTBackend(
         clEnumValEnd),
     llvm::cl::init(METASMT_DEFAULT_BACKEND));
 
+llvm::cl::list<klee::MetaSMTBackendType> PortfolioMetaSMTBackends(
+    "portfolio-metasmt-backends",
+    llvm::cl::desc("Comma-separated list of the metaSMT backends the portfolio "
+                   "solver runs for its metasmt entry, each as a configuration "
+                   "of its own (default=the one given by -metasmt-backend)"),
+    llvm::cl::values(
+        clEnumValN(METASMT_BACKEND_STP, "stp", "Use metaSMT with STP"),
+        clEnumValN(METASMT_BACKEND_Z3, "z3", "Use metaSMT with Z3"),
+        clEnumValN(METASMT_BACKEND_BOOLECTOR, "btor",
+                   "Use metaSMT with Boolector"),
+        clEnumValEnd),
+    llvm::cl::CommaSeparated);
+
 #undef METASMT_DEFAULT_BACKEND
 #undef METASMT_DEFAULT_BACKEND_STR
 
@@ -116,18 +192,27 @@ llvm::cl::opt<klee::MetaSMTBackendType> MetaSMTBackend(
 #define STP_IS_DEFAULT_STR " (default)"
 #define METASMT_IS_DEFAULT_STR ""
 #define Z3_IS_DEFAULT_STR ""
+#define BITWUZLA_IS_DEFAULT_STR ""
 #define DEFAULT_CORE_SOLVER STP_SOLVER
 #elif ENABLE_Z3
 #define STP_IS_DEFAULT_STR ""
 #define METASMT_IS_DEFAULT_STR ""
 #define Z3_IS_DEFAULT_STR " (default)"
+#define BITWUZLA_IS_DEFAULT_STR ""
 #define DEFAULT_CORE_SOLVER Z3_SOLVER
 #elif ENABLE_METASMT
 #define STP_IS_DEFAULT_STR ""
 #define METASMT_IS_DEFAULT_STR " (default)"
 #define Z3_IS_DEFAULT_STR ""
+#define BITWUZLA_IS_DEFAULT_STR ""
 #define DEFAULT_CORE_SOLVER METASMT_SOLVER
 #define Z3_IS_DEFAULT_STR ""
+#elif ENABLE_BITWUZLA
+#define STP_IS_DEFAULT_STR ""
+#define METASMT_IS_DEFAULT_STR ""
+#define Z3_IS_DEFAULT_STR ""
+#define BITWUZLA_IS_DEFAULT_STR " (default)"
+#define DEFAULT_CORE_SOLVER BITWUZLA_SOLVER
 #else
 #error "Unsupported solver configuration"
 #endif
@@ -137,9 +222,25 @@ llvm::cl::opt<CoreSolverType> CoreSolverToUse(
                      clEnumValN(METASMT_SOLVER, "metasmt", "metaSMT" METASMT_IS_DEFAULT_STR),
                      clEnumValN(DUMMY_SOLVER, "dummy", "Dummy solver"),
                      clEnumValN(Z3_SOLVER, "z3", "Z3" Z3_IS_DEFAULT_STR),
+                     clEnumValN(BITWUZLA_SOLVER, "bitwuzla",
+                                "Bitwuzla" BITWUZLA_IS_DEFAULT_STR),
+                     clEnumValN(PORTFOLIO_SOLVER, "portfolio",
+                                "Race the solvers given by -portfolio-solvers"),
                      clEnumValEnd),
     llvm::cl::init(DEFAULT_CORE_SOLVER));
 
+llvm::cl::list<CoreSolverType> PortfolioSolvers(
+    "portfolio-solvers",
+    llvm::cl::desc("Comma-separated list of the core solvers the portfolio "
+                   "solver runs concurrently on every query "
+                   "(default=z3,stp, where available)"),
+    llvm::cl::values(clEnumValN(STP_SOLVER, "stp", "stp"),
+                     clEnumValN(METASMT_SOLVER, "metasmt", "metaSMT"),
+                     clEnumValN(Z3_SOLVER, "z3", "Z3"),
+                     clEnumValN(BITWUZLA_SOLVER, "bitwuzla", "Bitwuzla"),
+                     clEnumValEnd),
+    llvm::cl::CommaSeparated);
+
 llvm::cl::opt<CoreSolverType> DebugCrossCheckCoreSolverWith(
     "debug-crosscheck-core-solver",
     llvm::cl::desc(
@@ -148,6 +249,7 @@ llvm::cl::opt<CoreSolverType> DebugCrossCheckCoreSolverWith(
                      clEnumValN(METASMT_SOLVER, "metasmt", "metaSMT"),
                      clEnumValN(DUMMY_SOLVER, "dummy", "Dummy solver"),
                      clEnumValN(Z3_SOLVER, "z3", "Z3"),
+                     clEnumValN(BITWUZLA_SOLVER, "bitwuzla", "Bitwuzla"),
                      clEnumValN(NO_SOLVER, "none",
                                 "Do not cross check (default)"),
                      clEnumValEnd),
@@ -156,6 +258,7 @@ llvm::cl::opt<CoreSolverType> DebugCrossCheckCoreSolverWith(
 #undef STP_IS_DEFAULT_STR
 #undef METASMT_IS_DEFAULT_STR
 #undef Z3_IS_DEFAULT_STR
+#undef BITWUZLA_IS_DEFAULT_STR
 #undef DEFAULT_CORE_SOLVER
 
 
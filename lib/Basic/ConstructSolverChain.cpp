@@ -12,20 +12,32 @@
  */
 #include "klee/Common.h"
 #include "klee/CommandLine.h"
+#include "klee/IncompleteSolver.h"
 #include "klee/Internal/Support/ErrorHandling.h"
 #include "llvm/Support/raw_ostream.h"
 
 namespace klee {
+/// Wrap \a solver, the top of the chain built so far, in a profiling solver
+/// for \a layer when the chain is profiled.
+static Solver *profileLayer(Solver *solver, const char *layer) {
+  if (!ProfileSolverChain)
+    return solver;
+  return createProfilingSolver(solver, layer);
+}
+
 Solver *constructSolverChain(Solver *coreSolver,
                              std::string querySMT2LogPath,
                              std::string baseSolverQuerySMT2LogPath,
                              std::string queryKQueryLogPath,
-                             std::string baseSolverQueryKQueryLogPath) {
-  Solver *solver = coreSolver;
+                             std::string baseSolverQueryKQueryLogPath,
+                             std::string queryBinaryLogPath,
+                             std::string baseSolverQueryBinaryLogPath) {
+  Solver *solver = profileLayer(coreSolver, "Core");
 
   if (optionIsSet(queryLoggingOptions, SOLVER_KQUERY)) {
     solver = createKQueryLoggingSolver(solver, baseSolverQueryKQueryLogPath,
                                    MinQueryTimeToLog);
+    solver = profileLayer(solver, "SolverKQueryLog");
     klee_message("Logging queries that reach solver in .kquery format to %s\n",
                  baseSolverQueryKQueryLogPath.c_str());
   }
@@ -33,28 +45,83 @@ Solver *constructSolverChain(Solver *coreSolver,
   if (optionIsSet(queryLoggingOptions, SOLVER_SMTLIB)) {
     solver = createSMTLIBLoggingSolver(solver, baseSolverQuerySMT2LogPath,
                                        MinQueryTimeToLog);
+    solver = profileLayer(solver, "SolverSMTLIBLog");
     klee_message("Logging queries that reach solver in .smt2 format to %s\n",
                  baseSolverQuerySMT2LogPath.c_str());
   }
 
+  if (optionIsSet(queryLoggingOptions, SOLVER_BINARY)) {
+    solver = createBinaryQueryLoggingSolver(solver, baseSolverQueryBinaryLogPath,
+                                            MinQueryTimeToLog);
+    solver = profileLayer(solver, "SolverBinaryLog");
+    klee_message("Logging queries that reach solver in binary format to %s\n",
+                 baseSolverQueryBinaryLogPath.c_str());
+  }
+
+  if (!PersistentQueryCache.empty()) {
+    solver = createPersistentCachingSolver(solver, PersistentQueryCache);
+    solver = profileLayer(solver, "PersistentCache");
+    klee_message("Caching query results persistently in %s\n",
+                 PersistentQueryCache.c_str());
+  }
+
+  // Above the persistent cache, which is slower and may also have the
+  // result.
+  if (!SharedQueryCache.empty()) {
+    solver = createSharedMemoryCachingSolver(
+        solver, SharedQueryCache, (uint64_t)SharedQueryCacheSize << 20);
+    solver = profileLayer(solver, "SharedCache");
+    klee_message("Sharing query results with the runs on this host in %s\n",
+                 SharedQueryCache.c_str());
+  }
+
+  // The incomplete solvers share one pipeline, cheapest first.
+  std::vector<IncompleteSolver *> stages;
+  if (UseFloatTriageSolver)
+    stages.push_back(createFloatTriageStage());
   if (UseFastCexSolver)
-    solver = createFastCexSolver(solver);
+    stages.push_back(createFastCexStage());
+  if (UseFloatSearchSolver)
+    stages.push_back(createFloatSearchStage());
+  if (!stages.empty()) {
+    solver = createStagedSolver(stages, solver);
+    solver = profileLayer(solver, "Staged");
+  }
 
-  if (UseCexCache)
+  if (UseCexCache) {
     solver = createCexCachingSolver(solver);
+    solver = profileLayer(solver, "CexCache");
+  }
 
-  if (UseCache)
+  if (UseCache) {
     solver = createCachingSolver(solver);
+    solver = profileLayer(solver, "Cache");
+  }
+
+  if (CanonicalizeArrays) {
+    solver = createCanonicalizingSolver(solver);
+    solver = profileLayer(solver, "Canonicalize");
+  }
 
-  if (UseIndependentSolver)
+  if (UseIndependentSolver) {
     solver = createIndependentSolver(solver);
+    solver = profileLayer(solver, "Independent");
+  }
+
+  if (SimplifyFloatQueries) {
+    solver = createFloatSimplifyingSolver(solver);
+    solver = profileLayer(solver, "FloatSimplify");
+  }
 
-  if (DebugValidateSolver)
+  if (DebugValidateSolver) {
     solver = createValidatingSolver(solver, coreSolver);
+    solver = profileLayer(solver, "Validating");
+  }
 
   if (optionIsSet(queryLoggingOptions, ALL_KQUERY)) {
     solver = createKQueryLoggingSolver(solver, queryKQueryLogPath,
                                        MinQueryTimeToLog);
+    solver = profileLayer(solver, "KQueryLog");
     klee_message("Logging all queries in .kquery format to %s\n",
                  queryKQueryLogPath.c_str());
   }
@@ -62,12 +129,23 @@ Solver *constructSolverChain(Solver *coreSolver,
   if (optionIsSet(queryLoggingOptions, ALL_SMTLIB)) {
     solver =
         createSMTLIBLoggingSolver(solver, querySMT2LogPath, MinQueryTimeToLog);
+    solver = profileLayer(solver, "SMTLIBLog");
     klee_message("Logging all queries in .smt2 format to %s\n",
                  querySMT2LogPath.c_str());
   }
+
+  if (optionIsSet(queryLoggingOptions, ALL_BINARY)) {
+    solver = createBinaryQueryLoggingSolver(solver, queryBinaryLogPath,
+                                            MinQueryTimeToLog);
+    solver = profileLayer(solver, "BinaryLog");
+    klee_message("Logging all queries in binary format to %s\n",
+                 queryBinaryLogPath.c_str());
+  }
+
   if (DebugCrossCheckCoreSolverWith != NO_SOLVER) {
     Solver *oracleSolver = createCoreSolver(DebugCrossCheckCoreSolverWith);
     solver = createValidatingSolver(/*s=*/solver, /*oracle=*/oracleSolver);
+    solver = profileLayer(solver, "CrossCheck");
   }
 
   return solver;
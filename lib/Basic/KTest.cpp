@@ -8,10 +8,22 @@
 //===----------------------------------------------------------------------===//
 
 #include "klee/Internal/ADT/KTest.h"
+#include "klee/Config/config.h"
 
 #include <stdlib.h>
 #include <string.h>
 #include <stdio.h>
+#include <stdint.h>
+#include <sys/types.h>
+
+#ifdef HAVE_ZLIB_H
+#include <zlib.h>
+#endif
+
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
 
 #define KTEST_VERSION 3
 #define KTEST_MAGIC_SIZE 5
@@ -93,11 +105,20 @@ int kTest_isKTestFile(const char *path) {
 
 KTest *kTest_fromFile(const char *path) {
   FILE *f = fopen(path, "rb");
+  KTest *res;
+
+  if (!f)
+    return 0;
+  res = kTest_fromStream(f);
+  fclose(f);
+
+  return res;
+}
+
+KTest *kTest_fromStream(FILE *f) {
   KTest *res = 0;
   unsigned i, version;
 
-  if (!f) 
-    goto error;
   if (!kTest_checkHeader(f)) 
     goto error;
 
@@ -146,8 +167,6 @@ KTest *kTest_fromFile(const char *path) {
       goto error;
   }
 
-  fclose(f);
-
   return res;
  error:
   if (res) {
@@ -170,17 +189,25 @@ KTest *kTest_fromFile(const char *path) {
     free(res);
   }
 
-  if (f) fclose(f);
-
   return 0;
 }
 
 int kTest_toFile(KTest *bo, const char *path) {
   FILE *f = fopen(path, "wb");
+  int res;
+
+  if (!f)
+    return 0;
+  res = kTest_toStream(bo, f);
+  if (fclose(f) != 0)
+    res = 0;
+
+  return res;
+}
+
+int kTest_toStream(KTest *bo, FILE *f) {
   unsigned i;
 
-  if (!f) 
-    goto error;
   if (fwrite(KTEST_MAGIC, strlen(KTEST_MAGIC), 1, f)!=1)
     goto error;
   if (!write_uint32(f, KTEST_VERSION))
@@ -210,12 +237,8 @@ int kTest_toFile(KTest *bo, const char *path) {
       goto error;
   }
 
-  fclose(f);
-
   return 1;
  error:
-  if (f) fclose(f);
-  
   return 0;
 }
 
@@ -238,3 +261,532 @@ void kTest_free(KTest *bo) {
   free(bo->objects);
   free(bo);
 }
+
+/***/
+
+// A pack starts with KPACK_MAGIC and the format version, followed by
+// records of the form <tag:1> <payload length:4> <payload>:
+//
+//   'O' object bytes: <encoding:1> <raw size:4> <stored bytes>
+//   'T' test: <name> <numArgs> <args> <symArgvs> <symArgvLen> <numObjects>
+//             and for each object <name> <object record number:4>
+//   'I' index: <numObjects> <object record offsets:8>...
+//              <numTests> (<name> <test record offset:8>)...
+//
+// An object record always precedes the first test using it. Closing the
+// writer appends the index, then its offset and KPACK_INDEX_MAGIC, so
+// readers need not scan the whole file. Numbers are big-endian.
+
+#define KPACK_VERSION 1
+#define KPACK_MAGIC_SIZE 5
+#define KPACK_MAGIC "KPACK"
+#define KPACK_INDEX_MAGIC "KPIDX"
+#define KPACK_TRAILER_SIZE (8 + KPACK_MAGIC_SIZE)
+#define KPACK_RECORD_HEADER_SIZE 5
+
+#define KPACK_OBJECT 'O'
+#define KPACK_TEST 'T'
+#define KPACK_INDEX 'I'
+
+#define KPACK_RAW 0
+#define KPACK_ZLIB 1
+
+// objects smaller than this are not worth compressing
+#define KPACK_MIN_COMPRESS_SIZE 64
+
+static void put_uint32(std::string &buf, unsigned value) {
+  buf += (char) (value >> 24);
+  buf += (char) (value >> 16);
+  buf += (char) (value >> 8);
+  buf += (char) value;
+}
+
+static void put_uint64(std::string &buf, uint64_t value) {
+  put_uint32(buf, (unsigned) (value >> 32));
+  put_uint32(buf, (unsigned) value);
+}
+
+static void put_string(std::string &buf, const char *value) {
+  unsigned len = strlen(value);
+  put_uint32(buf, len);
+  buf.append(value, len);
+}
+
+namespace {
+  /// Cursor over the payload of a record.
+  struct PackRecord {
+    std::string data;
+    size_t pos;
+
+    PackRecord() : pos(0) {}
+
+    bool getBytes(size_t n, const char **out) {
+      if (data.size() - pos < n)
+        return false;
+      *out = data.data() + pos;
+      pos += n;
+      return true;
+    }
+    bool getUInt8(unsigned char *out) {
+      const char *p;
+      if (!getBytes(1, &p))
+        return false;
+      *out = (unsigned char) p[0];
+      return true;
+    }
+    bool getUInt32(unsigned *out) {
+      const char *p;
+      if (!getBytes(4, &p))
+        return false;
+      const unsigned char *d = (const unsigned char *) p;
+      *out = (((((d[0] << 8) + d[1]) << 8) + d[2]) << 8) + d[3];
+      return true;
+    }
+    bool getUInt64(uint64_t *out) {
+      unsigned hi, lo;
+      if (!getUInt32(&hi) || !getUInt32(&lo))
+        return false;
+      *out = ((uint64_t) hi << 32) | lo;
+      return true;
+    }
+    bool getString(std::string &out) {
+      unsigned len;
+      const char *p;
+      if (!getUInt32(&len) || !getBytes(len, &p))
+        return false;
+      out.assign(p, len);
+      return true;
+    }
+    /// Returns a malloc'ed copy of the next string, as kTest_free expects.
+    char *getCString() {
+      std::string s;
+      if (!getString(s))
+        return 0;
+      char *res = (char *) malloc(s.size() + 1);
+      if (res)
+        memcpy(res, s.c_str(), s.size() + 1);
+      return res;
+    }
+  };
+}
+
+static int write_record(FILE *f, unsigned char tag, const std::string &payload) {
+  if (fputc(tag, f) == EOF)
+    return 0;
+  if (!write_uint32(f, payload.size()))
+    return 0;
+  return payload.empty() || fwrite(payload.data(), payload.size(), 1, f) == 1;
+}
+
+/// Reads the record at \a offset, or the next one if \a offset is -1.
+/// Returns 0 on error or at the end of the file.
+static int read_record(FILE *f, off_t offset, unsigned char *tag_out,
+                       PackRecord &record) {
+  if (offset >= 0 && fseeko(f, offset, SEEK_SET) != 0)
+    return 0;
+  int tag = fgetc(f);
+  unsigned len;
+  if (tag == EOF || !read_uint32(f, &len))
+    return 0;
+  *tag_out = tag;
+  record.data.resize(len);
+  record.pos = 0;
+  return len == 0 || fread(&record.data[0], len, 1, f) == 1;
+}
+
+static uint64_t hash_bytes(const unsigned char *bytes, unsigned numBytes) {
+  // FNV-1a
+  uint64_t hash = 14695981039346656037ULL;
+  for (unsigned i = 0; i < numBytes; i++) {
+    hash ^= bytes[i];
+    hash *= 1099511628211ULL;
+  }
+  return hash ^ numBytes;
+}
+
+struct KTestPackWriter {
+  FILE *f;
+  int compress;
+  std::vector<uint64_t> objectOffsets;
+  std::vector<std::pair<std::string, uint64_t> > tests;
+  // object record numbers by hash of their raw bytes
+  std::unordered_multimap<uint64_t, unsigned> objectsByHash;
+};
+
+struct KTestPackReader {
+  FILE *f;
+  std::vector<uint64_t> objectOffsets;
+  std::vector<std::pair<std::string, uint64_t> > tests;
+};
+
+static int kTestPack_checkHeader(FILE *f) {
+  char header[KPACK_MAGIC_SIZE];
+  unsigned version;
+  if (fread(header, KPACK_MAGIC_SIZE, 1, f)!=1)
+    return 0;
+  if (memcmp(header, KPACK_MAGIC, KPACK_MAGIC_SIZE))
+    return 0;
+  if (!read_uint32(f, &version))
+    return 0;
+  return version <= KPACK_VERSION;
+}
+
+int kTest_isKTestPack(const char *path) {
+  FILE *f = fopen(path, "rb");
+  int res;
+
+  if (!f)
+    return 0;
+  res = kTestPack_checkHeader(f);
+  fclose(f);
+
+  return res;
+}
+
+KTestPackWriter *kTestPack_create(const char *path, int compress) {
+  FILE *f = fopen(path, "w+b");
+  if (!f)
+    return 0;
+  if (fwrite(KPACK_MAGIC, KPACK_MAGIC_SIZE, 1, f)!=1 ||
+      !write_uint32(f, KPACK_VERSION) || fflush(f) != 0) {
+    fclose(f);
+    return 0;
+  }
+
+  KTestPackWriter *w = new KTestPackWriter();
+  w->f = f;
+  w->compress = compress;
+  return w;
+}
+
+/// Checks whether object record \a index holds \a stored, in \a encoding.
+static int kTestPack_sameObject(KTestPackWriter *w, unsigned index,
+                                unsigned char encoding, unsigned numBytes,
+                                const std::string &stored) {
+  unsigned char tag, recordEncoding;
+  unsigned recordNumBytes;
+  PackRecord record;
+  if (!read_record(w->f, w->objectOffsets[index], &tag, record))
+    return 0;
+  if (tag != KPACK_OBJECT || !record.getUInt8(&recordEncoding) ||
+      !record.getUInt32(&recordNumBytes))
+    return 0;
+  return recordEncoding == encoding && recordNumBytes == numBytes &&
+         record.data.compare(record.pos, std::string::npos, stored) == 0;
+}
+
+/// Stores the bytes of \a o unless an identical object already is, and
+/// returns the number of the object record holding them.
+static int kTestPack_writeObject(KTestPackWriter *w, KTestObject *o,
+                                 unsigned *index_out) {
+  unsigned char encoding = KPACK_RAW;
+  std::string stored;
+#ifdef HAVE_ZLIB_H
+  if (w->compress && o->numBytes >= KPACK_MIN_COMPRESS_SIZE) {
+    uLongf size = compressBound(o->numBytes);
+    stored.resize(size);
+    if (compress2((Bytef *) &stored[0], &size, o->bytes, o->numBytes,
+                  Z_DEFAULT_COMPRESSION) == Z_OK &&
+        size < o->numBytes) {
+      stored.resize(size);
+      encoding = KPACK_ZLIB;
+    }
+  }
+#endif
+  if (encoding == KPACK_RAW)
+    stored.assign((const char *) o->bytes, o->numBytes);
+
+  uint64_t hash = hash_bytes(o->bytes, o->numBytes);
+  std::pair<std::unordered_multimap<uint64_t, unsigned>::iterator,
+            std::unordered_multimap<uint64_t, unsigned>::iterator>
+    range = w->objectsByHash.equal_range(hash);
+  for (; range.first != range.second; ++range.first) {
+    if (kTestPack_sameObject(w, range.first->second, encoding, o->numBytes,
+                             stored)) {
+      *index_out = range.first->second;
+      return 1;
+    }
+  }
+
+  std::string payload;
+  payload += (char) encoding;
+  put_uint32(payload, o->numBytes);
+  payload += stored;
+
+  if (fseeko(w->f, 0, SEEK_END) != 0)
+    return 0;
+  off_t offset = ftello(w->f);
+  if (offset < 0 || !write_record(w->f, KPACK_OBJECT, payload))
+    return 0;
+
+  *index_out = w->objectOffsets.size();
+  w->objectOffsets.push_back(offset);
+  w->objectsByHash.insert(std::make_pair(hash, *index_out));
+  return 1;
+}
+
+int kTestPack_append(KTestPackWriter *w, KTest *bo, const char *name) {
+  unsigned i;
+  std::string payload;
+
+  put_string(payload, name);
+  put_uint32(payload, bo->numArgs);
+  for (i=0; i<bo->numArgs; i++)
+    put_string(payload, bo->args[i]);
+  put_uint32(payload, bo->symArgvs);
+  put_uint32(payload, bo->symArgvLen);
+  put_uint32(payload, bo->numObjects);
+  for (i=0; i<bo->numObjects; i++) {
+    KTestObject *o = &bo->objects[i];
+    unsigned index;
+    if (!kTestPack_writeObject(w, o, &index))
+      return 0;
+    put_string(payload, o->name);
+    put_uint32(payload, index);
+  }
+
+  if (fseeko(w->f, 0, SEEK_END) != 0)
+    return 0;
+  off_t offset = ftello(w->f);
+  if (offset < 0 || !write_record(w->f, KPACK_TEST, payload))
+    return 0;
+  // Keep the file complete after every test, so that an interrupted run
+  // (or a forked process sharing it) leaves a readable pack behind.
+  if (fflush(w->f) != 0)
+    return 0;
+
+  w->tests.push_back(std::make_pair(std::string(name), (uint64_t) offset));
+  return 1;
+}
+
+int kTestPack_close(KTestPackWriter *w) {
+  std::string payload;
+  int res = 1;
+
+  put_uint32(payload, w->objectOffsets.size());
+  for (unsigned i=0; i<w->objectOffsets.size(); i++)
+    put_uint64(payload, w->objectOffsets[i]);
+  put_uint32(payload, w->tests.size());
+  for (unsigned i=0; i<w->tests.size(); i++) {
+    put_string(payload, w->tests[i].first.c_str());
+    put_uint64(payload, w->tests[i].second);
+  }
+
+  std::string trailer;
+  off_t offset = -1;
+  if (fseeko(w->f, 0, SEEK_END) == 0)
+    offset = ftello(w->f);
+  put_uint64(trailer, offset);
+  trailer += KPACK_INDEX_MAGIC;
+  if (offset < 0 || !write_record(w->f, KPACK_INDEX, payload) ||
+      fwrite(trailer.data(), trailer.size(), 1, w->f) != 1)
+    res = 0;
+
+  if (fclose(w->f) != 0)
+    res = 0;
+  delete w;
+  return res;
+}
+
+void kTestPack_abandon(KTestPackWriter *w) {
+  fclose(w->f);
+  delete w;
+}
+
+static int kTestPack_readIndex(KTestPackReader *r, off_t fileSize) {
+  char magic[KPACK_MAGIC_SIZE];
+  unsigned hi, lo, num, i;
+  unsigned char tag;
+  PackRecord record;
+
+  if (fileSize < KPACK_TRAILER_SIZE ||
+      fseeko(r->f, fileSize - KPACK_TRAILER_SIZE, SEEK_SET) != 0 ||
+      !read_uint32(r->f, &hi) || !read_uint32(r->f, &lo) ||
+      fread(magic, KPACK_MAGIC_SIZE, 1, r->f) != 1 ||
+      memcmp(magic, KPACK_INDEX_MAGIC, KPACK_MAGIC_SIZE))
+    return 0;
+  uint64_t offset = ((uint64_t) hi << 32) | lo;
+  if (offset >= (uint64_t) fileSize ||
+      !read_record(r->f, offset, &tag, record) || tag != KPACK_INDEX)
+    return 0;
+
+  if (!record.getUInt32(&num))
+    return 0;
+  r->objectOffsets.resize(num);
+  for (i=0; i<num; i++)
+    if (!record.getUInt64(&r->objectOffsets[i]))
+      return 0;
+  if (!record.getUInt32(&num))
+    return 0;
+  r->tests.resize(num);
+  for (i=0; i<num; i++)
+    if (!record.getString(r->tests[i].first) ||
+        !record.getUInt64(&r->tests[i].second))
+      return 0;
+  return 1;
+}
+
+/// Rebuilds the index of a pack which has none, stopping at the first
+/// incomplete record.
+static int kTestPack_scan(KTestPackReader *r, off_t fileSize) {
+  off_t offset = KPACK_MAGIC_SIZE + 4;
+  r->objectOffsets.clear();
+  r->tests.clear();
+  if (fseeko(r->f, offset, SEEK_SET) != 0)
+    return 0;
+
+  while (fileSize - offset >= KPACK_RECORD_HEADER_SIZE) {
+    int tag = fgetc(r->f);
+    unsigned len;
+    if (tag == EOF || !read_uint32(r->f, &len))
+      break;
+    off_t next = offset + KPACK_RECORD_HEADER_SIZE + len;
+    if (next > fileSize || tag == KPACK_INDEX)
+      break;
+
+    if (tag == KPACK_OBJECT) {
+      r->objectOffsets.push_back(offset);
+    } else if (tag == KPACK_TEST) {
+      char *name;
+      if (!read_string(r->f, &name))
+        break;
+      r->tests.push_back(std::make_pair(std::string(name), (uint64_t) offset));
+      free(name);
+    }
+
+    offset = next;
+    if (fseeko(r->f, offset, SEEK_SET) != 0)
+      break;
+  }
+  return 1;
+}
+
+KTestPackReader *kTestPack_open(const char *path) {
+  FILE *f = fopen(path, "rb");
+  if (!f)
+    return 0;
+
+  off_t fileSize = -1;
+  if (kTestPack_checkHeader(f) && fseeko(f, 0, SEEK_END) == 0)
+    fileSize = ftello(f);
+  if (fileSize < 0) {
+    fclose(f);
+    return 0;
+  }
+
+  KTestPackReader *r = new KTestPackReader();
+  r->f = f;
+  if (!kTestPack_readIndex(r, fileSize) && !kTestPack_scan(r, fileSize)) {
+    kTestPack_free(r);
+    return 0;
+  }
+  return r;
+}
+
+unsigned kTestPack_numTests(KTestPackReader *r) {
+  return r->tests.size();
+}
+
+const char *kTestPack_getName(KTestPackReader *r, unsigned index) {
+  return r->tests[index].first.c_str();
+}
+
+/// Reads the bytes of object record \a index into \a o.
+static int kTestPack_readObject(KTestPackReader *r, unsigned index,
+                                KTestObject *o) {
+  unsigned char tag, encoding;
+  PackRecord record;
+  const char *stored;
+
+  if (index >= r->objectOffsets.size() ||
+      !read_record(r->f, r->objectOffsets[index], &tag, record) ||
+      tag != KPACK_OBJECT || !record.getUInt8(&encoding) ||
+      !record.getUInt32(&o->numBytes))
+    return 0;
+  size_t storedSize = record.data.size() - record.pos;
+  if (!record.getBytes(storedSize, &stored))
+    return 0;
+
+  o->bytes = (unsigned char*) malloc(o->numBytes ? o->numBytes : 1);
+  if (!o->bytes)
+    return 0;
+  if (encoding == KPACK_RAW) {
+    if (storedSize != o->numBytes)
+      return 0;
+    memcpy(o->bytes, stored, storedSize);
+    return 1;
+  }
+#ifdef HAVE_ZLIB_H
+  if (encoding == KPACK_ZLIB) {
+    uLongf size = o->numBytes;
+    if (uncompress(o->bytes, &size, (const Bytef *) stored, storedSize) != Z_OK)
+      return 0;
+    return size == o->numBytes;
+  }
+#endif
+  return 0;
+}
+
+KTest *kTestPack_get(KTestPackReader *r, unsigned index) {
+  unsigned char tag;
+  PackRecord record;
+  std::string name;
+  unsigned i;
+
+  if (index >= r->tests.size() ||
+      !read_record(r->f, r->tests[index].second, &tag, record) ||
+      tag != KPACK_TEST || !record.getString(name))
+    return 0;
+
+  KTest *res = (KTest*) calloc(1, sizeof(*res));
+  if (!res)
+    return 0;
+  res->version = KTEST_VERSION;
+
+  if (!record.getUInt32(&res->numArgs))
+    goto error;
+  res->args = (char**) calloc(res->numArgs, sizeof(*res->args));
+  if (!res->args)
+    goto error;
+  for (i=0; i<res->numArgs; i++)
+    if (!(res->args[i] = record.getCString()))
+      goto error;
+
+  if (!record.getUInt32(&res->symArgvs) ||
+      !record.getUInt32(&res->symArgvLen) ||
+      !record.getUInt32(&res->numObjects))
+    goto error;
+  res->objects = (KTestObject*) calloc(res->numObjects, sizeof(*res->objects));
+  if (!res->objects)
+    goto error;
+  for (i=0; i<res->numObjects; i++) {
+    KTestObject *o = &res->objects[i];
+    unsigned object;
+    if (!(o->name = record.getCString()) || !record.getUInt32(&object) ||
+        !kTestPack_readObject(r, object, o))
+      goto error;
+  }
+
+  return res;
+ error:
+  // kTest_free relies on the counts, which may exceed what was read
+  if (res->args) {
+    for (i=0; i<res->numArgs; i++)
+      free(res->args[i]);
+    free(res->args);
+  }
+  if (res->objects) {
+    for (i=0; i<res->numObjects; i++) {
+      free(res->objects[i].name);
+      free(res->objects[i].bytes);
+    }
+    free(res->objects);
+  }
+  free(res);
+  return 0;
+}
+
+void kTestPack_free(KTestPackReader *r) {
+  fclose(r->f);
+  delete r;
+}
@@ -9,35 +9,78 @@
 
 #include "klee/Statistics.h"
 
+#include <cassert>
 #include <vector>
 
 using namespace klee;
 
+__thread StatisticShard *StatisticManager::threadShard = 0;
+
 StatisticManager::StatisticManager()
   : enabled(true),
-    globalStats(0),
-    indexedStats(0),
-    contextStats(0),
-    index(0) {
+    totalIndices(0) {
 }
 
 StatisticManager::~StatisticManager() {
-  if (globalStats) delete[] globalStats;
-  if (indexedStats) delete[] indexedStats;
+  if (primary.globalStats) delete[] primary.globalStats;
+  if (primary.indexedStats) delete[] primary.indexedStats;
+  for (unsigned i = 0, e = shards.size(); i != e; ++i) {
+    delete[] shards[i]->globalStats;
+    delete[] shards[i]->indexedStats;
+    delete shards[i];
+  }
+}
+
+void StatisticManager::allocateIndexedStats(StatisticShard &shard) {
+  if (shard.indexedStats) delete[] shard.indexedStats;
+  shard.indexedStats = new uint64_t[totalIndices * stats.size()];
+  memset(shard.indexedStats, 0,
+         sizeof(*shard.indexedStats) * totalIndices * stats.size());
 }
 
-void StatisticManager::useIndexedStats(unsigned totalIndices) {  
-  if (indexedStats) delete[] indexedStats;
-  indexedStats = new uint64_t[totalIndices * stats.size()];
-  memset(indexedStats, 0, sizeof(*indexedStats) * totalIndices * stats.size());
+void StatisticManager::useIndexedStats(unsigned _totalIndices) {  
+  llvm::sys::ScopedLock lock(shardsLock);
+  totalIndices = _totalIndices;
+  allocateIndexedStats(primary);
+  for (unsigned i = 0, e = shards.size(); i != e; ++i)
+    allocateIndexedStats(*shards[i]);
 }
 
 void StatisticManager::registerStatistic(Statistic &s) {
-  if (globalStats) delete[] globalStats;
+  llvm::sys::ScopedLock lock(shardsLock);
+  assert(shards.empty() && "statistics must be registered before threads attach");
+  if (primary.globalStats) delete[] primary.globalStats;
   s.id = stats.size();
   stats.push_back(&s);
-  globalStats = new uint64_t[stats.size()];
-  memset(globalStats, 0, sizeof(*globalStats)*stats.size());
+  primary.globalStats = new uint64_t[stats.size()];
+  memset(primary.globalStats, 0, sizeof(*primary.globalStats)*stats.size());
+}
+
+void StatisticManager::attachThread() {
+  assert(!threadShard && "thread already has its own statistics");
+  llvm::sys::ScopedLock lock(shardsLock);
+  if (!idleShards.empty()) {
+    threadShard = idleShards.back();
+    idleShards.pop_back();
+    return;
+  }
+
+  StatisticShard *shard = new StatisticShard();
+  shard->globalStats = new uint64_t[stats.size()];
+  memset(shard->globalStats, 0, sizeof(*shard->globalStats)*stats.size());
+  if (primary.indexedStats)
+    allocateIndexedStats(*shard);
+  shards.push_back(shard);
+  threadShard = shard;
+}
+
+void StatisticManager::detachThread() {
+  assert(threadShard && "thread has no statistics of its own");
+  llvm::sys::ScopedLock lock(shardsLock);
+  threadShard->contextStats = 0;
+  threadShard->index = 0;
+  idleShards.push_back(threadShard);
+  threadShard = 0;
 }
 
 int StatisticManager::getStatisticID(const std::string &name) const {
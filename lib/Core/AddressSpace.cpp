@@ -14,19 +14,186 @@
 
 #include "klee/Expr.h"
 #include "klee/TimerStatIncrementer.h"
+#include "klee/Internal/Support/IntEvaluation.h"
+#include "klee/util/ExprRangeEvaluator.h"
+
+#include <algorithm>
 
 using namespace klee;
 
+namespace {
+/// AddressRange - A sound interval for the values an expression can take,
+/// ignoring the path constraints, used to bound the objects a symbolic
+/// pointer can resolve to without asking the solver.
+class AddressRange {
+  uint64_t m_min, m_max;
+
+  static AddressRange full(unsigned width) {
+    return AddressRange(0, bits64::maxValueOfNBits(width > 64 ? 64 : width));
+  }
+
+  /// smear - Set every bit below the highest set bit of \a v.
+  static uint64_t smear(uint64_t v) {
+    for (unsigned shift = 1; shift < 64; shift <<= 1)
+      v |= v >> shift;
+    return v;
+  }
+
+public:
+  AddressRange() : m_min(1), m_max(0) {}
+  AddressRange(const ref<ConstantExpr> &ce) {
+    if (ce->getWidth() <= 64) {
+      m_min = m_max = ce->getZExtValue();
+    } else {
+      m_min = 0;
+      m_max = UINT64_MAX;
+    }
+  }
+  AddressRange(uint64_t value) : m_min(value), m_max(value) {}
+  AddressRange(uint64_t _min, uint64_t _max) : m_min(_min), m_max(_max) {}
+
+  bool isEmpty() const { return m_min > m_max; }
+  bool isFixed() const { return m_min == m_max; }
+  bool isFullRange(unsigned bits) const { return *this == full(bits); }
+
+  uint64_t min() const {
+    assert(!isEmpty() && "cannot get minimum of empty range");
+    return m_min;
+  }
+  uint64_t max() const {
+    assert(!isEmpty() && "cannot get maximum of empty range");
+    return m_max;
+  }
+
+  bool operator==(const AddressRange &b) const {
+    return m_min == b.m_min && m_max == b.m_max;
+  }
+
+  bool mustEqual(uint64_t b) const { return isFixed() && m_min == b; }
+  bool mayEqual(uint64_t b) const { return m_min <= b && b <= m_max; }
+  bool mustEqual(const AddressRange &b) const {
+    return isFixed() && b.isFixed() && m_min == b.m_min;
+  }
+  bool mayEqual(const AddressRange &b) const {
+    return std::max(m_min, b.m_min) <= std::min(m_max, b.m_max);
+  }
+
+  AddressRange set_union(const AddressRange &b) const {
+    if (isEmpty())
+      return b;
+    if (b.isEmpty())
+      return *this;
+    return AddressRange(std::min(m_min, b.m_min), std::max(m_max, b.m_max));
+  }
+
+  AddressRange add(const AddressRange &b, unsigned width) const {
+    uint64_t limit = full(width).m_max;
+    if (width > 64 || m_max > limit - b.m_max)
+      return full(width);
+    return AddressRange(m_min + b.m_min, m_max + b.m_max);
+  }
+  AddressRange sub(const AddressRange &b, unsigned width) const {
+    if (width > 64 || m_min < b.m_max)
+      return full(width);
+    return AddressRange(m_min - b.m_max, m_max - b.m_min);
+  }
+  AddressRange mul(const AddressRange &b, unsigned width) const {
+    uint64_t limit = full(width).m_max;
+    if (width > 64 || (m_max && b.m_max > limit / m_max))
+      return full(width);
+    return AddressRange(m_min * b.m_min, m_max * b.m_max);
+  }
+  AddressRange udiv(const AddressRange &b, unsigned width) const {
+    if (width > 64 || !b.m_min)
+      return full(width);
+    return AddressRange(m_min / b.m_max, m_max / b.m_min);
+  }
+  AddressRange urem(const AddressRange &b, unsigned width) const {
+    if (width > 64 || !b.m_min)
+      return full(width);
+    return AddressRange(0, std::min(m_max, b.m_max - 1));
+  }
+  AddressRange sdiv(const AddressRange &b, unsigned width) const {
+    return full(width);
+  }
+  AddressRange srem(const AddressRange &b, unsigned width) const {
+    return full(width);
+  }
+
+  AddressRange binaryAnd(const AddressRange &b) const {
+    if (isFixed() && b.isFixed())
+      return AddressRange(m_min & b.m_min);
+    return AddressRange(0, std::min(m_max, b.m_max));
+  }
+  AddressRange binaryOr(const AddressRange &b) const {
+    if (isFixed() && b.isFixed())
+      return AddressRange(m_min | b.m_min);
+    return AddressRange(std::max(m_min, b.m_min), smear(m_max | b.m_max));
+  }
+  AddressRange binaryXor(const AddressRange &b) const {
+    if (isFixed() && b.isFixed())
+      return AddressRange(m_min ^ b.m_min);
+    return AddressRange(0, smear(m_max | b.m_max));
+  }
+
+  /// concat - The range of this value followed by \a bits low bits from
+  /// \a b.
+  AddressRange concat(const AddressRange &b, unsigned bits) const {
+    if (!m_max)
+      return b;
+    if (bits >= 64 || m_max > (UINT64_MAX >> bits))
+      return full(64);
+    return AddressRange((m_min << bits) + b.m_min, (m_max << bits) + b.m_max);
+  }
+
+  int64_t minSigned(unsigned bits) const {
+    uint64_t smallest = ((uint64_t) 1 << (bits - 1));
+    if (m_max >= smallest)
+      return ints::sext(smallest, 64, bits);
+    return m_min;
+  }
+  int64_t maxSigned(unsigned bits) const {
+    uint64_t smallest = ((uint64_t) 1 << (bits - 1));
+    if (m_min < smallest && m_max >= smallest)
+      return smallest - 1;
+    return ints::sext(m_max, 64, bits);
+  }
+};
+
+class AddressRangeEvaluator : public ExprRangeEvaluator<AddressRange> {
+protected:
+  AddressRange getInitialReadRange(const Array &array, AddressRange index) {
+    if (array.isConstantArray() && index.max() < array.size &&
+        index.max() - index.min() < 256) {
+      AddressRange res;
+      for (uint64_t i = index.min(); i <= index.max(); ++i)
+        res = res.set_union(AddressRange(array.constantValues[i]));
+      return res;
+    }
+    return AddressRange(0, bits64::maxValueOfNBits(array.range));
+  }
+};
+
+/// mayPointInto - Return false if no pointer within \a range is in bounds
+/// of \a mo.
+bool mayPointInto(const AddressRange &range, const MemoryObject *mo) {
+  return mo->address <= range.max() &&
+         mo->address + std::max(mo->size, 1u) > range.min();
+}
+}
+
 ///
 
 void AddressSpace::bindObject(const MemoryObject *mo, ObjectState *os) {
   assert(os->copyOnWriteOwner==0 && "object already has owner");
   os->copyOnWriteOwner = cowKey;
   objects = objects.replace(std::make_pair(mo, os));
+  clearResolutionCache();
 }
 
 void AddressSpace::unbindObject(const MemoryObject *mo) {
   objects = objects.remove(mo);
+  clearResolutionCache();
 }
 
 const ObjectState *AddressSpace::findObject(const MemoryObject *mo) const {
@@ -45,6 +212,7 @@ ObjectState *AddressSpace::getWriteable(const MemoryObject *mo,
     ObjectState *n = new ObjectState(*os);
     n->copyOnWriteOwner = cowKey;
     objects = objects.replace(std::make_pair(mo, n));
+    clearResolutionCache();
     return n;    
   }
 }
@@ -54,6 +222,20 @@ ObjectState *AddressSpace::getWriteable(const MemoryObject *mo,
 bool AddressSpace::resolveOne(const ref<ConstantExpr> &addr, 
                               ObjectPair &result) {
   uint64_t address = addr->getZExtValue();
+
+  for (unsigned i = 0; i != ResolutionCacheSize; ++i) {
+    const MemoryObject *mo = resolutionCache[i].first;
+    if (!mo)
+      break;
+    if ((mo->size==0 && address==mo->address) ||
+        (address - mo->address < mo->size)) {
+      ++stats::resolutionCacheHits;
+      result = resolutionCache[i];
+      return true;
+    }
+  }
+  ++stats::resolutionCacheMisses;
+
   MemoryObject hack(address);
 
   if (const MemoryMap::value_type *res = objects.lookup_previous(&hack)) {
@@ -63,6 +245,10 @@ bool AddressSpace::resolveOne(const ref<ConstantExpr> &addr,
     if ((mo->size==0 && address==mo->address) ||
         (address - mo->address < mo->size)) {
       result = *res;
+      std::copy_backward(resolutionCache,
+                         resolutionCache + ResolutionCacheSize - 1,
+                         resolutionCache + ResolutionCacheSize);
+      resolutionCache[0] = result;
       return true;
     }
   }
@@ -99,7 +285,10 @@ bool AddressSpace::resolveOne(ExecutionState &state,
       }
     }
 
-    // didn't work, now we have to search
+    // didn't work, now we have to search, but only through the objects a
+    // pointer within its range could be in bounds of; as they are disjoint
+    // and ordered by address, those are adjacent.
+    AddressRange range = AddressRangeEvaluator().evaluate(address);
        
     MemoryMap::iterator oi = objects.upper_bound(&hack);
     MemoryMap::iterator begin = objects.begin();
@@ -109,6 +298,8 @@ bool AddressSpace::resolveOne(ExecutionState &state,
     while (oi!=begin) {
       --oi;
       const MemoryObject *mo = oi->first;
+      if (!mayPointInto(range, mo))
+        break;
         
       bool mayBeTrue;
       if (!solver->mayBeTrue(state, 
@@ -119,6 +310,8 @@ bool AddressSpace::resolveOne(ExecutionState &state,
         success = true;
         return true;
       } else {
+        if (range.min() >= mo->address)
+          break;
         bool mustBeTrue;
         if (!solver->mustBeTrue(state, 
                                 UgeExpr::create(address, mo->getBaseExpr()),
@@ -132,6 +325,8 @@ bool AddressSpace::resolveOne(ExecutionState &state,
     // search forwards
     for (oi=start; oi!=end; ++oi) {
       const MemoryObject *mo = oi->first;
+      if (!mayPointInto(range, mo))
+        break;
 
       bool mustBeTrue;
       if (!solver->mustBeTrue(state, 
@@ -195,6 +390,11 @@ bool AddressSpace::resolve(ExecutionState &state,
       return true;
     uint64_t example = cast<ConstantExpr>(cex)->getZExtValue();
     MemoryObject hack(example);
+
+    // Only the objects a pointer within this range could be in bounds of
+    // are queried; as they are disjoint and ordered by address, those are
+    // adjacent.
+    AddressRange range = AddressRangeEvaluator().evaluate(p);
     
     MemoryMap::iterator oi = objects.upper_bound(&hack);
     MemoryMap::iterator begin = objects.begin();
@@ -213,6 +413,8 @@ bool AddressSpace::resolve(ExecutionState &state,
     while (oi!=begin) {
       --oi;
       const MemoryObject *mo = oi->first;
+      if (!mayPointInto(range, mo))
+        break;
       if (timeout_us && timeout_us < timer.check())
         return true;
 
@@ -237,6 +439,8 @@ bool AddressSpace::resolve(ExecutionState &state,
         }
       }
         
+      if (range.min() >= mo->address)
+        break;
       bool mustBeTrue;
       if (!solver->mustBeTrue(state, 
                               UgeExpr::create(p, mo->getBaseExpr()),
@@ -248,6 +452,8 @@ bool AddressSpace::resolve(ExecutionState &state,
     // search forwards
     for (oi=start; oi!=end; ++oi) {
       const MemoryObject *mo = oi->first;
+      if (!mayPointInto(range, mo))
+        break;
       if (timeout_us && timeout_us < timer.check())
         return true;
 
@@ -300,13 +506,20 @@ void AddressSpace::copyOutConcretes() {
       ObjectState *os = it->second;
       uint8_t *address = (uint8_t*) (unsigned long) mo->address;
 
-      if (!os->readOnly)
-        memcpy(address, os->concreteStore, mo->size);
+      // Skip the objects whose contents are there already, copied out or
+      // in by this or another state sharing them.
+      if (!os->readOnly && mo->nativeGeneration != os->generation) {
+        os->copyConcreteStoreTo(address);
+        mo->nativeGeneration = os->generation;
+      }
     }
   }
 }
 
 bool AddressSpace::copyInConcretes() {
+  // Every object is compared, also after finding a modified read-only one,
+  // so that all of them are known to match their native memory afterwards.
+  bool success = true;
   for (MemoryMap::iterator it = objects.begin(), ie = objects.end(); 
        it != ie; ++it) {
     const MemoryObject *mo = it->first;
@@ -315,17 +528,37 @@ bool AddressSpace::copyInConcretes() {
       const ObjectState *os = it->second;
       uint8_t *address = (uint8_t*) (unsigned long) mo->address;
 
-      if (memcmp(address, os->concreteStore, mo->size)!=0) {
+      if (!os->concreteStoreEquals(address)) {
         if (os->readOnly) {
-          return false;
+          mo->nativeGeneration = 0;
+          success = false;
         } else {
           ObjectState *wos = getWriteable(mo, os);
-          memcpy(wos->concreteStore, address, mo->size);
+          wos->copyConcreteStoreFrom(address);
+          mo->nativeGeneration = wos->generation;
         }
+      } else if (!os->readOnly) {
+        mo->nativeGeneration = os->generation;
       }
     }
   }
 
+  return success;
+}
+
+void AddressSpace::forgetNativeConcretes() {
+  for (MemoryMap::iterator it = objects.begin(), ie = objects.end();
+       it != ie; ++it)
+    it->first->nativeGeneration = 0;
+}
+
+bool AddressSpace::hasOnlyConcretes() const {
+  for (MemoryMap::iterator it = objects.begin(), ie = objects.end(); 
+       it != ie; ++it) {
+    const ObjectState *os = it->second;
+    if (it->first->isUserSpecified || !os->isAllConcrete())
+      return false;
+  }
   return true;
 }
 
@@ -40,6 +40,17 @@ namespace klee {
 
     /// Unsupported, use copy constructor
     AddressSpace &operator=(const AddressSpace&); 
+
+    /// The objects concrete addresses were last resolved to, most recently
+    /// added first, so that accesses to the same few objects need not look
+    /// them up in \ref objects. Cleared whenever \ref objects changes.
+    static const unsigned ResolutionCacheSize = 4;
+    ObjectPair resolutionCache[ResolutionCacheSize];
+
+    void clearResolutionCache() {
+      for (unsigned i = 0; i != ResolutionCacheSize; ++i)
+        resolutionCache[i] = ObjectPair(0, 0);
+    }
     
   public:
     /// The MemoryObject -> ObjectState map that constitutes the
@@ -52,8 +63,10 @@ namespace klee {
     MemoryMap objects;
     
   public:
-    AddressSpace() : cowKey(1) {}
-    AddressSpace(const AddressSpace &b) : cowKey(++b.cowKey), objects(b.objects) { }
+    AddressSpace() : cowKey(1) { clearResolutionCache(); }
+    AddressSpace(const AddressSpace &b) : cowKey(++b.cowKey), objects(b.objects) {
+      clearResolutionCache();
+    }
     ~AddressSpace() {}
 
     /// Resolve address to an ObjectPair in result.
@@ -113,7 +126,9 @@ namespace klee {
     ObjectState *getWriteable(const MemoryObject *mo, const ObjectState *os);
 
     /// Copy the concrete values of all managed ObjectStates into the
-    /// actual system memory location they were allocated at.
+    /// actual system memory location they were allocated at. Objects whose
+    /// memory holds their contents since the last copy, out or in, are
+    /// skipped.
     void copyOutConcretes();
 
     /// Copy the concrete values of all managed ObjectStates back from
@@ -125,6 +140,15 @@ namespace klee {
     /// \retval true The copy succeeded. 
     /// \retval false The copy failed because a read-only object was modified.
     bool copyInConcretes();
+
+    /// Forget which contents the memory of the objects holds, after native
+    /// code may have changed it without copyInConcretes seeing it.
+    void forgetNativeConcretes();
+
+    /// Whether every ObjectState is concrete and copied out by
+    /// copyOutConcretes, so that native code sees the same memory as the
+    /// interpreter.
+    bool hasOnlyConcretes() const;
   };
 } // End klee namespace
 
@@ -0,0 +1,110 @@
+//===-- CallMemo.cpp ------------------------------------------------------===//
+//
+//                     The KLEE Symbolic Virtual Machine
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+
+#include "CallMemo.h"
+
+#include "klee/Config/Version.h"
+#include "klee/Internal/Support/ErrorHandling.h"
+
+#if LLVM_VERSION_CODE >= LLVM_VERSION(3, 3)
+#include "llvm/IR/Module.h"
+#else
+#include "llvm/Module.h"
+#endif
+#include "llvm/Support/CommandLine.h"
+
+#include <fstream>
+#include <sstream>
+
+using namespace klee;
+using namespace llvm;
+
+namespace {
+  cl::opt<unsigned>
+  MaxMemoizedCalls("max-memoized-calls",
+                   cl::desc("Number of effects of pure calls to memoize, "
+                            "after which the memo starts over, 0 for no "
+                            "limit (default=65536)"),
+                   cl::init(65536));
+}
+
+// Calls with the same arguments reading different memory, e.g. a buffer
+// being filled, keep at most this many effects, the most recent ones.
+static const unsigned MaxEffectsPerCall = 4;
+
+bool CallMemo::load(const std::string &path, Module *module,
+                    std::string &error) {
+  std::ifstream f(path.c_str());
+  if (!f.good()) {
+    error = "unable to open " + path;
+    return false;
+  }
+
+  std::string line;
+  while (std::getline(f, line)) {
+    std::string::size_type comment = line.find('#');
+    if (comment != std::string::npos)
+      line.erase(comment);
+
+    std::istringstream fields(line);
+    std::string name;
+    if (!(fields >> name))
+      continue;
+
+    Function *fn = module->getFunction(name);
+    if (!fn || fn->isDeclaration())
+      klee_warning("%s: no defined function named %s", path.c_str(),
+                   name.c_str());
+    else
+      markPure(fn);
+  }
+  return true;
+}
+
+const CallMemo::Effects *CallMemo::lookup(const PureCall &call) const {
+  std::map<PureCall, Effects>::const_iterator it = effects.find(call);
+  return it == effects.end() ? 0 : &it->second;
+}
+
+/// Append the bytes of \a bytes, by address, to \a runs as runs of bytes at
+/// consecutive addresses.
+static void appendRuns(const std::map<uint64_t, uint8_t> &bytes,
+                       std::vector<CallMemo::Bytes> &runs) {
+  for (std::map<uint64_t, uint8_t>::const_iterator it = bytes.begin(),
+         ie = bytes.end(); it != ie; ++it) {
+    if (runs.empty() ||
+        runs.back().address + runs.back().values.size() != it->first) {
+      runs.push_back(CallMemo::Bytes());
+      runs.back().address = it->first;
+    }
+    runs.back().values.push_back(it->second);
+  }
+}
+
+void CallMemo::insert(const CallRecording &recording, const ref<Expr> &result,
+                      int fpExceptions) {
+  if (MaxMemoizedCalls && numEffects >= MaxMemoizedCalls) {
+    effects.clear();
+    numEffects = 0;
+  }
+
+  Effects &callEffects = effects[recording.call];
+  if (callEffects.size() == MaxEffectsPerCall) {
+    callEffects.erase(callEffects.begin());
+    --numEffects;
+  }
+
+  callEffects.push_back(Effect());
+  Effect &effect = callEffects.back();
+  appendRuns(recording.reads, effect.reads);
+  appendRuns(recording.writes, effect.writes);
+  effect.result = result;
+  effect.fpExceptions = fpExceptions;
+  ++numEffects;
+}
@@ -0,0 +1,84 @@
+//===-- CallMemo.h ----------------------------------------------*- C++ -*-===//
+//
+//                     The KLEE Symbolic Virtual Machine
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+
+#ifndef KLEE_CALLMEMO_H
+#define KLEE_CALLMEMO_H
+
+#include "klee/ExecutionState.h"
+
+#include <map>
+#include <set>
+#include <string>
+#include <vector>
+
+#include <stdint.h>
+
+namespace llvm {
+  class Function;
+  class Module;
+}
+
+namespace klee {
+  /// CallMemo - The effects of the calls of pure functions made so far, for
+  /// later calls with the same concrete arguments to reuse instead of
+  /// running the function again (see -pure-functions).
+  ///
+  /// A pure function only reads and writes memory, without calling
+  /// functions the interpreter models. An effect is kept with the bytes the
+  /// call read from its caller, and is reused by a call finding the same
+  /// bytes in memory. It consists of the bytes the call wrote, its result
+  /// and the floating-point exceptions raised once it returned.
+  class CallMemo {
+  public:
+    /// Bytes at consecutive addresses.
+    struct Bytes {
+      uint64_t address;
+      std::vector<uint8_t> values;
+    };
+
+    struct Effect {
+      std::vector<Bytes> reads, writes;
+      /// The result of the call, null if it returns void.
+      ref<Expr> result;
+      int fpExceptions;
+    };
+
+    typedef std::vector<Effect> Effects;
+
+  private:
+    std::set<const llvm::Function *> pureFunctions;
+    std::map<PureCall, Effects> effects;
+    size_t numEffects;
+
+  public:
+    CallMemo() : numEffects(0) {}
+
+    bool isPure(const llvm::Function *f) const {
+      return !pureFunctions.empty() && pureFunctions.count(f);
+    }
+    void markPure(const llvm::Function *f) { pureFunctions.insert(f); }
+
+    /// load - Mark the functions of \a module named in the file at \a path,
+    /// one per line, as pure.
+    bool load(const std::string &path, llvm::Module *module,
+              std::string &error);
+
+    /// lookup - The effects memoized for \a call, most recent last, or null
+    /// if there are none.
+    const Effects *lookup(const PureCall &call) const;
+
+    /// insert - Memoize the effect of the call \a recording recorded, once
+    /// it returned \a result with the floating-point exceptions
+    /// \a fpExceptions raised.
+    void insert(const CallRecording &recording, const ref<Expr> &result,
+                int fpExceptions);
+  };
+}
+
+#endif
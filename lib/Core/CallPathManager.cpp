@@ -11,8 +11,9 @@
 
 #include "klee/Statistics.h"
 
+#include "llvm/Support/CommandLine.h"
+
 #include <map>
-#include <vector>
 #if LLVM_VERSION_CODE >= LLVM_VERSION(3, 3)
 #include "llvm/IR/Function.h"
 #else
@@ -24,6 +25,16 @@
 using namespace llvm;
 using namespace klee;
 
+namespace {
+  cl::opt<unsigned>
+  MaxCallPathNodes("max-call-path-nodes",
+                   cl::desc("Maximum number of call paths tracked with "
+                            "-use-call-paths. Beyond it, new call paths are "
+                            "merged into one per call site and function, so "
+                            "that memory stays bounded (default=0 (off))"),
+                   cl::init(0));
+}
+
 ///
 
 CallPathNode::CallPathNode(CallPathNode *_parent, 
@@ -52,22 +63,19 @@ CallPathManager::CallPathManager() : root(0, 0, 0) {
 }
 
 CallPathManager::~CallPathManager() {
-  for (std::vector<CallPathNode*>::iterator it = paths.begin(),
-         ie = paths.end(); it != ie; ++it)
-    delete *it;
 }
 
 void CallPathManager::getSummaryStatistics(CallSiteSummaryTable &results) {
   results.clear();
 
-  for (std::vector<CallPathNode*>::iterator it = paths.begin(),
+  for (std::deque<CallPathNode>::iterator it = paths.begin(),
          ie = paths.end(); it != ie; ++it)
-    (*it)->summaryStatistics = (*it)->statistics;
+    it->summaryStatistics = it->statistics;
 
   // compute summary bottom up, while building result table
-  for (std::vector<CallPathNode*>::reverse_iterator it = paths.rbegin(),
+  for (std::deque<CallPathNode>::reverse_iterator it = paths.rbegin(),
          ie = paths.rend(); it != ie; ++it) {
-    CallPathNode *cp = *it;
+    CallPathNode *cp = &*it;
     cp->parent->summaryStatistics += cp->summaryStatistics;
 
     CallSiteInfo &csi = results[cp->callSite][cp->function];
@@ -84,9 +92,8 @@ CallPathNode *CallPathManager::computeCallPath(CallPathNode *parent,
     if (cs==p->callSite && f==p->function)
       return p;
   
-  CallPathNode *cp = new CallPathNode(parent, cs, f);
-  paths.push_back(cp);
-  return cp;
+  paths.push_back(CallPathNode(parent, cs, f));
+  return &paths.back();
 }
 
 CallPathNode *CallPathManager::getCallPath(CallPathNode *parent, 
@@ -98,6 +105,12 @@ CallPathNode *CallPathManager::getCallPath(CallPathNode *parent,
   
   CallPathNode::children_ty::iterator it = parent->children.find(key);
   if (it==parent->children.end()) {
+    // Past the limit, only the call paths directly under the root, one per
+    // call site and function, are still created.
+    if (MaxCallPathNodes && paths.size() >= MaxCallPathNodes &&
+        parent != &root)
+      return getCallPath(&root, cs, f);
+
     CallPathNode *cp = computeCallPath(parent, cs, f);
     parent->children.insert(std::make_pair(key, cp));
     return cp;
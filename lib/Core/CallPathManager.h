@@ -12,8 +12,10 @@
 
 #include "klee/Statistics.h"
 
+#include "llvm/ADT/DenseMap.h"
+
+#include <deque>
 #include <map>
-#include <vector>
 
 namespace llvm {
   class Instruction;
@@ -38,8 +40,10 @@ namespace klee {
     friend class CallPathManager;
 
   public:
-    typedef std::map<std::pair<llvm::Instruction*, 
-                               llvm::Function*>, CallPathNode*> children_ty;
+    // Most call paths have a handful of children, which are kept inline.
+    typedef llvm::SmallDenseMap<std::pair<llvm::Instruction*,
+                                          llvm::Function*>,
+                                CallPathNode*, 4> children_ty;
 
     // form list of (callSite,function) path
     CallPathNode *parent;
@@ -61,7 +65,9 @@ namespace klee {
 
   class CallPathManager {
     CallPathNode root;
-    std::vector<CallPathNode*> paths;
+    /// The call paths in the order they were created, parents first. A deque
+    /// allocates them in chunks and never moves them.
+    std::deque<CallPathNode> paths;
 
   private:
     CallPathNode *computeCallPath(CallPathNode *parent, 
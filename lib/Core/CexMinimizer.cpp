@@ -0,0 +1,194 @@
+//===-- CexMinimizer.cpp --------------------------------------------------===//
+//
+//                     The KLEE Symbolic Virtual Machine
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+
+#include "CexMinimizer.h"
+
+#include "klee/Constraints.h"
+#include "klee/Internal/System/Time.h"
+#include "klee/util/Assignment.h"
+#include "klee/util/ExprUtil.h"
+
+#include <cmath>
+#include <limits>
+#include <map>
+#include <stdint.h>
+#include <string.h>
+
+using namespace klee;
+
+namespace {
+/// Checks changes to one object of a counterexample against the constraints
+/// and preferences that read it, keeping the bytes of all other objects.
+class CandidateChecker {
+  const std::vector<const Array *> &objects;
+  std::vector<std::vector<unsigned char> > &values;
+  // The constraints which read each object.
+  std::vector<std::vector<ref<Expr> > > relevant;
+  // The preferences of each object that have to stay satisfied.
+  std::vector<std::vector<ref<Expr> > > preferred;
+
+  bool holds(const std::vector<ref<Expr> > &exprs) {
+    Assignment a(objects, values);
+    return a.satisfies(exprs.begin(), exprs.end());
+  }
+
+public:
+  CandidateChecker(const ConstraintManager &constraints,
+                   const std::vector<const Array *> &_objects,
+                   const std::vector<std::vector<ref<Expr> > > &preferences,
+                   std::vector<std::vector<unsigned char> > &_values)
+      : objects(_objects), values(_values), relevant(_objects.size()),
+        preferred(_objects.size()) {
+    std::map<const Array *, unsigned> index;
+    for (unsigned i = 0; i != objects.size(); ++i)
+      index[objects[i]] = i;
+
+    for (ConstraintManager::const_iterator it = constraints.begin(),
+                                           ie = constraints.end();
+         it != ie; ++it) {
+      std::vector<const Array *> reads;
+      findSymbolicObjects(*it, reads);
+      for (unsigned i = 0; i != reads.size(); ++i) {
+        std::map<const Array *, unsigned>::iterator pos = index.find(reads[i]);
+        if (pos != index.end())
+          relevant[pos->second].push_back(*it);
+      }
+    }
+
+    for (unsigned i = 0; i != objects.size() && i != preferences.size(); ++i)
+      for (unsigned j = 0; j != preferences[i].size(); ++j)
+        if (holds(std::vector<ref<Expr> >(1, preferences[i][j])))
+          preferred[i].push_back(preferences[i][j]);
+  }
+
+  /// Replace the bytes of object \a i with \a candidate if that keeps its
+  /// constraints and preferences satisfied.
+  bool tryCandidate(unsigned i, const std::vector<unsigned char> &candidate) {
+    if (candidate == values[i])
+      return false;
+    std::vector<unsigned char> old;
+    old.swap(values[i]);
+    values[i] = candidate;
+    if (holds(relevant[i]) && holds(preferred[i]))
+      return true;
+    values[i].swap(old);
+    return false;
+  }
+};
+}
+
+/// Simpler values for a float with the bytes \a bytes, best first.
+template <typename T>
+static void getFloatCandidates(const std::vector<unsigned char> &bytes,
+                               std::vector<std::vector<unsigned char> > &res) {
+  T value;
+  memcpy(&value, &bytes[0], sizeof(T));
+  bool negative = std::signbit(value);
+
+  std::vector<T> candidates;
+  switch (std::fpclassify(value)) {
+  case FP_NAN:
+    candidates.push_back(negative ? -std::numeric_limits<T>::quiet_NaN()
+                                  : std::numeric_limits<T>::quiet_NaN());
+    break;
+  case FP_SUBNORMAL:
+    candidates.push_back(negative ? -T(0) : T(0));
+    candidates.push_back(negative ? -std::numeric_limits<T>::min()
+                                  : std::numeric_limits<T>::min());
+    break;
+  case FP_NORMAL:
+    // Integral values first, then fewer significant digits.
+    if (std::fabs(value) < T(1) / std::numeric_limits<T>::epsilon()) {
+      candidates.push_back(std::trunc(value));
+      candidates.push_back(std::round(value));
+      candidates.push_back(std::round(value * T(10)) / T(10));
+    }
+    break;
+  default:
+    break;
+  }
+
+  for (unsigned i = 0; i != candidates.size(); ++i) {
+    std::vector<unsigned char> candidate(sizeof(T));
+    memcpy(&candidate[0], &candidates[i], sizeof(T));
+    res.push_back(candidate);
+  }
+}
+
+/// Whether \a bytes, taken as a float of type \a T, are a subnormal or a
+/// NaN other than the canonical one.
+template <typename T, typename Bits>
+static bool isOddFloat(const std::vector<unsigned char> &bytes) {
+  T value;
+  memcpy(&value, &bytes[0], sizeof(T));
+  if (std::fpclassify(value) == FP_SUBNORMAL)
+    return true;
+  if (!std::isnan(value))
+    return false;
+
+  T canonical = std::numeric_limits<T>::quiet_NaN();
+  Bits bits, canonicalBits;
+  memcpy(&bits, &value, sizeof(T));
+  memcpy(&canonicalBits, &canonical, sizeof(T));
+  Bits sign = Bits(1) << (sizeof(T) * 8 - 1);
+  return (bits & ~sign) != canonicalBits;
+}
+
+static bool isOddFloat(const std::vector<unsigned char> &bytes) {
+  if (bytes.size() == sizeof(float))
+    return isOddFloat<float, uint32_t>(bytes);
+  if (bytes.size() == sizeof(double))
+    return isOddFloat<double, uint64_t>(bytes);
+  return false;
+}
+
+void CexMinimizer::minimize(
+    const ConstraintManager &constraints,
+    const std::vector<const Array *> &objects,
+    const std::vector<std::vector<ref<Expr> > > &preferences,
+    std::vector<std::vector<unsigned char> > &values, double timeBudget) {
+  double deadline = util::getWallTime() + timeBudget;
+  CandidateChecker checker(constraints, objects, preferences, values);
+
+  for (unsigned i = 0; i != objects.size(); ++i) {
+    if (util::getWallTime() > deadline)
+      return;
+    if (values[i].empty())
+      continue;
+
+    // The whole object at zero is as simple as it gets.
+    if (checker.tryCandidate(i, std::vector<unsigned char>(values[i].size())))
+      continue;
+
+    std::vector<std::vector<unsigned char> > candidates;
+    if (values[i].size() == sizeof(float))
+      getFloatCandidates<float>(values[i], candidates);
+    else if (values[i].size() == sizeof(double))
+      getFloatCandidates<double>(values[i], candidates);
+    for (unsigned c = 0; c != candidates.size(); ++c)
+      if (checker.tryCandidate(i, candidates[c]))
+        break;
+
+    // Then clear as many single bytes as possible, without turning what
+    // might be a float into an odd one.
+    bool odd = isOddFloat(values[i]);
+    for (unsigned b = 0; b != values[i].size(); ++b) {
+      if (!values[i][b])
+        continue;
+      if (util::getWallTime() > deadline)
+        return;
+      std::vector<unsigned char> candidate(values[i]);
+      candidate[b] = 0;
+      if (!odd && isOddFloat(candidate))
+        continue;
+      if (checker.tryCandidate(i, candidate))
+        odd = isOddFloat(candidate);
+    }
+  }
+}
@@ -0,0 +1,41 @@
+//===-- CexMinimizer.h ------------------------------------------*- C++ -*-===//
+//
+//                     The KLEE Symbolic Virtual Machine
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+
+#ifndef KLEE_CEXMINIMIZER_H
+#define KLEE_CEXMINIMIZER_H
+
+#include "klee/Expr.h"
+
+#include <vector>
+
+// Solvers return whatever model they find first, which for floats is often a
+// subnormal or a NaN with an odd payload. Such values make test cases noisy
+// and slow to replay on hardware. This module moves a counterexample towards
+// simpler values (zeros, canonical NaNs, normal and integral floats) where
+// that keeps the constraints satisfied, checking candidates by evaluation
+// rather than with the solver.
+
+namespace klee {
+  class Array;
+  class ConstraintManager;
+
+  namespace CexMinimizer {
+    /// minimize - Simplify \a values, the bytes of \a objects, while they
+    /// still satisfy \a constraints and every preference in
+    /// \a preferences[i] that object i satisfied to begin with. Gives up
+    /// after \a timeBudget seconds.
+    void minimize(const ConstraintManager &constraints,
+                  const std::vector<const Array *> &objects,
+                  const std::vector<std::vector<ref<Expr> > > &preferences,
+                  std::vector<std::vector<unsigned char> > &values,
+                  double timeBudget);
+  }
+}
+
+#endif
@@ -12,18 +12,42 @@
 using namespace klee;
 
 Statistic stats::allocations("Allocations", "Alloc");
+Statistic stats::boundsMemoHits("BoundsMemoHits", "BChits");
+Statistic stats::branchMemoHits("BranchMemoHits", "BMhits");
 Statistic stats::coveredInstructions("CoveredInstructions", "Icov");
 Statistic stats::falseBranches("FalseBranches", "Bf");
+Statistic stats::floatClassesCovered("FloatClassesCovered", "FPcov");
+Statistic stats::floatConcretizations("FloatConcretizations", "FPconc");
 Statistic stats::forkTime("ForkTime", "Ftime");
 Statistic stats::forks("Forks", "Forks");
+Statistic stats::forksConcretized("ForksConcretized", "Fconc");
+Statistic stats::forksDeferred("ForksDeferred", "Fdefer");
+Statistic stats::fusedInstructions("FusedInstructions", "Ifused");
 Statistic stats::instructionRealTime("InstructionRealTimes", "Ireal");
 Statistic stats::instructionTime("InstructionTimes", "Itime");
 Statistic stats::instructions("Instructions", "I");
+Statistic stats::loopExitsSummarized("LoopExitsSummarized", "LSexits");
+Statistic stats::memoizedCalls("MemoizedCalls", "Memo");
+Statistic stats::modelBranchHits("ModelBranchHits", "MBhits");
 Statistic stats::minDistToReturn("MinDistToReturn", "Rdist");
+Statistic stats::nativeCalls("NativeCalls", "Native");
 Statistic stats::minDistToUncovered("MinDistToUncovered", "UCdist");
 Statistic stats::reachableUncovered("ReachableUncovered", "IuncovReach");
+Statistic stats::reclaimedArrays("ReclaimedArrays", "ArrFreed");
+Statistic stats::resolutionCacheHits("ResolutionCacheHits", "RChits");
+Statistic stats::resolutionCacheMisses("ResolutionCacheMisses", "RCmisses");
 Statistic stats::resolveTime("ResolveTime", "Rtime");
+Statistic stats::sharedSymbolicArrays("SharedSymbolicArrays", "SymArrShared");
 Statistic stats::solverTime("SolverTime", "Stime");
+Statistic stats::searcherTime("SearcherTime", "SEtime");
+Statistic stats::searcherWeightUpdates("SearcherWeightUpdates", "SEweights");
+Statistic stats::mergedStates("MergedStates", "Merged");
+Statistic stats::shortenedTimeouts("ShortenedTimeouts", "TOshort");
 Statistic stats::states("States", "States");
+Statistic stats::symbolicArrays("SymbolicArrays", "SymArr");
+Statistic stats::timeoutMispredictions("TimeoutMispredictions", "TOmiss");
+Statistic stats::timeoutPredictions("TimeoutPredictions", "TOpred");
+Statistic stats::timeoutRetries("TimeoutRetries", "TOretry");
 Statistic stats::trueBranches("TrueBranches", "Bt");
 Statistic stats::uncoveredInstructions("UncoveredInstructions", "Iuncov");
+Statistic stats::uniqueValueHits("UniqueValueHits", "UVhits");
@@ -30,6 +30,79 @@ namespace stats {
   /// The number of process forks.
   extern Statistic forks;
 
+  /// Symbolic branches -fork-controller took one side of from a model, and
+  /// those it forked lazily.
+  extern Statistic forksConcretized;
+  extern Statistic forksDeferred;
+
+  /// Queries whose outcome -adaptive-solver-timeout predicted, and got
+  /// wrong.
+  extern Statistic timeoutPredictions;
+  extern Statistic timeoutMispredictions;
+
+  /// Queries given a shorter timeout by -adaptive-solver-timeout, and those
+  /// retried with the full one after it was not enough.
+  extern Statistic shortenedTimeouts;
+  extern Statistic timeoutRetries;
+
+  /// The time spent selecting states and updating the searchers, and the
+  /// number of times a state's weight was computed for a weighted searcher.
+  extern Statistic searcherTime;
+  extern Statistic searcherWeightUpdates;
+
+  /// Concrete addresses resolved by the per-state cache of recently used
+  /// objects, and those looked up in the address space instead.
+  extern Statistic resolutionCacheHits;
+  extern Statistic resolutionCacheMisses;
+
+  /// Calls of Executor::toUnique answered from the state's memo of earlier
+  /// ones, without asking the solver.
+  extern Statistic uniqueValueHits;
+
+  /// Branches Executor::fork decided from the state's memo of conditions it
+  /// found to be true or false, without asking the solver.
+  extern Statistic branchMemoHits;
+
+  /// Bounds checks of symbolic offsets answered from the state's memo of
+  /// offsets proved in bounds, without asking the solver.
+  extern Statistic boundsMemoHits;
+
+  /// Sides of branches Executor::fork found feasible by evaluating the
+  /// state's model (see -state-models), without asking the solver.
+  extern Statistic modelBranchHits;
+
+  /// Arrays created for symbolic objects, and those of them which another
+  /// state had created already under the same name.
+  extern Statistic symbolicArrays;
+  extern Statistic sharedSymbolicArrays;
+
+  /// Arrays freed once no expression read them any more.
+  extern Statistic reclaimedArrays;
+
+  /// States merged into others by -use-auto-merge.
+  extern Statistic mergedStates;
+
+  /// Instructions executed by -fuse-concrete-runs without returning to the
+  /// searcher in between.
+  extern Statistic fusedInstructions;
+
+  /// Symbolic floating point values concretized by
+  /// -float-concretization-policy.
+  extern Statistic floatConcretizations;
+
+  /// Pairs of floating point operation and IEEE class its result was seen
+  /// in, with -float-coverage.
+  extern Statistic floatClassesCovered;
+
+  /// Calls of defined functions run natively by -native-concrete-calls.
+  extern Statistic nativeCalls;
+
+  /// Calls of pure functions whose memoized effect was reused.
+  extern Statistic memoizedCalls;
+
+  /// Exits of loops skipped by -loop-summary-bound instead of forking.
+  extern Statistic loopExitsSummarized;
+
   /// Number of states, this is a "fake" statistic used by istats, it
   /// isn't normally up-to-date.
   extern Statistic states;
@@ -45,10 +45,51 @@ namespace {
 
 /***/
 
+/// The blocks of cells freed, by the log2 of their capacity.
+static std::vector<StackLocals *> freeLocals[32];
+
+StackLocals *StackFrame::allocateLocals(unsigned size) {
+  unsigned shift = 0;
+  while ((1u << shift) < size)
+    ++shift;
+  std::vector<StackLocals *> &pool = freeLocals[shift];
+  StackLocals *res;
+  if (pool.empty()) {
+    res = new StackLocals;
+    res->capacity = 1u << shift;
+    res->cells = new Cell[res->capacity];
+  } else {
+    res = pool.back();
+    pool.pop_back();
+  }
+  res->refCount = 1;
+  return res;
+}
+
+void StackFrame::releaseLocals(StackLocals *locals, unsigned size) {
+  if (--locals->refCount)
+    return;
+  // Only the first size cells were used.
+  for (unsigned i = 0; i != size; ++i)
+    locals->cells[i] = Cell();
+  unsigned shift = 0;
+  while ((1u << shift) < locals->capacity)
+    ++shift;
+  freeLocals[shift].push_back(locals);
+}
+
+void StackFrame::copyLocals() {
+  StackLocals *copy = allocateLocals(kf->numRegisters);
+  for (unsigned i = 0; i != kf->numRegisters; ++i)
+    copy->cells[i] = locals->cells[i];
+  releaseLocals(locals, kf->numRegisters);
+  locals = copy;
+}
+
 StackFrame::StackFrame(KInstIterator _caller, KFunction *_kf)
   : caller(_caller), kf(_kf), callPathNode(0), 
-    minDistToUncoveredOnReturn(0), varargs(0) {
-  locals = new Cell[kf->numRegisters];
+    minDistToUncoveredOnReturn(0), budgetFrame(-1), varargs(0) {
+  locals = allocateLocals(kf->numRegisters);
 }
 
 StackFrame::StackFrame(const StackFrame &s) 
@@ -56,15 +97,29 @@ StackFrame::StackFrame(const StackFrame &s)
     kf(s.kf),
     callPathNode(s.callPathNode),
     allocas(s.allocas),
+    locals(s.locals),
     minDistToUncoveredOnReturn(s.minDistToUncoveredOnReturn),
+    budgetFrame(s.budgetFrame),
     varargs(s.varargs) {
-  locals = new Cell[s.kf->numRegisters];
-  for (unsigned i=0; i<s.kf->numRegisters; i++)
-    locals[i] = s.locals[i];
+  ++locals->refCount;
+}
+
+StackFrame &StackFrame::operator=(const StackFrame &s) {
+  ++s.locals->refCount;
+  releaseLocals(locals, kf->numRegisters);
+  caller = s.caller;
+  kf = s.kf;
+  callPathNode = s.callPathNode;
+  allocas = s.allocas;
+  locals = s.locals;
+  minDistToUncoveredOnReturn = s.minDistToUncoveredOnReturn;
+  budgetFrame = s.budgetFrame;
+  varargs = s.varargs;
+  return *this;
 }
 
 StackFrame::~StackFrame() { 
-  delete[] locals; 
+  releaseLocals(locals, kf->numRegisters);
 }
 
 /***/
@@ -74,36 +129,84 @@ ExecutionState::ExecutionState(KFunction *kf) :
     prevPC(pc),
     uniqueID(globalExecutionStateCounter++), // FIXME: Not thread safe
     queryCost(0.), 
+    constraintCost(0.),
+    constraintCostCount(0),
+    simplifiedConstraints(0),
     weight(1),
     depth(0),
 
+    pathPrefixPosition(0),
+    tookMultiWayBranch(false),
+    multiWayBranchPosition(0),
     instsSinceCovNew(0),
     coveredNew(false),
+    forkSite(0),
+    forkDecision(0),
+    newInstructions(0),
     forkDisabled(false),
     ptreeNode(0),
 
-    roundingMode(llvm::APFloat::rmNearestTiesToEven) {
+    roundingMode(llvm::APFloat::rmNearestTiesToEven),
+    fpExceptions(0) {
   pushFrame(0, kf);
-  fegetenv(&fEnv);
 }
 
 ExecutionState::ExecutionState(const std::vector<ref<Expr> > &assumptions)
     : constraints(assumptions), uniqueID(0), queryCost(0.),
-      ptreeNode(0), roundingMode(llvm::APFloat::rmNearestTiesToEven) {
-  fegetenv(&fEnv);
+      constraintCost(0.), constraintCostCount(0), simplifiedConstraints(0),
+      pathPrefixPosition(0), tookMultiWayBranch(false),
+      multiWayBranchPosition(0), forkSite(0),
+      forkDecision(0), newInstructions(0), ptreeNode(0), roundingMode(llvm::APFloat::rmNearestTiesToEven),
+      fpExceptions(0) {
+}
+
+StateCheckpoint::~StateCheckpoint() {
+  delete state;
 }
 
 ExecutionState::~ExecutionState() {
-  for (unsigned int i=0; i<symbolics.size(); i++)
-  {
-    const MemoryObject *mo = symbolics[i].first;
+  while (!stack.empty()) popFrame();
+}
+
+SymbolicList::Shared::~Shared() {
+  for (std::vector<value_type>::iterator it = entries.begin(),
+         ie = entries.end(); it != ie; ++it) {
+    it->second->release();
+    const MemoryObject *mo = it->first;
     assert(mo->refCount > 0);
     mo->refCount--;
     if (mo->refCount == 0)
       delete mo;
   }
+}
 
-  while (!stack.empty()) popFrame();
+void SymbolicList::push_back(const value_type &value) {
+  if (shared.isNull()) {
+    shared = new Shared();
+  } else if (shared->entries.size() != count) {
+    // Another list appended to the entries since they were shared.
+    Shared *prefix = new Shared();
+    prefix->entries.assign(shared->entries.begin(),
+                           shared->entries.begin() + count);
+    for (unsigned i = 0; i != count; ++i) {
+      prefix->entries[i].first->refCount++;
+      prefix->entries[i].second->retain();
+    }
+    shared = prefix;
+  }
+  value.first->refCount++;
+  value.second->retain();
+  shared->entries.push_back(value);
+  ++count;
+}
+
+bool SymbolicList::operator==(const SymbolicList &b) const {
+  if (count != b.count)
+    return false;
+  if (shared.get() == b.shared.get())
+    return true;
+  return std::equal(shared->entries.begin(), shared->entries.begin() + count,
+                    b.shared->entries.begin());
 }
 
 ExecutionState::ExecutionState(const ExecutionState& state):
@@ -115,27 +218,43 @@ ExecutionState::ExecutionState(const ExecutionState& state):
 
     addressSpace(state.addressSpace),
     constraints(state.constraints),
+    uniqueValues(state.uniqueValues),
+    decidedBranches(state.decidedBranches),
+    provenBounds(state.provenBounds),
+    model(state.model),
     uniqueID(globalExecutionStateCounter++), // FIXME: Not thread safe
     queryCost(state.queryCost),
+    constraintCost(state.constraintCost),
+    constraintCostCount(state.constraintCostCount),
+    simplifiedConstraints(state.simplifiedConstraints),
     weight(state.weight),
     depth(state.depth),
 
-    pathOS(state.pathOS),
-    symPathOS(state.symPathOS),
+    pathHistory(state.pathHistory),
+    symPathHistory(state.symPathHistory),
 
+    pathPrefix(state.pathPrefix),
+    pathPrefixPosition(state.pathPrefixPosition),
+    tookMultiWayBranch(state.tookMultiWayBranch),
+    multiWayBranchPosition(state.multiWayBranchPosition),
+    firstCalls(state.firstCalls),
+    checkpoint(state.checkpoint),
+    lazyCondition(state.lazyCondition),
     instsSinceCovNew(state.instsSinceCovNew),
     coveredNew(state.coveredNew),
+    forkSite(state.forkSite),
+    forkDecision(state.forkDecision),
+    newInstructions(state.newInstructions),
     forkDisabled(state.forkDisabled),
-    coveredLines(state.coveredLines),
+    coveredInstructions(state.coveredInstructions),
+    pathCoverage(state.pathCoverage),
     ptreeNode(state.ptreeNode),
     symbolics(state.symbolics),
     arrayNames(state.arrayNames),
 
     roundingMode(state.roundingMode),
-    fEnv(state.fEnv)
+    fpExceptions(state.fpExceptions)
 {
-  for (unsigned int i=0; i<symbolics.size(); i++)
-    symbolics[i].first->refCount++;
 }
 
 ExecutionState *ExecutionState::branch() {
@@ -143,7 +262,10 @@ ExecutionState *ExecutionState::branch() {
 
   ExecutionState *falseState = new ExecutionState(*this);
   falseState->coveredNew = false;
-  falseState->coveredLines.clear();
+  falseState->coveredInstructions.clear();
+  // Only symbolic values fork a state, and a pure call reading them is
+  // not memoized.
+  recording = 0;
 
   weight *= .5;
   falseState->weight -= weight;
@@ -164,24 +286,23 @@ void ExecutionState::popFrame() {
 }
 
 void ExecutionState::addSymbolic(const MemoryObject *mo, const Array *array) { 
-  mo->refCount++;
   symbolics.push_back(std::make_pair(mo, array));
 }
 ///
 
 std::string ExecutionState::getFnAlias(std::string fn) {
-  std::map < std::string, std::string >::iterator it = fnAliases.find(fn);
-  if (it != fnAliases.end())
-    return it->second;
+  const std::pair<std::string, std::string> *alias = fnAliases.lookup(fn);
+  if (alias)
+    return alias->second;
   else return "";
 }
 
 void ExecutionState::addFnAlias(std::string old_fn, std::string new_fn) {
-  fnAliases[old_fn] = new_fn;
+  fnAliases = fnAliases.replace(std::make_pair(old_fn, new_fn));
 }
 
 void ExecutionState::removeFnAlias(std::string fn) {
-  fnAliases.erase(fn);
+  fnAliases = fnAliases.remove(fn);
 }
 
 /**/
@@ -211,6 +332,9 @@ bool ExecutionState::merge(const ExecutionState &b) {
   if (symbolics!=b.symbolics)
     return false;
 
+  if (roundingMode != b.roundingMode || fpExceptions != b.fpExceptions)
+    return false;
+
   {
     std::vector<StackFrame>::const_iterator itA = stack.begin();
     std::vector<StackFrame>::const_iterator itB = b.stack.begin();
@@ -323,8 +447,8 @@ bool ExecutionState::merge(const ExecutionState &b) {
     StackFrame &af = *itA;
     const StackFrame &bf = *itB;
     for (unsigned i=0; i<af.kf->numRegisters; i++) {
-      ref<Expr> &av = af.locals[i].value;
-      const ref<Expr> &bv = bf.locals[i].value;
+      ref<Expr> av = af.getLocal(i).getValue();
+      ref<Expr> bv = bf.getLocal(i).getValue();
       if (av.isNull() || bv.isNull()) {
         // if one is null then by implication (we are at same pc)
         // we cannot reuse this local, so just ignore
@@ -332,11 +456,11 @@ bool ExecutionState::merge(const ExecutionState &b) {
         if (isa<FExpr>(av))
         {
           assert(isa<FExpr>(bv));
-          av = FSelectExpr::create(inA, av, bv);
+          af.getWriteableLocal(i).setValue(FSelectExpr::create(inA, av, bv));
         }
         else
         {
-          av = SelectExpr::create(inA, av, bv);
+          af.getWriteableLocal(i).setValue(SelectExpr::create(inA, av, bv));
         }
       }
     }
@@ -360,6 +484,11 @@ bool ExecutionState::merge(const ExecutionState &b) {
   }
 
   constraints = ConstraintManager();
+  uniqueValues.clear();
+  decidedBranches.clear();
+  provenBounds.clear();
+  model = 0;
+  simplifiedConstraints = 0;
   for (std::set< ref<Expr> >::iterator it = commonConstraints.begin(), 
          ie = commonConstraints.end(); it != ie; ++it)
     constraints.addConstraint(*it);
@@ -390,7 +519,7 @@ void ExecutionState::dumpStack(llvm::raw_ostream &out) const {
 
       out << ai->getName().str();
       // XXX should go through function
-      ref<Expr> value = sf.locals[sf.kf->getArgRegister(index++)].value;
+      ref<Expr> value = sf.getLocal(sf.kf->getArgRegister(index++)).getValue();
       if (value.get() && isa<ConstantExpr>(value))
         out << "=" << value;
     }
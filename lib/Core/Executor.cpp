@@ -8,13 +8,18 @@
 //===----------------------------------------------------------------------===//
 
 #include "Executor.h"
+#include "CexMinimizer.h"
 #include "Context.h"
 #include "CoreStats.h"
 #include "ExternalDispatcher.h"
+#include "FloatCoverage.h"
+#include "ForkController.h"
 #include "ImpliedValue.h"
 #include "Memory.h"
 #include "MemoryManager.h"
 #include "PTree.h"
+#include "RegressionPaths.h"
+#include "SamplingProfiler.h"
 #include "Searcher.h"
 #include "SeedInfo.h"
 #include "SpecialFunctionHandler.h"
@@ -30,7 +35,9 @@
 #include "klee/TimerStatIncrementer.h"
 #include "klee/CommandLine.h"
 #include "klee/Common.h"
+#include "klee/util/ArrayFootprint.h"
 #include "klee/util/Assignment.h"
+#include "klee/util/BatchEvaluator.h"
 #include "klee/util/ExprPPrinter.h"
 #include "klee/util/ExprSMTLIBPrinter.h"
 #include "klee/util/ExprUtil.h"
@@ -80,14 +87,17 @@
 #include "llvm/ADT/SmallPtrSet.h"
 #include "llvm/ADT/StringExtras.h"
 #include "llvm/Support/CommandLine.h"
+#include "llvm/Support/Errno.h"
 #include "llvm/Support/ErrorHandling.h"
 #include "llvm/Support/Process.h"
 #include "llvm/Support/raw_ostream.h"
 
 #if LLVM_VERSION_CODE < LLVM_VERSION(3, 5)
 #include "llvm/Support/CallSite.h"
+#include "llvm/Support/InstIterator.h"
 #else
 #include "llvm/IR/CallSite.h"
+#include "llvm/IR/InstIterator.h"
 #endif
 
 #ifdef HAVE_ZLIB_H
@@ -95,22 +105,32 @@
 #endif
 
 #include <cassert>
+#include <cfloat>
+#include <cstdlib>
+#include <cstring>
 #include <algorithm>
 #include <iomanip>
 #include <iosfwd>
+#include <iterator>
 #include <fstream>
 #include <sstream>
 #include <vector>
 #include <string>
 
 #include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <unistd.h>
 
+#include <dirent.h>
 #include <errno.h>
 #include <cxxabi.h>
 
 using namespace llvm;
 using namespace klee;
 
+extern cl::opt<double> CheckpointInterval;
+extern cl::opt<std::string> SeedWatchDir;
 
 
 
@@ -121,6 +141,21 @@ namespace {
                    cl::init(true),
 		   cl::desc("Dump test cases for all active states on exit (default=on)"));
   
+  cl::opt<double>
+  DumpStatesOnHaltTime("dump-states-on-halt-time",
+                       cl::init(0),
+                       cl::desc("Time in seconds to spend writing the test cases of the active states on halt. States which covered new code go first; those left when the time is up get a prefix<N>.path file for -replay-path-prefix instead (default=0 (no limit))"));
+
+  cl::opt<bool>
+  DumpPathPrefixesOnHalt("dump-path-prefixes-on-halt",
+                         cl::init(false),
+                         cl::desc("On halt, write the branch decisions of every active state to a prefix<N>.path file instead of a test case, so that its subtree can be explored later or elsewhere with -replay-path-prefix (default=off)"));
+
+  cl::opt<bool>
+  ReplayPathPrefix("replay-path-prefix",
+                   cl::init(false),
+                   cl::desc("Treat the -replay-path file as a prefix: follow its branch decisions without solver queries, then explore the whole subtree below it (default=off)"));
+
   cl::opt<bool>
   AllowExternalSymCalls("allow-external-sym-calls",
                         cl::init(false),
@@ -217,6 +252,59 @@ namespace {
 		  cl::init(false),
                   cl::desc("Discard states that do not have a seed (default=off)."));
  
+  cl::opt<bool>
+  ConcolicSeeds("concolic-seeds",
+                cl::init(false),
+                cl::desc("Decide branches of seeded states by evaluating their "
+                         "conditions on the seeds instead of asking the solver, "
+                         "which is only used to find a new seed for the other "
+                         "side of a branch (default=off)."));
+
+  cl::opt<bool>
+  UseForkController("fork-controller",
+                    cl::init(false),
+                    cl::desc("Decide at each symbolic branch whether to fork, "
+                             "to concretize the condition from a model or to "
+                             "defer the query to a lazy fork, from the solver "
+                             "time forking there took and the coverage it led "
+                             "to. The decisions are written to forks.txt "
+                             "(default=off)."));
+
+  cl::opt<double>
+  ForkControllerRate("fork-controller-rate",
+                     cl::init(0.05),
+                     cl::desc("The weight of the latest fork in the decayed "
+                              "averages of -fork-controller (default=0.05)."));
+
+  cl::opt<bool>
+  BranchMemoization("branch-memo",
+                    cl::init(true),
+                    cl::desc("Remember the branch conditions each state found "
+                             "to be true or false, to decide them again "
+                             "without the solver (default=on)."));
+
+  cl::opt<bool>
+  BoundsMemoization("bounds-memo",
+                    cl::init(true),
+                    cl::desc("Remember the symbolic offsets each state proved "
+                             "in bounds, to check accesses at constant "
+                             "displacements from them without the solver "
+                             "(default=on)."));
+
+  cl::opt<bool>
+  StateModels("state-models",
+              cl::init(false),
+              cl::desc("Keep a model of the constraints of each state, and "
+                       "ask the solver only about the side of a branch the "
+                       "model does not take (default=off)."));
+
+  cl::opt<bool>
+  SeedBatchEval("seed-batch-eval",
+                cl::init(true),
+                cl::desc("Evaluate the conditions of states with many seeds "
+                         "under many seeds at once, with a compiled "
+                         "evaluator (default=on)."));
+
   cl::opt<bool>
   OnlySeed("only-seed",
 	   cl::init(false),
@@ -271,6 +359,29 @@ namespace {
   SeedTime("seed-time",
            cl::desc("Amount of time to dedicate to seeds, before normal search (default=0 (off))"),
            cl::init(0));
+
+  cl::opt<double>
+  MinimizeCexTime("minimize-cex-time",
+                  cl::desc("Time to spend per test case on moving its inputs "
+                           "towards zeros, canonical NaNs and normal, "
+                           "integral floats (default=0s (off))"),
+                  cl::init(0));
+
+  cl::opt<unsigned>
+  SimplifyConstraintsInterval("simplify-constraints-interval",
+                              cl::desc("Simplify the constraints of a state "
+                                       "each time this many have been added "
+                                       "to it (default=0 (off))"),
+                              cl::init(0));
+
+  cl::opt<double>
+  SimplifyConstraintsTimeout("simplify-constraints-timeout",
+                             cl::desc("Time in seconds to spend asking the "
+                                      "solver whether each constraint is "
+                                      "implied by the others, when "
+                                      "simplifying constraints (default=0.1s, "
+                                      "0 for local reasoning only)"),
+                             cl::init(0.1));
   
   cl::list<Executor::TerminateReason>
   ExitOnErrorType("exit-on-error-type",
@@ -313,11 +424,113 @@ namespace {
            cl::desc("Only allow this many symbolic branches (default=0 (off))"),
            cl::init(0));
   
+  cl::opt<unsigned>
+  ParallelWorkers("parallel-workers",
+                  cl::desc("Explore with this many worker processes. Once "
+                           "there are as many states as workers, each worker "
+                           "takes an equal share of them and continues "
+                           "independently. When seeding, each worker takes "
+                           "an equal share of the seeds instead (default=1)"),
+                  cl::init(1));
+
   cl::opt<unsigned>
   MaxMemory("max-memory",
             cl::desc("Refuse to fork when above this amount of memory (in MB, default=2000)"),
             cl::init(2000));
 
+  cl::opt<bool>
+  OffloadStates("offload-states",
+                cl::desc("Instead of killing states over the memory cap, write their paths to disk and recreate them by replay once memory is available again (default=off)"),
+                cl::init(false));
+
+  cl::opt<unsigned>
+  OffloadCheckpointInterval("offload-checkpoint-interval",
+                            cl::desc("With -offload-states, keep a copy of a state every this many branches along its path, so that offloaded states are recreated by replay from the latest copy rather than from the initial state (default=0 (off))"),
+                            cl::init(0));
+
+  cl::opt<bool>
+  LazyFork("lazy-fork",
+           cl::desc("Fork on symbolic branches without asking the solver which sides are feasible; a side is checked when the searcher first selects it, deciding its sibling by the same query, and dropped if infeasible. Both sides count as visited for branch coverage. Not used along with -offload-states, -checkpoint-interval or path prefix dumps, which take every recorded branch as feasible (default=off)"),
+           cl::init(false));
+
+  cl::opt<bool>
+  SiteArrayNames("site-array-names",
+                 cl::desc("Name the arrays of symbolic objects after the instruction making them symbolic and how many times it did along the path, so that states making the same objects symbolic at the same point share their arrays, and the solver caches share their results, whatever other objects they made symbolic before. The SharedSymbolicArrays statistic counts the arrays shared (default=off)"),
+                 cl::init(false));
+
+  cl::opt<std::string>
+  FloatConcretizationPolicyFile("float-concretization-policy",
+                                cl::desc("Concretize symbolic floating point values where the rules of this file say so: values stored in a function or at a location, arguments passed to a function, or values computed past an expression size, each rule optionally applying only from a size on (see lib/Core/FloatConcretizationPolicy.h). Values come from the state's seed or the solver, and are recorded as constraints (default=off)"));
+
+  cl::opt<bool>
+  FloatCoverageOpt("float-coverage",
+                   cl::desc("Record which IEEE classes (NaN, +/-Inf, +/-0, subnormal, normal) the result of each floating point operation was seen in, counted by the FloatClassesCovered statistic and written to fpcov.txt. Implied by --search=nurs:fpcov (default=off)"),
+                   cl::init(false));
+
+  cl::opt<bool>
+  FloatCoverageQueries("float-coverage-queries",
+                       cl::desc("With -float-coverage, ask the solver which classes not seen yet a symbolic result may be in, and count those as seen (default=off)"),
+                       cl::init(false));
+
+  cl::opt<double>
+  ProfileSampleRate("profile-sample-rate",
+                    cl::desc("Sample what klee is doing this many times per second of CPU time, and write the samples, charged to the stack and source line of the program under test, to profile.folded (default=0 (off))"),
+                    cl::init(0));
+
+  cl::opt<bool>
+  TraceQueries("trace-queries",
+               cl::desc("Write a binary trace of every solver query (location, size, expression kinds and widths, time, result) to queries.trace, see klee-query-trace (default=off)"),
+               cl::init(false));
+
+  cl::opt<bool>
+  SpecializeDefaultRounding("specialize-default-rounding",
+                            cl::desc("Build smaller floating-point expressions on paths that round to nearest, and only add the explicit signed-zero handling of FAdd/FSub once a path changes the rounding mode (default=on)"),
+                            cl::init(true));
+
+  cl::opt<bool>
+  HostFloatArith("host-float-arith",
+                 cl::desc("Compute floating-point arithmetic on concrete single and double precision values with the host's floating point unit instead of APFloat (default=on)"),
+                 cl::init(true));
+
+  cl::opt<unsigned>
+  FuseConcreteRuns("fuse-concrete-runs",
+                   cl::desc("After executing an instruction, keep executing the same state without returning to the searcher for at most this many following instructions of its block that compute, load or store concrete values only, 0 to disable (default=64)"),
+                   cl::init(64));
+
+  cl::opt<bool>
+  NativeConcreteCalls("native-concrete-calls",
+                      cl::desc("Compile functions called with concrete arguments while all of memory is concrete, and which only call other such functions or the C math library, and run them natively instead of interpreting them. Their instructions are not counted or covered, and errors they cause are only caught if they fault or are checked by klee_report_error. Functions dividing or shifting by variable amounts are interpreted under -check-div-zero or -check-overshift (default=off)"),
+                      cl::init(false));
+
+  cl::opt<bool>
+  BulkMemoryFunctions("bulk-memory-functions",
+                      cl::desc("Copy and fill memory natively in calls of memcpy, memmove, mempcpy and memset whose pointers and length are concrete and in bounds, rather than interpreting them byte by byte. Their instructions are not counted or covered (default=on)"),
+                      cl::init(true));
+
+  cl::opt<unsigned>
+  LoopSummaryBound("loop-summary-bound",
+                   cl::desc("Keep running a loop without forking at its exit when the exit condition is symbolic, for at most this many iterations, then fork off a single state leaving the loop after any of them, with the values the loop computed selected by the number of iterations. Only loops which are a chain of blocks without stores or calls, compare a value computed in the loop with one computed before it to exit, and have no other exit qualify, as in optimized code. States taking part cannot be recreated from their path, 0 to disable (default=0)"),
+                   cl::init(0));
+
+  cl::opt<std::string>
+  PureFunctionsFile("pure-functions",
+                    cl::desc("File naming defined functions, one per line, which only read and write memory, like those marked by klee_mark_pure. Calls of them with concrete arguments reading concrete memory are memoized, and reuse the effect of an earlier such call reading the same bytes instead of being run. Their instructions are not counted or covered (default=none)"));
+
+  cl::opt<bool>
+  WriteRegressionPaths("write-regression-paths",
+                       cl::desc("Write the branch decisions of every path explored, with the functions it entered and hashes of their code, to regression.paths, for -regression-baseline. Calls of pure functions are not memoized meanwhile (default=off)"),
+                       cl::init(false));
+
+  cl::list<std::string>
+  RegressionBaseline("regression-baseline",
+                     cl::desc("regression.paths file of an earlier run on another version of the program. Paths which only entered unchanged functions are not explored again, and the others are followed without the solver up to their first call of a changed function, exploring only below. Implies -write-regression-paths, the paths not explored again being carried over (default=none)"),
+                     cl::ZeroOrMore);
+
+  cl::opt<bool>
+  NativeStringFunctions("native-string-functions",
+                        cl::desc("Compute calls of strlen, strcmp, strncmp, memcmp, strchr and memchr natively when the bytes they read are concrete, rather than interpreting them byte by byte. The results are those of klee-libc, which may differ from those of other C libraries in their magnitude. Their instructions are not counted or covered (default=off)"),
+                        cl::init(false));
+
   cl::opt<bool>
   MaxMemoryInhibit("max-memory-inhibit",
             cl::desc("Inhibit forking at memory cap (vs. random terminate) (default=on)"),
@@ -348,10 +561,18 @@ Executor::Executor(LLVMContext &ctx, const InterpreterOptions &opts,
     InterpreterHandler *ih)
     : Interpreter(opts), kmodule(0), interpreterHandler(ih), searcher(0),
       externalDispatcher(new ExternalDispatcher(ctx)), statsTracker(0),
-      pathWriter(0), symPathWriter(0), specialFunctionHandler(0),
-      processTree(0), replayKTest(0), replayPath(0), usingSeeds(0),
-      atMemoryLimit(false), inhibitForking(false), haltExecution(false),
-      ivcEnabled(false),
+      profiler(0), floatPolicy(0), floatCoverage(0), forkController(0),
+      regressionPaths(0), specialFunctionHandler(0),
+      processTree(0), memoryCheckDue(false), uncountedMemory(0),
+      countedMemoryMeasured(0),
+      memoryChecksUnmeasured(MemoryChecksPerMeasurement), memoryPressure(0),
+      replayKTest(0), replayPath(0), resumePaths(0),
+      usingSeeds(0), seedBaseState(0), atMemoryLimit(false),
+      inhibitForking(false),
+      haltExecution(false), ivcEnabled(false), checkDivZero(false),
+      checkOvershift(false), workerIndex(0), watchdogOwner(0),
+      watchdogStop(false), haltTime(0), offloadFile(0),
+      checkpointWriter(0),
       coreSolverTimeout(MaxCoreSolverTime != 0 && MaxInstructionTime != 0
                             ? std::min(MaxCoreSolverTime, MaxInstructionTime)
                             : std::max(MaxCoreSolverTime, MaxInstructionTime)),
@@ -368,11 +589,25 @@ Executor::Executor(LLVMContext &ctx, const InterpreterOptions &opts,
       interpreterHandler->getOutputFilename(ALL_QUERIES_SMT2_FILE_NAME),
       interpreterHandler->getOutputFilename(SOLVER_QUERIES_SMT2_FILE_NAME),
       interpreterHandler->getOutputFilename(ALL_QUERIES_KQUERY_FILE_NAME),
-      interpreterHandler->getOutputFilename(SOLVER_QUERIES_KQUERY_FILE_NAME));
+      interpreterHandler->getOutputFilename(SOLVER_QUERIES_KQUERY_FILE_NAME),
+      interpreterHandler->getOutputFilename(ALL_QUERIES_BINARY_FILE_NAME),
+      interpreterHandler->getOutputFilename(SOLVER_QUERIES_BINARY_FILE_NAME));
 
   this->solver = new TimingSolver(solver, this, EqualitySubstitution);
+  if (TraceQueries) {
+    if (llvm::raw_fd_ostream *f =
+            interpreterHandler->openOutputFile("queries.trace"))
+      this->solver->tracer = new QueryTracer(f);
+  }
   memory = new MemoryManager(&arrayCache);
 
+  if (!FloatConcretizationPolicyFile.empty()) {
+    floatPolicy = new FloatConcretizationPolicy();
+    std::string error;
+    if (!floatPolicy->load(FloatConcretizationPolicyFile, error))
+      klee_error("invalid float concretization policy: %s", error.c_str());
+  }
+
   if (optionIsSet(DebugPrintInstructions, FILE_ALL) ||
       optionIsSet(DebugPrintInstructions, FILE_COMPACT) ||
       optionIsSet(DebugPrintInstructions, FILE_SRC)) {
@@ -423,19 +658,64 @@ const Module *Executor::setModule(llvm::Module *module,
 
   specialFunctionHandler->prepare();
   kmodule->prepare(opts, interpreterHandler);
+  checkDivZero = opts.CheckDivZero;
+  checkOvershift = opts.CheckOvershift;
   specialFunctionHandler->bind();
 
-  if (StatsTracker::useStatistics() || userSearcherRequiresMD2U()) {
+  if (!PureFunctionsFile.empty()) {
+    std::string error;
+    if (!callMemo.load(PureFunctionsFile, kmodule->module, error))
+      klee_error("invalid pure functions: %s", error.c_str());
+  }
+
+  if (StatsTracker::useStatistics() || userSearcherRequiresMD2U() ||
+      userSearcherRequiresDistances()) {
     statsTracker = 
       new StatsTracker(*this,
                        interpreterHandler->getOutputFilename("assembly.ll"),
                        userSearcherRequiresMD2U());
   }
+
+  if (FloatCoverageOpt || userSearcherRequiresFloatCoverage())
+    floatCoverage = new FloatCoverage(kmodule->infos->getMaxID());
+  if (UseForkController)
+    forkController = new ForkController(kmodule->infos->getMaxID(),
+                                        ForkControllerRate);
+
+  if (WriteRegressionPaths || !RegressionBaseline.empty()) {
+    regressionPaths = new RegressionPaths(kmodule->module);
+    for (unsigned i = 0; i < RegressionBaseline.size(); ++i) {
+      std::string error;
+      if (!regressionPaths->load(RegressionBaseline[i], error))
+        klee_error("invalid regression baseline: %s", error.c_str());
+    }
+    regressionPaths->finishLoading();
+    regressionPaths->setOutput(
+        interpreterHandler->openOutputFile("regression.paths"),
+        /*carryOver=*/true);
+  }
   
-  return module;
+  // Preparing may have replaced the module with a cached one.
+  return kmodule->module;
 }
 
 Executor::~Executor() {
+  reapCheckpointWriter(/*block=*/true);
+  for (std::map<ExecutionState*, LoopSummary>::iterator
+         it = loopSummaries.begin(), ie = loopSummaries.end(); it != ie; ++it)
+    delete it->second.exitState;
+  delete profiler;
+  delete floatPolicy;
+  delete floatCoverage;
+  delete forkController;
+  delete regressionPaths;
+  delete seedBaseState;
+  while (!importedSeeds.empty()) {
+    kTest_free(importedSeeds.back());
+    importedSeeds.pop_back();
+  }
+  if (offloadFile)
+    fclose(offloadFile);
   delete memory;
   delete externalDispatcher;
   if (processTree)
@@ -465,16 +745,17 @@ void Executor::initializeGlobalObject(ExecutionState &state, ObjectState *os,
 #else
   DataLayout *targetData = kmodule->targetData;
 #endif
+  // The object is zero-filled when created, and writing zeros would only
+  // give it contents of its own.
+  if (c->isNullValue())
+    return;
+
   if (const ConstantVector *cp = dyn_cast<ConstantVector>(c)) {
     unsigned elementSize =
       targetData->getTypeAllocSize(cp->getType()->getElementType());
     for (unsigned i=0, e=cp->getNumOperands(); i != e; ++i)
       initializeGlobalObject(state, os, cp->getOperand(i), 
 			     offset + i*elementSize);
-  } else if (isa<ConstantAggregateZero>(c)) {
-    unsigned i, size = targetData->getTypeAllocSize(c->getType());
-    for (i=0; i<size; i++)
-      os->write8(offset+i, (uint8_t) 0);
   } else if (const ConstantArray *ca = dyn_cast<ConstantArray>(c)) {
     unsigned elementSize =
       targetData->getTypeAllocSize(ca->getType()->getElementType());
@@ -776,8 +1057,119 @@ void Executor::branch(ExecutionState &state,
   }
 
   for (unsigned i=0; i<N; ++i)
-    if (result[i])
+    if (result[i]) {
       addConstraint(*result[i], conditions[i]);
+      if (N > 1) {
+        result[i]->markMultiWayBranch();
+        dropPathPrefix(*result[i]);
+      }
+    }
+}
+
+void Executor::dropPathPrefix(ExecutionState &state) {
+  // The prefix was recorded by one of the states forked here, and which
+  // one is not known: replayed by all of them, it would lead each into the
+  // subtree of that one. They explore on their own instead.
+  if (state.pathPrefix.empty())
+    return;
+  klee_warning_once(0, "forked while replaying a path prefix, exploring "
+                    "the rest of it again");
+  state.pathPrefix.clear();
+  state.pathPrefixPosition = 0;
+}
+
+/// The seeds of a state above which conditions are evaluated in batches.
+static const unsigned MinBatchSeeds = 2 * BatchEvaluator::BatchSize;
+
+/// evaluateSeeds - Evaluate \a condition under each of \a seeds, setting
+/// \a values[i] to 1 or 0 if seed i makes it true or false, and to -1 if the
+/// seed leaves it symbolic. Many seeds are evaluated a batch at a time,
+/// leaving ExprEvaluator the seeds which don't bind all it reads.
+static void evaluateSeeds(std::vector<SeedInfo> &seeds,
+                          const ref<Expr> &condition,
+                          std::vector<int> &values) {
+  values.assign(seeds.size(), -1);
+  BatchEvaluator be;
+  bool batch = SeedBatchEval && seeds.size() >= MinBatchSeeds &&
+               be.add(condition);
+  const std::vector<const Array*> &arrays = condition->getFootprint().arrays;
+
+  std::vector<const Assignment*> lanes;
+  std::vector<unsigned> indices;
+  for (unsigned i = 0; i != seeds.size(); ++i) {
+    Assignment &assignment = seeds[i].assignment;
+    bool bound = batch;
+    for (unsigned j = 0; bound && j != arrays.size(); ++j) {
+      Assignment::bindings_ty::const_iterator bit =
+        assignment.bindings.find(arrays[j]);
+      bound = bit != assignment.bindings.end() &&
+              bit->second.size() >= arrays[j]->size;
+    }
+    if (!bound) {
+      ref<Expr> value = assignment.evaluate(condition);
+      if (klee::ConstantExpr *CE = dyn_cast<klee::ConstantExpr>(value))
+        values[i] = CE->isTrue();
+      continue;
+    }
+
+    lanes.push_back(&assignment);
+    indices.push_back(i);
+    if (lanes.size() == BatchEvaluator::BatchSize) {
+      be.evaluate(&lanes[0], lanes.size());
+      for (unsigned lane = 0; lane != lanes.size(); ++lane)
+        values[indices[lane]] = be.isTrue(condition, lane);
+      lanes.clear();
+      indices.clear();
+    }
+  }
+  if (!lanes.empty()) {
+    be.evaluate(&lanes[0], lanes.size());
+    for (unsigned lane = 0; lane != lanes.size(); ++lane)
+      values[indices[lane]] = be.isTrue(condition, lane);
+  }
+}
+
+bool Executor::getStateModel(ExecutionState &state, ref<Expr> condition,
+                             ref<StateModel> &model) {
+  std::vector<const Array *> objects;
+  for (unsigned i = 0; i != state.symbolics.size(); ++i)
+    objects.push_back(state.symbolics[i].second);
+  std::vector<std::vector<unsigned char> > values;
+  bool hasSolution;
+  if (!solver->getModel(state, condition, objects, values, hasSolution))
+    return false;
+  model = hasSolution ? new StateModel(objects, values) : 0;
+  return true;
+}
+
+bool Executor::evaluateUnderModel(ExecutionState &state, ref<Expr> condition,
+                                  Solver::Validity &res,
+                                  ref<StateModel> &otherModel) {
+  // The first model is found for the true side.
+  if (state.model.isNull()) {
+    ref<StateModel> model;
+    if (!getStateModel(state, condition, model))
+      return false;
+    if (model.isNull()) {
+      res = Solver::False;
+      return true;
+    }
+    state.model = model;
+  }
+
+  ConstantExpr *CE = dyn_cast<ConstantExpr>(state.model->evaluate(condition));
+  if (!CE)
+    return solver->evaluate(state, condition, res);
+  ++stats::modelBranchHits;
+  bool value = CE->isTrue();
+  if (!getStateModel(state, value ? Expr::createIsZero(condition) : condition,
+                     otherModel))
+    return false;
+  if (!otherModel.isNull())
+    res = Solver::Unknown;
+  else
+    res = value ? Solver::True : Solver::False;
+  return true;
 }
 
 Executor::StatePair 
@@ -787,6 +1179,38 @@ Executor::fork(ExecutionState &current, ref<Expr> condition, bool isInternal) {
     seedMap.find(&current);
   bool isSeeding = it != seedMap.end();
 
+  // A path prefix is known to be feasible, as it was recorded by an earlier
+  // exploration, so its decisions are taken without asking the solver.
+  bool inPrefix = false, branch = false;
+  if (!isInternal && !isSeeding) {
+    if (current.pathPrefixPosition < current.pathPrefix.size()) {
+      inPrefix = true;
+      branch = current.pathPrefix[current.pathPrefixPosition++];
+      if (current.pathPrefixPosition == current.pathPrefix.size()) {
+        current.pathPrefix.clear();
+        current.pathPrefixPosition = 0;
+      }
+    } else if (ReplayPathPrefix && replayPath &&
+               replayPosition < replayPath->size()) {
+      inPrefix = true;
+      branch = (*replayPath)[replayPosition++];
+    }
+  }
+  if (inPrefix) {
+    if (ConstantExpr *CE = dyn_cast<ConstantExpr>(condition)) {
+      if (CE->isTrue() != branch) {
+        current.pc = current.prevPC;
+        terminateStateEarly(current, "Replay path prefix diverged.");
+        return StatePair(0, 0);
+      }
+    } else {
+      addConstraint(current, branch ? condition
+                                    : Expr::createIsZero(condition));
+    }
+    current.pathHistory.push_back(branch);
+    return branch ? StatePair(&current, 0) : StatePair(0, &current);
+  }
+
   if (!isSeeding && !isa<ConstantExpr>(condition) && 
       (MaxStaticForkPct!=1. || MaxStaticSolvePct != 1. ||
        MaxStaticCPForkPct!=1. || MaxStaticCPSolvePct != 1.) &&
@@ -817,20 +1241,131 @@ Executor::fork(ExecutionState &current, ref<Expr> condition, bool isInternal) {
     }
   }
 
-  double timeout = coreSolverTimeout;
-  if (isSeeding)
-    timeout *= it->second.size();
-  solver->setTimeout(timeout);
-  bool success = solver->evaluate(current, condition, res);
-  solver->setTimeout(0);
-  if (!success) {
-    current.pc = current.prevPC;
-    terminateStateEarly(current, "Query timed out (fork).");
-    return StatePair(0, 0);
+  // In concolic mode a branch followed by some seed is known to be feasible.
+  // The solver is only asked for a seed taking the other side, which is
+  // then explored as well (a generational search).
+  bool concolic = isSeeding && ConcolicSeeds && !isa<ConstantExpr>(condition);
+  std::vector<SeedInfo> generatedSeeds;
+  if (concolic) {
+    bool trueSeed = false, falseSeed = false;
+    std::vector<int> values;
+    evaluateSeeds(it->second, condition, values);
+    for (unsigned i = 0; i != values.size(); ++i) {
+      if (values[i] < 0) {
+        // The seed does not bind every read value.
+        concolic = false;
+        break;
+      }
+      if (values[i])
+        trueSeed = true;
+      else
+        falseSeed = true;
+    }
+
+    if (concolic) {
+      if (trueSeed && falseSeed) {
+        res = Solver::Unknown;
+      } else {
+        res = trueSeed ? Solver::True : Solver::False;
+        ref<Expr> taken = trueSeed ? condition : Expr::createIsZero(condition);
+        if (!isInternal && !OnlyReplaySeeds && !current.forkDisabled &&
+            !inhibitForking && (MaxForks == ~0u || stats::forks < MaxForks)) {
+          SeedInfo seed = it->second.front();
+          std::vector<const Array*> objects;
+          for (Assignment::bindings_ty::iterator
+                 bit = seed.assignment.bindings.begin(),
+                 bie = seed.assignment.bindings.end(); bit != bie; ++bit)
+            objects.push_back(bit->first);
+          std::vector< std::vector<unsigned char> > values;
+          ExecutionState tmp(std::vector< ref<Expr> >(current.constraints.begin(),
+                                                      current.constraints.end()));
+          tmp.addConstraint(Expr::createIsZero(taken));
+          solver->setTimeout(coreSolverTimeout);
+          bool success = solver->getInitialValues(tmp, objects, values);
+          solver->setTimeout(0);
+          // Failing also means there is no seed for the other side.
+          if (success) {
+            for (unsigned i = 0; i != objects.size(); ++i)
+              seed.assignment.bindings[objects[i]] = values[i];
+            generatedSeeds.push_back(seed);
+            res = Solver::Unknown;
+          }
+        }
+        if (res != Solver::Unknown)
+          addConstraint(current, taken);
+      }
+    }
+  }
+
+  // A branch decided earlier on the path stays decided, as the path only
+  // gained constraints since.
+  bool decided = false, value;
+  if (!concolic && BranchMemoization && !isa<ConstantExpr>(condition) &&
+      current.decidedBranches.lookup(current.prevPC, condition, value)) {
+    ++stats::branchMemoHits;
+    res = value ? Solver::True : Solver::False;
+    decided = true;
+  }
+
+  // The fork controller takes one side of a branch whose forks have not
+  // paid for their solver time, or defers its query to a lazy fork.
+  bool controlled = forkController && !decided && !isSeeding &&
+                    !isInternal && !replayPath && !isa<ConstantExpr>(condition);
+  ForkController::Decision forkDecision = ForkController::Fork;
+  double queryStart = current.queryCost;
+  if (controlled) {
+    forkDecision = forkController->decide(current.prevPC, memoryPressure);
+    if (forkDecision == ForkController::Defer && !lazyForkSupported())
+      forkDecision = ForkController::Fork;
+  }
+  if (forkDecision == ForkController::Concretize) {
+    ++stats::forksConcretized;
+    ref<Expr> value;
+    bool success = solver->getValue(current, condition, value);
+    assert(success && "FIXME: Unhandled solver failure");
+    (void) success;
+    addConstraint(current, EqExpr::create(value, condition));
+    creditForkSite(current);
+    forkController->recordDecision(current.prevPC, forkDecision,
+                                   current.queryCost - queryStart, 1);
+    current.forkSite = current.prevPC->info->id + 1;
+    current.forkDecision = forkDecision;
+    condition = value;
+  }
+
+  // A lazy fork leaves the solver out until the searcher picks a side.
+  bool lazy = !concolic && !decided && !isSeeding && !isInternal && !replayPath &&
+              (canForkLazily() || forkDecision == ForkController::Defer) &&
+              !isa<ConstantExpr>(condition) &&
+              !(MaxMemoryInhibit && atMemoryLimit) && !current.forkDisabled &&
+              !inhibitForking && (MaxForks == ~0u || stats::forks < MaxForks);
+  if (lazy)
+    res = Solver::Unknown;
+
+  // The model of the side of the branch the current model does not take.
+  ref<StateModel> otherModel;
+  if (!concolic && !lazy && !decided) {
+    double timeout = coreSolverTimeout;
+    if (isSeeding)
+      timeout *= it->second.size();
+    solver->setTimeout(timeout);
+    bool success = StateModels && !isSeeding
+                       ? evaluateUnderModel(current, condition, res, otherModel)
+                       : solver->evaluate(current, condition, res);
+    solver->setTimeout(0);
+    if (!success) {
+      current.pc = current.prevPC;
+      terminateStateEarly(current, "Query timed out (fork).");
+      return StatePair(0, 0);
+    }
+    if (BranchMemoization && res != Solver::Unknown &&
+        !isa<ConstantExpr>(condition))
+      current.decidedBranches.insert(current.prevPC, condition,
+                                     res == Solver::True);
   }
 
   if (!isSeeding) {
-    if (replayPath && !isInternal) {
+    if (replayPath && !isInternal && !ReplayPathPrefix) {
       assert(replayPosition<replayPath->size() &&
              "ran out of branches in replay path mode");
       bool branch = (*replayPath)[replayPosition++];
@@ -880,19 +1415,23 @@ Executor::fork(ExecutionState &current, ref<Expr> condition, bool isInternal) {
 
   // Fix branch in only-replay-seed mode, if we don't have both true
   // and false seeds.
-  if (isSeeding && 
+  if (isSeeding && !concolic &&
       (current.forkDisabled || OnlyReplaySeeds) && 
       res == Solver::Unknown) {
     bool trueSeed=false, falseSeed=false;
+    std::vector<int> values;
+    evaluateSeeds(it->second, condition, values);
     // Is seed extension still ok here?
-    for (std::vector<SeedInfo>::iterator siit = it->second.begin(), 
-           siie = it->second.end(); siit != siie; ++siit) {
-      ref<Expr> res;
-      bool success = 
-        solver->getValue(current, siit->assignment.evaluate(condition), res);
-      assert(success && "FIXME: Unhandled solver failure");
-      (void) success;
-      if (cast<ConstantExpr>(res)->isTrue()) {
+    for (unsigned i = 0; i != values.size(); ++i) {
+      if (values[i] < 0) {
+        ref<Expr> res;
+        bool success = solver->getValue(
+          current, it->second[i].assignment.evaluate(condition), res);
+        assert(success && "FIXME: Unhandled solver failure");
+        (void) success;
+        values[i] = cast<ConstantExpr>(res)->isTrue();
+      }
+      if (values[i]) {
         trueSeed = true;
       } else {
         falseSeed = true;
@@ -917,19 +1456,13 @@ Executor::fork(ExecutionState &current, ref<Expr> condition, bool isInternal) {
   // hint to just use the single constraint instead of all the binary
   // search ones. If that makes sense.
   if (res==Solver::True) {
-    if (!isInternal) {
-      if (pathWriter) {
-        current.pathOS << "1";
-      }
-    }
+    if (!isInternal)
+      current.pathHistory.push_back(true);
 
     return StatePair(&current, 0);
   } else if (res==Solver::False) {
-    if (!isInternal) {
-      if (pathWriter) {
-        current.pathOS << "0";
-      }
-    }
+    if (!isInternal)
+      current.pathHistory.push_back(false);
 
     return StatePair(0, &current);
   } else {
@@ -938,26 +1471,46 @@ Executor::fork(ExecutionState &current, ref<Expr> condition, bool isInternal) {
 
     ++stats::forks;
 
+    // Both sides count as started by this branch, from here on.
+    if (controlled) {
+      if (forkDecision == ForkController::Defer && lazy)
+        ++stats::forksDeferred;
+      else
+        forkDecision = ForkController::Fork;
+      creditForkSite(current);
+      forkController->recordDecision(current.prevPC, forkDecision,
+                                     current.queryCost - queryStart, 2);
+      current.forkSite = current.prevPC->info->id + 1;
+      current.forkDecision = forkDecision;
+    }
+
+    if (!loopSummaries.empty())
+      endLoopSummary(current);
     falseState = trueState->branch();
     addedStates.push_back(falseState);
 
     if (it != seedMap.end()) {
       std::vector<SeedInfo> seeds = it->second;
+      seeds.insert(seeds.end(), generatedSeeds.begin(), generatedSeeds.end());
       it->second.clear();
       std::vector<SeedInfo> &trueSeeds = seedMap[trueState];
       std::vector<SeedInfo> &falseSeeds = seedMap[falseState];
-      for (std::vector<SeedInfo>::iterator siit = seeds.begin(), 
-             siie = seeds.end(); siit != siie; ++siit) {
-        ref<Expr> tmp;
-        bool success = 
-          solver->getValue(current, siit->assignment.evaluate(condition), tmp);
-        ref<ConstantExpr> res = cast<ConstantExpr>(tmp);
-        assert(success && "FIXME: Unhandled solver failure");
-        (void) success;
-        if (res->isTrue()) {
-          trueSeeds.push_back(*siit);
+      // Split the seeds in one pass, asking the solver only about those
+      // which leave the condition symbolic.
+      std::vector<int> values;
+      evaluateSeeds(seeds, condition, values);
+      for (unsigned i = 0; i != seeds.size(); ++i) {
+        if (values[i] < 0) {
+          ref<Expr> tmp = seeds[i].assignment.evaluate(condition);
+          bool success = solver->getValue(current, tmp, tmp);
+          assert(success && "FIXME: Unhandled solver failure");
+          (void) success;
+          values[i] = cast<ConstantExpr>(tmp)->isTrue();
+        }
+        if (values[i]) {
+          trueSeeds.push_back(seeds[i]);
         } else {
-          falseSeeds.push_back(*siit);
+          falseSeeds.push_back(seeds[i]);
         }
       }
       
@@ -972,7 +1525,7 @@ Executor::fork(ExecutionState &current, ref<Expr> condition, bool isInternal) {
       }
       if (swapInfo) {
         std::swap(trueState->coveredNew, falseState->coveredNew);
-        std::swap(trueState->coveredLines, falseState->coveredLines);
+        trueState->coveredInstructions.swap(falseState->coveredInstructions);
       }
     }
 
@@ -982,25 +1535,35 @@ Executor::fork(ExecutionState &current, ref<Expr> condition, bool isInternal) {
     falseState->ptreeNode = res.first;
     trueState->ptreeNode = res.second;
 
-    if (pathWriter) {
-      // Need to update the pathOS.id field of falseState, otherwise the same id
-      // is used for both falseState and trueState.
-      falseState->pathOS = pathWriter->open(current.pathOS);
-      if (!isInternal) {
-        trueState->pathOS << "1";
-        falseState->pathOS << "0";
-      }
+    // falseState was copied from current, so both share the history so far.
+    if (!isInternal) {
+      trueState->pathHistory.push_back(true);
+      falseState->pathHistory.push_back(false);
+      trueState->symPathHistory.push_back(true);
+      falseState->symPathHistory.push_back(false);
+    } else {
+      // The history does not tell the sides of an internal fork apart, so
+      // neither can be recreated from its path past here.
+      trueState->markMultiWayBranch();
+      falseState->markMultiWayBranch();
+      dropPathPrefix(*trueState);
+      dropPathPrefix(*falseState);
     }
-    if (symPathWriter) {
-      falseState->symPathOS = symPathWriter->open(current.symPathOS);
-      if (!isInternal) {
-        trueState->symPathOS << "1";
-        falseState->symPathOS << "0";
-      }
+
+    if (!otherModel.isNull()) {
+      ExecutionState *otherState =
+          cast<ConstantExpr>(current.model->evaluate(condition))->isTrue()
+              ? falseState : trueState;
+      otherState->model = otherModel;
     }
 
-    addConstraint(*trueState, condition);
-    addConstraint(*falseState, Expr::createIsZero(condition));
+    if (lazy) {
+      trueState->lazyCondition = condition;
+      falseState->lazyCondition = Expr::createIsZero(condition);
+    } else {
+      addConstraint(*trueState, condition);
+      addConstraint(*falseState, Expr::createIsZero(condition));
+    }
 
     // Kinda gross, do we even really still want this option?
     if (MaxDepth && MaxDepth<=trueState->depth) {
@@ -1013,6 +1576,207 @@ Executor::fork(ExecutionState &current, ref<Expr> condition, bool isInternal) {
   }
 }
 
+bool Executor::canForkLazily() {
+  return LazyFork && lazyForkSupported();
+}
+
+bool Executor::lazyForkSupported() {
+  // These write paths out to be replayed without checking their branches,
+  // and merging would drop the pending condition of a lazy child, which
+  // lands right at the join point of its branch.
+  return !OffloadStates && !CheckpointInterval &&
+         !DumpPathPrefixesOnHalt && DumpStatesOnHaltTime <= 0 &&
+         !WriteRegressionPaths && RegressionBaseline.empty() &&
+         !userSearcherMergesStates();
+}
+
+void Executor::creditForkSite(ExecutionState &state) {
+  if (forkController && state.forkSite)
+    forkController->recordCoverage(state.forkSite - 1,
+                                   (ForkController::Decision)
+                                     state.forkDecision,
+                                   state.newInstructions);
+  state.forkSite = 0;
+  state.newInstructions = 0;
+}
+
+bool Executor::summarizeLoopExit(ExecutionState &state,
+                                 KBranchInstruction *kbi, ref<Expr> cond) {
+  BranchInst *bi = cast<BranchInst>(kbi->inst);
+  ref<Expr> exitCondition = kbi->exitSuccessor == 1 ?
+    Expr::createIsZero(cond) : cond;
+  ref<Expr> stayCondition = Expr::createIsZero(exitCondition);
+
+  std::map<ExecutionState*, LoopSummary>::iterator it =
+    loopSummaries.find(&state);
+  if (it != loopSummaries.end() && it->second.branch != kbi) {
+    endLoopSummary(state);
+    it = loopSummaries.end();
+  }
+
+  // A concrete exit ends the summary, and the state leaves the loop as
+  // usual, as it does if it cannot stay in it.
+  if (ConstantExpr *CE = dyn_cast<ConstantExpr>(exitCondition)) {
+    if (CE->isTrue())
+      endLoopSummary(state);
+    return false;
+  }
+  if (seedMap.count(&state))
+    return false;
+
+  bool mayStay;
+  solver->setTimeout(coreSolverTimeout);
+  bool success = solver->mayBeTrue(state, stayCondition, mayStay);
+  solver->setTimeout(0);
+  if (!success || !mayStay) {
+    endLoopSummary(state);
+    return false;
+  }
+
+  if (it == loopSummaries.end()) {
+    LoopSummary summary;
+    summary.branch = kbi;
+    summary.exitState = state.branch();
+    it = loopSummaries.insert(std::make_pair(&state, summary)).first;
+  }
+  LoopSummary &summary = it->second;
+  summary.exitConditions.push_back(exitCondition);
+  summary.liveOuts.push_back(std::vector< ref<Expr> >());
+  std::vector< ref<Expr> > &values = summary.liveOuts.back();
+  for (std::vector<unsigned>::iterator ri = kbi->liveOuts.begin(),
+         re = kbi->liveOuts.end(); ri != re; ++ri)
+    values.push_back(state.stack.back().getLocal(*ri).getValue());
+  ++stats::loopExitsSummarized;
+
+  // Executor::addConstraint would end the summary.
+  state.addConstraint(stayCondition);
+  state.markMultiWayBranch();
+  transferToBasicBlock(bi->getSuccessor(1 - kbi->exitSuccessor),
+                       bi->getParent(), state);
+
+  if (summary.exitConditions.size() >= LoopSummaryBound)
+    endLoopSummary(state);
+  return true;
+}
+
+void Executor::endLoopSummary(ExecutionState &state) {
+  std::map<ExecutionState*, LoopSummary>::iterator it =
+    loopSummaries.find(&state);
+  if (it == loopSummaries.end())
+    return;
+  LoopSummary summary = it->second;
+  loopSummaries.erase(it);
+  ExecutionState *exitState = summary.exitState;
+  if (haltExecution) {
+    delete exitState;
+    return;
+  }
+
+  // The state leaves the loop at the first exit whose condition holds.
+  ref<Expr> exits = ConstantExpr::alloc(0, Expr::Bool);
+  for (unsigned i = 0; i != summary.exitConditions.size(); ++i)
+    exits = OrExpr::create(exits, summary.exitConditions[i]);
+  bool mayExit;
+  solver->setTimeout(coreSolverTimeout);
+  bool success = solver->mayBeTrue(*exitState, exits, mayExit);
+  solver->setTimeout(0);
+  if (!success)
+    klee_warning_once(summary.branch, "dropping the exits of a loop summary "
+                      "after a solver timeout");
+  if (!success || !mayExit) {
+    delete exitState;
+    return;
+  }
+  exitState->addConstraint(exits);
+  exitState->markMultiWayBranch();
+
+  KBranchInstruction *kbi = summary.branch;
+  StackFrame &sf = exitState->stack.back();
+  for (unsigned r = 0; r != kbi->liveOuts.size(); ++r) {
+    bool isFloat = false;
+    for (unsigned i = 0; i != summary.liveOuts.size(); ++i)
+      isFloat |= isa<FExpr>(summary.liveOuts[i][r]);
+    ref<Expr> value;
+    for (unsigned i = summary.liveOuts.size(); i-- != 0;) {
+      ref<Expr> exitValue = summary.liveOuts[i][r];
+      if (isFloat && !isa<FExpr>(exitValue))
+        exitValue = ExplicitFloatExpr::create(exitValue,
+                                              exitValue->getWidth());
+      if (value.isNull())
+        value = exitValue;
+      else if (isFloat)
+        value = FSelectExpr::create(summary.exitConditions[i], exitValue,
+                                    value);
+      else
+        value = SelectExpr::create(summary.exitConditions[i], exitValue,
+                                   value);
+    }
+    sf.getWriteableLocal(kbi->liveOuts[r]).setValue(value);
+  }
+
+  BranchInst *bi = cast<BranchInst>(kbi->inst);
+  transferToBasicBlock(bi->getSuccessor(kbi->exitSuccessor), bi->getParent(),
+                       *exitState);
+
+  state.ptreeNode->data = 0;
+  std::pair<PTree::Node*, PTree::Node*> res =
+    processTree->split(state.ptreeNode, exitState, &state);
+  exitState->ptreeNode = res.first;
+  state.ptreeNode = res.second;
+  addedStates.push_back(exitState);
+}
+
+bool Executor::resolveLazyFork(ExecutionState &state) {
+  if (state.lazyCondition.isNull())
+    return true;
+  ref<Expr> condition = state.lazyCondition;
+  state.lazyCondition = 0;
+
+  if (ConstantExpr *CE = dyn_cast<ConstantExpr>(condition)) {
+    if (CE->isTrue())
+      return true;
+    removeState(state);
+    return false;
+  }
+
+  // The sibling, if it was not run either, is still the other leaf of the
+  // split; its condition is the negation of this one.
+  ExecutionState *sibling = 0;
+  if (PTree::Node *parent = state.ptreeNode->parent) {
+    PTree::Node *other =
+        parent->left == state.ptreeNode ? parent->right : parent->left;
+    if (other && other->data && !other->data->lazyCondition.isNull() &&
+        !isa<ConstantExpr>(other->data->lazyCondition))
+      sibling = other->data;
+  }
+
+  Solver::Validity res;
+  solver->setTimeout(coreSolverTimeout);
+  bool success = solver->evaluate(state, condition, res);
+  solver->setTimeout(0);
+  if (!success) {
+    terminateStateEarly(state, "Query timed out (lazy fork).");
+    return false;
+  }
+
+  if (sibling) {
+    if (res == Solver::Unknown)
+      addConstraint(*sibling, sibling->lazyCondition);
+    sibling->lazyCondition =
+        res == Solver::Unknown
+            ? ref<Expr>(0)
+            : ref<Expr>(ConstantExpr::alloc(res == Solver::False, Expr::Bool));
+  }
+
+  if (res == Solver::False) {
+    removeState(state);
+    return false;
+  }
+  if (res == Solver::Unknown)
+    addConstraint(state, condition);
+  return true;
+}
+
 void Executor::addConstraint(ExecutionState &state, ref<Expr> condition) {
   if (ConstantExpr *CE = dyn_cast<ConstantExpr>(condition)) {
     if (!CE->isTrue())
@@ -1020,20 +1784,28 @@ void Executor::addConstraint(ExecutionState &state, ref<Expr> condition) {
     return;
   }
 
+  // The exits a loop summary skipped do not share the new constraint.
+  if (!loopSummaries.empty())
+    endLoopSummary(state);
+
   // Check to see if this constraint violates seeds.
   std::map< ExecutionState*, std::vector<SeedInfo> >::iterator it = 
     seedMap.find(&state);
   if (it != seedMap.end()) {
     bool warn = false;
-    for (std::vector<SeedInfo>::iterator siit = it->second.begin(), 
-           siie = it->second.end(); siit != siie; ++siit) {
-      bool res;
-      bool success = 
-        solver->mustBeFalse(state, siit->assignment.evaluate(condition), res);
-      assert(success && "FIXME: Unhandled solver failure");
-      (void) success;
+    std::vector<SeedInfo> &seeds = it->second;
+    std::vector<int> values;
+    evaluateSeeds(seeds, condition, values);
+    for (unsigned i = 0; i != seeds.size(); ++i) {
+      bool res = values[i] == 0;
+      if (values[i] < 0) {
+        ref<Expr> value = seeds[i].assignment.evaluate(condition);
+        bool success = solver->mustBeFalse(state, value, res);
+        assert(success && "FIXME: Unhandled solver failure");
+        (void) success;
+      }
       if (res) {
-        siit->patchSeed(state, condition, solver);
+        seeds[i].patchSeed(state, condition, solver);
         warn = true;
       }
     }
@@ -1045,6 +1817,57 @@ void Executor::addConstraint(ExecutionState &state, ref<Expr> condition) {
   if (ivcEnabled)
     doImpliedValueConcretization(state, condition, 
                                  ConstantExpr::alloc(1, Expr::Bool));
+
+  if (SimplifyConstraintsInterval &&
+      state.constraints.size() >=
+          state.simplifiedConstraints + SimplifyConstraintsInterval)
+    simplifyConstraints(state);
+}
+
+void Executor::simplifyConstraints(ExecutionState &state) {
+  // Whether an older constraint is implied by the others only changes with
+  // the constraints added since the last pass, and only for those sharing
+  // a symbolic array with them.
+  size_t first = state.simplifiedConstraints;
+  if (first > state.constraints.size())
+    first = 0;
+  std::vector< ref<Expr> > added(state.constraints.begin() + first,
+                                 state.constraints.end());
+
+  bool changed = state.constraints.simplify();
+
+  if (SimplifyConstraintsTimeout > 0) {
+    std::vector< ref<Expr> > kept(state.constraints.begin(),
+                                  state.constraints.end());
+    solver->setTimeout(SimplifyConstraintsTimeout);
+    for (unsigned i = kept.size(); i-- != 0;) {
+      const ArrayFootprint &fp = kept[i]->getFootprint();
+      bool candidate = false;
+      for (std::vector< ref<Expr> >::iterator it = added.begin(),
+             ie = added.end(); !candidate && it != ie; ++it)
+        candidate = (*it)->getFootprint().intersects(fp);
+      if (!candidate)
+        continue;
+
+      std::vector< ref<Expr> > others(kept.begin(), kept.begin() + i);
+      others.insert(others.end(), kept.begin() + i + 1, kept.end());
+      ExecutionState tmp(others);
+      bool implied;
+      if (solver->mustBeTrue(tmp, kept[i], implied) && implied) {
+        kept.erase(kept.begin() + i);
+        changed = true;
+      }
+    }
+    solver->setTimeout(0);
+    if (kept.size() != state.constraints.size())
+      state.constraints = ConstraintManager(kept);
+  }
+
+  if (changed) {
+    state.constraintCost = 0.;
+    state.constraintCostCount = 0;
+  }
+  state.simplifiedConstraints = state.constraints.size();
 }
 
 static inline const llvm::fltSemantics * fpWidthToSemantics(unsigned width) {
@@ -1060,6 +1883,587 @@ static inline const llvm::fltSemantics * fpWidthToSemantics(unsigned width) {
   }
 }
 
+/// coreSolverHandlesFloats - Whether floating-point expressions are kept
+/// symbolic, which needs a core solver that can decide them (Z3, or a
+/// portfolio racing Z3).
+static inline bool coreSolverHandlesFloats() {
+  return CoreSolverToUse == Z3_SOLVER || CoreSolverToUse == PORTFOLIO_SOLVER;
+}
+
+/// createFAdd - Build the sum of \a left and \a right rounded with \a rm,
+/// including the sign of an exact zero sum, which FAddExpr leaves open.
+static ref<Expr> createFAdd(const ref<Expr> &left, const ref<Expr> &right,
+                            llvm::APFloat::roundingMode rm) {
+  ref<Expr> sum = FAddExpr::create(left, right, rm);
+  if (SpecializeDefaultRounding && rm == llvm::APFloat::rmNearestTiesToEven) {
+    // An exact zero sum of operands with different signs is already +0.
+    return sum;
+  }
+
+  ref<Expr> left_negative = FOleExpr::create(left, FConstantExpr::alloc(APFloat::getZero(*fpWidthToSemantics(sum->getWidth()), 1)));
+  ref<Expr> right_negative = FOleExpr::create(right, FConstantExpr::alloc(APFloat::getZero(*fpWidthToSemantics(sum->getWidth()), 1)));
+  ref<Expr> different_signs = XorExpr::create(left_negative, right_negative);
+
+  ref<Expr> sum_is_zero = OrExpr::create(FOeqExpr::create(FConstantExpr::alloc(APFloat::getZero(*fpWidthToSemantics(sum->getWidth()), 1)), sum),
+                                         FOeqExpr::create(FConstantExpr::alloc(APFloat::getZero(*fpWidthToSemantics(sum->getWidth()), 0)), sum));
+  return FSelectExpr::create(AndExpr::create(sum_is_zero, different_signs), FConstantExpr::alloc(APFloat::getZero(*fpWidthToSemantics(sum->getWidth()), (rm == llvm::APFloat::rmTowardNegative))), sum);
+}
+
+/// createFSub - Build the difference of \a left and \a right rounded with
+/// \a rm, including the sign of an exact zero difference.
+static ref<Expr> createFSub(const ref<Expr> &left, const ref<Expr> &right,
+                            llvm::APFloat::roundingMode rm) {
+  ref<Expr> difference = FSubExpr::create(left, right, rm);
+  if (SpecializeDefaultRounding && rm == llvm::APFloat::rmNearestTiesToEven) {
+    // An exact zero difference of operands with the same sign is already +0.
+    return difference;
+  }
+
+  ref<Expr> left_negative = FOleExpr::create(left, FConstantExpr::alloc(APFloat::getZero(*fpWidthToSemantics(difference->getWidth()), 1)));
+  ref<Expr> right_negative = FOleExpr::create(right, FConstantExpr::alloc(APFloat::getZero(*fpWidthToSemantics(difference->getWidth()), 1)));
+  ref<Expr> same_signs = EqExpr::create(left_negative, right_negative);
+
+  ref<Expr> difference_is_zero = OrExpr::create(FOeqExpr::create(FConstantExpr::alloc(APFloat::getZero(*fpWidthToSemantics(difference->getWidth()), 1)), difference),
+                                                FOeqExpr::create(FConstantExpr::alloc(APFloat::getZero(*fpWidthToSemantics(difference->getWidth()), 0)), difference));
+  return FSelectExpr::create(AndExpr::create(difference_is_zero, same_signs), FConstantExpr::alloc(APFloat::getZero(*fpWidthToSemantics(difference->getWidth()), (rm == llvm::APFloat::rmTowardNegative))), difference);
+}
+
+/// evalHostFloatArith - Compute \a opcode on the bit patterns \a left and
+/// \a right of \a width bits with the host's floating point unit, rounding
+/// in the mode of \a state, and record the exceptions it raises in the
+/// state. Returns false if the host cannot compute the result exactly as
+/// APFloat would.
+static bool evalHostFloatArith(ExecutionState &state, unsigned opcode,
+                               Expr::Width width, uint64_t left,
+                               uint64_t right, uint64_t &result) {
+#if defined(FLT_EVAL_METHOD) && FLT_EVAL_METHOD == 0
+  if (width != Expr::Fl32 && width != Expr::Fl64)
+    return false;
+
+  int hostMode = fegetround(), mode = state.getRoundingMode();
+  if (mode != hostMode)
+    fesetround(mode);
+  feclearexcept(FE_ALL_EXCEPT);
+  // Keep the compiler from moving the arithmetic across the changes of the
+  // floating point environment.
+  volatile uint64_t l = left, r = right, res;
+  switch (opcode) {
+  case Instruction::FAdd: res = floats::add(l, r, width); break;
+  case Instruction::FSub: res = floats::sub(l, r, width); break;
+  case Instruction::FMul: res = floats::mul(l, r, width); break;
+  case Instruction::FDiv: res = floats::div(l, r, width); break;
+  case Instruction::FRem: res = floats::mod(l, r, width); break;
+  default: assert(0 && "invalid floating point operation");
+  }
+  int raised = fetestexcept(FE_ALL_EXCEPT);
+  if (mode != hostMode)
+    fesetround(hostMode);
+
+  // The host's NaNs differ from APFloat's in sign and payload.
+  if (floats::isNaN(res, width))
+    return false;
+  state.fpExceptions |= raised;
+  result = res;
+  return true;
+#else
+  // Excess precision would round twice.
+  return false;
+#endif
+}
+
+/// getFPExceptions - The FE_* flags of the exceptions \a status reports.
+static int getFPExceptions(llvm::APFloat::opStatus status) {
+  int excepts = 0;
+  if (status & llvm::APFloat::opInvalidOp)
+    excepts |= FE_INVALID;
+  if (status & llvm::APFloat::opDivByZero)
+    excepts |= FE_DIVBYZERO;
+  if (status & llvm::APFloat::opOverflow)
+    excepts |= FE_OVERFLOW;
+  if (status & llvm::APFloat::opUnderflow)
+    excepts |= FE_UNDERFLOW;
+  if (status & llvm::APFloat::opInexact)
+    excepts |= FE_INEXACT;
+  return excepts;
+}
+
+bool Executor::bindHostFloatArith(KInstruction *ki, ExecutionState &state) {
+  if (!HostFloatArith)
+    return false;
+
+  Expr::Width width = ki->width;
+  const Cell &left = eval(ki, 0, state), &right = eval(ki, 1, state);
+  uint64_t l, r, result;
+  Expr::Width lw, rw;
+  // With a float-aware solver, floats are FConstantExprs, otherwise they are
+  // kept as their bit patterns.
+  bool floatCells = coreSolverHandlesFloats();
+  if (floatCells ? !left.getFloatConstant(l, lw) || !right.getFloatConstant(r, rw)
+                 : !left.getConstant(l, lw) || !right.getConstant(r, rw))
+    return false;
+  if (lw != width || rw != width ||
+      !evalHostFloatArith(state, ki->opcode, width, l, r, result))
+    return false;
+
+  if (floatCells)
+    getDestCell(state, ki).setFloatConstant(result, width);
+  else
+    getDestCell(state, ki).setConstant(result, width);
+  return true;
+}
+
+bool Executor::bindConstantCells(KInstruction *ki, ExecutionState &state) {
+  Instruction *i = ki->inst;
+  uint64_t left, right;
+  Expr::Width width, rightWidth;
+  if (!eval(ki, 0, state).getConstant(left, width))
+    return false;
+
+  if (isa<CastInst>(i)) {
+    Expr::Width to = ki->width;
+    if (to > Expr::Int64)
+      return false;
+    uint64_t result;
+    switch (ki->opcode) {
+    case Instruction::Trunc: result = ints::trunc(left, to, width); break;
+    case Instruction::ZExt: result = ints::zext(left, to, width); break;
+    case Instruction::SExt: result = ints::sext(left, to, width); break;
+    default: return false;
+    }
+    getDestCell(state, ki).setConstant(result, to);
+    return true;
+  }
+
+  if (!eval(ki, 1, state).getConstant(right, rightWidth))
+    return false;
+  assert(width == rightWidth && "type mismatch");
+  (void) rightWidth;
+
+  uint64_t result;
+  Expr::Width resultWidth = width;
+  switch (ki->opcode) {
+  case Instruction::Add: result = ints::add(left, right, width); break;
+  case Instruction::Sub: result = ints::sub(left, right, width); break;
+  case Instruction::Mul: result = ints::mul(left, right, width); break;
+  // Leave divisions by zero to the checks, and the overflowing signed
+  // division to the expression builder.
+  case Instruction::UDiv:
+    if (!right)
+      return false;
+    result = ints::udiv(left, right, width);
+    break;
+  case Instruction::URem:
+    if (!right)
+      return false;
+    result = ints::urem(left, right, width);
+    break;
+  case Instruction::SDiv:
+    if (!right || right == bits64::maxValueOfNBits(width))
+      return false;
+    result = ints::sdiv(left, right, width);
+    break;
+  case Instruction::SRem:
+    if (!right || right == bits64::maxValueOfNBits(width))
+      return false;
+    result = ints::srem(left, right, width);
+    break;
+  case Instruction::And: result = ints::land(left, right, width); break;
+  case Instruction::Or: result = ints::lor(left, right, width); break;
+  case Instruction::Xor: result = ints::lxor(left, right, width); break;
+  // Leave overshifts to the expression builder.
+  case Instruction::Shl:
+    if (right >= width)
+      return false;
+    result = ints::shl(left, right, width);
+    break;
+  case Instruction::LShr:
+    if (right >= width)
+      return false;
+    result = ints::lshr(left, right, width);
+    break;
+  case Instruction::AShr:
+    if (right >= width)
+      return false;
+    result = ints::ashr(left, right, width);
+    break;
+  case Instruction::ICmp:
+    resultWidth = Expr::Bool;
+    switch (ki->predicate) {
+    case ICmpInst::ICMP_EQ: result = ints::eq(left, right, width); break;
+    case ICmpInst::ICMP_NE: result = ints::ne(left, right, width); break;
+    case ICmpInst::ICMP_UGT: result = ints::ugt(left, right, width); break;
+    case ICmpInst::ICMP_UGE: result = ints::uge(left, right, width); break;
+    case ICmpInst::ICMP_ULT: result = ints::ult(left, right, width); break;
+    case ICmpInst::ICMP_ULE: result = ints::ule(left, right, width); break;
+    case ICmpInst::ICMP_SGT: result = ints::sgt(left, right, width); break;
+    case ICmpInst::ICMP_SGE: result = ints::sge(left, right, width); break;
+    case ICmpInst::ICMP_SLT: result = ints::slt(left, right, width); break;
+    case ICmpInst::ICMP_SLE: result = ints::sle(left, right, width); break;
+    default: return false;
+    }
+    break;
+  default:
+    return false;
+  }
+  getDestCell(state, ki).setConstant(result, resultWidth);
+  return true;
+}
+
+bool Executor::checkOperand(ExecutionState &state, ref<Expr> isError,
+                            const char *message, const char *suffix) {
+  if (ConstantExpr *CE = dyn_cast<ConstantExpr>(isError)) {
+    if (CE->isFalse())
+      return true;
+    terminateStateOnError(state, message, ReportError, suffix);
+    return false;
+  }
+
+  // The state goes on where the operation is fine.
+  StatePair branches = fork(state, Expr::createIsZero(isError), true);
+  if (branches.second)
+    terminateStateOnError(*branches.second, message, ReportError, suffix);
+  return branches.first != 0;
+}
+
+bool Executor::checkDivisor(ExecutionState &state, ref<Expr> divisor) {
+  if (!checkDivZero)
+    return true;
+  return checkOperand(state, Expr::createIsZero(divisor), "divide by zero",
+                      "div.err");
+}
+
+bool Executor::checkShift(ExecutionState &state, ref<Expr> shift) {
+  if (!checkOvershift)
+    return true;
+  Expr::Width width = shift->getWidth();
+  return checkOperand(state,
+                      UgeExpr::create(shift,
+                                      ConstantExpr::create(width, width)),
+                      "overshift error", "overshift.err");
+}
+
+std::vector< ref<Expr> > Executor::evalLanes(KInstruction *ki, unsigned index,
+                                            ExecutionState &state) {
+  const Cell &c = eval(ki, index, state);
+  if (const std::vector< ref<Expr> > *lanes = c.getLanes())
+    return *lanes;
+
+  // Split the packed value, e.g. loaded from memory.
+  VectorType *type = cast<VectorType>(ki->inst->getOperand(index)->getType());
+  Type *elementType = type->getElementType();
+  Expr::Width width = getWidthForLLVMType(elementType);
+  ref<Expr> packed = c.getValue();
+  std::vector< ref<Expr> > lanes;
+  for (unsigned i = 0, e = type->getNumElements(); i != e; ++i) {
+    ref<Expr> lane = ExtractExpr::create(packed, i * width, width);
+    if (elementType->isFloatingPointTy())
+      lane = ExplicitFloatExpr::create(lane, width);
+    lanes.push_back(lane);
+  }
+  return lanes;
+}
+
+ref<Expr> Executor::toConstantLane(ExecutionState &state, ref<Expr> e) {
+  if (isa<ConstantExpr>(e) || isa<FConstantExpr>(e))
+    return e;
+  if (!isa<FExpr>(e))
+    return toConstant(state, e, "floating point");
+  ref<Expr> bits = toConstant(state,
+                              ExplicitIntExpr::create(e, e->getWidth()),
+                              "floating point");
+  return ExplicitFloatExpr::create(bits, bits->getWidth());
+}
+
+ref<Expr> Executor::evalLaneOperation(ExecutionState &state, Instruction *i,
+                                      ref<Expr> left, ref<Expr> right) {
+  unsigned opcode = i->getOpcode();
+  switch (opcode) {
+  case Instruction::Add: return AddExpr::create(left, right);
+  case Instruction::Sub: return SubExpr::create(left, right);
+  case Instruction::Mul: return MulExpr::create(left, right);
+  case Instruction::And: return AndExpr::create(left, right);
+  case Instruction::Or: return OrExpr::create(left, right);
+  case Instruction::Xor: return XorExpr::create(left, right);
+
+  // Constant divisors and shifts in error end the state even without the
+  // checks.
+  case Instruction::UDiv:
+  case Instruction::SDiv:
+  case Instruction::URem:
+  case Instruction::SRem: {
+    if (!checkDivisor(state, right))
+      return 0;
+    ConstantExpr *divisor = dyn_cast<ConstantExpr>(right);
+    if (divisor && divisor->isZero()) {
+      terminateStateOnError(state, "divide by zero", Overflow);
+      return 0;
+    }
+    switch (opcode) {
+    case Instruction::UDiv: return UDivExpr::create(left, right);
+    case Instruction::SDiv: return SDivExpr::create(left, right);
+    case Instruction::URem: return URemExpr::create(left, right);
+    default: return SRemExpr::create(left, right);
+    }
+  }
+
+  case Instruction::Shl:
+  case Instruction::LShr:
+  case Instruction::AShr: {
+    if (!checkShift(state, right))
+      return 0;
+    ConstantExpr *shift = dyn_cast<ConstantExpr>(right);
+    if (shift && shift->getZExtValue() >= left->getWidth()) {
+      terminateStateOnError(state, "overshift error", Overflow);
+      return 0;
+    }
+    switch (opcode) {
+    case Instruction::Shl: return ShlExpr::create(left, right);
+    case Instruction::LShr: return LShrExpr::create(left, right);
+    default: return AShrExpr::create(left, right);
+    }
+  }
+
+  case Instruction::FAdd:
+  case Instruction::FSub:
+  case Instruction::FMul:
+  case Instruction::FDiv:
+  case Instruction::FRem: {
+    if (!coreSolverHandlesFloats()) {
+      left = toConstantLane(state, left);
+      right = toConstantLane(state, right);
+    }
+    FConstantExpr *cl = dyn_cast<FConstantExpr>(left);
+    FConstantExpr *cr = dyn_cast<FConstantExpr>(right);
+    Expr::Width width = left->getWidth();
+    uint64_t result;
+    if (HostFloatArith && cl && cr &&
+        evalHostFloatArith(state, opcode, width,
+                           cl->getAPValue().bitcastToAPInt().getZExtValue(),
+                           cr->getAPValue().bitcastToAPInt().getZExtValue(),
+                           result))
+      return FConstantExpr::alloc(APFloat(*fpWidthToSemantics(width),
+                                          APInt(width, result)));
+    switch (opcode) {
+    case Instruction::FAdd:
+      return createFAdd(left, right, state.roundingMode);
+    case Instruction::FSub:
+      return createFSub(left, right, state.roundingMode);
+    case Instruction::FMul:
+      return FMulExpr::create(left, right, state.roundingMode);
+    case Instruction::FDiv:
+      return FDivExpr::create(left, right, state.roundingMode);
+    default:
+      return FRemExpr::create(left, right, state.roundingMode);
+    }
+  }
+
+  case Instruction::ICmp:
+    switch (cast<ICmpInst>(i)->getPredicate()) {
+    case ICmpInst::ICMP_EQ: return EqExpr::create(left, right);
+    case ICmpInst::ICMP_NE: return NeExpr::create(left, right);
+    case ICmpInst::ICMP_UGT: return UgtExpr::create(left, right);
+    case ICmpInst::ICMP_UGE: return UgeExpr::create(left, right);
+    case ICmpInst::ICMP_ULT: return UltExpr::create(left, right);
+    case ICmpInst::ICMP_ULE: return UleExpr::create(left, right);
+    case ICmpInst::ICMP_SGT: return SgtExpr::create(left, right);
+    case ICmpInst::ICMP_SGE: return SgeExpr::create(left, right);
+    case ICmpInst::ICMP_SLT: return SltExpr::create(left, right);
+    case ICmpInst::ICMP_SLE: return SleExpr::create(left, right);
+    default:
+      terminateStateOnExecError(state, "invalid ICmp predicate");
+      return 0;
+    }
+
+  case Instruction::FCmp:
+    if (!coreSolverHandlesFloats()) {
+      left = toConstantLane(state, left);
+      right = toConstantLane(state, right);
+    }
+    switch (cast<FCmpInst>(i)->getPredicate()) {
+    case FCmpInst::FCMP_FALSE: return ConstantExpr::alloc(0, Expr::Bool);
+    case FCmpInst::FCMP_TRUE: return ConstantExpr::alloc(1, Expr::Bool);
+    case FCmpInst::FCMP_ORD: return FOrdExpr::create(left, right);
+    case FCmpInst::FCMP_UNO: return FUnoExpr::create(left, right);
+    case FCmpInst::FCMP_UEQ: return FUeqExpr::create(left, right);
+    case FCmpInst::FCMP_OEQ: return FOeqExpr::create(left, right);
+    case FCmpInst::FCMP_UGT: return FUgtExpr::create(left, right);
+    case FCmpInst::FCMP_OGT: return FOgtExpr::create(left, right);
+    case FCmpInst::FCMP_UGE: return FUgeExpr::create(left, right);
+    case FCmpInst::FCMP_OGE: return FOgeExpr::create(left, right);
+    case FCmpInst::FCMP_ULT: return FUltExpr::create(left, right);
+    case FCmpInst::FCMP_OLT: return FOltExpr::create(left, right);
+    case FCmpInst::FCMP_ULE: return FUleExpr::create(left, right);
+    case FCmpInst::FCMP_OLE: return FOleExpr::create(left, right);
+    case FCmpInst::FCMP_UNE: return FUneExpr::create(left, right);
+    case FCmpInst::FCMP_ONE: return FOneExpr::create(left, right);
+    default:
+      terminateStateOnExecError(state, "invalid FCmp predicate");
+      return 0;
+    }
+
+  default:
+    assert(0 && "invalid lane operation");
+    return 0;
+  }
+}
+
+ref<Expr> Executor::evalLaneCast(ExecutionState &state, CastInst *ci,
+                                 ref<Expr> arg) {
+  Expr::Width width =
+    getWidthForLLVMType(cast<VectorType>(ci->getType())->getElementType());
+  if (!coreSolverHandlesFloats() &&
+      (ci->getSrcTy()->isFPOrFPVectorTy() ||
+       ci->getDestTy()->isFPOrFPVectorTy()))
+    arg = toConstantLane(state, arg);
+
+  switch (ci->getOpcode()) {
+  case Instruction::Trunc: return ExtractExpr::create(arg, 0, width);
+  case Instruction::ZExt: return ZExtExpr::create(arg, width);
+  case Instruction::SExt: return SExtExpr::create(arg, width);
+  case Instruction::FPTrunc:
+  case Instruction::FPExt:
+    return FExtExpr::create(arg, width, state.roundingMode);
+  case Instruction::FPToUI:
+    return FToUExpr::create(arg, width, llvm::APFloat::rmTowardZero);
+  case Instruction::FPToSI:
+    return FToSExpr::create(arg, width, llvm::APFloat::rmTowardZero);
+  case Instruction::UIToFP:
+    return UToFExpr::create(arg, width, state.roundingMode);
+  case Instruction::SIToFP:
+    return SToFExpr::create(arg, width, state.roundingMode);
+  default:
+    return 0;
+  }
+}
+
+bool Executor::executeVectorInstruction(ExecutionState &state,
+                                        KInstruction *ki) {
+  Instruction *i = ki->inst;
+  std::vector< ref<Expr> > result;
+
+  switch (ki->opcode) {
+  // These work on the packed value.
+  case Instruction::Load:
+  case Instruction::PHI:
+  case Instruction::Call:
+  case Instruction::Invoke:
+  case Instruction::BitCast:
+  case Instruction::ExtractValue:
+    return false;
+
+  case Instruction::Add:
+  case Instruction::Sub:
+  case Instruction::Mul:
+  case Instruction::UDiv:
+  case Instruction::SDiv:
+  case Instruction::URem:
+  case Instruction::SRem:
+  case Instruction::And:
+  case Instruction::Or:
+  case Instruction::Xor:
+  case Instruction::Shl:
+  case Instruction::LShr:
+  case Instruction::AShr:
+  case Instruction::FAdd:
+  case Instruction::FSub:
+  case Instruction::FMul:
+  case Instruction::FDiv:
+  case Instruction::FRem:
+  case Instruction::ICmp:
+  case Instruction::FCmp: {
+    std::vector< ref<Expr> > left = evalLanes(ki, 0, state);
+    std::vector< ref<Expr> > right = evalLanes(ki, 1, state);
+    for (unsigned lane = 0; lane != left.size(); ++lane) {
+      ref<Expr> e = evalLaneOperation(state, i, left[lane], right[lane]);
+      if (e.isNull())
+        return true;
+      result.push_back(e);
+    }
+    break;
+  }
+
+  case Instruction::Trunc:
+  case Instruction::ZExt:
+  case Instruction::SExt:
+  case Instruction::FPTrunc:
+  case Instruction::FPExt:
+  case Instruction::FPToUI:
+  case Instruction::FPToSI:
+  case Instruction::UIToFP:
+  case Instruction::SIToFP: {
+    std::vector< ref<Expr> > args = evalLanes(ki, 0, state);
+    for (unsigned lane = 0; lane != args.size(); ++lane)
+      result.push_back(evalLaneCast(state, cast<CastInst>(i), args[lane]));
+    break;
+  }
+
+  case Instruction::Select: {
+    std::vector< ref<Expr> > trueLanes = evalLanes(ki, 1, state);
+    std::vector< ref<Expr> > falseLanes = evalLanes(ki, 2, state);
+    std::vector< ref<Expr> > conds;
+    if (i->getOperand(0)->getType()->isVectorTy())
+      conds = evalLanes(ki, 0, state);
+    else
+      conds.assign(trueLanes.size(), eval(ki, 0, state).getValue());
+    for (unsigned lane = 0; lane != trueLanes.size(); ++lane) {
+      if (isa<FExpr>(trueLanes[lane]))
+        result.push_back(FSelectExpr::create(conds[lane], trueLanes[lane],
+                                             falseLanes[lane]));
+      else
+        result.push_back(SelectExpr::create(conds[lane], trueLanes[lane],
+                                            falseLanes[lane]));
+    }
+    break;
+  }
+
+  case Instruction::InsertElement: {
+    result = evalLanes(ki, 0, state);
+    ref<klee::ConstantExpr> index =
+      toConstant(state, eval(ki, 2, state).getValue(), "vector index");
+    uint64_t lane = index->getZExtValue();
+    if (lane >= result.size()) {
+      // The result is undefined, keep the vector.
+      bindLanes(ki, state, result);
+      return true;
+    }
+    ref<Expr> value = eval(ki, 1, state).getValue();
+    // Floating point lanes are always held as floats.
+    if (i->getOperand(1)->getType()->isFloatingPointTy() && !isa<FExpr>(value))
+      value = ExplicitFloatExpr::create(value, value->getWidth());
+    result[lane] = value;
+    break;
+  }
+
+  case Instruction::ShuffleVector: {
+    ShuffleVectorInst *si = cast<ShuffleVectorInst>(i);
+    std::vector< ref<Expr> > lanes = evalLanes(ki, 0, state);
+    std::vector< ref<Expr> > second = evalLanes(ki, 1, state);
+    unsigned n = lanes.size();
+    lanes.insert(lanes.end(), second.begin(), second.end());
+    for (unsigned lane = 0, e = cast<VectorType>(si->getType())->getNumElements();
+         lane != e; ++lane) {
+      int mask = si->getMaskValue(lane);
+      // Undefined lanes take the first lane of the first vector.
+      result.push_back(lanes[mask < 0 || (unsigned) mask >= 2 * n ? 0 : mask]);
+    }
+    break;
+  }
+
+  default:
+    terminateStateOnError(state, "XXX vector instructions unhandled",
+                          Unhandled);
+    return true;
+  }
+
+  bindLanes(ki, state, result);
+  return true;
+}
+
+void Executor::bindLanes(KInstruction *target, ExecutionState &state,
+                         const std::vector< ref<Expr> > &lanes) {
+  getDestCell(state, target).setLanes(lanes);
+}
+
 ref<klee::Expr> Executor::evalConstant(const Constant *c) {
   if (const llvm::ConstantExpr *ce = dyn_cast<llvm::ConstantExpr>(c)) {
     return evalConstantExpr(ce);
@@ -1075,9 +2479,20 @@ ref<klee::Expr> Executor::evalConstant(const Constant *c) {
     } else if (isa<UndefValue>(c) || isa<ConstantAggregateZero>(c)) {
       if (c->getType()->isFloatingPointTy()) {
         return FConstantExpr::alloc(APFloat(*fpWidthToSemantics(getWidthForLLVMType(c->getType()))));
+      } else if (c->getType()->isVectorTy()) {
+        return ConstantExpr::alloc(APInt(getWidthForLLVMType(c->getType()), 0));
       } else {
         return ConstantExpr::create(0, getWidthForLLVMType(c->getType()));
       }
+    } else if (c->getType()->isVectorTy() && !isa<ConstantAggregateZero>(c)) {
+      // Pack the lanes as the vector instructions do, the first lane in the
+      // lowest bits.
+      std::vector<ref<Expr> > lanes;
+      for (unsigned i = 0, e = c->getType()->getVectorNumElements(); i != e; ++i)
+        lanes.push_back(evalConstant(c->getAggregateElement(i)));
+      Cell cell;
+      cell.setLanes(lanes);
+      return cell.getValue();
 #if LLVM_VERSION_CODE >= LLVM_VERSION(3, 1)
     } else if (const ConstantDataSequential *cds =
                  dyn_cast<ConstantDataSequential>(c)) {
@@ -1119,7 +2534,6 @@ ref<klee::Expr> Executor::evalConstant(const Constant *c) {
       ref<Expr> res = ConcatExpr::createN(kids.size(), kids.data());
       return cast<ConstantExpr>(res);
     } else {
-      // Constant{Vector}
       llvm::report_fatal_error("invalid argument to evalConstant()");
     }
   }
@@ -1140,52 +2554,46 @@ const Cell& Executor::eval(KInstruction *ki, unsigned index,
   } else {
     unsigned index = vnumber;
     StackFrame &sf = state.stack.back();
-    return sf.locals[index];
+    return sf.getLocal(index);
   }
 }
 
 void Executor::bindLocal(KInstruction *target, ExecutionState &state, 
                          ref<Expr> value) {
-  getDestCell(state, target).value = value;
+  if (floatPolicy)
+    value = applyFloatPolicy(state, target, FloatConcretizationPolicy::Size,
+                             target->inst->getParent()->getParent()->getName(),
+                             value);
+  getDestCell(state, target).setValue(value);
 }
 
 void Executor::bindArgument(KFunction *kf, unsigned index, 
                             ExecutionState &state, ref<Expr> value) {
-  getArgumentCell(state, kf, index).value = value;
+  getArgumentCell(state, kf, index).setValue(value);
 }
 
 ref<Expr> Executor::toUnique(const ExecutionState &state, 
                              ref<Expr> &e) {
-  ref<Expr> result = e;
-
-  if (isa<IExpr>(e) && !isa<ConstantExpr>(e)) {
-    ref<Expr> value;
-    bool isTrue = false;
+  if (isa<ConstantExpr>(e) || isa<FConstantExpr>(e))
+    return e;
 
-    solver->setTimeout(coreSolverTimeout);
-    if (solver->getValue(state, e, value) &&
-        solver->mustBeTrue(state, EqExpr::create(e, value), isTrue) &&
-        isTrue)
-      result = value;
-    solver->setTimeout(0);
+  // The answer holds until the state gets a new constraint.
+  ExprHashMap< ref<Expr> >::iterator it = state.uniqueValues.find(e);
+  if (it != state.uniqueValues.end()) {
+    ++stats::uniqueValueHits;
+    return it->second;
   }
-  else if (isa<FExpr>(e) && !isa<FConstantExpr>(e)) {
-    ref<Expr> value;
-    bool isTrue = false;
 
-    solver->setTimeout(coreSolverTimeout);
-    if (solver->getValue(state, e, value) &&
-        solver->mustBeTrue(state, 
-                           OrExpr::create(
-                             FOeqExpr::create(e, value),
-                             AndExpr::create(
-                               EqExpr::create(FIsNanExpr::create(e), ConstantExpr::create(0, 8*sizeof(int))), 
-                               EqExpr::create(FIsNanExpr::create(value), ConstantExpr::create(0, 8*sizeof(int))))), 
-                           isTrue) &&
-        isTrue)
-      result = value;
-    solver->setTimeout(0);
-  }
+  ref<Expr> value;
+  bool isUnique = false;
+  solver->setTimeout(coreSolverTimeout);
+  bool success = solver->getUniqueValue(state, e, value, isUnique);
+  solver->setTimeout(0);
+  if (!success)
+    return e;
+
+  ref<Expr> result = isUnique ? value : e;
+  state.uniqueValues.insert(std::make_pair(e, result));
   return result;
 }
 
@@ -1222,6 +2630,50 @@ Executor::toConstant(ExecutionState &state,
   return value;
 }
 
+ref<Expr> Executor::concretizeFloat(ExecutionState &state, KInstruction *ki,
+                                    ref<Expr> e) {
+  Expr::Width width = e->getWidth();
+  ref<Expr> bits =
+      state.constraints.simplifyExpr(ExplicitIntExpr::create(e, width));
+  ref<Expr> value;
+  std::map< ExecutionState*, std::vector<SeedInfo> >::iterator it =
+    seedMap.find(&state);
+  if (it != seedMap.end()) {
+    for (std::vector<SeedInfo>::iterator siit = it->second.begin(),
+           siie = it->second.end(); siit != siie; ++siit) {
+      ref<Expr> seedValue = siit->assignment.evaluate(bits);
+      if (isa<ConstantExpr>(seedValue)) {
+        value = seedValue;
+        break;
+      }
+    }
+  }
+  if (value.isNull()) {
+    bool success = solver->getValue(state, bits, value);
+    assert(success && "FIXME: Unhandled solver failure");
+    (void) success;
+  }
+
+  klee_warning_once(ki, "concretizing floating point value by policy (%s:%u)",
+                    ki->info->file.c_str(), ki->info->line);
+  ++stats::floatConcretizations;
+  addConstraint(state, EqExpr::create(bits, value));
+  return ExplicitFloatExpr::create(value, width);
+}
+
+ref<Expr> Executor::applyFloatPolicy(ExecutionState &state, KInstruction *ki,
+                                     FloatConcretizationPolicy::Trigger trigger,
+                                     StringRef name, ref<Expr> e) {
+  if (!isa<FExpr>(e) || isa<FConstantExpr>(e))
+    return e;
+  unsigned threshold =
+      floatPolicy->getThreshold(trigger, name.str(), ki->info->file, ki->info->line);
+  if (!threshold ||
+      FloatConcretizationPolicy::countNodes(e, threshold) < threshold)
+    return e;
+  return concretizeFloat(state, ki, e);
+}
+
 void Executor::executeGetValue(ExecutionState &state,
                                ref<Expr> e,
                                KInstruction *target) {
@@ -1307,6 +2759,8 @@ void Executor::stepInstruction(ExecutionState &state) {
   printDebugInstructions(state);
   if (statsTracker)
     statsTracker->stepInstruction(state);
+  if (interpreterOpts.TrackPathCoverage)
+    state.pathCoverage.set(state.pc->info->id);
 
   ++stats::instructions;
   state.prevPC = state.pc;
@@ -1316,14 +2770,82 @@ void Executor::stepInstruction(ExecutionState &state) {
     haltExecution = true;
 }
 
+/// isConcreteCell - Whether the cell holds a constant, without building the
+/// expression of an immediate.
+static bool isConcreteCell(const Cell &c) {
+  uint64_t v;
+  Expr::Width w;
+  if (c.getConstant(v, w) || c.getFloatConstant(v, w))
+    return true;
+  ref<Expr> e = c.getValue();
+  return !e.isNull() && (isa<klee::ConstantExpr>(e) || isa<FConstantExpr>(e));
+}
+
+bool Executor::isFusable(KInstruction *ki, ExecutionState &state) const {
+  if (ki->isVector)
+    return false;
+
+  switch (ki->opcode) {
+  case Instruction::Add: case Instruction::Sub: case Instruction::Mul:
+  case Instruction::UDiv: case Instruction::SDiv:
+  case Instruction::URem: case Instruction::SRem:
+  case Instruction::And: case Instruction::Or: case Instruction::Xor:
+  case Instruction::Shl: case Instruction::LShr: case Instruction::AShr:
+  case Instruction::FAdd: case Instruction::FSub: case Instruction::FMul:
+  case Instruction::FDiv: case Instruction::FRem:
+  case Instruction::Trunc: case Instruction::ZExt: case Instruction::SExt:
+  case Instruction::FPTrunc: case Instruction::FPExt:
+  case Instruction::FPToUI: case Instruction::FPToSI:
+  case Instruction::UIToFP: case Instruction::SIToFP:
+  case Instruction::PtrToInt: case Instruction::IntToPtr:
+  case Instruction::BitCast:
+  case Instruction::ICmp: case Instruction::FCmp:
+  case Instruction::Select: case Instruction::GetElementPtr:
+  case Instruction::Load: case Instruction::Store:
+    break;
+  default:
+    return false;
+  }
+
+  for (unsigned i = 0, e = ki->inst->getNumOperands(); i != e; ++i)
+    if (!isConcreteCell(eval(ki, i, state)))
+      return false;
+  return true;
+}
+
+void Executor::executeConcreteRun(ExecutionState &state) {
+  // Concrete operands cannot fork the state; an error terminating it shows
+  // up in removedStates. Runs stay within a block, so that the searcher
+  // still sees every state entering one, e.g. to merge it.
+  BasicBlock *bb = state.prevPC->inst->getParent();
+  for (unsigned n = 0; n != FuseConcreteRuns; ++n) {
+    if (haltExecution || !addedStates.empty() || !removedStates.empty())
+      return;
+    KInstruction *ki = state.pc;
+    if (ki->inst->getParent() != bb || ki->inst == &bb->front() ||
+        !isFusable(ki, state))
+      return;
+    stepInstruction(state);
+    executeInstruction(state, ki);
+    ++stats::fusedInstructions;
+  }
+}
+
 void Executor::executeCall(ExecutionState &state, 
                            KInstruction *ki,
                            Function *f,
                            std::vector< ref<Expr> > &arguments) {
   Instruction *i = ki->inst;
+  if (floatPolicy && f)
+    for (unsigned j = 0; j != arguments.size(); ++j)
+      arguments[j] = applyFloatPolicy(state, ki,
+                                      FloatConcretizationPolicy::Call,
+                                      f->getName(), arguments[j]);
   if (f && f->isDeclaration()) {
     switch(f->getIntrinsicID()) {
     case Intrinsic::not_intrinsic:
+      // A call of a modeled or external function is not memoized.
+      state.recording = 0;
       // state may be destroyed by this call, cannot touch
       callExternalFunction(state, ki, f, arguments);
       break;
@@ -1366,6 +2888,32 @@ void Executor::executeCall(ExecutionState &state,
       }
       break;
     }
+    case Intrinsic::fma:
+#if LLVM_VERSION_CODE >= LLVM_VERSION(3, 2)
+    case Intrinsic::fmuladd:
+#endif
+    {
+      // Both are fused, rounding once, so that contracted code computes
+      // what it does on targets with a fused multiply-add instruction.
+      if (!coreSolverHandlesFloats()) {
+        ref<ConstantExpr> ops[3];
+        for (unsigned j = 0; j != 3; ++j)
+          ops[j] = toConstant(state, arguments[j], "floating point");
+        const llvm::fltSemantics *sem = fpWidthToSemantics(ops[0]->getWidth());
+        if (!sem)
+          return terminateStateOnExecError(state, "Unsupported FFma operation");
+        llvm::APFloat Res(*sem, ops[0]->getAPValue());
+        state.fpExceptions |= getFPExceptions(Res.fusedMultiplyAdd(APFloat(*sem, ops[1]->getAPValue()),
+                                                                   APFloat(*sem, ops[2]->getAPValue()),
+                                                                   state.roundingMode));
+        bindLocal(ki, state, FConstantExpr::alloc(Res));
+      } else {
+        bindLocal(ki, state, FFmaExpr::create(arguments[0], arguments[1],
+                                              arguments[2], state.roundingMode));
+      }
+      break;
+    }
+
     case Intrinsic::vaend:
       // va_end is a noop for the interpreter.
       //
@@ -1390,9 +2938,73 @@ void Executor::executeCall(ExecutionState &state,
     // instead of the actual instruction, since we can't make a KInstIterator
     // from just an instruction (unlike LLVM).
     KFunction *kf = kmodule->functionMap[f];
+
+    // Past its budget, a function is explored for one value of each
+    // argument, which also lets the calls of a pure one be memoized.
+    if (kf->cost.exceeds(kf->budget)) {
+      klee_warning_once(kf, "%s is over its budget, concretizing the "
+                        "arguments of its calls", f->getName().data());
+      for (unsigned j = 0; j != arguments.size(); ++j) {
+        ref<Expr> &arg = arguments[j];
+        if (isa<ConstantExpr>(arg) || isa<FConstantExpr>(arg))
+          continue;
+        if (!isa<FExpr>(arg)) {
+          arg = toConstant(state, arg, "call over its function's budget");
+          continue;
+        }
+        ref<Expr> bits = toConstant(state,
+                                    ExplicitIntExpr::create(arg,
+                                                            arg->getWidth()),
+                                    "call over its function's budget");
+        arg = ExplicitFloatExpr::create(bits, bits->getWidth());
+      }
+    }
+
+    PureCall call;
+    // A memoized call would not record the functions it enters.
+    bool pure = !regressionPaths && callMemo.isPure(f) &&
+                i->getType() == f->getReturnType();
+    for (unsigned j = 0; pure && j != arguments.size(); ++j)
+      pure = isa<ConstantExpr>(arguments[j]) ||
+             isa<FConstantExpr>(arguments[j]);
+    if (pure) {
+      call.function = f;
+      call.arguments = arguments;
+      call.roundingMode = state.roundingMode;
+      call.fpExceptions = state.fpExceptions;
+      if (callMemoized(state, ki, call)) {
+        if (InvokeInst *ii = dyn_cast<InvokeInst>(i))
+          transferToBasicBlock(ii->getNormalDest(), i->getParent(), state);
+        return;
+      }
+    }
+
+    // Functions handled natively are entered all the same.
+    if (regressionPaths)
+      state.firstCalls = state.firstCalls.insert(
+          std::make_pair(f, state.pathHistory.size()));
+
+    // Calls handled natively make no memory accesses to record.
+    if (state.recording.isNull() &&
+        ((BulkMemoryFunctions &&
+         specialFunctionHandler->handleBulkMemory(state, f, ki, arguments)) ||
+        (NativeStringFunctions &&
+         specialFunctionHandler->handleStringFunction(state, f, ki,
+                                                      arguments)) ||
+        (NativeConcreteCalls && callNatively(state, ki, f, arguments)))) {
+      if (InvokeInst *ii = dyn_cast<InvokeInst>(i))
+        transferToBasicBlock(ii->getNormalDest(), i->getParent(), state);
+      return;
+    }
+
     state.pushFrame(state.prevPC, kf);
     state.pc = kf->instructions;
 
+    // The outermost pure call is recorded, along with the calls it makes.
+    if (pure && state.recording.isNull())
+      state.recording = new CallRecording(call, state.stack.size(),
+                                          MemoryObject::getNextId());
+
     if (statsTracker)
       statsTracker->framePushed(state, &state.stack[state.stack.size()-2]);
 
@@ -1558,7 +3170,10 @@ static bool isDebugIntrinsic(const Function *f, KModule *KM) {
 
 void Executor::executeInstruction(ExecutionState &state, KInstruction *ki) {
   Instruction *i = ki->inst;
-  switch (i->getOpcode()) {
+  if (ki->isVector && executeVectorInstruction(state, ki))
+    return;
+
+  switch (ki->opcode) {
     // Control flow
   case Instruction::Ret: {
     ReturnInst *ri = cast<ReturnInst>(i);
@@ -1568,13 +3183,22 @@ void Executor::executeInstruction(ExecutionState &state, KInstruction *ki) {
     ref<Expr> result = ConstantExpr::alloc(0, Expr::Bool);
     
     if (!isVoidReturn) {
-      result = eval(ki, 0, state).value;
+      result = eval(ki, 0, state).getValue();
     }
     
     if (state.stack.size() <= 1) {
       assert(!caller && "caller set on initial stack frame");
       terminateStateOnExit(state);
     } else {
+      if (!state.recording.isNull() &&
+          state.recording->depth == state.stack.size()) {
+        if (isVoidReturn || isa<ConstantExpr>(result) ||
+            isa<FConstantExpr>(result))
+          callMemo.insert(*state.recording,
+                          isVoidReturn ? ref<Expr>() : result,
+                          state.fpExceptions);
+        state.recording = 0;
+      }
       state.popFrame();
 
       if (statsTracker)
@@ -1628,6 +3252,7 @@ void Executor::executeInstruction(ExecutionState &state, KInstruction *ki) {
   }
 #if LLVM_VERSION_CODE < LLVM_VERSION(3, 1)
   case Instruction::Unwind: {
+    state.recording = 0;
     for (;;) {
       KInstruction *kcaller = state.stack.back().caller;
       state.popFrame();
@@ -1657,7 +3282,11 @@ void Executor::executeInstruction(ExecutionState &state, KInstruction *ki) {
       // FIXME: Find a way that we don't have this hidden dependency.
       assert(bi->getCondition() == bi->getOperand(0) &&
              "Wrong operand index!");
-      ref<Expr> cond = eval(ki, 0, state).value;
+      ref<Expr> cond = eval(ki, 0, state).getValue();
+      KBranchInstruction *kbi = static_cast<KBranchInstruction*>(ki);
+      if (kbi->exitSuccessor >= 0 && LoopSummaryBound &&
+          summarizeLoopExit(state, kbi, cond))
+        break;
       Executor::StatePair branches = fork(state, cond, false);
 
       // NOTE: There is a hidden dependency here, markBranchVisited
@@ -1667,6 +3296,14 @@ void Executor::executeInstruction(ExecutionState &state, KInstruction *ki) {
       if (statsTracker && state.stack.back().kf->trackCoverage)
         statsTracker->markBranchVisited(branches.first, branches.second);
 
+      if (interpreterOpts.TrackPathCoverage) {
+        unsigned item = kmodule->infos->getMaxID() + 2 * ki->info->id;
+        if (branches.first)
+          branches.first->pathCoverage.set(item);
+        if (branches.second)
+          branches.second->pathCoverage.set(item + 1);
+      }
+
       if (branches.first)
         transferToBasicBlock(bi->getSuccessor(0), bi->getParent(), *branches.first);
       if (branches.second)
@@ -1676,22 +3313,35 @@ void Executor::executeInstruction(ExecutionState &state, KInstruction *ki) {
   }
   case Instruction::Switch: {
     SwitchInst *si = cast<SwitchInst>(i);
-    ref<Expr> cond = eval(ki, 0, state).value;
+    KSwitchInstruction *ksi = static_cast<KSwitchInstruction*>(ki);
     BasicBlock *bb = si->getParent();
 
+    // Concrete conditions are looked up in the case table.
+    uint64_t value;
+    Expr::Width valueWidth;
+    if (ksi->hasCaseTable &&
+        eval(ki, 0, state).getConstant(value, valueWidth)) {
+      transferToBasicBlock(si->getSuccessor(ksi->getSuccessorIndex(value)),
+                           bb, state);
+      break;
+    }
+
+    ref<Expr> cond = eval(ki, 0, state).getValue();
     cond = toUnique(state, cond);
     if (ConstantExpr *CE = dyn_cast<ConstantExpr>(cond)) {
-      // Somewhat gross to create these all the time, but fine till we
-      // switch to an internal rep.
-      LLVM_TYPE_Q llvm::IntegerType *Ty = 
-        cast<IntegerType>(si->getCondition()->getType());
-      ConstantInt *ci = ConstantInt::get(Ty, CE->getZExtValue());
+      unsigned index;
+      if (ksi->hasCaseTable) {
+        index = ksi->getSuccessorIndex(CE->getZExtValue());
+      } else {
+        ConstantInt *ci = ConstantInt::get(si->getContext(),
+                                           CE->getAPValue());
 #if LLVM_VERSION_CODE >= LLVM_VERSION(3, 1)
-      unsigned index = si->findCaseValue(ci).getSuccessorIndex();
+        index = si->findCaseValue(ci).getSuccessorIndex();
 #else
-      unsigned index = si->findCaseValue(ci);
+        index = si->findCaseValue(ci);
 #endif
-      transferToBasicBlock(si->getSuccessor(index), si->getParent(), state);
+      }
+      transferToBasicBlock(si->getSuccessor(index), bb, state);
     } else {
       // Handle possible different branch targets
 
@@ -1726,22 +3376,34 @@ void Executor::executeInstruction(ExecutionState &state, KInstruction *ki) {
       // Track default branch values
       ref<Expr> defaultValue = ConstantExpr::alloc(1, Expr::Bool);
 
-      // iterate through all non-default cases but in order of the expressions
+      std::vector< ref<Expr> > matches;
       for (std::map<ref<Expr>, BasicBlock *>::iterator
                it = expressionOrder.begin(),
                itE = expressionOrder.end();
            it != itE; ++it) {
         ref<Expr> match = EqExpr::create(cond, it->first);
+        matches.push_back(match);
 
         // Make sure that the default value does not contain this target's value
         defaultValue = AndExpr::create(defaultValue, Expr::createIsZero(match));
+      }
 
-        // Check if control flow could take this case
-        bool result;
-        bool success = solver->mayBeTrue(state, match, result);
-        assert(success && "FIXME: Unhandled solver failure");
-        (void) success;
-        if (result) {
+      // Check which cases control flow could take, including the default
+      // one, in a single batch over the state's constraints
+      matches.push_back(defaultValue);
+      std::vector<bool> feasible;
+      bool success = solver->mayBeTrueMany(state, matches, feasible);
+      assert(success && "FIXME: Unhandled solver failure");
+      (void) success;
+
+      // iterate through all non-default cases but in order of the expressions
+      unsigned index = 0;
+      for (std::map<ref<Expr>, BasicBlock *>::iterator
+               it = expressionOrder.begin(),
+               itE = expressionOrder.end();
+           it != itE; ++it, ++index) {
+        ref<Expr> match = matches[index];
+        if (feasible[index]) {
           BasicBlock *caseSuccessor = it->second;
 
           // Handle the case that a basic block might be the target of multiple
@@ -1764,11 +3426,7 @@ void Executor::executeInstruction(ExecutionState &state, KInstruction *ki) {
       }
 
       // Check if control could take the default case
-      bool res;
-      bool success = solver->mayBeTrue(state, defaultValue, res);
-      assert(success && "FIXME: Unhandled solver failure");
-      (void) success;
-      if (res) {
+      if (feasible[index]) {
         std::pair<std::map<BasicBlock *, ref<Expr> >::iterator, bool> ret =
             branchTargets.insert(
                 std::make_pair(si->getDefaultDest(), defaultValue));
@@ -1814,7 +3472,11 @@ void Executor::executeInstruction(ExecutionState &state, KInstruction *ki) {
 
     unsigned numArgs = cs.arg_size();
     Value *fp = cs.getCalledValue();
-    Function *f = getTargetFunction(fp, state);
+    // Only klee_alias_function makes the target differ from the one found
+    // when the module was loaded.
+    Function *f = state.hasFnAliases() ?
+      getTargetFunction(fp, state) :
+      static_cast<KCallInstruction*>(ki)->staticTarget;
 
     // Skip debug intrinsics, we can't evaluate their metadata arguments.
     if (f && isDebugIntrinsic(f, kmodule))
@@ -1829,7 +3491,7 @@ void Executor::executeInstruction(ExecutionState &state, KInstruction *ki) {
     arguments.reserve(numArgs);
 
     for (unsigned j=0; j<numArgs; ++j)
-      arguments.push_back(eval(ki, j+1, state).value);
+      arguments.push_back(eval(ki, j+1, state).getValue());
 
     if (f) {
       const FunctionType *fType = 
@@ -1876,7 +3538,7 @@ void Executor::executeInstruction(ExecutionState &state, KInstruction *ki) {
 
       executeCall(state, ki, f, arguments);
     } else {
-      ref<Expr> v = eval(ki, 0, state).value;
+      ref<Expr> v = eval(ki, 0, state).getValue();
 
       ExecutionState *free = &state;
       bool hasInvalid = false, first = true;
@@ -1919,9 +3581,9 @@ void Executor::executeInstruction(ExecutionState &state, KInstruction *ki) {
   }
   case Instruction::PHI: {
 #if LLVM_VERSION_CODE >= LLVM_VERSION(3, 0)
-    ref<Expr> result = eval(ki, state.incomingBBIndex, state).value;
+    ref<Expr> result = eval(ki, state.incomingBBIndex, state).getValue();
 #else
-    ref<Expr> result = eval(ki, state.incomingBBIndex * 2, state).value;
+    ref<Expr> result = eval(ki, state.incomingBBIndex * 2, state).getValue();
 #endif
     bindLocal(ki, state, result);
     break;
@@ -1929,9 +3591,9 @@ void Executor::executeInstruction(ExecutionState &state, KInstruction *ki) {
 
     // Special instructions
   case Instruction::Select: {
-    ref<Expr> cond = eval(ki, 0, state).value;
-    ref<Expr> tExpr = eval(ki, 1, state).value;
-    ref<Expr> fExpr = eval(ki, 2, state).value;
+    ref<Expr> cond = eval(ki, 0, state).getValue();
+    ref<Expr> tExpr = eval(ki, 1, state).getValue();
+    ref<Expr> fExpr = eval(ki, 2, state).getValue();
     ref<Expr> result;
     if (isa<FExpr>(tExpr)) {
       assert(isa<FExpr>(fExpr));
@@ -1951,101 +3613,141 @@ void Executor::executeInstruction(ExecutionState &state, KInstruction *ki) {
     // Arithmetic / logical
 
   case Instruction::Add: {
-    ref<Expr> left = eval(ki, 0, state).value;
-    ref<Expr> right = eval(ki, 1, state).value;
+    if (bindConstantCells(ki, state))
+      break;
+    ref<Expr> left = eval(ki, 0, state).getValue();
+    ref<Expr> right = eval(ki, 1, state).getValue();
     bindLocal(ki, state, AddExpr::create(left, right));
     break;
   }
 
   case Instruction::Sub: {
-    ref<Expr> left = eval(ki, 0, state).value;
-    ref<Expr> right = eval(ki, 1, state).value;
+    if (bindConstantCells(ki, state))
+      break;
+    ref<Expr> left = eval(ki, 0, state).getValue();
+    ref<Expr> right = eval(ki, 1, state).getValue();
     bindLocal(ki, state, SubExpr::create(left, right));
     break;
   }
  
   case Instruction::Mul: {
-    ref<Expr> left = eval(ki, 0, state).value;
-    ref<Expr> right = eval(ki, 1, state).value;
+    if (bindConstantCells(ki, state))
+      break;
+    ref<Expr> left = eval(ki, 0, state).getValue();
+    ref<Expr> right = eval(ki, 1, state).getValue();
     bindLocal(ki, state, MulExpr::create(left, right));
     break;
   }
 
   case Instruction::UDiv: {
-    ref<Expr> left = eval(ki, 0, state).value;
-    ref<Expr> right = eval(ki, 1, state).value;
+    if (bindConstantCells(ki, state))
+      break;
+    ref<Expr> left = eval(ki, 0, state).getValue();
+    ref<Expr> right = eval(ki, 1, state).getValue();
+    if (!checkDivisor(state, right))
+      break;
     ref<Expr> result = UDivExpr::create(left, right);
     bindLocal(ki, state, result);
     break;
   }
 
   case Instruction::SDiv: {
-    ref<Expr> left = eval(ki, 0, state).value;
-    ref<Expr> right = eval(ki, 1, state).value;
+    if (bindConstantCells(ki, state))
+      break;
+    ref<Expr> left = eval(ki, 0, state).getValue();
+    ref<Expr> right = eval(ki, 1, state).getValue();
+    if (!checkDivisor(state, right))
+      break;
     ref<Expr> result = SDivExpr::create(left, right);
     bindLocal(ki, state, result);
     break;
   }
 
   case Instruction::URem: {
-    ref<Expr> left = eval(ki, 0, state).value;
-    ref<Expr> right = eval(ki, 1, state).value;
+    if (bindConstantCells(ki, state))
+      break;
+    ref<Expr> left = eval(ki, 0, state).getValue();
+    ref<Expr> right = eval(ki, 1, state).getValue();
+    if (!checkDivisor(state, right))
+      break;
     ref<Expr> result = URemExpr::create(left, right);
     bindLocal(ki, state, result);
     break;
   }
  
   case Instruction::SRem: {
-    ref<Expr> left = eval(ki, 0, state).value;
-    ref<Expr> right = eval(ki, 1, state).value;
+    if (bindConstantCells(ki, state))
+      break;
+    ref<Expr> left = eval(ki, 0, state).getValue();
+    ref<Expr> right = eval(ki, 1, state).getValue();
+    if (!checkDivisor(state, right))
+      break;
     ref<Expr> result = SRemExpr::create(left, right);
     bindLocal(ki, state, result);
     break;
   }
 
   case Instruction::And: {
-    ref<Expr> left = eval(ki, 0, state).value;
-    ref<Expr> right = eval(ki, 1, state).value;
+    if (bindConstantCells(ki, state))
+      break;
+    ref<Expr> left = eval(ki, 0, state).getValue();
+    ref<Expr> right = eval(ki, 1, state).getValue();
     ref<Expr> result = AndExpr::create(left, right);
     bindLocal(ki, state, result);
     break;
   }
 
   case Instruction::Or: {
-    ref<Expr> left = eval(ki, 0, state).value;
-    ref<Expr> right = eval(ki, 1, state).value;
+    if (bindConstantCells(ki, state))
+      break;
+    ref<Expr> left = eval(ki, 0, state).getValue();
+    ref<Expr> right = eval(ki, 1, state).getValue();
     ref<Expr> result = OrExpr::create(left, right);
     bindLocal(ki, state, result);
     break;
   }
 
   case Instruction::Xor: {
-    ref<Expr> left = eval(ki, 0, state).value;
-    ref<Expr> right = eval(ki, 1, state).value;
+    if (bindConstantCells(ki, state))
+      break;
+    ref<Expr> left = eval(ki, 0, state).getValue();
+    ref<Expr> right = eval(ki, 1, state).getValue();
     ref<Expr> result = XorExpr::create(left, right);
     bindLocal(ki, state, result);
     break;
   }
 
   case Instruction::Shl: {
-    ref<Expr> left = eval(ki, 0, state).value;
-    ref<Expr> right = eval(ki, 1, state).value;
+    if (bindConstantCells(ki, state))
+      break;
+    ref<Expr> left = eval(ki, 0, state).getValue();
+    ref<Expr> right = eval(ki, 1, state).getValue();
+    if (!checkShift(state, right))
+      break;
     ref<Expr> result = ShlExpr::create(left, right);
     bindLocal(ki, state, result);
     break;
   }
 
   case Instruction::LShr: {
-    ref<Expr> left = eval(ki, 0, state).value;
-    ref<Expr> right = eval(ki, 1, state).value;
+    if (bindConstantCells(ki, state))
+      break;
+    ref<Expr> left = eval(ki, 0, state).getValue();
+    ref<Expr> right = eval(ki, 1, state).getValue();
+    if (!checkShift(state, right))
+      break;
     ref<Expr> result = LShrExpr::create(left, right);
     bindLocal(ki, state, result);
     break;
   }
 
   case Instruction::AShr: {
-    ref<Expr> left = eval(ki, 0, state).value;
-    ref<Expr> right = eval(ki, 1, state).value;
+    if (bindConstantCells(ki, state))
+      break;
+    ref<Expr> left = eval(ki, 0, state).getValue();
+    ref<Expr> right = eval(ki, 1, state).getValue();
+    if (!checkShift(state, right))
+      break;
     ref<Expr> result = AShrExpr::create(left, right);
     bindLocal(ki, state, result);
     break;
@@ -2054,85 +3756,85 @@ void Executor::executeInstruction(ExecutionState &state, KInstruction *ki) {
     // Compare
 
   case Instruction::ICmp: {
-    CmpInst *ci = cast<CmpInst>(i);
-    ICmpInst *ii = cast<ICmpInst>(ci);
- 
-    switch(ii->getPredicate()) {
+    if (bindConstantCells(ki, state))
+      break;
+
+    switch(ki->predicate) {
     case ICmpInst::ICMP_EQ: {
-      ref<Expr> left = eval(ki, 0, state).value;
-      ref<Expr> right = eval(ki, 1, state).value;
+      ref<Expr> left = eval(ki, 0, state).getValue();
+      ref<Expr> right = eval(ki, 1, state).getValue();
       ref<Expr> result = EqExpr::create(left, right);
       bindLocal(ki, state, result);
       break;
     }
 
     case ICmpInst::ICMP_NE: {
-      ref<Expr> left = eval(ki, 0, state).value;
-      ref<Expr> right = eval(ki, 1, state).value;
+      ref<Expr> left = eval(ki, 0, state).getValue();
+      ref<Expr> right = eval(ki, 1, state).getValue();
       ref<Expr> result = NeExpr::create(left, right);
       bindLocal(ki, state, result);
       break;
     }
 
     case ICmpInst::ICMP_UGT: {
-      ref<Expr> left = eval(ki, 0, state).value;
-      ref<Expr> right = eval(ki, 1, state).value;
+      ref<Expr> left = eval(ki, 0, state).getValue();
+      ref<Expr> right = eval(ki, 1, state).getValue();
       ref<Expr> result = UgtExpr::create(left, right);
       bindLocal(ki, state,result);
       break;
     }
 
     case ICmpInst::ICMP_UGE: {
-      ref<Expr> left = eval(ki, 0, state).value;
-      ref<Expr> right = eval(ki, 1, state).value;
+      ref<Expr> left = eval(ki, 0, state).getValue();
+      ref<Expr> right = eval(ki, 1, state).getValue();
       ref<Expr> result = UgeExpr::create(left, right);
       bindLocal(ki, state, result);
       break;
     }
 
     case ICmpInst::ICMP_ULT: {
-      ref<Expr> left = eval(ki, 0, state).value;
-      ref<Expr> right = eval(ki, 1, state).value;
+      ref<Expr> left = eval(ki, 0, state).getValue();
+      ref<Expr> right = eval(ki, 1, state).getValue();
       ref<Expr> result = UltExpr::create(left, right);
       bindLocal(ki, state, result);
       break;
     }
 
     case ICmpInst::ICMP_ULE: {
-      ref<Expr> left = eval(ki, 0, state).value;
-      ref<Expr> right = eval(ki, 1, state).value;
+      ref<Expr> left = eval(ki, 0, state).getValue();
+      ref<Expr> right = eval(ki, 1, state).getValue();
       ref<Expr> result = UleExpr::create(left, right);
       bindLocal(ki, state, result);
       break;
     }
 
     case ICmpInst::ICMP_SGT: {
-      ref<Expr> left = eval(ki, 0, state).value;
-      ref<Expr> right = eval(ki, 1, state).value;
+      ref<Expr> left = eval(ki, 0, state).getValue();
+      ref<Expr> right = eval(ki, 1, state).getValue();
       ref<Expr> result = SgtExpr::create(left, right);
       bindLocal(ki, state, result);
       break;
     }
 
     case ICmpInst::ICMP_SGE: {
-      ref<Expr> left = eval(ki, 0, state).value;
-      ref<Expr> right = eval(ki, 1, state).value;
+      ref<Expr> left = eval(ki, 0, state).getValue();
+      ref<Expr> right = eval(ki, 1, state).getValue();
       ref<Expr> result = SgeExpr::create(left, right);
       bindLocal(ki, state, result);
       break;
     }
 
     case ICmpInst::ICMP_SLT: {
-      ref<Expr> left = eval(ki, 0, state).value;
-      ref<Expr> right = eval(ki, 1, state).value;
+      ref<Expr> left = eval(ki, 0, state).getValue();
+      ref<Expr> right = eval(ki, 1, state).getValue();
       ref<Expr> result = SltExpr::create(left, right);
       bindLocal(ki, state, result);
       break;
     }
 
     case ICmpInst::ICMP_SLE: {
-      ref<Expr> left = eval(ki, 0, state).value;
-      ref<Expr> right = eval(ki, 1, state).value;
+      ref<Expr> left = eval(ki, 0, state).getValue();
+      ref<Expr> right = eval(ki, 1, state).getValue();
       ref<Expr> result = SleExpr::create(left, right);
       bindLocal(ki, state, result);
       break;
@@ -2151,7 +3853,7 @@ void Executor::executeInstruction(ExecutionState &state, KInstruction *ki) {
       kmodule->targetData->getTypeAllocSize(ai->getAllocatedType());
     ref<Expr> size = Expr::createPointer(elementSize);
     if (ai->isArrayAllocation()) {
-      ref<Expr> count = eval(ki, 0, state).value;
+      ref<Expr> count = eval(ki, 0, state).getValue();
       count = Expr::createZExtToPointerWidth(count);
       size = MulExpr::create(size, count);
     }
@@ -2160,26 +3862,29 @@ void Executor::executeInstruction(ExecutionState &state, KInstruction *ki) {
   }
 
   case Instruction::Load: {
-    ref<Expr> base = eval(ki, 0, state).value;
+    ref<Expr> base = eval(ki, 0, state).getValue();
     executeMemoryOperation(state, false, base, 0, ki);
     break;
   }
   case Instruction::Store: {
-    ref<Expr> base = eval(ki, 1, state).value;
-    ref<Expr> value = eval(ki, 0, state).value;
+    ref<Expr> base = eval(ki, 1, state).getValue();
+    ref<Expr> value = eval(ki, 0, state).getValue();
+    if (floatPolicy)
+      value = applyFloatPolicy(state, ki, FloatConcretizationPolicy::Store,
+                               i->getParent()->getParent()->getName(), value);
     executeMemoryOperation(state, true, base, value, 0);
     break;
   }
 
   case Instruction::GetElementPtr: {
     KGEPInstruction *kgepi = static_cast<KGEPInstruction*>(ki);
-    ref<Expr> base = eval(ki, 0, state).value;
+    ref<Expr> base = eval(ki, 0, state).getValue();
 
     for (std::vector< std::pair<unsigned, uint64_t> >::iterator 
            it = kgepi->indices.begin(), ie = kgepi->indices.end(); 
          it != ie; ++it) {
       uint64_t elementSize = it->second;
-      ref<Expr> index = eval(ki, it->first, state).value;
+      ref<Expr> index = eval(ki, it->first, state).getValue();
       base = AddExpr::create(base,
                              MulExpr::create(Expr::createSExtToPointerWidth(index),
                                              Expr::createPointer(elementSize)));
@@ -2193,57 +3898,58 @@ void Executor::executeInstruction(ExecutionState &state, KInstruction *ki) {
 
     // Conversion
   case Instruction::Trunc: {
-    CastInst *ci = cast<CastInst>(i);
-    ref<Expr> result = ExtractExpr::create(eval(ki, 0, state).value,
+    if (bindConstantCells(ki, state))
+      break;
+    ref<Expr> result = ExtractExpr::create(eval(ki, 0, state).getValue(),
                                            0,
-                                           getWidthForLLVMType(ci->getType()));
+                                           ki->width);
     bindLocal(ki, state, result);
     break;
   }
   case Instruction::ZExt: {
-    CastInst *ci = cast<CastInst>(i);
-    ref<Expr> result = ZExtExpr::create(eval(ki, 0, state).value,
-                                        getWidthForLLVMType(ci->getType()));
+    if (bindConstantCells(ki, state))
+      break;
+    ref<Expr> result = ZExtExpr::create(eval(ki, 0, state).getValue(),
+                                        ki->width);
     bindLocal(ki, state, result);
     break;
   }
   case Instruction::SExt: {
-    CastInst *ci = cast<CastInst>(i);
-    ref<Expr> result = SExtExpr::create(eval(ki, 0, state).value,
-                                        getWidthForLLVMType(ci->getType()));
+    if (bindConstantCells(ki, state))
+      break;
+    ref<Expr> result = SExtExpr::create(eval(ki, 0, state).getValue(),
+                                        ki->width);
     bindLocal(ki, state, result);
     break;
   }
 
   case Instruction::IntToPtr: {
-    CastInst *ci = cast<CastInst>(i);
-    Expr::Width pType = getWidthForLLVMType(ci->getType());
-    ref<Expr> arg = eval(ki, 0, state).value;
+    Expr::Width pType = ki->width;
+    ref<Expr> arg = eval(ki, 0, state).getValue();
     bindLocal(ki, state, ZExtExpr::create(arg, pType));
     break;
   } 
   case Instruction::PtrToInt: {
-    CastInst *ci = cast<CastInst>(i);
-    Expr::Width iType = getWidthForLLVMType(ci->getType());
-    ref<Expr> arg = eval(ki, 0, state).value;
+    Expr::Width iType = ki->width;
+    ref<Expr> arg = eval(ki, 0, state).getValue();
     bindLocal(ki, state, ZExtExpr::create(arg, iType));
     break;
   }
 
   case Instruction::BitCast: {
     CastInst *ci = cast<CastInst>(i);
-    ref<Expr> result = eval(ki, 0, state).value;
+    ref<Expr> result = eval(ki, 0, state).getValue();
 
     if (ci->getSrcTy()->isFloatingPointTy())
     {
       if (!ci->getDestTy()->isFloatingPointTy())
       {
-        result = ExplicitIntExpr::create(result, getWidthForLLVMType(ci->getDestTy()));
+        result = ExplicitIntExpr::create(result, ki->width);
       }
     }
     else if (ci->getDestTy()->isFloatingPointTy())
     {
-      result = ExplicitFloatExpr::create(result, getWidthForLLVMType(ci->getDestTy()));
+      result = ExplicitFloatExpr::create(result, ki->width);
     }
 
     bindLocal(ki, state, result);
@@ -2252,10 +3958,12 @@ void Executor::executeInstruction(ExecutionState &state, KInstruction *ki) {
 
     // Floating point instructions
 
-  case Instruction::FAdd: if(CoreSolverToUse != Z3_SOLVER) {
-    ref<ConstantExpr> left = toConstant(state, eval(ki, 0, state).value,
+  case Instruction::FAdd: if (bindHostFloatArith(ki, state)) {
+    break;
+  } else if(!coreSolverHandlesFloats()) {
+    ref<ConstantExpr> left = toConstant(state, eval(ki, 0, state).getValue(),
                                         "floating point");
-    ref<ConstantExpr> right = toConstant(state, eval(ki, 1, state).value,
+    ref<ConstantExpr> right = toConstant(state, eval(ki, 1, state).getValue(),
                                          "floating point");
     if (!fpWidthToSemantics(left->getWidth()) ||
         !fpWidthToSemantics(right->getWidth()))
@@ -2263,66 +3971,52 @@ void Executor::executeInstruction(ExecutionState &state, KInstruction *ki) {
 
 #if LLVM_VERSION_CODE >= LLVM_VERSION(3, 3)
     llvm::APFloat Res(*fpWidthToSemantics(left->getWidth()), left->getAPValue());
-    Res.add(APFloat(*fpWidthToSemantics(right->getWidth()),right->getAPValue()), state.roundingMode);
+    state.fpExceptions |= getFPExceptions(Res.add(APFloat(*fpWidthToSemantics(right->getWidth()),right->getAPValue()), state.roundingMode));
 #else
     llvm::APFloat Res(left->getAPValue());
-    Res.add(APFloat(right->getAPValue()), state.roundingMode);
+    state.fpExceptions |= getFPExceptions(Res.add(APFloat(right->getAPValue()), state.roundingMode));
 #endif
     bindLocal(ki, state, FConstantExpr::alloc(Res));
     break;
   } else {
-    ref<Expr> left = eval(ki, 0, state).value;
-    ref<Expr> right = eval(ki, 1, state).value;
-    ref<Expr> sum = FAddExpr::create(left, right, state.roundingMode);
-
-    ref<Expr> left_negative = FOleExpr::create(left, FConstantExpr::alloc(APFloat::getZero(*fpWidthToSemantics(sum->getWidth()), 1)));
-    ref<Expr> right_negative = FOleExpr::create(right, FConstantExpr::alloc(APFloat::getZero(*fpWidthToSemantics(sum->getWidth()), 1)));
-    ref<Expr> different_signs = XorExpr::create(left_negative, right_negative);
-
-    ref<Expr> sum_is_zero = OrExpr::create(FOeqExpr::create(FConstantExpr::alloc(APFloat::getZero(*fpWidthToSemantics(sum->getWidth()), 1)), sum),
-                                           FOeqExpr::create(FConstantExpr::alloc(APFloat::getZero(*fpWidthToSemantics(sum->getWidth()), 0)), sum));
-    ref<Expr> result = FSelectExpr::create(AndExpr::create(sum_is_zero, different_signs), FConstantExpr::alloc(APFloat::getZero(*fpWidthToSemantics(sum->getWidth()), (state.roundingMode == llvm::APFloat::rmTowardNegative))), sum);
-    bindLocal(ki, state, result);
+    ref<Expr> left = eval(ki, 0, state).getValue();
+    ref<Expr> right = eval(ki, 1, state).getValue();
+    bindLocal(ki, state, createFAdd(left, right, state.roundingMode));
     break;
   }
 
-  case Instruction::FSub: if(CoreSolverToUse != Z3_SOLVER) {
-    ref<ConstantExpr> left = toConstant(state, eval(ki, 0, state).value,
+  case Instruction::FSub: if (bindHostFloatArith(ki, state)) {
+    break;
+  } else if(!coreSolverHandlesFloats()) {
+    ref<ConstantExpr> left = toConstant(state, eval(ki, 0, state).getValue(),
                                         "floating point");
-    ref<ConstantExpr> right = toConstant(state, eval(ki, 1, state).value,
+    ref<ConstantExpr> right = toConstant(state, eval(ki, 1, state).getValue(),
                                          "floating point");
     if (!fpWidthToSemantics(left->getWidth()) ||
         !fpWidthToSemantics(right->getWidth()))
       return terminateStateOnExecError(state, "Unsupported FSub operation");
 #if LLVM_VERSION_CODE >= LLVM_VERSION(3, 3)
     llvm::APFloat Res(*fpWidthToSemantics(left->getWidth()), left->getAPValue());
-    Res.subtract(APFloat(*fpWidthToSemantics(right->getWidth()), right->getAPValue()), state.roundingMode);
+    state.fpExceptions |= getFPExceptions(Res.subtract(APFloat(*fpWidthToSemantics(right->getWidth()), right->getAPValue()), state.roundingMode));
 #else
     llvm::APFloat Res(left->getAPValue());
-    Res.subtract(APFloat(right->getAPValue()), state.roundingMode);
+    state.fpExceptions |= getFPExceptions(Res.subtract(APFloat(right->getAPValue()), state.roundingMode));
 #endif
     bindLocal(ki, state, FConstantExpr::alloc(Res));
     break;
   } else {
-    ref<Expr> left = eval(ki, 0, state).value;
-    ref<Expr> right = eval(ki, 1, state).value;
-    ref<Expr> difference = FSubExpr::create(left, right, state.roundingMode);
-
-    ref<Expr> left_negative = FOleExpr::create(left, FConstantExpr::alloc(APFloat::getZero(*fpWidthToSemantics(difference->getWidth()), 1)));
-    ref<Expr> right_negative = FOleExpr::create(right, FConstantExpr::alloc(APFloat::getZero(*fpWidthToSemantics(difference->getWidth()), 1)));
-    ref<Expr> same_signs = EqExpr::create(left_negative, right_negative);
-
-    ref<Expr> difference_is_zero = OrExpr::create(FOeqExpr::create(FConstantExpr::alloc(APFloat::getZero(*fpWidthToSemantics(difference->getWidth()), 1)), difference),
-                                                  FOeqExpr::create(FConstantExpr::alloc(APFloat::getZero(*fpWidthToSemantics(difference->getWidth()), 0)), difference));
-    ref<Expr> result = FSelectExpr::create(AndExpr::create(difference_is_zero, same_signs), FConstantExpr::alloc(APFloat::getZero(*fpWidthToSemantics(difference->getWidth()), (state.roundingMode == llvm::APFloat::rmTowardNegative))), difference);
-    bindLocal(ki, state, result);
+    ref<Expr> left = eval(ki, 0, state).getValue();
+    ref<Expr> right = eval(ki, 1, state).getValue();
+    bindLocal(ki, state, createFSub(left, right, state.roundingMode));
     break;
   }
 
-  case Instruction::FMul: if(CoreSolverToUse != Z3_SOLVER) {
-    ref<ConstantExpr> left = toConstant(state, eval(ki, 0, state).value,
+  case Instruction::FMul: if (bindHostFloatArith(ki, state)) {
+    break;
+  } else if(!coreSolverHandlesFloats()) {
+    ref<ConstantExpr> left = toConstant(state, eval(ki, 0, state).getValue(),
                                         "floating point");
-    ref<ConstantExpr> right = toConstant(state, eval(ki, 1, state).value,
+    ref<ConstantExpr> right = toConstant(state, eval(ki, 1, state).getValue(),
                                          "floating point");
     if (!fpWidthToSemantics(left->getWidth()) ||
         !fpWidthToSemantics(right->getWidth()))
@@ -2330,24 +4024,26 @@ void Executor::executeInstruction(ExecutionState &state, KInstruction *ki) {
 
 #if LLVM_VERSION_CODE >= LLVM_VERSION(3, 3)
     llvm::APFloat Res(*fpWidthToSemantics(left->getWidth()), left->getAPValue());
-    Res.multiply(APFloat(*fpWidthToSemantics(right->getWidth()), right->getAPValue()), state.roundingMode);
+    state.fpExceptions |= getFPExceptions(Res.multiply(APFloat(*fpWidthToSemantics(right->getWidth()), right->getAPValue()), state.roundingMode));
 #else
     llvm::APFloat Res(left->getAPValue());
-    Res.multiply(APFloat(right->getAPValue()), state.roundingMode);
+    state.fpExceptions |= getFPExceptions(Res.multiply(APFloat(right->getAPValue()), state.roundingMode));
 #endif
     bindLocal(ki, state, FConstantExpr::alloc(Res));
     break;
   } else {
-    ref<Expr> left = eval(ki, 0, state).value;
-    ref<Expr> right = eval(ki, 1, state).value;
+    ref<Expr> left = eval(ki, 0, state).getValue();
+    ref<Expr> right = eval(ki, 1, state).getValue();
     bindLocal(ki, state, FMulExpr::create(left, right, state.roundingMode));
     break;
   }
 
-  case Instruction::FDiv: if(CoreSolverToUse != Z3_SOLVER) {
-    ref<ConstantExpr> left = toConstant(state, eval(ki, 0, state).value,
+  case Instruction::FDiv: if (bindHostFloatArith(ki, state)) {
+    break;
+  } else if(!coreSolverHandlesFloats()) {
+    ref<ConstantExpr> left = toConstant(state, eval(ki, 0, state).getValue(),
                                         "floating point");
-    ref<ConstantExpr> right = toConstant(state, eval(ki, 1, state).value,
+    ref<ConstantExpr> right = toConstant(state, eval(ki, 1, state).getValue(),
                                          "floating point");
     if (!fpWidthToSemantics(left->getWidth()) ||
         !fpWidthToSemantics(right->getWidth()))
@@ -2355,49 +4051,50 @@ void Executor::executeInstruction(ExecutionState &state, KInstruction *ki) {
 
 #if LLVM_VERSION_CODE >= LLVM_VERSION(3, 3)
     llvm::APFloat Res(*fpWidthToSemantics(left->getWidth()), left->getAPValue());
-    Res.divide(APFloat(*fpWidthToSemantics(right->getWidth()), right->getAPValue()), state.roundingMode);
+    state.fpExceptions |= getFPExceptions(Res.divide(APFloat(*fpWidthToSemantics(right->getWidth()), right->getAPValue()), state.roundingMode));
 #else
     llvm::APFloat Res(left->getAPValue());
-    Res.divide(APFloat(right->getAPValue()), state.roundingMode);
+    state.fpExceptions |= getFPExceptions(Res.divide(APFloat(right->getAPValue()), state.roundingMode));
 #endif
     bindLocal(ki, state, FConstantExpr::alloc(Res));
     break;
   } else {
-    ref<Expr> left = eval(ki, 0, state).value;
-    ref<Expr> right = eval(ki, 1, state).value;
+    ref<Expr> left = eval(ki, 0, state).getValue();
+    ref<Expr> right = eval(ki, 1, state).getValue();
     bindLocal(ki, state, FDivExpr::create(left, right, state.roundingMode));
     break;
   }
 
-  case Instruction::FRem: if(CoreSolverToUse != Z3_SOLVER) {
-    ref<ConstantExpr> left = toConstant(state, eval(ki, 0, state).value,
+  case Instruction::FRem: if (bindHostFloatArith(ki, state)) {
+    break;
+  } else if(!coreSolverHandlesFloats()) {
+    ref<ConstantExpr> left = toConstant(state, eval(ki, 0, state).getValue(),
                                         "floating point");
-    ref<ConstantExpr> right = toConstant(state, eval(ki, 1, state).value,
+    ref<ConstantExpr> right = toConstant(state, eval(ki, 1, state).getValue(),
                                          "floating point");
     if (!fpWidthToSemantics(left->getWidth()) ||
         !fpWidthToSemantics(right->getWidth()))
       return terminateStateOnExecError(state, "Unsupported FRem operation");
 #if LLVM_VERSION_CODE >= LLVM_VERSION(3, 3)
     llvm::APFloat Res(*fpWidthToSemantics(left->getWidth()), left->getAPValue());
-    Res.mod(APFloat(*fpWidthToSemantics(right->getWidth()),right->getAPValue()),
-            state.roundingMode);
+    state.fpExceptions |= getFPExceptions(Res.mod(APFloat(*fpWidthToSemantics(right->getWidth()),right->getAPValue()),
+                                                  state.roundingMode));
 #else
     llvm::APFloat Res(left->getAPValue());
-    Res.mod(APFloat(right->getAPValue()), state.roundingMode);
+    state.fpExceptions |= getFPExceptions(Res.mod(APFloat(right->getAPValue()), state.roundingMode));
 #endif
     bindLocal(ki, state, FConstantExpr::alloc(Res));
     break;
   } else {
-    ref<Expr> left = eval(ki, 0, state).value;
-    ref<Expr> right = eval(ki, 1, state).value;
+    ref<Expr> left = eval(ki, 0, state).getValue();
+    ref<Expr> right = eval(ki, 1, state).getValue();
     bindLocal(ki, state, FRemExpr::create(left, right, state.roundingMode));
     break;
   }
 
-  case Instruction::FPTrunc: if(CoreSolverToUse != Z3_SOLVER) {
-    FPTruncInst *fi = cast<FPTruncInst>(i);
-    Expr::Width resultType = getWidthForLLVMType(fi->getType());
-    ref<ConstantExpr> arg = toConstant(state, eval(ki, 0, state).value,
+  case Instruction::FPTrunc: if(!coreSolverHandlesFloats()) {
+    Expr::Width resultType = ki->width;
+    ref<ConstantExpr> arg = toConstant(state, eval(ki, 0, state).getValue(),
                                        "floating point");
     if (!fpWidthToSemantics(arg->getWidth()) || resultType > arg->getWidth())
       return terminateStateOnExecError(state, "Unsupported FPTrunc operation");
@@ -2415,10 +4112,9 @@ void Executor::executeInstruction(ExecutionState &state, KInstruction *ki) {
     break;
   } //else fall through to FPExt
 
-  case Instruction::FPExt: if(CoreSolverToUse != Z3_SOLVER) {
-    FPExtInst *fi = cast<FPExtInst>(i);
-    Expr::Width resultType = getWidthForLLVMType(fi->getType());
-    ref<ConstantExpr> arg = toConstant(state, eval(ki, 0, state).value,
+  case Instruction::FPExt: if(!coreSolverHandlesFloats()) {
+    Expr::Width resultType = ki->width;
+    ref<ConstantExpr> arg = toConstant(state, eval(ki, 0, state).getValue(),
                                         "floating point");
     if (!fpWidthToSemantics(arg->getWidth()) || arg->getWidth() > resultType)
       return terminateStateOnExecError(state, "Unsupported FPExt operation");
@@ -2434,18 +4130,16 @@ void Executor::executeInstruction(ExecutionState &state, KInstruction *ki) {
     bindLocal(ki, state, FConstantExpr::alloc(Res));
     break;
   } else {
-    CastInst *ci = cast<CastInst>(i);
-    ref<Expr> result = FExtExpr::create(eval(ki, 0, state).value,
-                                        getWidthForLLVMType(ci->getType()),
+    ref<Expr> result = FExtExpr::create(eval(ki, 0, state).getValue(),
+                                        ki->width,
                                         state.roundingMode);
     bindLocal(ki, state, result);
     break;
   }
 
-  case Instruction::FPToUI: if(CoreSolverToUse != Z3_SOLVER) {
-    FPToUIInst *fi = cast<FPToUIInst>(i);
-    Expr::Width resultType = getWidthForLLVMType(fi->getType());
-    ref<ConstantExpr> arg = toConstant(state, eval(ki, 0, state).value,
+  case Instruction::FPToUI: if(!coreSolverHandlesFloats()) {
+    Expr::Width resultType = ki->width;
+    ref<ConstantExpr> arg = toConstant(state, eval(ki, 0, state).getValue(),
                                        "floating point");
     if (!fpWidthToSemantics(arg->getWidth()) || resultType > 64)
       return terminateStateOnExecError(state, "Unsupported FPToUI operation");
@@ -2463,19 +4157,17 @@ void Executor::executeInstruction(ExecutionState &state, KInstruction *ki) {
     bindLocal(ki, state, ConstantExpr::alloc(value, resultType));
     break;
   } else {
-    CastInst *ci = cast<CastInst>(i);
   // TODO: should this observe rounding mode?
-    ref<Expr> result = FToUExpr::create(eval(ki, 0, state).value,
-                                        getWidthForLLVMType(ci->getType()),
+    ref<Expr> result = FToUExpr::create(eval(ki, 0, state).getValue(),
+                                        ki->width,
                                         llvm::APFloat::rmTowardZero);
     bindLocal(ki, state, result);
     break;
   }
 
-  case Instruction::FPToSI: if(CoreSolverToUse != Z3_SOLVER) {
-    FPToSIInst *fi = cast<FPToSIInst>(i);
-    Expr::Width resultType = getWidthForLLVMType(fi->getType());
-    ref<ConstantExpr> arg = toConstant(state, eval(ki, 0, state).value,
+  case Instruction::FPToSI: if(!coreSolverHandlesFloats()) {
+    Expr::Width resultType = ki->width;
+    ref<ConstantExpr> arg = toConstant(state, eval(ki, 0, state).getValue(),
                                        "floating point");
     if (!fpWidthToSemantics(arg->getWidth()) || resultType > 64)
       return terminateStateOnExecError(state, "Unsupported FPToSI operation");
@@ -2493,19 +4185,17 @@ void Executor::executeInstruction(ExecutionState &state, KInstruction *ki) {
     bindLocal(ki, state, ConstantExpr::alloc(value, resultType));
     break;
   } else {
-    CastInst *ci = cast<CastInst>(i);
   // TODO: should this observe rounding mode?
-    ref<Expr> result = FToSExpr::create(eval(ki, 0, state).value,
-                                        getWidthForLLVMType(ci->getType()),
+    ref<Expr> result = FToSExpr::create(eval(ki, 0, state).getValue(),
+                                        ki->width,
                                         llvm::APFloat::rmTowardZero);
     bindLocal(ki, state, result);
     break;
   }
 
-  case Instruction::UIToFP: if(CoreSolverToUse != Z3_SOLVER) {
-    UIToFPInst *fi = cast<UIToFPInst>(i);
-    Expr::Width resultType = getWidthForLLVMType(fi->getType());
-    ref<ConstantExpr> arg = toConstant(state, eval(ki, 0, state).value,
+  case Instruction::UIToFP: if(!coreSolverHandlesFloats()) {
+    Expr::Width resultType = ki->width;
+    ref<ConstantExpr> arg = toConstant(state, eval(ki, 0, state).getValue(),
                                        "floating point");
     const llvm::fltSemantics *semantics = fpWidthToSemantics(resultType);
     if (!semantics)
@@ -2516,18 +4206,16 @@ void Executor::executeInstruction(ExecutionState &state, KInstruction *ki) {
     bindLocal(ki, state, FConstantExpr::alloc(f));
     break;
   } else {
-    CastInst *ci = cast<CastInst>(i);
-    ref<Expr> result = UToFExpr::create(eval(ki, 0, state).value,
-                                        getWidthForLLVMType(ci->getType()),
+    ref<Expr> result = UToFExpr::create(eval(ki, 0, state).getValue(),
+                                        ki->width,
                                         state.roundingMode);
     bindLocal(ki, state, result);
     break;
   }
 
-  case Instruction::SIToFP: if(CoreSolverToUse != Z3_SOLVER) {
-    SIToFPInst *fi = cast<SIToFPInst>(i);
-    Expr::Width resultType = getWidthForLLVMType(fi->getType());
-    ref<ConstantExpr> arg = toConstant(state, eval(ki, 0, state).value,
+  case Instruction::SIToFP: if(!coreSolverHandlesFloats()) {
+    Expr::Width resultType = ki->width;
+    ref<ConstantExpr> arg = toConstant(state, eval(ki, 0, state).getValue(),
                                        "floating point");
     const llvm::fltSemantics *semantics = fpWidthToSemantics(resultType);
     if (!semantics)
@@ -2538,19 +4226,17 @@ void Executor::executeInstruction(ExecutionState &state, KInstruction *ki) {
     bindLocal(ki, state, FConstantExpr::alloc(f));
     break;
   } else {
-    CastInst *ci = cast<CastInst>(i);
-    ref<Expr> result = SToFExpr::create(eval(ki, 0, state).value,
-                                        getWidthForLLVMType(ci->getType()), 
+    ref<Expr> result = SToFExpr::create(eval(ki, 0, state).getValue(),
+                                        ki->width, 
                                         state.roundingMode);
     bindLocal(ki, state, result);
     break;
   }
 
-  case Instruction::FCmp: if(CoreSolverToUse != Z3_SOLVER) {
-    FCmpInst *fi = cast<FCmpInst>(i);
-    ref<ConstantExpr> left = toConstant(state, eval(ki, 0, state).value,
+  case Instruction::FCmp: if(!coreSolverHandlesFloats()) {
+    ref<ConstantExpr> left = toConstant(state, eval(ki, 0, state).getValue(),
                                         "floating point");
-    ref<ConstantExpr> right = toConstant(state, eval(ki, 1, state).value,
+    ref<ConstantExpr> right = toConstant(state, eval(ki, 1, state).getValue(),
                                          "floating point");
     if (!fpWidthToSemantics(left->getWidth()) ||
         !fpWidthToSemantics(right->getWidth()))
@@ -2566,7 +4252,7 @@ void Executor::executeInstruction(ExecutionState &state, KInstruction *ki) {
     APFloat::cmpResult CmpRes = LHS.compare(RHS);
 
     bool Result = false;
-    switch( fi->getPredicate() ) {
+    switch( ki->predicate ) {
       // Predicates which only care about whether or not the operands are NaNs.
     case FCmpInst::FCMP_ORD:
       Result = CmpRes != APFloat::cmpUnordered;
@@ -2643,117 +4329,114 @@ void Executor::executeInstruction(ExecutionState &state, KInstruction *ki) {
     bindLocal(ki, state, ConstantExpr::alloc(Result, Expr::Bool));
     break;
   } else {
-    CmpInst *ci = cast<CmpInst>(i);
-    FCmpInst *fi = cast<FCmpInst>(ci);
-
-    switch(fi->getPredicate()) {
+    switch(ki->predicate) {
     case FCmpInst::FCMP_ORD: {
-      ref<Expr> left = eval(ki, 0, state).value;
-      ref<Expr> right = eval(ki, 1, state).value;
+      ref<Expr> left = eval(ki, 0, state).getValue();
+      ref<Expr> right = eval(ki, 1, state).getValue();
       ref<Expr> result = FOrdExpr::create(left, right);
       bindLocal(ki, state, result);
       break;
     }
 
     case FCmpInst::FCMP_UNO: {
-      ref<Expr> left = eval(ki, 0, state).value;
-      ref<Expr> right = eval(ki, 1, state).value;
+      ref<Expr> left = eval(ki, 0, state).getValue();
+      ref<Expr> right = eval(ki, 1, state).getValue();
       ref<Expr> result = FUnoExpr::create(left, right);
       bindLocal(ki, state, result);
       break;
     }
 
     case FCmpInst::FCMP_UEQ: {
-      ref<Expr> left = eval(ki, 0, state).value;
-      ref<Expr> right = eval(ki, 1, state).value;
+      ref<Expr> left = eval(ki, 0, state).getValue();
+      ref<Expr> right = eval(ki, 1, state).getValue();
       ref<Expr> result = FUeqExpr::create(left, right);
       bindLocal(ki, state, result);
       break;
     }
 
     case FCmpInst::FCMP_OEQ: {
-      ref<Expr> left = eval(ki, 0, state).value;
-      ref<Expr> right = eval(ki, 1, state).value;
+      ref<Expr> left = eval(ki, 0, state).getValue();
+      ref<Expr> right = eval(ki, 1, state).getValue();
       ref<Expr> result = FOeqExpr::create(left, right);
       bindLocal(ki, state, result);
       break;
     }
 
     case FCmpInst::FCMP_UGT: {
-      ref<Expr> left = eval(ki, 0, state).value;
-      ref<Expr> right = eval(ki, 1, state).value;
+      ref<Expr> left = eval(ki, 0, state).getValue();
+      ref<Expr> right = eval(ki, 1, state).getValue();
       ref<Expr> result = FUgtExpr::create(left, right);
       bindLocal(ki, state, result);
       break;
     }
 
     case FCmpInst::FCMP_OGT: {
-      ref<Expr> left = eval(ki, 0, state).value;
-      ref<Expr> right = eval(ki, 1, state).value;
+      ref<Expr> left = eval(ki, 0, state).getValue();
+      ref<Expr> right = eval(ki, 1, state).getValue();
       ref<Expr> result = FOgtExpr::create(left, right);
       bindLocal(ki, state, result);
       break;
     }
 
     case FCmpInst::FCMP_UGE: {
-      ref<Expr> left = eval(ki, 0, state).value;
-      ref<Expr> right = eval(ki, 1, state).value;
+      ref<Expr> left = eval(ki, 0, state).getValue();
+      ref<Expr> right = eval(ki, 1, state).getValue();
       ref<Expr> result = FUgeExpr::create(left, right);
       bindLocal(ki, state, result);
       break;
     }
 
     case FCmpInst::FCMP_OGE: {
-      ref<Expr> left = eval(ki, 0, state).value;
-      ref<Expr> right = eval(ki, 1, state).value;
+      ref<Expr> left = eval(ki, 0, state).getValue();
+      ref<Expr> right = eval(ki, 1, state).getValue();
       ref<Expr> result = FOgeExpr::create(left, right);
       bindLocal(ki, state, result);
       break;
     }
 
     case FCmpInst::FCMP_ULT: {
-      ref<Expr> left = eval(ki, 0, state).value;
-      ref<Expr> right = eval(ki, 1, state).value;
+      ref<Expr> left = eval(ki, 0, state).getValue();
+      ref<Expr> right = eval(ki, 1, state).getValue();
       ref<Expr> result = FUltExpr::create(left, right);
       bindLocal(ki, state, result);
       break;
     }
 
     case FCmpInst::FCMP_OLT: {
-      ref<Expr> left = eval(ki, 0, state).value;
-      ref<Expr> right = eval(ki, 1, state).value;
+      ref<Expr> left = eval(ki, 0, state).getValue();
+      ref<Expr> right = eval(ki, 1, state).getValue();
       ref<Expr> result = FOltExpr::create(left, right);
       bindLocal(ki, state, result);
       break;
     }
 
     case FCmpInst::FCMP_ULE: {
-      ref<Expr> left = eval(ki, 0, state).value;
-      ref<Expr> right = eval(ki, 1, state).value;
+      ref<Expr> left = eval(ki, 0, state).getValue();
+      ref<Expr> right = eval(ki, 1, state).getValue();
       ref<Expr> result = FUleExpr::create(left, right);
       bindLocal(ki, state, result);
       break;
     }
 
     case FCmpInst::FCMP_OLE: {
-      ref<Expr> left = eval(ki, 0, state).value;
-      ref<Expr> right = eval(ki, 1, state).value;
+      ref<Expr> left = eval(ki, 0, state).getValue();
+      ref<Expr> right = eval(ki, 1, state).getValue();
       ref<Expr> result = FOleExpr::create(left, right);
       bindLocal(ki, state, result);
       break;
     }
 
     case FCmpInst::FCMP_UNE: {
-      ref<Expr> left = eval(ki, 0, state).value;
-      ref<Expr> right = eval(ki, 1, state).value;
+      ref<Expr> left = eval(ki, 0, state).getValue();
+      ref<Expr> right = eval(ki, 1, state).getValue();
       ref<Expr> result = FUneExpr::create(left, right);
       bindLocal(ki, state, result);
       break;
     }
 
     case FCmpInst::FCMP_ONE: {
-      ref<Expr> left = eval(ki, 0, state).value;
-      ref<Expr> right = eval(ki, 1, state).value;
+      ref<Expr> left = eval(ki, 0, state).getValue();
+      ref<Expr> right = eval(ki, 1, state).getValue();
       ref<Expr> result = FOneExpr::create(left, right);
       bindLocal(ki, state, result);
       break;
@@ -2767,8 +4450,8 @@ void Executor::executeInstruction(ExecutionState &state, KInstruction *ki) {
   case Instruction::InsertValue: {
     KGEPInstruction *kgepi = static_cast<KGEPInstruction*>(ki);
 
-    ref<Expr> agg = eval(ki, 0, state).value;
-    ref<Expr> val = eval(ki, 1, state).value;
+    ref<Expr> agg = eval(ki, 0, state).getValue();
+    ref<Expr> val = eval(ki, 1, state).getValue();
 
     ref<Expr> l = NULL, r = NULL;
     unsigned lOffset = kgepi->offset*8, rOffset = kgepi->offset*8 + val->getWidth();
@@ -2794,9 +4477,9 @@ void Executor::executeInstruction(ExecutionState &state, KInstruction *ki) {
   case Instruction::ExtractValue: {
     KGEPInstruction *kgepi = static_cast<KGEPInstruction*>(ki);
 
-    ref<Expr> agg = eval(ki, 0, state).value;
+    ref<Expr> agg = eval(ki, 0, state).getValue();
 
-    ref<Expr> result = ExtractExpr::create(agg, kgepi->offset*8, getWidthForLLVMType(i->getType()));
+    ref<Expr> result = ExtractExpr::create(agg, kgepi->offset*8, ki->width);
 
     bindLocal(ki, state, result);
     break;
@@ -2810,7 +4493,20 @@ void Executor::executeInstruction(ExecutionState &state, KInstruction *ki) {
 
   // Other instructions...
   // Unhandled
-  case Instruction::ExtractElement:
+  case Instruction::ExtractElement: {
+    std::vector< ref<Expr> > lanes = evalLanes(ki, 0, state);
+    ref<klee::ConstantExpr> index =
+      toConstant(state, eval(ki, 1, state).getValue(), "vector index");
+    uint64_t lane = index->getZExtValue();
+    // An out of range index gives an undefined result.
+    ref<Expr> result = lanes[lane < lanes.size() ? lane : 0];
+    if (!coreSolverHandlesFloats() && isa<FExpr>(result))
+      result = ExplicitIntExpr::create(result, result->getWidth());
+    bindLocal(ki, state, result);
+    break;
+  }
+
+  // Vector results are handled by executeVectorInstruction.
   case Instruction::InsertElement:
   case Instruction::ShuffleVector:
     terminateStateOnError(state, "XXX vector instructions unhandled",
@@ -2821,10 +4517,53 @@ void Executor::executeInstruction(ExecutionState &state, KInstruction *ki) {
     terminateStateOnExecError(state, "illegal instruction");
     break;
   }
+
+  if (floatCoverage && FloatCoverage::isTracked(ki))
+    markFloatCoverage(state, ki);
+}
+
+void Executor::markFloatCoverage(ExecutionState &state, KInstruction *ki) {
+  unsigned unseen = floatCoverage->getUnseen(ki);
+  if (!unseen)
+    return;
+
+  ref<Expr> value = getDestCell(state, ki).getValue();
+  unsigned mask = 0;
+  if (FConstantExpr *fce = dyn_cast<FConstantExpr>(value)) {
+    mask = FloatCoverage::classify(fce->getAPValue());
+  } else if (ConstantExpr *ce = dyn_cast<ConstantExpr>(value)) {
+    // Without a solver for floats, results are held as their bits.
+    if (const llvm::fltSemantics *sem = fpWidthToSemantics(ce->getWidth()))
+      mask = FloatCoverage::classify(APFloat(*sem, ce->getAPValue()));
+  } else if (FloatCoverageQueries && isa<FExpr>(value)) {
+    std::vector< ref<Expr> > conditions;
+    std::vector<unsigned> classes;
+    for (unsigned c = 1; c & FloatCoverage::AllClasses; c <<= 1) {
+      if (!(unseen & c))
+        continue;
+      conditions.push_back(
+          FloatCoverage::getCondition(value, (FloatCoverage::Class) c));
+      classes.push_back(c);
+    }
+    std::vector<bool> feasible;
+    solver->setTimeout(coreSolverTimeout);
+    bool success = solver->mayBeTrueMany(state, conditions, feasible);
+    solver->setTimeout(0);
+    if (success)
+      for (unsigned i = 0; i != classes.size(); ++i)
+        if (feasible[i])
+          mask |= classes[i];
+  }
+
+  unsigned added = floatCoverage->mark(ki, mask);
+  for (; added; added &= added - 1)
+    ++stats::floatClassesCovered;
 }
 
 void Executor::updateStates(ExecutionState *current) {
   if (searcher) {
+    TimerStatIncrementer timer(stats::searcherTime);
+    SamplingProfiler::Scope profile(SamplingProfiler::Searcher);
     searcher->update(current, addedStates, removedStates);
   }
   
@@ -2881,9 +4620,69 @@ void Executor::computeOffsets(KGEPInstruction *kgepi, TypeIt ib, TypeIt ie) {
   kgepi->offset = constantOffset->getZExtValue();
 }
 
+void Executor::computeCaseTable(KSwitchInstruction *ksi, SwitchInst *si) {
+  ksi->hasCaseTable = false;
+  ksi->jumpBase = 0;
+  if (si->getCondition()->getType()->getIntegerBitWidth() > 64)
+    return;
+  ksi->hasCaseTable = true;
+
+  std::vector< std::pair<uint64_t, unsigned> > cases;
+#if LLVM_VERSION_CODE >= LLVM_VERSION(3, 1)
+  for (SwitchInst::CaseIt i = si->case_begin(), e = si->case_end(); i != e;
+       ++i)
+    cases.push_back(std::make_pair(i.getCaseValue()->getZExtValue(),
+                                   i.getSuccessorIndex()));
+#else
+  for (unsigned i = 1, e = si->getNumCases(); i < e; ++i)
+    cases.push_back(std::make_pair(si->getCaseValue(i)->getZExtValue(), i));
+#endif
+  if (cases.empty())
+    return;
+
+  // Dense cases, such as the opcodes of an interpreter, are indexed by
+  // value; the others are hashed into twice as many slots as there are.
+  uint64_t min = cases[0].first, max = cases[0].first;
+  for (unsigned i = 1; i != cases.size(); ++i) {
+    min = std::min(min, cases[i].first);
+    max = std::max(max, cases[i].first);
+  }
+  if (max - min < 2 * cases.size()) {
+    ksi->jumpBase = min;
+    ksi->jumpTable.assign(max - min + 1, 0);
+    for (unsigned i = 0; i != cases.size(); ++i)
+      ksi->jumpTable[cases[i].first - min] = cases[i].second;
+    return;
+  }
+
+  size_t size = 1;
+  while (size < 2 * cases.size())
+    size *= 2;
+  ksi->hashTable.assign(size, std::make_pair(0, 0));
+  for (unsigned i = 0; i != cases.size(); ++i) {
+    size_t slot = KSwitchInstruction::hash(cases[i].first, size);
+    while (ksi->hashTable[slot].second)
+      slot = (slot + 1) & (size - 1);
+    ksi->hashTable[slot] = cases[i];
+  }
+}
+
 void Executor::bindInstructionConstants(KInstruction *KI) {
   KGEPInstruction *kgepi = static_cast<KGEPInstruction*>(KI);
 
+  if (SwitchInst *si = dyn_cast<SwitchInst>(KI->inst)) {
+    computeCaseTable(static_cast<KSwitchInstruction*>(KI), si);
+    return;
+  }
+
+  if (isa<CallInst>(KI->inst) || isa<InvokeInst>(KI->inst)) {
+    KCallInstruction *kci = static_cast<KCallInstruction*>(KI);
+    if (kci->staticTarget)
+      kci->specialHandler =
+        specialFunctionHandler->getHandler(kci->staticTarget);
+    return;
+  }
+
   if (GetElementPtrInst *gepi = dyn_cast<GetElementPtrInst>(KI->inst)) {
     computeOffsets(kgepi, gep_type_begin(gepi), gep_type_end(gepi));
   } else if (InsertValueInst *ivi = dyn_cast<InsertValueInst>(KI->inst)) {
@@ -2906,27 +4705,78 @@ void Executor::bindModuleConstants() {
   kmodule->constantTable = new Cell[kmodule->constants.size()];
   for (unsigned i=0; i<kmodule->constants.size(); ++i) {
     Cell &c = kmodule->constantTable[i];
-    c.value = evalConstant(kmodule->constants[i]);
+    c.setValue(evalConstant(kmodule->constants[i]));
+  }
+}
+
+namespace {
+/// Orders states from the coldest, the one that went the longest without
+/// covering new code.
+struct ColderState {
+  bool operator()(const ExecutionState *a, const ExecutionState *b) const {
+    if (a->coveredNew != b->coveredNew)
+      return !a->coveredNew;
+    return a->instsSinceCovNew > b->instsSinceCovNew;
   }
+};
 }
 
 void Executor::checkMemoryUsage() {
   if (!MaxMemory)
     return;
-  if ((stats::instructions & 0xFFFF) == 0) {
+  if (memoryCheckDue) {
     // We need to avoid calling GetTotalMallocUsage() often because it
     // is O(elts on freelist). This is really bad since we start
-    // to pummel the freelist once we hit the memory cap.
-    unsigned mbs = (util::GetTotalMallocUsage() >> 20) +
+    // to pummel the freelist once we hit the memory cap. So it only
+    // measures the memory the allocators do not count every so often, or
+    // when the counted memory moved by a tenth of the cap; in between,
+    // the counters are followed.
+    memoryCheckDue = false;
+    size_t counted = util::GetCountedMemoryUsage();
+    size_t drift = counted > countedMemoryMeasured
+                       ? counted - countedMemoryMeasured
+                       : countedMemoryMeasured - counted;
+    if (++memoryChecksUnmeasured >= MemoryChecksPerMeasurement ||
+        (drift >> 20) >= MaxMemory / 10) {
+      size_t total = util::GetTotalMallocUsage();
+      uncountedMemory = total > counted ? total - counted : 0;
+      countedMemoryMeasured = counted;
+      memoryChecksUnmeasured = 0;
+    }
+    unsigned mbs = ((counted + uncountedMemory) >> 20) +
                    (memory->getUsedDeterministicSize() >> 20);
+    memoryPressure = (double) mbs / MaxMemory;
+
+    // The solver caches can be filled again, the states cannot be brought
+    // back: trim the caches first.
+    if (mbs > MaxMemory) {
+      size_t freed = solver->trimCaches((size_t)(mbs - MaxMemory) << 20);
+      mbs -= std::min(mbs, (unsigned)(freed >> 20));
+    }
 
     if (mbs > MaxMemory) {
       if (mbs > MaxMemory + 100) {
         // just guess at how many to kill
         unsigned numStates = states.size();
         unsigned toKill = std::max(1U, numStates - numStates * MaxMemory / mbs);
-        klee_warning("killing %d states (over memory cap)", toKill);
         std::vector<ExecutionState *> arr(states.begin(), states.end());
+        if (OffloadStates) {
+          klee_warning("offloading %d states (over memory cap)", toKill);
+          // The coldest states go first; those that cannot be recreated
+          // from their path are killed instead.
+          std::sort(arr.begin(), arr.end(), ColderState());
+          for (unsigned i = 0, N = arr.size(); i < N && i < toKill; ++i) {
+            if (std::find(removedStates.begin(), removedStates.end(),
+                          arr[i]) != removedStates.end())
+              continue;
+            if (!offloadState(*arr[i]))
+              terminateStateEarly(*arr[i], "Memory limit exceeded.");
+          }
+          toKill = 0;
+        } else {
+          klee_warning("killing %d states (over memory cap)", toKill);
+        }
+        std::vector<ExecutionState *> victims;
         for (unsigned i = 0, N = arr.size(); N && i < toKill; ++i, --N) {
           unsigned idx = rand() % N;
           // Make two pulls to try and not hit a state that
@@ -2935,28 +4785,380 @@ void Executor::checkMemoryUsage() {
             idx = rand() % N;
 
           std::swap(arr[idx], arr[N - 1]);
-          terminateStateEarly(*arr[N - 1], "Memory limit exceeded.");
+          victims.push_back(arr[N - 1]);
         }
+        terminateStatesEarly(victims, "Memory limit exceeded.");
       }
       atMemoryLimit = true;
     } else {
       atMemoryLimit = false;
+
+      // Bring offloaded states back while there is room for them, assuming
+      // each needs as much memory as the average live state.
+      unsigned limit = MaxMemory * 9 / 10;
+      if (!offloadedStates.empty() && mbs < limit)
+        restoreOffloadedStates(std::max(
+            1U, (unsigned)((uint64_t)(limit - mbs) * states.size() /
+                           std::max(mbs, 1U))));
+    }
+  }
+}
+
+void Executor::collectArrays() {
+  // Between instructions, every array still in use is read by an
+  // expression or bound to a symbolic object of a state.
+  std::vector<const Array *> arrays;
+  arrayCache.getUnreferencedArrays(arrays);
+  if (arrays.empty())
+    return;
+  solver->releaseArrays(arrays);
+  arrayCache.reclaimArrays(arrays);
+  stats::reclaimedArrays += arrays.size();
+}
+
+void Executor::importSeeds() {
+  // The other workers would import the same files.
+  if (!seedBaseState || workerIndex != 0)
+    return;
+  DIR *dir = opendir(SeedWatchDir.c_str());
+  if (!dir) {
+    klee_warning_once(0, "unable to read seed directory %s: %s",
+                      SeedWatchDir.c_str(), strerror(errno));
+    return;
+  }
+  std::vector<std::string> files;
+  while (struct dirent *entry = readdir(dir)) {
+    std::string name = entry->d_name;
+    std::string path = SeedWatchDir + "/" + name;
+    struct stat st;
+    // Hidden files are being written, and the tests exported there by
+    // -seed-export-dir came from this run.
+    if (name[0] == '.' || name.find(",src:klee") != std::string::npos ||
+        stat(path.c_str(), &st) != 0 || !S_ISREG(st.st_mode) ||
+        !watchedSeedFiles.insert(name).second)
+      continue;
+    files.push_back(path);
+  }
+  closedir(dir);
+  // The directory order is arbitrary, the seed order need not be.
+  std::sort(files.begin(), files.end());
+
+  std::vector<SeedInfo> seeds;
+  for (std::vector<std::string>::iterator it = files.begin(),
+         ie = files.end(); it != ie; ++it) {
+    bool raw = !kTest_isKTestFile(it->c_str());
+    KTest *seed = 0;
+    if (raw) {
+      std::ifstream f(it->c_str(), std::ios::binary);
+      if (!f)
+        continue;
+      std::vector<char> bytes((std::istreambuf_iterator<char>(f)),
+                              std::istreambuf_iterator<char>());
+      seed = (KTest *) calloc(1, sizeof *seed);
+      seed->numObjects = 1;
+      seed->objects = (KTestObject *) calloc(1, sizeof *seed->objects);
+      seed->objects[0].name = strdup("raw");
+      seed->objects[0].numBytes = bytes.size();
+      seed->objects[0].bytes = (unsigned char *) malloc(bytes.size() + 1);
+      std::copy(bytes.begin(), bytes.end(), seed->objects[0].bytes);
+    } else if (!(seed = kTest_fromFile(it->c_str()))) {
+      klee_warning("unable to read seed %s", it->c_str());
+      continue;
+    }
+    importedSeeds.push_back(seed);
+    seeds.push_back(SeedInfo(seed, raw));
+  }
+  if (seeds.empty())
+    return;
+
+  klee_message("imported %u seeds from %s", (unsigned) seeds.size(),
+               SeedWatchDir.c_str());
+  ExecutionState *es = new ExecutionState(*seedBaseState);
+  es->ptreeNode = processTree->attach(es);
+  seedMap[es].swap(seeds);
+  addedStates.push_back(es);
+}
+
+void Executor::doDumpStates() {
+  if (DumpPathPrefixesOnHalt && (!states.empty() || !offloadedStates.empty())) {
+    dumpPathPrefixes();
+    return;
+  }
+
+  if (!DumpStatesOnHalt || states.empty())
+    return;
+  klee_message("halting execution, dumping remaining states");
+  if (DumpStatesOnHaltTime <= 0) {
+    std::vector<ExecutionState *> halted(states.begin(), states.end());
+    for (std::vector<ExecutionState *>::iterator it = halted.begin(),
+                                                 ie = halted.end();
+         it != ie; ++it)
+      stepInstruction(**it); // keep stats rolling
+    terminateStatesEarly(halted, "Execution halting.");
+    updateStates(0);
+    return;
+  }
+
+  // The states which covered new code go first, each group in process tree
+  // order.
+  std::vector<ExecutionState *> halted, rest;
+  for (std::set<ExecutionState *>::iterator it = states.begin(),
+                                            ie = states.end();
+       it != ie; ++it)
+    ((*it)->coveredNew ? halted : rest).push_back(*it);
+  orderByProcessTree(halted);
+  orderByProcessTree(rest);
+  halted.insert(halted.end(), rest.begin(), rest.end());
+
+  double deadline = util::getWallTime() + DumpStatesOnHaltTime;
+  unsigned i = 0, e = halted.size();
+  for (; i != e && util::getWallTime() < deadline; ++i) {
+    stepInstruction(*halted[i]); // keep stats rolling
+    terminateStateEarly(*halted[i], "Execution halting.");
+  }
+
+  // Leave the others for a later run to explore from their prefixes.
+  if (i != e)
+    klee_warning("out of time dumping states, writing the path prefixes of "
+                 "the %u left",
+                 e - i);
+  for (unsigned id = 0; i != e; ++i) {
+    std::vector<unsigned char> path;
+    readPath(*halted[i], path);
+    dumpPathPrefix(++id, path);
+    recordRegressionPath(*halted[i], /*complete=*/false);
+    removedStates.push_back(halted[i]);
+  }
+  updateStates(0);
+}
+
+void Executor::readPath(const ExecutionState &state,
+                        std::vector<unsigned char> &path) {
+  state.pathHistory.read(path);
+  // A recreated state may not have replayed all of its path yet.
+  for (unsigned i = state.pathPrefixPosition; i < state.pathPrefix.size(); ++i)
+    path.push_back(state.pathPrefix[i] ? '1' : '0');
+}
+
+void Executor::dumpPathPrefix(unsigned id,
+                              const std::vector<unsigned char> &path) {
+  std::stringstream filename;
+  filename << "prefix" << std::setfill('0') << std::setw(6) << id << ".path";
+  if (llvm::raw_ostream *f =
+          interpreterHandler->openOutputFile(filename.str())) {
+    for (std::vector<unsigned char>::const_iterator it = path.begin(),
+                                                    ie = path.end();
+         it != ie; ++it)
+      *f << *it << "\n";
+    delete f;
+  }
+}
+
+void Executor::dumpPathPrefixes() {
+  klee_message("halting execution, dumping path prefixes of remaining states");
+  unsigned id = 0;
+  for (std::set<ExecutionState *>::iterator it = states.begin(),
+                                            ie = states.end();
+       it != ie; ++it) {
+    std::vector<unsigned char> path;
+    readPath(**it, path);
+    dumpPathPrefix(++id, path);
+    recordRegressionPath(**it, /*complete=*/false);
+
+    // The subtree is left for whoever replays the prefix, so the state is
+    // neither terminated with a test case nor counted as an explored path.
+    removedStates.push_back(*it);
+  }
+  updateStates(0);
+
+  for (unsigned i = 0; i < offloadedStates.size(); ++i) {
+    std::vector<unsigned char> path;
+    if (readOffloadedPath(i, path))
+      dumpPathPrefix(++id, path);
+  }
+  offloadedStates.clear();
+}
+
+bool Executor::offloadState(ExecutionState &state) {
+  if (state.tookMultiWayBranch || seedMap.count(&state) ||
+      state.checkpoint.isNull())
+    return false;
+
+  if (!offloadFile) {
+    std::string name = "offloaded-states";
+    if (workerIndex)
+      name += "." + llvm::utostr(workerIndex);
+    offloadFile =
+        fopen(interpreterHandler->getOutputFilename(name).c_str(), "w+b");
+    if (!offloadFile) {
+      klee_warning_once(0, "unable to open offload file (%s), killing states "
+                        "instead", llvm::sys::StrError(errno).c_str());
+      return false;
+    }
+  }
+
+  std::vector<unsigned char> path;
+  readPath(state, path);
+  fseek(offloadFile, 0, SEEK_END);
+  long offset = ftell(offloadFile);
+  if (!path.empty() &&
+      fwrite(&path[0], 1, path.size(), offloadFile) != path.size()) {
+    klee_warning_once(0, "unable to write offload file, killing states "
+                      "instead");
+    if (ftruncate(fileno(offloadFile), offset))
+      klee_warning_once(0, "unable to truncate offload file (%s)",
+                        llvm::sys::StrError(errno).c_str());
+    return false;
+  }
+  offloadedStates.push_back(
+      OffloadedState(offset, path.size(), state.checkpoint));
+
+  // Like terminateState, but the path is not explored yet.
+  std::vector<ExecutionState *>::iterator it =
+      std::find(addedStates.begin(), addedStates.end(), &state);
+  if (it == addedStates.end()) {
+    removedStates.push_back(&state);
+  } else {
+    addedStates.erase(it);
+    processTree->remove(state.ptreeNode);
+    delete &state;
+  }
+  return true;
+}
+
+void Executor::checkpointState(ExecutionState &state) {
+  // A state still replaying its path is not where its history says it is.
+  if (state.checkpoint.isNull() || !state.pathPrefix.empty() ||
+      state.tookMultiWayBranch)
+    return;
+  if (state.pathHistory.size() < state.checkpoint->state->pathHistory.size() +
+                                     OffloadCheckpointInterval)
+    return;
+
+  ExecutionState *copy = new ExecutionState(state);
+  copy->checkpoint = 0;
+  copy->ptreeNode = 0;
+  state.checkpoint = new StateCheckpoint(copy);
+}
+
+bool Executor::readOffloadedPath(unsigned index,
+                                 std::vector<unsigned char> &path) {
+  path.resize(offloadedStates[index].length);
+  if (path.empty())
+    return true;
+  // pread leaves the file position alone, which a checkpoint writer
+  // shares with this process.
+  fflush(offloadFile);
+  return pread(fileno(offloadFile), &path[0], path.size(),
+               offloadedStates[index].offset) == (ssize_t) path.size();
+}
+
+unsigned Executor::restoreOffloadedStates(unsigned count) {
+  unsigned restored = 0;
+  while (restored < count && !offloadedStates.empty()) {
+    std::vector<unsigned char> path;
+    bool success = readOffloadedPath(offloadedStates.size() - 1, path);
+    ref<StateCheckpoint> checkpoint = offloadedStates.back().checkpoint;
+    if (ftruncate(fileno(offloadFile), offloadedStates.back().offset))
+      klee_warning_once(0, "unable to truncate offload file (%s)",
+                        llvm::sys::StrError(errno).c_str());
+    offloadedStates.pop_back();
+    if (!success) {
+      klee_warning("unable to read offload file, dropping state");
+      continue;
     }
+
+    // The checkpoint has already taken the first part of the path.
+    ExecutionState *es = new ExecutionState(*checkpoint->state);
+    es->checkpoint = checkpoint;
+    for (std::vector<unsigned char>::iterator
+           it = path.begin() + checkpoint->state->pathHistory.size(),
+           ie = path.end();
+         it != ie; ++it)
+      es->pathPrefix.push_back(*it == '1');
+    es->ptreeNode = processTree->attach(es);
+    addedStates.push_back(es);
+    ++restored;
   }
+  return restored;
 }
 
-void Executor::doDumpStates() {
-  if (!DumpStatesOnHalt || states.empty())
+std::string Executor::getCheckpointFilename() {
+  std::string name = "checkpoint";
+  if (workerIndex)
+    name += "." + llvm::utostr(workerIndex);
+  return interpreterHandler->getOutputFilename(name);
+}
+
+bool Executor::reapCheckpointWriter(bool block) {
+  if (!checkpointWriter)
+    return true;
+  int status, res;
+  while ((res = waitpid(checkpointWriter, &status, block ? 0 : WNOHANG)) < 0 &&
+         errno == EINTR)
+    ;
+  if (res == 0)
+    return false;
+  if (res > 0 && (!WIFEXITED(status) || WEXITSTATUS(status) != 0))
+    klee_warning("unable to write checkpoint");
+  checkpointWriter = 0;
+  return true;
+}
+
+void Executor::writeCheckpoint(bool wait) {
+  if (!reapCheckpointWriter(wait))
     return;
-  klee_message("halting execution, dumping remaining states");
+
+  // Anything buffered now would otherwise be written by both processes.
+  fflush(NULL);
+  llvm::outs().flush();
+  llvm::errs().flush();
+  interpreterHandler->getInfoStream().flush();
+  if (solver->tracer)
+    solver->tracer->flush();
+
+  int pid = ::fork();
+  if (pid < 0) {
+    klee_warning("unable to fork checkpoint writer: %s",
+                 llvm::sys::StrError(errno).c_str());
+    return;
+  }
+  if (pid > 0) {
+    checkpointWriter = pid;
+    if (wait)
+      reapCheckpointWriter(/*block=*/true);
+    return;
+  }
+
+  // In the writer, which has a copy of all states as they were at the
+  // fork. The file is written aside and renamed, so that a checkpoint is
+  // never seen half written.
+  std::string name = getCheckpointFilename();
+  std::string tmpName = name + ".tmp";
+  FILE *f = fopen(tmpName.c_str(), "w");
+  if (!f)
+    _exit(1);
+  fprintf(f, "# KLEE checkpoint: one path of branch decisions per state\n");
   for (std::set<ExecutionState *>::iterator it = states.begin(),
                                             ie = states.end();
        it != ie; ++it) {
-    ExecutionState &state = **it;
-    stepInstruction(state); // keep stats rolling
-    terminateStateEarly(state, "Execution halting.");
+    if ((*it)->tookMultiWayBranch)
+      continue;
+    std::vector<unsigned char> path;
+    readPath(**it, path);
+    path.push_back('\n');
+    fwrite(&path[0], 1, path.size(), f);
   }
-  updateStates(0);
+  for (unsigned i = 0; i < offloadedStates.size(); ++i) {
+    std::vector<unsigned char> path;
+    if (!readOffloadedPath(i, path))
+      _exit(1);
+    path.push_back('\n');
+    fwrite(&path[0], 1, path.size(), f);
+  }
+  if (fclose(f) != 0 || rename(tmpName.c_str(), name.c_str()) < 0)
+    _exit(1);
+  _exit(0);
 }
 
 void Executor::run(ExecutionState &initialState) {
@@ -2965,9 +5167,73 @@ void Executor::run(ExecutionState &initialState) {
   // Delay init till now so that ticks don't accrue during
   // optimization and such.
   initTimers();
+  startWatchdog();
+  if (ProfileSampleRate > 0)
+    profiler = new SamplingProfiler(ProfileSampleRate);
 
   states.insert(&initialState);
 
+  if (OffloadStates) {
+    // Every state descends from this one, so each can be recreated.
+    ExecutionState *copy = new ExecutionState(initialState);
+    copy->ptreeNode = 0;
+    initialState.checkpoint = new StateCheckpoint(copy);
+  }
+
+  if (!SeedWatchDir.empty()) {
+    // The files already there are imported right away.
+    seedBaseState = new ExecutionState(initialState);
+    seedBaseState->ptreeNode = 0;
+    importSeeds();
+    updateStates(0);
+  }
+
+  if (resumePaths && !resumePaths->empty()) {
+    // Recreate the states left by an earlier run: the initial state takes
+    // the first path, and copies of it made beforehand the others.
+    klee_message("resuming %u states", (unsigned) resumePaths->size());
+    for (unsigned i = 1; i < resumePaths->size(); ++i) {
+      ExecutionState *es = new ExecutionState(initialState);
+      es->pathPrefix = (*resumePaths)[i];
+      es->ptreeNode = processTree->attach(es);
+      states.insert(es);
+    }
+    initialState.pathPrefix = (*resumePaths)[0];
+  }
+
+  if (regressionPaths) {
+    if (regressionPaths->hasBaseline() &&
+        ((resumePaths && !resumePaths->empty()) || usingSeeds ||
+         !SeedWatchDir.empty()))
+      klee_error("-regression-baseline cannot be used when resuming or "
+                 "seeding");
+    initialState.firstCalls = initialState.firstCalls.insert(
+        std::make_pair(initialState.stack.back().kf->function, 0u));
+    if (regressionPaths->hasBaseline()) {
+      // Explore only below the prefixes reaching changed code, as when
+      // resuming.
+      const std::vector<std::vector<bool> > &prefixes =
+        regressionPaths->getPrefixes();
+      klee_message("regression: %u unchanged paths not explored again, "
+                   "exploring below %u path prefixes",
+                   regressionPaths->getNumUnchangedPaths(),
+                   (unsigned) prefixes.size());
+      for (unsigned i = 1; i < prefixes.size(); ++i) {
+        ExecutionState *es = new ExecutionState(initialState);
+        es->pathPrefix = prefixes[i];
+        es->ptreeNode = processTree->attach(es);
+        states.insert(es);
+      }
+      if (prefixes.empty()) {
+        removeState(initialState);
+        updateStates(0);
+      } else {
+        initialState.pathPrefix = prefixes[0];
+      }
+    }
+  }
+
+  bool splitDone = ParallelWorkers <= 1;
   if (usingSeeds) {
     std::vector<SeedInfo> &v = seedMap[&initialState];
     
@@ -2975,12 +5241,23 @@ void Executor::run(ExecutionState &initialState) {
            ie = usingSeeds->end(); it != ie; ++it)
       v.push_back(SeedInfo(*it));
 
+    // Every worker needs at least one seed, or it would have nothing to do
+    // until seeding is over.
+    if (!splitDone && v.size() > 1) {
+      splitSeedsIntoWorkers(v, std::min((unsigned) ParallelWorkers,
+                                        (unsigned) v.size()));
+      splitDone = true;
+    }
+
     int lastNumSeeds = usingSeeds->size()+10;
     double lastTime, startTime = lastTime = util::getWallTime();
     ExecutionState *lastState = 0;
     while (!seedMap.empty()) {
       if (haltExecution) {
+        stopWatchdog();
         doDumpStates();
+        writeProfile();
+        waitForWorkers();
         return;
       }
 
@@ -2995,6 +5272,8 @@ void Executor::run(ExecutionState &initialState) {
       stepInstruction(state);
 
       executeInstruction(state, ki);
+      if (profiler)
+        profiler->sample(state);
       processTimers(&state, MaxInstructionTime * numSeeds);
       updateStates(&state);
 
@@ -3032,7 +5311,10 @@ void Executor::run(ExecutionState &initialState) {
     }
 
     if (OnlySeed) {
+      stopWatchdog();
       doDumpStates();
+      writeProfile();
+      waitForWorkers();
       return;
     }
   }
@@ -3043,22 +5325,194 @@ void Executor::run(ExecutionState &initialState) {
   searcher->update(0, newStates, std::vector<ExecutionState *>());
 
   while (!states.empty() && !haltExecution) {
-    ExecutionState &state = searcher->selectState();
+    ExecutionState *selected;
+    {
+      TimerStatIncrementer timer(stats::searcherTime);
+      SamplingProfiler::Scope profile(SamplingProfiler::Searcher);
+      selected = &searcher->selectState();
+    }
+    ExecutionState &state = *selected;
+    if (!resolveLazyFork(state)) {
+      updateStates(0);
+      continue;
+    }
+    if (OffloadCheckpointInterval)
+      checkpointState(state);
     KInstruction *ki = state.pc;
     stepInstruction(state);
 
     executeInstruction(state, ki);
+    executeConcreteRun(state);
+    if (profiler)
+      profiler->sample(state);
     processTimers(&state, MaxInstructionTime);
 
     checkMemoryUsage();
 
     updateStates(&state);
+
+    if (states.empty() && restoreOffloadedStates(1))
+      updateStates(0);
+
+    if (!splitDone && states.size() >= ParallelWorkers) {
+      splitIntoWorkers(ParallelWorkers);
+      splitDone = true;
+    }
   }
 
   delete searcher;
   searcher = 0;
 
+  if (CheckpointInterval) {
+    // Leave a checkpoint of what is left to explore, or none when all is.
+    if (!states.empty() || !offloadedStates.empty()) {
+      writeCheckpoint(/*wait=*/true);
+    } else {
+      reapCheckpointWriter(/*block=*/true);
+      unlink(getCheckpointFilename().c_str());
+    }
+  }
+
+  // The states left are terminated with test cases, whose queries must
+  // not be interrupted.
+  stopWatchdog();
   doDumpStates();
+  writeProfile();
+
+  if (!offloadedStates.empty())
+    klee_warning("%u offloaded states were not explored",
+                 (unsigned) offloadedStates.size());
+
+  waitForWorkers();
+}
+
+void Executor::writeProfile() {
+  if (!profiler)
+    return;
+  profiler->stop();
+  std::string name = "profile.folded";
+  if (workerIndex)
+    name += "." + llvm::utostr(workerIndex);
+  if (llvm::raw_ostream *os = interpreterHandler->openOutputFile(name)) {
+    profiler->write(*os);
+    delete os;
+  }
+  delete profiler;
+  profiler = 0;
+}
+
+void Executor::splitIntoWorkers(unsigned count) {
+  klee_message("Splitting %u states between %u worker processes",
+               (unsigned) states.size(), count);
+
+  unsigned spawned = forkWorkers(count);
+
+  // Every process has an identical copy of the state set, so they agree on
+  // its order.
+  unsigned position = 0;
+  for (std::set<ExecutionState*>::iterator it = states.begin(),
+         ie = states.end(); it != ie; ++it, ++position) {
+    if (!isWorkerShare(position, count, spawned))
+      removedStates.push_back(*it);
+  }
+  // The other workers explore the discarded states, so they are neither
+  // terminated nor counted as explored paths here.
+  updateStates(0);
+}
+
+void Executor::splitSeedsIntoWorkers(std::vector<SeedInfo> &seeds,
+                                     unsigned count) {
+  klee_message("Splitting %u seeds between %u worker processes",
+               (unsigned) seeds.size(), count);
+
+  unsigned spawned = forkWorkers(count);
+
+  std::vector<SeedInfo> share;
+  for (unsigned i = 0, e = seeds.size(); i != e; ++i)
+    if (isWorkerShare(i, count, spawned))
+      share.push_back(seeds[i]);
+  seeds.swap(share);
+}
+
+bool Executor::isWorkerShare(unsigned position, unsigned count,
+                             unsigned spawned) const {
+  // Worker i takes every count-th item starting at the i-th. The first
+  // worker also takes the shares of workers that failed to fork.
+  unsigned owner = position % count;
+  return owner == workerIndex || (workerIndex == 0 && owner >= spawned);
+}
+
+unsigned Executor::forkWorkers(unsigned count) {
+  // Anything buffered now would otherwise be written once per worker.
+  fflush(stdout);
+  fflush(stderr);
+  llvm::outs().flush();
+  llvm::errs().flush();
+  interpreterHandler->getInfoStream().flush();
+  if (solver->tracer)
+    solver->tracer->flush();
+  if (regressionPaths)
+    regressionPaths->flush();
+
+  for (unsigned i = 1; i < count; ++i) {
+    int pid = ::fork();
+    if (pid < 0) {
+      klee_warning("fork failed (for worker %u) - %s, continuing with %u "
+                   "workers", i, llvm::sys::StrError(errno).c_str(), i);
+      break;
+    }
+    if (pid == 0) {
+      workerIndex = i;
+      workerPids.clear();
+      checkpointWriter = 0;
+      // Timers and threads are not inherited, and the samples so far are
+      // the parent's.
+      setupTimer();
+      startWatchdog();
+      if (profiler) {
+        delete profiler;
+        profiler = new SamplingProfiler(ProfileSampleRate);
+      }
+      break;
+    }
+    workerPids.push_back(pid);
+  }
+
+  interpreterHandler->setWorker(workerIndex, count);
+  if (workerIndex && statsTracker)
+    statsTracker->startWorker(workerIndex);
+  if (workerIndex && regressionPaths)
+    regressionPaths->setOutput(
+        interpreterHandler->openOutputFile("regression.paths." +
+                                           llvm::utostr(workerIndex)),
+        /*carryOver=*/false);
+  if (workerIndex && solver->tracer) {
+    llvm::raw_fd_ostream *f = interpreterHandler->openOutputFile(
+        "queries.trace." + llvm::utostr(workerIndex));
+    if (f) {
+      solver->tracer->restart(f);
+    } else {
+      delete solver->tracer;
+      solver->tracer = 0;
+    }
+  }
+
+  return workerIndex ? count : workerPids.size() + 1;
+}
+
+void Executor::waitForWorkers() {
+  if (workerPids.empty())
+    return;
+
+  klee_message("Waiting for %u worker processes",
+               (unsigned) workerPids.size());
+  for (std::vector<int>::iterator it = workerPids.begin(),
+         ie = workerPids.end(); it != ie; ++it) {
+    int status;
+    while (waitpid(*it, &status, 0) < 0 && errno == EINTR)
+      ;
+  }
+  workerPids.clear();
 }
 
 std::string Executor::getAddressInfo(ExecutionState &state, 
@@ -3119,7 +5573,13 @@ void Executor::terminateState(ExecutionState &state) {
   }
 
   interpreterHandler->incPathsExplored();
+  removeState(state);
+}
 
+void Executor::removeState(ExecutionState &state) {
+  creditForkSite(state);
+  if (!loopSummaries.empty())
+    endLoopSummary(state);
   std::vector<ExecutionState *>::iterator it =
       std::find(addedStates.begin(), addedStates.end(), &state);
   if (it==addedStates.end()) {
@@ -3140,17 +5600,74 @@ void Executor::terminateState(ExecutionState &state) {
 
 void Executor::terminateStateEarly(ExecutionState &state, 
                                    const Twine &message) {
+  // An infeasible side of a lazy fork has no test case.
+  if (!resolveLazyFork(state))
+    return;
   if (!OnlyOutputStatesCoveringNew || state.coveredNew ||
-      (AlwaysOutputSeeds && seedMap.count(&state)))
+      (AlwaysOutputSeeds && seedMap.count(&state))) {
+    SamplingProfiler::Scope profile(SamplingProfiler::TestOutput);
     interpreterHandler->processTestCase(state, (message + "\n").str().c_str(),
                                         "early");
+  }
+  recordRegressionPath(state, /*complete=*/false);
   terminateState(state);
 }
 
+void Executor::recordRegressionPath(const ExecutionState &state,
+                                    bool complete) {
+  if (!regressionPaths)
+    return;
+  std::vector<unsigned char> path;
+  readPath(state, path);
+  regressionPaths->record(state, path, complete);
+}
+
+void Executor::orderByProcessTree(std::vector<ExecutionState *> &states) {
+  // Number the leaves of the process tree depth first: states next to each
+  // other then share the longest constraint prefixes, which an incremental
+  // core solver keeps asserted from one test case to the next.
+  std::map<ExecutionState *, unsigned> order;
+  std::vector<PTreeNode *> stack(1, processTree->root);
+  while (!stack.empty()) {
+    PTreeNode *n = stack.back();
+    stack.pop_back();
+    if (!n)
+      continue;
+    if (n->data)
+      order.insert(std::make_pair(n->data, order.size()));
+    stack.push_back(n->right);
+    stack.push_back(n->left);
+  }
+
+  std::vector<std::pair<unsigned, ExecutionState *> > sorted;
+  for (std::vector<ExecutionState *>::iterator it = states.begin(),
+                                               ie = states.end();
+       it != ie; ++it) {
+    std::map<ExecutionState *, unsigned>::iterator o = order.find(*it);
+    sorted.push_back(std::make_pair(
+        o == order.end() ? (unsigned) order.size() : o->second, *it));
+  }
+  std::sort(sorted.begin(), sorted.end());
+  for (unsigned i = 0, e = sorted.size(); i != e; ++i)
+    states[i] = sorted[i].second;
+}
+
+void Executor::terminateStatesEarly(std::vector<ExecutionState *> &states,
+                                    const Twine &message) {
+  orderByProcessTree(states);
+  for (std::vector<ExecutionState *>::iterator it = states.begin(),
+                                               ie = states.end();
+       it != ie; ++it)
+    terminateStateEarly(**it, message);
+}
+
 void Executor::terminateStateOnExit(ExecutionState &state) {
   if (!OnlyOutputStatesCoveringNew || state.coveredNew || 
-      (AlwaysOutputSeeds && seedMap.count(&state)))
+      (AlwaysOutputSeeds && seedMap.count(&state))) {
+    SamplingProfiler::Scope profile(SamplingProfiler::TestOutput);
     interpreterHandler->processTestCase(state, 0, 0);
+  }
+  recordRegressionPath(state, /*complete=*/true);
   terminateState(state);
 }
 
@@ -3250,9 +5767,11 @@ void Executor::terminateStateOnError(ExecutionState &state,
       suffix = suffix_buf.c_str();
     }
 
+    SamplingProfiler::Scope profile(SamplingProfiler::TestOutput);
     interpreterHandler->processTestCase(state, msg.str().c_str(), suffix);
   }
-    
+
+  recordRegressionPath(state, /*complete=*/true);
   terminateState(state);
 
   if (shouldExitOn(termReason))
@@ -3270,20 +5789,24 @@ static std::set<std::string> okExternals(okExternalsList,
 
 struct SetStateEnv {
   ExecutionState& state;
+  fenv_t hostEnv;
 
   SetStateEnv(ExecutionState& state) :state(state) {
-    // set the CPU's fenv to the one saved in the state
-    if (fesetenv(&state.fEnv))
-      assert(0 && "Unable to set floating-point environment");
+    // install the state's rounding mode and exceptions on the CPU
+    if (fegetenv(&hostEnv))
+      assert(0 && "Unable to get floating-point environment");
+    fesetround(state.getRoundingMode());
+    feclearexcept(FE_ALL_EXCEPT);
+    if (state.fpExceptions)
+      feraiseexcept(state.fpExceptions);
   }
 
   ~SetStateEnv() {
-    // save the CPU's fenv in the state, in case it changed
-    if (fegetenv(&state.fEnv))
-      assert(0 && "Unable to get floating-point environment");
-
-    // we can't extract the rounding mode from the fenv, so get it seperately
+    // save them back, in case the call changed them
+    state.fpExceptions = fetestexcept(FE_ALL_EXCEPT);
     state.setRoundingMode(fegetround());
+    if (fesetenv(&hostEnv))
+      assert(0 && "Unable to set floating-point environment");
   }
 
 private:
@@ -3291,15 +5814,41 @@ private:
   SetStateEnv(const SetStateEnv&); // = delete;
 };
 
+/// isNativeLibmFunction - Whether \a name is a function of the C math library
+/// without side effects other than on the floating point environment.
+static bool isNativeLibmFunction(StringRef name) {
+  static const char *const names[] = {
+    "acos", "asin", "atan", "atan2", "ceil", "cos", "cosh", "exp", "exp2",
+    "fabs", "floor", "fma", "fmax", "fmin", "fmod", "log", "log10", "log2",
+    "pow", "round", "sin", "sinh", "sqrt", "tan", "tanh", "trunc"
+  };
+  if (name.size() > 1 && name.back() == 'f')
+    name = name.drop_back();
+  for (unsigned i = 0; i != sizeof(names) / sizeof(names[0]); ++i)
+    if (name == names[i])
+      return true;
+  return false;
+}
+
 void Executor::callExternalFunction(ExecutionState &state,
                                     KInstruction *target,
                                     Function *function,
                                     std::vector< ref<Expr> > &arguments) {
-  SetStateEnv stateEnv(state);
-
-  // check if specialFunctionHandler wants it
-  if (specialFunctionHandler->handle(state, function, target, arguments))
+  // check if specialFunctionHandler wants it, through the handler of the
+  // call site unless the function was aliased or called through a pointer
+  KCallInstruction *kci = static_cast<KCallInstruction*>(target);
+  if (function == kci->staticTarget) {
+    if (kci->specialHandler >= 0) {
+      specialFunctionHandler->handle(state, kci->specialHandler, target,
+                                     arguments);
+      return;
+    }
+  } else if (specialFunctionHandler->handle(state, function, target,
+                                            arguments)) {
     return;
+  }
+
+  SetStateEnv stateEnv(state);
   
   if (NoExternals && !okExternals.count(function->getName())) {
     klee_warning("Calling not-OK external function : %s\n",
@@ -3344,7 +5893,11 @@ void Executor::callExternalFunction(ExecutionState &state,
     }
   }
 
-  state.addressSpace.copyOutConcretes();
+  // The math library neither reads nor writes the program's memory, so
+  // calls to it go without syncing the address space with native memory.
+  bool syncsMemory = !isNativeLibmFunction(function->getName());
+  if (syncsMemory)
+    state.addressSpace.copyOutConcretes();
 
   if (!SuppressExternalWarnings) {
 
@@ -3365,18 +5918,25 @@ void Executor::callExternalFunction(ExecutionState &state,
   }
   
   bool success = externalDispatcher->executeCall(function, target->inst, args);
+  restoreTimer();
   if (!success) {
+    state.addressSpace.forgetNativeConcretes();
     terminateStateOnError(state, "failed external call: " + function->getName(),
                           External);
     return;
   }
 
-  if (!state.addressSpace.copyInConcretes()) {
+  if (syncsMemory && !state.addressSpace.copyInConcretes()) {
     terminateStateOnError(state, "external modified read-only object",
                           External);
     return;
   }
 
+  bindExternalResult(state, target, function, args);
+}
+
+void Executor::bindExternalResult(ExecutionState &state, KInstruction *target,
+                                  Function *function, uint64_t *args) {
   LLVM_TYPE_Q Type *resultType = target->inst->getType();
   if (resultType != Type::getVoidTy(function->getContext())) {
     if (resultType->isIntegerTy()) {
@@ -3392,6 +5952,265 @@ void Executor::callExternalFunction(ExecutionState &state,
   }
 }
 
+bool Executor::isNativeCallable(Function *root) {
+  std::map<const Function*, bool>::iterator cached = nativeCallable.find(root);
+  if (cached != nativeCallable.end())
+    return cached->second;
+
+  // Only the root's answer is kept, as the functions reached from it may be
+  // callable natively even if it is not.
+  bool callable = true;
+  std::set<const Function*> visited;
+  std::vector<Function*> worklist(1, root);
+  visited.insert(root);
+  while (callable && !worklist.empty()) {
+    Function *f = worklist.back();
+    worklist.pop_back();
+    if (f->isVarArg()) {
+      callable = false;
+      break;
+    }
+
+    for (inst_iterator it = inst_begin(f), ie = inst_end(f);
+         callable && it != ie; ++it) {
+      Instruction *i = &*it;
+      if (isa<InvokeInst>(i) || isa<VAArgInst>(i) ||
+          isa<LandingPadInst>(i) || isa<ResumeInst>(i)) {
+        callable = false;
+        break;
+      }
+
+      // Native code would trap on a division by zero, and shift modulo
+      // the width, where the interpreter reports an error.
+      switch (i->getOpcode()) {
+      case Instruction::UDiv: case Instruction::SDiv:
+      case Instruction::URem: case Instruction::SRem:
+        if (checkDivZero) {
+          ConstantInt *divisor = dyn_cast<ConstantInt>(i->getOperand(1));
+          callable = divisor && !divisor->isZero();
+        }
+        break;
+      case Instruction::Shl: case Instruction::LShr: case Instruction::AShr:
+        if (checkOvershift) {
+          ConstantInt *shift = dyn_cast<ConstantInt>(i->getOperand(1));
+          callable = shift && shift->getValue().ult(
+                                  shift->getType()->getBitWidth());
+        }
+        break;
+      }
+      if (!callable)
+        break;
+
+      unsigned callee = ~0u;
+      if (CallInst *ci = dyn_cast<CallInst>(i)) {
+        Function *g = dyn_cast<Function>(ci->getCalledValue()->stripPointerCasts());
+        if (!g) {
+          callable = false;
+          break;
+        }
+        callee = ci->getNumArgOperands();
+        if (g->isDeclaration()) {
+          Intrinsic::ID id = g->getIntrinsicID();
+          callable = id != Intrinsic::not_intrinsic ?
+            id != Intrinsic::vastart && id != Intrinsic::vaend &&
+            id != Intrinsic::vacopy :
+            g->getName() == "klee_report_error" ||
+            isNativeLibmFunction(g->getName());
+        } else if (visited.insert(g).second) {
+          worklist.push_back(g);
+        }
+      }
+
+      // Function addresses differ between the interpreter and native code.
+      for (unsigned j = 0, e = i->getNumOperands(); callable && j != e; ++j) {
+        if (j == callee)
+          continue;
+        Value *v = i->getOperand(j)->stripPointerCasts();
+        if (isa<Function>(v) || isa<GlobalAlias>(v) ||
+            (isa<GlobalVariable>(v) &&
+             cast<GlobalVariable>(v)->isThreadLocal()))
+          callable = false;
+      }
+    }
+  }
+
+  nativeCallable[root] = callable;
+  return callable;
+}
+
+bool Executor::callNatively(ExecutionState &state, KInstruction *target,
+                            Function *f, std::vector< ref<Expr> > &arguments) {
+#if defined(FLT_EVAL_METHOD) && FLT_EVAL_METHOD == 0
+  // Native code rounds as the host does by default.
+  if (state.roundingMode != llvm::APFloat::rmNearestTiesToEven)
+    return false;
+
+  uint64_t *args = (uint64_t*) alloca(2*sizeof(*args) * (arguments.size() + 1));
+  memset(args, 0, 2 * sizeof(*args) * (arguments.size() + 1));
+  unsigned wordIndex = 2;
+  for (std::vector<ref<Expr> >::iterator ai = arguments.begin(), 
+       ae = arguments.end(); ai!=ae; ++ai) {
+    if (ConstantExpr *ce = dyn_cast<ConstantExpr>(*ai))
+      ce->toMemory(&args[wordIndex]);
+    else if (FConstantExpr *fce = dyn_cast<FConstantExpr>(*ai))
+      fce->toMemory(&args[wordIndex]);
+    else
+      return false;
+    wordIndex += ((*ai)->getWidth()+63)/64;
+  }
+
+  if (!isNativeCallable(f) || !state.addressSpace.hasOnlyConcretes())
+    return false;
+
+  if (!externalDispatcher->hasNativeModule()) {
+    std::map<const GlobalVariable*, void*> globals;
+    for (std::map<const GlobalValue*, MemoryObject*>::iterator
+           it = globalObjects.begin(), ie = globalObjects.end();
+         it != ie; ++it)
+      if (const GlobalVariable *gv = dyn_cast<GlobalVariable>(it->first))
+        globals[gv] = (void*) (unsigned long) it->second->address;
+    externalDispatcher->setNativeModule(kmodule->module, globals);
+  }
+
+  state.addressSpace.copyOutConcretes();
+  feclearexcept(FE_ALL_EXCEPT);
+  bool success = externalDispatcher->executeNativeCall(f, target->inst, args);
+  int raised = fetestexcept(FE_ALL_EXCEPT);
+  feclearexcept(FE_ALL_EXCEPT);
+  // The interpreter runs the call again from the memory it kept.
+  if (!success) {
+    state.addressSpace.forgetNativeConcretes();
+    return false;
+  }
+
+  state.fpExceptions |= raised;
+  ++stats::nativeCalls;
+  if (!state.addressSpace.copyInConcretes()) {
+    terminateStateOnError(state, "native call modified read-only object",
+                          External);
+    return true;
+  }
+
+  bindExternalResult(state, target, f, args);
+  return true;
+#else
+  // Excess precision would round differently from the interpreter.
+  return false;
+#endif
+}
+
+// A pure call accessing more bytes than this is not memoized, as comparing
+// the bytes it read would cost about as much as running it again.
+static const unsigned MaxRecordedCallBytes = 4096;
+
+bool Executor::callMemoized(ExecutionState &state, KInstruction *target,
+                            const PureCall &call) {
+  const CallMemo::Effects *effects = callMemo.lookup(call);
+  if (!effects)
+    return false;
+
+  for (CallMemo::Effects::const_reverse_iterator it = effects->rbegin(),
+         ie = effects->rend(); it != ie; ++it) {
+    bool matches = true;
+    for (unsigned i = 0; matches && i != it->reads.size(); ++i)
+      matches = accessMemoized(state, it->reads[i], false, false);
+    for (unsigned i = 0; matches && i != it->writes.size(); ++i)
+      matches = accessMemoized(state, it->writes[i], true, false);
+    if (!matches)
+      continue;
+
+    // The reads only need applying to the call being recorded.
+    if (!state.recording.isNull())
+      for (unsigned i = 0; i != it->reads.size(); ++i)
+        accessMemoized(state, it->reads[i], false, true);
+    for (unsigned i = 0; i != it->writes.size(); ++i)
+      accessMemoized(state, it->writes[i], true, true);
+    if (!state.recording.isNull() &&
+        state.recording->size() > MaxRecordedCallBytes)
+      state.recording = 0;
+
+    if (!it->result.isNull())
+      bindLocal(target, state, it->result);
+    state.fpExceptions = it->fpExceptions;
+    ++stats::memoizedCalls;
+    return true;
+  }
+  return false;
+}
+
+bool Executor::accessMemoized(ExecutionState &state,
+                              const CallMemo::Bytes &run, bool isWrite,
+                              bool apply) {
+  Expr::Width width = Context::get().getPointerWidth();
+  for (unsigned done = 0, n = run.values.size(); done != n;) {
+    uint64_t address = run.address + done;
+    ObjectPair op;
+    if (!state.addressSpace.resolveOne(ConstantExpr::create(address, width),
+                                       op))
+      return false;
+    const MemoryObject *mo = op.first;
+    const ObjectState *os = op.second;
+    uint64_t offset = address - mo->address;
+    if (offset >= mo->size)
+      return false;
+    // The run may span adjacent objects.
+    unsigned len = std::min((uint64_t) (n - done), mo->size - offset);
+    const uint8_t *values = &run.values[done];
+
+    if (!apply) {
+      if (isWrite) {
+        if (os->readOnly)
+          return false;
+      } else {
+        std::vector<uint8_t> buffer(len);
+        if (os->readConcrete(offset, len, &buffer[0]) != len ||
+            memcmp(&buffer[0], values, len))
+          return false;
+      }
+    } else {
+      if (isWrite) {
+        ObjectState *wos = state.addressSpace.getWriteable(mo, os);
+        for (unsigned i = 0; i != len; ++i)
+          wos->write8(offset + i, values[i]);
+      }
+      CallRecording *recording = state.recording.get();
+      if (recording && mo->id < recording->firstObjectId) {
+        if (isWrite)
+          recording->write(address, values, len);
+        else
+          recording->read(address, values, len);
+      }
+    }
+    done += len;
+  }
+  return true;
+}
+
+void Executor::recordAccess(ExecutionState &state, const MemoryObject *mo,
+                            const ref<Expr> &offset, unsigned bytes,
+                            bool isWrite) {
+  CallRecording &recording = *state.recording;
+  if (mo->id >= recording.firstObjectId)
+    return;
+
+  // The effect of a call accessing symbolic bytes, or at a symbolic offset,
+  // depends on more than the bytes it read.
+  ConstantExpr *CE = dyn_cast<ConstantExpr>(offset);
+  std::vector<uint8_t> values(bytes);
+  if (!CE || recording.size() + bytes > MaxRecordedCallBytes ||
+      state.addressSpace.findObject(mo)->readConcrete(
+          CE->getZExtValue(), bytes, &values[0]) != bytes) {
+    state.recording = 0;
+    return;
+  }
+
+  uint64_t address = mo->address + CE->getZExtValue();
+  if (isWrite)
+    recording.write(address, &values[0], bytes);
+  else
+    recording.read(address, &values[0], bytes);
+}
+
 /***/
 
 ref<Expr> Executor::replaceReadWithSymbolic(ExecutionState &state, 
@@ -3472,60 +6291,43 @@ void Executor::executeAlloc(ExecutionState &state,
     }
   } else {
     // XXX For now we just pick a size. Ideally we would support
-    // symbolic sizes fully but even if we don't it would be better to
-    // "smartly" pick a value, for example we could fork and pick the
-    // min and max values and perhaps some intermediate (reasonable
-    // value).
-    // 
-    // It would also be nice to recognize the case when size has
-    // exactly two values and just fork (but we need to get rid of
-    // return argument first). This shows up in pcre when llvm
-    // collapses the size expression with a select.
-
-    ref<Expr> t;
-    bool success = solver->getValue(state, size, t);
-	ref<ConstantExpr> example = cast<ConstantExpr>(t);
-    assert(success && "FIXME: Unhandled solver failure");
-    (void) success;
-    
-    // Try and start with a small example.
+    // symbolic sizes fully.
+    //
+    // The bounds of the size come from one range request, which the solvers
+    // that can optimize answer with a single query: the smallest size
+    // possible is picked, the two-value case needs no more than one check,
+    // and a huge size is only tried if the bounds allow it.
+    std::pair<ref<Expr>, ref<Expr> > range = solver->getRange(state, size);
+    assert(!range.first.isNull() && "FIXME: Unhandled solver failure");
+    ref<ConstantExpr> example = cast<ConstantExpr>(range.first);
+    ref<ConstantExpr> max = cast<ConstantExpr>(range.second);
     Expr::Width W = example->getWidth();
-    while (example->Ugt(ConstantExpr::alloc(128, W))->isTrue()) {
-      ref<ConstantExpr> tmp = example->LShr(ConstantExpr::alloc(1, W));
-      bool res;
-      bool success = solver->mayBeTrue(state, EqExpr::create(tmp, size), res);
-      assert(success && "FIXME: Unhandled solver failure");      
-      (void) success;
-      if (!res)
-        break;
-      example = tmp;
+
+    if (example->Eq(max)->isTrue()) {
+      executeAlloc(state, example, isLocal, target, zeroMemory, reallocFrom);
+      return;
     }
 
     StatePair fixedSize = fork(state, EqExpr::create(example, size), true);
     
     if (fixedSize.second) { 
       // Check for exactly two values
-      ref<Expr> tmp;
-      bool success = solver->getValue(*fixedSize.second, size, tmp);
-	  ref<ConstantExpr> ce = cast<ConstantExpr>(tmp);
-      assert(success && "FIXME: Unhandled solver failure");      
-      (void) success;
       bool res;
-      success = solver->mustBeTrue(*fixedSize.second, 
-                                   EqExpr::create(ce, size),
-                                   res);
+      bool success = solver->mustBeTrue(*fixedSize.second, 
+                                        EqExpr::create(max, size),
+                                        res);
       assert(success && "FIXME: Unhandled solver failure");      
       (void) success;
       if (res) {
-        executeAlloc(*fixedSize.second, ce, isLocal,
+        executeAlloc(*fixedSize.second, max, isLocal,
                      target, zeroMemory, reallocFrom);
       } else {
         // See if a *really* big value is possible. If so assume
         // malloc will fail for it, so lets fork and return 0.
-        StatePair hugeSize = 
-          fork(*fixedSize.second, 
-               UltExpr::create(ConstantExpr::alloc(1<<31, W), size), 
-               true);
+        ref<ConstantExpr> huge = ConstantExpr::alloc(1U << 31, W);
+        StatePair hugeSize(0, fixedSize.second);
+        if (huge->Ult(max)->isTrue())
+          hugeSize = fork(*fixedSize.second, UltExpr::create(huge, size), true);
         if (hugeSize.first) {
           klee_message("NOTE: found huge malloc, returning 0");
           bindLocal(target, *hugeSize.first, 
@@ -3538,7 +6340,7 @@ void Executor::executeAlloc(ExecutionState &state,
           llvm::raw_string_ostream info(Str);
           ExprPPrinter::printOne(info, "  size expr", size);
           info << "  concretization : " << example << "\n";
-          info << "  unbound example: " << ce << "\n";
+          info << "  unbound range  : [" << example << ", " << max << "]\n";
           terminateStateOnError(*hugeSize.second, "concretized symbolic size",
                                 Model, NULL, info.str());
         }
@@ -3610,11 +6412,35 @@ void Executor::resolveExact(ExecutionState &state,
   }
 }
 
+/// splitOffset - Split the symbolic \a offset into a base and a constant
+/// displacement, which an AddExpr keeps on its left.
+static bool splitOffset(const ref<Expr> &offset, ref<Expr> &base,
+                        int64_t &displacement) {
+  if (isa<klee::ConstantExpr>(offset))
+    return false;
+  base = offset;
+  displacement = 0;
+  if (AddExpr *add = dyn_cast<AddExpr>(offset)) {
+    if (klee::ConstantExpr *CE = dyn_cast<klee::ConstantExpr>(add->left)) {
+      if (CE->getWidth() > 64)
+        return false;
+      // Small displacements keep the intervals far from overflowing.
+      int64_t d = CE->getAPValue().getSExtValue();
+      if (d < INT32_MIN || d > INT32_MAX)
+        return false;
+      base = add->right;
+      displacement = d;
+    }
+  }
+  return true;
+}
+
 void Executor::executeMemoryOperation(ExecutionState &state,
                                       bool isWrite,
                                       ref<Expr> address,
                                       ref<Expr> value /* undef if read */,
                                       KInstruction *target /* undef if write */) {
+  SamplingProfiler::Scope profile(SamplingProfiler::MemoryResolution);
   Expr::Width type = (isWrite ? value->getWidth() : 
                      getWidthForLLVMType(target->inst->getType()));
   unsigned bytes = Expr::getMinBytesForWidth(type);
@@ -3645,16 +6471,31 @@ void Executor::executeMemoryOperation(ExecutionState &state,
     
     ref<Expr> offset = mo->getOffsetExpr(address);
 
+    // An access next to one proved in bounds on the path is checked against
+    // the proof, which holds as long as the path only gains constraints.
+    ref<Expr> base;
+    int64_t displacement;
+    bool memoize =
+        BoundsMemoization && splitOffset(offset, base, displacement);
+
     bool inBounds;
-    solver->setTimeout(coreSolverTimeout);
-    bool success = solver->mustBeTrue(state, 
-                                      mo->getBoundsCheckOffset(offset, bytes),
-                                      inBounds);
-    solver->setTimeout(0);
-    if (!success) {
-      state.pc = state.prevPC;
-      terminateStateEarly(state, "Query timed out (bounds check).");
-      return;
+    if (memoize &&
+        state.provenBounds.lookup(mo->id, base, displacement, bytes)) {
+      ++stats::boundsMemoHits;
+      inBounds = true;
+    } else {
+      solver->setTimeout(coreSolverTimeout);
+      bool success = solver->mustBeTrue(state, 
+                                        mo->getBoundsCheckOffset(offset, bytes),
+                                        inBounds);
+      solver->setTimeout(0);
+      if (!success) {
+        state.pc = state.prevPC;
+        terminateStateEarly(state, "Query timed out (bounds check).");
+        return;
+      }
+      if (memoize && inBounds)
+        state.provenBounds.insert(mo->id, base, displacement, bytes);
     }
 
     if (inBounds) {
@@ -3666,22 +6507,35 @@ void Executor::executeMemoryOperation(ExecutionState &state,
         } else {
           ObjectState *wos = state.addressSpace.getWriteable(mo, os);
           wos->write(offset, value);
+          if (!state.recording.isNull())
+            recordAccess(state, mo, offset, bytes, true);
         }          
       } else {
-        ref<Expr> result = os->read(offset, type);
-        
-        if (interpreterOpts.MakeConcreteSymbolic)
-          result = replaceReadWithSymbolic(state, result);
-        
-		if (target->inst->getType()->isFloatingPointTy())
-          result = ExplicitFloatExpr::create(result, result->getWidth());
+        ref<Expr> result;
+        if (target->inst->getType()->isFloatingPointTy() &&
+            !interpreterOpts.MakeConcreteSymbolic) {
+          result = os->readFloat(offset, type);
+        } else {
+          result = os->read(offset, type);
+
+          if (interpreterOpts.MakeConcreteSymbolic)
+            result = replaceReadWithSymbolic(state, result);
+
+          if (target->inst->getType()->isFloatingPointTy())
+            result = ExplicitFloatExpr::create(result, result->getWidth());
+        }
         bindLocal(target, state, result);
+        if (!state.recording.isNull())
+          recordAccess(state, mo, offset, bytes, false);
       }
 
       return;
     }
   } 
 
+  // An access which may be out of bounds is not memoized.
+  state.recording = 0;
+
   // we are on an error path (no resolution, multiple resolution, one
   // resolution with out of bounds)
   
@@ -3715,9 +6569,11 @@ void Executor::executeMemoryOperation(ExecutionState &state,
           wos->write(mo->getOffsetExpr(address), value);
         }
       } else {
-        ref<Expr> result = os->read(mo->getOffsetExpr(address), type);
-		if (target->inst->getType()->isFloatingPointTy())
-          result = ExplicitFloatExpr::create(result, result->getWidth());
+        ref<Expr> result;
+        if (target->inst->getType()->isFloatingPointTy())
+          result = os->readFloat(mo->getOffsetExpr(address), type);
+        else
+          result = os->read(mo->getOffsetExpr(address), type);
         bindLocal(target, *bound, result);
       }
     }
@@ -3745,12 +6601,22 @@ void Executor::executeMakeSymbolic(ExecutionState &state,
   if (!replayKTest) {
     // Find a unique name for this array.  First try the original name,
     // or if that fails try adding a unique identifier.
+    // With -site-array-names the identifier counts the objects made
+    // symbolic at this instruction instead.
+    std::string baseName = name;
+    if (SiteArrayNames)
+      baseName += ".site" + llvm::utostr(state.prevPC->info->id);
     unsigned id = 0;
-    std::string uniqueName = name;
-    while (!state.arrayNames.insert(uniqueName).second) {
-      uniqueName = name + "_" + llvm::utostr(++id);
+    std::string uniqueName = baseName;
+    while (state.arrayNames.count(uniqueName)) {
+      uniqueName = baseName + "_" + llvm::utostr(++id);
     }
+    state.arrayNames = state.arrayNames.insert(uniqueName);
+    size_t numArrays = arrayCache.getNumSymbolicArrays();
     const Array *array = arrayCache.CreateArray(uniqueName, mo->size);
+    ++stats::symbolicArrays;
+    if (arrayCache.getNumSymbolicArrays() == numArrays)
+      ++stats::sharedSymbolicArrays;
     bindObjectInState(state, mo, false, array);
     state.addSymbolic(mo, array);
     
@@ -3864,11 +6730,6 @@ void Executor::runFunctionAsMain(Function *f,
   }
 
   ExecutionState *state = new ExecutionState(kmodule->functionMap[f]);
-  
-  if (pathWriter) 
-    state->pathOS = pathWriter->open();
-  if (symPathWriter) 
-    state->symPathOS = symPathWriter->open();
 
 
   if (statsTracker)
@@ -3921,16 +6782,30 @@ void Executor::runFunctionAsMain(Function *f,
 
   if (statsTracker)
     statsTracker->done();
+
+  if (floatCoverage)
+    if (llvm::raw_fd_ostream *os =
+            interpreterHandler->openOutputFile("fpcov.txt")) {
+      floatCoverage->write(*os, *kmodule);
+      delete os;
+    }
+
+  if (forkController)
+    if (llvm::raw_fd_ostream *os =
+            interpreterHandler->openOutputFile("forks.txt")) {
+      forkController->write(*os, *kmodule);
+      delete os;
+    }
 }
 
-unsigned Executor::getPathStreamID(const ExecutionState &state) {
-  assert(pathWriter);
-  return state.pathOS.getID();
+void Executor::getPath(const ExecutionState &state,
+                       std::vector<unsigned char> &res) {
+  state.pathHistory.read(res);
 }
 
-unsigned Executor::getSymbolicPathStreamID(const ExecutionState &state) {
-  assert(symPathWriter);
-  return state.symPathOS.getID();
+void Executor::getSymbolicPath(const ExecutionState &state,
+                               std::vector<unsigned char> &res) {
+  state.symPathHistory.read(res);
 }
 
 void Executor::getConstraintLog(const ExecutionState &state, std::string &res,
@@ -4018,6 +6893,14 @@ bool Executor::getSymbolicSolution(const ExecutionState &state,
                              ConstantExpr::alloc(0, Expr::Bool));
     return false;
   }
+
+  if (MinimizeCexTime > 0) {
+    std::vector<std::vector<ref<Expr> > > preferences;
+    for (unsigned i = 0; i != state.symbolics.size(); ++i)
+      preferences.push_back(state.symbolics[i].first->cexPreferences);
+    CexMinimizer::minimize(tmp.constraints, objects, preferences, values,
+                           MinimizeCexTime);
+  }
   
   for (unsigned i = 0; i != state.symbolics.size(); ++i)
     res.push_back(std::make_pair(state.symbolics[i].first->name, values[i]));
@@ -4026,7 +6909,18 @@ bool Executor::getSymbolicSolution(const ExecutionState &state,
 
 void Executor::getCoveredLines(const ExecutionState &state,
                                std::map<const std::string*, std::set<unsigned> > &res) {
-  res = state.coveredLines;
+  std::vector<unsigned> ids;
+  state.coveredInstructions.getIds(ids);
+  for (std::vector<unsigned>::iterator it = ids.begin(), ie = ids.end();
+       it != ie; ++it) {
+    const InstructionInfo &ii = kmodule->infos->getInfo(*it);
+    res[&ii.file].insert(ii.line);
+  }
+}
+
+void Executor::getPathCoverage(const ExecutionState &state,
+                               std::vector<unsigned> &items) {
+  state.pathCoverage.getIds(items);
 }
 
 void Executor::doImpliedValueConcretization(ExecutionState &state,
@@ -15,8 +15,12 @@
 #ifndef KLEE_EXECUTOR_H
 #define KLEE_EXECUTOR_H
 
+#include "CallMemo.h"
+#include "FloatConcretizationPolicy.h"
+
 #include "klee/ExecutionState.h"
 #include "klee/Interpreter.h"
+#include "klee/Solver.h"
 #include "klee/Internal/Module/Cell.h"
 #include "klee/Internal/Module/KInstruction.h"
 #include "klee/Internal/Module/KModule.h"
@@ -30,18 +34,23 @@
 #include <map>
 #include <set>
 
+#include <pthread.h>
+#include <signal.h>
+
 struct KTest;
 
 namespace llvm {
   class BasicBlock;
   class BranchInst;
   class CallInst;
+  class CastInst;
   class Constant;
   class ConstantExpr;
   class Function;
   class GlobalValue;
   class Instruction;
   class LLVMContext;
+  class SwitchInst;
 #if LLVM_VERSION_CODE <= LLVM_VERSION(3, 1)
   class TargetData;
 #else
@@ -57,7 +66,10 @@ namespace klee {
   class ExecutionState;
   class ExternalDispatcher;
   class Expr;
+  class FloatCoverage;
+  class ForkController;
   class InstructionInfoTable;
+  class RegressionPaths;
   struct KFunction;
   struct KInstruction;
   class KInstIterator;
@@ -66,13 +78,13 @@ namespace klee {
   class MemoryObject;
   class ObjectState;
   class PTree;
+  class SamplingProfiler;
   class Searcher;
   class SeedInfo;
   class SpecialFunctionHandler;
   struct StackFrame;
   class StatsTracker;
   class TimingSolver;
-  class TreeStreamWriter;
   template<class T> class ref;
 
 
@@ -82,7 +94,10 @@ namespace klee {
   /// removedStates, and haltExecution, among others.
 
 class Executor : public Interpreter {
+  friend class AutoMergingSearcher;
+  friend class BanditSearcher;
   friend class BumpMergingSearcher;
+  friend class DirectedSearcher;
   friend class MergingSearcher;
   friend class RandomPathSearcher;
   friend class OwningSearcher;
@@ -131,11 +146,42 @@ private:
   MemoryManager *memory;
   std::set<ExecutionState*> states;
   StatsTracker *statsTracker;
-  TreeStreamWriter *pathWriter, *symPathWriter;
+  SamplingProfiler *profiler;
+  /// Where symbolic floating point values are concretized, set by
+  /// -float-concretization-policy.
+  FloatConcretizationPolicy *floatPolicy;
+  /// The IEEE classes seen at each floating point operation, with
+  /// -float-coverage or nurs:fpcov.
+  FloatCoverage *floatCoverage;
+  /// What to do at each symbolic branch, with -fork-controller.
+  ForkController *forkController;
+  /// The pure functions and the effects of their calls.
+  CallMemo callMemo;
+  /// The paths explored and those of the baseline, with
+  /// -write-regression-paths or -regression-baseline.
+  RegressionPaths *regressionPaths;
   SpecialFunctionHandler *specialFunctionHandler;
   std::vector<TimerInfo*> timers;
   PTree *processTree;
 
+  /// The ticks of the interval timer since they were last processed, set
+  /// by the SIGALRM handler.
+  static volatile sig_atomic_t timerTicks;
+  static void onTimerTick(int);
+  static void setupTimer();
+
+  /// Whether a timer tick asked for a memory check since the last one.
+  bool memoryCheckDue;
+
+  /// The heap memory not counted by util::CountMemory, and the counted
+  /// memory, when the heap was last measured, and the memory checks since.
+  size_t uncountedMemory;
+  size_t countedMemoryMeasured;
+  unsigned memoryChecksUnmeasured;
+  static const unsigned MemoryChecksPerMeasurement = 10;
+  /// The memory in use at the last check, as a fraction of -max-memory.
+  double memoryPressure;
+
   /// Used to track states that have been added during the current
   /// instructions step. 
   /// \invariant \ref addedStates is a subset of \ref states. 
@@ -155,6 +201,21 @@ private:
   /// happens with other states (that don't satisfy the seeds) depends
   /// on as-yet-to-be-determined flags.
   std::map<ExecutionState*, std::vector<SeedInfo> > seedMap;
+
+  /// The exits of a loop a state skipped (see -loop-summary-bound): the
+  /// condition of leaving the loop at each, with the values of the loop's
+  /// live-out registers then.
+  struct LoopSummary {
+    KBranchInstruction *branch;
+    /// A copy of the state from before the first exit skipped, to leave the
+    /// loop at any of them once the summary ends.
+    ExecutionState *exitState;
+    std::vector< ref<Expr> > exitConditions;
+    std::vector< std::vector< ref<Expr> > > liveOuts;
+  };
+
+  /// The loops states are summarizing.
+  std::map<ExecutionState*, LoopSummary> loopSummaries;
   
   /// Map of globals to their representative memory object.
   std::map<const llvm::GlobalValue*, MemoryObject*> globalObjects;
@@ -167,6 +228,10 @@ private:
   /// pointers. We use the actual Function* address as the function address.
   std::set<uint64_t> legalFunctions;
 
+  /// Whether each function checked so far may be called natively by
+  /// -native-concrete-calls.
+  std::map<const llvm::Function*, bool> nativeCallable;
+
   /// When non-null the bindings that will be used for calls to
   /// klee_make_symbolic in order replay.
   const struct KTest *replayKTest;
@@ -176,10 +241,23 @@ private:
   /// object.
   unsigned replayPosition;
 
+  /// When non-null the paths of the states to recreate, when resuming an
+  /// earlier run, instead of starting from the initial state.
+  const std::vector<std::vector<bool> > *resumePaths;
+
   /// When non-null a list of "seed" inputs which will be used to
   /// drive execution.
   const std::vector<struct KTest *> *usingSeeds;  
 
+  /// A copy of the initial state from before it ran, which the seeds
+  /// imported from -seed-watch-dir start from.
+  ExecutionState *seedBaseState;
+
+  /// The files of -seed-watch-dir seen so far, and the seeds imported
+  /// from them, which the executor owns.
+  std::set<std::string> watchedSeedFiles;
+  std::vector<struct KTest *> importedSeeds;
+
   /// Disables forking, instead a random path is chosen. Enabled as
   /// needed to control memory usage. \see fork()
   bool atMemoryLimit;
@@ -195,6 +273,49 @@ private:
   /// false, it is buggy (it needs to validate its writes).
   bool ivcEnabled;
 
+  /// Whether divisions by zero and overshifts are errors, as set by the
+  /// module options.
+  bool checkDivZero;
+  bool checkOvershift;
+
+  /// The index of this process among the parallel workers, 0 for the
+  /// process klee was started as. \see splitIntoWorkers()
+  unsigned workerIndex;
+
+  /// The worker processes forked by this one, which it waits for before
+  /// finishing.
+  std::vector<int> workerPids;
+
+  /// The thread interrupting the solver once execution is to halt, which
+  /// the timers cannot do in the middle of a query, and the process which
+  /// started it, or 0. \see watchSolver()
+  pthread_t watchdog;
+  pid_t watchdogOwner;
+  volatile bool watchdogStop;
+  /// The wall time at which -max-time halts execution, or 0.
+  double haltTime;
+
+  /// An offloaded state: the offset and length of its path in the offload
+  /// file, and the checkpoint it is recreated from. \see offloadState()
+  struct OffloadedState {
+    long offset;
+    size_t length;
+    ref<StateCheckpoint> checkpoint;
+
+    OffloadedState(long _offset, size_t _length,
+                   const ref<StateCheckpoint> &_checkpoint)
+      : offset(_offset), length(_length), checkpoint(_checkpoint) {}
+  };
+
+  /// The file holding the paths of offloaded states. States are restored
+  /// last in, first out so that the file can be truncated as they are.
+  FILE *offloadFile;
+  std::vector<OffloadedState> offloadedStates;
+
+  /// The process writing the last checkpoint, or 0 if it is done.
+  /// \see writeCheckpoint()
+  int checkpointWriter;
+
   /// The maximum time to allow for a single core solver query.
   /// (e.g. for a single STP query)
   double coreSolverTimeout;
@@ -233,6 +354,40 @@ private:
 
   void stepInstruction(ExecutionState &state);
   void updateStates(ExecutionState *current);
+
+  /// Fork \a count - 1 worker processes, and keep only this process' share
+  /// of the current states in each of them.
+  void splitIntoWorkers(unsigned count);
+  /// Fork \a count - 1 worker processes, and keep only this process' share
+  /// of \a seeds, those of the initial state, in each of them.
+  void splitSeedsIntoWorkers(std::vector<SeedInfo> &seeds, unsigned count);
+  /// Fork the worker processes for the two functions above, returning how
+  /// many of them run.
+  unsigned forkWorkers(unsigned count);
+  /// Whether the item at \a position in a sequence shared between \a count
+  /// workers, \a spawned of which run, belongs to this worker.
+  bool isWorkerShare(unsigned position, unsigned count, unsigned spawned) const;
+  void waitForWorkers();
+
+  /// Write the path of \a state to the offload file and remove it from the
+  /// executor, to be recreated by replaying the path once memory allows.
+  /// Returns false if the state cannot be recreated from its path.
+  bool offloadState(ExecutionState &state);
+  /// Give \a state a new checkpoint if it branched often enough since its
+  /// last one. \see -offload-checkpoint-interval
+  void checkpointState(ExecutionState &state);
+  /// Stop \a state, one of several forked apart in a way its path does not
+  /// record, from replaying the rest of its path prefix.
+  void dropPathPrefix(ExecutionState &state);
+  bool readOffloadedPath(unsigned index, std::vector<unsigned char> &path);
+  /// Recreate up to \a count offloaded states, returning how many were.
+  unsigned restoreOffloadedStates(unsigned count);
+  /// Wait for the process writing the last checkpoint, if \a block, or
+  /// check whether it is done. Returns true once there is none.
+  bool reapCheckpointWriter(bool block);
+  std::string getCheckpointFilename();
+  /// Write the samples of -profile-sample-rate, and stop sampling.
+  void writeProfile();
   void transferToBasicBlock(llvm::BasicBlock *dst, 
 			    llvm::BasicBlock *src,
 			    ExecutionState &state);
@@ -242,6 +397,41 @@ private:
                             llvm::Function *function,
                             std::vector< ref<Expr> > &arguments);
 
+  /// Bind the result of a native call of \a function, written to \a args
+  /// as ExternalDispatcher::executeCall describes.
+  void bindExternalResult(ExecutionState &state, KInstruction *target,
+                          llvm::Function *function, uint64_t *args);
+
+  /// Whether the defined function \a f and everything it calls can run
+  /// natively: it calls no function the interpreter models, other than the
+  /// C math library, and does not take function addresses.
+  bool isNativeCallable(llvm::Function *f);
+
+  /// Run a call of the defined function \a f natively, against a copy of
+  /// the state's memory, if -native-concrete-calls is set and the arguments
+  /// and memory are all concrete. Returns false if the call is left to the
+  /// interpreter, e.g. because it reported an error natively.
+  bool callNatively(ExecutionState &state, KInstruction *target,
+                    llvm::Function *f, std::vector< ref<Expr> > &arguments);
+
+  /// Reuse a memoized effect of the pure \a call, one whose reads match
+  /// the memory of \a state, if there is one. Returns false if there is
+  /// none and the call is to be run.
+  bool callMemoized(ExecutionState &state, KInstruction *target,
+                    const PureCall &call);
+
+  /// Check the bytes of \a run in \a state, or apply them if \a apply:
+  /// the bytes a memoized call read must be in memory, those it wrote must
+  /// be in writeable objects. Applying records them for the call recorded
+  /// by \a state, if any.
+  bool accessMemoized(ExecutionState &state, const CallMemo::Bytes &run,
+                      bool isWrite, bool apply);
+
+  /// Record the concrete bytes at \a offset in \a mo accessed by the call
+  /// recorded by \a state, or stop recording it if they are symbolic.
+  void recordAccess(ExecutionState &state, const MemoryObject *mo,
+                    const ref<Expr> &offset, unsigned bytes, bool isWrite);
+
   ObjectState *bindObjectInState(ExecutionState &state, const MemoryObject *mo,
                                  bool isLocal, const Array *array = 0);
 
@@ -320,12 +510,52 @@ private:
   // current state, and one of the states may be null.
   StatePair fork(ExecutionState &current, ref<Expr> condition, bool isInternal);
 
+  // Whether symbolic branches may be forked lazily (see -lazy-fork), and
+  // whether they could be were it enabled.
+  bool canForkLazily();
+  bool lazyForkSupported();
+
+  // Credit the branch whose fork started state with the instructions it
+  // covered first since, for the fork controller.
+  void creditForkSite(ExecutionState &state);
+
+  // Skip the exit of a summarizable loop at the branch kbi on cond, adding
+  // it to the summary of state, instead of forking. Returns false if the
+  // branch is to be taken as usual.
+  bool summarizeLoopExit(ExecutionState &state, KBranchInstruction *kbi,
+                         ref<Expr> cond);
+
+  // End the loop summary of state, if any, adding a state which leaves the
+  // loop at any of the exits skipped.
+  void endLoopSummary(ExecutionState &state);
+
+  // Find a model of the constraints of state and condition, or none.
+  bool getStateModel(ExecutionState &state, ref<Expr> condition,
+                     ref<StateModel> &model);
+
+  // Evaluate a branch condition in state, taking the side the model of
+  // state takes to be feasible and only asking the solver about the other
+  // one, whose model is returned in otherModel if it is feasible as well.
+  bool evaluateUnderModel(ExecutionState &state, ref<Expr> condition,
+                          Solver::Validity &res,
+                          ref<StateModel> &otherModel);
+
+  // Check the pending branch condition of a lazy fork in state, adding it
+  // to its constraints, and decide its unrun sibling by the same query.
+  // Returns false, having terminated state, if the branch is infeasible.
+  bool resolveLazyFork(ExecutionState &state);
+
   /// Add the given (boolean) condition as a constraint on state. This
   /// function is a wrapper around the state's addConstraint function
   /// which also manages propagation of implied values,
   /// validity checks, and seed patching.
   void addConstraint(ExecutionState &state, ref<Expr> condition);
 
+  /// Drop the constraints of state which the others imply, and rewrite the
+  /// rest under each other (see ConstraintManager::simplify), asking the
+  /// solver about the constraints cheap reasoning cannot decide.
+  void simplifyConstraints(ExecutionState &state);
+
   // Called on [for now] concrete reads, replaces constant with a symbolic
   // Used for testing.
   ref<Expr> replaceReadWithSymbolic(ExecutionState &state, ref<Expr> e);
@@ -336,12 +566,12 @@ private:
   Cell& getArgumentCell(ExecutionState &state,
                         KFunction *kf,
                         unsigned index) {
-    return state.stack.back().locals[kf->getArgRegister(index)];
+    return state.stack.back().getWriteableLocal(kf->getArgRegister(index));
   }
 
   Cell& getDestCell(ExecutionState &state,
                     KInstruction *target) {
-    return state.stack.back().locals[target->dest];
+    return state.stack.back().getWriteableLocal(target->dest);
   }
 
   void bindLocal(KInstruction *target, 
@@ -352,6 +582,55 @@ private:
                     ExecutionState &state,
                     ref<Expr> value);
 
+  /// Compute a floating point binary operation on constant single or
+  /// double precision operands with the host's arithmetic and bind the
+  /// result. Returns false if the operands are not such constants.
+  bool bindHostFloatArith(KInstruction *ki, ExecutionState &state);
+
+  /// Compute an integer operation or cast on constant operands of up to 64
+  /// bits directly on their cells, leaving an immediate result instead of
+  /// allocating an expression. Returns false if the operands are not such
+  /// constants or the operation is not covered.
+  bool bindConstantCells(KInstruction *ki, ExecutionState &state);
+
+  /// Fork off the states in which \a isError holds, terminating them with
+  /// the error \a message written to a \a suffix file. Returns false if
+  /// \a state itself was terminated.
+  bool checkOperand(ExecutionState &state, ref<Expr> isError,
+                    const char *message, const char *suffix);
+  /// Check a division or remainder by \a divisor, with -check-div-zero.
+  bool checkDivisor(ExecutionState &state, ref<Expr> divisor);
+  /// Check a shift of \a shift bits, with -check-overshift. Overshifts,
+  /// by the width of the value shifted or more, are undefined in LLVM.
+  bool checkShift(ExecutionState &state, ref<Expr> shift);
+
+  /// Whether \a ki computes, loads or stores concrete values only, so that
+  /// executing it cannot fork the state.
+  bool isFusable(KInstruction *ki, ExecutionState &state) const;
+
+  /// Keep executing \a state after an instruction for as long as
+  /// -fuse-concrete-runs allows and its next instruction is fusable,
+  /// leaving the searcher, timers and memory checks to the end of the run.
+  void executeConcreteRun(ExecutionState &state);
+
+  /// The lanes of vector operand \a index, floating point lanes as floats.
+  std::vector< ref<Expr> > evalLanes(KInstruction *ki, unsigned index,
+                                     ExecutionState &state);
+  void bindLanes(KInstruction *target, ExecutionState &state,
+                 const std::vector< ref<Expr> > &lanes);
+  /// Concretize a floating point lane for a core solver without floats.
+  ref<Expr> toConstantLane(ExecutionState &state, ref<Expr> e);
+  /// Apply the binary operation or comparison \a i to a pair of lanes.
+  /// Returns null if the state was terminated.
+  ref<Expr> evalLaneOperation(ExecutionState &state, llvm::Instruction *i,
+                              ref<Expr> left, ref<Expr> right);
+  ref<Expr> evalLaneCast(ExecutionState &state, llvm::CastInst *ci,
+                         ref<Expr> arg);
+  /// Execute an instruction with a vector result lane by lane. Returns false
+  /// if the instruction is left to the generic code, working on the packed
+  /// value.
+  bool executeVectorInstruction(ExecutionState &state, KInstruction *ki);
+
   ref<klee::Expr> evalConstantExpr(const llvm::ConstantExpr *ce);
 
   /// Return a unique constant value for the given expression in the
@@ -368,6 +647,23 @@ private:
   ref<klee::ConstantExpr> toConstant(ExecutionState &state, ref<Expr> e, 
                                      const char *purpose);
 
+  /// Bind the floating point value \a e to one of its values in \a state,
+  /// taken from a seed of the state when it has one and from the solver
+  /// otherwise, constraining its bits to be those of the value returned.
+  ref<Expr> concretizeFloat(ExecutionState &state, KInstruction *ki,
+                            ref<Expr> e);
+
+  /// Return \a e, concretized if it is a symbolic floating point value
+  /// which the float concretization policy trades for a constant when
+  /// \a trigger happens for \a name at \a ki.
+  ref<Expr> applyFloatPolicy(ExecutionState &state, KInstruction *ki,
+                             FloatConcretizationPolicy::Trigger trigger,
+                             llvm::StringRef name, ref<Expr> e);
+
+  /// Record the IEEE class of the floating point result \a ki just bound,
+  /// or with -float-coverage-queries the classes a symbolic one may be in.
+  void markFloatCoverage(ExecutionState &state, KInstruction *ki);
+
   /// Bind a constant value for e to the given target. NOTE: This
   /// function may fork state if the state has multiple seeds.
   void executeGetValue(ExecutionState &state, ref<Expr> e, KInstruction *target);
@@ -384,8 +680,16 @@ private:
 
   // remove state from queue and delete
   void terminateState(ExecutionState &state);
+  // the same, without counting it as an explored path
+  void removeState(ExecutionState &state);
   // call exit handler and terminate state
   void terminateStateEarly(ExecutionState &state, const llvm::Twine &message);
+  // sort states in process tree order, so that siblings come together
+  void orderByProcessTree(std::vector<ExecutionState *> &states);
+  // call exit handler and terminate states, in process tree order so that
+  // the test cases of siblings are solved one after another
+  void terminateStatesEarly(std::vector<ExecutionState *> &states,
+                            const llvm::Twine &message);
   // call exit handler and terminate state
   void terminateStateOnExit(ExecutionState &state);
   // call error handler and terminate state
@@ -409,6 +713,10 @@ private:
   template <typename TypeIt>
   void computeOffsets(KGEPInstruction *kgepi, TypeIt ib, TypeIt ie);
 
+  /// computeCaseTable - Fill the table \a ksi looks up concrete conditions
+  /// of the switch \a si in.
+  void computeCaseTable(KSwitchInstruction *ksi, llvm::SwitchInst *si);
+
   /// bindInstructionConstants - Initialize any necessary per instruction
   /// constant values.
   void bindInstructionConstants(KInstruction *KI);
@@ -428,11 +736,40 @@ private:
   void addTimer(Timer *timer, double rate);
 
   void initTimers();
+
+  /// Start the watchdog thread in this process, or stop it.
+  void startWatchdog();
+  void stopWatchdog();
+  static void *watchSolver(void *executor);
+
+  /// Run the timers which are due, check the time taken by the last
+  /// instruction and dump what the debugger asked for, if the timer has
+  /// ticked since the last call. Otherwise this is a single load, so it
+  /// can be called after every instruction.
   void processTimers(ExecutionState *current,
-                     double maxInstTime);
+                     double maxInstTime) {
+    if (timerTicks)
+      processTimerTicks(current, maxInstTime);
+  }
+  void processTimerTicks(ExecutionState *current, double maxInstTime);
+
+  /// Reinstall the timer if an external call replaced its signal handler
+  /// or stopped it.
+  void restoreTimer();
+
+  /// Check the memory usage against -max-memory, once per timer tick.
   void checkMemoryUsage();
   void printDebugInstructions(ExecutionState &state);
   void doDumpStates();
+  void dumpPathPrefixes();
+  void dumpPathPrefix(unsigned id, const std::vector<unsigned char> &path);
+  /// Get the branch decisions \a state took, or will take while it replays
+  /// its prefix.
+  void readPath(const ExecutionState &state, std::vector<unsigned char> &path);
+  /// Record the path of \a state, which is terminated, for
+  /// -write-regression-paths. Its subtree was explored unless \a complete
+  /// is false.
+  void recordRegressionPath(const ExecutionState &state, bool complete);
 
 public:
   Executor(llvm::LLVMContext &ctx, const InterpreterOptions &opts,
@@ -443,16 +780,11 @@ public:
     return *interpreterHandler;
   }
 
+  const FloatCoverage *getFloatCoverage() const { return floatCoverage; }
+
   // XXX should just be moved out to utility module
   ref<klee::Expr> evalConstant(const llvm::Constant *c);
 
-  virtual void setPathWriter(TreeStreamWriter *tsw) {
-    pathWriter = tsw;
-  }
-  virtual void setSymbolicPathWriter(TreeStreamWriter *tsw) {
-    symPathWriter = tsw;
-  }
-
   virtual void setReplayKTest(const struct KTest *out) {
     assert(!replayPath && "cannot replay both buffer and path");
     replayKTest = out;
@@ -465,6 +797,25 @@ public:
     replayPosition = 0;
   }
 
+  virtual void setResumePaths(const std::vector<std::vector<bool> > *paths) {
+    resumePaths = paths;
+  }
+
+  /// Write the paths of all states, live and offloaded, to the checkpoint
+  /// file in the output directory, from which klee -resume recreates
+  /// them. The file is written by a forked process so that exploration
+  /// goes on meanwhile, unless \a wait is set. A checkpoint is skipped
+  /// while the last one is still being written.
+  void writeCheckpoint(bool wait);
+
+  /// Free the arrays no state, constraint or cache references any more,
+  /// after dropping what the solvers keep by them.
+  void collectArrays();
+
+  /// Import the files of -seed-watch-dir not seen yet as seeds of a new
+  /// state, copied from the initial state.
+  void importSeeds();
+
   virtual const llvm::Module *
   setModule(llvm::Module *module, const ModuleOptions &opts);
 
@@ -489,9 +840,11 @@ public:
 
   /*** State accessor methods ***/
 
-  virtual unsigned getPathStreamID(const ExecutionState &state);
+  virtual void getPath(const ExecutionState &state,
+                       std::vector<unsigned char> &res);
 
-  virtual unsigned getSymbolicPathStreamID(const ExecutionState &state);
+  virtual void getSymbolicPath(const ExecutionState &state,
+                               std::vector<unsigned char> &res);
 
   virtual void getConstraintLog(const ExecutionState &state,
                                 std::string &res,
@@ -506,6 +859,9 @@ public:
   virtual void getCoveredLines(const ExecutionState &state,
                                std::map<const std::string*, std::set<unsigned> > &res);
 
+  virtual void getPathCoverage(const ExecutionState &state,
+                               std::vector<unsigned> &items);
+
   Expr::Width getWidthForLLVMType(LLVM_TYPE_Q llvm::Type *type) const;
   size_t getAllocationAlignment(const llvm::Value *allocSite) const;
 
@@ -12,6 +12,7 @@
 #include "PTree.h"
 #include "StatsTracker.h"
 #include "ExecutorTimerInfo.h"
+#include "TimingSolver.h"
 
 #include "klee/ExecutionState.h"
 #include "klee/Internal/Module/InstructionInfoTable.h"
@@ -42,6 +43,26 @@ MaxTime("max-time",
         cl::desc("Halt execution after the specified number of seconds (default=0 (off))"),
         cl::init(0));
 
+cl::opt<double>
+CheckpointInterval("checkpoint-interval",
+                   cl::desc("Write the paths of all states to a checkpoint file in the output directory every this many seconds, from which the run can be continued with -resume (default=0 (off))"),
+                   cl::init(0));
+
+cl::opt<double>
+ArrayCollectionInterval("array-collection-interval",
+                        cl::desc("Free the arrays which no expression reads any more every this many seconds (default=0 (off))"),
+                        cl::init(0));
+
+cl::opt<std::string>
+SeedWatchDir("seed-watch-dir",
+             cl::desc("Import the files appearing in this directory while exploring as seeds, such as the queue of a fuzzer run alongside: .ktest files as they are, other files as raw bytes for the symbolic objects in turn (default=none)"),
+             cl::init(""));
+
+cl::opt<double>
+SeedWatchInterval("seed-watch-interval",
+                  cl::desc("Look for new files in -seed-watch-dir every this many seconds (default=5)"),
+                  cl::init(5));
+
 ///
 
 class HaltTimer : public Executor::Timer {
@@ -59,19 +80,51 @@ public:
 
 ///
 
+class CheckpointTimer : public Executor::Timer {
+  Executor *executor;
+
+public:
+  CheckpointTimer(Executor *_executor) : executor(_executor) {}
+  ~CheckpointTimer() {}
+
+  void run() { executor->writeCheckpoint(/*wait=*/false); }
+};
+
+class ArrayCollectionTimer : public Executor::Timer {
+  Executor *executor;
+
+public:
+  ArrayCollectionTimer(Executor *_executor) : executor(_executor) {}
+  ~ArrayCollectionTimer() {}
+
+  void run() { executor->collectArrays(); }
+};
+
+class SeedWatchTimer : public Executor::Timer {
+  Executor *executor;
+
+public:
+  SeedWatchTimer(Executor *_executor) : executor(_executor) {}
+  ~SeedWatchTimer() {}
+
+  void run() { executor->importSeeds(); }
+};
+
+///
+
 static const double kSecondsPerTick = .1;
-static volatile unsigned timerTicks = 0;
+volatile sig_atomic_t Executor::timerTicks = 0;
 
 // XXX hack
 extern "C" unsigned dumpStates, dumpPTree;
 unsigned dumpStates = 0, dumpPTree = 0;
 
-static void onAlarm(int) {
+void Executor::onTimerTick(int) {
   ++timerTicks;
 }
 
 // oooogalay
-static void setupHandler() {
+void Executor::setupTimer() {
   struct itimerval t;
   struct timeval tv;
   
@@ -81,7 +134,19 @@ static void setupHandler() {
   t.it_interval = t.it_value = tv;
   
   ::setitimer(ITIMER_REAL, &t, 0);
-  ::signal(SIGALRM, onAlarm);
+  ::signal(SIGALRM, onTimerTick);
+}
+
+void Executor::restoreTimer() {
+  struct sigaction sa;
+  struct itimerval t;
+  if (::sigaction(SIGALRM, 0, &sa) < 0 || sa.sa_handler != onTimerTick ||
+      ::getitimer(ITIMER_REAL, &t) < 0 ||
+      (!t.it_interval.tv_sec && !t.it_interval.tv_usec)) {
+    klee_warning_once(0, "external call changed the interval timer, "
+                         "restoring it");
+    setupTimer();
+  }
 }
 
 // FIXME: Use LLVM style RTTI so we can know
@@ -112,14 +177,60 @@ void Executor::initTimers() {
 
   if (first) {
     first = false;
-    setupHandler();
+    setupTimer();
   }
 
   if (MaxTime) {
+    haltTime = util::getWallTime() + MaxTime;
     HaltTimer *ht = new HaltTimer(this);
     hack_haltTimer = ht; // HACK
     addTimer(ht, MaxTime.getValue());
   }
+
+  if (CheckpointInterval)
+    addTimer(new CheckpointTimer(this), CheckpointInterval);
+
+  if (ArrayCollectionInterval)
+    addTimer(new ArrayCollectionTimer(this), ArrayCollectionInterval);
+
+  if (!SeedWatchDir.empty())
+    addTimer(new SeedWatchTimer(this), SeedWatchInterval);
+}
+
+/// watchSolver - Body of the watchdog thread: every tick, interrupt the
+/// query running once execution is to halt, whether -max-time is up or
+/// the user asked. The query then fails instead of holding up the halt
+/// for as long as its timeout, if it has one.
+void *Executor::watchSolver(void *arg) {
+  Executor *executor = static_cast<Executor *>(arg);
+  while (!executor->watchdogStop) {
+    usleep((useconds_t)(kSecondsPerTick * 1000000));
+    if (executor->haltExecution ||
+        (executor->haltTime && util::getWallTime() > executor->haltTime))
+      executor->solver->interrupt();
+  }
+  return NULL;
+}
+
+void Executor::startWatchdog() {
+  if (watchdogOwner == getpid())
+    return;
+  // A watchdog inherited across fork() does not exist in this process.
+  watchdogOwner = 0;
+  watchdogStop = false;
+  if (pthread_create(&watchdog, NULL, watchSolver, this)) {
+    klee_warning("unable to start the solver watchdog");
+    return;
+  }
+  watchdogOwner = getpid();
+}
+
+void Executor::stopWatchdog() {
+  if (watchdogOwner != getpid())
+    return;
+  watchdogStop = true;
+  pthread_join(watchdog, NULL);
+  watchdogOwner = 0;
 }
 
 ///
@@ -132,104 +243,95 @@ void Executor::addTimer(Timer *timer, double rate) {
   timers.push_back(new TimerInfo(timer, rate));
 }
 
-void Executor::processTimers(ExecutionState *current,
-                             double maxInstTime) {
-  static unsigned callsWithoutCheck = 0;
-  unsigned ticks = timerTicks;
-
-  if (!ticks && ++callsWithoutCheck > 1000) {
-    setupHandler();
-    ticks = 1;
-  }
-
-  if (ticks || dumpPTree || dumpStates) {
-    if (dumpPTree) {
-      char name[32];
-      sprintf(name, "ptree%08d.dot", (int) stats::instructions);
-      llvm::raw_ostream *os = interpreterHandler->openOutputFile(name);
-      if (os) {
-        processTree->dump(*os);
-        delete os;
-      }
-      
-      dumpPTree = 0;
+void Executor::processTimerTicks(ExecutionState *current,
+                                 double maxInstTime) {
+  memoryCheckDue = true;
+
+  if (dumpPTree) {
+    char name[32];
+    sprintf(name, "ptree%08d.dot", (int) stats::instructions);
+    llvm::raw_ostream *os = interpreterHandler->openOutputFile(name);
+    if (os) {
+      processTree->dump(*os);
+      delete os;
     }
+    
+    dumpPTree = 0;
+  }
 
-    if (dumpStates) {
-      llvm::raw_ostream *os = interpreterHandler->openOutputFile("states.txt");
-      
-      if (os) {
-        for (std::set<ExecutionState*>::const_iterator it = states.begin(), 
-               ie = states.end(); it != ie; ++it) {
-          ExecutionState *es = *it;
-          *os << "(" << es << ",";
-          *os << "[";
-          ExecutionState::stack_ty::iterator next = es->stack.begin();
-          ++next;
-          for (ExecutionState::stack_ty::iterator sfIt = es->stack.begin(),
-                 sf_ie = es->stack.end(); sfIt != sf_ie; ++sfIt) {
-            *os << "('" << sfIt->kf->function->getName().str() << "',";
-            if (next == es->stack.end()) {
-              *os << es->prevPC->info->line << "), ";
-            } else {
-              *os << next->caller->info->line << "), ";
-              ++next;
-            }
+  if (dumpStates) {
+    llvm::raw_ostream *os = interpreterHandler->openOutputFile("states.txt");
+    
+    if (os) {
+      for (std::set<ExecutionState*>::const_iterator it = states.begin(), 
+             ie = states.end(); it != ie; ++it) {
+        ExecutionState *es = *it;
+        *os << "(" << es << ",";
+        *os << "[";
+        ExecutionState::stack_ty::iterator next = es->stack.begin();
+        ++next;
+        for (ExecutionState::stack_ty::iterator sfIt = es->stack.begin(),
+               sf_ie = es->stack.end(); sfIt != sf_ie; ++sfIt) {
+          *os << "('" << sfIt->kf->function->getName().str() << "',";
+          if (next == es->stack.end()) {
+            *os << es->prevPC->info->line << "), ";
+          } else {
+            *os << next->caller->info->line << "), ";
+            ++next;
           }
-          *os << "], ";
-
-          StackFrame &sf = es->stack.back();
-          uint64_t md2u = computeMinDistToUncovered(es->pc,
-                                                    sf.minDistToUncoveredOnReturn);
-          uint64_t icnt = theStatisticManager->getIndexedValue(stats::instructions,
-                                                               es->pc->info->id);
-          uint64_t cpicnt = sf.callPathNode->statistics.getValue(stats::instructions);
-
-          *os << "{";
-          *os << "'depth' : " << es->depth << ", ";
-          *os << "'weight' : " << es->weight << ", ";
-          *os << "'queryCost' : " << es->queryCost << ", ";
-          *os << "'coveredNew' : " << es->coveredNew << ", ";
-          *os << "'instsSinceCovNew' : " << es->instsSinceCovNew << ", ";
-          *os << "'md2u' : " << md2u << ", ";
-          *os << "'icnt' : " << icnt << ", ";
-          *os << "'CPicnt' : " << cpicnt << ", ";
-          *os << "}";
-          *os << ")\n";
         }
-        
-        delete os;
+        *os << "], ";
+
+        StackFrame &sf = es->stack.back();
+        uint64_t md2u = computeMinDistToUncovered(es->pc,
+                                                  sf.minDistToUncoveredOnReturn);
+        uint64_t icnt = theStatisticManager->getIndexedValue(stats::instructions,
+                                                             es->pc->info->id);
+        uint64_t cpicnt = sf.callPathNode->statistics.getValue(stats::instructions);
+
+        *os << "{";
+        *os << "'depth' : " << es->depth << ", ";
+        *os << "'weight' : " << es->weight << ", ";
+        *os << "'queryCost' : " << es->queryCost << ", ";
+        *os << "'coveredNew' : " << es->coveredNew << ", ";
+        *os << "'instsSinceCovNew' : " << es->instsSinceCovNew << ", ";
+        *os << "'md2u' : " << md2u << ", ";
+        *os << "'icnt' : " << icnt << ", ";
+        *os << "'CPicnt' : " << cpicnt << ", ";
+        *os << "}";
+        *os << ")\n";
       }
-
-      dumpStates = 0;
+      
+      delete os;
     }
 
-    if (maxInstTime > 0 && current &&
-        std::find(removedStates.begin(), removedStates.end(), current) ==
-            removedStates.end()) {
-      if (timerTicks*kSecondsPerTick > maxInstTime) {
-        klee_warning("max-instruction-time exceeded: %.2fs",
-                     timerTicks*kSecondsPerTick);
-        terminateStateEarly(*current, "max-instruction-time exceeded");
-      }
+    dumpStates = 0;
+  }
+
+  if (maxInstTime > 0 && current &&
+      std::find(removedStates.begin(), removedStates.end(), current) ==
+          removedStates.end()) {
+    if (timerTicks*kSecondsPerTick > maxInstTime) {
+      klee_warning("max-instruction-time exceeded: %.2fs",
+                   timerTicks*kSecondsPerTick);
+      terminateStateEarly(*current, "max-instruction-time exceeded");
     }
+  }
 
-    if (!timers.empty()) {
-      double time = util::getWallTime();
+  if (!timers.empty()) {
+    double time = util::getWallTime();
 
-      for (std::vector<TimerInfo*>::iterator it = timers.begin(), 
-             ie = timers.end(); it != ie; ++it) {
-        TimerInfo *ti = *it;
-        
-        if (time >= ti->nextFireTime) {
-          ti->timer->run();
-          ti->nextFireTime = time + ti->rate;
-        }
+    for (std::vector<TimerInfo*>::iterator it = timers.begin(), 
+           ie = timers.end(); it != ie; ++it) {
+      TimerInfo *ti = *it;
+      
+      if (time >= ti->nextFireTime) {
+        ti->timer->run();
+        ti->nextFireTime = time + ti->rate;
       }
     }
-
-    timerTicks = 0;
-    callsWithoutCheck = 0;
   }
+
+  timerTicks = 0;
 }
 
@@ -24,9 +24,9 @@
 #include "llvm/LLVMContext.h"
 #endif
 #include "llvm/ExecutionEngine/JIT.h"
-#include "llvm/ExecutionEngine/GenericValue.h"
 #include "llvm/Support/DynamicLibrary.h"
 #include "llvm/Support/raw_ostream.h"
+#include "llvm/Transforms/Utils/Cloning.h"
 
 #if LLVM_VERSION_CODE < LLVM_VERSION(3, 0)
 #include "llvm/Target/TargetSelect.h"
@@ -42,18 +42,33 @@
 
 #include <setjmp.h>
 #include <signal.h>
+#include <string.h>
 
 using namespace llvm;
 using namespace klee;
 
 /***/
 
-static jmp_buf escapeCallJmpBuf;
+// The handler is installed once, and only escapes from the external calls
+// of the thread that faulted.
+static __thread sigjmp_buf *escapeCallJmpBuf;
+static struct sigaction segvActionOld;
 
 extern "C" {
 
 static void sigsegv_handler(int signal, siginfo_t *info, void *context) {
-  longjmp(escapeCallJmpBuf, 1);
+  if (escapeCallJmpBuf)
+    siglongjmp(*escapeCallJmpBuf, 1);
+  // Not in an external call: the fault recurs under the previous handler.
+  sigaction(SIGSEGV, &segvActionOld, 0);
+}
+
+// Stands in for klee_report_error in native calls, whose errors are left to
+// the interpreter to report.
+static void escape_native_call() {
+  if (escapeCallJmpBuf)
+    siglongjmp(*escapeCallJmpBuf, 1);
+  abort();
 }
 
 }
@@ -85,7 +100,7 @@ void *ExternalDispatcher::resolveSymbol(const std::string &name) {
   return addr;
 }
 
-ExternalDispatcher::ExternalDispatcher(LLVMContext &ctx) {
+ExternalDispatcher::ExternalDispatcher(LLVMContext &ctx) : nativeModule(0) {
   dispatchModule = new Module("ExternalDispatcher", ctx);
 
   std::string error;
@@ -113,16 +128,23 @@ ExternalDispatcher::ExternalDispatcher(LLVMContext &ctx) {
   preboundFunctions["fprintf"] = (void*) (long) fprintf;
   preboundFunctions["sprintf"] = (void*) (long) sprintf;
 #endif
+
+  struct sigaction segvAction;
+  segvAction.sa_handler = 0;
+  memset(&segvAction.sa_mask, 0, sizeof(segvAction.sa_mask));
+  segvAction.sa_flags = SA_SIGINFO;
+  segvAction.sa_sigaction = ::sigsegv_handler;
+  sigaction(SIGSEGV, &segvAction, &segvActionOld);
 }
 
 ExternalDispatcher::~ExternalDispatcher() {
+  sigaction(SIGSEGV, &segvActionOld, 0);
   delete executionEngine;
 }
 
 bool ExternalDispatcher::executeCall(Function *f, Instruction *i, uint64_t *args) {
-  dispatchers_ty::iterator it = dispatchers.find(i);
-  Function *dispatcher;
-
+  std::pair<const Instruction*, Function*> key(i, f);
+  dispatchers_ty::iterator it = dispatchers.find(key);
   if (it == dispatchers.end()) {
 #ifdef WINDOWS
     std::map<std::string, void*>::iterator it2 = 
@@ -137,65 +159,140 @@ bool ExternalDispatcher::executeCall(Function *f, Instruction *i, uint64_t *args
     }
 #endif
 
-    dispatcher = createDispatcher(f,i);
+    it = dispatchers.insert(std::make_pair(key, createDispatcher(f, i))).first;
+  }
+
+  return runProtectedCall(it->second, args);
+}
 
-    dispatchers.insert(std::make_pair(i, dispatcher));
+void ExternalDispatcher::setNativeModule(
+    const Module *m, const std::map<const GlobalVariable*, void*> &globals) {
+  assert(!nativeModule && "native module already set");
+  ValueToValueMapTy vmap;
+  nativeModule = CloneModule(m, vmap);
+
+  for (std::map<const GlobalVariable*, void*>::const_iterator
+         it = globals.begin(), ie = globals.end(); it != ie; ++it)
+    executionEngine->addGlobalMapping(cast<GlobalValue>(vmap[it->first]),
+                                      it->second);
+  for (Module::const_iterator it = m->begin(), ie = m->end(); it != ie; ++it)
+    nativeFunctions[&*it] = cast<Function>(vmap[&*it]);
+  if (Function *f = nativeModule->getFunction("klee_report_error"))
+    executionEngine->addGlobalMapping(f, (void*) ::escape_native_call);
+
+  // The engine owns the module from now on.
+  executionEngine->addModule(nativeModule);
+}
 
-    if (dispatcher) {
-      // Force the JIT execution engine to go ahead and build the function. This
-      // ensures that any errors or assertions in the compilation process will
-      // trigger crashes instead of being caught as aborts in the external
-      // function.
-      executionEngine->recompileAndRelinkFunction(dispatcher);
-    }
-  } else {
-    dispatcher = it->second;
+bool ExternalDispatcher::executeNativeCall(Function *f, Instruction *i,
+                                           uint64_t *args) {
+  assert(nativeModule && "no native module");
+  assert(!f->isDeclaration() && "calling a declaration natively");
+  std::pair<const Instruction*, Function*> key(i, f);
+  dispatchers_ty::iterator it = dispatchers.find(key);
+  if (it == dispatchers.end()) {
+    Function *native = nativeFunctions[f];
+    Dispatcher d;
+    d.target = executionEngine->getPointerToFunction(native);
+    setCallingSequence(d, native, i);
+    it = dispatchers.insert(std::make_pair(key, d)).first;
   }
 
-  return runProtectedCall(dispatcher, args);
+  return runProtectedCall(it->second, args);
 }
 
-// FIXME: This is not reentrant.
-static uint64_t *gTheArgsP;
+bool ExternalDispatcher::runProtectedCall(const Dispatcher &d, uint64_t *args) {
+  if (!d.target)
+    return false;
 
-bool ExternalDispatcher::runProtectedCall(Function *f, uint64_t *args) {
-  struct sigaction segvAction, segvActionOld;
-  bool res;
-  
-  if (!f)
+  sigjmp_buf escape;
+  if (sigsetjmp(escape, 1)) {
+    escapeCallJmpBuf = 0;
     return false;
+  }
+  escapeCallJmpBuf = &escape;
+
+  switch (d.nativeCall) {
+  case DoubleToDouble: {
+    double a, r;
+    memcpy(&a, &args[2], sizeof a);
+    r = ((double (*)(double)) d.target)(a);
+    memcpy(args, &r, sizeof r);
+    break;
+  }
+  case DoubleDoubleToDouble: {
+    double a, b, r;
+    memcpy(&a, &args[2], sizeof a);
+    memcpy(&b, &args[3], sizeof b);
+    r = ((double (*)(double, double)) d.target)(a, b);
+    memcpy(args, &r, sizeof r);
+    break;
+  }
+  case FloatToFloat: {
+    float a, r;
+    memcpy(&a, &args[2], sizeof a);
+    r = ((float (*)(float)) d.target)(a);
+    memcpy(args, &r, sizeof r);
+    break;
+  }
+  case FloatFloatToFloat: {
+    float a, b, r;
+    memcpy(&a, &args[2], sizeof a);
+    memcpy(&b, &args[3], sizeof b);
+    r = ((float (*)(float, float)) d.target)(a, b);
+    memcpy(args, &r, sizeof r);
+    break;
+  }
+  case NoNativeCall:
+    d.trampoline(args, d.target);
+    break;
+  }
 
-  std::vector<GenericValue> gvArgs;
-  gTheArgsP = args;
+  escapeCallJmpBuf = 0;
+  return true;
+}
 
-  segvAction.sa_handler = 0;
-  memset(&segvAction.sa_mask, 0, sizeof(segvAction.sa_mask));
-  segvAction.sa_flags = SA_SIGINFO;
-  segvAction.sa_sigaction = ::sigsegv_handler;
-  sigaction(SIGSEGV, &segvAction, &segvActionOld);
+/// isFloatSignature - Whether all parameters and the result of a function
+/// type are of the floating point type \a ty.
+static bool isFloatSignature(LLVM_TYPE_Q FunctionType *FTy,
+                             LLVM_TYPE_Q Type *ty) {
+  for (unsigned i = 0, e = FTy->getNumParams(); i != e; ++i)
+    if (FTy->getParamType(i) != ty)
+      return false;
+  return FTy->getReturnType() == ty;
+}
 
-  if (setjmp(escapeCallJmpBuf)) {
-    res = false;
-  } else {
-    executionEngine->runFunction(f, gvArgs);
-    res = true;
-  }
+ExternalDispatcher::Dispatcher
+ExternalDispatcher::createDispatcher(Function *target, Instruction *inst) {
+  Dispatcher d;
+  d.target = 0;
+  d.trampoline = 0;
+  d.nativeCall = NoNativeCall;
+  if (!resolveSymbol(target->getName()))
+    return d;
 
-  sigaction(SIGSEGV, &segvActionOld, 0);
-  return res;
+  // Get the target function type.
+  LLVM_TYPE_Q FunctionType *FTy =
+    cast<FunctionType>(cast<PointerType>(target->getType())->getElementType());
+
+  // Let the JIT resolve the function, as it knows how to find some that are
+  // not exported by the C library.
+  Constant *decl =
+    dispatchModule->getOrInsertFunction(target->getName(), FTy,
+                                        target->getAttributes());
+  d.target = executionEngine->getPointerToFunction(
+      cast<Function>(decl->stripPointerCasts()));
+  setCallingSequence(d, target, inst);
+  return d;
 }
 
-// For performance purposes we construct the stub in such a way that the
-// arguments pointer is passed through the static global variable gTheArgsP in
-// this file. This is done so that the stub function prototype trivially matches
-// the special cases that the JIT knows how to directly call. If this is not
-// done, then the jit will end up generating a nullary stub just to call our
-// stub, for every single function call.
-Function *ExternalDispatcher::createDispatcher(Function *target, Instruction *inst) {
-  if (!resolveSymbol(target->getName()))
-    return 0;
+/// setCallingSequence - Choose how \a d calls \a target from \a inst: directly
+/// for the common floating point signatures, else through a trampoline.
+void ExternalDispatcher::setCallingSequence(Dispatcher &d, Function *target,
+                                            Instruction *inst) {
+  d.trampoline = 0;
+  d.nativeCall = NoNativeCall;
 
-  LLVMContext &ctx = target->getContext();
   CallSite cs;
   if (inst->getOpcode()==Instruction::Call) {
     cs = CallSite(cast<CallInst>(inst));
@@ -203,41 +300,73 @@ Function *ExternalDispatcher::createDispatcher(Function *target, Instruction *in
     cs = CallSite(cast<InvokeInst>(inst));
   }
 
-  Value **args = new Value*[cs.arg_size()];
-
-  std::vector<LLVM_TYPE_Q Type*> nullary;
-  
-  // MCJIT functions need unique names, or wrong function can be called
-  Function *dispatcher = Function::Create(FunctionType::get(Type::getVoidTy(ctx),
-							    nullary, false),
-					  GlobalVariable::ExternalLinkage, 
-					  "dispatcher_" + target->getName().str(),
-					  dispatchModule);
-
-
-  BasicBlock *dBB = BasicBlock::Create(ctx, "entry", dispatcher);
-
-  // Get a Value* for &gTheArgsP, as an i64**.
-  Instruction *argI64sp = 
-    new IntToPtrInst(ConstantInt::get(Type::getInt64Ty(ctx),
-                                      (uintptr_t) (void*) &gTheArgsP),
-                     PointerType::getUnqual(PointerType::getUnqual(Type::getInt64Ty(ctx))),
-                     "argsp", dBB);
-  Instruction *argI64s = new LoadInst(argI64sp, "args", dBB); 
-  
-  // Get the target function type.
   LLVM_TYPE_Q FunctionType *FTy =
     cast<FunctionType>(cast<PointerType>(target->getType())->getElementType());
 
-  // Each argument will be passed by writing it into gTheArgsP[i].
-  unsigned i = 0, idx = 2;
+  LLVMContext &ctx = target->getContext();
+  unsigned numArgs = cs.arg_size();
+  if (!FTy->isVarArg() && FTy->getNumParams() == numArgs &&
+      (numArgs == 1 || numArgs == 2) &&
+      target->getCallingConv() == CallingConv::C) {
+    if (isFloatSignature(FTy, Type::getDoubleTy(ctx)))
+      d.nativeCall = numArgs == 1 ? DoubleToDouble : DoubleDoubleToDouble;
+    else if (isFloatSignature(FTy, Type::getFloatTy(ctx)))
+      d.nativeCall = numArgs == 1 ? FloatToFloat : FloatFloatToFloat;
+    if (d.nativeCall != NoNativeCall)
+      return;
+  }
+
+  // Determine the types the arguments will be passed as. This accomodates
+  // for the corresponding code in Executor.cpp for handling calls to
+  // bitcasted functions.
+  std::vector<LLVM_TYPE_Q Type*> argTys;
+  unsigned i = 0;
   for (CallSite::arg_iterator ai = cs.arg_begin(), ae = cs.arg_end();
-       ai!=ae; ++ai, ++i) {
-    // Determine the type the argument will be passed as. This accomodates for
-    // the corresponding code in Executor.cpp for handling calls to bitcasted
-    // functions.
-    LLVM_TYPE_Q Type *argTy = (i < FTy->getNumParams() ? FTy->getParamType(i) : 
-                               (*ai)->getType());
+       ai!=ae; ++ai, ++i)
+    argTys.push_back(i < FTy->getNumParams() ? FTy->getParamType(i) : 
+                     (*ai)->getType());
+  d.trampoline = getTrampoline(target, FunctionType::get(Type::getVoidTy(ctx),
+                                                         argTys, false));
+}
+
+ExternalDispatcher::trampoline_ty
+ExternalDispatcher::getTrampoline(Function *target,
+                                  LLVM_TYPE_Q FunctionType *argTys) {
+  LLVM_TYPE_Q FunctionType *FTy =
+    cast<FunctionType>(cast<PointerType>(target->getType())->getElementType());
+  std::vector<Trampoline> &candidates =
+    trampolines[std::make_pair(FTy, argTys)];
+  for (std::vector<Trampoline>::iterator it = candidates.begin(),
+         ie = candidates.end(); it != ie; ++it)
+    if (it->prototype->getAttributes() == target->getAttributes() &&
+        it->prototype->getCallingConv() == target->getCallingConv())
+      return it->code;
+
+  LLVMContext &ctx = target->getContext();
+  LLVM_TYPE_Q Type *i64PtrTy = PointerType::getUnqual(Type::getInt64Ty(ctx));
+  std::vector<LLVM_TYPE_Q Type*> params;
+  params.push_back(i64PtrTy);
+  params.push_back(PointerType::getUnqual(Type::getInt8Ty(ctx)));
+
+  // MCJIT functions need unique names, or wrong function can be called
+  Function *trampoline =
+    Function::Create(FunctionType::get(Type::getVoidTy(ctx), params, false),
+                     GlobalVariable::ExternalLinkage,
+                     "trampoline_" + target->getName().str(), dispatchModule);
+  Function::arg_iterator params_it = trampoline->arg_begin();
+  Value *argI64s = &*params_it++;
+  Value *targetp = &*params_it;
+
+  BasicBlock *dBB = BasicBlock::Create(ctx, "entry", trampoline);
+  Instruction *callee = new BitCastInst(targetp, PointerType::getUnqual(FTy),
+                                        "", dBB);
+
+  // Each argument is passed by writing it into args[idx], from idx 2 on.
+  unsigned numArgs = argTys->getNumParams();
+  Value **args = new Value*[numArgs];
+  unsigned idx = 2;
+  for (unsigned i = 0; i != numArgs; ++i) {
+    LLVM_TYPE_Q Type *argTy = argTys->getParamType(i);
     Instruction *argI64p = 
       GetElementPtrInst::Create(argI64s, 
                                 ConstantInt::get(Type::getInt32Ty(ctx), idx),
@@ -251,16 +380,15 @@ Function *ExternalDispatcher::createDispatcher(Function *target, Instruction *in
     idx += ((!!argSize ? argSize : 64) + 63)/64;
   }
 
-  Constant *dispatchTarget =
-    dispatchModule->getOrInsertFunction(target->getName(), FTy,
-                                        target->getAttributes());
 #if LLVM_VERSION_CODE >= LLVM_VERSION(3, 0)
-  Instruction *result = CallInst::Create(dispatchTarget,
-                                         llvm::ArrayRef<Value *>(args, args+i),
-                                         "", dBB);
+  CallInst *result = CallInst::Create(callee,
+                                      llvm::ArrayRef<Value *>(args, args+numArgs),
+                                      "", dBB);
 #else
-  Instruction *result = CallInst::Create(dispatchTarget, args, args+i, "", dBB);
+  CallInst *result = CallInst::Create(callee, args, args+numArgs, "", dBB);
 #endif
+  result->setAttributes(target->getAttributes());
+  result->setCallingConv(target->getCallingConv());
   if (result->getType() != Type::getVoidTy(ctx)) {
     Instruction *resp = 
       new BitCastInst(argI64s, PointerType::getUnqual(result->getType()), 
@@ -272,5 +400,12 @@ Function *ExternalDispatcher::createDispatcher(Function *target, Instruction *in
 
   delete[] args;
 
-  return dispatcher;
+  // Build the trampoline now, so that any errors or assertions in the
+  // compilation process trigger crashes instead of being caught as aborts
+  // in the external function.
+  Trampoline t;
+  t.prototype = target;
+  t.code = (trampoline_ty) executionEngine->getPointerToFunction(trampoline);
+  candidates.push_back(t);
+  return t.code;
 }
@@ -12,6 +12,8 @@
 
 #include <map>
 #include <string>
+#include <utility>
+#include <vector>
 #include <stdint.h>
 
 namespace llvm {
@@ -20,31 +22,88 @@ namespace llvm {
   class LLVMContext;
   class Function;
   class FunctionType;
+  class GlobalVariable;
   class Module;
 }
 
 namespace klee {
   class ExternalDispatcher {
   private:
-    typedef std::map<const llvm::Instruction*,llvm::Function*> dispatchers_ty;
+    /// A trampoline calls the function at \a target, loading the arguments
+    /// from \a args as executeCall describes and storing the result.
+    typedef void (*trampoline_ty)(uint64_t *args, void *target);
+
+    /// Signatures of the functions called without a trampoline, such as most
+    /// of libm.
+    enum NativeCall {
+      NoNativeCall,
+      DoubleToDouble,
+      DoubleDoubleToDouble,
+      FloatToFloat,
+      FloatFloatToFloat
+    };
+
+    struct Trampoline {
+      /// A function the trampoline was made for, whose attributes it calls
+      /// with.
+      llvm::Function *prototype;
+      trampoline_ty code;
+    };
+
+    /// How a call site calls an external function.
+    struct Dispatcher {
+      /// The address of the function, or null if it cannot be resolved.
+      void *target;
+      trampoline_ty trampoline;
+      NativeCall nativeCall;
+    };
+
+    /// Trampolines by the type of the function and the types its arguments
+    /// are passed as, which differ for variadic and bitcast functions. Call
+    /// sites with the same signature share them.
+    typedef std::pair<llvm::FunctionType*, llvm::FunctionType*> signature_ty;
+    std::map<signature_ty, std::vector<Trampoline> > trampolines;
+
+    typedef std::map<std::pair<const llvm::Instruction*, llvm::Function*>,
+                     Dispatcher> dispatchers_ty;
     dispatchers_ty dispatchers;
     llvm::Module *dispatchModule;
+    /// A copy of the module under test for calling its functions natively,
+    /// so that compiling them leaves the interpreted code alone.
+    llvm::Module *nativeModule;
+    std::map<const llvm::Function*, llvm::Function*> nativeFunctions;
     llvm::ExecutionEngine *executionEngine;
     std::map<std::string, void*> preboundFunctions;
     
-    llvm::Function *createDispatcher(llvm::Function *f, llvm::Instruction *i);
-    bool runProtectedCall(llvm::Function *f, uint64_t *args);
+    Dispatcher createDispatcher(llvm::Function *f, llvm::Instruction *i);
+    void setCallingSequence(Dispatcher &d, llvm::Function *target,
+                            llvm::Instruction *inst);    trampoline_ty getTrampoline(llvm::Function *f, llvm::FunctionType *argTys);
+    bool runProtectedCall(const Dispatcher &d, uint64_t *args);
     
   public:
     ExternalDispatcher(llvm::LLVMContext &ctx);
     ~ExternalDispatcher();
 
     /* Call the given function using the parameter passing convention of
-     * ci with arguments in args[1], args[2], ... and writing the result
+     * ci with arguments in args[2], args[3], ... and writing the result
      * into args[0].
      */
     bool executeCall(llvm::Function *function, llvm::Instruction *i, uint64_t *args);
     void *resolveSymbol(const std::string &name);
+
+    /// Prepare calling the functions defined in \a m natively, with its
+    /// globals at the addresses in \a globals. Calls to klee_report_error
+    /// abandon the native call.
+    void setNativeModule(const llvm::Module *m,
+                         const std::map<const llvm::GlobalVariable*,
+                                        void*> &globals);
+    bool hasNativeModule() const { return nativeModule != 0; }
+
+    /// Call \a function of the module given to setNativeModule natively, as
+    /// executeCall does. Returns false if the call faulted or was abandoned,
+    /// in which case memory may be partially written.
+    bool executeNativeCall(llvm::Function *function, llvm::Instruction *i,
+                           uint64_t *args);
   };  
 }
 
@@ -0,0 +1,136 @@
+//===-- FloatConcretizationPolicy.cpp -------------------------------------===//
+//
+//                     The KLEE Symbolic Virtual Machine
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+
+#include "FloatConcretizationPolicy.h"
+
+#include "klee/util/ExprHashMap.h"
+
+#include <fstream>
+#include <sstream>
+#include <stdlib.h>
+
+using namespace klee;
+
+bool FloatConcretizationPolicy::load(const std::string &path,
+                                     std::string &error) {
+  std::ifstream f(path.c_str());
+  if (!f.good()) {
+    error = "unable to open " + path;
+    return false;
+  }
+
+  std::string line;
+  for (unsigned lineNo = 1; std::getline(f, line); ++lineNo) {
+    std::string::size_type comment = line.find('#');
+    if (comment != std::string::npos)
+      line.erase(comment);
+
+    std::istringstream fields(line);
+    std::string trigger, scope, size, extra;
+    if (!(fields >> trigger))
+      continue;
+
+    std::ostringstream where;
+    where << path << ":" << lineNo << ": ";
+    Rule rule;
+    if (trigger == "store") {
+      rule.trigger = Store;
+    } else if (trigger == "call") {
+      rule.trigger = Call;
+    } else if (trigger == "size") {
+      rule.trigger = Size;
+    } else {
+      error = where.str() + "unknown trigger '" + trigger + "'";
+      return false;
+    }
+
+    if (!(fields >> scope)) {
+      error = where.str() + "missing scope";
+      return false;
+    }
+    rule.size = 1;
+    if (fields >> size) {
+      char *end;
+      unsigned long value = strtoul(size.c_str(), &end, 10);
+      if (*end || !value) {
+        error = where.str() + "invalid size '" + size + "'";
+        return false;
+      }
+      rule.size = value;
+    } else if (rule.trigger == Size) {
+      error = where.str() + "size rules need a size";
+      return false;
+    }
+    if (fields >> extra) {
+      error = where.str() + "unexpected '" + extra + "'";
+      return false;
+    }
+
+    // A scope ending in ":<digits>" is a source location.
+    rule.line = 0;
+    std::string::size_type colon = scope.rfind(':');
+    if (rule.trigger != Call && colon != std::string::npos &&
+        colon + 1 < scope.size() &&
+        scope.find_first_not_of("0123456789", colon + 1) ==
+            std::string::npos) {
+      rule.line = strtoul(scope.c_str() + colon + 1, 0, 10);
+      scope.erase(colon);
+    }
+    rule.scope = scope;
+    rules.push_back(rule);
+  }
+  return true;
+}
+
+bool FloatConcretizationPolicy::matchesFile(const std::string &file,
+                                            const std::string &pattern) {
+  if (file.size() < pattern.size() ||
+      file.compare(file.size() - pattern.size(), pattern.size(), pattern))
+    return false;
+  return file.size() == pattern.size() ||
+         file[file.size() - pattern.size() - 1] == '/';
+}
+
+unsigned FloatConcretizationPolicy::getThreshold(Trigger trigger,
+                                                 const std::string &name,
+                                                 const std::string &file,
+                                                 unsigned line) const {
+  unsigned threshold = 0;
+  for (std::vector<Rule>::const_iterator it = rules.begin(),
+         ie = rules.end(); it != ie; ++it) {
+    if (it->trigger != trigger)
+      continue;
+    bool matches;
+    if (it->scope == "*")
+      matches = true;
+    else if (it->line)
+      matches = it->line == line && matchesFile(file, it->scope);
+    else
+      matches = it->scope == name ||
+                (trigger != Call && matchesFile(file, it->scope));
+    if (matches && (!threshold || it->size < threshold))
+      threshold = it->size;
+  }
+  return threshold;
+}
+
+unsigned FloatConcretizationPolicy::countNodes(const ref<Expr> &e,
+                                               unsigned limit) {
+  ExprHashSet visited;
+  std::vector<ref<Expr> > stack(1, e);
+  while (!stack.empty() && visited.size() < limit) {
+    ref<Expr> top = stack.back();
+    stack.pop_back();
+    if (!visited.insert(top).second)
+      continue;
+    for (unsigned i = 0, n = top->getNumKids(); i != n; ++i)
+      stack.push_back(top->getKid(i));
+  }
+  return visited.size();
+}
@@ -0,0 +1,79 @@
+//===-- FloatConcretizationPolicy.h -----------------------------*- C++ -*-===//
+//
+//                     The KLEE Symbolic Virtual Machine
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+
+#ifndef KLEE_FLOATCONCRETIZATIONPOLICY_H
+#define KLEE_FLOATCONCRETIZATIONPOLICY_H
+
+#include "klee/Expr.h"
+
+#include <string>
+#include <vector>
+
+namespace klee {
+
+  /// FloatConcretizationPolicy - Where symbolic floating point values are
+  /// traded for one of their concrete values, so that costly chains of
+  /// operations stop growing before they reach the solver.
+  ///
+  /// The policy is read from a file of rules, one per line, with '#'
+  /// starting a comment:
+  ///
+  ///   store <scope> [size]   - values stored to memory in \c scope
+  ///   call <callee> [size]   - arguments passed to the function \c callee
+  ///   size <scope> <size>    - values computed in \c scope
+  ///
+  /// A scope is a function name, a source location "file:line", a source
+  /// file, or "*" for anywhere; files match on their last path components.
+  /// A callee is a function name or "*". A rule applies to values of at
+  /// least \c size expression nodes, or to every symbolic value when the
+  /// size is left out.
+  class FloatConcretizationPolicy {
+  public:
+    enum Trigger {
+      Store,
+      Call,
+      Size
+    };
+
+  private:
+    struct Rule {
+      Trigger trigger;
+      std::string scope;
+      unsigned line;
+      unsigned size;
+    };
+
+    std::vector<Rule> rules;
+
+  public:
+    /// matchesFile - Whether \a pattern is \a file or its last path
+    /// components.
+    static bool matchesFile(const std::string &file,
+                            const std::string &pattern);
+
+    /// load - Add the rules of the policy file \a path, returning false and
+    /// setting \a error if it cannot be read or parsed.
+    bool load(const std::string &path, std::string &error);
+
+    bool empty() const { return rules.empty(); }
+
+    /// getThreshold - The smallest size of the values concretized by \a
+    /// trigger for \a name (the function executing, or the callee for
+    /// calls) at \a file and \a line, or 0 if no rule applies.
+    unsigned getThreshold(Trigger trigger, const std::string &name,
+                          const std::string &file, unsigned line) const;
+
+    /// countNodes - The number of distinct expressions making up \a e,
+    /// counting no further than \a limit.
+    static unsigned countNodes(const ref<Expr> &e, unsigned limit);
+  };
+
+}
+
+#endif
@@ -0,0 +1,131 @@
+//===-- FloatCoverage.cpp -------------------------------------------------===//
+//
+//                     The KLEE Symbolic Virtual Machine
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+
+#include "FloatCoverage.h"
+
+#include "klee/Config/Version.h"
+#include "klee/Internal/Module/InstructionInfoTable.h"
+#include "klee/Internal/Module/KInstruction.h"
+#include "klee/Internal/Module/KModule.h"
+
+#if LLVM_VERSION_CODE >= LLVM_VERSION(3, 3)
+#include "llvm/IR/Function.h"
+#include "llvm/IR/Instruction.h"
+#else
+#include "llvm/Function.h"
+#include "llvm/Instruction.h"
+#endif
+#include "llvm/ADT/APFloat.h"
+#include "llvm/Support/raw_ostream.h"
+
+#include <cmath>
+
+using namespace llvm;
+using namespace klee;
+
+bool FloatCoverage::isTracked(const KInstruction *ki) {
+  if (ki->isVector)
+    return false;
+  switch (ki->opcode) {
+  case Instruction::FAdd:
+  case Instruction::FSub:
+  case Instruction::FMul:
+  case Instruction::FDiv:
+  case Instruction::FRem:
+  case Instruction::FPTrunc:
+  case Instruction::FPExt:
+  case Instruction::UIToFP:
+  case Instruction::SIToFP:
+    return true;
+  default:
+    return false;
+  }
+}
+
+FloatCoverage::Class FloatCoverage::classify(const APFloat &v) {
+  if (v.isNaN())
+    return NaN;
+  if (v.isInfinity())
+    return v.isNegative() ? NegInf : PosInf;
+  if (v.isZero())
+    return v.isNegative() ? NegZero : PosZero;
+  if (v.isDenormal())
+    return Subnormal;
+  return Normal;
+}
+
+ref<Expr> FloatCoverage::getCondition(const ref<Expr> &e, Class c) {
+  int fpClass;
+  switch (c) {
+  case NaN: fpClass = FP_NAN; break;
+  case PosInf: case NegInf: fpClass = FP_INFINITE; break;
+  case PosZero: case NegZero: fpClass = FP_ZERO; break;
+  case Subnormal: fpClass = FP_SUBNORMAL; break;
+  default: fpClass = FP_NORMAL; break;
+  }
+  ref<Expr> cond =
+    EqExpr::create(FpClassifyExpr::create(e),
+                   ConstantExpr::alloc(fpClass, sizeof(int) * 8));
+  if (c != PosInf && c != NegInf && c != PosZero && c != NegZero)
+    return cond;
+
+  // Tell the signs apart by the sign bit, as -0 and +0 compare equal.
+  Expr::Width w = e->getWidth();
+  ref<Expr> sign = ExtractExpr::create(ExplicitIntExpr::create(e, w), w - 1,
+                                       Expr::Bool);
+  if (c == PosInf || c == PosZero)
+    sign = Expr::createIsZero(sign);
+  return AndExpr::create(cond, sign);
+}
+
+const char *FloatCoverage::getName(Class c) {
+  switch (c) {
+  case NaN: return "nan";
+  case PosInf: return "+inf";
+  case NegInf: return "-inf";
+  case PosZero: return "+0";
+  case NegZero: return "-0";
+  case Subnormal: return "subnormal";
+  default: return "normal";
+  }
+}
+
+unsigned FloatCoverage::getSeen(const KInstruction *ki) const {
+  unsigned id = ki->info->id;
+  return id < seen.size() ? seen[id] : 0;
+}
+
+unsigned FloatCoverage::mark(const KInstruction *ki, unsigned mask) {
+  unsigned id = ki->info->id;
+  if (id >= seen.size())
+    return 0;
+  unsigned added = mask & ~seen[id];
+  seen[id] |= added;
+  return added;
+}
+
+void FloatCoverage::write(raw_ostream &os, const KModule &kmodule) const {
+  for (std::vector<KFunction*>::const_iterator it = kmodule.functions.begin(),
+         ie = kmodule.functions.end(); it != ie; ++it) {
+    KFunction *kf = *it;
+    for (unsigned i = 0; i != kf->numInstructions; ++i) {
+      KInstruction *ki = kf->instructions[i];
+      if (!isTracked(ki))
+        continue;
+      unsigned mask = getSeen(ki);
+      os << ki->info->file << ":" << ki->info->line << " "
+         << ki->inst->getOpcodeName() << " " << kf->function->getName()
+         << ":";
+      for (unsigned c = 1; c != (1 << NumClasses); c <<= 1)
+        if (mask & c)
+          os << " " << getName((Class) c);
+      os << "\n";
+    }
+  }
+}
@@ -0,0 +1,83 @@
+//===-- FloatCoverage.h -----------------------------------------*- C++ -*-===//
+//
+//                     The KLEE Symbolic Virtual Machine
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+
+#ifndef KLEE_FLOATCOVERAGE_H
+#define KLEE_FLOATCOVERAGE_H
+
+#include "klee/Expr.h"
+
+#include <stdint.h>
+#include <vector>
+
+namespace llvm {
+  class APFloat;
+  class raw_ostream;
+}
+
+namespace klee {
+  class KModule;
+  struct KInstruction;
+
+  /// FloatCoverage - Which IEEE classes the result of each floating point
+  /// operation was seen in, either concretely or, for symbolic results, as
+  /// proven feasible by the solver. Operations with classes left to cover
+  /// are what nurs:fpcov steers towards.
+  class FloatCoverage {
+  public:
+    enum Class {
+      NaN = 1 << 0,
+      PosInf = 1 << 1,
+      NegInf = 1 << 2,
+      PosZero = 1 << 3,
+      NegZero = 1 << 4,
+      Subnormal = 1 << 5,
+      Normal = 1 << 6,
+      NumClasses = 7,
+      AllClasses = (1 << NumClasses) - 1
+    };
+
+  private:
+    /// The classes seen, by instruction id.
+    std::vector<uint8_t> seen;
+
+  public:
+    explicit FloatCoverage(unsigned numInstructions)
+      : seen(numInstructions, 0) {}
+
+    /// isTracked - Whether the result of \a ki is covered by class, which
+    /// holds for scalar floating point arithmetic and conversions to
+    /// floating point.
+    static bool isTracked(const KInstruction *ki);
+
+    /// classify - The class of \a v.
+    static Class classify(const llvm::APFloat &v);
+
+    /// getCondition - The condition for the floating point value \a e to be
+    /// of class \a c.
+    static ref<Expr> getCondition(const ref<Expr> &e, Class c);
+
+    static const char *getName(Class c);
+
+    unsigned getSeen(const KInstruction *ki) const;
+    unsigned getUnseen(const KInstruction *ki) const {
+      return AllClasses & ~getSeen(ki);
+    }
+
+    /// mark - Record the classes of \a mask as seen at \a ki, returning
+    /// those that were not before.
+    unsigned mark(const KInstruction *ki, unsigned mask);
+
+    /// write - Print the classes seen at each tracked instruction of \a
+    /// kmodule, one instruction per line.
+    void write(llvm::raw_ostream &os, const KModule &kmodule) const;
+  };
+
+}
+
+#endif
@@ -0,0 +1,145 @@
+//===-- ForkController.cpp ------------------------------------------------===//
+//
+//                     The KLEE Symbolic Virtual Machine
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+
+#include "ForkController.h"
+
+#include "klee/Config/Version.h"
+#include "klee/Internal/Module/InstructionInfoTable.h"
+#include "klee/Internal/Module/KInstruction.h"
+#include "klee/Internal/Module/KModule.h"
+
+#if LLVM_VERSION_CODE >= LLVM_VERSION(3, 3)
+#include "llvm/IR/Function.h"
+#else
+#include "llvm/Function.h"
+#endif
+#include "llvm/Support/raw_ostream.h"
+
+#include <algorithm>
+
+using namespace llvm;
+using namespace klee;
+
+/// The samples a branch needs of both its costs and what it gave before
+/// it is judged.
+static const unsigned MinSamples = 8;
+
+/// The least solver time a fork is taken to cost, so that branches whose
+/// queries the caches answer still compare.
+static const double MinSolverTime = 1e-3;
+
+/// The fraction of the average yield below which a branch is unproductive.
+static const double LowYield = 0.25;
+
+/// The memory pressure, and the share of the running states forked at a
+/// branch, from which an unproductive branch is concretized.
+static const double HighPressure = 0.75;
+static const double CrowdingShare = 0.25;
+
+static const char *const decisionNames[] = { "fork", "concretize", "defer" };
+
+ForkController::ForkController(unsigned numInstructions, double _rate)
+  : sites(numInstructions), rate(_rate), solverTime(0), coverage(0),
+    solverSamples(0), coverageSamples(0), liveStates(0) {
+  for (unsigned i = 0; i != NumDecisions; ++i) {
+    decisionCoverage[i] = 0;
+    decisionSolverTime[i] = 0;
+  }
+}
+
+void ForkController::update(double &average, unsigned &samples,
+                            double value) const {
+  // The first samples are averaged plainly, so that the average does not
+  // start out biased towards zero.
+  ++samples;
+  double weight = std::max(rate, 1. / samples);
+  average += weight * (value - average);
+}
+
+ForkController::Decision ForkController::decide(const KInstruction *ki,
+                                                double pressure) {
+  Site &site = sites[ki->info->id];
+  if (site.solverSamples < MinSamples || site.coverageSamples < MinSamples)
+    return Fork;
+
+  double siteYield = site.coverage / std::max(site.solverTime, MinSolverTime);
+  double yield = coverage / std::max(solverTime, MinSolverTime);
+  if (siteYield >= LowYield * yield)
+    return Fork;
+
+  if (pressure >= HighPressure || site.liveStates > CrowdingShare * liveStates)
+    return Concretize;
+  return Defer;
+}
+
+void ForkController::recordDecision(const KInstruction *ki, Decision decision,
+                                    double seconds, unsigned states) {
+  Site &site = sites[ki->info->id];
+  ++site.decisions[decision];
+  site.liveStates += states;
+  liveStates += states;
+  decisionSolverTime[decision] += seconds;
+
+  // Deferred queries are paid for later, by whichever side runs first.
+  if (decision != Defer) {
+    update(site.solverTime, site.solverSamples, seconds);
+    update(solverTime, solverSamples, seconds);
+  }
+}
+
+void ForkController::recordCoverage(unsigned id, Decision decision,
+                                    uint64_t instructions) {
+  Site &site = sites[id];
+  if (site.liveStates) {
+    --site.liveStates;
+    --liveStates;
+  }
+  decisionCoverage[decision] += instructions;
+  update(site.coverage, site.coverageSamples, instructions);
+  update(coverage, coverageSamples, instructions);
+}
+
+uint64_t ForkController::getDecisions(Decision decision) const {
+  uint64_t total = 0;
+  for (std::vector<Site>::const_iterator it = sites.begin(),
+         ie = sites.end(); it != ie; ++it)
+    total += it->decisions[decision];
+  return total;
+}
+
+void ForkController::write(raw_ostream &os, const KModule &kmodule) const {
+  for (std::vector<KFunction*>::const_iterator it = kmodule.functions.begin(),
+         ie = kmodule.functions.end(); it != ie; ++it) {
+    KFunction *kf = *it;
+    for (unsigned i = 0; i != kf->numInstructions; ++i) {
+      KInstruction *ki = kf->instructions[i];
+      const Site &site = sites[ki->info->id];
+      if (!site.solverSamples && !site.decisions[Defer])
+        continue;
+      os << ki->info->file << ":" << ki->info->line << " "
+         << kf->function->getName() << ":";
+      for (unsigned d = 0; d != NumDecisions; ++d)
+        os << " " << decisionNames[d] << "=" << site.decisions[d];
+      os << " solver-time=" << site.solverTime
+         << " coverage=" << site.coverage << "\n";
+    }
+  }
+
+  // The instructions covered first per second of solver time each kind of
+  // decision took.
+  for (unsigned d = 0; d != NumDecisions; ++d) {
+    os << "total " << decisionNames[d] << ": " << getDecisions((Decision) d)
+       << " decisions, " << decisionCoverage[d] << " instructions covered, "
+       << decisionSolverTime[d] << "s solver time";
+    if (decisionSolverTime[d] > 0)
+      os << ", " << decisionCoverage[d] / decisionSolverTime[d]
+         << " instructions/s";
+    os << "\n";
+  }
+}
@@ -0,0 +1,102 @@
+//===-- ForkController.h ----------------------------------------*- C++ -*-===//
+//
+//                     The KLEE Symbolic Virtual Machine
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+
+#ifndef KLEE_FORKCONTROLLER_H
+#define KLEE_FORKCONTROLLER_H
+
+#include <stdint.h>
+#include <vector>
+
+namespace llvm {
+  class raw_ostream;
+}
+
+namespace klee {
+  class KModule;
+  struct KInstruction;
+
+  /// ForkController - Decide for each symbolic branch whether to fork, to
+  /// take one side by concretizing the condition from a model, or to defer
+  /// the query to a lazy fork, from what forking at the branch cost and
+  /// gave so far.
+  ///
+  /// Each branch keeps exponentially decayed averages of the solver time
+  /// its forks took and of the instructions the states it forked covered
+  /// first, and counts the states it forked that are still running. A
+  /// branch whose states cover less per solver second than a fraction of
+  /// the average over all branches is unproductive: its queries are
+  /// deferred, or, under memory pressure or when its states crowd the
+  /// others out, its conditions concretized.
+  class ForkController {
+  public:
+    enum Decision { Fork, Concretize, Defer, NumDecisions };
+
+  private:
+    struct Site {
+      /// Decayed solver seconds per fork, and instructions first covered
+      /// per fork, and the samples taken of each.
+      double solverTime, coverage;
+      unsigned solverSamples, coverageSamples;
+      /// The states forked here that are still running.
+      unsigned liveStates;
+      /// The decisions taken here.
+      uint64_t decisions[NumDecisions];
+
+      Site()
+        : solverTime(0), coverage(0), solverSamples(0), coverageSamples(0),
+          liveStates(0) {
+        for (unsigned i = 0; i != NumDecisions; ++i)
+          decisions[i] = 0;
+      }
+    };
+
+    /// The sites, by instruction id.
+    std::vector<Site> sites;
+    /// The weight of the latest sample in the decayed averages.
+    double rate;
+    /// The decayed averages over all sites, and the running states forked
+    /// at any.
+    double solverTime, coverage;
+    unsigned solverSamples, coverageSamples;
+    unsigned liveStates;
+    /// Instructions first covered by the states after each decision, and
+    /// the solver time the decisions took.
+    uint64_t decisionCoverage[NumDecisions];
+    double decisionSolverTime[NumDecisions];
+
+    void update(double &average, unsigned &samples, double value) const;
+
+  public:
+    ForkController(unsigned numInstructions, double rate);
+
+    /// decide - What to do at the symbolic branch \a ki, with \a pressure
+    /// the memory in use as a fraction of the limit.
+    Decision decide(const KInstruction *ki, double pressure);
+
+    /// recordDecision - Learn that \a decision at \a ki took \a seconds of
+    /// solver time and started \a states new states.
+    void recordDecision(const KInstruction *ki, Decision decision,
+                        double seconds, unsigned states);
+
+    /// recordCoverage - Learn that a state started by \a decision at the
+    /// instruction with id \a site covered \a instructions first before it
+    /// forked again or ended.
+    void recordCoverage(unsigned site, Decision decision,
+                        uint64_t instructions);
+
+    /// getDecisions - The decisions of each kind taken so far.
+    uint64_t getDecisions(Decision decision) const;
+
+    /// write - Print the decisions taken at each branch of \a kmodule, their
+    /// costs and the coverage they led to, and the totals per decision.
+    void write(llvm::raw_ostream &os, const KModule &kmodule) const;
+  };
+}
+
+#endif
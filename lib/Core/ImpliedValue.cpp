@@ -23,6 +23,12 @@
 
 using namespace klee;
 
+/// Whether every bit pattern of floats of the given width is a distinct
+/// value, unlike long doubles with their explicit integer bit.
+static bool isExactFloatWidth(Expr::Width w) {
+  return w == Expr::Fl32 || w == Expr::Fl64;
+}
+
 // XXX we really want to do some sort of canonicalization of exprs
 // globally so that cases below become simpler
 void ImpliedValue::getImpliedValues(ref<Expr> e,
@@ -97,6 +103,35 @@ void ImpliedValue::getImpliedValues(ref<Expr> e,
     break;
   }
 
+  case Expr::ExplicitInt: {
+    CastExpr *ce = cast<CastExpr>(e);
+    if (isExactFloatWidth(ce->src->getWidth()) &&
+        ce->src->getWidth() == ce->getWidth())
+      getImpliedFloatValues(ce->src, value->ExplicitFloat(ce->getWidth()),
+                            results);
+    break;
+  }
+
+    // Floating-point special functions
+
+  case Expr::FIsNan: {
+    // Known only through a select of a NaN and a number. The result is an
+    // int, not a bool.
+    ref<Expr> kid = e->getKid(0);
+    if (FSelectExpr *se = dyn_cast<FSelectExpr>(kid)) {
+      FConstantExpr *TrueCE = dyn_cast<FConstantExpr>(se->trueExpr);
+      FConstantExpr *FalseCE = dyn_cast<FConstantExpr>(se->falseExpr);
+      if (TrueCE && FalseCE &&
+          TrueCE->getAPValue().isNaN() != FalseCE->getAPValue().isNaN())
+        getImpliedValues(se->cond,
+                         ConstantExpr::alloc(!value->isZero() ==
+                                             TrueCE->getAPValue().isNaN(),
+                                             Expr::Bool),
+                         results);
+    }
+    break;
+  }
+
     // Arithmetic
 
   case Expr::Add: { // constants on left
@@ -180,12 +215,83 @@ void ImpliedValue::getImpliedValues(ref<Expr> e,
     }
     break;
   }
+
+    // Floating-point comparison
+  case Expr::FUne:
+    value = value->Not();
+    /* fallthru */
+  case Expr::FOeq: {
+    // Zeros of either sign and NaNs compare equal to (or unordered with)
+    // more than one bit pattern, any other number only to itself.
+    if (value->isTrue()) {
+      BinaryExpr *be = cast<BinaryExpr>(e);
+      ref<Expr> other = be->right;
+      FConstantExpr *CE = dyn_cast<FConstantExpr>(be->left);
+      if (!CE) {
+        other = be->left;
+        CE = dyn_cast<FConstantExpr>(be->right);
+      }
+      if (CE && isExactFloatWidth(CE->getWidth()) &&
+          !CE->getAPValue().isNaN() && !CE->isZero())
+        getImpliedFloatValues(other, CE, results);
+    }
+    break;
+  }
     
   default:
     break;
   }
 }
     
+void ImpliedValue::getImpliedFloatValues(ref<Expr> e,
+                                         ref<FConstantExpr> value,
+                                         ImpliedValueList &results) {
+  switch (e->getKind()) {
+  case Expr::FSelect: {
+    FSelectExpr *se = cast<FSelectExpr>(e);
+
+    if (FConstantExpr *TrueCE = dyn_cast<FConstantExpr>(se->trueExpr)) {
+      if (FConstantExpr *FalseCE = dyn_cast<FConstantExpr>(se->falseExpr)) {
+        const llvm::APFloat &v = value->getAPValue();
+        if (!TrueCE->getAPValue().bitwiseIsEqual(FalseCE->getAPValue())) {
+          if (v.bitwiseIsEqual(TrueCE->getAPValue()))
+            getImpliedValues(se->cond, ConstantExpr::alloc(1, Expr::Bool),
+                             results);
+          else if (v.bitwiseIsEqual(FalseCE->getAPValue()))
+            getImpliedValues(se->cond, ConstantExpr::alloc(0, Expr::Bool),
+                             results);
+        }
+      }
+    }
+    break;
+  }
+
+  case Expr::FExt: {
+    // Only a widening conversion of a number is one to one.
+    FExtExpr *fe = cast<FExtExpr>(e);
+    Expr::Width w = fe->src->getWidth();
+    if (w >= fe->getWidth() || value->getAPValue().isNaN())
+      break;
+    ref<FConstantExpr> src = value->FExt(w, llvm::APFloat::rmNearestTiesToEven);
+    if (src->FExt(fe->getWidth(), llvm::APFloat::rmNearestTiesToEven)
+          ->getAPValue().bitwiseIsEqual(value->getAPValue()))
+      getImpliedFloatValues(fe->src, src, results);
+    break;
+  }
+
+  case Expr::ExplicitFloat: {
+    FCastExpr *ce = cast<FCastExpr>(e);
+    if (isExactFloatWidth(ce->getWidth()) &&
+        ce->src->getWidth() == ce->getWidth())
+      getImpliedValues(ce->src, value->ExplicitInt(ce->getWidth()), results);
+    break;
+  }
+
+  default:
+    break;
+  }
+}
+
 void ImpliedValue::checkForImpliedValues(Solver *S, ref<Expr> e, 
                                          ref<ConstantExpr> value) {
   std::vector<ref<ReadExpr> > reads;
@@ -23,6 +23,7 @@
 namespace klee {
   class ConstantExpr;
   class Expr;
+  class FConstantExpr;
   class ReadExpr;
   class Solver;
 
@@ -32,6 +33,10 @@ namespace klee {
   namespace ImpliedValue {        
     void getImpliedValues(ref<Expr> e, ref<ConstantExpr> cvalue, 
                           ImpliedValueList &result);
+    /// getImpliedFloatValues - As getImpliedValues, for a float expression
+    /// known to have the bit pattern of \a fvalue.
+    void getImpliedFloatValues(ref<Expr> e, ref<FConstantExpr> fvalue,
+                               ImpliedValueList &result);
     void checkForImpliedValues(Solver *S, ref<Expr> e, 
                                ref<ConstantExpr> cvalue);    
   }
@@ -14,6 +14,7 @@
 #include "klee/Solver.h"
 #include "klee/util/BitArray.h"
 #include "klee/Internal/Support/ErrorHandling.h"
+#include "klee/Internal/System/MemoryUsage.h"
 #include "klee/util/ArrayCache.h"
 
 #include "ObjectHolder.h"
@@ -32,7 +33,12 @@
 #include "llvm/Support/CommandLine.h"
 #include "llvm/Support/raw_ostream.h"
 
+#include <algorithm>
 #include <cassert>
+#include <cstddef>
+#include <cstring>
+#include <new>
+#include <set>
 #include <sstream>
 
 using namespace llvm;
@@ -42,10 +48,148 @@ namespace {
   cl::opt<bool>
   UseConstantArrays("use-constant-arrays",
                     cl::init(true));
+
+  cl::opt<unsigned>
+  UpdateListCompactionSize("update-list-compaction-size",
+                           cl::desc("Compact the update list of an object "
+                                    "once this many updates were added to it "
+                                    "since it was last compacted. 0 never "
+                                    "compacts (default=256)"),
+                           cl::init(256));
+
+  /// PayloadPool - Allocates small blocks in power of two size classes,
+  /// carved from large slabs and recycled through per-class free lists, so
+  /// that the memory objects, object states and contents created for every
+  /// alloca do not each cost a malloc and a free. Larger blocks go to the
+  /// heap.
+  class PayloadPool {
+    static const unsigned MinShift = 3, MaxShift = 12;
+    static const size_t SlabSize = 256 * 1024;
+
+    struct FreeBlock {
+      FreeBlock *next;
+    };
+
+    FreeBlock *freeLists[MaxShift - MinShift + 1];
+    char *slab, *slabEnd;
+
+    static unsigned sizeClass(size_t size) {
+      unsigned c = 0;
+      while (((size_t) 1 << (c + MinShift)) < size)
+        ++c;
+      return c;
+    }
+
+  public:
+    PayloadPool() : slab(0), slabEnd(0) {
+      memset(freeLists, 0, sizeof(freeLists));
+    }
+
+    void *allocate(size_t size) {
+      util::CountMemory(util::ObjectStateMemory, size);
+      if (size > ((size_t) 1 << MaxShift))
+        return ::operator new(size);
+
+      unsigned c = sizeClass(size);
+      if (FreeBlock *b = freeLists[c]) {
+        freeLists[c] = b->next;
+        return b;
+      }
+
+      size_t blockSize = (size_t) 1 << (c + MinShift);
+      if ((size_t) (slabEnd - slab) < blockSize) {
+        // The rest of the old slab is too small for this class, so hand it
+        // out to the smaller ones.
+        for (unsigned s = c; s-- > 0;) {
+          size_t n = (size_t) 1 << (s + MinShift);
+          while ((size_t) (slabEnd - slab) >= n) {
+            FreeBlock *b = reinterpret_cast<FreeBlock *>(slab);
+            b->next = freeLists[s];
+            freeLists[s] = b;
+            slab += n;
+          }
+        }
+        slab = static_cast<char *>(::operator new(SlabSize));
+        slabEnd = slab + SlabSize;
+      }
+      void *res = slab;
+      slab += blockSize;
+      return res;
+    }
+
+    void deallocate(void *p, size_t size) {
+      if (!p)
+        return;
+      util::UncountMemory(util::ObjectStateMemory, size);
+      if (size > ((size_t) 1 << MaxShift)) {
+        ::operator delete(p);
+        return;
+      }
+
+      unsigned c = sizeClass(size);
+      FreeBlock *b = static_cast<FreeBlock *>(p);
+      b->next = freeLists[c];
+      freeLists[c] = b;
+    }
+  };
+
+  /// Never freed: object states held by globals may be destroyed late.
+  PayloadPool &getPayloadPool() {
+    static PayloadPool *pool = new PayloadPool();
+    return *pool;
+  }
+
+  size_t chunkAllocationSize(unsigned bytes) {
+    return offsetof(ConcreteChunk, data) + bytes;
+  }
+
+  ConcreteChunk *allocateChunk(unsigned bytes) {
+    ConcreteChunk *res = static_cast<ConcreteChunk *>(
+        getPayloadPool().allocate(chunkAllocationSize(bytes)));
+    res->refCount = 1;
+    return res;
+  }
+
+  void releaseChunk(ConcreteChunk *chunk, unsigned bytes) {
+    if (--chunk->refCount == 0)
+      getPayloadPool().deallocate(chunk, chunkAllocationSize(bytes));
+  }
+
+  ref<Expr> *allocateKnownSymbolics(unsigned size) {
+    ref<Expr> *res = static_cast<ref<Expr> *>(
+        getPayloadPool().allocate(size * sizeof(ref<Expr>)));
+    for (unsigned i = 0; i < size; i++)
+      new (&res[i]) ref<Expr>();
+    return res;
+  }
+
+  void freeKnownSymbolics(ref<Expr> *knownSymbolics, unsigned size) {
+    if (!knownSymbolics)
+      return;
+    for (unsigned i = 0; i < size; i++)
+      knownSymbolics[i].~ref<Expr>();
+    getPayloadPool().deallocate(knownSymbolics, size * sizeof(ref<Expr>));
+  }
 }
 
 /***/
 
+void *MemoryObject::operator new(size_t size) {
+  return getPayloadPool().allocate(size);
+}
+
+void MemoryObject::operator delete(void *p, size_t size) {
+  getPayloadPool().deallocate(p, size);
+}
+
+void *ObjectState::operator new(size_t size) {
+  return getPayloadPool().allocate(size);
+}
+
+void ObjectState::operator delete(void *p, size_t size) {
+  getPayloadPool().deallocate(p, size);
+}
+
 ObjectHolder::ObjectHolder(const ObjectHolder &b) : os(b.os) { 
   if (os) ++os->refCount; 
 }
@@ -68,6 +212,7 @@ ObjectHolder &ObjectHolder::operator=(const ObjectHolder &b) {
 /***/
 
 int MemoryObject::counter = 0;
+uint64_t ObjectState::lastGeneration = 0;
 
 MemoryObject::~MemoryObject() {
   if (parent)
@@ -102,11 +247,15 @@ ObjectState::ObjectState(const MemoryObject *mo)
   : copyOnWriteOwner(0),
     refCount(0),
     object(mo),
-    concreteStore(new uint8_t[mo->size]),
+    concreteChunks(0),
+    singleChunk(0),
     concreteMask(0),
     flushMask(0),
     knownSymbolics(0),
     updates(0, 0),
+    knownFloats(0),
+    compactedUpdates(0),
+    generation(0),
     size(mo->size),
     readOnly(false) {
   mo->refCount++;
@@ -116,7 +265,7 @@ ObjectState::ObjectState(const MemoryObject *mo)
         getArrayCache()->CreateArray("tmp_arr" + llvm::utostr(++id), size);
     updates = UpdateList(array, 0);
   }
-  memset(concreteStore, 0, size);
+  allocateZeroChunks();
 }
 
 
@@ -124,27 +273,36 @@ ObjectState::ObjectState(const MemoryObject *mo, const Array *array)
   : copyOnWriteOwner(0),
     refCount(0),
     object(mo),
-    concreteStore(new uint8_t[mo->size]),
+    concreteChunks(0),
+    singleChunk(0),
     concreteMask(0),
     flushMask(0),
     knownSymbolics(0),
     updates(array, 0),
+    knownFloats(0),
+    compactedUpdates(0),
+    generation(0),
     size(mo->size),
     readOnly(false) {
   mo->refCount++;
+  allocateZeroChunks();
   makeSymbolic();
-  memset(concreteStore, 0, size);
 }
 
 ObjectState::ObjectState(const ObjectState &os) 
   : copyOnWriteOwner(0),
     refCount(0),
     object(os.object),
-    concreteStore(new uint8_t[os.size]),
+    concreteChunks(0),
+    singleChunk(0),
     concreteMask(os.concreteMask ? new BitArray(*os.concreteMask, os.size) : 0),
     flushMask(os.flushMask ? new BitArray(*os.flushMask, os.size) : 0),
     knownSymbolics(0),
     updates(os.updates),
+    knownFloats(os.knownFloats ?
+                new std::map<unsigned, ref<Expr> >(*os.knownFloats) : 0),
+    compactedUpdates(os.compactedUpdates),
+    generation(os.generation),
     size(os.size),
     readOnly(false) {
   assert(!os.readOnly && "no need to copy read only object?");
@@ -152,19 +310,28 @@ ObjectState::ObjectState(const ObjectState &os)
     object->refCount++;
 
   if (os.knownSymbolics) {
-    knownSymbolics = new ref<Expr>[size];
+    knownSymbolics = allocateKnownSymbolics(size);
     for (unsigned i=0; i<size; i++)
       knownSymbolics[i] = os.knownSymbolics[i];
   }
 
-  memcpy(concreteStore, os.concreteStore, size*sizeof(*concreteStore));
+  allocateChunkTable();
+  for (unsigned i = 0, e = getNumChunks(); i != e; ++i) {
+    concreteChunks[i] = os.concreteChunks[i];
+    ++concreteChunks[i]->refCount;
+  }
 }
 
 ObjectState::~ObjectState() {
   if (concreteMask) delete concreteMask;
   if (flushMask) delete flushMask;
-  if (knownSymbolics) delete[] knownSymbolics;
-  delete[] concreteStore;
+  freeKnownSymbolics(knownSymbolics, size);
+  delete knownFloats;
+  for (unsigned i = 0, e = getNumChunks(); i != e; ++i)
+    releaseChunk(concreteChunks[i], getChunkBytes(i));
+  if (concreteChunks != &singleChunk)
+    getPayloadPool().deallocate(concreteChunks,
+                                getNumChunks() * sizeof(ConcreteChunk *));
 
   if (object)
   {
@@ -177,6 +344,168 @@ ObjectState::~ObjectState() {
   }
 }
 
+void ObjectState::allocateChunkTable() {
+  if (getNumChunks() > 1)
+    concreteChunks = static_cast<ConcreteChunk **>(
+        getPayloadPool().allocate(getNumChunks() * sizeof(ConcreteChunk *)));
+  else
+    concreteChunks = &singleChunk;
+}
+
+ConcreteChunk *ObjectState::getZeroChunk() {
+  // Never freed, as the reference held here is never released.
+  static ConcreteChunk *zero = 0;
+  if (!zero) {
+    zero = allocateChunk(ChunkSize);
+    memset(zero->data, 0, ChunkSize);
+  }
+  return zero;
+}
+
+void ObjectState::allocateZeroChunks() {
+  newGeneration();
+  allocateChunkTable();
+  ConcreteChunk *zero = getZeroChunk();
+  for (unsigned i = 0, e = getNumChunks(); i != e; ++i) {
+    concreteChunks[i] = zero;
+    ++zero->refCount;
+  }
+}
+
+uint8_t *ObjectState::getWriteableChunk(unsigned index) {
+  newGeneration();
+  ConcreteChunk *&chunk = concreteChunks[index];
+  if (chunk->refCount > 1) {
+    unsigned bytes = getChunkBytes(index);
+    ConcreteChunk *copy = allocateChunk(bytes);
+    memcpy(copy->data, chunk->data, bytes);
+    releaseChunk(chunk, bytes);
+    chunk = copy;
+  }
+  return chunk->data;
+}
+
+void ObjectState::fillConcreteStore(uint8_t value) {
+  forgetAllKnownFloats();
+  newGeneration();
+  ConcreteChunk *zero = getZeroChunk();
+  for (unsigned i = 0, e = getNumChunks(); i != e; ++i) {
+    unsigned bytes = getChunkBytes(i);
+    if (!value) {
+      releaseChunk(concreteChunks[i], bytes);
+      concreteChunks[i] = zero;
+      ++zero->refCount;
+      continue;
+    }
+    // Do not copy a shared chunk just to overwrite it.
+    if (concreteChunks[i]->refCount > 1) {
+      releaseChunk(concreteChunks[i], bytes);
+      concreteChunks[i] = allocateChunk(bytes);
+    }
+    memset(concreteChunks[i]->data, value, bytes);
+  }
+}
+
+void ObjectState::copyConcreteStoreTo(uint8_t *address) const {
+  for (unsigned i = 0, e = getNumChunks(); i != e; ++i)
+    memcpy(address + (i << ChunkShift), concreteChunks[i]->data,
+           getChunkBytes(i));
+}
+
+void ObjectState::copyConcreteStoreFrom(const uint8_t *address) {
+  for (unsigned i = 0, e = getNumChunks(); i != e; ++i) {
+    unsigned bytes = getChunkBytes(i);
+    const uint8_t *src = address + (i << ChunkShift);
+    if (memcmp(concreteChunks[i]->data, src, bytes) != 0) {
+      memcpy(getWriteableChunk(i), src, bytes);
+      forgetAllKnownFloats();
+    }
+  }
+}
+
+void ObjectState::copyConcreteRange(unsigned offset, const ObjectState &src,
+                                    unsigned srcOffset, unsigned n) {
+  newGeneration();
+  if (&src == this && offset < srcOffset + n && srcOffset < offset + n) {
+    // Overlapping ranges, go through a buffer.
+    std::vector<uint8_t> buffer(n);
+    for (unsigned i = 0; i != n; ++i)
+      buffer[i] = getConcreteByte(srcOffset + i);
+    for (unsigned done = 0; done != n;) {
+      unsigned pos = offset + done, index = pos >> ChunkShift;
+      unsigned start = pos & (ChunkSize - 1);
+      unsigned bytes = std::min(n - done, getChunkBytes(index) - start);
+      memcpy(getWriteableChunk(index) + start, &buffer[done], bytes);
+      done += bytes;
+    }
+    return;
+  }
+
+  for (unsigned done = 0; done != n;) {
+    unsigned pos = offset + done, index = pos >> ChunkShift;
+    unsigned srcPos = srcOffset + done, srcIndex = srcPos >> ChunkShift;
+    unsigned start = pos & (ChunkSize - 1);
+    unsigned srcStart = srcPos & (ChunkSize - 1);
+    unsigned bytes = std::min(std::min(n - done, getChunkBytes(index) - start),
+                              src.getChunkBytes(srcIndex) - srcStart);
+    if (bytes == ChunkSize) {
+      // A whole chunk to a whole chunk, share it.
+      ConcreteChunk *chunk = src.concreteChunks[srcIndex];
+      ++chunk->refCount;
+      releaseChunk(concreteChunks[index], ChunkSize);
+      concreteChunks[index] = chunk;
+    } else {
+      memcpy(getWriteableChunk(index) + start,
+             src.concreteChunks[srcIndex]->data + srcStart, bytes);
+    }
+    done += bytes;
+  }
+}
+
+void ObjectState::fillConcreteRange(unsigned offset, uint8_t value,
+                                    unsigned n) {
+  newGeneration();
+  for (unsigned done = 0; done != n;) {
+    unsigned pos = offset + done, index = pos >> ChunkShift;
+    unsigned start = pos & (ChunkSize - 1);
+    unsigned bytes = std::min(n - done, getChunkBytes(index) - start);
+    if (bytes == ChunkSize && !value) {
+      ConcreteChunk *zero = getZeroChunk();
+      ++zero->refCount;
+      releaseChunk(concreteChunks[index], ChunkSize);
+      concreteChunks[index] = zero;
+    } else if (bytes == ChunkSize && concreteChunks[index]->refCount > 1) {
+      // Do not copy a shared chunk just to overwrite it.
+      releaseChunk(concreteChunks[index], ChunkSize);
+      concreteChunks[index] = allocateChunk(ChunkSize);
+      memset(concreteChunks[index]->data, value, ChunkSize);
+    } else {
+      memset(getWriteableChunk(index) + start, value, bytes);
+    }
+    done += bytes;
+  }
+}
+
+void ObjectState::writeConcreteRange(unsigned offset, const uint8_t *bytes,
+                                     unsigned n) {
+  for (unsigned done = 0; done != n;) {
+    unsigned pos = offset + done, index = pos >> ChunkShift;
+    unsigned start = pos & (ChunkSize - 1);
+    unsigned len = std::min(n - done, getChunkBytes(index) - start);
+    memcpy(getWriteableChunk(index) + start, bytes + done, len);
+    done += len;
+  }
+  markRangeConcrete(offset, n);
+}
+
+bool ObjectState::concreteStoreEquals(const uint8_t *address) const {
+  for (unsigned i = 0, e = getNumChunks(); i != e; ++i)
+    if (memcmp(concreteChunks[i]->data, address + (i << ChunkShift),
+               getChunkBytes(i)) != 0)
+      return false;
+  return true;
+}
+
 ArrayCache *ObjectState::getArrayCache() const {
   assert(object && "object was NULL");
   return object->parent->getArrayCache();
@@ -221,11 +550,7 @@ const UpdateList &ObjectState::getUpdates() const {
       Contents[Index->getZExtValue()] = Value;
     }
 
-    static unsigned id = 0;
-    const Array *array = getArrayCache()->CreateArray(
-        "const_arr" + llvm::utostr(++id), size, &Contents[0],
-        &Contents[0] + Contents.size());
-    updates = UpdateList(array, 0);
+    updates = UpdateList(createConstantArray(Contents), 0);
 
     // Apply the remaining (non-constant) writes.
     for (; Begin != End; ++Begin)
@@ -235,10 +560,65 @@ const UpdateList &ObjectState::getUpdates() const {
   return updates;
 }
 
+const Array *
+ObjectState::createConstantArray(std::vector< ref<ConstantExpr> > &contents) const {
+  static unsigned id = 0;
+  return getArrayCache()->CreateArray(
+      "const_arr" + llvm::utostr(++id), size, &contents[0],
+      &contents[0] + contents.size());
+}
+
+void ObjectState::compactUpdates() {
+  if (!UpdateListCompactionSize ||
+      updates.getSize() < compactedUpdates + UpdateListCompactionSize)
+    return;
+
+  // Collect the list of writes, with the oldest writes first.
+  unsigned NumWrites = updates.getSize();
+  std::vector<const UpdateNode *> Writes(NumWrites);
+  const UpdateNode *un = updates.head;
+  for (unsigned i = NumWrites; i != 0; un = un->next)
+    Writes[--i] = un;
+
+  // A write at a constant index is never read once a newer write at the
+  // same index exists, whatever writes at symbolic indices come between.
+  std::vector<bool> Shadowed(NumWrites);
+  std::set<uint64_t> Written;
+  for (unsigned i = NumWrites; i != 0;) {
+    --i;
+    if (ConstantExpr *Index = dyn_cast<ConstantExpr>(Writes[i]->index))
+      Shadowed[i] = !Written.insert(Index->getZExtValue()).second;
+  }
+
+  // The oldest writes of constants at constant indices can be folded into
+  // a constant root.
+  const Array *root = updates.root;
+  unsigned Begin = 0;
+  if (root->isConstantArray()) {
+    std::vector< ref<ConstantExpr> > Contents(root->constantValues);
+    for (; Begin != NumWrites; ++Begin) {
+      ConstantExpr *Index = dyn_cast<ConstantExpr>(Writes[Begin]->index);
+      ConstantExpr *Value = dyn_cast<ConstantExpr>(Writes[Begin]->value);
+      if (!Index || !Value || Index->getZExtValue() >= Contents.size())
+        break;
+      Contents[Index->getZExtValue()] = Value;
+    }
+    if (Begin)
+      root = createConstantArray(Contents);
+  }
+
+  UpdateList compacted(root, 0);
+  for (unsigned i = Begin; i != NumWrites; ++i)
+    if (!Shadowed[i])
+      compacted.extend(Writes[i]->index, Writes[i]->value);
+  updates = compacted;
+  compactedUpdates = updates.getSize();
+}
+
 void ObjectState::makeConcrete() {
   if (concreteMask) delete concreteMask;
   if (flushMask) delete flushMask;
-  if (knownSymbolics) delete[] knownSymbolics;
+  freeKnownSymbolics(knownSymbolics, size);
   concreteMask = 0;
   flushMask = 0;
   knownSymbolics = 0;
@@ -247,6 +627,7 @@ void ObjectState::makeConcrete() {
 void ObjectState::makeSymbolic() {
   assert(!updates.head &&
          "XXX makeSymbolic of objects with symbolic values is unsupported");
+  forgetAllKnownFloats();
 
   // XXX simplify this, can just delete various arrays I guess
   for (unsigned i=0; i<size; i++) {
@@ -258,15 +639,13 @@ void ObjectState::makeSymbolic() {
 
 void ObjectState::initializeToZero() {
   makeConcrete();
-  memset(concreteStore, 0, size);
+  fillConcreteStore(0);
 }
 
 void ObjectState::initializeToRandom() {  
   makeConcrete();
-  for (unsigned i=0; i<size; i++) {
-    // randomly selected by 256 sided die
-    concreteStore[i] = 0xAB;
-  }
+  // randomly selected by 256 sided die
+  fillConcreteStore(0xAB);
 }
 
 /*
@@ -292,7 +671,7 @@ void ObjectState::flushRangeForRead(unsigned rangeBase,
     if (!isByteFlushed(offset)) {
       if (isByteConcrete(offset)) {
         updates.extend(ConstantExpr::create(offset, Expr::Int32),
-                       ConstantExpr::create(concreteStore[offset], Expr::Int8));
+                       ConstantExpr::create(getConcreteByte(offset), Expr::Int8));
       } else {
         assert(isByteKnownSymbolic(offset) && "invalid bit set in flushMask");
         updates.extend(ConstantExpr::create(offset, Expr::Int32),
@@ -312,7 +691,7 @@ void ObjectState::flushRangeForWrite(unsigned rangeBase,
     if (!isByteFlushed(offset)) {
       if (isByteConcrete(offset)) {
         updates.extend(ConstantExpr::create(offset, Expr::Int32),
-                       ConstantExpr::create(concreteStore[offset], Expr::Int8));
+                       ConstantExpr::create(getConcreteByte(offset), Expr::Int8));
         markByteSymbolic(offset);
       } else {
         assert(isByteKnownSymbolic(offset) && "invalid bit set in flushMask");
@@ -338,6 +717,15 @@ bool ObjectState::isByteConcrete(unsigned offset) const {
   return !concreteMask || concreteMask->get(offset);
 }
 
+bool ObjectState::isAllConcrete() const {
+  if (!concreteMask)
+    return true;
+  for (unsigned i = 0; i != size; ++i)
+    if (!concreteMask->get(i))
+      return false;
+  return true;
+}
+
 bool ObjectState::isByteFlushed(unsigned offset) const {
   return flushMask && !flushMask->get(offset);
 }
@@ -376,17 +764,52 @@ void ObjectState::setKnownSymbolic(unsigned offset,
     knownSymbolics[offset] = value;
   } else {
     if (value) {
-      knownSymbolics = new ref<Expr>[size];
+      knownSymbolics = allocateKnownSymbolics(size);
       knownSymbolics[offset] = value;
     }
   }
 }
 
+void ObjectState::markRangeConcrete(unsigned offset, unsigned n) {
+  forgetKnownFloats(offset, n);
+  for (unsigned i = offset, e = offset + n; i != e; ++i) {
+    setKnownSymbolic(i, 0);
+    markByteConcrete(i);
+    markByteUnflushed(i);
+  }
+}
+
+void ObjectState::setKnownFloat(unsigned offset, ref<Expr> value) {
+  if (!knownFloats)
+    knownFloats = new std::map<unsigned, ref<Expr> >();
+  (*knownFloats)[offset] = value;
+}
+
+void ObjectState::forgetKnownFloatsAt(unsigned offset, unsigned n) {
+  // No float is wider than Fl80, so the ones including the bytes start at
+  // most that many bytes before them.
+  unsigned maxBytes = Expr::getMinBytesForWidth(Expr::Fl80);
+  unsigned start = offset >= maxBytes ? offset - maxBytes + 1 : 0;
+  std::map<unsigned, ref<Expr> >::iterator it = knownFloats->lower_bound(start),
+    ie = knownFloats->end();
+  while (it != ie && it->first < offset + n) {
+    if (it->first + Expr::getMinBytesForWidth(it->second->getWidth()) > offset)
+      knownFloats->erase(it++);
+    else
+      ++it;
+  }
+}
+
+void ObjectState::forgetAllKnownFloats() {
+  delete knownFloats;
+  knownFloats = 0;
+}
+
 /***/
 
 ref<Expr> ObjectState::read8(unsigned offset) const {
   if (isByteConcrete(offset)) {
-    return ConstantExpr::create(concreteStore[offset], Expr::Int8);
+    return ConstantExpr::create(getConcreteByte(offset), Expr::Int8);
   } else if (isByteKnownSymbolic(offset)) {
     return knownSymbolics[offset];
   } else {
@@ -399,6 +822,11 @@ ref<Expr> ObjectState::read8(unsigned offset) const {
 
 ref<Expr> ObjectState::read8(ref<Expr> offset) const {
   assert(!isa<ConstantExpr>(offset) && "constant offset passed to symbolic read8");
+  flushForSymbolicRead(offset);
+  return ReadExpr::create(getUpdates(), ZExtExpr::create(offset, Expr::Int32));
+}
+
+void ObjectState::flushForSymbolicRead(ref<Expr> offset) const {
   unsigned base, size;
   fastRangeCheckOffset(offset, &base, &size);
   flushRangeForRead(base, size);
@@ -410,13 +838,12 @@ ref<Expr> ObjectState::read8(ref<Expr> offset) const {
                       size,
                       allocInfo.c_str());
   }
-  
-  return ReadExpr::create(getUpdates(), ZExtExpr::create(offset, Expr::Int32));
 }
 
 void ObjectState::write8(unsigned offset, uint8_t value) {
   //assert(read_only == false && "writing to read-only object!");
-  concreteStore[offset] = value;
+  forgetKnownFloats(offset);
+  setConcreteByte(offset, value);
   setKnownSymbolic(offset, 0);
 
   markByteConcrete(offset);
@@ -428,6 +855,7 @@ void ObjectState::write8(unsigned offset, ref<Expr> value) {
   if (ConstantExpr *CE = dyn_cast<ConstantExpr>(value)) {
     write8(offset, (uint8_t) CE->getZExtValue(8));
   } else {
+    forgetKnownFloats(offset);
     setKnownSymbolic(offset, value.get());
       
     markByteSymbolic(offset);
@@ -437,9 +865,62 @@ void ObjectState::write8(unsigned offset, ref<Expr> value) {
 
 void ObjectState::write8(ref<Expr> offset, ref<Expr> value) {
   assert(!isa<ConstantExpr>(offset) && "constant offset passed to symbolic write8");
+  flushForSymbolicWrite(offset);
+  updates.extend(ZExtExpr::create(offset, Expr::Int32), value);
+  compactUpdates();
+}
+
+void ObjectState::copy(unsigned offset, const ObjectState &src,
+                       unsigned srcOffset, unsigned n) {
+  // Read the symbolic bytes before writing anything, in case the ranges
+  // overlap, and copy them one by one after the concrete ones.
+  std::vector<std::pair<unsigned, ref<Expr> > > symbolics;
+  if (src.concreteMask)
+    for (unsigned i = 0; i != n; ++i)
+      if (!src.isByteConcrete(srcOffset + i))
+        symbolics.push_back(std::make_pair(i, src.read8(srcOffset + i)));
+
+  copyConcreteRange(offset, src, srcOffset, n);
+  markRangeConcrete(offset, n);
+  for (std::vector<std::pair<unsigned, ref<Expr> > >::iterator
+         it = symbolics.begin(), ie = symbolics.end(); it != ie; ++it)
+    write8(offset + it->first, it->second);
+}
+
+void ObjectState::fill(unsigned offset, ref<Expr> value, unsigned n) {
+  if (ConstantExpr *CE = dyn_cast<ConstantExpr>(value)) {
+    fillConcreteRange(offset, CE->getZExtValue(8), n);
+    markRangeConcrete(offset, n);
+  } else {
+    for (unsigned i = offset, e = offset + n; i != e; ++i)
+      write8(i, value);
+  }
+}
+
+unsigned ObjectState::readConcrete(unsigned offset, unsigned n,
+                                   uint8_t *buffer) const {
+  if (concreteMask)
+    for (unsigned i = 0; i != n; ++i)
+      if (!concreteMask->get(offset + i)) {
+        n = i;
+        break;
+      }
+
+  for (unsigned done = 0; done != n;) {
+    unsigned pos = offset + done, index = pos >> ChunkShift;
+    unsigned start = pos & (ChunkSize - 1);
+    unsigned bytes = std::min(n - done, getChunkBytes(index) - start);
+    memcpy(buffer + done, concreteChunks[index]->data + start, bytes);
+    done += bytes;
+  }
+  return n;
+}
+
+void ObjectState::flushForSymbolicWrite(ref<Expr> offset) {
   unsigned base, size;
   fastRangeCheckOffset(offset, &base, &size);
   flushRangeForWrite(base, size);
+  forgetAllKnownFloats();
 
   if (size>4096) {
     std::string allocInfo;
@@ -448,12 +929,51 @@ void ObjectState::write8(ref<Expr> offset, ref<Expr> value) {
                       size,
                       allocInfo.c_str());
   }
-  
-  updates.extend(ZExtExpr::create(offset, Expr::Int32), value);
 }
 
 /***/
 
+// The widest accesses with a fast path for concrete bytes, those of Fl128.
+static const unsigned MaxConcreteAccessBytes = 16;
+
+/// loadConcrete - The value of the \a NumBytes bytes at \a bytes, in the
+/// byte order of the target. With the width known, the loop compiles to
+/// a load.
+template <unsigned NumBytes>
+static uint64_t loadConcrete(const uint8_t *bytes, bool littleEndian) {
+  uint64_t value = 0;
+  for (unsigned i = 0; i != NumBytes; ++i)
+    value |= (uint64_t)bytes[littleEndian ? i : NumBytes - 1 - i] << (8 * i);
+  return value;
+}
+
+template <unsigned NumBytes>
+static void storeConcrete(uint64_t value, uint8_t *bytes, bool littleEndian) {
+  for (unsigned i = 0; i != NumBytes; ++i)
+    bytes[littleEndian ? i : NumBytes - 1 - i] = (uint8_t)(value >> (8 * i));
+}
+
+/// loadConcrete - The constant of the \a n bytes at \a bytes, for the
+/// widths without a specialization (Fl80, Int128 and odd ones).
+static ref<Expr> loadConcrete(const uint8_t *bytes, unsigned n,
+                              bool littleEndian) {
+  uint64_t words[MaxConcreteAccessBytes / 8] = { 0 };
+  for (unsigned i = 0; i != n; ++i)
+    words[i / 8] |= (uint64_t)bytes[littleEndian ? i : n - 1 - i]
+                    << (8 * (i % 8));
+  return ConstantExpr::alloc(
+      llvm::APInt(n * 8, llvm::makeArrayRef(words, (n + 7) / 8)));
+}
+
+static void storeConcrete(const llvm::APInt &value, uint8_t *bytes,
+                          bool littleEndian) {
+  unsigned n = value.getBitWidth() / 8;
+  const uint64_t *words = value.getRawData();
+  for (unsigned i = 0; i != n; ++i)
+    bytes[littleEndian ? i : n - 1 - i] =
+        (uint8_t)(words[i / 8] >> (8 * (i % 8)));
+}
+
 ref<Expr> ObjectState::read(ref<Expr> offset, Expr::Width width) const {
   // Truncate offset to 32-bits.
   offset = ZExtExpr::create(offset, Expr::Int32);
@@ -466,15 +986,19 @@ ref<Expr> ObjectState::read(ref<Expr> offset, Expr::Width width) const {
   if (width == Expr::Bool)
     return ExtractExpr::create(read8(offset), 0, Expr::Bool);
 
-  // Otherwise, follow the slow general case.
+  // Otherwise, follow the slow general case. The bytes read lie in the
+  // range flushed for the first one, so flush once and read them all from
+  // the same update list.
   unsigned NumBytes = width / 8;
   assert(width == NumBytes * 8 && "Invalid read size!");
+  flushForSymbolicRead(offset);
+  const UpdateList &ul = getUpdates();
   ref<Expr> Res(0);
   for (unsigned i = 0; i != NumBytes; ++i) {
     unsigned idx = Context::get().isLittleEndian() ? i : (NumBytes - i - 1);
-    ref<Expr> Byte = read8(AddExpr::create(offset, 
-                                           ConstantExpr::create(idx, 
-                                                                Expr::Int32)));
+    ref<Expr> Byte = ReadExpr::create(ul, AddExpr::create(offset, 
+                                                          ConstantExpr::create(idx, 
+                                                                               Expr::Int32)));
     Res = i ? ConcatExpr::create(Byte, Res) : Byte;
   }
 
@@ -486,9 +1010,33 @@ ref<Expr> ObjectState::read(unsigned offset, Expr::Width width) const {
   if (width == Expr::Bool)
     return ExtractExpr::create(read8(offset), 0, Expr::Bool);
 
-  // Otherwise, follow the slow general case.
   unsigned NumBytes = width / 8;
   assert(width == NumBytes * 8 && "Invalid width for read size!");
+
+  // Read concrete bytes as one constant, rather than a concatenation of
+  // byte constants.
+  uint8_t bytes[MaxConcreteAccessBytes];
+  if (NumBytes <= MaxConcreteAccessBytes &&
+      readConcrete(offset, NumBytes, bytes) == NumBytes) {
+    bool littleEndian = Context::get().isLittleEndian();
+    switch (NumBytes) {
+    case 1:
+      return ConstantExpr::create(bytes[0], Expr::Int8);
+    case 2:
+      return ConstantExpr::create(loadConcrete<2>(bytes, littleEndian),
+                                  Expr::Int16);
+    case 4:
+      return ConstantExpr::create(loadConcrete<4>(bytes, littleEndian),
+                                  Expr::Int32);
+    case 8:
+      return ConstantExpr::create(loadConcrete<8>(bytes, littleEndian),
+                                  Expr::Int64);
+    default:
+      return loadConcrete(bytes, NumBytes, littleEndian);
+    }
+  }
+
+  // Otherwise, follow the slow general case.
   ref<Expr> Res(0);
   for (unsigned i = 0; i != NumBytes; ++i) {
     unsigned idx = Context::get().isLittleEndian() ? i : (NumBytes - i - 1);
@@ -499,6 +1047,23 @@ ref<Expr> ObjectState::read(unsigned offset, Expr::Width width) const {
   return Res;
 }
 
+ref<Expr> ObjectState::readFloat(ref<Expr> offset, Expr::Width width) const {
+  offset = ZExtExpr::create(offset, Expr::Int32);
+  if (ConstantExpr *CE = dyn_cast<ConstantExpr>(offset))
+    return readFloat(CE->getZExtValue(32), width);
+  return ExplicitFloatExpr::create(read(offset, width), width);
+}
+
+ref<Expr> ObjectState::readFloat(unsigned offset, Expr::Width width) const {
+  if (knownFloats) {
+    std::map<unsigned, ref<Expr> >::const_iterator it =
+      knownFloats->find(offset);
+    if (it != knownFloats->end() && it->second->getWidth() == width)
+      return it->second;
+  }
+  return ExplicitFloatExpr::create(read(offset, width), width);
+}
+
 void ObjectState::write(ref<Expr> offset, ref<Expr> value) {
   // Truncate offset to 32-bits.
   offset = ZExtExpr::create(offset, Expr::Int32);
@@ -519,19 +1084,29 @@ void ObjectState::write(ref<Expr> offset, ref<Expr> value) {
     return;
   }
 
-  // Otherwise, follow the slow general case.
+  // Otherwise, follow the slow general case. As for reads, flush once for
+  // all the bytes written.
   unsigned NumBytes = w / 8;
   assert(w == NumBytes * 8 && "Invalid write size!");
+  flushForSymbolicWrite(offset);
   for (unsigned i = 0; i != NumBytes; ++i) {
     unsigned idx = Context::get().isLittleEndian() ? i : (NumBytes - i - 1);
-    write8(AddExpr::create(offset, ConstantExpr::create(idx, Expr::Int32)),
-           ExtractExpr::create(value, 8 * i, Expr::Int8));
+    updates.extend(AddExpr::create(offset, ConstantExpr::create(idx, Expr::Int32)),
+                   ExtractExpr::create(value, 8 * i, Expr::Int8));
   }
+  compactUpdates();
 }
 
 void ObjectState::write(unsigned offset, ref<Expr> value) {
-  if (isa<FExpr>(value))
-    value = ExplicitIntExpr::create(value, value->getWidth());
+  if (isa<FExpr>(value)) {
+    ref<Expr> bits = ExplicitIntExpr::create(value, value->getWidth());
+    write(offset, bits);
+    // The bytes are written too, for reads of other widths or at other
+    // offsets.
+    if (!isa<ConstantExpr>(bits))
+      setKnownFloat(offset, value);
+    return;
+  }
   
   // Check for writes of constant values.
   if (ConstantExpr *CE = dyn_cast<ConstantExpr>(value)) {
@@ -547,6 +1122,13 @@ void ObjectState::write(unsigned offset, ref<Expr> value) {
       case Expr::Int64: write64(offset, val); return;
       }
     }
+    if (w % 8 == 0 && w <= MaxConcreteAccessBytes * 8) {
+      uint8_t bytes[MaxConcreteAccessBytes];
+      storeConcrete(CE->getAPValue(), bytes,
+                    Context::get().isLittleEndian());
+      writeConcreteRange(offset, bytes, w / 8);
+      return;
+    }
   }
 
   // Treat bool specially, it is the only non-byte sized write we allow.
@@ -566,27 +1148,21 @@ void ObjectState::write(unsigned offset, ref<Expr> value) {
 } 
 
 void ObjectState::write16(unsigned offset, uint16_t value) {
-  unsigned NumBytes = 2;
-  for (unsigned i = 0; i != NumBytes; ++i) {
-    unsigned idx = Context::get().isLittleEndian() ? i : (NumBytes - i - 1);
-    write8(offset + idx, (uint8_t) (value >> (8 * i)));
-  }
+  uint8_t bytes[2];
+  storeConcrete<2>(value, bytes, Context::get().isLittleEndian());
+  writeConcreteRange(offset, bytes, 2);
 }
 
 void ObjectState::write32(unsigned offset, uint32_t value) {
-  unsigned NumBytes = 4;
-  for (unsigned i = 0; i != NumBytes; ++i) {
-    unsigned idx = Context::get().isLittleEndian() ? i : (NumBytes - i - 1);
-    write8(offset + idx, (uint8_t) (value >> (8 * i)));
-  }
+  uint8_t bytes[4];
+  storeConcrete<4>(value, bytes, Context::get().isLittleEndian());
+  writeConcreteRange(offset, bytes, 4);
 }
 
 void ObjectState::write64(unsigned offset, uint64_t value) {
-  unsigned NumBytes = 8;
-  for (unsigned i = 0; i != NumBytes; ++i) {
-    unsigned idx = Context::get().isLittleEndian() ? i : (NumBytes - i - 1);
-    write8(offset + idx, (uint8_t) (value >> (8 * i)));
-  }
+  uint8_t bytes[8];
+  storeConcrete<8>(value, bytes, Context::get().isLittleEndian());
+  writeConcreteRange(offset, bytes, 8);
 }
 
 void ObjectState::print() {
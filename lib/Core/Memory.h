@@ -15,6 +15,8 @@
 
 #include "llvm/ADT/StringExtras.h"
 
+#include <algorithm>
+#include <map>
 #include <vector>
 #include <string>
 
@@ -33,6 +35,7 @@ class MemoryObject {
   friend class STPBuilder;
   friend class ObjectState;
   friend class ExecutionState;
+  friend class SymbolicList;
 
 private:
   static int counter;
@@ -54,6 +57,10 @@ public:
   bool fake_object;
   bool isUserSpecified;
 
+  /// true if the memory at address is a block of the memory manager's
+  /// pool for small local objects.
+  bool isPooled;
+
   MemoryManager *parent;
 
   /// "Location" for which this memory object was allocated. This
@@ -67,11 +74,20 @@ public:
   /// should sensibly be only at creation time).
   mutable std::vector< ref<Expr> > cexPreferences;
 
+  /// The generation of the object state whose concrete contents were last
+  /// copied to or from the memory at address, or 0 if it is unknown.
+  mutable uint64_t nativeGeneration;
+
   // DO NOT IMPLEMENT
   MemoryObject(const MemoryObject &b);
   MemoryObject &operator=(const MemoryObject &b);
 
 public:
+  /// Memory objects come from the same size-classed pool as object
+  /// contents, as there are as many of them as allocas.
+  static void *operator new(size_t size);
+  static void operator delete(void *p, size_t size);
+
   // XXX this is just a temp hack, should be removed
   explicit
   MemoryObject(uint64_t _address) 
@@ -80,8 +96,10 @@ public:
       address(_address),
       size(0),
       isFixed(true),
+      isPooled(false),
       parent(NULL),
-      allocSite(0) {
+      allocSite(0),
+      nativeGeneration(0) {
   }
 
   MemoryObject(uint64_t _address, unsigned _size, 
@@ -98,12 +116,17 @@ public:
       isFixed(_isFixed),
       fake_object(false),
       isUserSpecified(false),
+      isPooled(false),
       parent(_parent), 
-      allocSite(_allocSite) {
+      allocSite(_allocSite),
+      nativeGeneration(0) {
   }
 
   ~MemoryObject();
 
+  /// The id the next object created will get.
+  static unsigned getNextId() { return counter; }
+
   /// Get an identifying string for this allocation.
   void getAllocInfo(std::string &result) const;
 
@@ -146,6 +169,13 @@ public:
   }
 };
 
+/// A chunk of the concrete contents of object states, shared by copies of
+/// an object state until one of them writes to it.
+struct ConcreteChunk {
+  unsigned refCount;
+  uint8_t data[1];
+};
+
 class ObjectState {
 private:
   friend class AddressSpace;
@@ -156,7 +186,15 @@ private:
 
   const MemoryObject *object;
 
-  uint8_t *concreteStore;
+  static const unsigned ChunkShift = 12;
+  static const unsigned ChunkSize = 1 << ChunkShift;
+
+  /// The concrete contents, in chunks of ChunkSize bytes, so that writing
+  /// to a copy of a large object only copies the chunk written to. For
+  /// objects of at most one chunk this points to singleChunk.
+  ConcreteChunk **concreteChunks;
+  ConcreteChunk *singleChunk;
+
   // XXX cleanup name of flushMask (its backwards or something)
   BitArray *concreteMask;
 
@@ -168,6 +206,21 @@ private:
   // mutable because we may need flush during read of const
   mutable UpdateList updates;
 
+  /// The symbolic floats last written at constant offsets, by offset, whose
+  /// bytes have not been written to since. Reading one back as a float of
+  /// the same width yields the float itself rather than a conversion of its
+  /// bytes, which the solver would otherwise have to see through.
+  std::map<unsigned, ref<Expr> > *knownFloats;
+
+  /// The size of the update list when it was last compacted.
+  unsigned compactedUpdates;
+
+  /// Object states have the same generation only while they have the same
+  /// concrete contents: copies start with the generation of the original,
+  /// and every change to the contents gives a new one.
+  uint64_t generation;
+  static uint64_t lastGeneration;
+
 public:
   unsigned size;
 
@@ -186,6 +239,9 @@ public:
   ObjectState(const ObjectState &os);
   ~ObjectState();
 
+  static void *operator new(size_t size);
+  static void operator delete(void *p, size_t size);
+
   const MemoryObject *getObject() const { return object; }
 
   void setReadOnly(bool ro) { readOnly = ro; }
@@ -199,6 +255,10 @@ public:
   ref<Expr> read(unsigned offset, Expr::Width width) const;
   ref<Expr> read8(unsigned offset) const;
 
+  /// Read a float of the given width, as read() followed by a bitcast.
+  ref<Expr> readFloat(ref<Expr> offset, Expr::Width width) const;
+  ref<Expr> readFloat(unsigned offset, Expr::Width width) const;
+
   // return bytes written.
   void write(unsigned offset, ref<Expr> value);
   void write(ref<Expr> offset, ref<Expr> value);
@@ -208,8 +268,64 @@ public:
   void write32(unsigned offset, uint32_t value);
   void write64(unsigned offset, uint64_t value);
 
+  /// Copy the \a n bytes of \a src at \a srcOffset to \a offset, as
+  /// memmove does. \a src may be this object state. Concrete bytes are
+  /// copied in bulk, sharing whole chunks where the ranges are aligned.
+  void copy(unsigned offset, const ObjectState &src, unsigned srcOffset,
+            unsigned n);
+  /// Write the byte \a value to the \a n bytes at \a offset, as memset
+  /// does.
+  void fill(unsigned offset, ref<Expr> value, unsigned n);
+
+  /// Copy the \a n bytes at \a offset to \a buffer up to the first
+  /// symbolic one, and return how many were copied.
+  unsigned readConcrete(unsigned offset, unsigned n, uint8_t *buffer) const;
+
 private:
   const UpdateList &getUpdates() const;
+  const Array *createConstantArray(std::vector< ref<ConstantExpr> > &contents) const;
+  /// Rewrite the update list without the writes which can no longer be
+  /// read, and with the oldest concrete writes folded into a new constant
+  /// root, once it grew by -update-list-compaction-size writes.
+  void compactUpdates();
+
+  unsigned getNumChunks() const {
+    return (size + ChunkSize - 1) >> ChunkShift;
+  }
+  unsigned getChunkBytes(unsigned index) const {
+    return std::min(ChunkSize, size - (index << ChunkShift));
+  }
+  void allocateChunkTable();
+  /// The chunk of zeros all zero-filled chunks share until written to, so
+  /// that objects cost no contents until they are.
+  static ConcreteChunk *getZeroChunk();
+  void allocateZeroChunks();
+
+  uint8_t getConcreteByte(unsigned offset) const {
+    return concreteChunks[offset >> ChunkShift]->data[offset & (ChunkSize - 1)];
+  }
+  void newGeneration() { generation = ++lastGeneration; }
+  /// Get chunk \a index for writing, copying it first if it is shared.
+  uint8_t *getWriteableChunk(unsigned index);
+  void setConcreteByte(unsigned offset, uint8_t value) {
+    getWriteableChunk(offset >> ChunkShift)[offset & (ChunkSize - 1)] = value;
+  }
+  void fillConcreteStore(uint8_t value);
+  void copyConcreteRange(unsigned offset, const ObjectState &src,
+                         unsigned srcOffset, unsigned n);
+  void fillConcreteRange(unsigned offset, uint8_t value, unsigned n);
+  /// Write the \a n concrete bytes at \a bytes to \a offset, as write8
+  /// does for each.
+  void writeConcreteRange(unsigned offset, const uint8_t *bytes, unsigned n);
+  /// Mark the \a n bytes at \a offset as holding their concrete values,
+  /// as write8 does for one byte.
+  void markRangeConcrete(unsigned offset, unsigned n);
+
+  /// Copy the concrete contents to or from \a address, and compare them
+  /// with it. Unchanged chunks stay shared when copying in.
+  void copyConcreteStoreTo(uint8_t *address) const;
+  void copyConcreteStoreFrom(const uint8_t *address);
+  bool concreteStoreEquals(const uint8_t *address) const;
 
   void makeConcrete();
 
@@ -219,12 +335,17 @@ private:
   void write8(unsigned offset, ref<Expr> value);
   void write8(ref<Expr> offset, ref<Expr> value);
 
+  /// Flush the bytes a read or write at symbolic \a offset may access.
+  void flushForSymbolicRead(ref<Expr> offset) const;
+  void flushForSymbolicWrite(ref<Expr> offset);
+
   void fastRangeCheckOffset(ref<Expr> offset, unsigned *base_r, 
                             unsigned *size_r) const;
   void flushRangeForRead(unsigned rangeBase, unsigned rangeSize) const;
   void flushRangeForWrite(unsigned rangeBase, unsigned rangeSize);
 
   bool isByteConcrete(unsigned offset) const;
+  bool isAllConcrete() const;
   bool isByteFlushed(unsigned offset) const;
   bool isByteKnownSymbolic(unsigned offset) const;
 
@@ -234,6 +355,15 @@ private:
   void markByteUnflushed(unsigned offset);
   void setKnownSymbolic(unsigned offset, Expr *value);
 
+  void setKnownFloat(unsigned offset, ref<Expr> value);
+  /// Forget the known floats which include the byte at \a offset.
+  void forgetKnownFloats(unsigned offset, unsigned n = 1) {
+    if (knownFloats)
+      forgetKnownFloatsAt(offset, n);
+  }
+  void forgetKnownFloatsAt(unsigned offset, unsigned n);
+  void forgetAllKnownFloats();
+
   void print();
   ArrayCache *getArrayCache() const;
 };
@@ -56,14 +56,15 @@ llvm::cl::opt<unsigned long long> DeterministicStartAddress(
 /***/
 MemoryManager::MemoryManager(ArrayCache *_arrayCache)
     : arrayCache(_arrayCache), deterministicSpace(0), nextFreeSlot(0),
-      spaceSize(DeterministicAllocationSize.getValue() * 1024 * 1024) {
+      spaceSize(DeterministicAllocationSize.getValue() * 1024 * 1024),
+      localSlabNext(0), localSlabEnd(0), usedDeterministicSize(0) {
   if (DeterministicAllocation) {
     // Page boundary
     void *expectedAddress = (void *)DeterministicStartAddress.getValue();
 
     char *newSpace =
         (char *)mmap(expectedAddress, spaceSize, PROT_READ | PROT_WRITE,
-                     MAP_ANONYMOUS | MAP_PRIVATE, -1, 0);
+                     MAP_ANONYMOUS | MAP_PRIVATE | MAP_NORESERVE, -1, 0);
 
     if (newSpace == MAP_FAILED) {
       klee_error("Couldn't mmap() memory for deterministic allocations");
@@ -72,6 +73,13 @@ MemoryManager::MemoryManager(ArrayCache *_arrayCache)
       klee_error("Could not allocate memory deterministically");
     }
 
+#ifdef MADV_HUGEPAGE
+    // Objects are spread over the space, and all of them are touched when
+    // memory is synchronized for external calls: huge pages save many TLB
+    // misses.
+    madvise(newSpace, spaceSize, MADV_HUGEPAGE);
+#endif
+
     klee_message("Deterministic memory allocation starting from %p", newSpace);
     deterministicSpace = newSpace;
     nextFreeSlot = newSpace;
@@ -79,18 +87,170 @@ MemoryManager::MemoryManager(ArrayCache *_arrayCache)
 }
 
 MemoryManager::~MemoryManager() {
+  // Deleting an object calls markFreed, which must not find it: it would
+  // change the set being walked and free the address a second time.
   while (!objects.empty()) {
     MemoryObject *mo = *objects.begin();
-    if (!mo->isFixed && !DeterministicAllocation)
+    if (!mo->isFixed && !mo->isPooled && !DeterministicAllocation)
       free((void *)mo->address);
     objects.erase(mo);
     delete mo;
   }
+  for (std::vector<char *>::iterator it = localSlabs.begin(),
+         ie = localSlabs.end(); it != ie; ++it)
+    free(*it);
 
   if (DeterministicAllocation)
     munmap(deterministicSpace, spaceSize);
 }
 
+int MemoryManager::getLocalBlockClass(uint64_t size) {
+  for (unsigned shift = MinLocalBlockShift; shift <= MaxLocalBlockShift;
+       ++shift)
+    if (size + LocalRedZone <= (1u << shift))
+      return shift - MinLocalBlockShift;
+  return -1;
+}
+
+uint64_t MemoryManager::allocateLocalBlock(int blockClass) {
+  std::vector<uint64_t> &freeBlocks = freeLocalBlocks[blockClass];
+  if (!freeBlocks.empty()) {
+    uint64_t address = freeBlocks.back();
+    freeBlocks.pop_back();
+    return address;
+  }
+
+  // Blocks are aligned to their size, as slabs are to the largest one.
+  size_t blockSize = 1u << (blockClass + MinLocalBlockShift);
+  localSlabNext = (char *)llvm::RoundUpToAlignment((uint64_t)localSlabNext,
+                                                   blockSize);
+  if (!localSlabNext || localSlabNext + blockSize > localSlabEnd) {
+    void *slab;
+    if (posix_memalign(&slab, 1u << MaxLocalBlockShift, LocalSlabSize))
+      return 0;
+    localSlabs.push_back((char *)slab);
+    localSlabNext = (char *)slab;
+    localSlabEnd = localSlabNext + LocalSlabSize;
+  }
+  uint64_t address = (uint64_t)localSlabNext;
+  localSlabNext += blockSize;
+  return address;
+}
+
+uint64_t MemoryManager::getDetermRangeSize(uint64_t size) {
+  return llvm::RoundUpToAlignment(std::max(size, (uint64_t)1) + RedZoneSpace,
+                                  DetermPageSize);
+}
+
+uint64_t MemoryManager::allocateDetermRange(uint64_t size,
+                                            uint64_t alignment) {
+  for (std::map<uint64_t, uint64_t>::iterator it = freeDetermRanges.begin(),
+         ie = freeDetermRanges.end(); it != ie; ++it) {
+    uint64_t start = it->first, end = it->first + it->second;
+    uint64_t address = llvm::RoundUpToAlignment(start, alignment);
+    if (address + size > end)
+      continue;
+    freeDetermRanges.erase(it);
+    if (address > start)
+      freeDetermRanges[start] = address - start;
+    if (address + size < end)
+      freeDetermRanges[address + size] = end - address - size;
+    return address;
+  }
+
+  uint64_t start = (uint64_t)nextFreeSlot;
+  uint64_t address = llvm::RoundUpToAlignment(start, alignment);
+  if (address + size > (uint64_t)(deterministicSpace + spaceSize))
+    return 0;
+  nextFreeSlot = (char *)(address + size);
+  if (address > start)
+    releaseDetermRange(start, address - start);
+  return address;
+}
+
+void MemoryManager::releaseDetermRange(uint64_t address, uint64_t size) {
+  std::map<uint64_t, uint64_t>::iterator next =
+      freeDetermRanges.lower_bound(address);
+  if (next != freeDetermRanges.end() && address + size == next->first) {
+    size += next->second;
+    freeDetermRanges.erase(next++);
+  }
+  if (next != freeDetermRanges.begin()) {
+    std::map<uint64_t, uint64_t>::iterator prev = next;
+    --prev;
+    if (prev->first + prev->second == address) {
+      address = prev->first;
+      size += prev->second;
+      freeDetermRanges.erase(prev);
+    }
+  }
+
+  // A range at the end goes back to the unused space.
+  if (address + size == (uint64_t)nextFreeSlot)
+    nextFreeSlot = (char *)address;
+  else
+    freeDetermRanges[address] = size;
+}
+
+uint64_t MemoryManager::allocateDeterministic(uint64_t size,
+                                              size_t alignment) {
+  // Handle the case of 0-sized allocations as 1-byte allocations.
+  // This way, we make sure we have this allocation between its own red zones
+  uint64_t allocSize = std::max(size, (uint64_t)1) + RedZoneSpace;
+  unsigned shift = MinLocalBlockShift;
+  while (shift <= MaxDetermBlockShift &&
+         ((1ull << shift) < allocSize || (1ull << shift) < alignment))
+    ++shift;
+
+  uint64_t address, blockSize;
+  int blockClass = -1;
+  if (shift <= MaxDetermBlockShift) {
+    blockClass = shift - MinLocalBlockShift;
+    blockSize = 1ull << shift;
+    DetermClass &c = determClasses[blockClass];
+    if (!c.freeBlocks.empty()) {
+      address = *c.freeBlocks.begin();
+      c.freeBlocks.erase(c.freeBlocks.begin());
+    } else {
+      if (c.next == c.end) {
+        // Chunks are aligned to their size, so blocks are to theirs.
+        const uint64_t chunkSize = 1ull << MaxDetermBlockShift;
+        c.next = allocateDetermRange(chunkSize, chunkSize);
+        if (!c.next)
+          return 0;
+        c.end = c.next + chunkSize;
+      }
+      address = c.next;
+      c.next += blockSize;
+    }
+  } else {
+    blockSize = getDetermRangeSize(size);
+    address = allocateDetermRange(
+        blockSize, std::max(alignment, (size_t)DetermPageSize));
+    if (!address)
+      return 0;
+  }
+
+  determBlocks[address] = blockClass;
+  usedDeterministicSize += blockSize;
+  return address;
+}
+
+void MemoryManager::freeDeterministic(const MemoryObject *mo) {
+  std::map<uint64_t, int>::iterator it = determBlocks.find(mo->address);
+  assert(it != determBlocks.end() && "not a deterministic object");
+  int blockClass = it->second;
+  determBlocks.erase(it);
+  if (blockClass >= 0) {
+    determClasses[blockClass].freeBlocks.insert(mo->address);
+    usedDeterministicSize -= 1ull << (blockClass + MinLocalBlockShift);
+  } else {
+    uint64_t blockSize = getDetermRangeSize(mo->size);
+    releaseDetermRange(mo->address, blockSize);
+    usedDeterministicSize -= blockSize;
+  }
+}
+
 MemoryObject *MemoryManager::allocate(uint64_t size, bool isLocal,
                                       bool isGlobal,
                                       const llvm::Value *allocSite,
@@ -110,22 +270,19 @@ MemoryObject *MemoryManager::allocate(uint64_t size, bool isLocal,
   }
 
   uint64_t address = 0;
-  if (DeterministicAllocation) {
-
-    address = llvm::RoundUpToAlignment((uint64_t)nextFreeSlot + alignment - 1,
-                                       alignment);
+  int blockClass = -1;
+  if (isLocal && !DeterministicAllocation &&
+      alignment <= (1u << MinLocalBlockShift))
+    blockClass = getLocalBlockClass(size);
 
-    // Handle the case of 0-sized allocations as 1-byte allocations.
-    // This way, we make sure we have this allocation between its own red zones
-    size_t alloc_size = std::max(size, (uint64_t)1);
-    if ((char *)address + alloc_size < deterministicSpace + spaceSize) {
-      nextFreeSlot = (char *)address + alloc_size + RedZoneSpace;
-    } else {
+  if (blockClass >= 0) {
+    address = allocateLocalBlock(blockClass);
+  } else if (DeterministicAllocation) {
+    address = allocateDeterministic(size, alignment);
+    if (!address)
       klee_warning_once(0, "Couldn't allocate %" PRIu64
                            " bytes. Not enough deterministic space left.",
                         size);
-      address = 0;
-    }
   } else {
     // Use malloc for the standard case
     if (alignment <= 8)
@@ -145,6 +302,7 @@ MemoryObject *MemoryManager::allocate(uint64_t size, bool isLocal,
   ++stats::allocations;
   MemoryObject *res = new MemoryObject(address, size, isLocal, isGlobal, false,
                                        allocSite, this);
+  res->isPooled = blockClass >= 0;
   objects.insert(res);
   return res;
 }
@@ -170,13 +328,16 @@ MemoryObject *MemoryManager::allocateFixed(uint64_t address, uint64_t size,
 void MemoryManager::deallocate(const MemoryObject *mo) { assert(0); }
 
 void MemoryManager::markFreed(MemoryObject *mo) {
-  if (objects.find(mo) != objects.end()) {
-    if (!mo->isFixed && !DeterministicAllocation)
+  if (objects.erase(mo)) {
+    if (mo->isPooled)
+      freeLocalBlocks[getLocalBlockClass(mo->size)].push_back(mo->address);
+    else if (!mo->isFixed && DeterministicAllocation)
+      freeDeterministic(mo);
+    else if (!mo->isFixed)
       free((void *)mo->address);
-    objects.erase(mo);
   }
 }
 
 size_t MemoryManager::getUsedDeterministicSize() {
-  return nextFreeSlot - deterministicSpace;
+  return usedDeterministicSize;
 }
@@ -10,8 +10,16 @@
 #ifndef KLEE_MEMORYMANAGER_H
 #define KLEE_MEMORYMANAGER_H
 
+#include <ciso646>
+#ifdef _LIBCPP_VERSION
+#include <unordered_set>
+#else
+#include <tr1/unordered_set>
+#endif
+#include <map>
 #include <set>
 #include <stdint.h>
+#include <vector>
 
 namespace llvm {
 class Value;
@@ -23,7 +31,11 @@ class ArrayCache;
 
 class MemoryManager {
 private:
-  typedef std::set<MemoryObject *> objects_ty;
+#ifdef _LIBCPP_VERSION
+  typedef std::unordered_set<MemoryObject *> objects_ty;
+#else
+  typedef std::tr1::unordered_set<MemoryObject *> objects_ty;
+#endif
   objects_ty objects;
   ArrayCache *const arrayCache;
 
@@ -31,6 +43,56 @@ private:
   char *nextFreeSlot;
   size_t spaceSize;
 
+  /// Memory for small local objects is carved out of slabs, in blocks of
+  /// powers of two from MinLocalBlock to MaxLocalBlock bytes, and blocks
+  /// freed are kept for the next object of their size, so that the allocas
+  /// of a call and their release on return do not go through malloc and
+  /// free. Objects are smaller than their block by LocalRedZone bytes, so
+  /// that no object ends where another one starts.
+  static const unsigned MinLocalBlockShift = 4;
+  static const unsigned MaxLocalBlockShift = 10;
+  static const unsigned LocalRedZone = 16;
+  static const unsigned LocalSlabSize = 64 * 1024;
+  std::vector<char *> localSlabs;
+  char *localSlabNext;
+  char *localSlabEnd;
+  std::vector<uint64_t>
+      freeLocalBlocks[MaxLocalBlockShift - MinLocalBlockShift + 1];
+
+  /// The index of the block size for a local object of \a size bytes, or
+  /// -1 if it is too large for one.
+  static int getLocalBlockClass(uint64_t size);
+  uint64_t allocateLocalBlock(int blockClass);
+
+  /// Deterministic objects get blocks of powers of two from MinLocalBlock
+  /// up to MaxDetermBlock bytes, carved out of chunks of the largest size,
+  /// or whole pages if they are larger. Both include RedZoneSpace bytes.
+  /// Freed blocks are reused lowest address first and freed page ranges are
+  /// merged, so that the layout only depends on which objects are alive,
+  /// not on the order in which the others died.
+  static const unsigned MaxDetermBlockShift = 16;
+  static const unsigned DetermPageSize = 4096;
+  struct DetermClass {
+    std::set<uint64_t> freeBlocks;
+    uint64_t next, end;
+    DetermClass() : next(0), end(0) {}
+  };
+  DetermClass determClasses[MaxDetermBlockShift - MinLocalBlockShift + 1];
+  /// The free page ranges below nextFreeSlot, by address.
+  std::map<uint64_t, uint64_t> freeDetermRanges;
+  /// The block class of each deterministic object alive, or -1 for a page
+  /// range.
+  std::map<uint64_t, int> determBlocks;
+  size_t usedDeterministicSize;
+
+  static uint64_t getDetermRangeSize(uint64_t size);
+  /// Take \a size bytes aligned to \a alignment, both multiples of the page
+  /// size, from the lowest free range or the end of the space.
+  uint64_t allocateDetermRange(uint64_t size, uint64_t alignment);
+  void releaseDetermRange(uint64_t address, uint64_t size);
+  uint64_t allocateDeterministic(uint64_t size, size_t alignment);
+  void freeDeterministic(const MemoryObject *mo);
+
 public:
   MemoryManager(ArrayCache *arrayCache);
   ~MemoryManager();
@@ -48,7 +110,7 @@ public:
   ArrayCache *getArrayCache() const { return arrayCache; }
 
   /*
-   * Returns the size used by deterministic allocation in bytes
+   * Returns the size of the deterministic blocks in use in bytes
    */
   size_t getUsedDeterministicSize();
 };
@@ -0,0 +1,147 @@
+//===-- MetricsServer.cpp -------------------------------------------------===//
+//
+//                     The KLEE Symbolic Virtual Machine
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+
+#include "MetricsServer.h"
+
+#include "klee/Internal/Support/ErrorHandling.h"
+
+#include "llvm/ADT/StringExtras.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <netdb.h>
+#include <poll.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+using namespace klee;
+
+/// How long a client may take to send its request, in milliseconds. The
+/// executor waits meanwhile, so this is kept short.
+static const int requestTimeout = 100;
+
+MetricsServer::MetricsServer(const std::string &_address)
+  : address(_address), fd(-1), creator(getpid()) {
+  if (address.find('/') != std::string::npos) {
+    struct sockaddr_un sun;
+    if (address.size() >= sizeof sun.sun_path) {
+      klee_warning("metrics socket path too long: %s", address.c_str());
+      return;
+    }
+    memset(&sun, 0, sizeof sun);
+    sun.sun_family = AF_UNIX;
+    strcpy(sun.sun_path, address.c_str());
+    unlink(address.c_str());
+    fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd >= 0 && bind(fd, (struct sockaddr *) &sun, sizeof sun) == 0)
+      socketPath = address;
+  } else {
+    std::string host, port = address;
+    std::string::size_type colon = address.rfind(':');
+    if (colon != std::string::npos) {
+      host = address.substr(0, colon);
+      port = address.substr(colon + 1);
+    }
+    struct addrinfo hints, *res;
+    memset(&hints, 0, sizeof hints);
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+    hints.ai_flags = AI_PASSIVE;
+    int err = getaddrinfo(host.empty() ? 0 : host.c_str(), port.c_str(),
+                          &hints, &res);
+    if (err) {
+      klee_warning("cannot resolve metrics address %s: %s", address.c_str(),
+                   gai_strerror(err));
+      return;
+    }
+    fd = socket(res->ai_family, res->ai_socktype, res->ai_protocol);
+    int one = 1;
+    if (fd >= 0)
+      setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof one);
+    if (fd >= 0 && bind(fd, res->ai_addr, res->ai_addrlen) < 0) {
+      close(fd);
+      fd = -1;
+    }
+    freeaddrinfo(res);
+  }
+
+  if (fd < 0 || listen(fd, 16) < 0 ||
+      fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK) < 0) {
+    klee_warning("cannot listen for metrics on %s: %s", address.c_str(),
+                 strerror(errno));
+    if (fd >= 0)
+      close(fd);
+    fd = -1;
+    return;
+  }
+}
+
+MetricsServer::~MetricsServer() {
+  if (fd >= 0)
+    close(fd);
+  // Processes forked from the creator must not remove its socket.
+  if (!socketPath.empty() && getpid() == creator)
+    unlink(socketPath.c_str());
+}
+
+int MetricsServer::accept() {
+  if (fd < 0)
+    return -1;
+  int conn = ::accept(fd, 0, 0);
+  if (conn >= 0)
+    fcntl(conn, F_SETFL, fcntl(conn, F_GETFL) | O_NONBLOCK);
+  return conn;
+}
+
+void MetricsServer::respond(int conn, const std::string &body) {
+  // The request itself does not matter, but reading it up to its end
+  // spares the client a connection reset.
+  std::string request;
+  char buf[1024];
+  struct pollfd pfd = { conn, POLLIN, 0 };
+  while (request.find("\r\n\r\n") == std::string::npos &&
+         request.size() < 8192 && poll(&pfd, 1, requestTimeout) > 0) {
+    ssize_t n = read(conn, buf, sizeof buf);
+    if (n <= 0)
+      break;
+    request.append(buf, n);
+  }
+
+  std::string response =
+      "HTTP/1.0 200 OK\r\n"
+      "Content-Type: text/plain; version=0.0.4\r\n"
+      "Content-Length: " + llvm::utostr(body.size()) + "\r\n"
+      "Connection: close\r\n\r\n" + body;
+  const char *p = response.data();
+  size_t left = response.size();
+  pfd.events = POLLOUT;
+  while (left && poll(&pfd, 1, requestTimeout) > 0) {
+    ssize_t n = send(conn, p, left, MSG_NOSIGNAL);
+    if (n <= 0)
+      break;
+    p += n;
+    left -= n;
+  }
+  close(conn);
+}
+
+std::string MetricsServer::getWorkerAddress(const std::string &address,
+                                            unsigned index) {
+  if (address.find('/') != std::string::npos)
+    return address + "." + llvm::utostr(index);
+  std::string::size_type colon = address.rfind(':');
+  std::string host = colon == std::string::npos
+                         ? "" : address.substr(0, colon + 1);
+  unsigned port = atoi(address.c_str() + (colon == std::string::npos
+                                              ? 0 : colon + 1));
+  return host + llvm::utostr(port + index);
+}
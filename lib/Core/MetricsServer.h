@@ -0,0 +1,52 @@
+//===-- MetricsServer.h -----------------------------------------*- C++ -*-===//
+//
+//                     The KLEE Symbolic Virtual Machine
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+
+#ifndef KLEE_METRICSSERVER_H
+#define KLEE_METRICSSERVER_H
+
+#include <string>
+
+namespace klee {
+
+  /// MetricsServer - A minimal HTTP endpoint which answers every request
+  /// with the same document, for monitoring tools to scrape.
+  ///
+  /// The server never blocks and has no thread of its own: the executor
+  /// polls it for waiting connections every now and then, and only builds
+  /// the document when there are any.
+  class MetricsServer {
+    std::string address;
+    std::string socketPath; // set for a Unix domain socket
+    int fd;
+    int creator;
+
+  public:
+    /// Listen on \a address: the path of a Unix domain socket if it
+    /// contains a '/', otherwise a TCP "[host:]port".
+    explicit MetricsServer(const std::string &address);
+    ~MetricsServer();
+
+    bool good() const { return fd >= 0; }
+    const std::string &getAddress() const { return address; }
+
+    /// accept - Return a waiting connection, or -1 if there is none.
+    int accept();
+
+    /// respond - Read the request of connection \a conn, answer it with
+    /// \a body as plain text and close it.
+    void respond(int conn, const std::string &body);
+
+    /// getWorkerAddress - The address parallel worker \a index listens on
+    /// instead of \a address: the next ports, or suffixed socket paths.
+    static std::string getWorkerAddress(const std::string &address,
+                                        unsigned index);
+  };
+}
+
+#endif
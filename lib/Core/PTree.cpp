@@ -12,42 +12,126 @@
 #include <klee/Expr.h>
 #include <klee/util/ExprPPrinter.h>
 
+#include <new>
 #include <vector>
 
 using namespace klee;
 
   /* *** */
 
-PTree::PTree(const data_type &_root) : root(new Node(0,_root)) {
+/// The number of nodes allocated at once.
+static const unsigned NodesPerBlock = 1024;
+
+PTree::PTree(const data_type &_root) : root(0), countingStates(false) {
+  root = allocate(0, _root);
+}
+
+PTree::~PTree() {
+  for (std::vector<void*>::iterator it = blocks.begin(), ie = blocks.end();
+       it != ie; ++it)
+    ::operator delete(*it);
 }
 
-PTree::~PTree() {}
+PTreeNode *PTree::allocate(Node *parent, const data_type &data) {
+  if (freeNodes.empty()) {
+    Node *block =
+      static_cast<Node*>(::operator new(NodesPerBlock * sizeof(Node)));
+    blocks.push_back(block);
+    // Hand out the nodes of a block in order.
+    for (unsigned i = NodesPerBlock; i != 0; --i)
+      freeNodes.push_back(block + i - 1);
+  }
+  Node *n = freeNodes.back();
+  freeNodes.pop_back();
+  return new (n) Node(parent, data);
+}
+
+void PTree::release(Node *n) {
+  n->~Node();
+  freeNodes.push_back(n);
+}
+
+void PTree::addToCounts(Node *n, int delta) {
+  if (countingStates)
+    for (; n; n = n->parent)
+      n->numStates += delta;
+}
 
 std::pair<PTreeNode*, PTreeNode*>
 PTree::split(Node *n, 
              const data_type &leftData, 
              const data_type &rightData) {
   assert(n && !n->left && !n->right);
-  n->left = new Node(n, leftData);
-  n->right = new Node(n, rightData);
+  n->left = allocate(n, leftData);
+  n->right = allocate(n, rightData);
+  addToCounts(n, 1);
   return std::make_pair(n->left, n->right);
 }
 
 void PTree::remove(Node *n) {
   assert(!n->left && !n->right);
-  do {
-    Node *p = n->parent;
-    if (p) {
-      if (n == p->left) {
-        p->left = 0;
-      } else {
-        assert(n == p->right);
-        p->right = 0;
-      }
+  Node *p = n->parent;
+  release(n);
+  if (!p) {
+    assert(n == root);
+    root = 0;
+    return;
+  }
+
+  // Splice out the branch, which has a single side left.
+  Node *sibling = (n == p->left) ? p->right : p->left;
+  assert(sibling && (n == p->left || n == p->right));
+  Node *grandparent = p->parent;
+  sibling->parent = grandparent;
+  if (!grandparent) {
+    root = sibling;
+  } else if (p == grandparent->left) {
+    grandparent->left = sibling;
+  } else {
+    grandparent->right = sibling;
+  }
+  release(p);
+  addToCounts(grandparent, -1);
+}
+
+PTreeNode *PTree::attach(const data_type &data) {
+  Node *leaf = allocate(0, data);
+  if (!root)
+    return root = leaf;
+
+  Node *n = allocate(0, 0);
+  n->left = root;
+  n->right = leaf;
+  n->numStates = root->numStates + 1;
+  root->parent = leaf->parent = n;
+  root = n;
+  return leaf;
+}
+
+void PTree::countStates() {
+  if (countingStates)
+    return;
+  countingStates = true;
+  if (!root)
+    return;
+
+  // Count in post order, children before their parent.
+  std::vector<std::pair<Node*, bool> > stack;
+  stack.push_back(std::make_pair(root, false));
+  while (!stack.empty()) {
+    Node *n = stack.back().first;
+    if (!n->left) {
+      stack.pop_back();
+      n->numStates = 1;
+    } else if (!stack.back().second) {
+      stack.back().second = true;
+      stack.push_back(std::make_pair(n->left, false));
+      stack.push_back(std::make_pair(n->right, false));
+    } else {
+      stack.pop_back();
+      n->numStates = n->left->numStates + n->right->numStates;
     }
-    delete n;
-    n = p;
-  } while (n && !n->left && !n->right);
+  }
 }
 
 void PTree::dump(llvm::raw_ostream &os) {
@@ -94,7 +178,8 @@ PTreeNode::PTreeNode(PTreeNode *_parent,
     left(0),
     right(0),
     data(_data),
-    condition(0) {
+    condition(0),
+    numStates(1) {
 }
 
 PTreeNode::~PTreeNode() {
@@ -12,9 +12,16 @@
 
 #include <klee/Expr.h>
 
+#include <vector>
+
 namespace klee {
   class ExecutionState;
 
+  /// PTree - The process tree: its leaves are the states, and each inner
+  /// node is a branch two of them were forked at. Branches one side of
+  /// which has terminated are spliced out, so every inner node has two
+  /// children and the tree is never deeper than it needs to be. Nodes come
+  /// from a pool that reuses those freed.
   class PTree { 
     typedef ExecutionState* data_type;
 
@@ -30,7 +37,25 @@ namespace klee {
                                  const data_type &rightData);
     void remove(Node *n);
 
+    /// attach - Add a new leaf for a state that does not descend from any
+    /// state in the tree, next to the current root.
+    Node *attach(const data_type &data);
+
+    /// countStates - Keep the number of states below each node in
+    /// PTreeNode::numStates from now on.
+    void countStates();
+
     void dump(llvm::raw_ostream &os);
+
+  private:
+    /// The blocks the nodes are allocated in, and the free nodes in them.
+    std::vector<void*> blocks;
+    std::vector<Node*> freeNodes;
+    bool countingStates;
+
+    Node *allocate(Node *parent, const data_type &data);
+    void release(Node *n);
+    void addToCounts(Node *n, int delta);
   };
 
   class PTreeNode {
@@ -39,6 +64,9 @@ namespace klee {
     PTreeNode *parent, *left, *right;
     ExecutionState *data;
     ref<Expr> condition;
+    /// The number of states (leaves) below this node, if the tree counts
+    /// them.
+    unsigned numStates;
 
   private:
     PTreeNode(PTreeNode *_parent, ExecutionState *_data);
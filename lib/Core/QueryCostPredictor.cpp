@@ -0,0 +1,153 @@
+//===-- QueryCostPredictor.cpp --------------------------------------------===//
+//
+//                     The KLEE Symbolic Virtual Machine
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+
+#include "QueryCostPredictor.h"
+
+#include "CoreStats.h"
+
+#include "klee/Constraints.h"
+#include "klee/util/ExprHashMap.h"
+
+#include "llvm/Support/CommandLine.h"
+
+#include <algorithm>
+#include <set>
+
+using namespace klee;
+using namespace llvm;
+
+namespace {
+  cl::opt<unsigned>
+  AdaptiveTimeoutMinSamples("adaptive-solver-timeout-min-samples",
+                            cl::desc("Number of queries like a query which "
+                                     "must have finished or timed out before "
+                                     "its timeout is adapted (default=8)"),
+                            cl::init(8));
+
+  cl::opt<double>
+  AdaptiveTimeoutMin("adaptive-solver-timeout-min",
+                     cl::desc("Shortest timeout (in seconds) given to queries "
+                              "which are unlikely to finish (default=1)"),
+                     cl::init(1.0));
+
+  cl::opt<unsigned>
+  AdaptiveTimeoutRetryInterval("adaptive-solver-timeout-retry-interval",
+                               cl::desc("Retry one in this many queries "
+                                        "whose shorter timeout was not "
+                                        "enough with the full timeout "
+                                        "(default=10)"),
+                               cl::init(10));
+
+  /// Stop looking at a query after this many expressions.
+  const unsigned MaxFeatureNodes = 10000;
+}
+
+static bool isFloatOperation(Expr::Kind k) {
+  return (k >= Expr::FOrd && k <= Expr::FOne) ||
+         (k >= Expr::CastRoundKindFirst && k <= Expr::CastRoundKindLast) ||
+         (k >= Expr::UnaryKindFirst && k <= Expr::UnaryKindLast) ||
+         (k >= Expr::FKindFirst && k != Expr::FConstant);
+}
+
+static uint64_t log2Bucket(uint64_t n) {
+  uint64_t bucket = 0;
+  for (; n; n >>= 1)
+    ++bucket;
+  return bucket;
+}
+
+QueryCostPredictor::Features
+QueryCostPredictor::getFeatures(const ConstraintManager &constraints,
+                                const std::vector< ref<Expr> > &exprs) const {
+  ExprHashSet visited;
+  std::set<const Array*> arrays;
+  std::vector< ref<Expr> > stack(exprs);
+  stack.insert(stack.end(), constraints.begin(), constraints.end());
+  unsigned nodes = 0, fpOps = 0;
+  Expr::Width fpWidth = 0;
+  while (!stack.empty() && nodes != MaxFeatureNodes) {
+    ref<Expr> e = stack.back();
+    stack.pop_back();
+    if (!visited.insert(e).second)
+      continue;
+    ++nodes;
+    if (isFloatOperation(e->getKind())) {
+      ++fpOps;
+      Expr::Width w = isa<FExpr>(e) ? e->getWidth() : e->getKid(0)->getWidth();
+      fpWidth = std::max(fpWidth, w);
+    } else if (const ReadExpr *re = dyn_cast<ReadExpr>(e)) {
+      arrays.insert(re->updates.root);
+    }
+    for (unsigned i = 0, n = e->getNumKids(); i != n; ++i)
+      stack.push_back(e->getKid(i));
+  }
+
+  Features features;
+  features.key = log2Bucket(nodes) | log2Bucket(fpOps) << 8 |
+                 log2Bucket(arrays.size()) << 16 |
+                 log2Bucket(constraints.size()) << 24 |
+                 log2Bucket(fpWidth) << 32;
+  return features;
+}
+
+const QueryCostPredictor::History *
+QueryCostPredictor::getHistory(const Features &features) const {
+  std::map<uint64_t, History>::const_iterator it =
+    histories.find(features.key);
+  if (it == histories.end() ||
+      it->second.finished + it->second.timedOut < AdaptiveTimeoutMinSamples)
+    return 0;
+  return &it->second;
+}
+
+bool QueryCostPredictor::isUnlikelyToFinish(const History &history) const {
+  return history.timedOut > history.finished;
+}
+
+double QueryCostPredictor::getTimeout(const Features &features,
+                                      double timeout) const {
+  const History *history = getHistory(features);
+  if (!history || !isUnlikelyToFinish(*history))
+    return timeout;
+  // Leave the queries which do finish twice the time the slowest took.
+  double shorter = std::max((double) AdaptiveTimeoutMin,
+                            2 * history->longestFinished);
+  return std::min(shorter, timeout);
+}
+
+bool QueryCostPredictor::shouldRetry(const Features &features) {
+  History &history = histories[features.key];
+  if (++history.shortFailures < AdaptiveTimeoutRetryInterval)
+    return false;
+  history.shortFailures = 0;
+  ++stats::timeoutRetries;
+  return true;
+}
+
+void QueryCostPredictor::recordQuery(const Features &features, double timeout,
+                                     double fullTimeout, double elapsed,
+                                     bool timedOut) {
+  bool shortened = timeout < fullTimeout;
+  if (shortened && timedOut)
+    return; // It is not known whether it would have finished.
+
+  if (const History *history = getHistory(features)) {
+    ++stats::timeoutPredictions;
+    if (isUnlikelyToFinish(*history) != timedOut)
+      ++stats::timeoutMispredictions;
+  }
+
+  History &history = histories[features.key];
+  if (timedOut) {
+    ++history.timedOut;
+  } else {
+    ++history.finished;
+    history.longestFinished = std::max(history.longestFinished, elapsed);
+  }
+}
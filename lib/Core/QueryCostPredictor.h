@@ -0,0 +1,81 @@
+//===-- QueryCostPredictor.h ------------------------------------*- C++ -*-===//
+//
+//                     The KLEE Symbolic Virtual Machine
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+
+#ifndef KLEE_QUERYCOSTPREDICTOR_H
+#define KLEE_QUERYCOSTPREDICTOR_H
+
+#include "klee/Expr.h"
+
+#include <map>
+#include <vector>
+
+#include <stdint.h>
+
+namespace klee {
+  class ConstraintManager;
+
+  /// QueryCostPredictor - Learn from the queries issued so far whether
+  /// queries like a given one finish within the solver timeout, so that
+  /// queries which are unlikely to can be given a shorter timeout instead of
+  /// running into the full one.
+  ///
+  /// Queries are told apart by their features, each rounded to a power of
+  /// two: the number of distinct expressions, floating point operations,
+  /// arrays and constraints, and the widest floating point type. Queries with
+  /// the same rounded features share their history.
+  class QueryCostPredictor {
+  public:
+    struct Features {
+      uint64_t key;
+
+      Features() : key(0) {}
+    };
+
+  private:
+    struct History {
+      /// Queries which ran with the full timeout and finished, or timed out.
+      unsigned finished, timedOut;
+      /// Queries given a shorter timeout which it was not enough for, since
+      /// the last one retried with the full timeout.
+      unsigned shortFailures;
+      /// The longest time a query took to finish.
+      double longestFinished;
+
+      History()
+        : finished(0), timedOut(0), shortFailures(0), longestFinished(0) {}
+    };
+
+    std::map<uint64_t, History> histories;
+
+    const History *getHistory(const Features &features) const;
+    bool isUnlikelyToFinish(const History &history) const;
+
+  public:
+    /// getFeatures - The features of a query of \a exprs given
+    /// \a constraints.
+    Features getFeatures(const ConstraintManager &constraints,
+                         const std::vector< ref<Expr> > &exprs) const;
+
+    /// getTimeout - The timeout to give a query with \a features when the
+    /// executor asks for \a timeout.
+    double getTimeout(const Features &features, double timeout) const;
+
+    /// shouldRetry - Whether a query given a shorter timeout which it was
+    /// not enough for should be retried with the full timeout. It is every
+    /// so often, to find out whether queries like it have got cheaper.
+    bool shouldRetry(const Features &features);
+
+    /// recordQuery - Learn that a query with \a features given \a timeout,
+    /// the full one or not, finished in \a elapsed seconds or timed out.
+    void recordQuery(const Features &features, double timeout,
+                     double fullTimeout, double elapsed, bool timedOut);
+  };
+}
+
+#endif
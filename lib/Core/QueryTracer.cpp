@@ -0,0 +1,149 @@
+//===-- QueryTracer.cpp ---------------------------------------------------===//
+//
+//                     The KLEE Symbolic Virtual Machine
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+
+#include "QueryTracer.h"
+
+#include "klee/ExecutionState.h"
+#include "klee/Internal/Module/InstructionInfoTable.h"
+#include "klee/Internal/Module/KInstruction.h"
+#include "klee/Internal/System/Time.h"
+#include "klee/util/ExprHashMap.h"
+
+#include "llvm/Support/TimeValue.h"
+#include "llvm/Support/raw_ostream.h"
+
+using namespace klee;
+
+QueryTracer::QueryTracer(llvm::raw_ostream *_os)
+  : os(_os), startTime(getTime()), kindNamed(Expr::LastKind + 1, false) {
+  writeHeader();
+}
+
+QueryTracer::~QueryTracer() {
+  delete os;
+}
+
+uint64_t QueryTracer::getTime() {
+  return util::getWallTimeVal().usec();
+}
+
+void QueryTracer::restart(llvm::raw_ostream *_os) {
+  delete os;
+  os = _os;
+  // The names have to be repeated in the new trace.
+  fileIds.clear();
+  kindNamed.assign(Expr::LastKind + 1, false);
+  writeHeader();
+}
+
+void QueryTracer::flush() {
+  os->flush();
+}
+
+void QueryTracer::writeHeader() {
+  *os << "KQTR";
+  write32(Version);
+}
+
+void QueryTracer::write8(uint8_t v) {
+  *os << (char) v;
+}
+
+void QueryTracer::write32(uint32_t v) {
+  for (unsigned i = 0; i != 4; ++i)
+    write8((uint8_t) (v >> (8 * i)));
+}
+
+void QueryTracer::write64(uint64_t v) {
+  write32((uint32_t) v);
+  write32((uint32_t) (v >> 32));
+}
+
+void QueryTracer::writeString(const std::string &s) {
+  write32(s.size());
+  os->write(s.data(), s.size());
+}
+
+uint32_t QueryTracer::getFileId(const std::string &file) {
+  // InstructionInfoTable interns its file names, so they can be told apart
+  // by address.
+  std::map<const std::string*, uint32_t>::iterator it = fileIds.find(&file);
+  if (it != fileIds.end())
+    return it->second;
+
+  uint32_t id = fileIds.size();
+  fileIds.insert(std::make_pair(&file, id));
+  write8('F');
+  write32(id);
+  writeString(file);
+  return id;
+}
+
+void QueryTracer::traceQuery(const ExecutionState &state, QueryKind kind,
+                             const std::vector< ref<Expr> > &exprs,
+                             uint64_t start, uint64_t duration,
+                             QueryResult result) {
+  // Count the distinct expressions by kind and width.
+  std::map<std::pair<unsigned, unsigned>, uint32_t> histogram;
+  ExprHashSet visited;
+  std::vector< ref<Expr> > stack(exprs);
+  stack.insert(stack.end(), state.constraints.begin(),
+               state.constraints.end());
+  uint32_t nodes = 0;
+  while (!stack.empty()) {
+    ref<Expr> e = stack.back();
+    stack.pop_back();
+    if (!visited.insert(e).second)
+      continue;
+    ++nodes;
+    ++histogram[std::make_pair((unsigned) e->getKind(), e->getWidth())];
+    for (unsigned i = 0, n = e->getNumKids(); i != n; ++i)
+      stack.push_back(e->getKid(i));
+  }
+
+  // Name what the query record refers to first.
+  uint32_t fileId = UnknownFile, line = 0, assemblyLine = 0;
+  if (state.prevPC) {
+    const InstructionInfo &ii = *state.prevPC->info;
+    fileId = getFileId(ii.file);
+    line = ii.line;
+    assemblyLine = ii.assemblyLine;
+  }
+  for (std::map<std::pair<unsigned, unsigned>, uint32_t>::iterator
+         it = histogram.begin(), ie = histogram.end(); it != ie; ++it) {
+    unsigned k = it->first.first;
+    if (kindNamed[k])
+      continue;
+    kindNamed[k] = true;
+    std::string name;
+    llvm::raw_string_ostream ss(name);
+    Expr::printKind(ss, (Expr::Kind) k);
+    write8('K');
+    write8(k);
+    writeString(ss.str());
+  }
+
+  write8('Q');
+  write8(kind);
+  write8(result);
+  write32(fileId);
+  write32(line);
+  write32(assemblyLine);
+  write32(state.constraints.size());
+  write32(nodes);
+  write64(start >= startTime ? start - startTime : 0);
+  write64(duration);
+  write32(histogram.size());
+  for (std::map<std::pair<unsigned, unsigned>, uint32_t>::iterator
+         it = histogram.begin(), ie = histogram.end(); it != ie; ++it) {
+    write8(it->first.first);
+    write32(it->first.second);
+    write32(it->second);
+  }
+}
@@ -0,0 +1,109 @@
+//===-- QueryTracer.h -------------------------------------------*- C++ -*-===//
+//
+//                     The KLEE Symbolic Virtual Machine
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+
+#ifndef KLEE_QUERYTRACER_H
+#define KLEE_QUERYTRACER_H
+
+#include "klee/Expr.h"
+
+#include <map>
+#include <string>
+#include <vector>
+
+#include <stdint.h>
+
+namespace llvm {
+  class raw_ostream;
+}
+
+namespace klee {
+  class ExecutionState;
+
+  /// QueryTracer - Write a compact binary record of every solver query issued
+  /// by the executor: where it was issued, how large it was, which kinds of
+  /// expressions (at which widths) it contained, how long the solver took and
+  /// what it answered. tools/klee-query-trace turns the trace into summaries,
+  /// flame graphs or Chrome traces.
+  ///
+  /// All integers are little endian. The file starts with the magic "KQTR"
+  /// and a u32 format version, followed by records, each starting with a tag
+  /// byte:
+  ///
+  ///   'F' u32 id, u32 length, bytes     - name of source file \c id
+  ///   'K' u8 kind, u32 length, bytes    - name of expression kind \c kind
+  ///   'Q' u8 query kind, u8 result,
+  ///       u32 file id, u32 line, u32 assembly line,
+  ///       u32 constraints, u32 nodes, u64 start, u64 duration,
+  ///       u32 entries, entries * (u8 kind, u32 width, u32 count)
+  ///
+  /// File and kind names are written once, before the first query using
+  /// them. Times are in microseconds, starts relative to the tracer's
+  /// creation. Nodes counts the distinct expressions of the constraints and
+  /// query expressions (not looking into array updates), which the entries
+  /// break down by kind and width.
+  class QueryTracer {
+  public:
+    enum QueryKind {
+      Evaluate,
+      MustBeTrue,
+      GetValue,
+      GetInitialValues,
+      MayBeTrueMany,
+      GetUniqueValue
+    };
+
+    enum QueryResult {
+      Failed,
+      True,
+      False,
+      Unknown,
+      Done
+    };
+
+    static const uint32_t Version = 1;
+    static const uint32_t UnknownFile = ~0u;
+
+  private:
+    llvm::raw_ostream *os;
+    uint64_t startTime;
+    std::map<const std::string*, uint32_t> fileIds;
+    std::vector<bool> kindNamed;
+
+    void writeHeader();
+    void write8(uint8_t v);
+    void write32(uint32_t v);
+    void write64(uint64_t v);
+    void writeString(const std::string &s);
+    uint32_t getFileId(const std::string &file);
+
+  public:
+    /// Takes ownership of \a os.
+    explicit QueryTracer(llvm::raw_ostream *os);
+    ~QueryTracer();
+
+    /// getTime - The current wall time in microseconds, in the unit of the
+    /// start times passed to traceQuery.
+    static uint64_t getTime();
+
+    /// restart - Continue the trace in \a os (taking ownership), e.g. in a
+    /// worker process which must not share the inherited stream.
+    void restart(llvm::raw_ostream *os);
+
+    void flush();
+
+    /// traceQuery - Record a query over the constraints of \a state, issued
+    /// at its current instruction, which took \a duration microseconds from
+    /// \a start (as returned by getTime).
+    void traceQuery(const ExecutionState &state, QueryKind kind,
+                    const std::vector< ref<Expr> > &exprs, uint64_t start,
+                    uint64_t duration, QueryResult result);
+  };
+}
+
+#endif
@@ -0,0 +1,321 @@
+//===-- RegressionPaths.cpp -----------------------------------------------===//
+//
+//                     The KLEE Symbolic Virtual Machine
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+
+#include "RegressionPaths.h"
+
+#include "klee/ExecutionState.h"
+#include "klee/Config/Version.h"
+
+#if LLVM_VERSION_CODE >= LLVM_VERSION(3, 3)
+#include "llvm/IR/Constants.h"
+#include "llvm/IR/Function.h"
+#include "llvm/IR/GlobalVariable.h"
+#include "llvm/IR/Instructions.h"
+#include "llvm/IR/IntrinsicInst.h"
+#include "llvm/IR/Module.h"
+#else
+#include "llvm/Constants.h"
+#include "llvm/Function.h"
+#include "llvm/GlobalVariable.h"
+#include "llvm/Instructions.h"
+#include "llvm/IntrinsicInst.h"
+#include "llvm/Module.h"
+#endif
+#include "llvm/Support/raw_ostream.h"
+
+#include <algorithm>
+#include <climits>
+#include <cstdlib>
+#include <fstream>
+#include <sstream>
+
+using namespace klee;
+using namespace llvm;
+
+RegressionPaths::~RegressionPaths() {
+  delete out;
+}
+
+/// Describe \a v to \a os: values of the function by their position in
+/// it, and globals by their name along with their contents, or only by
+/// their contents for private ones, whose names are numbered in order. The
+/// globals an initializer refers to are only named.
+static void describeValue(raw_ostream &os, const Value *v,
+                          const std::map<const Value *, unsigned> &numbers,
+                          bool inInitializer = false) {
+  std::map<const Value *, unsigned>::const_iterator it = numbers.find(v);
+  if (it != numbers.end()) {
+    os << '%' << it->second;
+  } else if (const GlobalVariable *gv = dyn_cast<GlobalVariable>(v)) {
+    if (!gv->hasPrivateLinkage() || inInitializer)
+      os << '@' << gv->getName();
+    if (gv->hasInitializer() && !inInitializer) {
+      os << '{';
+      describeValue(os, gv->getInitializer(), numbers, true);
+      os << '}';
+    }
+  } else if (isa<GlobalValue>(v)) {
+    os << '@' << v->getName();
+  } else if (const llvm::ConstantExpr *ce =
+                 dyn_cast<llvm::ConstantExpr>(v)) {
+    os << ce->getOpcodeName() << '(';
+    for (unsigned i = 0, e = ce->getNumOperands(); i != e; ++i) {
+      if (i)
+        os << ',';
+      describeValue(os, ce->getOperand(i), numbers, inInitializer);
+    }
+    os << ')';
+    ce->getType()->print(os);
+  } else {
+    v->print(os);
+  }
+}
+
+uint64_t RegressionPaths::hashFunction(const Function *f) {
+  std::map<const Value *, unsigned> numbers;
+  for (Function::const_arg_iterator it = f->arg_begin(), ie = f->arg_end();
+       it != ie; ++it)
+    numbers.insert(std::make_pair(&*it, (unsigned) numbers.size()));
+  for (Function::const_iterator bb = f->begin(), bbe = f->end(); bb != bbe;
+       ++bb) {
+    numbers.insert(std::make_pair(&*bb, (unsigned) numbers.size()));
+    for (BasicBlock::const_iterator it = bb->begin(), ie = bb->end();
+         it != ie; ++it)
+      numbers.insert(std::make_pair(&*it, (unsigned) numbers.size()));
+  }
+
+  std::string code;
+  raw_string_ostream os(code);
+  f->getFunctionType()->print(os);
+  for (Function::const_iterator bb = f->begin(), bbe = f->end(); bb != bbe;
+       ++bb) {
+    os << "\n%" << numbers[&*bb] << ":";
+    for (BasicBlock::const_iterator it = bb->begin(), ie = bb->end();
+         it != ie; ++it) {
+      const Instruction *inst = &*it;
+      // Their operands are debug information.
+      if (isa<DbgInfoIntrinsic>(inst))
+        continue;
+      os << "\n" << inst->getOpcodeName() << ' ';
+      inst->getType()->print(os);
+      if (const CmpInst *ci = dyn_cast<CmpInst>(inst))
+        os << " p" << (unsigned) ci->getPredicate();
+      for (unsigned i = 0, e = inst->getNumOperands(); i != e; ++i) {
+        os << ' ';
+        describeValue(os, inst->getOperand(i), numbers);
+      }
+      if (const PHINode *phi = dyn_cast<PHINode>(inst))
+        for (unsigned i = 0, e = phi->getNumIncomingValues(); i != e; ++i)
+          os << " %" << numbers[phi->getIncomingBlock(i)];
+    }
+  }
+  os.flush();
+
+  // FNV-1a, which is stable across processes and platforms.
+  uint64_t h = 14695981039346656037ULL;
+  for (std::string::iterator it = code.begin(), ie = code.end(); it != ie;
+       ++it) {
+    h ^= (unsigned char) *it;
+    h *= 1099511628211ULL;
+  }
+  return h;
+}
+
+uint64_t RegressionPaths::getHash(const Function *f) {
+  std::map<const Function *, uint64_t>::iterator it = hashes.find(f);
+  if (it != hashes.end())
+    return it->second;
+  uint64_t h = hashFunction(f);
+  hashes.insert(std::make_pair(f, h));
+  return h;
+}
+
+bool RegressionPaths::load(const std::string &path, std::string &error) {
+  std::ifstream f(path.c_str());
+  if (!f.good()) {
+    error = "unable to open " + path;
+    return false;
+  }
+  loaded = true;
+
+  // The functions of the file, null when they changed.
+  std::map<unsigned, const Function *> functions;
+  std::string line;
+  for (unsigned lineNo = 1; std::getline(f, line); ++lineNo) {
+    if (line.empty() || line[0] == '#')
+      continue;
+    std::istringstream fields(line);
+    std::string kind;
+    fields >> kind;
+
+    if (kind == "f") {
+      unsigned id;
+      uint64_t hash;
+      std::string name;
+      if (!(fields >> id >> hash >> name)) {
+        std::stringstream where;
+        where << path << ":" << lineNo << ": invalid function";
+        error = where.str();
+        return false;
+      }
+      const Function *fn = module->getFunction(name);
+      if (fn && (fn->isDeclaration() || getHash(fn) != hash))
+        fn = 0;
+      functions[id] = fn;
+      continue;
+    }
+
+    std::string calls, branches;
+    if (kind != "p" || !(fields >> calls)) {
+      std::stringstream where;
+      where << path << ":" << lineNo << ": invalid line";
+      error = where.str();
+      return false;
+    }
+    fields >> branches;
+
+    // The path can be replayed up to its first call of a changed function.
+    Path p;
+    unsigned replayable = UINT_MAX;
+    std::istringstream callFields(calls);
+    std::string call;
+    while (std::getline(callFields, call, ',')) {
+      std::string::size_type at = call.find('@');
+      if (at == std::string::npos)
+        continue;
+      unsigned position = atoi(call.c_str() + at + 1);
+      if (call[0] == '*') {
+        replayable = std::min(replayable, position);
+        continue;
+      }
+      std::map<unsigned, const Function *>::iterator it =
+        functions.find(atoi(call.c_str()));
+      if (it == functions.end() || !it->second)
+        replayable = std::min(replayable, position);
+      else
+        p.calls.push_back(std::make_pair(it->second, position));
+    }
+    for (std::string::iterator it = branches.begin(), ie = branches.end();
+         it != ie; ++it)
+      p.branches.push_back(*it == '1');
+
+    if (replayable == UINT_MAX) {
+      unchangedPaths.push_back(p);
+    } else {
+      if (replayable < p.branches.size())
+        p.branches.resize(replayable);
+      prefixes.push_back(p.branches);
+    }
+  }
+  return true;
+}
+
+/// Whether \a prefix is a prefix of \a path.
+static bool isPrefix(const std::vector<bool> &prefix,
+                     const std::vector<bool> &path) {
+  return prefix.size() <= path.size() &&
+         std::equal(prefix.begin(), prefix.end(), path.begin());
+}
+
+void RegressionPaths::finishLoading() {
+  // Once sorted, the prefixes extending one come right after it.
+  std::sort(prefixes.begin(), prefixes.end());
+  std::vector<std::vector<bool> > shortest;
+  for (std::vector<std::vector<bool> >::iterator it = prefixes.begin(),
+         ie = prefixes.end(); it != ie; ++it)
+    if (shortest.empty() || !isPrefix(shortest.back(), *it))
+      shortest.push_back(*it);
+  prefixes.swap(shortest);
+
+  std::vector<Path> kept;
+  for (std::vector<Path>::iterator it = unchangedPaths.begin(),
+         ie = unchangedPaths.end(); it != ie; ++it) {
+    std::vector<std::vector<bool> >::iterator next =
+      std::upper_bound(prefixes.begin(), prefixes.end(), it->branches);
+    if (next == prefixes.begin() || !isPrefix(*(next - 1), it->branches))
+      kept.push_back(*it);
+  }
+  unchangedPaths.swap(kept);
+}
+
+void RegressionPaths::setOutput(raw_ostream *os, bool carryOver) {
+  delete out;
+  out = os;
+  functionIds.clear();
+  if (!out)
+    return;
+  *out << "# KLEE regression paths: functions entered and branches taken\n";
+  if (!carryOver)
+    return;
+
+  for (std::vector<Path>::iterator it = unchangedPaths.begin(),
+         ie = unchangedPaths.end(); it != ie; ++it) {
+    std::vector<unsigned char> branches;
+    for (std::vector<bool>::iterator bit = it->branches.begin(),
+           bie = it->branches.end(); bit != bie; ++bit)
+      branches.push_back(*bit ? '1' : '0');
+    writePath(it->calls, -1, branches);
+  }
+}
+
+void RegressionPaths::flush() {
+  if (out)
+    out->flush();
+}
+
+void RegressionPaths::writePath(
+    const std::vector<std::pair<const Function *, unsigned> > &calls,
+    int replayable, const std::vector<unsigned char> &branches) {
+  for (std::vector<std::pair<const Function *, unsigned> >::const_iterator
+         it = calls.begin(), ie = calls.end(); it != ie; ++it) {
+    if (functionIds.count(it->first))
+      continue;
+    unsigned id = functionIds.size();
+    functionIds[it->first] = id;
+    *out << "f " << id << " " << getHash(it->first) << " "
+         << it->first->getName() << "\n";
+  }
+
+  *out << "p ";
+  if (calls.empty() && replayable < 0)
+    *out << "-";
+  bool first = true;
+  for (std::vector<std::pair<const Function *, unsigned> >::const_iterator
+         it = calls.begin(), ie = calls.end(); it != ie; ++it) {
+    if (!first)
+      *out << ",";
+    first = false;
+    *out << functionIds[it->first] << "@" << it->second;
+  }
+  if (replayable >= 0)
+    *out << (first ? "" : ",") << "*@" << replayable;
+  *out << " ";
+  if (!branches.empty())
+    out->write((const char *) &branches[0], branches.size());
+  *out << "\n";
+}
+
+void RegressionPaths::record(const ExecutionState &state,
+                             const std::vector<unsigned char> &branches,
+                             bool complete) {
+  if (!out)
+    return;
+
+  std::vector<std::pair<const Function *, unsigned> > calls;
+  for (ImmutableMap<const Function *, unsigned>::iterator
+         it = state.firstCalls.begin(), ie = state.firstCalls.end();
+       it != ie; ++it)
+    calls.push_back(*it);
+  int replayable = -1;
+  if (state.tookMultiWayBranch)
+    replayable = state.multiWayBranchPosition;
+  else if (!complete)
+    replayable = branches.size();
+  writePath(calls, replayable, branches);
+}
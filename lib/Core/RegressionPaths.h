@@ -0,0 +1,108 @@
+//===-- RegressionPaths.h ---------------------------------------*- C++ -*-===//
+//
+//                     The KLEE Symbolic Virtual Machine
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+
+#ifndef KLEE_REGRESSIONPATHS_H
+#define KLEE_REGRESSIONPATHS_H
+
+#include <map>
+#include <string>
+#include <vector>
+
+#include <stdint.h>
+
+namespace llvm {
+  class Function;
+  class Module;
+  class raw_ostream;
+}
+
+namespace klee {
+  class ExecutionState;
+
+  /// RegressionPaths - The paths explored, with the functions each entered,
+  /// for a later run on another version of the program to explore again
+  /// only where the code changed (see -regression-baseline).
+  ///
+  /// A path is recorded as its branch decisions along with the number of
+  /// decisions taken when it first entered each function, and the hash of
+  /// the code of these functions. Up to its first call of a function whose
+  /// code changed, a path takes the same decisions in both versions: such a
+  /// prefix is followed without the solver, and the rest of its subtree
+  /// explored. A path which only entered unchanged functions is not
+  /// explored again, it is carried over to the paths of the new run.
+  ///
+  /// The paths are written to regression.paths as lines of the form
+  ///
+  ///   f <id> <hash> <name>       - a function, defined before its first use
+  ///   p <id>@<n>,... <branches>  - a path, entering function <id> after
+  ///                                <n> branches, or "*@<n>" when it cannot
+  ///                                be replayed past <n> branches
+  ///
+  /// with the branches as '0' and '1' characters, as in checkpoints.
+  class RegressionPaths {
+    /// A path of the baseline which only entered unchanged functions.
+    struct Path {
+      std::vector<std::pair<const llvm::Function *, unsigned> > calls;
+      std::vector<bool> branches;
+    };
+
+    llvm::Module *module;
+    std::map<const llvm::Function *, uint64_t> hashes;
+
+    std::vector<std::vector<bool> > prefixes;
+    std::vector<Path> unchangedPaths;
+    bool loaded;
+
+    llvm::raw_ostream *out;
+    /// The ids of the functions defined in \c out so far.
+    std::map<const llvm::Function *, unsigned> functionIds;
+
+    uint64_t getHash(const llvm::Function *f);
+    void writePath(
+        const std::vector<std::pair<const llvm::Function *, unsigned> > &calls,
+        int replayable, const std::vector<unsigned char> &branches);
+
+  public:
+    explicit RegressionPaths(llvm::Module *_module)
+        : module(_module), loaded(false), out(0) {}
+    ~RegressionPaths();
+
+    /// hashFunction - A hash of the code of \a f, which does not depend on
+    /// the names of its values, its debug locations or the rest of the
+    /// module.
+    static uint64_t hashFunction(const llvm::Function *f);
+
+    /// load - Read the paths of the baseline file \a path.
+    bool load(const std::string &path, std::string &error);
+
+    /// finishLoading - Leave the prefixes to explore: the shortest of
+    /// those reaching changed code, each one once. The unchanged paths
+    /// explored again below them are dropped.
+    void finishLoading();
+
+    /// hasBaseline - Whether paths of an earlier run were loaded.
+    bool hasBaseline() const { return loaded; }
+    const std::vector<std::vector<bool> > &getPrefixes() const {
+      return prefixes;
+    }
+    unsigned getNumUnchangedPaths() const { return unchangedPaths.size(); }
+
+    /// setOutput - Write the paths recorded from now on to \a os, starting
+    /// with the unchanged paths of the baseline if \a carryOver is set.
+    void setOutput(llvm::raw_ostream *os, bool carryOver);
+    void flush();
+
+    /// record - Record the path \a branches of \a state, which was
+    /// explored completely unless \a complete is false.
+    void record(const ExecutionState &state,
+                const std::vector<unsigned char> &branches, bool complete);
+  };
+}
+
+#endif
@@ -0,0 +1,136 @@
+//===-- SamplingProfiler.cpp ----------------------------------------------===//
+//
+//                     The KLEE Symbolic Virtual Machine
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+
+#include "SamplingProfiler.h"
+
+#include "klee/CommandLine.h"
+#include "klee/Config/Version.h"
+#include "klee/ExecutionState.h"
+#include "klee/Internal/Module/InstructionInfoTable.h"
+#include "klee/Internal/Module/KInstruction.h"
+#include "klee/Internal/Module/KModule.h"
+#include "klee/Internal/Support/ErrorHandling.h"
+#include "klee/Solver.h"
+
+#if LLVM_VERSION_CODE >= LLVM_VERSION(3, 3)
+#include "llvm/IR/Function.h"
+#else
+#include "llvm/Function.h"
+#endif
+#include "llvm/Support/raw_ostream.h"
+
+#include <errno.h>
+#include <string.h>
+#include <sys/time.h>
+
+using namespace klee;
+
+volatile sig_atomic_t SamplingProfiler::current = SamplingProfiler::Interpreter;
+volatile sig_atomic_t SamplingProfiler::pending = 0;
+volatile sig_atomic_t SamplingProfiler::samples[NumActivities];
+
+static std::string activityName(SamplingProfiler::Activity activity) {
+  switch (activity) {
+  case SamplingProfiler::Interpreter: return "[interpreter]";
+  case SamplingProfiler::Searcher: return "[searcher]";
+  case SamplingProfiler::MemoryResolution: return "[memory resolution]";
+  case SamplingProfiler::TestOutput: return "[test output]";
+  case SamplingProfiler::Solver:
+    return std::string("[solver: ") + getCoreSolverName(CoreSolverToUse) + "]";
+  default: return "[unknown]";
+  }
+}
+
+SamplingProfiler::SamplingProfiler(double _rate) : rate(_rate) {
+  struct sigaction sa;
+  memset(&sa, 0, sizeof sa);
+  sa.sa_handler = onSample;
+  // Restart system calls rather than fail them with EINTR at every sample.
+  sa.sa_flags = SA_RESTART;
+  sigemptyset(&sa.sa_mask);
+  sigaction(SIGPROF, &sa, 0);
+  start();
+}
+
+SamplingProfiler::~SamplingProfiler() {
+  stop();
+}
+
+void SamplingProfiler::onSample(int) {
+  ++samples[current];
+  pending = 1;
+}
+
+void SamplingProfiler::start() {
+  struct itimerval t;
+  double interval = 1. / rate;
+  t.it_interval.tv_sec = (long) interval;
+  t.it_interval.tv_usec = (long) ((interval - (long) interval) * 1000000);
+  if (!t.it_interval.tv_sec && !t.it_interval.tv_usec)
+    t.it_interval.tv_usec = 1;
+  t.it_value = t.it_interval;
+  if (setitimer(ITIMER_PROF, &t, 0) < 0)
+    klee_warning("unable to start the sampling profiler: %s",
+                 strerror(errno));
+}
+
+void SamplingProfiler::stop() {
+  struct itimerval t;
+  memset(&t, 0, sizeof t);
+  setitimer(ITIMER_PROF, &t, 0);
+}
+
+void SamplingProfiler::takeSamples(const ExecutionState *state) {
+  // Take the counts with the signal blocked, so that none is lost.
+  unsigned counts[NumActivities];
+  sigset_t block, old;
+  sigemptyset(&block);
+  sigaddset(&block, SIGPROF);
+  sigprocmask(SIG_BLOCK, &block, &old);
+  for (unsigned i = 0; i < NumActivities; ++i) {
+    counts[i] = samples[i];
+    samples[i] = 0;
+  }
+  pending = 0;
+  sigprocmask(SIG_SETMASK, &old, 0);
+
+  std::string stack;
+  if (state) {
+    for (ExecutionState::stack_ty::const_iterator it = state->stack.begin(),
+                                                  ie = state->stack.end();
+         it != ie; ++it)
+      stack += it->kf->function->getName().str() + ";";
+    if (const InstructionInfo *info = state->prevPC->info) {
+      std::string line;
+      llvm::raw_string_ostream ls(line);
+      ls << (info->file.empty() ? "??" : info->file) << ":" << info->line;
+      stack += ls.str() + ";";
+    }
+  }
+
+  for (unsigned i = 0; i < NumActivities; ++i) {
+    if (!counts[i])
+      continue;
+    std::string name = activityName((Activity) i);
+    // The searcher picks the next state, it does not work for this one.
+    if (i == Searcher)
+      stacks[name] += counts[i];
+    else
+      stacks[stack + name] += counts[i];
+  }
+}
+
+void SamplingProfiler::write(llvm::raw_ostream &os) {
+  if (pending)
+    takeSamples(0);
+  for (std::map<std::string, uint64_t>::iterator it = stacks.begin(),
+                                                 ie = stacks.end();
+       it != ie; ++it)
+    os << it->first << " " << it->second << "\n";
+}
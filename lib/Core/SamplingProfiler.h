@@ -0,0 +1,92 @@
+//===-- SamplingProfiler.h --------------------------------------*- C++ -*-===//
+//
+//                     The KLEE Symbolic Virtual Machine
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+
+#ifndef KLEE_SAMPLINGPROFILER_H
+#define KLEE_SAMPLINGPROFILER_H
+
+#include <map>
+#include <string>
+
+#include <signal.h>
+#include <stdint.h>
+
+namespace llvm {
+  class raw_ostream;
+}
+
+namespace klee {
+  class ExecutionState;
+
+  /// SamplingProfiler - Find out where klee spends its time, in terms of the
+  /// program under test, without timing every instruction.
+  ///
+  /// A SIGPROF timer counts samples by what klee is doing at the time (see
+  /// Scope). Between instructions the executor hands over the state it just
+  /// stepped, and the samples taken meanwhile are charged to the state's
+  /// stack and source line. Samples taken in the searcher belong to no
+  /// state and are charged to the searcher alone.
+  ///
+  /// The profile is written in the folded stack format of flamegraph.pl,
+  /// one "frame;frame;... count" line per stack, outermost frame first.
+  class SamplingProfiler {
+  public:
+    enum Activity {
+      Interpreter,
+      Solver,
+      Searcher,
+      MemoryResolution,
+      TestOutput,
+      NumActivities
+    };
+
+    /// Scope - Charge the samples taken during the lifetime of an object
+    /// to \a activity. Scopes nest, the innermost one wins.
+    class Scope {
+      sig_atomic_t saved;
+
+    public:
+      explicit Scope(Activity activity) : saved(current) {
+        current = activity;
+      }
+      ~Scope() { current = saved; }
+    };
+
+  private:
+    static volatile sig_atomic_t current;
+    static volatile sig_atomic_t pending;
+    static volatile sig_atomic_t samples[NumActivities];
+
+    double rate;
+    std::map<std::string, uint64_t> stacks;
+
+    static void onSample(int);
+    void takeSamples(const ExecutionState *state);
+
+  public:
+    /// Take \a rate samples per second of CPU time.
+    explicit SamplingProfiler(double rate);
+    ~SamplingProfiler();
+
+    /// start - Start or restart the timer, which forked processes do not
+    /// inherit.
+    void start();
+    void stop();
+
+    /// sample - Charge the samples taken since the last call to \a state,
+    /// which just executed an instruction. Cheap unless there are any.
+    void sample(const ExecutionState &state) {
+      if (pending)
+        takeSamples(&state);
+    }
+
+    void write(llvm::raw_ostream &os);
+  };
+}
+
+#endif
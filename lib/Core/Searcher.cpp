@@ -11,6 +11,8 @@
 
 #include "CoreStats.h"
 #include "Executor.h"
+#include "FloatConcretizationPolicy.h"
+#include "FloatCoverage.h"
 #include "PTree.h"
 #include "StatsTracker.h"
 
@@ -24,6 +26,7 @@
 #include "klee/Internal/Support/ModuleUtil.h"
 #include "klee/Internal/System/Time.h"
 #include "klee/Internal/Support/ErrorHandling.h"
+#include "klee/util/ExprHashMap.h"
 #if LLVM_VERSION_CODE >= LLVM_VERSION(3, 3)
 #include "llvm/IR/Constants.h"
 #include "llvm/IR/Instructions.h"
@@ -37,11 +40,16 @@
 
 #if LLVM_VERSION_CODE < LLVM_VERSION(3, 5)
 #include "llvm/Support/CallSite.h"
+#include "llvm/Support/CFG.h"
 #else
 #include "llvm/IR/CallSite.h"
+#include "llvm/IR/CFG.h"
 #endif
 
+#include <algorithm>
 #include <cassert>
+#include <cmath>
+#include <cstdlib>
 #include <fstream>
 #include <climits>
 
@@ -51,6 +59,13 @@ using namespace llvm;
 namespace {
   cl::opt<bool>
   DebugLogMerge("debug-log-merge");
+
+  cl::opt<bool>
+  WeightedRandomPath("weighted-random-path",
+                     cl::desc("Make random-path take each side of a branch "
+                              "in proportion to the number of states on "
+                              "it, instead of with even odds (default=off)"),
+                     cl::init(false));
 }
 
 namespace klee {
@@ -69,29 +84,19 @@ ExecutionState &DFSSearcher::selectState() {
 void DFSSearcher::update(ExecutionState *current,
                          const std::vector<ExecutionState *> &addedStates,
                          const std::vector<ExecutionState *> &removedStates) {
-  states.insert(states.end(),
-                addedStates.begin(),
-                addedStates.end());
+  for (std::vector<ExecutionState *>::const_iterator it = addedStates.begin(),
+                                                     ie = addedStates.end();
+       it != ie; ++it)
+    positions[*it] = states.insert(states.end(), *it);
   for (std::vector<ExecutionState *>::const_iterator it = removedStates.begin(),
                                                      ie = removedStates.end();
        it != ie; ++it) {
-    ExecutionState *es = *it;
-    if (es == states.back()) {
-      states.pop_back();
-    } else {
-      bool ok = false;
-
-      for (std::vector<ExecutionState*>::iterator it = states.begin(),
-             ie = states.end(); it != ie; ++it) {
-        if (es==*it) {
-          states.erase(it);
-          ok = true;
-          break;
-        }
-      }
-
-      assert(ok && "invalid state removed");
-    }
+    llvm::DenseMap<ExecutionState*,
+                   std::list<ExecutionState*>::iterator>::iterator pos =
+      positions.find(*it);
+    assert(pos != positions.end() && "invalid state removed");
+    states.erase(pos->second);
+    positions.erase(pos);
   }
 }
 
@@ -110,33 +115,23 @@ void BFSSearcher::update(ExecutionState *current,
       std::find(removedStates.begin(), removedStates.end(), current) ==
           removedStates.end()) {
     assert(states.front() == current);
-    states.pop_front();
-    states.push_back(current);
+    // Moving the node keeps its position valid.
+    states.splice(states.end(), states, states.begin());
   }
 
-  states.insert(states.end(),
-                addedStates.begin(),
-                addedStates.end());
+  for (std::vector<ExecutionState *>::const_iterator it = addedStates.begin(),
+                                                     ie = addedStates.end();
+       it != ie; ++it)
+    positions[*it] = states.insert(states.end(), *it);
   for (std::vector<ExecutionState *>::const_iterator it = removedStates.begin(),
                                                      ie = removedStates.end();
        it != ie; ++it) {
-    ExecutionState *es = *it;
-    if (es == states.front()) {
-      states.pop_front();
-    } else {
-      bool ok = false;
-
-      for (std::deque<ExecutionState*>::iterator it = states.begin(),
-             ie = states.end(); it != ie; ++it) {
-        if (es==*it) {
-          states.erase(it);
-          ok = true;
-          break;
-        }
-      }
-
-      assert(ok && "invalid state removed");
-    }
+    llvm::DenseMap<ExecutionState*,
+                   std::list<ExecutionState*>::iterator>::iterator pos =
+      positions.find(*it);
+    assert(pos != positions.end() && "invalid state removed");
+    states.erase(pos->second);
+    positions.erase(pos);
   }
 }
 
@@ -150,33 +145,32 @@ void
 RandomSearcher::update(ExecutionState *current,
                        const std::vector<ExecutionState *> &addedStates,
                        const std::vector<ExecutionState *> &removedStates) {
-  states.insert(states.end(),
-                addedStates.begin(),
-                addedStates.end());
+  for (std::vector<ExecutionState *>::const_iterator it = addedStates.begin(),
+                                                     ie = addedStates.end();
+       it != ie; ++it) {
+    indices[*it] = states.size();
+    states.push_back(*it);
+  }
   for (std::vector<ExecutionState *>::const_iterator it = removedStates.begin(),
                                                      ie = removedStates.end();
        it != ie; ++it) {
-    ExecutionState *es = *it;
-    bool ok = false;
-
-    for (std::vector<ExecutionState*>::iterator it = states.begin(),
-           ie = states.end(); it != ie; ++it) {
-      if (es==*it) {
-        states.erase(it);
-        ok = true;
-        break;
-      }
-    }
-    
-    assert(ok && "invalid state removed");
+    llvm::DenseMap<ExecutionState*, unsigned>::iterator index =
+      indices.find(*it);
+    assert(index != indices.end() && "invalid state removed");
+    ExecutionState *last = states.back();
+    states[index->second] = last;
+    indices[last] = index->second;
+    states.pop_back();
+    indices.erase(*it);
   }
 }
 
 ///
 
-WeightedRandomSearcher::WeightedRandomSearcher(WeightType _type)
+WeightedRandomSearcher::WeightedRandomSearcher(
+    WeightType _type, const FloatCoverage *_floatCoverage)
     : states(new DiscretePDF<ExecutionState *, ExecutionStateLessThanCmp>()),
-      type(_type) {
+      type(_type), floatCoverage(_floatCoverage) {
   switch(type) {
   case Depth: 
     updateWeights = false;
@@ -186,6 +180,8 @@ WeightedRandomSearcher::WeightedRandomSearcher(WeightType _type)
   case QueryCost:
   case MinDistToUncovered:
   case CoveringNew:
+  case FPCost:
+  case FPCoverage:
     updateWeights = true;
     break;
   default:
@@ -197,7 +193,121 @@ WeightedRandomSearcher::~WeightedRandomSearcher() {
   delete states;
 }
 
+/// getNodeCost - A rough relative cost of \a e for the solver, where most
+/// integer nodes are cheap, and floating point arithmetic, in particular
+/// division and square roots, gets more expensive with the precision.
+static double getNodeCost(const ref<Expr> &e) {
+  Expr::Kind k = e->getKind();
+  switch (k) {
+  case Expr::Mul:
+    return 0.1 * e->getWidth() / 32;
+  case Expr::UDiv:
+  case Expr::SDiv:
+  case Expr::URem:
+  case Expr::SRem:
+    return 0.4 * e->getWidth() / 32;
+  default:
+    break;
+  }
+
+  double cost;
+  switch (k) {
+  case Expr::FDiv:
+  case Expr::FSqrt:
+  case Expr::FRem:
+    cost = 4.;
+    break;
+  case Expr::FFma:
+    cost = 1.5;
+    break;
+  case Expr::FMul:
+    cost = 1.;
+    break;
+  case Expr::FAdd:
+  case Expr::FSub:
+    cost = 0.5;
+    break;
+  case Expr::FToU:
+  case Expr::FToS:
+  case Expr::UToF:
+  case Expr::SToF:
+  case Expr::FExt:
+  case Expr::FNearbyInt:
+    cost = 0.25;
+    break;
+  default:
+    if (k < Expr::FpClassify || (k > Expr::FIsInf && k < Expr::FOrd))
+      return 0.01;
+    cost = 0.1;
+    break;
+  }
+
+  // Comparisons and classifications are boolean, the precision is the one of
+  // their operands.
+  Expr::Width width = e->getWidth();
+  for (unsigned i = 0, n = e->getNumKids(); i != n; ++i)
+    width = std::max(width, e->getKid(i)->getWidth());
+  if (width > Expr::Int64)
+    return cost * 4;
+  if (width > Expr::Int32)
+    return cost * 2.5;
+  return cost;
+}
+
+/// getConstraintCost - Estimate how expensive the constraints of \a es make
+/// its next query. As constraints are only ever added, only the new ones are
+/// looked at; when simplification dropped some, all are counted again.
+static double getConstraintCost(ExecutionState *es) {
+  const ConstraintManager &cm = es->constraints;
+  if (cm.size() < es->constraintCostCount) {
+    es->constraintCost = 0.;
+    es->constraintCostCount = 0;
+  }
+  if (cm.size() == es->constraintCostCount)
+    return es->constraintCost;
+
+  ExprHashSet visited;
+  std::vector< ref<Expr> > stack(cm.begin() + es->constraintCostCount,
+                                 cm.end());
+  while (!stack.empty()) {
+    ref<Expr> e = stack.back();
+    stack.pop_back();
+    if (isa<klee::ConstantExpr>(e) || !visited.insert(e).second)
+      continue;
+    es->constraintCost += getNodeCost(e);
+    for (unsigned i = 0, n = e->getNumKids(); i != n; ++i)
+      stack.push_back(e->getKid(i));
+  }
+  es->constraintCostCount = cm.size();
+  return es->constraintCost;
+}
+
+WeightedRandomSearcher::WeightInputs::WeightInputs(ExecutionState *es)
+  : block(es->pc->inst->getParent()),
+    coveredInstructions(stats::coveredInstructions),
+    floatClassesCovered(stats::floatClassesCovered),
+    numConstraints(es->constraints.size()),
+    queryCost(es->queryCost),
+    pending(false) {}
+
+void WeightedRandomSearcher::updatePendingWeights() {
+  for (std::vector<ExecutionState *>::iterator it = pendingUpdates.begin(),
+                                               ie = pendingUpdates.end();
+       it != ie; ++it) {
+    std::map<ExecutionState*, WeightInputs>::iterator wi =
+      weightInputs.find(*it);
+    // Skip states removed since.
+    if (wi == weightInputs.end() || !wi->second.pending)
+      continue;
+    wi->second = WeightInputs(*it);
+    ++stats::searcherWeightUpdates;
+    states->update(*it, getWeight(*it));
+  }
+  pendingUpdates.clear();
+}
+
 ExecutionState &WeightedRandomSearcher::selectState() {
+  updatePendingWeights();
   return *states->choose(theRNG.getDoubleL());
 }
 
@@ -220,6 +330,28 @@ double WeightedRandomSearcher::getWeight(ExecutionState *es) {
   }
   case QueryCost:
     return (es->queryCost < .1) ? 1. : 1./es->queryCost;
+  case FPCost: {
+    // Favour states whose next queries are expected to be cheap, taking the
+    // time their past queries actually took into account as well.
+    double cost = getConstraintCost(es) + es->queryCost;
+    double inv = 1. / (1. + cost);
+    return inv * inv;
+  }
+  case FPCoverage: {
+    // Favour states about to run floating point operations whose results
+    // were not seen in every IEEE class yet, in the rest of their block.
+    unsigned unseen = 0;
+    for (KInstIterator it = es->pc;; ++it) {
+      KInstruction *ki = it;
+      if (FloatCoverage::isTracked(ki)) {
+        for (unsigned m = floatCoverage->getUnseen(ki); m; m &= m - 1)
+          ++unseen;
+      }
+      if (ki->inst == ki->inst->getParent()->getTerminator())
+        break;
+    }
+    return (1. + unseen) * (1. + unseen);
+  }
   case CoveringNew:
   case MinDistToUncovered: {
     uint64_t md2u = computeMinDistToUncovered(es->pc,
@@ -243,13 +375,21 @@ void WeightedRandomSearcher::update(
     const std::vector<ExecutionState *> &removedStates) {
   if (current && updateWeights &&
       std::find(removedStates.begin(), removedStates.end(), current) ==
-          removedStates.end())
-    states->update(current, getWeight(current));
+          removedStates.end()) {
+    WeightInputs &wi = weightInputs[current];
+    if (!wi.pending && !(wi == WeightInputs(current))) {
+      wi.pending = true;
+      pendingUpdates.push_back(current);
+    }
+  }
 
   for (std::vector<ExecutionState *>::const_iterator it = addedStates.begin(),
                                                      ie = addedStates.end();
        it != ie; ++it) {
     ExecutionState *es = *it;
+    if (updateWeights)
+      weightInputs[es] = WeightInputs(es);
+    ++stats::searcherWeightUpdates;
     states->insert(es, getWeight(es));
   }
 
@@ -257,6 +397,7 @@ void WeightedRandomSearcher::update(
                                                      ie = removedStates.end();
        it != ie; ++it) {
     states->remove(*it);
+    weightInputs.erase(*it);
   }
 }
 
@@ -266,6 +407,131 @@ bool WeightedRandomSearcher::empty() {
 
 ///
 
+DirectedSearcher::DirectedSearcher(Executor &_executor,
+                                   const std::vector<std::string> &targets)
+    : executor(_executor) {
+  KModule *km = executor.kmodule;
+  std::vector<unsigned> targetIds;
+  for (std::vector<std::string>::const_iterator it = targets.begin(),
+         ie = targets.end(); it != ie; ++it) {
+    std::string::size_type colon = it->rfind(':');
+    unsigned line = 0;
+    if (colon != std::string::npos &&
+        it->find_first_not_of("0123456789", colon + 1) == std::string::npos)
+      line = strtoul(it->c_str() + colon + 1, 0, 10);
+    if (!line)
+      klee_error("invalid target: %s (expected file:line)", it->c_str());
+    std::string file = it->substr(0, colon);
+
+    unsigned found = 0;
+    for (std::vector<KFunction*>::iterator fit = km->functions.begin(),
+           fie = km->functions.end(); fit != fie; ++fit) {
+      KFunction *kf = *fit;
+      for (unsigned i = 0; i != kf->numInstructions; ++i) {
+        const InstructionInfo &info = *kf->instructions[i]->info;
+        if (info.line != line ||
+            !FloatConcretizationPolicy::matchesFile(info.file, file))
+          continue;
+        targetIds.push_back(info.id);
+        ++found;
+      }
+    }
+    if (!found)
+      klee_error("no instruction at target %s", it->c_str());
+  }
+
+  executor.statsTracker->computeMinDistToTargets(targetIds, distToTarget);
+}
+
+uint64_t DirectedSearcher::getDistance(const KInstruction *ki,
+                                       uint64_t distAtRA) {
+  uint64_t distLocal = distToTarget[ki->info->id];
+  if (distAtRA==0) // unreachable on return, best is local
+    return distLocal;
+
+  uint64_t distToReturn =
+    theStatisticManager->getIndexedValue(stats::minDistToReturn,
+                                         ki->info->id);
+  if (distToReturn==0) // return unreachable, best is local
+    return distLocal;
+  if (!distLocal) // no local reachable
+    return distToReturn + distAtRA;
+  return std::min(distLocal, distToReturn + distAtRA);
+}
+
+uint64_t DirectedSearcher::getDistance(ExecutionState *es) {
+  uint64_t dist = 0;
+  for (ExecutionState::stack_ty::iterator sfIt = es->stack.begin(),
+         sf_ie = es->stack.end(); sfIt != sf_ie; ++sfIt) {
+    ExecutionState::stack_ty::iterator next = sfIt + 1;
+    KInstIterator kii;
+
+    if (next==es->stack.end()) {
+      kii = es->pc;
+    } else {
+      kii = next->caller;
+      ++kii;
+    }
+
+    dist = getDistance(kii, dist);
+  }
+
+  // Unreachable states sort last.
+  return dist ? dist : UINT64_MAX;
+}
+
+ExecutionState &DirectedSearcher::selectState() {
+  // Terminate the states which cannot reach a target once the closest one
+  // still can. Otherwise, carry on with the last of them.
+  if (states.begin()->first != UINT64_MAX) {
+    while (states.rbegin()->first == UINT64_MAX) {
+      ExecutionState *es = states.rbegin()->second;
+      states.erase(--states.end());
+      distances.erase(es);
+      executor.terminateStateEarly(*es, "target unreachable");
+    }
+  }
+  return *states.begin()->second;
+}
+
+void DirectedSearcher::update(
+    ExecutionState *current, const std::vector<ExecutionState *> &addedStates,
+    const std::vector<ExecutionState *> &removedStates) {
+  std::vector<ExecutionState *> toUpdate(addedStates);
+  if (current && std::find(removedStates.begin(), removedStates.end(),
+                           current) == removedStates.end())
+    toUpdate.push_back(current);
+
+  for (std::vector<ExecutionState *>::const_iterator it = removedStates.begin(),
+                                                     ie = removedStates.end();
+       it != ie; ++it) {
+    std::map<ExecutionState*, uint64_t>::iterator dit = distances.find(*it);
+    if (dit == distances.end())
+      continue; // already terminated as unreachable
+    states.erase(std::make_pair(dit->second, *it));
+    distances.erase(dit);
+  }
+
+  for (std::vector<ExecutionState *>::iterator it = toUpdate.begin(),
+                                               ie = toUpdate.end();
+       it != ie; ++it) {
+    ExecutionState *es = *it;
+    uint64_t dist = getDistance(es);
+    std::map<ExecutionState*, uint64_t>::iterator dit = distances.find(es);
+    if (dit != distances.end()) {
+      if (dit->second == dist)
+        continue;
+      states.erase(std::make_pair(dit->second, es));
+      dit->second = dist;
+    } else {
+      distances.insert(std::make_pair(es, dist));
+    }
+    states.insert(std::make_pair(dist, es));
+  }
+}
+
+///
+
 RandomPathSearcher::RandomPathSearcher(Executor &_executor)
   : executor(_executor) {
 }
@@ -274,15 +540,18 @@ RandomPathSearcher::~RandomPathSearcher() {
 }
 
 ExecutionState &RandomPathSearcher::selectState() {
-  unsigned flips=0, bits=0;
   PTree::Node *n = executor.processTree->root;
-  
-  while (!n->data) {
-    if (!n->left) {
-      n = n->right;
-    } else if (!n->right) {
-      n = n->left;
-    } else {
+
+  // Every branch of the tree has two sides.
+  if (WeightedRandomPath) {
+    executor.processTree->countStates();
+    while (!n->data) {
+      unsigned pick = theRNG.getInt32() % n->numStates;
+      n = (pick < n->left->numStates) ? n->left : n->right;
+    }
+  } else {
+    unsigned flips=0, bits=0;
+    while (!n->data) {
       if (bits==0) {
         flips = theRNG.getInt32();
         bits = 32;
@@ -385,6 +654,197 @@ void BumpMergingSearcher::update(
 
 ///
 
+AutoMergingSearcher::AutoMergingSearcher(Executor &_executor,
+                                         Searcher *_baseSearcher,
+                                         uint64_t _waitInstructions,
+                                         unsigned _maxQueryCost)
+  : executor(_executor),
+    baseSearcher(_baseSearcher),
+    waitInstructions(_waitInstructions),
+    maxQueryCost(_maxQueryCost) {
+}
+
+AutoMergingSearcher::~AutoMergingSearcher() {
+  delete baseSearcher;
+}
+
+bool AutoMergingSearcher::isMergePoint(const KInstruction *ki) {
+  // Phi nodes depend on the block a state came from, so states are merged
+  // after them.
+  BasicBlock *bb = ki->inst->getParent();
+  if (ki->inst != bb->getFirstNonPHI())
+    return false;
+  pred_iterator it = pred_begin(bb), ie = pred_end(bb);
+  return it != ie && ++it != ie;
+}
+
+const std::vector<unsigned> &AutoMergingSearcher::getQueryUses(KFunction *kf) {
+  std::map<KFunction*, std::vector<unsigned> >::iterator it =
+    queryUses.find(kf);
+  if (it != queryUses.end())
+    return it->second;
+
+  std::vector<unsigned> &uses = queryUses[kf];
+  uses.assign(kf->numRegisters, 0);
+
+  std::map<const Value*, unsigned> registers;
+  unsigned index = 0;
+  for (Function::arg_iterator ai = kf->function->arg_begin(),
+         ae = kf->function->arg_end(); ai != ae; ++ai)
+    registers[&*ai] = kf->getArgRegister(index++);
+  for (unsigned i = 0; i != kf->numInstructions; ++i)
+    registers[kf->instructions[i]->inst] = kf->instructions[i]->dest;
+
+  for (unsigned i = 0; i != kf->numInstructions; ++i) {
+    Instruction *inst = kf->instructions[i]->inst;
+    const Value *queried = 0;
+    if (BranchInst *bi = dyn_cast<BranchInst>(inst)) {
+      if (bi->isConditional())
+        queried = bi->getCondition();
+    } else if (SwitchInst *si = dyn_cast<SwitchInst>(inst)) {
+      queried = si->getCondition();
+    } else if (LoadInst *li = dyn_cast<LoadInst>(inst)) {
+      queried = li->getPointerOperand();
+    } else if (StoreInst *si = dyn_cast<StoreInst>(inst)) {
+      queried = si->getPointerOperand();
+    }
+    if (!queried)
+      continue;
+
+    // Count the registers the queried value is computed from.
+    std::set<const Value*> visited;
+    std::vector<const Value*> stack(1, queried);
+    while (!stack.empty()) {
+      const Value *v = stack.back();
+      stack.pop_back();
+      if (!visited.insert(v).second)
+        continue;
+      std::map<const Value*, unsigned>::iterator reg = registers.find(v);
+      if (reg == registers.end())
+        continue;
+      ++uses[reg->second];
+      if (const Instruction *def = dyn_cast<Instruction>(v))
+        for (unsigned j = 0, e = def->getNumOperands(); j != e; ++j)
+          stack.push_back(def->getOperand(j));
+    }
+  }
+
+  return uses;
+}
+
+bool AutoMergingSearcher::shouldMerge(const ExecutionState &a,
+                                      const ExecutionState &b) {
+  if (a.stack.size() != b.stack.size())
+    return false;
+  const StackFrame &af = a.stack.back();
+  const StackFrame &bf = b.stack.back();
+  if (af.kf != bf.kf)
+    return false;
+
+  const std::vector<unsigned> &uses = getQueryUses(af.kf);
+  uint64_t cost = 0;
+  for (unsigned i = 0; i != af.kf->numRegisters; ++i) {
+    ref<Expr> av = af.getLocal(i).getValue();
+    ref<Expr> bv = bf.getLocal(i).getValue();
+    if (av.isNull() || bv.isNull() || av == bv)
+      continue;
+    // Values symbolic in both states already cost their queries.
+    if (isa<ConstantExpr>(av) || isa<FConstantExpr>(av) ||
+        isa<ConstantExpr>(bv) || isa<FConstantExpr>(bv)) {
+      cost += uses[i];
+      if (cost > maxQueryCost)
+        return false;
+    }
+  }
+  return true;
+}
+
+void AutoMergingSearcher::stopWaiting(ExecutionState *es) {
+  waitingStates.erase(es);
+  std::vector<ExecutionState*> &states = waiting[es->pc];
+  states.erase(std::find(states.begin(), states.end(), es));
+  if (states.empty())
+    waiting.erase(es->pc);
+}
+
+void AutoMergingSearcher::release(ExecutionState *es) {
+  stopWaiting(es);
+  released.insert(es);
+  baseSearcher->addState(es);
+}
+
+void AutoMergingSearcher::releaseDue() {
+  while (!releaseQueue.empty() &&
+         (releaseQueue.front().first <= stats::instructions ||
+          baseSearcher->empty())) {
+    ExecutionState *es = releaseQueue.front().second;
+    std::map<ExecutionState*, uint64_t>::iterator it = waitingStates.find(es);
+    // The state may have stopped waiting and waited again since.
+    if (it != waitingStates.end() &&
+        it->second == releaseQueue.front().first)
+      release(es);
+    releaseQueue.pop_front();
+  }
+}
+
+ExecutionState &AutoMergingSearcher::selectState() {
+  for (;;) {
+    releaseDue();
+    ExecutionState &es = baseSearcher->selectState();
+    if (!isMergePoint(es.pc) || released.erase(&es))
+      return es;
+
+    // The base searcher may not know that a state is waiting (such as
+    // random-path); it then runs on.
+    if (waitingStates.count(&es)) {
+      stopWaiting(&es);
+      baseSearcher->addState(&es);
+      return es;
+    }
+
+    std::vector<ExecutionState*> &states = waiting[es.pc];
+    for (std::vector<ExecutionState*>::iterator it = states.begin(),
+           ie = states.end(); it != ie; ++it) {
+      ExecutionState *other = *it;
+      if (shouldMerge(*other, es) && other->merge(es)) {
+        ++stats::mergedStates;
+        executor.terminateState(es);
+        // The merged state runs on, so that it cannot run into a state
+        // terminated by merging, which the base searcher may still hold
+        // until the update.
+        stopWaiting(other);
+        baseSearcher->addState(other);
+        return *other;
+      }
+    }
+
+    baseSearcher->removeState(&es);
+    uint64_t releaseAt = stats::instructions + waitInstructions;
+    states.push_back(&es);
+    waitingStates[&es] = releaseAt;
+    releaseQueue.push_back(std::make_pair(releaseAt, &es));
+  }
+}
+
+void AutoMergingSearcher::update(
+    ExecutionState *current, const std::vector<ExecutionState *> &addedStates,
+    const std::vector<ExecutionState *> &removedStates) {
+  // Waiting states are not in the base searcher.
+  std::vector<ExecutionState *> removed;
+  for (std::vector<ExecutionState *>::const_iterator it = removedStates.begin(),
+                                                     ie = removedStates.end();
+       it != ie; ++it) {
+    released.erase(*it);
+    if (waitingStates.count(*it))
+      stopWaiting(*it);
+    else
+      removed.push_back(*it);
+  }
+  baseSearcher->update(current, addedStates, removed);
+}
+
+///
+
 MergingSearcher::MergingSearcher(Executor &_executor, Searcher *_baseSearcher) 
   : executor(_executor),
     baseSearcher(_baseSearcher),
@@ -622,6 +1082,98 @@ void IterativeDeepeningTimeSearcher::update(
 
 /***/
 
+IterativeDeepeningBudgetSearcher::IterativeDeepeningBudgetSearcher(
+    Searcher *_baseSearcher, uint64_t _instructionBudget,
+    double _solverTimeBudget)
+  : baseSearcher(_baseSearcher),
+    instructionBudget(std::max(_instructionBudget, (uint64_t) 1)),
+    solverTimeBudget(std::max((uint64_t) (_solverTimeBudget * 1000000),
+                              (uint64_t) 1)),
+    selected(0),
+    startInstructions(0),
+    startSolverTime(0) {
+}
+
+IterativeDeepeningBudgetSearcher::~IterativeDeepeningBudgetSearcher() {
+  delete baseSearcher;
+}
+
+double IterativeDeepeningBudgetSearcher::getUse(const Usage &u) const {
+  return std::max((double) u.instructions / instructionBudget,
+                  (double) u.solverTime / solverTimeBudget);
+}
+
+void IterativeDeepeningBudgetSearcher::deepen() {
+  // Only paused states resume, so go straight to budgets that cover one.
+  do {
+    instructionBudget *= 2;
+    solverTimeBudget *= 2;
+  } while (getUse(usage[paused.begin()->second]) > 1);
+  klee_message("increased budgets to %llu instructions and %.2fs of solver "
+               "time", (unsigned long long) instructionBudget,
+               solverTimeBudget / 1000000.);
+
+  std::vector<ExecutionState *> resumed;
+  while (!paused.empty()) {
+    ExecutionState *es = paused.begin()->second;
+    Usage &u = usage[es];
+    if (getUse(u) > 1)
+      break;
+    paused.erase(paused.begin());
+    pausedKeys.erase(es);
+    u = Usage();
+    resumed.push_back(es);
+  }
+  baseSearcher->update(0, resumed, std::vector<ExecutionState *>());
+}
+
+ExecutionState &IterativeDeepeningBudgetSearcher::selectState() {
+  selected = &baseSearcher->selectState();
+  startInstructions = stats::instructions;
+  startSolverTime = stats::solverTime;
+  return *selected;
+}
+
+void IterativeDeepeningBudgetSearcher::update(
+    ExecutionState *current, const std::vector<ExecutionState *> &addedStates,
+    const std::vector<ExecutionState *> &removedStates) {
+  if (current && current == selected) {
+    Usage &u = usage[current];
+    u.instructions += stats::instructions - startInstructions;
+    u.solverTime += stats::solverTime - startSolverTime;
+  }
+  selected = 0;
+
+  std::vector<ExecutionState *> alt;
+  for (std::vector<ExecutionState *>::const_iterator
+         it = removedStates.begin(), ie = removedStates.end(); it != ie; ++it) {
+    ExecutionState *es = *it;
+    usage.erase(es);
+    std::map<ExecutionState*, double>::iterator key = pausedKeys.find(es);
+    if (key != pausedKeys.end()) {
+      paused.erase(std::make_pair(key->second, es));
+      pausedKeys.erase(key);
+    } else {
+      alt.push_back(es);
+    }
+  }
+  baseSearcher->update(current, addedStates, alt);
+
+  if (current && usage.count(current) && !pausedKeys.count(current)) {
+    double use = getUse(usage[current]);
+    if (use > 1) {
+      paused.insert(std::make_pair(use, current));
+      pausedKeys[current] = use;
+      baseSearcher->removeState(current);
+    }
+  }
+
+  if (baseSearcher->empty() && !paused.empty())
+    deepen();
+}
+
+/***/
+
 InterleavedSearcher::InterleavedSearcher(const std::vector<Searcher*> &_searchers)
   : searchers(_searchers),
     index(1) {
@@ -646,3 +1198,105 @@ void InterleavedSearcher::update(
          ie = searchers.end(); it != ie; ++it)
     (*it)->update(current, addedStates, removedStates);
 }
+
+/***/
+
+BanditSearcher::BanditSearcher(Executor &executor,
+                               const std::vector<Searcher*> &_searchers,
+                               unsigned _sliceInstructions)
+  : searchers(_searchers),
+    arms(_searchers.size()),
+    sliceInstructions(_sliceInstructions ? _sliceInstructions : 1),
+    sliceLog(executor.interpreterHandler->openOutputFile("bandit.txt")),
+    current(-1),
+    slices(0),
+    sliceStartInstructions(0),
+    sliceStartCovered(0),
+    sliceStartTime(0) {
+  if (sliceLog)
+    *sliceLog << "# slice searcher instructions covered seconds\n";
+}
+
+BanditSearcher::~BanditSearcher() {
+  if (current >= 0)
+    endSlice();
+  for (unsigned i = 0; i != searchers.size(); ++i) {
+    std::string name;
+    llvm::raw_string_ostream os(name);
+    searchers[i]->printName(os);
+    os.flush();
+    // Only the first line of nested searchers' names.
+    name = name.substr(0, name.find('\n'));
+    klee_message("bandit searcher %u (%s): %u slices, %.2fs, %llu newly "
+                 "covered instructions", i, name.c_str(), arms[i].slices,
+                 arms[i].time, (unsigned long long) arms[i].covered);
+  }
+  delete sliceLog;
+  for (std::vector<Searcher*>::const_iterator it = searchers.begin(),
+         ie = searchers.end(); it != ie; ++it)
+    delete *it;
+}
+
+unsigned BanditSearcher::chooseSearcher() const {
+  for (unsigned i = 0; i != arms.size(); ++i)
+    if (!arms[i].slices)
+      return i;
+
+  // Rewards are unbounded, so the exploration term is scaled by the best
+  // mean, or left as is while no searcher covered anything.
+  double scale = 0;
+  for (unsigned i = 0; i != arms.size(); ++i)
+    scale = std::max(scale, arms[i].rewards / arms[i].slices);
+  if (scale == 0)
+    scale = 1;
+
+  unsigned best = 0;
+  double bestScore = -1;
+  for (unsigned i = 0; i != arms.size(); ++i) {
+    double score = arms[i].rewards / arms[i].slices +
+                   scale * sqrt(2 * log((double) slices) / arms[i].slices);
+    if (score > bestScore) {
+      best = i;
+      bestScore = score;
+    }
+  }
+  return best;
+}
+
+void BanditSearcher::endSlice() {
+  double elapsed = std::max(util::getWallTime() - sliceStartTime, 1e-6);
+  uint64_t instructions = stats::instructions - sliceStartInstructions;
+  uint64_t covered = stats::coveredInstructions - sliceStartCovered;
+  Arm &arm = arms[current];
+  ++arm.slices;
+  arm.rewards += covered / elapsed;
+  arm.time += elapsed;
+  arm.covered += covered;
+  if (sliceLog) {
+    *sliceLog << slices << " " << current << " " << instructions << " "
+              << covered << " " << elapsed << "\n";
+    sliceLog->flush();
+  }
+}
+
+ExecutionState &BanditSearcher::selectState() {
+  if (current < 0 ||
+      stats::instructions - sliceStartInstructions >= sliceInstructions) {
+    if (current >= 0)
+      endSlice();
+    current = chooseSearcher();
+    ++slices;
+    sliceStartInstructions = stats::instructions;
+    sliceStartCovered = stats::coveredInstructions;
+    sliceStartTime = util::getWallTime();
+  }
+  return searchers[current]->selectState();
+}
+
+void BanditSearcher::update(
+    ExecutionState *current, const std::vector<ExecutionState *> &addedStates,
+    const std::vector<ExecutionState *> &removedStates) {
+  for (std::vector<Searcher*>::const_iterator it = searchers.begin(),
+         ie = searchers.end(); it != ie; ++it)
+    (*it)->update(current, addedStates, removedStates);
+}
@@ -11,7 +11,10 @@
 #define KLEE_SEARCHER_H
 
 #include "klee/ExecutionState.h"
+#include "llvm/ADT/DenseMap.h"
 #include "llvm/Support/raw_ostream.h"
+#include <deque>
+#include <list>
 #include <map>
 #include <queue>
 #include <set>
@@ -27,6 +30,9 @@ namespace llvm {
 namespace klee {
 template <class T, class Compare> class DiscretePDF;
 class Executor;
+class FloatCoverage;
+struct KFunction;
+struct KInstruction;
 
 class Searcher {
 public:
@@ -76,12 +82,19 @@ public:
     NURS_Depth,
     NURS_ICnt,
     NURS_CPICnt,
-    NURS_QC
+    NURS_QC,
+    NURS_FPCost,
+    NURS_FPCov,
+    Directed
   };
   };
 
   class DFSSearcher : public Searcher {
-    std::vector<ExecutionState*> states;
+    std::list<ExecutionState*> states;
+    /// The position of each state in ``states``, so that states can be
+    /// removed from anywhere in constant time.
+    llvm::DenseMap<ExecutionState*, std::list<ExecutionState*>::iterator>
+      positions;
 
   public:
     ExecutionState &selectState();
@@ -95,7 +108,11 @@ public:
   };
 
   class BFSSearcher : public Searcher {
-    std::deque<ExecutionState*> states;
+    std::list<ExecutionState*> states;
+    /// The position of each state in ``states``, so that states can be
+    /// removed from anywhere in constant time.
+    llvm::DenseMap<ExecutionState*, std::list<ExecutionState*>::iterator>
+      positions;
 
   public:
     ExecutionState &selectState();
@@ -110,6 +127,9 @@ public:
 
   class RandomSearcher : public Searcher {
     std::vector<ExecutionState*> states;
+    /// The index of each state in ``states``. A state is removed by moving
+    /// the last one into its place.
+    llvm::DenseMap<ExecutionState*, unsigned> indices;
 
   public:
     ExecutionState &selectState();
@@ -130,7 +150,9 @@ public:
       InstCount,
       CPInstCount,
       MinDistToUncovered,
-      CoveringNew
+      CoveringNew,
+      FPCost,
+      FPCoverage
     };
 
   private:
@@ -156,11 +178,46 @@ public:
     DiscretePDF<ExecutionState *, ExecutionStateLessThanCmp> *states;
     WeightType type;
     bool updateWeights;
-    
+    /// The classes covered at floating point operations, for FPCoverage.
+    const FloatCoverage *floatCoverage;
+
+    /// WeightInputs - What the weight of a state was last computed from.
+    /// It is only computed again once the state moved to another basic
+    /// block, or the coverage, its constraints or its query cost changed.
+    struct WeightInputs {
+      const llvm::BasicBlock *block;
+      uint64_t coveredInstructions;
+      uint64_t floatClassesCovered;
+      size_t numConstraints;
+      double queryCost;
+      /// Whether the weight is to be updated before the next selection.
+      bool pending;
+
+      WeightInputs() : block(0), coveredInstructions(0),
+                       floatClassesCovered(0), numConstraints(0),
+                       queryCost(0), pending(false) {}
+      WeightInputs(ExecutionState *es);
+
+      bool operator==(const WeightInputs &other) const {
+        return block == other.block &&
+               coveredInstructions == other.coveredInstructions &&
+               floatClassesCovered == other.floatClassesCovered &&
+               numConstraints == other.numConstraints &&
+               queryCost == other.queryCost;
+      }
+    };
+    std::map<ExecutionState*, WeightInputs> weightInputs;
+    /// The states whose weights are updated in a batch when the next state
+    /// is selected, so that those of states stepped several times in a row
+    /// are only updated once.
+    std::vector<ExecutionState*> pendingUpdates;
+
     double getWeight(ExecutionState*);
+    void updatePendingWeights();
 
   public:
-    WeightedRandomSearcher(WeightType type);
+    WeightedRandomSearcher(WeightType type,
+                           const FloatCoverage *floatCoverage = 0);
     ~WeightedRandomSearcher();
 
     ExecutionState &selectState();
@@ -177,11 +234,53 @@ public:
       case CPInstCount        : os << "CPInstCount\n"; return;
       case MinDistToUncovered : os << "MinDistToUncovered\n"; return;
       case CoveringNew        : os << "CoveringNew\n"; return;
+      case FPCost             : os << "FPCost\n"; return;
+      case FPCoverage         : os << "FPCoverage\n"; return;
       default                 : os << "<unknown type>\n"; return;
       }
     }
   };
 
+  /// DirectedSearcher - Select the state closest to one of the target
+  /// instructions, the distance being context sensitive as for
+  /// MinDistToUncovered: from the current instruction, or from the return
+  /// address of each frame up the stack. States from which no target can be
+  /// reached are terminated, as long as another state can reach one.
+  class DirectedSearcher : public Searcher {
+    struct StateLessThan {
+      bool operator()(const std::pair<uint64_t, ExecutionState*> &lhs,
+                      const std::pair<uint64_t, ExecutionState*> &rhs) const {
+        if (lhs.first != rhs.first)
+          return lhs.first < rhs.first;
+        return lhs.second->uniqueID < rhs.second->uniqueID;
+      }
+    };
+
+    Executor &executor;
+    /// The shortest distance from each instruction id to a target, 0 is
+    /// unreachable.
+    std::vector<uint64_t> distToTarget;
+    /// The states by distance, unreachable states last.
+    std::set<std::pair<uint64_t, ExecutionState*>, StateLessThan> states;
+    std::map<ExecutionState*, uint64_t> distances;
+
+    uint64_t getDistance(const KInstruction *ki, uint64_t distAtRA);
+    uint64_t getDistance(ExecutionState *es);
+
+  public:
+    DirectedSearcher(Executor &executor,
+                     const std::vector<std::string> &targets);
+
+    ExecutionState &selectState();
+    void update(ExecutionState *current,
+                const std::vector<ExecutionState *> &addedStates,
+                const std::vector<ExecutionState *> &removedStates);
+    bool empty() { return states.empty(); }
+    void printName(llvm::raw_ostream &os) {
+      os << "DirectedSearcher\n";
+    }
+  };
+
   class RandomPathSearcher : public Searcher {
     Executor &executor;
 
@@ -245,6 +344,57 @@ public:
     }
   };
 
+  /// AutoMergingSearcher - Merges states without klee_merge calls. States
+  /// reaching a join point (the first instruction after the phi nodes of a
+  /// block with several predecessors, such as a loop head or the
+  /// post-dominator of a branch) wait there for a while for others to merge
+  /// with. Two states are only merged if the locals they differ in are not
+  /// expected to cause many more queries: a value which is constant in one
+  /// of them becomes symbolic, which costs a query for each branch and
+  /// memory access it flows into further on in the function.
+  class AutoMergingSearcher : public Searcher {
+    Executor &executor;
+    Searcher *baseSearcher;
+    /// How many instructions a state waits at a join point.
+    uint64_t waitInstructions;
+    /// The number of queries merging may add.
+    unsigned maxQueryCost;
+
+    /// The states waiting at each join point, and when they are released.
+    std::map<const KInstruction*, std::vector<ExecutionState*> > waiting;
+    std::map<ExecutionState*, uint64_t> waitingStates;
+    std::deque<std::pair<uint64_t, ExecutionState*> > releaseQueue;
+    /// The states released from a join point, which do not wait there again.
+    std::set<ExecutionState*> released;
+    /// For each register of a function, the number of branches and memory
+    /// accesses its value flows into.
+    std::map<KFunction*, std::vector<unsigned> > queryUses;
+
+    bool isMergePoint(const KInstruction *ki);
+    const std::vector<unsigned> &getQueryUses(KFunction *kf);
+    bool shouldMerge(const ExecutionState &a, const ExecutionState &b);
+    void stopWaiting(ExecutionState *es);
+    void release(ExecutionState *es);
+    void releaseDue();
+
+  public:
+    AutoMergingSearcher(Executor &executor, Searcher *baseSearcher,
+                        uint64_t waitInstructions, unsigned maxQueryCost);
+    ~AutoMergingSearcher();
+
+    ExecutionState &selectState();
+    void update(ExecutionState *current,
+                const std::vector<ExecutionState *> &addedStates,
+                const std::vector<ExecutionState *> &removedStates);
+    bool empty() { return baseSearcher->empty() && waitingStates.empty(); }
+    void printName(llvm::raw_ostream &os) {
+      os << "<AutoMergingSearcher> waitInstructions: " << waitInstructions
+         << ", maxQueryCost: " << maxQueryCost << ", baseSearcher:\n";
+      baseSearcher->printName(os);
+      os << "</AutoMergingSearcher>\n";
+    }
+  };
+
   class BatchingSearcher : public Searcher {
     Searcher *baseSearcher;
     double timeBudget;
@@ -293,6 +443,62 @@ public:
     }
   };
 
+  /// IterativeDeepeningBudgetSearcher - Iterative deepening on what each
+  /// state used since it was last resumed, counting its instructions and
+  /// its solver time apart, so that a state waiting on the solver is not
+  /// taken for one looping without progress. A state exceeding either
+  /// budget is paused. Once no state is left, both budgets are doubled until
+  /// they cover the paused state which used the least, and the paused states
+  /// they cover resume, least used first. Paused states are not selected, so
+  /// their pending lazy forks (see -lazy-fork) are not resolved until they
+  /// resume.
+  class IterativeDeepeningBudgetSearcher : public Searcher {
+    struct Usage {
+      uint64_t instructions;
+      uint64_t solverTime;
+
+      Usage() : instructions(0), solverTime(0) {}
+    };
+
+    Searcher *baseSearcher;
+    uint64_t instructionBudget;
+    uint64_t solverTimeBudget;
+    std::map<ExecutionState*, Usage> usage;
+
+    /// The state last selected, and the statistics when it was.
+    ExecutionState *selected;
+    uint64_t startInstructions;
+    uint64_t startSolverTime;
+
+    /// The paused states by how much of the budgets they used, the larger
+    /// of the two fractions, so that the least used comes first.
+    typedef std::set<std::pair<double, ExecutionState*> > paused_ty;
+    paused_ty paused;
+    std::map<ExecutionState*, double> pausedKeys;
+
+    double getUse(const Usage &u) const;
+    void deepen();
+
+  public:
+    IterativeDeepeningBudgetSearcher(Searcher *baseSearcher,
+                                     uint64_t instructionBudget,
+                                     double solverTimeBudget);
+    ~IterativeDeepeningBudgetSearcher();
+
+    ExecutionState &selectState();
+    void update(ExecutionState *current,
+                const std::vector<ExecutionState *> &addedStates,
+                const std::vector<ExecutionState *> &removedStates);
+    bool empty() { return baseSearcher->empty() && paused.empty(); }
+    void printName(llvm::raw_ostream &os) {
+      os << "<IterativeDeepeningBudgetSearcher> instructionBudget: "
+         << instructionBudget << ", solverTimeBudget: "
+         << solverTimeBudget / 1000000. << ", baseSearcher:\n";
+      baseSearcher->printName(os);
+      os << "</IterativeDeepeningBudgetSearcher>\n";
+    }
+  };
+
   class InterleavedSearcher : public Searcher {
     typedef std::vector<Searcher*> searchers_ty;
 
@@ -318,6 +524,60 @@ public:
     }
   };
 
+  /// BanditSearcher - Let one of several searchers select states at a time,
+  /// for slices of a number of instructions, choosing the searcher of each
+  /// slice with UCB1. A slice is rewarded with the instructions it newly
+  /// covered per second of wall time, which includes the time spent in the
+  /// solver. Every searcher sees every update, as in InterleavedSearcher.
+  /// Slices are logged to bandit.txt, and each searcher's share summarized
+  /// at the end.
+  class BanditSearcher : public Searcher {
+    typedef std::vector<Searcher*> searchers_ty;
+
+    struct Arm {
+      unsigned slices;
+      double rewards;
+      double time;
+      uint64_t covered;
+
+      Arm() : slices(0), rewards(0), time(0), covered(0) {}
+    };
+
+    searchers_ty searchers;
+    std::vector<Arm> arms;
+    unsigned sliceInstructions;
+    llvm::raw_ostream *sliceLog;
+
+    /// The searcher of the current slice, or -1 before the first one.
+    int current;
+    unsigned slices;
+    uint64_t sliceStartInstructions;
+    uint64_t sliceStartCovered;
+    double sliceStartTime;
+
+    unsigned chooseSearcher() const;
+    void endSlice();
+
+  public:
+    BanditSearcher(Executor &executor, const searchers_ty &_searchers,
+                   unsigned _sliceInstructions);
+    ~BanditSearcher();
+
+    ExecutionState &selectState();
+    void update(ExecutionState *current,
+                const std::vector<ExecutionState *> &addedStates,
+                const std::vector<ExecutionState *> &removedStates);
+    bool empty() { return searchers[0]->empty(); }
+    void printName(llvm::raw_ostream &os) {
+      os << "<BanditSearcher> sliceInstructions: " << sliceInstructions
+         << ", containing " << searchers.size() << " searchers:\n";
+      for (searchers_ty::iterator it = searchers.begin(), ie = searchers.end();
+           it != ie; ++it)
+        (*it)->printName(os);
+      os << "</BanditSearcher>\n";
+    }
+  };
+
 }
 
 #endif
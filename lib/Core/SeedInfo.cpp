@@ -17,10 +17,25 @@
 #include "klee/Internal/ADT/KTest.h"
 #include "klee/Internal/Support/ErrorHandling.h"
 
+#include <algorithm>
+
 using namespace klee;
 
 KTestObject *SeedInfo::getNextInput(const MemoryObject *mo,
                                    bool byName) {
+  if (raw) {
+    KTestObject *obj = &input->objects[0];
+    unsigned begin = std::min(inputPosition, obj->numBytes);
+    unsigned end = std::min(inputPosition + mo->size, obj->numBytes);
+    rawBytes.assign(obj->bytes + begin, obj->bytes + end);
+    rawBytes.resize(mo->size, 0);
+    inputPosition += mo->size;
+    rawObject.name = obj->name;
+    rawObject.numBytes = mo->size;
+    rawObject.bytes = rawBytes.empty() ? 0 : &rawBytes[0];
+    return &rawObject;
+  }
+
   if (byName) {
     unsigned i;
     
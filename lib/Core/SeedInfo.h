@@ -10,13 +10,9 @@
 #ifndef KLEE_SEEDINFO_H
 #define KLEE_SEEDINFO_H
 
+#include "klee/Internal/ADT/KTest.h"
 #include "klee/util/Assignment.h"
 
-extern "C" {
-  struct KTest;
-  struct KTestObject;
-}
-
 namespace klee {
   class ExecutionState;
   class TimingSolver;
@@ -27,12 +23,22 @@ namespace klee {
     KTest *input;
     unsigned inputPosition;
     std::set<struct KTestObject*> used;
+    /// Whether the input is raw bytes, such as those of a fuzzer, in its
+    /// only object: each symbolic object then takes the next bytes of it,
+    /// with zeros past its end. \c inputPosition counts bytes.
+    bool raw;
+
+  private:
+    /// The bytes of the input last taken from a raw input.
+    KTestObject rawObject;
+    std::vector<unsigned char> rawBytes;
     
   public:
     explicit
-    SeedInfo(KTest *_input) : assignment(true),
-                             input(_input),
-                             inputPosition(0) {}
+    SeedInfo(KTest *_input, bool _raw = false) : assignment(true),
+                                                input(_input),
+                                                inputPosition(0),
+                                                raw(_raw) {}
     
     KTestObject *getNextInput(const MemoryObject *mo,
                              bool byName);
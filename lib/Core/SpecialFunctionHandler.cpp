@@ -28,6 +28,7 @@
 #else
 #include "llvm/Module.h"
 #endif
+#include "llvm/ADT/StringExtras.h"
 #include "llvm/ADT/Twine.h"
 
 #if LLVM_VERSION_CODE <= LLVM_VERSION(3, 1)
@@ -39,6 +40,8 @@
 #endif
 
 #include <errno.h>
+#include <fenv.h>
+#include <math.h>
 
 using namespace llvm;
 using namespace klee;
@@ -56,6 +59,28 @@ namespace {
                    cl::desc("Silently terminate paths with an infeasible "
                             "condition given to klee_assume() rather than "
                             "emitting an error (default=false)"));
+
+  enum LibmModelType {
+    ExternalLibm,
+    ConcretizeLibm,
+    AbstractLibm
+  };
+
+  cl::opt<LibmModelType>
+  LibmModel("libm-model",
+            cl::desc("How calls of exp, log, pow, sin and cos with symbolic "
+                     "arguments are handled (default=external)"),
+            cl::values(clEnumValN(ExternalLibm, "external",
+                                  "Like other external calls, which only "
+                                  "allow arguments with a unique value"),
+                       clEnumValN(ConcretizeLibm, "concretize",
+                                  "Pick a value for each symbolic argument"),
+                       clEnumValN(AbstractLibm, "abstract",
+                                  "Return a symbolic value, constrained by "
+                                  "properties of the function such as the "
+                                  "range of sin"),
+                       clEnumValEnd),
+            cl::init(ExternalLibm));
 }
 
 
@@ -104,7 +129,9 @@ static SpecialFunctionHandler::HandlerInfo handlerInfo[] = {
   add("klee_get_errno", handleGetErrno, true),
   add("klee_is_symbolic", handleIsSymbolic, true),
   add("klee_make_symbolic", handleMakeSymbolic, false),
+  add("klee_make_symbolic_float", handleMakeSymbolicFloat, false),
   add("klee_mark_global", handleMarkGlobal, false),
+  add("klee_mark_pure", handleMarkPure, false),
   add("klee_merge", handleMerge, false),
   add("klee_prefer_cex", handlePreferCex, false),
   add("klee_posix_prefer_cex", handlePosixPreferCex, false),
@@ -193,6 +220,27 @@ static SpecialFunctionHandler::HandlerInfo handlerInfo[] = {
   add("fmaxf"          , handleFMax           , true),
   add("fmaxl"          , handleFMax           , true),
 
+  add("fma"            , handleFma            , true),
+  add("fmaf"           , handleFma            , true),
+  add("fmal"           , handleFma            , true),
+
+  // Only calls of the C library are handled; long double variants remain
+  // external calls.
+#define addLibm(name, handler) { name, \
+                                 &SpecialFunctionHandler::handler, \
+                                 false, true, true }
+  addLibm("exp"            , handleExp),
+  addLibm("expf"           , handleExp),
+  addLibm("log"            , handleLog),
+  addLibm("logf"           , handleLog),
+  addLibm("pow"            , handlePow),
+  addLibm("powf"           , handlePow),
+  addLibm("sin"            , handleSin),
+  addLibm("sinf"           , handleSin),
+  addLibm("cos"            , handleCos),
+  addLibm("cosf"           , handleCos),
+#undef addLibm
+
 #undef addDNR
 #undef add  
 };
@@ -264,8 +312,39 @@ void SpecialFunctionHandler::bind() {
     Function *f = executor.kmodule->module->getFunction(hi.name);
     
     if (f && (!hi.doNotOverride || f->isDeclaration()))
-      handlers[f] = std::make_pair(hi.handler, hi.hasReturnValue);
+      handlers[f] = i;
   }
+
+  // memmove is memcpy with overlapping ranges, which copying handles.
+  static const struct {
+    const char *name;
+    BulkMemoryFunction kind;
+  } bulkMemory[] = {
+    { "memcpy", Memcpy },
+    { "memmove", Memcpy },
+    { "mempcpy", Mempcpy },
+    { "memset", Memset },
+  };
+  for (unsigned i = 0; i != sizeof bulkMemory / sizeof bulkMemory[0]; ++i)
+    if (Function *f = executor.kmodule->module->getFunction(bulkMemory[i].name))
+      if (!f->isDeclaration())
+        bulkMemoryFunctions[f] = bulkMemory[i].kind;
+
+  static const struct {
+    const char *name;
+    StringFunction kind;
+  } string[] = {
+    { "strlen", Strlen },
+    { "strcmp", Strcmp },
+    { "strncmp", Strncmp },
+    { "memcmp", Memcmp },
+    { "strchr", Strchr },
+    { "memchr", Memchr },
+  };
+  for (unsigned i = 0; i != sizeof string / sizeof string[0]; ++i)
+    if (Function *f = executor.kmodule->module->getFunction(string[i].name))
+      if (!f->isDeclaration())
+        stringFunctions[f] = string[i].kind;
 }
 
 
@@ -273,21 +352,226 @@ bool SpecialFunctionHandler::handle(ExecutionState &state,
                                     Function *f,
                                     KInstruction *target,
                                     std::vector< ref<Expr> > &arguments) {
-  handlers_ty::iterator it = handlers.find(f);
-  if (it != handlers.end()) {    
-    Handler h = it->second.first;
-    bool hasReturnValue = it->second.second;
-     // FIXME: Check this... add test?
-    if (!hasReturnValue && !target->inst->use_empty()) {
-      executor.terminateStateOnExecError(state, 
-                                         "expected return value from void special function");
+  int index = getHandler(f);
+  if (index < 0)
+    return false;
+  handle(state, index, target, arguments);
+  return true;
+}
+
+int SpecialFunctionHandler::getHandler(const Function *f) const {
+  handlers_ty::const_iterator it = handlers.find(f);
+  return it != handlers.end() ? (int) it->second : -1;
+}
+
+void SpecialFunctionHandler::handle(ExecutionState &state,
+                                    int index,
+                                    KInstruction *target,
+                                    std::vector< ref<Expr> > &arguments) {
+  const HandlerInfo &hi = handlerInfo[index];
+  // FIXME: Check this... add test?
+  if (!hi.hasReturnValue && !target->inst->use_empty()) {
+    executor.terminateStateOnExecError(state, 
+                                       "expected return value from void special function");
+  } else {
+    (this->*hi.handler)(state, target, arguments);
+  }
+}
+
+bool SpecialFunctionHandler::handleBulkMemory(ExecutionState &state,
+                                              Function *f,
+                                              KInstruction *target,
+                                              std::vector<ref<Expr> > &arguments) {
+  std::map<const Function*, BulkMemoryFunction>::iterator it =
+    bulkMemoryFunctions.find(f);
+  if (it == bulkMemoryFunctions.end() || arguments.size() != 3)
+    return false;
+  ConstantExpr *dst = dyn_cast<ConstantExpr>(arguments[0]);
+  ConstantExpr *len = dyn_cast<ConstantExpr>(arguments[2]);
+  if (!dst || !len)
+    return false;
+  uint64_t n = len->getZExtValue();
+
+  ObjectPair dop;
+  if (n) {
+    if (!state.addressSpace.resolveOne(dst, dop) || dop.second->readOnly)
+      return false;
+    uint64_t offset = dst->getZExtValue() - dop.first->address;
+    if (n > dop.first->size || offset > dop.first->size - n)
+      return false;
+
+    if (it->second == Memset) {
+      ObjectState *wos = state.addressSpace.getWriteable(dop.first,
+                                                         dop.second);
+      wos->fill(offset, ExtractExpr::create(arguments[1], 0, Expr::Int8), n);
     } else {
-      (this->*h)(state, target, arguments);
+      ConstantExpr *src = dyn_cast<ConstantExpr>(arguments[1]);
+      ObjectPair sop;
+      if (!src || !state.addressSpace.resolveOne(src, sop))
+        return false;
+      uint64_t srcOffset = src->getZExtValue() - sop.first->address;
+      if (n > sop.first->size || srcOffset > sop.first->size - n)
+        return false;
+
+      ObjectState *wos = state.addressSpace.getWriteable(dop.first,
+                                                         dop.second);
+      // Copying within an object reads what was just made writeable.
+      const ObjectState *sos = sop.first == dop.first ? wos : sop.second;
+      wos->copy(offset, *sos, srcOffset, n);
     }
-    return true;
-  } else {
+  }
+
+  ref<Expr> result = arguments[0];
+  if (it->second == Mempcpy)
+    result = AddExpr::create(result, ZExtExpr::create(arguments[2],
+                                                      result->getWidth()));
+  executor.bindLocal(target, state, result);
+  return true;
+}
+
+namespace {
+  /// ConcreteBytes - The bytes from a concrete address to the end of the
+  /// object it points to, read a window at a time for as long as they are
+  /// concrete.
+  class ConcreteBytes {
+    const ObjectState *os;
+    unsigned offset;
+
+  public:
+    enum { WindowSize = 256 };
+
+    /// The bytes available.
+    unsigned size;
+    /// The window last read.
+    uint8_t window[WindowSize];
+
+    ConcreteBytes() : os(0), offset(0), size(0) {}
+
+    bool init(ExecutionState &state, ref<Expr> address) {
+      klee::ConstantExpr *CE = dyn_cast<klee::ConstantExpr>(address);
+      ObjectPair op;
+      if (!CE || !state.addressSpace.resolveOne(CE, op))
+        return false;
+      os = op.second;
+      offset = CE->getZExtValue() - op.first->address;
+      size = op.first->size - offset;
+      return offset < op.first->size;
+    }
+
+    /// Read the window at byte \a at, of at most \a n bytes, and return
+    /// how many of them are in bounds and concrete.
+    unsigned read(unsigned at, unsigned n) {
+      n = std::min(std::min(n, (unsigned) WindowSize), size - at);
+      return os->readConcrete(offset + at, n, window);
+    }
+  };
+}
+
+bool SpecialFunctionHandler::handleStringFunction(ExecutionState &state,
+                                                  Function *f,
+                                                  KInstruction *target,
+                                                  std::vector<ref<Expr> > &arguments) {
+  std::map<const Function*, StringFunction>::iterator it =
+    stringFunctions.find(f);
+  if (it == stringFunctions.end())
+    return false;
+  StringFunction kind = it->second;
+  unsigned arity = kind == Strlen ? 1 : (kind == Strcmp || kind == Strchr) ? 2
+                                                                           : 3;
+  if (arguments.size() != arity)
+    return false;
+
+  Expr::Width width = executor.getWidthForLLVMType(target->inst->getType());
+  uint64_t limit = ~(uint64_t) 0;
+  if (arity == 3) {
+    ConstantExpr *n = dyn_cast<ConstantExpr>(arguments[2]);
+    if (!n)
+      return false;
+    limit = n->getZExtValue();
+    if (!limit) {
+      executor.bindLocal(target, state,
+                         kind == Memchr ? Expr::createPointer(0)
+                                        : ConstantExpr::create(0, width));
+      return true;
+    }
+  }
+
+  ConcreteBytes a, b;
+  if (!a.init(state, arguments[0]))
+    return false;
+  bool twoStrings = kind == Strcmp || kind == Strncmp || kind == Memcmp;
+  if (twoStrings && !b.init(state, arguments[1]))
     return false;
+  int c = 0;
+  if (kind == Strchr || kind == Memchr) {
+    ConstantExpr *CE = dyn_cast<ConstantExpr>(arguments[1]);
+    if (!CE)
+      return false;
+    c = (int) CE->getZExtValue(32);
+  }
+
+  // Scan a window at a time until the result is known, as the runtime's
+  // loops do a byte at a time, so that the bytes beyond need not be
+  // concrete or even in bounds.
+  for (uint64_t at = 0; at < limit; at += ConcreteBytes::WindowSize) {
+    unsigned want = std::min(limit - at,
+                             (uint64_t) ConcreteBytes::WindowSize);
+    unsigned n = a.read(at, want);
+    if (twoStrings)
+      n = std::min(n, b.read(at, want));
+
+    ref<Expr> result;
+    switch (kind) {
+    case Strlen:
+      if (const void *p = memchr(a.window, 0, n))
+        result = ConstantExpr::create(at + ((const uint8_t *) p - a.window),
+                                      width);
+      break;
+    case Strchr:
+    case Memchr:
+      for (unsigned i = 0; i != n; ++i) {
+        // strchr compares chars, memchr unsigned chars with the int.
+        if (kind == Strchr ? a.window[i] == (uint8_t) c : a.window[i] == c) {
+          result = AddExpr::create(
+              arguments[0], ConstantExpr::create(at + i,
+                                                 arguments[0]->getWidth()));
+          break;
+        }
+        if (kind == Strchr && !a.window[i]) {
+          result = Expr::createPointer(0);
+          break;
+        }
+      }
+      break;
+    default:
+      for (unsigned i = 0; i != n; ++i) {
+        uint8_t x = a.window[i], y = b.window[i];
+        if (x != y || (!x && kind != Memcmp)) {
+          // klee-libc's strcmp subtracts chars, the others unsigned chars.
+          int d = kind == Strcmp ? (int) (int8_t) x - (int8_t) y
+                                 : (int) x - y;
+          result = ConstantExpr::create((uint64_t) (int64_t) d, width);
+          break;
+        }
+      }
+      break;
+    }
+
+    if (!result.isNull()) {
+      executor.bindLocal(target, state, result);
+      return true;
+    }
+    // A symbolic byte, or the end of an object, decides the rest.
+    if (n < want)
+      return false;
   }
+
+  // Only memcmp, strncmp and memchr get here, having found no difference
+  // or match in as many bytes as they were given.
+  executor.bindLocal(target, state,
+                     kind == Memchr ? Expr::createPointer(0)
+                                    : ConstantExpr::create(0, width));
+  return true;
 }
 
 /****/
@@ -796,6 +1080,187 @@ void SpecialFunctionHandler::handleMakeSymbolic(ExecutionState &state,
   }
 }
 
+/// The flags of klee_make_symbolic_float, as in klee.h.
+enum FloatDomainFlags {
+  FloatNoNaN = 1,
+  FloatNoInf = 2,
+  FloatNormal = 4,
+  FloatRange = 8
+};
+
+/// getFloatMagnitude - The bits of \a v without its sign.
+static uint64_t getFloatMagnitude(const llvm::APFloat &v) {
+  llvm::APInt bits = v.bitcastToAPInt();
+  bits.clearBit(bits.getBitWidth() - 1);
+  return bits.getZExtValue();
+}
+
+/// getFloatDomain - The condition on \a bits, those of a single or double
+/// precision value, that it is in the domain of klee_make_symbolic_float
+/// \a flags. It only compares the sign and the magnitude, the rest of the
+/// bits, as unsigned integers, with IEEE 754 magnitudes ordered as the
+/// values they encode and NaNs above infinity.
+static ref<Expr> getFloatDomain(ref<Expr> bits, unsigned flags,
+                                const llvm::APFloat &lo,
+                                const llvm::APFloat &hi) {
+  Expr::Width width = bits->getWidth();
+  Expr::Width magWidth = width - 1;
+  unsigned mantissaBits = width == Expr::Fl32 ? 23 : 52;
+  ref<Expr> sign = ExtractExpr::create(bits, magWidth, Expr::Bool);
+  ref<Expr> mag = ExtractExpr::create(bits, 0, magWidth);
+  ref<klee::ConstantExpr> inf = klee::ConstantExpr::create(
+      ((1ULL << magWidth) - 1) & ~((1ULL << mantissaBits) - 1), magWidth);
+
+  ref<Expr> domain = klee::ConstantExpr::create(1, Expr::Bool);
+  if ((flags & FloatNoNaN) && (flags & FloatNoInf))
+    domain = AndExpr::create(domain, UltExpr::create(mag, inf));
+  else if (flags & FloatNoNaN)
+    domain = AndExpr::create(domain, UleExpr::create(mag, inf));
+  else if (flags & FloatNoInf)
+    domain = AndExpr::create(domain, NeExpr::create(mag, inf));
+
+  if (flags & FloatNormal) {
+    ref<klee::ConstantExpr> minNormal =
+        klee::ConstantExpr::create(1ULL << mantissaBits, magWidth);
+    domain = AndExpr::create(
+        domain,
+        AndExpr::create(
+            UltExpr::create(mag, inf),
+            OrExpr::create(
+                EqExpr::create(mag, klee::ConstantExpr::create(0, magWidth)),
+                UleExpr::create(minNormal, mag))));
+  }
+
+  if (flags & FloatRange) {
+    // The non-negative values in [max(lo, 0), hi] and the negative ones
+    // in [lo, min(hi, 0)], by magnitude. Zeros of either sign are in the
+    // range when 0 is.
+    llvm::APFloat zero = llvm::APFloat::getZero(lo.getSemantics());
+    bool hiNonNegative = hi.compare(zero) != llvm::APFloat::cmpLessThan;
+    bool loNonPositive = lo.compare(zero) != llvm::APFloat::cmpGreaterThan;
+    ref<Expr> range = klee::ConstantExpr::create(0, Expr::Bool);
+    if (hiNonNegative) {
+      uint64_t from = loNonPositive ? 0 : getFloatMagnitude(lo);
+      range = OrExpr::create(
+          range,
+          AndExpr::create(
+              Expr::createIsZero(sign),
+              AndExpr::create(
+                  UleExpr::create(klee::ConstantExpr::create(from, magWidth), mag),
+                  UleExpr::create(
+                      mag, klee::ConstantExpr::create(getFloatMagnitude(hi),
+                                                magWidth)))));
+    }
+    if (loNonPositive) {
+      uint64_t from = hiNonNegative ? 0 : getFloatMagnitude(hi);
+      range = OrExpr::create(
+          range,
+          AndExpr::create(
+              sign,
+              AndExpr::create(
+                  UleExpr::create(klee::ConstantExpr::create(from, magWidth), mag),
+                  UleExpr::create(
+                      mag, klee::ConstantExpr::create(getFloatMagnitude(lo),
+                                                magWidth)))));
+    }
+    domain = AndExpr::create(domain, range);
+  }
+  return domain;
+}
+
+void SpecialFunctionHandler::handleMakeSymbolicFloat(
+    ExecutionState &state, KInstruction *target,
+    std::vector<ref<Expr> > &arguments) {
+  assert(arguments.size() == 7 &&
+         "invalid number of arguments to klee_make_symbolic_float");
+  std::string name = readStringAtAddress(state, arguments[2]);
+
+  ConstantExpr *kind = dyn_cast<ConstantExpr>(arguments[3]);
+  ConstantExpr *flagsExpr = dyn_cast<ConstantExpr>(arguments[4]);
+  FConstantExpr *loExpr = dyn_cast<FConstantExpr>(arguments[5]);
+  FConstantExpr *hiExpr = dyn_cast<FConstantExpr>(arguments[6]);
+  if (!kind || !flagsExpr || !loExpr || !hiExpr) {
+    executor.terminateStateOnError(
+        state, "klee_make_symbolic_float requires a constant kind, flags "
+               "and bounds",
+        Executor::User);
+    return;
+  }
+  Expr::Width width = kind->getZExtValue();
+  if (width != Expr::Fl32 && width != Expr::Fl64) {
+    executor.terminateStateOnError(
+        state, "invalid kind given to klee_make_symbolic_float",
+        Executor::User);
+    return;
+  }
+  unsigned flags = flagsExpr->getZExtValue();
+
+  llvm::APFloat lo = loExpr->getAPValue(), hi = hiExpr->getAPValue();
+  if (width == Expr::Fl32) {
+    bool losesInfo;
+    lo.convert(llvm::APFloat::IEEEsingle, llvm::APFloat::rmTowardPositive,
+               &losesInfo);
+    hi.convert(llvm::APFloat::IEEEsingle, llvm::APFloat::rmTowardNegative,
+               &losesInfo);
+  }
+  if ((flags & FloatRange) && (lo.isNaN() || hi.isNaN() ||
+                               lo.compare(hi) == llvm::APFloat::cmpGreaterThan)) {
+    executor.terminateStateOnError(
+        state, "empty range given to klee_make_symbolic_float",
+        Executor::User);
+    return;
+  }
+
+  Executor::ExactResolutionList rl;
+  executor.resolveExact(state, arguments[0], rl, "make_symbolic_float");
+
+  for (Executor::ExactResolutionList::iterator it = rl.begin(),
+         ie = rl.end(); it != ie; ++it) {
+    const MemoryObject *mo = it->first.first;
+    mo->setName(name);
+
+    const ObjectState *old = it->first.second;
+    ExecutionState *s = it->second;
+
+    if (old->readOnly) {
+      executor.terminateStateOnError(*s, "cannot make readonly object symbolic",
+                                     Executor::User);
+      return;
+    }
+
+    bool res;
+    bool success __attribute__ ((unused)) =
+      executor.solver->mustBeTrue(*s,
+                                  EqExpr::create(ZExtExpr::create(arguments[1],
+                                                                  Context::get().getPointerWidth()),
+                                                 mo->getSizeExpr()),
+                                  res);
+    assert(success && "FIXME: Unhandled solver failure");
+    if (!res || mo->size % (width / 8) != 0) {
+      executor.terminateStateOnError(
+          *s, "wrong size given to klee_make_symbolic_float", Executor::User);
+      continue;
+    }
+
+    executor.executeMakeSymbolic(*s, mo, name);
+    const ObjectState *os = s->addressSpace.findObject(mo);
+    ref<Expr> domain = ConstantExpr::create(1, Expr::Bool);
+    for (unsigned offset = 0; offset != mo->size; offset += width / 8)
+      domain = AndExpr::create(
+          domain, getFloatDomain(os->read(offset, width), flags, lo, hi));
+
+    // When replaying, the values are given and may be outside the domain.
+    success = executor.solver->mustBeFalse(*s, domain, res);
+    assert(success && "FIXME: Unhandled solver failure");
+    if (res)
+      executor.terminateStateOnError(
+          *s, "klee_make_symbolic_float values outside of their domain",
+          Executor::User);
+    else
+      executor.addConstraint(*s, domain);
+  }
+}
+
 void SpecialFunctionHandler::handleMarkGlobal(ExecutionState &state,
                                               KInstruction *target,
                                               std::vector<ref<Expr> > &arguments) {
@@ -813,6 +1278,22 @@ void SpecialFunctionHandler::handleMarkGlobal(ExecutionState &state,
   }
 }
 
+void SpecialFunctionHandler::handleMarkPure(ExecutionState &state,
+                                            KInstruction *target,
+                                            std::vector<ref<Expr> > &arguments) {
+  assert(arguments.size()==1 &&
+         "invalid number of arguments to klee_mark_pure");
+  std::string name = readStringAtAddress(state, arguments[0]);
+  Function *f = executor.kmodule->module->getFunction(name);
+  if (!f || f->isDeclaration()) {
+    executor.terminateStateOnError(state,
+                                   "klee_mark_pure: no defined function named " +
+                                   name, Executor::User);
+    return;
+  }
+  executor.callMemo.markPure(f);
+}
+
 void SpecialFunctionHandler::handleAddOverflow(ExecutionState &state,
                                                KInstruction *target,
                                                std::vector<ref<Expr> > &arguments) {
@@ -841,16 +1322,95 @@ void SpecialFunctionHandler::handleDivRemOverflow(ExecutionState &state,
                                  Executor::Overflow);
 }
 
+/* The fe* functions work on the floating point environment kept in the
+   state, not on the host's. A fenv_t holds the rounding mode and then the
+   raised exceptions as two ints, and a fexcept_t the exceptions. */
+
+static const unsigned FEnvSize = 2 * sizeof(int);
+
+static bool isRoundingMode(uint64_t mode) {
+  return mode == FE_TONEAREST || mode == FE_DOWNWARD ||
+         mode == FE_UPWARD || mode == FE_TOWARDZERO;
+}
+
+const ObjectState *
+SpecialFunctionHandler::resolveFEnvObject(ExecutionState &state,
+                                          ref<Expr> addressExpr,
+                                          unsigned size, const char *name,
+                                          const MemoryObject *&mo,
+                                          unsigned &offset) {
+  ref<ConstantExpr> address =
+    executor.toConstant(state, addressExpr, (std::string("Argument to ") +
+                                             name).c_str());
+  ObjectPair op;
+  if (!state.addressSpace.resolveOne(address, op) ||
+      address->getZExtValue() - op.first->address + size > op.first->size) {
+    executor.terminateStateOnError(state,
+                                   std::string(name) + ": memory error",
+                                   Executor::Ptr, NULL,
+                                   executor.getAddressInfo(state, address));
+    return 0;
+  }
+  mo = op.first;
+  offset = address->getZExtValue() - op.first->address;
+  return op.second;
+}
+
+bool SpecialFunctionHandler::readFEnv(ExecutionState &state,
+                                      ref<Expr> address, const char *name) {
+  // glibc's FE_DFL_ENV, which points nowhere.
+  ConstantExpr *ce = dyn_cast<ConstantExpr>(address);
+  if (ce && ce->isAllOnes()) {
+    state.roundingMode = llvm::APFloat::rmNearestTiesToEven;
+    state.fpExceptions = 0;
+    return true;
+  }
+
+  const MemoryObject *mo;
+  unsigned offset;
+  const ObjectState *os =
+    resolveFEnvObject(state, address, FEnvSize, name, mo, offset);
+  if (!os)
+    return false;
+  uint64_t mode =
+    executor.toConstant(state, os->read(offset, Expr::Int32), "fenv_t")
+      ->getZExtValue();
+  uint64_t excepts =
+    executor.toConstant(state, os->read(offset + sizeof(int), Expr::Int32),
+                        "fenv_t")->getZExtValue();
+  if (!isRoundingMode(mode)) {
+    executor.terminateStateOnError(state,
+                                   std::string(name) + ": invalid fenv_t",
+                                   Executor::User);
+    return false;
+  }
+  state.setRoundingMode(mode);
+  state.fpExceptions = excepts & FE_ALL_EXCEPT;
+  return true;
+}
+
+bool SpecialFunctionHandler::writeFEnv(ExecutionState &state,
+                                       ref<Expr> address, const char *name) {
+  const MemoryObject *mo;
+  unsigned offset;
+  const ObjectState *os =
+    resolveFEnvObject(state, address, FEnvSize, name, mo, offset);
+  if (!os)
+    return false;
+  ObjectState *wos = state.addressSpace.getWriteable(mo, os);
+  wos->write32(offset, state.getRoundingMode());
+  wos->write32(offset + sizeof(int), state.fpExceptions);
+  return true;
+}
+
 void SpecialFunctionHandler::handleFeClearExcept(ExecutionState &state,
                                                  KInstruction *target,
                                                  std::vector<ref<Expr> > &arguments) {
-
   int excepts = executor.toConstant(state, arguments[0], "Argument to feclearexcept")->getAPValue().getLimitedValue(std::numeric_limits<int>::max());
-  
-  int ret = feclearexcept(excepts);
-  
-  ref<ConstantExpr> retExpr = ConstantExpr::alloc(ret, sizeof(ret) * 8);
-  executor.bindLocal(target, state, retExpr);
+
+  state.fpExceptions &= ~excepts;
+
+  executor.bindLocal(target, state, ConstantExpr::alloc(0, sizeof(int) * 8));
 }
 
 void SpecialFunctionHandler::handleFeGetExceptFlag(ExecutionState &state,
@@ -858,33 +1418,19 @@ void SpecialFunctionHandler::handleFeGetExceptFlag(ExecutionState &state,
                                                    std::vector<ref<Expr> > &arguments) {
   int excepts = executor.toConstant(state, arguments[1], "Argument to fegetexceptflag")->getAPValue().getLimitedValue(std::numeric_limits<int>::max());
 
-  fexcept_t flag;
-  fexcept_t* flagp = &flag;
-  uint8_t* flagArr = (uint8_t*) flagp;
-
-  ref<ConstantExpr> addr = executor.toConstant(state, arguments[0], "Argument to fegetexceptflag");
-
-  ObjectPair op;
-  state.addressSpace.resolveOne(addr, op);
-  ObjectState* os = state.addressSpace.getWriteable(op.first, op.second);
-
-  // fegetexceptflag should not care what's inside *flagp
-  /*for (size_t i = 0; i < op.second->size; ++i)
-  {
-    ref<Expr> e = op.second->read8(i);
-    ref<ConstantExpr> ce = executor.toConstant(state, e, "fexcept_t");
-    flagArr[i] = static_cast<uint8_t>(ce->getZExtValue(8));
-  }*/
-
-  int ret = fegetexceptflag(flagp, excepts);
-
-  for (size_t i = 0; i < sizeof(flag); ++i)
-  {
-    os->write8(i, flagArr[i]);
-  }
+  const MemoryObject *mo;
+  unsigned offset;
+  const ObjectState *os = resolveFEnvObject(state, arguments[0],
+                                            sizeof(fexcept_t),
+                                            "fegetexceptflag", mo, offset);
+  if (!os)
+    return;
+  ObjectState *wos = state.addressSpace.getWriteable(mo, os);
+  int flag = state.fpExceptions & excepts;
+  for (size_t i = 0; i < sizeof(fexcept_t); ++i)
+    wos->write8(offset + i, (uint8_t) (flag >> (8 * i)));
 
-  ref<ConstantExpr> retExpr = ConstantExpr::alloc(ret, sizeof(ret) * 8);
-  executor.bindLocal(target, state, retExpr);
+  executor.bindLocal(target, state, ConstantExpr::alloc(0, sizeof(int) * 8));
 }
 
 void SpecialFunctionHandler::handleFeRaiseExcept(ExecutionState &state,
@@ -892,10 +1438,9 @@ void SpecialFunctionHandler::handleFeRaiseExcept(ExecutionState &state,
                                                  std::vector<ref<Expr> > &arguments) {
   int excepts = executor.toConstant(state, arguments[0], "Argument to feraiseexcept")->getAPValue().getLimitedValue(std::numeric_limits<int>::max());
 
-  int ret = feraiseexcept(excepts);
-  
-  ref<ConstantExpr> retExpr = ConstantExpr::alloc(ret, sizeof(ret) * 8);
-  executor.bindLocal(target, state, retExpr);
+  state.fpExceptions |= excepts & FE_ALL_EXCEPT;
+
+  executor.bindLocal(target, state, ConstantExpr::alloc(0, sizeof(int) * 8));
 }
 
 void SpecialFunctionHandler::handleFeSetExceptFlag(ExecutionState &state,
@@ -903,32 +1448,22 @@ void SpecialFunctionHandler::handleFeSetExceptFlag(ExecutionState &state,
                                                    std::vector<ref<Expr> > &arguments) {
   int excepts = executor.toConstant(state, arguments[1], "Argument to fesetexceptflag")->getAPValue().getLimitedValue(std::numeric_limits<int>::max());
 
-  fexcept_t flag;
-  fexcept_t* flagp = &flag;
-  uint8_t* flagArr = (uint8_t*) flagp;
-
-  ref<ConstantExpr> addr = executor.toConstant(state, arguments[0], "Argument to fesetexceptflag");
-
-  ObjectPair op;
-  state.addressSpace.resolveOne(addr, op);
-  ObjectState* os = state.addressSpace.getWriteable(op.first, op.second);
-
-  for (size_t i = 0; i < op.second->size; ++i)
-  {
-    ref<Expr> e = op.second->read8(i);
-    ref<ConstantExpr> ce = executor.toConstant(state, e, "fexcept_t");
-    flagArr[i] = static_cast<uint8_t>(ce->getZExtValue(8));
-  }
+  const MemoryObject *mo;
+  unsigned offset;
+  const ObjectState *os = resolveFEnvObject(state, arguments[0],
+                                            sizeof(fexcept_t),
+                                            "fesetexceptflag", mo, offset);
+  if (!os)
+    return;
+  int flag = 0;
+  for (size_t i = 0; i < sizeof(fexcept_t); ++i)
+    flag |= (int) executor.toConstant(state, os->read8(offset + i),
+                                      "fexcept_t")->getZExtValue(8)
+              << (8 * i);
+  excepts &= FE_ALL_EXCEPT;
+  state.fpExceptions = (state.fpExceptions & ~excepts) | (flag & excepts);
 
-  int ret = fesetexceptflag(flagp, excepts);
-
-  for (size_t i = 0; i < sizeof(flag); ++i)
-  {
-    os->write8(i, flagArr[i]);
-  }
-
-  ref<ConstantExpr> retExpr = ConstantExpr::alloc(ret, sizeof(ret) * 8);
-  executor.bindLocal(target, state, retExpr);
+  executor.bindLocal(target, state, ConstantExpr::alloc(0, sizeof(int) * 8));
 }
 
 void SpecialFunctionHandler::handleFeTestExcept(ExecutionState &state,
@@ -936,7 +1471,7 @@ void SpecialFunctionHandler::handleFeTestExcept(ExecutionState &state,
                                                 std::vector<ref<Expr> > &arguments) {
   int excepts = executor.toConstant(state, arguments[0], "Argument to fetestexcept")->getAPValue().getLimitedValue(std::numeric_limits<int>::max());
   
-  int ret = fetestexcept(excepts);
+  int ret = state.fpExceptions & excepts;
   
   ref<ConstantExpr> retExpr = ConstantExpr::alloc(ret, sizeof(ret) * 8);
   executor.bindLocal(target, state, retExpr);
@@ -956,7 +1491,11 @@ void SpecialFunctionHandler::handleFeSetRound(ExecutionState &state,
                                               std::vector<ref<Expr> > &arguments) {
   int rounding_mode = executor.toConstant(state, arguments[0], "Argument to fesetround")->getAPValue().getLimitedValue(std::numeric_limits<int>::max());
   
-  int ret = fesetround(rounding_mode);
+  int ret = 1;
+  if (isRoundingMode(rounding_mode)) {
+    state.setRoundingMode(rounding_mode);
+    ret = 0;
+  }
   
   ref<ConstantExpr> retExpr = ConstantExpr::alloc(ret, sizeof(ret) * 8);
   executor.bindLocal(target, state, retExpr);
@@ -965,110 +1504,41 @@ void SpecialFunctionHandler::handleFeSetRound(ExecutionState &state,
 void SpecialFunctionHandler::handleFeGetEnv(ExecutionState &state,
                                             KInstruction *target,
                                             std::vector<ref<Expr> > &arguments) {
-  fenv_t env = state.fEnv;
-  uint8_t* envArr = (uint8_t*) &env;
+  if (!writeFEnv(state, arguments[0], "fegetenv"))
+    return;
 
-  ref<ConstantExpr> addr = executor.toConstant(state, arguments[0], "Argument to fegetenv");
-
-  ObjectPair op;
-  state.addressSpace.resolveOne(addr, op);
-  ObjectState* os = state.addressSpace.getWriteable(op.first, op.second);
-
-  for (size_t i = 0; i < sizeof(env); ++i)
-  {
-    os->write8(i, envArr[i]);
-  }
-  
-  ref<ConstantExpr> retExpr = ConstantExpr::alloc(0, sizeof(int) * 8);
-  executor.bindLocal(target, state, retExpr);
+  executor.bindLocal(target, state, ConstantExpr::alloc(0, sizeof(int) * 8));
 }
 
 void SpecialFunctionHandler::handleFeHoldExcept(ExecutionState &state,
                                                 KInstruction *target,
                                                 std::vector<ref<Expr> > &arguments) {
-  fenv_t env;
-  fenv_t* envp = &env;
-  uint8_t* envArr = (uint8_t*) envp;
+  if (!writeFEnv(state, arguments[0], "feholdexcept"))
+    return;
+  // Exceptions never trap, so there is no non-stop mode to install.
+  state.fpExceptions = 0;
 
-  ref<ConstantExpr> addr = executor.toConstant(state, arguments[0], "Argument to feholdexcept");
-
-  ObjectPair op;
-  state.addressSpace.resolveOne(addr, op);
-  ObjectState* os = state.addressSpace.getWriteable(op.first, op.second);
-
-  // feholdexcept should not care what's inside *envp
-  /*for (size_t i = 0; i < op.second->size; ++i)
-  {
-    ref<Expr> e = op.second->read8(i);
-    ref<ConstantExpr> ce = executor.toConstant(state, e, "fenv_t");
-    envArr[i] = static_cast<uint8_t>(ce->getZExtValue(8));
-  }*/
-
-  int ret = feholdexcept(envp);
-
-  for (size_t i = 0; i < sizeof(env); ++i)
-  {
-    os->write8(i, envArr[i]);
-  }
-
-  ref<ConstantExpr> retExpr = ConstantExpr::alloc(ret, sizeof(ret) * 8);
-  executor.bindLocal(target, state, retExpr);
+  executor.bindLocal(target, state, ConstantExpr::alloc(0, sizeof(int) * 8));
 }
 
 void SpecialFunctionHandler::handleFeSetEnv(ExecutionState &state,
                                             KInstruction *target,
                                             std::vector<ref<Expr> > &arguments) {
-  fenv_t env;
-  fenv_t* envp = &env;
-  uint8_t* envArr = (uint8_t*) envp;
-
-  ref<ConstantExpr> addr = executor.toConstant(state, arguments[0], "Argument to fesetenv");
-
-  ObjectPair op;
-  state.addressSpace.resolveOne(addr, op);
-
-  for (size_t i = 0; i < op.second->size; ++i)
-  {
-    ref<Expr> e = op.second->read8(i);
-    ref<ConstantExpr> ce = executor.toConstant(state, e, "fenv_t");
-    envArr[i] = static_cast<uint8_t>(ce->getZExtValue(8));
-  }
+  if (!readFEnv(state, arguments[0], "fesetenv"))
+    return;
 
-  int ret = fesetenv(envp);
-
-  ref<ConstantExpr> retExpr = ConstantExpr::alloc(ret, sizeof(ret) * 8);
-  executor.bindLocal(target, state, retExpr);
+  executor.bindLocal(target, state, ConstantExpr::alloc(0, sizeof(int) * 8));
 }
 
 void SpecialFunctionHandler::handleFeUpdateEnv(ExecutionState &state,
                                                KInstruction *target,
                                                std::vector<ref<Expr> > &arguments) {
-  fenv_t env;
-  fenv_t* envp = &env;
-  uint8_t* envArr = (uint8_t*) envp;
-
-  ref<ConstantExpr> addr = executor.toConstant(state, arguments[0], "Argument to feupdateenv");
-
-  ObjectPair op;
-  state.addressSpace.resolveOne(addr, op);
-  ObjectState* os = state.addressSpace.getWriteable(op.first, op.second);
-
-  for (size_t i = 0; i < op.second->size; ++i)
-  {
-    ref<Expr> e = op.second->read8(i);
-    ref<ConstantExpr> ce = executor.toConstant(state, e, "fenv_t");
-    envArr[i] = static_cast<uint8_t>(ce->getZExtValue(8));
-  }
-
-  int ret = feupdateenv(envp);
+  int raised = state.fpExceptions;
+  if (!readFEnv(state, arguments[0], "feupdateenv"))
+    return;
+  state.fpExceptions |= raised;
 
-  for (size_t i = 0; i < sizeof(env); ++i)
-  {
-    os->write8(i, envArr[i]);
-  }
-
-  ref<ConstantExpr> retExpr = ConstantExpr::alloc(ret, sizeof(ret) * 8);
-  executor.bindLocal(target, state, retExpr);
+  executor.bindLocal(target, state, ConstantExpr::alloc(0, sizeof(int) * 8));
 }
 
 void SpecialFunctionHandler::handleFAbs(ExecutionState &state,
@@ -1129,3 +1599,216 @@ void SpecialFunctionHandler::handleFMax(ExecutionState &state,
                                         std::vector<ref<Expr> > &arguments) {
   executor.bindLocal(target, state, FMaxExpr::create(arguments[0], arguments[1]));
 }
+
+void SpecialFunctionHandler::handleFma(ExecutionState &state,
+                                       KInstruction *target,
+                                       std::vector<ref<Expr> > &arguments) {
+  executor.bindLocal(target, state, FFmaExpr::create(arguments[0], arguments[1], arguments[2], state.roundingMode));
+}
+
+void SpecialFunctionHandler::handleExp(ExecutionState &state,
+                                       KInstruction *target,
+                                       std::vector<ref<Expr> > &arguments) {
+  callLibm(state, target, arguments, Exp);
+}
+
+void SpecialFunctionHandler::handleLog(ExecutionState &state,
+                                       KInstruction *target,
+                                       std::vector<ref<Expr> > &arguments) {
+  callLibm(state, target, arguments, Log);
+}
+
+void SpecialFunctionHandler::handlePow(ExecutionState &state,
+                                       KInstruction *target,
+                                       std::vector<ref<Expr> > &arguments) {
+  callLibm(state, target, arguments, Pow);
+}
+
+void SpecialFunctionHandler::handleSin(ExecutionState &state,
+                                       KInstruction *target,
+                                       std::vector<ref<Expr> > &arguments) {
+  callLibm(state, target, arguments, Sin);
+}
+
+void SpecialFunctionHandler::handleCos(ExecutionState &state,
+                                       KInstruction *target,
+                                       std::vector<ref<Expr> > &arguments) {
+  callLibm(state, target, arguments, Cos);
+}
+
+static const char *getLibmName(SpecialFunctionHandler::LibmFunction f) {
+  switch (f) {
+  case SpecialFunctionHandler::Exp: return "exp";
+  case SpecialFunctionHandler::Log: return "log";
+  case SpecialFunctionHandler::Pow: return "pow";
+  case SpecialFunctionHandler::Sin: return "sin";
+  case SpecialFunctionHandler::Cos: return "cos";
+  }
+  return "libm";
+}
+
+static ref<Expr> getFloatConstant(double v, Expr::Width w) {
+  if (w == Expr::Fl32)
+    return FConstantExpr::alloc(llvm::APFloat((float) v));
+  return FConstantExpr::alloc(llvm::APFloat(v));
+}
+
+void SpecialFunctionHandler::callLibm(ExecutionState &state,
+                                      KInstruction *target,
+                                      std::vector<ref<Expr> > &arguments,
+                                      LibmFunction f) {
+  Expr::Width w = arguments[0]->getWidth();
+  bool isConstant = true;
+  for (unsigned i = 0; i != arguments.size(); ++i) {
+    if (!isa<FConstantExpr>(arguments[i]))
+      arguments[i] = executor.toUnique(state, arguments[i]);
+    isConstant &= isa<FConstantExpr>(arguments[i]);
+  }
+
+  if (!isConstant) {
+    switch (LibmModel) {
+    case ExternalLibm:
+      executor.terminateStateOnExecError(state,
+                                         "external call with symbolic "
+                                         "argument: " +
+                                         std::string(getLibmName(f)));
+      return;
+    case ConcretizeLibm:
+      for (unsigned i = 0; i != arguments.size(); ++i)
+        arguments[i] = executor.toConstantLane(state, arguments[i]);
+      break;
+    case AbstractLibm:
+      executor.bindLocal(target, state,
+                         getLibmAbstraction(state, arguments, f));
+      return;
+    }
+  }
+
+  // Call the C library directly, without the external call machinery.
+  ref<Expr> result;
+  if (w == Expr::Fl32) {
+    float x = cast<FConstantExpr>(arguments[0])->getAPValue().convertToFloat();
+    float r = 0;
+    switch (f) {
+    case Exp: r = expf(x); break;
+    case Log: r = logf(x); break;
+    case Pow:
+      r = powf(x, cast<FConstantExpr>(arguments[1])->getAPValue()
+                    .convertToFloat());
+      break;
+    case Sin: r = sinf(x); break;
+    case Cos: r = cosf(x); break;
+    }
+    result = FConstantExpr::alloc(llvm::APFloat(r));
+  } else {
+    double x = cast<FConstantExpr>(arguments[0])->getAPValue().convertToDouble();
+    double r = 0;
+    switch (f) {
+    case Exp: r = exp(x); break;
+    case Log: r = log(x); break;
+    case Pow:
+      r = pow(x, cast<FConstantExpr>(arguments[1])->getAPValue()
+                   .convertToDouble());
+      break;
+    case Sin: r = sin(x); break;
+    case Cos: r = cos(x); break;
+    }
+    result = FConstantExpr::alloc(llvm::APFloat(r));
+  }
+  executor.bindLocal(target, state, result);
+}
+
+ref<Expr>
+SpecialFunctionHandler::getLibmAbstraction(ExecutionState &state,
+                                           std::vector<ref<Expr> > &arguments,
+                                           LibmFunction f) {
+  Expr::Width w = arguments[0]->getWidth();
+  std::pair<LibmFunction, std::vector<ref<Expr> > > key(f, arguments);
+  ref<Expr> &r = libmResults[key];
+  if (r.isNull()) {
+    static unsigned id;
+    const Array *array =
+      executor.arrayCache.CreateArray(std::string(getLibmName(f)) + "_ret" +
+                                      llvm::utostr(++id),
+                                      Expr::getMinBytesForWidth(w));
+    r = ExplicitFloatExpr::create(Expr::createTempRead(array, w), w);
+  }
+
+  ref<Expr> x = arguments[0];
+  ref<Expr> zero = getFloatConstant(0, w), one = getFloatConstant(1, w);
+  ref<Expr> intZero = ConstantExpr::create(0, 8 * sizeof(int));
+  ref<Expr> xIsNaN = NeExpr::create(FIsNanExpr::create(x), intZero);
+  ref<Expr> rIsNaN = NeExpr::create(FIsNanExpr::create(r), intZero);
+
+  // The properties of the function the result has; a NaN argument gives a
+  // NaN result except where noted.
+  std::vector<ref<Expr> > axioms;
+  switch (f) {
+  case Exp:
+    axioms.push_back(Expr::createImplies(xIsNaN, rIsNaN));
+    axioms.push_back(Expr::createImplies(FOeqExpr::create(x, zero),
+                                         FOeqExpr::create(r, one)));
+    axioms.push_back(Expr::createImplies(FOgtExpr::create(x, zero),
+                                         FOgeExpr::create(r, one)));
+    axioms.push_back(Expr::createImplies(FOltExpr::create(x, zero),
+                                         AndExpr::create(
+                                           FOgeExpr::create(r, zero),
+                                           FOleExpr::create(r, one))));
+    break;
+  case Log:
+    axioms.push_back(Expr::createImplies(
+                       OrExpr::create(xIsNaN, FOltExpr::create(x, zero)),
+                       rIsNaN));
+    axioms.push_back(Expr::createImplies(FOeqExpr::create(x, one),
+                                         FOeqExpr::create(r, zero)));
+    axioms.push_back(Expr::createImplies(FOgtExpr::create(x, one),
+                                         FOgtExpr::create(r, zero)));
+    axioms.push_back(Expr::createImplies(
+                       AndExpr::create(FOgeExpr::create(x, zero),
+                                       FOltExpr::create(x, one)),
+                       FOltExpr::create(r, zero)));
+    break;
+  case Pow: {
+    ref<Expr> y = arguments[1];
+    ref<Expr> yIsNaN = NeExpr::create(FIsNanExpr::create(y), intZero);
+    // pow(x, 0) and pow(1, y) are 1 even for NaNs.
+    ref<Expr> isOne = OrExpr::create(FOeqExpr::create(y, zero),
+                                     FOeqExpr::create(x, one));
+    axioms.push_back(Expr::createImplies(isOne, FOeqExpr::create(r, one)));
+    axioms.push_back(Expr::createImplies(
+                       AndExpr::create(OrExpr::create(xIsNaN, yIsNaN),
+                                       Expr::createIsZero(isOne)),
+                       rIsNaN));
+    axioms.push_back(Expr::createImplies(
+                       AndExpr::create(FOgtExpr::create(x, zero),
+                                       Expr::createIsZero(yIsNaN)),
+                       FOgeExpr::create(r, zero)));
+    break;
+  }
+  case Sin:
+  case Cos: {
+    ref<Expr> xIsFinite = NeExpr::create(FIsFiniteExpr::create(x), intZero);
+    axioms.push_back(Expr::createImplies(Expr::createIsZero(xIsFinite),
+                                         rIsNaN));
+    axioms.push_back(Expr::createImplies(
+                       xIsFinite,
+                       AndExpr::create(
+                         FOgeExpr::create(r, getFloatConstant(-1, w)),
+                         FOleExpr::create(r, one))));
+    // sin keeps the sign of a zero.
+    axioms.push_back(Expr::createImplies(FOeqExpr::create(x, zero),
+                                         f == Sin ?
+                                         EqExpr::create(
+                                           ExplicitIntExpr::create(r, w),
+                                           ExplicitIntExpr::create(x, w)) :
+                                         FOeqExpr::create(r, one)));
+    break;
+  }
+  }
+
+  for (std::vector<ref<Expr> >::iterator it = axioms.begin(),
+         ie = axioms.end(); it != ie; ++it)
+    if (!(*it)->isTrue())
+      executor.addConstraint(state, *it);
+  return r;
+}
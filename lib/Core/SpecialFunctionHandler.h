@@ -23,6 +23,8 @@ namespace klee {
   class Executor;
   class Expr;
   class ExecutionState;
+  class MemoryObject;
+  class ObjectState;
   struct KInstruction;
   template<typename T> class ref;
   
@@ -32,8 +34,8 @@ namespace klee {
                                                     KInstruction *target, 
                                                     std::vector<ref<Expr> > 
                                                       &arguments);
-    typedef std::map<const llvm::Function*, 
-                     std::pair<Handler,bool> > handlers_ty;
+    /// The index in the handler table of the handler of each function.
+    typedef std::map<const llvm::Function*, unsigned> handlers_ty;
 
     handlers_ty handlers;
     class Executor &executor;
@@ -88,9 +90,53 @@ namespace klee {
                 KInstruction *target,
                 std::vector< ref<Expr> > &arguments);
 
+    /// getHandler - The index of the handler bound to \a f, or -1 if it has
+    /// none, so that call sites can look it up once.
+    int getHandler(const llvm::Function *f) const;
+
+    /// Run the handler at \a index, as getHandler gave it.
+    void handle(ExecutionState &state,
+                int index,
+                KInstruction *target,
+                std::vector< ref<Expr> > &arguments);
+
+    /// Copy or fill memory natively for a call of the defined function \a f
+    /// if it is memcpy, memmove, mempcpy or memset, and its pointers and
+    /// length are concrete and in bounds of one object each. Returns false
+    /// to leave the call to its definition in the runtime, which also
+    /// reports its errors.
+    bool handleBulkMemory(ExecutionState &state,
+                          llvm::Function *f,
+                          KInstruction *target,
+                          std::vector< ref<Expr> > &arguments);
+
+    /// Compute a call of the defined function \a f natively if it is
+    /// strlen, strcmp, strncmp, memcmp, strchr or memchr, and the bytes it
+    /// reads are concrete and in bounds of the objects its concrete
+    /// pointers point to. The results are those of klee-libc. Returns false
+    /// to leave the call to its definition in the runtime.
+    bool handleStringFunction(ExecutionState &state,
+                              llvm::Function *f,
+                              KInstruction *target,
+                              std::vector< ref<Expr> > &arguments);
+
     /* Convenience routines */
 
     std::string readStringAtAddress(ExecutionState &state, ref<Expr> address);
+
+    /// resolveFEnvObject - The object holding the \a size bytes at
+    /// \a address, an argument of \a name, and their offset in it.
+    /// Terminates the state and returns null if there is none.
+    const ObjectState *resolveFEnvObject(ExecutionState &state,
+                                         ref<Expr> address, unsigned size,
+                                         const char *name,
+                                         const MemoryObject *&mo,
+                                         unsigned &offset);
+
+    /// Read or write the floating point environment of \a state as a
+    /// fenv_t at \a address, returning false if the state was terminated.
+    bool readFEnv(ExecutionState &state, ref<Expr> address, const char *name);
+    bool writeFEnv(ExecutionState &state, ref<Expr> address, const char *name);
     
     /* Handlers */
 
@@ -114,8 +160,10 @@ namespace klee {
     HANDLER(handleGetValue);
     HANDLER(handleIsSymbolic);
     HANDLER(handleMakeSymbolic);
+    HANDLER(handleMakeSymbolicFloat);
     HANDLER(handleMalloc);
     HANDLER(handleMarkGlobal);
+    HANDLER(handleMarkPure);
     HANDLER(handleMerge);
     HANDLER(handleNew);
     HANDLER(handleNewArray);
@@ -158,8 +206,35 @@ namespace klee {
     HANDLER(handleFMod);
     HANDLER(handleFMin);
     HANDLER(handleFMax);
+    HANDLER(handleFma);
+    HANDLER(handleExp);
+    HANDLER(handleLog);
+    HANDLER(handlePow);
+    HANDLER(handleSin);
+    HANDLER(handleCos);
 
 #undef HANDLER
+
+    /// The functions of the C math library modelled by -libm-model.
+    enum LibmFunction { Exp, Log, Pow, Sin, Cos };
+
+  private:
+    enum BulkMemoryFunction { Memcpy, Mempcpy, Memset };
+    std::map<const llvm::Function*, BulkMemoryFunction> bulkMemoryFunctions;
+
+    enum StringFunction { Strlen, Strcmp, Strncmp, Memcmp, Strchr, Memchr };
+    std::map<const llvm::Function*, StringFunction> stringFunctions;
+
+    /// Results of -libm-model=abstract calls by function and arguments, so
+    /// that calls with the same arguments return the same value.
+    std::map<std::pair<LibmFunction, std::vector<ref<Expr> > >,
+             ref<Expr> > libmResults;
+
+    void callLibm(ExecutionState &state, KInstruction *target,
+                  std::vector<ref<Expr> > &arguments, LibmFunction f);
+    ref<Expr> getLibmAbstraction(ExecutionState &state,
+                                 std::vector<ref<Expr> > &arguments,
+                                 LibmFunction f);
   };
 } // End klee namespace
 
@@ -19,12 +19,16 @@
 #include "klee/Internal/System/MemoryUsage.h"
 #include "klee/Internal/System/Time.h"
 #include "klee/Internal/Support/ErrorHandling.h"
+#include "klee/Solver.h"
+#include "klee/SolverProfile.h"
 #include "klee/SolverStats.h"
+#include "klee/CommandLine.h"
 
 #include "CallPathManager.h"
 #include "CoreStats.h"
 #include "Executor.h"
 #include "MemoryManager.h"
+#include "MetricsServer.h"
 #include "UserSearcher.h"
 
 #if LLVM_VERSION_CODE > LLVM_VERSION(3, 2)
@@ -44,10 +48,12 @@
 #include "llvm/Module.h"
 #include "llvm/Type.h"
 #endif
+#include "llvm/ADT/StringExtras.h"
 #include "llvm/Support/CommandLine.h"
 #include "llvm/Support/Process.h"
 #include "llvm/Support/Path.h"
 #include "llvm/Support/FileSystem.h"
+#include "llvm/Support/Format.h"
 
 #if LLVM_VERSION_CODE < LLVM_VERSION(3, 5)
 #include "llvm/Support/CallSite.h"
@@ -57,7 +63,15 @@
 #include "llvm/IR/CFG.h"
 #endif
 
+#include <algorithm>
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
 #include <fstream>
+#include <functional>
+#include <queue>
+#include <fcntl.h>
+#include <sys/file.h>
 #include <unistd.h>
 
 using namespace klee;
@@ -107,17 +121,101 @@ namespace {
                           cl::init(30.),
 			  cl::desc("(default=30.0s)"));
   
+  enum StatsFormatType {
+    TextStats,
+    BinaryStats
+  };
+
+  cl::opt<StatsFormatType>
+  StatsFormat("stats-format",
+              cl::desc("Format of the statistics files (default=text)"),
+              cl::values(clEnumValN(TextStats, "text",
+                                    "run.stats, and run.istats in the "
+                                    "callgrind format"),
+                         clEnumValN(BinaryStats, "binary",
+                                    "run.stats.bin and run.istats.bin, "
+                                    "which are appended to instead of "
+                                    "rewritten (see klee-stats "
+                                    "--to-callgrind)"),
+                         clEnumValEnd),
+              cl::init(TextStats));
+
   cl::opt<bool>
   UseCallPaths("use-call-paths",
 	       cl::init(true),
                cl::desc("Enable calltree tracking for instruction level statistics (default=on)"));
+
+  cl::opt<std::string>
+  MetricsAddress("metrics-address",
+                 cl::desc("Serve live statistics over HTTP in the Prometheus text format on this TCP [host:]port, or Unix domain socket path if it contains a '/'. Parallel worker <i> uses the port plus <i>, or the path with the suffix .<i> (default=off)"),
+                 cl::init(""));
+
+  cl::opt<std::string>
+  SharedCoverageFile("shared-coverage-file",
+                     cl::desc("Merge the instructions covered into this file, shared by all the instances exploring the same program, on the same host or a file system with locking across hosts, and count the ones any of them covered as covered, for new coverage and distances to uncovered code (default=off)"),
+                     cl::init(""));
+
+  cl::opt<double>
+  SharedCoverageInterval("shared-coverage-interval",
+                         cl::init(5.),
+                         cl::desc("Approximate number of seconds between merges with -shared-coverage-file (default=5.0s)"));
+
+  cl::opt<bool>
+  WriteFunctionCosts("write-function-costs",
+                     cl::init(false),
+                     cl::desc("Write the interpreter time, solver time and states spawned in each function to function.costs (default=off)"));
+
+  cl::list<std::string>
+  FunctionBudgets("function-budget",
+                  cl::desc("Limit the exploration of a function and the ones it calls to <seconds> of interpreter time, <solver-seconds> of solver time and <states> states spawned, 0 being no limit: once over, its calls get concrete arguments, and calls of pure functions are memoized (see -memoize-pure-calls)"),
+                  cl::value_desc("name:seconds[:solver-seconds[:states]]"));
   
 }
 
+/// How often to look for metrics requests, in seconds.
+static const double MetricsPollInterval = 0.1;
+
 ///
 
+static bool trackFunctionCosts() {
+  return WriteFunctionCosts || !FunctionBudgets.empty();
+}
+
+static bool hasBudget(const KFunction *kf) {
+  return kf->budget.time || kf->budget.solverTime || kf->budget.states;
+}
+
 bool StatsTracker::useStatistics() {
-  return OutputStats || OutputIStats;
+  return OutputStats || OutputIStats || !MetricsAddress.empty() ||
+         trackFunctionCosts();
+}
+
+static std::string getStatsFilename(const std::string &name,
+                                    const std::string &suffix) {
+  return name + suffix + (StatsFormat == BinaryStats ? ".bin" : "");
+}
+
+/// The binary statistics files are little endian, and strings in them are
+/// a u32 length followed by the characters.
+static void writeBinary32(llvm::raw_ostream &os, uint32_t v) {
+  for (unsigned i = 0; i != 4; ++i)
+    os << (char) (v >> (8 * i));
+}
+
+static void writeBinary64(llvm::raw_ostream &os, uint64_t v) {
+  for (unsigned i = 0; i != 8; ++i)
+    os << (char) (v >> (8 * i));
+}
+
+static void writeBinaryDouble(llvm::raw_ostream &os, double v) {
+  uint64_t bits;
+  memcpy(&bits, &v, sizeof bits);
+  writeBinary64(os, bits);
+}
+
+static void writeBinaryString(llvm::raw_ostream &os, const std::string &s) {
+  writeBinary32(os, s.size());
+  os << s;
 }
 
 namespace klee {
@@ -141,6 +239,28 @@ namespace klee {
     void run() { statsTracker->writeStatsLine(); }
   };
 
+  class ServeMetricsTimer : public Executor::Timer {
+    StatsTracker *statsTracker;
+
+  public:
+    ServeMetricsTimer(StatsTracker *_statsTracker)
+      : statsTracker(_statsTracker) {}
+    ~ServeMetricsTimer() {}
+
+    void run() { statsTracker->serveMetrics(); }
+  };
+
+  class MergeCoverageTimer : public Executor::Timer {
+    StatsTracker *statsTracker;
+
+  public:
+    MergeCoverageTimer(StatsTracker *_statsTracker)
+      : statsTracker(_statsTracker) {}
+    ~MergeCoverageTimer() {}
+
+    void run() { statsTracker->mergeSharedCoverage(); }
+  };
+
   class UpdateReachableTimer : public Executor::Timer {
     StatsTracker *statsTracker;
     
@@ -188,7 +308,14 @@ StatsTracker::StatsTracker(Executor &_executor, std::string _objectFilename,
     numBranches(0),
     fullBranches(0),
     partialBranches(0),
-    updateMinDistToUncovered(_updateMinDistToUncovered) {
+    updateMinDistToUncovered(_updateMinDistToUncovered),
+    metricsServer(0),
+    lastMetricsInstructions(0),
+    lastMetricsTime(startWallTime),
+    sharedCoverageFd(-1),
+    lastChargeTime(startWallTime),
+    lastChargeSolverTime(0),
+    lastChargeForks(0) {
 
   if (StatsWriteAfterInstructions > 0 && StatsWriteInterval > 0)
     klee_error("Both options --stats-write-interval and "
@@ -203,6 +330,24 @@ StatsTracker::StatsTracker(Executor &_executor, std::string _objectFilename,
 
   KModule *km = executor.kmodule;
 
+  for (std::vector<std::string>::iterator it = FunctionBudgets.begin(),
+         ie = FunctionBudgets.end(); it != ie; ++it) {
+    std::string::size_type colon = it->find(':');
+    Function *f = km->module->getFunction(it->substr(0, colon));
+    std::map<llvm::Function*, KFunction*>::iterator kf =
+      f ? km->functionMap.find(f) : km->functionMap.end();
+    if (colon == std::string::npos || kf == km->functionMap.end())
+      klee_error("invalid -function-budget %s: expected the name of a "
+                 "defined function followed by :<seconds>", it->c_str());
+    FunctionCost &budget = kf->second->budget;
+    unsigned long long states = 0;
+    int n = sscanf(it->c_str() + colon + 1, "%lf:%lf:%llu", &budget.time,
+                   &budget.solverTime, &states);
+    budget.states = states;
+    if (n < 1 || budget.time < 0 || budget.solverTime < 0)
+      klee_error("invalid -function-budget %s", it->c_str());
+  }
+
   if (!sys::path::is_absolute(objectFilename)) {
     SmallString<128> current(objectFilename);
     if(sys::fs::make_absolute(current)) {
@@ -246,7 +391,8 @@ StatsTracker::StatsTracker(Executor &_executor, std::string _objectFilename,
   }
 
   if (OutputStats) {
-    statsFile = executor.interpreterHandler->openOutputFile("run.stats");
+    statsFile = executor.interpreterHandler->openOutputFile(
+        getStatsFilename("run.stats", ""));
     assert(statsFile && "unable to open statistics trace file");
     writeStatsHeader();
     writeStatsLine();
@@ -255,6 +401,18 @@ StatsTracker::StatsTracker(Executor &_executor, std::string _objectFilename,
       executor.addTimer(new WriteStatsTimer(this), StatsWriteInterval);
   }
 
+  if (!SharedCoverageFile.empty()) {
+    if (!OutputIStats) {
+      klee_warning("-shared-coverage-file needs -output-istats, ignoring it");
+    } else {
+      openSharedCoverage(SharedCoverageFile);
+      mergeSharedCoverage();
+      if (sharedCoverageFd >= 0)
+        executor.addTimer(new MergeCoverageTimer(this),
+                          SharedCoverageInterval);
+    }
+  }
+
   // Add timer to calculate uncovered instructions if needed by the solver
   if (updateMinDistToUncovered) {
     computeReachableUncovered();
@@ -262,12 +420,22 @@ StatsTracker::StatsTracker(Executor &_executor, std::string _objectFilename,
   }
 
   if (OutputIStats) {
-    istatsFile = executor.interpreterHandler->openOutputFile("run.istats");
+    istatsFile = executor.interpreterHandler->openOutputFile(
+        getStatsFilename("run.istats", ""));
     assert(istatsFile && "unable to open istats file");
+    if (StatsFormat == BinaryStats)
+      writeBinaryIStatsHeader();
 
     if (IStatsWriteInterval > 0)
       executor.addTimer(new WriteIStatsTimer(this), IStatsWriteInterval);
   }
+
+  if (!MetricsAddress.empty()) {
+    metricsServer = new MetricsServer(MetricsAddress);
+    if (metricsServer->good())
+      klee_message("serving metrics on %s", MetricsAddress.c_str());
+    executor.addTimer(new ServeMetricsTimer(this), MetricsPollInterval);
+  }
 }
 
 StatsTracker::~StatsTracker() {  
@@ -275,12 +443,326 @@ StatsTracker::~StatsTracker() {
     delete statsFile;
   if (istatsFile)
     delete istatsFile;
+  delete metricsServer;
+  if (sharedCoverageFd >= 0)
+    close(sharedCoverageFd);
+}
+
+void StatsTracker::startWorker(unsigned index) {
+  std::string suffix = "." + llvm::utostr(index);
+
+  // A lock belongs to the open file, which the workers would share.
+  if (sharedCoverageFd >= 0) {
+    close(sharedCoverageFd);
+    openSharedCoverage(SharedCoverageFile);
+  }
+
+  if (metricsServer) {
+    delete metricsServer;
+    metricsServer = new MetricsServer(
+        MetricsServer::getWorkerAddress(MetricsAddress, index));
+  }
+
+  // Both files are flushed after every write, so dropping the inherited
+  // streams loses nothing.
+  if (statsFile) {
+    delete statsFile;
+    statsFile = executor.interpreterHandler->openOutputFile(
+        getStatsFilename("run.stats", suffix));
+    assert(statsFile && "unable to open statistics trace file");
+    writeStatsHeader();
+    writeStatsLine();
+  }
+
+  if (istatsFile) {
+    delete istatsFile;
+    istatsFile = executor.interpreterHandler->openOutputFile(
+        getStatsFilename("run.istats", suffix));
+    assert(istatsFile && "unable to open istats file");
+    if (StatsFormat == BinaryStats)
+      writeBinaryIStatsHeader();
+  }
+}
+
+void StatsTracker::serveMetrics() {
+  int conn;
+  while ((conn = metricsServer->accept()) >= 0) {
+    std::string body;
+    llvm::raw_string_ostream os(body);
+    writeMetrics(os);
+    metricsServer->respond(conn, os.str());
+  }
+}
+
+namespace {
+  /// Writes metrics in the Prometheus text exposition format.
+  class MetricsWriter {
+    llvm::raw_ostream &os;
+
+  public:
+    MetricsWriter(llvm::raw_ostream &_os) : os(_os) {}
+
+    void header(const char *name, const char *type, const char *help) {
+      os << "# HELP klee_" << name << " " << help << "\n";
+      os << "# TYPE klee_" << name << " " << type << "\n";
+    }
+
+    void sample(const char *name, double value,
+                const std::string &labels = "") {
+      os << "klee_" << name;
+      if (!labels.empty())
+        os << "{" << labels << "}";
+      os << " " << value << "\n";
+    }
+
+    void metric(const char *name, const char *type, const char *help,
+                double value) {
+      header(name, type, help);
+      sample(name, value);
+    }
+
+    void cache(const char *cache, const Statistic &hits,
+               const Statistic &misses) {
+      std::string label = std::string("cache=\"") + cache + "\"";
+      uint64_t h = hits, m = misses;
+      sample("cache_hits_total", h, label);
+      sample("cache_misses_total", m, label);
+      sample("cache_hit_ratio", h + m ? (double) h / (h + m) : 0, label);
+    }
+  };
+}
+
+void StatsTracker::writeMetrics(llvm::raw_ostream &os) {
+  MetricsWriter w(os);
+  double now = util::getWallTime();
+  uint64_t instructions = stats::instructions;
+
+  w.metric("elapsed_seconds", "gauge", "Wall time since the start.",
+           elapsed());
+  w.metric("instructions_total", "counter", "Instructions executed.",
+           instructions);
+  w.metric("instructions_per_second", "gauge",
+           "Instructions executed per second since the last request.",
+           now > lastMetricsTime
+               ? (instructions - lastMetricsInstructions) /
+                     (now - lastMetricsTime)
+               : 0);
+  lastMetricsInstructions = instructions;
+  lastMetricsTime = now;
+  w.metric("states", "gauge", "States under exploration.",
+           executor.states.size());
+  w.metric("memory_bytes", "gauge", "Memory in use.",
+           util::GetTotalMallocUsage() +
+               executor.memory->getUsedDeterministicSize());
+  w.header("counted_memory_bytes", "gauge",
+           "Memory in use, by the part of klee which counts it.");
+  for (unsigned i = 0; i != util::NumMemoryCategories; ++i) {
+    util::MemoryCategory category = (util::MemoryCategory) i;
+    w.sample("counted_memory_bytes", util::GetCountedMemoryUsage(category),
+             std::string("category=\"") +
+                 util::GetMemoryCategoryName(category) + "\"");
+  }
+
+  w.metric("queries_total", "counter", "Solver queries.",
+           (uint64_t) stats::queries);
+  w.metric("query_constructs_total", "counter",
+           "Queries constructed by the solver backend.",
+           (uint64_t) stats::queryConstructs);
+  w.metric("query_seconds_total", "counter",
+           "Time spent in the solver chain, caches included.",
+           stats::queryTime / 1000000.);
+  w.header("solver_seconds_total", "counter",
+           "Time spent in the core solver, by backend.");
+  w.sample("solver_seconds_total", stats::solverTime / 1000000.,
+           std::string("backend=\"") + getCoreSolverName(CoreSolverToUse) +
+               "\"");
+
+  w.header("cache_hits_total", "counter", "Solver cache hits, by cache.");
+  w.header("cache_misses_total", "counter", "Solver cache misses, by cache.");
+  w.header("cache_hit_ratio", "gauge", "Solver cache hit ratio, by cache.");
+  w.cache("query", stats::queryCacheHits, stats::queryCacheMisses);
+  w.cache("counterexample", stats::queryCexCacheHits,
+          stats::queryCexCacheMisses);
+  w.cache("construct", stats::queryConstructCacheHits,
+          stats::queryConstructCacheMisses);
+  w.cache("persistent", stats::queryPersistentCacheHits,
+          stats::queryPersistentCacheMisses);
+  w.cache("shared", stats::querySharedCacheHits,
+          stats::querySharedCacheMisses);
+  w.metric("float_triage_queries_total", "counter",
+           "Floating-point queries looked at by the float triage solver.",
+           (uint64_t) stats::floatTriageQueries);
+  w.metric("float_triage_decided_total", "counter",
+           "Floating-point queries answered by the float triage solver.",
+           (uint64_t) stats::floatTriageDecided);
+
+  w.metric("covered_instructions", "gauge", "Instructions covered.",
+           (uint64_t) stats::coveredInstructions);
+  w.metric("uncovered_instructions", "gauge", "Instructions not covered.",
+           (uint64_t) stats::uncoveredInstructions);
+  w.metric("branches", "gauge", "Conditional branches.", numBranches);
+  w.metric("full_branches", "gauge",
+           "Conditional branches covered both ways.", fullBranches);
+  w.metric("partial_branches", "gauge",
+           "Conditional branches covered one way.", partialBranches);
+
+  // Everything else, for completeness, under its run.stats name.
+  w.header("statistic", "gauge", "Every statistic, by name.");
+  for (unsigned i = 0, e = theStatisticManager->getNumStatistics(); i != e;
+       ++i) {
+    Statistic &s = theStatisticManager->getStatistic(i);
+    w.sample("statistic", theStatisticManager->getValue(s),
+             "name=\"" + s.getName() + "\"");
+  }
+}
+
+/// The header of a -shared-coverage-file: the magic "KCOV", a u32 format
+/// version, the u32 number of instruction ids and a u64 hash of the names
+/// and sizes of the functions of the module, all little endian. Instances
+/// only share a file if they number the instructions the same way. A bit
+/// for each instruction id follows, set once it is covered.
+static std::string getSharedCoverageHeader(KModule *km) {
+  uint64_t h = 14695981039346656037ULL;
+  for (std::vector<KFunction*>::iterator it = km->functions.begin(),
+         ie = km->functions.end(); it != ie; ++it) {
+    std::string key = (*it)->function->getName().str() + ":" +
+                      llvm::utostr((*it)->numInstructions) + ";";
+    for (std::string::iterator c = key.begin(), ce = key.end(); c != ce; ++c) {
+      h ^= (unsigned char) *c;
+      h *= 1099511628211ULL;
+    }
+  }
+
+  std::string header;
+  llvm::raw_string_ostream os(header);
+  os << "KCOV";
+  writeBinary32(os, 1);
+  writeBinary32(os, km->infos->getMaxID());
+  writeBinary64(os, h);
+  os.flush();
+  return header;
+}
+
+void StatsTracker::openSharedCoverage(const std::string &path) {
+  sharedCoverageFd = open(path.c_str(), O_RDWR | O_CREAT, 0666);
+  if (sharedCoverageFd < 0)
+    klee_warning("unable to open shared coverage file %s: %s", path.c_str(),
+                 strerror(errno));
+  sharedCovered.resize(executor.kmodule->infos->getMaxID());
+}
+
+void StatsTracker::mergeSharedCoverage() {
+  if (sharedCoverageFd < 0)
+    return;
+  if (flock(sharedCoverageFd, LOCK_EX) != 0) {
+    klee_warning_once(0, "unable to lock shared coverage file: %s",
+                      strerror(errno));
+    return;
+  }
+
+  StatisticManager &sm = *theStatisticManager;
+  std::string header = getSharedCoverageHeader(executor.kmodule);
+  unsigned numIds = sharedCovered.size();
+  std::vector<unsigned char> data(header.size() + (numIds + 7) / 8);
+  size_t size = 0;
+  while (size < data.size()) {
+    ssize_t n = pread(sharedCoverageFd, &data[size], data.size() - size, size);
+    if (n < 0 && errno == EINTR)
+      continue;
+    if (n <= 0)
+      break;
+    size += n;
+  }
+  bool changed = size == 0;
+  if (changed) {
+    std::copy(header.begin(), header.end(), data.begin());
+  } else if (size != data.size() ||
+             !std::equal(header.begin(), header.end(), data.begin())) {
+    klee_warning("shared coverage file %s is of another program, not "
+                 "sharing coverage",
+                 SharedCoverageFile.c_str());
+    flock(sharedCoverageFd, LOCK_UN);
+    close(sharedCoverageFd);
+    sharedCoverageFd = -1;
+    return;
+  }
+
+  bool learned = false;
+  unsigned char *bits = &data[header.size()];
+  for (unsigned id = 0; id != numIds; ++id) {
+    unsigned char mask = 1 << (id % 8);
+    if (!(bits[id / 8] & mask) &&
+        sm.getIndexedValue(stats::coveredInstructions, id)) {
+      bits[id / 8] |= mask;
+      changed = true;
+    }
+    if ((bits[id / 8] & mask) && !sharedCovered[id]) {
+      sharedCovered[id] = true;
+      learned = true;
+    }
+  }
+
+  for (size = 0; changed && size < data.size();) {
+    ssize_t n = pwrite(sharedCoverageFd, &data[size], data.size() - size, size);
+    if (n < 0 && errno == EINTR)
+      continue;
+    if (n <= 0) {
+      klee_warning_once(0, "unable to write shared coverage file: %s",
+                        strerror(errno));
+      break;
+    }
+    size += n;
+  }
+  flock(sharedCoverageFd, LOCK_UN);
+
+  if (learned && updateMinDistToUncovered)
+    computeReachableUncovered();
+}
+
+/// The functions by decreasing interpreter time.
+static bool compareFunctionTime(const KFunction *a, const KFunction *b) {
+  return a->cost.time > b->cost.time;
+}
+
+void StatsTracker::writeFunctionCosts() {
+  std::vector<KFunction*> functions(executor.kmodule->functions);
+  std::stable_sort(functions.begin(), functions.end(), compareFunctionTime);
+
+  llvm::raw_fd_ostream *os =
+    executor.interpreterHandler->openOutputFile("function.costs");
+  if (!os)
+    return;
+  *os << "# function\ttime\tsolver-time\tstates\tbudget\n";
+  for (std::vector<KFunction*>::iterator it = functions.begin(),
+         ie = functions.end(); it != ie; ++it) {
+    KFunction *kf = *it;
+    if (!kf->cost.time && !kf->cost.states && !hasBudget(kf))
+      continue;
+    *os << kf->function->getName() << "\t"
+        << llvm::format("%.6f\t%.6f\t", kf->cost.time, kf->cost.solverTime)
+        << kf->cost.states << "\t";
+    if (hasBudget(kf))
+      *os << llvm::format("%g:%g:", kf->budget.time, kf->budget.solverTime)
+          << kf->budget.states
+          << (kf->cost.exceeds(kf->budget) ? " exceeded" : "");
+    else
+      *os << "-";
+    *os << "\n";
+  }
+  delete os;
 }
 
 void StatsTracker::done() {
   if (statsFile)
     writeStatsLine();
 
+  if (WriteFunctionCosts) {
+    chargeFunctions(0);
+    writeFunctionCosts();
+  }
+
+  mergeSharedCoverage();
+
   if (OutputIStats) {
     if (updateMinDistToUncovered)
       computeReachableUncovered();
@@ -288,7 +770,42 @@ void StatsTracker::done() {
   }
 }
 
+void StatsTracker::chargeFunctions(ExecutionState *es) {
+  double now = util::getWallTime();
+  uint64_t solverTime = stats::solverTime, forks = stats::forks;
+  FunctionCost cost;
+  cost.time = now - lastChargeTime;
+  cost.solverTime = (solverTime - lastChargeSolverTime) / 1000000.;
+  cost.states = forks - lastChargeForks;
+  // The solver time is part of the time of the step, not interpreting.
+  cost.time = std::max(cost.time - cost.solverTime, 0.);
+  for (std::vector<KFunction*>::iterator it = chargedFunctions.begin(),
+         ie = chargedFunctions.end(); it != ie; ++it) {
+    (*it)->cost.time += cost.time;
+    (*it)->cost.solverTime += cost.solverTime;
+    (*it)->cost.states += cost.states;
+  }
+  lastChargeTime = now;
+  lastChargeSolverTime = solverTime;
+  lastChargeForks = forks;
+
+  // The step about to be taken is charged to the function it is in, and
+  // the functions with a budget it was called from.
+  chargedFunctions.clear();
+  if (!es)
+    return;
+  KFunction *top = es->stack.back().kf;
+  chargedFunctions.push_back(top);
+  for (int i = es->stack.back().budgetFrame; i >= 0;
+       i = i ? es->stack[i - 1].budgetFrame : -1)
+    if (es->stack[i].kf != top)
+      chargedFunctions.push_back(es->stack[i].kf);
+}
+
 void StatsTracker::stepInstruction(ExecutionState &es) {
+  if (trackFunctionCosts())
+    chargeFunctions(&es);
+
   if (OutputIStats) {
     if (TrackInstructionTime) {
       static sys::TimeValue lastNowTime(0,0),lastUserTime(0,0);
@@ -325,9 +842,13 @@ void StatsTracker::stepInstruction(ExecutionState &es) {
         //
         // FIXME: This trick no longer works, we should fix this in the line
         // number propogation.
-          es.coveredLines[&ii.file].insert(ii.line);
-	es.coveredNew = true;
-        es.instsSinceCovNew = 1;
+        es.coveredInstructions.set(ii.id);
+        // Another instance sharing coverage got here first.
+        if (sharedCovered.empty() || !sharedCovered[ii.id]) {
+          es.coveredNew = true;
+          ++es.newInstructions;
+          es.instsSinceCovNew = 1;
+        }
 	++stats::coveredInstructions;
 	stats::uncoveredInstructions += (uint64_t)-1;
       }
@@ -347,6 +868,19 @@ void StatsTracker::stepInstruction(ExecutionState &es) {
 
 /* Should be called _after_ the es->pushFrame() */
 void StatsTracker::framePushed(ExecutionState &es, StackFrame *parentFrame) {
+  if (trackFunctionCosts()) {
+    StackFrame &sf = es.stack.back();
+    sf.budgetFrame = parentFrame ? parentFrame->budgetFrame : -1;
+
+    // A recursive call is already charged through the outer one.
+    bool charged = false;
+    for (int i = sf.budgetFrame; i >= 0 && !charged;
+         i = i ? es.stack[i - 1].budgetFrame : -1)
+      charged = es.stack[i].kf == sf.kf;
+    if (hasBudget(sf.kf) && !charged)
+      sf.budgetFrame = es.stack.size() - 1;
+  }
+
   if (OutputIStats) {
     StackFrame &sf = es.stack.back();
 
@@ -402,29 +936,123 @@ void StatsTracker::markBranchVisited(ExecutionState *visitedTrue,
   }
 }
 
+namespace {
+  /// StatsRecordWriter - Writes the header or a line of run.stats. In the
+  /// text format, each is a Python tuple on a line of its own. In the binary
+  /// one, the file starts with the magic "KSTB", a u32 format version and
+  /// a u8 type ('I' for an u64 count, 'F' for a double time in seconds) and
+  /// name for each column, followed by a u8 0, and each line is the values
+  /// of the columns.
+  class StatsRecordWriter {
+    llvm::raw_ostream &os;
+    bool first;
+
+    void separate() {
+      os << (first ? "(" : ",");
+      first = false;
+    }
+
+  public:
+    explicit StatsRecordWriter(llvm::raw_ostream &_os)
+      : os(_os), first(true) {}
+
+    void column(const char *name, bool isTime) {
+      if (StatsFormat == BinaryStats) {
+        if (first) {
+          os << "KSTB";
+          writeBinary32(os, 1);
+        }
+        os << (isTime ? 'F' : 'I');
+        writeBinaryString(os, name);
+      } else {
+        if (first)
+          os << "(";
+        os << "'" << name << "',";
+      }
+      first = false;
+    }
+
+    void count(uint64_t v) {
+      if (StatsFormat == BinaryStats) {
+        writeBinary64(os, v);
+      } else {
+        separate();
+        os << v;
+      }
+    }
+
+    void time(double v) {
+      if (StatsFormat == BinaryStats) {
+        writeBinaryDouble(os, v);
+      } else {
+        separate();
+        os << v;
+      }
+    }
+
+    void finishHeader() {
+      if (StatsFormat == BinaryStats)
+        os << '\0';
+      else
+        os << ")\n";
+    }
+
+    void finishLine() {
+      if (StatsFormat != BinaryStats)
+        os << ")\n";
+    }
+  };
+}
+
 void StatsTracker::writeStatsHeader() {
-  *statsFile << "('Instructions',"
-             << "'FullBranches',"
-             << "'PartialBranches',"
-             << "'NumBranches',"
-             << "'UserTime',"
-             << "'NumStates',"
-             << "'MallocUsage',"
-             << "'NumQueries',"
-             << "'NumQueryConstructs',"
-             << "'NumObjects',"
-             << "'WallTime',"
-             << "'CoveredInstructions',"
-             << "'UncoveredInstructions',"
-             << "'QueryTime',"
-             << "'SolverTime',"
-             << "'CexCacheTime',"
-             << "'ForkTime',"
-             << "'ResolveTime',"
+  StatsRecordWriter header(*statsFile);
+  header.column("Instructions", false);
+  header.column("FullBranches", false);
+  header.column("PartialBranches", false);
+  header.column("NumBranches", false);
+  header.column("UserTime", true);
+  header.column("NumStates", false);
+  header.column("MallocUsage", false);
+  header.column("NumQueries", false);
+  header.column("NumQueryConstructs", false);
+  header.column("NumObjects", false);
+  header.column("WallTime", true);
+  header.column("CoveredInstructions", false);
+  header.column("UncoveredInstructions", false);
+  header.column("QueryTime", true);
+  header.column("SolverTime", true);
+  header.column("CexCacheTime", true);
+  header.column("ForkTime", true);
+  header.column("ResolveTime", true);
+  header.column("TimeoutPredictions", false);
+  header.column("TimeoutMispredictions", false);
+  header.column("ShortenedTimeouts", false);
+  header.column("TimeoutRetries", false);
+  header.column("SearcherTime", true);
+  header.column("ExprMemory", false);
+  header.column("ObjectStateMemory", false);
+  header.column("SolverCacheMemory", false);
+  header.column("FloatTriageQueries", false);
+  header.column("FloatTriageDecided", false);
 #ifdef DEBUG
-	     << "'ArrayHashTime',"
+  header.column("ArrayHashTime", true);
 #endif
-             << ")\n";
+  // The profiled solver layers, if any, as <Layer><Kind><Column>.
+  const std::vector<SolverLayerProfile *> &profiles = getSolverLayerProfiles();
+  for (std::vector<SolverLayerProfile *>::const_iterator
+         it = profiles.begin(), ie = profiles.end(); it != ie; ++it) {
+    for (unsigned k = 0; k != SolverLayerProfile::NumQueryKinds; ++k) {
+      std::string prefix = (*it)->layer + SolverLayerProfile::getQueryKindName(
+                               (SolverLayerProfile::QueryKind) k);
+      header.column((prefix + "Calls").c_str(), false);
+      header.column((prefix + "Passed").c_str(), false);
+      header.column((prefix + "SelfTime").c_str(), true);
+      for (unsigned a = 0; a != SolverLayerProfile::NumAnswers; ++a)
+        header.column((prefix + SolverLayerProfile::getAnswerName(
+                           (SolverLayerProfile::Answer) a)).c_str(), false);
+    }
+  }
+  header.finishHeader();
   statsFile->flush();
 }
 
@@ -433,28 +1061,52 @@ double StatsTracker::elapsed() {
 }
 
 void StatsTracker::writeStatsLine() {
-  *statsFile << "(" << stats::instructions
-             << "," << fullBranches
-             << "," << partialBranches
-             << "," << numBranches
-             << "," << util::getUserTime()
-             << "," << executor.states.size()
-             << "," << util::GetTotalMallocUsage() + executor.memory->getUsedDeterministicSize()
-             << "," << stats::queries
-             << "," << stats::queryConstructs
-             << "," << 0 // was numObjects
-             << "," << elapsed()
-             << "," << stats::coveredInstructions
-             << "," << stats::uncoveredInstructions
-             << "," << stats::queryTime / 1000000.
-             << "," << stats::solverTime / 1000000.
-             << "," << stats::cexCacheTime / 1000000.
-             << "," << stats::forkTime / 1000000.
-             << "," << stats::resolveTime / 1000000.
+  StatsRecordWriter line(*statsFile);
+  line.count(stats::instructions);
+  line.count(fullBranches);
+  line.count(partialBranches);
+  line.count(numBranches);
+  line.time(util::getUserTime());
+  line.count(executor.states.size());
+  line.count(util::GetTotalMallocUsage() +
+             executor.memory->getUsedDeterministicSize());
+  line.count(stats::queries);
+  line.count(stats::queryConstructs);
+  line.count(0); // was numObjects
+  line.time(elapsed());
+  line.count(stats::coveredInstructions);
+  line.count(stats::uncoveredInstructions);
+  line.time(stats::queryTime / 1000000.);
+  line.time(stats::solverTime / 1000000.);
+  line.time(stats::cexCacheTime / 1000000.);
+  line.time(stats::forkTime / 1000000.);
+  line.time(stats::resolveTime / 1000000.);
+  line.count(stats::timeoutPredictions);
+  line.count(stats::timeoutMispredictions);
+  line.count(stats::shortenedTimeouts);
+  line.count(stats::timeoutRetries);
+  line.time(stats::searcherTime / 1000000.);
+  line.count(util::GetCountedMemoryUsage(util::ExprMemory));
+  line.count(util::GetCountedMemoryUsage(util::ObjectStateMemory));
+  line.count(util::GetCountedMemoryUsage(util::SolverCacheMemory));
+  line.count(stats::floatTriageQueries);
+  line.count(stats::floatTriageDecided);
 #ifdef DEBUG
-             << "," << stats::arrayHashTime / 1000000.
+  line.time(stats::arrayHashTime / 1000000.);
 #endif
-             << ")\n";
+  const std::vector<SolverLayerProfile *> &profiles = getSolverLayerProfiles();
+  for (std::vector<SolverLayerProfile *>::const_iterator
+         it = profiles.begin(), ie = profiles.end(); it != ie; ++it) {
+    for (unsigned k = 0; k != SolverLayerProfile::NumQueryKinds; ++k) {
+      const SolverLayerProfile::Counts &counts = (*it)->counts[k];
+      line.count(counts.calls);
+      line.count(counts.passed);
+      line.time(counts.selfTime);
+      for (unsigned a = 0; a != SolverLayerProfile::NumAnswers; ++a)
+        line.count(counts.answers[a]);
+    }
+  }
+  line.finishLine();
   statsFile->flush();
 }
 
@@ -469,9 +1121,35 @@ void StatsTracker::updateStateStatistics(uint64_t addend) {
   }
 }
 
+/// The statistics written to run.istats.
+static uint64_t getIStatsMask(StatisticManager &sm) {
+  uint64_t istatsMask = 0;
+
+  // Max is 13, sadly
+  istatsMask |= 1<<sm.getStatisticID("Queries");
+  istatsMask |= 1<<sm.getStatisticID("QueriesValid");
+  istatsMask |= 1<<sm.getStatisticID("QueriesInvalid");
+  istatsMask |= 1<<sm.getStatisticID("QueryTime");
+  istatsMask |= 1<<sm.getStatisticID("ResolveTime");
+  istatsMask |= 1<<sm.getStatisticID("Instructions");
+  istatsMask |= 1<<sm.getStatisticID("InstructionTimes");
+  istatsMask |= 1<<sm.getStatisticID("InstructionRealTimes");
+  istatsMask |= 1<<sm.getStatisticID("Forks");
+  istatsMask |= 1<<sm.getStatisticID("CoveredInstructions");
+  istatsMask |= 1<<sm.getStatisticID("UncoveredInstructions");
+  istatsMask |= 1<<sm.getStatisticID("States");
+  istatsMask |= 1<<sm.getStatisticID("MinDistToUncovered");
+
+  return istatsMask;
+}
+
 void StatsTracker::writeIStats() {
+  if (StatsFormat == BinaryStats) {
+    writeBinaryIStats();
+    return;
+  }
+
   Module *m = executor.kmodule->module;
-  uint64_t istatsMask = 0;
   llvm::raw_fd_ostream &of = *istatsFile;
   
   // We assume that we didn't move the file pointer
@@ -487,21 +1165,7 @@ void StatsTracker::writeIStats() {
   
   StatisticManager &sm = *theStatisticManager;
   unsigned nStats = sm.getNumStatistics();
-
-  // Max is 13, sadly
-  istatsMask |= 1<<sm.getStatisticID("Queries");
-  istatsMask |= 1<<sm.getStatisticID("QueriesValid");
-  istatsMask |= 1<<sm.getStatisticID("QueriesInvalid");
-  istatsMask |= 1<<sm.getStatisticID("QueryTime");
-  istatsMask |= 1<<sm.getStatisticID("ResolveTime");
-  istatsMask |= 1<<sm.getStatisticID("Instructions");
-  istatsMask |= 1<<sm.getStatisticID("InstructionTimes");
-  istatsMask |= 1<<sm.getStatisticID("InstructionRealTimes");
-  istatsMask |= 1<<sm.getStatisticID("Forks");
-  istatsMask |= 1<<sm.getStatisticID("CoveredInstructions");
-  istatsMask |= 1<<sm.getStatisticID("UncoveredInstructions");
-  istatsMask |= 1<<sm.getStatisticID("States");
-  istatsMask |= 1<<sm.getStatisticID("MinDistToUncovered");
+  uint64_t istatsMask = getIStatsMask(sm);
 
   of << "positions: instr line\n";
 
@@ -622,6 +1286,207 @@ void StatsTracker::writeIStats() {
   of.flush();
 }
 
+/// getFileId - The index of \a file in the file table of a binary
+/// run.istats, adding it to \a files if it is not there yet.
+static uint32_t getFileId(const std::string &file,
+                          std::map<std::string, uint32_t> &fileIds,
+                          std::vector<std::string> &files) {
+  std::map<std::string, uint32_t>::iterator it = fileIds.find(file);
+  if (it != fileIds.end())
+    return it->second;
+  fileIds.insert(std::make_pair(file, files.size()));
+  files.push_back(file);
+  return files.size() - 1;
+}
+
+/// A binary run.istats starts with the magic "KISB", a u32 format version,
+/// the u32 pid, the command and object file name, and the tables snapshots
+/// refer to by index:
+///
+///   u32 n, n * (short name, name)                   the events
+///   u32 n, n * name                                 the source files
+///   u32 n, n * (name, u32 file, u32 asm line, u32 line)   the functions
+///   u32 n, n * (u32 function, u32 file, u32 asm line, u32 line)
+///                                                   the instructions, by id
+///
+/// It is followed by snapshots, each of which only holds the values which
+/// changed since the previous one (all values start at 0):
+///
+///   'S' double elapsed, u32 n, n * (u32 instruction, u32 event, u64 value),
+///       u32 m, m * (u32 call site instruction, u32 callee, u64 calls,
+///                   one u64 value per event)
+///
+/// klee-stats --to-callgrind converts the last snapshot to the text format.
+void StatsTracker::writeBinaryIStatsHeader() {
+  Module *m = executor.kmodule->module;
+  const InstructionInfoTable &infos = *executor.kmodule->infos;
+  llvm::raw_fd_ostream &of = *istatsFile;
+  StatisticManager &sm = *theStatisticManager;
+  unsigned nStats = sm.getNumStatistics();
+  uint64_t istatsMask = getIStatsMask(sm);
+
+  of << "KISB";
+  writeBinary32(of, 1);
+  writeBinary32(of, getpid());
+  writeBinaryString(of, m->getModuleIdentifier());
+  writeBinaryString(of, objectFilename);
+
+  unsigned nEvents = 0;
+  for (unsigned i=0; i<nStats; i++)
+    if (istatsMask & (1<<i))
+      ++nEvents;
+  writeBinary32(of, nEvents);
+  for (unsigned i=0; i<nStats; i++) {
+    if (istatsMask & (1<<i)) {
+      Statistic &s = sm.getStatistic(i);
+      writeBinaryString(of, s.getShortName());
+      writeBinaryString(of, s.getName());
+    }
+  }
+
+  std::map<std::string, uint32_t> fileIds;
+  std::vector<std::string> files;
+  std::vector<uint32_t> functionFiles;
+  istatsFunctionIds.clear();
+  for (Module::iterator fnIt = m->begin(), fn_ie = m->end();
+       fnIt != fn_ie; ++fnIt) {
+    Function *fn = static_cast<Function *>(fnIt);
+    istatsFunctionIds.insert(std::make_pair(fn, functionFiles.size()));
+    functionFiles.push_back(getFileId(infos.getFunctionInfo(fn).file,
+                                      fileIds, files));
+  }
+
+  std::vector<uint32_t> instructionFiles;
+  for (Module::iterator fnIt = m->begin(), fn_ie = m->end();
+       fnIt != fn_ie; ++fnIt)
+    for (Function::iterator bbIt = fnIt->begin(), bb_ie = fnIt->end();
+         bbIt != bb_ie; ++bbIt)
+      for (BasicBlock::iterator it = bbIt->begin(), ie = bbIt->end();
+           it != ie; ++it)
+        instructionFiles.push_back(getFileId(infos.getInfo(&*it).file,
+                                             fileIds, files));
+
+  writeBinary32(of, files.size());
+  for (std::vector<std::string>::iterator it = files.begin(),
+         ie = files.end(); it != ie; ++it)
+    writeBinaryString(of, *it);
+
+  writeBinary32(of, functionFiles.size());
+  for (Module::iterator fnIt = m->begin(), fn_ie = m->end();
+       fnIt != fn_ie; ++fnIt) {
+    Function *fn = static_cast<Function *>(fnIt);
+    const InstructionInfo &ii = infos.getFunctionInfo(fn);
+    writeBinaryString(of, fn->getName().str());
+    writeBinary32(of, functionFiles[istatsFunctionIds[fn]]);
+    writeBinary32(of, ii.assemblyLine);
+    writeBinary32(of, ii.line);
+  }
+
+  // Instruction ids are assigned in the order of the module.
+  writeBinary32(of, instructionFiles.size());
+  for (Module::iterator fnIt = m->begin(), fn_ie = m->end();
+       fnIt != fn_ie; ++fnIt) {
+    uint32_t function = istatsFunctionIds[static_cast<Function *>(fnIt)];
+    for (Function::iterator bbIt = fnIt->begin(), bb_ie = fnIt->end();
+         bbIt != bb_ie; ++bbIt) {
+      for (BasicBlock::iterator it = bbIt->begin(), ie = bbIt->end();
+           it != ie; ++it) {
+        const InstructionInfo &ii = infos.getInfo(&*it);
+        writeBinary32(of, function);
+        writeBinary32(of, instructionFiles[ii.id]);
+        writeBinary32(of, ii.assemblyLine);
+        writeBinary32(of, ii.line);
+      }
+    }
+  }
+  of.flush();
+
+  lastIStats.assign(instructionFiles.size() * nEvents, 0);
+  lastCallSiteIStats.clear();
+}
+
+void StatsTracker::writeBinaryIStats() {
+  llvm::raw_fd_ostream &of = *istatsFile;
+  StatisticManager &sm = *theStatisticManager;
+  unsigned nStats = sm.getNumStatistics();
+  uint64_t istatsMask = getIStatsMask(sm);
+
+  std::vector<Statistic*> events;
+  for (unsigned i=0; i<nStats; i++)
+    if (istatsMask & (1<<i))
+      events.push_back(&sm.getStatistic(i));
+  unsigned nEvents = events.size();
+
+  if (istatsMask & (1<<stats::states.getID()))
+    updateStateStatistics(1);
+
+  // The changes are gathered first, as their number precedes them.
+  std::string changes;
+  llvm::raw_string_ostream os(changes);
+  uint32_t numChanges = 0;
+  for (unsigned id = 0, e = lastIStats.size() / nEvents; id != e; ++id) {
+    for (unsigned i = 0; i != nEvents; ++i) {
+      uint64_t value = sm.getIndexedValue(*events[i], id);
+      uint64_t &last = lastIStats[id * nEvents + i];
+      if (value != last) {
+        last = value;
+        writeBinary32(os, id);
+        writeBinary32(os, i);
+        writeBinary64(os, value);
+        ++numChanges;
+      }
+    }
+  }
+
+  std::string callSiteChanges;
+  llvm::raw_string_ostream callSiteOS(callSiteChanges);
+  uint32_t numCallSiteChanges = 0;
+  CallSiteSummaryTable callSiteStats;
+  if (UseCallPaths)
+    callPathManager.getSummaryStatistics(callSiteStats);
+  for (CallSiteSummaryTable::iterator it = callSiteStats.begin(),
+         ie = callSiteStats.end(); it != ie; ++it) {
+    for (std::map<llvm::Function*, CallSiteInfo>::iterator
+           fit = it->second.begin(), fie = it->second.end();
+         fit != fie; ++fit) {
+      CallSiteInfo &csi = fit->second;
+      std::vector<uint64_t> values;
+      values.push_back(csi.count);
+      for (unsigned i = 0; i != nEvents; ++i) {
+        // Hack, ignore things that don't make sense on call paths.
+        if (events[i] == &stats::uncoveredInstructions)
+          values.push_back(0);
+        else
+          values.push_back(csi.statistics.getValue(*events[i]));
+      }
+
+      std::vector<uint64_t> &last =
+        lastCallSiteIStats[std::make_pair(it->first, fit->first)];
+      if (values != last) {
+        last = values;
+        writeBinary32(callSiteOS,
+                      executor.kmodule->infos->getInfo(it->first).id);
+        writeBinary32(callSiteOS, istatsFunctionIds[fit->first]);
+        for (std::vector<uint64_t>::iterator vit = values.begin(),
+               vie = values.end(); vit != vie; ++vit)
+          writeBinary64(callSiteOS, *vit);
+        ++numCallSiteChanges;
+      }
+    }
+  }
+
+  if (istatsMask & (1<<stats::states.getID()))
+    updateStateStatistics((uint64_t)-1);
+
+  of << 'S';
+  writeBinaryDouble(of, elapsed());
+  writeBinary32(of, numChanges);
+  of << os.str();
+  writeBinary32(of, numCallSiteChanges);
+  of << callSiteOS.str();
+  of.flush();
+}
+
 ///
 
 typedef std::map<Instruction*, std::vector<Function*> > calltargets_ty;
@@ -630,6 +1495,18 @@ static calltargets_ty callTargets;
 static std::map<Function*, std::vector<Instruction*> > functionCallers;
 static std::map<Function*, unsigned> functionShortestPath;
 
+/// The edges of the graph minDistToUncovered is computed in, from and to
+/// instruction ids, with their costs, and the coverage of each instruction
+/// at the last update.
+typedef std::pair<unsigned, unsigned> dist_edge_ty;
+static std::vector<std::vector<dist_edge_ty> > distEdges, reverseDistEdges;
+static std::vector<bool> lastUncovered;
+
+static void addDistEdge(unsigned from, unsigned to, unsigned cost) {
+  distEdges[from].push_back(dist_edge_ty(to, cost));
+  reverseDistEdges[to].push_back(dist_edge_ty(from, cost));
+}
+
 static std::vector<Instruction*> getSuccs(Instruction *i) {
   BasicBlock *bb = i->getParent();
   std::vector<Instruction*> res;
@@ -666,7 +1543,7 @@ uint64_t klee::computeMinDistToUncovered(const KInstruction *ki,
   }
 }
 
-void StatsTracker::computeReachableUncovered() {
+void StatsTracker::computeDistanceGraph() {
   KModule *km = executor.kmodule;
   Module *m = km->module;
   static bool init = true;
@@ -806,40 +1683,20 @@ void StatsTracker::computeReachableUncovered() {
         }
       }
     } while (changed);
-  }
 
-  // compute minDistToUncovered, 0 is unreachable
-  std::vector<Instruction *> instructions;
-  for (Module::iterator fnIt = m->begin(), fn_ie = m->end(); 
-       fnIt != fn_ie; ++fnIt) {
-    // Not sure if I should bother to preorder here.
-    for (Function::iterator bbIt = fnIt->begin(), bb_ie = fnIt->end(); 
-         bbIt != bb_ie; ++bbIt) {
-      for (BasicBlock::iterator it = bbIt->begin(), ie = bbIt->end(); 
-           it != ie; ++it) {
-        Instruction *inst = static_cast<Instruction *>(it);
-        unsigned id = infos.getInfo(inst).id;
-        instructions.push_back(inst);
-        sm.setIndexedValue(stats::minDistToUncovered, 
-                           id, 
-                           sm.getIndexedValue(stats::uncoveredInstructions, id));
-      }
-    }
-  }
-  
-  std::reverse(instructions.begin(), instructions.end());
-  
-  // I'm so lazy it's not even worklisted.
-  bool changed;
-  do {
-    changed = false;
+    // Build the graph minDistToUncovered is the shortest distance in: an
+    // instruction reaches its successors at the cost of executing it
+    // (through the shortest path of the callees for a call) and the entry of
+    // each defined callee in one step.
+    unsigned numIds = infos.getMaxID();
+    distEdges.resize(numIds);
+    reverseDistEdges.resize(numIds);
     for (std::vector<Instruction*>::iterator it = instructions.begin(),
            ie = instructions.end(); it != ie; ++it) {
       Instruction *inst = *it;
-      uint64_t best, cur = best = sm.getIndexedValue(stats::minDistToUncovered, 
-                                                     infos.getInfo(inst).id);
+      unsigned id = infos.getInfo(inst).id;
       unsigned bestThrough = 0;
-      
+
       if (isa<CallInst>(inst) || isa<InvokeInst>(inst)) {
         std::vector<Function*> &targets = callTargets[inst];
         for (std::vector<Function*>::iterator fnIt = targets.begin(),
@@ -851,42 +1708,159 @@ void StatsTracker::computeReachableUncovered() {
               bestThrough = dist;
           }
 
-          if (!(*fnIt)->isDeclaration()) {
-            uint64_t calleeDist = sm.getIndexedValue(stats::minDistToUncovered,
-                                                     infos.getFunctionInfo(*fnIt).id);
-            if (calleeDist) {
-              calleeDist = 1+calleeDist; // count instruction itself
-              if (best==0 || calleeDist<best)
-                best = calleeDist;
-            }
-          }
+          if (!(*fnIt)->isDeclaration())
+            addDistEdge(id, infos.getFunctionInfo(*fnIt).id, 1);
         }
       } else {
         bestThrough = 1;
       }
-      
+
       if (bestThrough) {
         std::vector<Instruction*> succs = getSuccs(inst);
         for (std::vector<Instruction*>::iterator it2 = succs.begin(),
-               ie = succs.end(); it2 != ie; ++it2) {
-          uint64_t dist = sm.getIndexedValue(stats::minDistToUncovered,
-                                             infos.getInfo(*it2).id);
-          if (dist) {
-            uint64_t val = bestThrough + dist;
-            if (best==0 || val<best)
-              best = val;
-          }
-        }
+               ie = succs.end(); it2 != ie; ++it2)
+          addDistEdge(id, infos.getInfo(*it2).id, bestThrough);
       }
+    }
+  }
+}
 
-      if (best != cur) {
-        sm.setIndexedValue(stats::minDistToUncovered, 
-                           infos.getInfo(inst).id, 
-                           best);
-        changed = true;
+void StatsTracker::computeMinDistToTargets(
+    const std::vector<unsigned> &targets, std::vector<uint64_t> &dist) {
+  computeDistanceGraph();
+
+  // Shortest distances backwards from the targets, 0 is unreachable.
+  typedef std::pair<uint64_t, unsigned> dist_entry_ty;
+  std::priority_queue<dist_entry_ty, std::vector<dist_entry_ty>,
+                      std::greater<dist_entry_ty> > queue;
+  dist.assign(distEdges.size(), 0);
+  for (std::vector<unsigned>::const_iterator it = targets.begin(),
+         ie = targets.end(); it != ie; ++it) {
+    dist[*it] = 1;
+    queue.push(dist_entry_ty(1, *it));
+  }
+
+  while (!queue.empty()) {
+    uint64_t d = queue.top().first;
+    unsigned id = queue.top().second;
+    queue.pop();
+    if (d != dist[id])
+      continue;
+
+    std::vector<dist_edge_ty> &preds = reverseDistEdges[id];
+    for (std::vector<dist_edge_ty>::iterator it = preds.begin(),
+           ie = preds.end(); it != ie; ++it) {
+      uint64_t val = d + it->second;
+      if (dist[it->first]==0 || val<dist[it->first]) {
+        dist[it->first] = val;
+        queue.push(dist_entry_ty(val, it->first));
       }
     }
-  } while (changed);
+  }
+}
+
+void StatsTracker::computeReachableUncovered() {
+  StatisticManager &sm = *theStatisticManager;
+  static bool init = true;
+
+  if (init) {
+    init = false;
+    computeDistanceGraph();
+
+    // Nothing is reachable until the first update below finds the
+    // uncovered instructions.
+    unsigned numIds = distEdges.size();
+    lastUncovered.resize(numIds);
+    for (unsigned id = 0; id != numIds; ++id)
+      sm.setIndexedValue(stats::minDistToUncovered, id, 0);
+  }
+
+  // Update minDistToUncovered, 0 is unreachable, from the instructions
+  // whose coverage changed since the last update. Covering an instruction
+  // can only lengthen the distances of the instructions whose shortest path
+  // led to it: these are reset to their best distance through the others,
+  // and shortened again from there, along with the instructions which
+  // became uncovered, in order of distance. This only visits the part of
+  // the module whose distances change, instead of iterating over all of it
+  // to a fixpoint.
+  typedef std::pair<uint64_t, unsigned> dist_entry_ty;
+  std::priority_queue<dist_entry_ty, std::vector<dist_entry_ty>,
+                      std::greater<dist_entry_ty> > queue;
+  std::vector<unsigned> affected;
+  std::vector<bool> isAffected(lastUncovered.size());
+
+  for (unsigned id = 0, e = lastUncovered.size(); id != e; ++id) {
+    bool uncovered = sm.getIndexedValue(stats::uncoveredInstructions, id) &&
+                     (sharedCovered.empty() || !sharedCovered[id]);
+    if (uncovered == lastUncovered[id])
+      continue;
+    lastUncovered[id] = uncovered;
+    if (uncovered) {
+      sm.setIndexedValue(stats::minDistToUncovered, id, 1);
+      queue.push(dist_entry_ty(1, id));
+    } else {
+      isAffected[id] = true;
+      affected.push_back(id);
+    }
+  }
+
+  for (unsigned i = 0; i != affected.size(); ++i) {
+    unsigned id = affected[i];
+    uint64_t dist = sm.getIndexedValue(stats::minDistToUncovered, id);
+    if (!dist)
+      continue;
+    std::vector<dist_edge_ty> &preds = reverseDistEdges[id];
+    for (std::vector<dist_edge_ty>::iterator it = preds.begin(),
+           ie = preds.end(); it != ie; ++it) {
+      unsigned pred = it->first;
+      if (!isAffected[pred] && !lastUncovered[pred] &&
+          sm.getIndexedValue(stats::minDistToUncovered, pred) ==
+            dist + it->second) {
+        isAffected[pred] = true;
+        affected.push_back(pred);
+      }
+    }
+  }
+
+  for (std::vector<unsigned>::iterator it = affected.begin(),
+         ie = affected.end(); it != ie; ++it) {
+    uint64_t best = 0;
+    std::vector<dist_edge_ty> &succs = distEdges[*it];
+    for (std::vector<dist_edge_ty>::iterator it2 = succs.begin(),
+           ie = succs.end(); it2 != ie; ++it2) {
+      if (isAffected[it2->first])
+        continue;
+      uint64_t dist = sm.getIndexedValue(stats::minDistToUncovered,
+                                         it2->first);
+      if (dist) {
+        uint64_t val = it2->second + dist;
+        if (best==0 || val<best)
+          best = val;
+      }
+    }
+    sm.setIndexedValue(stats::minDistToUncovered, *it, best);
+    if (best)
+      queue.push(dist_entry_ty(best, *it));
+  }
+
+  while (!queue.empty()) {
+    uint64_t dist = queue.top().first;
+    unsigned id = queue.top().second;
+    queue.pop();
+    if (dist != sm.getIndexedValue(stats::minDistToUncovered, id))
+      continue;
+
+    std::vector<dist_edge_ty> &preds = reverseDistEdges[id];
+    for (std::vector<dist_edge_ty>::iterator it = preds.begin(),
+           ie = preds.end(); it != ie; ++it) {
+      uint64_t val = dist + it->second;
+      uint64_t cur = sm.getIndexedValue(stats::minDistToUncovered, it->first);
+      if (cur==0 || val<cur) {
+        sm.setIndexedValue(stats::minDistToUncovered, it->first, val);
+        queue.push(dist_entry_ty(val, it->first));
+      }
+    }
+  }
 
   for (std::set<ExecutionState*>::iterator it = executor.states.begin(),
          ie = executor.states.end(); it != ie; ++it) {
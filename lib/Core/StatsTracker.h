@@ -12,26 +12,33 @@
 
 #include "CallPathManager.h"
 
+#include <map>
 #include <set>
+#include <vector>
 
 namespace llvm {
   class BranchInst;
   class Function;
   class Instruction;
   class raw_fd_ostream;
+  class raw_ostream;
 }
 
 namespace klee {
   class ExecutionState;
   class Executor;  
   class InstructionInfoTable;
+  class MetricsServer;
   class InterpreterHandler;
+  struct KFunction;
   struct KInstruction;
   struct StackFrame;
 
   class StatsTracker {
     friend class WriteStatsTimer;
     friend class WriteIStatsTimer;
+    friend class ServeMetricsTimer;
+    friend class MergeCoverageTimer;
 
     Executor &executor;
     std::string objectFilename;
@@ -46,6 +53,32 @@ namespace klee {
 
     bool updateMinDistToUncovered;
 
+    /// The values written to a binary run.istats so far, by instruction id
+    /// and event, and by call site and callee, which snapshots only write
+    /// the changes of.
+    std::vector<uint64_t> lastIStats;
+    std::map<std::pair<llvm::Instruction*, llvm::Function*>,
+             std::vector<uint64_t> > lastCallSiteIStats;
+    /// The index of each function of the module in a binary run.istats.
+    std::map<llvm::Function*, uint32_t> istatsFunctionIds;
+
+    /// The -metrics-address endpoint, and the instruction count and time
+    /// at the last request, to report the rate since.
+    MetricsServer *metricsServer;
+    uint64_t lastMetricsInstructions;
+    double lastMetricsTime;
+
+    /// The -shared-coverage-file, or -1, and the instructions it has as
+    /// covered by any instance as of the last merge.
+    int sharedCoverageFd;
+    std::vector<bool> sharedCovered;
+
+    /// The functions the cost since the last step is charged to, and the
+    /// time, solver time and forks at that step.
+    std::vector<KFunction*> chargedFunctions;
+    double lastChargeTime;
+    uint64_t lastChargeSolverTime, lastChargeForks;
+
   public:
     static bool useStatistics();
 
@@ -54,6 +87,18 @@ namespace klee {
     void writeStatsHeader();
     void writeStatsLine();
     void writeIStats();
+    void writeBinaryIStatsHeader();
+    void writeBinaryIStats();
+    void serveMetrics();
+    void writeMetrics(llvm::raw_ostream &os);
+    void openSharedCoverage(const std::string &path);
+    void mergeSharedCoverage();
+    void writeFunctionCosts();
+
+    /// chargeFunctions - Charge the cost since the last step to the
+    /// functions it was taken in, and start the step \a es is about to
+    /// take, if any.
+    void chargeFunctions(ExecutionState *es);
 
   public:
     StatsTracker(Executor &_executor, std::string _objectFilename,
@@ -75,6 +120,10 @@ namespace klee {
     // called when execution is done and stats files should be flushed
     void done();
 
+    // called in a newly forked parallel worker, which must not share the
+    // stats files with the process it was forked from
+    void startWorker(unsigned index);
+
     // process stats for a single instruction step, es is the state
     // about to be stepped
     void stepInstruction(ExecutionState &es);
@@ -83,6 +132,18 @@ namespace klee {
     double elapsed();
 
     void computeReachableUncovered();
+
+    /// computeMinDistToTargets - Compute in \a dist the shortest distance
+    /// from each instruction id to one of the \a targets within its
+    /// function and the functions it calls, as minDistToUncovered is, 0
+    /// being unreachable.
+    void computeMinDistToTargets(const std::vector<unsigned> &targets,
+                                 std::vector<uint64_t> &dist);
+
+  private:
+    /// computeDistanceGraph - Build the graph of the instructions distances
+    /// are computed in, and minDistToReturn, once.
+    void computeDistanceGraph();
   };
 
   uint64_t computeMinDistToUncovered(const KInstruction *ki,
@@ -12,6 +12,7 @@
 #include "klee/Config/Version.h"
 #include "klee/ExecutionState.h"
 #include "klee/Solver.h"
+#include "klee/SolverImpl.h"
 #include "klee/Statistics.h"
 #include "klee/Internal/System/Time.h"
 #include "klee/Internal/Support/Debug.h"
@@ -20,6 +21,7 @@
 #include "CoreStats.h"
 #include "Executor.h"
 #include "ExecutorTimerInfo.h"
+#include "SamplingProfiler.h"
 
 #include "llvm/Support/TimeValue.h"
 #include "llvm/Support/CommandLine.h"
@@ -35,6 +37,14 @@ DynamicSolverTimeout("dynamic-solver-timeout",
         cl::desc("Use dynamic solver timeout"),
         cl::init(false));
 
+cl::opt<bool>
+AdaptiveSolverTimeout("adaptive-solver-timeout",
+                      cl::desc("Give queries which queries like them "
+                               "suggest will not finish a shorter timeout "
+                               "than -max-solver-time; test generation "
+                               "always gets the full one (default=off)"),
+                      cl::init(false));
+
 cl::opt<double> DynamicSolverTimeoutTestCaseGenMaxTime(
     "dynamic-solver-timeout-max-test-gen-time",
     cl::desc("Maximum time (seconds) allowed to spend doing all test case "
@@ -183,10 +193,56 @@ void TimingSolver::setTimeout(double t) {
   if (DynamicSolverTimeout) {
     klee_warning_once(0, "Ignoring set solver timeout request. Using dynamic timeout instead.");
   } else {
+    timeout = t;
     solver->setCoreSolverTimeout(t);
   }
 }
 
+/// beginAdaptiveQuery - Give the query of \a exprs the timeout the cost
+/// predictor suggests.
+void TimingSolver::beginAdaptiveQuery(const ExecutionState &state,
+                                      const std::vector< ref<Expr> > &exprs) {
+  queryTimeout = 0;
+  if (!AdaptiveSolverTimeout || DynamicSolverTimeout || timeout <= 0)
+    return;
+  if (!costPredictor)
+    costPredictor = new QueryCostPredictor();
+
+  queryFeatures = costPredictor->getFeatures(state.constraints, exprs);
+  queryTimeout = costPredictor->getTimeout(queryFeatures, timeout);
+  if (queryTimeout < timeout) {
+    ++stats::shortenedTimeouts;
+    solver->setCoreSolverTimeout(queryTimeout);
+  }
+  queryStart = util::getWallTime();
+}
+
+/// retryAdaptiveQuery - Learn from the outcome of the query, and tell
+/// whether it should be issued again, with the full timeout.
+bool TimingSolver::retryAdaptiveQuery(bool success) {
+  if (queryTimeout <= 0)
+    return false;
+
+  double elapsed = util::getWallTime() - queryStart;
+  bool timedOut = !success && solver->impl->getOperationStatusCode() ==
+                                  SolverImpl::SOLVER_RUN_STATUS_TIMEOUT;
+  // Only timeouts tell something about the cost of the query.
+  if (success || timedOut)
+    costPredictor->recordQuery(queryFeatures, queryTimeout, timeout, elapsed,
+                               timedOut);
+
+  bool shortened = queryTimeout < timeout;
+  if (shortened)
+    solver->setCoreSolverTimeout(timeout);
+  if (!shortened || !timedOut || !costPredictor->shouldRetry(queryFeatures)) {
+    queryTimeout = 0;
+    return false;
+  }
+  queryTimeout = timeout;
+  queryStart = util::getWallTime();
+  return true;
+}
+
 bool TimingSolver::evaluate(const ExecutionState& state, ref<Expr> expr,
                             Solver::Validity &result) {
   // Fast path, to avoid timer and OS overhead.
@@ -195,6 +251,7 @@ bool TimingSolver::evaluate(const ExecutionState& state, ref<Expr> expr,
     return true;
   }
 
+  SamplingProfiler::Scope profile(SamplingProfiler::Solver);
   sys::TimeValue now = util::getWallTimeVal();
 
   if (simplifyExprs)
@@ -203,13 +260,26 @@ bool TimingSolver::evaluate(const ExecutionState& state, ref<Expr> expr,
   if (!setDynamicTimeout(this)) {
     return false;
   }
-  bool success = solver->evaluate(Query(state.constraints, expr), result);
+  beginAdaptiveQuery(state, std::vector< ref<Expr> >(1, expr));
+  Query query(state.constraints, expr);
+  bool success = solver->evaluate(query, result);
+  while (retryAdaptiveQuery(success))
+    success = solver->evaluate(query, result);
 
   sys::TimeValue delta = util::getWallTimeVal();
   delta -= now;
   stats::solverTime += delta.usec();
   state.queryCost += delta.usec()/1000000.;
 
+  if (tracer)
+    tracer->traceQuery(state, QueryTracer::Evaluate,
+                       std::vector< ref<Expr> >(1, expr),
+                       now.usec(), delta.usec(),
+                       !success ? QueryTracer::Failed :
+                       result == Solver::True ? QueryTracer::True :
+                       result == Solver::False ? QueryTracer::False :
+                       QueryTracer::Unknown);
+
   return success;
 }
 
@@ -221,6 +291,7 @@ bool TimingSolver::mustBeTrue(const ExecutionState& state, ref<Expr> expr,
     return true;
   }
 
+  SamplingProfiler::Scope profile(SamplingProfiler::Solver);
   sys::TimeValue now = util::getWallTimeVal();
 
   if (simplifyExprs)
@@ -229,13 +300,24 @@ bool TimingSolver::mustBeTrue(const ExecutionState& state, ref<Expr> expr,
   if (!setDynamicTimeout(this)) {
     return false;
   }
-  bool success = solver->mustBeTrue(Query(state.constraints, expr), result);
+  beginAdaptiveQuery(state, std::vector< ref<Expr> >(1, expr));
+  Query query(state.constraints, expr);
+  bool success = solver->mustBeTrue(query, result);
+  while (retryAdaptiveQuery(success))
+    success = solver->mustBeTrue(query, result);
 
   sys::TimeValue delta = util::getWallTimeVal();
   delta -= now;
   stats::solverTime += delta.usec();
   state.queryCost += delta.usec()/1000000.;
 
+  if (tracer)
+    tracer->traceQuery(state, QueryTracer::MustBeTrue,
+                       std::vector< ref<Expr> >(1, expr),
+                       now.usec(), delta.usec(),
+                       !success ? QueryTracer::Failed :
+                       result ? QueryTracer::True : QueryTracer::False);
+
   return success;
 }
 
@@ -262,6 +344,40 @@ bool TimingSolver::mayBeFalse(const ExecutionState& state, ref<Expr> expr,
   return true;
 }
 
+bool TimingSolver::mayBeTrueMany(const ExecutionState& state,
+                                 const std::vector< ref<Expr> > &exprs,
+                                 std::vector<bool> &result) {
+  SamplingProfiler::Scope profile(SamplingProfiler::Solver);
+  sys::TimeValue now = util::getWallTimeVal();
+
+  std::vector< ref<Expr> > simplified(exprs);
+  if (simplifyExprs) {
+    for (std::vector< ref<Expr> >::iterator it = simplified.begin(),
+           ie = simplified.end(); it != ie; ++it)
+      *it = state.constraints.simplifyExpr(*it);
+  }
+
+  if (!setDynamicTimeout(this)) {
+    return false;
+  }
+  beginAdaptiveQuery(state, simplified);
+  bool success = solver->mayBeTrueMany(state.constraints, simplified, result);
+  while (retryAdaptiveQuery(success))
+    success = solver->mayBeTrueMany(state.constraints, simplified, result);
+
+  sys::TimeValue delta = util::getWallTimeVal();
+  delta -= now;
+  stats::solverTime += delta.usec();
+  state.queryCost += delta.usec()/1000000.;
+
+  if (tracer)
+    tracer->traceQuery(state, QueryTracer::MayBeTrueMany, simplified,
+                       now.usec(), delta.usec(),
+                       success ? QueryTracer::Done : QueryTracer::Failed);
+
+  return success;
+}
+
 bool TimingSolver::getValue(const ExecutionState& state, ref<Expr> expr, 
                             ref<Expr> &result) {
   // Fast path, to avoid timer and OS overhead.
@@ -270,6 +386,7 @@ bool TimingSolver::getValue(const ExecutionState& state, ref<Expr> expr,
     return true;
   }
   
+  SamplingProfiler::Scope profile(SamplingProfiler::Solver);
   sys::TimeValue now = util::getWallTimeVal();
 
   if (simplifyExprs)
@@ -278,13 +395,62 @@ bool TimingSolver::getValue(const ExecutionState& state, ref<Expr> expr,
   if (!setDynamicTimeout(this)) {
     return false;
   }
-  bool success = solver->getValue(Query(state.constraints, expr), result);
+  beginAdaptiveQuery(state, std::vector< ref<Expr> >(1, expr));
+  Query query(state.constraints, expr);
+  bool success = solver->getValue(query, result);
+  while (retryAdaptiveQuery(success))
+    success = solver->getValue(query, result);
 
   sys::TimeValue delta = util::getWallTimeVal();
   delta -= now;
   stats::solverTime += delta.usec();
   state.queryCost += delta.usec()/1000000.;
 
+  if (tracer)
+    tracer->traceQuery(state, QueryTracer::GetValue,
+                       std::vector< ref<Expr> >(1, expr),
+                       now.usec(), delta.usec(),
+                       success ? QueryTracer::Done : QueryTracer::Failed);
+
+  return success;
+}
+
+bool TimingSolver::getUniqueValue(const ExecutionState& state, ref<Expr> expr,
+                                  ref<Expr> &result, bool &isUnique) {
+  // Fast path, to avoid timer and OS overhead.
+  if (isa<ConstantExpr>(expr) || isa<FConstantExpr>(expr)) {
+    result = expr;
+    isUnique = true;
+    return true;
+  }
+
+  SamplingProfiler::Scope profile(SamplingProfiler::Solver);
+  sys::TimeValue now = util::getWallTimeVal();
+
+  if (simplifyExprs)
+    expr = state.constraints.simplifyExpr(expr);
+
+  if (!setDynamicTimeout(this)) {
+    return false;
+  }
+  beginAdaptiveQuery(state, std::vector< ref<Expr> >(1, expr));
+  Query query(state.constraints, expr);
+  bool success = solver->getUniqueValue(query, result, isUnique);
+  while (retryAdaptiveQuery(success))
+    success = solver->getUniqueValue(query, result, isUnique);
+
+  sys::TimeValue delta = util::getWallTimeVal();
+  delta -= now;
+  stats::solverTime += delta.usec();
+  state.queryCost += delta.usec()/1000000.;
+
+  if (tracer)
+    tracer->traceQuery(state, QueryTracer::GetUniqueValue,
+                       std::vector< ref<Expr> >(1, expr),
+                       now.usec(), delta.usec(),
+                       !success ? QueryTracer::Failed :
+                       isUnique ? QueryTracer::True : QueryTracer::False);
+
   return success;
 }
 
@@ -297,6 +463,7 @@ TimingSolver::getInitialValues(const ExecutionState& state,
   if (objects.empty())
     return true;
 
+  SamplingProfiler::Scope profile(SamplingProfiler::Solver);
   sys::TimeValue now = util::getWallTimeVal();
 
   if (!setDynamicTimeout(this)) {
@@ -310,12 +477,54 @@ TimingSolver::getInitialValues(const ExecutionState& state,
   delta -= now;
   stats::solverTime += delta.usec();
   state.queryCost += delta.usec()/1000000.;
+
+  if (tracer)
+    tracer->traceQuery(state, QueryTracer::GetInitialValues,
+                       std::vector< ref<Expr> >(), now.usec(), delta.usec(),
+                       success ? QueryTracer::Done : QueryTracer::Failed);
   
   return success;
 }
 
+bool TimingSolver::getModel(const ExecutionState& state, ref<Expr> expr,
+                            const std::vector<const Array*> &objects,
+                            std::vector< std::vector<unsigned char> > &result,
+                            bool &hasSolution) {
+  SamplingProfiler::Scope profile(SamplingProfiler::Solver);
+  sys::TimeValue now = util::getWallTimeVal();
+
+  if (simplifyExprs)
+    expr = state.constraints.simplifyExpr(expr);
+
+  if (!setDynamicTimeout(this)) {
+    return false;
+  }
+  beginAdaptiveQuery(state, std::vector< ref<Expr> >(1, expr));
+  // A counterexample to the negation satisfies expr.
+  Query query(state.constraints, Expr::createIsZero(expr));
+  bool success = solver->impl->computeInitialValues(query, objects, result,
+                                                    hasSolution);
+  while (retryAdaptiveQuery(success))
+    success = solver->impl->computeInitialValues(query, objects, result,
+                                                 hasSolution);
+
+  sys::TimeValue delta = util::getWallTimeVal();
+  delta -= now;
+  stats::solverTime += delta.usec();
+  state.queryCost += delta.usec()/1000000.;
+
+  if (tracer)
+    tracer->traceQuery(state, QueryTracer::GetInitialValues,
+                       std::vector< ref<Expr> >(1, expr),
+                       now.usec(), delta.usec(),
+                       success ? QueryTracer::Done : QueryTracer::Failed);
+
+  return success;
+}
+
 std::pair< ref<Expr>, ref<Expr> >
 TimingSolver::getRange(const ExecutionState& state, ref<Expr> expr) {
+  SamplingProfiler::Scope profile(SamplingProfiler::Solver);
   if (!setDynamicTimeout(this)) {
     // FIXME: Implementation doesn't actually define how to handle the solver
     // not succeeding. Just do this for now. If we do this we will likely
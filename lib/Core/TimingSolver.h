@@ -13,6 +13,9 @@
 #include "klee/Expr.h"
 #include "klee/Solver.h"
 
+#include "QueryCostPredictor.h"
+#include "QueryTracer.h"
+
 #include <vector>
 
 namespace klee {
@@ -27,6 +30,23 @@ namespace klee {
     Solver *solver;
     Executor* executor;
     bool simplifyExprs;
+    /// Records every query when set, owned by the solver.
+    QueryTracer *tracer;
+
+  private:
+    /// The timeout the executor asked for.
+    double timeout;
+    /// Adapts the timeout of each query with -adaptive-solver-timeout.
+    QueryCostPredictor *costPredictor;
+    /// The query being adapted: its features, its timeout and when it
+    /// started.
+    QueryCostPredictor::Features queryFeatures;
+    double queryTimeout;
+    double queryStart;
+
+    void beginAdaptiveQuery(const ExecutionState &state,
+                            const std::vector< ref<Expr> > &exprs);
+    bool retryAdaptiveQuery(bool success);
 
   public:
     /// TimingSolver - Construct a new timing solver.
@@ -35,9 +55,13 @@ namespace klee {
     /// simplified (via the constraint manager interface) prior to
     /// querying.
     TimingSolver(Solver *_solver, Executor* _executor, bool _simplifyExprs = true)
-      : solver(_solver), executor(_executor), simplifyExprs(_simplifyExprs) {}
+      : solver(_solver), executor(_executor), simplifyExprs(_simplifyExprs),
+        tracer(0), timeout(0), costPredictor(0), queryTimeout(0),
+        queryStart(0) {}
     ~TimingSolver() {
       delete solver;
+      delete tracer;
+      delete costPredictor;
     }
 
     void setTimeout(double t);
@@ -46,6 +70,16 @@ namespace klee {
       return solver->getConstraintLog(query);
     }
 
+    size_t trimCaches(size_t bytes) { return solver->trimCaches(bytes); }
+    void releaseArrays(const std::vector<const Array *> &arrays) {
+      solver->releaseArrays(arrays);
+    }
+    /// interrupt - Make the running query fail as soon as possible, from
+    /// another thread.
+    void interrupt() {
+      solver->interrupt();
+    }
+
     bool evaluate(const ExecutionState&, ref<Expr>, Solver::Validity &result);
 
     bool mustBeTrue(const ExecutionState&, ref<Expr>, bool &result);
@@ -56,12 +90,32 @@ namespace klee {
 
     bool mayBeFalse(const ExecutionState&, ref<Expr>, bool &result);
 
+    /// mayBeTrueMany - Determine for each of \a exprs whether it may be true
+    /// in the given state, sharing the solver work on the state's
+    /// constraints between the queries.
+    bool mayBeTrueMany(const ExecutionState&,
+                       const std::vector< ref<Expr> > &exprs,
+                       std::vector<bool> &result);
+
     bool getValue(const ExecutionState &, ref<Expr> expr, ref<Expr> &result);
 
+    /// getUniqueValue - Compute a possible value of \a expr in the given
+    /// state, and whether it is the only one (see Solver::getUniqueValue).
+    bool getUniqueValue(const ExecutionState &, ref<Expr> expr,
+                        ref<Expr> &result, bool &isUnique);
+
     bool getInitialValues(const ExecutionState&, 
                           const std::vector<const Array*> &objects,
                           std::vector< std::vector<unsigned char> > &result);
 
+    /// getModel - Compute values of \a objects satisfying the constraints
+    /// of the state and \a expr, setting \a hasSolution to false if there
+    /// are none.
+    bool getModel(const ExecutionState&, ref<Expr> expr,
+                  const std::vector<const Array*> &objects,
+                  std::vector< std::vector<unsigned char> > &result,
+                  bool &hasSolution);
+
     std::pair< ref<Expr>, ref<Expr> >
     getRange(const ExecutionState&, ref<Expr> query);
   };
@@ -31,12 +31,45 @@ namespace {
 			clEnumValN(Searcher::NURS_ICnt, "nurs:icnt", "use NURS with Instr-Count"),
 			clEnumValN(Searcher::NURS_CPICnt, "nurs:cpicnt", "use NURS with CallPath-Instr-Count"),
 			clEnumValN(Searcher::NURS_QC, "nurs:qc", "use NURS with Query-Cost"),
+			clEnumValN(Searcher::NURS_FPCost, "nurs:fpcost", "use NURS with the estimated cost of the next query, from the size and floating point operators of the constraints"),
+			clEnumValN(Searcher::NURS_FPCov, "nurs:fpcov", "use NURS with the IEEE classes (NaN, +/-Inf, +/-0, subnormal, normal) not yet seen at the floating point operations ahead in the current block, see -float-coverage"),
+			clEnumValN(Searcher::Directed, "directed", "select the state closest to one of the --target lines, terminating the states which cannot reach any"),
 			clEnumValEnd));
 
+  cl::list<std::string>
+  Target("target",
+         cl::desc("Source lines to reach with --search=directed, as file:line, the file matching on its last path components"),
+         cl::CommaSeparated);
+
+  cl::opt<bool>
+  UseBanditSearch("use-bandit-search",
+                  cl::desc("When several searchers are given, let one of them select states at a time, for slices of --bandit-slice-instructions instructions, choosing the searcher of each slice with UCB1 by the instructions it newly covered per second in its past slices, instead of interleaving them. Slices are logged to bandit.txt (default=off)"),
+                  cl::init(false));
+
+  cl::opt<unsigned>
+  BanditSliceInstructions("bandit-slice-instructions",
+                          cl::desc("Number of instructions per slice with --use-bandit-search (default=10000)"),
+                          cl::init(10000));
+
   cl::opt<bool>
   UseIterativeDeepeningTimeSearch("use-iterative-deepening-time-search", 
                                     cl::desc("(experimental)"));
 
+  cl::opt<bool>
+  UseIterativeDeepeningBudgetSearch("use-iterative-deepening-budget-search",
+                                    cl::desc("Pause states which exceed an instruction or solver time budget since they last resumed, doubling both budgets once no other state is left (see --iterative-deepening-instructions and --iterative-deepening-solver-time, default=off)"),
+                                    cl::init(false));
+
+  cl::opt<unsigned>
+  IterativeDeepeningInstructions("iterative-deepening-instructions",
+                                 cl::desc("Initial instruction budget with --use-iterative-deepening-budget-search (default=100000)"),
+                                 cl::init(100000));
+
+  cl::opt<double>
+  IterativeDeepeningSolverTime("iterative-deepening-solver-time",
+                               cl::desc("Initial solver time budget in seconds with --use-iterative-deepening-budget-search (default=1.0)"),
+                               cl::init(1.0));
+
   cl::opt<bool>
   UseBatchingSearch("use-batching-search", 
 		    cl::desc("Use batching searcher (keep running selected state for N instructions/time, see --batch-instructions and --batch-time)"),
@@ -61,8 +94,39 @@ namespace {
   UseBumpMerge("use-bump-merge", 
            cl::desc("Enable support for klee_merge() (extra experimental)"));
 
+  cl::opt<bool>
+  UseAutoMerge("use-auto-merge",
+               cl::desc("Merge states that meet at a join point of the "
+                        "control flow graph, unless merging makes values "
+                        "symbolic that many queries depend on (default=off)"),
+               cl::init(false));
+
+  cl::opt<unsigned>
+  AutoMergeWait("auto-merge-wait",
+                cl::desc("Number of instructions a state waits at a join "
+                         "point for others to merge with (default=1000)"),
+                cl::init(1000));
+
+  cl::opt<unsigned>
+  AutoMergeMaxQueryCost("auto-merge-max-query-cost",
+                        cl::desc("Maximum number of queries whose operands "
+                                 "merging may make symbolic (default=2)"),
+                        cl::init(2));
+
+}
+
+
+bool klee::userSearcherRequiresFloatCoverage() {
+  return std::find(CoreSearch.begin(), CoreSearch.end(), Searcher::NURS_FPCov) != CoreSearch.end();
+}
+
+bool klee::userSearcherMergesStates() {
+  return UseMerge || UseBumpMerge || UseAutoMerge;
 }
 
+bool klee::userSearcherRequiresDistances() {
+  return std::find(CoreSearch.begin(), CoreSearch.end(), Searcher::Directed) != CoreSearch.end();
+}
 
 bool klee::userSearcherRequiresMD2U() {
   return (std::find(CoreSearch.begin(), CoreSearch.end(), Searcher::NURS_MD2U) != CoreSearch.end() ||
@@ -86,6 +150,13 @@ Searcher *getNewSearcher(Searcher::CoreSearchType type, Executor &executor) {
   case Searcher::NURS_ICnt: searcher = new WeightedRandomSearcher(WeightedRandomSearcher::InstCount); break;
   case Searcher::NURS_CPICnt: searcher = new WeightedRandomSearcher(WeightedRandomSearcher::CPInstCount); break;
   case Searcher::NURS_QC: searcher = new WeightedRandomSearcher(WeightedRandomSearcher::QueryCost); break;
+  case Searcher::NURS_FPCost: searcher = new WeightedRandomSearcher(WeightedRandomSearcher::FPCost); break;
+  case Searcher::NURS_FPCov: searcher = new WeightedRandomSearcher(WeightedRandomSearcher::FPCoverage, executor.getFloatCoverage()); break;
+  case Searcher::Directed:
+    if (Target.empty())
+      klee_error("--search=directed requires --target");
+    searcher = new DirectedSearcher(executor, Target);
+    break;
   }
 
   return searcher;
@@ -108,7 +179,10 @@ Searcher *klee::constructUserSearcher(Executor &executor) {
     for (unsigned i=1; i<CoreSearch.size(); i++)
       s.push_back(getNewSearcher(CoreSearch[i], executor));
     
-    searcher = new InterleavedSearcher(s);
+    if (UseBanditSearch)
+      searcher = new BanditSearcher(executor, s, BanditSliceInstructions);
+    else
+      searcher = new InterleavedSearcher(s);
   }
 
   if (UseBatchingSearch) {
@@ -119,19 +193,34 @@ Searcher *klee::constructUserSearcher(Executor &executor) {
   if (UseMerge) {
     if (UseBumpMerge)
       klee_error("use-merge and use-bump-merge cannot be used together");
+    if (UseAutoMerge)
+      klee_error("use-merge and use-auto-merge cannot be used together");
     // RandomPathSearcher cannot be used in conjunction with MergingSearcher,
     // see MergingSearcher::selectState() for explanation.
     if (std::find(CoreSearch.begin(), CoreSearch.end(), Searcher::RandomPath) != CoreSearch.end())
       klee_error("use-merge currently does not support random-path, please use another search strategy");
     searcher = new MergingSearcher(executor, searcher);
   } else if (UseBumpMerge) {
+    if (UseAutoMerge)
+      klee_error("use-bump-merge and use-auto-merge cannot be used together");
     searcher = new BumpMergingSearcher(executor, searcher);
+  } else if (UseAutoMerge) {
+    searcher = new AutoMergingSearcher(executor, searcher, AutoMergeWait,
+                                       AutoMergeMaxQueryCost);
   }
   
   if (UseIterativeDeepeningTimeSearch) {
     searcher = new IterativeDeepeningTimeSearcher(searcher);
   }
 
+  if (UseIterativeDeepeningBudgetSearch) {
+    if (UseIterativeDeepeningTimeSearch)
+      klee_error("use-iterative-deepening-budget-search and "
+                 "use-iterative-deepening-time-search cannot be used together");
+    searcher = new IterativeDeepeningBudgetSearcher(
+        searcher, IterativeDeepeningInstructions, IterativeDeepeningSolverTime);
+  }
+
   llvm::raw_ostream &os = executor.getHandler().getInfoStream();
 
   os << "BEGIN searcher description\n";
@@ -16,6 +16,9 @@ namespace klee {
 
   // XXX gross, should be on demand?
   bool userSearcherRequiresMD2U();
+  bool userSearcherRequiresFloatCoverage();
+  bool userSearcherRequiresDistances();
+  bool userSearcherMergesStates();
 
   Searcher *constructUserSearcher(Executor &executor);
 }
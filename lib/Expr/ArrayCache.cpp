@@ -1,5 +1,8 @@
 #include "klee/util/ArrayCache.h"
 
+#include <cassert>
+#include <set>
+
 namespace klee {
 
 ArrayCache::~ArrayCache() {
@@ -44,4 +47,49 @@ ArrayCache::CreateArray(const std::string &_name, uint64_t _size,
     return array;
   }
 }
+
+void ArrayCache::getUnreferencedArrays(
+    std::vector<const Array *> &arrays) const {
+  for (ArrayHashMap::const_iterator ai = cachedSymbolicArrays.begin(),
+                                    e = cachedSymbolicArrays.end();
+       ai != e; ++ai) {
+    if ((*ai)->isUnreferenced())
+      arrays.push_back(*ai);
+  }
+  for (ArrayPtrVec::const_iterator ai = concreteArrays.begin(),
+                                   e = concreteArrays.end();
+       ai != e; ++ai) {
+    if ((*ai)->isUnreferenced())
+      arrays.push_back(*ai);
+  }
+}
+
+void ArrayCache::reclaimArrays(const std::vector<const Array *> &arrays) {
+  std::set<const Array *> concrete;
+  for (std::vector<const Array *>::const_iterator ai = arrays.begin(),
+                                                  e = arrays.end();
+       ai != e; ++ai) {
+    assert((*ai)->isUnreferenced() && "Reclaiming a referenced array");
+    if ((*ai)->isSymbolicArray()) {
+      cachedSymbolicArrays.erase(*ai);
+      delete *ai;
+    } else {
+      concrete.insert(*ai);
+    }
+  }
+  if (concrete.empty())
+    return;
+
+  // Concrete arrays are only kept for deletion: keep the rest in order.
+  ArrayPtrVec::iterator kept = concreteArrays.begin();
+  for (ArrayPtrVec::iterator ai = concreteArrays.begin(),
+                             e = concreteArrays.end();
+       ai != e; ++ai) {
+    if (concrete.count(*ai))
+      delete *ai;
+    else
+      *kept++ = *ai;
+  }
+  concreteArrays.erase(kept, concreteArrays.end());
+}
 }
@@ -0,0 +1,195 @@
+//===-- ArrayFootprint.cpp ------------------------------------------------===//
+//
+//                     The KLEE Symbolic Virtual Machine
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+
+#include "klee/util/ArrayFootprint.h"
+
+#include "klee/Expr.h"
+
+#include <algorithm>
+
+using namespace klee;
+
+const ArrayFootprint &ArrayFootprint::getEmpty() {
+  // Held forever, so that releasing it never frees it.
+  static const ArrayFootprint *empty =
+    new ArrayFootprint(std::vector<const Array*>(), 1);
+  return *empty;
+}
+
+bool ArrayFootprint::intersects(const ArrayFootprint &b) const {
+  for (std::vector<const Array*>::const_iterator it = arrays.begin(),
+         ie = arrays.end(); it != ie; ++it)
+    if (std::find(b.arrays.begin(), b.arrays.end(), *it) != b.arrays.end())
+      return true;
+  return false;
+}
+
+void ArrayFootprint::retain(const ArrayFootprint *fp) {
+  incRefCount(fp->refCount);
+}
+
+void ArrayFootprint::release(const ArrayFootprint *fp) {
+  if (decRefCount(fp->refCount) == 0)
+    delete fp;
+}
+
+const ArrayFootprint *ArrayFootprint::load(const ArrayFootprint *const &slot) {
+#ifdef KLEE_ATOMIC_REFCOUNT
+  return __atomic_load_n(&slot, __ATOMIC_ACQUIRE);
+#else
+  return slot;
+#endif
+}
+
+const ArrayFootprint *ArrayFootprint::publish(const ArrayFootprint *&slot,
+                                              const ArrayFootprint *fp) {
+#ifdef KLEE_ATOMIC_REFCOUNT
+  const ArrayFootprint *expected = 0;
+  if (!__atomic_compare_exchange_n(&slot, &expected, fp, false,
+                                   __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)) {
+    release(fp);
+    return expected;
+  }
+  return fp;
+#else
+  slot = fp;
+  return fp;
+#endif
+}
+
+const ArrayFootprint *
+ArrayFootprint::share(const std::vector<const Array*> &arrays,
+                      const std::vector<const ArrayFootprint*> &parts) {
+  const ArrayFootprint *fp = 0;
+  if (arrays.empty())
+    fp = &getEmpty();
+  for (std::vector<const ArrayFootprint*>::const_iterator it = parts.begin(),
+         ie = parts.end(); it != ie && !fp; ++it)
+    if ((*it)->arrays == arrays)
+      fp = *it;
+  if (!fp)
+    fp = new ArrayFootprint(arrays);
+  retain(fp);
+  return fp;
+}
+
+namespace {
+
+/// A node whose footprint is being computed: an expression or an update.
+struct FootprintNode {
+  const Expr *e;
+  const UpdateNode *un;
+  bool expanded;
+
+  FootprintNode(const Expr *_e, const UpdateNode *_un)
+    : e(_e), un(_un), expanded(false) {}
+};
+
+/// appendArrays - Append the arrays of \a fp not yet in \a arrays.
+void appendArrays(std::vector<const Array*> &arrays, const ArrayFootprint &fp) {
+  for (std::vector<const Array*>::const_iterator it = fp.arrays.begin(),
+         ie = fp.arrays.end(); it != ie; ++it)
+    if (std::find(arrays.begin(), arrays.end(), *it) == arrays.end())
+      arrays.push_back(*it);
+}
+
+}
+
+const ArrayFootprint *ArrayFootprint::lookup(const Expr *e) {
+  if (isa<ConstantExpr>(e) || isa<FConstantExpr>(e))
+    return &getEmpty();
+  return load(e->footprint);
+}
+
+const ArrayFootprint *ArrayFootprint::lookup(const UpdateNode *un) {
+  if (!un)
+    return &getEmpty();
+  return load(un->footprint);
+}
+
+void ArrayFootprint::compute(const Expr *root, const UpdateNode *rootUpdate) {
+  // Compute the footprints of everything below the root first, with an
+  // explicit stack as expressions and update lists can be very deep.
+  std::vector<FootprintNode> stack(1, FootprintNode(root, rootUpdate));
+  std::vector<const ArrayFootprint*> parts;
+  std::vector<const Array*> arrays;
+  while (!stack.empty()) {
+    FootprintNode node = stack.back();
+    if (node.e ? lookup(node.e) : lookup(node.un)) {
+      stack.pop_back();
+      continue;
+    }
+
+    // The footprint of a read covers its updates, then its array, then its
+    // index, which is the order findSymbolicObjects reads them in. An
+    // update covers its index, value and the older updates.
+    std::vector<FootprintNode> deps;
+    const ReadExpr *re = node.e ? dyn_cast<ReadExpr>(node.e) : 0;
+    if (re) {
+      deps.push_back(FootprintNode(0, re->updates.head));
+      deps.push_back(FootprintNode(re->index.get(), 0));
+    } else if (node.e) {
+      for (unsigned i = 0, n = node.e->getNumKids(); i != n; ++i)
+        deps.push_back(FootprintNode(node.e->getKid(i).get(), 0));
+    } else {
+      deps.push_back(FootprintNode(node.un->index.get(), 0));
+      deps.push_back(FootprintNode(node.un->value.get(), 0));
+      deps.push_back(FootprintNode(0, node.un->next));
+    }
+
+    if (!node.expanded) {
+      stack.back().expanded = true;
+      for (unsigned i = deps.size(); i != 0; --i) {
+        const FootprintNode &dep = deps[i - 1];
+        if (!(dep.e ? lookup(dep.e) : lookup(dep.un)))
+          stack.push_back(dep);
+      }
+      continue;
+    }
+    stack.pop_back();
+
+    parts.clear();
+    arrays.clear();
+    for (unsigned i = 0; i != deps.size(); ++i) {
+      const FootprintNode &dep = deps[i];
+      const ArrayFootprint *fp = dep.e ? lookup(dep.e) : lookup(dep.un);
+      assert(fp && "footprint of a kid not computed");
+      parts.push_back(fp);
+      appendArrays(arrays, *fp);
+      if (re && i == 0 && re->updates.root->isSymbolicArray() &&
+          std::find(arrays.begin(), arrays.end(), re->updates.root) ==
+            arrays.end())
+        arrays.push_back(re->updates.root);
+    }
+
+    const ArrayFootprint *fp = share(arrays, parts);
+    if (node.e)
+      publish(node.e->footprint, fp);
+    else
+      publish(node.un->footprint, fp);
+  }
+}
+
+const ArrayFootprint &Expr::getFootprint() const {
+  const ArrayFootprint *fp = ArrayFootprint::lookup(this);
+  if (!fp) {
+    ArrayFootprint::compute(this, 0);
+    fp = ArrayFootprint::lookup(this);
+  }
+  return *fp;
+}
+
+const ArrayFootprint &UpdateNode::getFootprint() const {
+  const ArrayFootprint *fp = ArrayFootprint::lookup(this);
+  if (!fp) {
+    ArrayFootprint::compute(0, this);
+    fp = ArrayFootprint::lookup(this);
+  }
+  return *fp;
+}
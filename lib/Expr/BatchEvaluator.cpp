@@ -0,0 +1,492 @@
+//===-- BatchEvaluator.cpp ------------------------------------------------===//
+//
+//                     The KLEE Symbolic Virtual Machine
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+
+#include "klee/util/BatchEvaluator.h"
+#include "klee/util/Assignment.h"
+
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+#include <cstring>
+
+using namespace klee;
+
+// As for ExprEvaluator's native evaluation, host arithmetic must be done
+// without excess precision.
+#if defined(FLT_EVAL_METHOD) && FLT_EVAL_METHOD == 0
+static const bool HostFloatIsExact = true;
+#else
+static const bool HostFloatIsExact = false;
+#endif
+
+enum { BatchSize = BatchEvaluator::BatchSize };
+
+static inline uint64_t getMask(Expr::Width w) {
+  return w >= 64 ? ~0ULL : (1ULL << w) - 1;
+}
+
+static inline int64_t sext(uint64_t v, Expr::Width w) {
+  return w >= 64 ? (int64_t) v : ((int64_t) (v << (64 - w))) >> (64 - w);
+}
+
+template<typename T> static inline T fromBits(uint64_t bits);
+
+template<> inline float fromBits<float>(uint64_t bits) {
+  uint32_t tmp = bits;
+  float f;
+  memcpy(&f, &tmp, sizeof f);
+  return f;
+}
+
+template<> inline double fromBits<double>(uint64_t bits) {
+  double d;
+  memcpy(&d, &bits, sizeof d);
+  return d;
+}
+
+static inline uint64_t toBits(float f) {
+  uint32_t tmp;
+  memcpy(&tmp, &f, sizeof tmp);
+  return tmp;
+}
+
+static inline uint64_t toBits(double d) {
+  uint64_t tmp;
+  memcpy(&tmp, &d, sizeof tmp);
+  return tmp;
+}
+
+static bool isFloatWidth(Expr::Width w) {
+  return w == Expr::Fl32 || w == Expr::Fl64;
+}
+
+static bool roundsToNearest(const Expr &e) {
+  llvm::APFloat::roundingMode rm = llvm::APFloat::rmNearestTiesToEven;
+  if (const FUnaryRoundExpr *ue = dyn_cast<FUnaryRoundExpr>(&e))
+    rm = ue->getRoundingMode();
+  else if (const FBinaryRoundExpr *be = dyn_cast<FBinaryRoundExpr>(&e))
+    rm = be->getRoundingMode();
+  else if (const FCastRoundExpr *ce = dyn_cast<FCastRoundExpr>(&e))
+    rm = ce->getRoundingMode();
+  return rm == llvm::APFloat::rmNearestTiesToEven;
+}
+
+/// runFloat - Run a float arithmetic instruction over host values of type T.
+template<typename T>
+static void runFloat(Expr::Kind kind, uint64_t *d, const uint64_t *a,
+                     const uint64_t *b) {
+  switch (kind) {
+  case Expr::FAdd:
+    for (unsigned i = 0; i != BatchSize; ++i)
+      d[i] = toBits(fromBits<T>(a[i]) + fromBits<T>(b[i]));
+    break;
+  case Expr::FSub:
+    for (unsigned i = 0; i != BatchSize; ++i)
+      d[i] = toBits(fromBits<T>(a[i]) - fromBits<T>(b[i]));
+    break;
+  case Expr::FMul:
+    for (unsigned i = 0; i != BatchSize; ++i)
+      d[i] = toBits(fromBits<T>(a[i]) * fromBits<T>(b[i]));
+    break;
+  case Expr::FDiv:
+    for (unsigned i = 0; i != BatchSize; ++i)
+      d[i] = toBits(fromBits<T>(a[i]) / fromBits<T>(b[i]));
+    break;
+  case Expr::FSqrt:
+    for (unsigned i = 0; i != BatchSize; ++i)
+      d[i] = toBits((T) std::sqrt(fromBits<T>(a[i])));
+    break;
+  case Expr::FAbs:
+    for (unsigned i = 0; i != BatchSize; ++i)
+      d[i] = toBits((T) std::fabs(fromBits<T>(a[i])));
+    break;
+  default:
+    assert(0 && "not a float operation");
+  }
+}
+
+/// runFloatCompare - Run a float comparison over host values of type T.
+template<typename T>
+static void runFloatCompare(Expr::Kind kind, uint64_t *d, const uint64_t *a,
+                            const uint64_t *b) {
+  for (unsigned i = 0; i != BatchSize; ++i) {
+    T x = fromBits<T>(a[i]), y = fromBits<T>(b[i]);
+    bool unordered = x != x || y != y;
+    bool res;
+    switch (kind) {
+    case Expr::FOrd: res = !unordered; break;
+    case Expr::FUno: res = unordered; break;
+    case Expr::FUeq: res = unordered || x == y; break;
+    case Expr::FOeq: res = x == y; break;
+    case Expr::FUgt: res = unordered || x > y; break;
+    case Expr::FOgt: res = x > y; break;
+    case Expr::FUge: res = unordered || x >= y; break;
+    case Expr::FOge: res = x >= y; break;
+    case Expr::FUlt: res = unordered || x < y; break;
+    case Expr::FOlt: res = x < y; break;
+    case Expr::FUle: res = unordered || x <= y; break;
+    case Expr::FOle: res = x <= y; break;
+    case Expr::FUne: res = unordered || x != y; break;
+    default: res = !unordered && x != y; break; // FOne
+    }
+    d[i] = res;
+  }
+}
+
+/// runFloatClass - Run a float classification over host values of type T.
+template<typename T>
+static void runFloatClass(Expr::Kind kind, uint64_t *d, const uint64_t *a) {
+  for (unsigned i = 0; i != BatchSize; ++i) {
+    T x = fromBits<T>(a[i]);
+    switch (kind) {
+    case Expr::FIsNan: d[i] = std::isnan(x); break;
+    case Expr::FIsInf: d[i] = std::isinf(x); break;
+    default: d[i] = std::isfinite(x); break; // FIsFinite
+    }
+  }
+}
+
+int BatchEvaluator::emit(Expr::Kind kind, Expr::Width width,
+                         Expr::Width srcWidth, int a, int b, int c,
+                         uint64_t imm) {
+  Instruction inst;
+  inst.kind = kind;
+  inst.width = width;
+  inst.srcWidth = srcWidth;
+  inst.dst = values.size() / BatchSize;
+  inst.a = a;
+  inst.b = b;
+  inst.c = c;
+  inst.imm = imm;
+  program.push_back(inst);
+  values.resize(values.size() + BatchSize);
+  return inst.dst;
+}
+
+int BatchEvaluator::compileRead(const UpdateList &ul, uint64_t index,
+                                Expr::Width width) {
+  // Find the newest write to the index, giving up on any which may or may
+  // not be to it.
+  for (const UpdateNode *un = ul.head; un; un = un->next) {
+    ConstantExpr *ce = dyn_cast<ConstantExpr>(un->index);
+    if (!ce)
+      return -1;
+    if (ce->getZExtValue() == index)
+      return compile(un->value);
+  }
+
+  const Array *array = ul.root;
+  if (array->isConstantArray()) {
+    uint64_t value = 0;
+    if (index < array->size)
+      value = array->constantValues[index]->getZExtValue();
+    return emit(Expr::Constant, width, width, 0, 0, 0, value);
+  }
+  unsigned slot = std::find(arrays.begin(), arrays.end(), array) -
+                  arrays.begin();
+  if (slot == arrays.size())
+    arrays.push_back(array);
+  return emit(Expr::Read, width, width, slot, 0, 0, index);
+}
+
+int BatchEvaluator::compile(const ref<Expr> &e) {
+  ExprHashMap<unsigned>::iterator it = registers.find(e);
+  if (it != registers.end())
+    return it->second;
+
+  Expr::Kind kind = e->getKind();
+  Expr::Width width = e->getWidth();
+  if (width > 64)
+    return -1;
+
+  // The kids are compiled first; all of them must be.
+  int kids[3] = { 0, 0, 0 };
+  unsigned numKids = e->getNumKids();
+  if (kind != Expr::Read) {
+    if (numKids > 3)
+      return -1;
+    for (unsigned i = 0; i != numKids; ++i)
+      if ((kids[i] = compile(e->getKid(i))) < 0)
+        return -1;
+  }
+  Expr::Width srcWidth = numKids ? e->getKid(0)->getWidth() : width;
+
+  int reg = -1;
+  switch (kind) {
+  case Expr::Constant:
+    reg = emit(kind, width, width, 0, 0, 0,
+               cast<ConstantExpr>(e)->getZExtValue());
+    break;
+
+  case Expr::Read: {
+    const ReadExpr *re = cast<ReadExpr>(e);
+    ConstantExpr *index = dyn_cast<ConstantExpr>(re->index);
+    if (!index)
+      return -1;
+    reg = compileRead(re->updates, index->getZExtValue(), width);
+    if (reg < 0)
+      return -1;
+    break;
+  }
+
+  case Expr::Select:
+  case Expr::Concat:
+  case Expr::Add: case Expr::Sub: case Expr::Mul:
+  case Expr::And: case Expr::Or: case Expr::Xor:
+  case Expr::Shl: case Expr::LShr: case Expr::AShr:
+  case Expr::Not:
+  case Expr::ZExt: case Expr::SExt:
+  case Expr::Eq: case Expr::Ne:
+  case Expr::Ult: case Expr::Ule: case Expr::Ugt: case Expr::Uge:
+  case Expr::Slt: case Expr::Sle: case Expr::Sgt: case Expr::Sge:
+    if (kind == Expr::Concat)
+      srcWidth = e->getKid(1)->getWidth();
+    else if (kind == Expr::Select)
+      srcWidth = width;
+    reg = emit(kind, width, srcWidth, kids[0], kids[1], kids[2]);
+    break;
+
+  case Expr::Extract:
+    reg = emit(kind, width, srcWidth, kids[0], 0, 0,
+               cast<ExtractExpr>(e)->offset);
+    break;
+
+  case Expr::FConstant:
+    if (!HostFloatIsExact || !isFloatWidth(width))
+      return -1;
+    reg = emit(Expr::Constant, width, width, 0, 0, 0,
+               cast<FConstantExpr>(e)->ExplicitInt(width)->getZExtValue());
+    break;
+
+  case Expr::ExplicitFloat:
+  case Expr::ExplicitInt:
+    // Both only reinterpret the bits.
+    if (!HostFloatIsExact || width != srcWidth ||
+        !isFloatWidth(kind == Expr::ExplicitFloat ? width : srcWidth))
+      return -1;
+    registers.insert(std::make_pair(e, kids[0]));
+    return kids[0];
+
+  case Expr::FSelect:
+    if (!HostFloatIsExact || !isFloatWidth(width))
+      return -1;
+    reg = emit(Expr::Select, width, width, kids[0], kids[1], kids[2]);
+    break;
+
+  case Expr::FExt:
+    if (!HostFloatIsExact || !isFloatWidth(width) || !isFloatWidth(srcWidth) ||
+        !roundsToNearest(*e))
+      return -1;
+    if (width == srcWidth) {
+      registers.insert(std::make_pair(e, kids[0]));
+      return kids[0];
+    }
+    reg = emit(kind, width, srcWidth, kids[0]);
+    break;
+
+  case Expr::FAdd: case Expr::FSub: case Expr::FMul: case Expr::FDiv:
+  case Expr::FSqrt: case Expr::FAbs:
+    if (!HostFloatIsExact || !isFloatWidth(width) || !roundsToNearest(*e))
+      return -1;
+    reg = emit(kind, width, width, kids[0], kids[1]);
+    break;
+
+  case Expr::FOrd: case Expr::FUno: case Expr::FUeq: case Expr::FOeq:
+  case Expr::FUgt: case Expr::FOgt: case Expr::FUge: case Expr::FOge:
+  case Expr::FUlt: case Expr::FOlt: case Expr::FUle: case Expr::FOle:
+  case Expr::FUne: case Expr::FOne:
+  case Expr::FIsNan: case Expr::FIsInf: case Expr::FIsFinite:
+    if (!HostFloatIsExact || !isFloatWidth(srcWidth) ||
+        (numKids == 2 && e->getKid(1)->getWidth() != srcWidth))
+      return -1;
+    reg = emit(kind, width, srcWidth, kids[0], kids[1]);
+    break;
+
+  default:
+    // Division, whose evaluation by zero ExprEvaluator leaves symbolic, and
+    // everything else is left to ExprEvaluator.
+    return -1;
+  }
+
+  registers.insert(std::make_pair(e, (unsigned) reg));
+  return reg;
+}
+
+bool BatchEvaluator::add(const ref<Expr> &e) {
+  return compile(e) >= 0;
+}
+
+void BatchEvaluator::evaluate(const Assignment *const *assignments,
+                              unsigned n) {
+  assert(n <= BatchSize && "too many assignments");
+
+  // The bytes each assignment binds to each array read, or null.
+  std::vector<const std::vector<unsigned char> *>
+    bytes(arrays.size() * BatchSize, 0);
+  for (unsigned i = 0; i != n; ++i)
+    for (unsigned j = 0; j != arrays.size(); ++j) {
+      Assignment::bindings_ty::const_iterator it =
+        assignments[i]->bindings.find(arrays[j]);
+      if (it != assignments[i]->bindings.end())
+        bytes[j * BatchSize + i] = &it->second;
+    }
+
+  uint64_t *regs = values.data();
+  for (std::vector<Instruction>::const_iterator it = program.begin(),
+         ie = program.end(); it != ie; ++it) {
+    const Instruction &inst = *it;
+    uint64_t *d = regs + inst.dst * BatchSize;
+    const uint64_t *a = regs + inst.a * BatchSize;
+    const uint64_t *b = regs + inst.b * BatchSize;
+    const uint64_t *c = regs + inst.c * BatchSize;
+    uint64_t mask = getMask(inst.width);
+    Expr::Width w = inst.srcWidth;
+
+    switch (inst.kind) {
+    case Expr::Constant:
+      std::fill(d, d + BatchSize, inst.imm);
+      break;
+    case Expr::Read:
+      for (unsigned i = 0; i != BatchSize; ++i) {
+        const std::vector<unsigned char> *v = bytes[inst.a * BatchSize + i];
+        d[i] = v && inst.imm < v->size() ? (*v)[inst.imm] : 0;
+      }
+      break;
+    case Expr::Select:
+      for (unsigned i = 0; i != BatchSize; ++i)
+        d[i] = a[i] ? b[i] : c[i];
+      break;
+    case Expr::Concat:
+      for (unsigned i = 0; i != BatchSize; ++i)
+        d[i] = (a[i] << w) | b[i];
+      break;
+    case Expr::Extract:
+      for (unsigned i = 0; i != BatchSize; ++i)
+        d[i] = (a[i] >> inst.imm) & mask;
+      break;
+    case Expr::ZExt:
+      std::copy(a, a + BatchSize, d);
+      break;
+    case Expr::SExt:
+      for (unsigned i = 0; i != BatchSize; ++i)
+        d[i] = sext(a[i], w) & mask;
+      break;
+    case Expr::Add:
+      for (unsigned i = 0; i != BatchSize; ++i)
+        d[i] = (a[i] + b[i]) & mask;
+      break;
+    case Expr::Sub:
+      for (unsigned i = 0; i != BatchSize; ++i)
+        d[i] = (a[i] - b[i]) & mask;
+      break;
+    case Expr::Mul:
+      for (unsigned i = 0; i != BatchSize; ++i)
+        d[i] = (a[i] * b[i]) & mask;
+      break;
+    case Expr::And:
+      for (unsigned i = 0; i != BatchSize; ++i)
+        d[i] = a[i] & b[i];
+      break;
+    case Expr::Or:
+      for (unsigned i = 0; i != BatchSize; ++i)
+        d[i] = a[i] | b[i];
+      break;
+    case Expr::Xor:
+      for (unsigned i = 0; i != BatchSize; ++i)
+        d[i] = a[i] ^ b[i];
+      break;
+    case Expr::Not:
+      for (unsigned i = 0; i != BatchSize; ++i)
+        d[i] = ~a[i] & mask;
+      break;
+    // Shifting by the width or more gives zero, or the sign.
+    case Expr::Shl:
+      for (unsigned i = 0; i != BatchSize; ++i)
+        d[i] = b[i] >= w ? 0 : (a[i] << b[i]) & mask;
+      break;
+    case Expr::LShr:
+      for (unsigned i = 0; i != BatchSize; ++i)
+        d[i] = b[i] >= w ? 0 : a[i] >> b[i];
+      break;
+    case Expr::AShr:
+      for (unsigned i = 0; i != BatchSize; ++i)
+        d[i] = (sext(a[i], w) >> std::min<uint64_t>(b[i], w - 1)) & mask;
+      break;
+    case Expr::Eq:
+      for (unsigned i = 0; i != BatchSize; ++i)
+        d[i] = a[i] == b[i];
+      break;
+    case Expr::Ne:
+      for (unsigned i = 0; i != BatchSize; ++i)
+        d[i] = a[i] != b[i];
+      break;
+    case Expr::Ult:
+      for (unsigned i = 0; i != BatchSize; ++i)
+        d[i] = a[i] < b[i];
+      break;
+    case Expr::Ule:
+      for (unsigned i = 0; i != BatchSize; ++i)
+        d[i] = a[i] <= b[i];
+      break;
+    case Expr::Ugt:
+      for (unsigned i = 0; i != BatchSize; ++i)
+        d[i] = a[i] > b[i];
+      break;
+    case Expr::Uge:
+      for (unsigned i = 0; i != BatchSize; ++i)
+        d[i] = a[i] >= b[i];
+      break;
+    case Expr::Slt:
+      for (unsigned i = 0; i != BatchSize; ++i)
+        d[i] = sext(a[i], w) < sext(b[i], w);
+      break;
+    case Expr::Sle:
+      for (unsigned i = 0; i != BatchSize; ++i)
+        d[i] = sext(a[i], w) <= sext(b[i], w);
+      break;
+    case Expr::Sgt:
+      for (unsigned i = 0; i != BatchSize; ++i)
+        d[i] = sext(a[i], w) > sext(b[i], w);
+      break;
+    case Expr::Sge:
+      for (unsigned i = 0; i != BatchSize; ++i)
+        d[i] = sext(a[i], w) >= sext(b[i], w);
+      break;
+    case Expr::FExt:
+      // Widening is exact, and narrowing rounds to nearest.
+      if (inst.width == Expr::Fl64) {
+        for (unsigned i = 0; i != BatchSize; ++i)
+          d[i] = toBits((double) fromBits<float>(a[i]));
+      } else {
+        for (unsigned i = 0; i != BatchSize; ++i)
+          d[i] = toBits((float) fromBits<double>(a[i]));
+      }
+      break;
+    case Expr::FAdd: case Expr::FSub: case Expr::FMul: case Expr::FDiv:
+    case Expr::FSqrt: case Expr::FAbs:
+      if (inst.width == Expr::Fl32)
+        runFloat<float>(inst.kind, d, a, b);
+      else
+        runFloat<double>(inst.kind, d, a, b);
+      break;
+    case Expr::FIsNan: case Expr::FIsInf: case Expr::FIsFinite:
+      if (w == Expr::Fl32)
+        runFloatClass<float>(inst.kind, d, a);
+      else
+        runFloatClass<double>(inst.kind, d, a);
+      break;
+    default:
+      if (w == Expr::Fl32)
+        runFloatCompare<float>(inst.kind, d, a, b);
+      else
+        runFloatCompare<double>(inst.kind, d, a, b);
+      break;
+    }
+  }
+}
@@ -10,6 +10,7 @@
 #include "klee/Constraints.h"
 
 #include "klee/util/ExprPPrinter.h"
+#include "klee/util/ExprUtil.h"
 #include "klee/util/ExprVisitor.h"
 #if LLVM_VERSION_CODE >= LLVM_VERSION(3, 3)
 #include "llvm/IR/Function.h"
@@ -19,7 +20,8 @@
 #include "llvm/Support/CommandLine.h"
 #include "klee/Internal/Module/KModule.h"
 
-#include <map>
+#include <algorithm>
+#include <set>
 
 using namespace klee;
 
@@ -57,17 +59,24 @@ public:
 
 class ExprReplaceVisitor2 : public ExprVisitor {
 private:
-  const std::map< ref<Expr>, ref<Expr> > &replacements;
+  const ImmutableMap< ref<Expr>, ref<Expr> > &replacements;
 
 public:
-  ExprReplaceVisitor2(const std::map< ref<Expr>, ref<Expr> > &_replacements) 
+  ExprReplaceVisitor2(const ImmutableMap< ref<Expr>, ref<Expr> > &_replacements)
     : ExprVisitor(true),
       replacements(_replacements) {}
 
+  ExprReplaceVisitor2(const ImmutableMap< ref<Expr>, ref<Expr> > &_replacements,
+                      visited_ty &memo)
+    : ExprVisitor(true),
+      replacements(_replacements) {
+    useMemo(memo);
+  }
+
   Action visitExprPost(const Expr &e) {
-    std::map< ref<Expr>, ref<Expr> >::const_iterator it =
-      replacements.find(ref<Expr>(const_cast<Expr*>(&e)));
-    if (it!=replacements.end()) {
+    const std::pair< ref<Expr>, ref<Expr> > *it =
+      replacements.lookup(ref<Expr>(const_cast<Expr*>(&e)));
+    if (it) {
       return Action::changeTo(it->second);
     } else {
       return Action::doChildren();
@@ -75,25 +84,170 @@ public:
   }
 };
 
-bool ConstraintManager::rewriteConstraints(ExprVisitor &visitor) {
-  ConstraintManager::constraints_ty old;
-  bool changed = false;
+/// A list adding to a shared chunk this small copies it rather than
+/// starting a new chunk after it, which keeps the chains short.
+static const unsigned MinSharedChunkSize = 64;
 
-  constraints.swap(old);
-  for (ConstraintManager::constraints_ty::iterator 
-         it = old.begin(), ie = old.end(); it != ie; ++it) {
-    ref<Expr> &ce = *it;
-    ref<Expr> e = visitor.visit(ce);
+/// The simplified subexpressions a list keeps before starting over.
+static const unsigned MaxSimplifyCacheSize = 8192;
 
-    if (e!=ce) {
-      addConstraintInternal(e); // enable further reductions
-      changed = true;
+ConstraintManager::ConstraintChunk::ConstraintChunk(
+    const ref<ConstraintChunk> &_parent)
+  : refCount(0), parent(_parent), offset(0) {
+  if (!parent.isNull()) {
+    path = parent->path;
+    offset = parent->offset + parent->constraints.size();
+  }
+  path.push_back(this);
+}
+
+ConstraintManager::const_iterator
+ConstraintManager::const_iterator::operator+(size_t n) const {
+  const_iterator it(*this);
+  while (n) {
+    size_t left = it.chunks[it.chunk]->constraints.size() - it.index;
+    if (n < left || it.chunk + 1 == it.numChunks) {
+      it.index += n;
+      break;
+    }
+    n -= left;
+    ++it.chunk;
+    it.index = 0;
+  }
+  return it;
+}
+
+ConstraintManager::ConstraintManager(
+    const std::vector< ref<Expr> > &_constraints)
+  : indexed(_constraints.empty()) {
+  if (!_constraints.empty()) {
+    tail = new ConstraintChunk(0);
+    tail->constraints = _constraints;
+  }
+}
+
+bool ConstraintManager::operator==(const ConstraintManager &other) const {
+  if (tail.get() == other.tail.get())
+    return true;
+  return size() == other.size() && std::equal(begin(), end(), other.begin());
+}
+
+ref<Expr> ConstraintManager::addEquality(equalities_ty &equalities,
+                                         const ref<Expr> &e) {
+  const EqExpr *ee = dyn_cast<EqExpr>(e);
+  if (ee && isa<ConstantExpr>(ee->left)) {
+    equalities = equalities.insert(std::make_pair(ee->right, ee->left));
+    return ee->right;
+  }
+  equalities = equalities.insert(
+      std::make_pair(e, ConstantExpr::alloc(1, Expr::Bool)));
+  return e;
+}
+
+void ConstraintManager::invalidateSimplifyCache(const ref<Expr> &src) {
+  if (simplifyCache.isNull())
+    return;
+
+  // Simplifying an expression which reads none of the arrays src reads
+  // never meets src, as replacing only ever drops arrays. An src reading no
+  // symbolic array could be met anywhere.
+  const ArrayFootprint &fp = src->getFootprint();
+  if (fp.empty()) {
+    simplifyCache = 0;
+    return;
+  }
+
+  typedef ExprHashMap< ref<Expr> > results_ty;
+  if (simplifyCache->refCount > 1) {
+    ref<SimplifyCache> shared = simplifyCache;
+    simplifyCache = new SimplifyCache();
+    for (results_ty::const_iterator it = shared->results.begin(),
+           ie = shared->results.end(); it != ie; ++it)
+      if (!it->first->getFootprint().intersects(fp))
+        simplifyCache->results.insert(*it);
+  } else {
+    results_ty &results = simplifyCache->results;
+    for (results_ty::iterator it = results.begin(); it != results.end();) {
+      if (it->first->getFootprint().intersects(fp))
+        it = results.erase(it);
+      else
+        ++it;
+    }
+  }
+}
+
+void ConstraintManager::push(const ref<Expr> &e) {
+  if (tail.isNull()) {
+    tail = new ConstraintChunk(0);
+  } else if (tail->refCount > 1) {
+    ref<ConstraintChunk> shared = tail;
+    if (shared->constraints.size() < MinSharedChunkSize) {
+      tail = new ConstraintChunk(shared->parent);
+      tail->constraints = shared->constraints;
+      tail->reads = shared->reads;
     } else {
-      constraints.push_back(ce);
+      tail = new ConstraintChunk(shared);
     }
   }
+  tail->constraints.push_back(e);
+  if (indexed)
+    invalidateSimplifyCache(addEquality(equalities, e));
+}
 
-  return changed;
+void ConstraintManager::rewriteEquality(ref<Expr> src, ref<Expr> dst) {
+  if (tail.isNull())
+    return;
+
+  // A constraint containing src reads every symbolic array src reads, so
+  // only the constraints reading one of them need to be visited.
+  std::vector<const Array*> arrays;
+  findSymbolicObjects(src, arrays);
+  std::vector<const ConstraintChunk*> chunks(tail->path);
+  std::vector<bool> candidates;
+  bool any = false;
+  for (std::vector<const ConstraintChunk*>::iterator it = chunks.begin(),
+         ie = chunks.end(); it != ie; ++it) {
+    const ConstraintChunk *chunk = *it;
+    for (unsigned i = chunk->reads.size(), e = chunk->constraints.size();
+         i != e; ++i) {
+      chunk->reads.push_back(std::vector<const Array*>());
+      findSymbolicObjects(chunk->constraints[i], chunk->reads.back());
+    }
+    for (unsigned i = 0, e = chunk->constraints.size(); i != e; ++i) {
+      const std::vector<const Array*> &reads = chunk->reads[i];
+      bool candidate = arrays.empty();
+      for (std::vector<const Array*>::const_iterator ait = arrays.begin(),
+             aie = arrays.end(); !candidate && ait != aie; ++ait)
+        candidate = std::find(reads.begin(), reads.end(), *ait) != reads.end();
+      candidates.push_back(candidate);
+      any |= candidate;
+    }
+  }
+  if (!any)
+    return;
+
+  // Rebuild the list as a single chunk.
+  ref<ConstraintChunk> old = tail;
+  tail = 0;
+  equalities = equalities_ty();
+  simplifyCache = 0;
+  ExprReplaceVisitor visitor(src, dst);
+  unsigned position = 0;
+  for (std::vector<const ConstraintChunk*>::iterator it = chunks.begin(),
+         ie = chunks.end(); it != ie; ++it) {
+    const ConstraintChunk *chunk = *it;
+    for (unsigned i = 0, e = chunk->constraints.size(); i != e; ++i) {
+      const ref<Expr> &ce = chunk->constraints[i];
+      if (candidates[position++]) {
+        ref<Expr> e = visitor.visit(ce);
+        if (e != ce) {
+          addConstraintInternal(e); // enable further reductions
+          continue;
+        }
+      }
+      push(ce);
+    }
+  }
 }
 
 void ConstraintManager::simplifyForValidConstraint(ref<Expr> e) {
@@ -101,28 +255,225 @@ void ConstraintManager::simplifyForValidConstraint(ref<Expr> e) {
 }
 
 ref<Expr> ConstraintManager::simplifyExpr(ref<Expr> e) const {
-  if (isa<ConstantExpr>(e))
+  if (isa<ConstantExpr>(e) || tail.isNull())
     return e;
 
-  std::map< ref<Expr>, ref<Expr> > equalities;
-  
-  for (ConstraintManager::constraints_ty::const_iterator 
-         it = constraints.begin(), ie = constraints.end(); it != ie; ++it) {
-    if (const EqExpr *ee = dyn_cast<EqExpr>(*it)) {
-      if (isa<ConstantExpr>(ee->left)) {
-        equalities.insert(std::make_pair(ee->right,
-                                         ee->left));
-      } else {
-        equalities.insert(std::make_pair(*it,
-                                         ConstantExpr::alloc(1, Expr::Bool)));
+  // Building the equalities does not change the constraints.
+  if (!indexed) {
+    for (const_iterator it = begin(), ie = end(); it != ie; ++it)
+      addEquality(equalities, *it);
+    indexed = true;
+  }
+
+  // The equalities only grow as constraints are added, and a new one only
+  // drops the results it may change, so most subexpressions are simplified
+  // once over the whole life of the list and of its copies.
+  if (simplifyCache.isNull() ||
+      simplifyCache->results.size() >= MaxSimplifyCacheSize)
+    simplifyCache = new SimplifyCache();
+  return ExprReplaceVisitor2(equalities, simplifyCache->results).visit(e);
+}
+
+/// getNegated - If \a e is the negation of a boolean, that boolean.
+static ref<Expr> getNegated(const ref<Expr> &e) {
+  const EqExpr *ee = dyn_cast<EqExpr>(e);
+  if (!ee || ee->right->getWidth() != Expr::Bool)
+    return 0;
+  const ConstantExpr *ce = dyn_cast<ConstantExpr>(ee->left);
+  return ce && ce->isFalse() ? ee->right : 0;
+}
+
+namespace {
+/// FloatBound - A bound a constraint puts on a float: x < c, x <= c, x > c
+/// or x >= c, also holding for a NaN x unless it is ordered.
+struct FloatBound {
+  ref<Expr> x;
+  ref<FConstantExpr> c;
+  bool upper, strict, ordered;
+};
+}
+
+/// getFloatBound - Whether \a e bounds a float by a constant, directly or
+/// as the negation of a comparison, and if so which bound it is.
+static bool getFloatBound(ref<Expr> e, FloatBound &b) {
+  ref<Expr> negation = getNegated(e);
+  bool negated = !negation.isNull();
+  if (negated)
+    e = negation;
+
+  switch (e->getKind()) {
+  case Expr::FOlt: b.upper = true;  b.strict = true;  b.ordered = true;  break;
+  case Expr::FOle: b.upper = true;  b.strict = false; b.ordered = true;  break;
+  case Expr::FOgt: b.upper = false; b.strict = true;  b.ordered = true;  break;
+  case Expr::FOge: b.upper = false; b.strict = false; b.ordered = true;  break;
+  case Expr::FUlt: b.upper = true;  b.strict = true;  b.ordered = false; break;
+  case Expr::FUle: b.upper = true;  b.strict = false; b.ordered = false; break;
+  case Expr::FUgt: b.upper = false; b.strict = true;  b.ordered = false; break;
+  case Expr::FUge: b.upper = false; b.strict = false; b.ordered = false; break;
+  default:
+    return false;
+  }
+
+  const BinaryExpr *be = cast<BinaryExpr>(e);
+  if (isa<FConstantExpr>(be->right) && !isa<FConstantExpr>(be->left)) {
+    b.x = be->left;
+    b.c = cast<FConstantExpr>(be->right);
+  } else if (isa<FConstantExpr>(be->left) && !isa<FConstantExpr>(be->right)) {
+    b.x = be->right;
+    b.c = cast<FConstantExpr>(be->left);
+    b.upper = !b.upper;
+  } else {
+    return false;
+  }
+  if (b.c->getAPValue().isNaN())
+    return false;
+
+  // !(x < c) is x >= c or x is NaN.
+  if (negated) {
+    b.upper = !b.upper;
+    b.strict = !b.strict;
+    b.ordered = !b.ordered;
+  }
+  return true;
+}
+
+/// impliesBound - Whether the bound \a a implies the bound \a b.
+static bool impliesBound(const FloatBound &a, const FloatBound &b) {
+  if (a.x != b.x || a.upper != b.upper || (!a.ordered && b.ordered))
+    return false;
+  const ref<FConstantExpr> &tighter = a.upper ? a.c : b.c;
+  const ref<FConstantExpr> &looser = a.upper ? b.c : a.c;
+  if (tighter->FOlt(looser)->isTrue())
+    return true;
+  return tighter->FOeq(looser)->isTrue() && (a.strict || !b.strict);
+}
+
+/// getFloatClass - Whether \a e states that the float \a x is not NaN
+/// (\a finite unset) or that it is finite (\a finite set).
+static bool getFloatClass(const ref<Expr> &e, ref<Expr> &x, bool &finite) {
+  // FOrd(x, x) and !FUno(x, x).
+  ref<Expr> negated = getNegated(e);
+  const BinaryExpr *be = 0;
+  if (isa<FOrdExpr>(e))
+    be = cast<BinaryExpr>(e);
+  else if (!negated.isNull() && isa<FUnoExpr>(negated))
+    be = cast<BinaryExpr>(negated);
+  if (be) {
+    if (be->left != be->right)
+      return false;
+    x = be->left;
+    finite = false;
+    return true;
+  }
+
+  // isnan(x) == 0, isinf(x) == 0 and isfinite(x) != 0.
+  const EqExpr *ee = dyn_cast<EqExpr>(negated.isNull() ? e : negated);
+  if (!ee || !isa<ConstantExpr>(ee->left) ||
+      !cast<ConstantExpr>(ee->left)->isZero())
+    return false;
+  Expr::Kind kind = ee->right->getKind();
+  if (negated.isNull() && kind == Expr::FIsNan)
+    finite = false;
+  else if (negated.isNull() && kind == Expr::FIsInf)
+    finite = true;
+  else if (!negated.isNull() && kind == Expr::FIsFinite)
+    finite = true;
+  else
+    return false;
+  x = cast<UnaryExpr>(ee->right)->expr;
+  return true;
+}
+
+bool ConstraintManager::simplify() {
+  if (tail.isNull())
+    return false;
+
+  bool changed = false;
+  constraints_ty old(begin(), end()), kept;
+  kept.reserve(old.size());
+
+  // Rewrite each constraint under the equalities of the others, keeping a
+  // single copy of the constraints which appear several times.
+  equalities_ty others;
+  std::set< ref<Expr> > seen;
+  for (constraints_ty::iterator it = old.begin(), ie = old.end(); it != ie;
+       ++it)
+    if (seen.insert(*it).second)
+      addEquality(others, *it);
+  changed = seen.size() != old.size();
+  seen.clear();
+  for (constraints_ty::iterator it = old.begin(), ie = old.end(); it != ie;
+       ++it) {
+    const ref<Expr> &c = *it;
+    if (!seen.insert(c).second)
+      continue;
+    const EqExpr *ee = dyn_cast<EqExpr>(c);
+    equalities_ty rest =
+        others.remove(ee && isa<ConstantExpr>(ee->left) ? ee->right : c);
+    ref<Expr> e = ExprReplaceVisitor2(rest).visit(c);
+    if (ConstantExpr *ce = dyn_cast<ConstantExpr>(e)) {
+      if (ce->isTrue()) {
+        others = rest;
+        changed = true;
+        continue;
       }
-    } else {
-      equalities.insert(std::make_pair(*it,
-                                       ConstantExpr::alloc(1, Expr::Bool)));
+      // The constraints are unsatisfiable; leave them to the solver.
+      e = c;
+    }
+    if (e != c) {
+      others = rest;
+      addEquality(others, e);
+      changed = true;
+    }
+    kept.push_back(e);
+  }
+
+  // Drop the float bounds another bound on the same value implies.
+  std::vector<FloatBound> bounds(kept.size());
+  std::vector<bool> isBound(kept.size()), dropped(kept.size());
+  for (unsigned i = 0, e = kept.size(); i != e; ++i)
+    isBound[i] = getFloatBound(kept[i], bounds[i]);
+  for (unsigned i = 0, e = kept.size(); i != e; ++i) {
+    if (!isBound[i])
+      continue;
+    for (unsigned j = 0; j != e; ++j) {
+      if (j != i && isBound[j] && !dropped[j] &&
+          impliesBound(bounds[j], bounds[i])) {
+        dropped[i] = true;
+        break;
+      }
+    }
+  }
+
+  // Drop the classifications the remaining ordered bounds imply: any of
+  // them makes a float not NaN, finite ones on both sides make it finite.
+  for (unsigned i = 0, e = kept.size(); i != e; ++i) {
+    ref<Expr> x;
+    bool finite;
+    if (!getFloatClass(kept[i], x, finite))
+      continue;
+    bool lower = false, upper = false;
+    for (unsigned j = 0; j != e; ++j) {
+      if (!isBound[j] || dropped[j] || !bounds[j].ordered || bounds[j].x != x)
+        continue;
+      if (!finite || !bounds[j].c->getAPValue().isInfinity())
+        (bounds[j].upper ? upper : lower) = true;
     }
+    if (finite ? lower && upper : lower || upper)
+      dropped[i] = true;
   }
 
-  return ExprReplaceVisitor2(equalities).visit(e);
+  constraints_ty result;
+  result.reserve(kept.size());
+  for (unsigned i = 0, e = kept.size(); i != e; ++i) {
+    if (dropped[i])
+      changed = true;
+    else
+      result.push_back(kept[i]);
+  }
+  if (changed)
+    *this = ConstraintManager(result);
+  return changed;
 }
 
 void ConstraintManager::addConstraintInternal(ref<Expr> e) {
@@ -144,23 +495,15 @@ void ConstraintManager::addConstraintInternal(ref<Expr> e) {
 
   case Expr::Eq: {
     if (RewriteEqualities) {
-      // XXX: should profile the effects of this and the overhead.
-      // traversing the constraints looking for equalities is hardly the
-      // slowest thing we do, but it is probably nicer to have a
-      // ConstraintSet ADT which efficiently remembers obvious patterns
-      // (byte-constant comparison).
       BinaryExpr *be = cast<BinaryExpr>(e);
-      if (isa<ConstantExpr>(be->left)) {
-	ExprReplaceVisitor visitor(be->right, be->left);
-	rewriteConstraints(visitor);
-      }
+      if (isa<ConstantExpr>(be->left))
+        rewriteEquality(be->right, be->left);
     }
-    constraints.push_back(e);
-    break;
+    // fall through
   }
     
   default:
-    constraints.push_back(e);
+    push(e);
     break;
   }
 }
@@ -10,6 +10,7 @@
 #include "klee/Expr.h"
 #include "klee/Config/Version.h"
 #include "klee/Internal/Support/ErrorHandling.h"
+#include "klee/Internal/System/MemoryUsage.h"
 
 #if LLVM_VERSION_CODE >= LLVM_VERSION(3, 1)
 #include "llvm/ADT/Hashing.h"
@@ -22,9 +23,19 @@
 
 #include "klee/util/ExprPPrinter.h"
 
+#include <ciso646>
+#ifdef _LIBCPP_VERSION
+#include <unordered_map>
+#define unordered_multimap std::unordered_multimap
+#else
+#include <tr1/unordered_map>
+#define unordered_multimap std::tr1::unordered_multimap
+#endif
+#include <cmath>
 #include <sstream>
 #include <fenv.h>
 #include <limits.h>
+#include <string.h>
 
 using namespace klee;
 using namespace llvm;
@@ -34,12 +45,152 @@ namespace {
   ConstArrayOpt("const-array-opt",
    cl::init(false),
    cl::desc("Enable various optimizations involving all-constant arrays."));
+
+  cl::opt<bool>
+  UniqueExprs("unique-exprs",
+   cl::init(false),
+   cl::desc("Hash-cons expressions, so that structurally equal expressions "
+            "share a single node (default=off)"));
+
+  /// The nodes entered by Expr::uniquify, by hash. Allocated on first use and
+  /// never freed, as expressions held by globals may be destroyed late.
+  typedef unordered_multimap<unsigned, Expr *> UniqueExprTable;
+  UniqueExprTable *uniqueExprs = 0;
+
+  /// Expression nodes are small and most of those built while canonicalizing,
+  /// splitting and rewriting queries die as soon as the solver call returns.
+  /// They are carved from slabs and recycled through free lists with one
+  /// class per 8 bytes, so that this churn does not go through malloc.
+  class ExprPool {
+    static const unsigned Granularity = 8, MaxSize = 256;
+    static const size_t SlabSize = 64 * 1024;
+
+    struct FreeBlock {
+      FreeBlock *next;
+    };
+
+    FreeBlock *freeLists[MaxSize / Granularity];
+    char *slab, *slabEnd;
+
+    static unsigned sizeClass(size_t size) {
+      return (size - 1) / Granularity;
+    }
+
+  public:
+    ExprPool() : slab(0), slabEnd(0) {
+      memset(freeLists, 0, sizeof(freeLists));
+    }
+
+    void *allocate(size_t size) {
+      if (size > MaxSize)
+        return ::operator new(size);
+
+      unsigned c = sizeClass(size);
+      if (FreeBlock *b = freeLists[c]) {
+        freeLists[c] = b->next;
+        return b;
+      }
+
+      size_t blockSize = (c + 1) * Granularity;
+      if ((size_t) (slabEnd - slab) < blockSize) {
+        // Give the tail of the old slab to the class that fits it exactly.
+        if (slabEnd != slab) {
+          FreeBlock *b = reinterpret_cast<FreeBlock *>(slab);
+          unsigned tail = sizeClass(slabEnd - slab);
+          b->next = freeLists[tail];
+          freeLists[tail] = b;
+        }
+        slab = static_cast<char *>(::operator new(SlabSize));
+        slabEnd = slab + SlabSize;
+      }
+      void *res = slab;
+      slab += blockSize;
+      return res;
+    }
+
+    void deallocate(void *p, size_t size) {
+      if (!p)
+        return;
+      if (size > MaxSize) {
+        ::operator delete(p);
+        return;
+      }
+
+      unsigned c = sizeClass(size);
+      FreeBlock *b = static_cast<FreeBlock *>(p);
+      b->next = freeLists[c];
+      freeLists[c] = b;
+    }
+  };
+
+  /// Never freed: expressions held by globals may be destroyed late.
+  ExprPool &getExprPool() {
+    static ExprPool *pool = new ExprPool();
+    return *pool;
+  }
 }
 
+#undef unordered_multimap
+
 /***/
 
 unsigned Expr::count = 0;
 
+// The pool is not thread safe, so builds that share expressions between
+// threads keep using the global heap.
+void *Expr::operator new(size_t size) {
+#ifdef KLEE_ATOMIC_REFCOUNT
+  return ::operator new(size);
+#else
+  util::CountMemory(util::ExprMemory, size);
+  return getExprPool().allocate(size);
+#endif
+}
+
+void Expr::operator delete(void *p, size_t size) {
+#ifdef KLEE_ATOMIC_REFCOUNT
+  ::operator delete(p);
+#else
+  if (p)
+    util::UncountMemory(util::ExprMemory, size);
+  getExprPool().deallocate(p, size);
+#endif
+}
+
+Expr::~Expr() {
+  decRefCount(Expr::count);
+  if (footprint)
+    ArrayFootprint::release(footprint);
+
+  // Only the hash is safe to look at here, the derived parts of this node
+  // are already gone.
+  if (uniqueExprs) {
+    std::pair<UniqueExprTable::iterator, UniqueExprTable::iterator> range =
+        uniqueExprs->equal_range(hashValue);
+    for (UniqueExprTable::iterator it = range.first; it != range.second; ++it)
+      if (it->second == this) {
+        uniqueExprs->erase(it);
+        break;
+      }
+  }
+}
+
+Expr *Expr::uniquify(Expr *e) {
+  if (!UniqueExprs)
+    return e;
+  if (!uniqueExprs)
+    uniqueExprs = new UniqueExprTable();
+
+  std::pair<UniqueExprTable::iterator, UniqueExprTable::iterator> range =
+      uniqueExprs->equal_range(e->hashValue);
+  for (UniqueExprTable::iterator it = range.first; it != range.second; ++it)
+    if (it->second->compare(*e) == 0)
+      return it->second;
+
+  uniqueExprs->insert(std::make_pair(e->hashValue, e));
+  return e;
+}
+
 ref<Expr> Expr::createTempRead(const Array *array, Expr::Width w) {
   UpdateList ul(array, 0);
 
@@ -86,10 +237,61 @@ ref<Expr> Expr::createTempRead(const Array *array, Expr::Width w) {
   }
 }
 
+/// Expr::ExprEquivSet - The pairs of distinct nodes one comparison has found
+/// equal, so that the subexpressions they share are compared only once. Most
+/// comparisons find a handful, which are kept in place; the set only goes to
+/// the heap for large shared DAGs. Each comparison has its own.
+class Expr::ExprEquivSet {
+  typedef std::pair<const Expr *, const Expr *> Pair;
+  static const unsigned SmallSize = 8;
+
+  Pair small[SmallSize];
+  unsigned numSmall;
+  llvm::DenseSet<Pair> *large;
+
+  ExprEquivSet(const ExprEquivSet &);
+  void operator=(const ExprEquivSet &);
+
+public:
+  ExprEquivSet() : numSmall(0), large(0) {}
+  ~ExprEquivSet() { delete large; }
+
+  bool count(const Pair &p) const {
+    for (unsigned i = 0; i != numSmall; ++i)
+      if (small[i] == p)
+        return true;
+    return large && large->count(p);
+  }
+
+  void insert(const Pair &p) {
+    if (numSmall != SmallSize) {
+      small[numSmall++] = p;
+      return;
+    }
+    if (!large)
+      large = new llvm::DenseSet<Pair>();
+    large->insert(p);
+  }
+};
+
+#ifdef DEBUG
+uint64_t Expr::hashMatches = 0, Expr::hashCollisions = 0;
+#endif
+
 int Expr::compare(const Expr &b) const {
-  static ExprEquivSet equivs;
+  // The common case once expressions are unique.
+  if (this == &b)
+    return 0;
+
+  ExprEquivSet equivs;
   int r = compare(b, equivs);
-  equivs.clear();
+#ifdef DEBUG
+  if (hashValue == b.hashValue) {
+    ++hashMatches;
+    if (r)
+      ++hashCollisions;
+  }
+#endif
   return r;
 }
 
@@ -104,9 +306,6 @@ int Expr::compare(const Expr &b, ExprEquivSet &equivs) const {
     ap = &b; bp = this;
   }
 
-  if (equivs.count(std::make_pair(ap, bp)))
-    return 0;
-
   Kind ak = getKind(), bk = b.getKind();
   if (ak!=bk)
     return (ak < bk) ? -1 : 1;
@@ -114,6 +313,9 @@ int Expr::compare(const Expr &b, ExprEquivSet &equivs) const {
   if (hashValue != b.hashValue) 
     return (hashValue < b.hashValue) ? -1 : 1;
 
+  if (equivs.count(std::make_pair(ap, bp)))
+    return 0;
+
   if (int res = compareContents(b)) 
     return res;
 
@@ -174,6 +376,7 @@ void Expr::printKind(llvm::raw_ostream &os, Kind k) {
     X(FRem);
     X(FMin);
     X(FMax);
+    X(FFma);
     X(Eq);
     X(Ne);
     X(Ult);
@@ -210,59 +413,100 @@ void Expr::printKind(llvm::raw_ostream &os, Kind k) {
 //
 ///////
 
+uint64_t Expr::hashCombine(uint64_t seed, uint64_t value) {
+  // The 64-bit finalizer of MurmurHash3 over both, so that every bit of
+  // either affects every bit of the result.
+  uint64_t h = seed ^ (value + 0x9e3779b97f4a7c15ULL + (seed << 6) +
+                       (seed >> 2));
+  h ^= h >> 33;
+  h *= 0xff51afd7ed558ccdULL;
+  h ^= h >> 33;
+  h *= 0xc4ceb9fe1a85ec53ULL;
+  h ^= h >> 33;
+  return h;
+}
+
 unsigned Expr::computeHash() {
-  unsigned res = getKind() * Expr::MAGIC_HASH_CONSTANT;
+  uint64_t res = hashCombine(getKind(), getWidth());
 
   int n = getNumKids();
-  for (int i = 0; i < n; i++) {
-    res <<= 1;
-    res ^= getKid(i)->hash() * Expr::MAGIC_HASH_CONSTANT;
-  }
-  
-  hashValue = res;
+  for (int i = 0; i < n; i++)
+    res = hashCombine(res, getKid(i)->hash());
+
+  hashValue = foldHash(res);
   return hashValue;
 }
 
 unsigned ConstantExpr::computeHash() {
 #if LLVM_VERSION_CODE >= LLVM_VERSION(3, 1)
-  hashValue = hash_value(value) ^ (getWidth() * MAGIC_HASH_CONSTANT);
+  uint64_t res = hash_value(value);
 #else
-  hashValue = value.getHashValue() ^ (getWidth() * MAGIC_HASH_CONSTANT);
+  uint64_t res = value.getHashValue();
 #endif
+  hashValue = foldHash(hashCombine(res, getWidth()));
   return hashValue;
 }
 
 unsigned FConstantExpr::computeHash() {
+  uint64_t res;
+  if (!wideValue)
+    res = bits;
+  else
 #if LLVM_VERSION_CODE >= LLVM_VERSION(3, 1)
-  hashValue = hash_value(value) ^ (getWidth() * MAGIC_HASH_CONSTANT);
+    res = hash_value(*wideValue);
 #else
-  hashValue = value.getHashValue() ^ (getWidth() * MAGIC_HASH_CONSTANT);
+    res = wideValue->getHashValue();
 #endif
+  hashValue = foldHash(hashCombine(hashCombine(FConstant, getWidth()), res));
   return hashValue;
 }
 
 unsigned CastExpr::computeHash() {
-  unsigned res = getWidth() * Expr::MAGIC_HASH_CONSTANT;
-  hashValue = res ^ src->hash() * Expr::MAGIC_HASH_CONSTANT;
+  uint64_t res = hashCombine(getKind(), getWidth());
+  hashValue = foldHash(hashCombine(res, src->hash()));
+  return hashValue;
+}
+
+unsigned CastRoundExpr::computeHash() {
+  hashValue = foldHash(hashCombine(CastExpr::computeHash(), (uint64_t) round));
+  return hashValue;
+}
+
+unsigned FCastRoundExpr::computeHash() {
+  hashValue = foldHash(hashCombine(Expr::computeHash(), (uint64_t) round));
+  return hashValue;
+}
+
+unsigned FUnaryRoundExpr::computeHash() {
+  hashValue = foldHash(hashCombine(Expr::computeHash(), (uint64_t) round));
+  return hashValue;
+}
+
+unsigned FBinaryRoundExpr::computeHash() {
+  hashValue = foldHash(hashCombine(Expr::computeHash(), (uint64_t) round));
+  return hashValue;
+}
+
+unsigned FFmaExpr::computeHash() {
+  hashValue = foldHash(hashCombine(Expr::computeHash(), (uint64_t) round));
   return hashValue;
 }
 
 unsigned ExtractExpr::computeHash() {
-  unsigned res = offset * Expr::MAGIC_HASH_CONSTANT;
-  res ^= getWidth() * Expr::MAGIC_HASH_CONSTANT;
-  hashValue = res ^ expr->hash() * Expr::MAGIC_HASH_CONSTANT;
+  uint64_t res = hashCombine(hashCombine(Extract, getWidth()), offset);
+  hashValue = foldHash(hashCombine(res, expr->hash()));
   return hashValue;
 }
 
 unsigned ReadExpr::computeHash() {
-  unsigned res = index->hash() * Expr::MAGIC_HASH_CONSTANT;
-  res ^= updates.hash();
-  hashValue = res;
+  uint64_t res = hashCombine(hashCombine(Read, index->hash()), updates.hash());
+  hashValue = foldHash(res);
   return hashValue;
 }
 
 unsigned NotExpr::computeHash() {
-  hashValue = expr->hash() * Expr::MAGIC_HASH_CONSTANT * Expr::Not;
+  hashValue = foldHash(hashCombine(hashCombine(Not, getWidth()),
+                                   expr->hash()));
   return hashValue;
 }
 
@@ -298,6 +542,13 @@ ref<Expr> Expr::createFromKind(Kind k, std::vector<CreateArg> args) {
                                  args[1].expr,
                                  args[2].expr);
 
+    case FFma:
+      assert(numArgs == 4 && args[0].isExpr() && args[1].isExpr() &&
+             args[2].isExpr() && args[3].isRoundingMode() &&
+             "invalid args array for FFma opcode");
+      return FFmaExpr::create(args[0].expr, args[1].expr, args[2].expr,
+                              args[3].rm);
+
     case Concat: {
       assert(numArgs == 2 && args[0].isExpr() && args[1].isExpr() && 
              "invalid args array for Concat opcode");
@@ -490,7 +741,7 @@ void ConstantExpr::toMemory(void *address) {
 }
 
 void FConstantExpr::toMemory(void *address) {
-  llvm::APInt bits = value.bitcastToAPInt();
+  llvm::APInt bits = getAPValue().bitcastToAPInt();
   switch (getWidth()) {
   default: assert(0 && "invalid type");
   case Expr::Fl32: *((float*) address) = bits.getZExtValue(); break;
@@ -506,7 +757,7 @@ void ConstantExpr::toString(std::string &Res, unsigned radix) const {
 
 void FConstantExpr::toString(std::string &Res) const {
   llvm::SmallString<100> F;
-  value.toString(F, 0, 0);
+  getAPValue().toString(F, 0, 0);
   Res = F.str();
 }
 
@@ -545,6 +796,78 @@ static inline const llvm::fltSemantics * fpWidthToSemantics(unsigned width) {
   }
 }
 
+FConstantExpr::FConstantExpr(const llvm::APFloat &v) : bits(0), wideValue(0) {
+  // getSizeInBits doesn't exist in our LLVM
+  switch (llvm::APFloat::semanticsPrecision(v.getSemantics()))
+  {
+  case 24:
+    width = Fl32;
+    break;
+  case 53:
+    width = Fl64;
+    break;
+  case 64:
+    width = Fl80;
+    break;
+  default:
+    width = 0;
+  }
+
+  if (width == Fl32 || width == Fl64)
+    bits = v.bitcastToAPInt().getZExtValue();
+  else
+    wideValue = new llvm::APFloat(v);
+}
+
+llvm::APFloat FConstantExpr::getAPValue() const {
+  if (wideValue)
+    return *wideValue;
+  return llvm::APFloat(*fpWidthToSemantics(width), llvm::APInt(width, bits));
+}
+
+FConstantExpr *FConstantExpr::getCommonConstant(Width w, uint64_t bits) {
+  static const uint64_t commonFl32[] = {
+    0x00000000, 0x80000000, 0x3F800000, 0xBF800000,
+    0x7F800000, 0xFF800000, 0x7FC00000 };
+  static const uint64_t commonFl64[] = {
+    0x0000000000000000ULL, 0x8000000000000000ULL, 0x3FF0000000000000ULL,
+    0xBFF0000000000000ULL, 0x7FF0000000000000ULL, 0xFFF0000000000000ULL,
+    0x7FF8000000000000ULL };
+  static const unsigned numCommon = sizeof(commonFl32) / sizeof(commonFl32[0]);
+  // Never freed, so that the shared nodes outlive any expressions held in
+  // other static storage.
+  static FConstantExpr **shared = new FConstantExpr*[2 * numCommon]();
+
+  const uint64_t *common = w == Fl32 ? commonFl32 : commonFl64;
+  for (unsigned i = 0; i != numCommon; ++i) {
+    if (common[i] != bits)
+      continue;
+    FConstantExpr *&slot = shared[(w == Fl32 ? 0 : numCommon) + i];
+    if (!slot) {
+      slot = new FConstantExpr(
+          llvm::APFloat(*fpWidthToSemantics(w), llvm::APInt(w, bits)));
+      slot->computeHash();
+      incRefCount(slot->refCount);
+    }
+    return slot;
+  }
+  return 0;
+}
+
+ref<FConstantExpr> FConstantExpr::alloc(const llvm::APFloat &v) {
+  unsigned precision = llvm::APFloat::semanticsPrecision(v.getSemantics());
+  if (precision == 24 || precision == 53) {
+    Width w = precision == 24 ? Fl32 : Fl64;
+    if (FConstantExpr *common =
+            getCommonConstant(w, v.bitcastToAPInt().getZExtValue()))
+      return common;
+  }
+
+  ref<FConstantExpr> r(new FConstantExpr(v));
+  r->computeHash();
+  return r;
+}
+
 ref<ConstantExpr> FConstantExpr::FToU(Width W, llvm::APFloat::roundingMode rm) {
   if (!fpWidthToSemantics(getWidth()) || W > 64)
     klee_error("Unsupported FToU operation");
@@ -556,7 +879,7 @@ ref<ConstantExpr> FConstantExpr::FToU(Width W, llvm::APFloat::roundingMode rm) {
 
   uint64_t new_value = 0;
   bool isExact = true;
-  value.convertToInteger(&new_value, W, false, llvm::APFloat::rmTowardZero, &isExact);
+  getAPValue().convertToInteger(&new_value, W, false, llvm::APFloat::rmTowardZero, &isExact);
   return ConstantExpr::alloc(new_value, W);
 }
 
@@ -579,11 +902,12 @@ ref<ConstantExpr> FConstantExpr::FToS(Width W, llvm::APFloat::roundingMode rm) {
 
   uint64_t new_value = 0;
   bool isExact = true;
-  value.convertToInteger(&new_value, W, true, llvm::APFloat::rmTowardZero, &isExact);
+  getAPValue().convertToInteger(&new_value, W, true, llvm::APFloat::rmTowardZero, &isExact);
   return ConstantExpr::alloc(new_value, W);
 }
 
 ref<ConstantExpr> FConstantExpr::FpClassify() {
+  APFloat value = getAPValue();
   int res;
   if (value.isNaN())
     res = FP_NAN;
@@ -600,18 +924,20 @@ ref<ConstantExpr> FConstantExpr::FpClassify() {
 }
 
 ref<ConstantExpr> FConstantExpr::FIsFinite() {
+  APFloat value = getAPValue();
   int res = (!value.isNaN() && !value.isInfinity());
 
   return ConstantExpr::alloc(res, sizeof(int) * 8);
 }
 
 ref<ConstantExpr> FConstantExpr::FIsNan() {
-  int res = value.isNaN();
+  int res = getAPValue().isNaN();
 
   return ConstantExpr::alloc(res, sizeof(int) * 8);
 }
 
 ref<ConstantExpr> FConstantExpr::FIsInf() {
+  APFloat value = getAPValue();
   if (getWidth() == Fl80 && !correctHiddenBit)
   {
     return ConstantExpr::alloc(0, sizeof(int) * 8);
@@ -742,7 +1068,7 @@ ref<ConstantExpr> FConstantExpr::FOrd(const ref<FConstantExpr> &RHS) {
     return ConstantExpr::alloc(false, Expr::Bool);
   }
 
-  APFloat::cmpResult CmpRes = value.compare(RHS->getAPValue());
+  APFloat::cmpResult CmpRes = getAPValue().compare(RHS->getAPValue());
 
   bool Result = CmpRes != APFloat::cmpUnordered;
   return ConstantExpr::alloc(Result, Expr::Bool);
@@ -757,7 +1083,7 @@ ref<ConstantExpr> FConstantExpr::FUno(const ref<FConstantExpr> &RHS) {
     return ConstantExpr::alloc(true, Expr::Bool);
   }
 
-  APFloat::cmpResult CmpRes = value.compare(RHS->getAPValue());
+  APFloat::cmpResult CmpRes = getAPValue().compare(RHS->getAPValue());
 
   bool Result = CmpRes == APFloat::cmpUnordered;
   return ConstantExpr::alloc(Result, Expr::Bool);
@@ -772,7 +1098,7 @@ ref<ConstantExpr> FConstantExpr::FUeq(const ref<FConstantExpr> &RHS) {
     return ConstantExpr::alloc(false, Expr::Bool);
   }
 
-  APFloat::cmpResult CmpRes = value.compare(RHS->getAPValue());
+  APFloat::cmpResult CmpRes = getAPValue().compare(RHS->getAPValue());
 
   bool Result = CmpRes == APFloat::cmpUnordered || CmpRes == APFloat::cmpEqual;
   return ConstantExpr::alloc(Result, Expr::Bool);
@@ -787,7 +1113,7 @@ ref<ConstantExpr> FConstantExpr::FOeq(const ref<FConstantExpr> &RHS) {
     return ConstantExpr::alloc(false, Expr::Bool);
   }
 
-  APFloat::cmpResult CmpRes = value.compare(RHS->getAPValue());
+  APFloat::cmpResult CmpRes = getAPValue().compare(RHS->getAPValue());
 
   bool Result = CmpRes == APFloat::cmpEqual;
   return ConstantExpr::alloc(Result, Expr::Bool);
@@ -802,7 +1128,7 @@ ref<ConstantExpr> FConstantExpr::FUgt(const ref<FConstantExpr> &RHS) {
     return ConstantExpr::alloc(false, Expr::Bool);
   }
 
-  APFloat::cmpResult CmpRes = value.compare(RHS->getAPValue());
+  APFloat::cmpResult CmpRes = getAPValue().compare(RHS->getAPValue());
 
   bool Result = CmpRes == APFloat::cmpUnordered || CmpRes == APFloat::cmpGreaterThan;
   return ConstantExpr::alloc(Result, Expr::Bool);
@@ -817,7 +1143,7 @@ ref<ConstantExpr> FConstantExpr::FOgt(const ref<FConstantExpr> &RHS) {
     return ConstantExpr::alloc(false, Expr::Bool);
   }
 
-  APFloat::cmpResult CmpRes = value.compare(RHS->getAPValue());
+  APFloat::cmpResult CmpRes = getAPValue().compare(RHS->getAPValue());
 
   bool Result = CmpRes == APFloat::cmpGreaterThan;
   return ConstantExpr::alloc(Result, Expr::Bool);
@@ -832,7 +1158,7 @@ ref<ConstantExpr> FConstantExpr::FUge(const ref<FConstantExpr> &RHS) {
     return ConstantExpr::alloc(false, Expr::Bool);
   }
 
-  APFloat::cmpResult CmpRes = value.compare(RHS->getAPValue());
+  APFloat::cmpResult CmpRes = getAPValue().compare(RHS->getAPValue());
 
   bool Result = CmpRes == APFloat::cmpUnordered || CmpRes == APFloat::cmpGreaterThan || CmpRes == APFloat::cmpEqual;
   return ConstantExpr::alloc(Result, Expr::Bool);
@@ -847,7 +1173,7 @@ ref<ConstantExpr> FConstantExpr::FOge(const ref<FConstantExpr> &RHS) {
     return ConstantExpr::alloc(false, Expr::Bool);
   }
 
-  APFloat::cmpResult CmpRes = value.compare(RHS->getAPValue());
+  APFloat::cmpResult CmpRes = getAPValue().compare(RHS->getAPValue());
 
   bool Result = CmpRes == APFloat::cmpGreaterThan || CmpRes == APFloat::cmpEqual;
   return ConstantExpr::alloc(Result, Expr::Bool);
@@ -862,7 +1188,7 @@ ref<ConstantExpr> FConstantExpr::FUlt(const ref<FConstantExpr> &RHS) {
     return ConstantExpr::alloc(false, Expr::Bool);
   }
 
-  APFloat::cmpResult CmpRes = value.compare(RHS->getAPValue());
+  APFloat::cmpResult CmpRes = getAPValue().compare(RHS->getAPValue());
 
   bool Result = CmpRes == APFloat::cmpUnordered || CmpRes == APFloat::cmpLessThan;
   return ConstantExpr::alloc(Result, Expr::Bool);
@@ -877,7 +1203,7 @@ ref<ConstantExpr> FConstantExpr::FOlt(const ref<FConstantExpr> &RHS) {
     return ConstantExpr::alloc(false, Expr::Bool);
   }
 
-  APFloat::cmpResult CmpRes = value.compare(RHS->getAPValue());
+  APFloat::cmpResult CmpRes = getAPValue().compare(RHS->getAPValue());
 
   bool Result = CmpRes == APFloat::cmpLessThan;
   return ConstantExpr::alloc(Result, Expr::Bool);
@@ -892,9 +1218,9 @@ ref<ConstantExpr> FConstantExpr::FUle(const ref<FConstantExpr> &RHS) {
     return ConstantExpr::alloc(false, Expr::Bool);
   }
 
-  APFloat::cmpResult CmpRes = value.compare(RHS->getAPValue());
+  APFloat::cmpResult CmpRes = getAPValue().compare(RHS->getAPValue());
 
-  bool Result = CmpRes == APFloat::cmpUnordered || APFloat::cmpLessThan || CmpRes == APFloat::cmpEqual;
+  bool Result = CmpRes == APFloat::cmpUnordered || CmpRes == APFloat::cmpLessThan || CmpRes == APFloat::cmpEqual;
   return ConstantExpr::alloc(Result, Expr::Bool);
 }
 
@@ -907,7 +1233,7 @@ ref<ConstantExpr> FConstantExpr::FOle(const ref<FConstantExpr> &RHS) {
     return ConstantExpr::alloc(false, Expr::Bool);
   }
 
-  APFloat::cmpResult CmpRes = value.compare(RHS->getAPValue());
+  APFloat::cmpResult CmpRes = getAPValue().compare(RHS->getAPValue());
 
   bool Result = CmpRes == APFloat::cmpLessThan || CmpRes == APFloat::cmpEqual;
   return ConstantExpr::alloc(Result, Expr::Bool);
@@ -922,7 +1248,7 @@ ref<ConstantExpr> FConstantExpr::FUne(const ref<FConstantExpr> &RHS) {
     return ConstantExpr::alloc(true, Expr::Bool);
   }
 
-  APFloat::cmpResult CmpRes = value.compare(RHS->getAPValue());
+  APFloat::cmpResult CmpRes = getAPValue().compare(RHS->getAPValue());
 
   bool Result = CmpRes == APFloat::cmpUnordered || CmpRes != APFloat::cmpEqual;
   return ConstantExpr::alloc(Result, Expr::Bool);
@@ -937,14 +1263,16 @@ ref<ConstantExpr> FConstantExpr::FOne(const ref<FConstantExpr> &RHS) {
     return ConstantExpr::alloc(true, Expr::Bool);
   }
 
-  APFloat::cmpResult CmpRes = value.compare(RHS->getAPValue());
+  APFloat::cmpResult CmpRes = getAPValue().compare(RHS->getAPValue());
 
   bool Result = CmpRes != APFloat::cmpUnordered && CmpRes != APFloat::cmpEqual;
   return ConstantExpr::alloc(Result, Expr::Bool);
 }
 
 ref<ConstantExpr> FConstantExpr::ExplicitInt(Width W) {
-  return ConstantExpr::alloc(value.bitcastToAPInt().zextOrTrunc(W)); // TODO: Figure out what really happens when e.g. 32 bit float is extended to 64 bit signed long long
+  if (!wideValue)
+    return ConstantExpr::alloc(llvm::APInt(width, bits).zextOrTrunc(W));
+  return ConstantExpr::alloc(getAPValue().bitcastToAPInt().zextOrTrunc(W)); // TODO: Figure out what really happens when e.g. 32 bit float is extended to 64 bit signed long long
 }
 
 ref<FConstantExpr> ConstantExpr::ExplicitFloat(Width W) {
@@ -978,7 +1306,7 @@ ref<FConstantExpr> FConstantExpr::FExt(Width W, llvm::APFloat::roundingMode rm)
   }
 
   bool losesInfo = false;
-  APFloat Res = value;
+  APFloat Res = getAPValue();
   Res.convert(*fpWidthToSemantics(W), rm, &losesInfo);
   return FConstantExpr::alloc(Res);
 }
@@ -1006,7 +1334,7 @@ ref<FConstantExpr> ConstantExpr::SToF(Width W, llvm::APFloat::roundingMode rm) {
 }
 
 ref<FConstantExpr> FConstantExpr::FAbs() {
-  APFloat Res = value;
+  APFloat Res = getAPValue();
   Res.clearSign();
   ref<FConstantExpr> ret = FConstantExpr::alloc(Res);
   ret->correctHiddenBit = correctHiddenBit;
@@ -1014,32 +1342,34 @@ ref<FConstantExpr> FConstantExpr::FAbs() {
   return ret;
 }
 
-ref<FConstantExpr> FConstantExpr::FSqrt(llvm::APFloat::roundingMode rm) {
-  if (getWidth() == Fl80 && !correctHiddenBit)
-  { 
-    return FConstantExpr::alloc(APFloat::getNaN(*fpWidthToSemantics(Fl80)));
-  }
-
-  // XXX hack, change this when LLVM implements native APFloat sqrt
-  int rounding_mode;
+/// getHostRoundingMode - The FE_* rounding mode of the host for \a rm.
+static int getHostRoundingMode(llvm::APFloat::roundingMode rm) {
   switch (rm)
   {
   case llvm::APFloat::rmNearestTiesToEven:
-    rounding_mode = FE_TONEAREST;
-    break;
+    return FE_TONEAREST;
   case llvm::APFloat::rmTowardNegative:
-    rounding_mode = FE_DOWNWARD;
-    break;
+    return FE_DOWNWARD;
   case llvm::APFloat::rmTowardPositive:
-    rounding_mode = FE_UPWARD;
-    break;
+    return FE_UPWARD;
   case llvm::APFloat::rmTowardZero:
-    rounding_mode = FE_TOWARDZERO;
-    break;
+    return FE_TOWARDZERO;
   default:
     assert(0 && "invalid mode");
+    return FE_TONEAREST;
+  }
+}
+
+ref<FConstantExpr> FConstantExpr::FSqrt(llvm::APFloat::roundingMode rm) {
+  APFloat value = getAPValue();
+  if (getWidth() == Fl80 && !correctHiddenBit)
+  { 
+    return FConstantExpr::alloc(APFloat::getNaN(*fpWidthToSemantics(Fl80)));
   }
 
+  // XXX hack, change this when LLVM implements native APFloat sqrt
+  int rounding_mode = getHostRoundingMode(rm);
+
   switch (getWidth()) {
   case Fl32: {
     float f = value.convertToFloat();
@@ -1091,7 +1421,7 @@ ref<FConstantExpr> FConstantExpr::FNearbyInt(llvm::APFloat::roundingMode rm) {
     return FConstantExpr::alloc(APFloat::getNaN(*fpWidthToSemantics(Fl80)));
   }
 
-  APFloat Res = value;
+  APFloat Res = getAPValue();
   Res.roundToIntegral(rm);
   return FConstantExpr::alloc(Res);
 }
@@ -1105,7 +1435,7 @@ ref<FConstantExpr> FConstantExpr::FAdd(const ref<FConstantExpr> &RHS, llvm::APFl
     return FConstantExpr::alloc(APFloat::getNaN(*fpWidthToSemantics(Fl80)));
   }
 
-  llvm::APFloat Res = value;
+  llvm::APFloat Res = getAPValue();
   Res.add(RHS->getAPValue(), RM);
   return FConstantExpr::alloc(Res);
 }
@@ -1119,7 +1449,7 @@ ref<FConstantExpr> FConstantExpr::FSub(const ref<FConstantExpr> &RHS, llvm::APFl
     return FConstantExpr::alloc(APFloat::getNaN(*fpWidthToSemantics(Fl80)));
   }
 
-  llvm::APFloat Res = value;
+  llvm::APFloat Res = getAPValue();
   Res.subtract(RHS->getAPValue(), RM);
   return FConstantExpr::alloc(Res);
 }
@@ -1133,7 +1463,7 @@ ref<FConstantExpr> FConstantExpr::FMul(const ref<FConstantExpr> &RHS, llvm::APFl
     return FConstantExpr::alloc(APFloat::getNaN(*fpWidthToSemantics(Fl80)));
   }
 
-  llvm::APFloat Res = value;
+  llvm::APFloat Res = getAPValue();
   Res.multiply(RHS->getAPValue(), RM);
   return FConstantExpr::alloc(Res);
 }
@@ -1147,7 +1477,7 @@ ref<FConstantExpr> FConstantExpr::FDiv(const ref<FConstantExpr> &RHS, llvm::APFl
     return FConstantExpr::alloc(APFloat::getNaN(*fpWidthToSemantics(Fl80)));
   }
 
-  llvm::APFloat Res = value;
+  llvm::APFloat Res = getAPValue();
   Res.divide(RHS->getAPValue(), RM);
   return FConstantExpr::alloc(Res);
 }
@@ -1161,12 +1491,13 @@ ref<FConstantExpr> FConstantExpr::FRem(const ref<FConstantExpr> &RHS, llvm::APFl
     return FConstantExpr::alloc(APFloat::getNaN(*fpWidthToSemantics(Fl80)));
   }
 
-  llvm::APFloat Res = value;
+  llvm::APFloat Res = getAPValue();
   Res.mod(RHS->getAPValue(), RM);
   return FConstantExpr::alloc(Res);
 }
 
 ref<FConstantExpr> FConstantExpr::FMin(const ref<FConstantExpr> &RHS) {
+  APFloat value = getAPValue();
   if (!getWidth() || !RHS->getWidth())
     klee_error("Unsupported FMin operation");
 
@@ -1201,6 +1532,7 @@ ref<FConstantExpr> FConstantExpr::FMin(const ref<FConstantExpr> &RHS) {
 }
 
 ref<FConstantExpr> FConstantExpr::FMax(const ref<FConstantExpr> &RHS) {
+  APFloat value = getAPValue();
   if (!getWidth() || !RHS->getWidth())
     klee_error("Unsupported FMax operation");
 
@@ -1234,8 +1566,58 @@ ref<FConstantExpr> FConstantExpr::FMax(const ref<FConstantExpr> &RHS) {
   }
 }
 
+ref<FConstantExpr> FConstantExpr::FFma(const ref<FConstantExpr> &RHS,
+                                       const ref<FConstantExpr> &Addend,
+                                       llvm::APFloat::roundingMode RM) {
+  if (!getWidth() || !RHS->getWidth() || !Addend->getWidth())
+    klee_error("Unsupported FFma operation");
+
+  if (getWidth() == Fl80 &&
+      !(correctHiddenBit && RHS->correctHiddenBit && Addend->correctHiddenBit))
+  {
+    return FConstantExpr::alloc(APFloat::getNaN(*fpWidthToSemantics(Fl80)));
+  }
+
+  // The host's fma() rounds once, exactly as APFloat does, and is much
+  // faster. Its NaNs differ from APFloat's in sign and payload, so those are
+  // left to APFloat.
+  fenv_t env;
+  switch (getWidth()) {
+  case Fl32: {
+    fegetenv(&env);
+    fesetround(getHostRoundingMode(RM));
+    float f = fmaf(getAPValue().convertToFloat(),
+                   RHS->getAPValue().convertToFloat(),
+                   Addend->getAPValue().convertToFloat());
+    fesetenv(&env);
+    if (!std::isnan(f))
+      return FConstantExpr::alloc(llvm::APFloat(f));
+    break;
+  }
+  case Fl64: {
+    fegetenv(&env);
+    fesetround(getHostRoundingMode(RM));
+    double d = fma(getAPValue().convertToDouble(),
+                   RHS->getAPValue().convertToDouble(),
+                   Addend->getAPValue().convertToDouble());
+    fesetenv(&env);
+    if (!std::isnan(d))
+      return FConstantExpr::alloc(llvm::APFloat(d));
+    break;
+  }
+  default:
+    break;
+  }
+
+  llvm::APFloat Res = getAPValue();
+  Res.fusedMultiplyAdd(RHS->getAPValue(), Addend->getAPValue(), RM);
+  return FConstantExpr::alloc(Res);
+}
+
 bool FConstantExpr::isZero() const {
-  return value.isZero();
+  if (!wideValue)
+    return (bits & ~(UINT64_C(1) << (width - 1))) == 0;
+  return getAPValue().isZero();
 }
 
 /***/
@@ -1251,7 +1633,8 @@ Array::Array(const std::string &_name, uint64_t _size,
              const ref<ConstantExpr> *constantValuesEnd, Expr::Width _domain,
              Expr::Width _range)
     : name(_name), size(_size), domain(_domain), range(_range),
-      constantValues(constantValuesBegin, constantValuesEnd) {
+      constantValues(constantValuesBegin, constantValuesEnd), refCount(0),
+      retained(false) {
 
   assert((isSymbolicArray() || constantValues.size() == size) &&
          "Invalid size for constant array!");
@@ -1383,6 +1766,17 @@ ref<Expr> FSelectExpr::create(ref<Expr> c, ref<Expr> t, ref<Expr> f) {
   return FSelectExpr::alloc(c, t, f);
 }
 
+ref<Expr> FFmaExpr::create(const ref<Expr> &l, const ref<Expr> &r,
+                           const ref<Expr> &a, llvm::APFloat::roundingMode rm) {
+  assert(l->getWidth() == r->getWidth() && l->getWidth() == a->getWidth() &&
+         "type mismatch");
+  if (FConstantExpr *cl = dyn_cast<FConstantExpr>(l))
+    if (FConstantExpr *cr = dyn_cast<FConstantExpr>(r))
+      if (FConstantExpr *ca = dyn_cast<FConstantExpr>(a))
+        return cl->FFma(cr, ca, rm);
+  return FFmaExpr::alloc(l, r, a, rm);
+}
+
 /***/
 
 ref<Expr> ConcatExpr::create(const ref<Expr> &l, const ref<Expr> &r) {
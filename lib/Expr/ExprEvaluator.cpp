@@ -9,24 +9,291 @@
 
 #include "klee/util/ExprEvaluator.h"
 
+#include "klee/Internal/Support/IntEvaluation.h"
+
+#include "llvm/Support/CommandLine.h"
+
+#include <cfloat>
+#include <cmath>
+#include <cstring>
+#include <fenv.h>
+
 using namespace klee;
 
+namespace {
+  llvm::cl::opt<bool>
+  NativeFloatEvaluation("native-float-eval",
+                        llvm::cl::desc("Evaluate concrete single and double "
+                                       "precision expressions with host "
+                                       "arithmetic (default=on)"),
+                        llvm::cl::init(true));
+}
+
+// Native evaluation relies on float and double arithmetic being done without
+// excess precision, as with SSE but not with x87.
+#if defined(FLT_EVAL_METHOD) && FLT_EVAL_METHOD == 0
+static const bool HostFloatIsExact = true;
+#else
+static const bool HostFloatIsExact = false;
+#endif
+
+static inline void fromBits(uint64_t bits, float &f) {
+  uint32_t tmp = bits;
+  memcpy(&f, &tmp, sizeof f);
+}
+
+static inline void fromBits(uint64_t bits, double &d) {
+  memcpy(&d, &bits, sizeof d);
+}
+
+static inline uint64_t toBits(float f) {
+  uint32_t tmp;
+  memcpy(&tmp, &f, sizeof tmp);
+  return tmp;
+}
+
+static inline uint64_t toBits(double d) {
+  uint64_t tmp;
+  memcpy(&tmp, &d, sizeof tmp);
+  return tmp;
+}
+
+static inline float hostSqrt(float f) { return sqrtf(f); }
+static inline double hostSqrt(double d) { return sqrt(d); }
+static inline float hostNearbyInt(float f) { return nearbyintf(f); }
+static inline double hostNearbyInt(double d) { return nearbyint(d); }
+static inline float hostFma(float a, float b, float c) { return fmaf(a, b, c); }
+static inline double hostFma(double a, double b, double c) {
+  return fma(a, b, c);
+}
+
+/// getHostRoundingMode - Return the fenv rounding mode for an APFloat one,
+/// or false if the host has no equivalent (round to nearest, ties away).
+static bool getHostRoundingMode(llvm::APFloat::roundingMode rm, int &mode) {
+  switch (rm) {
+  case llvm::APFloat::rmNearestTiesToEven:
+    mode = FE_TONEAREST;
+    return true;
+  case llvm::APFloat::rmTowardNegative:
+    mode = FE_DOWNWARD;
+    return true;
+  case llvm::APFloat::rmTowardPositive:
+    mode = FE_UPWARD;
+    return true;
+  case llvm::APFloat::rmTowardZero:
+    mode = FE_TOWARDZERO;
+    return true;
+  default:
+    return false;
+  }
+}
+
+namespace {
+  /// HostRounding - Select a host rounding mode for the lifetime of the
+  /// object. Operations done under it must go through volatile values so
+  /// they are not moved across the mode changes.
+  class HostRounding {
+    int saved;
+
+  public:
+    HostRounding(int mode) : saved(fegetround()) {
+      if (mode != saved)
+        fesetround(mode);
+    }
+    ~HostRounding() {
+      if (fegetround() != saved)
+        fesetround(saved);
+    }
+  };
+}
+
+/// evalHostFloat - Evaluate a unary or binary floating-point operation on
+/// host values of type T.
+template<typename T>
+static bool evalHostFloat(const Expr &e, uint64_t left, uint64_t right,
+                          uint64_t &bits) {
+  volatile T a, b, res;
+  T tmp;
+  fromBits(left, tmp);
+  a = tmp;
+  fromBits(right, tmp);
+  b = tmp;
+
+  llvm::APFloat::roundingMode rm = llvm::APFloat::rmNearestTiesToEven;
+  if (const FUnaryRoundExpr *ue = dyn_cast<FUnaryRoundExpr>(&e))
+    rm = ue->getRoundingMode();
+  else if (const FBinaryRoundExpr *be = dyn_cast<FBinaryRoundExpr>(&e))
+    rm = be->getRoundingMode();
+
+  int mode;
+  if (!getHostRoundingMode(rm, mode))
+    return false;
+
+  {
+    HostRounding hr(mode);
+    switch (e.getKind()) {
+    case Expr::FAbs: res = fabs(a); break;
+    case Expr::FSqrt: res = hostSqrt(a); break;
+    case Expr::FNearbyInt: res = hostNearbyInt(a); break;
+    case Expr::FAdd: res = a + b; break;
+    case Expr::FSub: res = a - b; break;
+    case Expr::FMul: res = a * b; break;
+    case Expr::FDiv: res = a / b; break;
+    default:
+      return false;
+    }
+  }
+
+  tmp = res;
+  if (tmp != tmp)
+    return false;
+  bits = toBits(tmp);
+  return true;
+}
+
+/// evalHostFma - Evaluate a fused multiply-add on host values of type T.
+template<typename T>
+static bool evalHostFma(const FFmaExpr &e, uint64_t left, uint64_t right,
+                        uint64_t addend, uint64_t &bits) {
+  int mode;
+  if (!getHostRoundingMode(e.getRoundingMode(), mode))
+    return false;
+
+  volatile T a, b, c, res;
+  T tmp;
+  fromBits(left, tmp);
+  a = tmp;
+  fromBits(right, tmp);
+  b = tmp;
+  fromBits(addend, tmp);
+  c = tmp;
+  {
+    HostRounding hr(mode);
+    res = hostFma(a, b, c);
+  }
+  tmp = res;
+  if (tmp != tmp)
+    return false;
+  bits = toBits(tmp);
+  return true;
+}
+
+/// hostIntToFloat - Convert an integer to a host value of type T under the
+/// current rounding mode.
+template<typename T>
+static uint64_t hostIntToFloat(uint64_t value, unsigned width, bool isSigned) {
+  volatile T res;
+  if (isSigned) {
+    volatile int64_t v = ints::sext(value, 64, width);
+    res = v;
+  } else {
+    volatile uint64_t v = value;
+    res = v;
+  }
+  return toBits((T) res);
+}
+
+/// hostToDouble - Widen the bit pattern of a single or double precision value
+/// to a host double, which is exact.
+static double hostToDouble(uint64_t bits, Expr::Width width) {
+  if (width == Expr::Fl32) {
+    float f;
+    fromBits(bits, f);
+    return f;
+  }
+  double d;
+  fromBits(bits, d);
+  return d;
+}
+
+/// hostClassify - Evaluate a classification of a host value of type T, with
+/// the same results as the FConstantExpr operations.
+template<typename T>
+static int hostClassify(Expr::Kind k, uint64_t bits) {
+  T f;
+  fromBits(bits, f);
+  switch (k) {
+  case Expr::FpClassify: return std::fpclassify(f);
+  case Expr::FIsFinite: return std::isfinite(f) ? 1 : 0;
+  case Expr::FIsNan: return std::isnan(f) ? 1 : 0;
+  case Expr::FIsInf: return std::isinf(f) ? (std::signbit(f) ? -1 : 1) : 0;
+  default:
+    assert(0 && "invalid floating-point classification");
+    return 0;
+  }
+}
+
+static bool hostCompare(Expr::Kind k, double a, double b) {
+  switch (k) {
+  case Expr::FOrd: return !std::isnan(a) && !std::isnan(b);
+  case Expr::FUno: return std::isnan(a) || std::isnan(b);
+  case Expr::FUeq: return !(a < b || a > b);
+  case Expr::FOeq: return a == b;
+  case Expr::FUgt: return !(a <= b);
+  case Expr::FOgt: return a > b;
+  case Expr::FUge: return !(a < b);
+  case Expr::FOge: return a >= b;
+  case Expr::FUlt: return !(a >= b);
+  case Expr::FOlt: return a < b;
+  case Expr::FUle: return !(a > b);
+  case Expr::FOle: return a <= b;
+  case Expr::FUne: return !(a == b);
+  case Expr::FOne: return a < b || a > b;
+  default:
+    assert(0 && "invalid floating-point comparison");
+    return false;
+  }
+}
+
+/// Update lists at least this long are searched through their lookup index
+/// rather than node by node.
+static const unsigned IndexedUpdateListSize = 32;
+
 ExprVisitor::Action ExprEvaluator::evalRead(const UpdateList &ul,
                                             unsigned index) {
-  for (const UpdateNode *un=ul.head; un; un=un->next) {
-    ref<Expr> ui = visit(un->index);
-    
-    if (ConstantExpr *CE = dyn_cast<ConstantExpr>(ui)) {
-      if (CE->getZExtValue() == index)
-        return Action::changeTo(visit(un->value));
-    } else {
-      // update index is unknown, so may or may not be index, we
-      // cannot guarantee value. we can rewrite to read at this
-      // version though (mostly for debugging).
+  if (ul.head && ul.head->getSize() >= IndexedUpdateListSize) {
+    const UpdateNodeIndex &lookup = ul.head->getLookupIndex();
+    llvm::DenseMap<uint64_t, const UpdateNode *>::const_iterator it =
+      lookup.constantUpdates.find(index);
+    const UpdateNode *match =
+      it != lookup.constantUpdates.end() ? it->second : 0;
+
+    // Only the updates at other indices which are newer than the match may
+    // still be read instead. Newer nodes head longer sequences.
+    for (std::vector<const UpdateNode *>::const_iterator
+           oit = lookup.otherUpdates.begin(), oie = lookup.otherUpdates.end();
+         oit != oie; ++oit) {
+      const UpdateNode *un = *oit;
+      if (match && match->getSize() > un->getSize())
+        break;
+      ref<Expr> ui = visit(un->index);
+      if (ConstantExpr *CE = dyn_cast<ConstantExpr>(ui)) {
+        if (CE->getZExtValue() == index)
+          return Action::changeTo(visit(un->value));
+      } else {
+        return Action::changeTo(ReadExpr::create(UpdateList(ul.root, un), 
+                                                 ConstantExpr::alloc(index, 
+                                                                     ul.root->getDomain())));
+      }
+    }
+    if (match)
+      return Action::changeTo(visit(match->value));
+  } else {
+    for (const UpdateNode *un=ul.head; un; un=un->next) {
+      ref<Expr> ui = visit(un->index);
       
-      return Action::changeTo(ReadExpr::create(UpdateList(ul.root, un), 
-                                               ConstantExpr::alloc(index, 
-                                                                   ul.root->getDomain())));
+      if (ConstantExpr *CE = dyn_cast<ConstantExpr>(ui)) {
+        if (CE->getZExtValue() == index)
+          return Action::changeTo(visit(un->value));
+      } else {
+        // update index is unknown, so may or may not be index, we
+        // cannot guarantee value. we can rewrite to read at this
+        // version though (mostly for debugging).
+        
+        return Action::changeTo(ReadExpr::create(UpdateList(ul.root, un), 
+                                                 ConstantExpr::alloc(index, 
+                                                                     ul.root->getDomain())));
+      }
     }
   }
   
@@ -36,7 +303,226 @@ ExprVisitor::Action ExprEvaluator::evalRead(const UpdateList &ul,
   return Action::changeTo(getInitialValue(*ul.root, index));
 }
 
+bool ExprEvaluator::evalNativeFloat(const ref<Expr> &e, uint64_t &bits) {
+  Expr::Width width = e->getWidth();
+  if (!HostFloatIsExact || (width != Expr::Fl32 && width != Expr::Fl64))
+    return false;
+
+  if (const FConstantExpr *FE = dyn_cast<FConstantExpr>(e)) {
+    bits = FE->getAPValue().bitcastToAPInt().getZExtValue();
+    return true;
+  }
+
+  ExprHashMap<uint64_t>::iterator it = nativeFloats.find(e);
+  if (it != nativeFloats.end()) {
+    bits = it->second;
+    return true;
+  }
+
+  switch (e->getKind()) {
+  case Expr::ExplicitFloat: {
+    ref<Expr> src = visit(e->getKid(0));
+    ConstantExpr *CE = dyn_cast<ConstantExpr>(src);
+    if (!CE)
+      return false;
+    bits = CE->getZExtValue();
+    break;
+  }
+
+  case Expr::FSelect: {
+    const FSelectExpr *se = cast<FSelectExpr>(e);
+    ref<Expr> cond = visit(se->cond);
+    ConstantExpr *CE = dyn_cast<ConstantExpr>(cond);
+    if (!CE ||
+        !evalNativeFloat(CE->isTrue() ? se->trueExpr : se->falseExpr, bits))
+      return false;
+    break;
+  }
+
+  case Expr::FExt: {
+    const FExtExpr *fe = cast<FExtExpr>(e);
+    uint64_t src;
+    int mode;
+    if (!evalNativeFloat(fe->src, src) ||
+        !getHostRoundingMode(fe->getRoundingMode(), mode))
+      return false;
+
+    if (fe->src->getWidth() == width) {
+      bits = src;
+    } else if (width == Expr::Fl64) {
+      // Widening is exact.
+      double d = hostToDouble(src, Expr::Fl32);
+      if (d != d)
+        return false;
+      bits = toBits(d);
+    } else {
+      volatile double d;
+      volatile float f;
+      {
+        HostRounding hr(mode);
+        d = hostToDouble(src, Expr::Fl64);
+        f = d;
+      }
+      float tmp = f;
+      if (tmp != tmp)
+        return false;
+      bits = toBits(tmp);
+    }
+    break;
+  }
+
+  case Expr::UToF:
+  case Expr::SToF: {
+    const FCastRoundExpr *ce = cast<FCastRoundExpr>(e);
+    ref<Expr> src = visit(ce->src);
+    ConstantExpr *CE = dyn_cast<ConstantExpr>(src);
+    int mode;
+    if (!CE || CE->getWidth() > 64 ||
+        !getHostRoundingMode(ce->getRoundingMode(), mode))
+      return false;
+
+    bool isSigned = e->getKind() == Expr::SToF;
+    HostRounding hr(mode);
+    if (width == Expr::Fl32)
+      bits = hostIntToFloat<float>(CE->getZExtValue(), CE->getWidth(),
+                                   isSigned);
+    else
+      bits = hostIntToFloat<double>(CE->getZExtValue(), CE->getWidth(),
+                                    isSigned);
+    break;
+  }
+
+  case Expr::FAbs:
+  case Expr::FSqrt:
+  case Expr::FNearbyInt:
+  case Expr::FAdd:
+  case Expr::FSub:
+  case Expr::FMul:
+  case Expr::FDiv: {
+    uint64_t left, right = 0;
+    if (!evalNativeFloat(e->getKid(0), left))
+      return false;
+    if (e->getNumKids() == 2 && !evalNativeFloat(e->getKid(1), right))
+      return false;
+
+    bool success = width == Expr::Fl32 ?
+      evalHostFloat<float>(*e, left, right, bits) :
+      evalHostFloat<double>(*e, left, right, bits);
+    if (!success)
+      return false;
+    break;
+  }
+
+  case Expr::FFma: {
+    const FFmaExpr *fe = cast<FFmaExpr>(e);
+    uint64_t left, right, addend;
+    if (!evalNativeFloat(fe->left, left) ||
+        !evalNativeFloat(fe->right, right) ||
+        !evalNativeFloat(fe->addend, addend))
+      return false;
+
+    bool success = width == Expr::Fl32 ?
+      evalHostFma<float>(*fe, left, right, addend, bits) :
+      evalHostFma<double>(*fe, left, right, addend, bits);
+    if (!success)
+      return false;
+    break;
+  }
+
+  default:
+    // FRem, FMin and FMax are left to APFloat.
+    return false;
+  }
+
+  nativeFloats.insert(std::make_pair(e, bits));
+  return true;
+}
+
+ref<Expr> ExprEvaluator::evalNativeFloatResult(const Expr &e) {
+  switch (e.getKind()) {
+  case Expr::FOrd:
+  case Expr::FUno:
+  case Expr::FUeq:
+  case Expr::FOeq:
+  case Expr::FUgt:
+  case Expr::FOgt:
+  case Expr::FUge:
+  case Expr::FOge:
+  case Expr::FUlt:
+  case Expr::FOlt:
+  case Expr::FUle:
+  case Expr::FOle:
+  case Expr::FUne:
+  case Expr::FOne: {
+    ref<Expr> left = e.getKid(0), right = e.getKid(1);
+    uint64_t l, r;
+    if (!evalNativeFloat(left, l) || !evalNativeFloat(right, r))
+      return 0;
+    bool res = hostCompare(e.getKind(), hostToDouble(l, left->getWidth()),
+                           hostToDouble(r, right->getWidth()));
+    return ConstantExpr::alloc(res, Expr::Bool);
+  }
+
+  case Expr::FpClassify:
+  case Expr::FIsFinite:
+  case Expr::FIsNan:
+  case Expr::FIsInf: {
+    ref<Expr> src = e.getKid(0);
+    uint64_t bits;
+    if (!evalNativeFloat(src, bits))
+      return 0;
+    int res = src->getWidth() == Expr::Fl32 ?
+      hostClassify<float>(e.getKind(), bits) :
+      hostClassify<double>(e.getKind(), bits);
+    return ConstantExpr::alloc(res, e.getWidth());
+  }
+
+  case Expr::FToU:
+  case Expr::FToS: {
+    // Both truncate toward zero, whatever the rounding mode.
+    ref<Expr> src = e.getKid(0);
+    Expr::Width width = e.getWidth();
+    uint64_t bits;
+    if (width > 64 || !evalNativeFloat(src, bits))
+      return 0;
+
+    double d = trunc(hostToDouble(bits, src->getWidth()));
+    // Out of range values (and NaN) saturate in APFloat; leave them to it.
+    if (e.getKind() == Expr::FToS) {
+      double limit = ldexp(1.0, width - 1);
+      if (!(d >= -limit && d < limit))
+        return 0;
+      return ConstantExpr::alloc(bits64::truncateToNBits((int64_t) d, width),
+                                 width);
+    }
+    if (!(d >= 0 && d < ldexp(1.0, width)))
+      return 0;
+    return ConstantExpr::alloc((uint64_t) d, width);
+  }
+
+  case Expr::ExplicitInt: {
+    ref<Expr> src = e.getKid(0);
+    uint64_t bits;
+    if (e.getWidth() > 64 || !evalNativeFloat(src, bits))
+      return 0;
+    return ConstantExpr::alloc(bits64::truncateToNBits(bits, e.getWidth()),
+                               e.getWidth());
+  }
+
+  default:
+    return 0;
+  }
+}
+
 ExprVisitor::Action ExprEvaluator::visitExpr(const Expr &e) {
+  // Evaluate integers computed from floating-point values on the host where
+  // we can, rather than folding every intermediate value through APFloat.
+  if (NativeFloatEvaluation) {
+    ref<Expr> res = evalNativeFloatResult(e);
+    if (!res.isNull())
+      return Action::changeTo(res);
+  }
+
   // Evaluate all constant expressions here, in case they weren't folded in
   // construction. Don't do this for reads though, because we want them to go to
   // the normal rewrite path.
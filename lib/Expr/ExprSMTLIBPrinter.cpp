@@ -47,6 +47,12 @@ llvm::cl::opt<klee::ExprSMTLIBPrinter::AbbreviationMode> abbreviationMode(
                                 "Abbreviate with :named annotations"),
                      clEnumValEnd),
     llvm::cl::init(klee::ExprSMTLIBPrinter::ABBR_LET));
+
+llvm::cl::opt<unsigned> abbreviationMinSize(
+    "smtlib-abbreviation-min-size",
+    llvm::cl::desc("Only abbreviate shared subexpressions of at least this "
+                   "many nodes in SMT-LIBv2 files (default=1)"),
+    llvm::cl::init(1));
 }
 
 namespace klee {
@@ -58,6 +64,7 @@ ExprSMTLIBPrinter::ExprSMTLIBPrinter()
       smtlibBoolOptions(), arraysToCallGetValueOn(NULL) {
   setConstantDisplayMode(ExprSMTLIBOptions::argConstantDisplayMode);
   setAbbreviationMode(ExprSMTLIBOptions::abbreviationMode);
+  setAbbreviationMinSize(ExprSMTLIBOptions::abbreviationMinSize);
 }
 
 ExprSMTLIBPrinter::~ExprSMTLIBPrinter() {
@@ -657,8 +664,8 @@ void ExprSMTLIBPrinter::printQueryInSingleAssert() {
   ref<Expr> queryAssert = Expr::createIsZero(query->expr);
 
   // Print constraints inside the main query to reuse the Expr bindings
-  for (std::vector<ref<Expr> >::const_iterator i = query->constraints.begin(),
-                                               e = query->constraints.end();
+  for (ConstraintManager::const_iterator i = query->constraints.begin(),
+                                         e = query->constraints.end();
        i != e; ++i) {
     queryAssert = AndExpr::create(queryAssert, *i);
   }
@@ -719,13 +726,31 @@ void ExprSMTLIBPrinter::scan(const ref<Expr> &e) {
     Expr *ep = e.get();
     for (unsigned int i = 0; i < ep->getNumKids(); i++)
       scan(ep->getKid(i));
-  } else {
+  } else if (isWorthAbbreviating(e)) {
     // Add the expression to the binding map. The semantics of std::map::insert
     // are such that it will not be inserted twice.
     bindings.insert(std::make_pair(e, bindings.size()+1));
   }
 }
 
+bool ExprSMTLIBPrinter::isWorthAbbreviating(const ref<Expr> &e) {
+  if (abbrMinSize <= 1)
+    return true;
+
+  // Count the nodes of e as a tree, stopping at abbrMinSize.
+  unsigned size = 0;
+  std::vector<const Expr *> stack(1, e.get());
+  while (!stack.empty()) {
+    const Expr *ep = stack.back();
+    stack.pop_back();
+    if (++size >= abbrMinSize)
+      return true;
+    for (unsigned i = 0; i < ep->getNumKids(); ++i)
+      stack.push_back(ep->getKid(i).get());
+  }
+  return false;
+}
+
 void ExprSMTLIBPrinter::scanBindingExprDeps() {
   if (!bindings.size())
     return;
@@ -13,6 +13,7 @@
 #include "klee/Expr.h"
 
 #include "klee/util/ExprVisitor.h"
+#include "klee/util/Bits.h"
 
 #include <set>
 
@@ -76,48 +77,25 @@ void klee::findReads(ref<Expr> e,
 
 ///
 
-namespace klee {
-
-class SymbolicObjectFinder : public ExprVisitor {
-protected:
-  Action visitRead(const ReadExpr &re) {
-    const UpdateList &ul = re.updates;
-
-    // XXX should we memo better than what ExprVisitor is doing for us?
-    for (const UpdateNode *un=ul.head; un; un=un->next) {
-      visit(un->index);
-      visit(un->value);
-    }
-
-    if (ul.root->isSymbolicArray())
-      if (results.insert(ul.root).second)
-        objects.push_back(ul.root);
-
-    return Action::doChildren();
-  }
-
-public:
-  std::set<const Array*> results;
-  std::vector<const Array*> &objects;
-  
-  SymbolicObjectFinder(std::vector<const Array*> &_objects)
-    : objects(_objects) {}
-};
-
-}
-
 template<typename InputIterator>
 void klee::findSymbolicObjects(InputIterator begin, 
                                InputIterator end,
                                std::vector<const Array*> &results) {
-  SymbolicObjectFinder of(results);
-  for (; begin!=end; ++begin)
-    of.visit(*begin);
+  // The expressions keep the arrays they read, so only those need merging.
+  std::set<const Array*> found;
+  for (; begin!=end; ++begin) {
+    const std::vector<const Array*> &arrays = (*begin)->getFootprint().arrays;
+    for (std::vector<const Array*>::const_iterator it = arrays.begin(),
+           ie = arrays.end(); it != ie; ++it)
+      if (found.insert(*it).second)
+        results.push_back(*it);
+  }
 }
 
 void klee::findSymbolicObjects(ref<Expr> e,
                                std::vector<const Array*> &results) {
-  findSymbolicObjects(&e, &e+1, results);
+  const std::vector<const Array*> &arrays = e->getFootprint().arrays;
+  results.insert(results.end(), arrays.begin(), arrays.end());
 }
 
 typedef std::vector< ref<Expr> >::iterator A;
@@ -125,3 +103,34 @@ template void klee::findSymbolicObjects<A>(A, A, std::vector<const Array*> &);
 
 typedef std::set< ref<Expr> >::iterator B;
 template void klee::findSymbolicObjects<B>(B, B, std::vector<const Array*> &);
+
+ref<Expr> klee::getFloatOrderKey(ref<Expr> e) {
+  Expr::Width width = e->getWidth();
+  ref<Expr> bits = ExplicitIntExpr::create(e, width);
+  ref<Expr> signBit = ConstantExpr::create(1, width)->Shl(
+      ConstantExpr::create(width - 1, width));
+  return SelectExpr::create(ExtractExpr::create(bits, width - 1, Expr::Bool),
+                            NotExpr::create(bits),
+                            XorExpr::create(bits, signBit));
+}
+
+ref<Expr> klee::getFloatFromOrderKey(uint64_t key, unsigned width) {
+  assert((width == Expr::Fl32 || width == Expr::Fl64) &&
+         "unsupported float width");
+  uint64_t signBit = (uint64_t) 1 << (width - 1);
+  uint64_t bits = (key & signBit) ? key ^ signBit : ~key;
+  return ExplicitFloatExpr::create(
+      ConstantExpr::create(bits & bits64::maxValueOfNBits(width), width),
+      width);
+}
+
+ref<Expr> klee::createIsValue(ref<Expr> e, ref<Expr> value) {
+  if (!isa<FExpr>(e))
+    return EqExpr::create(e, value);
+
+  if (!cast<ConstantExpr>(FIsNanExpr::create(value))->isZero())
+    return Expr::createIsZero(Expr::createIsZero(FIsNanExpr::create(e)));
+  Expr::Width width = e->getWidth();
+  return EqExpr::create(ExplicitIntExpr::create(e, width),
+                        ExplicitIntExpr::create(value, width));
+}
@@ -25,13 +25,13 @@ ref<Expr> ExprVisitor::visit(const ref<Expr> &e) {
   if (!UseVisitorHash || isa<ConstantExpr>(e) || isa<FConstantExpr>(e)) {
     return visitActual(e);
   } else {
-    visited_ty::iterator it = visited.find(e);
+    visited_ty::iterator it = memo->find(e);
 
-    if (it!=visited.end()) {
+    if (it!=memo->end()) {
       return it->second;
     } else {
       ref<Expr> res = visitActual(e);
-      visited.insert(std::make_pair(e, res));
+      memo->insert(std::make_pair(e, res));
       return res;
     }
   }
@@ -122,6 +122,7 @@ ref<Expr> ExprVisitor::visitActual(const ref<Expr> &e) {
     case Expr::FRem: res = visitFRem(static_cast<FRemExpr&>(ep)); break;
     case Expr::FMin: res = visitFMin(static_cast<FMinExpr&>(ep)); break;
     case Expr::FMax: res = visitFMax(static_cast<FMaxExpr&>(ep)); break;
+    case Expr::FFma: res = visitFFma(static_cast<FFmaExpr&>(ep)); break;
 
     case Expr::Constant:
     case Expr::FConstant:
@@ -437,3 +438,7 @@ ExprVisitor::Action ExprVisitor::visitFMin(const FMinExpr&) {
 ExprVisitor::Action ExprVisitor::visitFMax(const FMaxExpr&) {
   return Action::doChildren();
 }
+
+ExprVisitor::Action ExprVisitor::visitFFma(const FFmaExpr&) {
+  return Action::doChildren();
+}
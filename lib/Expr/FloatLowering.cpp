@@ -0,0 +1,878 @@
+//===-- FloatLowering.cpp -------------------------------------------------===//
+//
+//                     The KLEE Symbolic Virtual Machine
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+
+#include "klee/util/FloatLowering.h"
+#include "klee/util/ExprVisitor.h"
+
+#include "llvm/ADT/APFloat.h"
+#include "llvm/ADT/APInt.h"
+
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+
+using namespace klee;
+using llvm::APFloat;
+using llvm::APInt;
+
+namespace {
+
+typedef APFloat::roundingMode RoundingMode;
+
+/// FloatFormat - The layout of an IEEE-754 binary interchange format.
+struct FloatFormat {
+  Expr::Width width;
+  unsigned expBits;
+  /// Significand bits, including the hidden one.
+  unsigned precision;
+
+  explicit FloatFormat(Expr::Width w)
+    : width(w),
+      expBits(w == Expr::Fl32 ? 8 : 11),
+      precision(w == Expr::Fl32 ? 24 : 53) {
+    assert((w == Expr::Fl32 || w == Expr::Fl64) && "unsupported float width");
+  }
+
+  unsigned fracBits() const { return precision - 1; }
+  int64_t bias() const { return (1 << (expBits - 1)) - 1; }
+  int64_t minExp() const { return 1 - bias(); }
+
+  /// expWidth - Width of the signed, unbiased exponents of intermediate
+  /// results; wide enough for the product or quotient of two subnormals.
+  Expr::Width expWidth() const { return expBits + 3; }
+};
+
+/// UnpackedFloat - The finite, nonzero value (-1)^sign * sig * 2^(exp - w + 1)
+/// where w is the width of sig, i.e. exp is the weight of sig's top bit.
+struct UnpackedFloat {
+  ref<Expr> sign, exp, sig;
+};
+
+inline bool isSupportedWidth(Expr::Width w) {
+  return w == Expr::Fl32 || w == Expr::Fl64;
+}
+
+inline Expr::Width bitsFor(unsigned value) {
+  Expr::Width res = 0;
+  for (; value; value >>= 1)
+    ++res;
+  return res;
+}
+
+inline ref<Expr> bvConst(uint64_t value, Expr::Width w) {
+  return ConstantExpr::alloc(APInt(w, value));
+}
+
+inline ref<Expr> bvSigned(int64_t value, Expr::Width w) {
+  return ConstantExpr::alloc(APInt(w, value, true));
+}
+
+inline ref<Expr> bvBit(unsigned bit, Expr::Width w) {
+  return ConstantExpr::alloc(APInt::getOneBitSet(w, bit));
+}
+
+inline ref<Expr> bvLowBits(unsigned n, Expr::Width w) {
+  return ConstantExpr::alloc(APInt::getLowBitsSet(w, n));
+}
+
+inline ref<Expr> isNonZero(const ref<Expr> &e) {
+  return NotExpr::create(Expr::createIsZero(e));
+}
+
+/***/
+
+ref<Expr> signOf(const FloatFormat &f, const ref<Expr> &x) {
+  return ExtractExpr::create(x, f.width - 1, 1);
+}
+
+ref<Expr> expFieldOf(const FloatFormat &f, const ref<Expr> &x) {
+  return ExtractExpr::create(x, f.fracBits(), f.expBits);
+}
+
+ref<Expr> fracFieldOf(const FloatFormat &f, const ref<Expr> &x) {
+  return ExtractExpr::create(x, 0, f.fracBits());
+}
+
+ref<Expr> hasMaxExp(const FloatFormat &f, const ref<Expr> &x) {
+  return EqExpr::create(bvLowBits(f.expBits, f.expBits), expFieldOf(f, x));
+}
+
+ref<Expr> isNaN(const FloatFormat &f, const ref<Expr> &x) {
+  return AndExpr::create(hasMaxExp(f, x), isNonZero(fracFieldOf(f, x)));
+}
+
+ref<Expr> isInf(const FloatFormat &f, const ref<Expr> &x) {
+  return AndExpr::create(hasMaxExp(f, x),
+                         Expr::createIsZero(fracFieldOf(f, x)));
+}
+
+ref<Expr> isZero(const FloatFormat &f, const ref<Expr> &x) {
+  return Expr::createIsZero(ExtractExpr::create(x, 0, f.width - 1));
+}
+
+ref<Expr> isSubnormal(const FloatFormat &f, const ref<Expr> &x) {
+  return AndExpr::create(Expr::createIsZero(expFieldOf(f, x)),
+                         isNonZero(fracFieldOf(f, x)));
+}
+
+ref<Expr> packFloat(const ref<Expr> &sign, const ref<Expr> &expField,
+                    const ref<Expr> &frac) {
+  return ConcatExpr::create(sign, ConcatExpr::create(expField, frac));
+}
+
+ref<Expr> makeZero(const FloatFormat &f, const ref<Expr> &sign) {
+  return ConcatExpr::create(sign, bvConst(0, f.width - 1));
+}
+
+ref<Expr> makeInf(const FloatFormat &f, const ref<Expr> &sign) {
+  return packFloat(sign, bvLowBits(f.expBits, f.expBits),
+                   bvConst(0, f.fracBits()));
+}
+
+ref<Expr> makeMaxFinite(const FloatFormat &f, const ref<Expr> &sign) {
+  return packFloat(sign, bvConst((1 << f.expBits) - 2, f.expBits),
+                   bvLowBits(f.fracBits(), f.fracBits()));
+}
+
+/// makeDefaultNaN - The quiet NaN APFloat produces for invalid operations.
+ref<Expr> makeDefaultNaN(const FloatFormat &f) {
+  return ConstantExpr::alloc(
+      APInt::getBitsSet(f.width, f.fracBits() - 1, f.width - 1));
+}
+
+ref<Expr> quietNaN(const FloatFormat &f, const ref<Expr> &x) {
+  return OrExpr::create(x, bvBit(f.fracBits() - 1, f.width));
+}
+
+/// normalize - Shift the significand of \a u left until its top bit is set,
+/// by binary search over the number of leading zeros. The significand must
+/// be nonzero.
+void normalize(UnpackedFloat &u) {
+  Expr::Width w = u.sig->getWidth(), ew = u.exp->getWidth();
+  if (w < 2)
+    return;
+
+  unsigned step = 1;
+  while (step * 2 <= w - 1)
+    step *= 2;
+
+  for (; step; step /= 2) {
+    ref<Expr> shift =
+        Expr::createIsZero(ExtractExpr::create(u.sig, w - step, step));
+    u.sig = SelectExpr::create(
+        shift, ShlExpr::create(u.sig, bvConst(step, w)), u.sig);
+    u.exp = SelectExpr::create(
+        shift, SubExpr::create(u.exp, bvConst(step, ew)), u.exp);
+  }
+}
+
+/// unpack - Split a finite, nonzero \a x into sign, exponent and p-bit
+/// significand, optionally normalizing subnormals to a leading one.
+UnpackedFloat unpack(const FloatFormat &f, const ref<Expr> &x, Expr::Width ew,
+                     bool normalized) {
+  ref<Expr> expField = expFieldOf(f, x);
+  ref<Expr> subnormal = Expr::createIsZero(expField);
+
+  UnpackedFloat u;
+  u.sign = signOf(f, x);
+  u.sig = ConcatExpr::create(NotExpr::create(subnormal), fracFieldOf(f, x));
+  u.exp = SubExpr::create(SelectExpr::create(subnormal, bvConst(1, ew),
+                                             ZExtExpr::create(expField, ew)),
+                          bvConst(f.bias(), ew));
+  if (normalized)
+    normalize(u);
+  return u;
+}
+
+/// roundIncrement - Whether a value truncated to \a lsb, with the first
+/// discarded bit \a roundBit and \a sticky set if any later one was, rounds
+/// away from zero under \a rm.
+ref<Expr> roundIncrement(RoundingMode rm, const ref<Expr> &sign,
+                         const ref<Expr> &lsb, const ref<Expr> &roundBit,
+                         const ref<Expr> &sticky) {
+  ref<Expr> inexact = OrExpr::create(roundBit, sticky);
+
+  switch (rm) {
+  case APFloat::rmNearestTiesToEven:
+    return AndExpr::create(roundBit, OrExpr::create(sticky, lsb));
+  case APFloat::rmNearestTiesToAway:
+    return roundBit;
+  case APFloat::rmTowardPositive:
+    return AndExpr::create(inexact, NotExpr::create(sign));
+  case APFloat::rmTowardNegative:
+    return AndExpr::create(inexact, sign);
+  case APFloat::rmTowardZero:
+    break;
+  }
+  return ConstantExpr::alloc(0, Expr::Bool);
+}
+
+/// overflowResult - What a finite result too large for \a f rounds to.
+ref<Expr> overflowResult(const FloatFormat &f, const ref<Expr> &sign,
+                         RoundingMode rm) {
+  switch (rm) {
+  case APFloat::rmTowardZero:
+    return makeMaxFinite(f, sign);
+  case APFloat::rmTowardPositive:
+    return SelectExpr::create(sign, makeMaxFinite(f, sign), makeInf(f, sign));
+  case APFloat::rmTowardNegative:
+    return SelectExpr::create(sign, makeInf(f, sign), makeMaxFinite(f, sign));
+  default:
+    return makeInf(f, sign);
+  }
+}
+
+/// roundAndPack - Round the exact (or sticky-bit approximated) value \a u,
+/// whose significand must be nonzero, to format \a f under \a rm.
+ref<Expr> roundAndPack(const FloatFormat &f, UnpackedFloat u,
+                       RoundingMode rm) {
+  unsigned p = f.precision;
+  Expr::Width ew = u.exp->getWidth();
+
+  // Make room for the round bit and at least one sticky bit.
+  if (u.sig->getWidth() < p + 2) {
+    unsigned pad = p + 2 - u.sig->getWidth();
+    u.sig = ShlExpr::create(ZExtExpr::create(u.sig, p + 2),
+                            bvConst(pad, p + 2));
+  }
+  Expr::Width w = u.sig->getWidth();
+  normalize(u);
+
+  // Keep the top p bits, or fewer for results below the normal range,
+  // which are denormalized to the minimum exponent.
+  ref<Expr> minExp = bvSigned(f.minExp(), ew);
+  ref<Expr> tiny = SltExpr::create(u.exp, minExp);
+  ref<Expr> deficit = SubExpr::create(minExp, u.exp);
+  // Past p bits of deficit even the top bit is only sticky.
+  ref<Expr> vanishes =
+      AndExpr::create(tiny, UltExpr::create(bvConst(p, ew), deficit));
+  deficit = SelectExpr::create(
+      UltExpr::create(deficit, bvConst(p, ew)), deficit, bvConst(p, ew));
+  deficit = SelectExpr::create(tiny, deficit, bvConst(0, ew));
+  ref<Expr> shift =
+      AddExpr::create(bvConst(w - p, w), ZExtExpr::create(deficit, w));
+  ref<Expr> roundShift = SubExpr::create(shift, bvConst(1, w));
+
+  ref<Expr> kept = LShrExpr::create(u.sig, shift);
+  ref<Expr> roundBit = AndExpr::create(
+      ExtractExpr::create(LShrExpr::create(u.sig, roundShift), 0, 1),
+      NotExpr::create(vanishes));
+  ref<Expr> stickyMask = SubExpr::create(
+      ShlExpr::create(bvConst(1, w), roundShift), bvConst(1, w));
+  ref<Expr> sticky = OrExpr::create(
+      isNonZero(AndExpr::create(u.sig, stickyMask)), vanishes);
+  ref<Expr> inc = roundIncrement(rm, u.sign, ExtractExpr::create(kept, 0, 1),
+                                 roundBit, sticky);
+  kept = ExtractExpr::create(AddExpr::create(kept, ZExtExpr::create(inc, w)),
+                             0, p + 1);
+
+  // Rounding up may carry into a new top bit.
+  ref<Expr> exp = SelectExpr::create(tiny, minExp, u.exp);
+  ref<Expr> carry = ExtractExpr::create(kept, p, 1);
+  kept = SelectExpr::create(
+      carry, LShrExpr::create(kept, bvConst(1, p + 1)), kept);
+  exp = SelectExpr::create(carry, AddExpr::create(exp, bvConst(1, ew)), exp);
+
+  // A subnormal that rounded up to the hidden bit becomes the smallest
+  // normal, which has the same exponent.
+  ref<Expr> biased = AddExpr::create(exp, bvConst(f.bias(), ew));
+  ref<Expr> normal = ExtractExpr::create(kept, p - 1, 1);
+  ref<Expr> expField =
+      SelectExpr::create(normal, ExtractExpr::create(biased, 0, f.expBits),
+                         bvConst(0, f.expBits));
+  ref<Expr> res =
+      packFloat(u.sign, expField, ExtractExpr::create(kept, 0, p - 1));
+
+  ref<Expr> overflow =
+      SleExpr::create(bvConst((1 << f.expBits) - 1, ew), biased);
+  return SelectExpr::create(overflow, overflowResult(f, u.sign, rm), res);
+}
+
+/***/
+
+ref<Expr> lowerAdd(const FloatFormat &f, const ref<Expr> &a,
+                   const ref<Expr> &b, RoundingMode rm) {
+  unsigned p = f.precision;
+  Expr::Width ew = f.expWidth(), w = p + 4;
+  UnpackedFloat ua = unpack(f, a, ew, true), ub = unpack(f, b, ew, true);
+
+  // Order the operands by magnitude so the difference is never negative.
+  ref<Expr> swap = OrExpr::create(
+      SltExpr::create(ua.exp, ub.exp),
+      AndExpr::create(EqExpr::create(ua.exp, ub.exp),
+                      UltExpr::create(ua.sig, ub.sig)));
+  UnpackedFloat big, small;
+  big.sign = SelectExpr::create(swap, ub.sign, ua.sign);
+  big.exp = SelectExpr::create(swap, ub.exp, ua.exp);
+  big.sig = SelectExpr::create(swap, ub.sig, ua.sig);
+  small.sign = SelectExpr::create(swap, ua.sign, ub.sign);
+  small.exp = SelectExpr::create(swap, ua.exp, ub.exp);
+  small.sig = SelectExpr::create(swap, ua.sig, ub.sig);
+
+  // Three extra low bits (guard, round and sticky) keep the sum exact
+  // enough to round correctly; one extra high bit catches the carry.
+  ref<Expr> bigSig =
+      ShlExpr::create(ZExtExpr::create(big.sig, w), bvConst(3, w));
+  ref<Expr> smallSig =
+      ShlExpr::create(ZExtExpr::create(small.sig, w), bvConst(3, w));
+  ref<Expr> diff = SubExpr::create(big.exp, small.exp);
+  diff = SelectExpr::create(UltExpr::create(diff, bvConst(p + 3, ew)), diff,
+                            bvConst(p + 3, ew));
+  ref<Expr> shift = ZExtExpr::create(diff, w);
+  ref<Expr> lost = AndExpr::create(
+      smallSig,
+      SubExpr::create(ShlExpr::create(bvConst(1, w), shift), bvConst(1, w)));
+  ref<Expr> aligned = OrExpr::create(LShrExpr::create(smallSig, shift),
+                                     ZExtExpr::create(isNonZero(lost), w));
+
+  UnpackedFloat sum;
+  sum.sign = big.sign;
+  sum.sig = SelectExpr::create(XorExpr::create(big.sign, small.sign),
+                               SubExpr::create(bigSig, aligned),
+                               AddExpr::create(bigSig, aligned));
+  sum.exp = AddExpr::create(big.exp, bvConst(1, ew));
+
+  // Exact cancellation gives +0, or -0 when rounding toward negative.
+  ref<Expr> cancelSign =
+      ConstantExpr::alloc(rm == APFloat::rmTowardNegative, Expr::Bool);
+  ref<Expr> res = SelectExpr::create(Expr::createIsZero(sum.sig),
+                                     makeZero(f, cancelSign),
+                                     roundAndPack(f, sum, rm));
+
+  ref<Expr> signA = signOf(f, a), signB = signOf(f, b);
+  ref<Expr> zeroA = isZero(f, a), zeroB = isZero(f, b);
+  ref<Expr> infA = isInf(f, a), infB = isInf(f, b);
+  ref<Expr> zeroSign = rm == APFloat::rmTowardNegative
+                           ? OrExpr::create(signA, signB)
+                           : AndExpr::create(signA, signB);
+
+  res = SelectExpr::create(zeroB, a, res);
+  res = SelectExpr::create(zeroA, b, res);
+  res = SelectExpr::create(AndExpr::create(zeroA, zeroB),
+                           makeZero(f, zeroSign), res);
+  res = SelectExpr::create(infB, b, res);
+  res = SelectExpr::create(infA, a, res);
+  res = SelectExpr::create(
+      AndExpr::create(AndExpr::create(infA, infB),
+                      XorExpr::create(signA, signB)),
+      makeDefaultNaN(f), res);
+  res = SelectExpr::create(isNaN(f, b), quietNaN(f, b), res);
+  return SelectExpr::create(isNaN(f, a), quietNaN(f, a), res);
+}
+
+ref<Expr> lowerMul(const FloatFormat &f, const ref<Expr> &a,
+                   const ref<Expr> &b, RoundingMode rm) {
+  unsigned p = f.precision;
+  Expr::Width ew = f.expWidth(), w = 2 * p;
+  UnpackedFloat ua = unpack(f, a, ew, true), ub = unpack(f, b, ew, true);
+
+  UnpackedFloat prod;
+  prod.sign = XorExpr::create(ua.sign, ub.sign);
+  prod.sig = MulExpr::create(ZExtExpr::create(ua.sig, w),
+                             ZExtExpr::create(ub.sig, w));
+  prod.exp = AddExpr::create(AddExpr::create(ua.exp, ub.exp), bvConst(1, ew));
+  ref<Expr> res = roundAndPack(f, prod, rm);
+
+  ref<Expr> zeroA = isZero(f, a), zeroB = isZero(f, b);
+  ref<Expr> infA = isInf(f, a), infB = isInf(f, b);
+  res = SelectExpr::create(OrExpr::create(zeroA, zeroB),
+                           makeZero(f, prod.sign), res);
+  res = SelectExpr::create(OrExpr::create(infA, infB), makeInf(f, prod.sign),
+                           res);
+  res = SelectExpr::create(OrExpr::create(AndExpr::create(infA, zeroB),
+                                          AndExpr::create(zeroA, infB)),
+                           makeDefaultNaN(f), res);
+  res = SelectExpr::create(isNaN(f, b), quietNaN(f, b), res);
+  return SelectExpr::create(isNaN(f, a), quietNaN(f, a), res);
+}
+
+ref<Expr> lowerDiv(const FloatFormat &f, const ref<Expr> &a,
+                   const ref<Expr> &b, RoundingMode rm) {
+  unsigned p = f.precision;
+  Expr::Width ew = f.expWidth(), w = 2 * p + 3;
+  UnpackedFloat ua = unpack(f, a, ew, true), ub = unpack(f, b, ew, true);
+
+  // With both significands normalized the quotient has p + 2 or p + 3 bits;
+  // the remainder only matters as a sticky bit. Division by a zero b is
+  // answered below, but must not fold to a division by zero.
+  ref<Expr> zeroA = isZero(f, a), zeroB = isZero(f, b);
+  ref<Expr> num = ShlExpr::create(ZExtExpr::create(ua.sig, w),
+                                  bvConst(p + 2, w));
+  ref<Expr> den = ZExtExpr::create(
+      SelectExpr::create(zeroB, bvConst(1, p), ub.sig), w);
+  UnpackedFloat quot;
+  quot.sign = XorExpr::create(ua.sign, ub.sign);
+  quot.sig = OrExpr::create(
+      ShlExpr::create(UDivExpr::create(num, den), bvConst(1, w)),
+      ZExtExpr::create(isNonZero(URemExpr::create(num, den)), w));
+  quot.exp = AddExpr::create(SubExpr::create(ua.exp, ub.exp),
+                             bvConst(p - 1, ew));
+  ref<Expr> res = roundAndPack(f, quot, rm);
+
+  ref<Expr> infA = isInf(f, a), infB = isInf(f, b);
+  res = SelectExpr::create(OrExpr::create(zeroA, infB),
+                           makeZero(f, quot.sign), res);
+  res = SelectExpr::create(OrExpr::create(infA, zeroB),
+                           makeInf(f, quot.sign), res);
+  res = SelectExpr::create(OrExpr::create(AndExpr::create(zeroA, zeroB),
+                                          AndExpr::create(infA, infB)),
+                           makeDefaultNaN(f), res);
+  res = SelectExpr::create(isNaN(f, b), quietNaN(f, b), res);
+  return SelectExpr::create(isNaN(f, a), quietNaN(f, a), res);
+}
+
+ref<Expr> lowerSqrt(const FloatFormat &f, const ref<Expr> &a,
+                    RoundingMode rm) {
+  unsigned p = f.precision;
+  Expr::Width ew = f.expWidth(), wr = 2 * p + 4, w = wr + 2;
+  UnpackedFloat u = unpack(f, a, ew, true);
+
+  // a = sig * 2^k. Scale the radicand by an even power of two larger than
+  // 2^(p+2) so the exponent halves exactly and the root has p + 2 bits.
+  ref<Expr> k = SubExpr::create(u.exp, bvConst(p - 1, ew));
+  ref<Expr> scale = SelectExpr::create(
+      EqExpr::create(ExtractExpr::create(k, 0, 1),
+                     ConstantExpr::alloc((p + 3) & 1, Expr::Bool)),
+      bvConst(p + 3, ew), bvConst(p + 4, ew));
+  ref<Expr> radicand = ShlExpr::create(ZExtExpr::create(u.sig, wr),
+                                       ZExtExpr::create(scale, wr));
+
+  // Restoring square root, two radicand bits at a time.
+  ref<Expr> rem = bvConst(0, w), root = bvConst(0, w);
+  for (unsigned i = wr / 2; i--;) {
+    rem = OrExpr::create(
+        ShlExpr::create(rem, bvConst(2, w)),
+        ZExtExpr::create(ExtractExpr::create(radicand, 2 * i, 2), w));
+    ref<Expr> trial =
+        OrExpr::create(ShlExpr::create(root, bvConst(2, w)), bvConst(1, w));
+    ref<Expr> fits = UleExpr::create(trial, rem);
+    rem = SelectExpr::create(fits, SubExpr::create(rem, trial), rem);
+    root = OrExpr::create(ShlExpr::create(root, bvConst(1, w)),
+                          ZExtExpr::create(fits, w));
+  }
+
+  UnpackedFloat r;
+  r.sign = ConstantExpr::alloc(0, Expr::Bool);
+  r.sig = OrExpr::create(ShlExpr::create(root, bvConst(1, w)),
+                         ZExtExpr::create(isNonZero(rem), w));
+  r.exp = AddExpr::create(
+      AShrExpr::create(SubExpr::create(k, scale), bvConst(1, ew)),
+      bvConst(w - 2, ew));
+  ref<Expr> res = roundAndPack(f, r, rm);
+
+  ref<Expr> zeroA = isZero(f, a);
+  res = SelectExpr::create(OrExpr::create(zeroA, isInf(f, a)), a, res);
+  res = SelectExpr::create(
+      AndExpr::create(signOf(f, a), NotExpr::create(zeroA)),
+      makeDefaultNaN(f), res);
+  return SelectExpr::create(isNaN(f, a), quietNaN(f, a), res);
+}
+
+ref<Expr> lowerNearbyInt(const FloatFormat &f, const ref<Expr> &a,
+                         RoundingMode rm) {
+  unsigned p = f.precision;
+  Expr::Width ew = f.expWidth(), w = p + 2;
+  UnpackedFloat u = unpack(f, a, ew, false);
+
+  // Values from 2^(p-1) up, infinities and NaNs have no fraction bits.
+  ref<Expr> integral = SleExpr::create(bvConst(p - 1, ew), u.exp);
+  ref<Expr> fraction = SubExpr::create(bvConst(p - 1, ew), u.exp);
+  fraction = SelectExpr::create(UltExpr::create(fraction, bvConst(p + 1, ew)),
+                                fraction, bvConst(p + 1, ew));
+  fraction = SelectExpr::create(integral, bvConst(1, ew), fraction);
+
+  ref<Expr> sig = ZExtExpr::create(u.sig, w);
+  ref<Expr> shift = ZExtExpr::create(fraction, w);
+  ref<Expr> roundShift = SubExpr::create(shift, bvConst(1, w));
+  ref<Expr> kept = LShrExpr::create(sig, shift);
+  ref<Expr> roundBit =
+      ExtractExpr::create(LShrExpr::create(sig, roundShift), 0, 1);
+  ref<Expr> sticky = isNonZero(AndExpr::create(
+      sig, SubExpr::create(ShlExpr::create(bvConst(1, w), roundShift),
+                           bvConst(1, w))));
+  ref<Expr> inc = roundIncrement(rm, u.sign, ExtractExpr::create(kept, 0, 1),
+                                 roundBit, sticky);
+
+  UnpackedFloat n;
+  n.sign = u.sign;
+  n.sig = AddExpr::create(kept, ZExtExpr::create(inc, w));
+  n.exp = bvConst(w - 1, ew);
+  ref<Expr> res =
+      SelectExpr::create(Expr::createIsZero(n.sig), makeZero(f, u.sign),
+                         roundAndPack(f, n, rm));
+
+  res = SelectExpr::create(integral, a, res);
+  return SelectExpr::create(isNaN(f, a), quietNaN(f, a), res);
+}
+
+ref<Expr> lowerFExt(const FloatFormat &from, const FloatFormat &to,
+                    const ref<Expr> &a, RoundingMode rm) {
+  if (from.width == to.width)
+    return a;
+
+  Expr::Width ew = std::max(from.expWidth(), to.expWidth());
+  UnpackedFloat u = unpack(from, a, ew, true);
+  ref<Expr> res = roundAndPack(to, u, rm);
+  res = SelectExpr::create(isZero(from, a), makeZero(to, u.sign), res);
+  res = SelectExpr::create(isInf(from, a), makeInf(to, u.sign), res);
+
+  // NaNs keep the top of their payload.
+  ref<Expr> payload = fracFieldOf(from, a);
+  if (to.fracBits() > from.fracBits())
+    payload = ShlExpr::create(ZExtExpr::create(payload, to.fracBits()),
+                              bvConst(to.fracBits() - from.fracBits(),
+                                      to.fracBits()));
+  else
+    payload = ExtractExpr::create(payload, from.fracBits() - to.fracBits(),
+                                  to.fracBits());
+  ref<Expr> nan = quietNaN(
+      to, packFloat(u.sign, bvLowBits(to.expBits, to.expBits), payload));
+  return SelectExpr::create(isNaN(from, a), nan, res);
+}
+
+ref<Expr> lowerIntToFloat(const FloatFormat &f, const ref<Expr> &x,
+                          bool isSigned, RoundingMode rm) {
+  Expr::Width w = x->getWidth();
+  Expr::Width ew = std::max(f.expWidth(), bitsFor(w) + 2);
+
+  UnpackedFloat u;
+  if (isSigned) {
+    u.sign = ExtractExpr::create(x, w - 1, 1);
+    u.sig = SelectExpr::create(u.sign, SubExpr::create(bvConst(0, w), x), x);
+  } else {
+    u.sign = ConstantExpr::alloc(0, Expr::Bool);
+    u.sig = x;
+  }
+  u.exp = bvConst(w - 1, ew);
+
+  return SelectExpr::create(Expr::createIsZero(x),
+                            makeZero(f, ConstantExpr::alloc(0, Expr::Bool)),
+                            roundAndPack(f, u, rm));
+}
+
+/// lowerFloatToInt - Truncate toward zero like APFloat::convertToInteger,
+/// which saturates out of range values and turns NaNs into zero.
+ref<Expr> lowerFloatToInt(const FloatFormat &f, const ref<Expr> &a,
+                          Expr::Width w, bool isSigned) {
+  unsigned p = f.precision;
+  Expr::Width ew = std::max(f.expWidth(), bitsFor(w) + 2), wi = w + p + 1;
+  UnpackedFloat u = unpack(f, a, ew, false);
+
+  ref<Expr> fraction = SltExpr::create(u.exp, bvConst(0, ew));
+  ref<Expr> huge = OrExpr::create(hasMaxExp(f, a),
+                                  SltExpr::create(bvConst(w, ew), u.exp));
+  ref<Expr> exact = SleExpr::create(bvConst(p - 1, ew), u.exp);
+  ref<Expr> rshift = SelectExpr::create(
+      OrExpr::create(fraction, exact), bvConst(0, ew),
+      SubExpr::create(bvConst(p - 1, ew), u.exp));
+  ref<Expr> lshift = SelectExpr::create(
+      AndExpr::create(exact, NotExpr::create(huge)),
+      SubExpr::create(u.exp, bvConst(p - 1, ew)), bvConst(0, ew));
+
+  ref<Expr> sig = ZExtExpr::create(u.sig, wi);
+  ref<Expr> mag = SelectExpr::create(
+      exact, ShlExpr::create(sig, ZExtExpr::create(lshift, wi)),
+      LShrExpr::create(sig, ZExtExpr::create(rshift, wi)));
+  mag = SelectExpr::create(fraction, bvConst(0, wi), mag);
+  ref<Expr> low = ExtractExpr::create(mag, 0, w);
+
+  ref<Expr> res;
+  if (isSigned) {
+    ref<Expr> limit = bvBit(w - 1, wi);
+    ref<Expr> pos = SelectExpr::create(
+        OrExpr::create(huge, UleExpr::create(limit, mag)),
+        bvLowBits(w - 1, w), low);
+    ref<Expr> neg = SelectExpr::create(
+        OrExpr::create(huge, UltExpr::create(limit, mag)), bvBit(w - 1, w),
+        SubExpr::create(bvConst(0, w), low));
+    res = SelectExpr::create(u.sign, neg, pos);
+  } else {
+    ref<Expr> overflow = OrExpr::create(
+        huge, isNonZero(ExtractExpr::create(mag, w, wi - w)));
+    res = SelectExpr::create(overflow, bvLowBits(w, w), low);
+    res = SelectExpr::create(u.sign, bvConst(0, w), res);
+  }
+  return SelectExpr::create(isNaN(f, a), bvConst(0, w), res);
+}
+
+/// lessThan - Whether \a a orders before \a b, neither being a NaN.
+ref<Expr> lessThan(const FloatFormat &f, const ref<Expr> &a,
+                   const ref<Expr> &b) {
+  ref<Expr> signA = signOf(f, a), signB = signOf(f, b);
+  ref<Expr> ordered = SelectExpr::create(
+      signA,
+      SelectExpr::create(signB, UltExpr::create(b, a),
+                         ConstantExpr::alloc(1, Expr::Bool)),
+      SelectExpr::create(signB, ConstantExpr::alloc(0, Expr::Bool),
+                         UltExpr::create(a, b)));
+  return AndExpr::create(NotExpr::create(isZero(f, OrExpr::create(a, b))),
+                         ordered);
+}
+
+/// equalTo - Whether \a a equals \a b, neither being a NaN.
+ref<Expr> equalTo(const FloatFormat &f, const ref<Expr> &a,
+                  const ref<Expr> &b) {
+  return OrExpr::create(EqExpr::create(a, b),
+                        isZero(f, OrExpr::create(a, b)));
+}
+
+ref<Expr> lowerCompare(Expr::Kind k, const FloatFormat &f, const ref<Expr> &a,
+                       const ref<Expr> &b) {
+  ref<Expr> unordered = OrExpr::create(isNaN(f, a), isNaN(f, b));
+  ref<Expr> ordered = NotExpr::create(unordered);
+
+  switch (k) {
+  case Expr::FOrd:
+    return ordered;
+  case Expr::FUno:
+    return unordered;
+  case Expr::FOeq:
+    return AndExpr::create(ordered, equalTo(f, a, b));
+  case Expr::FUeq:
+    return OrExpr::create(unordered, equalTo(f, a, b));
+  case Expr::FOgt:
+    return AndExpr::create(ordered, lessThan(f, b, a));
+  case Expr::FUgt:
+    return OrExpr::create(unordered, lessThan(f, b, a));
+  case Expr::FOge:
+    return AndExpr::create(ordered, NotExpr::create(lessThan(f, a, b)));
+  case Expr::FUge:
+    return OrExpr::create(unordered, NotExpr::create(lessThan(f, a, b)));
+  case Expr::FOlt:
+    return AndExpr::create(ordered, lessThan(f, a, b));
+  case Expr::FUlt:
+    return OrExpr::create(unordered, lessThan(f, a, b));
+  case Expr::FOle:
+    return AndExpr::create(ordered, NotExpr::create(lessThan(f, b, a)));
+  case Expr::FUle:
+    return OrExpr::create(unordered, NotExpr::create(lessThan(f, b, a)));
+  case Expr::FOne:
+    return AndExpr::create(ordered, NotExpr::create(equalTo(f, a, b)));
+  case Expr::FUne:
+    return OrExpr::create(unordered, NotExpr::create(equalTo(f, a, b)));
+  default:
+    assert(0 && "invalid floating-point comparison");
+    return ConstantExpr::alloc(0, Expr::Bool);
+  }
+}
+
+/// lowerMinMax - FMin and FMax as FConstantExpr folds them: the other
+/// operand wins unless the comparison says otherwise or it is a NaN.
+ref<Expr> lowerMinMax(bool isMax, const FloatFormat &f, const ref<Expr> &a,
+                      const ref<Expr> &b) {
+  ref<Expr> less = AndExpr::create(
+      NotExpr::create(OrExpr::create(isNaN(f, a), isNaN(f, b))),
+      lessThan(f, a, b));
+  if (isMax)
+    return SelectExpr::create(OrExpr::create(less, isNaN(f, a)), b, a);
+  return SelectExpr::create(OrExpr::create(less, isNaN(f, b)), a, b);
+}
+
+ref<Expr> lowerClassify(Expr::Kind k, const FloatFormat &f,
+                        const ref<Expr> &a, Expr::Width w) {
+  switch (k) {
+  case Expr::FIsNan:
+    return ZExtExpr::create(isNaN(f, a), w);
+  case Expr::FIsFinite:
+    return ZExtExpr::create(NotExpr::create(hasMaxExp(f, a)), w);
+  case Expr::FIsInf:
+    return SelectExpr::create(
+        isInf(f, a),
+        SelectExpr::create(signOf(f, a), bvSigned(-1, w), bvConst(1, w)),
+        bvConst(0, w));
+  case Expr::FpClassify: {
+    ref<Expr> res = bvConst(FP_NORMAL, w);
+    res = SelectExpr::create(isSubnormal(f, a), bvConst(FP_SUBNORMAL, w), res);
+    res = SelectExpr::create(isZero(f, a), bvConst(FP_ZERO, w), res);
+    res = SelectExpr::create(isInf(f, a), bvConst(FP_INFINITE, w), res);
+    return SelectExpr::create(isNaN(f, a), bvConst(FP_NAN, w), res);
+  }
+  default:
+    assert(0 && "invalid floating-point classification");
+    return bvConst(0, w);
+  }
+}
+
+/***/
+
+bool isLowerable(const Expr &e) {
+  if (e.getKind() == Expr::FRem || e.getKind() == Expr::FFma)
+    return false;
+  if (isa<FExpr>(e) && !isSupportedWidth(e.getWidth()))
+    return false;
+  for (unsigned i = 0; i < e.getNumKids(); ++i) {
+    ref<Expr> kid = e.getKid(i);
+    if (isa<FExpr>(kid) && !isSupportedWidth(kid->getWidth()))
+      return false;
+  }
+  return true;
+}
+
+class FloatLoweringChecker : public ExprVisitor {
+protected:
+  Action visitRead(const ReadExpr &re) {
+    for (const UpdateNode *un = re.updates.head; un && supported;
+         un = un->next) {
+      visit(un->index);
+      visit(un->value);
+    }
+    return Action::doChildren();
+  }
+
+  Action visitExpr(const Expr &e) {
+    if (FloatLowering::isFloatKind(e.getKind()) && !isLowerable(e))
+      supported = false;
+    return supported ? Action::doChildren() : Action::skipChildren();
+  }
+
+public:
+  bool supported;
+
+  FloatLoweringChecker() : supported(true) {}
+};
+
+}
+
+bool FloatLowering::isFloatKind(Expr::Kind k) {
+  return k >= Expr::FKindFirst ||
+         (k >= Expr::FToU && k <= Expr::ExplicitInt) ||
+         (k >= Expr::FpClassify && k <= Expr::FIsInf) ||
+         (k >= Expr::FOrd && k <= Expr::FOne);
+}
+
+bool FloatLowering::canLower(const ref<Expr> &e) {
+  FloatLoweringChecker checker;
+  checker.visit(e);
+  return checker.supported;
+}
+
+ref<Expr> FloatLowering::lower(const ref<Expr> &e) {
+  assert(isFloatKind(e->getKind()) && "not a floating-point expression");
+  assert(isLowerable(*e) && "unsupported floating-point expression");
+
+  ExprHashMap< ref<Expr> >::iterator it = lowered.find(e);
+  if (it != lowered.end())
+    return it->second;
+
+  ref<Expr> res = isa<FExpr>(e) ? lowerFloat(e) : lowerFloatUse(e);
+  assert(res->getWidth() == e->getWidth() && "lowering changed the width");
+  lowered.insert(std::make_pair(e, res));
+  return res;
+}
+
+ref<Expr> FloatLowering::lowerFloat(const ref<Expr> &e) {
+  switch (e->getKind()) {
+  case Expr::FConstant:
+    return ConstantExpr::alloc(
+        cast<FConstantExpr>(e)->getAPValue().bitcastToAPInt());
+
+  case Expr::ExplicitFloat:
+    return ZExtExpr::create(e->getKid(0), e->getWidth());
+
+  case Expr::FSelect: {
+    FSelectExpr *se = cast<FSelectExpr>(e);
+    return SelectExpr::create(se->cond, lower(se->trueExpr),
+                              lower(se->falseExpr));
+  }
+
+  case Expr::FExt: {
+    FExtExpr *ce = cast<FExtExpr>(e);
+    return lowerFExt(FloatFormat(ce->src->getWidth()),
+                     FloatFormat(ce->getWidth()), lower(ce->src),
+                     ce->getRoundingMode());
+  }
+
+  case Expr::UToF:
+  case Expr::SToF: {
+    FCastRoundExpr *ce = cast<FCastRoundExpr>(e);
+    return lowerIntToFloat(FloatFormat(ce->getWidth()), ce->src,
+                           e->getKind() == Expr::SToF, ce->getRoundingMode());
+  }
+
+  case Expr::FAbs: {
+    FloatFormat f(e->getWidth());
+    return AndExpr::create(lower(e->getKid(0)), bvLowBits(f.width - 1,
+                                                          f.width));
+  }
+
+  case Expr::FSqrt: {
+    FSqrtExpr *ue = cast<FSqrtExpr>(e);
+    return lowerSqrt(FloatFormat(e->getWidth()), lower(ue->expr),
+                     ue->getRoundingMode());
+  }
+
+  case Expr::FNearbyInt: {
+    FNearbyIntExpr *ue = cast<FNearbyIntExpr>(e);
+    return lowerNearbyInt(FloatFormat(e->getWidth()), lower(ue->expr),
+                          ue->getRoundingMode());
+  }
+
+  case Expr::FAdd:
+  case Expr::FSub:
+  case Expr::FMul:
+  case Expr::FDiv: {
+    FBinaryRoundExpr *be = cast<FBinaryRoundExpr>(e);
+    FloatFormat f(e->getWidth());
+    ref<Expr> left = lower(be->left), right = lower(be->right);
+    llvm::APFloat::roundingMode rm = be->getRoundingMode();
+
+    switch (e->getKind()) {
+    case Expr::FAdd:
+      return lowerAdd(f, left, right, rm);
+    case Expr::FSub:
+      return lowerAdd(f, left, XorExpr::create(right, bvBit(f.width - 1,
+                                                            f.width)), rm);
+    case Expr::FMul:
+      return lowerMul(f, left, right, rm);
+    default:
+      return lowerDiv(f, left, right, rm);
+    }
+  }
+
+  case Expr::FMin:
+  case Expr::FMax: {
+    FBinaryExpr *be = cast<FBinaryExpr>(e);
+    return lowerMinMax(e->getKind() == Expr::FMax, FloatFormat(e->getWidth()),
+                       lower(be->left), lower(be->right));
+  }
+
+  default:
+    assert(0 && "unhandled floating-point expression");
+    return ConstantExpr::alloc(0, e->getWidth());
+  }
+}
+
+ref<Expr> FloatLowering::lowerFloatUse(const ref<Expr> &e) {
+  switch (e->getKind()) {
+  case Expr::ExplicitInt:
+    return ZExtExpr::create(lower(e->getKid(0)), e->getWidth());
+
+  case Expr::FToU:
+  case Expr::FToS: {
+    CastRoundExpr *ce = cast<CastRoundExpr>(e);
+    return lowerFloatToInt(FloatFormat(ce->src->getWidth()), lower(ce->src),
+                           ce->getWidth(), e->getKind() == Expr::FToS);
+  }
+
+  case Expr::FpClassify:
+  case Expr::FIsFinite:
+  case Expr::FIsNan:
+  case Expr::FIsInf: {
+    ref<Expr> kid = e->getKid(0);
+    return lowerClassify(e->getKind(), FloatFormat(kid->getWidth()),
+                         lower(kid), e->getWidth());
+  }
+
+  default: {
+    BinaryExpr *be = cast<BinaryExpr>(e);
+    return lowerCompare(e->getKind(), FloatFormat(be->left->getWidth()),
+                        lower(be->left), lower(be->right));
+  }
+  }
+}
@@ -19,6 +19,7 @@
 #include "klee/util/ArrayCache.h"
 
 #include "llvm/ADT/APInt.h"
+#include "llvm/ADT/StringMap.h"
 #include "llvm/Support/MemoryBuffer.h"
 #include "llvm/Support/raw_ostream.h"
 
@@ -103,7 +104,9 @@ namespace {
 
   /// ParserImpl - Parser implementation.
   class ParserImpl : public Parser {
-    typedef std::map<const std::string, const Identifier*> IdentifierTabTy;
+    // Keyed by the token text itself, so that looking up a known name, by
+    // far the common case, allocates nothing.
+    typedef llvm::StringMap<const Identifier*> IdentifierTabTy;
     typedef std::map<const Identifier*, ExprHandle> ExprSymTabTy;
     typedef std::map<const Identifier*, VersionHandle> VersionSymTabTy;
 
@@ -354,16 +357,10 @@ namespace {
 }
 
 const Identifier *ParserImpl::GetOrCreateIdentifier(const Token &Tok) {
-  // FIXME: Make not horribly inefficient please.
   assert(Tok.kind == Token::Identifier && "Expected only identifier tokens.");
-  std::string Name(Tok.start, Tok.length);
-  IdentifierTabTy::iterator it = IdentifierTab.find(Name);
-  if (it != IdentifierTab.end())
-    return it->second;
-
-  Identifier *I = new Identifier(Name);
-  IdentifierTab.insert(std::make_pair(Name, I));
-
+  const Identifier *&I = IdentifierTab[StringRef(Tok.start, Tok.length)];
+  if (!I)
+    I = new Identifier(std::string(Tok.start, Tok.length));
   return I;
 }
 
@@ -1577,7 +1574,7 @@ ParserImpl::~ParserImpl() {
   for (IdentifierTabTy::iterator pi = IdentifierTab.begin(),
                                  pe = IdentifierTab.end();
        pi != pe; ++pi) {
-    const Identifier* id = pi->second;
+    const Identifier* id = pi->getValue();
     if (freedNodes.insert(id).second)
       delete id;
   }
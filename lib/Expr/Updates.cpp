@@ -19,6 +19,8 @@ UpdateNode::UpdateNode(const UpdateNode *_next,
                        const ref<Expr> &_index, 
                        const ref<Expr> &_value) 
   : refCount(0),    
+    lookupIndex(0),
+    footprint(0),
     next(_next),
     index(_index),
     value(_value) {
@@ -30,7 +32,7 @@ UpdateNode::UpdateNode(const UpdateNode *_next,
   */
   computeHash();
   if (next) {
-    ++next->refCount;
+    incRefCount(next->refCount);
     size = 1 + next->size;
   }
   else size = 1;
@@ -44,6 +46,25 @@ extern "C" void vc_DeleteExpr(void*);
 // non-recursively.
 UpdateNode::~UpdateNode() {
     assert(refCount == 0 && "Deleted UpdateNode when a reference is still held");
+    delete lookupIndex;
+    if (footprint)
+      ArrayFootprint::release(footprint);
+}
+
+const UpdateNodeIndex &UpdateNode::getLookupIndex() const {
+  if (!lookupIndex) {
+    lookupIndex = new UpdateNodeIndex();
+    for (const UpdateNode *un = this; un; un = un->next) {
+      if (ConstantExpr *CE = dyn_cast<ConstantExpr>(un->index)) {
+        // Only the newest update at an index is ever read.
+        lookupIndex->constantUpdates.insert(
+            std::make_pair(CE->getZExtValue(), un));
+      } else {
+        lookupIndex->otherUpdates.push_back(un);
+      }
+    }
+  }
+  return *lookupIndex;
 }
 
 int UpdateNode::compare(const UpdateNode &b) const {
@@ -53,9 +74,14 @@ int UpdateNode::compare(const UpdateNode &b) const {
 }
 
 unsigned UpdateNode::computeHash() {
-  hashValue = index->hash() ^ value->hash();
+  // Mixed in order, so that swapping an index and a value, or two writes,
+  // changes the hash.
+  uint64_t h = (uint64_t) index->hash() << 32 | value->hash();
+  h *= 0x9e3779b97f4a7c15ULL;
   if (next)
-    hashValue ^= next->hash();
+    h ^= next->hash() * 0xc4ceb9fe1a85ec53ULL;
+  h ^= h >> 29;
+  hashValue = (unsigned) (h ^ (h >> 32));
   return hashValue;
 }
 
@@ -64,17 +90,20 @@ unsigned UpdateNode::computeHash() {
 UpdateList::UpdateList(const Array *_root, const UpdateNode *_head)
   : root(_root),
     head(_head) {
-  if (head) ++head->refCount;
+  if (root) root->retain();
+  if (head) incRefCount(head->refCount);
 }
 
 UpdateList::UpdateList(const UpdateList &b)
   : root(b.root),
     head(b.head) {
-  if (head) ++head->refCount;
+  if (root) root->retain();
+  if (head) incRefCount(head->refCount);
 }
 
 UpdateList::~UpdateList() {
     tryFreeNodes();
+    if (root) root->release();
 }
 
 void UpdateList::tryFreeNodes() {
@@ -127,7 +156,7 @@ void UpdateList::tryFreeNodes() {
   //  nullptr
   //  ^Head0
   //
-  while (head && --head->refCount==0) {
+  while (head && decRefCount(head->refCount)==0) {
     const UpdateNode *n = head->next;
     delete head;
     head = n;
@@ -135,10 +164,12 @@ void UpdateList::tryFreeNodes() {
 }
 
 UpdateList &UpdateList::operator=(const UpdateList &b) {
-  if (b.head) ++b.head->refCount;
+  if (b.root) b.root->retain();
+  if (b.head) incRefCount(b.head->refCount);
   // Drop reference to the current head and free a chain of nodes
   // if we are the only UpdateList referencing them
   tryFreeNodes();
+  if (root) root->release();
   root = b.root;
   head = b.head;
   return *this;
@@ -151,9 +182,9 @@ void UpdateList::extend(const ref<Expr> &index, const ref<Expr> &value) {
     assert(root->getRange() == value->getWidth());
   }
 
-  if (head) --head->refCount;
+  if (head) decRefCount(head->refCount);
   head = new UpdateNode(head, index, value);
-  ++head->refCount;
+  incRefCount(head->refCount);
 }
 
 int UpdateList::compare(const UpdateList &b) const {
@@ -45,9 +45,14 @@
 
 #include "llvm/Analysis/ValueTracking.h"
 #include "llvm/Support/ErrorHandling.h"
+#include "llvm/Support/MemoryBuffer.h"
 
-#include <map>
+#include <new>
 #include <string>
+#include <vector>
+
+#include <stdlib.h>
+#include <string.h>
 
 using namespace llvm;
 using namespace klee;
@@ -61,29 +66,37 @@ public:
   }
 };
         
+/// buildInstructionToLineMap - Map the instructions of \a m to their lines in
+/// its assembly, which is stored in \a assembly.
 static void buildInstructionToLineMap(Module *m,
-                                      std::map<const Instruction*, unsigned> &out) {  
+                                      DenseMap<const Instruction*,
+                                               unsigned> &out,
+                                      std::string &assembly) {
   InstructionToLineAnnotator a;
   std::string str;
   llvm::raw_string_ostream os(str);
   m->print(os, &a);
   os.flush();
-  const char *s;
 
+  // Drop the annotations, which start the lines of instructions, while
+  // reading them.
+  assembly.clear();
+  assembly.reserve(str.size());
   unsigned line = 1;
-  for (s=str.c_str(); *s; s++) {
-    if (*s=='\n') {
-      line++;
-      if (s[1]=='%' && s[2]=='%' && s[3]=='%') {
-        s += 4;
-        char *end;
-        unsigned long long value = strtoull(s, &end, 10);
-        if (end!=s) {
-          out.insert(std::make_pair((const Instruction*) value, line));
-        }
-        s = end;
+  for (const char *s = str.c_str(); *s; ++s) {
+    if (s[0]=='%' && s[1]=='%' && s[2]=='%' &&
+        (s == str.c_str() || s[-1] == '\n')) {
+      char *end;
+      unsigned long long value = strtoull(s + 3, &end, 10);
+      if (end != s + 3) {
+        out[(const Instruction*) value] = line;
+        s = end - 1;
+        continue;
       }
     }
+    if (*s=='\n')
+      line++;
+    assembly += *s;
   }
 }
 
@@ -112,12 +125,29 @@ bool InstructionInfoTable::getInstructionDebugInfo(const llvm::Instruction *I,
   return false;
 }
 
-InstructionInfoTable::InstructionInfoTable(Module *m) 
-  : dummyString(""), dummyInfo(0, dummyString, 0, 0) {
-  unsigned id = 0;
-  std::map<const Instruction*, unsigned> lineTable;
-  buildInstructionToLineMap(m, lineTable);
+InstructionInfoTable::InstructionInfoTable()
+  : dummyString(""), dummyInfo(0, dummyString, 0, 0), infos(0), numInfos(0) {
+}
 
+void InstructionInfoTable::allocate(Module *m) {
+  numInfos = 0;
+  for (Module::iterator fnIt = m->begin(), fn_ie = m->end(); 
+       fnIt != fn_ie; ++fnIt)
+    for (inst_iterator it = inst_begin(fnIt), ie = inst_end(fnIt); it != ie;
+         ++it)
+      ids[&*it] = numInfos++;
+  infos = static_cast<InstructionInfo *>(
+      ::operator new(numInfos * sizeof(InstructionInfo)));
+}
+
+InstructionInfoTable::InstructionInfoTable(Module *m, std::string *assembly) 
+  : dummyString(""), dummyInfo(0, dummyString, 0, 0), infos(0), numInfos(0) {
+  DenseMap<const Instruction*, unsigned> lineTable;
+  if (assembly)
+    buildInstructionToLineMap(m, lineTable, *assembly);
+  allocate(m);
+
+  unsigned id = 0;
   for (Module::iterator fnIt = m->begin(), fn_ie = m->end(); 
        fnIt != fn_ie; ++fnIt) {
     Function *fn = static_cast<Function *>(fnIt);
@@ -139,48 +169,166 @@ InstructionInfoTable::InstructionInfoTable(Module *m)
     for (inst_iterator it = inst_begin(fn), ie = inst_end(fn); it != ie;
         ++it) {
       Instruction *instr = &*it;
-      unsigned assemblyLine = lineTable[instr];
+      unsigned assemblyLine = lineTable.lookup(instr);
 
       // Update our source level debug information.
       getInstructionDebugInfo(instr, file, line);
 
-      infos.insert(std::make_pair(instr,
-                                  InstructionInfo(id++, *file, line,
-                                                  assemblyLine)));
+      new (&infos[id]) InstructionInfo(id, *file, line, assemblyLine);
+      ++id;
     }
   }
 }
 
 InstructionInfoTable::~InstructionInfoTable() {
-  for (std::set<const std::string *, ltstr>::iterator
-         it = internedStrings.begin(), ie = internedStrings.end();
-       it != ie; ++it)
-    delete *it;
-}
-
-const std::string *InstructionInfoTable::internString(std::string s) {
-  std::set<const std::string *, ltstr>::iterator it = internedStrings.find(&s);
-  if (it==internedStrings.end()) {
-    std::string *interned = new std::string(s);
-    internedStrings.insert(interned);
-    return interned;
-  } else {
-    return *it;
+  for (unsigned i = 0; i != numInfos; ++i)
+    infos[i].~InstructionInfo();
+  ::operator delete(infos);
+  for (StringMap<std::string*>::iterator it = internedStrings.begin(),
+         ie = internedStrings.end(); it != ie; ++it)
+    delete it->getValue();
+}
+
+const std::string *InstructionInfoTable::internString(const std::string &s) {
+  std::string *&interned = internedStrings[s];
+  if (!interned)
+    interned = new std::string(s);
+  return interned;
+}
+
+// The saved table is "KIIT", a u32 version, the u32 number of file names and
+// each as a u32 length and its characters, then the u32 number of
+// instructions and each as u32 file name index, line and assembly line, in
+// the host's byte order.
+static const uint32_t SavedTableVersion = 1;
+
+static void write32(llvm::raw_ostream &os, uint32_t v) {
+  os.write((const char*) &v, sizeof v);
+}
+
+static bool read32(const char *&p, const char *end, uint32_t &v) {
+  if ((size_t) (end - p) < sizeof v)
+    return false;
+  memcpy(&v, p, sizeof v);
+  p += sizeof v;
+  return true;
+}
+
+bool InstructionInfoTable::save(const std::string &path) const {
+  std::string error;
+#if LLVM_VERSION_CODE >= LLVM_VERSION(3,5)
+  llvm::raw_fd_ostream os(path.c_str(), error, llvm::sys::fs::F_None);
+#elif LLVM_VERSION_CODE >= LLVM_VERSION(3,4)
+  llvm::raw_fd_ostream os(path.c_str(), error, llvm::sys::fs::F_Binary);
+#else
+  llvm::raw_fd_ostream os(path.c_str(), error, llvm::raw_fd_ostream::F_Binary);
+#endif
+  if (!error.empty())
+    return false;
+
+  DenseMap<const std::string*, uint32_t> files;
+  files[&dummyString] = 0;
+  os << "KIIT";
+  write32(os, SavedTableVersion);
+  write32(os, internedStrings.size() + 1);
+  write32(os, 0);
+  for (StringMap<std::string*>::const_iterator it = internedStrings.begin(),
+         ie = internedStrings.end(); it != ie; ++it) {
+    uint32_t index = files.size();
+    files[it->getValue()] = index;
+    write32(os, it->getValue()->size());
+    os << *it->getValue();
+  }
+
+  write32(os, numInfos);
+  for (unsigned i = 0; i != numInfos; ++i) {
+    write32(os, files.lookup(&infos[i].file));
+    write32(os, infos[i].line);
+    write32(os, infos[i].assemblyLine);
+  }
+
+  os.close();
+  if (os.has_error()) {
+    os.clear_error();
+    return false;
+  }
+  return true;
+}
+
+InstructionInfoTable *InstructionInfoTable::load(Module *m,
+                                                 const std::string &path) {
+#if LLVM_VERSION_CODE < LLVM_VERSION(3, 5)
+  OwningPtr<MemoryBuffer> buffer;
+  if (MemoryBuffer::getFile(path, buffer))
+    return 0;
+#else
+  ErrorOr<std::unique_ptr<MemoryBuffer> > file = MemoryBuffer::getFile(path);
+  if (!file)
+    return 0;
+  std::unique_ptr<MemoryBuffer> &buffer = *file;
+#endif
+  const char *p = buffer->getBufferStart(), *end = buffer->getBufferEnd();
+  uint32_t version, numFiles;
+  if (end - p < 4 || memcmp(p, "KIIT", 4))
+    return 0;
+  p += 4;
+  if (!read32(p, end, version) || version != SavedTableVersion ||
+      !read32(p, end, numFiles))
+    return 0;
+
+  InstructionInfoTable *table = new InstructionInfoTable();
+  std::vector<const std::string*> files;
+  for (uint32_t i = 0; i != numFiles; ++i) {
+    uint32_t length;
+    if (!read32(p, end, length) || (size_t) (end - p) < length) {
+      delete table;
+      return 0;
+    }
+    files.push_back(i == 0 ? &table->dummyString :
+                    table->internString(std::string(p, length)));
+    p += length;
+  }
+
+  uint32_t count;
+  table->allocate(m);
+  if (!read32(p, end, count) || count != table->numInfos) {
+    // The constructed entries are none, so none must be destroyed.
+    table->numInfos = 0;
+    delete table;
+    return 0;
+  }
+  for (uint32_t i = 0; i != count; ++i) {
+    uint32_t file, line, assemblyLine;
+    if (!read32(p, end, file) || !read32(p, end, line) ||
+        !read32(p, end, assemblyLine) || file >= files.size()) {
+      table->numInfos = i;
+      delete table;
+      return 0;
+    }
+    new (&table->infos[i]) InstructionInfo(i, *files[file], line,
+                                           assemblyLine);
   }
+  return table;
 }
 
 unsigned InstructionInfoTable::getMaxID() const {
-  return infos.size();
+  return numInfos;
 }
 
 const InstructionInfo &
 InstructionInfoTable::getInfo(const Instruction *inst) const {
-  std::map<const llvm::Instruction*, InstructionInfo>::const_iterator it = 
-    infos.find(inst);
-  if (it == infos.end())
+  DenseMap<const llvm::Instruction*, unsigned>::const_iterator it = 
+    ids.find(inst);
+  if (it == ids.end())
     llvm::report_fatal_error("invalid instruction, not present in "
                              "initial module!");
-  return it->second;
+  return infos[it->second];
+}
+
+const InstructionInfo &InstructionInfoTable::getInfo(unsigned id) const {
+  if (id >= numInfos)
+    llvm::report_fatal_error("invalid instruction id");
+  return infos[id];
 }
 
 const InstructionInfo &
@@ -260,6 +260,15 @@ bool IntrinsicCleanerPass::runOnBasicBlock(BasicBlock &b, Module &M) {
         dirty = true;
         break;
       }
+      case Intrinsic::fma:
+#if LLVM_VERSION_CODE >= LLVM_VERSION(3, 2)
+      case Intrinsic::fmuladd:
+#endif
+        // Scalar fused multiply-adds are executed as such; vector ones are
+        // lowered.
+        if (!ii->getType()->isVectorTy())
+          break;
+        // Fall through.
       default:
         if (LowerIntrinsics)
           IL->LowerIntrinsicCall(ii);
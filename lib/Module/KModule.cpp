@@ -14,6 +14,7 @@
 #include "Passes.h"
 
 #include "klee/Config/Version.h"
+#include "klee/Config/config.h"
 #include "klee/Interpreter.h"
 #include "klee/Internal/Module/Cell.h"
 #include "klee/Internal/Module/KInstruction.h"
@@ -48,7 +49,11 @@
 #endif
 
 #include "llvm/PassManager.h"
+#include "llvm/ADT/SmallPtrSet.h"
+#include "llvm/ADT/StringExtras.h"
 #include "llvm/Support/CommandLine.h"
+#include "llvm/Support/MD5.h"
+#include "llvm/Support/MemoryBuffer.h"
 #include "llvm/Support/raw_ostream.h"
 #include "llvm/Support/raw_os_ostream.h"
 #include "llvm/Support/Path.h"
@@ -59,6 +64,9 @@
 
 #include <sstream>
 
+#include <stdio.h>
+#include <unistd.h>
+
 using namespace llvm;
 using namespace klee;
 
@@ -102,6 +110,17 @@ namespace {
                         clEnumValEnd),
              cl::init(eSwitchTypeInternal));
   
+  cl::opt<bool>
+  ScalarizeVectors("scalarize-vectors",
+                   cl::desc("Break vector instructions into scalar ones "
+                            "before execution, instead of executing them "
+                            "lane by lane (default=on)"),
+                   cl::init(true));
+
+  cl::opt<std::string>
+  PreparedModuleCache("prepared-module-cache",
+                      cl::desc("Keep modules prepared for execution in this directory, named by a hash of the module and of the options and runtime library preparing it, and use them instead of preparing the same module again. Clear it after changing klee (default=off)"));
+
   cl::opt<bool>
   DebugPrintEscapingFunctions("debug-print-escaping-functions", 
                               cl::desc("Print functions whose address is taken."));
@@ -139,6 +158,7 @@ KModule::~KModule() {
 
 namespace llvm {
 extern void Optimize(Module *, const std::string &EntryPoint);
+extern std::string getOptimizeConfiguration();
 }
 
 // what a hack
@@ -245,8 +265,7 @@ void KModule::addInternalFunction(const char* functionName){
   internalFunctions.insert(internalFunction);
 }
 
-void KModule::prepare(const Interpreter::ModuleOptions &opts,
-                      InterpreterHandler *ih) {
+void KModule::transform(const Interpreter::ModuleOptions &opts) {
   LLVMContext &ctx = module->getContext();
 
   if (!MergeAtExit.empty()) {
@@ -301,17 +320,15 @@ void KModule::prepare(const Interpreter::ModuleOptions &opts,
     }
   }
 
-  // Inject checks prior to optimization... we also perform the
-  // invariant transformations that we will end up doing later so that
-  // optimize is seeing what is as close as possible to the final
+  // Perform the invariant transformations that we will end up doing later
+  // so that optimize is seeing what is as close as possible to the final
   // module.
   PassManager pm;
   pm.add(new RaiseAsmPass());
   pm.add(createFunctionScalarizerPass());
-  pm.add(createScalarizerPass());
+  if (ScalarizeVectors)
+    pm.add(createScalarizerPass());
   pm.add(new InstCombiner());
-  if (opts.CheckDivZero) pm.add(new DivCheckPass());
-  if (opts.CheckOvershift) pm.add(new OvershiftCheckPass());
   // FIXME: This false here is to work around a bug in
   // IntrinsicLowering which caches values which may eventually be
   // deleted (via RAUW). This can be removed once LLVM fixes this
@@ -359,14 +376,6 @@ void KModule::prepare(const Interpreter::ModuleOptions &opts,
     );
   module = linkWithLibrary(module, LibPath.str());
 
-  // Add internal functions which are not used to check if instructions
-  // have been already visited
-  if (opts.CheckDivZero)
-    addInternalFunction("klee_div_zero_check");
-  if (opts.CheckOvershift)
-    addInternalFunction("klee_overshift_check");
-
-
   // Needs to happen after linking (since ctors/dtors can be modified)
   // and optimization (since global optimization can rewrite lists).
   injectStaticConstructorsAndDestructors(module);
@@ -398,6 +407,183 @@ void KModule::prepare(const Interpreter::ModuleOptions &opts,
   f = module->getFunction("memset");
   if (f && f->use_empty()) f->eraseFromParent();
 #endif
+}
+
+/// getPreparationKey - A hash of \a m and of everything preparing it depends
+/// on, naming the prepared module in -prepared-module-cache.
+static std::string getPreparationKey(Module *m,
+                                     const Interpreter::ModuleOptions &opts) {
+  MD5 hash;
+  hash.update(PACKAGE_STRING);
+
+  std::string options;
+  raw_string_ostream os(options);
+  os << opts.LibraryDir << '\0' << opts.EntryPoint << '\0' << opts.Optimize
+     << SwitchType
+     << ScalarizeVectors << getOptimizeConfiguration();
+  for (cl::list<std::string>::iterator it = MergeAtExit.begin(),
+         ie = MergeAtExit.end(); it != ie; ++it)
+    os << '\0' << *it;
+  hash.update(os.str());
+
+  // The runtime library linked in.
+  SmallString<128> LibPath(opts.LibraryDir);
+  llvm::sys::path::append(LibPath,
+#if LLVM_VERSION_CODE >= LLVM_VERSION(3,3)
+      "kleeRuntimeIntrinsic.bc"
+#else
+      "libkleeRuntimeIntrinsic.bca"
+#endif
+    );
+#if LLVM_VERSION_CODE < LLVM_VERSION(3, 5)
+  OwningPtr<MemoryBuffer> library;
+  if (!MemoryBuffer::getFile(LibPath.str(), library))
+    hash.update(library->getBuffer());
+#else
+  ErrorOr<std::unique_ptr<MemoryBuffer> > library =
+    MemoryBuffer::getFile(LibPath.str());
+  if (library)
+    hash.update((*library)->getBuffer());
+#endif
+
+  std::string bitcode;
+  raw_string_ostream bos(bitcode);
+  WriteBitcodeToFile(m, bos);
+  hash.update(bos.str());
+
+  MD5::MD5Result result;
+  hash.final(result);
+  SmallString<32> key;
+  MD5::stringifyResult(result, key);
+  return key.str();
+}
+
+/// loadPreparedModule - The module cached at \a path, or null.
+static Module *loadPreparedModule(const std::string &path,
+                                  LLVMContext &ctx) {
+  std::string error;
+#if LLVM_VERSION_CODE < LLVM_VERSION(3, 5)
+  OwningPtr<MemoryBuffer> buffer;
+  if (MemoryBuffer::getFile(path, buffer))
+    return 0;
+  Module *m = ParseBitcodeFile(buffer.get(), ctx, &error);
+#else
+  ErrorOr<std::unique_ptr<MemoryBuffer> > buffer = MemoryBuffer::getFile(path);
+  if (!buffer)
+    return 0;
+  ErrorOr<Module *> parsed = parseBitcodeFile(buffer->get(), ctx);
+  Module *m = parsed ? *parsed : 0;
+  if (!parsed)
+    error = parsed.getError().message();
+#endif
+  if (!m)
+    klee_warning("ignoring prepared module %s: %s", path.c_str(),
+                 error.c_str());
+  return m;
+}
+
+/// storePreparedModule - Cache \a m at \a path, replacing the file at once so
+/// that concurrent runs never read part of it.
+static void storePreparedModule(Module *m, const std::string &path) {
+  std::string temp = path + ".tmp" + llvm::utostr(getpid());
+  std::string error;
+#if LLVM_VERSION_CODE >= LLVM_VERSION(3,5)
+  llvm::raw_fd_ostream os(temp.c_str(), error, llvm::sys::fs::F_None);
+#elif LLVM_VERSION_CODE >= LLVM_VERSION(3,4)
+  llvm::raw_fd_ostream os(temp.c_str(), error, llvm::sys::fs::F_Binary);
+#else
+  llvm::raw_fd_ostream os(temp.c_str(), error, llvm::raw_fd_ostream::F_Binary);
+#endif
+  if (error.empty()) {
+    WriteBitcodeToFile(m, os);
+    os.close();
+    if (!os.has_error() && !rename(temp.c_str(), path.c_str()))
+      return;
+    os.clear_error();
+  }
+  klee_warning("unable to cache the prepared module in %s", path.c_str());
+  unlink(temp.c_str());
+}
+
+/// storePreparedText - Cache \a text at \a path, like storePreparedModule.
+static void storePreparedText(const std::string &text,
+                              const std::string &path) {
+  std::string temp = path + ".tmp" + llvm::utostr(getpid());
+  FILE *f = fopen(temp.c_str(), "wb");
+  if (f) {
+    bool written = fwrite(text.data(), 1, text.size(), f) == text.size();
+    if (!fclose(f) && written && !rename(temp.c_str(), path.c_str()))
+      return;
+  }
+  klee_warning("unable to cache the prepared module in %s", path.c_str());
+  unlink(temp.c_str());
+}
+
+/// loadPreparedText - Read the text cached at \a path into \a text.
+static bool loadPreparedText(const std::string &path, std::string &text) {
+#if LLVM_VERSION_CODE < LLVM_VERSION(3, 5)
+  OwningPtr<MemoryBuffer> buffer;
+  if (MemoryBuffer::getFile(path, buffer))
+    return false;
+  text = buffer->getBuffer();
+#else
+  ErrorOr<std::unique_ptr<MemoryBuffer> > buffer = MemoryBuffer::getFile(path);
+  if (!buffer)
+    return false;
+  text = (*buffer)->getBuffer();
+#endif
+  return true;
+}
+
+void KModule::prepare(const Interpreter::ModuleOptions &opts,
+                      InterpreterHandler *ih) {
+  // The prepared module, its instruction table and its assembly are cached
+  // as <key>.bc, <key>.info and <key>.ll.
+  std::string cachePath;
+  Module *prepared = 0;
+  if (!PreparedModuleCache.empty()) {
+    SmallString<128> path(PreparedModuleCache);
+    llvm::sys::path::append(path, getPreparationKey(module, opts));
+    cachePath = path.str();
+    prepared = loadPreparedModule(cachePath + ".bc", module->getContext());
+  }
+
+  if (prepared) {
+    klee_message("using the prepared module %s.bc", cachePath.c_str());
+    delete module;
+    module = prepared;
+  } else {
+    transform(opts);
+    if (!cachePath.empty())
+      storePreparedModule(module, cachePath + ".bc");
+  }
+
+  // The assembly lines of instructions refer to assembly.ll, so the module
+  // is only printed when that is written or cached.
+  std::string assembly;
+  if (prepared) {
+    infos = InstructionInfoTable::load(module, cachePath + ".info");
+    if (infos && OutputSource &&
+        !loadPreparedText(cachePath + ".ll", assembly)) {
+      delete infos;
+      infos = 0;
+    }
+  }
+  if (!infos) {
+    bool cached = !cachePath.empty();
+    infos = new InstructionInfoTable(module,
+                                     (OutputSource || cached) ? &assembly : 0);
+    if (cached) {
+      std::string temp = cachePath + ".info.tmp" + llvm::utostr(getpid());
+      if (!infos->save(temp) ||
+          rename(temp.c_str(), (cachePath + ".info").c_str())) {
+        klee_warning("unable to cache the prepared module in %s.info",
+                     cachePath.c_str());
+        unlink(temp.c_str());
+      }
+      storePreparedText(assembly, cachePath + ".ll");
+    }
+  }
 
   // Write out the .ll assembly file. We truncate long lines to work
   // around a kcachegrind parsing bug (it puts them on new lines), so
@@ -409,13 +595,9 @@ void KModule::prepare(const Interpreter::ModuleOptions &opts,
     // We have an option for this in case the user wants a .ll they
     // can compile.
     if (NoTruncateSourceLines) {
-      *os << *module;
+      *os << assembly;
     } else {
-      std::string string;
-      llvm::raw_string_ostream rss(string);
-      rss << *module;
-      rss.flush();
-      const char *position = string.c_str();
+      const char *position = assembly.c_str();
 
       for (;;) {
         const char *end = index(position, '\n');
@@ -447,8 +629,6 @@ void KModule::prepare(const Interpreter::ModuleOptions &opts,
 
   /* Build shadow structures */
 
-  infos = new InstructionInfoTable(module);  
-  
   for (Module::iterator it = module->begin(), ie = module->end();
        it != ie; ++it) {
     if (it->isDeclaration())
@@ -532,6 +712,97 @@ static int getOperandNum(Value *v,
   }
 }
 
+/// getStaticTarget - The function \a calledVal calls, looking through
+/// bitcasts and aliases, or null if that isn't known before execution.
+static Function *getStaticTarget(Value *calledVal) {
+  SmallPtrSet<const GlobalValue*, 3> Visited;
+
+  Constant *c = dyn_cast<Constant>(calledVal);
+  while (c) {
+    if (Function *f = dyn_cast<Function>(c))
+      return f;
+    if (GlobalAlias *ga = dyn_cast<GlobalAlias>(c)) {
+      if (!Visited.insert(ga))
+        return 0;
+      c = ga->getAliasee();
+    } else if (llvm::ConstantExpr *ce = dyn_cast<llvm::ConstantExpr>(c)) {
+      if (ce->getOpcode() != Instruction::BitCast)
+        return 0;
+      c = ce->getOperand(0);
+    } else {
+      return 0;
+    }
+  }
+  return 0;
+}
+
+static bool isInLoop(Value *v, const std::set<BasicBlock*> &loop) {
+  Instruction *inst = dyn_cast<Instruction>(v);
+  return inst && loop.count(inst->getParent());
+}
+
+/// Find out whether \a kbi exits a loop the executor can summarize, as
+/// KBranchInstruction::exitSuccessor describes.
+static void findLoopExit(KBranchInstruction *kbi,
+                         std::map<Instruction*, unsigned> &registerMap) {
+  BranchInst *bi = cast<BranchInst>(kbi->inst);
+  if (bi->isUnconditional())
+    return;
+  ICmpInst *cmp = dyn_cast<ICmpInst>(bi->getCondition());
+  if (!cmp)
+    return;
+
+  BasicBlock *exiting = bi->getParent();
+  for (unsigned s = 0; s != 2; ++s) {
+    std::set<BasicBlock*> loop;
+    loop.insert(exiting);
+    BasicBlock *bb = bi->getSuccessor(s);
+    bool closed = false;
+    for (;;) {
+      if (bb == exiting) {
+        closed = true;
+        break;
+      }
+      if (!loop.insert(bb).second)
+        break;
+      BranchInst *next = dyn_cast<BranchInst>(bb->getTerminator());
+      if (!next || next->isConditional())
+        break;
+      bb = next->getSuccessor(0);
+    }
+    if (!closed || loop.count(bi->getSuccessor(1 - s)))
+      continue;
+
+    if (isInLoop(cmp->getOperand(0), loop) ==
+        isInLoop(cmp->getOperand(1), loop))
+      return;
+
+    std::vector<unsigned> liveOuts;
+    for (std::set<BasicBlock*>::iterator it = loop.begin(), ie = loop.end();
+         it != ie; ++it) {
+      for (BasicBlock::iterator ii = (*it)->begin(), ie = (*it)->end();
+           ii != ie; ++ii) {
+        Instruction *inst = static_cast<Instruction *>(ii);
+        if (inst->mayWriteToMemory() || isa<CallInst>(inst) ||
+            isa<InvokeInst>(inst) || isa<AllocaInst>(inst) ||
+            isa<VAArgInst>(inst))
+          return;
+        for (Value::use_iterator ui = inst->use_begin(),
+               ue = inst->use_end(); ui != ue; ++ui) {
+          if (!isInLoop(*ui, loop)) {
+            liveOuts.push_back(registerMap[inst]);
+            break;
+          }
+        }
+      }
+    }
+
+    kbi->exitSuccessor = 1 - s;
+    kbi->liveOuts = liveOuts;
+    return;
+  }
+}
+
 KFunction::KFunction(llvm::Function *_function,
                      KModule *km) 
   : function(_function),
@@ -571,6 +842,13 @@ KFunction::KFunction(llvm::Function *_function,
       case Instruction::InsertValue:
       case Instruction::ExtractValue:
         ki = new KGEPInstruction(); break;
+      case Instruction::Br:
+        ki = new KBranchInstruction(); break;
+      case Instruction::Switch:
+        ki = new KSwitchInstruction(); break;
+      case Instruction::Call:
+      case Instruction::Invoke:
+        ki = new KCallInstruction(); break;
       default:
         ki = new KInstruction(); break;
       }
@@ -578,9 +856,18 @@ KFunction::KFunction(llvm::Function *_function,
       Instruction *inst = static_cast<Instruction *>(it);
       ki->inst = inst;
       ki->dest = registerMap[inst];
+      ki->opcode = inst->getOpcode();
+      ki->predicate = 0;
+      if (CmpInst *ci = dyn_cast<CmpInst>(inst))
+        ki->predicate = ci->getPredicate();
+      ki->width = inst->getType()->isSized() ?
+        km->targetData->getTypeSizeInBits(inst->getType()) : 0;
+      ki->isVector = inst->getType()->isVectorTy();
 
       if (isa<CallInst>(it) || isa<InvokeInst>(it)) {
         CallSite cs(inst);
+        static_cast<KCallInstruction*>(ki)->staticTarget =
+          getStaticTarget(cs.getCalledValue());
         unsigned numArgs = cs.arg_size();
         ki->operands = new int[numArgs+1];
         ki->operands[0] = getOperandNum(cs.getCalledValue(), registerMap, km,
@@ -598,6 +885,9 @@ KFunction::KFunction(llvm::Function *_function,
         }
       }
 
+      if (isa<BranchInst>(inst))
+        findLoopExit(static_cast<KBranchInstruction*>(ki), registerMap);
+
       instructions[i++] = ki;
     }
   }
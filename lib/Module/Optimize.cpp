@@ -44,6 +44,7 @@
 #include "llvm/Transforms/IPO.h"
 #include "llvm/Transforms/Scalar.h"
 #include "llvm/Support/PluginLoader.h"
+#include "llvm/Support/raw_ostream.h"
 using namespace llvm;
 
 // Don't verify at the end
@@ -160,6 +161,16 @@ static void AddStandardCompilePasses(PassManager &PM) {
   addPass(PM, createConstantMergePass());        // Merge dup global constants
 }
 
+/// getOptimizeConfiguration - The options Optimize depends on, so that
+/// modules it prepared can be told apart.
+std::string getOptimizeConfiguration() {
+  std::string result;
+  raw_string_ostream os(result);
+  os << DisableInline << DisableOptimizations << DisableInternalize << Strip
+     << StripDebug;
+  return os.str();
+}
+
 /// Optimize - Perform link time optimizations. This will run the scalar
 /// optimizations, any loaded plugin-optimization modules, and then the
 /// inter-procedural optimizations if applicable.
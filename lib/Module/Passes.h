@@ -121,34 +121,6 @@ public:
   virtual bool runOnFunction(llvm::Function &f);
 };
   
-class DivCheckPass : public llvm::ModulePass {
-  static char ID;
-public:
-  DivCheckPass(): ModulePass(ID) {}
-  virtual bool runOnModule(llvm::Module &M);
-};
-
-/// This pass injects checks to check for overshifting.
-///
-/// Overshifting is where a Shl, LShr or AShr is performed
-/// where the shift amount is greater than width of the bitvector
-/// being shifted.
-/// In LLVM (and in C/C++) this undefined behaviour!
-///
-/// Example:
-/// \code
-///     unsigned char x=15;
-///     x << 4 ; // Defined behaviour
-///     x << 8 ; // Undefined behaviour
-///     x << 255 ; // Undefined behaviour
-/// \endcode
-class OvershiftCheckPass : public llvm::ModulePass {
-  static char ID;
-public:
-  OvershiftCheckPass(): ModulePass(ID) {}
-  virtual bool runOnModule(llvm::Module &M);
-};
-
 /// LowerSwitchPass - Replace all SwitchInst instructions with chained branch
 /// instructions.  Note that this cannot be a BasicBlock pass because it
 /// modifies the CFG!
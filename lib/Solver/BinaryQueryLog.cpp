@@ -0,0 +1,547 @@
+//===-- BinaryQueryLog.cpp ------------------------------------------------===//
+//
+//                     The KLEE Symbolic Virtual Machine
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+
+#include "klee/Internal/Support/BinaryQueryLog.h"
+
+#include "klee/Config/config.h"
+#include "klee/Constraints.h"
+#include "klee/Solver.h"
+#include "klee/util/ArrayCache.h"
+
+#include "llvm/Support/raw_ostream.h"
+
+#include <errno.h>
+#include <stdio.h>
+#include <string.h>
+#ifdef HAVE_ZLIB_H
+#include <zlib.h>
+#include <unistd.h>
+#endif
+
+using namespace klee;
+
+const char *binlog::getQueryTypeName(QueryType type) {
+  switch (type) {
+  case Truth: return "Truth";
+  case Validity: return "Validity";
+  case Value: return "Value";
+  case InitialValues: return "InitialValues";
+  }
+  return "Unknown";
+}
+
+static const uint32_t None = ~0u;
+
+static bool isCastKind(Expr::Kind k) {
+  return (k >= Expr::CastKindFirst && k <= Expr::CastKindLast) ||
+         (k >= Expr::FCastKindFirst && k <= Expr::FCastKindLast);
+}
+
+static bool hasRoundingMode(Expr::Kind k) {
+  return (k >= Expr::CastRoundKindFirst && k <= Expr::CastRoundKindLast) ||
+         (k >= Expr::FCastRoundKindFirst && k <= Expr::FCastRoundKindLast) ||
+         (k >= Expr::FUnaryRoundKindFirst && k <= Expr::FUnaryRoundKindLast) ||
+         (k >= Expr::FBinaryRoundKindFirst && k <= Expr::FBinaryRoundKindLast);
+}
+
+static llvm::APFloat::roundingMode getRoundingMode(const Expr *e) {
+  if (const CastRoundExpr *cre = dyn_cast<CastRoundExpr>(e))
+    return cre->getRoundingMode();
+  if (const FCastRoundExpr *fcre = dyn_cast<FCastRoundExpr>(e))
+    return fcre->getRoundingMode();
+  if (const FUnaryRoundExpr *fure = dyn_cast<FUnaryRoundExpr>(e))
+    return fure->getRoundingMode();
+  return cast<FBinaryRoundExpr>(e)->getRoundingMode();
+}
+
+static const llvm::fltSemantics *widthToSemantics(Expr::Width width) {
+  switch (width) {
+  case Expr::Fl32: return &llvm::APFloat::IEEEsingle;
+  case Expr::Fl64: return &llvm::APFloat::IEEEdouble;
+  case Expr::Fl80: return &llvm::APFloat::x87DoubleExtended;
+  default: return 0;
+  }
+}
+
+/***/
+
+void BinaryQueryWriter::write8(uint8_t v) {
+  os << (char) v;
+}
+
+void BinaryQueryWriter::write32(uint32_t v) {
+  for (unsigned i = 0; i != 4; ++i)
+    write8((uint8_t) (v >> (8 * i)));
+}
+
+void BinaryQueryWriter::write64(uint64_t v) {
+  write32((uint32_t) v);
+  write32((uint32_t) (v >> 32));
+}
+
+void BinaryQueryWriter::writeAPInt(const llvm::APInt &v) {
+  write32(v.getBitWidth());
+  const uint64_t *words = v.getRawData();
+  for (unsigned i = 0, e = v.getNumWords(); i != e; ++i)
+    write64(words[i]);
+}
+
+void BinaryQueryWriter::writeHeader() {
+  os << "KQLB";
+  write32(binlog::Version);
+}
+
+uint32_t BinaryQueryWriter::writeArray(const Array *array) {
+  std::map<const Array*, uint32_t>::iterator it = arrayIds.find(array);
+  if (it != arrayIds.end())
+    return it->second;
+
+  write8('A');
+  write32(array->name.size());
+  os << array->name;
+  write32(array->size);
+  write32(array->domain);
+  write32(array->range);
+  write32(array->constantValues.size());
+  for (std::vector< ref<ConstantExpr> >::const_iterator
+         ci = array->constantValues.begin(),
+         ce = array->constantValues.end(); ci != ce; ++ci)
+    writeAPInt((*ci)->getAPValue());
+
+  uint32_t id = arrayIds.size();
+  arrayIds.insert(std::make_pair(array, id));
+  return id;
+}
+
+uint32_t BinaryQueryWriter::writeUpdates(const UpdateList &updates) {
+  if (!updates.head)
+    return None;
+
+  // Write the nodes not seen before oldest first, so that each one can refer
+  // to its successor. Walking the list iteratively keeps long update chains
+  // from exhausting the stack.
+  std::vector<const UpdateNode*> pending;
+  for (const UpdateNode *un = updates.head; un && !updateIds.count(un);
+       un = un->next)
+    pending.push_back(un);
+
+  uint32_t root = writeArray(updates.root);
+  for (std::vector<const UpdateNode*>::reverse_iterator
+         it = pending.rbegin(), ie = pending.rend(); it != ie; ++it) {
+    const UpdateNode *un = *it;
+    uint32_t index = writeExpr(un->index);
+    uint32_t value = writeExpr(un->value);
+    write8('U');
+    write32(root);
+    write32(un->next ? updateIds[un->next] : None);
+    write32(index);
+    write32(value);
+    uint32_t id = updateIds.size();
+    updateIds.insert(std::make_pair(un, id));
+  }
+  return updateIds[updates.head];
+}
+
+uint32_t BinaryQueryWriter::writeExpr(const ref<Expr> &e) {
+  ExprHashMap<uint32_t>::iterator it = exprIds.find(e);
+  if (it != exprIds.end())
+    return it->second;
+
+  uint32_t array = None, updates = None;
+  if (const ReadExpr *re = dyn_cast<ReadExpr>(e)) {
+    array = writeArray(re->updates.root);
+    updates = writeUpdates(re->updates);
+  }
+  std::vector<uint32_t> kids;
+  for (unsigned i = 0, n = e->getNumKids(); i != n; ++i)
+    kids.push_back(writeExpr(e->getKid(i)));
+
+  write8('E');
+  write8(e->getKind());
+  write32(e->getWidth());
+  write8(kids.size());
+  for (unsigned i = 0; i != kids.size(); ++i)
+    write32(kids[i]);
+
+  if (const ConstantExpr *ce = dyn_cast<ConstantExpr>(e)) {
+    writeAPInt(ce->getAPValue());
+  } else if (const FConstantExpr *fce = dyn_cast<FConstantExpr>(e)) {
+    writeAPInt(fce->getAPValue().bitcastToAPInt());
+  } else if (isa<ReadExpr>(e)) {
+    write32(array);
+    write32(updates);
+  } else if (const ExtractExpr *ee = dyn_cast<ExtractExpr>(e)) {
+    write32(ee->offset);
+  } else if (hasRoundingMode(e->getKind())) {
+    write8(getRoundingMode(e.get()));
+  }
+
+  uint32_t id = exprIds.size();
+  exprIds.insert(std::make_pair(e, id));
+  return id;
+}
+
+void BinaryQueryWriter::writeQuery(binlog::QueryType type,
+                                   uint64_t instructions, const Query &query,
+                                   const std::vector<const Array*> *objects) {
+  // Nodes are only shared within a query, so that a reader need not keep
+  // earlier queries and a logger may drop them.
+  exprIds.clear();
+  arrayIds.clear();
+  updateIds.clear();
+
+  write8('Q');
+  write8(type);
+  write64(instructions);
+
+  std::vector<uint32_t> constraints;
+  for (ConstraintManager::const_iterator it = query.constraints.begin(),
+         ie = query.constraints.end(); it != ie; ++it)
+    constraints.push_back(writeExpr(*it));
+  uint32_t expr = writeExpr(query.expr);
+  std::vector<uint32_t> arrays;
+  if (objects)
+    for (std::vector<const Array*>::const_iterator it = objects->begin(),
+           ie = objects->end(); it != ie; ++it)
+      arrays.push_back(writeArray(*it));
+
+  write8('X');
+  write32(constraints.size());
+  for (unsigned i = 0; i != constraints.size(); ++i)
+    write32(constraints[i]);
+  write32(expr);
+  write32(arrays.size());
+  for (unsigned i = 0; i != arrays.size(); ++i)
+    write32(arrays[i]);
+}
+
+void BinaryQueryWriter::writeResult(bool success, uint64_t elapsed,
+                                    binlog::Answer answer) {
+  write8('R');
+  write8(success);
+  write64(elapsed);
+  write8(answer);
+}
+
+/***/
+
+struct BinaryQueryReader::Stream {
+#ifdef HAVE_ZLIB_H
+  /// The log, unless it is read from \a file.
+  gzFile gz;
+#endif
+  FILE *file;
+  bool ownsFile;
+};
+
+BinaryQueryReader::BinaryQueryReader(ArrayCache &_arrayCache)
+  : stream(0), arrayCache(_arrayCache), pendingTag(EOF) {}
+
+BinaryQueryReader::~BinaryQueryReader() {
+  if (stream) {
+#ifdef HAVE_ZLIB_H
+    if (stream->gz)
+      gzclose(stream->gz);
+#endif
+    if (stream->file && stream->ownsFile)
+      fclose(stream->file);
+    delete stream;
+  }
+}
+
+bool BinaryQueryReader::fail(const std::string &message) {
+  if (error.empty())
+    error = message;
+  return false;
+}
+
+bool BinaryQueryReader::read(void *buf, size_t n) {
+  if (!error.empty())
+    return false;
+#ifdef HAVE_ZLIB_H
+  bool ok = stream->gz ? gzread(stream->gz, buf, n) == (int) n
+                       : fread(buf, 1, n, stream->file) == n;
+#else
+  bool ok = fread(buf, 1, n, stream->file) == n;
+#endif
+  return ok || fail("unexpected end of file");
+}
+
+bool BinaryQueryReader::read8(uint8_t &v) {
+  return read(&v, 1);
+}
+
+bool BinaryQueryReader::read32(uint32_t &v) {
+  unsigned char b[4];
+  if (!read(b, 4))
+    return false;
+  v = b[0] | (b[1] << 8) | (b[2] << 16) | ((uint32_t) b[3] << 24);
+  return true;
+}
+
+bool BinaryQueryReader::read64(uint64_t &v) {
+  uint32_t lo, hi;
+  if (!read32(lo) || !read32(hi))
+    return false;
+  v = lo | ((uint64_t) hi << 32);
+  return true;
+}
+
+bool BinaryQueryReader::readAPInt(llvm::APInt &v) {
+  uint32_t width;
+  if (!read32(width))
+    return false;
+  if (width == 0 || width > (1u << 24))
+    return fail("invalid constant width");
+  std::vector<uint64_t> words((width + 63) / 64);
+  for (unsigned i = 0; i != words.size(); ++i)
+    if (!read64(words[i]))
+      return false;
+  v = llvm::APInt(width, words);
+  return true;
+}
+
+int BinaryQueryReader::nextTag() {
+  if (pendingTag != EOF) {
+    int tag = pendingTag;
+    pendingTag = EOF;
+    return tag;
+  }
+#ifdef HAVE_ZLIB_H
+  if (stream->gz)
+    return gzgetc(stream->gz);
+#endif
+  return getc(stream->file);
+}
+
+bool BinaryQueryReader::open(const std::string &path) {
+  stream = new Stream;
+#ifdef HAVE_ZLIB_H
+  // gzip reads uncompressed files transparently.
+  stream->gz = path == "-" ? gzdopen(dup(STDIN_FILENO), "rb")
+                           : gzopen(path.c_str(), "rb");
+  stream->file = 0;
+  bool opened = stream->gz;
+#else
+  stream->file = path == "-" ? stdin : fopen(path.c_str(), "rb");
+  bool opened = stream->file;
+#endif
+  stream->ownsFile = path != "-";
+  if (!opened) {
+    delete stream;
+    stream = 0;
+    return fail(std::string("cannot open ") + path + ": " + strerror(errno));
+  }
+  return readHeader();
+}
+
+bool BinaryQueryReader::open(FILE *file) {
+  stream = new Stream;
+#ifdef HAVE_ZLIB_H
+  stream->gz = 0;
+#endif
+  stream->file = file;
+  stream->ownsFile = false;
+  return readHeader();
+}
+
+bool BinaryQueryReader::readHeader() {
+  char magic[4];
+  uint32_t version;
+  if (!read(magic, 4) || memcmp(magic, "KQLB", 4))
+    return fail("not a binary query log");
+  if (!read32(version))
+    return false;
+  if (version != binlog::Version)
+    return fail("unsupported version of the binary query log");
+  return true;
+}
+
+bool BinaryQueryReader::readQuery(BinaryQuery &query) {
+  if (!stream || !error.empty())
+    return false;
+
+  int tag = nextTag();
+  if (tag == EOF)
+    return false;
+  if (tag != 'Q')
+    return fail("corrupt record");
+
+  uint8_t type;
+  if (!read8(type) || !read64(query.instructions))
+    return false;
+  if (type < binlog::Truth || type > binlog::InitialValues)
+    return fail("invalid query type");
+  query.type = (binlog::QueryType) type;
+
+  std::vector<const Array*> arrays;
+  std::vector<UpdateList> updates;
+  std::vector< ref<Expr> > exprs;
+  for (;;) {
+    tag = nextTag();
+    if (tag == 'X') {
+      break;
+    } else if (tag == 'A') {
+      uint32_t length, size, domain, range, n;
+      if (!read32(length))
+        return false;
+      std::string name(length, '\0');
+      if ((length && !read(&name[0], length)) || !read32(size) ||
+          !read32(domain) || !read32(range) || !read32(n))
+        return false;
+      if (n && n != size)
+        return fail("invalid constant array");
+      std::vector< ref<ConstantExpr> > values;
+      for (unsigned i = 0; i != n; ++i) {
+        llvm::APInt v;
+        if (!readAPInt(v))
+          return false;
+        values.push_back(ConstantExpr::alloc(v));
+      }
+      arrays.push_back(n ? arrayCache.CreateArray(name, size, &values[0],
+                                                  &values[0] + n, domain, range)
+                         : arrayCache.CreateArray(name, size, 0, 0, domain,
+                                                  range));
+    } else if (tag == 'U') {
+      uint32_t root, next, index, value;
+      if (!read32(root) || !read32(next) || !read32(index) || !read32(value))
+        return false;
+      if (root >= arrays.size() ||
+          (next != None && (next >= updates.size() ||
+                            updates[next].root != arrays[root])) ||
+          index >= exprs.size() || value >= exprs.size())
+        return fail("invalid update");
+      UpdateList ul = next == None ? UpdateList(arrays[root], 0)
+                                   : updates[next];
+      ul.extend(exprs[index], exprs[value]);
+      updates.push_back(ul);
+    } else if (tag == 'E') {
+      uint8_t k, n;
+      uint32_t width;
+      if (!read8(k) || !read32(width) || !read8(n))
+        return false;
+      if (k > Expr::LastKind || k == Expr::NotOptimized + 1)
+        return fail("invalid expression kind");
+      std::vector< ref<Expr> > kids;
+      for (unsigned i = 0; i != n; ++i) {
+        uint32_t kid;
+        if (!read32(kid))
+          return false;
+        if (kid >= exprs.size())
+          return fail("invalid expression");
+        kids.push_back(exprs[kid]);
+      }
+
+      Expr::Kind kind = (Expr::Kind) k;
+      ref<Expr> e;
+      if (kind == Expr::Constant || kind == Expr::FConstant) {
+        llvm::APInt v;
+        if (n || !readAPInt(v))
+          return fail("invalid constant");
+        if (kind == Expr::Constant) {
+          e = ConstantExpr::alloc(v);
+        } else {
+          const llvm::fltSemantics *sem = widthToSemantics(v.getBitWidth());
+          if (!sem)
+            return fail("invalid floating point constant");
+          e = FConstantExpr::alloc(llvm::APFloat(*sem, v));
+        }
+      } else if (kind == Expr::Read) {
+        uint32_t array, update;
+        if (n != 1 || !read32(array) || !read32(update))
+          return fail("invalid read");
+        if (array >= arrays.size() ||
+            (update != None && (update >= updates.size() ||
+                                updates[update].root != arrays[array])))
+          return fail("invalid read");
+        e = ReadExpr::create(update == None ? UpdateList(arrays[array], 0)
+                                            : updates[update], kids[0]);
+      } else if (kind == Expr::Extract) {
+        uint32_t offset;
+        if (n != 1 || !read32(offset))
+          return fail("invalid extract");
+        if (offset + width > kids[0]->getWidth())
+          return fail("invalid extract");
+        e = ExtractExpr::create(kids[0], offset, width);
+      } else if (kind == Expr::Not) {
+        if (n != 1)
+          return fail("invalid expression");
+        e = NotExpr::create(kids[0]);
+      } else {
+        unsigned expected;
+        if (kind == Expr::Select || kind == Expr::FSelect)
+          expected = 3;
+        else if (kind == Expr::NotOptimized || isCastKind(kind) ||
+                 (kind >= Expr::UnaryKindFirst &&
+                  kind <= Expr::UnaryKindLast) ||
+                 (kind >= Expr::FUnaryKindFirst &&
+                  kind <= Expr::FUnaryKindLast))
+          expected = 1;
+        else
+          expected = 2;
+        if (n != expected)
+          return fail("invalid expression");
+
+        std::vector<Expr::CreateArg> args(kids.begin(), kids.end());
+        if (isCastKind(kind))
+          args.push_back(Expr::CreateArg(width));
+        if (hasRoundingMode(kind)) {
+          uint8_t rm;
+          if (!read8(rm))
+            return false;
+          args.push_back(Expr::CreateArg((llvm::APFloat::roundingMode) rm));
+        }
+        e = Expr::createFromKind(kind, args);
+      }
+      exprs.push_back(e);
+    } else {
+      return fail(tag == EOF ? "unexpected end of file" : "corrupt query");
+    }
+  }
+
+  uint32_t n, expr;
+  if (!read32(n))
+    return false;
+  query.constraints.clear();
+  for (unsigned i = 0; i != n; ++i) {
+    uint32_t c;
+    if (!read32(c))
+      return false;
+    if (c >= exprs.size())
+      return fail("invalid constraint");
+    query.constraints.push_back(exprs[c]);
+  }
+  if (!read32(expr) || !read32(n))
+    return false;
+  if (expr >= exprs.size())
+    return fail("invalid query expression");
+  query.expr = exprs[expr];
+  query.objects.clear();
+  for (unsigned i = 0; i != n; ++i) {
+    uint32_t a;
+    if (!read32(a))
+      return false;
+    if (a >= arrays.size())
+      return fail("invalid object");
+    query.objects.push_back(arrays[a]);
+  }
+
+  query.hasResult = false;
+  pendingTag = nextTag();
+  if (pendingTag == 'R') {
+    pendingTag = EOF;
+    uint8_t success, answer;
+    if (!read8(success) || !read64(query.elapsed) || !read8(answer))
+      return false;
+    query.hasResult = true;
+    query.success = success;
+    query.answer = (binlog::Answer) answer;
+  }
+  return true;
+}
@@ -0,0 +1,117 @@
+//===-- BinaryQueryLoggingSolver.cpp --------------------------------------===//
+//
+//                     The KLEE Symbolic Virtual Machine
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+
+#include "QueryLoggingSolver.h"
+
+#include "klee/Statistics.h"
+#include "klee/Internal/Support/BinaryQueryLog.h"
+#include "klee/Internal/System/Time.h"
+
+using namespace klee;
+using namespace klee::util;
+
+/// This QueryLoggingSolver logs queries and their results in the binary query
+/// log format (see BinaryQueryLog.h), which is much smaller than the text
+/// formats and can be replayed without parsing.
+class BinaryQueryLoggingSolver : public QueryLoggingSolver {
+private:
+  BinaryQueryWriter writer;
+  binlog::QueryType type;
+
+  virtual void startQuery(const Query &query, const char *typeName,
+                          const Query *falseQuery = 0,
+                          const std::vector<const Array *> *objects = 0) {
+    printQuery(query, falseQuery, objects);
+    startTime = getWallTime();
+  }
+
+  virtual void finishQuery(bool success) {
+    lastQueryTime = getWallTime() - startTime;
+  }
+
+  virtual void printQuery(const Query &query, const Query *falseQuery = 0,
+                          const std::vector<const Array *> *objects = 0) {
+    Statistic *S = theStatisticManager->getStatisticByName("Instructions");
+    uint64_t instructions = S ? S->getValue() : 0;
+    ++queryCount;
+    writer.writeQuery(type, instructions, query, objects);
+  }
+
+  void logResult(bool success, binlog::Answer answer) {
+    writer.writeResult(success, (uint64_t) (lastQueryTime * 1000000.),
+                       success ? answer : binlog::NoAnswer);
+    flushBuffer();
+  }
+
+public:
+  BinaryQueryLoggingSolver(Solver *_solver, std::string path,
+                           int queryTimeToLog)
+      : QueryLoggingSolver(_solver, path, "", queryTimeToLog),
+        writer(logBuffer), type(binlog::Truth) {
+    BinaryQueryWriter(*os).writeHeader();
+    os->flush();
+  }
+
+  bool computeTruth(const Query &query, bool &isValid) {
+    type = binlog::Truth;
+    startQuery(query, "Truth");
+    bool success = solver->impl->computeTruth(query, isValid);
+    finishQuery(success);
+    logResult(success, isValid ? binlog::True : binlog::False);
+    return success;
+  }
+
+  bool computeValidity(const Query &query, Solver::Validity &result) {
+    type = binlog::Validity;
+    startQuery(query, "Validity");
+    bool success = solver->impl->computeValidity(query, result);
+    finishQuery(success);
+    logResult(success, result == Solver::True
+                           ? binlog::True
+                           : result == Solver::False ? binlog::False
+                                                     : binlog::Unknown);
+    return success;
+  }
+
+  bool computeValue(const Query &query, ref<Expr> &result) {
+    type = binlog::Value;
+    startQuery(query, "Value");
+    bool success = solver->impl->computeValue(query, result);
+    finishQuery(success);
+    logResult(success, binlog::NoAnswer);
+    return success;
+  }
+
+  // Ranges have no query type of their own in the log, so they pass
+  // through unlogged.
+  bool computeRange(const Query &query, ref<Expr> &min, ref<Expr> &max) {
+    return solver->impl->computeRange(query, min, max);
+  }
+
+  bool computeInitialValues(const Query &query,
+                            const std::vector<const Array *> &objects,
+                            std::vector<std::vector<unsigned char> > &values,
+                            bool &hasSolution) {
+    type = binlog::InitialValues;
+    startQuery(query, "InitialValues", 0, &objects);
+    bool success =
+        solver->impl->computeInitialValues(query, objects, values, hasSolution);
+    finishQuery(success);
+    logResult(success, hasSolution ? binlog::True : binlog::False);
+    return success;
+  }
+};
+
+///
+
+Solver *klee::createBinaryQueryLoggingSolver(Solver *_solver, std::string path,
+                                             int minQueryTimeToLog) {
+  return new Solver(
+      new BinaryQueryLoggingSolver(_solver, path, minQueryTimeToLog));
+}
@@ -0,0 +1,786 @@
+//===-- BitwuzlaBuilder.cpp ------------------------------------*- C++ -*-====//
+//
+//                     The KLEE Symbolic Virtual Machine
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+#include "klee/Config/config.h"
+#ifdef ENABLE_BITWUZLA
+#include "BitwuzlaBuilder.h"
+
+#include "klee/Expr.h"
+#include "klee/SolverStats.h"
+#include "ConstructOrder.h"
+
+#include "llvm/ADT/StringExtras.h"
+
+#include <math.h>
+
+using namespace klee;
+
+BitwuzlaBuilder::BitwuzlaBuilder()
+    : constructingKids(false), numBuilt(0),
+      tm(bitwuzla_term_manager_new()) {}
+
+BitwuzlaBuilder::~BitwuzlaBuilder() {
+  // Frees every sort and term built, so the caches go with it.
+  bitwuzla_term_manager_delete(tm);
+}
+
+BitwuzlaSort BitwuzlaBuilder::getBvSort(unsigned width) {
+  return bitwuzla_mk_bv_sort(tm, width);
+}
+
+/// toFloat - Convert \a src by \a kind to a float of \a width bits, rounding
+/// by \a rm unless it is null.
+BitwuzlaTerm BitwuzlaBuilder::toFloat(BitwuzlaKind kind, BitwuzlaTerm rm,
+                                      BitwuzlaTerm src, unsigned width) {
+  assert((width == Expr::Fl32 || width == Expr::Fl64) &&
+         "float format not supported by Bitwuzla builder");
+  // The significand sizes include the hidden bit.
+  uint64_t exponent = width == Expr::Fl32 ? 8 : 11;
+  uint64_t significand = width == Expr::Fl32 ? 24 : 53;
+  if (!rm)
+    return bitwuzla_mk_term1_indexed2(tm, kind, src, exponent, significand);
+  return bitwuzla_mk_term2_indexed2(tm, kind, rm, src, exponent, significand);
+}
+
+BitwuzlaTerm BitwuzlaBuilder::bvConst(unsigned width, uint64_t value) {
+  return bitwuzla_mk_bv_value_uint64(tm, getBvSort(width), value);
+}
+
+BitwuzlaTerm BitwuzlaBuilder::bvSExtConst(unsigned width, int64_t value) {
+  if (width <= 64)
+    return bvConst(width, (uint64_t)value);
+  return bitwuzla_mk_term1_indexed1(tm, BITWUZLA_KIND_BV_SIGN_EXTEND,
+                                    bvConst(64, (uint64_t)value), width - 64);
+}
+
+BitwuzlaTerm BitwuzlaBuilder::bvBoolExtract(BitwuzlaTerm expr, unsigned bit) {
+  return bitwuzla_mk_term2(
+      tm, BITWUZLA_KIND_EQUAL,
+      bitwuzla_mk_term1_indexed2(tm, BITWUZLA_KIND_BV_EXTRACT, expr, bit, bit),
+      bvConst(1, 1));
+}
+
+BitwuzlaTerm BitwuzlaBuilder::boolToBv(BitwuzlaTerm expr) {
+  return bitwuzla_mk_term3(tm, BITWUZLA_KIND_ITE, expr, bvConst(1, 1),
+                           bvConst(1, 0));
+}
+
+BitwuzlaTerm
+BitwuzlaBuilder::getRoundingMode(llvm::APFloat::roundingMode rm) {
+  switch (rm) {
+  default:
+  case llvm::APFloat::rmNearestTiesToEven:
+    return bitwuzla_mk_rm_value(tm, BITWUZLA_RM_RNE);
+  case llvm::APFloat::rmTowardPositive:
+    return bitwuzla_mk_rm_value(tm, BITWUZLA_RM_RTP);
+  case llvm::APFloat::rmTowardNegative:
+    return bitwuzla_mk_rm_value(tm, BITWUZLA_RM_RTN);
+  case llvm::APFloat::rmTowardZero:
+    return bitwuzla_mk_rm_value(tm, BITWUZLA_RM_RTZ);
+  case llvm::APFloat::rmNearestTiesToAway:
+    return bitwuzla_mk_rm_value(tm, BITWUZLA_RM_RNA);
+  }
+}
+
+BitwuzlaTerm BitwuzlaBuilder::isNan(BitwuzlaTerm expr) {
+  return bitwuzla_mk_term1(tm, BITWUZLA_KIND_FP_IS_NAN, expr);
+}
+
+/// fmod - The remainder of \a left divided by \a right truncated towards
+/// zero, as fmod() and APFloat::mod() compute it, where fp.rem divides
+/// rounding to nearest. The two differ by \a right exactly when the IEEE
+/// remainder is nonzero and has the other sign than \a left; the sum is
+/// the exact fmod() then, so it does not round.
+BitwuzlaTerm BitwuzlaBuilder::fmod(BitwuzlaTerm left, BitwuzlaTerm right) {
+  BitwuzlaTerm rem = bitwuzla_mk_term2(tm, BITWUZLA_KIND_FP_REM, left, right);
+  BitwuzlaTerm leftNeg = bitwuzla_mk_term1(tm, BITWUZLA_KIND_FP_IS_NEG, left);
+  BitwuzlaTerm absRight = bitwuzla_mk_term1(tm, BITWUZLA_KIND_FP_ABS, right);
+  BitwuzlaTerm step = bitwuzla_mk_term3(
+      tm, BITWUZLA_KIND_ITE, leftNeg,
+      bitwuzla_mk_term1(tm, BITWUZLA_KIND_FP_NEG, absRight), absRight);
+  BitwuzlaTerm sameSign = bitwuzla_mk_term2(
+      tm, BITWUZLA_KIND_EQUAL,
+      bitwuzla_mk_term1(tm, BITWUZLA_KIND_FP_IS_NEG, rem), leftNeg);
+  BitwuzlaTerm keep = bitwuzla_mk_term2(
+      tm, BITWUZLA_KIND_OR,
+      bitwuzla_mk_term2(tm, BITWUZLA_KIND_OR, isNan(rem),
+                        bitwuzla_mk_term1(tm, BITWUZLA_KIND_FP_IS_ZERO, rem)),
+      sameSign);
+  BitwuzlaTerm adjusted =
+      bitwuzla_mk_term3(tm, BITWUZLA_KIND_FP_ADD,
+                        getRoundingMode(llvm::APFloat::rmNearestTiesToEven),
+                        rem, step);
+  return bitwuzla_mk_term3(tm, BITWUZLA_KIND_ITE, keep, rem, adjusted);
+}
+
+BitwuzlaTerm BitwuzlaBuilder::getInitialArray(const Array *root) {
+  assert(root);
+  BitwuzlaTerm array_expr;
+  bool hashed = _arr_hash.lookupArrayExpr(root, array_expr);
+
+  if (!hashed) {
+    // Unique arrays by name, so we make sure the name is unique by
+    // using the number of arrays hashed as a counter.
+    std::string unique_id = llvm::itostr(_arr_hash.getNumArraysHashed());
+    std::string unique_name = root->name + unique_id;
+
+    array_expr = bitwuzla_mk_const(
+        tm,
+        bitwuzla_mk_array_sort(tm, getBvSort(root->getDomain()),
+                               getBvSort(root->getRange())),
+        unique_name.c_str());
+
+    if (root->isConstantArray()) {
+      for (unsigned i = 0, e = root->size; i != e; ++i)
+        array_expr = bitwuzla_mk_term3(
+            tm, BITWUZLA_KIND_ARRAY_STORE, array_expr,
+            bvConst(root->getDomain(), i),
+            bvConst(root->getRange(),
+                    root->constantValues[i]->getZExtValue()));
+    }
+
+    _arr_hash.hashArrayExpr(root, array_expr);
+  }
+
+  return array_expr;
+}
+
+BitwuzlaTerm BitwuzlaBuilder::getInitialRead(const Array *root,
+                                             unsigned index) {
+  return bitwuzla_mk_term2(tm, BITWUZLA_KIND_ARRAY_SELECT,
+                           getInitialArray(root),
+                           bvConst(root->getDomain(), index));
+}
+
+BitwuzlaTerm BitwuzlaBuilder::getArrayForUpdate(const Array *root,
+                                                const UpdateNode *un) {
+  // Start from the newest update already built, or the initial array, and
+  // write the others over it oldest first.
+  std::vector<const UpdateNode *> pending;
+  BitwuzlaTerm un_expr;
+  for (; un; un = un->next) {
+    if (_arr_hash.lookupUpdateNodeExpr(un, un_expr))
+      break;
+    pending.push_back(un);
+  }
+  if (!un)
+    un_expr = getInitialArray(root);
+
+  for (std::vector<const UpdateNode *>::reverse_iterator it = pending.rbegin(),
+                                                         ie = pending.rend();
+       it != ie; ++it) {
+    const UpdateNode *update = *it;
+    un_expr = bitwuzla_mk_term3(tm, BITWUZLA_KIND_ARRAY_STORE, un_expr,
+                                construct(update->index, 0),
+                                construct(update->value, 0));
+    _arr_hash.hashUpdateNodeExpr(update, un_expr);
+    if (hasDefinitions(update->index) || hasDefinitions(update->value) ||
+        hasDefinitions(update->next))
+      updatesWithDefinitions.insert(update);
+  }
+  return un_expr;
+}
+
+void BitwuzlaBuilder::releaseArrays(const std::vector<const Array *> &arrays) {
+  if (arrays.empty())
+    return;
+  _arr_hash.releaseArrays(arrays);
+  // What is known of the updates goes with their terms.
+  updatesWithDefinitions.clear();
+}
+
+bool BitwuzlaBuilder::hasDefinitions(const ref<Expr> &e) {
+  if (isa<ConstantExpr>(e))
+    return false;
+  ExprHashMap<ConstructCacheEntry>::iterator it = constructed.find(e);
+  return it != constructed.end() && it->second.hasDefinitions;
+}
+
+bool BitwuzlaBuilder::canEncode(const ref<Expr> &e) {
+  // Whatever has been built was checked before.
+  std::vector<ref<Expr> > stack(1, e);
+  ExprHashSet visited;
+  std::set<const UpdateNode *> visitedUpdates;
+  while (!stack.empty()) {
+    ref<Expr> top = stack.back();
+    stack.pop_back();
+    if (isConstructed(top) || !visited.insert(top).second)
+      continue;
+    if (isa<FExpr>(top) && top->getWidth() != Expr::Fl32 &&
+        top->getWidth() != Expr::Fl64)
+      return false;
+
+    if (const ReadExpr *re = dyn_cast<ReadExpr>(top))
+      for (const UpdateNode *un = re->updates.head;
+           un && !isConstructed(un) && visitedUpdates.insert(un).second;
+           un = un->next) {
+        stack.push_back(un->index);
+        stack.push_back(un->value);
+      }
+    for (unsigned i = 0, n = top->getNumKids(); i != n; ++i)
+      stack.push_back(top->getKid(i));
+  }
+  return true;
+}
+
+BitwuzlaTerm BitwuzlaBuilder::construct(ref<Expr> e,
+                                        std::vector<BitwuzlaTerm> &defs) {
+  BitwuzlaTerm res = construct(e, 0);
+  if (!hasDefinitions(e))
+    return res;
+
+  // Collect the definitions of the encodings below e, only going down
+  // where there are any.
+  std::vector<ref<Expr> > stack(1, e);
+  ExprHashSet visited;
+  std::set<const UpdateNode *> visitedUpdates;
+  while (!stack.empty()) {
+    ref<Expr> top = stack.back();
+    stack.pop_back();
+    if (!hasDefinitions(top) || !visited.insert(top).second)
+      continue;
+    if (isa<ExplicitIntExpr>(top)) {
+      ExprHashMap<BitwuzlaTerm>::iterator it = definitions.find(top);
+      assert(it != definitions.end() && "encoding built without definition");
+      defs.push_back(it->second);
+    }
+
+    if (const ReadExpr *re = dyn_cast<ReadExpr>(top))
+      for (const UpdateNode *un = re->updates.head;
+           un && hasDefinitions(un) && visitedUpdates.insert(un).second;
+           un = un->next) {
+        stack.push_back(un->index);
+        stack.push_back(un->value);
+      }
+    for (unsigned i = 0, n = top->getNumKids(); i != n; ++i)
+      stack.push_back(top->getKid(i));
+  }
+  return res;
+}
+
+BitwuzlaTerm BitwuzlaBuilder::construct(ref<Expr> e, unsigned *width_out) {
+  if (isa<ConstantExpr>(e))
+    return constructActual(e, width_out);
+
+  ExprHashMap<ConstructCacheEntry>::iterator it = constructed.find(e);
+  if (it != constructed.end()) {
+    ++stats::queryConstructCacheHits;
+    if (width_out)
+      *width_out = it->second.width;
+    return it->second.term;
+  }
+
+  ++stats::queryConstructCacheMisses;
+  if (!constructingKids) {
+    constructingKids = true;
+    constructKidsFirst(*this, e);
+    constructingKids = false;
+  }
+  unsigned width;
+  if (!width_out)
+    width_out = &width;
+  BitwuzlaTerm res = constructActual(e, width_out);
+
+  bool defs = isa<ExplicitIntExpr>(e);
+  for (unsigned i = 0, n = e->getNumKids(); i != n && !defs; ++i)
+    defs = hasDefinitions(e->getKid(i));
+  if (const ReadExpr *re = dyn_cast<ReadExpr>(e))
+    defs = defs || hasDefinitions(re->updates.head);
+  constructed.insert(
+      std::make_pair(e, ConstructCacheEntry(res, *width_out, defs)));
+  return res;
+}
+
+/** if *width_out!=1 then result is a bitvector or a float,
+    otherwise it is a bool */
+BitwuzlaTerm BitwuzlaBuilder::constructActual(ref<Expr> e,
+                                              unsigned *width_out) {
+  unsigned width;
+  if (!width_out)
+    width_out = &width;
+
+  ++stats::queryConstructs;
+  ++numBuilt;
+
+  switch (e->getKind()) {
+  case Expr::Constant: {
+    ConstantExpr *CE = cast<ConstantExpr>(e);
+    *width_out = CE->getWidth();
+
+    // Coerce to bool if necessary.
+    if (*width_out == 1)
+      return CE->isTrue() ? bitwuzla_mk_true(tm) : bitwuzla_mk_false(tm);
+
+    // Fast path.
+    if (*width_out <= 64)
+      return bvConst(*width_out, CE->getZExtValue());
+
+    ref<ConstantExpr> Tmp = CE;
+    BitwuzlaTerm Res = bvConst(64, Tmp->Extract(0, 64)->getZExtValue());
+    while (Tmp->getWidth() > 64) {
+      Tmp = Tmp->Extract(64, Tmp->getWidth() - 64);
+      unsigned Width = std::min(64U, Tmp->getWidth());
+      Res = bitwuzla_mk_term2(
+          tm, BITWUZLA_KIND_BV_CONCAT,
+          bvConst(Width, Tmp->Extract(0, Width)->getZExtValue()), Res);
+    }
+    return Res;
+  }
+
+  case Expr::FConstant: {
+    FConstantExpr *CE = cast<FConstantExpr>(e);
+    *width_out = CE->getWidth();
+    // Bitwuzla folds the conversion of a constant.
+    uint64_t bits = CE->getAPValue().bitcastToAPInt().getZExtValue();
+    return toFloat(BITWUZLA_KIND_FP_TO_FP_FROM_BV, 0,
+                   bvConst(*width_out, bits), *width_out);
+  }
+
+  // Special
+  case Expr::NotOptimized: {
+    NotOptimizedExpr *noe = cast<NotOptimizedExpr>(e);
+    return construct(noe->src, width_out);
+  }
+
+  case Expr::Read: {
+    ReadExpr *re = cast<ReadExpr>(e);
+    assert(re && re->updates.root);
+    *width_out = re->updates.root->getRange();
+    return bitwuzla_mk_term2(
+        tm, BITWUZLA_KIND_ARRAY_SELECT,
+        getArrayForUpdate(re->updates.root, re->updates.head),
+        construct(re->index, 0));
+  }
+
+  case Expr::Select: {
+    SelectExpr *se = cast<SelectExpr>(e);
+    BitwuzlaTerm cond = construct(se->cond, 0);
+    BitwuzlaTerm tExpr = construct(se->trueExpr, width_out);
+    BitwuzlaTerm fExpr = construct(se->falseExpr, width_out);
+    return bitwuzla_mk_term3(tm, BITWUZLA_KIND_ITE, cond, tExpr, fExpr);
+  }
+
+  case Expr::FSelect: {
+    FSelectExpr *se = cast<FSelectExpr>(e);
+    BitwuzlaTerm cond = construct(se->cond, 0);
+    BitwuzlaTerm tExpr = construct(se->trueExpr, width_out);
+    BitwuzlaTerm fExpr = construct(se->falseExpr, width_out);
+    return bitwuzla_mk_term3(tm, BITWUZLA_KIND_ITE, cond, tExpr, fExpr);
+  }
+
+  case Expr::Concat: {
+    ConcatExpr *ce = cast<ConcatExpr>(e);
+    unsigned numKids = ce->getNumKids();
+    BitwuzlaTerm res = construct(ce->getKid(numKids - 1), 0);
+    for (int i = numKids - 2; i >= 0; i--)
+      res = bitwuzla_mk_term2(tm, BITWUZLA_KIND_BV_CONCAT,
+                              construct(ce->getKid(i), 0), res);
+    *width_out = ce->getWidth();
+    return res;
+  }
+
+  case Expr::Extract: {
+    ExtractExpr *ee = cast<ExtractExpr>(e);
+    BitwuzlaTerm src = construct(ee->expr, width_out);
+    *width_out = ee->getWidth();
+    if (*width_out == 1)
+      return bvBoolExtract(src, ee->offset);
+    return bitwuzla_mk_term1_indexed2(tm, BITWUZLA_KIND_BV_EXTRACT, src,
+                                      ee->offset + *width_out - 1,
+                                      ee->offset);
+  }
+
+  // Casting
+
+  case Expr::ZExt: {
+    unsigned srcWidth;
+    CastExpr *ce = cast<CastExpr>(e);
+    BitwuzlaTerm src = construct(ce->src, &srcWidth);
+    *width_out = ce->getWidth();
+    if (srcWidth == 1)
+      return bitwuzla_mk_term3(tm, BITWUZLA_KIND_ITE, src,
+                               bvConst(*width_out, 1), bvConst(*width_out, 0));
+    return bitwuzla_mk_term1_indexed1(tm, BITWUZLA_KIND_BV_ZERO_EXTEND, src,
+                                      *width_out - srcWidth);
+  }
+
+  case Expr::SExt: {
+    unsigned srcWidth;
+    CastExpr *ce = cast<CastExpr>(e);
+    BitwuzlaTerm src = construct(ce->src, &srcWidth);
+    *width_out = ce->getWidth();
+    if (srcWidth == 1)
+      return bitwuzla_mk_term3(tm, BITWUZLA_KIND_ITE, src,
+                               bvSExtConst(*width_out, -1),
+                               bvConst(*width_out, 0));
+    return bitwuzla_mk_term1_indexed1(tm, BITWUZLA_KIND_BV_SIGN_EXTEND, src,
+                                      *width_out - srcWidth);
+  }
+
+  case Expr::FExt: {
+    FCastRoundExpr *ce = cast<FCastRoundExpr>(e);
+    BitwuzlaTerm src = construct(ce->src, 0);
+    *width_out = ce->getWidth();
+    return toFloat(BITWUZLA_KIND_FP_TO_FP_FROM_FP,
+                   getRoundingMode(ce->getRoundingMode()), src, *width_out);
+  }
+
+  case Expr::FToU:
+  case Expr::FToS: {
+    CastRoundExpr *ce = cast<CastRoundExpr>(e);
+    BitwuzlaTerm src = construct(ce->src, 0);
+    *width_out = ce->getWidth();
+    return bitwuzla_mk_term2_indexed1(
+        tm,
+        e->getKind() == Expr::FToU ? BITWUZLA_KIND_FP_TO_UBV
+                                   : BITWUZLA_KIND_FP_TO_SBV,
+        getRoundingMode(ce->getRoundingMode()), src, *width_out);
+  }
+
+  case Expr::UToF:
+  case Expr::SToF: {
+    FCastRoundExpr *ce = cast<FCastRoundExpr>(e);
+    unsigned srcWidth;
+    BitwuzlaTerm src = construct(ce->src, &srcWidth);
+    if (srcWidth == 1)
+      src = boolToBv(src);
+    *width_out = ce->getWidth();
+    return toFloat(e->getKind() == Expr::UToF
+                       ? BITWUZLA_KIND_FP_TO_FP_FROM_UBV
+                       : BITWUZLA_KIND_FP_TO_FP_FROM_SBV,
+                   getRoundingMode(ce->getRoundingMode()), src, *width_out);
+  }
+
+  case Expr::ExplicitFloat: {
+    ExplicitFloatExpr *ce = cast<ExplicitFloatExpr>(e);
+    BitwuzlaTerm src = construct(ce->src, width_out);
+    return toFloat(BITWUZLA_KIND_FP_TO_FP_FROM_BV, 0, src, *width_out);
+  }
+
+  case Expr::ExplicitInt: {
+    // A fresh bitvector which converts back to the float. Every NaN
+    // encoding converts to NaN, so a NaN may take any of them.
+    ExplicitIntExpr *ce = cast<ExplicitIntExpr>(e);
+    BitwuzlaTerm src = construct(ce->src, width_out);
+    std::string name = "klee_fp_bits" + llvm::utostr(definitions.size());
+    BitwuzlaTerm bits =
+        bitwuzla_mk_const(tm, getBvSort(*width_out), name.c_str());
+    BitwuzlaTerm def = bitwuzla_mk_term2(
+        tm, BITWUZLA_KIND_EQUAL,
+        toFloat(BITWUZLA_KIND_FP_TO_FP_FROM_BV, 0, bits, *width_out), src);
+    definitions.insert(std::make_pair(e, def));
+    return bits;
+  }
+
+  // Floating-point special functions
+  case Expr::FAbs: {
+    FAbsExpr *fe = cast<FAbsExpr>(e);
+    BitwuzlaTerm expr = construct(fe->expr, width_out);
+    return bitwuzla_mk_term1(tm, BITWUZLA_KIND_FP_ABS, expr);
+  }
+
+  case Expr::FpClassify: {
+    FpClassifyExpr *fe = cast<FpClassifyExpr>(e);
+    BitwuzlaTerm expr = construct(fe->expr, 0);
+    *width_out = sizeof(int) * 8;
+
+    // this is the same if-then-else chain as in ConstantExpr::FpClassify()
+    BitwuzlaTerm result = bvSExtConst(*width_out, FP_NORMAL);
+    result = bitwuzla_mk_term3(
+        tm, BITWUZLA_KIND_ITE,
+        bitwuzla_mk_term1(tm, BITWUZLA_KIND_FP_IS_SUBNORMAL, expr),
+        bvSExtConst(*width_out, FP_SUBNORMAL), result);
+    result = bitwuzla_mk_term3(
+        tm, BITWUZLA_KIND_ITE,
+        bitwuzla_mk_term1(tm, BITWUZLA_KIND_FP_IS_ZERO, expr),
+        bvSExtConst(*width_out, FP_ZERO), result);
+    result = bitwuzla_mk_term3(
+        tm, BITWUZLA_KIND_ITE,
+        bitwuzla_mk_term1(tm, BITWUZLA_KIND_FP_IS_INF, expr),
+        bvSExtConst(*width_out, FP_INFINITE), result);
+    return bitwuzla_mk_term3(tm, BITWUZLA_KIND_ITE, isNan(expr),
+                             bvSExtConst(*width_out, FP_NAN), result);
+  }
+
+  case Expr::FIsFinite: {
+    FIsFiniteExpr *fe = cast<FIsFiniteExpr>(e);
+    BitwuzlaTerm expr = construct(fe->expr, 0);
+    *width_out = sizeof(int) * 8;
+    BitwuzlaTerm notFinite = bitwuzla_mk_term2(
+        tm, BITWUZLA_KIND_OR, isNan(expr),
+        bitwuzla_mk_term1(tm, BITWUZLA_KIND_FP_IS_INF, expr));
+    return bitwuzla_mk_term3(tm, BITWUZLA_KIND_ITE, notFinite,
+                             bvConst(*width_out, 0), bvConst(*width_out, 1));
+  }
+
+  case Expr::FIsNan: {
+    FIsNanExpr *fe = cast<FIsNanExpr>(e);
+    BitwuzlaTerm expr = construct(fe->expr, 0);
+    *width_out = sizeof(int) * 8;
+    return bitwuzla_mk_term3(tm, BITWUZLA_KIND_ITE, isNan(expr),
+                             bvConst(*width_out, 1), bvConst(*width_out, 0));
+  }
+
+  case Expr::FIsInf: {
+    FIsInfExpr *fe = cast<FIsInfExpr>(e);
+    BitwuzlaTerm expr = construct(fe->expr, 0);
+    *width_out = sizeof(int) * 8;
+    BitwuzlaTerm sign = bitwuzla_mk_term3(
+        tm, BITWUZLA_KIND_ITE,
+        bitwuzla_mk_term1(tm, BITWUZLA_KIND_FP_IS_NEG, expr),
+        bvSExtConst(*width_out, -1), bvConst(*width_out, 1));
+    return bitwuzla_mk_term3(
+        tm, BITWUZLA_KIND_ITE,
+        bitwuzla_mk_term1(tm, BITWUZLA_KIND_FP_IS_INF, expr), sign,
+        bvConst(*width_out, 0));
+  }
+
+  case Expr::FSqrt: {
+    FSqrtExpr *fe = cast<FSqrtExpr>(e);
+    BitwuzlaTerm expr = construct(fe->expr, width_out);
+    return bitwuzla_mk_term2(tm, BITWUZLA_KIND_FP_SQRT,
+                             getRoundingMode(fe->getRoundingMode()), expr);
+  }
+
+  case Expr::FNearbyInt: {
+    FNearbyIntExpr *fe = cast<FNearbyIntExpr>(e);
+    BitwuzlaTerm expr = construct(fe->expr, width_out);
+    return bitwuzla_mk_term2(tm, BITWUZLA_KIND_FP_RTI,
+                             getRoundingMode(fe->getRoundingMode()), expr);
+  }
+
+  // Arithmetic
+  case Expr::Add:
+  case Expr::Sub:
+  case Expr::Mul:
+  case Expr::UDiv:
+  case Expr::SDiv:
+  case Expr::URem:
+  case Expr::SRem:
+  case Expr::Shl:
+  case Expr::LShr:
+  case Expr::AShr: {
+    BinaryExpr *be = cast<BinaryExpr>(e);
+    BitwuzlaTerm left = construct(be->left, width_out);
+    BitwuzlaTerm right = construct(be->right, width_out);
+    assert(*width_out != 1 && "uncanonicalized arithmetic");
+    // Bitwuzla shifts by the width or more as KLEE does, to zero or to the
+    // sign, and divides by zero as the other builders do.
+    BitwuzlaKind kind;
+    switch (e->getKind()) {
+    default:
+    case Expr::Add: kind = BITWUZLA_KIND_BV_ADD; break;
+    case Expr::Sub: kind = BITWUZLA_KIND_BV_SUB; break;
+    case Expr::Mul: kind = BITWUZLA_KIND_BV_MUL; break;
+    case Expr::UDiv: kind = BITWUZLA_KIND_BV_UDIV; break;
+    case Expr::SDiv: kind = BITWUZLA_KIND_BV_SDIV; break;
+    case Expr::URem: kind = BITWUZLA_KIND_BV_UREM; break;
+    case Expr::SRem: kind = BITWUZLA_KIND_BV_SREM; break;
+    case Expr::Shl: kind = BITWUZLA_KIND_BV_SHL; break;
+    case Expr::LShr: kind = BITWUZLA_KIND_BV_SHR; break;
+    case Expr::AShr: kind = BITWUZLA_KIND_BV_ASHR; break;
+    }
+    return bitwuzla_mk_term2(tm, kind, left, right);
+  }
+
+  // Bitwise
+  case Expr::Not: {
+    NotExpr *ne = cast<NotExpr>(e);
+    BitwuzlaTerm expr = construct(ne->expr, width_out);
+    return bitwuzla_mk_term1(
+        tm, *width_out == 1 ? BITWUZLA_KIND_NOT : BITWUZLA_KIND_BV_NOT, expr);
+  }
+
+  case Expr::And:
+  case Expr::Or:
+  case Expr::Xor: {
+    BinaryExpr *be = cast<BinaryExpr>(e);
+    BitwuzlaTerm left = construct(be->left, width_out);
+    BitwuzlaTerm right = construct(be->right, width_out);
+    bool isBool = *width_out == 1;
+    BitwuzlaKind kind;
+    switch (e->getKind()) {
+    default:
+    case Expr::And:
+      kind = isBool ? BITWUZLA_KIND_AND : BITWUZLA_KIND_BV_AND;
+      break;
+    case Expr::Or:
+      kind = isBool ? BITWUZLA_KIND_OR : BITWUZLA_KIND_BV_OR;
+      break;
+    case Expr::Xor:
+      kind = isBool ? BITWUZLA_KIND_XOR : BITWUZLA_KIND_BV_XOR;
+      break;
+    }
+    return bitwuzla_mk_term2(tm, kind, left, right);
+  }
+
+  // Comparison
+  case Expr::Eq: {
+    EqExpr *ee = cast<EqExpr>(e);
+    BitwuzlaTerm left = construct(ee->left, width_out);
+    BitwuzlaTerm right = construct(ee->right, width_out);
+    if (*width_out == 1) {
+      if (ConstantExpr *CE = dyn_cast<ConstantExpr>(ee->left)) {
+        if (CE->isTrue())
+          return right;
+        return bitwuzla_mk_term1(tm, BITWUZLA_KIND_NOT, right);
+      }
+    }
+    *width_out = 1;
+    return bitwuzla_mk_term2(tm, BITWUZLA_KIND_EQUAL, left, right);
+  }
+
+  case Expr::Ult:
+  case Expr::Ule:
+  case Expr::Slt:
+  case Expr::Sle: {
+    BinaryExpr *be = cast<BinaryExpr>(e);
+    BitwuzlaTerm left = construct(be->left, width_out);
+    BitwuzlaTerm right = construct(be->right, width_out);
+    assert(*width_out != 1 && "uncanonicalized comparison");
+    *width_out = 1;
+    BitwuzlaKind kind;
+    switch (e->getKind()) {
+    default:
+    case Expr::Ult: kind = BITWUZLA_KIND_BV_ULT; break;
+    case Expr::Ule: kind = BITWUZLA_KIND_BV_ULE; break;
+    case Expr::Slt: kind = BITWUZLA_KIND_BV_SLT; break;
+    case Expr::Sle: kind = BITWUZLA_KIND_BV_SLE; break;
+    }
+    return bitwuzla_mk_term2(tm, kind, left, right);
+  }
+
+  // Floating-point comparison
+  case Expr::FOrd:
+  case Expr::FUno:
+  case Expr::FUeq:
+  case Expr::FOeq:
+  case Expr::FUgt:
+  case Expr::FOgt:
+  case Expr::FUge:
+  case Expr::FOge:
+  case Expr::FUlt:
+  case Expr::FOlt:
+  case Expr::FUle:
+  case Expr::FOle:
+  case Expr::FUne:
+  case Expr::FOne: {
+    BinaryExpr *be = cast<BinaryExpr>(e);
+    BitwuzlaTerm left = construct(be->left, 0);
+    BitwuzlaTerm right = construct(be->right, 0);
+    *width_out = 1;
+
+    // The IEEE comparisons are all false on NaN, the ordered ones here
+    // too, while the unordered ones are true.
+    BitwuzlaTerm unordered =
+        bitwuzla_mk_term2(tm, BITWUZLA_KIND_OR, isNan(left), isNan(right));
+    BitwuzlaKind kind;
+    switch (e->getKind()) {
+    case Expr::FOrd:
+      return bitwuzla_mk_term1(tm, BITWUZLA_KIND_NOT, unordered);
+    case Expr::FUno:
+      return unordered;
+    case Expr::FUne:
+      return bitwuzla_mk_term1(
+          tm, BITWUZLA_KIND_NOT,
+          bitwuzla_mk_term2(tm, BITWUZLA_KIND_FP_EQUAL, left, right));
+    case Expr::FOne:
+      return bitwuzla_mk_term2(
+          tm, BITWUZLA_KIND_AND,
+          bitwuzla_mk_term1(tm, BITWUZLA_KIND_NOT, unordered),
+          bitwuzla_mk_term1(
+              tm, BITWUZLA_KIND_NOT,
+              bitwuzla_mk_term2(tm, BITWUZLA_KIND_FP_EQUAL, left, right)));
+    case Expr::FUeq:
+    case Expr::FOeq:
+      kind = BITWUZLA_KIND_FP_EQUAL;
+      break;
+    case Expr::FUgt:
+    case Expr::FOgt:
+      kind = BITWUZLA_KIND_FP_GT;
+      break;
+    case Expr::FUge:
+    case Expr::FOge:
+      kind = BITWUZLA_KIND_FP_GEQ;
+      break;
+    case Expr::FUlt:
+    case Expr::FOlt:
+      kind = BITWUZLA_KIND_FP_LT;
+      break;
+    default:
+      kind = BITWUZLA_KIND_FP_LEQ;
+      break;
+    }
+    BitwuzlaTerm cmp = bitwuzla_mk_term2(tm, kind, left, right);
+    switch (e->getKind()) {
+    case Expr::FUeq:
+    case Expr::FUgt:
+    case Expr::FUge:
+    case Expr::FUlt:
+    case Expr::FUle:
+      return bitwuzla_mk_term2(tm, BITWUZLA_KIND_OR, unordered, cmp);
+    default:
+      return cmp;
+    }
+  }
+
+  // Floating-point arithmetic
+  case Expr::FAdd:
+  case Expr::FSub:
+  case Expr::FMul:
+  case Expr::FDiv: {
+    FBinaryRoundExpr *fe = cast<FBinaryRoundExpr>(e);
+    BitwuzlaTerm left = construct(fe->left, width_out);
+    BitwuzlaTerm right = construct(fe->right, width_out);
+    BitwuzlaKind kind;
+    switch (e->getKind()) {
+    default:
+    case Expr::FAdd: kind = BITWUZLA_KIND_FP_ADD; break;
+    case Expr::FSub: kind = BITWUZLA_KIND_FP_SUB; break;
+    case Expr::FMul: kind = BITWUZLA_KIND_FP_MUL; break;
+    case Expr::FDiv: kind = BITWUZLA_KIND_FP_DIV; break;
+    }
+    return bitwuzla_mk_term3(tm, kind, getRoundingMode(fe->getRoundingMode()),
+                             left, right);
+  }
+
+  case Expr::FRem: {
+    // The remainder is exact, so it takes no rounding mode.
+    FRemExpr *fe = cast<FRemExpr>(e);
+    BitwuzlaTerm left = construct(fe->left, width_out);
+    BitwuzlaTerm right = construct(fe->right, width_out);
+    return fmod(left, right);
+  }
+
+  case Expr::FMin:
+  case Expr::FMax: {
+    FBinaryExpr *fe = cast<FBinaryExpr>(e);
+    BitwuzlaTerm left = construct(fe->left, width_out);
+    BitwuzlaTerm right = construct(fe->right, width_out);
+    return bitwuzla_mk_term2(tm,
+                             e->getKind() == Expr::FMin ? BITWUZLA_KIND_FP_MIN
+                                                        : BITWUZLA_KIND_FP_MAX,
+                             left, right);
+  }
+
+  case Expr::FFma: {
+    FFmaExpr *fe = cast<FFmaExpr>(e);
+    BitwuzlaTerm left = construct(fe->left, width_out);
+    BitwuzlaTerm right = construct(fe->right, width_out);
+    BitwuzlaTerm addend = construct(fe->addend, width_out);
+    return bitwuzla_mk_term4(tm, BITWUZLA_KIND_FP_FMA,
+                             getRoundingMode(fe->getRoundingMode()), left,
+                             right, addend);
+  }
+
+  default:
+    assert(0 && "unhandled Expr type");
+    return bitwuzla_mk_true(tm);
+  }
+}
+#endif // ENABLE_BITWUZLA
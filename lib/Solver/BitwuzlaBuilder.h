@@ -0,0 +1,126 @@
+//===-- BitwuzlaBuilder.h --------------------------------------*- C++ -*-====//
+//
+//                     The KLEE Symbolic Virtual Machine
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+
+#ifndef __UTIL_BITWUZLABUILDER_H__
+#define __UTIL_BITWUZLABUILDER_H__
+
+#include "klee/util/ExprHashMap.h"
+#include "klee/util/ArrayExprHash.h"
+#include "klee/Config/config.h"
+
+#include "llvm/ADT/APFloat.h"
+
+#include <bitwuzla/c/bitwuzla.h>
+
+#include <set>
+#include <vector>
+
+namespace klee {
+
+// Terms belong to the term manager, which frees them all at once, so the
+// hash needs no destructor of its own.
+class BitwuzlaArrayExprHash : public ArrayExprHash<BitwuzlaTerm> {
+  friend class BitwuzlaBuilder;
+};
+
+/// BitwuzlaBuilder - Build Bitwuzla terms for expressions, floating point
+/// ones in Bitwuzla's theory of floating point.
+///
+/// Bitwuzla cannot take a float to its IEEE-754 encoding, so the encoding
+/// of a float (an ExplicitInt expression) is a fresh bitvector, defined to
+/// convert back to the float. The definitions an expression needs are
+/// handed out along with its term, to be asserted wherever it is.
+class BitwuzlaBuilder {
+  /// An entry of the construction cache. ``hasDefinitions`` is set when the
+  /// expression contains an ExplicitInt expression.
+  struct ConstructCacheEntry {
+    BitwuzlaTerm term;
+    unsigned width;
+    bool hasDefinitions;
+
+    ConstructCacheEntry(BitwuzlaTerm _term, unsigned _width,
+                        bool _hasDefinitions)
+        : term(_term), width(_width), hasDefinitions(_hasDefinitions) {}
+  };
+
+  ExprHashMap<ConstructCacheEntry> constructed;
+  BitwuzlaArrayExprHash _arr_hash;
+  /// The updates built whose indices or values, or older updates, contain
+  /// an ExplicitInt expression.
+  std::set<const UpdateNode *> updatesWithDefinitions;
+  /// The definition of the encoding of each ExplicitInt expression built.
+  ExprHashMap<BitwuzlaTerm> definitions;
+  /// Whether the kids of the expression being constructed are being
+  /// constructed first.
+  bool constructingKids;
+  /// The expressions built so far, which all live as long as the term
+  /// manager.
+  uint64_t numBuilt;
+
+  BitwuzlaSort getBvSort(unsigned width);
+  BitwuzlaTerm toFloat(BitwuzlaKind kind, BitwuzlaTerm rm, BitwuzlaTerm src,
+                       unsigned width);
+  BitwuzlaTerm bvConst(unsigned width, uint64_t value);
+  BitwuzlaTerm bvSExtConst(unsigned width, int64_t value);
+  BitwuzlaTerm bvBoolExtract(BitwuzlaTerm expr, unsigned bit);
+  BitwuzlaTerm boolToBv(BitwuzlaTerm expr);
+  BitwuzlaTerm getRoundingMode(llvm::APFloat::roundingMode rm);
+  BitwuzlaTerm isNan(BitwuzlaTerm expr);
+  BitwuzlaTerm fmod(BitwuzlaTerm left, BitwuzlaTerm right);
+
+  BitwuzlaTerm getArrayForUpdate(const Array *root, const UpdateNode *un);
+  bool hasDefinitions(const ref<Expr> &e);
+  bool hasDefinitions(const UpdateNode *un) {
+    return updatesWithDefinitions.count(un);
+  }
+
+  BitwuzlaTerm constructActual(ref<Expr> e, unsigned *width_out);
+  BitwuzlaTerm construct(ref<Expr> e, unsigned *width_out);
+
+  // Hooks for constructKidsFirst().
+  template <class Builder>
+  friend void constructKidsFirst(Builder &builder, const ref<Expr> &root);
+  bool isConstructed(const ref<Expr> &e) {
+    return isa<ConstantExpr>(e) || constructed.count(e);
+  }
+  bool isConstructed(const UpdateNode *un) {
+    BitwuzlaTerm tmp;
+    return _arr_hash.lookupUpdateNodeExpr(un, tmp);
+  }
+  bool constructsKids(const ref<Expr> &e) { return true; }
+  void constructAndCache(const ref<Expr> &e) { construct(e, 0); }
+
+public:
+  BitwuzlaTermManager *tm;
+
+  BitwuzlaBuilder();
+  ~BitwuzlaBuilder();
+
+  /// canEncode - Whether every float in \a e is in single or double
+  /// precision, the formats the builder encodes.
+  bool canEncode(const ref<Expr> &e);
+
+  /// construct - Build the boolean \a e and append the definitions it
+  /// needs to \a defs.
+  BitwuzlaTerm construct(ref<Expr> e, std::vector<BitwuzlaTerm> &defs);
+
+  BitwuzlaTerm getInitialArray(const Array *root);
+  BitwuzlaTerm getInitialRead(const Array *root, unsigned index);
+
+  /// releaseArrays - Forget the terms built for \a arrays, which are about
+  /// to be freed. The terms themselves live as long as the term manager.
+  void releaseArrays(const std::vector<const Array *> &arrays);
+
+  /// getNumBuilt - The number of expressions built since the builder was
+  /// created. Their terms are only freed with the builder.
+  uint64_t getNumBuilt() const { return numBuilt; }
+};
+}
+
+#endif
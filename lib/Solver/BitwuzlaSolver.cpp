@@ -0,0 +1,374 @@
+//===-- BitwuzlaSolver.cpp -------------------------------------*- C++ -*-====//
+//
+//                     The KLEE Symbolic Virtual Machine
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+#include "klee/Config/config.h"
+#include "klee/Internal/Support/ErrorHandling.h"
+#ifdef ENABLE_BITWUZLA
+#include "BitwuzlaBuilder.h"
+#include "klee/Constraints.h"
+#include "klee/Solver.h"
+#include "klee/SolverImpl.h"
+#include "klee/SolverStats.h"
+#include "klee/Internal/System/Time.h"
+#include "klee/util/Assignment.h"
+#include "klee/util/ExprUtil.h"
+
+#include "llvm/Support/CommandLine.h"
+
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+namespace {
+llvm::cl::opt<bool> BitwuzlaIncrementalSolving(
+    "bitwuzla-incremental",
+    llvm::cl::desc("Keep a single Bitwuzla instance alive across queries and "
+                   "use push/pop so that only the constraints which differ "
+                   "from the previous query are asserted (default=off)"),
+    llvm::cl::init(false));
+
+llvm::cl::opt<unsigned> BitwuzlaSessionSize(
+    "bitwuzla-session-size",
+    llvm::cl::desc("Number of expressions built for Bitwuzla after which its "
+                   "terms are all freed and it starts over. Terms are kept "
+                   "until then so that queries share them (default=1000000)"),
+    llvm::cl::init(1000000));
+}
+
+namespace klee {
+
+class BitwuzlaSolverImpl : public SolverImpl {
+private:
+  BitwuzlaBuilder *builder;
+  BitwuzlaOptions *options;
+  double timeout;
+  /// The wall time at which the running check gives up, or 0.
+  double deadline;
+  /// Set by interrupt() to stop the running check.
+  volatile sig_atomic_t interrupted;
+  SolverRunStatus runStatusCode;
+
+  // Incremental solving state (only used with ``-bitwuzla-incremental``).
+  // ``incrementalSolver`` has exactly one backtracking point per entry in
+  // ``assertedConstraints``, so that entry ``i`` can be retracted by popping
+  // ``assertedConstraints.size() - i`` scopes.
+  Bitwuzla *incrementalSolver;
+  std::vector<ref<Expr> > assertedConstraints;
+
+  static int32_t terminate(void *state);
+  Bitwuzla *createSolver();
+  Bitwuzla *getIncrementalSolver(const ConstraintManager &constraints);
+  void resetIncrementalSolver();
+  void resetBuilder();
+  bool canEncode(const Query &query);
+  void assertExpr(Bitwuzla *theSolver, const ref<Expr> &e);
+
+  bool internalRunSolver(const Query &,
+                         const std::vector<const Array *> *objects,
+                         std::vector<std::vector<unsigned char> > *values,
+                         bool &hasSolution);
+
+public:
+  BitwuzlaSolverImpl();
+  ~BitwuzlaSolverImpl();
+
+  char *getConstraintLog(const Query &);
+  void setCoreSolverTimeout(double _timeout) { timeout = _timeout; }
+  void releaseArrays(const std::vector<const Array *> &arrays) {
+    builder->releaseArrays(arrays);
+  }
+  void interrupt() { interrupted = 1; }
+
+  bool computeTruth(const Query &, bool &isValid);
+  bool computeValue(const Query &, ref<Expr> &result);
+  bool computeInitialValues(const Query &,
+                            const std::vector<const Array *> &objects,
+                            std::vector<std::vector<unsigned char> > &values,
+                            bool &hasSolution);
+  SolverRunStatus getOperationStatusCode();
+};
+
+BitwuzlaSolverImpl::BitwuzlaSolverImpl()
+    : builder(new BitwuzlaBuilder()), options(bitwuzla_options_new()),
+      timeout(0.0), deadline(0.0), interrupted(0),
+      runStatusCode(SOLVER_RUN_STATUS_FAILURE),
+      incrementalSolver(NULL) {
+  bitwuzla_set_option(options, BITWUZLA_OPT_PRODUCE_MODELS, 1);
+}
+
+BitwuzlaSolverImpl::~BitwuzlaSolverImpl() {
+  resetIncrementalSolver();
+  bitwuzla_options_delete(options);
+  delete builder;
+}
+
+BitwuzlaSolver::BitwuzlaSolver() : Solver(new BitwuzlaSolverImpl()) {}
+
+char *BitwuzlaSolver::getConstraintLog(const Query &query) {
+  return impl->getConstraintLog(query);
+}
+
+void BitwuzlaSolver::setCoreSolverTimeout(double timeout) {
+  impl->setCoreSolverTimeout(timeout);
+}
+
+/// terminate - Bitwuzla's termination callback: stop once the deadline of
+/// the running check has passed, or once it is interrupted.
+int32_t BitwuzlaSolverImpl::terminate(void *state) {
+  BitwuzlaSolverImpl *impl = static_cast<BitwuzlaSolverImpl *>(state);
+  return impl->interrupted ||
+         (impl->deadline && util::getWallTime() > impl->deadline);
+}
+
+Bitwuzla *BitwuzlaSolverImpl::createSolver() {
+  Bitwuzla *theSolver = bitwuzla_new(builder->tm, options);
+  bitwuzla_set_termination_callback(theSolver, terminate, this);
+  return theSolver;
+}
+
+void BitwuzlaSolverImpl::resetIncrementalSolver() {
+  if (incrementalSolver) {
+    bitwuzla_delete(incrementalSolver);
+    incrementalSolver = NULL;
+  }
+  assertedConstraints.clear();
+}
+
+/// resetBuilder - Free every term built and start over with a new builder.
+/// The instances use the terms, so they go first.
+void BitwuzlaSolverImpl::resetBuilder() {
+  resetIncrementalSolver();
+  delete builder;
+  builder = new BitwuzlaBuilder();
+}
+
+bool BitwuzlaSolverImpl::canEncode(const Query &query) {
+  for (ConstraintManager::const_iterator it = query.constraints.begin(),
+                                         ie = query.constraints.end();
+       it != ie; ++it)
+    if (!builder->canEncode(*it))
+      return false;
+  return builder->canEncode(query.expr);
+}
+
+void BitwuzlaSolverImpl::assertExpr(Bitwuzla *theSolver,
+                                    const ref<Expr> &e) {
+  std::vector<BitwuzlaTerm> defs;
+  bitwuzla_assert(theSolver, builder->construct(e, defs));
+  for (std::vector<BitwuzlaTerm>::iterator it = defs.begin(),
+                                           ie = defs.end();
+       it != ie; ++it)
+    bitwuzla_assert(theSolver, *it);
+}
+
+Bitwuzla *
+BitwuzlaSolverImpl::getIncrementalSolver(const ConstraintManager &constraints) {
+  if (!incrementalSolver)
+    incrementalSolver = createSolver();
+
+  // Find the longest prefix of the new constraint set that is already
+  // asserted. Constraints are compared by pointer first because states
+  // forked from the same parent share their constraint ``ref``s.
+  unsigned prefix = 0;
+  ConstraintManager::const_iterator it = constraints.begin(),
+                                    ie = constraints.end();
+  for (unsigned e = assertedConstraints.size(); prefix != e && it != ie;
+       ++prefix, ++it) {
+    const ref<Expr> &asserted = assertedConstraints[prefix];
+    if (asserted.get() != it->get() && asserted != *it)
+      break;
+  }
+
+  if (prefix != assertedConstraints.size()) {
+    bitwuzla_pop(incrementalSolver, assertedConstraints.size() - prefix);
+    assertedConstraints.resize(prefix);
+  }
+  stats::queryIncrementalPrefixHits += prefix;
+
+  for (; it != ie; ++it) {
+    bitwuzla_push(incrementalSolver, 1);
+    assertExpr(incrementalSolver, *it);
+    assertedConstraints.push_back(*it);
+    ++stats::queryIncrementalPrefixMisses;
+  }
+
+  return incrementalSolver;
+}
+
+char *BitwuzlaSolverImpl::getConstraintLog(const Query &query) {
+  if (!canEncode(query))
+    return strdup("; query has floats Bitwuzla does not support\n");
+
+  Bitwuzla *theSolver = createSolver();
+  for (ConstraintManager::const_iterator it = query.constraints.begin(),
+                                         ie = query.constraints.end();
+       it != ie; ++it)
+    assertExpr(theSolver, *it);
+  // KLEE Queries are validity queries i.e.
+  // ∀ X Constraints(X) → query(X)
+  // but Bitwuzla works in terms of satisfiability so instead we ask the
+  // negation of the equivalent i.e.
+  // ∃ X Constraints(X) ∧ ¬ query(X)
+  std::vector<BitwuzlaTerm> defs;
+  BitwuzlaTerm formula = builder->construct(query.expr, defs);
+  bitwuzla_assert(theSolver,
+                  bitwuzla_mk_term1(builder->tm, BITWUZLA_KIND_NOT, formula));
+  for (std::vector<BitwuzlaTerm>::iterator it = defs.begin(),
+                                           ie = defs.end();
+       it != ie; ++it)
+    bitwuzla_assert(theSolver, *it);
+
+  char *result = NULL;
+  size_t size = 0;
+  FILE *out = open_memstream(&result, &size);
+  bitwuzla_print_formula(theSolver, "smt2", out, 2);
+  fclose(out);
+  bitwuzla_delete(theSolver);
+  // Client is responsible for freeing the returned C-string
+  return result;
+}
+
+bool BitwuzlaSolverImpl::computeTruth(const Query &query, bool &isValid) {
+  bool hasSolution;
+  bool status =
+      internalRunSolver(query, /*objects=*/NULL, /*values=*/NULL, hasSolution);
+  isValid = !hasSolution;
+  return status;
+}
+
+bool BitwuzlaSolverImpl::computeValue(const Query &query, ref<Expr> &result) {
+  std::vector<const Array *> objects;
+  std::vector<std::vector<unsigned char> > values;
+  bool hasSolution;
+
+  // Find the object used in the expression, and compute an assignment
+  // for them.
+  findSymbolicObjects(query.expr, objects);
+  if (!computeInitialValues(query.withFalse(), objects, values, hasSolution))
+    return false;
+  assert(hasSolution && "state has invalid constraint set");
+
+  // Evaluate the expression with the computed assignment.
+  Assignment a(objects, values);
+  result = a.evaluate(query.expr);
+
+  return true;
+}
+
+bool BitwuzlaSolverImpl::computeInitialValues(
+    const Query &query, const std::vector<const Array *> &objects,
+    std::vector<std::vector<unsigned char> > &values, bool &hasSolution) {
+  return internalRunSolver(query, &objects, &values, hasSolution);
+}
+
+bool BitwuzlaSolverImpl::internalRunSolver(
+    const Query &query, const std::vector<const Array *> *objects,
+    std::vector<std::vector<unsigned char> > *values, bool &hasSolution) {
+  runStatusCode = SOLVER_RUN_STATUS_FAILURE;
+  if (!canEncode(query)) {
+    klee_warning_once(0, "Bitwuzla only supports single and double precision "
+                         "floats, failing queries with others");
+    return false;
+  }
+
+  TimerStatIncrementer t(stats::queryTime);
+  // Terms live as long as the builder, so start over once it has built
+  // too many.
+  if (builder->getNumBuilt() > BitwuzlaSessionSize)
+    resetBuilder();
+
+  Bitwuzla *theSolver;
+  if (BitwuzlaIncrementalSolving) {
+    theSolver = getIncrementalSolver(query.constraints);
+  } else {
+    theSolver = createSolver();
+    for (ConstraintManager::const_iterator it = query.constraints.begin(),
+                                           ie = query.constraints.end();
+         it != ie; ++it)
+      assertExpr(theSolver, *it);
+  }
+
+  ++stats::queries;
+  if (objects)
+    ++stats::queryCounterexamples;
+
+  // The negated query expression and its definitions are assumed for this
+  // check only, so that the incremental solver keeps just the constraints.
+  std::vector<BitwuzlaTerm> assumptions;
+  BitwuzlaTerm queryTerm = builder->construct(query.expr, assumptions);
+  assumptions.push_back(
+      bitwuzla_mk_term1(builder->tm, BITWUZLA_KIND_NOT, queryTerm));
+
+  deadline = timeout ? util::getWallTime() + timeout : 0;
+  interrupted = 0;
+  BitwuzlaResult result = bitwuzla_check_sat_assuming(
+      theSolver, assumptions.size(), &assumptions[0]);
+  bool timedOut = deadline && util::getWallTime() > deadline;
+  deadline = 0;
+
+  switch (result) {
+  case BITWUZLA_SAT:
+    hasSolution = true;
+    runStatusCode = SOLVER_RUN_STATUS_SUCCESS_SOLVABLE;
+    if (objects) {
+      values->reserve(objects->size());
+      for (std::vector<const Array *>::const_iterator it = objects->begin(),
+                                                      ie = objects->end();
+           it != ie; ++it) {
+        const Array *array = *it;
+        std::vector<unsigned char> data;
+        data.reserve(array->size);
+        for (unsigned offset = 0; offset < array->size; offset++) {
+          BitwuzlaTerm value = bitwuzla_get_value(
+              theSolver, builder->getInitialRead(array, offset));
+          data.push_back(
+              strtoul(bitwuzla_term_value_get_str_fmt(value, 10), NULL, 10));
+        }
+        values->push_back(data);
+      }
+    }
+    break;
+  case BITWUZLA_UNSAT:
+    hasSolution = false;
+    runStatusCode = SOLVER_RUN_STATUS_SUCCESS_UNSOLVABLE;
+    break;
+  default:
+    runStatusCode = interrupted ? SOLVER_RUN_STATUS_INTERRUPTED
+                    : timedOut  ? SOLVER_RUN_STATUS_TIMEOUT
+                                : SOLVER_RUN_STATUS_FAILURE;
+    break;
+  }
+
+  if (BitwuzlaIncrementalSolving) {
+    // After a timeout Bitwuzla gives no guarantees about the state of the
+    // instance, so start again from scratch next time.
+    if (runStatusCode != SOLVER_RUN_STATUS_SUCCESS_SOLVABLE &&
+        runStatusCode != SOLVER_RUN_STATUS_SUCCESS_UNSOLVABLE)
+      resetIncrementalSolver();
+  } else {
+    bitwuzla_delete(theSolver);
+  }
+
+  if (runStatusCode == SOLVER_RUN_STATUS_SUCCESS_SOLVABLE ||
+      runStatusCode == SOLVER_RUN_STATUS_SUCCESS_UNSOLVABLE) {
+    if (hasSolution) {
+      ++stats::queriesInvalid;
+    } else {
+      ++stats::queriesValid;
+    }
+    return true; // success
+  }
+  return false; // failed
+}
+
+SolverImpl::SolverRunStatus BitwuzlaSolverImpl::getOperationStatusCode() {
+  return runStatusCode;
+}
+}
+#endif // ENABLE_BITWUZLA
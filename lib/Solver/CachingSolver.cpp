@@ -16,6 +16,7 @@
 #include "klee/SolverImpl.h"
 
 #include "klee/SolverStats.h"
+#include "klee/Internal/System/MemoryUsage.h"
 
 #include <ciso646>
 #ifdef _LIBCPP_VERSION
@@ -66,23 +67,50 @@ private:
     }
   };
 
+  /// A cached result, with the reference bit of the CLOCK eviction done
+  /// by trimCaches: set by every lookup, cleared by every sweep.
+  struct CachedResult {
+    CachedResult(IncompleteSolver::PartialValidity r)
+      : result(r), referenced(false) {}
+
+    IncompleteSolver::PartialValidity result;
+    bool referenced;
+  };
+
   typedef unordered_map<CacheEntry, 
-                        IncompleteSolver::PartialValidity, 
+                        CachedResult, 
                         CacheEntryHash> cache_map;
   
   Solver *solver;
   cache_map cache;
 
+  /// The bytes an entry takes, about: the node, and the constraint list
+  /// it copied. The expressions themselves are shared with the states.
+  static size_t getEntryBytes(const CacheEntry &ce) {
+    return sizeof(cache_map::value_type) + 2 * sizeof(void*) +
+           ce.constraints.size() * sizeof(ref<Expr>);
+  }
+
 public:
   CachingSolver(Solver *s) : solver(s) {}
-  ~CachingSolver() { cache.clear(); delete solver; }
+  ~CachingSolver();
 
   bool computeValidity(const Query&, Solver::Validity &result);
   bool computeTruth(const Query&, bool &isValid);
+  bool computeTruthMany(const ConstraintManager &constraints,
+                        const std::vector< ref<Expr> > &exprs,
+                        std::vector<bool> &isValid);
   bool computeValue(const Query& query, ref<Expr> &result) {
     ++stats::queryCacheMisses;
     return solver->impl->computeValue(query, result);
   }
+  bool computeRange(const Query& query, ref<Expr> &min, ref<Expr> &max) {
+    return solver->impl->computeRange(query, min, max);
+  }
+  bool computeUniqueValue(const Query& query, ref<Expr> &result,
+                          bool &isUnique) {
+    return solver->impl->computeUniqueValue(query, result, isUnique);
+  }
   bool computeInitialValues(const Query& query,
                             const std::vector<const Array*> &objects,
                             std::vector< std::vector<unsigned char> > &values,
@@ -94,8 +122,19 @@ public:
   SolverRunStatus getOperationStatusCode();
   char *getConstraintLog(const Query&);
   void setCoreSolverTimeout(double timeout);
+  size_t trimCaches(size_t bytes);
+  void releaseArrays(const std::vector<const Array *> &arrays);
+  void interrupt();
 };
 
+CachingSolver::~CachingSolver() {
+  for (cache_map::iterator it = cache.begin(), ie = cache.end(); it != ie;
+       ++it)
+    util::UncountMemory(util::SolverCacheMemory, getEntryBytes(it->first));
+  cache.clear();
+  delete solver;
+}
+
 /** @returns the canonical version of the given query.  The reference
     negationUsed is set to true if the original query was negated in
     the canonicalization process. */
@@ -124,9 +163,10 @@ bool CachingSolver::cacheLookup(const Query& query,
   cache_map::iterator it = cache.find(ce);
   
   if (it != cache.end()) {
+    it->second.referenced = true;
     result = (negationUsed ?
-              IncompleteSolver::negatePartialValidity(it->second) :
-              it->second);
+              IncompleteSolver::negatePartialValidity(it->second.result) :
+              it->second.result);
     return true;
   }
   
@@ -143,7 +183,8 @@ void CachingSolver::cacheInsert(const Query& query,
   IncompleteSolver::PartialValidity cachedResult = 
     (negationUsed ? IncompleteSolver::negatePartialValidity(result) : result);
   
-  cache.insert(std::make_pair(ce, cachedResult));
+  if (cache.insert(std::make_pair(ce, CachedResult(cachedResult))).second)
+    util::CountMemory(util::SolverCacheMemory, getEntryBytes(ce));
 }
 
 bool CachingSolver::computeValidity(const Query& query,
@@ -249,6 +290,49 @@ bool CachingSolver::computeTruth(const Query& query,
   return true;
 }
 
+bool CachingSolver::computeTruthMany(const ConstraintManager &constraints,
+                                     const std::vector< ref<Expr> > &exprs,
+                                     std::vector<bool> &isValid) {
+  isValid.assign(exprs.size(), false);
+
+  // Answer what the cache can, as computeTruth does, and send the misses
+  // down as one batch.
+  std::vector< ref<Expr> > misses;
+  std::vector<unsigned> positions;
+  std::vector<bool> mayBeTrue;
+  for (unsigned i = 0, e = exprs.size(); i != e; ++i) {
+    IncompleteSolver::PartialValidity cachedResult;
+    bool cacheHit = cacheLookup(Query(constraints, exprs[i]), cachedResult);
+    if (cacheHit && cachedResult != IncompleteSolver::MayBeTrue) {
+      ++stats::queryCacheHits;
+      isValid[i] = (cachedResult == IncompleteSolver::MustBeTrue);
+      continue;
+    }
+    ++stats::queryCacheMisses;
+    misses.push_back(exprs[i]);
+    positions.push_back(i);
+    mayBeTrue.push_back(cacheHit);
+  }
+  if (misses.empty())
+    return true;
+
+  std::vector<bool> results;
+  if (!solver->impl->computeTruthMany(constraints, misses, results))
+    return false;
+  for (unsigned i = 0, e = misses.size(); i != e; ++i) {
+    isValid[positions[i]] = results[i];
+    IncompleteSolver::PartialValidity cachedResult;
+    if (results[i])
+      cachedResult = IncompleteSolver::MustBeTrue;
+    else if (mayBeTrue[i])
+      cachedResult = IncompleteSolver::TrueOrFalse;
+    else
+      cachedResult = IncompleteSolver::MayBeFalse;
+    cacheInsert(Query(constraints, misses[i]), cachedResult);
+  }
+  return true;
+}
+
 SolverImpl::SolverRunStatus CachingSolver::getOperationStatusCode() {
   return solver->impl->getOperationStatusCode();
 }
@@ -261,6 +345,36 @@ void CachingSolver::setCoreSolverTimeout(double timeout) {
   solver->impl->setCoreSolverTimeout(timeout);
 }
 
+size_t CachingSolver::trimCaches(size_t bytes) {
+  // Sweep the cache like a clock hand: entries looked up since the last
+  // sweep get a second chance, the others go. Two sweeps can empty it.
+  size_t freed = 0;
+  for (unsigned sweep = 0; sweep != 2 && freed < bytes; ++sweep) {
+    for (cache_map::iterator it = cache.begin();
+         it != cache.end() && freed < bytes;) {
+      if (it->second.referenced) {
+        it->second.referenced = false;
+        ++it;
+        continue;
+      }
+      size_t entryBytes = getEntryBytes(it->first);
+      util::UncountMemory(util::SolverCacheMemory, entryBytes);
+      freed += entryBytes;
+      ++stats::queryCacheEvictions;
+      cache.erase(it++);
+    }
+  }
+  return freed + solver->impl->trimCaches(bytes > freed ? bytes - freed : 0);
+}
+
+void CachingSolver::releaseArrays(const std::vector<const Array *> &arrays) {
+  solver->impl->releaseArrays(arrays);
+}
+
+void CachingSolver::interrupt() {
+  solver->impl->interrupt();
+}
+
 ///
 
 Solver *klee::createCachingSolver(Solver *_solver) {
@@ -0,0 +1,259 @@
+//===-- CanonicalizingSolver.cpp ------------------------------------------===//
+//
+//                     The KLEE Symbolic Virtual Machine
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+//
+// A solver stage which renames the symbolic arrays of a query to canonical
+// ones, numbered in the order the query reads them, before handing it on.
+// Queries which only differ in the names of their arrays, such as those of
+// sibling states or of successive loop iterations making an object symbolic
+// at the same site, then reach the caches below as the same query. Answers
+// do not depend on the names, and the values of the objects of
+// computeInitialValues come back in the order the objects were given, so
+// nothing needs to be renamed back.
+//
+//===----------------------------------------------------------------------===//
+
+#include "klee/Solver.h"
+
+#include "klee/Constraints.h"
+#include "klee/Expr.h"
+#include "klee/SolverImpl.h"
+#include "klee/util/ArrayCache.h"
+#include "klee/util/ExprVisitor.h"
+
+#include "llvm/ADT/StringExtras.h"
+
+#include <map>
+#include <vector>
+
+using namespace klee;
+using namespace llvm;
+
+namespace {
+
+/// ArrayRenamer - Rename the symbolic arrays of the expressions it visits
+/// to the canonical arrays in \a arrays, in the order it meets them.
+/// Constant arrays keep their identity.
+class ArrayRenamer : public ExprVisitor {
+  ArrayCache &arrays;
+  std::map<const Array *, const Array *> renamed;
+  /// The renamed update lists, by their newest update.
+  std::map<const UpdateNode *, UpdateList> lists;
+
+  UpdateList renameUpdates(const UpdateList &ul);
+
+protected:
+  Action visitRead(const ReadExpr &re);
+
+public:
+  ArrayRenamer(ArrayCache &_arrays) : arrays(_arrays) {}
+
+  const Array *rename(const Array *array);
+  void renameQuery(const Query &query, std::vector< ref<Expr> > &constraints,
+                   ref<Expr> &expr);
+};
+
+class CanonicalizingSolver : public SolverImpl {
+private:
+  Solver *solver;
+  /// The canonical arrays, which live as long as the solvers below, whose
+  /// caches hold expressions over them.
+  ArrayCache arrays;
+
+public:
+  CanonicalizingSolver(Solver *_solver) : solver(_solver) {}
+  ~CanonicalizingSolver() { delete solver; }
+
+  bool computeTruth(const Query&, bool &isValid);
+  bool computeTruthMany(const ConstraintManager &constraints,
+                        const std::vector< ref<Expr> > &exprs,
+                        std::vector<bool> &isValid);
+  bool computeValidity(const Query&, Solver::Validity &result);
+  bool computeValue(const Query&, ref<Expr> &result);
+  bool computeRange(const Query&, ref<Expr> &min, ref<Expr> &max);
+  bool computeUniqueValue(const Query&, ref<Expr> &result, bool &isUnique);
+  bool computeInitialValues(const Query& query,
+                            const std::vector<const Array*> &objects,
+                            std::vector< std::vector<unsigned char> > &values,
+                            bool &hasSolution);
+  SolverRunStatus getOperationStatusCode();
+  char *getConstraintLog(const Query&);
+  void setCoreSolverTimeout(double timeout);
+  size_t trimCaches(size_t bytes);
+  void releaseArrays(const std::vector<const Array *> &arrays);
+  void interrupt();
+};
+
+}
+
+const Array *ArrayRenamer::rename(const Array *array) {
+  if (array->isConstantArray())
+    return array;
+  std::map<const Array *, const Array *>::iterator it = renamed.find(array);
+  if (it != renamed.end())
+    return it->second;
+
+  // The cache tells arrays apart by name and size only.
+  std::string name = "arr" + utostr(renamed.size()) + "_" +
+                     utostr(array->getDomain()) + "_" +
+                     utostr(array->getRange());
+  const Array *canonical = arrays.CreateArray(
+      name, array->size, 0, 0, array->getDomain(), array->getRange());
+  renamed.insert(std::make_pair(array, canonical));
+  return canonical;
+}
+
+UpdateList ArrayRenamer::renameUpdates(const UpdateList &ul) {
+  if (!ul.head)
+    return UpdateList(rename(ul.root), 0);
+  std::map<const UpdateNode *, UpdateList>::iterator it = lists.find(ul.head);
+  if (it != lists.end())
+    return it->second;
+
+  // Write the updates over the renamed array oldest first.
+  std::vector<const UpdateNode *> updates;
+  for (const UpdateNode *un = ul.head; un; un = un->next)
+    updates.push_back(un);
+  UpdateList res(rename(ul.root), 0);
+  for (std::vector<const UpdateNode *>::reverse_iterator
+         it = updates.rbegin(), ie = updates.rend(); it != ie; ++it)
+    res.extend(visit((*it)->index), visit((*it)->value));
+  lists.insert(std::make_pair(ul.head, res));
+  return res;
+}
+
+ExprVisitor::Action ArrayRenamer::visitRead(const ReadExpr &re) {
+  UpdateList ul = renameUpdates(re.updates);
+  return Action::changeTo(ReadExpr::create(ul, visit(re.index)));
+}
+
+void ArrayRenamer::renameQuery(const Query &query,
+                               std::vector< ref<Expr> > &constraints,
+                               ref<Expr> &expr) {
+  constraints.reserve(query.constraints.size());
+  for (ConstraintManager::const_iterator it = query.constraints.begin(),
+         ie = query.constraints.end(); it != ie; ++it)
+    constraints.push_back(visit(*it));
+  expr = visit(query.expr);
+}
+
+bool CanonicalizingSolver::computeTruth(const Query& query, bool &isValid) {
+  ArrayRenamer renamer(arrays);
+  std::vector< ref<Expr> > constraints;
+  ref<Expr> expr;
+  renamer.renameQuery(query, constraints, expr);
+  ConstraintManager tmp(constraints);
+  return solver->mustBeTrue(Query(tmp, expr), isValid);
+}
+
+bool CanonicalizingSolver::computeTruthMany(const ConstraintManager &constraints,
+                                            const std::vector< ref<Expr> > &exprs,
+                                            std::vector<bool> &isValid) {
+  ArrayRenamer renamer(arrays);
+  std::vector< ref<Expr> > renamedConstraints;
+  renamedConstraints.reserve(constraints.size());
+  for (ConstraintManager::const_iterator it = constraints.begin(),
+         ie = constraints.end(); it != ie; ++it)
+    renamedConstraints.push_back(renamer.visit(*it));
+  std::vector< ref<Expr> > renamed;
+  renamed.reserve(exprs.size());
+  for (std::vector< ref<Expr> >::const_iterator it = exprs.begin(),
+         ie = exprs.end(); it != ie; ++it)
+    renamed.push_back(renamer.visit(*it));
+
+  ConstraintManager tmp(renamedConstraints);
+  return solver->mustBeTrueMany(tmp, renamed, isValid);
+}
+
+bool CanonicalizingSolver::computeValidity(const Query& query,
+                                           Solver::Validity &result) {
+  ArrayRenamer renamer(arrays);
+  std::vector< ref<Expr> > constraints;
+  ref<Expr> expr;
+  renamer.renameQuery(query, constraints, expr);
+  ConstraintManager tmp(constraints);
+  return solver->evaluate(Query(tmp, expr), result);
+}
+
+bool CanonicalizingSolver::computeValue(const Query& query,
+                                        ref<Expr> &result) {
+  ArrayRenamer renamer(arrays);
+  std::vector< ref<Expr> > constraints;
+  ref<Expr> expr;
+  renamer.renameQuery(query, constraints, expr);
+  ConstraintManager tmp(constraints);
+  return solver->getValue(Query(tmp, expr), result);
+}
+
+bool CanonicalizingSolver::computeRange(const Query& query,
+                                        ref<Expr> &min, ref<Expr> &max) {
+  ArrayRenamer renamer(arrays);
+  std::vector< ref<Expr> > constraints;
+  ref<Expr> expr;
+  renamer.renameQuery(query, constraints, expr);
+  ConstraintManager tmp(constraints);
+  return solver->computeRange(Query(tmp, expr), min, max);
+}
+
+bool CanonicalizingSolver::computeUniqueValue(const Query& query,
+                                              ref<Expr> &result,
+                                              bool &isUnique) {
+  ArrayRenamer renamer(arrays);
+  std::vector< ref<Expr> > constraints;
+  ref<Expr> expr;
+  renamer.renameQuery(query, constraints, expr);
+  ConstraintManager tmp(constraints);
+  return solver->computeUniqueValue(Query(tmp, expr), result, isUnique);
+}
+
+bool CanonicalizingSolver::computeInitialValues(const Query& query,
+                                                const std::vector<const Array*> &objects,
+                                                std::vector< std::vector<unsigned char> > &values,
+                                                bool &hasSolution) {
+  ArrayRenamer renamer(arrays);
+  std::vector< ref<Expr> > constraints;
+  ref<Expr> expr;
+  renamer.renameQuery(query, constraints, expr);
+  // Objects the query does not read are numbered after those it does.
+  std::vector<const Array*> renamedObjects;
+  renamedObjects.reserve(objects.size());
+  for (std::vector<const Array*>::const_iterator it = objects.begin(),
+         ie = objects.end(); it != ie; ++it)
+    renamedObjects.push_back(renamer.rename(*it));
+  ConstraintManager tmp(constraints);
+  return solver->impl->computeInitialValues(Query(tmp, expr), renamedObjects,
+                                            values, hasSolution);
+}
+
+SolverImpl::SolverRunStatus CanonicalizingSolver::getOperationStatusCode() {
+  return solver->impl->getOperationStatusCode();
+}
+
+char *CanonicalizingSolver::getConstraintLog(const Query& query) {
+  return solver->impl->getConstraintLog(query);
+}
+
+void CanonicalizingSolver::setCoreSolverTimeout(double timeout) {
+  solver->impl->setCoreSolverTimeout(timeout);
+}
+
+size_t CanonicalizingSolver::trimCaches(size_t bytes) {
+  return solver->impl->trimCaches(bytes);
+}
+
+void CanonicalizingSolver::releaseArrays(const std::vector<const Array *> &arrays) {
+  solver->impl->releaseArrays(arrays);
+}
+
+void CanonicalizingSolver::interrupt() {
+  solver->impl->interrupt();
+}
+
+Solver *klee::createCanonicalizingSolver(Solver *s) {
+  return new Solver(new CanonicalizingSolver(s));
+}
@@ -14,6 +14,7 @@
 #include "klee/SolverImpl.h"
 #include "klee/TimerStatIncrementer.h"
 #include "klee/util/Assignment.h"
+#include "klee/util/BatchEvaluator.h"
 #include "klee/util/ExprUtil.h"
 #include "klee/util/ExprVisitor.h"
 #include "klee/Internal/ADT/MapOfSets.h"
@@ -21,9 +22,12 @@
 #include "klee/SolverStats.h"
 
 #include "klee/Internal/Support/ErrorHandling.h"
+#include "klee/Internal/System/MemoryUsage.h"
 
 #include "llvm/Support/CommandLine.h"
 
+#include <list>
+
 using namespace klee;
 using namespace llvm;
 
@@ -44,6 +48,21 @@ namespace {
   cl::opt<bool>
   CexCacheExperimental("cex-cache-exp", cl::init(false));
 
+  cl::opt<unsigned>
+  CexCacheMaxAssignments("cex-cache-max-assignments",
+                         cl::desc("Maximum number of counterexamples kept by "
+                                  "the counterexample cache. The least "
+                                  "recently used ones are evicted first. "
+                                  "0 is no limit (default=0)"),
+                         cl::init(0));
+
+  cl::opt<bool>
+  CexCacheBatchEval("cex-cache-batch-eval",
+                    cl::desc("Check the counterexamples tried for a query "
+                             "many at a time with a compiled evaluator "
+                             "(default=on)"),
+                    cl::init(true));
+
 }
 
 ///
@@ -65,6 +84,17 @@ class CexCachingSolver : public SolverImpl {
   MapOfSets<ref<Expr>, Assignment*> cache;
   // memo table
   assignmentsTable_ty assignmentsTable;
+  // The assignments in the memo table which bind each array.
+  std::map<const Array*, std::set<Assignment*> > assignmentsByArray;
+  // The assignments in the memo table from the most to the least recently
+  // used.
+  std::list<Assignment*> lruAssignments;
+  std::map<Assignment*, std::list<Assignment*>::iterator> lruPositions;
+
+  Assignment *memoizeAssignment(Assignment *binding);
+  void touchAssignment(Assignment *a);
+  void evictAssignments();
+  size_t evictLeastRecentlyUsed(size_t count, size_t bytes);
 
   bool searchForAssignment(KeyType &key, 
                            Assignment *&result);
@@ -83,8 +113,18 @@ public:
   ~CexCachingSolver();
   
   bool computeTruth(const Query&, bool &isValid);
+  bool computeTruthMany(const ConstraintManager &constraints,
+                        const std::vector< ref<Expr> > &exprs,
+                        std::vector<bool> &isValid);
   bool computeValidity(const Query&, Solver::Validity &result);
   bool computeValue(const Query&, ref<Expr> &result);
+  bool computeRange(const Query& query, ref<Expr> &min, ref<Expr> &max) {
+    return solver->impl->computeRange(query, min, max);
+  }
+  bool computeUniqueValue(const Query& query, ref<Expr> &result,
+                          bool &isUnique) {
+    return solver->impl->computeUniqueValue(query, result, isUnique);
+  }
   bool computeInitialValues(const Query&,
                             const std::vector<const Array*> &objects,
                             std::vector< std::vector<unsigned char> > &values,
@@ -92,6 +132,9 @@ public:
   SolverRunStatus getOperationStatusCode();
   char *getConstraintLog(const Query& query);
   void setCoreSolverTimeout(double timeout);
+  size_t trimCaches(size_t bytes);
+  void releaseArrays(const std::vector<const Array *> &arrays);
+  void interrupt();
 };
 
 ///
@@ -104,16 +147,178 @@ struct NonNullAssignment {
   bool operator()(Assignment *a) const { return a!=0; }
 };
 
+/// KeyChecker - Check assignments against the constraints of a key.
+/// Candidates for the same key tend to fail on the same constraint, so the
+/// one which rejected the last candidate is tried first, and candidates
+/// which were already rejected are not evaluated again.
+class KeyChecker {
+  std::vector< ref<Expr> > constraints;
+  std::set<Assignment*> rejected;
+
+public:
+  KeyChecker(const KeyType &key) : constraints(key.begin(), key.end()) {}
+
+  bool satisfies(Assignment *a) {
+    if (rejected.count(a))
+      return false;
+    AssignmentEvaluator v(*a);
+    for (unsigned i = 0, e = constraints.size(); i != e; ++i) {
+      if (!v.visit(constraints[i])->isTrue()) {
+        std::swap(constraints[0], constraints[i]);
+        rejected.insert(a);
+        return false;
+      }
+    }
+    return true;
+  }
+};
+
+/// findInBatches - Evaluate the constraints of \a key under \a candidates
+/// BatchEvaluator::BatchSize at a time, setting \a result to the first one
+/// the checker confirms satisfies them, or null. Returns false if the
+/// constraints can't be compiled, leaving the candidates to the checker.
+static bool findInBatches(const KeyType &key,
+                          const std::set<Assignment*> &candidates,
+                          KeyChecker &checker, Assignment *&result) {
+  BatchEvaluator be;
+  for (KeyType::const_iterator it = key.begin(), ie = key.end(); it != ie;
+       ++it)
+    if (!be.add(*it))
+      return false;
+
+  result = 0;
+  std::vector<Assignment*> batch;
+  for (std::set<Assignment*>::const_iterator it = candidates.begin(),
+         ie = candidates.end(); it != ie;) {
+    batch.clear();
+    for (; it != ie && batch.size() != BatchEvaluator::BatchSize; ++it)
+      batch.push_back(*it);
+    be.evaluate(&batch[0], batch.size());
+
+    for (unsigned i = 0; i != batch.size(); ++i) {
+      bool holds = true;
+      for (KeyType::const_iterator kit = key.begin(), kie = key.end();
+           kit != kie && holds; ++kit)
+        holds = be.isTrue(*kit, i);
+      if (holds && checker.satisfies(batch[i])) {
+        result = batch[i];
+        return true;
+      }
+    }
+  }
+  return true;
+}
+
 struct NullOrSatisfyingAssignment {
-  KeyType &key;
+  KeyChecker &checker;
   
-  NullOrSatisfyingAssignment(KeyType &_key) : key(_key) {}
+  NullOrSatisfyingAssignment(KeyChecker &_checker) : checker(_checker) {}
 
   bool operator()(Assignment *a) const { 
-    return !a || a->satisfies(key.begin(), key.end()); 
+    return !a || checker.satisfies(a);
   }
 };
 
+struct EvictedAssignment {
+  const std::set<Assignment*> &evicted;
+
+  EvictedAssignment(const std::set<Assignment*> &_evicted)
+    : evicted(_evicted) {}
+
+  bool operator()(Assignment *a) const { return evicted.count(a) != 0; }
+};
+
+/// getAssignmentBytes - Roughly the memory \a a holds, for
+/// util::SolverCacheMemory.
+static size_t getAssignmentBytes(const Assignment *a) {
+  size_t bytes = sizeof(*a);
+  for (Assignment::bindings_ty::const_iterator it = a->bindings.begin(),
+         ie = a->bindings.end(); it != ie; ++it)
+    bytes += 4 * sizeof(void *) + sizeof(*it) + it->second.capacity();
+  return bytes;
+}
+
+/// memoizeAssignment - Add \a binding to the memo table, unless an equal
+/// assignment is already there, in which case \a binding is deleted.
+///
+/// \return - The assignment in the memo table.
+Assignment *CexCachingSolver::memoizeAssignment(Assignment *binding) {
+  std::pair<assignmentsTable_ty::iterator, bool>
+    res = assignmentsTable.insert(binding);
+  if (!res.second) {
+    delete binding;
+    binding = *res.first;
+  } else {
+    util::CountMemory(util::SolverCacheMemory, getAssignmentBytes(binding));
+    for (Assignment::bindings_ty::iterator it = binding->bindings.begin(),
+           ie = binding->bindings.end(); it != ie; ++it)
+      assignmentsByArray[it->first].insert(binding);
+  }
+  touchAssignment(binding);
+  return binding;
+}
+
+void CexCachingSolver::touchAssignment(Assignment *a) {
+  std::map<Assignment*, std::list<Assignment*>::iterator>::iterator
+    it = lruPositions.find(a);
+  if (it != lruPositions.end()) {
+    lruAssignments.splice(lruAssignments.begin(), lruAssignments, it->second);
+  } else {
+    lruAssignments.push_front(a);
+    lruPositions.insert(std::make_pair(a, lruAssignments.begin()));
+  }
+}
+
+/// evictAssignments - Once there are more assignments than
+/// -cex-cache-max-assignments, evict the least recently used tenth of them.
+void CexCachingSolver::evictAssignments() {
+  if (!CexCacheMaxAssignments || 
+      lruAssignments.size() <= CexCacheMaxAssignments)
+    return;
+
+  unsigned target = CexCacheMaxAssignments - CexCacheMaxAssignments / 10;
+  evictLeastRecentlyUsed(lruAssignments.size() - target, 0);
+}
+
+/// evictLeastRecentlyUsed - Evict the least recently used assignments, at
+/// least \a count of them and enough to free \a bytes, along with the cache
+/// entries which refer to them, in a single walk of the cache. Entries for
+/// unsatisfiable queries are kept.
+///
+/// \return - The bytes freed.
+size_t CexCachingSolver::evictLeastRecentlyUsed(size_t count, size_t bytes) {
+  std::set<Assignment*> evicted;
+  size_t freed = 0;
+  while (!lruAssignments.empty() && (evicted.size() < count || freed < bytes)) {
+    Assignment *a = lruAssignments.back();
+    lruAssignments.pop_back();
+    lruPositions.erase(a);
+    evicted.insert(a);
+    freed += getAssignmentBytes(a);
+  }
+  if (evicted.empty())
+    return 0;
+
+  cache.removeIf(EvictedAssignment(evicted));
+  for (std::set<Assignment*>::iterator it = evicted.begin(), 
+         ie = evicted.end(); it != ie; ++it) {
+    Assignment *a = *it;
+    assignmentsTable.erase(a);
+    for (Assignment::bindings_ty::iterator bit = a->bindings.begin(),
+           bie = a->bindings.end(); bit != bie; ++bit) {
+      std::map<const Array*, std::set<Assignment*> >::iterator
+        ait = assignmentsByArray.find(bit->first);
+      ait->second.erase(a);
+      if (ait->second.empty())
+        assignmentsByArray.erase(ait);
+    }
+    util::UncountMemory(util::SolverCacheMemory, getAssignmentBytes(a));
+    delete a;
+  }
+  stats::queryCexCacheEvictions += evicted.size();
+  return freed;
+}
+
 /// searchForAssignment - Look for a cached solution for a query.
 ///
 /// \param key - The query to look up.
@@ -145,15 +350,46 @@ bool CexCachingSolver::searchForAssignment(KeyType &key, Assignment *&result) {
       return true;
     }
 
-    // Otherwise, iterate through the set of current assignments to see if one
-    // of them satisfies the query.
-    for (assignmentsTable_ty::iterator it = assignmentsTable.begin(), 
-           ie = assignmentsTable.end(); it != ie; ++it) {
-      Assignment *a = *it;
-      if (a->satisfies(key.begin(), key.end())) {
-        result = a;
+    // Otherwise, try the current assignments which bind an array the query
+    // reads. Every other assignment reads zeros from all of them, as does
+    // an assignment binding nothing, so that one is tried in their place.
+    std::vector<const Array*> objects;
+    findSymbolicObjects(key.begin(), key.end(), objects);
+    std::set<Assignment*> candidates;
+    for (std::vector<const Array*>::iterator it = objects.begin(),
+           ie = objects.end(); it != ie; ++it) {
+      std::map<const Array*, std::set<Assignment*> >::iterator
+        ait = assignmentsByArray.find(*it);
+      if (ait != assignmentsByArray.end())
+        candidates.insert(ait->second.begin(), ait->second.end());
+    }
+
+    KeyChecker checker(key);
+    Assignment *found = 0;
+    if (CexCacheBatchEval && candidates.size() > 1 &&
+        findInBatches(key, candidates, checker, found)) {
+      if (found) {
+        result = found;
         return true;
       }
+    } else {
+      for (std::set<Assignment*>::iterator it = candidates.begin(),
+             ie = candidates.end(); it != ie; ++it) {
+        if (checker.satisfies(*it)) {
+          result = *it;
+          return true;
+        }
+      }
+    }
+
+    Assignment zeros;
+    if (checker.satisfies(&zeros)) {
+      std::vector< std::vector<unsigned char> > values;
+      for (std::vector<const Array*>::iterator it = objects.begin(),
+             ie = objects.end(); it != ie; ++it)
+        values.push_back(std::vector<unsigned char>((*it)->size, 0));
+      result = memoizeAssignment(new Assignment(objects, values));
+      return true;
     }
   } else {
     // FIXME: Which order? one is sure to be better.
@@ -169,8 +405,10 @@ bool CexCachingSolver::searchForAssignment(KeyType &key, Assignment *&result) {
     // assignment. While searching subsets, we also explicitly the solutions for
     // satisfiable subsets to see if they solve the current query and return
     // them if so. This is cheap and frequently succeeds.
-    if (!lookup) 
-      lookup = cache.findSubset(key, NullOrSatisfyingAssignment(key));
+    if (!lookup) {
+      KeyChecker checker(key);
+      lookup = cache.findSubset(key, NullOrSatisfyingAssignment(checker));
+    }
 
     // If either lookup succeeded, then we have a cached solution.
     if (lookup) {
@@ -206,9 +444,11 @@ bool CexCachingSolver::lookupAssignment(const Query &query,
   }
 
   bool found = searchForAssignment(key, result);
-  if (found)
+  if (found) {
     ++stats::queryCexCacheHits;
-  else ++stats::queryCexCacheMisses;
+    if (result)
+      touchAssignment(result);
+  } else ++stats::queryCexCacheMisses;
     
   return found;
 }
@@ -229,15 +469,8 @@ bool CexCachingSolver::getAssignment(const Query& query, Assignment *&result) {
     
   Assignment *binding;
   if (hasSolution) {
-    binding = new Assignment(objects, values);
-
     // Memoize the result.
-    std::pair<assignmentsTable_ty::iterator, bool>
-      res = assignmentsTable.insert(binding);
-    if (!res.second) {
-      delete binding;
-      binding = *res.first;
-    }
+    binding = memoizeAssignment(new Assignment(objects, values));
     
     if (DebugCexCacheCheckBinding)
       if (!binding->satisfies(key.begin(), key.end())) {
@@ -251,6 +484,7 @@ bool CexCachingSolver::getAssignment(const Query& query, Assignment *&result) {
   
   result = binding;
   cache.insert(key, binding);
+  evictAssignments();
 
   return true;
 }
@@ -261,8 +495,10 @@ CexCachingSolver::~CexCachingSolver() {
   cache.clear();
   delete solver;
   for (assignmentsTable_ty::iterator it = assignmentsTable.begin(), 
-         ie = assignmentsTable.end(); it != ie; ++it)
+         ie = assignmentsTable.end(); it != ie; ++it) {
+    util::UncountMemory(util::SolverCacheMemory, getAssignmentBytes(*it));
     delete *it;
+  }
 }
 
 bool CexCachingSolver::computeValidity(const Query& query,
@@ -316,6 +552,43 @@ bool CexCachingSolver::computeTruth(const Query& query,
   return true;
 }
 
+bool CexCachingSolver::computeTruthMany(const ConstraintManager &constraints,
+                                        const std::vector< ref<Expr> > &exprs,
+                                        std::vector<bool> &isValid) {
+  TimerStatIncrementer t(stats::cexCacheTime);
+  isValid.assign(exprs.size(), false);
+
+  // The cached assignments answer what they can, and the rest goes down as
+  // one batch. Its answers come without assignments, so only those which
+  // are valid, having none, are cached.
+  std::vector< ref<Expr> > misses;
+  std::vector<unsigned> positions;
+  std::vector<KeyType> keys;
+  for (unsigned i = 0, e = exprs.size(); i != e; ++i) {
+    KeyType key;
+    Assignment *a;
+    if (lookupAssignment(Query(constraints, exprs[i]), key, a)) {
+      isValid[i] = !a;
+      continue;
+    }
+    misses.push_back(exprs[i]);
+    positions.push_back(i);
+    keys.push_back(key);
+  }
+  if (misses.empty())
+    return true;
+
+  std::vector<bool> results;
+  if (!solver->impl->computeTruthMany(constraints, misses, results))
+    return false;
+  for (unsigned i = 0, e = misses.size(); i != e; ++i) {
+    isValid[positions[i]] = results[i];
+    if (results[i])
+      cache.insert(keys[i], (Assignment*) 0);
+  }
+  return true;
+}
+
 bool CexCachingSolver::computeValue(const Query& query,
                                     ref<Expr> &result) {
   TimerStatIncrementer t(stats::cexCacheTime);
@@ -375,6 +648,19 @@ void CexCachingSolver::setCoreSolverTimeout(double timeout) {
   solver->impl->setCoreSolverTimeout(timeout);
 }
 
+size_t CexCachingSolver::trimCaches(size_t bytes) {
+  size_t freed = bytes ? evictLeastRecentlyUsed(0, bytes) : 0;
+  return freed + solver->impl->trimCaches(bytes > freed ? bytes - freed : 0);
+}
+
+void CexCachingSolver::releaseArrays(const std::vector<const Array *> &arrays) {
+  solver->impl->releaseArrays(arrays);
+}
+
+void CexCachingSolver::interrupt() {
+  solver->impl->interrupt();
+}
+
 ///
 
 Solver *klee::createCexCachingSolver(Solver *_solver) {
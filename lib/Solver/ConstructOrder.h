@@ -0,0 +1,67 @@
+//===-- ConstructOrder.h ----------------------------------------*- C++ -*-===//
+//
+//                     The KLEE Symbolic Virtual Machine
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+
+#ifndef __UTIL_CONSTRUCTORDER_H__
+#define __UTIL_CONSTRUCTORDER_H__
+
+#include "klee/Expr.h"
+
+#include <utility>
+#include <vector>
+
+namespace klee {
+
+/// constructKidsFirst - Have \a builder construct everything below \a root,
+/// children before parents, with an explicit stack: the kids of every
+/// expression, and the indices and values of the updates a read goes
+/// through. Constructing \a root afterwards then only looks its kids up in
+/// the construction cache, however deep the expression is, instead of
+/// recursing all the way down.
+///
+/// The builder provides:
+///  - isConstructed(e), true for cached expressions and for those which need
+///    no construction at all, such as constants;
+///  - isConstructed(un), true for update nodes already built, which implies
+///    the older ones are too;
+///  - constructsKids(e), false for expressions whose construction does not
+///    go through their kids as they are, which are left whole;
+///  - constructAndCache(e), which builds \a e, its kids being cached.
+template <class Builder>
+void constructKidsFirst(Builder &builder, const ref<Expr> &root) {
+  // Each entry is an expression and whether its kids have been pushed.
+  std::vector<std::pair<ref<Expr>, bool> > stack;
+  stack.push_back(std::make_pair(root, false));
+  while (!stack.empty()) {
+    ref<Expr> e = stack.back().first;
+    if (builder.isConstructed(e)) {
+      stack.pop_back();
+      continue;
+    }
+    if (stack.back().second || !builder.constructsKids(e)) {
+      stack.pop_back();
+      if (e != root)
+        builder.constructAndCache(e);
+      continue;
+    }
+
+    stack.back().second = true;
+    if (const ReadExpr *re = dyn_cast<ReadExpr>(e))
+      for (const UpdateNode *un = re->updates.head;
+           un && !builder.isConstructed(un); un = un->next) {
+        stack.push_back(std::make_pair(un->value, false));
+        stack.push_back(std::make_pair(un->index, false));
+      }
+    for (unsigned i = e->getNumKids(); i != 0; --i)
+      stack.push_back(std::make_pair(e->getKid(i - 1), false));
+  }
+}
+
+}
+
+#endif
@@ -13,6 +13,7 @@
 #include "llvm/Support/ErrorHandling.h"
 #include "llvm/Support/raw_ostream.h"
 #include <string>
+#include <vector>
 
 #ifdef ENABLE_METASMT
 
@@ -32,24 +33,24 @@ using namespace klee;
 using namespace metaSMT;
 using namespace metaSMT::solver;
 
-static klee::Solver *handleMetaSMT() {
+static klee::Solver *handleMetaSMT(MetaSMTBackendType type, bool useForked,
+                                   std::string &backend) {
   Solver *coreSolver = NULL;
-  std::string backend;
-  switch (MetaSMTBackend) {
+  switch (type) {
   case METASMT_BACKEND_STP:
     backend = "STP";
     coreSolver = new MetaSMTSolver<DirectSolver_Context<STP_Backend> >(
-        UseForkedCoreSolver, CoreSolverOptimizeDivides);
+        useForked, CoreSolverOptimizeDivides);
     break;
   case METASMT_BACKEND_Z3:
     backend = "Z3";
     coreSolver = new MetaSMTSolver<DirectSolver_Context<Z3_Backend> >(
-        UseForkedCoreSolver, CoreSolverOptimizeDivides);
+        useForked, CoreSolverOptimizeDivides);
     break;
   case METASMT_BACKEND_BOOLECTOR:
     backend = "Boolector";
     coreSolver = new MetaSMTSolver<DirectSolver_Context<Boolector> >(
-        UseForkedCoreSolver, CoreSolverOptimizeDivides);
+        useForked, CoreSolverOptimizeDivides);
     break;
   default:
     llvm_unreachable("Unrecognised MetaSMT backend");
@@ -58,16 +59,93 @@ static klee::Solver *handleMetaSMT() {
   klee_message("Starting MetaSMTSolver(%s)", backend.c_str());
   return coreSolver;
 }
+
+static klee::Solver *handleMetaSMT(bool useForked) {
+  std::string backend;
+  return handleMetaSMT(MetaSMTBackend, useForked, backend);
+}
 #endif /* ENABLE_METASMT */
 
 namespace klee {
 
-Solver *createCoreSolver(CoreSolverType cst) {
+static Solver *createCoreSolver(CoreSolverType cst, bool useForked);
+
+const char *getCoreSolverName(CoreSolverType cst) {
+  switch (cst) {
+  case STP_SOLVER:
+    return "stp";
+  case METASMT_SOLVER:
+    return "metasmt";
+  case DUMMY_SOLVER:
+    return "dummy";
+  case Z3_SOLVER:
+    return "z3";
+  case BITWUZLA_SOLVER:
+    return "bitwuzla";
+  case PORTFOLIO_SOLVER:
+    return "portfolio";
+  default:
+    return "none";
+  }
+}
+
+static Solver *createPortfolio() {
+  std::vector<CoreSolverType> types(PortfolioSolvers.begin(),
+                                    PortfolioSolvers.end());
+  if (types.empty()) {
+#ifdef ENABLE_Z3
+    types.push_back(Z3_SOLVER);
+#endif
+#ifdef ENABLE_STP
+    types.push_back(STP_SOLVER);
+#endif
+  }
+
+  std::vector<Solver *> solvers;
+  std::vector<std::string> names;
+  for (unsigned i = 0, e = types.size(); i != e; ++i) {
+    CoreSolverType type = types[i];
+    if (type == PORTFOLIO_SOLVER || type == NO_SOLVER) {
+      klee_warning("Ignoring invalid portfolio solver configuration");
+      continue;
+    }
+#ifdef ENABLE_METASMT
+    // Each metaSMT backend races as a configuration of its own.
+    if (type == METASMT_SOLVER) {
+      std::vector<MetaSMTBackendType> backends(
+          PortfolioMetaSMTBackends.begin(), PortfolioMetaSMTBackends.end());
+      if (backends.empty())
+        backends.push_back(MetaSMTBackend);
+      for (unsigned j = 0, f = backends.size(); j != f; ++j) {
+        std::string backend;
+        solvers.push_back(
+            handleMetaSMT(backends[j], /*useForked=*/false, backend));
+        names.push_back("metasmt-" + backend);
+      }
+      continue;
+    }
+#endif
+    // The portfolio already runs every configuration in its own process,
+    // so the configurations themselves must not fork.
+    Solver *solver = createCoreSolver(type, /*useForked=*/false);
+    if (!solver)
+      continue;
+    solvers.push_back(solver);
+    names.push_back(getCoreSolverName(type));
+  }
+  if (solvers.empty()) {
+    klee_message("No usable portfolio solver configuration");
+    return NULL;
+  }
+  return createPortfolioSolver(solvers, names);
+}
+
+static Solver *createCoreSolver(CoreSolverType cst, bool useForked) {
   switch (cst) {
   case STP_SOLVER:
 #ifdef ENABLE_STP
     klee_message("Using STP solver backend");
-    return new STPSolver(UseForkedCoreSolver, CoreSolverOptimizeDivides);
+    return new STPSolver(useForked, CoreSolverOptimizeDivides);
 #else
     klee_message("Not compiled with STP support");
     return NULL;
@@ -75,7 +153,7 @@ Solver *createCoreSolver(CoreSolverType cst) {
   case METASMT_SOLVER:
 #ifdef ENABLE_METASMT
     klee_message("Using MetaSMT solver backend");
-    return handleMetaSMT();
+    return handleMetaSMT(useForked);
 #else
     klee_message("Not compiled with MetaSMT support");
     return NULL;
@@ -85,11 +163,23 @@ Solver *createCoreSolver(CoreSolverType cst) {
   case Z3_SOLVER:
 #ifdef ENABLE_Z3
     klee_message("Using Z3 solver backend");
-    return new Z3Solver();
+    return new Z3Solver(useForked);
 #else
     klee_message("Not compiled with Z3 support");
     return NULL;
 #endif
+  case BITWUZLA_SOLVER:
+#ifdef ENABLE_BITWUZLA
+    // Timeouts are enforced in process, so there is nothing to fork for.
+    klee_message("Using Bitwuzla solver backend");
+    return new BitwuzlaSolver();
+#else
+    klee_message("Not compiled with Bitwuzla support");
+    return NULL;
+#endif
+  case PORTFOLIO_SOLVER:
+    klee_message("Using portfolio solver backend");
+    return createPortfolio();
   case NO_SOLVER:
     klee_message("Invalid solver");
     return NULL;
@@ -97,4 +187,8 @@ Solver *createCoreSolver(CoreSolverType cst) {
     llvm_unreachable("Unsupported CoreSolverType");
   }
 }
+
+Solver *createCoreSolver(CoreSolverType cst) {
+  return createCoreSolver(cst, UseForkedCoreSolver);
+}
 }
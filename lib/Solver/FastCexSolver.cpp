@@ -20,9 +20,12 @@
 #include "klee/Internal/Support/Debug.h"
 #include "klee/Internal/Support/IntEvaluation.h"
 
+#include "llvm/ADT/APFloat.h"
 #include "llvm/Support/raw_ostream.h"
+#include <algorithm>
 #include <sstream>
 #include <cassert>
+#include <cmath>
 #include <map>
 #include <vector>
 
@@ -342,6 +345,352 @@ public:
   }
 };
 
+/***/
+
+// Floating-point ranges. Only single and double precision are handled, since
+// their bit patterns fit in a ValueRange.
+
+static inline const llvm::fltSemantics * fpWidthToSemantics(unsigned width) {
+  switch(width) {
+  case Expr::Fl32:
+    return &llvm::APFloat::IEEEsingle;
+  case Expr::Fl64:
+    return &llvm::APFloat::IEEEdouble;
+  default:
+    return 0;
+  }
+}
+
+static inline uint64_t fpToBits(const llvm::APFloat &f) {
+  return f.bitcastToAPInt().getZExtValue();
+}
+
+static inline llvm::APFloat fpFromBits(unsigned width, uint64_t bits) {
+  return llvm::APFloat(*fpWidthToSemantics(width), llvm::APInt(width, bits));
+}
+
+static inline bool fpLess(const llvm::APFloat &a, const llvm::APFloat &b) {
+  return a.compare(b) == llvm::APFloat::cmpLessThan;
+}
+
+static inline const llvm::APFloat &fpMin(const llvm::APFloat &a,
+                                         const llvm::APFloat &b) {
+  return fpLess(b, a) ? b : a;
+}
+
+static inline const llvm::APFloat &fpMax(const llvm::APFloat &a,
+                                         const llvm::APFloat &b) {
+  return fpLess(a, b) ? b : a;
+}
+
+/// FloatRange - A conservative description of a set of floating-point values,
+/// as the interval [lo, hi] of the non-NaN values plus whether NaN is
+/// possible. Signed zeros are not told apart since they compare equal.
+class FloatRange {
+public:
+  llvm::APFloat lo, hi;
+  /// hasValue - Whether any non-NaN value is possible; if not, lo and hi are
+  /// meaningless.
+  bool hasValue;
+  bool mayBeNaN;
+
+  FloatRange(const llvm::APFloat &_lo, const llvm::APFloat &_hi,
+             bool _mayBeNaN)
+    : lo(_lo), hi(_hi), hasValue(true), mayBeNaN(_mayBeNaN) {}
+  FloatRange(const llvm::APFloat &value)
+    : lo(value), hi(value), hasValue(!value.isNaN()),
+      mayBeNaN(value.isNaN()) {}
+
+  static FloatRange full(unsigned width) {
+    const llvm::fltSemantics &sem = *fpWidthToSemantics(width);
+    return FloatRange(llvm::APFloat::getInf(sem, true),
+                      llvm::APFloat::getInf(sem, false), true);
+  }
+  static FloatRange empty(unsigned width) {
+    FloatRange res(llvm::APFloat::getZero(*fpWidthToSemantics(width)));
+    res.hasValue = false;
+    return res;
+  }
+
+  bool isFixed() const {
+    return hasValue && !mayBeNaN && lo.compare(hi) == llvm::APFloat::cmpEqual;
+  }
+  bool mayBeInfinity() const {
+    return hasValue && (lo.isInfinity() || hi.isInfinity());
+  }
+  bool mayBeZero() const {
+    llvm::APFloat zero = llvm::APFloat::getZero(lo.getSemantics());
+    return hasValue && !fpLess(zero, lo) && !fpLess(hi, zero);
+  }
+
+  FloatRange set_union(const FloatRange &b) const {
+    FloatRange res(b.hasValue ? b : *this);
+    if (hasValue && b.hasValue) {
+      res.lo = fpMin(lo, b.lo);
+      res.hi = fpMax(hi, b.hi);
+    }
+    res.mayBeNaN = mayBeNaN || b.mayBeNaN;
+    return res;
+  }
+
+  /// fromBits - Return the range of the values whose bit patterns are in the
+  /// given range. Non-negative values are ordered like their bit patterns,
+  /// negative values in reverse, and NaNs sit above the infinities.
+  static FloatRange fromBits(unsigned width, const ValueRange &bits) {
+    const llvm::fltSemantics &sem = *fpWidthToSemantics(width);
+    uint64_t signBit = UINT64_C(1) << (width - 1);
+    uint64_t posInf = fpToBits(llvm::APFloat::getInf(sem, false));
+    uint64_t negInf = signBit | posInf;
+
+    FloatRange res = empty(width);
+    if (bits.isEmpty())
+      return res;
+
+    uint64_t min = bits.min();
+    uint64_t max = std::min(bits.max(), bits64::maxValueOfNBits(width));
+    if (min < signBit) {
+      uint64_t top = std::min(max, signBit - 1);
+      if (min <= posInf)
+        res = res.set_union(FloatRange(fpFromBits(width, min),
+                                       fpFromBits(width,
+                                                  std::min(top, posInf)),
+                                       false));
+      if (top > posInf)
+        res.mayBeNaN = true;
+    }
+    if (max >= signBit) {
+      uint64_t bottom = std::max(min, signBit);
+      if (bottom <= negInf)
+        res = res.set_union(FloatRange(fpFromBits(width,
+                                                  std::min(max, negInf)),
+                                       fpFromBits(width, bottom),
+                                       false));
+      if (max > negInf)
+        res.mayBeNaN = true;
+    }
+    return res;
+  }
+
+  /// toBits - Return a range of bit patterns covering these values.
+  ValueRange toBits(unsigned width) const {
+    if (hasValue && !mayBeNaN) {
+      if (!lo.isNegative())
+        return ValueRange(fpToBits(lo), fpToBits(hi));
+      if (hi.isNegative())
+        return ValueRange(fpToBits(hi), fpToBits(lo));
+    }
+    return ValueRange(0, bits64::maxValueOfNBits(width));
+  }
+};
+
+/// FloatRelation - The relation a floating-point comparison tests between
+/// two non-NaN operands.
+enum FloatRelation { FRelLt, FRelLe, FRelGt, FRelGe, FRelEq, FRelNe };
+
+static FloatRelation getFloatRelation(Expr::Kind k) {
+  switch (k) {
+  case Expr::FOlt: case Expr::FUlt: return FRelLt;
+  case Expr::FOle: case Expr::FUle: return FRelLe;
+  case Expr::FOgt: case Expr::FUgt: return FRelGt;
+  case Expr::FOge: case Expr::FUge: return FRelGe;
+  case Expr::FOeq: case Expr::FUeq: return FRelEq;
+  case Expr::FOne: case Expr::FUne: return FRelNe;
+  default:
+    assert(0 && "invalid floating-point comparison");
+    return FRelEq;
+  }
+}
+
+/// isUnorderedFloatCompare - Return whether a comparison is true, rather
+/// than false, when an operand is NaN.
+static bool isUnorderedFloatCompare(Expr::Kind k) {
+  switch (k) {
+  case Expr::FUno: case Expr::FUeq: case Expr::FUgt: case Expr::FUge:
+  case Expr::FUlt: case Expr::FUle: case Expr::FUne:
+    return true;
+  default:
+    return false;
+  }
+}
+
+/// swapFloatRelation - Return r' such that "a r b" is "b r' a".
+static FloatRelation swapFloatRelation(FloatRelation r) {
+  switch (r) {
+  case FRelLt: return FRelGt;
+  case FRelLe: return FRelGe;
+  case FRelGt: return FRelLt;
+  case FRelGe: return FRelLe;
+  default: return r;
+  }
+}
+
+static FloatRelation negateFloatRelation(FloatRelation r) {
+  switch (r) {
+  case FRelLt: return FRelGe;
+  case FRelLe: return FRelGt;
+  case FRelGt: return FRelLe;
+  case FRelGe: return FRelLt;
+  case FRelEq: return FRelNe;
+  default: return FRelEq;
+  }
+}
+
+/// evalFloatRelation - Compute whether the relation must hold, and whether
+/// it may hold, between the non-NaN values of two ranges.
+static void evalFloatRelation(FloatRelation r, const FloatRange &left,
+                              const FloatRange &right, bool &must, bool &may) {
+  switch (r) {
+  case FRelLt:
+    must = fpLess(left.hi, right.lo);
+    may = fpLess(left.lo, right.hi);
+    break;
+  case FRelLe:
+    must = !fpLess(right.lo, left.hi);
+    may = !fpLess(right.hi, left.lo);
+    break;
+  case FRelGt:
+  case FRelGe:
+    evalFloatRelation(swapFloatRelation(r), right, left, must, may);
+    break;
+  case FRelEq:
+    must = left.isFixed() && right.isFixed() &&
+      left.lo.compare(right.lo) == llvm::APFloat::cmpEqual;
+    may = !fpLess(left.hi, right.lo) && !fpLess(right.hi, left.lo);
+    break;
+  case FRelNe: {
+    bool mustEq, mayEq;
+    evalFloatRelation(FRelEq, left, right, mustEq, mayEq);
+    must = !mayEq;
+    may = !mustEq;
+    break;
+  }
+  }
+}
+
+/// evalFloatCompare - Return 1 if the comparison must be true over the given
+/// ranges, 0 if it must be false and -1 if either is possible.
+static int evalFloatCompare(Expr::Kind k, const FloatRange &left,
+                            const FloatRange &right) {
+  bool anyNaN = left.mayBeNaN || right.mayBeNaN;
+  // If an operand has no non-NaN value the comparison is always unordered.
+  bool allNaN = !left.hasValue || !right.hasValue;
+
+  if (k == Expr::FOrd || k == Expr::FUno) {
+    if (allNaN)
+      return k == Expr::FUno;
+    if (!anyNaN)
+      return k == Expr::FOrd;
+    return -1;
+  }
+
+  bool unordered = isUnorderedFloatCompare(k);
+  if (allNaN)
+    return unordered;
+
+  bool must, may;
+  evalFloatRelation(getFloatRelation(k), left, right, must, may);
+  if (unordered) {
+    if (must)
+      return 1;
+    if (!may && !anyNaN)
+      return 0;
+  } else {
+    if (must && !anyNaN)
+      return 1;
+    if (!may)
+      return 0;
+  }
+  return -1;
+}
+
+/// evalFloatArith - Evaluate an arithmetic operation over ranges. Rounding
+/// is monotonic under a fixed rounding mode, so the bounds are the rounded
+/// results at the corners of the operand ranges.
+static FloatRange evalFloatArith(Expr::Kind k, const FloatRange &left,
+                                 const FloatRange &right,
+                                 llvm::APFloat::roundingMode rm,
+                                 unsigned width) {
+  if (!left.hasValue || !right.hasValue) {
+    FloatRange res = FloatRange::empty(width);
+    res.mayBeNaN = true;
+    return res;
+  }
+
+  // inf - inf and 0 * inf are NaN; rather than track exactly when these
+  // happen, allow NaN whenever an operand may be infinite.
+  bool mayBeNaN = left.mayBeNaN || right.mayBeNaN ||
+    left.mayBeInfinity() || right.mayBeInfinity();
+
+  llvm::APFloat lo = left.lo, hi = left.hi;
+  switch (k) {
+  case Expr::FAdd:
+    lo.add(right.lo, rm);
+    hi.add(right.hi, rm);
+    break;
+  case Expr::FSub:
+    lo.subtract(right.hi, rm);
+    hi.subtract(right.lo, rm);
+    break;
+  case Expr::FMul: {
+    llvm::APFloat c[4] = { left.lo, left.lo, left.hi, left.hi };
+    c[0].multiply(right.lo, rm);
+    c[1].multiply(right.hi, rm);
+    c[2].multiply(right.lo, rm);
+    c[3].multiply(right.hi, rm);
+    for (unsigned i = 0; i != 4; ++i)
+      if (c[i].isNaN())
+        return FloatRange::full(width);
+    lo = fpMin(fpMin(c[0], c[1]), fpMin(c[2], c[3]));
+    hi = fpMax(fpMax(c[0], c[1]), fpMax(c[2], c[3]));
+    break;
+  }
+  default:
+    return FloatRange::full(width);
+  }
+
+  if (lo.isNaN() || hi.isNaN())
+    return FloatRange::full(width);
+  return FloatRange(lo, hi, mayBeNaN);
+}
+
+/// fpBitsForRelation - Return a range of bit patterns of non-NaN values v
+/// for which "v r c" holds, or an empty range if there are none. The range
+/// must be contiguous, so it may cover only some of the values.
+static ValueRange fpBitsForRelation(FloatRelation r, llvm::APFloat c,
+                                    unsigned width) {
+  const llvm::fltSemantics &sem = *fpWidthToSemantics(width);
+  uint64_t signBit = UINT64_C(1) << (width - 1);
+  uint64_t posInf = fpToBits(llvm::APFloat::getInf(sem, false));
+  uint64_t negInf = signBit | posInf;
+
+  if (c.isZero())
+    c = llvm::APFloat::getZero(sem);
+  uint64_t b = fpToBits(c);
+  bool neg = c.isNegative();
+
+  switch (r) {
+  case FRelLt:
+    if (neg)
+      return b == negInf ? ValueRange() : ValueRange(b + 1, negInf);
+    return b == 0 ? ValueRange(signBit + 1, negInf) : ValueRange(0, b - 1);
+  case FRelLe:
+    return neg ? ValueRange(b, negInf) : ValueRange(0, b);
+  case FRelGt:
+    if (neg)
+      return ValueRange(0, posInf);
+    return b == posInf ? ValueRange() : ValueRange(b + 1, posInf);
+  case FRelGe:
+    return neg ? ValueRange(0, posInf) : ValueRange(b, posInf);
+  case FRelEq:
+    return ValueRange(b);
+  case FRelNe:
+    if (neg || b != posInf)
+      return fpBitsForRelation(FRelGt, c, width);
+    return ValueRange(0, b - 1);
+  }
+  return ValueRange();
+}
+
 class CexRangeEvaluator : public ExprRangeEvaluator<ValueRange> {
 public:
   std::map<const Array*, CexObjectData*> &objects;
@@ -357,6 +706,174 @@ public:
 
     return ValueRange(0, 255);
   }
+
+  /// evalFloatRange - Return the range of values of a single or double
+  /// precision expression.
+  FloatRange evalFloatRange(const ref<Expr> &e) {
+    unsigned width = e->getWidth();
+    assert(fpWidthToSemantics(width) && "unsupported floating-point width");
+
+    switch (e->getKind()) {
+    case Expr::FConstant:
+      return FloatRange(cast<FConstantExpr>(e)->getAPValue());
+
+    case Expr::ExplicitFloat:
+      return FloatRange::fromBits(width, evaluate(e->getKid(0)));
+
+    case Expr::FSelect: {
+      const FSelectExpr *se = cast<FSelectExpr>(e);
+      ValueRange cond = evaluate(se->cond);
+
+      if (cond.mustEqual(1)) {
+        return evalFloatRange(se->trueExpr);
+      } else if (cond.mustEqual(0)) {
+        return evalFloatRange(se->falseExpr);
+      } else {
+        return evalFloatRange(se->trueExpr).set_union(
+            evalFloatRange(se->falseExpr));
+      }
+    }
+
+      // Conversions are monotonic under a fixed rounding mode.
+
+    case Expr::FExt: {
+      const FExtExpr *fe = cast<FExtExpr>(e);
+      if (!fpWidthToSemantics(fe->src->getWidth()))
+        break;
+
+      FloatRange src = evalFloatRange(fe->src);
+      if (!src.hasValue)
+        return FloatRange::empty(width).set_union(src);
+
+      bool losesInfo;
+      llvm::APFloat lo = src.lo, hi = src.hi;
+      lo.convert(*fpWidthToSemantics(width), fe->getRoundingMode(), &losesInfo);
+      hi.convert(*fpWidthToSemantics(width), fe->getRoundingMode(), &losesInfo);
+      return FloatRange(lo, hi, src.mayBeNaN);
+    }
+
+    case Expr::UToF:
+    case Expr::SToF: {
+      const FCastRoundExpr *ce = cast<FCastRoundExpr>(e);
+      unsigned srcWidth = ce->src->getWidth();
+      if (srcWidth > 64)
+        break;
+
+      ValueRange src = evaluate(ce->src);
+      bool isSigned = e->getKind() == Expr::SToF;
+      uint64_t min = isSigned ? src.minSigned(srcWidth) : src.min();
+      uint64_t max = isSigned ? src.maxSigned(srcWidth) : src.max();
+
+      llvm::APFloat lo(*fpWidthToSemantics(width), 0);
+      llvm::APFloat hi(*fpWidthToSemantics(width), 0);
+      lo.convertFromAPInt(llvm::APInt(srcWidth, min), isSigned,
+                          ce->getRoundingMode());
+      hi.convertFromAPInt(llvm::APInt(srcWidth, max), isSigned,
+                          ce->getRoundingMode());
+      return FloatRange(lo, hi, false);
+    }
+
+    case Expr::FAbs: {
+      FloatRange src = evalFloatRange(e->getKid(0));
+      if (!src.hasValue)
+        return src;
+
+      llvm::APFloat lo = src.lo, hi = src.hi;
+      lo.clearSign();
+      hi.clearSign();
+      if (src.mayBeZero())
+        return FloatRange(llvm::APFloat::getZero(*fpWidthToSemantics(width)),
+                          fpMax(lo, hi), src.mayBeNaN);
+      return FloatRange(fpMin(lo, hi), fpMax(lo, hi), src.mayBeNaN);
+    }
+
+    case Expr::FAdd:
+    case Expr::FSub:
+    case Expr::FMul: {
+      const FBinaryRoundExpr *be = cast<FBinaryRoundExpr>(e);
+      return evalFloatArith(e->getKind(), evalFloatRange(be->left),
+                            evalFloatRange(be->right), be->getRoundingMode(),
+                            width);
+    }
+
+    default:
+      break;
+    }
+
+    return FloatRange::full(width);
+  }
+
+  ValueRange evalFloat(const ref<Expr> &e) {
+    switch (e->getKind()) {
+    case Expr::FOrd:
+    case Expr::FUno:
+    case Expr::FUeq:
+    case Expr::FOeq:
+    case Expr::FUgt:
+    case Expr::FOgt:
+    case Expr::FUge:
+    case Expr::FOge:
+    case Expr::FUlt:
+    case Expr::FOlt:
+    case Expr::FUle:
+    case Expr::FOle:
+    case Expr::FUne:
+    case Expr::FOne: {
+      const BinaryExpr *be = cast<BinaryExpr>(e);
+      if (!fpWidthToSemantics(be->left->getWidth()))
+        break;
+
+      int res = evalFloatCompare(e->getKind(), evalFloatRange(be->left),
+                                 evalFloatRange(be->right));
+      if (res >= 0)
+        return ValueRange(res);
+      break;
+    }
+
+    case Expr::FpClassify:
+    case Expr::FIsFinite:
+    case Expr::FIsNan:
+    case Expr::FIsInf: {
+      ref<Expr> src = e->getKid(0);
+      const llvm::fltSemantics *sem = fpWidthToSemantics(src->getWidth());
+      if (!sem)
+        break;
+
+      FloatRange fr = evalFloatRange(src);
+
+      // A single possible value (or only NaN) classifies like a constant.
+      if (fr.isFixed() || (!fr.hasValue && fr.mayBeNaN)) {
+        ref<Expr> kids[1] = {
+          FConstantExpr::alloc(fr.hasValue ? fr.lo
+                                           : llvm::APFloat::getNaN(*sem)) };
+        ref<Expr> value = e->rebuild(kids);
+        if (ConstantExpr *CE = dyn_cast<ConstantExpr>(value))
+          return ValueRange(CE->getZExtValue());
+        break;
+      }
+
+      if (fr.mayBeNaN)
+        break;
+      if (e->getKind() == Expr::FIsNan)
+        return ValueRange(0);
+      if (!fr.mayBeInfinity()) {
+        if (e->getKind() == Expr::FIsInf)
+          return ValueRange(0);
+        if (e->getKind() == Expr::FIsFinite)
+          return ValueRange(1);
+      }
+      break;
+    }
+
+    default:
+      // Floating-point values, as bit patterns.
+      if (isa<FExpr>(e) && fpWidthToSemantics(e->getWidth()))
+        return evalFloatRange(e).toBits(e->getWidth());
+      break;
+    }
+
+    return ExprRangeEvaluator<ValueRange>::evalFloat(e);
+  }
 };
 
 class CexPossibleEvaluator : public ExprEvaluator {
@@ -521,6 +1038,23 @@ public:
       break;
     }
 
+    case Expr::FSelect: {
+      FSelectExpr *se = cast<FSelectExpr>(e);
+      ValueRange cond = evalRangeForExpr(se->cond);
+      if (cond.isFixed()) {
+        if (cond.min()) {
+          propogatePossibleValues(se->trueExpr, range);
+        } else {
+          propogatePossibleValues(se->falseExpr, range);
+        }
+      } else {
+        // XXX imprecise, see Select above.
+        propogatePossibleValues(se->trueExpr, range);
+        propogatePossibleValues(se->falseExpr, range);
+      }
+      break;
+    }
+
       // XXX imprecise... the problem here is that extracting bits
       // loses information about what bits are connected across the
       // bytes. if a value can be 1 or 256 then either the top or
@@ -552,6 +1086,14 @@ public:
 
       // For ZExt this simplifies to just intersection with the possible input
       // range.
+    case Expr::ExplicitFloat:
+    case Expr::ExplicitInt: {
+      // Bitcasts keep the bit pattern, so the range carries over.
+      if (e->getWidth() <= 64)
+        propogatePossibleValues(e->getKid(0), range);
+      break;
+    }
+
     case Expr::ZExt: {
       CastExpr *ce = cast<CastExpr>(e);
       unsigned inBits = ce->src->getWidth();
@@ -768,6 +1310,37 @@ public:
       break;
     }
 
+      // Floating-point comparison
+
+    case Expr::FOrd:
+    case Expr::FUno:
+    case Expr::FUeq:
+    case Expr::FOeq:
+    case Expr::FUgt:
+    case Expr::FOgt:
+    case Expr::FUge:
+    case Expr::FOge:
+    case Expr::FUlt:
+    case Expr::FOlt:
+    case Expr::FUle:
+    case Expr::FOle:
+    case Expr::FUne:
+    case Expr::FOne: {
+      if (range.isFixed())
+        propogateFloatCompare(cast<BinaryExpr>(e), range.min());
+      break;
+    }
+
+      // Floating-point classification
+
+    case Expr::FpClassify:
+    case Expr::FIsFinite:
+    case Expr::FIsNan:
+    case Expr::FIsInf: {
+      propogateFloatClass(e, range);
+      break;
+    }
+
     case Expr::Ne:
     case Expr::Ugt:
     case Expr::Uge:
@@ -780,6 +1353,105 @@ public:
     }
   }
 
+  /// propogateFloatCompare - Propogate the known result of a comparison
+  /// against a floating-point constant into the other operand.
+  void propogateFloatCompare(BinaryExpr *be, bool result) {
+    ref<Expr> other = be->right;
+    FConstantExpr *CE = dyn_cast<FConstantExpr>(be->left);
+    bool constantIsLeft = CE != 0;
+    if (!CE) {
+      other = be->left;
+      CE = dyn_cast<FConstantExpr>(be->right);
+    }
+    if (!CE)
+      return;
+
+    unsigned width = CE->getWidth();
+    const llvm::fltSemantics *sem = fpWidthToSemantics(width);
+    if (!sem || CE->getAPValue().isNaN())
+      return;
+
+    ValueRange bits;
+    if (be->getKind() == Expr::FOrd || be->getKind() == Expr::FUno) {
+      // The other operand is NaN exactly when the comparison is unordered.
+      if (result == (be->getKind() == Expr::FOrd))
+        bits = ValueRange(0, fpToBits(llvm::APFloat::getInf(*sem, false)));
+      else
+        bits = ValueRange(fpToBits(llvm::APFloat::getNaN(*sem)));
+    } else {
+      // Whether the comparison is ordered or not, a non-NaN value satisfying
+      // the relation makes it true and one satisfying the negation makes it
+      // false.
+      FloatRelation r = getFloatRelation(be->getKind());
+      if (constantIsLeft)
+        r = swapFloatRelation(r);
+      if (!result)
+        r = negateFloatRelation(r);
+      bits = fpBitsForRelation(r, CE->getAPValue(), width);
+    }
+
+    if (!bits.isEmpty())
+      propogatePossibleValues(other, bits);
+  }
+
+  /// propogateFloatClass - Propogate the known range of a floating-point
+  /// classification into its operand.
+  void propogateFloatClass(ref<Expr> e, CexValueData range) {
+    ref<Expr> src = e->getKid(0);
+    unsigned width = src->getWidth();
+    const llvm::fltSemantics *sem = fpWidthToSemantics(width);
+    if (!sem || range.isEmpty())
+      return;
+
+    uint64_t posInf = fpToBits(llvm::APFloat::getInf(*sem, false));
+    uint64_t negInf = fpToBits(llvm::APFloat::getInf(*sem, true));
+    uint64_t nan = fpToBits(llvm::APFloat::getNaN(*sem));
+    uint64_t maxFinite = fpToBits(llvm::APFloat::getLargest(*sem, false));
+    uint64_t minNormal =
+      fpToBits(llvm::APFloat::getSmallestNormalized(*sem, false));
+    bool isZero = range.mustEqual(0), isNonZero = !range.contains(0);
+
+    ValueRange bits;
+    switch (e->getKind()) {
+    case Expr::FIsNan:
+      if (isNonZero)
+        bits = ValueRange(nan);
+      else if (isZero)
+        bits = ValueRange(0, posInf);
+      break;
+    case Expr::FIsFinite:
+      if (isNonZero)
+        bits = ValueRange(0, maxFinite);
+      else if (isZero)
+        bits = ValueRange(posInf);
+      break;
+    case Expr::FIsInf:
+      // FIsInf is 1 for +inf and -1 for -inf.
+      if (isZero)
+        bits = ValueRange(0, maxFinite);
+      else if (isNonZero)
+        bits = ValueRange(range.contains(1) ? posInf : negInf);
+      break;
+    case Expr::FpClassify:
+      if (!range.isFixed())
+        break;
+      switch (range.min()) {
+      case FP_NAN: bits = ValueRange(nan); break;
+      case FP_INFINITE: bits = ValueRange(posInf); break;
+      case FP_ZERO: bits = ValueRange(0); break;
+      case FP_SUBNORMAL: bits = ValueRange(1, minNormal - 1); break;
+      case FP_NORMAL: bits = ValueRange(minNormal, maxFinite); break;
+      default: break;
+      }
+      break;
+    default:
+      assert(0 && "invalid floating-point classification");
+    }
+
+    if (!bits.isEmpty())
+      propogatePossibleValues(src, bits);
+  }
+
   void propogateExactValues(ref<Expr> e, CexValueData range) {
     switch (e->getKind()) {
     case Expr::Constant: {
@@ -1049,6 +1721,11 @@ IncompleteSolver::PartialValidity
 FastCexSolver::computeTruth(const Query& query) {
   CexData cd;
 
+  // If the query expression is true over every value it can take then it is
+  // valid whatever the constraints.
+  if (cd.evalRangeForExpr(query.expr).mustEqual(1))
+    return IncompleteSolver::MustBeTrue;
+
   bool isValid;
   bool success = propogateValues(query, cd, true, isValid);
 
@@ -1132,6 +1809,10 @@ FastCexSolver::computeInitialValues(const Query& query,
 }
 
 
+IncompleteSolver *klee::createFastCexStage() {
+  return new FastCexSolver();
+}
+
 Solver *klee::createFastCexSolver(Solver *s) {
   return new Solver(new StagedSolverImpl(new FastCexSolver(), s));
 }
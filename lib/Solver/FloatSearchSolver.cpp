@@ -0,0 +1,569 @@
+//===-- FloatSearchSolver.cpp ---------------------------------------------===//
+//
+//                     The KLEE Symbolic Virtual Machine
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+//
+// An incomplete solver stage which looks for a model of a floating-point
+// query by local search, in the manner of XSat and goSAT: the constraints
+// become a distance which is zero exactly when they hold, and the float
+// inputs are moved around in ULP space to bring it down. The search only
+// ever finds satisfying assignments, so it answers the queries which are
+// satisfiable and leaves proofs of validity to the next solver.
+//
+// The inputs are the single and double precision values read whole from
+// symbolic arrays. Candidates are evaluated concretely, a batch of moves at
+// a time with the BatchEvaluator when the constraints compile and otherwise
+// one by one with the native float evaluator, and a candidate is only
+// reported after ExprEvaluator sees every constraint hold under it.
+//
+//===----------------------------------------------------------------------===//
+
+#include "klee/Solver.h"
+
+#include "klee/Constraints.h"
+#include "klee/Expr.h"
+#include "klee/IncompleteSolver.h"
+#include "klee/SolverStats.h"
+#include "klee/util/Assignment.h"
+#include "klee/util/BatchEvaluator.h"
+#include "klee/util/ExprHashMap.h"
+#include "klee/util/ExprUtil.h"
+
+#include "llvm/Support/CommandLine.h"
+
+#include <algorithm>
+#include <cmath>
+
+using namespace klee;
+using namespace llvm;
+
+namespace {
+
+cl::opt<unsigned>
+FloatSearchSteps("float-search-steps",
+                 cl::desc("Number of moves the float search solver makes "
+                          "looking for a model before giving up on a query "
+                          "(default=256)"),
+                 cl::init(256));
+
+cl::opt<bool>
+FloatSearchBatchEval("float-search-batch-eval",
+                     cl::desc("Have the float search solver try moves many "
+                              "at a time with a compiled evaluator "
+                              "(default=on)"),
+                     cl::init(true));
+
+/// The distance of a constraint with a NaN where it needs a number, or the
+/// other way around. It is further than any two numbers are apart.
+const double NaNDistance = 4e19;
+
+/// A float input of the query: \a width bits of \a array, the least
+/// significant byte at \a offset.
+struct FloatInput {
+  const Array *array;
+  unsigned offset;
+  Expr::Width width;
+};
+
+/// matchFloatInput - Match \a e, the source of an ExplicitFloat, against a
+/// little endian read of a whole single or double precision value from an
+/// array which was never written to.
+bool matchFloatInput(ref<Expr> e, Expr::Width width, FloatInput &input) {
+  if (width != Expr::Fl32 && width != Expr::Fl64)
+    return false;
+  unsigned bytes = width / 8;
+  // The reads are concatenated most significant byte first.
+  for (unsigned i = 0; i != bytes; ++i) {
+    ref<Expr> byte = e;
+    if (i + 1 != bytes) {
+      ConcatExpr *ce = dyn_cast<ConcatExpr>(e);
+      if (!ce)
+        return false;
+      byte = ce->getLeft();
+      e = ce->getRight();
+    }
+    ReadExpr *re = dyn_cast<ReadExpr>(byte);
+    if (!re || re->updates.head || re->getWidth() != Expr::Int8)
+      return false;
+    ConstantExpr *index = dyn_cast<ConstantExpr>(re->index);
+    if (!index)
+      return false;
+    uint64_t at = index->getZExtValue();
+    unsigned significance = bytes - 1 - i;
+    if (i == 0) {
+      if (at < significance)
+        return false;
+      input.array = re->updates.root;
+      input.offset = at - significance;
+    } else if (re->updates.root != input.array ||
+               at != input.offset + significance) {
+      return false;
+    }
+  }
+  input.width = width;
+  return true;
+}
+
+/// findFloatInputs - Add the float inputs read in \a e to \a inputs.
+void findFloatInputs(ref<Expr> e, ExprHashSet &visited,
+                     std::vector<FloatInput> &inputs) {
+  std::vector<ref<Expr> > stack(1, e);
+  while (!stack.empty()) {
+    e = stack.back();
+    stack.pop_back();
+    if (!visited.insert(e).second)
+      continue;
+
+    if (ExplicitFloatExpr *ef = dyn_cast<ExplicitFloatExpr>(e)) {
+      FloatInput input;
+      if (matchFloatInput(ef->src, ef->getWidth(), input)) {
+        bool known = false;
+        for (std::vector<FloatInput>::iterator it = inputs.begin(),
+               ie = inputs.end(); it != ie && !known; ++it)
+          known = it->array == input.array && it->offset == input.offset;
+        if (!known)
+          inputs.push_back(input);
+        continue;
+      }
+    }
+    for (unsigned i = 0; i != e->getNumKids(); ++i)
+      stack.push_back(e->getKid(i));
+  }
+}
+
+/// toKey - Map the bits of a float to an integer which orders the non-NaN
+/// values as they compare and counts the ULPs between them, +0 and -0 both
+/// being 0.
+int64_t toKey(uint64_t bits, Expr::Width width) {
+  uint64_t sign = 1ULL << (width - 1);
+  int64_t magnitude = bits & (sign - 1);
+  return (bits & sign) ? -magnitude : magnitude;
+}
+
+uint64_t fromKey(int64_t key, Expr::Width width) {
+  uint64_t sign = 1ULL << (width - 1);
+  if (key < 0)
+    return sign | ((uint64_t) -key & (sign - 1));
+  return (uint64_t) key & (sign - 1);
+}
+
+bool isNaNBits(uint64_t bits, Expr::Width width) {
+  uint64_t sign = 1ULL << (width - 1);
+  uint64_t infinity = width == Expr::Fl32 ? 0x7f800000ULL
+                                          : 0x7ff0000000000000ULL;
+  return (bits & (sign - 1)) > infinity;
+}
+
+/// The relation a comparison tests between its non-NaN operands.
+enum Relation { Lt, Le, Gt, Ge, Eq, Ne, Always, Never };
+
+Relation getRelation(Expr::Kind k) {
+  switch (k) {
+  case Expr::FOlt: case Expr::FUlt: return Lt;
+  case Expr::FOle: case Expr::FUle: return Le;
+  case Expr::FOgt: case Expr::FUgt: return Gt;
+  case Expr::FOge: case Expr::FUge: return Ge;
+  case Expr::FOeq: case Expr::FUeq: return Eq;
+  case Expr::FOne: case Expr::FUne: return Ne;
+  case Expr::FOrd: return Always;
+  default: return Never; // FUno
+  }
+}
+
+Relation negate(Relation r) {
+  switch (r) {
+  case Lt: return Ge;
+  case Le: return Gt;
+  case Gt: return Le;
+  case Ge: return Lt;
+  case Eq: return Ne;
+  case Ne: return Eq;
+  case Always: return Never;
+  default: return Always;
+  }
+}
+
+/// A point of the search: values for the arrays of the query.
+class Candidate {
+public:
+  const std::vector<const Array*> &objects;
+  std::vector< std::vector<unsigned char> > values;
+
+  explicit Candidate(const std::vector<const Array*> &_objects)
+    : objects(_objects) {
+    for (std::vector<const Array*>::const_iterator it = objects.begin(),
+           ie = objects.end(); it != ie; ++it)
+      values.push_back(std::vector<unsigned char>((*it)->size, 0));
+  }
+
+  std::vector<unsigned char> &getBytes(const Array *array) {
+    unsigned i = std::find(objects.begin(), objects.end(), array) -
+                 objects.begin();
+    assert(i != objects.size() && "float input of an unknown array");
+    return values[i];
+  }
+
+  uint64_t get(const FloatInput &input) {
+    std::vector<unsigned char> &bytes = getBytes(input.array);
+    uint64_t bits = 0;
+    for (unsigned i = input.width / 8; i != 0; --i)
+      bits = (bits << 8) | bytes[input.offset + i - 1];
+    return bits;
+  }
+
+  void set(const FloatInput &input, uint64_t bits) {
+    std::vector<unsigned char> &bytes = getBytes(input.array);
+    for (unsigned i = 0; i != input.width / 8; ++i, bits >>= 8)
+      bytes[input.offset + i] = bits & 0xFF;
+  }
+};
+
+/// The values of the conditions under one candidate, from ExprEvaluator.
+class ScalarValues {
+  AssignmentEvaluator ev;
+
+public:
+  explicit ScalarValues(const Assignment &a) : ev(a) {}
+
+  /// getBool - The value of \a e, a boolean, if it evaluates to a constant.
+  bool getBool(const ref<Expr> &e, bool &value) {
+    ConstantExpr *ce = dyn_cast<ConstantExpr>(ev.visit(e));
+    if (!ce)
+      return false;
+    value = ce->isTrue();
+    return true;
+  }
+
+  /// getFloat - The bits of \a e, a float, if it evaluates to a constant.
+  bool getFloat(const ref<Expr> &e, uint64_t &bits) {
+    FConstantExpr *fe = dyn_cast<FConstantExpr>(ev.visit(e));
+    if (!fe)
+      return false;
+    bits = fe->ExplicitInt(e->getWidth())->getZExtValue();
+    return true;
+  }
+};
+
+/// The values of the conditions under one lane of a batch.
+class BatchValues {
+  const BatchEvaluator &be;
+  unsigned lane;
+
+public:
+  BatchValues(const BatchEvaluator &_be, unsigned _lane)
+    : be(_be), lane(_lane) {}
+
+  bool getBool(const ref<Expr> &e, bool &value) {
+    value = be.isTrue(e, lane);
+    return true;
+  }
+
+  bool getFloat(const ref<Expr> &e, uint64_t &bits) {
+    bits = be.getValue(e, lane);
+    return true;
+  }
+};
+
+class FloatSearchSolver : public IncompleteSolver {
+  /// State of the xorshift generator behind the moves. It is never reseeded,
+  /// so that runs are reproducible.
+  uint64_t rngState;
+
+  uint64_t random() {
+    rngState ^= rngState << 13;
+    rngState ^= rngState >> 7;
+    rngState ^= rngState << 17;
+    return rngState;
+  }
+
+  /// distance - How far \a e is from evaluating to \a positive, given the
+  /// \a values of a candidate.
+  template<class Values>
+  double distance(const ref<Expr> &e, bool positive, Values &values);
+
+  /// comparisonDistance - distance() for a float comparison.
+  template<class Values>
+  double comparisonDistance(const ref<Expr> &e, bool positive,
+                            Values &values);
+
+  /// totalDistance - The sum of the distances of \a conditions from
+  /// holding, which is zero when they are all seen to hold.
+  template<class Values>
+  double totalDistance(const std::vector< ref<Expr> > &conditions,
+                       Values &values);
+
+  /// move - Change one of \a inputs in \a c.
+  void move(const std::vector<FloatInput> &inputs, Candidate &c);
+
+  /// search - Look for values of \a objects making the constraints of \a
+  /// query true and, if \a negateExpr, its expression false. Returns false
+  /// if the query has no float inputs or none were found in time.
+  bool search(const Query &query, bool negateExpr,
+              const std::vector<const Array*> &objects,
+              std::vector< std::vector<unsigned char> > &values);
+
+public:
+  FloatSearchSolver() : rngState(0x2545F4914F6CDD1DULL) {}
+
+  IncompleteSolver::PartialValidity computeTruth(const Query&);
+  bool computeValue(const Query&, ref<Expr> &result);
+  bool computeInitialValues(const Query&,
+                            const std::vector<const Array*> &objects,
+                            std::vector< std::vector<unsigned char> > &values,
+                            bool &hasSolution);
+};
+
+template<class Values>
+double FloatSearchSolver::comparisonDistance(const ref<Expr> &e,
+                                             bool positive,
+                                             Values &values) {
+  bool held;
+  if (values.getBool(e, held) && held == positive)
+    return 0;
+
+  Expr::Width width = e->getKid(0)->getWidth();
+  uint64_t a, b;
+  if ((width != Expr::Fl32 && width != Expr::Fl64) ||
+      !values.getFloat(e->getKid(0), a) || !values.getFloat(e->getKid(1), b))
+    return 1;
+  // The comparison fails on a NaN when it needs numbers, or the other way.
+  if (isNaNBits(a, width) || isNaNBits(b, width))
+    return NaNDistance;
+
+  Relation r = getRelation(e->getKind());
+  if (!positive)
+    r = negate(r);
+  double ulps = std::abs((double) toKey(a, width) - (double) toKey(b, width));
+  switch (r) {
+  case Lt: case Gt: return ulps + 1;
+  case Le: case Ge: case Eq: return ulps;
+  case Ne: return 1;
+  default: return NaNDistance; // Needs a NaN
+  }
+}
+
+template<class Values>
+double FloatSearchSolver::distance(const ref<Expr> &e, bool positive,
+                                   Values &values) {
+  switch (e->getKind()) {
+  case Expr::Eq: {
+    // Not(x) is Eq(false, x).
+    ConstantExpr *ce = dyn_cast<ConstantExpr>(e->getKid(0));
+    if (ce && ce->getWidth() == Expr::Bool && ce->isFalse())
+      return distance(e->getKid(1), !positive, values);
+    break;
+  }
+  case Expr::And:
+  case Expr::Or: {
+    if (e->getWidth() != Expr::Bool)
+      break;
+    double l = distance(e->getKid(0), positive, values);
+    double r = distance(e->getKid(1), positive, values);
+    // And needs both kids, Or either, and the other way when negated.
+    if ((e->getKind() == Expr::And) == positive)
+      return l + r;
+    return std::min(l, r);
+  }
+  default:
+    if (e->getKind() >= Expr::FOrd && e->getKind() <= Expr::FOne)
+      return comparisonDistance(e, positive, values);
+    break;
+  }
+
+  bool held;
+  return values.getBool(e, held) && held == positive ? 0 : 1;
+}
+
+template<class Values>
+double FloatSearchSolver::totalDistance(
+    const std::vector< ref<Expr> > &conditions, Values &values) {
+  double total = 0;
+  for (std::vector< ref<Expr> >::const_iterator it = conditions.begin(),
+         ie = conditions.end(); it != ie; ++it)
+    total += distance(*it, true, values);
+  return total;
+}
+
+void FloatSearchSolver::move(const std::vector<FloatInput> &inputs,
+                             Candidate &c) {
+  const FloatInput &input = inputs[random() % inputs.size()];
+  uint64_t choice = random();
+  uint64_t bits;
+  if (choice % 16 == 0) {
+    // Now and then jump somewhere else entirely, to leave a local minimum.
+    static const uint64_t singles[] = { 0, 0x3f800000, 0xbf800000 };
+    static const uint64_t doubles[] = { 0, 0x3ff0000000000000ULL,
+                                        0xbff0000000000000ULL };
+    unsigned which = (choice >> 4) % 4;
+    if (which == 3)
+      bits = random() >> (64 - input.width);
+    else
+      bits = input.width == Expr::Fl32 ? singles[which] : doubles[which];
+  } else {
+    // Otherwise step up or down by a power of two ULPs, small steps being
+    // as likely as large ones.
+    int64_t key = toKey(c.get(input), input.width);
+    int64_t step = 1LL << ((choice >> 5) % (input.width - 2));
+    bits = fromKey(choice & 16 ? key + step : key - step, input.width);
+  }
+  c.set(input, bits);
+}
+
+bool FloatSearchSolver::search(const Query &query, bool negateExpr,
+                               const std::vector<const Array*> &objects,
+                               std::vector< std::vector<unsigned char> >
+                                 &values) {
+  std::vector< ref<Expr> > conditions(query.constraints.begin(),
+                                      query.constraints.end());
+  if (negateExpr)
+    conditions.push_back(Expr::createIsZero(query.expr));
+
+  std::vector<FloatInput> inputs;
+  ExprHashSet visited;
+  for (std::vector< ref<Expr> >::iterator it = conditions.begin(),
+         ie = conditions.end(); it != ie; ++it)
+    findFloatInputs(*it, visited, inputs);
+  if (inputs.empty())
+    return false;
+  // The inputs must lie within the arrays being solved for.
+  for (std::vector<FloatInput>::iterator it = inputs.begin(),
+         ie = inputs.end(); it != ie; ++it)
+    if (std::find(objects.begin(), objects.end(), it->array) ==
+          objects.end() ||
+        it->offset + it->width / 8 > it->array->size)
+      return false;
+  ++stats::floatSearchQueries;
+
+  // With every condition compiled, moves are tried a batch at a time.
+  BatchEvaluator be;
+  bool batched = FloatSearchBatchEval;
+  for (std::vector< ref<Expr> >::iterator it = conditions.begin(),
+         ie = conditions.end(); it != ie && batched; ++it)
+    batched = be.add(*it);
+
+  // Hill climb from all zeros, keeping moves which do not make things worse.
+  Candidate current(objects);
+  double best;
+  {
+    Assignment a(current.objects, current.values);
+    ScalarValues v(a);
+    best = totalDistance(conditions, v);
+  }
+  for (unsigned step = 0; best != 0 && step < FloatSearchSteps;) {
+    if (batched) {
+      std::vector<Candidate> next(BatchEvaluator::BatchSize, current);
+      std::vector<Assignment*> assignments;
+      for (unsigned i = 0; i != next.size(); ++i) {
+        move(inputs, next[i]);
+        assignments.push_back(new Assignment(objects, next[i].values));
+      }
+      be.evaluate(&assignments[0], assignments.size());
+
+      unsigned bestLane = 0;
+      double bestInBatch = 0;
+      for (unsigned i = 0; i != next.size(); ++i) {
+        BatchValues v(be, i);
+        double d = totalDistance(conditions, v);
+        if (i == 0 || d < bestInBatch) {
+          bestLane = i;
+          bestInBatch = d;
+        }
+        delete assignments[i];
+      }
+      if (bestInBatch <= best) {
+        best = bestInBatch;
+        current.values.swap(next[bestLane].values);
+      }
+      step += next.size();
+    } else {
+      Candidate next(current);
+      move(inputs, next);
+      Assignment a(next.objects, next.values);
+      ScalarValues v(a);
+      double d = totalDistance(conditions, v);
+      if (d <= best) {
+        best = d;
+        current.values.swap(next.values);
+      }
+      ++step;
+    }
+  }
+  if (best != 0)
+    return false;
+
+  // A zero distance means every condition was seen to hold, but check it
+  // once more as the answer will be trusted.
+  Assignment a(current.objects, current.values);
+  if (!a.satisfies(conditions.begin(), conditions.end()))
+    return false;
+  ++stats::floatSearchSolved;
+  values.swap(current.values);
+  return true;
+}
+
+IncompleteSolver::PartialValidity
+FloatSearchSolver::computeTruth(const Query &query) {
+  std::vector<const Array*> objects;
+  findSymbolicObjects(query.constraints.begin(), query.constraints.end(),
+                      objects);
+  findSymbolicObjects(query.expr, objects);
+  std::vector< std::vector<unsigned char> > values;
+  if (search(query, true, objects, values))
+    return IncompleteSolver::MayBeFalse;
+  return IncompleteSolver::None;
+}
+
+bool FloatSearchSolver::computeValue(const Query &query, ref<Expr> &result) {
+  std::vector<const Array*> objects;
+  findSymbolicObjects(query.constraints.begin(), query.constraints.end(),
+                      objects);
+  findSymbolicObjects(query.expr, objects);
+  std::vector< std::vector<unsigned char> > values;
+  if (!search(query, false, objects, values))
+    return false;
+  Assignment a(objects, values);
+  result = a.evaluate(query.expr);
+  return isa<ConstantExpr>(result) || isa<FConstantExpr>(result);
+}
+
+bool
+FloatSearchSolver::computeInitialValues(const Query &query,
+                                        const std::vector<const Array*>
+                                          &objects,
+                                        std::vector< std::vector<unsigned char> >
+                                          &values,
+                                        bool &hasSolution) {
+  // The objects must cover whatever the query reads for the model to be
+  // checked.
+  std::vector<const Array*> read;
+  findSymbolicObjects(query.constraints.begin(), query.constraints.end(),
+                      read);
+  findSymbolicObjects(query.expr, read);
+  std::vector<const Array*> all(objects);
+  for (std::vector<const Array*>::iterator it = read.begin(),
+         ie = read.end(); it != ie; ++it)
+    if (std::find(all.begin(), all.end(), *it) == all.end())
+      all.push_back(*it);
+
+  std::vector< std::vector<unsigned char> > found;
+  if (!search(query, true, all, found))
+    return false;
+  found.resize(objects.size());
+  values.swap(found);
+  hasSolution = true;
+  return true;
+}
+
+}
+
+IncompleteSolver *klee::createFloatSearchStage() {
+  return new FloatSearchSolver();
+}
+
+Solver *klee::createFloatSearchSolver(Solver *s) {
+  return new Solver(new StagedSolverImpl(new FloatSearchSolver(), s));
+}
@@ -0,0 +1,697 @@
+//===-- FloatSimplifyingSolver.cpp ----------------------------------------===//
+//
+//                     The KLEE Symbolic Virtual Machine
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+//
+// A solver stage which rewrites floating-point subexpressions of a query using
+// identities that hold exactly under IEEE-754 semantics, before handing the
+// query on. The rewrites never change the value of an expression, except for
+// the payload of a NaN result, which the core solvers and FloatLowering do not
+// distinguish either.
+//
+//===----------------------------------------------------------------------===//
+
+#include "klee/Solver.h"
+
+#include "klee/Constraints.h"
+#include "klee/Expr.h"
+#include "klee/SolverImpl.h"
+#include "klee/SolverStats.h"
+#include "klee/util/ExprHashMap.h"
+
+#include "llvm/ADT/APFloat.h"
+
+#include <algorithm>
+#include <vector>
+
+using namespace klee;
+using namespace llvm;
+
+namespace {
+
+/// The number of rewritten expressions remembered between queries before the
+/// cache is flushed.
+const unsigned MaxCachedRewrites = 1 << 16;
+
+class FloatSimplifyingSolver : public SolverImpl {
+private:
+  Solver *solver;
+  ExprHashMap< ref<Expr> > rewritten;
+
+  ref<Expr> simplify(const ref<Expr> &e);
+  ref<Expr> simplifyNode(const ref<Expr> &e);
+  void simplifyQuery(const Query &query, std::vector< ref<Expr> > &constraints,
+                     ref<Expr> &expr);
+
+public:
+  FloatSimplifyingSolver(Solver *_solver) : solver(_solver) {}
+  ~FloatSimplifyingSolver() { delete solver; }
+
+  bool computeTruth(const Query&, bool &isValid);
+  bool computeTruthMany(const ConstraintManager &constraints,
+                        const std::vector< ref<Expr> > &exprs,
+                        std::vector<bool> &isValid);
+  bool computeValidity(const Query&, Solver::Validity &result);
+  bool computeValue(const Query&, ref<Expr> &result);
+  bool computeRange(const Query&, ref<Expr> &min, ref<Expr> &max);
+  bool computeUniqueValue(const Query&, ref<Expr> &result, bool &isUnique);
+  bool computeInitialValues(const Query& query,
+                            const std::vector<const Array*> &objects,
+                            std::vector< std::vector<unsigned char> > &values,
+                            bool &hasSolution);
+  SolverRunStatus getOperationStatusCode();
+  char *getConstraintLog(const Query&);
+  void setCoreSolverTimeout(double timeout);
+  size_t trimCaches(size_t bytes);
+  void releaseArrays(const std::vector<const Array *> &arrays);
+  void interrupt();
+};
+
+const fltSemantics *getSemantics(Expr::Width w) {
+  switch (w) {
+  case Expr::Fl32: return &APFloat::IEEEsingle;
+  case Expr::Fl64: return &APFloat::IEEEdouble;
+  case Expr::Fl80: return &APFloat::x87DoubleExtended;
+  default: return 0;
+  }
+}
+
+bool isConstantValue(const ref<Expr> &e, double d) {
+  const FConstantExpr *fe = dyn_cast<FConstantExpr>(e);
+  if (!fe)
+    return false;
+  const APFloat &v = fe->getAPValue();
+  if (v.isNaN())
+    return false;
+  bool losesInfo;
+  APFloat t(d);
+  t.convert(v.getSemantics(), APFloat::rmNearestTiesToEven, &losesInfo);
+  return v.bitwiseIsEqual(t);
+}
+
+bool isNegativeZero(const ref<Expr> &e) {
+  const FConstantExpr *fe = dyn_cast<FConstantExpr>(e);
+  return fe && fe->getAPValue().isZero() && fe->getAPValue().isNegative();
+}
+
+bool isPositiveZero(const ref<Expr> &e) {
+  const FConstantExpr *fe = dyn_cast<FConstantExpr>(e);
+  return fe && fe->getAPValue().isZero() && !fe->getAPValue().isNegative();
+}
+
+/// isFinite - Return true if \a e can be proven to never be infinite or
+/// NaN, looking only at its structure.
+bool isFinite(const ref<Expr> &e) {
+  switch (e->getKind()) {
+  case Expr::FConstant: {
+    const APFloat &v = cast<FConstantExpr>(e)->getAPValue();
+    return !v.isNaN() && !v.isInfinity();
+  }
+  case Expr::UToF:
+  case Expr::SToF: {
+    // Even the smallest supported format holds every 64 bit integer.
+    const FCastRoundExpr *ce = cast<FCastRoundExpr>(e);
+    return getSemantics(ce->width) && ce->src->getWidth() <= 64;
+  }
+  case Expr::FExt: {
+    const FExtExpr *ce = cast<FExtExpr>(e);
+    return ce->width >= ce->src->getWidth() && isFinite(ce->src);
+  }
+  case Expr::FAbs:
+    return isFinite(cast<FAbsExpr>(e)->expr);
+  case Expr::FSelect: {
+    const FSelectExpr *se = cast<FSelectExpr>(e);
+    return isFinite(se->trueExpr) && isFinite(se->falseExpr);
+  }
+  default:
+    return false;
+  }
+}
+
+/// isExactIntConversion - Return true if \a e converts an integer to a
+/// floating-point value without rounding, whatever the integer is.
+bool isExactIntConversion(const ref<Expr> &e) {
+  const FCastRoundExpr *ce = dyn_cast<FCastRoundExpr>(e);
+  if (!ce || ce->getKind() == Expr::FExt)
+    return false;
+  const fltSemantics *sem = getSemantics(ce->width);
+  if (!sem)
+    return false;
+  unsigned precision = APFloat::semanticsPrecision(*sem);
+  unsigned w = ce->src->getWidth();
+  // The magnitude of a signed value needs one bit less.
+  if (ce->getKind() == Expr::SToF)
+    return w <= precision + 1;
+  return w <= precision;
+}
+
+/// simplifyIntCompare - Compare the integers directly when both sides are
+/// exact conversions of the same kind and width. Neither side can be NaN, so
+/// ordered and unordered predicates agree.
+ref<Expr> simplifyIntCompare(const ref<Expr> &e) {
+  ref<Expr> l = e->getKid(0), r = e->getKid(1);
+  if (!isExactIntConversion(l) || !isExactIntConversion(r) ||
+      l->getKind() != r->getKind())
+    return 0;
+  ref<Expr> a = cast<FCastRoundExpr>(l)->src;
+  ref<Expr> b = cast<FCastRoundExpr>(r)->src;
+  if (a->getWidth() != b->getWidth())
+    return 0;
+
+  bool isSigned = l->getKind() == Expr::SToF;
+  switch (e->getKind()) {
+  case Expr::FOrd:
+    return ConstantExpr::alloc(1, Expr::Bool);
+  case Expr::FUno:
+    return ConstantExpr::alloc(0, Expr::Bool);
+  case Expr::FOeq:
+  case Expr::FUeq:
+    return EqExpr::create(a, b);
+  case Expr::FOne:
+  case Expr::FUne:
+    return NotExpr::create(EqExpr::create(a, b));
+  case Expr::FOlt:
+  case Expr::FUlt:
+    return isSigned ? SltExpr::create(a, b) : UltExpr::create(a, b);
+  case Expr::FOle:
+  case Expr::FUle:
+    return isSigned ? SleExpr::create(a, b) : UleExpr::create(a, b);
+  case Expr::FOgt:
+  case Expr::FUgt:
+    return isSigned ? SltExpr::create(b, a) : UltExpr::create(b, a);
+  case Expr::FOge:
+  case Expr::FUge:
+    return isSigned ? SleExpr::create(b, a) : UleExpr::create(b, a);
+  default:
+    return 0;
+  }
+}
+
+/// narrowValue - Return \a e as a value of the narrower float width \a w, if
+/// it is a value of that width or a narrower one widened, or a constant
+/// exactly representable in it; otherwise a null reference.
+ref<Expr> narrowValue(const ref<Expr> &e, Expr::Width w) {
+  if (e->getWidth() == w)
+    return e;
+  if (e->getWidth() < w)
+    return 0;
+
+  if (const FExtExpr *ce = dyn_cast<FExtExpr>(e)) {
+    Expr::Width srcW = ce->src->getWidth();
+    if (srcW > ce->width || !getSemantics(srcW))
+      return 0;
+    // Widening is exact, whatever the rounding mode.
+    if (srcW < w)
+      return FExtExpr::create(ce->src, w, APFloat::rmNearestTiesToEven);
+    return narrowValue(ce->src, w);
+  }
+
+  if (const FConstantExpr *fe = dyn_cast<FConstantExpr>(e)) {
+    APFloat v = fe->getAPValue();
+    if (v.isNaN())
+      return 0;
+    if (fe->getWidth() == Expr::Fl80) {
+      // Unnormal and pseudo-denormal values have no narrower equivalent.
+      const uint64_t *raw = v.bitcastToAPInt().getRawData();
+      if (((raw[1] & 0x7FFF) == 0) != ((raw[0] >> 63) == 0))
+        return 0;
+    }
+    bool losesInfo;
+    v.convert(*getSemantics(w), APFloat::rmNearestTiesToEven, &losesInfo);
+    if (losesInfo)
+      return 0;
+    return FConstantExpr::alloc(v);
+  }
+
+  return 0;
+}
+
+/// getNarrowWidth - The narrowest float width \a e can be given to
+/// narrowValue for, which is its own width if there is none narrower.
+Expr::Width getNarrowWidth(const ref<Expr> &e) {
+  static const Expr::Width widths[] = { Expr::Fl32, Expr::Fl64 };
+  for (unsigned i = 0; i != 2 && widths[i] < e->getWidth(); ++i)
+    if (!narrowValue(e, widths[i]).isNull())
+      return widths[i];
+  return e->getWidth();
+}
+
+/// narrowIntConversion - Convert an integer in the narrowest format which
+/// holds all its values, and widen the result.
+ref<Expr> narrowIntConversion(const ref<Expr> &e) {
+  static const Expr::Width widths[] = { Expr::Fl32, Expr::Fl64 };
+  const FCastRoundExpr *ce = cast<FCastRoundExpr>(e);
+  unsigned w = ce->src->getWidth();
+  for (unsigned i = 0; i != 2 && widths[i] < ce->width; ++i) {
+    unsigned precision = APFloat::semanticsPrecision(*getSemantics(widths[i]));
+    // The magnitude of a signed value needs one bit less.
+    if (w > (ce->getKind() == Expr::SToF ? precision + 1 : precision))
+      continue;
+    ref<Expr> narrow = ce->getKind() == Expr::SToF
+        ? SToFExpr::create(ce->src, widths[i], ce->getRoundingMode())
+        : UToFExpr::create(ce->src, widths[i], ce->getRoundingMode());
+    return FExtExpr::create(narrow, ce->width, APFloat::rmNearestTiesToEven);
+  }
+  return 0;
+}
+
+/// narrowRoundedOperation - Compute an operation rounded to a narrower
+/// format right after in that format, when its operands are values of it.
+/// Rounding to precision p a result correctly rounded to precision
+/// p' >= 2p + 2 gives the result correctly rounded to p, so float
+/// arithmetic done in double or long double can be done in float.
+ref<Expr> narrowRoundedOperation(const ref<Expr> &e) {
+  const FExtExpr *ce = cast<FExtExpr>(e);
+  const ref<Expr> &op = ce->src;
+  if (op->getWidth() <= ce->width ||
+      ce->getRoundingMode() != APFloat::rmNearestTiesToEven)
+    return 0;
+  const fltSemantics *narrow = getSemantics(ce->width);
+  const fltSemantics *wide = getSemantics(op->getWidth());
+  if (!narrow || !wide ||
+      APFloat::semanticsPrecision(*wide) <
+          2 * APFloat::semanticsPrecision(*narrow) + 2)
+    return 0;
+
+  APFloat::roundingMode rm;
+  switch (op->getKind()) {
+  case Expr::FAdd:
+  case Expr::FSub:
+  case Expr::FMul:
+  case Expr::FDiv:
+    rm = cast<FBinaryRoundExpr>(op)->getRoundingMode();
+    break;
+  case Expr::FSqrt:
+    rm = cast<FUnaryRoundExpr>(op)->getRoundingMode();
+    break;
+  default:
+    return 0;
+  }
+  if (rm != APFloat::rmNearestTiesToEven)
+    return 0;
+
+  ref<Expr> kids[2];
+  for (unsigned i = 0; i != op->getNumKids(); ++i) {
+    kids[i] = narrowValue(op->getKid(i), ce->width);
+    if (kids[i].isNull())
+      return 0;
+  }
+  return op->rebuild(kids);
+}
+
+/// simplifyNarrow - Do an operation on widened values in the narrower format
+/// when that gives exactly the same result, moving the widening to the
+/// result. Applied bottom-up, this lets whole computations on long doubles
+/// which only ever hold doubles be solved in double, and so on.
+ref<Expr> simplifyNarrow(const ref<Expr> &e) {
+  // The operands to narrow are the kids from the first one on.
+  unsigned first = 0;
+  // Whether the result is a value of the format of the operands.
+  bool widen = true;
+  switch (e->getKind()) {
+  case Expr::FSelect:
+    first = 1;
+    break;
+  // Rounding to an integer, the remainder, minimum and maximum are exact:
+  // their result is representable in the format of their operands.
+  case Expr::FAbs:
+  case Expr::FNearbyInt:
+  case Expr::FRem:
+  case Expr::FMin:
+  case Expr::FMax:
+    break;
+  // Conversions to integers, tests and comparisons give the same answer on
+  // the narrower values. FpClassify does not: a subnormal double is normal
+  // in long double.
+  case Expr::FToU:
+  case Expr::FToS:
+  case Expr::FIsNan:
+  case Expr::FIsInf:
+  case Expr::FIsFinite:
+  case Expr::FOrd:
+  case Expr::FUno:
+  case Expr::FUeq:
+  case Expr::FOeq:
+  case Expr::FUgt:
+  case Expr::FOgt:
+  case Expr::FUge:
+  case Expr::FOge:
+  case Expr::FUlt:
+  case Expr::FOlt:
+  case Expr::FUle:
+  case Expr::FOle:
+  case Expr::FUne:
+  case Expr::FOne:
+    widen = false;
+    break;
+  case Expr::UToF:
+  case Expr::SToF:
+    return narrowIntConversion(e);
+  case Expr::FExt:
+    return narrowRoundedOperation(e);
+  default:
+    return 0;
+  }
+
+  unsigned numKids = e->getNumKids();
+  Expr::Width width = e->getKid(first)->getWidth(), narrow = 0;
+  bool symbolic = false;
+  for (unsigned i = first; i != numKids; ++i) {
+    narrow = std::max(narrow, getNarrowWidth(e->getKid(i)));
+    symbolic |= !isa<FConstantExpr>(e->getKid(i));
+  }
+  // Operations on constants alone are folded anyway.
+  if (!symbolic || narrow >= width)
+    return 0;
+
+  ref<Expr> kids[3];
+  for (unsigned i = 0; i != numKids; ++i)
+    kids[i] = i < first ? e->getKid(i) : narrowValue(e->getKid(i), narrow);
+  ref<Expr> res = e->rebuild(kids);
+  if (!widen)
+    return res;
+  return FExtExpr::create(res, width, APFloat::rmNearestTiesToEven);
+}
+
+}
+
+/// simplifyNode - Apply the rewrite rules to the root of \a e, whose kids
+/// have already been simplified. Returns a null reference if no rule fires.
+ref<Expr> FloatSimplifyingSolver::simplifyNode(const ref<Expr> &e) {
+  switch (e->getKind()) {
+  case Expr::FAdd: {
+    // x + -0 == x, except that +0 + -0 is -0 when rounding downwards.
+    const FAddExpr *be = cast<FAddExpr>(e);
+    if (be->getRoundingMode() == APFloat::rmTowardNegative)
+      break;
+    if (isNegativeZero(be->right)) {
+      ++stats::floatSimplifyIdentity;
+      return be->left;
+    }
+    if (isNegativeZero(be->left)) {
+      ++stats::floatSimplifyIdentity;
+      return be->right;
+    }
+    break;
+  }
+
+  case Expr::FSub: {
+    const FSubExpr *be = cast<FSubExpr>(e);
+    bool downwards = be->getRoundingMode() == APFloat::rmTowardNegative;
+    if (!downwards && isPositiveZero(be->right)) {
+      ++stats::floatSimplifyIdentity;
+      return be->left;
+    }
+    // x - x is an exact zero for any finite x, and its sign only depends on
+    // the rounding mode.
+    const fltSemantics *sem = getSemantics(e->getWidth());
+    if (sem && be->left == be->right && isFinite(be->left)) {
+      ++stats::floatSimplifyCancel;
+      return FConstantExpr::alloc(APFloat::getZero(*sem, downwards));
+    }
+    break;
+  }
+
+  case Expr::FMul: {
+    const FMulExpr *be = cast<FMulExpr>(e);
+    if (isConstantValue(be->right, 1.0)) {
+      ++stats::floatSimplifyIdentity;
+      return be->left;
+    }
+    if (isConstantValue(be->left, 1.0)) {
+      ++stats::floatSimplifyIdentity;
+      return be->right;
+    }
+    break;
+  }
+
+  case Expr::FDiv: {
+    const FDivExpr *be = cast<FDivExpr>(e);
+    if (isConstantValue(be->right, 1.0)) {
+      ++stats::floatSimplifyIdentity;
+      return be->left;
+    }
+    break;
+  }
+
+  case Expr::FMin:
+  case Expr::FMax: {
+    const FBinaryExpr *be = cast<FBinaryExpr>(e);
+    if (be->left == be->right) {
+      ++stats::floatSimplifyIdentity;
+      return be->left;
+    }
+    break;
+  }
+
+  case Expr::FSelect: {
+    const FSelectExpr *se = cast<FSelectExpr>(e);
+    if (se->trueExpr == se->falseExpr) {
+      ++stats::floatSimplifyIdentity;
+      return se->trueExpr;
+    }
+    break;
+  }
+
+  case Expr::FAbs: {
+    const FAbsExpr *ue = cast<FAbsExpr>(e);
+    if (isa<FAbsExpr>(ue->expr)) {
+      ++stats::floatSimplifyIdentity;
+      return ue->expr;
+    }
+    break;
+  }
+
+  case Expr::FExt: {
+    const FExtExpr *ce = cast<FExtExpr>(e);
+    Expr::Width w = ce->src->getWidth();
+    if (ce->width == w) {
+      ++stats::floatSimplifyExtChain;
+      return ce->src;
+    }
+    const FExtExpr *inner = dyn_cast<FExtExpr>(ce->src);
+    if (!inner)
+      break;
+    Expr::Width origW = inner->src->getWidth();
+    // The inner extension is exact, so rounding back to the original format
+    // gives the original value, and extending further needs no rounding.
+    if (w > origW && ce->width == origW) {
+      ++stats::floatSimplifyExtChain;
+      return inner->src;
+    }
+    if (w > origW && ce->width > w) {
+      ++stats::floatSimplifyExtChain;
+      return FExtExpr::create(inner->src, ce->width, ce->getRoundingMode());
+    }
+    break;
+  }
+
+  case Expr::FIsNan:
+  case Expr::FIsInf:
+    if (isFinite(e->getKid(0))) {
+      ++stats::floatSimplifyClassify;
+      return ConstantExpr::alloc(0, Expr::Bool);
+    }
+    break;
+
+  case Expr::FIsFinite:
+    if (isFinite(e->getKid(0))) {
+      ++stats::floatSimplifyClassify;
+      return ConstantExpr::alloc(1, Expr::Bool);
+    }
+    break;
+
+  case Expr::FOrd:
+  case Expr::FUno:
+  case Expr::FUeq:
+  case Expr::FOeq:
+  case Expr::FUgt:
+  case Expr::FOgt:
+  case Expr::FUge:
+  case Expr::FOge:
+  case Expr::FUlt:
+  case Expr::FOlt:
+  case Expr::FUle:
+  case Expr::FOle:
+  case Expr::FUne:
+  case Expr::FOne: {
+    ref<Expr> res = simplifyIntCompare(e);
+    if (!res.isNull()) {
+      ++stats::floatSimplifyIntCompare;
+      return res;
+    }
+    break;
+  }
+
+  default:
+    break;
+  }
+
+  ref<Expr> res = simplifyNarrow(e);
+  if (!res.isNull())
+    ++stats::floatSimplifyNarrow;
+  return res;
+}
+
+ref<Expr> FloatSimplifyingSolver::simplify(const ref<Expr> &e) {
+  if (isa<ConstantExpr>(e) || isa<FConstantExpr>(e))
+    return e;
+
+  ExprHashMap< ref<Expr> >::iterator it = rewritten.find(e);
+  if (it != rewritten.end())
+    return it->second;
+
+  ref<Expr> res = e;
+  unsigned numKids = e->getNumKids();
+  if (numKids) {
+    std::vector< ref<Expr> > kids(numKids);
+    bool changed = false;
+    for (unsigned i = 0; i != numKids; ++i) {
+      kids[i] = simplify(e->getKid(i));
+      changed |= kids[i] != e->getKid(i);
+    }
+    if (changed)
+      res = e->rebuild(&kids[0]);
+  }
+
+  // A rewrite may expose further ones at the root, e.g. FAbs(FAbs(FAbs x)).
+  for (ref<Expr> next = simplifyNode(res); !next.isNull();
+       next = simplifyNode(res))
+    res = next;
+
+  rewritten.insert(std::make_pair(e, res));
+  return res;
+}
+
+void FloatSimplifyingSolver::simplifyQuery(const Query &query,
+                                           std::vector< ref<Expr> > &constraints,
+                                           ref<Expr> &expr) {
+  if (rewritten.size() > MaxCachedRewrites)
+    rewritten.clear();
+
+  for (ConstraintManager::const_iterator it = query.constraints.begin(),
+         ie = query.constraints.end(); it != ie; ++it) {
+    ref<Expr> c = simplify(*it);
+    if (ConstantExpr *ce = dyn_cast<ConstantExpr>(c))
+      if (ce->isTrue())
+        continue;
+    constraints.push_back(c);
+  }
+  expr = simplify(query.expr);
+}
+
+bool FloatSimplifyingSolver::computeTruth(const Query& query, bool &isValid) {
+  std::vector< ref<Expr> > constraints;
+  ref<Expr> expr;
+  simplifyQuery(query, constraints, expr);
+  ConstraintManager tmp(constraints);
+  // The rewrites may fold the expression to a constant, which the Solver
+  // interface answers itself.
+  return solver->mustBeTrue(Query(tmp, expr), isValid);
+}
+
+bool FloatSimplifyingSolver::computeTruthMany(const ConstraintManager &constraints,
+                                              const std::vector< ref<Expr> > &exprs,
+                                              std::vector<bool> &isValid) {
+  if (rewritten.size() > MaxCachedRewrites)
+    rewritten.clear();
+
+  std::vector< ref<Expr> > simplifiedConstraints;
+  for (ConstraintManager::const_iterator it = constraints.begin(),
+         ie = constraints.end(); it != ie; ++it) {
+    ref<Expr> c = simplify(*it);
+    if (ConstantExpr *ce = dyn_cast<ConstantExpr>(c))
+      if (ce->isTrue())
+        continue;
+    simplifiedConstraints.push_back(c);
+  }
+  std::vector< ref<Expr> > simplified;
+  simplified.reserve(exprs.size());
+  for (std::vector< ref<Expr> >::const_iterator it = exprs.begin(),
+         ie = exprs.end(); it != ie; ++it)
+    simplified.push_back(simplify(*it));
+
+  ConstraintManager tmp(simplifiedConstraints);
+  return solver->mustBeTrueMany(tmp, simplified, isValid);
+}
+
+bool FloatSimplifyingSolver::computeValidity(const Query& query,
+                                             Solver::Validity &result) {
+  std::vector< ref<Expr> > constraints;
+  ref<Expr> expr;
+  simplifyQuery(query, constraints, expr);
+  ConstraintManager tmp(constraints);
+  return solver->evaluate(Query(tmp, expr), result);
+}
+
+bool FloatSimplifyingSolver::computeValue(const Query& query,
+                                          ref<Expr> &result) {
+  std::vector< ref<Expr> > constraints;
+  ref<Expr> expr;
+  simplifyQuery(query, constraints, expr);
+  ConstraintManager tmp(constraints);
+  return solver->getValue(Query(tmp, expr), result);
+}
+
+bool FloatSimplifyingSolver::computeRange(const Query& query,
+                                          ref<Expr> &min, ref<Expr> &max) {
+  std::vector< ref<Expr> > constraints;
+  ref<Expr> expr;
+  simplifyQuery(query, constraints, expr);
+  ConstraintManager tmp(constraints);
+  return solver->computeRange(Query(tmp, expr), min, max);
+}
+
+bool FloatSimplifyingSolver::computeUniqueValue(const Query& query,
+                                                ref<Expr> &result,
+                                                bool &isUnique) {
+  std::vector< ref<Expr> > constraints;
+  ref<Expr> expr;
+  simplifyQuery(query, constraints, expr);
+  ConstraintManager tmp(constraints);
+  return solver->computeUniqueValue(Query(tmp, expr), result, isUnique);
+}
+
+bool FloatSimplifyingSolver::computeInitialValues(const Query& query,
+                                                  const std::vector<const Array*> &objects,
+                                                  std::vector< std::vector<unsigned char> > &values,
+                                                  bool &hasSolution) {
+  std::vector< ref<Expr> > constraints;
+  ref<Expr> expr;
+  simplifyQuery(query, constraints, expr);
+  ConstraintManager tmp(constraints);
+  return solver->impl->computeInitialValues(Query(tmp, expr), objects, values,
+                                            hasSolution);
+}
+
+SolverImpl::SolverRunStatus FloatSimplifyingSolver::getOperationStatusCode() {
+  return solver->impl->getOperationStatusCode();
+}
+
+char *FloatSimplifyingSolver::getConstraintLog(const Query& query) {
+  return solver->impl->getConstraintLog(query);
+}
+
+void FloatSimplifyingSolver::setCoreSolverTimeout(double timeout) {
+  solver->impl->setCoreSolverTimeout(timeout);
+}
+
+size_t FloatSimplifyingSolver::trimCaches(size_t bytes) {
+  return solver->impl->trimCaches(bytes);
+}
+
+void FloatSimplifyingSolver::releaseArrays(const std::vector<const Array *> &arrays) {
+  solver->impl->releaseArrays(arrays);
+}
+
+void FloatSimplifyingSolver::interrupt() {
+  solver->impl->interrupt();
+}
+
+Solver *klee::createFloatSimplifyingSolver(Solver *s) {
+  return new Solver(new FloatSimplifyingSolver(s));
+}
@@ -0,0 +1,863 @@
+//===-- FloatTriageSolver.cpp ---------------------------------------------===//
+//
+//                     The KLEE Symbolic Virtual Machine
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+//
+// An incomplete solver stage which answers the floating-point queries that
+// follow from what is known of NaN-ness and ranges alone, e.g. FOlt(x, x),
+// isnan(fabs(y)) under !isnan(y), or a comparison against a constant which
+// the constraints already decide.
+//
+// Every float subexpression is described by the interval of its non-NaN
+// values and whether it may be NaN. The constraints of the query narrow the
+// descriptions of the expressions they test, then the query expression is
+// evaluated over them. Whatever is not understood is assumed to take any
+// value, so that a decisive answer is always right.
+//
+//===----------------------------------------------------------------------===//
+
+#include "klee/Solver.h"
+
+#include "klee/Constraints.h"
+#include "klee/Expr.h"
+#include "klee/IncompleteSolver.h"
+#include "klee/SolverStats.h"
+#include "klee/util/ExprHashMap.h"
+
+#include "llvm/ADT/APFloat.h"
+
+using namespace klee;
+using namespace llvm;
+
+namespace {
+
+const fltSemantics *getSemantics(Expr::Width w) {
+  switch (w) {
+  case Expr::Fl32: return &APFloat::IEEEsingle;
+  case Expr::Fl64: return &APFloat::IEEEdouble;
+  case Expr::Fl80: return &APFloat::x87DoubleExtended;
+  default: return 0;
+  }
+}
+
+bool fpLess(const APFloat &a, const APFloat &b) {
+  return a.compare(b) == APFloat::cmpLessThan;
+}
+
+bool fpEqual(const APFloat &a, const APFloat &b) {
+  return a.compare(b) == APFloat::cmpEqual;
+}
+
+/// The relation a comparison tests between its non-NaN operands.
+enum Relation { Lt, Le, Gt, Ge, Eq, Ne, Always, Never };
+
+Relation getRelation(Expr::Kind k) {
+  switch (k) {
+  case Expr::FOlt: case Expr::FUlt: return Lt;
+  case Expr::FOle: case Expr::FUle: return Le;
+  case Expr::FOgt: case Expr::FUgt: return Gt;
+  case Expr::FOge: case Expr::FUge: return Ge;
+  case Expr::FOeq: case Expr::FUeq: return Eq;
+  case Expr::FOne: case Expr::FUne: return Ne;
+  case Expr::FOrd: return Always;
+  default: return Never; // FUno
+  }
+}
+
+/// isUnordered - Whether the comparison is true when an operand is NaN.
+bool isUnordered(Expr::Kind k) {
+  switch (k) {
+  case Expr::FUno: case Expr::FUeq: case Expr::FUgt: case Expr::FUge:
+  case Expr::FUlt: case Expr::FUle: case Expr::FUne:
+    return true;
+  default:
+    return false;
+  }
+}
+
+bool isFloatCompare(Expr::Kind k) {
+  return k >= Expr::FOrd && k <= Expr::FOne;
+}
+
+Relation negate(Relation r) {
+  switch (r) {
+  case Lt: return Ge;
+  case Le: return Gt;
+  case Gt: return Le;
+  case Ge: return Lt;
+  case Eq: return Ne;
+  case Ne: return Eq;
+  case Always: return Never;
+  default: return Always;
+  }
+}
+
+/// swap - Return r' such that "a r b" is "b r' a".
+Relation swap(Relation r) {
+  switch (r) {
+  case Lt: return Gt;
+  case Le: return Ge;
+  case Gt: return Lt;
+  case Ge: return Le;
+  default: return r;
+  }
+}
+
+/// holdsReflexively - Whether "x r x" holds for a non-NaN x.
+bool holdsReflexively(Relation r) {
+  return r == Le || r == Ge || r == Eq || r == Always;
+}
+
+/// FloatFacts - What is known of the values of a float expression: the
+/// interval of its non-NaN values, each end of which may be excluded, and
+/// whether it may be NaN. Signed zeros are not told apart, since they compare
+/// equal.
+struct FloatFacts {
+  APFloat lo, hi;
+  bool loOpen, hiOpen;
+  /// Whether a non-NaN value is possible; if not, the interval is
+  /// meaningless.
+  bool hasValue;
+  bool mayBeNaN;
+
+  /// Any value of the format.
+  explicit FloatFacts(const fltSemantics &sem)
+    : lo(APFloat::getInf(sem, true)), hi(APFloat::getInf(sem, false)),
+      loOpen(false), hiOpen(false), hasValue(true), mayBeNaN(true) {}
+
+  /// Only \a v.
+  explicit FloatFacts(const APFloat &v)
+    : lo(v), hi(v), loOpen(false), hiOpen(false), hasValue(!v.isNaN()),
+      mayBeNaN(v.isNaN()) {}
+
+  bool isEmpty() const { return !hasValue && !mayBeNaN; }
+
+  bool mayBeInfinity() const {
+    return hasValue && ((lo.isInfinity() && !loOpen) ||
+                        (hi.isInfinity() && !hiOpen));
+  }
+  bool mayBeFinite() const {
+    return hasValue && !(lo.isInfinity() && hi.isInfinity() &&
+                         lo.isNegative() == hi.isNegative());
+  }
+  bool mayBeZero() const {
+    if (!hasValue)
+      return false;
+    APFloat zero = APFloat::getZero(lo.getSemantics());
+    return (fpLess(lo, zero) || (fpEqual(lo, zero) && !loOpen)) &&
+           (fpLess(zero, hi) || (fpEqual(hi, zero) && !hiOpen));
+  }
+
+  void checkEmpty() {
+    if (hasValue && (fpLess(hi, lo) ||
+                     (fpEqual(lo, hi) && (loOpen || hiOpen))))
+      hasValue = false;
+  }
+
+  void raiseLo(const APFloat &v, bool open) {
+    if (fpLess(lo, v)) {
+      lo = v;
+      loOpen = open;
+    } else if (fpEqual(lo, v)) {
+      loOpen |= open;
+    }
+  }
+  void lowerHi(const APFloat &v, bool open) {
+    if (fpLess(v, hi)) {
+      hi = v;
+      hiOpen = open;
+    } else if (fpEqual(hi, v)) {
+      hiOpen |= open;
+    }
+  }
+
+  /// meet - Keep the non-NaN values x for which "x r c" holds.
+  void meet(Relation r, const APFloat &c) {
+    if (!hasValue || c.isNaN())
+      return;
+    switch (r) {
+    case Lt: lowerHi(c, true); break;
+    case Le: lowerHi(c, false); break;
+    case Gt: raiseLo(c, true); break;
+    case Ge: raiseLo(c, false); break;
+    case Eq: raiseLo(c, false); lowerHi(c, false); break;
+    case Ne:
+      if (fpEqual(lo, c))
+        loOpen = true;
+      if (fpEqual(hi, c))
+        hiOpen = true;
+      break;
+    case Always: break;
+    case Never: hasValue = false; break;
+    }
+    checkEmpty();
+  }
+
+  /// meetNaN - Keep the NaNs only, or the non-NaN values only.
+  void meetNaN(bool isNaN) {
+    if (isNaN)
+      hasValue = false;
+    else
+      mayBeNaN = false;
+  }
+
+  /// meetFinite - Drop the infinities.
+  void meetFinite() {
+    if (!hasValue)
+      return;
+    if (lo.isInfinity() && lo.isNegative())
+      loOpen = true;
+    if (hi.isInfinity() && !hi.isNegative())
+      hiOpen = true;
+    checkEmpty();
+  }
+
+  void meet(const FloatFacts &b) {
+    mayBeNaN &= b.mayBeNaN;
+    if (!b.hasValue)
+      hasValue = false;
+    if (!hasValue)
+      return;
+    raiseLo(b.lo, b.loOpen);
+    lowerHi(b.hi, b.hiOpen);
+    checkEmpty();
+  }
+
+  void join(const FloatFacts &b) {
+    mayBeNaN |= b.mayBeNaN;
+    if (!b.hasValue)
+      return;
+    if (!hasValue) {
+      lo = b.lo;
+      hi = b.hi;
+      loOpen = b.loOpen;
+      hiOpen = b.hiOpen;
+      hasValue = true;
+      return;
+    }
+    if (fpLess(b.lo, lo) || (fpEqual(b.lo, lo) && !b.loOpen)) {
+      lo = b.lo;
+      loOpen = b.loOpen;
+    }
+    if (fpLess(hi, b.hi) || (fpEqual(b.hi, hi) && !b.hiOpen)) {
+      hi = b.hi;
+      hiOpen = b.hiOpen;
+    }
+  }
+
+  /// Keep the NaN-ness, and let the non-NaN values be anything.
+  void forgetRange() {
+    const fltSemantics &sem = lo.getSemantics();
+    lo = APFloat::getInf(sem, true);
+    hi = APFloat::getInf(sem, false);
+    loOpen = hiOpen = false;
+  }
+};
+
+/// Truth - Whether a boolean expression may be true, and may be false.
+struct Truth {
+  bool mayBeTrue, mayBeFalse;
+
+  Truth(bool t, bool f) : mayBeTrue(t), mayBeFalse(f) {}
+  static Truth unknown() { return Truth(true, true); }
+  Truth operator!() const { return Truth(mayBeFalse, mayBeTrue); }
+};
+
+/// FloatTriage - The facts of the float expressions of one query.
+class FloatTriage {
+  ExprHashMap<FloatFacts> assumed;
+  ExprHashMap<FloatFacts> evaluated;
+  /// Whether the constraints were found to contradict each other.
+  bool contradiction;
+
+  FloatFacts &getAssumed(const ref<Expr> &e);
+  void assumeCompare(const ref<Expr> &e, bool holds);
+  void assumeClass(const ref<Expr> &test, bool holds, int64_t sign);
+  Truth evalCompare(const ref<Expr> &e);
+  Truth evalClass(const ref<Expr> &test, int64_t value);
+  FloatFacts evalStructure(const ref<Expr> &e);
+  FloatFacts evalArith(Expr::Kind k, const FloatFacts &a,
+                       const FloatFacts &b);
+
+public:
+  FloatTriage() : contradiction(false) {}
+
+  /// assume - Narrow the facts down knowing that \a e is \a holds.
+  void assume(const ref<Expr> &e, bool holds);
+  bool isContradictory() const { return contradiction; }
+
+  FloatFacts evalFloat(const ref<Expr> &e);
+  Truth evalBool(const ref<Expr> &e);
+};
+
+/// isClassTest - Whether \a e is an FIsNan, FIsInf or FIsFinite test, which
+/// give an int rather than a Bool: 0 or 1, and -1 for a negative infinity.
+bool isClassTest(const ref<Expr> &e) {
+  Expr::Kind k = e->getKind();
+  return (k == Expr::FIsNan || k == Expr::FIsInf || k == Expr::FIsFinite) &&
+         getSemantics(e->getKid(0)->getWidth()) != 0;
+}
+
+/// hasFloatTest - Whether the boolean structure of \a e leads to a test of a
+/// float value, the only thing the triage knows anything about.
+bool hasFloatTest(const ref<Expr> &e) {
+  Expr::Kind k = e->getKind();
+  if (isFloatCompare(k))
+    return getSemantics(e->getKid(0)->getWidth()) != 0;
+  if (e->getWidth() != Expr::Bool)
+    return false;
+  switch (k) {
+  case Expr::Not:
+    return hasFloatTest(e->getKid(0));
+  case Expr::Eq:
+    return isa<ConstantExpr>(e->getKid(0)) &&
+           (hasFloatTest(e->getKid(1)) || isClassTest(e->getKid(1)));
+  case Expr::And:
+  case Expr::Or:
+    return hasFloatTest(e->getKid(0)) || hasFloatTest(e->getKid(1));
+  default:
+    return false;
+  }
+}
+
+bool isSupportedConstant(const FConstantExpr *ce) {
+  if (ce->getWidth() != Expr::Fl80)
+    return getSemantics(ce->getWidth()) != 0;
+  // Unnormal and pseudo-denormal x87 values behave as NaNs in operations;
+  // leave them alone.
+  const uint64_t *raw = ce->getAPValue().bitcastToAPInt().getRawData();
+  return ((raw[1] & 0x7FFF) == 0) == ((raw[0] >> 63) == 0);
+}
+
+FloatFacts &FloatTriage::getAssumed(const ref<Expr> &e) {
+  ExprHashMap<FloatFacts>::iterator it = assumed.find(e);
+  if (it == assumed.end())
+    it = assumed.insert(std::make_pair(
+        e, FloatFacts(*getSemantics(e->getWidth())))).first;
+  return it->second;
+}
+
+void FloatTriage::assume(const ref<Expr> &e, bool holds) {
+  Expr::Kind k = e->getKind();
+  if (isFloatCompare(k)) {
+    assumeCompare(e, holds);
+    return;
+  }
+
+  switch (k) {
+  case Expr::Constant:
+    if (cast<ConstantExpr>(e)->isTrue() != holds)
+      contradiction = true;
+    return;
+  case Expr::Not:
+    assume(e->getKid(0), !holds);
+    return;
+  case Expr::Eq: {
+    const ConstantExpr *ce = dyn_cast<ConstantExpr>(e->getKid(0));
+    if (!ce)
+      return;
+    const ref<Expr> &test = e->getKid(1);
+    if (ce->getWidth() == Expr::Bool) {
+      assume(test, ce->isTrue() == holds);
+    } else if (isClassTest(test)) {
+      int64_t value = ce->getAPValue().getSExtValue();
+      if (holds)
+        assumeClass(test, value != 0, value);
+      else if (value == 0)
+        assumeClass(test, true, 0);
+      else if (value == 1 && test->getKind() != Expr::FIsInf)
+        assumeClass(test, false, 0);
+    }
+    return;
+  }
+  case Expr::And:
+  case Expr::Or:
+    if (e->getWidth() == Expr::Bool && holds == (k == Expr::And)) {
+      assume(e->getKid(0), holds);
+      assume(e->getKid(1), holds);
+    }
+    return;
+  default:
+    return;
+  }
+}
+
+/// assumeClass - Narrow the facts down knowing whether \a test holds, and
+/// for an infinity, the sign it has if \a sign is 1 or -1.
+void FloatTriage::assumeClass(const ref<Expr> &test, bool holds,
+                              int64_t sign) {
+  Expr::Kind k = test->getKind();
+  const ref<Expr> &x = test->getKid(0);
+  if (isa<FConstantExpr>(x))
+    return;
+  FloatFacts &facts = getAssumed(x);
+  if (k == Expr::FIsNan) {
+    facts.meetNaN(holds);
+  } else if ((k == Expr::FIsFinite) == holds) {
+    // The values which are not NaN are finite.
+    if (holds)
+      facts.meetNaN(false);
+    facts.meetFinite();
+  } else if (holds) {
+    facts.meetNaN(false);
+    if (k == Expr::FIsInf && (sign == 1 || sign == -1))
+      facts.meet(Eq, APFloat::getInf(facts.lo.getSemantics(), sign < 0));
+  }
+  if (facts.isEmpty())
+    contradiction = true;
+}
+
+void FloatTriage::assumeCompare(const ref<Expr> &e, bool holds) {
+  ref<Expr> a = e->getKid(0), b = e->getKid(1);
+  if (!getSemantics(a->getWidth()))
+    return;
+  Expr::Kind k = e->getKind();
+  // The relation the non-NaN values satisfy, and whether NaN is excluded.
+  Relation r = holds ? getRelation(k) : negate(getRelation(k));
+  bool notNaN = holds != isUnordered(k);
+
+  const FConstantExpr *ca = dyn_cast<FConstantExpr>(a);
+  const FConstantExpr *cb = dyn_cast<FConstantExpr>(b);
+  if ((ca && !isSupportedConstant(ca)) || (cb && !isSupportedConstant(cb)))
+    return;
+
+  if (a == b) {
+    FloatFacts &facts = getAssumed(a);
+    if (notNaN)
+      facts.meetNaN(false);
+    if (!holdsReflexively(r))
+      facts.meetNaN(true);
+    if (facts.isEmpty())
+      contradiction = true;
+    return;
+  }
+
+  if (!ca) {
+    FloatFacts &facts = getAssumed(a);
+    if (notNaN)
+      facts.meetNaN(false);
+    if (cb)
+      facts.meet(r, cb->getAPValue());
+    if (facts.isEmpty())
+      contradiction = true;
+  }
+  if (!cb) {
+    FloatFacts &facts = getAssumed(b);
+    if (notNaN)
+      facts.meetNaN(false);
+    if (ca)
+      facts.meet(swap(r), ca->getAPValue());
+    if (facts.isEmpty())
+      contradiction = true;
+  }
+}
+
+FloatFacts FloatTriage::evalFloat(const ref<Expr> &e) {
+  ExprHashMap<FloatFacts>::iterator it = evaluated.find(e);
+  if (it != evaluated.end())
+    return it->second;
+
+  FloatFacts res = evalStructure(e);
+  ExprHashMap<FloatFacts>::iterator ait = assumed.find(e);
+  if (ait != assumed.end())
+    res.meet(ait->second);
+  evaluated.insert(std::make_pair(e, res));
+  return res;
+}
+
+FloatFacts FloatTriage::evalArith(Expr::Kind k, const FloatFacts &a,
+                                  const FloatFacts &b) {
+  FloatFacts res(a.lo.getSemantics());
+  res.mayBeNaN = a.mayBeNaN || b.mayBeNaN;
+  switch (k) {
+  case Expr::FAdd:
+  case Expr::FSub:
+    res.mayBeNaN |= a.mayBeInfinity() && b.mayBeInfinity();
+    break;
+  case Expr::FMul:
+    res.mayBeNaN |= (a.mayBeZero() && b.mayBeInfinity()) ||
+                    (a.mayBeInfinity() && b.mayBeZero());
+    break;
+  case Expr::FDiv:
+    res.mayBeNaN |= (a.mayBeZero() && b.mayBeZero()) ||
+                    (a.mayBeInfinity() && b.mayBeInfinity());
+    break;
+  default:
+    break;
+  }
+  if (!a.hasValue || !b.hasValue) {
+    // Only NaNs come out of a NaN operand.
+    res.hasValue = false;
+    return res;
+  }
+  if (a.mayBeInfinity() || b.mayBeInfinity() ||
+      (k == Expr::FDiv && b.mayBeZero()))
+    return res;
+
+  // Round the corners outwards, which covers every rounding mode.
+  const APFloat corners[4][2] = {
+    { a.lo, b.lo }, { a.lo, b.hi }, { a.hi, b.lo }, { a.hi, b.hi }
+  };
+  for (unsigned i = 0; i != 4; ++i) {
+    if (k == Expr::FAdd || k == Expr::FSub) {
+      // Addition is monotonic: the lower end comes from the lower ends.
+      if (i != 0 && i != 3)
+        continue;
+    }
+    APFloat down = corners[i][0], up = corners[i][0];
+    const APFloat &y = k == Expr::FSub ? corners[3 - i][1] : corners[i][1];
+    switch (k) {
+    case Expr::FAdd:
+      down.add(y, APFloat::rmTowardNegative);
+      up.add(y, APFloat::rmTowardPositive);
+      break;
+    case Expr::FSub:
+      down.subtract(y, APFloat::rmTowardNegative);
+      up.subtract(y, APFloat::rmTowardPositive);
+      break;
+    case Expr::FMul:
+      down.multiply(y, APFloat::rmTowardNegative);
+      up.multiply(y, APFloat::rmTowardPositive);
+      break;
+    default:
+      down.divide(y, APFloat::rmTowardNegative);
+      up.divide(y, APFloat::rmTowardPositive);
+      break;
+    }
+    if (i == 0 || fpLess(down, res.lo))
+      res.lo = down;
+    if (i == 0 || fpLess(res.hi, up))
+      res.hi = up;
+  }
+  return res;
+}
+
+FloatFacts FloatTriage::evalStructure(const ref<Expr> &e) {
+  const fltSemantics &sem = *getSemantics(e->getWidth());
+  FloatFacts res(sem);
+
+  switch (e->getKind()) {
+  case Expr::FConstant: {
+    const FConstantExpr *ce = cast<FConstantExpr>(e);
+    if (isSupportedConstant(ce))
+      return FloatFacts(ce->getAPValue());
+    return res;
+  }
+
+  case Expr::FSelect: {
+    const FSelectExpr *se = cast<FSelectExpr>(e);
+    Truth cond = evalBool(se->cond);
+    if (!cond.mayBeFalse)
+      return evalFloat(se->trueExpr);
+    if (!cond.mayBeTrue)
+      return evalFloat(se->falseExpr);
+    res = evalFloat(se->trueExpr);
+    res.join(evalFloat(se->falseExpr));
+    return res;
+  }
+
+  case Expr::FExt: {
+    const FExtExpr *ce = cast<FExtExpr>(e);
+    if (!getSemantics(ce->src->getWidth()))
+      return res;
+    FloatFacts src = evalFloat(ce->src);
+    res.mayBeNaN = src.mayBeNaN;
+    res.hasValue = src.hasValue;
+    if (!src.hasValue)
+      return res;
+    // Round the ends outwards; they stay excluded only if exact.
+    bool losesInfo;
+    res.lo = src.lo;
+    res.lo.convert(sem, APFloat::rmTowardNegative, &losesInfo);
+    res.loOpen = src.loOpen && !losesInfo;
+    res.hi = src.hi;
+    res.hi.convert(sem, APFloat::rmTowardPositive, &losesInfo);
+    res.hiOpen = src.hiOpen && !losesInfo;
+    return res;
+  }
+
+  case Expr::UToF:
+    res.mayBeNaN = false;
+    res.lo = APFloat::getZero(sem);
+    return res;
+
+  case Expr::SToF:
+    res.mayBeNaN = false;
+    return res;
+
+  case Expr::FAbs: {
+    FloatFacts x = evalFloat(e->getKid(0));
+    res.mayBeNaN = x.mayBeNaN;
+    res.hasValue = x.hasValue;
+    if (!x.hasValue)
+      return res;
+    APFloat zero = APFloat::getZero(sem);
+    APFloat negLo = x.lo, negHi = x.hi;
+    negLo.changeSign();
+    negHi.changeSign();
+    if (!fpLess(x.lo, zero)) {
+      res.lo = x.lo; res.loOpen = x.loOpen;
+      res.hi = x.hi; res.hiOpen = x.hiOpen;
+    } else if (!fpLess(zero, x.hi)) {
+      res.lo = negHi; res.loOpen = x.hiOpen;
+      res.hi = negLo; res.hiOpen = x.loOpen;
+    } else {
+      res.lo = zero;
+      if (fpLess(negLo, x.hi)) {
+        res.hi = x.hi; res.hiOpen = x.hiOpen;
+      } else {
+        res.hi = negLo; res.hiOpen = x.loOpen;
+      }
+    }
+    return res;
+  }
+
+  case Expr::FSqrt: {
+    FloatFacts x = evalFloat(e->getKid(0));
+    APFloat zero = APFloat::getZero(sem);
+    res.mayBeNaN = x.mayBeNaN || (x.hasValue && fpLess(x.lo, zero));
+    res.hasValue = x.hasValue && !fpLess(x.hi, zero);
+    res.lo = zero;
+    return res;
+  }
+
+  case Expr::FNearbyInt: {
+    FloatFacts x = evalFloat(e->getKid(0));
+    res.mayBeNaN = x.mayBeNaN;
+    res.hasValue = x.hasValue;
+    if (!x.hasValue)
+      return res;
+    res.lo = x.lo;
+    res.lo.roundToIntegral(APFloat::rmTowardNegative);
+    res.hi = x.hi;
+    res.hi.roundToIntegral(APFloat::rmTowardPositive);
+    return res;
+  }
+
+  case Expr::FAdd:
+  case Expr::FSub:
+  case Expr::FMul:
+  case Expr::FDiv:
+    return evalArith(e->getKind(), evalFloat(e->getKid(0)),
+                     evalFloat(e->getKid(1)));
+
+  case Expr::FFma:
+    // The product and the sum, each rounded outwards, enclose the exact
+    // result and so the fused one.
+    return evalArith(Expr::FAdd,
+                     evalArith(Expr::FMul, evalFloat(e->getKid(0)),
+                               evalFloat(e->getKid(1))),
+                     evalFloat(e->getKid(2)));
+
+  case Expr::FRem: {
+    FloatFacts a = evalFloat(e->getKid(0)), b = evalFloat(e->getKid(1));
+    res.mayBeNaN = a.mayBeNaN || b.mayBeNaN || a.mayBeInfinity() ||
+                   b.mayBeZero();
+    res.hasValue = a.hasValue && b.hasValue;
+    return res;
+  }
+
+  case Expr::FMin:
+  case Expr::FMax: {
+    // A NaN operand gives the other one.
+    FloatFacts a = evalFloat(e->getKid(0)), b = evalFloat(e->getKid(1));
+    if (!a.hasValue)
+      return b;
+    if (!b.hasValue)
+      return a;
+    if (a.mayBeNaN || b.mayBeNaN) {
+      res = a;
+      res.join(b);
+      res.mayBeNaN = a.mayBeNaN && b.mayBeNaN;
+      return res;
+    }
+    bool isMin = e->getKind() == Expr::FMin;
+    res.mayBeNaN = false;
+    res.lo = isMin == fpLess(a.lo, b.lo) ? a.lo : b.lo;
+    res.hi = isMin == fpLess(a.hi, b.hi) ? a.hi : b.hi;
+    return res;
+  }
+
+  default:
+    return res;
+  }
+}
+
+Truth FloatTriage::evalCompare(const ref<Expr> &e) {
+  ref<Expr> left = e->getKid(0), right = e->getKid(1);
+  if (!getSemantics(left->getWidth()))
+    return Truth::unknown();
+  Expr::Kind k = e->getKind();
+  Relation r = getRelation(k);
+  bool nanResult = isUnordered(k);
+
+  FloatFacts a = evalFloat(left);
+  bool mayBeNaN = a.mayBeNaN, hasValues = a.hasValue;
+  // Whether the relation must, and may, hold between non-NaN operands.
+  bool must, may;
+  if (left == right) {
+    must = may = holdsReflexively(r);
+  } else {
+    FloatFacts b = evalFloat(right);
+    mayBeNaN |= b.mayBeNaN;
+    hasValues &= b.hasValue;
+
+    bool lt = fpLess(a.hi, b.lo) ||
+              (fpEqual(a.hi, b.lo) && (a.hiOpen || b.loOpen));
+    bool gt = fpLess(b.hi, a.lo) ||
+              (fpEqual(b.hi, a.lo) && (b.hiOpen || a.loOpen));
+    bool le = !fpLess(b.lo, a.hi);
+    bool ge = !fpLess(a.lo, b.hi);
+    bool eq = le && ge;
+    switch (r) {
+    case Lt: must = lt; may = !ge; break;
+    case Le: must = le; may = !gt; break;
+    case Gt: must = gt; may = !le; break;
+    case Ge: must = ge; may = !lt; break;
+    case Eq: must = eq; may = !lt && !gt; break;
+    case Ne: must = lt || gt; may = !eq; break;
+    case Always: must = may = true; break;
+    default: must = may = false; break;
+    }
+  }
+
+  return Truth((mayBeNaN && nanResult) || (hasValues && may),
+               (mayBeNaN && !nanResult) || (hasValues && !must));
+}
+
+Truth FloatTriage::evalBool(const ref<Expr> &e) {
+  Expr::Kind k = e->getKind();
+  if (isFloatCompare(k))
+    return evalCompare(e);
+
+  switch (k) {
+  case Expr::Constant: {
+    bool value = cast<ConstantExpr>(e)->isTrue();
+    return Truth(value, !value);
+  }
+  case Expr::Not:
+    return !evalBool(e->getKid(0));
+  case Expr::Eq: {
+    const ConstantExpr *ce = dyn_cast<ConstantExpr>(e->getKid(0));
+    if (!ce)
+      return Truth::unknown();
+    const ref<Expr> &test = e->getKid(1);
+    if (ce->getWidth() == Expr::Bool)
+      return ce->isTrue() ? evalBool(test) : !evalBool(test);
+    if (isClassTest(test))
+      return evalClass(test, ce->getAPValue().getSExtValue());
+    return Truth::unknown();
+  }
+  case Expr::And:
+  case Expr::Or: {
+    if (e->getWidth() != Expr::Bool)
+      return Truth::unknown();
+    Truth a = evalBool(e->getKid(0)), b = evalBool(e->getKid(1));
+    if (k == Expr::And)
+      return Truth(a.mayBeTrue && b.mayBeTrue, a.mayBeFalse || b.mayBeFalse);
+    return Truth(a.mayBeTrue || b.mayBeTrue, a.mayBeFalse && b.mayBeFalse);
+  }
+  default:
+    return Truth::unknown();
+  }
+}
+
+/// evalClass - Whether \a test may give \a value, and may give another.
+Truth FloatTriage::evalClass(const ref<Expr> &test, int64_t value) {
+  FloatFacts x = evalFloat(test->getKid(0));
+  Truth isSet = Truth::unknown();
+  switch (test->getKind()) {
+  case Expr::FIsNan:
+    isSet = Truth(x.mayBeNaN, x.hasValue);
+    break;
+  case Expr::FIsFinite:
+    isSet = Truth(x.mayBeFinite(), x.mayBeNaN || x.mayBeInfinity());
+    break;
+  default: {
+    if (value == 0)
+      return Truth(x.mayBeNaN || x.mayBeFinite(), x.mayBeInfinity());
+    if (value != 1 && value != -1)
+      return Truth(false, true);
+    // Whether the infinity of that sign is in the interval, and whether
+    // anything else is.
+    const APFloat &end = value < 0 ? x.lo : x.hi;
+    bool open = value < 0 ? x.loOpen : x.hiOpen;
+    bool mayBe = x.hasValue && end.isInfinity() &&
+                 end.isNegative() == (value < 0) && !open;
+    bool only = mayBe && !x.mayBeNaN && x.lo.isInfinity() &&
+                x.lo.isNegative() == x.hi.isNegative();
+    return Truth(mayBe, !only);
+  }
+  }
+  if (value == 0)
+    return !isSet;
+  if (value == 1)
+    return isSet;
+  return Truth(false, true);
+}
+
+class FloatTriageSolver : public IncompleteSolver {
+  /// triage - Evaluate the query expression under the constraints, or return
+  /// false if there is nothing to evaluate it for.
+  bool triage(const Query &query, Truth &result);
+
+public:
+  IncompleteSolver::PartialValidity computeValidity(const Query&);
+  IncompleteSolver::PartialValidity computeTruth(const Query&);
+  bool computeValue(const Query&, ref<Expr> &result) { return false; }
+  bool computeInitialValues(const Query&,
+                            const std::vector<const Array*> &objects,
+                            std::vector< std::vector<unsigned char> > &values,
+                            bool &hasSolution) {
+    return false;
+  }
+};
+
+bool FloatTriageSolver::triage(const Query &query, Truth &result) {
+  if (!hasFloatTest(query.expr))
+    return false;
+  ++stats::floatTriageQueries;
+
+  FloatTriage t;
+  for (ConstraintManager::const_iterator it = query.constraints.begin(),
+         ie = query.constraints.end(); it != ie; ++it)
+    t.assume(*it, true);
+  // Leave contradictions, which KLEE never makes, to the next solver.
+  if (t.isContradictory())
+    return false;
+
+  // Neither value being possible is a contradiction too.
+  result = t.evalBool(query.expr);
+  if (result.mayBeTrue == result.mayBeFalse)
+    return false;
+  ++stats::floatTriageDecided;
+  return true;
+}
+
+IncompleteSolver::PartialValidity
+FloatTriageSolver::computeValidity(const Query &query) {
+  Truth result = Truth::unknown();
+  if (!triage(query, result))
+    return IncompleteSolver::None;
+  return result.mayBeFalse ? IncompleteSolver::MustBeFalse
+                           : IncompleteSolver::MustBeTrue;
+}
+
+IncompleteSolver::PartialValidity
+FloatTriageSolver::computeTruth(const Query &query) {
+  return computeValidity(query);
+}
+
+}
+
+IncompleteSolver *klee::createFloatTriageStage() {
+  return new FloatTriageSolver();
+}
+
+Solver *klee::createFloatTriageSolver(Solver *s) {
+  return new Solver(new StagedSolverImpl(new FloatTriageSolver(), s));
+}
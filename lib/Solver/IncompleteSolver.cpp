@@ -10,6 +10,9 @@
 #include "klee/IncompleteSolver.h"
 
 #include "klee/Constraints.h"
+#include "klee/SolverStats.h"
+
+#include "llvm/Support/CommandLine.h"
 
 using namespace klee;
 using namespace llvm;
@@ -58,56 +61,152 @@ IncompleteSolver::computeValidity(const Query& query) {
 
 /***/
 
+namespace {
+llvm::cl::opt<unsigned> StagedSolverMinSuccessRate(
+    "staged-solver-min-success-rate",
+    llvm::cl::desc("Percentage of the queries of a class an incomplete "
+                   "solver stage must answer to keep being tried on all of "
+                   "them (default=1)"),
+    llvm::cl::init(1));
+
+llvm::cl::opt<unsigned> StagedSolverRetryInterval(
+    "staged-solver-retry-interval",
+    llvm::cl::desc("Try a stage which seldom answers a class of queries on "
+                   "one in this many of them, to notice when it starts "
+                   "answering again (default=64)"),
+    llvm::cl::init(64));
+}
+
+// A stage is judged after this many attempts on a class, and its counts
+// are halved once it reaches twice as many.
+static const unsigned StageWarmupAttempts = 32;
+static const unsigned StageHistoryAttempts = 1024;
+
 StagedSolverImpl::StagedSolverImpl(IncompleteSolver *_primary, 
                                    Solver *_secondary) 
-  : primary(_primary),
+  : stages(1, _primary),
+    records(NumQueryClasses),
     secondary(_secondary) {
 }
 
+StagedSolverImpl::StagedSolverImpl(
+    const std::vector<IncompleteSolver *> &_stages, Solver *_secondary)
+    : stages(_stages), records(_stages.size() * NumQueryClasses),
+      secondary(_secondary) {}
+
 StagedSolverImpl::~StagedSolverImpl() {
-  delete primary;
+  for (unsigned i = 0, e = stages.size(); i != e; ++i)
+    delete stages[i];
   delete secondary;
 }
 
-bool StagedSolverImpl::computeTruth(const Query& query, bool &isValid) {
-  IncompleteSolver::PartialValidity trueResult = primary->computeTruth(query); 
-  
-  if (trueResult != IncompleteSolver::None) {
-    isValid = (trueResult == IncompleteSolver::MustBeTrue);
+StagedSolverImpl::QueryClass
+StagedSolverImpl::getTruthClass(const Query &query) {
+  // Look through a negation, which is an equality with false.
+  ref<Expr> test = query.expr;
+  if (const EqExpr *ee = dyn_cast<EqExpr>(test))
+    if (ee->left->isFalse())
+      test = ee->right;
+  Expr::Kind k = test->getKind();
+  if ((k >= Expr::FOrd && k <= Expr::FOne) ||
+      (k >= Expr::UnaryKindFirst && k <= Expr::UnaryKindLast))
+    return FloatTruthQuery;
+  return TruthQuery;
+}
+
+bool StagedSolverImpl::shouldTry(unsigned i, QueryClass c) {
+  StageRecord &r = records[i * NumQueryClasses + c];
+  if (r.attempts < StageWarmupAttempts ||
+      r.successes * 100 >= r.attempts * StagedSolverMinSuccessRate)
+    return true;
+  if (++r.skipped >= StagedSolverRetryInterval) {
+    r.skipped = 0;
     return true;
-  } 
+  }
+  ++stats::stagedSolverStageSkips;
+  return false;
+}
+
+void StagedSolverImpl::recordOutcome(unsigned i, QueryClass c,
+                                     bool success) {
+  StageRecord &r = records[i * NumQueryClasses + c];
+  ++r.attempts;
+  if (success) {
+    ++r.successes;
+    ++stats::stagedSolverStageHits;
+  } else {
+    ++stats::stagedSolverStageMisses;
+  }
+  if (r.attempts >= 2 * StageHistoryAttempts) {
+    r.attempts /= 2;
+    r.successes /= 2;
+  }
+}
+
+bool StagedSolverImpl::computeTruth(const Query& query, bool &isValid) {
+  QueryClass c = getTruthClass(query);
+  for (unsigned i = 0, e = stages.size(); i != e; ++i) {
+    if (!shouldTry(i, c))
+      continue;
+    IncompleteSolver::PartialValidity trueResult =
+        stages[i]->computeTruth(query);
+    recordOutcome(i, c, trueResult != IncompleteSolver::None);
+    if (trueResult != IncompleteSolver::None) {
+      isValid = (trueResult == IncompleteSolver::MustBeTrue);
+      return true;
+    }
+  }
 
   return secondary->impl->computeTruth(query, isValid);
 }
 
 bool StagedSolverImpl::computeValidity(const Query& query,
                                        Solver::Validity &result) {
-  bool tmp;
+  // What the stages found so far: a true, or a false, assignment exists.
+  bool mayBeTrue = false, mayBeFalse = false;
+  QueryClass c = getTruthClass(query);
+  for (unsigned i = 0, e = stages.size(); i != e; ++i) {
+    if (!shouldTry(i, c))
+      continue;
+    IncompleteSolver::PartialValidity pv = stages[i]->computeValidity(query);
+    recordOutcome(i, c, pv != IncompleteSolver::None);
+    switch (pv) {
+    case IncompleteSolver::MustBeTrue:
+      result = Solver::True;
+      return true;
+    case IncompleteSolver::MustBeFalse:
+      result = Solver::False;
+      return true;
+    case IncompleteSolver::TrueOrFalse:
+      result = Solver::Unknown;
+      return true;
+    case IncompleteSolver::MayBeTrue:
+      mayBeTrue = true;
+      break;
+    case IncompleteSolver::MayBeFalse:
+      mayBeFalse = true;
+      break;
+    default:
+      break;
+    }
+    if (mayBeTrue && mayBeFalse) {
+      result = Solver::Unknown;
+      return true;
+    }
+  }
 
-  switch(primary->computeValidity(query)) {
-  case IncompleteSolver::MustBeTrue: 
-    result = Solver::True;
-    break;
-  case IncompleteSolver::MustBeFalse: 
-    result = Solver::False;
-    break;
-  case IncompleteSolver::TrueOrFalse: 
-    result = Solver::Unknown;
-    break;
-  case IncompleteSolver::MayBeTrue:
+  bool tmp;
+  if (mayBeTrue) {
     if (!secondary->impl->computeTruth(query, tmp))
       return false;
     result = tmp ? Solver::True : Solver::Unknown;
-    break;
-  case IncompleteSolver::MayBeFalse:
+  } else if (mayBeFalse) {
     if (!secondary->impl->computeTruth(query.negateExpr(), tmp))
       return false;
     result = tmp ? Solver::False : Solver::Unknown;
-    break;
-  default:
+  } else {
     if (!secondary->impl->computeValidity(query, result))
       return false;
-    break;
   }
 
   return true;
@@ -115,12 +214,29 @@ bool StagedSolverImpl::computeValidity(const Query& query,
 
 bool StagedSolverImpl::computeValue(const Query& query,
                                     ref<Expr> &result) {
-  if (primary->computeValue(query, result))
-    return true;
+  for (unsigned i = 0, e = stages.size(); i != e; ++i) {
+    if (!shouldTry(i, ValueQuery))
+      continue;
+    bool success = stages[i]->computeValue(query, result);
+    recordOutcome(i, ValueQuery, success);
+    if (success)
+      return true;
+  }
 
   return secondary->impl->computeValue(query, result);
 }
 
+bool StagedSolverImpl::computeRange(const Query& query, ref<Expr> &min,
+                                    ref<Expr> &max) {
+  return secondary->impl->computeRange(query, min, max);
+}
+
+bool StagedSolverImpl::computeUniqueValue(const Query& query,
+                                          ref<Expr> &result,
+                                          bool &isUnique) {
+  return secondary->impl->computeUniqueValue(query, result, isUnique);
+}
+
 bool 
 StagedSolverImpl::computeInitialValues(const Query& query,
                                        const std::vector<const Array*> 
@@ -128,8 +244,15 @@ StagedSolverImpl::computeInitialValues(const Query& query,
                                        std::vector< std::vector<unsigned char> >
                                          &values,
                                        bool &hasSolution) {
-  if (primary->computeInitialValues(query, objects, values, hasSolution))
-    return true;
+  for (unsigned i = 0, e = stages.size(); i != e; ++i) {
+    if (!shouldTry(i, InitialValuesQuery))
+      continue;
+    bool success =
+        stages[i]->computeInitialValues(query, objects, values, hasSolution);
+    recordOutcome(i, InitialValuesQuery, success);
+    if (success)
+      return true;
+  }
   
   return secondary->impl->computeInitialValues(query, objects, values,
                                                hasSolution);
@@ -147,3 +270,22 @@ void StagedSolverImpl::setCoreSolverTimeout(double timeout) {
   secondary->impl->setCoreSolverTimeout(timeout);
 }
 
+size_t StagedSolverImpl::trimCaches(size_t bytes) {
+  return secondary->impl->trimCaches(bytes);
+}
+
+void StagedSolverImpl::releaseArrays(const std::vector<const Array *> &arrays) {
+  secondary->impl->releaseArrays(arrays);
+}
+
+// The stages answer on their own without search, so only the secondary
+// solver has anything to interrupt.
+void StagedSolverImpl::interrupt() {
+  secondary->impl->interrupt();
+}
+
+
+Solver *klee::createStagedSolver(const std::vector<IncompleteSolver *> &stages,
+                                 Solver *s) {
+  return new Solver(new StagedSolverImpl(stages, s));
+}
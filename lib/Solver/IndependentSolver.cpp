@@ -14,19 +14,55 @@
 #include "klee/Constraints.h"
 #include "klee/SolverImpl.h"
 #include "klee/Internal/Support/Debug.h"
+#include "klee/Internal/Support/ErrorHandling.h"
 
 #include "klee/util/ExprUtil.h"
+#include "klee/util/ExprHashMap.h"
 #include "klee/util/Assignment.h"
 
+#include "llvm/Support/CommandLine.h"
+#include "llvm/Support/Errno.h"
 #include "llvm/Support/raw_ostream.h"
+#include <algorithm>
 #include <map>
 #include <vector>
 #include <ostream>
 #include <list>
 
+#include <errno.h>
+#include <pthread.h>
+#include <signal.h>
+#include <unistd.h>
+#include <sys/wait.h>
+#include <sys/ipc.h>
+#include <sys/shm.h>
+
 using namespace klee;
 using namespace llvm;
 
+namespace {
+  cl::opt<unsigned>
+  IndependentSolverJobs("independent-solver-jobs",
+                        cl::desc("Number of independent factors of a "
+                                 "counterexample query to solve at once, each "
+                                 "in a forked process (default=1)"),
+                        cl::init(1));
+}
+
+// See STPSolver.cpp for why Darwin gets a smaller region.
+#ifdef __APPLE__
+static const unsigned shared_memory_size = 1 << 16;
+#else
+static const unsigned shared_memory_size = 1 << 20;
+#endif
+
+// Exit codes of the processes solving a factor.
+enum {
+  FACTOR_EXIT_SOLVABLE = 0,
+  FACTOR_EXIT_UNSOLVABLE = 1,
+  FACTOR_EXIT_FAILURE = 2
+};
+
 template<class T>
 class DenseSet {
   typedef std::set<T> set_ty;
@@ -256,120 +292,6 @@ inline llvm::raw_ostream &operator<<(llvm::raw_ostream &os,
   return os;
 }
 
-// Breaks down a constraint into all of it's individual pieces, returning a
-// list of IndependentElementSets or the independent factors.
-//
-// Caller takes ownership of returned std::list.
-static std::list<IndependentElementSet>*
-getAllIndependentConstraintsSets(const Query &query) {
-  std::list<IndependentElementSet> *factors = new std::list<IndependentElementSet>();
-  ConstantExpr *CE = dyn_cast<ConstantExpr>(query.expr);
-  if (CE) {
-    assert(CE && CE->isFalse() && "the expr should always be false and "
-                                  "therefore not included in factors");
-  } else {
-    ref<Expr> neg = Expr::createIsZero(query.expr);
-    factors->push_back(IndependentElementSet(neg));
-  }
-
-  for (ConstraintManager::const_iterator it = query.constraints.begin(),
-                                         ie = query.constraints.end();
-       it != ie; ++it) {
-    // iterate through all the previously separated constraints.  Until we
-    // actually return, factors is treated as a queue of expressions to be
-    // evaluated.  If the queue property isn't maintained, then the exprs
-    // could be returned in an order different from how they came it, negatively
-    // affecting later stages.
-    factors->push_back(IndependentElementSet(*it));
-  }
-
-  bool doneLoop = false;
-  do {
-    doneLoop = true;
-    std::list<IndependentElementSet> *done =
-        new std::list<IndependentElementSet>;
-    while (factors->size() > 0) {
-      IndependentElementSet current = factors->front();
-      factors->pop_front();
-      // This list represents the set of factors that are separate from current.
-      // Those that are not inserted into this list (queue) intersect with
-      // current.
-      std::list<IndependentElementSet> *keep =
-          new std::list<IndependentElementSet>;
-      while (factors->size() > 0) {
-        IndependentElementSet compare = factors->front();
-        factors->pop_front();
-        if (current.intersects(compare)) {
-          if (current.add(compare)) {
-            // Means that we have added (z=y)added to (x=y)
-            // Now need to see if there are any (z=?)'s
-            doneLoop = false;
-          }
-        } else {
-          keep->push_back(compare);
-        }
-      }
-      done->push_back(current);
-      delete factors;
-      factors = keep;
-    }
-    delete factors;
-    factors = done;
-  } while (!doneLoop);
-
-  return factors;
-}
-
-static 
-IndependentElementSet getIndependentConstraints(const Query& query,
-                                                std::vector< ref<Expr> > &result) {
-  IndependentElementSet eltsClosure(query.expr);
-  std::vector< std::pair<ref<Expr>, IndependentElementSet> > worklist;
-
-  for (ConstraintManager::const_iterator it = query.constraints.begin(), 
-         ie = query.constraints.end(); it != ie; ++it)
-    worklist.push_back(std::make_pair(*it, IndependentElementSet(*it)));
-
-  // XXX This should be more efficient (in terms of low level copy stuff).
-  bool done = false;
-  do {
-    done = true;
-    std::vector< std::pair<ref<Expr>, IndependentElementSet> > newWorklist;
-    for (std::vector< std::pair<ref<Expr>, IndependentElementSet> >::iterator
-           it = worklist.begin(), ie = worklist.end(); it != ie; ++it) {
-      if (it->second.intersects(eltsClosure)) {
-        if (eltsClosure.add(it->second))
-          done = false;
-        result.push_back(it->first);
-        // Means that we have added (z=y)added to (x=y)
-        // Now need to see if there are any (z=?)'s
-      } else {
-        newWorklist.push_back(*it);
-      }
-    }
-    worklist.swap(newWorklist);
-  } while (!done);
-
-  KLEE_DEBUG(
-    std::set< ref<Expr> > reqset(result.begin(), result.end());
-    errs() << "--\n";
-    errs() << "Q: " << query.expr << "\n";
-    errs() << "\telts: " << IndependentElementSet(query.expr) << "\n";
-    int i = 0;
-    for (ConstraintManager::const_iterator it = query.constraints.begin(),
-        ie = query.constraints.end(); it != ie; ++it) {
-      errs() << "C" << i++ << ": " << *it;
-      errs() << " " << (reqset.count(*it) ? "(required)" : "(independent)") << "\n";
-      errs() << "\telts: " << IndependentElementSet(*it) << "\n";
-    }
-    errs() << "elts closure: " << eltsClosure << "\n";
- );
-
-
-  return eltsClosure;
-}
-
-
 // Extracts which arrays are referenced from a particular independent set.  Examines both
 // the actual known array accesses arr[1] plus the undetermined accesses arr[x].
 static
@@ -390,18 +312,77 @@ void calculateArrayReferences(const IndependentElementSet & ie,
   }
 }
 
+// The model of a factor, as computed for its arrays (in the order of
+// calculateArrayReferences).
+struct FactorModel {
+  bool hasSolution;
+  std::vector< std::vector<unsigned char> > values;
+};
+
 class IndependentSolver : public SolverImpl {
 private:
   Solver *solver;
 
+  // Bounds on the sizes of the caches, which are cleared when exceeded.
+  static const unsigned MaxElementSets = 100000;
+  static const unsigned MaxFactorModels = 10000;
+
+  // The element sets of the constraints seen recently, as finding their
+  // reads is the expensive part of computing the factors.
+  ExprHashMap<IndependentElementSet> elementSets;
+
+  // The constraints factorized last and their factors. Queries mostly come
+  // from the same path, or one forked from it, so that their constraints
+  // extend these and only the new constraints have to be added.
+  std::vector< ref<Expr> > lastConstraints;
+  std::list<IndependentElementSet> lastFactors;
+
+  // The models of recently solved factors, by their sorted constraints, so
+  // that a query only touching a new factor reuses those of the others.
+  std::map<std::vector< ref<Expr> >, FactorModel> factorModels;
+
+  // One region per job, for the models found by the processes solving
+  // factors, and the process which allocated them.
+  std::vector<unsigned char *> sharedMemory;
+  pid_t sharedMemoryOwner;
+
+  // Set by interrupt() until the next query. The processes solving factors
+  // are killed by interrupt() too; the lock keeps it from signalling a
+  // process which has been reaped.
+  volatile sig_atomic_t interrupted;
+  pthread_mutex_t factorProcessesLock;
+  std::vector<pid_t> factorProcesses;
+
+  void allocateSharedMemory();
+  void solveFactorsInParallel(const std::list<IndependentElementSet> &factors);
+
+  const IndependentElementSet &getElementSet(ref<Expr> e);
+  void addToFactors(std::list<IndependentElementSet> &factors,
+                    IndependentElementSet set);
+  const std::list<IndependentElementSet> &getFactors(const Query &query);
+  IndependentElementSet getIndependentConstraints(const Query &query,
+                                                  std::vector< ref<Expr> > &result);
+
 public:
   IndependentSolver(Solver *_solver) 
-    : solver(_solver) {}
-  ~IndependentSolver() { delete solver; }
+    : solver(_solver), sharedMemoryOwner(0), interrupted(0) {
+    pthread_mutex_init(&factorProcessesLock, NULL);
+  }
+  ~IndependentSolver() {
+    for (unsigned i = 0; i != sharedMemory.size(); ++i)
+      shmdt(sharedMemory[i]);
+    pthread_mutex_destroy(&factorProcessesLock);
+    delete solver;
+  }
 
   bool computeTruth(const Query&, bool &isValid);
+  bool computeTruthMany(const ConstraintManager &constraints,
+                        const std::vector< ref<Expr> > &exprs,
+                        std::vector<bool> &isValid);
   bool computeValidity(const Query&, Solver::Validity &result);
   bool computeValue(const Query&, ref<Expr> &result);
+  bool computeRange(const Query&, ref<Expr> &min, ref<Expr> &max);
+  bool computeUniqueValue(const Query&, ref<Expr> &result, bool &isUnique);
   bool computeInitialValues(const Query& query,
                             const std::vector<const Array*> &objects,
                             std::vector< std::vector<unsigned char> > &values,
@@ -409,8 +390,242 @@ public:
   SolverRunStatus getOperationStatusCode();
   char *getConstraintLog(const Query&);
   void setCoreSolverTimeout(double timeout);
+  size_t trimCaches(size_t bytes);
+  void releaseArrays(const std::vector<const Array *> &arrays);
+  void interrupt();
 };
   
+static std::vector< ref<Expr> > getFactorKey(const IndependentElementSet &ies) {
+  std::vector< ref<Expr> > key(ies.exprs);
+  std::sort(key.begin(), key.end());
+  return key;
+}
+
+// The regions are inherited across fork(), so processes forked from klee
+// itself (parallel workers) allocate their own, as the portfolio solver does.
+void IndependentSolver::allocateSharedMemory() {
+  for (unsigned i = 0; i != sharedMemory.size(); ++i)
+    shmdt(sharedMemory[i]);
+  sharedMemory.clear();
+  for (unsigned i = 0; i != IndependentSolverJobs; ++i) {
+    int id = shmget(IPC_PRIVATE, shared_memory_size, IPC_CREAT | 0700);
+    if (id < 0)
+      llvm::report_fatal_error("unable to allocate shared memory region");
+    unsigned char *ptr = (unsigned char *)shmat(id, NULL, 0);
+    if (ptr == (void *)-1)
+      llvm::report_fatal_error("unable to attach shared memory region");
+    shmctl(id, IPC_RMID, NULL);
+    sharedMemory.push_back(ptr);
+  }
+  sharedMemoryOwner = getpid();
+}
+
+// Solves the factors without a memoized model, up to IndependentSolverJobs
+// at once, and memoizes their models. Factors which could not be solved this
+// way are left to the caller.
+void IndependentSolver::solveFactorsInParallel(
+    const std::list<IndependentElementSet> &factors) {
+  std::vector<const IndependentElementSet *> pending;
+  for (std::list<IndependentElementSet>::const_iterator it = factors.begin(),
+         ie = factors.end(); it != ie; ++it) {
+    std::vector<const Array*> arrays;
+    calculateArrayReferences(*it, arrays);
+    unsigned size = 0;
+    for (unsigned i = 0; i != arrays.size(); ++i)
+      size += arrays[i]->size;
+    if (!arrays.empty() && size < shared_memory_size &&
+        !factorModels.count(getFactorKey(*it)))
+      pending.push_back(&*it);
+  }
+  if (pending.size() < 2)
+    return;
+
+  if (sharedMemoryOwner != getpid())
+    allocateSharedMemory();
+  // Don't let the models of this query evict each other.
+  if (factorModels.size() + pending.size() > MaxFactorModels)
+    factorModels.clear();
+
+  fflush(stdout);
+  fflush(stderr);
+  for (unsigned first = 0; first < pending.size() && !interrupted;
+       first += IndependentSolverJobs) {
+    unsigned n = std::min((unsigned) pending.size() - first,
+                          (unsigned) IndependentSolverJobs);
+    std::vector<pid_t> pids(n, -1);
+    for (unsigned i = 0; i != n; ++i) {
+      const IndependentElementSet &factor = *pending[first + i];
+      pid_t pid = fork();
+      if (pid == -1) {
+        klee_warning("fork failed (for independent solver) - %s",
+                     llvm::sys::StrError(errno).c_str());
+        continue;
+      }
+      if (pid == 0) {
+        std::vector<const Array*> arrays;
+        calculateArrayReferences(factor, arrays);
+        ConstraintManager tmp(factor.exprs);
+        std::vector< std::vector<unsigned char> > values;
+        bool hasSolution;
+        if (!solver->impl->computeInitialValues(
+                Query(tmp, ConstantExpr::alloc(0, Expr::Bool)), arrays, values,
+                hasSolution))
+          _exit(FACTOR_EXIT_FAILURE);
+        if (!hasSolution)
+          _exit(FACTOR_EXIT_UNSOLVABLE);
+        unsigned char *pos = sharedMemory[i];
+        for (unsigned j = 0; j != values.size(); ++j)
+          pos = std::copy(values[j].begin(), values[j].end(), pos);
+        _exit(FACTOR_EXIT_SOLVABLE);
+      }
+      pids[i] = pid;
+      pthread_mutex_lock(&factorProcessesLock);
+      factorProcesses.push_back(pid);
+      pthread_mutex_unlock(&factorProcessesLock);
+    }
+    if (interrupted)
+      interrupt();
+
+    for (unsigned i = 0; i != n; ++i) {
+      if (pids[i] == -1)
+        continue;
+      // Wait for the process to exit, but only reap it once interrupt()
+      // can no longer signal it.
+      siginfo_t info;
+      int res;
+      do {
+        res = waitid(P_PID, pids[i], &info, WEXITED | WNOWAIT);
+      } while (res < 0 && errno == EINTR);
+      pthread_mutex_lock(&factorProcessesLock);
+      factorProcesses.erase(std::find(factorProcesses.begin(),
+                                      factorProcesses.end(), pids[i]));
+      pthread_mutex_unlock(&factorProcessesLock);
+      int status;
+      do {
+        res = waitpid(pids[i], &status, 0);
+      } while (res < 0 && errno == EINTR);
+      if (res < 0 || WIFSIGNALED(status) || !WIFEXITED(status))
+        continue;
+
+      const IndependentElementSet &factor = *pending[first + i];
+      FactorModel fm;
+      switch (WEXITSTATUS(status)) {
+      case FACTOR_EXIT_SOLVABLE: {
+        std::vector<const Array*> arrays;
+        calculateArrayReferences(factor, arrays);
+        unsigned char *pos = sharedMemory[i];
+        for (unsigned j = 0; j != arrays.size(); ++j) {
+          fm.values.push_back(std::vector<unsigned char>(pos,
+                                                         pos + arrays[j]->size));
+          pos += arrays[j]->size;
+        }
+        fm.hasSolution = true;
+        break;
+      }
+      case FACTOR_EXIT_UNSOLVABLE:
+        fm.hasSolution = false;
+        break;
+      default:
+        continue;
+      }
+      factorModels.insert(std::make_pair(getFactorKey(factor), fm));
+    }
+  }
+}
+
+const IndependentElementSet &IndependentSolver::getElementSet(ref<Expr> e) {
+  ExprHashMap<IndependentElementSet>::iterator it = elementSets.find(e);
+  if (it != elementSets.end())
+    return it->second;
+  if (elementSets.size() >= MaxElementSets)
+    elementSets.clear();
+  return elementSets.insert(std::make_pair(e, IndependentElementSet(e)))
+    .first->second;
+}
+
+// Adds a set to a list of (pairwise independent) factors, merging it with
+// every factor it intersects. Factors do not intersect each other, so a
+// single pass finds all of them.
+void IndependentSolver::addToFactors(std::list<IndependentElementSet> &factors,
+                                     IndependentElementSet set) {
+  // Keep the constraints of the merged factors first, in the order they
+  // were added.
+  IndependentElementSet merged;
+  for (std::list<IndependentElementSet>::iterator it = factors.begin();
+       it != factors.end();) {
+    if (it->intersects(set)) {
+      merged.add(*it);
+      it = factors.erase(it);
+    } else {
+      ++it;
+    }
+  }
+  merged.add(set);
+  factors.push_back(merged);
+}
+
+// Breaks down the constraints of a query into their independent factors,
+// extending the factors of the last query if its constraints are a prefix
+// of these.
+const std::list<IndependentElementSet> &
+IndependentSolver::getFactors(const Query &query) {
+  const ConstraintManager &constraints = query.constraints;
+  unsigned n = lastConstraints.size();
+  if (n > constraints.size() ||
+      !std::equal(lastConstraints.begin(), lastConstraints.end(),
+                  constraints.begin())) {
+    lastConstraints.clear();
+    lastFactors.clear();
+    n = 0;
+  }
+  for (ConstraintManager::const_iterator it = constraints.begin() + n,
+         ie = constraints.end(); it != ie; ++it) {
+    lastConstraints.push_back(*it);
+    addToFactors(lastFactors, getElementSet(*it));
+  }
+  return lastFactors;
+}
+
+IndependentElementSet
+IndependentSolver::getIndependentConstraints(const Query& query,
+                                             std::vector< ref<Expr> > &result) {
+  IndependentElementSet eltsClosure(query.expr);
+  const std::list<IndependentElementSet> &factors = getFactors(query);
+
+  ExprHashSet required;
+  for (std::list<IndependentElementSet>::const_iterator it = factors.begin(),
+         ie = factors.end(); it != ie; ++it) {
+    if (eltsClosure.intersects(*it))
+      required.insert(it->exprs.begin(), it->exprs.end());
+  }
+  for (std::list<IndependentElementSet>::const_iterator it = factors.begin(),
+         ie = factors.end(); it != ie; ++it) {
+    if (required.count(it->exprs.front()))
+      eltsClosure.add(*it);
+  }
+  // Keep the order of the constraints.
+  for (ConstraintManager::const_iterator it = query.constraints.begin(),
+         ie = query.constraints.end(); it != ie; ++it)
+    if (required.count(*it))
+      result.push_back(*it);
+
+  KLEE_DEBUG(
+    errs() << "--\n";
+    errs() << "Q: " << query.expr << "\n";
+    errs() << "\telts: " << IndependentElementSet(query.expr) << "\n";
+    int i = 0;
+    for (ConstraintManager::const_iterator it = query.constraints.begin(),
+        ie = query.constraints.end(); it != ie; ++it) {
+      errs() << "C" << i++ << ": " << *it;
+      errs() << " " << (required.count(*it) ? "(required)" : "(independent)") << "\n";
+      errs() << "\telts: " << IndependentElementSet(*it) << "\n";
+    }
+    errs() << "elts closure: " << eltsClosure << "\n";
+ );
+
+  return eltsClosure;
+}
+
 bool IndependentSolver::computeValidity(const Query& query,
                                         Solver::Validity &result) {
   std::vector< ref<Expr> > required;
@@ -430,6 +645,35 @@ bool IndependentSolver::computeTruth(const Query& query, bool &isValid) {
                                     isValid);
 }
 
+bool IndependentSolver::computeTruthMany(const ConstraintManager &constraints,
+                                         const std::vector< ref<Expr> > &exprs,
+                                         std::vector<bool> &isValid) {
+  // The expressions which need the same constraints go down as one batch.
+  typedef std::map<std::vector< ref<Expr> >, std::vector<unsigned> > groups_ty;
+  groups_ty groups;
+  for (unsigned i = 0, e = exprs.size(); i != e; ++i) {
+    std::vector< ref<Expr> > required;
+    getIndependentConstraints(Query(constraints, exprs[i]), required);
+    groups[required].push_back(i);
+  }
+
+  isValid.assign(exprs.size(), false);
+  for (groups_ty::iterator it = groups.begin(), ie = groups.end(); it != ie;
+       ++it) {
+    std::vector< ref<Expr> > batch;
+    for (std::vector<unsigned>::iterator pit = it->second.begin(),
+           pie = it->second.end(); pit != pie; ++pit)
+      batch.push_back(exprs[*pit]);
+    ConstraintManager tmp(it->first);
+    std::vector<bool> results;
+    if (!solver->impl->computeTruthMany(tmp, batch, results))
+      return false;
+    for (unsigned i = 0, e = it->second.size(); i != e; ++i)
+      isValid[it->second[i]] = results[i];
+  }
+  return true;
+}
+
 bool IndependentSolver::computeValue(const Query& query, ref<Expr> &result) {
   std::vector< ref<Expr> > required;
   IndependentElementSet eltsClosure = 
@@ -438,6 +682,26 @@ bool IndependentSolver::computeValue(const Query& query, ref<Expr> &result) {
   return solver->impl->computeValue(Query(tmp, query.expr), result);
 }
 
+bool IndependentSolver::computeRange(const Query& query, ref<Expr> &min,
+                                     ref<Expr> &max) {
+  std::vector< ref<Expr> > required;
+  IndependentElementSet eltsClosure =
+    getIndependentConstraints(query, required);
+  ConstraintManager tmp(required);
+  return solver->impl->computeRange(Query(tmp, query.expr), min, max);
+}
+
+bool IndependentSolver::computeUniqueValue(const Query& query,
+                                           ref<Expr> &result,
+                                           bool &isUnique) {
+  std::vector< ref<Expr> > required;
+  IndependentElementSet eltsClosure =
+    getIndependentConstraints(query, required);
+  ConstraintManager tmp(required);
+  return solver->impl->computeUniqueValue(Query(tmp, query.expr), result,
+                                          isUnique);
+}
+
 // Helper function used only for assertions to make sure point created
 // during computeInitialValues is in fact correct. The ``retMap`` is used
 // in the case ``objects`` doesn't contain all the assignments needed.
@@ -480,14 +744,22 @@ bool IndependentSolver::computeInitialValues(const Query& query,
   // This is important in case we don't have any constraints but
   // we need initial values for requested array objects.
   hasSolution = true;
-  // FIXME: When we switch to C++11 this should be a std::unique_ptr so we don't need
-  // to remember to manually call delete
-  std::list<IndependentElementSet> *factors = getAllIndependentConstraintsSets(query);
+  interrupted = 0;
+  std::list<IndependentElementSet> factors = getFactors(query);
+  ConstantExpr *CE = dyn_cast<ConstantExpr>(query.expr);
+  if (CE) {
+    assert(CE && CE->isFalse() && "the expr should always be false and "
+                                  "therefore not included in factors");
+  } else {
+    addToFactors(factors, IndependentElementSet(Expr::createIsZero(query.expr)));
+  }
+  if (IndependentSolverJobs > 1)
+    solveFactorsInParallel(factors);
 
   //Used to rearrange all of the answers into the correct order
   std::map<const Array*, std::vector<unsigned char> > retMap;
-  for (std::list<IndependentElementSet>::iterator it = factors->begin();
-       it != factors->end(); ++it) {
+  for (std::list<IndependentElementSet>::iterator it = factors.begin();
+       it != factors.end(); ++it) {
     std::vector<const Array*> arraysInFactor;
     calculateArrayReferences(*it, arraysInFactor);
     // Going to use this as the "fresh" expression for the Query() invocation below
@@ -495,16 +767,31 @@ bool IndependentSolver::computeInitialValues(const Query& query,
     if (arraysInFactor.size() == 0){
       continue;
     }
-    ConstraintManager tmp(it->exprs);
-    std::vector<std::vector<unsigned char> > tempValues;
-    if (!solver->impl->computeInitialValues(Query(tmp, ConstantExpr::alloc(0, Expr::Bool)),
-                                            arraysInFactor, tempValues, hasSolution)){
-      values.clear();
-      delete factors;
-      return false;
-    } else if (!hasSolution){
+    std::vector< ref<Expr> > key = getFactorKey(*it);
+    std::map<std::vector< ref<Expr> >, FactorModel>::iterator model =
+      factorModels.find(key);
+    if (model == factorModels.end()) {
+      if (interrupted) {
+        values.clear();
+        return false;
+      }
+      ConstraintManager tmp(it->exprs);
+      FactorModel fm;
+      if (!solver->impl->computeInitialValues(Query(tmp, ConstantExpr::alloc(0, Expr::Bool)),
+                                              arraysInFactor, fm.values,
+                                              fm.hasSolution)) {
+        values.clear();
+        return false;
+      }
+      if (factorModels.size() >= MaxFactorModels)
+        factorModels.clear();
+      model = factorModels.insert(std::make_pair(key, fm)).first;
+    }
+    hasSolution = model->second.hasSolution;
+    const std::vector<std::vector<unsigned char> > &tempValues =
+      model->second.values;
+    if (!hasSolution){
       values.clear();
-      delete factors;
       return true;
     } else {
       assert(tempValues.size() == arraysInFactor.size() &&
@@ -543,7 +830,6 @@ bool IndependentSolver::computeInitialValues(const Query& query,
     }
   }
   assert(assertCreatedPointEvaluatesToTrue(query, objects, values, retMap) && "should satisfy the equation");
-  delete factors;
   return true;
 }
 
@@ -559,6 +845,29 @@ void IndependentSolver::setCoreSolverTimeout(double timeout) {
   solver->impl->setCoreSolverTimeout(timeout);
 }
 
+size_t IndependentSolver::trimCaches(size_t bytes) {
+  // Both tables are bounded already; they are only emptied, their size
+  // is not known.
+  if (bytes) {
+    elementSets.clear();
+    factorModels.clear();
+  }
+  return solver->impl->trimCaches(bytes);
+}
+
+void IndependentSolver::releaseArrays(const std::vector<const Array *> &arrays) {
+  solver->impl->releaseArrays(arrays);
+}
+
+void IndependentSolver::interrupt() {
+  interrupted = 1;
+  pthread_mutex_lock(&factorProcessesLock);
+  for (unsigned i = 0; i != factorProcesses.size(); ++i)
+    kill(factorProcesses[i], SIGKILL);
+  pthread_mutex_unlock(&factorProcessesLock);
+  solver->impl->interrupt();
+}
+
 Solver *klee::createIndependentSolver(Solver *s) {
   return new Solver(new IndependentSolver(s));
 }
@@ -22,6 +22,7 @@
 #include "klee/util/ExprPPrinter.h"
 #include "klee/util/ArrayExprHash.h"
 #include "klee/util/ExprHashMap.h"
+#include "klee/util/FloatLowering.h"
 #include "ConstantDivision.h"
 
 #ifdef ENABLE_METASMT
@@ -67,15 +68,34 @@ public:
 
 template <typename SolverContext> class MetaSMTBuilder {
 public:
-  MetaSMTBuilder(SolverContext &solver, bool optimizeDivides)
-      : _solver(solver), _optimizeDivides(optimizeDivides){};
+  MetaSMTBuilder(SolverContext &solver, bool optimizeDivides,
+                 bool keepConstructed = false)
+      : _solver(solver), _optimizeDivides(optimizeDivides),
+        _keepConstructed(keepConstructed){};
   virtual ~MetaSMTBuilder(){};
 
+  /// construct - Build \a e in the context. What was built for its
+  /// subexpressions is only kept for later calls if the builder was created
+  /// to keep it, which is sound as long as the context lives.
   typename SolverContext::result_type construct(ref<Expr> e);
 
+  /// isConstructed - Whether \a e was built before and kept.
+  bool isConstructed(ref<Expr> e) const {
+    return _constructed.find(e) != _constructed.end();
+  }
+
+  /// getNumConstructed - The number of expressions built and kept.
+  unsigned getNumConstructed() const { return _constructed.size(); }
+
   typename SolverContext::result_type getInitialRead(const Array *root,
                                                      unsigned index);
 
+  /// releaseArrays - Forget what was built for \a arrays, which are about
+  /// to be freed.
+  void releaseArrays(const std::vector<const Array *> &arrays) {
+    _arr_hash.releaseArrays(arrays);
+  }
+
   typename SolverContext::result_type getTrue() {
     return (evaluate(_solver, metaSMT::logic::True));
   }
@@ -143,8 +163,10 @@ private:
 
   SolverContext &_solver;
   bool _optimizeDivides;
+  bool _keepConstructed;
   MetaSMTArrayExprHash<SolverContext> _arr_hash;
   MetaSMTExprHashMap _constructed;
+  FloatLowering _floatLowering;
 
   typename SolverContext::result_type constructActual(ref<Expr> e,
                                                       int *width_out);
@@ -585,7 +607,10 @@ template <typename SolverContext>
 typename SolverContext::result_type
 MetaSMTBuilder<SolverContext>::construct(ref<Expr> e) {
   typename SolverContext::result_type res = construct(e, 0);
-  _constructed.clear();
+  if (!_keepConstructed) {
+    _constructed.clear();
+    _floatLowering.clear();
+  }
   return res;
 }
 
@@ -1189,6 +1214,46 @@ MetaSMTBuilder<SolverContext>::constructActual(ref<Expr> e, int *width_out) {
         case Expr::Sge:
 #endif
 
+  // Floating point, bit-blasted over the IEEE encodings
+  case Expr::FToU:
+  case Expr::FToS:
+  case Expr::ExplicitInt:
+  case Expr::FpClassify:
+  case Expr::FIsFinite:
+  case Expr::FIsNan:
+  case Expr::FIsInf:
+  case Expr::FOrd:
+  case Expr::FUno:
+  case Expr::FUeq:
+  case Expr::FOeq:
+  case Expr::FUgt:
+  case Expr::FOgt:
+  case Expr::FUge:
+  case Expr::FOge:
+  case Expr::FUlt:
+  case Expr::FOlt:
+  case Expr::FUle:
+  case Expr::FOle:
+  case Expr::FUne:
+  case Expr::FOne:
+  case Expr::FConstant:
+  case Expr::FSelect:
+  case Expr::FExt:
+  case Expr::UToF:
+  case Expr::SToF:
+  case Expr::ExplicitFloat:
+  case Expr::FAbs:
+  case Expr::FSqrt:
+  case Expr::FNearbyInt:
+  case Expr::FAdd:
+  case Expr::FSub:
+  case Expr::FMul:
+  case Expr::FDiv:
+  case Expr::FMin:
+  case Expr::FMax:
+    res = construct(_floatLowering.lower(e), width_out);
+    break;
+
   default:
     assert(false);
     break;
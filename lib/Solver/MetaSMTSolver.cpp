@@ -14,8 +14,10 @@
 #include "klee/Internal/Support/ErrorHandling.h"
 #include "klee/Solver.h"
 #include "klee/SolverImpl.h"
+#include "klee/SolverStats.h"
 #include "klee/util/Assignment.h"
 #include "klee/util/ExprUtil.h"
+#include "klee/util/FloatLowering.h"
 
 #include <metaSMT/DirectSolver_Context.hpp>
 #include <metaSMT/backend/Z3_Backend.hpp>
@@ -29,6 +31,8 @@
 #undef Type
 #undef STP
 
+#include "llvm/Support/CommandLine.h"
+
 #include <errno.h>
 #include <unistd.h>
 #include <signal.h>
@@ -38,6 +42,8 @@
 
 static unsigned char *shared_memory_ptr;
 static int shared_memory_id = 0;
+// The process which allocated the region, see allocateSharedMemory().
+static pid_t shared_memory_owner = 0;
 // Darwin by default has a very small limit on the maximum amount of shared
 // memory, which will quickly be exhausted by KLEE running its tests in
 // parallel. For now, we work around this by just requesting a smaller size --
@@ -49,17 +55,66 @@ static const unsigned shared_memory_size = 1 << 16;
 static const unsigned shared_memory_size = 1 << 20;
 #endif
 
+/// allocateSharedMemory - Allocate the region forked solver processes write
+/// their counterexamples to. Processes forked from klee itself (parallel
+/// workers) inherit it, and allocate their own before querying.
+static void allocateSharedMemory() {
+  shared_memory_id =
+      shmget(IPC_PRIVATE, shared_memory_size, IPC_CREAT | 0700);
+  assert(shared_memory_id >= 0 && "shmget failed");
+  shared_memory_ptr = (unsigned char *)shmat(shared_memory_id, NULL, 0);
+  assert(shared_memory_ptr != (void *)-1 && "shmat failed");
+  shmctl(shared_memory_id, IPC_RMID, NULL);
+  shared_memory_owner = getpid();
+}
+
+namespace {
+llvm::cl::opt<bool> MetaSMTIncremental(
+    "metasmt-incremental",
+    llvm::cl::desc("Keep one metaSMT context alive across queries, with "
+                   "every expression built in it, and pass the constraints "
+                   "of each query as assumptions, so that constraints shared "
+                   "between queries are only built once. Not used with the "
+                   "forked solver (default=off)"),
+    llvm::cl::init(false));
+
+llvm::cl::opt<unsigned> MetaSMTSessionSize(
+    "metasmt-session-size",
+    llvm::cl::desc("Number of expressions kept by -metasmt-incremental after "
+                   "which the context is dropped and a fresh one started "
+                   "(default=1000000)"),
+    llvm::cl::init(1000000));
+}
+
 namespace klee {
 
+/// canBitBlast - Whether every floating-point expression in the query can be
+/// lowered to bitvectors for metaSMT.
+static bool canBitBlast(const Query &query) {
+  for (ConstraintManager::const_iterator it = query.constraints.begin(),
+                                         ie = query.constraints.end();
+       it != ie; ++it)
+    if (!FloatLowering::canLower(*it))
+      return false;
+  return FloatLowering::canLower(query.expr);
+}
+
 template <typename SolverContext> class MetaSMTSolverImpl : public SolverImpl {
 private:
-  SolverContext _meta_solver;
+  SolverContext *_meta_solver;
   MetaSMTSolver<SolverContext> *_solver;
   MetaSMTBuilder<SolverContext> *_builder;
   double _timeout;
   bool _useForked;
+  bool _optimizeDivides;
+  // Whether the context and what was built in it outlive a query, see
+  // -metasmt-incremental.
+  bool _incremental;
   SolverRunStatus _runStatusCode;
 
+  /// resetContext - Drop the context and everything built in it.
+  void resetContext();
+
 public:
   MetaSMTSolverImpl(MetaSMTSolver<SolverContext> *solver, bool useForked,
                     bool optimizeDivides);
@@ -67,6 +122,9 @@ public:
 
   char *getConstraintLog(const Query &);
   void setCoreSolverTimeout(double timeout) { _timeout = timeout; }
+  void releaseArrays(const std::vector<const Array *> &arrays) {
+    _builder->releaseArrays(arrays);
+  }
 
   bool computeTruth(const Query &, bool &isValid);
   bool computeValue(const Query &, ref<Expr> &result);
@@ -89,30 +147,37 @@ public:
 
   SolverRunStatus getOperationStatusCode();
 
-  SolverContext &get_meta_solver() { return (_meta_solver); };
+  SolverContext &get_meta_solver() { return (*_meta_solver); };
 };
 
 template <typename SolverContext>
 MetaSMTSolverImpl<SolverContext>::MetaSMTSolverImpl(
     MetaSMTSolver<SolverContext> *solver, bool useForked, bool optimizeDivides)
-    : _solver(solver), _builder(new MetaSMTBuilder<SolverContext>(
-                           _meta_solver, optimizeDivides)),
-      _timeout(0.0), _useForked(useForked) {
+    : _meta_solver(0), _solver(solver), _builder(0), _timeout(0.0),
+      _useForked(useForked), _optimizeDivides(optimizeDivides),
+      _incremental(MetaSMTIncremental && !useForked) {
   assert(_solver && "unable to create MetaSMTSolver");
-  assert(_builder && "unable to create MetaSMTBuilder");
+  resetContext();
 
-  if (_useForked) {
-    shared_memory_id =
-        shmget(IPC_PRIVATE, shared_memory_size, IPC_CREAT | 0700);
-    assert(shared_memory_id >= 0 && "shmget failed");
-    shared_memory_ptr = (unsigned char *)shmat(shared_memory_id, NULL, 0);
-    assert(shared_memory_ptr != (void *)-1 && "shmat failed");
-    shmctl(shared_memory_id, IPC_RMID, NULL);
-  }
+  if (_useForked)
+    allocateSharedMemory();
+}
+
+template <typename SolverContext>
+MetaSMTSolverImpl<SolverContext>::~MetaSMTSolverImpl() {
+  delete _builder;
+  delete _meta_solver;
 }
 
 template <typename SolverContext>
-MetaSMTSolverImpl<SolverContext>::~MetaSMTSolverImpl() {}
+void MetaSMTSolverImpl<SolverContext>::resetContext() {
+  delete _builder;
+  delete _meta_solver;
+  _meta_solver = new SolverContext();
+  _builder = new MetaSMTBuilder<SolverContext>(*_meta_solver, _optimizeDivides,
+                                               _incremental);
+  assert(_builder && "unable to create MetaSMTBuilder");
+}
 
 template <typename SolverContext>
 char *MetaSMTSolverImpl<SolverContext>::getConstraintLog(const Query &) {
@@ -169,6 +234,12 @@ bool MetaSMTSolverImpl<SolverContext>::computeInitialValues(
 
   _runStatusCode = SOLVER_RUN_STATUS_FAILURE;
 
+  if (!canBitBlast(query)) {
+    klee_warning_once(0, "metaSMT: unsupported floating-point operation or "
+                         "precision in query, failing it");
+    return false;
+  }
+
   TimerStatIncrementer t(stats::queryTime);
   assert(_builder);
 
@@ -202,15 +273,26 @@ SolverImpl::SolverRunStatus MetaSMTSolverImpl<SolverContext>::runAndGetCex(
     const Query &query, const std::vector<const Array *> &objects,
     std::vector<std::vector<unsigned char> > &values, bool &hasSolution) {
 
-  // assume the constraints of the query
+  if (_incremental && _builder->getNumConstructed() > MetaSMTSessionSize)
+    resetContext();
+
+  // assume the constraints of the query, which only hold for this solve, so
+  // that the context can be kept for the next query
   for (ConstraintManager::const_iterator it = query.constraints.begin(),
                                          ie = query.constraints.end();
        it != ie; ++it) {
-    assumption(_meta_solver, _builder->construct(*it));
+    if (_incremental) {
+      if (_builder->isConstructed(*it))
+        ++stats::queryIncrementalPrefixHits;
+      else
+        ++stats::queryIncrementalPrefixMisses;
+    }
+    assumption(*_meta_solver, _builder->construct(*it));
   }
   // assume the negation of the query
-  assumption(_meta_solver, _builder->construct(Expr::createIsZero(query.expr)));
-  hasSolution = solve(_meta_solver);
+  assumption(*_meta_solver,
+             _builder->construct(Expr::createIsZero(query.expr)));
+  hasSolution = solve(*_meta_solver);
 
   if (hasSolution) {
     values.reserve(objects.size());
@@ -228,9 +310,9 @@ SolverImpl::SolverRunStatus MetaSMTSolverImpl<SolverContext>::runAndGetCex(
 
       for (unsigned offset = 0; offset < array->size; offset++) {
         typename SolverContext::result_type elem_exp = evaluate(
-            _meta_solver, metaSMT::logic::Array::select(
+            *_meta_solver, metaSMT::logic::Array::select(
                               array_exp, bvuint(offset, array->getDomain())));
-        unsigned char elem_value = metaSMT::read_value(_meta_solver, elem_exp);
+        unsigned char elem_value = metaSMT::read_value(*_meta_solver, elem_exp);
         data.push_back(elem_value);
       }
 
@@ -253,6 +335,11 @@ MetaSMTSolverImpl<SolverContext>::runAndGetCexForked(
     const Query &query, const std::vector<const Array *> &objects,
     std::vector<std::vector<unsigned char> > &values, bool &hasSolution,
     double timeout) {
+  if (shared_memory_owner != getpid()) {
+    shmdt(shared_memory_ptr);
+    allocateSharedMemory();
+  }
+
   unsigned char *pos = shared_memory_ptr;
   unsigned sum = 0;
   for (std::vector<const Array *>::const_iterator it = objects.begin(),
@@ -284,14 +371,14 @@ MetaSMTSolverImpl<SolverContext>::runAndGetCexForked(
     for (ConstraintManager::const_iterator it = query.constraints.begin(),
                                            ie = query.constraints.end();
          it != ie; ++it) {
-      assertion(_meta_solver, _builder->construct(*it));
+      assertion(*_meta_solver, _builder->construct(*it));
       // assumption(_meta_solver, _builder->construct(*it));
     }
 
     // asssert the negation of the query as we are in a child process
-    assertion(_meta_solver,
+    assertion(*_meta_solver,
               _builder->construct(Expr::createIsZero(query.expr)));
-    unsigned res = solve(_meta_solver);
+    unsigned res = solve(*_meta_solver);
 
     if (res) {
       for (std::vector<const Array *>::const_iterator it = objects.begin(),
@@ -306,10 +393,10 @@ MetaSMTSolverImpl<SolverContext>::runAndGetCexForked(
         for (unsigned offset = 0; offset < array->size; offset++) {
 
           typename SolverContext::result_type elem_exp = evaluate(
-              _meta_solver, metaSMT::logic::Array::select(
+              *_meta_solver, metaSMT::logic::Array::select(
                                 array_exp, bvuint(offset, array->getDomain())));
           unsigned char elem_value =
-              metaSMT::read_value(_meta_solver, elem_exp);
+              metaSMT::read_value(*_meta_solver, elem_exp);
           *pos++ = elem_value;
         }
       }
@@ -0,0 +1,956 @@
+//===-- PersistentCachingSolver.cpp ---------------------------------------===//
+//
+//                     The KLEE Symbolic Virtual Machine
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+//
+// Solver caches shared between processes: one which lives in a file, so
+// that query results survive the process and can be shared between
+// concurrent and subsequent klee runs, and a bounded table in shared memory
+// for the runs on one host at the same time.
+//
+// The file starts with a magic string, followed by an append-only sequence of
+// records. Each record is a header (the 64-bit hash of the key, and the sizes
+// of the key and value), the key, and the value. The key is a canonical
+// structural serialization of the query, so a record is only used when the
+// query matches exactly, not merely its hash.
+//
+// Records are written with a single append under an exclusive lock, and the
+// index is extended under a shared lock, so readers never see partial
+// records. Written records are never modified, so their contents can be read
+// without locking. Only the record headers are read to build the in-memory
+// index, lazily on the first query and incrementally whenever the file has
+// grown; keys and values are read on demand.
+//
+// The table is a file mapped by every process, best kept in memory under
+// /dev/shm, of fixed-size slots in sets of SlotsPerSet. A query goes to the
+// set its hash picks, and is identified there by two independent 64-bit
+// hashes of its key and the key size rather than the key itself. Slots are
+// written without locks: a writer claims a slot by making its sequence
+// number odd, and makes it even again once done; readers take a slot only
+// if its sequence number was the same even number before and after
+// copying it, and its checksum matches, so that a writer which crashed
+// midway leaves nothing used. Once its set is full, an entry is evicted
+// with the clock algorithm: entries are marked when hit, and the first
+// one unmarked from a position picked by the hash goes, the marks passed
+// being cleared.
+//
+//===----------------------------------------------------------------------===//
+
+#include "klee/Solver.h"
+
+#include "klee/Constraints.h"
+#include "klee/Expr.h"
+#include "klee/SolverImpl.h"
+#include "klee/SolverStats.h"
+#include "klee/Internal/Support/ErrorHandling.h"
+#include "klee/util/ExprHashMap.h"
+
+
+#include "llvm/Support/Errno.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <signal.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <map>
+#include <string>
+#include <vector>
+
+using namespace klee;
+
+namespace {
+
+/// Bump the version whenever the key or value encoding changes.
+const char CacheMagic[8] = { 'K', 'L', 'E', 'E', 'P', 'Q', 'C', '1' };
+
+struct RecordHeader {
+  uint64_t hash;
+  uint32_t keySize;
+  uint32_t valueSize;
+};
+
+enum QueryType {
+  ValidityQuery = 1,
+  TruthQuery,
+  ValueQuery,
+  InitialValuesQuery
+};
+
+/// FNV-1a, which is stable across processes and platforms.
+uint64_t hashKey(const std::string &key) {
+  uint64_t h = 14695981039346656037ULL;
+  for (std::string::const_iterator it = key.begin(), ie = key.end(); it != ie;
+       ++it) {
+    h ^= (unsigned char)*it;
+    h *= 1099511628211ULL;
+  }
+  return h;
+}
+
+/// A second hash of keys, independent of hashKey, for the shared table.
+uint64_t hashKey2(const std::string &key) {
+  uint64_t h = 0x9e3779b97f4a7c15ULL;
+  for (std::string::const_iterator it = key.begin(), ie = key.end(); it != ie;
+       ++it) {
+    h = (h ^ (unsigned char)*it) * 0xff51afd7ed558ccdULL;
+    h ^= h >> 32;
+  }
+  return h;
+}
+
+void appendU8(std::string &s, uint8_t v) { s.push_back((char)v); }
+
+void appendU32(std::string &s, uint32_t v) {
+  s.append((const char *)&v, sizeof(v));
+}
+
+void appendU64(std::string &s, uint64_t v) {
+  s.append((const char *)&v, sizeof(v));
+}
+
+void appendAPInt(std::string &s, const llvm::APInt &v) {
+  appendU32(s, v.getBitWidth());
+  appendU32(s, v.getNumWords());
+  const uint64_t *words = v.getRawData();
+  for (unsigned i = 0, e = v.getNumWords(); i != e; ++i)
+    appendU64(s, words[i]);
+}
+
+/// ValueReader - Bounds-checked decoding of a cached value. Any read past the
+/// end marks the reader as failed, and the record is ignored.
+class ValueReader {
+  const std::string &data;
+  size_t pos;
+  bool failed;
+
+  bool read(void *out, size_t n) {
+    if (failed || data.size() - pos < n) {
+      failed = true;
+      return false;
+    }
+    memcpy(out, data.data() + pos, n);
+    pos += n;
+    return true;
+  }
+
+public:
+  ValueReader(const std::string &_data) : data(_data), pos(0), failed(false) {}
+
+  uint8_t readU8() {
+    uint8_t v = 0;
+    read(&v, sizeof(v));
+    return v;
+  }
+
+  uint32_t readU32() {
+    uint32_t v = 0;
+    read(&v, sizeof(v));
+    return v;
+  }
+
+  uint64_t readU64() {
+    uint64_t v = 0;
+    read(&v, sizeof(v));
+    return v;
+  }
+
+  bool readAPInt(llvm::APInt &result) {
+    uint32_t width = readU32(), numWords = readU32();
+    if (failed || width == 0 || numWords != (width + 63) / 64) {
+      failed = true;
+      return false;
+    }
+    std::vector<uint64_t> words(numWords);
+    for (unsigned i = 0; i != numWords; ++i)
+      words[i] = readU64();
+    if (failed)
+      return false;
+    result = llvm::APInt(width, words);
+    return true;
+  }
+
+  bool readBytes(std::vector<unsigned char> &result, size_t n) {
+    result.resize(n);
+    return n == 0 || read(&result[0], n);
+  }
+
+  /// done - Whether the whole value was decoded successfully.
+  bool done() const { return !failed && pos == data.size(); }
+};
+
+/// QueryKeyBuilder - Serialize queries into a canonical byte string. Every
+/// distinct expression, array and update node is emitted once, after the
+/// things it refers to, and later referenced by the number of its first
+/// occurrence. Structurally equal queries therefore get identical keys, no
+/// matter how their expressions are shared in memory; every field which
+/// affects the meaning of an expression, including the bit pattern of
+/// floating-point constants and rounding modes, is part of the key.
+class QueryKeyBuilder {
+  std::string &key;
+  ExprHashMap<uint32_t> exprIds;
+  std::map<const Array *, uint32_t> arrayIds;
+  std::map<const UpdateNode *, uint32_t> nodeIds;
+  uint32_t nextId;
+
+  uint32_t emitArray(const Array *array);
+  uint32_t emitUpdates(const UpdateList &updates);
+
+public:
+  QueryKeyBuilder(std::string &_key, QueryType type) : key(_key), nextId(0) {
+    appendU8(key, type);
+  }
+
+  uint32_t emitExpr(const ref<Expr> &e);
+
+  void addRoot(const ref<Expr> &e) {
+    uint32_t id = emitExpr(e);
+    appendU8(key, 'T');
+    appendU32(key, id);
+  }
+
+  void addQuery(const Query &query) {
+    appendU32(key, query.constraints.size());
+    for (ConstraintManager::const_iterator it = query.constraints.begin(),
+                                           ie = query.constraints.end();
+         it != ie; ++it)
+      addRoot(*it);
+    addRoot(query.expr);
+  }
+
+  void addObjects(const std::vector<const Array *> &objects) {
+    appendU32(key, objects.size());
+    for (std::vector<const Array *>::const_iterator it = objects.begin(),
+                                                    ie = objects.end();
+         it != ie; ++it) {
+      uint32_t id = emitArray(*it);
+      appendU8(key, 'O');
+      appendU32(key, id);
+    }
+  }
+};
+
+uint32_t QueryKeyBuilder::emitArray(const Array *array) {
+  std::map<const Array *, uint32_t>::iterator it = arrayIds.find(array);
+  if (it != arrayIds.end())
+    return it->second;
+
+  appendU8(key, 'A');
+  appendU32(key, array->name.size());
+  key.append(array->name);
+  appendU32(key, array->size);
+  appendU32(key, array->domain);
+  appendU32(key, array->range);
+  appendU32(key, array->constantValues.size());
+  for (std::vector<ref<ConstantExpr> >::const_iterator
+           ci = array->constantValues.begin(),
+           ce = array->constantValues.end();
+       ci != ce; ++ci)
+    appendAPInt(key, (*ci)->getAPValue());
+
+  uint32_t id = nextId++;
+  arrayIds.insert(std::make_pair(array, id));
+  return id;
+}
+
+uint32_t QueryKeyBuilder::emitUpdates(const UpdateList &updates) {
+  uint32_t root = emitArray(updates.root);
+
+  // Emit the nodes not seen before oldest first, so that each one can refer
+  // to its predecessor. Walking the list iteratively keeps long update
+  // chains from exhausting the stack.
+  std::vector<const UpdateNode *> pending;
+  for (const UpdateNode *un = updates.head; un && !nodeIds.count(un);
+       un = un->next)
+    pending.push_back(un);
+
+  for (std::vector<const UpdateNode *>::reverse_iterator
+           it = pending.rbegin(),
+           ie = pending.rend();
+       it != ie; ++it) {
+    const UpdateNode *un = *it;
+    uint32_t index = emitExpr(un->index);
+    uint32_t value = emitExpr(un->value);
+    appendU8(key, 'U');
+    appendU32(key, un->next ? nodeIds[un->next] : ~0U);
+    appendU32(key, index);
+    appendU32(key, value);
+    nodeIds.insert(std::make_pair(un, nextId++));
+  }
+
+  appendU8(key, 'L');
+  appendU32(key, root);
+  appendU32(key, updates.head ? nodeIds[updates.head] : ~0U);
+  return nextId++;
+}
+
+uint32_t QueryKeyBuilder::emitExpr(const ref<Expr> &e) {
+  ExprHashMap<uint32_t>::iterator it = exprIds.find(e);
+  if (it != exprIds.end())
+    return it->second;
+
+  std::vector<uint32_t> kids;
+  uint32_t updates = ~0U;
+  if (const ReadExpr *re = dyn_cast<ReadExpr>(e))
+    updates = emitUpdates(re->updates);
+  for (unsigned i = 0, n = e->getNumKids(); i != n; ++i)
+    kids.push_back(emitExpr(e->getKid(i)));
+
+  appendU8(key, 'E');
+  appendU32(key, e->getKind());
+  appendU32(key, e->getWidth());
+  appendU32(key, kids.size());
+  for (std::vector<uint32_t>::iterator ki = kids.begin(), ke = kids.end();
+       ki != ke; ++ki)
+    appendU32(key, *ki);
+
+  if (const ConstantExpr *ce = dyn_cast<ConstantExpr>(e))
+    appendAPInt(key, ce->getAPValue());
+  else if (const FConstantExpr *fe = dyn_cast<FConstantExpr>(e))
+    appendAPInt(key, fe->getAPValue().bitcastToAPInt());
+  else if (isa<ReadExpr>(e))
+    appendU32(key, updates);
+  else if (const ExtractExpr *ee = dyn_cast<ExtractExpr>(e))
+    appendU32(key, ee->offset);
+  else if (const CastRoundExpr *cre = dyn_cast<CastRoundExpr>(e))
+    appendU8(key, (uint8_t)cre->getRoundingMode());
+  else if (const FCastRoundExpr *fcre = dyn_cast<FCastRoundExpr>(e))
+    appendU8(key, (uint8_t)fcre->getRoundingMode());
+  else if (const FUnaryRoundExpr *fure = dyn_cast<FUnaryRoundExpr>(e))
+    appendU8(key, (uint8_t)fure->getRoundingMode());
+  else if (const FBinaryRoundExpr *fbre = dyn_cast<FBinaryRoundExpr>(e))
+    appendU8(key, (uint8_t)fbre->getRoundingMode());
+
+  uint32_t id = nextId++;
+  exprIds.insert(std::make_pair(e, id));
+  return id;
+}
+
+const llvm::fltSemantics *widthToSemantics(Expr::Width width) {
+  switch (width) {
+  case Expr::Fl32:
+    return &llvm::APFloat::IEEEsingle;
+  case Expr::Fl64:
+    return &llvm::APFloat::IEEEdouble;
+  case Expr::Fl80:
+    return &llvm::APFloat::x87DoubleExtended;
+  default:
+    return 0;
+  }
+}
+
+/// QueryStore - Where query results are kept, by the serialized query.
+class QueryStore {
+public:
+  virtual ~QueryStore() {}
+
+  virtual bool lookup(const std::string &key, std::string &value) = 0;
+  virtual void insert(const std::string &key, const std::string &value) = 0;
+};
+
+/// QueryCacheFile - The on-disk store; see the top of the file for the
+/// format. A file which cannot be opened or has the wrong format disables
+/// the cache for the rest of the run.
+class QueryCacheFile : public QueryStore {
+  std::string path;
+  int fd;
+  bool opened;
+  off_t indexedSize;
+  std::map<uint64_t, std::vector<off_t> > index;
+
+  bool open();
+  void disable(const char *reason);
+  void refreshIndex();
+  bool readAt(off_t offset, void *buf, size_t n);
+
+public:
+  QueryCacheFile(const std::string &_path)
+      : path(_path), fd(-1), opened(false), indexedSize(0) {}
+  ~QueryCacheFile() {
+    if (fd >= 0)
+      ::close(fd);
+  }
+
+  bool lookup(const std::string &key, std::string &value);
+  void insert(const std::string &key, const std::string &value);
+};
+
+void QueryCacheFile::disable(const char *reason) {
+  klee_warning("persistent query cache %s %s (%s), disabling it", path.c_str(),
+               reason, llvm::sys::StrError(errno).c_str());
+  if (fd >= 0)
+    ::close(fd);
+  fd = -1;
+}
+
+bool QueryCacheFile::open() {
+  if (opened)
+    return fd >= 0;
+  opened = true;
+
+  fd = ::open(path.c_str(), O_RDWR | O_CREAT | O_APPEND, 0644);
+  if (fd < 0) {
+    disable("could not be opened");
+    return false;
+  }
+
+  // Write the magic of a fresh file, or check the one already there, under
+  // the exclusive lock so that concurrent runs agree on the header.
+  if (flock(fd, LOCK_EX) < 0) {
+    disable("could not be locked");
+    return false;
+  }
+  struct stat st;
+  bool ok = fstat(fd, &st) == 0;
+  if (ok && st.st_size == 0) {
+    ok = ::write(fd, CacheMagic, sizeof(CacheMagic)) ==
+         (ssize_t)sizeof(CacheMagic);
+  } else if (ok) {
+    char magic[sizeof(CacheMagic)];
+    ok = readAt(0, magic, sizeof(magic)) &&
+         memcmp(magic, CacheMagic, sizeof(magic)) == 0;
+  }
+  flock(fd, LOCK_UN);
+  if (!ok) {
+    disable("is not a query cache of this version");
+    return false;
+  }
+
+  indexedSize = sizeof(CacheMagic);
+  return true;
+}
+
+bool QueryCacheFile::readAt(off_t offset, void *buf, size_t n) {
+  char *p = (char *)buf;
+  while (n) {
+    ssize_t r = ::pread(fd, p, n, offset);
+    if (r < 0 && errno == EINTR)
+      continue;
+    if (r <= 0)
+      return false;
+    p += r;
+    offset += r;
+    n -= r;
+  }
+  return true;
+}
+
+void QueryCacheFile::refreshIndex() {
+  struct stat st;
+  if (fstat(fd, &st) < 0 || st.st_size <= indexedSize)
+    return;
+
+  flock(fd, LOCK_SH);
+  if (fstat(fd, &st) == 0) {
+    off_t offset = indexedSize;
+    RecordHeader header;
+    while (offset + (off_t)sizeof(header) <= st.st_size &&
+           readAt(offset, &header, sizeof(header))) {
+      off_t end = offset + sizeof(header) + header.keySize + header.valueSize;
+      if (end > st.st_size)
+        break;
+      index[header.hash].push_back(offset);
+      offset = end;
+    }
+    indexedSize = offset;
+  }
+  flock(fd, LOCK_UN);
+}
+
+bool QueryCacheFile::lookup(const std::string &key, std::string &value) {
+  if (!open())
+    return false;
+  refreshIndex();
+
+  std::map<uint64_t, std::vector<off_t> >::iterator it =
+      index.find(hashKey(key));
+  if (it == index.end())
+    return false;
+
+  std::string candidate;
+  for (std::vector<off_t>::iterator oi = it->second.begin(),
+                                    oe = it->second.end();
+       oi != oe; ++oi) {
+    RecordHeader header;
+    if (!readAt(*oi, &header, sizeof(header)) ||
+        header.keySize != key.size())
+      continue;
+    candidate.resize(header.keySize);
+    if (!readAt(*oi + sizeof(header), &candidate[0], header.keySize) ||
+        candidate != key)
+      continue;
+    value.resize(header.valueSize);
+    if (header.valueSize &&
+        !readAt(*oi + sizeof(header) + header.keySize, &value[0],
+                header.valueSize))
+      continue;
+    return true;
+  }
+  return false;
+}
+
+void QueryCacheFile::insert(const std::string &key, const std::string &value) {
+  if (!open())
+    return;
+
+  RecordHeader header;
+  header.hash = hashKey(key);
+  header.keySize = key.size();
+  header.valueSize = value.size();
+
+  std::string record((const char *)&header, sizeof(header));
+  record += key;
+  record += value;
+
+  // A single append under the exclusive lock; should it come up short, cut
+  // the partial record off again so the file stays well-formed.
+  if (flock(fd, LOCK_EX) < 0)
+    return;
+  struct stat st;
+  if (fstat(fd, &st) == 0) {
+    ssize_t written = ::write(fd, record.data(), record.size());
+    if (written != (ssize_t)record.size()) {
+      klee_warning_once(0, "failed to write to persistent query cache %s",
+                        path.c_str());
+      if (written > 0 && ftruncate(fd, st.st_size) < 0)
+        klee_warning("persistent query cache %s may be corrupt",
+                     path.c_str());
+    }
+  }
+  flock(fd, LOCK_UN);
+}
+
+const char TableMagic[8] = { 'K', 'L', 'E', 'E', 'S', 'Q', 'T', '1' };
+
+const uint32_t SlotsPerSet = 8;
+const uint32_t SlotSize = 512;
+
+struct TableHeader {
+  char magic[8];
+  uint32_t numSets;
+  uint32_t slotSize;
+};
+
+/// A slot of the shared table, followed by the bytes of its value.
+struct TableSlot {
+  uint64_t seq;
+  uint32_t writer;
+  uint8_t referenced;
+  uint64_t hash1, hash2;
+  uint32_t keySize, valueSize;
+  uint64_t checksum;
+};
+
+const uint32_t SlotValueCapacity = SlotSize - sizeof(TableSlot);
+
+/// SharedQueryTable - The store in shared memory; see the top of the file.
+/// A table which cannot be mapped or has the wrong format disables the
+/// cache for the rest of the run.
+class SharedQueryTable : public QueryStore {
+  std::string path;
+  uint64_t requestedSize;
+  bool opened;
+  char *table;
+  size_t tableSize;
+
+  bool open();
+  TableHeader &header() { return *reinterpret_cast<TableHeader *>(table); }
+  TableSlot &slot(uint64_t set, uint32_t i) {
+    return *reinterpret_cast<TableSlot *>(
+        table + sizeof(TableHeader) +
+        (set * SlotsPerSet + i) * (uint64_t)SlotSize);
+  }
+  unsigned char *slotValue(TableSlot &s) {
+    return reinterpret_cast<unsigned char *>(&s + 1);
+  }
+  static uint64_t checksum(const TableSlot &s, const unsigned char *value);
+
+public:
+  SharedQueryTable(const std::string &_path, uint64_t size)
+      : path(_path), requestedSize(size), opened(false), table(0),
+        tableSize(0) {}
+  ~SharedQueryTable() {
+    if (table)
+      munmap(table, tableSize);
+  }
+
+  bool lookup(const std::string &key, std::string &value);
+  void insert(const std::string &key, const std::string &value);
+};
+
+bool SharedQueryTable::open() {
+  if (opened)
+    return table != 0;
+  opened = true;
+
+  int fd = ::open(path.c_str(), O_RDWR | O_CREAT, 0644);
+  if (fd < 0) {
+    klee_warning("shared query cache %s could not be opened (%s), disabling "
+                 "it",
+                 path.c_str(), llvm::sys::StrError(errno).c_str());
+    return false;
+  }
+
+  // The first process sizes the table, under the lock so that the others
+  // find it complete.
+  const char *problem = 0;
+  TableHeader h;
+  struct stat st;
+  if (flock(fd, LOCK_EX) < 0 || fstat(fd, &st) < 0) {
+    problem = "could not be locked";
+  } else if (st.st_size == 0) {
+    memcpy(h.magic, TableMagic, sizeof(h.magic));
+    h.numSets = std::max<uint64_t>(
+        1, requestedSize / ((uint64_t)SlotsPerSet * SlotSize));
+    h.slotSize = SlotSize;
+    if (ftruncate(fd, sizeof(h) +
+                          (uint64_t)h.numSets * SlotsPerSet * SlotSize) < 0 ||
+        ::pwrite(fd, &h, sizeof(h), 0) != (ssize_t)sizeof(h))
+      problem = "could not be created";
+  } else if (::pread(fd, &h, sizeof(h), 0) != (ssize_t)sizeof(h) ||
+             memcmp(h.magic, TableMagic, sizeof(h.magic)) != 0 ||
+             h.slotSize != SlotSize ||
+             (uint64_t)st.st_size !=
+                 sizeof(h) + (uint64_t)h.numSets * SlotsPerSet * SlotSize) {
+    problem = "is not a shared query cache of this version";
+  }
+  flock(fd, LOCK_UN);
+
+  if (!problem) {
+    tableSize = sizeof(h) + (uint64_t)h.numSets * SlotsPerSet * SlotSize;
+    void *p =
+        mmap(0, tableSize, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (p == MAP_FAILED)
+      problem = "could not be mapped";
+    else
+      table = static_cast<char *>(p);
+  }
+  ::close(fd);
+  if (problem) {
+    klee_warning("shared query cache %s %s (%s), disabling it", path.c_str(),
+                 problem, llvm::sys::StrError(errno).c_str());
+    return false;
+  }
+  return true;
+}
+
+uint64_t SharedQueryTable::checksum(const TableSlot &s,
+                                    const unsigned char *value) {
+  std::string data;
+  appendU64(data, s.hash1);
+  appendU64(data, s.hash2);
+  appendU32(data, s.keySize);
+  appendU32(data, s.valueSize);
+  data.append((const char *)value, s.valueSize);
+  return hashKey(data);
+}
+
+bool SharedQueryTable::lookup(const std::string &key, std::string &value) {
+  if (!open())
+    return false;
+
+  uint64_t h1 = hashKey(key), h2 = hashKey2(key);
+  uint64_t set = h1 % header().numSets;
+  for (uint32_t i = 0; i != SlotsPerSet; ++i) {
+    TableSlot &s = slot(set, i);
+    uint64_t seq = __atomic_load_n(&s.seq, __ATOMIC_ACQUIRE);
+    if (seq == 0 || (seq & 1))
+      continue;
+
+    // A copy, which is only good if no writer came in meanwhile.
+    TableSlot copy;
+    memcpy(&copy, &s, sizeof(copy));
+    if (copy.hash1 != h1 || copy.hash2 != h2 || copy.keySize != key.size() ||
+        copy.valueSize > SlotValueCapacity)
+      continue;
+    unsigned char bytes[SlotValueCapacity];
+    memcpy(bytes, slotValue(s), copy.valueSize);
+    __atomic_thread_fence(__ATOMIC_ACQUIRE);
+    if (__atomic_load_n(&s.seq, __ATOMIC_RELAXED) != seq ||
+        checksum(copy, bytes) != copy.checksum)
+      continue;
+
+    __atomic_store_n(&s.referenced, 1, __ATOMIC_RELAXED);
+    value.assign((const char *)bytes, copy.valueSize);
+    return true;
+  }
+  return false;
+}
+
+void SharedQueryTable::insert(const std::string &key,
+                              const std::string &value) {
+  if (value.size() > SlotValueCapacity || !open())
+    return;
+
+  uint64_t h1 = hashKey(key), h2 = hashKey2(key);
+  uint64_t set = h1 % header().numSets;
+
+  // An empty slot, or else the clock victim. A slot a writer left odd is
+  // only taken over once that writer is gone.
+  int victim = -1;
+  for (uint32_t i = 0; i != SlotsPerSet && victim < 0; ++i)
+    if (__atomic_load_n(&slot(set, i).seq, __ATOMIC_ACQUIRE) == 0)
+      victim = i;
+  uint32_t start = h2 % SlotsPerSet;
+  for (uint32_t step = 0; step != 2 * SlotsPerSet && victim < 0; ++step) {
+    uint32_t i = (start + step) % SlotsPerSet;
+    TableSlot &s = slot(set, i);
+    uint64_t seq = __atomic_load_n(&s.seq, __ATOMIC_ACQUIRE);
+    if ((seq & 1) && !(kill(s.writer, 0) < 0 && errno == ESRCH))
+      continue;
+    if (__atomic_exchange_n(&s.referenced, 0, __ATOMIC_RELAXED) == 0)
+      victim = i;
+  }
+  if (victim < 0)
+    return;
+
+  TableSlot &s = slot(set, victim);
+  uint64_t seq = __atomic_load_n(&s.seq, __ATOMIC_ACQUIRE);
+  uint64_t claimed = (seq & 1) ? seq + 2 : seq + 1;
+  if (!__atomic_compare_exchange_n(&s.seq, &seq, claimed, false,
+                                   __ATOMIC_ACQ_REL, __ATOMIC_RELAXED))
+    return; // another writer got it
+  s.writer = getpid();
+  s.hash1 = h1;
+  s.hash2 = h2;
+  s.keySize = key.size();
+  s.valueSize = value.size();
+  memcpy(slotValue(s), value.data(), value.size());
+  s.checksum = checksum(s, slotValue(s));
+  s.referenced = 0;
+  __atomic_store_n(&s.seq, claimed + 1, __ATOMIC_RELEASE);
+}
+
+} // end anonymous namespace
+
+class PersistentCachingSolver : public SolverImpl {
+private:
+  Solver *solver;
+  QueryStore *cache;
+  Statistic &hits, &misses;
+
+  bool lookup(const std::string &key, std::string &value) {
+    if (cache->lookup(key, value)) {
+      ++hits;
+      return true;
+    }
+    ++misses;
+    return false;
+  }
+
+public:
+  PersistentCachingSolver(Solver *s, QueryStore *_cache, Statistic &_hits,
+                          Statistic &_misses)
+      : solver(s), cache(_cache), hits(_hits), misses(_misses) {}
+  ~PersistentCachingSolver() {
+    delete cache;
+    delete solver;
+  }
+
+  bool computeValidity(const Query &, Solver::Validity &result);
+  bool computeTruth(const Query &, bool &isValid);
+  bool computeValue(const Query &, ref<Expr> &result);
+  bool computeRange(const Query &query, ref<Expr> &min, ref<Expr> &max) {
+    return solver->impl->computeRange(query, min, max);
+  }
+  bool computeUniqueValue(const Query &query, ref<Expr> &result,
+                          bool &isUnique) {
+    return solver->impl->computeUniqueValue(query, result, isUnique);
+  }
+  bool computeInitialValues(const Query &,
+                            const std::vector<const Array *> &objects,
+                            std::vector<std::vector<unsigned char> > &values,
+                            bool &hasSolution);
+  SolverRunStatus getOperationStatusCode();
+  char *getConstraintLog(const Query &);
+  void setCoreSolverTimeout(double timeout);
+  size_t trimCaches(size_t bytes);
+  void releaseArrays(const std::vector<const Array *> &arrays);
+  void interrupt();
+};
+
+bool PersistentCachingSolver::computeValidity(const Query &query,
+                                              Solver::Validity &result) {
+  std::string key, value;
+  QueryKeyBuilder(key, ValidityQuery).addQuery(query);
+
+  if (lookup(key, value)) {
+    ValueReader reader(value);
+    int8_t v = (int8_t)reader.readU8();
+    if (reader.done() && -1 <= v && v <= 1) {
+      result = (Solver::Validity)v;
+      return true;
+    }
+  }
+
+  if (!solver->impl->computeValidity(query, result))
+    return false;
+
+  value.clear();
+  appendU8(value, (uint8_t)(int8_t)result);
+  cache->insert(key, value);
+  return true;
+}
+
+bool PersistentCachingSolver::computeTruth(const Query &query,
+                                           bool &isValid) {
+  std::string key, value;
+  QueryKeyBuilder(key, TruthQuery).addQuery(query);
+
+  if (lookup(key, value)) {
+    ValueReader reader(value);
+    uint8_t v = reader.readU8();
+    if (reader.done() && v <= 1) {
+      isValid = v;
+      return true;
+    }
+  }
+
+  if (!solver->impl->computeTruth(query, isValid))
+    return false;
+
+  value.clear();
+  appendU8(value, isValid);
+  cache->insert(key, value);
+  return true;
+}
+
+bool PersistentCachingSolver::computeValue(const Query &query,
+                                           ref<Expr> &result) {
+  std::string key, value;
+  QueryKeyBuilder(key, ValueQuery).addQuery(query);
+
+  if (lookup(key, value)) {
+    ValueReader reader(value);
+    uint8_t isFloat = reader.readU8();
+    llvm::APInt bits;
+    if (reader.readAPInt(bits) && reader.done()) {
+      if (!isFloat) {
+        result = ConstantExpr::alloc(bits);
+        return true;
+      }
+      if (const llvm::fltSemantics *sem = widthToSemantics(bits.getBitWidth())) {
+        result = FConstantExpr::alloc(llvm::APFloat(*sem, bits));
+        return true;
+      }
+    }
+  }
+
+  if (!solver->impl->computeValue(query, result))
+    return false;
+
+  // Values are always constants, but only cache what can be restored
+  // bit-exactly.
+  value.clear();
+  if (const ConstantExpr *ce = dyn_cast<ConstantExpr>(result)) {
+    appendU8(value, 0);
+    appendAPInt(value, ce->getAPValue());
+  } else if (const FConstantExpr *fe = dyn_cast<FConstantExpr>(result)) {
+    if (!widthToSemantics(fe->getWidth()))
+      return true;
+    appendU8(value, 1);
+    appendAPInt(value, fe->getAPValue().bitcastToAPInt());
+  } else {
+    return true;
+  }
+  cache->insert(key, value);
+  return true;
+}
+
+bool PersistentCachingSolver::computeInitialValues(
+    const Query &query, const std::vector<const Array *> &objects,
+    std::vector<std::vector<unsigned char> > &values, bool &hasSolution) {
+  std::string key, value;
+  QueryKeyBuilder builder(key, InitialValuesQuery);
+  builder.addQuery(query);
+  builder.addObjects(objects);
+
+  if (lookup(key, value)) {
+    ValueReader reader(value);
+    uint8_t solvable = reader.readU8();
+    std::vector<std::vector<unsigned char> > cached;
+    if (solvable) {
+      cached.resize(objects.size());
+      for (unsigned i = 0, e = objects.size(); i != e; ++i) {
+        uint32_t size = reader.readU32();
+        if (size != objects[i]->size || !reader.readBytes(cached[i], size))
+          break;
+      }
+    }
+    if (reader.done() && solvable <= 1) {
+      hasSolution = solvable;
+      values.swap(cached);
+      return true;
+    }
+  }
+
+  if (!solver->impl->computeInitialValues(query, objects, values,
+                                          hasSolution))
+    return false;
+
+  value.clear();
+  appendU8(value, hasSolution);
+  if (hasSolution) {
+    for (std::vector<std::vector<unsigned char> >::const_iterator
+             it = values.begin(),
+             ie = values.end();
+         it != ie; ++it) {
+      appendU32(value, it->size());
+      value.append(it->begin(), it->end());
+    }
+  }
+  cache->insert(key, value);
+  return true;
+}
+
+SolverImpl::SolverRunStatus
+PersistentCachingSolver::getOperationStatusCode() {
+  return solver->impl->getOperationStatusCode();
+}
+
+char *PersistentCachingSolver::getConstraintLog(const Query &query) {
+  return solver->impl->getConstraintLog(query);
+}
+
+void PersistentCachingSolver::setCoreSolverTimeout(double timeout) {
+  solver->impl->setCoreSolverTimeout(timeout);
+}
+
+size_t PersistentCachingSolver::trimCaches(size_t bytes) {
+  return solver->impl->trimCaches(bytes);
+}
+
+void PersistentCachingSolver::releaseArrays(const std::vector<const Array *> &arrays) {
+  solver->impl->releaseArrays(arrays);
+}
+
+void PersistentCachingSolver::interrupt() {
+  solver->impl->interrupt();
+}
+
+///
+
+Solver *klee::createPersistentCachingSolver(Solver *s,
+                                            const std::string &path) {
+  return new Solver(new PersistentCachingSolver(
+      s, new QueryCacheFile(path), stats::queryPersistentCacheHits,
+      stats::queryPersistentCacheMisses));
+}
+
+Solver *klee::createSharedMemoryCachingSolver(Solver *s,
+                                              const std::string &path,
+                                              uint64_t size) {
+  return new Solver(new PersistentCachingSolver(
+      s, new SharedQueryTable(path, size), stats::querySharedCacheHits,
+      stats::querySharedCacheMisses));
+}
@@ -0,0 +1,475 @@
+//===-- PortfolioSolver.cpp -----------------------------------------------===//
+//
+//                     The KLEE Symbolic Virtual Machine
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+
+#include "klee/Solver.h"
+#include "klee/SolverImpl.h"
+#include "klee/SolverStats.h"
+#include "klee/TimerStatIncrementer.h"
+#include "klee/Constraints.h"
+#include "klee/Internal/Support/ErrorHandling.h"
+#include "klee/util/Assignment.h"
+#include "klee/util/ExprUtil.h"
+
+#include "llvm/Support/CommandLine.h"
+#include "llvm/Support/Errno.h"
+#include "llvm/Support/ErrorHandling.h"
+
+#include <algorithm>
+#include <errno.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <signal.h>
+#include <sys/wait.h>
+#include <sys/ipc.h>
+#include <sys/shm.h>
+
+using namespace klee;
+
+namespace {
+llvm::cl::opt<bool> DebugPortfolioSolver(
+    "debug-portfolio-solver", llvm::cl::init(false),
+    llvm::cl::desc("Report which portfolio configuration answered each "
+                   "query (default=off)"));
+}
+
+// See STPSolver.cpp for why Darwin gets a smaller region.
+#ifdef __APPLE__
+static const unsigned shared_memory_size = 1 << 16;
+#else
+static const unsigned shared_memory_size = 1 << 20;
+#endif
+
+// Exit codes of the processes running a configuration.
+enum {
+  PORTFOLIO_EXIT_SOLVABLE = 0,
+  PORTFOLIO_EXIT_UNSOLVABLE = 1,
+  PORTFOLIO_EXIT_FAILURE = 2,
+  PORTFOLIO_EXIT_TIMEOUT = 52
+};
+
+// Every process running a configuration writes its index to this pipe just
+// before exiting, so that the portfolio only ever waits for its own children.
+static int portfolio_pipe = -1;
+static unsigned char portfolio_index;
+
+static void portfolioTimeoutHandler(int x) {
+  ssize_t res = ::write(portfolio_pipe, &portfolio_index, 1);
+  (void)res;
+  _exit(PORTFOLIO_EXIT_TIMEOUT);
+}
+
+namespace klee {
+
+/// PortfolioSolverImpl - Race several core solvers on every query. Each
+/// configuration runs in its own forked process and writes its
+/// counterexample to a private shared memory region; the first process to
+/// return an answer wins and the others are killed.
+///
+/// Since the configurations only ever run in children, any state they keep
+/// between queries (e.g. incremental Z3 sessions) is lost after each query.
+class PortfolioSolverImpl : public SolverImpl {
+private:
+  struct Configuration {
+    Solver *solver;
+    std::string name;
+    unsigned char *sharedMemory;
+    uint64_t wins;
+  };
+
+  std::vector<Configuration> configurations;
+  double timeout;
+  SolverRunStatus runStatusCode;
+
+  /// The process which allocated the shared memory regions.
+  pid_t sharedMemoryOwner;
+
+  /// The process running each configuration during a query, or -1.
+  /// interrupt() kills them from another thread; the lock keeps it from
+  /// signalling a process which has been reaped.
+  std::vector<pid_t> children;
+  pthread_mutex_t childrenLock;
+  volatile sig_atomic_t interrupted;
+
+  void allocateSharedMemory();
+  int runConfiguration(const Configuration &config, const Query &query,
+                       const std::vector<const Array *> &objects);
+
+public:
+  PortfolioSolverImpl(const std::vector<Solver *> &solvers,
+                      const std::vector<std::string> &names);
+  ~PortfolioSolverImpl();
+
+  char *getConstraintLog(const Query &);
+  void setCoreSolverTimeout(double _timeout);
+  size_t trimCaches(size_t bytes);
+  void releaseArrays(const std::vector<const Array *> &arrays);
+  void interrupt();
+
+  bool computeTruth(const Query &, bool &isValid);
+  bool computeValue(const Query &, ref<Expr> &result);
+  bool computeInitialValues(const Query &,
+                            const std::vector<const Array *> &objects,
+                            std::vector<std::vector<unsigned char> > &values,
+                            bool &hasSolution);
+  SolverRunStatus getOperationStatusCode();
+};
+
+PortfolioSolverImpl::PortfolioSolverImpl(const std::vector<Solver *> &solvers,
+                                         const std::vector<std::string> &names)
+    : timeout(0.0), runStatusCode(SOLVER_RUN_STATUS_FAILURE),
+      children(solvers.size(), -1), interrupted(0) {
+  assert(!solvers.empty() && "portfolio needs at least one solver");
+  assert(solvers.size() < 256 && "too many portfolio configurations");
+  assert(solvers.size() == names.size() && "every solver needs a name");
+
+  for (unsigned i = 0, e = solvers.size(); i != e; ++i) {
+    Configuration config;
+    config.solver = solvers[i];
+    config.name = names[i];
+    config.sharedMemory = 0;
+    config.wins = 0;
+    configurations.push_back(config);
+  }
+  pthread_mutex_init(&childrenLock, NULL);
+  allocateSharedMemory();
+}
+
+/// allocateSharedMemory - Give every configuration a region to write its
+/// counterexample to. The regions are inherited across fork(), so processes
+/// forked from klee itself (parallel workers) allocate their own before
+/// querying, or concurrent queries would clobber each other's results.
+void PortfolioSolverImpl::allocateSharedMemory() {
+  for (std::vector<Configuration>::iterator it = configurations.begin(),
+                                            ie = configurations.end();
+       it != ie; ++it) {
+    if (it->sharedMemory)
+      shmdt(it->sharedMemory);
+    int id = shmget(IPC_PRIVATE, shared_memory_size, IPC_CREAT | 0700);
+    if (id < 0)
+      llvm::report_fatal_error("unable to allocate shared memory region");
+    unsigned char *ptr = (unsigned char *)shmat(id, NULL, 0);
+    if (ptr == (void *)-1)
+      llvm::report_fatal_error("unable to attach shared memory region");
+    shmctl(id, IPC_RMID, NULL);
+    it->sharedMemory = ptr;
+  }
+  sharedMemoryOwner = getpid();
+}
+
+PortfolioSolverImpl::~PortfolioSolverImpl() {
+  for (std::vector<Configuration>::iterator it = configurations.begin(),
+                                            ie = configurations.end();
+       it != ie; ++it) {
+    if (it->wins)
+      klee_message("Portfolio solver: %s answered %llu queries",
+                   it->name.c_str(), (unsigned long long)it->wins);
+    shmdt(it->sharedMemory);
+    delete it->solver;
+  }
+  pthread_mutex_destroy(&childrenLock);
+}
+
+char *PortfolioSolverImpl::getConstraintLog(const Query &query) {
+  return configurations.front().solver->getConstraintLog(query);
+}
+
+void PortfolioSolverImpl::setCoreSolverTimeout(double _timeout) {
+  timeout = _timeout;
+  for (std::vector<Configuration>::iterator it = configurations.begin(),
+                                            ie = configurations.end();
+       it != ie; ++it)
+    it->solver->setCoreSolverTimeout(_timeout);
+}
+
+size_t PortfolioSolverImpl::trimCaches(size_t bytes) {
+  size_t freed = 0;
+  for (std::vector<Configuration>::iterator it = configurations.begin(),
+                                            ie = configurations.end();
+       it != ie && freed < bytes; ++it)
+    freed += it->solver->trimCaches(bytes - freed);
+  return freed;
+}
+
+void PortfolioSolverImpl::releaseArrays(
+    const std::vector<const Array *> &arrays) {
+  for (std::vector<Configuration>::iterator it = configurations.begin(),
+                                            ie = configurations.end();
+       it != ie; ++it)
+    it->solver->releaseArrays(arrays);
+}
+
+// The configurations only run in children, so killing them is enough; the
+// query then finds the pipe at end of file.
+void PortfolioSolverImpl::interrupt() {
+  pthread_mutex_lock(&childrenLock);
+  interrupted = 1;
+  for (unsigned i = 0; i != children.size(); ++i)
+    if (children[i] != -1)
+      kill(children[i], SIGKILL);
+  pthread_mutex_unlock(&childrenLock);
+}
+
+/// reapChild - Wait for the process running configuration \a i, once
+/// interrupt() can no longer signal it.
+static pid_t reapChild(std::vector<pid_t> &children, pthread_mutex_t &lock,
+                       unsigned i, int &status) {
+  pthread_mutex_lock(&lock);
+  pid_t pid = children[i];
+  children[i] = -1;
+  pthread_mutex_unlock(&lock);
+  pid_t res;
+  do {
+    res = waitpid(pid, &status, 0);
+  } while (res < 0 && errno == EINTR);
+  return res;
+}
+
+bool PortfolioSolverImpl::computeTruth(const Query &query, bool &isValid) {
+  std::vector<const Array *> objects;
+  std::vector<std::vector<unsigned char> > values;
+  bool hasSolution;
+
+  if (!computeInitialValues(query, objects, values, hasSolution))
+    return false;
+
+  isValid = !hasSolution;
+  return true;
+}
+
+bool PortfolioSolverImpl::computeValue(const Query &query,
+                                       ref<Expr> &result) {
+  std::vector<const Array *> objects;
+  std::vector<std::vector<unsigned char> > values;
+  bool hasSolution;
+
+  // Find the object used in the expression, and compute an assignment
+  // for them.
+  findSymbolicObjects(query.expr, objects);
+  if (!computeInitialValues(query.withFalse(), objects, values, hasSolution))
+    return false;
+  assert(hasSolution && "state has invalid constraint set");
+
+  // Evaluate the expression with the computed assignment.
+  Assignment a(objects, values);
+  result = a.evaluate(query.expr);
+
+  return true;
+}
+
+/// runConfiguration - Body of the child process racing \a config; returns
+/// the code the child should exit with.
+int PortfolioSolverImpl::runConfiguration(
+    const Configuration &config, const Query &query,
+    const std::vector<const Array *> &objects) {
+  if (timeout) {
+    ::alarm(0); /* Turn off alarm so we can safely set signal handler */
+    ::signal(SIGALRM, portfolioTimeoutHandler);
+    ::alarm(std::max(1, (int)timeout));
+  }
+
+  std::vector<std::vector<unsigned char> > values;
+  bool hasSolution;
+  if (!config.solver->impl->computeInitialValues(query, objects, values,
+                                                 hasSolution)) {
+    if (config.solver->impl->getOperationStatusCode() ==
+        SOLVER_RUN_STATUS_TIMEOUT)
+      return PORTFOLIO_EXIT_TIMEOUT;
+    return PORTFOLIO_EXIT_FAILURE;
+  }
+
+  if (!hasSolution)
+    return PORTFOLIO_EXIT_UNSOLVABLE;
+
+  unsigned char *pos = config.sharedMemory;
+  for (std::vector<std::vector<unsigned char> >::const_iterator
+           it = values.begin(),
+           ie = values.end();
+       it != ie; ++it)
+    pos = std::copy(it->begin(), it->end(), pos);
+  return PORTFOLIO_EXIT_SOLVABLE;
+}
+
+bool PortfolioSolverImpl::computeInitialValues(
+    const Query &query, const std::vector<const Array *> &objects,
+    std::vector<std::vector<unsigned char> > &values, bool &hasSolution) {
+  runStatusCode = SOLVER_RUN_STATUS_FAILURE;
+  interrupted = 0;
+
+  TimerStatIncrementer t(stats::queryTime);
+  ++stats::queries;
+  ++stats::queryCounterexamples;
+
+  unsigned sum = 0;
+  for (std::vector<const Array *>::const_iterator it = objects.begin(),
+                                                  ie = objects.end();
+       it != ie; ++it)
+    sum += (*it)->size;
+  if (sum >= shared_memory_size)
+    llvm::report_fatal_error("not enough shared memory for counterexample");
+
+  if (sharedMemoryOwner != getpid())
+    allocateSharedMemory();
+
+  int fds[2];
+  if (pipe(fds) < 0) {
+    klee_warning("pipe failed (for portfolio solver) - %s",
+                 llvm::sys::StrError(errno).c_str());
+    return false;
+  }
+
+  unsigned n = configurations.size();
+  unsigned running = 0;
+
+  fflush(stdout);
+  fflush(stderr);
+  for (unsigned i = 0; i != n; ++i) {
+    pid_t pid = fork();
+    if (pid == -1) {
+      klee_warning("fork failed (for portfolio solver %s) - %s",
+                   configurations[i].name.c_str(),
+                   llvm::sys::StrError(errno).c_str());
+      continue;
+    }
+    if (pid == 0) {
+      ::close(fds[0]);
+      portfolio_pipe = fds[1];
+      portfolio_index = i;
+      int code = runConfiguration(configurations[i], query, objects);
+      ssize_t res = ::write(portfolio_pipe, &portfolio_index, 1);
+      (void)res;
+      _exit(code);
+    }
+    pthread_mutex_lock(&childrenLock);
+    children[i] = pid;
+    pthread_mutex_unlock(&childrenLock);
+    ++running;
+  }
+  ::close(fds[1]);
+  if (interrupted)
+    interrupt();
+
+  if (!running) {
+    ::close(fds[0]);
+    runStatusCode = SOLVER_RUN_STATUS_FORK_FAILED;
+    return false;
+  }
+
+  // Wait for the first configuration to answer. The pipe reaches end of file
+  // once every child has exited, including any that crashed without writing
+  // to it.
+  int winner = -1;
+  bool timedOut = false;
+  while (running && winner < 0) {
+    unsigned char index;
+    ssize_t r = ::read(fds[0], &index, 1);
+    if (r < 0 && errno == EINTR)
+      continue;
+    if (r <= 0 || index >= n || children[index] == -1)
+      break;
+
+    unsigned i = index;
+    int status;
+    pid_t res = reapChild(children, childrenLock, i, status);
+    --running;
+
+    if (res < 0) {
+      klee_warning("waitpid() for portfolio solver failed");
+      runStatusCode = SOLVER_RUN_STATUS_WAITPID_FAILED;
+      break;
+    }
+
+    // From timed_run.py: It appears that linux at least will on
+    // "occasion" return a status when the process was terminated by a
+    // signal, so test signal first.
+    if (WIFSIGNALED(status) || !WIFEXITED(status)) {
+      if (!interrupted)
+        klee_warning("portfolio solver %s did not return successfully",
+                     configurations[i].name.c_str());
+      continue;
+    }
+
+    switch (WEXITSTATUS(status)) {
+    case PORTFOLIO_EXIT_SOLVABLE:
+      hasSolution = true;
+      winner = i;
+      break;
+    case PORTFOLIO_EXIT_UNSOLVABLE:
+      hasSolution = false;
+      winner = i;
+      break;
+    case PORTFOLIO_EXIT_TIMEOUT:
+      timedOut = true;
+      break;
+    default:
+      break;
+    }
+  }
+
+  ::close(fds[0]);
+
+  // Cancel the configurations that lost the race.
+  for (unsigned i = 0; i != n; ++i) {
+    if (children[i] == -1)
+      continue;
+    kill(children[i], SIGKILL);
+    int status;
+    reapChild(children, childrenLock, i, status);
+  }
+
+  if (winner < 0) {
+    if (runStatusCode != SOLVER_RUN_STATUS_WAITPID_FAILED) {
+      if (interrupted) {
+        runStatusCode = SOLVER_RUN_STATUS_INTERRUPTED;
+      } else if (timedOut) {
+        klee_warning("portfolio solver timed out");
+        runStatusCode = SOLVER_RUN_STATUS_TIMEOUT;
+      } else {
+        runStatusCode = SOLVER_RUN_STATUS_FAILURE;
+      }
+    }
+    return false;
+  }
+
+  Configuration &config = configurations[winner];
+  ++config.wins;
+  if (DebugPortfolioSolver)
+    klee_message("Portfolio solver: %s answered first (%s)",
+                 config.name.c_str(), hasSolution ? "sat" : "unsat");
+
+  if (hasSolution) {
+    values = std::vector<std::vector<unsigned char> >(objects.size());
+    unsigned char *pos = config.sharedMemory;
+    unsigned i = 0;
+    for (std::vector<const Array *>::const_iterator it = objects.begin(),
+                                                    ie = objects.end();
+         it != ie; ++it) {
+      const Array *array = *it;
+      std::vector<unsigned char> &data = values[i++];
+      data.insert(data.begin(), pos, pos + array->size);
+      pos += array->size;
+    }
+    ++stats::queriesInvalid;
+    runStatusCode = SOLVER_RUN_STATUS_SUCCESS_SOLVABLE;
+  } else {
+    ++stats::queriesValid;
+    runStatusCode = SOLVER_RUN_STATUS_SUCCESS_UNSOLVABLE;
+  }
+
+  return true;
+}
+
+SolverImpl::SolverRunStatus PortfolioSolverImpl::getOperationStatusCode() {
+  return runStatusCode;
+}
+
+Solver *createPortfolioSolver(const std::vector<Solver *> &solvers,
+                              const std::vector<std::string> &names) {
+  return new Solver(new PortfolioSolverImpl(solvers, names));
+}
+}
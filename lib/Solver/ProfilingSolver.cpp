@@ -0,0 +1,230 @@
+//===-- ProfilingSolver.cpp -----------------------------------------------===//
+//
+//                     The KLEE Symbolic Virtual Machine
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+//
+// A solver which counts and times the queries asked of the solver it wraps.
+// Profiling solvers are stacked between the layers of the solver chain; each
+// one charges a query to its own layer only for the time not spent in the
+// profiling solver below it, which is also how it tells that its layer passed
+// the query on.
+//
+//===----------------------------------------------------------------------===//
+
+#include "klee/Solver.h"
+
+#include "klee/SolverImpl.h"
+#include "klee/SolverProfile.h"
+#include "klee/Internal/Support/Timer.h"
+
+#include <algorithm>
+#include <vector>
+
+using namespace klee;
+
+namespace {
+
+std::vector<SolverLayerProfile *> profiles;
+
+class ProfilingSolver : public SolverImpl {
+private:
+  Solver *solver;
+  SolverLayerProfile *profile;
+
+  /// A query being answered by a profiled layer. Queries are asked of one
+  /// solver chain at a time, so the calls in progress form a stack.
+  class Call {
+    static Call *active;
+
+    SolverLayerProfile::Counts &counts;
+    Call *parent;
+    WallTimer timer;
+    /// The time spent in the layers below, in microseconds.
+    uint64_t childTime;
+    bool passed;
+
+  public:
+    Call(SolverLayerProfile::Counts &_counts)
+        : counts(_counts), parent(active), childTime(0), passed(false) {
+      active = this;
+    }
+
+    ~Call() {
+      uint64_t delta = timer.check();
+      active = parent;
+      if (parent) {
+        parent->childTime += delta;
+        parent->passed = true;
+      }
+      ++counts.calls;
+      if (passed)
+        ++counts.passed;
+      counts.selfTime += (delta - std::min(delta, childTime)) / 1000000.;
+    }
+
+    void answer(bool success, SolverLayerProfile::Answer answer) {
+      ++counts.answers[success ? answer : SolverLayerProfile::Failed];
+    }
+  };
+
+  SolverLayerProfile::Counts &getCounts(SolverLayerProfile::QueryKind kind) {
+    return profile->counts[kind];
+  }
+
+public:
+  ProfilingSolver(Solver *_solver, SolverLayerProfile *_profile)
+      : solver(_solver), profile(_profile) {}
+  ~ProfilingSolver() { delete solver; }
+
+  bool computeValidity(const Query&, Solver::Validity &result);
+  bool computeTruth(const Query&, bool &isValid);
+  bool computeTruthMany(const ConstraintManager &constraints,
+                        const std::vector< ref<Expr> > &exprs,
+                        std::vector<bool> &isValid);
+  bool computeValue(const Query&, ref<Expr> &result);
+  bool computeRange(const Query&, ref<Expr> &min, ref<Expr> &max);
+  bool computeUniqueValue(const Query&, ref<Expr> &result, bool &isUnique);
+  bool computeInitialValues(const Query& query,
+                            const std::vector<const Array*> &objects,
+                            std::vector< std::vector<unsigned char> > &values,
+                            bool &hasSolution);
+  SolverRunStatus getOperationStatusCode();
+  char *getConstraintLog(const Query&);
+  void setCoreSolverTimeout(double timeout);
+  size_t trimCaches(size_t bytes);
+  void releaseArrays(const std::vector<const Array *> &arrays);
+  void interrupt();
+};
+
+ProfilingSolver::Call *ProfilingSolver::Call::active = 0;
+
+}
+
+bool ProfilingSolver::computeValidity(const Query& query,
+                                      Solver::Validity &result) {
+  Call call(getCounts(SolverLayerProfile::Validity));
+  bool success = solver->impl->computeValidity(query, result);
+  call.answer(success, result == Solver::True ? SolverLayerProfile::Yes :
+                       result == Solver::False ? SolverLayerProfile::No :
+                       SolverLayerProfile::Unknown);
+  return success;
+}
+
+bool ProfilingSolver::computeTruth(const Query& query, bool &isValid) {
+  Call call(getCounts(SolverLayerProfile::Truth));
+  bool success = solver->impl->computeTruth(query, isValid);
+  call.answer(success,
+              isValid ? SolverLayerProfile::Yes : SolverLayerProfile::No);
+  return success;
+}
+
+bool ProfilingSolver::computeTruthMany(const ConstraintManager &constraints,
+                                       const std::vector< ref<Expr> > &exprs,
+                                       std::vector<bool> &isValid) {
+  // A batch counts as one truth query, valid if any of its queries is.
+  Call call(getCounts(SolverLayerProfile::Truth));
+  bool success = solver->impl->computeTruthMany(constraints, exprs, isValid);
+  bool anyValid = std::find(isValid.begin(), isValid.end(), true) !=
+                  isValid.end();
+  call.answer(success,
+              anyValid ? SolverLayerProfile::Yes : SolverLayerProfile::No);
+  return success;
+}
+
+bool ProfilingSolver::computeValue(const Query& query, ref<Expr> &result) {
+  Call call(getCounts(SolverLayerProfile::Value));
+  bool success = solver->impl->computeValue(query, result);
+  call.answer(success, SolverLayerProfile::Yes);
+  return success;
+}
+
+bool ProfilingSolver::computeRange(const Query& query, ref<Expr> &min,
+                                   ref<Expr> &max) {
+  Call call(getCounts(SolverLayerProfile::Value));
+  bool success = solver->impl->computeRange(query, min, max);
+  call.answer(success, SolverLayerProfile::Yes);
+  return success;
+}
+
+bool ProfilingSolver::computeUniqueValue(const Query& query,
+                                         ref<Expr> &result, bool &isUnique) {
+  Call call(getCounts(SolverLayerProfile::Value));
+  bool success = solver->impl->computeUniqueValue(query, result, isUnique);
+  call.answer(success,
+              isUnique ? SolverLayerProfile::Yes : SolverLayerProfile::No);
+  return success;
+}
+
+bool
+ProfilingSolver::computeInitialValues(const Query& query,
+                                      const std::vector<const Array*>
+                                        &objects,
+                                      std::vector< std::vector<unsigned char> >
+                                        &values,
+                                      bool &hasSolution) {
+  Call call(getCounts(SolverLayerProfile::InitialValues));
+  bool success = solver->impl->computeInitialValues(query, objects, values,
+                                                    hasSolution);
+  call.answer(success,
+              hasSolution ? SolverLayerProfile::Yes : SolverLayerProfile::No);
+  return success;
+}
+
+SolverImpl::SolverRunStatus ProfilingSolver::getOperationStatusCode() {
+  return solver->impl->getOperationStatusCode();
+}
+
+char *ProfilingSolver::getConstraintLog(const Query& query) {
+  return solver->impl->getConstraintLog(query);
+}
+
+void ProfilingSolver::setCoreSolverTimeout(double timeout) {
+  solver->impl->setCoreSolverTimeout(timeout);
+}
+
+size_t ProfilingSolver::trimCaches(size_t bytes) {
+  return solver->impl->trimCaches(bytes);
+}
+
+void ProfilingSolver::releaseArrays(const std::vector<const Array *> &arrays) {
+  solver->impl->releaseArrays(arrays);
+}
+
+void ProfilingSolver::interrupt() {
+  solver->impl->interrupt();
+}
+
+const char *
+SolverLayerProfile::getQueryKindName(SolverLayerProfile::QueryKind kind) {
+  switch (kind) {
+  case Validity: return "Validity";
+  case Truth: return "Truth";
+  case Value: return "Value";
+  case InitialValues: return "InitialValues";
+  default: return "Unknown";
+  }
+}
+
+const char *SolverLayerProfile::getAnswerName(SolverLayerProfile::Answer a) {
+  switch (a) {
+  case Yes: return "Yes";
+  case No: return "No";
+  case Unknown: return "Unknown";
+  case Failed: return "Failed";
+  default: return "Unknown";
+  }
+}
+
+const std::vector<SolverLayerProfile *> &klee::getSolverLayerProfiles() {
+  return profiles;
+}
+
+Solver *klee::createProfilingSolver(Solver *s, const char *layer) {
+  SolverLayerProfile *profile = new SolverLayerProfile(layer);
+  profiles.push_back(profile);
+  return new Solver(new ProfilingSolver(s, profile));
+}
@@ -19,6 +19,10 @@
 #include "llvm/Support/FileSystem.h"
 #endif
 
+#include <deque>
+
+#include <pthread.h>
+
 using namespace klee::util;
 
 namespace {
@@ -26,6 +30,12 @@ llvm::cl::opt<bool> DumpPartialQueryiesEarly(
     "log-partial-queries-early", llvm::cl::init(false),
     llvm::cl::desc("Log queries before calling the solver (default=off)"));
 
+llvm::cl::opt<bool> QueryLogBackgroundWrites(
+    "query-log-background-writes", llvm::cl::init(false),
+    llvm::cl::desc("Write query logs to their files on a separate thread, so "
+                   "that solving does not wait for the disk. Queries still "
+                   "queued are lost if KLEE crashes (default=off)"));
+
 #ifdef HAVE_ZLIB_H
 llvm::cl::opt<bool> CreateCompressedQueryLog(
     "compress-query-log", llvm::cl::init(false),
@@ -33,12 +43,91 @@ llvm::cl::opt<bool> CreateCompressedQueryLog(
 #endif
 }
 
+/// QueryLogWriter - A thread writing the buffers queued by a query logging
+/// solver to its stream, in order. Only the finished text of the queries
+/// crosses threads, never their expressions.
+class QueryLogWriter {
+  llvm::raw_ostream &os;
+  pthread_t thread;
+  pthread_mutex_t lock;
+  pthread_cond_t wake;
+  std::deque<std::string> queue;
+  bool stopping;
+
+  static void *run(void *arg) {
+    static_cast<QueryLogWriter *>(arg)->writeQueued();
+    return 0;
+  }
+
+  void writeQueued() {
+    std::deque<std::string> batch;
+    pthread_mutex_lock(&lock);
+    for (;;) {
+      while (queue.empty() && !stopping)
+        pthread_cond_wait(&wake, &lock);
+      if (queue.empty())
+        break;
+      batch.swap(queue);
+      pthread_mutex_unlock(&lock);
+
+      for (std::deque<std::string>::iterator it = batch.begin(),
+                                             ie = batch.end();
+           it != ie; ++it)
+        os << *it;
+      os.flush();
+      batch.clear();
+
+      pthread_mutex_lock(&lock);
+    }
+    pthread_mutex_unlock(&lock);
+  }
+
+  explicit QueryLogWriter(llvm::raw_ostream &_os)
+      : os(_os), stopping(false) {
+    pthread_mutex_init(&lock, 0);
+    pthread_cond_init(&wake, 0);
+  }
+
+public:
+  /// create - Start a writer to \a os, or return null if no thread can be
+  /// started, in which case the caller writes itself.
+  static QueryLogWriter *create(llvm::raw_ostream &os) {
+    QueryLogWriter *w = new QueryLogWriter(os);
+    if (pthread_create(&w->thread, 0, run, w)) {
+      delete w;
+      return 0;
+    }
+    return w;
+  }
+
+  /// ~QueryLogWriter - Write everything still queued and stop the thread.
+  ~QueryLogWriter() {
+    pthread_mutex_lock(&lock);
+    stopping = true;
+    pthread_cond_signal(&wake);
+    pthread_mutex_unlock(&lock);
+    pthread_join(thread, 0);
+    pthread_cond_destroy(&wake);
+    pthread_mutex_destroy(&lock);
+  }
+
+  /// write - Queue \a text, leaving it empty.
+  void write(std::string &text) {
+    pthread_mutex_lock(&lock);
+    queue.push_back(std::string());
+    queue.back().swap(text);
+    pthread_cond_signal(&wake);
+    pthread_mutex_unlock(&lock);
+  }
+};
+
 QueryLoggingSolver::QueryLoggingSolver(Solver *_solver, std::string path,
                                        const std::string &commentSign,
                                        int queryTimeToLog)
     : solver(_solver), os(0), BufferString(""), logBuffer(BufferString),
       queryCount(0), minQueryTimeToLog(queryTimeToLog), startTime(0.0f),
-      lastQueryTime(0.0f), queryCommentSign(commentSign) {
+      lastQueryTime(0.0f), queryCommentSign(commentSign), pendingQuery(0),
+      pendingFalseQuery(0), pendingObjects(0), pendingOffset(0), logWriter(0) {
 #ifdef HAVE_ZLIB_H
   if (!CreateCompressedQueryLog) {
 #endif
@@ -61,12 +150,17 @@ QueryLoggingSolver::QueryLoggingSolver(Solver *_solver, std::string path,
 
 QueryLoggingSolver::~QueryLoggingSolver() {
   delete solver;
+  delete logWriter;
   delete os;
 }
 
 void QueryLoggingSolver::flushBufferConditionally(bool writeToFile) {
   logBuffer.flush();
-  if (writeToFile) {
+  if (writeToFile && QueryLogBackgroundWrites && !logWriter)
+    logWriter = QueryLogWriter::create(*os);
+  if (writeToFile && logWriter) {
+    logWriter->write(BufferString);
+  } else if (writeToFile) {
     *os << logBuffer.str();
     os->flush();
   }
@@ -84,7 +178,16 @@ void QueryLoggingSolver::startQuery(const Query &query, const char *typeName,
             << "Type: " << typeName << ", "
             << "Instructions: " << instructions << "\n";
 
-  printQuery(query, falseQuery, objects);
+  if (minQueryTimeToLog != 0 && !DumpPartialQueryiesEarly) {
+    // Most queries are usually filtered out, so only print those which are
+    // kept, once solved.
+    pendingQuery = &query;
+    pendingFalseQuery = falseQuery;
+    pendingObjects = objects;
+    pendingOffset = logBuffer.str().size();
+  } else {
+    printQuery(query, falseQuery, objects);
+  }
 
   if (DumpPartialQueryiesEarly) {
     flushBufferConditionally(true);
@@ -121,6 +224,16 @@ void QueryLoggingSolver::flushBuffer() {
     }
   }
 
+  if (writeToFile && pendingQuery) {
+    // Print the deferred query between its header and its result.
+    std::string result = logBuffer.str().substr(pendingOffset);
+    BufferString.resize(pendingOffset);
+    printQuery(*pendingQuery, pendingFalseQuery, pendingObjects);
+    logBuffer << result;
+  }
+  pendingQuery = pendingFalseQuery = 0;
+  pendingObjects = 0;
+
   flushBufferConditionally(writeToFile);
 }
 
@@ -231,3 +344,16 @@ char *QueryLoggingSolver::getConstraintLog(const Query &query) {
 void QueryLoggingSolver::setCoreSolverTimeout(double timeout) {
   solver->impl->setCoreSolverTimeout(timeout);
 }
+
+size_t QueryLoggingSolver::trimCaches(size_t bytes) {
+  return solver->impl->trimCaches(bytes);
+}
+
+void QueryLoggingSolver::releaseArrays(
+    const std::vector<const Array *> &arrays) {
+  solver->impl->releaseArrays(arrays);
+}
+
+void QueryLoggingSolver::interrupt() {
+  solver->impl->interrupt();
+}
@@ -17,6 +17,8 @@
 
 using namespace klee;
 
+class QueryLogWriter;
+
 /// This abstract class represents a solver that is capable of logging
 /// queries to a file.
 /// Derived classes might specialize this one by providing different formats
@@ -42,6 +44,18 @@ protected:
   const std::string queryCommentSign; // sign representing commented lines
                                       // in given a query format
 
+  // @brief The query whose printing is deferred until it is known to be
+  // logged, and where in logBuffer it goes. Printing is only deferred when
+  // minQueryTimeToLog may filter the query out.
+  const Query *pendingQuery;
+  const Query *pendingFalseQuery;
+  const std::vector<const Array *> *pendingObjects;
+  size_t pendingOffset;
+
+  // @brief Writes the buffers of the logged queries to os on a thread of its
+  // own with -query-log-background-writes, started by the first write.
+  QueryLogWriter *logWriter;
+
   virtual void startQuery(const Query &query, const char *typeName,
                           const Query *falseQuery = 0,
                           const std::vector<const Array *> *objects = 0);
@@ -67,6 +81,11 @@ public:
   bool computeTruth(const Query &query, bool &isValid);
   bool computeValidity(const Query &query, Solver::Validity &result);
   bool computeValue(const Query &query, ref<Expr> &result);
+  // Ranges cannot be written as a single query, so they pass through
+  // unlogged.
+  bool computeRange(const Query &query, ref<Expr> &min, ref<Expr> &max) {
+    return solver->impl->computeRange(query, min, max);
+  }
   bool computeInitialValues(const Query &query,
                             const std::vector<const Array *> &objects,
                             std::vector<std::vector<unsigned char> > &values,
@@ -74,6 +93,9 @@ public:
   SolverRunStatus getOperationStatusCode();
   char *getConstraintLog(const Query &);
   void setCoreSolverTimeout(double timeout);
+  size_t trimCaches(size_t bytes);
+  void releaseArrays(const std::vector<const Array *> &arrays);
+  void interrupt();
 };
 
 #endif /* KLEE_QUERYLOGGINGSOLVER_H */
@@ -16,6 +16,7 @@
 #include "klee/SolverStats.h"
 
 #include "ConstantDivision.h"
+#include "ConstructOrder.h"
 
 #include "llvm/ADT/StringExtras.h"
 #include "llvm/Support/CommandLine.h"
@@ -72,10 +73,32 @@ STPArrayExprHash::~STPArrayExprHash() {
   }
 }
 
+void STPArrayExprHash::releaseArrays(const std::vector<const Array *> &arrays) {
+  if (arrays.empty())
+    return;
+  for (std::vector<const Array *>::const_iterator it = arrays.begin(),
+                                                  ie = arrays.end();
+       it != ie; ++it) {
+    ArrayHashIter entry = _array_hash.find(*it);
+    if (entry == _array_hash.end())
+      continue;
+    if (entry->second)
+      ::vc_DeleteExpr(entry->second);
+    _array_hash.erase(entry);
+  }
+
+  for (UpdateNodeHashConstIter it = _update_node_hash.begin();
+      it != _update_node_hash.end(); ++it) {
+    if (it->second)
+      ::vc_DeleteExpr(it->second);
+  }
+  _update_node_hash.clear();
+}
+
 /***/
 
 STPBuilder::STPBuilder(::VC _vc, bool _optimizeDivides)
-  : vc(_vc), optimizeDivides(_optimizeDivides) {
+  : vc(_vc), optimizeDivides(_optimizeDivides), constructingKids(false) {
 
 }
 
@@ -426,6 +449,10 @@ ExprHandle STPBuilder::constructSDivByConstant(ExprHandle expr_n, unsigned width
   return res;
 }
 
+void STPBuilder::releaseArrays(const std::vector<const Array *> &arrays) {
+  _arr_hash.releaseArrays(arrays);
+}
+
 ::VCExpr STPBuilder::getInitialArray(const Array *root) {
   
   assert(root);
@@ -434,8 +461,8 @@ ExprHandle STPBuilder::constructSDivByConstant(ExprHandle expr_n, unsigned width
   
   if (!hashed) {
     // STP uniques arrays by name, so we make sure the name is unique by
-    // using the size of the array hash as a counter.
-    std::string unique_id = llvm::itostr(_arr_hash._array_hash.size());
+    // using the number of arrays hashed as a counter.
+    std::string unique_id = llvm::itostr(_arr_hash.getNumArraysHashed());
     unsigned const uid_length = unique_id.length();
     unsigned const space = (root->name.length() > 32 - uid_length)
                                ? (32 - uid_length)
@@ -470,24 +497,70 @@ ExprHandle STPBuilder::getInitialRead(const Array *root, unsigned index) {
 
 ::VCExpr STPBuilder::getArrayForUpdate(const Array *root, 
                                        const UpdateNode *un) {
-  if (!un) {
-      return(getInitialArray(root));
+  // Start from the newest update already built, or the initial array, and
+  // write the others over it oldest first.
+  std::vector<const UpdateNode *> pending;
+  ::VCExpr un_expr;
+  for (; un; un = un->next) {
+    if (_arr_hash.lookupUpdateNodeExpr(un, un_expr))
+      break;
+    pending.push_back(un);
   }
-  else {
-      // FIXME: This really needs to be non-recursive.
-      ::VCExpr un_expr;
-      bool hashed = _arr_hash.lookupUpdateNodeExpr(un, un_expr);
-      
-      if (!hashed) {
-	un_expr = vc_writeExpr(vc,
-                               getArrayForUpdate(root, un->next),
-                               construct(un->index, 0),
-                               construct(un->value, 0));
-	
-	_arr_hash.hashUpdateNodeExpr(un, un_expr);
-      }
-      
-      return(un_expr);
+  if (!un)
+    un_expr = getInitialArray(root);
+
+  for (std::vector<const UpdateNode *>::reverse_iterator it = pending.rbegin(),
+                                                         ie = pending.rend();
+       it != ie; ++it) {
+    un_expr = vc_writeExpr(vc, un_expr, construct((*it)->index, 0),
+                           construct((*it)->value, 0));
+    _arr_hash.hashUpdateNodeExpr(*it, un_expr);
+  }
+  return un_expr;
+}
+
+bool STPBuilder::constructsKids(const ref<Expr> &e) {
+  // Floating-point expressions are lowered whole.
+  switch (e->getKind()) {
+  case Expr::FToU:
+  case Expr::FToS:
+  case Expr::ExplicitInt:
+  case Expr::FpClassify:
+  case Expr::FIsFinite:
+  case Expr::FIsNan:
+  case Expr::FIsInf:
+  case Expr::FOrd:
+  case Expr::FUno:
+  case Expr::FUeq:
+  case Expr::FOeq:
+  case Expr::FUgt:
+  case Expr::FOgt:
+  case Expr::FUge:
+  case Expr::FOge:
+  case Expr::FUlt:
+  case Expr::FOlt:
+  case Expr::FUle:
+  case Expr::FOle:
+  case Expr::FUne:
+  case Expr::FOne:
+  case Expr::FConstant:
+  case Expr::FSelect:
+  case Expr::FExt:
+  case Expr::UToF:
+  case Expr::SToF:
+  case Expr::ExplicitFloat:
+  case Expr::FAbs:
+  case Expr::FSqrt:
+  case Expr::FNearbyInt:
+  case Expr::FAdd:
+  case Expr::FSub:
+  case Expr::FMul:
+  case Expr::FDiv:
+  case Expr::FMin:
+  case Expr::FMax:
+    return false;
+  default:
+    return true;
   }
 }
 
@@ -504,6 +577,11 @@ ExprHandle STPBuilder::construct(ref<Expr> e, int *width_out) {
         *width_out = it->second.second;
       return it->second.first;
     } else {
+      if (!constructingKids) {
+        constructingKids = true;
+        constructKidsFirst(*this, e);
+        constructingKids = false;
+      }
       int width;
       if (!width_out) width_out = &width;
       ExprHandle res = constructActual(e, width_out);
@@ -919,6 +997,45 @@ ExprHandle STPBuilder::constructActual(ref<Expr> e, int *width_out) {
   case Expr::Sge:
 #endif
 
+    // Floating point, bit-blasted over the IEEE encodings
+  case Expr::FToU:
+  case Expr::FToS:
+  case Expr::ExplicitInt:
+  case Expr::FpClassify:
+  case Expr::FIsFinite:
+  case Expr::FIsNan:
+  case Expr::FIsInf:
+  case Expr::FOrd:
+  case Expr::FUno:
+  case Expr::FUeq:
+  case Expr::FOeq:
+  case Expr::FUgt:
+  case Expr::FOgt:
+  case Expr::FUge:
+  case Expr::FOge:
+  case Expr::FUlt:
+  case Expr::FOlt:
+  case Expr::FUle:
+  case Expr::FOle:
+  case Expr::FUne:
+  case Expr::FOne:
+  case Expr::FConstant:
+  case Expr::FSelect:
+  case Expr::FExt:
+  case Expr::UToF:
+  case Expr::SToF:
+  case Expr::ExplicitFloat:
+  case Expr::FAbs:
+  case Expr::FSqrt:
+  case Expr::FNearbyInt:
+  case Expr::FAdd:
+  case Expr::FSub:
+  case Expr::FMul:
+  case Expr::FDiv:
+  case Expr::FMin:
+  case Expr::FMax:
+    return construct(floatLowering.lower(e), width_out);
+
   default: 
     assert(0 && "unhandled Expr type");
     return vc_trueExpr(vc);
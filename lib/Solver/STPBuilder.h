@@ -12,6 +12,7 @@
 
 #include "klee/util/ExprHashMap.h"
 #include "klee/util/ArrayExprHash.h"
+#include "klee/util/FloatLowering.h"
 #include "klee/Config/config.h"
 
 #include <vector>
@@ -60,6 +61,7 @@ namespace klee {
   public:
     STPArrayExprHash() {};
     virtual ~STPArrayExprHash();
+    void releaseArrays(const std::vector<const Array *> &arrays);
   };
 
 class STPBuilder {
@@ -73,6 +75,14 @@ class STPBuilder {
 
   STPArrayExprHash _arr_hash;
 
+  /// Whether the kids of the expression being constructed are being
+  /// constructed first.
+  bool constructingKids;
+
+  /// floatLowering - Rewrites floating-point expressions, which STP has no
+  /// theory for, into bitvector ones.
+  FloatLowering floatLowering;
+
 private:  
 
   ExprHandle bvOne(unsigned width);
@@ -107,6 +117,19 @@ private:
 
   ExprHandle constructActual(ref<Expr> e, int *width_out);
   ExprHandle construct(ref<Expr> e, int *width_out);
+
+  // Hooks for constructKidsFirst().
+  template <class Builder>
+  friend void constructKidsFirst(Builder &builder, const ref<Expr> &root);
+  bool isConstructed(const ref<Expr> &e) {
+    return isa<ConstantExpr>(e) || constructed.count(e);
+  }
+  bool isConstructed(const UpdateNode *un) {
+    ::VCExpr tmp;
+    return _arr_hash.lookupUpdateNodeExpr(un, tmp);
+  }
+  bool constructsKids(const ref<Expr> &e);
+  void constructAndCache(const ref<Expr> &e) { construct(e, 0); }
   
   ::VCExpr buildVar(const char *name, unsigned width);
   ::VCExpr buildArray(const char *name, unsigned indexWidth, unsigned valueWidth);
@@ -119,9 +142,14 @@ public:
   ExprHandle getFalse();
   ExprHandle getInitialRead(const Array *os, unsigned index);
 
+  /// Forget and delete the expressions built for \p arrays, which are about
+  /// to be freed.
+  void releaseArrays(const std::vector<const Array *> &arrays);
+
   ExprHandle construct(ref<Expr> e) { 
     ExprHandle res = construct(e, 0);
     constructed.clear();
+    floatLowering.clear();
     return res;
   }
 };
@@ -15,12 +15,16 @@
 #include "klee/Internal/Support/ErrorHandling.h"
 #include "klee/util/Assignment.h"
 #include "klee/util/ExprUtil.h"
+#include "klee/util/FloatLowering.h"
 
 #include "llvm/Support/CommandLine.h"
 #include "llvm/Support/Errno.h"
 #include "llvm/Support/ErrorHandling.h"
 
 #include <errno.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
 #include <unistd.h>
 #include <signal.h>
 #include <sys/wait.h>
@@ -42,6 +46,8 @@ llvm::cl::opt<bool> IgnoreSolverFailures(
 
 static unsigned char *shared_memory_ptr;
 static int shared_memory_id = 0;
+// The process which allocated the region, see allocateSharedMemory().
+static pid_t shared_memory_owner = 0;
 // Darwin by default has a very small limit on the maximum amount of shared
 // memory, which will quickly be exhausted by KLEE running its tests in
 // parallel. For now, we work around this by just requesting a smaller size --
@@ -53,6 +59,41 @@ static const unsigned shared_memory_size = 1 << 16;
 static const unsigned shared_memory_size = 1 << 20;
 #endif
 
+// The process running the current forked query, or 0, which interrupt()
+// kills from another thread. The lock keeps it from signalling the process
+// once it has been reaped.
+static pthread_mutex_t stp_child_lock = PTHREAD_MUTEX_INITIALIZER;
+static pid_t stp_child_pid = 0;
+static volatile sig_atomic_t stp_interrupted = 0;
+
+/// allocateSharedMemory - Allocate the region forked STP processes write
+/// their counterexamples to. The region is inherited across fork(), so
+/// processes forked from klee itself (parallel workers) allocate their own
+/// before querying, or concurrent queries would clobber each other's
+/// counterexamples.
+static void allocateSharedMemory() {
+  shared_memory_id =
+      shmget(IPC_PRIVATE, shared_memory_size, IPC_CREAT | 0700);
+  if (shared_memory_id < 0)
+    llvm::report_fatal_error("unable to allocate shared memory region");
+  shared_memory_ptr = (unsigned char *)shmat(shared_memory_id, NULL, 0);
+  if (shared_memory_ptr == (void *)-1)
+    llvm::report_fatal_error("unable to attach shared memory region");
+  shmctl(shared_memory_id, IPC_RMID, NULL);
+  shared_memory_owner = getpid();
+}
+
+/// canBitBlast - Whether every floating-point expression in the query can be
+/// lowered to bitvectors for STP.
+static bool canBitBlast(const Query &query) {
+  for (ConstraintManager::const_iterator it = query.constraints.begin(),
+                                         ie = query.constraints.end();
+       it != ie; ++it)
+    if (!FloatLowering::canLower(*it))
+      return false;
+  return FloatLowering::canLower(query.expr);
+}
+
 static void stp_error_handler(const char *err_msg) {
   fprintf(stderr, "error: STP Error: %s\n", err_msg);
   abort();
@@ -74,6 +115,10 @@ public:
 
   char *getConstraintLog(const Query &);
   void setCoreSolverTimeout(double _timeout) { timeout = _timeout; }
+  void releaseArrays(const std::vector<const Array *> &arrays) {
+    builder->releaseArrays(arrays);
+  }
+  void interrupt();
 
   bool computeTruth(const Query &, bool &isValid);
   bool computeValue(const Query &, ref<Expr> &result);
@@ -105,14 +150,7 @@ STPSolverImpl::STPSolverImpl(bool _useForkedSTP, bool _optimizeDivides)
 
   if (useForkedSTP) {
     assert(shared_memory_id == 0 && "shared memory id already allocated");
-    shared_memory_id =
-        shmget(IPC_PRIVATE, shared_memory_size, IPC_CREAT | 0700);
-    if (shared_memory_id < 0)
-      llvm::report_fatal_error("unable to allocate shared memory region");
-    shared_memory_ptr = (unsigned char *)shmat(shared_memory_id, NULL, 0);
-    if (shared_memory_ptr == (void *)-1)
-      llvm::report_fatal_error("unable to attach shared memory region");
-    shmctl(shared_memory_id, IPC_RMID, NULL);
+    allocateSharedMemory();
   }
 }
 
@@ -130,8 +168,15 @@ STPSolverImpl::~STPSolverImpl() {
 /***/
 
 char *STPSolverImpl::getConstraintLog(const Query &query) {
+  if (!canBitBlast(query)) {
+    const char *msg = "Unsupported floating-point query";
+    char *buf = (char *)malloc(strlen(msg) + 1);
+    strcpy(buf, msg);
+    return buf;
+  }
+
   vc_push(vc);
-  for (std::vector<ref<Expr> >::const_iterator it = query.constraints.begin(),
+  for (ConstraintManager::const_iterator it = query.constraints.begin(),
                                                ie = query.constraints.end();
        it != ie; ++it)
     vc_assertFormula(vc, builder->construct(*it));
@@ -219,6 +264,11 @@ runAndGetCexForked(::VC vc, STPBuilder *builder, ::VCExpr q,
                    const std::vector<const Array *> &objects,
                    std::vector<std::vector<unsigned char> > &values,
                    bool &hasSolution, double timeout) {
+  if (shared_memory_owner != getpid()) {
+    shmdt(shared_memory_ptr);
+    allocateSharedMemory();
+  }
+
   unsigned char *pos = shared_memory_ptr;
   unsigned sum = 0;
   for (std::vector<const Array *>::const_iterator it = objects.begin(),
@@ -230,6 +280,7 @@ runAndGetCexForked(::VC vc, STPBuilder *builder, ::VCExpr q,
 
   fflush(stdout);
   fflush(stderr);
+  stp_interrupted = 0;
   int pid = fork();
   if (pid == -1) {
     klee_warning("fork failed (for STP) - %s", llvm::sys::StrError(errno).c_str());
@@ -259,9 +310,23 @@ runAndGetCexForked(::VC vc, STPBuilder *builder, ::VCExpr q,
     }
     _exit(res);
   } else {
+    pthread_mutex_lock(&stp_child_lock);
+    stp_child_pid = pid;
+    if (stp_interrupted)
+      kill(pid, SIGKILL);
+    pthread_mutex_unlock(&stp_child_lock);
+
+    // Wait for STP to exit, but only reap it once interrupt() can no
+    // longer signal it.
+    siginfo_t info;
     int status;
     pid_t res;
-
+    do {
+      res = waitid(P_PID, pid, &info, WEXITED | WNOWAIT);
+    } while (res < 0 && errno == EINTR);
+    pthread_mutex_lock(&stp_child_lock);
+    stp_child_pid = 0;
+    pthread_mutex_unlock(&stp_child_lock);
     do {
       res = waitpid(pid, &status, 0);
     } while (res < 0 && errno == EINTR);
@@ -277,6 +342,8 @@ runAndGetCexForked(::VC vc, STPBuilder *builder, ::VCExpr q,
     // "occasion" return a status when the process was terminated by a
     // signal, so test signal first.
     if (WIFSIGNALED(status) || !WIFEXITED(status)) {
+      if (stp_interrupted)
+        return SolverImpl::SOLVER_RUN_STATUS_INTERRUPTED;
       klee_warning("STP did not return successfully.  Most likely you forgot "
                    "to run 'ulimit -s unlimited'");
       if (!IgnoreSolverFailures) {
@@ -326,6 +393,12 @@ bool STPSolverImpl::computeInitialValues(
     std::vector<std::vector<unsigned char> > &values, bool &hasSolution) {
   runStatusCode = SOLVER_RUN_STATUS_FAILURE;
 
+  if (!canBitBlast(query)) {
+    klee_warning_once(0, "STP: unsupported floating-point operation or "
+                         "precision in query, failing it");
+    return false;
+  }
+
   TimerStatIncrementer t(stats::queryTime);
 
   vc_push(vc);
@@ -375,6 +448,16 @@ SolverImpl::SolverRunStatus STPSolverImpl::getOperationStatusCode() {
   return runStatusCode;
 }
 
+/// interrupt - Kill the process running a forked query. STP cannot be
+/// stopped when it runs in klee itself.
+void STPSolverImpl::interrupt() {
+  pthread_mutex_lock(&stp_child_lock);
+  stp_interrupted = 1;
+  if (stp_child_pid)
+    kill(stp_child_pid, SIGKILL);
+  pthread_mutex_unlock(&stp_child_lock);
+}
+
 STPSolver::STPSolver(bool useForkedSTP, bool optimizeDivides)
     : Solver(new STPSolverImpl(useForkedSTP, optimizeDivides)) {}
 
@@ -10,6 +10,7 @@
 #include "klee/Solver.h"
 #include "klee/SolverImpl.h"
 #include "klee/Constraints.h"
+#include "klee/util/ExprUtil.h"
 
 using namespace klee;
 
@@ -33,6 +34,18 @@ void Solver::setCoreSolverTimeout(double timeout) {
     impl->setCoreSolverTimeout(timeout);
 }
 
+size_t Solver::trimCaches(size_t bytes) {
+  return impl->trimCaches(bytes);
+}
+
+void Solver::releaseArrays(const std::vector<const Array *> &arrays) {
+  impl->releaseArrays(arrays);
+}
+
+void Solver::interrupt() {
+  impl->interrupt();
+}
+
 bool Solver::evaluate(const Query& query, Validity &result) {
   assert(query.expr->getWidth() == Expr::Bool && "Invalid expression type!");
 
@@ -77,6 +90,50 @@ bool Solver::mayBeFalse(const Query& query, bool &result) {
   return true;
 }
 
+bool Solver::mustBeTrueMany(const ConstraintManager &constraints,
+                            const std::vector< ref<Expr> > &exprs,
+                            std::vector<bool> &result) {
+  result.assign(exprs.size(), false);
+
+  // Maintain invariants implementations expect: only the non-constant
+  // expressions are handed on, so remember where their results go.
+  std::vector< ref<Expr> > pending;
+  std::vector<unsigned> positions;
+  for (unsigned i = 0, e = exprs.size(); i != e; ++i) {
+    assert(exprs[i]->getWidth() == Expr::Bool && "Invalid expression type!");
+    if (ConstantExpr *CE = dyn_cast<ConstantExpr>(exprs[i])) {
+      result[i] = CE->isTrue();
+    } else {
+      pending.push_back(exprs[i]);
+      positions.push_back(i);
+    }
+  }
+  if (pending.empty())
+    return true;
+
+  std::vector<bool> isValid;
+  if (!impl->computeTruthMany(constraints, pending, isValid))
+    return false;
+  assert(isValid.size() == pending.size() && "Missing truth results");
+  for (unsigned i = 0, e = positions.size(); i != e; ++i)
+    result[positions[i]] = isValid[i];
+  return true;
+}
+
+bool Solver::mayBeTrueMany(const ConstraintManager &constraints,
+                           const std::vector< ref<Expr> > &exprs,
+                           std::vector<bool> &result) {
+  std::vector< ref<Expr> > negated;
+  negated.reserve(exprs.size());
+  for (std::vector< ref<Expr> >::const_iterator it = exprs.begin(),
+         ie = exprs.end(); it != ie; ++it)
+    negated.push_back(Expr::createIsZero(*it));
+  if (!mustBeTrueMany(constraints, negated, result))
+    return false;
+  result.flip();
+  return true;
+}
+
 bool Solver::getValue(const Query& query, ref<Expr> &result) {
   // Maintain invariants implementation expect.
   if (ConstantExpr *CE = dyn_cast<ConstantExpr>(query.expr)) {
@@ -110,14 +167,16 @@ Solver::getInitialValues(const Query& query,
   return success;
 }
 
-std::pair< ref<Expr>, ref<Expr> > Solver::getRange(const Query& query) {
+/// getIntegerRange - Search for the bounds of the integer query expression
+/// with queries on its bits, its lower and its upper bound.
+static void getIntegerRange(Solver &solver, const Query& query,
+                            uint64_t &min, uint64_t &max) {
   ref<Expr> e = query.expr;
   Expr::Width width = e->getWidth();
-  uint64_t min, max;
 
   if (width==1) {
     Solver::Validity result;
-    if (!evaluate(query, result))
+    if (!solver.evaluate(query, result))
       assert(0 && "computeValidity failed");
     switch (result) {
     case Solver::True: 
@@ -136,7 +195,7 @@ std::pair< ref<Expr>, ref<Expr> > Solver::getRange(const Query& query) {
       mid = lo + (hi - lo)/2;
       bool res;
       bool success = 
-        mustBeTrue(query.withExpr(
+        solver.mustBeTrue(query.withExpr(
                      EqExpr::create(LShrExpr::create(e,
                                                      ConstantExpr::create(mid, 
                                                                           width)),
@@ -161,7 +220,7 @@ std::pair< ref<Expr>, ref<Expr> > Solver::getRange(const Query& query) {
     // check common case
     bool res = false;
     bool success = 
-      mayBeTrue(query.withExpr(EqExpr::create(e, ConstantExpr::create(0, 
+      solver.mayBeTrue(query.withExpr(EqExpr::create(e, ConstantExpr::create(0, 
                                                                       width))), 
                 res);
 
@@ -177,7 +236,7 @@ std::pair< ref<Expr>, ref<Expr> > Solver::getRange(const Query& query) {
         mid = lo + (hi - lo)/2;
         bool res = false;
         bool success = 
-          mayBeTrue(query.withExpr(UleExpr::create(e, 
+          solver.mayBeTrue(query.withExpr(UleExpr::create(e, 
                                                    ConstantExpr::create(mid, 
                                                                         width))),
                     res);
@@ -201,7 +260,7 @@ std::pair< ref<Expr>, ref<Expr> > Solver::getRange(const Query& query) {
       mid = lo + (hi - lo)/2;
       bool res;
       bool success = 
-        mustBeTrue(query.withExpr(UleExpr::create(e, 
+        solver.mustBeTrue(query.withExpr(UleExpr::create(e, 
                                                   ConstantExpr::create(mid, 
                                                                        width))),
                    res);
@@ -218,9 +277,84 @@ std::pair< ref<Expr>, ref<Expr> > Solver::getRange(const Query& query) {
 
     max = lo;
   }
+}
 
-  return std::make_pair(ConstantExpr::create(min, width),
-                        ConstantExpr::create(max, width));
+bool Solver::computeRange(const Query& query, ref<Expr> &min,
+                          ref<Expr> &max) {
+  // Maintain invariants implementations expect.
+  if (isa<ConstantExpr>(query.expr) || isa<FConstantExpr>(query.expr)) {
+    min = max = query.expr;
+    return true;
+  }
+  if (query.expr->getWidth() == Expr::Bool)
+    return false;
+  return impl->computeRange(query, min, max);
+}
+
+std::pair< ref<Expr>, ref<Expr> > Solver::getRange(const Query& query) {
+  ref<Expr> e = query.expr;
+  Expr::Width width = e->getWidth();
+  ref<Expr> min, max;
+  if (computeRange(query, min, max))
+    return std::make_pair(min, max);
+
+  if (!isa<FExpr>(e)) {
+    uint64_t lo, hi;
+    getIntegerRange(*this, query, lo, hi);
+    return std::make_pair(ConstantExpr::create(lo, width),
+                          ConstantExpr::create(hi, width));
+  }
+
+  // Search for the bounds of a float among its non-NaN values, on the
+  // integer which orders them as the float does.
+  ref<Expr> notNaN = Expr::createIsZero(FIsNanExpr::create(e));
+  bool hasNumber = false;
+  bool success = mayBeTrue(query.withExpr(notNaN), hasNumber);
+  assert(success && "FIXME: Unhandled solver failure");
+  (void) success;
+  if (hasNumber && width == Expr::Fl80) {
+    // The keys of x87 values are too wide to search, so give the range of
+    // every non-NaN value.
+    const llvm::fltSemantics &sem = llvm::APFloat::x87DoubleExtended;
+    return std::make_pair(FConstantExpr::alloc(llvm::APFloat::getInf(sem, true)),
+                          FConstantExpr::alloc(llvm::APFloat::getInf(sem, false)));
+  }
+  if (!hasNumber) {
+    // Only NaNs remain, which have no order.
+    ref<Expr> value;
+    success = getValue(query, value);
+    assert(success && "FIXME: Unhandled solver failure");
+    return std::make_pair(value, value);
+  }
+
+  std::vector< ref<Expr> > constraints(query.constraints.begin(),
+                                       query.constraints.end());
+  constraints.push_back(notNaN);
+  ConstraintManager numbers(constraints);
+  uint64_t lo, hi;
+  getIntegerRange(*this, Query(numbers, getFloatOrderKey(e)), lo, hi);
+  return std::make_pair(getFloatFromOrderKey(lo, width),
+                        getFloatFromOrderKey(hi, width));
+}
+
+bool Solver::computeUniqueValue(const Query& query, ref<Expr> &result,
+                                bool &isUnique) {
+  // Maintain invariants implementations expect.
+  if (isa<ConstantExpr>(query.expr) || isa<FConstantExpr>(query.expr)) {
+    result = query.expr;
+    isUnique = true;
+    return true;
+  }
+  return impl->computeUniqueValue(query, result, isUnique);
+}
+
+bool Solver::getUniqueValue(const Query& query, ref<Expr> &result,
+                            bool &isUnique) {
+  if (computeUniqueValue(query, result, isUnique))
+    return true;
+  return getValue(query, result) &&
+         mustBeTrue(query.withExpr(createIsValue(query.expr, result)),
+                    isUnique);
 }
 
 void Query::dump() const {
@@ -28,6 +28,21 @@ bool SolverImpl::computeValidity(const Query &query, Solver::Validity &result) {
   return true;
 }
 
+bool SolverImpl::computeTruthMany(const ConstraintManager &constraints,
+                                  const std::vector< ref<Expr> > &exprs,
+                                  std::vector<bool> &isValid) {
+  isValid.clear();
+  isValid.reserve(exprs.size());
+  for (std::vector< ref<Expr> >::const_iterator it = exprs.begin(),
+         ie = exprs.end(); it != ie; ++it) {
+    bool res;
+    if (!computeTruth(Query(constraints, *it), res))
+      return false;
+    isValid.push_back(res);
+  }
+  return true;
+}
+
 const char *SolverImpl::getOperationStatusString(SolverRunStatus statusCode) {
   switch (statusCode) {
   case SOLVER_RUN_STATUS_SUCCESS_SOLVABLE:
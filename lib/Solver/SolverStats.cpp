@@ -19,10 +19,62 @@ Statistic stats::queryCacheHits("QueryCacheHits", "QChits") ;
 Statistic stats::queryCacheMisses("QueryCacheMisses", "QCmisses");
 Statistic stats::queryCexCacheHits("QueryCexCacheHits", "QCexHits") ;
 Statistic stats::queryCexCacheMisses("QueryCexCacheMisses", "QCexMisses");
+Statistic stats::queryCacheEvictions("QueryCacheEvictions", "QCevict");
+Statistic stats::queryCexCacheEvictions("QueryCexCacheEvictions",
+                                        "QCexEvict");
 Statistic stats::queryConstructTime("QueryConstructTime", "QBtime") ;
 Statistic stats::queryConstructs("QueriesConstructs", "QB");
+Statistic stats::queryConstructCacheHits("QueryConstructCacheHits", "QBhits");
+Statistic stats::queryConstructCacheMisses("QueryConstructCacheMisses",
+                                           "QBmisses");
+Statistic stats::queryConstructCacheEvictions("QueryConstructCacheEvictions",
+                                              "QBevict");
 Statistic stats::queryCounterexamples("QueriesCEX", "Qcex");
+Statistic stats::queryPersistentCacheHits("QueryPersistentCacheHits",
+                                          "QPChits");
+Statistic stats::queryPersistentCacheMisses("QueryPersistentCacheMisses",
+                                            "QPCmisses");
+Statistic stats::querySharedCacheHits("QuerySharedCacheHits", "QSChits");
+Statistic stats::querySharedCacheMisses("QuerySharedCacheMisses",
+                                        "QSCmisses");
 Statistic stats::queryTime("QueryTime", "Qtime");
+Statistic stats::queryIncrementalPrefixHits("QueryIncPrefixHits", "QIhits");
+Statistic stats::queryIncrementalPrefixMisses("QueryIncPrefixMisses",
+                                              "QImisses");
+Statistic stats::queryUnsatCoreHits("QueryUnsatCoreHits", "QUChits");
+Statistic stats::queryUnsatCores("QueryUnsatCores", "QUCores");
+Statistic stats::queryShapeBitVector("QueryShapeBitVector", "QSbv");
+Statistic stats::queryShapeArray("QueryShapeArray", "QSarray");
+Statistic stats::queryShapeFloat("QueryShapeFloat", "QSfp");
+Statistic stats::queryShapeMixed("QueryShapeMixed", "QSmixed");
+Statistic stats::queryModelHintFloatHits("QueryModelHintFloatHits", "QMHfphits");
+Statistic stats::queryModelHintFloatMisses("QueryModelHintFloatMisses",
+                                           "QMHfpmisses");
+Statistic stats::queryModelHintMixedHits("QueryModelHintMixedHits",
+                                         "QMHmixedhits");
+Statistic stats::queryModelHintMixedMisses("QueryModelHintMixedMisses",
+                                           "QMHmixedmisses");
+Statistic stats::queryModelHintTime("QueryModelHintTime", "QMHtime");
+Statistic stats::floatSimplifyIdentity("FloatSimplifyIdentity", "FSidentity");
+Statistic stats::floatSimplifyCancel("FloatSimplifyCancel", "FScancel");
+Statistic stats::floatSimplifyIntCompare("FloatSimplifyIntCompare", "FSicmp");
+Statistic stats::floatSimplifyExtChain("FloatSimplifyExtChain", "FSext");
+Statistic stats::floatSimplifyClassify("FloatSimplifyClassify", "FSclass");
+Statistic stats::floatSimplifyNarrow("FloatSimplifyNarrow", "FSnarrow");
+Statistic stats::stagedSolverStageHits("StagedSolverStageHits", "SShits");
+Statistic stats::stagedSolverStageMisses("StagedSolverStageMisses",
+                                         "SSmisses");
+Statistic stats::stagedSolverStageSkips("StagedSolverStageSkips", "SSskips");
+Statistic stats::queryValidations("QueryValidations", "QVal");
+Statistic stats::queryValidationMismatches("QueryValidationMismatches",
+                                           "QVmismatches");
+Statistic stats::floatTriageQueries("FloatTriageQueries", "FTqueries");
+Statistic stats::floatTriageDecided("FloatTriageDecided", "FTdecided");
+Statistic stats::floatSearchQueries("FloatSearchQueries", "FLSqueries");
+Statistic stats::floatSearchSolved("FloatSearchSolved", "FLSsolved");
+Statistic stats::queryCubeSplits("QueryCubeSplits", "QCsplits");
+Statistic stats::queryCubes("QueryCubes", "QCubes");
+Statistic stats::solverContextRecycles("SolverContextRecycles", "SCrecycles");
 
 #ifdef DEBUG
 Statistic stats::arrayHashTime("ArrayHashTime", "AHtime");
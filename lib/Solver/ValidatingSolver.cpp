@@ -9,22 +9,83 @@
 #include "klee/Constraints.h"
 #include "klee/Solver.h"
 #include "klee/SolverImpl.h"
+#include "klee/SolverStats.h"
+#include "klee/Internal/Support/BinaryQueryLog.h"
+#include "klee/Internal/Support/ErrorHandling.h"
+#include "klee/util/ExprUtil.h"
+
+#include "llvm/Support/CommandLine.h"
+#include "llvm/Support/raw_ostream.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/wait.h>
+#include <unistd.h>
 #include <vector>
 
+using namespace klee;
+
+namespace {
+llvm::cl::opt<unsigned> ValidateSolverRate(
+    "debug-validate-solver-rate",
+    llvm::cl::desc("Check only one in this many queries under "
+                   "-debug-validate-solver and -debug-crosscheck-core-solver "
+                   "(default=1, every query)"),
+    llvm::cl::init(1));
+
+llvm::cl::opt<unsigned> ValidateSolverJobs(
+    "debug-validate-solver-jobs",
+    llvm::cl::desc("Check queries in the background, in up to this many "
+                   "forked processes, instead of before answering them. "
+                   "Queries sampled while all of them are busy go unchecked "
+                   "(default=0, check before answering)"),
+    llvm::cl::init(0));
+
+llvm::cl::opt<std::string> ValidateSolverLog(
+    "debug-validate-solver-log",
+    llvm::cl::desc("Write the queries whose check fails to this binary query "
+                   "log and warn, instead of aborting (default=none)"));
+}
+
 namespace klee {
 
 class ValidatingSolver : public SolverImpl {
 private:
   Solver *solver, *oracle;
+  /// The number of queries answered, to check one in
+  /// -debug-validate-solver-rate of them.
+  uint64_t queries;
+  /// The processes checking queries in the background.
+  std::vector<pid_t> checks;
+  /// Whether this process is one of them.
+  bool inCheck;
+
+  /// beginCheck - Decide whether to check the query just answered, and
+  /// where. Returns true in the process which checks it: this one, or a
+  /// forked one with -debug-validate-solver-jobs.
+  bool beginCheck();
+  /// finishCheck - Report the outcome of a check begun by beginCheck, for
+  /// \a query of the given binary log type, answered with \a answer. A
+  /// background check ends its process here.
+  void finishCheck(bool agrees, const char *check, binlog::QueryType type,
+                   const Query &query, binlog::Answer answer,
+                   const std::vector<const Array *> *objects = 0);
+  /// reapChecks - Collect the background checks which have finished, or,
+  /// if \a wait, all of them.
+  void reapChecks(bool wait);
 
 public:
-  ValidatingSolver(Solver *_solver, Solver *_oracle)
-      : solver(_solver), oracle(_oracle) {}
-  ~ValidatingSolver() { delete solver; }
+  ValidatingSolver(Solver *_solver, Solver *_oracle);
+  ~ValidatingSolver() {
+    reapChecks(true);
+    delete solver;
+  }
 
   bool computeValidity(const Query &, Solver::Validity &result);
   bool computeTruth(const Query &, bool &isValid);
   bool computeValue(const Query &, ref<Expr> &result);
+  bool computeRange(const Query &, ref<Expr> &min, ref<Expr> &max);
+  bool computeUniqueValue(const Query &, ref<Expr> &result, bool &isUnique);
   bool computeInitialValues(const Query &,
                             const std::vector<const Array *> &objects,
                             std::vector<std::vector<unsigned char> > &values,
@@ -32,95 +93,300 @@ public:
   SolverRunStatus getOperationStatusCode();
   char *getConstraintLog(const Query &);
   void setCoreSolverTimeout(double timeout);
+  size_t trimCaches(size_t bytes);
+  void releaseArrays(const std::vector<const Array *> &arrays);
+  void interrupt();
 };
 
-bool ValidatingSolver::computeTruth(const Query &query, bool &isValid) {
-  bool answer;
+/// writeToLog - Write \a data to -debug-validate-solver-log with a single
+/// write, opening it with the given flags besides O_WRONLY | O_APPEND.
+static bool writeToLog(const std::string &data, int flags) {
+  int fd = open(ValidateSolverLog.c_str(), O_WRONLY | O_APPEND | flags, 0644);
+  if (fd < 0)
+    return false;
+  bool success = write(fd, data.data(), data.size()) == (ssize_t) data.size();
+  close(fd);
+  return success;
+}
 
-  if (!solver->impl->computeTruth(query, isValid))
+ValidatingSolver::ValidatingSolver(Solver *_solver, Solver *_oracle)
+    : solver(_solver), oracle(_oracle), queries(0), inCheck(false) {
+  // Both -debug-validate-solver and -debug-crosscheck-core-solver may log
+  // to the file, which is started over only once.
+  static bool logCreated = false;
+  if (ValidateSolverLog.empty() || logCreated)
+    return;
+  logCreated = true;
+  std::string header;
+  {
+    llvm::raw_string_ostream os(header);
+    BinaryQueryWriter(os).writeHeader();
+  }
+  if (!writeToLog(header, O_CREAT | O_TRUNC))
+    klee_error("cannot write to %s", ValidateSolverLog.c_str());
+}
+
+bool ValidatingSolver::beginCheck() {
+  if (++queries % std::max(1u, (unsigned) ValidateSolverRate))
     return false;
-  if (!oracle->impl->computeTruth(query, answer))
+  if (!ValidateSolverJobs) {
+    ++stats::queryValidations;
+    return true;
+  }
+
+  reapChecks(false);
+  if (checks.size() >= ValidateSolverJobs)
+    return false;
+  pid_t pid = fork();
+  if (pid < 0) {
+    klee_warning("fork failed (for solver validation)");
     return false;
+  }
+  if (pid == 0) {
+    inCheck = true;
+    return true;
+  }
+  ++stats::queryValidations;
+  checks.push_back(pid);
+  return false;
+}
 
-  if (isValid != answer)
-    assert(0 && "invalid solver result (computeTruth)");
+void ValidatingSolver::finishCheck(bool agrees, const char *check,
+                                   binlog::QueryType type, const Query &query,
+                                   binlog::Answer answer,
+                                   const std::vector<const Array *> *objects) {
+  if (!agrees && !ValidateSolverLog.empty()) {
+    // The record is written at once, so that checks running side by side
+    // do not interleave theirs.
+    std::string record;
+    {
+      llvm::raw_string_ostream os(record);
+      BinaryQueryWriter writer(os);
+      writer.writeQuery(type, 0, query, objects);
+      writer.writeResult(true, 0, answer);
+    }
+    if (!writeToLog(record, 0) && !inCheck)
+      klee_warning("cannot write to %s", ValidateSolverLog.c_str());
+  }
+
+  // A background check reports through its exit status alone, as its
+  // output would duplicate what the parent has buffered.
+  if (inCheck)
+    _exit(agrees ? 0 : 1);
+  if (agrees)
+    return;
+
+  ++stats::queryValidationMismatches;
+  if (ValidateSolverLog.empty()) {
+    klee_warning("invalid solver result (%s)", check);
+    assert(0 && "invalid solver result");
+  } else {
+    klee_warning("invalid solver result (%s), query written to %s", check,
+                 ValidateSolverLog.c_str());
+  }
+}
+
+void ValidatingSolver::reapChecks(bool wait) {
+  for (unsigned i = 0; i != checks.size();) {
+    int status;
+    pid_t res = waitpid(checks[i], &status, wait ? 0 : WNOHANG);
+    if (res == 0) {
+      ++i;
+      continue;
+    }
+    if (res < 0 && errno == EINTR)
+      continue;
+    if (res > 0 && !(WIFEXITED(status) && WEXITSTATUS(status) == 0)) {
+      ++stats::queryValidationMismatches;
+      if (ValidateSolverLog.empty())
+        klee_warning("invalid solver result found by a background check");
+      else
+        klee_warning("invalid solver result found by a background check, "
+                     "query written to %s", ValidateSolverLog.c_str());
+    }
+    checks.erase(checks.begin() + i);
+  }
+}
+
+static binlog::Answer getAnswer(bool answer) {
+  return answer ? binlog::True : binlog::False;
+}
+
+static binlog::Answer getAnswer(Solver::Validity validity) {
+  return validity == Solver::True
+             ? binlog::True
+             : validity == Solver::False ? binlog::False : binlog::Unknown;
+}
+
+// A check whose oracle fails, e.g. by timing out, passes: only answers
+// which are known to be wrong are reported.
 
+bool ValidatingSolver::computeTruth(const Query &query, bool &isValid) {
+  if (!solver->impl->computeTruth(query, isValid))
+    return false;
+  if (beginCheck()) {
+    bool answer;
+    finishCheck(!oracle->impl->computeTruth(query, answer) ||
+                    isValid == answer,
+                "computeTruth", binlog::Truth, query, getAnswer(isValid));
+  }
   return true;
 }
 
 bool ValidatingSolver::computeValidity(const Query &query,
                                        Solver::Validity &result) {
-  Solver::Validity answer;
-
   if (!solver->impl->computeValidity(query, result))
     return false;
-  if (!oracle->impl->computeValidity(query, answer))
-    return false;
-
-  if (result != answer)
-    assert(0 && "invalid solver result (computeValidity)");
-
+  if (beginCheck()) {
+    Solver::Validity answer;
+    finishCheck(!oracle->impl->computeValidity(query, answer) ||
+                    result == answer,
+                "computeValidity", binlog::Validity, query,
+                getAnswer(result));
+  }
   return true;
 }
 
 bool ValidatingSolver::computeValue(const Query &query, ref<Expr> &result) {
-  bool answer;
-
   if (!solver->impl->computeValue(query, result))
     return false;
-  // We don't want to compare, but just make sure this is a legal
-  // solution.
-  if (!oracle->impl->computeTruth(
-          query.withExpr(NeExpr::create(query.expr, result)), answer))
-    return false;
+  if (beginCheck()) {
+    // We don't want to compare, but just make sure this is a legal
+    // solution.
+    bool answer;
+    finishCheck(!oracle->impl->computeTruth(
+                    query.withExpr(NeExpr::create(query.expr, result)),
+                    answer) ||
+                    !answer,
+                "computeValue", binlog::Value, query, binlog::NoAnswer);
+  }
+  return true;
+}
 
+/// rangeAgrees - Whether \a oracle finds \a min and \a max to be the bounds
+/// of the values of the expression of \a query.
+static bool rangeAgrees(Solver *oracle, const Query &query,
+                        const ref<Expr> &min, const ref<Expr> &max) {
+  // Both bounds must be values, and no value may lie outside them. Floats
+  // are compared by their keys, NaNs aside.
+  ref<Expr> e = query.expr, lo = min, hi = max, isNumber;
+  if (isa<FExpr>(e)) {
+    Expr::Width width = e->getWidth();
+    isNumber = Expr::createIsZero(FIsNanExpr::create(e));
+    e = ExplicitIntExpr::create(e, width);
+    lo = ExplicitIntExpr::create(min, width);
+    hi = ExplicitIntExpr::create(max, width);
+  }
+  bool answer;
+  if (!oracle->impl->computeTruth(query.withExpr(NeExpr::create(e, lo)),
+                                  answer))
+    return true;
   if (answer)
-    assert(0 && "invalid solver result (computeValue)");
+    return false;
+  if (!oracle->impl->computeTruth(query.withExpr(NeExpr::create(e, hi)),
+                                  answer))
+    return true;
+  if (answer)
+    return false;
 
+  ref<Expr> inRange;
+  if (isNumber.isNull()) {
+    inRange = AndExpr::create(UleExpr::create(lo, e), UleExpr::create(e, hi));
+  } else {
+    ref<Expr> key = getFloatOrderKey(query.expr);
+    inRange = OrExpr::create(
+        Expr::createIsZero(isNumber),
+        AndExpr::create(UleExpr::create(getFloatOrderKey(min), key),
+                        UleExpr::create(key, getFloatOrderKey(max))));
+  }
+  if (ConstantExpr *ce = dyn_cast<ConstantExpr>(inRange))
+    return ce->isTrue();
+  return !oracle->impl->computeTruth(query.withExpr(inRange), answer) ||
+         answer;
+}
+
+bool ValidatingSolver::computeRange(const Query &query, ref<Expr> &min,
+                                    ref<Expr> &max) {
+  if (!solver->impl->computeRange(query, min, max))
+    return false;
+  if (beginCheck())
+    finishCheck(rangeAgrees(oracle, query, min, max), "computeRange",
+                binlog::Value, query, binlog::NoAnswer);
   return true;
 }
 
-bool ValidatingSolver::computeInitialValues(
-    const Query &query, const std::vector<const Array *> &objects,
-    std::vector<std::vector<unsigned char> > &values, bool &hasSolution) {
+/// uniqueValueAgrees - Whether \a oracle finds \a result to be a value of
+/// the expression of \a query, and its only one exactly when \a isUnique.
+static bool uniqueValueAgrees(Solver *oracle, const Query &query,
+                              const ref<Expr> &result, bool isUnique) {
+  ref<Expr> isValue = createIsValue(query.expr, result);
   bool answer;
+  if (!oracle->impl->computeTruth(query.withExpr(Expr::createIsZero(isValue)),
+                                  answer))
+    return true;
+  if (answer)
+    return false;
+  return !oracle->impl->computeTruth(query.withExpr(isValue), answer) ||
+         isUnique == answer;
+}
 
-  if (!solver->impl->computeInitialValues(query, objects, values, hasSolution))
+bool ValidatingSolver::computeUniqueValue(const Query &query,
+                                          ref<Expr> &result, bool &isUnique) {
+  if (!solver->impl->computeUniqueValue(query, result, isUnique))
     return false;
+  if (beginCheck())
+    finishCheck(uniqueValueAgrees(oracle, query, result, isUnique),
+                "computeUniqueValue", binlog::Value, query,
+                getAnswer(isUnique));
+  return true;
+}
 
-  if (hasSolution) {
-    // Assert the bindings as constraints, and verify that the
-    // conjunction of the actual constraints is satisfiable.
-    std::vector<ref<Expr> > bindings;
-    for (unsigned i = 0; i != values.size(); ++i) {
-      const Array *array = objects[i];
-      assert(array);
-      for (unsigned j = 0; j < array->size; j++) {
-        unsigned char value = values[i][j];
-        bindings.push_back(EqExpr::create(
-            ReadExpr::create(UpdateList(array, 0),
-                             ConstantExpr::alloc(j, array->getDomain())),
-            ConstantExpr::alloc(value, array->getRange())));
-      }
+/// initialValuesAgree - Whether \a oracle finds \a values to be a solution
+/// of \a query, or finds none either when \a hasSolution is false.
+static bool
+initialValuesAgree(Solver *oracle, const Query &query,
+                   const std::vector<const Array *> &objects,
+                   const std::vector<std::vector<unsigned char> > &values,
+                   bool hasSolution) {
+  bool answer;
+  if (!hasSolution)
+    return !oracle->impl->computeTruth(query, answer) || answer;
+
+  // Assert the bindings as constraints, and verify that the
+  // conjunction of the actual constraints is satisfiable.
+  std::vector<ref<Expr> > bindings;
+  for (unsigned i = 0; i != values.size(); ++i) {
+    const Array *array = objects[i];
+    assert(array);
+    for (unsigned j = 0; j < array->size; j++) {
+      unsigned char value = values[i][j];
+      bindings.push_back(EqExpr::create(
+          ReadExpr::create(UpdateList(array, 0),
+                           ConstantExpr::alloc(j, array->getDomain())),
+          ConstantExpr::alloc(value, array->getRange())));
     }
-    ConstraintManager tmp(bindings);
-    ref<Expr> constraints = Expr::createIsZero(query.expr);
-    for (ConstraintManager::const_iterator it = query.constraints.begin(),
-                                           ie = query.constraints.end();
-         it != ie; ++it)
-      constraints = AndExpr::create(constraints, *it);
-
-    if (!oracle->impl->computeTruth(Query(tmp, constraints), answer))
-      return false;
-    if (!answer)
-      assert(0 && "invalid solver result (computeInitialValues)");
-  } else {
-    if (!oracle->impl->computeTruth(query, answer))
-      return false;
-    if (!answer)
-      assert(0 && "invalid solver result (computeInitialValues)");
   }
+  ConstraintManager tmp(bindings);
+  ref<Expr> constraints = Expr::createIsZero(query.expr);
+  for (ConstraintManager::const_iterator it = query.constraints.begin(),
+                                         ie = query.constraints.end();
+       it != ie; ++it)
+    constraints = AndExpr::create(constraints, *it);
+
+  return !oracle->impl->computeTruth(Query(tmp, constraints), answer) ||
+         answer;
+}
 
+bool ValidatingSolver::computeInitialValues(
+    const Query &query, const std::vector<const Array *> &objects,
+    std::vector<std::vector<unsigned char> > &values, bool &hasSolution) {
+  if (!solver->impl->computeInitialValues(query, objects, values, hasSolution))
+    return false;
+  if (beginCheck())
+    finishCheck(
+        initialValuesAgree(oracle, query, objects, values, hasSolution),
+        "computeInitialValues", binlog::InitialValues, query,
+        getAnswer(hasSolution), &objects);
   return true;
 }
 
@@ -136,6 +402,20 @@ void ValidatingSolver::setCoreSolverTimeout(double timeout) {
   solver->impl->setCoreSolverTimeout(timeout);
 }
 
+size_t ValidatingSolver::trimCaches(size_t bytes) {
+  return solver->impl->trimCaches(bytes);
+}
+
+void ValidatingSolver::releaseArrays(const std::vector<const Array *> &arrays) {
+  solver->impl->releaseArrays(arrays);
+  oracle->impl->releaseArrays(arrays);
+}
+
+void ValidatingSolver::interrupt() {
+  solver->impl->interrupt();
+  oracle->impl->interrupt();
+}
+
 Solver *createValidatingSolver(Solver *s, Solver *oracle) {
   return new Solver(new ValidatingSolver(s, oracle));
 }
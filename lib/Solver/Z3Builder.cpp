@@ -14,11 +14,14 @@
 #include "klee/Solver.h"
 #include "klee/util/Bits.h"
 #include "ConstantDivision.h"
+#include "ConstructOrder.h"
 #include "klee/SolverStats.h"
 
 #include "llvm/ADT/StringExtras.h"
 #include "llvm/Support/CommandLine.h"
 
+#include <algorithm>
+#include <map>
 #include <limits>
 
 using namespace klee;
@@ -28,6 +31,150 @@ llvm::cl::opt<bool> UseConstructHashZ3(
     "use-construct-hash-z3",
     llvm::cl::desc("Use hash-consing during Z3 query construction."),
     llvm::cl::init(true));
+
+llvm::cl::opt<bool> NarrowFloatOpsZ3(
+    "z3-narrow-float-ops",
+    llvm::cl::desc("Encode floating-point operations on values widened from "
+                   "a narrower format in that format, where this gives the "
+                   "same result (default=off)."),
+    llvm::cl::init(false));
+
+llvm::cl::opt<unsigned> Z3ConstantTableSize(
+    "z3-constant-table-size",
+    llvm::cl::desc("Encode constant arrays of at least this many bytes as a "
+                   "lookup on the index (a default value with the exceptions "
+                   "stored, or a tree of if-then-elses on the index bits) "
+                   "rather than as one store per byte. Needs Z3 4.8 or later. "
+                   "0 disables (default=0)."),
+    llvm::cl::init(0));
+
+llvm::cl::opt<bool> Z3ScalarizeReads(
+    "z3-scalarize-reads",
+    llvm::cl::desc("Encode the bytes of symbolic arrays which are only read "
+                   "at constant indices as bitvector constants, keeping "
+                   "queries out of the theory of arrays (default=on)."),
+    llvm::cl::init(true));
+
+const llvm::fltSemantics *fpWidthToSemantics(unsigned width) {
+  switch (width) {
+  case Expr::Fl32: return &llvm::APFloat::IEEEsingle;
+  case Expr::Fl64: return &llvm::APFloat::IEEEdouble;
+  case Expr::Fl80: return &llvm::APFloat::x87DoubleExtended;
+  default: return 0;
+  }
+}
+
+/// narrowFloat - Return \a e as a value of the narrower float width \a width,
+/// if it can only ever hold such values, or null.
+ref<Expr> narrowFloat(const ref<Expr> &e, Expr::Width width) {
+  if (e->getWidth() == width)
+    return e;
+  if (e->getWidth() < width)
+    return 0;
+
+  if (const FExtExpr *fe = dyn_cast<FExtExpr>(e)) {
+    // Widening is exact, whatever the rounding mode.
+    Expr::Width srcWidth = fe->src->getWidth();
+    if (srcWidth > fe->getWidth() || !fpWidthToSemantics(srcWidth))
+      return 0;
+    if (srcWidth < width)
+      return FExtExpr::create(fe->src, width,
+                              llvm::APFloat::rmNearestTiesToEven);
+    return narrowFloat(fe->src, width);
+  }
+
+  if (const FConstantExpr *ce = dyn_cast<FConstantExpr>(e)) {
+    llvm::APFloat v = ce->getAPValue();
+    if (v.isNaN())
+      return 0;
+    if (ce->getWidth() == Expr::Fl80) {
+      // Unnormal and pseudo-denormal values have no narrower equivalent.
+      const uint64_t *raw = v.bitcastToAPInt().getRawData();
+      if (((raw[1] & 0x7FFF) == 0) != ((raw[0] >> 63) == 0))
+        return 0;
+    }
+    bool losesInfo;
+    v.convert(*fpWidthToSemantics(width), llvm::APFloat::rmNearestTiesToEven,
+              &losesInfo);
+    if (losesInfo)
+      return 0;
+    return FConstantExpr::alloc(v);
+  }
+
+  return 0;
+}
+
+/// narrowFloatExpr - Return an expression computing exactly the same value
+/// as \a e with its floating-point operation done in a narrower format, or
+/// null. Narrower formats are much cheaper to bit-blast, above all for
+/// remainders and for the x87 format.
+ref<Expr> narrowFloatExpr(const ref<Expr> &e) {
+  static const Expr::Width widths[] = { Expr::Fl32, Expr::Fl64 };
+  Expr::Kind k = e->getKind();
+
+  if ((k >= Expr::FOrd && k <= Expr::FOne) || k == Expr::FRem) {
+    // Comparisons give the same answer in any format holding both operands.
+    // So does the remainder, which is always exact: the result is
+    // representable in the format of the operands.
+    Expr::Width width = e->getKid(0)->getWidth();
+    for (unsigned i = 0; i != 2 && widths[i] < width; ++i) {
+      ref<Expr> kids[2] = { narrowFloat(e->getKid(0), widths[i]),
+                            narrowFloat(e->getKid(1), widths[i]) };
+      if (kids[0].isNull() || kids[1].isNull())
+        continue;
+      ref<Expr> narrow = e->rebuild(kids);
+      if (k != Expr::FRem)
+        return narrow;
+      return FExtExpr::create(narrow, width,
+                              llvm::APFloat::rmNearestTiesToEven);
+    }
+    return 0;
+  }
+
+  if (k == Expr::FExt) {
+    // Rounding to precision p a result correctly rounded to precision
+    // p' >= 2p + 2 gives the result correctly rounded to p (double rounding
+    // is innocuous for these operations), so float operations computed in
+    // double or long double can be computed in float.
+    const FExtExpr *fe = cast<FExtExpr>(e);
+    const ref<Expr> &op = fe->src;
+    if (fe->getRoundingMode() != llvm::APFloat::rmNearestTiesToEven)
+      return 0;
+    const llvm::fltSemantics *narrow = fpWidthToSemantics(fe->getWidth());
+    const llvm::fltSemantics *wide = fpWidthToSemantics(op->getWidth());
+    if (!narrow || !wide ||
+        llvm::APFloat::semanticsPrecision(*wide) <
+            2 * llvm::APFloat::semanticsPrecision(*narrow) + 2)
+      return 0;
+
+    llvm::APFloat::roundingMode rm;
+    switch (op->getKind()) {
+    case Expr::FAdd:
+    case Expr::FSub:
+    case Expr::FMul:
+    case Expr::FDiv:
+      rm = cast<FBinaryRoundExpr>(op)->getRoundingMode();
+      break;
+    case Expr::FSqrt:
+      rm = cast<FUnaryRoundExpr>(op)->getRoundingMode();
+      break;
+    default:
+      return 0;
+    }
+    if (rm != llvm::APFloat::rmNearestTiesToEven)
+      return 0;
+
+    ref<Expr> kids[2];
+    for (unsigned i = 0; i != op->getNumKids(); ++i) {
+      kids[i] = narrowFloat(op->getKid(i), fe->getWidth());
+      if (kids[i].isNull())
+        return 0;
+    }
+    return op->rebuild(kids);
+  }
+
+  return 0;
+}
 }
 
 void custom_z3_error_handler(Z3_context ctx, Z3_error_code ec) {
@@ -58,7 +205,8 @@ void Z3ArrayExprHash::clear() {
 }
 
 Z3Builder::Z3Builder(bool autoClearConstructCache)
-    : autoClearConstructCache(autoClearConstructCache) {
+    : constructGeneration(0), constructingKids(false), numScalarReads(0),
+      autoClearConstructCache(autoClearConstructCache) {
   // FIXME: Should probably let the client pass in a Z3_config instead
   Z3_config cfg = Z3_mk_config();
   // It is very important that we ask Z3 to let us manage memory so that
@@ -69,6 +217,8 @@ Z3Builder::Z3Builder(bool autoClearConstructCache)
   // When emitting Z3 expressions make them SMT-LIBv2 compliant
   Z3_set_ast_print_mode(ctx, Z3_PRINT_SMTLIB2_COMPLIANT);
   Z3_del_config(cfg);
+  roundNearestTiesToEven = Z3_mk_fpa_round_nearest_ties_to_even(ctx);
+  Z3_inc_ref(ctx, roundNearestTiesToEven);
 }
 
 Z3Builder::~Z3Builder() {
@@ -76,9 +226,47 @@ Z3Builder::~Z3Builder() {
   // they aren associated with.
   clearConstructCache();
   _arr_hash.clear();
+  scalarReads.clear();
+  Z3_dec_ref(ctx, roundNearestTiesToEven);
   Z3_del_context(ctx);
 }
 
+void Z3Builder::trimConstructCache(size_t maxEntries) {
+  ++constructGeneration;
+  if (constructed.size() <= maxEntries)
+    return;
+  if (maxEntries == 0) {
+    clearConstructCache();
+    return;
+  }
+
+  // Evict down to three quarters of the budget so that a cache which is
+  // hovering around its limit is not trimmed after every single query.
+  size_t target = maxEntries - maxEntries / 4;
+  size_t toEvict = constructed.size() - target;
+  std::vector<unsigned> generations;
+  generations.reserve(constructed.size());
+  for (ExprHashMap<ConstructCacheEntry>::const_iterator
+           it = constructed.begin(),
+           ie = constructed.end();
+       it != ie; ++it)
+    generations.push_back(it->second.generation);
+  std::nth_element(generations.begin(), generations.begin() + (toEvict - 1),
+                   generations.end());
+  unsigned cutoff = generations[toEvict - 1];
+
+  for (ExprHashMap<ConstructCacheEntry>::iterator it = constructed.begin(),
+                                                  ie = constructed.end();
+       it != ie;) {
+    if (it->second.generation <= cutoff) {
+      constructed.erase(it++);
+      ++stats::queryConstructCacheEvictions;
+    } else {
+      ++it;
+    }
+  }
+}
+
 Z3SortHandle Z3Builder::getBvSort(unsigned width) {
   // FIXME: cache these
   return Z3SortHandle(Z3_mk_bv_sort(ctx, width), ctx);
@@ -345,7 +533,7 @@ Z3_ast Z3Builder::getRoundingModeAST(llvm::APFloat::roundingMode rm) {
   switch (rm) {
   default:
   case llvm::APFloat::rmNearestTiesToEven:
-    return Z3_mk_fpa_round_nearest_ties_to_even(ctx);
+    return roundNearestTiesToEven;
   case llvm::APFloat::rmTowardPositive:
     return Z3_mk_fpa_round_toward_positive(ctx);
   case llvm::APFloat::rmTowardNegative:
@@ -424,8 +612,8 @@ Z3ASTHandle Z3Builder::getInitialArray(const Array *root) {
 
   if (!hashed) {
     // Unique arrays by name, so we make sure the name is unique by
-    // using the size of the array hash as a counter.
-    std::string unique_id = llvm::itostr(_arr_hash._array_hash.size());
+    // using the number of arrays hashed as a counter.
+    std::string unique_id = llvm::itostr(_arr_hash.getNumArraysHashed());
     unsigned const uid_length = unique_id.length();
     unsigned const space = (root->name.length() > 32 - uid_length)
                                ? (32 - uid_length)
@@ -435,7 +623,24 @@ Z3ASTHandle Z3Builder::getInitialArray(const Array *root) {
     array_expr = buildArray(unique_name.c_str(), root->getDomain(),
                             root->getRange());
 
-    if (root->isConstantArray()) {
+#ifdef HAVE_Z3_MK_LAMBDA
+    if (root->isConstantArray() && Z3ConstantTableSize &&
+        root->size >= Z3ConstantTableSize) {
+      array_expr = buildConstantTable(root, array_expr);
+    } else
+#endif
+    if (!root->isConstantArray()) {
+      // Bytes read before as constants are the array's from now on.
+      std::map<const Array *, std::map<unsigned, Z3ASTHandle> >::iterator it =
+          scalarReads.find(root);
+      if (it != scalarReads.end())
+        for (std::map<unsigned, Z3ASTHandle>::iterator
+               sit = it->second.begin(), sie = it->second.end();
+             sit != sie; ++sit)
+          array_expr = writeExpr(array_expr,
+                                 bvConst32(root->getDomain(), sit->first),
+                                 sit->second);
+    } else {
       // FIXME: Flush the concrete values into Z3. Ideally we would do this
       // using assertions, which might be faster, but we need to fix the caching
       // to work correctly in that case.
@@ -453,28 +658,124 @@ Z3ASTHandle Z3Builder::getInitialArray(const Array *root) {
   return (array_expr);
 }
 
+#ifdef HAVE_Z3_MK_LAMBDA
+/// buildConstantTable - Encode the constant array \a root as a function of
+/// the index rather than as a chain of stores. Reads in bounds look the value
+/// up, the others read \a base, as they would without the stores.
+Z3ASTHandle Z3Builder::buildConstantTable(const Array *root,
+                                          Z3ASTHandle base) {
+  // The most common value, which mostly uniform tables are filled with.
+  std::map<uint64_t, unsigned> counts;
+  uint64_t fill = 0;
+  unsigned fillCount = 0;
+  for (unsigned i = 0, e = root->size; i != e; ++i) {
+    uint64_t value = root->constantValues[i]->getZExtValue();
+    unsigned count = ++counts[value];
+    if (count > fillCount) {
+      fill = value;
+      fillCount = count;
+    }
+  }
+
+  Z3SortHandle domainSort = getBvSort(root->getDomain());
+  Z3ASTHandle index(
+      Z3_mk_const(ctx, Z3_mk_string_symbol(ctx, "klee_table_index"),
+                  domainSort),
+      ctx);
+  Z3ASTHandle lookup;
+  if ((root->size - fillCount) * 8 <= root->size) {
+    // Few exceptions: store them over an array of the fill value.
+    Z3ASTHandle table(
+        Z3_mk_const_array(ctx, domainSort,
+                          bvConst64(root->getRange(), fill)),
+        ctx);
+    for (unsigned i = 0, e = root->size; i != e; ++i)
+      if (root->constantValues[i]->getZExtValue() != fill)
+        table = writeExpr(table, bvConst32(root->getDomain(), i),
+                          construct(root->constantValues[i], 0));
+    lookup = readExpr(table, index);
+  } else {
+    unsigned bits = 0;
+    while (((uint64_t)1 << bits) < root->size)
+      ++bits;
+    lookup = buildTableTree(root, index, 0, bits);
+  }
+
+  Z3ASTHandle body =
+      iteExpr(bvLtExpr(index, bvConst32(root->getDomain(), root->size)),
+              lookup, readExpr(base, index));
+  Z3_app bound = Z3_to_app(ctx, index);
+  return Z3ASTHandle(Z3_mk_lambda_const(ctx, 1, &bound, body), ctx);
+}
+
+/// buildTableTree - Look \a index up in the entries of \a root from \a lo
+/// to \a lo + 2^\a bits, given that it is within them, branching on one
+/// index bit at a time. Runs of equal entries take a single leaf.
+Z3ASTHandle Z3Builder::buildTableTree(const Array *root, Z3ASTHandle index,
+                                      uint64_t lo, unsigned bits) {
+  uint64_t hi = std::min((uint64_t)root->size, lo + ((uint64_t)1 << bits));
+  const ref<ConstantExpr> &first = root->constantValues[lo];
+  uint64_t i = lo + 1;
+  while (i != hi && root->constantValues[i]->getZExtValue() ==
+                        first->getZExtValue())
+    ++i;
+  if (i == hi)
+    return construct(first, 0);
+
+  uint64_t half = lo + ((uint64_t)1 << (bits - 1));
+  if (half >= root->size)
+    return buildTableTree(root, index, lo, bits - 1);
+  return iteExpr(eqExpr(bvExtract(index, bits - 1, bits - 1), bvOne(1)),
+                 buildTableTree(root, index, half, bits - 1),
+                 buildTableTree(root, index, lo, bits - 1));
+}
+#endif
+
 Z3ASTHandle Z3Builder::getInitialRead(const Array *root, unsigned index) {
+  if (Z3ScalarizeReads && !root->isConstantArray() && !hasArrayTerm(root))
+    return getScalarRead(root, index);
   return readExpr(getInitialArray(root), bvConst32(32, index));
 }
 
+/// getScalarRead - The constant standing for byte \a index of the symbolic
+/// array \a root, which has no array term yet. Should one be built, it
+/// stores the constants made so far, so that reads through it and the
+/// constants agree; no more are made then.
+Z3ASTHandle Z3Builder::getScalarRead(const Array *root, unsigned index) {
+  Z3ASTHandle &res = scalarReads[root][index];
+  if (!res) {
+    std::string name = root->name.substr(0, 24) + "[" +
+                       llvm::utostr(index) + "]" +
+                       llvm::utostr(numScalarReads++);
+    res = Z3ASTHandle(Z3_mk_const(ctx, Z3_mk_string_symbol(ctx, name.c_str()),
+                                  getBvSort(root->getRange())),
+                      ctx);
+  }
+  return res;
+}
+
 Z3ASTHandle Z3Builder::getArrayForUpdate(const Array *root,
                                          const UpdateNode *un) {
-  if (!un) {
-    return (getInitialArray(root));
-  } else {
-    // FIXME: This really needs to be non-recursive.
-    Z3ASTHandle un_expr;
-    bool hashed = _arr_hash.lookupUpdateNodeExpr(un, un_expr);
-
-    if (!hashed) {
-      un_expr = writeExpr(getArrayForUpdate(root, un->next),
-                          construct(un->index, 0), construct(un->value, 0));
-
-      _arr_hash.hashUpdateNodeExpr(un, un_expr);
-    }
+  // Start from the newest update already built, or the initial array, and
+  // write the others over it oldest first.
+  std::vector<const UpdateNode *> pending;
+  Z3ASTHandle un_expr;
+  for (; un; un = un->next) {
+    if (_arr_hash.lookupUpdateNodeExpr(un, un_expr))
+      break;
+    pending.push_back(un);
+  }
+  if (!un)
+    un_expr = getInitialArray(root);
 
-    return (un_expr);
+  for (std::vector<const UpdateNode *>::reverse_iterator it = pending.rbegin(),
+                                                         ie = pending.rend();
+       it != ie; ++it) {
+    un_expr = writeExpr(un_expr, construct((*it)->index, 0),
+                        construct((*it)->value, 0));
+    _arr_hash.hashUpdateNodeExpr(*it, un_expr);
   }
+  return un_expr;
 }
 
 /** if *width_out!=1 then result is a bitvector,
@@ -485,18 +786,26 @@ Z3ASTHandle Z3Builder::construct(ref<Expr> e, int *width_out) {
   if (!UseConstructHashZ3 || isa<ConstantExpr>(e)) {
     return constructActual(e, width_out);
   } else {
-    ExprHashMap<std::pair<Z3ASTHandle, unsigned> >::iterator it =
-        constructed.find(e);
+    ExprHashMap<ConstructCacheEntry>::iterator it = constructed.find(e);
     if (it != constructed.end()) {
+      ++stats::queryConstructCacheHits;
+      it->second.generation = constructGeneration;
       if (width_out)
-        *width_out = it->second.second;
-      return it->second.first;
+        *width_out = it->second.width;
+      return it->second.ast;
     } else {
+      ++stats::queryConstructCacheMisses;
+      if (!constructingKids) {
+        constructingKids = true;
+        constructKidsFirst(*this, e);
+        constructingKids = false;
+      }
       int width;
       if (!width_out)
         width_out = &width;
       Z3ASTHandle res = constructActual(e, width_out);
-      constructed.insert(std::make_pair(e, std::make_pair(res, *width_out)));
+      constructed.insert(std::make_pair(
+          e, ConstructCacheEntry(res, *width_out, constructGeneration)));
       return res;
     }
   }
@@ -511,6 +820,12 @@ Z3ASTHandle Z3Builder::constructActual(ref<Expr> e, int *width_out) {
 
   ++stats::queryConstructs;
 
+  if (NarrowFloatOpsZ3) {
+    ref<Expr> narrow = narrowFloatExpr(e);
+    if (!narrow.isNull())
+      return construct(narrow, width_out);
+  }
+
   switch (e->getKind()) {
   case Expr::Constant: {
     ConstantExpr *CE = cast<ConstantExpr>(e);
@@ -588,8 +903,15 @@ Z3ASTHandle Z3Builder::constructActual(ref<Expr> e, int *width_out) {
   case Expr::Read: {
     ReadExpr *re = cast<ReadExpr>(e);
     assert(re && re->updates.root);
-    *width_out = re->updates.root->getRange();
-    return readExpr(getArrayForUpdate(re->updates.root, re->updates.head),
+    const Array *root = re->updates.root;
+    *width_out = root->getRange();
+    // Initial bytes of symbolic arrays at constant indices are plain
+    // variables, until the array is needed as such.
+    if (!re->updates.head)
+      if (ConstantExpr *CE = dyn_cast<ConstantExpr>(re->index))
+        if (CE->getZExtValue() < root->size)
+          return getInitialRead(root, CE->getZExtValue());
+    return readExpr(getArrayForUpdate(root, re->updates.head),
                     construct(re->index, 0));
   }
 
@@ -1455,6 +1777,34 @@ Z3ASTHandle Z3Builder::constructActual(ref<Expr> e, int *width_out) {
     }
   }
 
+  case Expr::FFma: {
+    FFmaExpr *fe = cast<FFmaExpr>(e);
+    Z3ASTHandle left = construct(fe->left, width_out);
+    Z3ASTHandle right = construct(fe->right, width_out);
+    Z3ASTHandle addend = construct(fe->addend, width_out);
+
+    assert((*width_out == Expr::Fl32 || *width_out == Expr::Fl64 || *width_out == Expr::Fl80) && "non-float argument to FFma");
+
+    if (*width_out == Expr::Fl80)
+    {
+      Z3SortHandle sort = Z3SortHandle(Z3_mk_fpa_sort(ctx, 15, 64), ctx);
+      Z3ASTHandle wrongHiddenBit = orExpr(orExpr(isNanExpr(readExpr(left, bvOne(1))), isNanExpr(readExpr(right, bvOne(1)))), isNanExpr(readExpr(addend, bvOne(1))));
+      left = readExpr(left, bvZero(1));
+      right = readExpr(right, bvZero(1));
+      addend = readExpr(addend, bvZero(1));
+      Z3ASTHandle result = iteExpr(wrongHiddenBit, fpNan(sort), Z3ASTHandle(Z3_mk_fpa_fma(ctx, getRoundingModeAST(fe->getRoundingMode()), left, right, addend), ctx));
+      Z3ASTHandle arr = Z3ASTHandle(Z3_mk_const(ctx, Z3_mk_string_symbol(ctx, "[F80, unnormal]"), getArraySort(getBvSort(1), sort)), ctx);
+      arr = writeExpr(arr, bvZero(1), result);
+      arr = writeExpr(arr, bvOne(1), fpZero(sort));
+      return arr;
+    }
+    else
+    {
+      Z3ASTHandle result = Z3ASTHandle(Z3_mk_fpa_fma(ctx, getRoundingModeAST(fe->getRoundingMode()), left, right, addend), ctx);
+      return result;
+    }
+  }
+
   // Comparison
 
   case Expr::Eq: {
@@ -15,6 +15,8 @@
 #include "klee/Config/config.h"
 #include <z3.h>
 
+#include <map>
+
 namespace klee {
 
 template <typename T> class Z3NodeHandle {
@@ -106,8 +108,32 @@ public:
 };
 
 class Z3Builder {
-  ExprHashMap<std::pair<Z3ASTHandle, unsigned> > constructed;
+  /// An entry of the construction cache. ``generation`` is the value of
+  /// ``constructGeneration`` when the entry was last used, which lets
+  /// ``trimConstructCache()`` evict the least recently used entries.
+  struct ConstructCacheEntry {
+    Z3ASTHandle ast;
+    unsigned width;
+    unsigned generation;
+
+    ConstructCacheEntry(const Z3ASTHandle &_ast, unsigned _width,
+                        unsigned _generation)
+        : ast(_ast), width(_width), generation(_generation) {}
+  };
+
+  ExprHashMap<ConstructCacheEntry> constructed;
+  unsigned constructGeneration;
   Z3ArrayExprHash _arr_hash;
+  /// Whether the kids of the expression being constructed are being
+  /// constructed first.
+  bool constructingKids;
+  /// The round-to-nearest-even rounding mode, which almost every
+  /// floating-point operation uses, built once per context.
+  Z3_ast roundNearestTiesToEven;
+  /// The bitvector constants standing for the bytes of symbolic arrays read
+  /// at constant indices only, by array and index. See getScalarRead().
+  std::map<const Array *, std::map<unsigned, Z3ASTHandle> > scalarReads;
+  unsigned numScalarReads;
 
 private:
   Z3ASTHandle bvOne(unsigned width);
@@ -175,12 +201,28 @@ private:
   Z3ASTHandle constructAShrByConstant(Z3ASTHandle expr, unsigned shift,
                                       Z3ASTHandle isSigned);
 
-  Z3ASTHandle getInitialArray(const Array *os);
+  Z3ASTHandle buildConstantTable(const Array *root, Z3ASTHandle base);
+  Z3ASTHandle buildTableTree(const Array *root, Z3ASTHandle index,
+                             uint64_t lo, unsigned bits);
   Z3ASTHandle getArrayForUpdate(const Array *root, const UpdateNode *un);
+  Z3ASTHandle getScalarRead(const Array *root, unsigned index);
 
   Z3ASTHandle constructActual(ref<Expr> e, int *width_out);
   Z3ASTHandle construct(ref<Expr> e, int *width_out);
 
+  // Hooks for constructKidsFirst().
+  template <class Builder>
+  friend void constructKidsFirst(Builder &builder, const ref<Expr> &root);
+  bool isConstructed(const ref<Expr> &e) {
+    return isa<ConstantExpr>(e) || constructed.count(e);
+  }
+  bool isConstructed(const UpdateNode *un) {
+    Z3ASTHandle tmp;
+    return _arr_hash.lookupUpdateNodeExpr(un, tmp);
+  }
+  bool constructsKids(const ref<Expr> &e) { return true; }
+  void constructAndCache(const ref<Expr> &e) { construct(e, 0); }
+
   Z3ASTHandle buildArray(const char *name, unsigned indexWidth,
                          unsigned valueWidth);
 
@@ -196,8 +238,16 @@ public:
 
   Z3ASTHandle getTrue();
   Z3ASTHandle getFalse();
+  Z3ASTHandle getInitialArray(const Array *os);
   Z3ASTHandle getInitialRead(const Array *os, unsigned index);
 
+  /// hasArrayTerm - Whether \a root is encoded as a Z3 array, rather than
+  /// only as constants for the bytes read.
+  bool hasArrayTerm(const Array *root) {
+    Z3ASTHandle tmp;
+    return _arr_hash.lookupArrayExpr(root, tmp);
+  }
+
   Z3ASTHandle construct(ref<Expr> e) {
     Z3ASTHandle res = construct(e, 0);
     if (autoClearConstructCache)
@@ -206,6 +256,20 @@ public:
   }
 
   void clearConstructCache() { constructed.clear(); }
+
+  /// Forget the arrays built for \p arrays, which are about to be freed.
+  void releaseArrays(const std::vector<const Array *> &arrays) {
+    _arr_hash.releaseArrays(arrays);
+    for (std::vector<const Array *>::const_iterator it = arrays.begin(),
+                                                    ie = arrays.end();
+         it != ie; ++it)
+      scalarReads.erase(*it);
+  }
+
+  /// Start a new cache generation and, if the construction cache holds more
+  /// than \p maxEntries expressions, evict the least recently used ones.
+  /// A \p maxEntries of zero clears the cache.
+  void trimConstructCache(size_t maxEntries);
 };
 }
 
@@ -13,13 +13,233 @@
 #include "klee/Constraints.h"
 #include "klee/Solver.h"
 #include "klee/SolverImpl.h"
+#include "klee/SolverStats.h"
+#include "klee/Internal/ADT/MapOfSets.h"
+#include "klee/Internal/Support/BinaryQueryLog.h"
+#include "klee/util/ArrayCache.h"
 #include "klee/util/Assignment.h"
 #include "klee/util/ExprUtil.h"
 
+#include "llvm/Support/CommandLine.h"
+#include "llvm/Support/Errno.h"
 #include "llvm/Support/ErrorHandling.h"
+#include "llvm/Support/raw_ostream.h"
+
+#include <algorithm>
+#include <map>
+#include <set>
+
+#include <errno.h>
+#include <stdlib.h>
+#include <poll.h>
+#include <signal.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/ipc.h>
+#include <sys/resource.h>
+#include <sys/shm.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+#include <pthread.h>
+
+namespace {
+llvm::cl::opt<bool> Z3IncrementalSolving(
+    "z3-incremental",
+    llvm::cl::desc("Keep a single Z3 solver alive across queries and use "
+                   "push/pop so that only the constraints which differ from "
+                   "the previous query are asserted (default=off)"),
+    llvm::cl::init(false));
+
+llvm::cl::opt<unsigned> Z3IncrementalSessions(
+    "z3-incremental-sessions",
+    llvm::cl::desc("With -z3-incremental, the number of Z3 solvers kept "
+                   "alive, each with the constraints of a different subtree "
+                   "of states asserted. A query goes to the one sharing the "
+                   "longest constraint prefix with it, or, if it would "
+                   "retract most of that prefix, to a new one replacing the "
+                   "least recently used (default=1)"),
+    llvm::cl::init(1));
+
+llvm::cl::opt<unsigned> Z3ConstructCacheSize(
+    "z3-construct-cache-size",
+    llvm::cl::desc("Maximum number of expressions whose Z3 translation is "
+                   "kept between queries. The least recently used entries "
+                   "are evicted first. 0 clears the cache after every query "
+                   "(default=0)"),
+    llvm::cl::init(0));
+
+llvm::cl::opt<bool> Z3UnsatCoreCache(
+    "z3-unsat-core-cache",
+    llvm::cl::desc("Track the assertions of each query and remember the "
+                   "unsatisfiable core of every valid one. Queries whose "
+                   "constraints and negated expression include a known core "
+                   "are answered without calling Z3 (default=off)"),
+    llvm::cl::init(false));
+
+llvm::cl::opt<bool> Z3TacticSelection(
+    "z3-tactic-selection",
+    llvm::cl::desc("Classify each query by the theories it uses and solve it "
+                   "with the Z3 tactic given for that class by "
+                   "-z3-bv-tactic, -z3-array-tactic, -z3-fp-tactic and "
+                   "-z3-mixed-tactic. Not used with -z3-incremental "
+                   "(default=off)"),
+    llvm::cl::init(false));
+
+llvm::cl::opt<std::string> Z3BVTactic(
+    "z3-bv-tactic",
+    llvm::cl::desc("Comma-separated Z3 tactics applied in sequence to "
+                   "bit-vector queries that only read at constant indices. "
+                   "Empty uses Z3's default solver (default=qfbv)"),
+    llvm::cl::init("qfbv"));
+
+llvm::cl::opt<std::string> Z3ArrayTactic(
+    "z3-array-tactic",
+    llvm::cl::desc("Comma-separated Z3 tactics for bit-vector queries that "
+                   "read or write at symbolic indices. Empty uses Z3's "
+                   "default solver (default=empty)"),
+    llvm::cl::init(""));
+
+llvm::cl::opt<std::string> Z3FPTactic(
+    "z3-fp-tactic",
+    llvm::cl::desc("Comma-separated Z3 tactics for floating-point queries "
+                   "that only read at constant indices. Empty uses Z3's "
+                   "default solver (default=simplify,ackermannize_bv,fpa2bv,"
+                   "simplify,bit-blast,sat)"),
+    llvm::cl::init("simplify,ackermannize_bv,fpa2bv,simplify,bit-blast,sat"));
+
+llvm::cl::opt<std::string> Z3MixedTactic(
+    "z3-mixed-tactic",
+    llvm::cl::desc("Comma-separated Z3 tactics for floating-point queries "
+                   "that also read or write at symbolic indices. Empty uses "
+                   "Z3's default solver (default=empty)"),
+    llvm::cl::init(""));
+
+llvm::cl::opt<bool> Z3ModelHints(
+    "z3-model-hints",
+    llvm::cl::desc("Try floating-point queries first under the assumption "
+                   "that the bytes of their arrays keep the values of the "
+                   "last counterexample Z3 computed, and only solve them "
+                   "from scratch if that fails (default=off)"),
+    llvm::cl::init(false));
+
+llvm::cl::opt<bool> Z3OptimizeRanges(
+    "z3-optimize-ranges",
+    llvm::cl::desc("Compute the range of an expression (for "
+                   "klee_print_range() and symbolic pointers) with a single "
+                   "Z3 optimization query minimizing and maximizing it, "
+                   "instead of a binary search of queries (default=on)"),
+    llvm::cl::init(true));
+
+llvm::cl::opt<unsigned> Z3ContextPoolSize(
+    "z3-context-pool-size",
+    llvm::cl::desc("Maximum number of Z3 contexts, each with a builder of "
+                   "its own, that batches of independent queries are solved "
+                   "on. With atomic reference counts the contexts run in "
+                   "parallel (default=4)"),
+    llvm::cl::init(4));
+
+llvm::cl::opt<double> Z3CubeThreshold(
+    "z3-cube-threshold",
+    llvm::cl::desc("Split floating-point queries Z3 has not solved after "
+                   "this many seconds into cubes over the classes (NaN, "
+                   "zero, sign and magnitude) of their most used floats, "
+                   "and solve the cubes on the context pool, in parallel "
+                   "with atomic reference counts (default=0 (off))"),
+    llvm::cl::init(0));
+
+llvm::cl::opt<unsigned> Z3ContextMemoryBudget(
+    "z3-context-memory-budget",
+    llvm::cl::desc("Replace the Z3 context, and the caches of its builder, "
+                   "once Z3 uses this many megabytes more than it did after "
+                   "the previous replacement. The new context is built with "
+                   "the constraints of the latest query, in the background "
+                   "with atomic reference counts (default=0 (off))"),
+    llvm::cl::init(0));
+
+llvm::cl::opt<unsigned> Z3ServerMemoryLimit(
+    "z3-server-memory-limit",
+    llvm::cl::desc("Address space limit in megabytes of the process running "
+                   "Z3 with -use-forked-solver. 0 is no limit (default=0)"),
+    llvm::cl::init(0));
+}
+
+// Darwin by default has a very small limit on the maximum amount of shared
+// memory, see STPSolver.cpp.
+#ifdef __APPLE__
+static const unsigned z3SharedMemorySize = 1 << 16;
+#else
+static const unsigned z3SharedMemorySize = 1 << 20;
+#endif
+
+namespace {
+/// The classes of queries that -z3-tactic-selection solves with different
+/// Z3 strategies.
+enum QueryShape {
+  QS_BitVector, ///< Bit-vectors, reads at constant indices only.
+  QS_Array,     ///< Bit-vectors with reads or writes at symbolic indices.
+  QS_Float,     ///< Floating point, reads at constant indices only.
+  QS_Mixed,     ///< Floating point with reads or writes at symbolic indices.
+  QS_NumShapes
+};
+
+/// Z3ServerRequest - What the solver server finds at the start of the shared
+/// memory region, followed by room for the values of the objects.
+struct Z3ServerRequest {
+  double timeout;
+};
+
+/// Z3ServerResponse - What the solver server answers each query with; the
+/// values of the objects, if any, are left in the shared memory region.
+struct Z3ServerResponse {
+  int status;
+  bool hasSolution;
+};
+}
 
 namespace klee {
 
+/// Z3PoolContext - A Z3 context with a builder and array hash of its own.
+/// The queries of a batch are spread over such contexts, so that they can be
+/// solved at the same time.
+struct Z3PoolContext {
+  Z3Builder *builder;
+  ::Z3_params solverParameters;
+  ::Z3_symbol timeoutParamStrSymbol;
+
+  Z3PoolContext() : builder(new Z3Builder(/*autoClearConstructCache=*/false)) {
+    solverParameters = Z3_mk_params(builder->ctx);
+    Z3_params_inc_ref(builder->ctx, solverParameters);
+    timeoutParamStrSymbol = Z3_mk_string_symbol(builder->ctx, "timeout");
+  }
+
+  ~Z3PoolContext() {
+    Z3_params_dec_ref(builder->ctx, solverParameters);
+    delete builder;
+  }
+
+  void setTimeout(unsigned timeoutInMilliSeconds) {
+    Z3_params_set_uint(builder->ctx, solverParameters, timeoutParamStrSymbol,
+                       timeoutInMilliSeconds);
+  }
+
+  SolverImpl::SolverRunStatus
+  solve(const Query &query, const std::vector<const Array *> *objects,
+        std::vector<std::vector<unsigned char> > *values, bool &hasSolution);
+};
+
+/// Z3ContextWarmer - A builder for a new context, and the expressions it is
+/// to have built before it replaces the context of the solver. ``thread``
+/// builds it unless ``threaded`` is false; it only exists in ``owner``.
+struct Z3ContextWarmer {
+  std::vector<ref<Expr> > exprs;
+  Z3Builder *builder;
+  volatile bool done;
+  bool threaded;
+  pthread_t thread;
+  pid_t owner;
+};
+
 class Z3SolverImpl : public SolverImpl {
 private:
   Z3Builder *builder;
@@ -28,14 +248,138 @@ private:
   ::Z3_params solverParameters;
   // Parameter symbols
   ::Z3_symbol timeoutParamStrSymbol;
+  unsigned timeoutInMilliSeconds;
+
+  // Contexts for solving batches of independent queries, created on first
+  // use and kept for later batches.
+  std::vector<Z3PoolContext *> contextPool;
+
+  // Incremental solving state (only used with ``-z3-incremental``).
+  // The solver of a session has exactly one backtracking point per entry
+  // in its ``asserted`` constraints, so that entry ``i`` can be retracted
+  // by popping ``asserted.size() - i`` scopes. Sibling states share the
+  // prefix of the node they forked at, so each session serves a subtree.
+  struct IncrementalSession {
+    ::Z3_solver solver;
+    std::vector<ref<Expr> > asserted;
+    uint64_t lastUse;
+  };
+  std::vector<IncrementalSession> incrementalSessions;
+  // The session of the last query, and the number of queries so far.
+  unsigned currentSession;
+  uint64_t sessionClock;
+
+  ::Z3_solver getIncrementalSolver(const ConstraintManager &constraints);
+  /// resetIncrementalSolver - Drop the session of the last query, whose
+  /// solver is in an unknown state after a failure.
+  void resetIncrementalSolver();
+  void resetIncrementalSolvers();
+
+  // UNSAT core cache state (only used with ``-z3-unsat-core-cache``). The
+  // ``i``-th constraint of a query is tracked by ``coreTrackers[i]`` and its
+  // negated expression by the tracker after the last constraint, so a
+  // solver never has two assertions with the same tracker in scope.
+  // ``unsatCores`` holds the assertions of every core seen so far.
+  std::vector<Z3ASTHandle> coreTrackers;
+  std::map<unsigned, unsigned> coreTrackerIndex; // Z3 AST id -> tracker
+  MapOfSets<ref<Expr>, bool> unsatCores;
+
+  void assertExpr(::Z3_solver theSolver, Z3ASTHandle e, unsigned index);
+  bool lookupUnsatCore(const ConstraintManager &constraints,
+                       ref<Expr> queryExpr);
+  void recordUnsatCore(::Z3_solver theSolver,
+                       const ConstraintManager &constraints,
+                       ref<Expr> queryExpr);
+
+  // Tactic selection state (only used with ``-z3-tactic-selection``). A
+  // null entry solves the shape with Z3's default solver.
+  ::Z3_tactic shapeTactics[QS_NumShapes];
+
+  ::Z3_tactic createTactic(const std::string &tactics, const char *option);
+  QueryShape classifyQuery(const ConstraintManager &constraints,
+                           const std::vector<ref<Expr> > &exprs,
+                           std::set<const Array *> *arrays = NULL);
+  ::Z3_solver createSolver(QueryShape shape);
+
+  // Model hint state (only used with ``-z3-model-hints``): the bytes of
+  // every array in the most recent counterexample.
+  std::map<const Array *, std::vector<unsigned char> > lastModel;
+
+  ::Z3_lbool checkWithModelHints(::Z3_solver theSolver, QueryShape shape,
+                                 const std::set<const Array *> &arrays);
 
   bool internalRunSolver(const Query &,
                          const std::vector<const Array *> *objects,
                          std::vector<std::vector<unsigned char> > *values,
                          bool &hasSolution);
 
+  void growContextPool(unsigned numContexts);
+
+  // Cube splitting (only used with ``-z3-cube-threshold``).
+  SolverRunStatus solveCubes(const Query &query,
+                             const std::vector<ref<Expr> > &cubes,
+                             const std::vector<const Array *> *objects,
+                             std::vector<std::vector<unsigned char> > *values,
+                             bool &hasSolution);
+
+  // Forked solving state (only used with ``-use-forked-solver``). Queries
+  // are solved by a server process, forked once rather than per query, which
+  // reads them in the binary query log format from ``serverSocket`` and
+  // leaves the values of the objects in the shared memory region. A server
+  // which crashes or does not answer in time is killed and started again on
+  // the next query.
+  bool useForkedZ3;
+  pid_t serverPid;
+  int serverSocket;
+  // The process which started the server and allocated the shared memory.
+  // Processes forked from klee itself start their own.
+  pid_t serverOwner;
+  int sharedMemoryId;
+  unsigned char *sharedMemory;
+
+  bool startServer();
+  void stopServer(bool kill);
+  void runServer(int socket);
+  bool internalRunSolverForked(const Query &,
+                               const std::vector<const Array *> *objects,
+                               std::vector<std::vector<unsigned char> > *values,
+                               bool &hasSolution);
+
+  // Interruption state (see interrupt()). Z3 is only interrupted while a
+  // query runs, so that later queries are not; ``queriesRunning`` counts
+  // the nested QueryScopes. The lock also guards the context pool and the
+  // server process, which interrupt() reaches from other threads.
+  pthread_mutex_t interruptLock;
+  unsigned queriesRunning;
+  volatile sig_atomic_t interrupted;
+
+  void beginQuery();
+  void endQuery();
+
+  // Context recycling state (only used with ``-z3-context-memory-budget``).
+  // ``hotConstraints`` are the constraints of the latest query, which the
+  // next context is built with; ``baseMemory`` is what Z3 used after the
+  // previous recycle. A warmer builds the next context while the current
+  // one keeps answering queries.
+  std::vector<ref<Expr> > hotConstraints;
+  uint64_t baseMemory;
+  Z3ContextWarmer *warmer;
+
+  void createContext(Z3Builder *newBuilder);
+  void freeContext();
+  void recycleContext();
+
+  /// QueryScope - Marks a query as running for as long as it lives.
+  struct QueryScope {
+    Z3SolverImpl &solver;
+    QueryScope(Z3SolverImpl &_solver) : solver(_solver) {
+      solver.beginQuery();
+    }
+    ~QueryScope() { solver.endQuery(); }
+  };
+
 public:
-  Z3SolverImpl();
+  Z3SolverImpl(bool useForkedZ3 = false);
   ~Z3SolverImpl();
 
   char *getConstraintLog(const Query &);
@@ -43,19 +387,60 @@ public:
     assert(_timeout >= 0.0 && "timeout must be >= 0");
     timeout = _timeout;
 
-    unsigned int timeoutInMilliSeconds = (unsigned int)((timeout * 1000) + 0.5);
+    timeoutInMilliSeconds = (unsigned int)((timeout * 1000) + 0.5);
     if (timeoutInMilliSeconds == 0)
       timeoutInMilliSeconds = UINT_MAX;
     Z3_params_set_uint(builder->ctx, solverParameters, timeoutParamStrSymbol,
                        timeoutInMilliSeconds);
+    for (std::vector<IncrementalSession>::iterator
+             it = incrementalSessions.begin(),
+             ie = incrementalSessions.end();
+         it != ie; ++it)
+      Z3_solver_set_params(builder->ctx, it->solver, solverParameters);
+    for (std::vector<Z3PoolContext *>::iterator it = contextPool.begin(),
+                                                ie = contextPool.end();
+         it != ie; ++it)
+      (*it)->setTimeout(timeoutInMilliSeconds);
+  }
+
+  size_t trimCaches(size_t bytes) {
+    // The expressions live in Z3, whose memory is not counted: whatever
+    // is freed, none of it is known.
+    if (bytes)
+      builder->clearConstructCache();
+    return 0;
   }
 
+  void releaseArrays(const std::vector<const Array *> &arrays) {
+    builder->releaseArrays(arrays);
+    for (std::vector<Z3PoolContext *>::iterator it = contextPool.begin(),
+                                                ie = contextPool.end();
+         it != ie; ++it)
+      (*it)->builder->releaseArrays(arrays);
+    for (std::vector<const Array *>::const_iterator it = arrays.begin(),
+                                                    ie = arrays.end();
+         it != ie; ++it)
+      lastModel.erase(*it);
+  }
+
+  void interrupt();
+
   bool computeTruth(const Query &, bool &isValid);
+  bool computeTruthMany(const ConstraintManager &constraints,
+                        const std::vector<ref<Expr> > &exprs,
+                        std::vector<bool> &isValid);
   bool computeValue(const Query &, ref<Expr> &result);
+  bool computeRange(const Query &, ref<Expr> &min, ref<Expr> &max);
+  bool computeUniqueValue(const Query &, ref<Expr> &result, bool &isUnique);
   bool computeInitialValues(const Query &,
                             const std::vector<const Array *> &objects,
                             std::vector<std::vector<unsigned char> > &values,
                             bool &hasSolution);
+  bool computeInitialValuesMany(
+      const std::vector<Query> &queries,
+      const std::vector<std::vector<const Array *> > &objects,
+      std::vector<std::vector<std::vector<unsigned char> > > &values,
+      std::vector<bool> &hasSolution);
   SolverRunStatus
   handleSolverResponse(::Z3_solver theSolver, ::Z3_lbool satisfiable,
                        const std::vector<const Array *> *objects,
@@ -64,22 +449,77 @@ public:
   SolverRunStatus getOperationStatusCode();
 };
 
-Z3SolverImpl::Z3SolverImpl()
-    : builder(new Z3Builder(/*autoClearConstructCache=*/false)), timeout(0.0),
-      runStatusCode(SOLVER_RUN_STATUS_FAILURE) {
-  assert(builder && "unable to create Z3Builder");
+Z3SolverImpl::Z3SolverImpl(bool _useForkedZ3)
+    : builder(NULL), timeout(0.0), runStatusCode(SOLVER_RUN_STATUS_FAILURE),
+      timeoutInMilliSeconds(UINT_MAX), currentSession(~0u), sessionClock(0),
+      useForkedZ3(_useForkedZ3), serverPid(0), serverSocket(-1),
+      serverOwner(0), sharedMemoryId(0), sharedMemory(NULL),
+      queriesRunning(0), interrupted(0), baseMemory(0), warmer(NULL) {
+  pthread_mutex_init(&interruptLock, NULL);
+  createContext(new Z3Builder(/*autoClearConstructCache=*/false));
+  if (Z3ContextMemoryBudget)
+    baseMemory = Z3_get_estimated_alloc_size();
+
+  // Fork the server now, while klee is still small.
+  if (useForkedZ3)
+    startServer();
+}
+
+Z3SolverImpl::~Z3SolverImpl() {
+  if (serverOwner == getpid()) {
+    stopServer(/*kill=*/false);
+    shmdt(sharedMemory);
+  }
+  if (warmer && warmer->owner == getpid()) {
+    if (warmer->threaded)
+      pthread_join(warmer->thread, NULL);
+    delete warmer->builder;
+    delete warmer;
+  }
+  for (std::vector<Z3PoolContext *>::iterator it = contextPool.begin(),
+                                              ie = contextPool.end();
+       it != ie; ++it)
+    delete *it;
+  freeContext();
+  pthread_mutex_destroy(&interruptLock);
+}
+
+/// createContext - Make \a newBuilder, and its context, the one queries
+/// are solved in.
+void Z3SolverImpl::createContext(Z3Builder *newBuilder) {
+  assert(newBuilder && "unable to create Z3Builder");
+  builder = newBuilder;
   solverParameters = Z3_mk_params(builder->ctx);
   Z3_params_inc_ref(builder->ctx, solverParameters);
   timeoutParamStrSymbol = Z3_mk_string_symbol(builder->ctx, "timeout");
-  setCoreSolverTimeout(timeout);
+  Z3_params_set_uint(builder->ctx, solverParameters, timeoutParamStrSymbol,
+                     timeoutInMilliSeconds);
+
+  memset(shapeTactics, 0, sizeof(shapeTactics));
+  if (Z3TacticSelection) {
+    shapeTactics[QS_BitVector] = createTactic(Z3BVTactic, "z3-bv-tactic");
+    shapeTactics[QS_Array] = createTactic(Z3ArrayTactic, "z3-array-tactic");
+    shapeTactics[QS_Float] = createTactic(Z3FPTactic, "z3-fp-tactic");
+    shapeTactics[QS_Mixed] = createTactic(Z3MixedTactic, "z3-mixed-tactic");
+  }
 }
 
-Z3SolverImpl::~Z3SolverImpl() {
+/// freeContext - Free the context queries are solved in, with everything
+/// built in it.
+void Z3SolverImpl::freeContext() {
+  resetIncrementalSolvers();
+  coreTrackers.clear();
+  coreTrackerIndex.clear();
+  for (unsigned i = 0; i != QS_NumShapes; ++i)
+    if (shapeTactics[i])
+      Z3_tactic_dec_ref(builder->ctx, shapeTactics[i]);
   Z3_params_dec_ref(builder->ctx, solverParameters);
   delete builder;
+  builder = NULL;
 }
 
-Z3Solver::Z3Solver() : Solver(new Z3SolverImpl()) {}
+Z3Solver::Z3Solver(bool useForkedZ3)
+    : Solver(new Z3SolverImpl(useForkedZ3)) {}
 
 char *Z3Solver::getConstraintLog(const Query &query) {
   return impl->getConstraintLog(query);
@@ -89,9 +529,18 @@ void Z3Solver::setCoreSolverTimeout(double timeout) {
   impl->setCoreSolverTimeout(timeout);
 }
 
+bool Z3Solver::getInitialValuesMany(
+    const std::vector<Query> &queries,
+    const std::vector<std::vector<const Array *> > &objects,
+    std::vector<std::vector<std::vector<unsigned char> > > &values,
+    std::vector<bool> &hasSolution) {
+  return static_cast<Z3SolverImpl *>(impl)->computeInitialValuesMany(
+      queries, objects, values, hasSolution);
+}
+
 char *Z3SolverImpl::getConstraintLog(const Query &query) {
   std::vector<Z3ASTHandle> assumptions;
-  for (std::vector<ref<Expr> >::const_iterator it = query.constraints.begin(),
+  for (ConstraintManager::const_iterator it = query.constraints.begin(),
                                                ie = query.constraints.end();
        it != ie; ++it) {
     assumptions.push_back(builder->construct(*it));
@@ -137,6 +586,85 @@ bool Z3SolverImpl::computeTruth(const Query &query, bool &isValid) {
   return status;
 }
 
+bool Z3SolverImpl::computeTruthMany(const ConstraintManager &constraints,
+                                    const std::vector<ref<Expr> > &exprs,
+                                    std::vector<bool> &isValid) {
+  if (useForkedZ3)
+    return SolverImpl::computeTruthMany(constraints, exprs, isValid);
+
+  QueryScope scope(*this);
+  TimerStatIncrementer t(stats::queryTime);
+  // The constraints are asserted once, and each expression is checked
+  // in a backtracking point of its own on top of them.
+  Z3_solver theSolver;
+  if (Z3IncrementalSolving) {
+    theSolver = getIncrementalSolver(constraints);
+  } else {
+    theSolver = createSolver(Z3TacticSelection
+                                 ? classifyQuery(constraints, exprs)
+                                 : QS_NumShapes);
+
+    unsigned index = 0;
+    for (ConstraintManager::const_iterator it = constraints.begin(),
+                                           ie = constraints.end();
+         it != ie; ++it, ++index) {
+      assertExpr(theSolver, builder->construct(*it), index);
+    }
+  }
+
+  isValid.clear();
+  isValid.reserve(exprs.size());
+  runStatusCode = SOLVER_RUN_STATUS_SUCCESS_UNSOLVABLE;
+  for (std::vector<ref<Expr> >::const_iterator it = exprs.begin(),
+                                               ie = exprs.end();
+       it != ie; ++it) {
+    if (Z3UnsatCoreCache && lookupUnsatCore(constraints, *it)) {
+      isValid.push_back(true);
+      continue;
+    }
+
+    ++stats::queries;
+    Z3_solver_push(builder->ctx, theSolver);
+    Z3ASTHandle z3QueryExpr =
+        Z3ASTHandle(builder->construct(*it), builder->ctx);
+    // As in internalRunSolver, look for a counterexample to the validity
+    // of the expression.
+    assertExpr(theSolver,
+               Z3ASTHandle(Z3_mk_not(builder->ctx, z3QueryExpr), builder->ctx),
+               constraints.size());
+
+    bool hasSolution;
+    ::Z3_lbool satisfiable = Z3_solver_check(builder->ctx, theSolver);
+    runStatusCode = handleSolverResponse(theSolver, satisfiable,
+                                         /*objects=*/NULL, /*values=*/NULL,
+                                         hasSolution);
+    if (Z3UnsatCoreCache &&
+        runStatusCode == SolverImpl::SOLVER_RUN_STATUS_SUCCESS_UNSOLVABLE)
+      recordUnsatCore(theSolver, constraints, *it);
+    Z3_solver_pop(builder->ctx, theSolver, 1);
+
+    if (runStatusCode != SolverImpl::SOLVER_RUN_STATUS_SUCCESS_SOLVABLE &&
+        runStatusCode != SolverImpl::SOLVER_RUN_STATUS_SUCCESS_UNSOLVABLE)
+      break;
+    if (hasSolution) {
+      ++stats::queriesInvalid;
+    } else {
+      ++stats::queriesValid;
+    }
+    isValid.push_back(!hasSolution);
+  }
+
+  if (Z3IncrementalSolving) {
+    if (isValid.size() != exprs.size())
+      resetIncrementalSolver();
+  } else {
+    Z3_solver_dec_ref(builder->ctx, theSolver);
+  }
+  builder->trimConstructCache(Z3ConstructCacheSize);
+
+  return isValid.size() == exprs.size();
+}
+
 bool Z3SolverImpl::computeValue(const Query &query, ref<Expr> &result) {
   std::vector<const Array *> objects;
   std::vector<std::vector<unsigned char> > values;
@@ -156,31 +684,647 @@ bool Z3SolverImpl::computeValue(const Query &query, ref<Expr> &result) {
   return true;
 }
 
+/// getNumeral - The value of the numeral \a e, which fits 64 bits.
+static uint64_t getNumeral(Z3_context ctx, Z3_ast e) {
+  // Z3_get_numeral_uint64() takes a different type across versions.
+  return strtoull(Z3_get_numeral_string(ctx, e), NULL, 10);
+}
+
+bool Z3SolverImpl::computeRange(const Query &query, ref<Expr> &min,
+                                ref<Expr> &max) {
+  // The forked server only answers satisfiability queries.
+  Expr::Width width = query.expr->getWidth();
+  if (!Z3OptimizeRanges || useForkedZ3 || width > Expr::Int64)
+    return false;
+
+  QueryScope scope(*this);
+  TimerStatIncrementer t(stats::queryTime);
+  ++stats::queries;
+  ::Z3_optimize opt = Z3_mk_optimize(builder->ctx);
+  Z3_optimize_inc_ref(builder->ctx, opt);
+  // Optimize the bounds independently of each other, rather than the
+  // second one given the first.
+  ::Z3_params params = Z3_mk_params(builder->ctx);
+  Z3_params_inc_ref(builder->ctx, params);
+  Z3_params_set_symbol(builder->ctx, params,
+                       Z3_mk_string_symbol(builder->ctx, "priority"),
+                       Z3_mk_string_symbol(builder->ctx, "box"));
+  Z3_params_set_uint(builder->ctx, params, timeoutParamStrSymbol,
+                     timeoutInMilliSeconds);
+  Z3_optimize_set_params(builder->ctx, opt, params);
+  Z3_params_dec_ref(builder->ctx, params);
+
+  for (ConstraintManager::const_iterator it = query.constraints.begin(),
+                                         ie = query.constraints.end();
+       it != ie; ++it)
+    Z3_optimize_assert(builder->ctx, opt, builder->construct(*it));
+
+  // Floats are optimized on the integer which orders them, NaNs aside.
+  bool isFloat = isa<FExpr>(query.expr);
+  ref<Expr> objective = query.expr;
+  if (isFloat) {
+    Z3_optimize_assert(
+        builder->ctx, opt,
+        builder->construct(
+            Expr::createIsZero(FIsNanExpr::create(query.expr))));
+    objective = getFloatOrderKey(query.expr);
+  }
+  Z3ASTHandle z3Objective(builder->construct(objective), builder->ctx);
+  unsigned minIndex = Z3_optimize_minimize(builder->ctx, opt, z3Objective);
+  unsigned maxIndex = Z3_optimize_maximize(builder->ctx, opt, z3Objective);
+
+#ifdef HAVE_Z3_OPTIMIZE_CHECK_ASSUMPTIONS
+  ::Z3_lbool satisfiable = Z3_optimize_check(builder->ctx, opt, 0, NULL);
+#else
+  ::Z3_lbool satisfiable = Z3_optimize_check(builder->ctx, opt);
+#endif
+  // Unsatisfiable constraints, or floats which can only be NaN, are left
+  // to the search of Solver::getRange.
+  runStatusCode = satisfiable == Z3_L_TRUE
+                      ? SOLVER_RUN_STATUS_SUCCESS_SOLVABLE
+                      : SOLVER_RUN_STATUS_FAILURE;
+  if (satisfiable == Z3_L_TRUE) {
+    Z3ASTHandle lower(Z3_optimize_get_lower(builder->ctx, opt, minIndex),
+                      builder->ctx);
+    Z3ASTHandle upper(Z3_optimize_get_upper(builder->ctx, opt, maxIndex),
+                      builder->ctx);
+    uint64_t lo = getNumeral(builder->ctx, lower);
+    uint64_t hi = getNumeral(builder->ctx, upper);
+    if (isFloat) {
+      min = getFloatFromOrderKey(lo, width);
+      max = getFloatFromOrderKey(hi, width);
+    } else {
+      min = ConstantExpr::create(lo, width);
+      max = ConstantExpr::create(hi, width);
+    }
+  }
+
+  Z3_optimize_dec_ref(builder->ctx, opt);
+  builder->trimConstructCache(Z3ConstructCacheSize);
+  return satisfiable == Z3_L_TRUE;
+}
+
+bool Z3SolverImpl::computeUniqueValue(const Query &query, ref<Expr> &result,
+                                      bool &isUnique) {
+  // Both checks share a solver, which the forked server does not keep.
+  if (useForkedZ3)
+    return false;
+
+  QueryScope scope(*this);
+  TimerStatIncrementer t(stats::queryTime);
+  ++stats::queries;
+  ++stats::queryCounterexamples;
+  Z3_solver theSolver;
+  if (Z3IncrementalSolving) {
+    theSolver = getIncrementalSolver(query.constraints);
+    // The blocking clause is retracted again once we are done with it.
+    Z3_solver_push(builder->ctx, theSolver);
+  } else {
+    theSolver = createSolver(
+        Z3TacticSelection
+            ? classifyQuery(query.constraints,
+                            std::vector<ref<Expr> >(1, query.expr))
+            : QS_NumShapes);
+
+    unsigned index = 0;
+    for (ConstraintManager::const_iterator it = query.constraints.begin(),
+                                           ie = query.constraints.end();
+         it != ie; ++it, ++index) {
+      assertExpr(theSolver, builder->construct(*it), index);
+    }
+  }
+
+  // Take the value of the expression in a model of the constraints, then
+  // block it: the value is unique if no model is left.
+  std::vector<const Array *> objects;
+  std::vector<std::vector<unsigned char> > values;
+  bool hasSolution;
+  findSymbolicObjects(query.expr, objects);
+  runStatusCode =
+      handleSolverResponse(theSolver, Z3_solver_check(builder->ctx, theSolver),
+                           &objects, &values, hasSolution);
+  if (runStatusCode == SolverImpl::SOLVER_RUN_STATUS_SUCCESS_SOLVABLE) {
+    Assignment a(objects, values);
+    result = a.evaluate(query.expr);
+    assertExpr(theSolver,
+               builder->construct(
+                   Expr::createIsZero(createIsValue(query.expr, result))),
+               query.constraints.size());
+    runStatusCode = handleSolverResponse(
+        theSolver, Z3_solver_check(builder->ctx, theSolver),
+        /*objects=*/NULL, /*values=*/NULL, hasSolution);
+    isUnique = !hasSolution;
+  } else if (runStatusCode ==
+             SolverImpl::SOLVER_RUN_STATUS_SUCCESS_UNSOLVABLE) {
+    assert(0 && "state has invalid constraint set");
+    runStatusCode = SOLVER_RUN_STATUS_FAILURE;
+  }
+
+  bool success =
+      runStatusCode == SolverImpl::SOLVER_RUN_STATUS_SUCCESS_SOLVABLE ||
+      runStatusCode == SolverImpl::SOLVER_RUN_STATUS_SUCCESS_UNSOLVABLE;
+  if (Z3IncrementalSolving) {
+    Z3_solver_pop(builder->ctx, theSolver, 1);
+    if (!success)
+      resetIncrementalSolver();
+  } else {
+    Z3_solver_dec_ref(builder->ctx, theSolver);
+  }
+  builder->trimConstructCache(Z3ConstructCacheSize);
+
+  if (!success)
+    return false;
+  if (isUnique) {
+    ++stats::queriesValid;
+  } else {
+    ++stats::queriesInvalid;
+  }
+  return true;
+}
+
 bool Z3SolverImpl::computeInitialValues(
     const Query &query, const std::vector<const Array *> &objects,
     std::vector<std::vector<unsigned char> > &values, bool &hasSolution) {
   return internalRunSolver(query, &objects, &values, hasSolution);
 }
 
+void Z3SolverImpl::resetIncrementalSolver() {
+  if (currentSession >= incrementalSessions.size())
+    return;
+  Z3_solver_dec_ref(builder->ctx,
+                    incrementalSessions[currentSession].solver);
+  incrementalSessions.erase(incrementalSessions.begin() + currentSession);
+  currentSession = ~0u;
+}
+
+void Z3SolverImpl::resetIncrementalSolvers() {
+  for (std::vector<IncrementalSession>::iterator
+           it = incrementalSessions.begin(),
+           ie = incrementalSessions.end();
+       it != ie; ++it)
+    Z3_solver_dec_ref(builder->ctx, it->solver);
+  incrementalSessions.clear();
+  currentSession = ~0u;
+}
+
+::Z3_solver
+Z3SolverImpl::getIncrementalSolver(const ConstraintManager &constraints) {
+  // Find the session sharing the longest prefix with the new constraint
+  // set, and the least recently used one. Constraints are compared by
+  // pointer first because states forked from the same parent share their
+  // constraint ``ref``s.
+  unsigned best = 0, prefix = 0, oldest = 0;
+  for (unsigned i = 0, e = incrementalSessions.size(); i != e; ++i) {
+    const IncrementalSession &session = incrementalSessions[i];
+    unsigned shared = 0;
+    ConstraintManager::const_iterator it = constraints.begin(),
+                                      ie = constraints.end();
+    for (unsigned n = session.asserted.size(); shared != n && it != ie;
+         ++shared, ++it) {
+      const ref<Expr> &asserted = session.asserted[shared];
+      if (asserted.get() != it->get() && asserted != *it)
+        break;
+    }
+    if (shared > prefix) {
+      best = i;
+      prefix = shared;
+    }
+    if (session.lastUse < incrementalSessions[oldest].lastUse)
+      oldest = i;
+  }
+
+  // Retracting most of a session's constraints would rebuild them when the
+  // searcher goes back to its subtree, so a query from elsewhere in the
+  // tree gets a session of its own, if one can be spared.
+  unsigned maxSessions = std::max(1u, Z3IncrementalSessions.getValue());
+  if (incrementalSessions.empty() ||
+      (prefix * 2 < incrementalSessions[best].asserted.size() &&
+       (incrementalSessions.size() < maxSessions || oldest != best))) {
+    if (incrementalSessions.size() < maxSessions) {
+      best = incrementalSessions.size();
+      incrementalSessions.push_back(IncrementalSession());
+    } else {
+      best = oldest;
+      Z3_solver_dec_ref(builder->ctx, incrementalSessions[best].solver);
+      incrementalSessions[best].asserted.clear();
+    }
+    ::Z3_solver solver = Z3_mk_solver(builder->ctx);
+    Z3_solver_inc_ref(builder->ctx, solver);
+    Z3_solver_set_params(builder->ctx, solver, solverParameters);
+    incrementalSessions[best].solver = solver;
+    prefix = 0;
+  }
+
+  IncrementalSession &session = incrementalSessions[best];
+  session.lastUse = ++sessionClock;
+  currentSession = best;
+  if (prefix != session.asserted.size()) {
+    Z3_solver_pop(builder->ctx, session.solver,
+                  session.asserted.size() - prefix);
+    session.asserted.resize(prefix);
+  }
+  stats::queryIncrementalPrefixHits += prefix;
+
+  ConstraintManager::const_iterator it = constraints.begin(),
+                                    ie = constraints.end();
+  for (unsigned i = 0; i != prefix; ++i)
+    ++it;
+  for (; it != ie; ++it) {
+    Z3_solver_push(builder->ctx, session.solver);
+    assertExpr(session.solver, builder->construct(*it),
+               session.asserted.size());
+    session.asserted.push_back(*it);
+    ++stats::queryIncrementalPrefixMisses;
+  }
+
+  return session.solver;
+}
+
+/// createTactic - Build the sequence of the comma-separated Z3 tactics in
+/// \a tactics, or return null if there are none. Should the sequence fail
+/// on a query, it is handed to Z3's general SMT tactic instead.
+::Z3_tactic Z3SolverImpl::createTactic(const std::string &tactics,
+                                       const char *option) {
+  std::set<std::string> known;
+  for (unsigned i = 0, e = Z3_get_num_tactics(builder->ctx); i != e; ++i)
+    known.insert(Z3_get_tactic_name(builder->ctx, i));
+
+  ::Z3_tactic result = NULL;
+  std::string::size_type start = 0;
+  while (start < tactics.size()) {
+    std::string::size_type end = tactics.find(',', start);
+    if (end == std::string::npos)
+      end = tactics.size();
+    std::string name = tactics.substr(start, end - start);
+    start = end + 1;
+    if (name.empty())
+      continue;
+    if (!known.count(name))
+      klee_error("Unknown Z3 tactic '%s' given to -%s", name.c_str(), option);
+
+    ::Z3_tactic tactic = Z3_mk_tactic(builder->ctx, name.c_str());
+    if (result)
+      tactic = Z3_tactic_and_then(builder->ctx, result, tactic);
+    Z3_tactic_inc_ref(builder->ctx, tactic);
+    if (result)
+      Z3_tactic_dec_ref(builder->ctx, result);
+    result = tactic;
+  }
+  if (!result)
+    return NULL;
+
+  ::Z3_tactic fallback = Z3_tactic_or_else(
+      builder->ctx, result, Z3_mk_tactic(builder->ctx, "smt"));
+  Z3_tactic_inc_ref(builder->ctx, fallback);
+  Z3_tactic_dec_ref(builder->ctx, result);
+  return fallback;
+}
+
+namespace {
+/// Walks the expressions of a query to find its QueryShape.
+class QueryShapeClassifier {
+  std::set<const Expr *> visited;
+  std::set<const UpdateNode *> visitedUpdates;
+
+public:
+  bool hasFloat, hasSymbolicIndex;
+  std::set<const Array *> arrays;
+
+  QueryShapeClassifier() : hasFloat(false), hasSymbolicIndex(false) {}
+
+  void visit(const ref<Expr> &e) {
+    if (!visited.insert(e.get()).second)
+      return;
+    if (isa<FExpr>(e))
+      hasFloat = true;
+    if (const ReadExpr *re = dyn_cast<ReadExpr>(e)) {
+      arrays.insert(re->updates.root);
+      if (!isa<ConstantExpr>(re->index))
+        hasSymbolicIndex = true;
+      for (const UpdateNode *un = re->updates.head; un; un = un->next) {
+        if (!visitedUpdates.insert(un).second)
+          break;
+        if (!isa<ConstantExpr>(un->index))
+          hasSymbolicIndex = true;
+        visit(un->index);
+        visit(un->value);
+      }
+    }
+    for (unsigned i = 0, e2 = e->getNumKids(); i != e2; ++i)
+      visit(e->getKid(i));
+  }
+
+  QueryShape getShape() const {
+    if (hasFloat)
+      return hasSymbolicIndex ? QS_Mixed : QS_Float;
+    return hasSymbolicIndex ? QS_Array : QS_BitVector;
+  }
+};
+}
+
+/// classifyQuery - Find the shape of a query, and optionally the arrays it
+/// reads from.
+QueryShape Z3SolverImpl::classifyQuery(const ConstraintManager &constraints,
+                                       const std::vector<ref<Expr> > &exprs,
+                                       std::set<const Array *> *arrays) {
+  QueryShapeClassifier classifier;
+  for (ConstraintManager::const_iterator it = constraints.begin(),
+                                         ie = constraints.end();
+       it != ie; ++it)
+    classifier.visit(*it);
+  for (std::vector<ref<Expr> >::const_iterator it = exprs.begin(),
+                                               ie = exprs.end();
+       it != ie; ++it)
+    classifier.visit(*it);
+  if (arrays)
+    arrays->swap(classifier.arrays);
+
+  QueryShape shape = classifier.getShape();
+  switch (shape) {
+  case QS_BitVector: ++stats::queryShapeBitVector; break;
+  case QS_Array: ++stats::queryShapeArray; break;
+  case QS_Float: ++stats::queryShapeFloat; break;
+  case QS_Mixed: ++stats::queryShapeMixed; break;
+  default: assert(0 && "invalid query shape");
+  }
+  return shape;
+}
+
+/// createSolver - Create a solver for a query of the given shape, using the
+/// tactic for it with ``-z3-tactic-selection``. \a shape is QS_NumShapes if
+/// the query was not classified.
+::Z3_solver Z3SolverImpl::createSolver(QueryShape shape) {
+  ::Z3_tactic tactic = NULL;
+  if (Z3TacticSelection && shape != QS_NumShapes)
+    tactic = shapeTactics[shape];
+
+  ::Z3_solver theSolver = tactic
+                              ? Z3_mk_solver_from_tactic(builder->ctx, tactic)
+                              : Z3_mk_solver(builder->ctx);
+  Z3_solver_inc_ref(builder->ctx, theSolver);
+  Z3_solver_set_params(builder->ctx, theSolver, solverParameters);
+  return theSolver;
+}
+
+/// checkWithModelHints - Check \a theSolver assuming that the bytes of
+/// \a arrays keep their values from the last counterexample. Returns
+/// Z3_L_UNDEF if there were no hints or they did not lead to a solution, in
+/// which case the query has to be checked without them.
+::Z3_lbool
+Z3SolverImpl::checkWithModelHints(::Z3_solver theSolver, QueryShape shape,
+                                  const std::set<const Array *> &arrays) {
+  if (shape != QS_Float && shape != QS_Mixed)
+    return Z3_L_UNDEF;
+
+  std::vector<Z3ASTHandle> hints;
+  for (std::set<const Array *>::const_iterator it = arrays.begin(),
+                                               ie = arrays.end();
+       it != ie; ++it) {
+    std::map<const Array *, std::vector<unsigned char> >::iterator model =
+        lastModel.find(*it);
+    if (model == lastModel.end())
+      continue;
+    const std::vector<unsigned char> &bytes = model->second;
+    for (unsigned i = 0, e = bytes.size(); i != e; ++i)
+      hints.push_back(Z3ASTHandle(
+          Z3_mk_eq(builder->ctx, builder->getInitialRead(*it, i),
+                   Z3_mk_unsigned_int(builder->ctx, bytes[i],
+                                      Z3_mk_bv_sort(builder->ctx, 8))),
+          builder->ctx));
+  }
+  if (hints.empty())
+    return Z3_L_UNDEF;
+
+  TimerStatIncrementer t(stats::queryModelHintTime);
+  std::vector< ::Z3_ast> assumptions(hints.begin(), hints.end());
+  ::Z3_lbool satisfiable = Z3_solver_check_assumptions(
+      builder->ctx, theSolver, assumptions.size(), &assumptions[0]);
+  if (satisfiable == Z3_L_TRUE) {
+    if (shape == QS_Float)
+      ++stats::queryModelHintFloatHits;
+    else
+      ++stats::queryModelHintMixedHits;
+    return Z3_L_TRUE;
+  }
+  if (shape == QS_Float)
+    ++stats::queryModelHintFloatMisses;
+  else
+    ++stats::queryModelHintMixedMisses;
+  return Z3_L_UNDEF;
+}
+
+/// assertExpr - Assert \a e in \a theSolver as the \a index-th assertion of
+/// the query, tracked if unsatisfiable cores are recorded.
+void Z3SolverImpl::assertExpr(::Z3_solver theSolver, Z3ASTHandle e,
+                              unsigned index) {
+  if (!Z3UnsatCoreCache) {
+    Z3_solver_assert(builder->ctx, theSolver, e);
+    return;
+  }
+
+  while (coreTrackers.size() <= index) {
+    Z3ASTHandle tracker(
+        Z3_mk_const(builder->ctx,
+                    Z3_mk_int_symbol(builder->ctx, coreTrackers.size()),
+                    Z3_mk_bool_sort(builder->ctx)),
+        builder->ctx);
+    coreTrackerIndex[Z3_get_ast_id(builder->ctx, tracker)] =
+        coreTrackers.size();
+    coreTrackers.push_back(tracker);
+  }
+  Z3_solver_assert_and_track(builder->ctx, theSolver, e, coreTrackers[index]);
+}
+
+static void getAssertions(const ConstraintManager &constraints,
+                          ref<Expr> queryExpr,
+                          std::vector<ref<Expr> > &assertions) {
+  assertions.reserve(constraints.size() + 1);
+  for (ConstraintManager::const_iterator it = constraints.begin(),
+                                         ie = constraints.end();
+       it != ie; ++it)
+    assertions.push_back(*it);
+  assertions.push_back(Expr::createIsZero(queryExpr));
+}
+
+namespace {
+struct AnyCore {
+  bool operator()(bool) const { return true; }
+};
+}
+
+/// lookupUnsatCore - Check whether the assertions of the query include a
+/// recorded unsatisfiable core.
+bool Z3SolverImpl::lookupUnsatCore(const ConstraintManager &constraints,
+                                   ref<Expr> queryExpr) {
+  std::vector<ref<Expr> > assertions;
+  getAssertions(constraints, queryExpr, assertions);
+  std::set<ref<Expr> > key(assertions.begin(), assertions.end());
+  if (!unsatCores.findSubset(key, AnyCore()))
+    return false;
+  ++stats::queryUnsatCoreHits;
+  return true;
+}
+
+/// recordUnsatCore - Remember the core of the query \a theSolver has just
+/// found to be unsatisfiable.
+void Z3SolverImpl::recordUnsatCore(::Z3_solver theSolver,
+                                   const ConstraintManager &constraints,
+                                   ref<Expr> queryExpr) {
+  std::vector<ref<Expr> > assertions;
+  getAssertions(constraints, queryExpr, assertions);
+
+  ::Z3_ast_vector core = Z3_solver_get_unsat_core(builder->ctx, theSolver);
+  Z3_ast_vector_inc_ref(builder->ctx, core);
+  std::set<ref<Expr> > coreAssertions;
+  for (unsigned i = 0, e = Z3_ast_vector_size(builder->ctx, core); i != e;
+       ++i) {
+    ::Z3_ast tracker = Z3_ast_vector_get(builder->ctx, core, i);
+    std::map<unsigned, unsigned>::iterator it =
+        coreTrackerIndex.find(Z3_get_ast_id(builder->ctx, tracker));
+    assert(it != coreTrackerIndex.end() && it->second < assertions.size() &&
+           "unsatisfiable core refers to an unknown assertion");
+    coreAssertions.insert(assertions[it->second]);
+  }
+  Z3_ast_vector_dec_ref(builder->ctx, core);
+
+  // An empty core would make every later query valid. Z3 should never
+  // return one as all assertions are tracked, but do not rely on it.
+  if (coreAssertions.empty())
+    return;
+  if (!unsatCores.lookup(coreAssertions)) {
+    unsatCores.insert(coreAssertions, true);
+    ++stats::queryUnsatCores;
+  }
+}
+
+/// The most cubes -z3-cube-threshold splits a query into.
+static const unsigned MaxCubes = 64;
+
+/// getFloatClasses - Add to \a classes the conditions splitting the values
+/// of the float \a x: NaN, at most -1, between -1 and 0, zero, between 0 and
+/// 1, and at least 1. They tell the sign and whether the exponent is
+/// negative, and put the infinities with the large values.
+static void getFloatClasses(const ref<Expr> &x,
+                            std::vector<ref<Expr> > &classes) {
+  Expr::Width width = x->getWidth();
+  llvm::APFloat::roundingMode rm = llvm::APFloat::rmNearestTiesToEven;
+  ref<Expr> zero = ConstantExpr::create(0, Expr::Int32)->SToF(width, rm);
+  ref<Expr> one = ConstantExpr::create(1, Expr::Int32)->SToF(width, rm);
+  ref<Expr> minusOne =
+      ConstantExpr::create(0xFFFFFFFF, Expr::Int32)->SToF(width, rm);
+
+  classes.push_back(FUnoExpr::create(x, x));
+  classes.push_back(FOleExpr::create(x, minusOne));
+  classes.push_back(AndExpr::create(FOgtExpr::create(x, minusOne),
+                                    FOltExpr::create(x, zero)));
+  classes.push_back(FOeqExpr::create(x, zero));
+  classes.push_back(AndExpr::create(FOgtExpr::create(x, zero),
+                                    FOltExpr::create(x, one)));
+  classes.push_back(FOgeExpr::create(x, one));
+}
+
+/// getCubes - Split the values of the floats \a query uses most into
+/// cubes, each a conjunction of a class of each float, which together
+/// cover every value. Leaves \a cubes empty if the query has no float
+/// made of symbolic bits.
+static void getCubes(const Query &query, std::vector<ref<Expr> > &cubes) {
+  // Count the expressions of the query each float appears in.
+  std::vector<ref<Expr> > exprs(query.constraints.begin(),
+                                query.constraints.end());
+  exprs.push_back(query.expr);
+  std::vector<ref<Expr> > floats;
+  ExprHashMap<unsigned> uses;
+  for (std::vector<ref<Expr> >::iterator it = exprs.begin(),
+                                         ie = exprs.end();
+       it != ie; ++it) {
+    ExprHashSet visited;
+    std::vector<ref<Expr> > stack(1, *it);
+    while (!stack.empty()) {
+      ref<Expr> e = stack.back();
+      stack.pop_back();
+      if (!visited.insert(e).second)
+        continue;
+      if (isa<ExplicitFloatExpr>(e) &&
+          (e->getWidth() == Expr::Fl32 || e->getWidth() == Expr::Fl64 ||
+           e->getWidth() == Expr::Fl80)) {
+        if (uses[e]++ == 0)
+          floats.push_back(e);
+        continue;
+      }
+      for (unsigned i = 0, n = e->getNumKids(); i != n; ++i)
+        stack.push_back(e->getKid(i));
+    }
+  }
+
+  // Split on the most used floats first, as far as the cubes go.
+  for (unsigned i = 1; i < floats.size(); ++i)
+    for (unsigned j = i; j && uses[floats[j]] > uses[floats[j - 1]]; --j)
+      std::swap(floats[j], floats[j - 1]);
+  cubes.clear();
+  for (std::vector<ref<Expr> >::iterator it = floats.begin(),
+                                         ie = floats.end();
+       it != ie; ++it) {
+    std::vector<ref<Expr> > classes;
+    getFloatClasses(*it, classes);
+    if (std::max<size_t>(cubes.size(), 1) * classes.size() > MaxCubes)
+      break;
+    if (cubes.empty()) {
+      cubes.swap(classes);
+      continue;
+    }
+    std::vector<ref<Expr> > product;
+    for (unsigned i = 0, e = cubes.size(); i != e; ++i)
+      for (unsigned j = 0, f = classes.size(); j != f; ++j)
+        product.push_back(AndExpr::create(cubes[i], classes[j]));
+    cubes.swap(product);
+  }
+}
+
 bool Z3SolverImpl::internalRunSolver(
     const Query &query, const std::vector<const Array *> *objects,
     std::vector<std::vector<unsigned char> > *values, bool &hasSolution) {
+  QueryScope scope(*this);
+  if (useForkedZ3)
+    return internalRunSolverForked(query, objects, values, hasSolution);
+
+  if (Z3ContextMemoryBudget)
+    hotConstraints.assign(query.constraints.begin(), query.constraints.end());
+
+  // A query which includes a known core is unsatisfiable, so it is valid and
+  // has no counterexample.
+  if (Z3UnsatCoreCache && lookupUnsatCore(query.constraints, query.expr)) {
+    hasSolution = false;
+    runStatusCode = SOLVER_RUN_STATUS_SUCCESS_UNSOLVABLE;
+    return true;
+  }
+
   TimerStatIncrementer t(stats::queryTime);
-  // TODO: Does making a new solver for each query have a performance
-  // impact vs making one global solver and using push and pop?
   // TODO: is the "simple_solver" the right solver to use for
   // best performance?
-  Z3_solver theSolver = Z3_mk_solver(builder->ctx);
-  Z3_solver_inc_ref(builder->ctx, theSolver);
-  Z3_solver_set_params(builder->ctx, theSolver, solverParameters);
+  QueryShape shape = QS_NumShapes;
+  std::set<const Array *> arrays;
+  if (Z3TacticSelection || Z3ModelHints || Z3CubeThreshold > 0)
+    shape = classifyQuery(query.constraints,
+                          std::vector<ref<Expr> >(1, query.expr), &arrays);
 
-  runStatusCode = SOLVER_RUN_STATUS_FAILURE;
+  Z3_solver theSolver;
+  if (Z3IncrementalSolving) {
+    theSolver = getIncrementalSolver(query.constraints);
+    // The query expression is retracted again once we are done with it.
+    Z3_solver_push(builder->ctx, theSolver);
+  } else {
+    theSolver = createSolver(shape);
 
-  for (ConstraintManager::const_iterator it = query.constraints.begin(),
-                                         ie = query.constraints.end();
-       it != ie; ++it) {
-    Z3_solver_assert(builder->ctx, theSolver, builder->construct(*it));
+    unsigned index = 0;
+    for (ConstraintManager::const_iterator it = query.constraints.begin(),
+                                           ie = query.constraints.end();
+         it != ie; ++it, ++index) {
+      assertExpr(theSolver, builder->construct(*it), index);
+    }
   }
+
+  runStatusCode = SOLVER_RUN_STATUS_FAILURE;
+
   ++stats::queries;
   if (objects)
     ++stats::queryCounterexamples;
@@ -193,21 +1337,70 @@ bool Z3SolverImpl::internalRunSolver(
   // but Z3 works in terms of satisfiability so instead we ask the
   // negation of the equivalent i.e.
   // ∃ X Constraints(X) ∧ ¬ query(X)
-  Z3_solver_assert(
-      builder->ctx, theSolver,
-      Z3ASTHandle(Z3_mk_not(builder->ctx, z3QueryExpr), builder->ctx));
+  assertExpr(theSolver,
+             Z3ASTHandle(Z3_mk_not(builder->ctx, z3QueryExpr), builder->ctx),
+             query.constraints.size());
 
-  ::Z3_lbool satisfiable = Z3_solver_check(builder->ctx, theSolver);
-  runStatusCode = handleSolverResponse(theSolver, satisfiable, objects, values,
-                                       hasSolution);
+  // A floating-point query gets -z3-cube-threshold as a whole before it is
+  // split, if that is less than its timeout.
+  std::vector<ref<Expr> > cubes;
+  unsigned cubeThreshold = (unsigned)(Z3CubeThreshold * 1000 + 0.5);
+  if (!Z3IncrementalSolving && cubeThreshold &&
+      cubeThreshold < timeoutInMilliSeconds &&
+      (shape == QS_Float || shape == QS_Mixed)) {
+    getCubes(query, cubes);
+    if (!cubes.empty()) {
+      ::Z3_params params = Z3_mk_params(builder->ctx);
+      Z3_params_inc_ref(builder->ctx, params);
+      Z3_params_set_uint(builder->ctx, params, timeoutParamStrSymbol,
+                         cubeThreshold);
+      Z3_solver_set_params(builder->ctx, theSolver, params);
+      Z3_params_dec_ref(builder->ctx, params);
+    }
+  }
 
-  Z3_solver_dec_ref(builder->ctx, theSolver);
-  // Clear the builder's cache to prevent memory usage exploding.
-  // By using ``autoClearConstructCache=false`` and clearning now
+  ::Z3_lbool satisfiable = Z3_L_UNDEF;
+  if (Z3ModelHints)
+    satisfiable = checkWithModelHints(theSolver, shape, arrays);
+  if (satisfiable != Z3_L_TRUE)
+    satisfiable = Z3_solver_check(builder->ctx, theSolver);
+  bool split = false;
+  if (!cubes.empty() && satisfiable == Z3_L_UNDEF) {
+    ::Z3_string reason =
+        ::Z3_solver_get_reason_unknown(builder->ctx, theSolver);
+    split = strcmp(reason, "timeout") == 0 || strcmp(reason, "canceled") == 0;
+  }
+  if (split)
+    runStatusCode = solveCubes(query, cubes, objects, values, hasSolution);
+  else
+    runStatusCode = handleSolverResponse(theSolver, satisfiable, objects,
+                                         values, hasSolution);
+  if (Z3ModelHints && objects &&
+      runStatusCode == SolverImpl::SOLVER_RUN_STATUS_SUCCESS_SOLVABLE)
+    for (unsigned i = 0, e = objects->size(); i != e; ++i)
+      lastModel[(*objects)[i]] = (*values)[i];
+  if (Z3UnsatCoreCache && !split &&
+      runStatusCode == SolverImpl::SOLVER_RUN_STATUS_SUCCESS_UNSOLVABLE)
+    recordUnsatCore(theSolver, query.constraints, query.expr);
+
+  if (Z3IncrementalSolving) {
+    Z3_solver_pop(builder->ctx, theSolver, 1);
+    // After a timeout or cancellation Z3 gives no guarantees about the
+    // state of the solver, so start again from scratch next time.
+    if (runStatusCode != SolverImpl::SOLVER_RUN_STATUS_SUCCESS_SOLVABLE &&
+        runStatusCode != SolverImpl::SOLVER_RUN_STATUS_SUCCESS_UNSOLVABLE)
+      resetIncrementalSolver();
+  } else {
+    Z3_solver_dec_ref(builder->ctx, theSolver);
+  }
+  // Trim the builder's cache to prevent memory usage exploding.
+  // By using ``autoClearConstructCache=false`` and trimming now
   // we allow Z3_ast expressions to be shared from an entire
-  // ``Query`` rather than only sharing within a single call to
-  // ``builder->construct()``.
-  builder->clearConstructCache();
+  // ``Query`` (and, with ``-z3-construct-cache-size``, across queries)
+  // rather than only sharing within a single call to
+  // ``builder->construct()``. Constraints kept by the incremental solver
+  // stay alive through the solver's own references.
+  builder->trimConstructCache(Z3ConstructCacheSize);
 
   if (runStatusCode == SolverImpl::SOLVER_RUN_STATUS_SUCCESS_SOLVABLE ||
       runStatusCode == SolverImpl::SOLVER_RUN_STATUS_SUCCESS_UNSOLVABLE) {
@@ -221,10 +1414,378 @@ bool Z3SolverImpl::internalRunSolver(
   return false; // failed
 }
 
-SolverImpl::SolverRunStatus Z3SolverImpl::handleSolverResponse(
-    ::Z3_solver theSolver, ::Z3_lbool satisfiable,
-    const std::vector<const Array *> *objects,
+bool Z3SolverImpl::startServer() {
+  if (serverOwner != getpid()) {
+    // Whatever was inherited belongs to the process we were forked from.
+    if (serverSocket >= 0)
+      close(serverSocket);
+    if (sharedMemory)
+      shmdt(sharedMemory);
+    serverPid = 0;
+    serverSocket = -1;
+
+    sharedMemoryId =
+        shmget(IPC_PRIVATE, z3SharedMemorySize, IPC_CREAT | 0700);
+    if (sharedMemoryId < 0)
+      llvm::report_fatal_error("unable to allocate shared memory region");
+    sharedMemory = (unsigned char *)shmat(sharedMemoryId, NULL, 0);
+    if (sharedMemory == (void *)-1)
+      llvm::report_fatal_error("unable to attach shared memory region");
+    shmctl(sharedMemoryId, IPC_RMID, NULL);
+    serverOwner = getpid();
+  }
+
+  int sockets[2];
+  if (socketpair(AF_UNIX, SOCK_STREAM, 0, sockets) < 0) {
+    klee_warning("socketpair failed (for Z3) - %s",
+                 llvm::sys::StrError(errno).c_str());
+    return false;
+  }
+
+  fflush(stdout);
+  fflush(stderr);
+  pid_t pid = fork();
+  if (pid == -1) {
+    klee_warning("fork failed (for Z3) - %s",
+                 llvm::sys::StrError(errno).c_str());
+    close(sockets[0]);
+    close(sockets[1]);
+    return false;
+  }
+
+  if (pid == 0) {
+    close(sockets[0]);
+    runServer(sockets[1]);
+    _exit(0);
+  }
+
+  close(sockets[1]);
+  pthread_mutex_lock(&interruptLock);
+  serverPid = pid;
+  pthread_mutex_unlock(&interruptLock);
+  serverSocket = sockets[0];
+
+  std::string header;
+  llvm::raw_string_ostream os(header);
+  BinaryQueryWriter(os).writeHeader();
+  os.flush();
+  if (send(serverSocket, header.data(), header.size(), MSG_NOSIGNAL) !=
+      (ssize_t)header.size()) {
+    stopServer(/*kill=*/true);
+    return false;
+  }
+  return true;
+}
+
+void Z3SolverImpl::stopServer(bool kill) {
+  if (serverSocket < 0)
+    return;
+  // The server exits once it reads the end of its queries. It is
+  // forgotten before it is reaped, so that interrupt() cannot signal
+  // another process by its pid.
+  pthread_mutex_lock(&interruptLock);
+  pid_t pid = serverPid;
+  serverPid = 0;
+  pthread_mutex_unlock(&interruptLock);
+  if (kill)
+    ::kill(pid, SIGKILL);
+  close(serverSocket);
+  int status;
+  while (waitpid(pid, &status, 0) < 0 && errno == EINTR)
+    ;
+  serverSocket = -1;
+}
+
+/// runServer - Solve the queries read from \a socket until it is closed.
+/// Runs in the server process.
+void Z3SolverImpl::runServer(int socket) {
+  if (Z3ServerMemoryLimit) {
+    struct rlimit limit;
+    limit.rlim_cur = limit.rlim_max = (rlim_t)Z3ServerMemoryLimit << 20;
+    setrlimit(RLIMIT_AS, &limit);
+  }
+
+  FILE *queries = fdopen(socket, "rb");
+  if (!queries)
+    return;
+  ArrayCache arrayCache;
+  BinaryQueryReader reader(arrayCache);
+  if (!reader.open(queries))
+    return;
+
+  Z3SolverImpl solver(/*useForkedZ3=*/false);
+  const Z3ServerRequest *request = (const Z3ServerRequest *)sharedMemory;
+  unsigned char *valuesMemory = sharedMemory + sizeof(Z3ServerRequest);
+  BinaryQuery bq;
+  while (reader.readQuery(bq)) {
+    solver.setCoreSolverTimeout(request->timeout);
+
+    ConstraintManager constraints(bq.constraints);
+    Query query(constraints, bq.expr);
+    Z3ServerResponse response;
+    response.hasSolution = false;
+    std::vector<std::vector<unsigned char> > values;
+    if (bq.type == binlog::InitialValues)
+      solver.internalRunSolver(query, &bq.objects, &values,
+                               response.hasSolution);
+    else
+      solver.internalRunSolver(query, NULL, NULL, response.hasSolution);
+    response.status = solver.getOperationStatusCode();
+
+    unsigned char *pos = valuesMemory;
+    for (unsigned i = 0, e = values.size(); i != e; ++i) {
+      std::copy(values[i].begin(), values[i].end(), pos);
+      pos += values[i].size();
+    }
+    if (send(socket, &response, sizeof response, MSG_NOSIGNAL) !=
+        (ssize_t)sizeof response)
+      break;
+  }
+  fclose(queries);
+}
+
+bool Z3SolverImpl::internalRunSolverForked(
+    const Query &query, const std::vector<const Array *> *objects,
     std::vector<std::vector<unsigned char> > *values, bool &hasSolution) {
+  TimerStatIncrementer t(stats::queryTime);
+  runStatusCode = SOLVER_RUN_STATUS_FORK_FAILED;
+  if ((serverOwner != getpid() || serverSocket < 0) && !startServer())
+    return false;
+
+  unsigned sum = sizeof(Z3ServerRequest);
+  if (objects)
+    for (std::vector<const Array *>::const_iterator it = objects->begin(),
+                                                    ie = objects->end();
+         it != ie; ++it)
+      sum += (*it)->size;
+  if (sum >= z3SharedMemorySize)
+    llvm::report_fatal_error("not enough shared memory for counterexample");
+
+  ++stats::queries;
+  if (objects)
+    ++stats::queryCounterexamples;
+
+  ((Z3ServerRequest *)sharedMemory)->timeout = timeout;
+  std::string buffer;
+  llvm::raw_string_ostream os(buffer);
+  BinaryQueryWriter writer(os);
+  writer.writeQuery(objects ? binlog::InitialValues : binlog::Truth, 0, query,
+                    objects);
+  // Terminate the query, or the server would wait for the next record to
+  // tell whether the query has a result.
+  writer.writeResult(false, 0, binlog::NoAnswer);
+  os.flush();
+
+  runStatusCode = SOLVER_RUN_STATUS_INTERRUPTED;
+  for (size_t sent = 0; sent != buffer.size();) {
+    ssize_t n = send(serverSocket, buffer.data() + sent, buffer.size() - sent,
+                     MSG_NOSIGNAL);
+    if (n < 0 && errno == EINTR)
+      continue;
+    if (n <= 0) {
+      klee_warning("Z3 server is gone");
+      stopServer(/*kill=*/true);
+      return false;
+    }
+    sent += n;
+  }
+
+  // Z3 does not always honour its timeout, so give it a second more before
+  // giving up on it, as STP's alarm() does.
+  int wait = timeout ? (int)(timeout * 1000) + 1000 : -1;
+  struct pollfd pfd;
+  pfd.fd = serverSocket;
+  pfd.events = POLLIN;
+  int ready;
+  do {
+    ready = poll(&pfd, 1, wait);
+  } while (ready < 0 && errno == EINTR);
+  if (ready == 0) {
+    klee_warning("Z3 timed out, killing it");
+    stopServer(/*kill=*/true);
+    runStatusCode = SOLVER_RUN_STATUS_TIMEOUT;
+    return false;
+  }
+
+  Z3ServerResponse response;
+  size_t received = 0;
+  while (ready > 0 && received != sizeof response) {
+    ssize_t n = recv(serverSocket, (char *)&response + received,
+                     sizeof response - received, 0);
+    if (n < 0 && errno == EINTR)
+      continue;
+    if (n <= 0)
+      break;
+    received += n;
+  }
+  if (received != sizeof response) {
+    if (!interrupted)
+      klee_warning("Z3 did not return successfully");
+    stopServer(/*kill=*/true);
+    return false;
+  }
+
+  runStatusCode = (SolverRunStatus)response.status;
+  if (runStatusCode != SOLVER_RUN_STATUS_SUCCESS_SOLVABLE &&
+      runStatusCode != SOLVER_RUN_STATUS_SUCCESS_UNSOLVABLE)
+    return false;
+
+  hasSolution = response.hasSolution;
+  if (hasSolution) {
+    ++stats::queriesInvalid;
+    if (objects) {
+      unsigned char *pos = sharedMemory + sizeof(Z3ServerRequest);
+      values->clear();
+      values->reserve(objects->size());
+      for (std::vector<const Array *>::const_iterator it = objects->begin(),
+                                                      ie = objects->end();
+           it != ie; ++it) {
+        values->push_back(
+            std::vector<unsigned char>(pos, pos + (*it)->size));
+        pos += (*it)->size;
+      }
+    }
+  } else {
+    ++stats::queriesValid;
+  }
+  return true;
+}
+
+/// getByte - Read the numeral \a e, the value of a byte in a model, into
+/// \a byte.
+static bool getByte(Z3_context ctx, Z3_ast e, unsigned char &byte) {
+  if (!e || Z3_get_ast_kind(ctx, e) != Z3_NUMERAL_AST)
+    return false;
+  uint64_t value = getNumeral(ctx, e);
+  if (value > 255)
+    return false;
+  byte = value;
+  return true;
+}
+
+/// readArrayModel - Read the bytes \a theModel gives the array \a array
+/// into \a data, from the model's interpretation of the array as a whole:
+/// either a function with an entry per constrained byte and a default, or
+/// a chain of stores over a constant array. Returns false if the array, or
+/// its interpretation, is not of a form this decodes.
+static bool readArrayModel(Z3_context ctx, Z3_model theModel, Z3_ast array,
+                           unsigned size, std::vector<unsigned char> &data) {
+  // Constant arrays are built over stores rather than being a constant.
+  if (Z3_get_ast_kind(ctx, array) != Z3_APP_AST)
+    return false;
+  Z3_app app = Z3_to_app(ctx, array);
+  if (Z3_get_app_num_args(ctx, app) != 0)
+    return false;
+  Z3_func_decl decl = Z3_get_app_decl(ctx, app);
+
+  // The model leaves out arrays the query does not constrain.
+  data.assign(size, 0);
+  if (!Z3_model_has_interp(ctx, theModel, decl))
+    return true;
+  Z3ASTHandle interp(Z3_model_get_const_interp(ctx, theModel, decl), ctx);
+  if (!interp)
+    return false;
+
+  if (Z3_is_as_array(ctx, interp)) {
+    Z3_func_interp fi = Z3_model_get_func_interp(
+        ctx, theModel, Z3_get_as_array_func_decl(ctx, interp));
+    if (!fi)
+      return false;
+    Z3_func_interp_inc_ref(ctx, fi);
+    unsigned char byte = 0;
+    bool success = getByte(ctx, Z3_func_interp_get_else(ctx, fi), byte);
+    if (success)
+      data.assign(size, byte);
+    for (unsigned i = 0, e = Z3_func_interp_get_num_entries(ctx, fi);
+         success && i != e; ++i) {
+      Z3_func_entry entry = Z3_func_interp_get_entry(ctx, fi, i);
+      Z3_func_entry_inc_ref(ctx, entry);
+      Z3_ast index = Z3_func_entry_get_arg(ctx, entry, 0);
+      success = Z3_func_entry_get_num_args(ctx, entry) == 1 &&
+                Z3_get_ast_kind(ctx, index) == Z3_NUMERAL_AST &&
+                getByte(ctx, Z3_func_entry_get_value(ctx, entry), byte);
+      if (success) {
+        uint64_t offset = getNumeral(ctx, index);
+        if (offset < size)
+          data[offset] = byte;
+      }
+      Z3_func_entry_dec_ref(ctx, entry);
+    }
+    Z3_func_interp_dec_ref(ctx, fi);
+    return success;
+  }
+
+  // The outermost store to an offset is the one that holds.
+  std::vector<bool> stored(size, false);
+  Z3_ast node = interp;
+  while (Z3_get_ast_kind(ctx, node) == Z3_APP_AST) {
+    Z3_app nodeApp = Z3_to_app(ctx, node);
+    Z3_decl_kind kind = Z3_get_decl_kind(ctx, Z3_get_app_decl(ctx, nodeApp));
+    unsigned char byte;
+    if (kind == Z3_OP_CONST_ARRAY) {
+      if (!getByte(ctx, Z3_get_app_arg(ctx, nodeApp, 0), byte))
+        return false;
+      for (unsigned offset = 0; offset != size; ++offset)
+        if (!stored[offset])
+          data[offset] = byte;
+      return true;
+    }
+    if (kind != Z3_OP_STORE)
+      return false;
+    Z3_ast index = Z3_get_app_arg(ctx, nodeApp, 1);
+    if (Z3_get_ast_kind(ctx, index) != Z3_NUMERAL_AST ||
+        !getByte(ctx, Z3_get_app_arg(ctx, nodeApp, 2), byte))
+      return false;
+    uint64_t offset = getNumeral(ctx, index);
+    if (offset < size && !stored[offset]) {
+      data[offset] = byte;
+      stored[offset] = true;
+    }
+    node = Z3_get_app_arg(ctx, nodeApp, 0);
+  }
+  return false;
+}
+
+/// evaluateArrayModel - Read the bytes \a theModel gives \a array into
+/// \a data by evaluating a read of each byte.
+static void evaluateArrayModel(Z3Builder *builder, Z3_model theModel,
+                               const Array *array,
+                               std::vector<unsigned char> &data) {
+  data.clear();
+  data.reserve(array->size);
+  for (unsigned offset = 0; offset < array->size; offset++) {
+    // We can't use Z3ASTHandle here so have to do ref counting manually
+    ::Z3_ast arrayElementExpr;
+    Z3ASTHandle initial_read = builder->getInitialRead(array, offset);
+
+    bool successfulEval =
+        Z3_model_eval(builder->ctx, theModel, initial_read,
+                      /*model_completion=*/Z3_TRUE, &arrayElementExpr);
+    assert(successfulEval && "Failed to evaluate model");
+    Z3_inc_ref(builder->ctx, arrayElementExpr);
+    assert(Z3_get_ast_kind(builder->ctx, arrayElementExpr) ==
+               Z3_NUMERAL_AST &&
+           "Evaluated expression has wrong sort");
+
+    int arrayElementValue = 0;
+    bool successGet = Z3_get_numeral_int(builder->ctx, arrayElementExpr,
+                                         &arrayElementValue);
+    assert(successGet && "failed to get value back");
+    assert(arrayElementValue >= 0 && arrayElementValue <= 255 &&
+           "Integer from model is out of range");
+    data.push_back(arrayElementValue);
+    Z3_dec_ref(builder->ctx, arrayElementExpr);
+  }
+}
+
+/// getSolverResponse - Turn the answer of \a theSolver, on the context of
+/// \a builder, into a run status and read back the values of the objects.
+static SolverImpl::SolverRunStatus
+getSolverResponse(Z3Builder *builder, ::Z3_solver theSolver,
+                  ::Z3_lbool satisfiable,
+                  const std::vector<const Array *> *objects,
+                  std::vector<std::vector<unsigned char> > *values,
+                  bool &hasSolution) {
   switch (satisfiable) {
   case Z3_L_TRUE: {
     hasSolution = true;
@@ -244,30 +1805,13 @@ SolverImpl::SolverRunStatus Z3SolverImpl::handleSolverResponse(
       const Array *array = *it;
       std::vector<unsigned char> data;
 
-      data.reserve(array->size);
-      for (unsigned offset = 0; offset < array->size; offset++) {
-        // We can't use Z3ASTHandle here so have to do ref counting manually
-        ::Z3_ast arrayElementExpr;
-        Z3ASTHandle initial_read = builder->getInitialRead(array, offset);
-
-        bool successfulEval =
-            Z3_model_eval(builder->ctx, theModel, initial_read,
-                          /*model_completion=*/Z3_TRUE, &arrayElementExpr);
-        assert(successfulEval && "Failed to evaluate model");
-        Z3_inc_ref(builder->ctx, arrayElementExpr);
-        assert(Z3_get_ast_kind(builder->ctx, arrayElementExpr) ==
-                   Z3_NUMERAL_AST &&
-               "Evaluated expression has wrong sort");
-
-        int arrayElementValue = 0;
-        bool successGet = Z3_get_numeral_int(builder->ctx, arrayElementExpr,
-                                             &arrayElementValue);
-        assert(successGet && "failed to get value back");
-        assert(arrayElementValue >= 0 && arrayElementValue <= 255 &&
-               "Integer from model is out of range");
-        data.push_back(arrayElementValue);
-        Z3_dec_ref(builder->ctx, arrayElementExpr);
-      }
+      // Arrays only read at constant indices have no array term; building
+      // one now would only make the reads go through it.
+      if (!builder->hasArrayTerm(array) ||
+          !readArrayModel(builder->ctx, theModel,
+                          builder->getInitialArray(array), array->size,
+                          data))
+        evaluateArrayModel(builder, theModel, array, data);
       values->push_back(data);
     }
 
@@ -295,6 +1839,413 @@ SolverImpl::SolverRunStatus Z3SolverImpl::handleSolverResponse(
   }
 }
 
+SolverImpl::SolverRunStatus Z3SolverImpl::handleSolverResponse(
+    ::Z3_solver theSolver, ::Z3_lbool satisfiable,
+    const std::vector<const Array *> *objects,
+    std::vector<std::vector<unsigned char> > *values, bool &hasSolution) {
+  return getSolverResponse(builder, theSolver, satisfiable, objects, values,
+                           hasSolution);
+}
+
+/// solve - Solve \a query from scratch on this context. Only reads the
+/// query's expressions and touches no statistics, so that contexts can run
+/// in parallel.
+SolverImpl::SolverRunStatus
+Z3PoolContext::solve(const Query &query,
+                     const std::vector<const Array *> *objects,
+                     std::vector<std::vector<unsigned char> > *values,
+                     bool &hasSolution) {
+  ::Z3_solver theSolver = Z3_mk_solver(builder->ctx);
+  Z3_solver_inc_ref(builder->ctx, theSolver);
+  Z3_solver_set_params(builder->ctx, theSolver, solverParameters);
+
+  for (ConstraintManager::const_iterator it = query.constraints.begin(),
+                                         ie = query.constraints.end();
+       it != ie; ++it)
+    Z3_solver_assert(builder->ctx, theSolver, builder->construct(*it));
+  Z3ASTHandle z3QueryExpr =
+      Z3ASTHandle(builder->construct(query.expr), builder->ctx);
+  Z3_solver_assert(
+      builder->ctx, theSolver,
+      Z3ASTHandle(Z3_mk_not(builder->ctx, z3QueryExpr), builder->ctx));
+
+  ::Z3_lbool satisfiable = Z3_solver_check(builder->ctx, theSolver);
+  SolverImpl::SolverRunStatus status = getSolverResponse(
+      builder, theSolver, satisfiable, objects, values, hasSolution);
+  Z3_solver_dec_ref(builder->ctx, theSolver);
+  builder->clearConstructCache();
+  return status;
+}
+
+namespace {
+/// The queries of a batch one pool context solves: every
+/// ``contexts.size()``-th one, starting at ``first``.
+struct Z3BatchWork {
+  Z3PoolContext *context;
+  unsigned first, stride;
+  const std::vector<Query> *queries;
+  const std::vector<std::vector<const Array *> > *objects;
+  std::vector<std::vector<std::vector<unsigned char> > > *values;
+  std::vector<char> *hasSolution;
+  std::vector<SolverImpl::SolverRunStatus> *status;
+};
+}
+
+static void *solveBatchWork(void *arg) {
+  Z3BatchWork *work = static_cast<Z3BatchWork *>(arg);
+  for (unsigned i = work->first, e = work->queries->size(); i < e;
+       i += work->stride) {
+    bool hasSolution = false;
+    (*work->status)[i] =
+        work->context->solve((*work->queries)[i], &(*work->objects)[i],
+                             &(*work->values)[i], hasSolution);
+    (*work->hasSolution)[i] = hasSolution;
+  }
+  return NULL;
+}
+
+/// computeInitialValuesMany - Solve independent queries on the contexts of
+/// the pool. Expressions are shared between threads only when reference
+/// counts are atomic; otherwise the contexts take turns.
+bool Z3SolverImpl::computeInitialValuesMany(
+    const std::vector<Query> &queries,
+    const std::vector<std::vector<const Array *> > &objects,
+    std::vector<std::vector<std::vector<unsigned char> > > &values,
+    std::vector<bool> &hasSolution) {
+  assert(queries.size() == objects.size() && "one object list per query");
+  values.clear();
+  values.resize(queries.size());
+  hasSolution.assign(queries.size(), false);
+
+  QueryScope scope(*this);
+  // The forked server solves one query at a time anyway.
+  if (useForkedZ3) {
+    for (unsigned i = 0, e = queries.size(); i != e; ++i) {
+      bool res;
+      if (!internalRunSolver(queries[i], &objects[i], &values[i], res))
+        return false;
+      hasSolution[i] = res;
+    }
+    return true;
+  }
+
+  TimerStatIncrementer t(stats::queryTime);
+  unsigned numContexts =
+      std::min<unsigned>(std::max(Z3ContextPoolSize.getValue(), 1u),
+                         queries.size());
+  growContextPool(numContexts);
+
+  std::vector<char> solutions(queries.size());
+  std::vector<SolverRunStatus> status(queries.size(),
+                                      SOLVER_RUN_STATUS_FAILURE);
+  std::vector<Z3BatchWork> work(numContexts);
+  for (unsigned c = 0; c != numContexts; ++c) {
+    Z3BatchWork w = {contextPool[c], c,       numContexts, &queries,
+                     &objects,       &values, &solutions,  &status};
+    work[c] = w;
+  }
+
+#ifdef KLEE_ATOMIC_REFCOUNT
+  std::vector<pthread_t> threads(numContexts);
+  std::vector<bool> started(numContexts);
+  for (unsigned c = 1; c < numContexts; ++c)
+    started[c] = !pthread_create(&threads[c], NULL, solveBatchWork, &work[c]);
+  if (numContexts)
+    solveBatchWork(&work[0]);
+  for (unsigned c = 1; c < numContexts; ++c) {
+    if (started[c])
+      pthread_join(threads[c], NULL);
+    else
+      solveBatchWork(&work[c]);
+  }
+#else
+  for (unsigned c = 0; c != numContexts; ++c)
+    solveBatchWork(&work[c]);
+#endif
+
+  bool success = true;
+  runStatusCode = SOLVER_RUN_STATUS_SUCCESS_SOLVABLE;
+  for (unsigned i = 0, e = queries.size(); i != e; ++i) {
+    ++stats::queries;
+    ++stats::queryCounterexamples;
+    if (status[i] != SOLVER_RUN_STATUS_SUCCESS_SOLVABLE &&
+        status[i] != SOLVER_RUN_STATUS_SUCCESS_UNSOLVABLE) {
+      runStatusCode = status[i];
+      success = false;
+      continue;
+    }
+    if (solutions[i])
+      ++stats::queriesInvalid;
+    else
+      ++stats::queriesValid;
+    hasSolution[i] = solutions[i];
+  }
+  return success;
+}
+
+/// growContextPool - Create pool contexts up to \a numContexts.
+void Z3SolverImpl::growContextPool(unsigned numContexts) {
+  pthread_mutex_lock(&interruptLock);
+  while (contextPool.size() < numContexts) {
+    contextPool.push_back(new Z3PoolContext());
+    contextPool.back()->setTimeout(timeoutInMilliSeconds);
+  }
+  pthread_mutex_unlock(&interruptLock);
+}
+
+namespace {
+/// Z3CubeSearch - The cubes of a split query, which the contexts of the
+/// pool take one at a time until one of them has a solution.
+struct Z3CubeSearch {
+  const Query *query;
+  const std::vector<ref<Expr> > *cubes;
+  const std::vector<const Array *> *objects;
+  const std::vector<Z3PoolContext *> *contexts;
+
+  /// Guards the fields below.
+  pthread_mutex_t lock;
+  unsigned nextCube;
+  /// Whether each context is solving a cube, and whether it was
+  /// interrupted as another cube had a solution.
+  std::vector<char> running, interrupted;
+  bool solved;
+  /// The values of the objects in the cube with a solution.
+  std::vector<std::vector<unsigned char> > values;
+  /// The status of a cube which was not solved, or
+  /// SOLVER_RUN_STATUS_SUCCESS_UNSOLVABLE.
+  SolverImpl::SolverRunStatus failure;
+};
+
+struct Z3CubeWork {
+  Z3CubeSearch *search;
+  unsigned context;
+};
+}
+
+static void *solveCubeWork(void *arg) {
+  Z3CubeWork *work = static_cast<Z3CubeWork *>(arg);
+  Z3CubeSearch &search = *work->search;
+  Z3PoolContext *context = (*search.contexts)[work->context];
+  for (;;) {
+    pthread_mutex_lock(&search.lock);
+    if (search.solved || search.nextCube == search.cubes->size()) {
+      pthread_mutex_unlock(&search.lock);
+      return NULL;
+    }
+    const ref<Expr> &cube = (*search.cubes)[search.nextCube++];
+    search.running[work->context] = true;
+    pthread_mutex_unlock(&search.lock);
+
+    std::vector<ref<Expr> > constraints(search.query->constraints.begin(),
+                                        search.query->constraints.end());
+    constraints.push_back(cube);
+    ConstraintManager cm(constraints);
+    std::vector<std::vector<unsigned char> > values;
+    bool hasSolution = false;
+    SolverImpl::SolverRunStatus status =
+        context->solve(Query(cm, search.query->expr), search.objects,
+                       search.objects ? &values : NULL, hasSolution);
+
+    pthread_mutex_lock(&search.lock);
+    search.running[work->context] = false;
+    if (status == SolverImpl::SOLVER_RUN_STATUS_SUCCESS_SOLVABLE) {
+      if (!search.solved) {
+        search.solved = true;
+        search.values.swap(values);
+        // The other cubes no longer matter.
+        for (unsigned c = 0, e = search.running.size(); c != e; ++c) {
+          if (search.running[c]) {
+            Z3_interrupt((*search.contexts)[c]->builder->ctx);
+            search.interrupted[c] = true;
+          }
+        }
+      }
+    } else if (status != SolverImpl::SOLVER_RUN_STATUS_SUCCESS_UNSOLVABLE) {
+      search.failure = status;
+    }
+    pthread_mutex_unlock(&search.lock);
+  }
+}
+
+/// solveCubes - Solve \a query, which Z3 did not solve within
+/// -z3-cube-threshold, as one query per cube on the contexts of the pool.
+/// It has a solution if a cube has one, and none if no cube has.
+SolverImpl::SolverRunStatus Z3SolverImpl::solveCubes(
+    const Query &query, const std::vector<ref<Expr> > &cubes,
+    const std::vector<const Array *> *objects,
+    std::vector<std::vector<unsigned char> > *values, bool &hasSolution) {
+  ++stats::queryCubeSplits;
+  unsigned numContexts =
+      std::min<unsigned>(std::max(Z3ContextPoolSize.getValue(), 1u),
+                         cubes.size());
+  growContextPool(numContexts);
+
+  Z3CubeSearch search;
+  search.query = &query;
+  search.cubes = &cubes;
+  search.objects = objects;
+  search.contexts = &contextPool;
+  pthread_mutex_init(&search.lock, NULL);
+  search.nextCube = 0;
+  search.running.assign(numContexts, false);
+  search.interrupted.assign(numContexts, false);
+  search.solved = false;
+  search.failure = SOLVER_RUN_STATUS_SUCCESS_UNSOLVABLE;
+  std::vector<Z3CubeWork> work(numContexts);
+  for (unsigned c = 0; c != numContexts; ++c) {
+    Z3CubeWork w = {&search, c};
+    work[c] = w;
+  }
+
+#ifdef KLEE_ATOMIC_REFCOUNT
+  std::vector<pthread_t> threads(numContexts);
+  std::vector<bool> started(numContexts);
+  for (unsigned c = 1; c < numContexts; ++c)
+    started[c] = !pthread_create(&threads[c], NULL, solveCubeWork, &work[c]);
+  solveCubeWork(&work[0]);
+  for (unsigned c = 1; c < numContexts; ++c)
+    if (started[c])
+      pthread_join(threads[c], NULL);
+#else
+  solveCubeWork(&work[0]);
+#endif
+  pthread_mutex_destroy(&search.lock);
+  stats::queryCubes += search.nextCube;
+
+  // Z3 leaves no guarantees about an interrupted context.
+  pthread_mutex_lock(&interruptLock);
+  for (unsigned c = 0; c != numContexts; ++c) {
+    if (search.interrupted[c]) {
+      delete contextPool[c];
+      contextPool[c] = new Z3PoolContext();
+      contextPool[c]->setTimeout(timeoutInMilliSeconds);
+    }
+  }
+  pthread_mutex_unlock(&interruptLock);
+
+  if (search.solved) {
+    hasSolution = true;
+    if (values)
+      values->swap(search.values);
+    return SOLVER_RUN_STATUS_SUCCESS_SOLVABLE;
+  }
+  hasSolution = false;
+  return search.failure;
+}
+
+void Z3SolverImpl::beginQuery() {
+  // Only this thread starts queries, so no query runs, and nothing can
+  // interrupt the context, while it is replaced.
+  if (Z3ContextMemoryBudget && !queriesRunning)
+    recycleContext();
+  pthread_mutex_lock(&interruptLock);
+  if (queriesRunning++ == 0)
+    interrupted = 0;
+  pthread_mutex_unlock(&interruptLock);
+}
+
+/// endQuery - Leave a QueryScope. Once the outermost one of an interrupted
+/// query is left, the solvers and contexts the query was interrupted in
+/// are replaced, as Z3 leaves no guarantees about them.
+void Z3SolverImpl::endQuery() {
+  pthread_mutex_lock(&interruptLock);
+  bool wasInterrupted = --queriesRunning == 0 && interrupted;
+  if (wasInterrupted) {
+    for (unsigned c = 0, e = contextPool.size(); c != e; ++c) {
+      delete contextPool[c];
+      contextPool[c] = new Z3PoolContext();
+      contextPool[c]->setTimeout(timeoutInMilliSeconds);
+    }
+  }
+  pthread_mutex_unlock(&interruptLock);
+  if (!wasInterrupted)
+    return;
+
+  resetIncrementalSolvers();
+  if (runStatusCode != SOLVER_RUN_STATUS_SUCCESS_SOLVABLE &&
+      runStatusCode != SOLVER_RUN_STATUS_SUCCESS_UNSOLVABLE)
+    runStatusCode = SOLVER_RUN_STATUS_INTERRUPTED;
+}
+
+static void *warmContext(void *arg) {
+  Z3ContextWarmer *warmer = static_cast<Z3ContextWarmer *>(arg);
+  warmer->builder = new Z3Builder(/*autoClearConstructCache=*/false);
+  for (std::vector<ref<Expr> >::const_iterator it = warmer->exprs.begin(),
+                                               ie = warmer->exprs.end();
+       it != ie; ++it)
+    warmer->builder->construct(*it);
+  warmer->done = true;
+  return NULL;
+}
+
+/// recycleContext - Once Z3 uses more memory than -z3-context-memory-budget
+/// allows, replace the context by a new one, which has the constraints of
+/// the latest query built already, so that the next queries do not pay for
+/// building their arrays and update lists all over again. The terms Z3
+/// interns and the caches of the builder otherwise only ever grow.
+void Z3SolverImpl::recycleContext() {
+  // A warmer inherited across fork() has no thread in this process, and
+  // its builder may be half built: it is left alone.
+  if (warmer && warmer->owner != getpid())
+    warmer = NULL;
+
+  if (!warmer) {
+    if (Z3_get_estimated_alloc_size() <
+        baseMemory + ((uint64_t)Z3ContextMemoryBudget << 20))
+      return;
+    warmer = new Z3ContextWarmer();
+    warmer->exprs.swap(hotConstraints);
+    warmer->builder = NULL;
+    warmer->done = false;
+    warmer->threaded = false;
+    warmer->owner = getpid();
+#ifdef KLEE_ATOMIC_REFCOUNT
+    // The current context answers queries until the new one is built.
+    warmer->threaded =
+        !pthread_create(&warmer->thread, NULL, warmContext, warmer);
+    if (warmer->threaded)
+      return;
+#endif
+    warmContext(warmer);
+  } else if (!warmer->done) {
+    return;
+  }
+
+  if (warmer->threaded)
+    pthread_join(warmer->thread, NULL);
+  freeContext();
+  createContext(warmer->builder);
+  delete warmer;
+  warmer = NULL;
+  // The pool contexts grow just the same; they are created again as needed.
+  pthread_mutex_lock(&interruptLock);
+  for (std::vector<Z3PoolContext *>::iterator it = contextPool.begin(),
+                                              ie = contextPool.end();
+       it != ie; ++it)
+    delete *it;
+  contextPool.clear();
+  pthread_mutex_unlock(&interruptLock);
+  baseMemory = Z3_get_estimated_alloc_size();
+  ++stats::solverContextRecycles;
+}
+
+/// interrupt - Stop Z3 in the main context and the pool, or kill the
+/// server, which is started again on the next query.
+void Z3SolverImpl::interrupt() {
+  pthread_mutex_lock(&interruptLock);
+  if (queriesRunning) {
+    interrupted = 1;
+    Z3_interrupt(builder->ctx);
+    for (std::vector<Z3PoolContext *>::iterator it = contextPool.begin(),
+                                                ie = contextPool.end();
+         it != ie; ++it)
+      Z3_interrupt((*it)->builder->ctx);
+    if (serverPid && serverOwner == getpid())
+      ::kill(serverPid, SIGKILL);
+  }
+  pthread_mutex_unlock(&interruptLock);
+}
+
 SolverImpl::SolverRunStatus Z3SolverImpl::getOperationStatusCode() {
   return runStatusCode;
 }
@@ -83,6 +83,15 @@
 
 using namespace klee;
 
+const char *util::GetMemoryCategoryName(MemoryCategory category) {
+  switch (category) {
+  case ExprMemory: return "Expr";
+  case ObjectStateMemory: return "ObjectState";
+  case SolverCacheMemory: return "SolverCache";
+  default: return "Unknown";
+  }
+}
+
 size_t util::GetTotalMallocUsage() {
 #ifdef KLEE_ASAN_BUILD
   // When building with ASan on Linux `mallinfo()` just returns 0 so use ASan runtime
@@ -392,6 +392,9 @@ ssize_t read(int fd, void *buf, size_t count) {
       count = f->dfile->size - f->off;
     }
     
+    /* With concrete pointers and count, the executor copies the bytes
+       natively rather than interpreting memcpy (see
+       -bulk-memory-functions); keep this a single call. */
     memcpy(buf, f->dfile->contents + f->off, count);
     f->off += count;
     
@@ -10,13 +10,17 @@
 /* Straight C for linking simplicity */
 
 #include <assert.h>
+#include <errno.h>
 #include <stdarg.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <sys/mman.h>
 #include <sys/time.h>
+#include <sys/wait.h>
 #include <time.h>
+#include <unistd.h>
 
 #include "klee/klee.h"
 
@@ -49,6 +53,103 @@ static void report_internal_error(const char *msg, ...) {
   }
 }
 
+static int read_all(int fd, void *buf, size_t n) {
+  char *p = buf;
+  while (n) {
+    ssize_t res = read(fd, p, n);
+    if (res < 0 && errno == EINTR)
+      continue;
+    if (res <= 0)
+      return 0;
+    p += res;
+    n -= res;
+  }
+  return 1;
+}
+
+static int write_all(int fd, const void *buf, size_t n) {
+  const char *p = buf;
+  while (n) {
+    ssize_t res = write(fd, p, n);
+    if (res < 0 && errno == EINTR)
+      continue;
+    if (res <= 0)
+      return 0;
+    p += res;
+    n -= res;
+  }
+  return 1;
+}
+
+/* Fork server for klee-replay --fork-server, which sets
+   KLEE_REPLAY_FORK_SERVER to "<command fd>,<status fd>,<input fd>".
+
+   The program is started once. Before main runs, this loops: it reads the
+   size of the next test, which klee-replay has written to the input file,
+   and forks. The child maps the test, reads it and goes on into main; the
+   server sends klee-replay the child's pid and then its wait status. The
+   loop ends when klee-replay closes the command pipe. */
+__attribute__((constructor)) static void fork_server(void) {
+  int commandFd, statusFd, inputFd;
+  const char *env = getenv("KLEE_REPLAY_FORK_SERVER");
+  uint32_t hello = 0;
+
+  if (!env || sscanf(env, "%d,%d,%d", &commandFd, &statusFd, &inputFd) != 3)
+    return;
+  if (!write_all(statusFd, &hello, sizeof hello))
+    _exit(1);
+
+  for (;;) {
+    uint32_t size;
+    int32_t pid, status;
+
+    if (!read_all(commandFd, &size, sizeof size))
+      _exit(0);
+
+    pid = fork();
+    if (pid < 0)
+      _exit(1);
+    if (pid == 0) {
+      void *input;
+      FILE *f;
+
+      close(commandFd);
+      close(statusFd);
+      unsetenv("KLEE_REPLAY_FORK_SERVER");
+
+      input = mmap(0, size, PROT_READ, MAP_SHARED, inputFd, 0);
+      if (input == MAP_FAILED || !(f = fmemopen(input, size, "rb"))) {
+        fprintf(stderr, "KLEE-RUNTIME: unable to map test input\n");
+        exit(1);
+      }
+      testData = kTest_fromStream(f);
+      fclose(f);
+      munmap(input, size);
+      close(inputFd);
+      if (!testData) {
+        fprintf(stderr, "KLEE-RUNTIME: unable to read test input\n");
+        exit(1);
+      }
+      return;
+    }
+
+    if (!write_all(statusFd, &pid, sizeof pid))
+      _exit(1);
+    while (waitpid(pid, &status, 0) < 0) {
+      if (errno != EINTR)
+        _exit(1);
+    }
+    if (!write_all(statusFd, &status, sizeof status))
+      _exit(1);
+  }
+}
+
+void klee_make_symbolic_float(void *array, size_t nbytes, const char *name,
+                              unsigned kind, unsigned flags, double lo,
+                              double hi) {
+  klee_make_symbolic(array, nbytes, name);
+}
+
 void klee_make_symbolic(void *array, size_t nbytes, const char *name) {
   static int rand_init = -1;
 
@@ -176,3 +277,5 @@ int klee_range(int begin, int end, const char* name) {
 void klee_print_expr(const char *msg, ...) { }
 
 void klee_set_forking(unsigned enable) { }
+
+void klee_mark_pure(const char *fn_name) { }
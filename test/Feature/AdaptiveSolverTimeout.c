@@ -0,0 +1,24 @@
+// RUN: %llvmgcc %s -emit-llvm -O0 -c -o %t.bc
+// RUN: rm -rf %t.klee-out
+// RUN: %klee --output-dir=%t.klee-out --max-solver-time=10 --adaptive-solver-timeout --adaptive-solver-timeout-min-samples=1 %t.bc
+// RUN: ls %t.klee-out/ | grep .ktest | wc -l | grep 16
+// RUN: head -n 1 %t.klee-out/run.stats | grep TimeoutPredictions
+
+// Queries which finish keep the full timeout, so no path is lost.
+
+#include "klee/klee.h"
+
+int main() {
+  float f;
+  unsigned char x;
+  klee_make_symbolic(&f, sizeof(f), "f");
+  klee_make_symbolic(&x, sizeof(x), "x");
+
+  int n = 0;
+  for (unsigned i = 0; i != 3; ++i)
+    if (x & (1 << i))
+      n++;
+  if (f > 1.0f)
+    n++;
+  return n;
+}
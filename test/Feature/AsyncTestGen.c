@@ -0,0 +1,24 @@
+// RUN: %llvmgcc %s -emit-llvm -O0 -c -o %t1.bc
+// RUN: rm -rf %t.klee-out
+// RUN: %klee --output-dir=%t.klee-out --async-test-gen=2 %t1.bc 2> %t.log
+// RUN: ls %t.klee-out/ | grep .ktest | wc -l | grep 16
+// RUN: ls %t.klee-out/ | grep .assert.err | wc -l | grep 1
+// RUN: grep "generated tests = 16" %t.log
+// RUN: ktest-tool %t.klee-out/test000016.ktest
+
+#include "klee/klee.h"
+#include <assert.h>
+
+int main() {
+  unsigned char x;
+  klee_make_symbolic(&x, sizeof x, "x");
+
+  // Sixteen paths, one of which fails the assertion.
+  unsigned n = 0;
+  if (x & 1) ++n;
+  if (x & 2) n += 2;
+  if (x & 4) n += 4;
+  if (x & 8) n += 8;
+  assert(n != 15);
+  return 0;
+}
@@ -0,0 +1,27 @@
+// RUN: %llvmgcc %s -emit-llvm -g -O0 -c -o %t.bc
+// RUN: rm -rf %t.klee-out
+// RUN: %klee --output-dir=%t.klee-out --search=dfs --search=random-path --use-bandit-search --bandit-slice-instructions=20 %t.bc 2>&1 | FileCheck %s
+// RUN: grep -q "^1 0 " %t.klee-out/bandit.txt
+// RUN: grep -q "^2 1 " %t.klee-out/bandit.txt
+// CHECK-DAG: bandit searcher 0 (DFSSearcher)
+// CHECK-DAG: bandit searcher 1 (RandomPathSearcher)
+// CHECK: KLEE: done: completed paths = 8
+
+// Each searcher gets a first slice before UCB1 picks by their rewards; the
+// states explored are the same whichever searcher picks them.
+
+#include "klee/klee.h"
+
+int main() {
+  int a, b, c, r = 0;
+  klee_make_symbolic(&a, sizeof(a), "a");
+  klee_make_symbolic(&b, sizeof(b), "b");
+  klee_make_symbolic(&c, sizeof(c), "c");
+  if (a > 0)
+    r += 1;
+  if (b > 0)
+    r += 2;
+  if (c > 0)
+    r += 4;
+  return r;
+}
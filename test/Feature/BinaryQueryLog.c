@@ -0,0 +1,35 @@
+// RUN: %llvmgcc %s -emit-llvm -g -O0 -c -o %t.bc
+// RUN: rm -rf %t.klee-out
+// RUN: %klee --output-dir=%t.klee-out --use-query-log=all:binary,solver:binary %t.bc
+// RUN: %kleaver --replay-binary %t.klee-out/all-queries.kqlog | FileCheck %s
+// RUN: %kleaver --replay-binary %t.klee-out/solver-queries.kqlog | FileCheck %s
+// RUN: %kleaver --benchmark --benchmark-jobs=2 %t.klee-out/all-queries.kqlog | FileCheck --check-prefix=CSV %s
+// RUN: %kleaver --benchmark --benchmark-format=json %t.klee-out/all-queries.kqlog | FileCheck --check-prefix=JSON %s
+// RUN: %kleaver --benchmark --benchmark-variant="default:" --benchmark-variant="nocache:-use-cache=false -use-cex-cache=false -use-independent-solver=false" %t.klee-out/all-queries.kqlog | FileCheck --check-prefix=VARIANTS %s
+
+// CHECK: Query 0:
+// CHECK-NOT: MISMATCH
+// CHECK: mismatches = 0
+
+// CSV: type,queries,timeouts,failures,total,p50,p90,p99,max,query_cache_hit_rate,cex_cache_hit_rate,mismatches
+// CSV-NEXT: all,{{[1-9][0-9]*}},0,0,{{.*}},0{{$}}
+
+// JSON: "jobs": 1,
+// JSON: {"type": "all", "queries": {{[1-9][0-9]*}}, "timeouts": 0,{{.*}}"mismatches": 0}
+
+// The chain without caches gives the same answers as the default one.
+// VARIANTS: variant,type,queries,
+// VARIANTS: default,all,{{[1-9][0-9]*}},0,0,{{.*}},0{{$}}
+// VARIANTS: nocache,all,{{[1-9][0-9]*}},0,0,{{.*}},0{{$}}
+
+#include "klee/klee.h"
+
+int main() {
+  unsigned x, y;
+  klee_make_symbolic(&x, sizeof(x), "x");
+  klee_make_symbolic(&y, sizeof(y), "y");
+
+  if (x > 10 && y < x)
+    return x * y == 77;
+  return 0;
+}
@@ -0,0 +1,20 @@
+// RUN: %llvmgcc %s -emit-llvm -g -O0 -c -o %t.bc
+// RUN: rm -rf %t.klee-out
+// RUN: %klee --output-dir=%t.klee-out --stats-format=binary %t.bc
+// RUN: not test -f %t.klee-out/run.stats
+// RUN: not test -f %t.klee-out/run.istats
+// RUN: head -c 4 %t.klee-out/run.stats.bin | FileCheck --check-prefix=STATS %s
+// RUN: head -c 4 %t.klee-out/run.istats.bin | FileCheck --check-prefix=ISTATS %s
+
+// STATS: KSTB
+// ISTATS: KISB
+
+#include "klee/klee.h"
+
+int main() {
+  int x;
+  klee_make_symbolic(&x, sizeof(x), "x");
+  if (x > 10)
+    return 1;
+  return 0;
+}
@@ -0,0 +1,33 @@
+// REQUIRES: bitwuzla
+// RUN: %llvmgcc %s -emit-llvm -O0 -c -o %t.bc
+// RUN: rm -rf %t.klee-out
+// RUN: %klee --output-dir=%t.klee-out --solver-backend=bitwuzla --exit-on-error %t.bc 2>&1 | FileCheck %s
+// RUN: rm -rf %t.klee-out
+// RUN: %klee --output-dir=%t.klee-out --solver-backend=bitwuzla --bitwuzla-incremental --exit-on-error %t.bc 2>&1 | FileCheck %s
+// CHECK: KLEE: done: completed paths = 9
+
+#include "klee/klee.h"
+
+#include <math.h>
+
+int main() {
+  float f;
+  double x;
+  union {
+    float f;
+    unsigned u;
+  } c;
+  klee_make_symbolic(&f, sizeof(f), "f");
+  klee_make_symbolic(&x, sizeof(x), "x");
+
+  // The bits of a float are a bitvector defined to convert back to it.
+  c.f = f;
+  if (f >= 1.0f && f < 2.0f)
+    klee_assert(c.u >> 23 == 127);
+
+  // fmod() truncates the quotient, where the IEEE remainder rounds it to
+  // nearest and may come out negative.
+  if (x > 0 && x < 100)
+    klee_assert(fmod(x, 4.0) >= 0);
+  return 0;
+}
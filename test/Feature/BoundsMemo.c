@@ -0,0 +1,24 @@
+// RUN: %llvmgcc %s -emit-llvm -g -O0 -c -o %t.bc
+// RUN: rm -rf %t.klee-out
+// RUN: %klee --output-dir=%t.klee-out %t.bc 2>&1 | FileCheck %s
+// RUN: rm -rf %t.klee-out
+// RUN: %klee --output-dir=%t.klee-out --bounds-memo=false %t.bc 2>&1 | FileCheck %s
+
+#include "klee/klee.h"
+
+int main() {
+  int a[8] = { 0 };
+  unsigned i;
+  int *p;
+
+  klee_make_symbolic(&i, sizeof(i), "i");
+  klee_assume(i < 6);
+  p = a + i;
+
+  // The accesses next to the first are proved in bounds along with it,
+  // and one past them is still checked.
+  int s = p[0] + p[1] + p[2];
+  // CHECK: BoundsMemo.c:[[@LINE+1]]: memory error: out of bound pointer
+  s += p[3];
+  return s;
+}
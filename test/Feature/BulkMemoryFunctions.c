@@ -0,0 +1,48 @@
+// RUN: %llvmgcc %s -emit-llvm -O0 -c -o %t.bc
+// RUN: rm -rf %t.klee-out
+// RUN: %klee --output-dir=%t.klee-out --exit-on-error %t.bc 2>&1 | FileCheck %s
+// RUN: rm -rf %t.klee-out
+// RUN: %klee --output-dir=%t.klee-out --bulk-memory-functions=false --exit-on-error %t.bc 2>&1 | FileCheck %s
+
+// Copies of mixed concrete and symbolic bytes, within one object and
+// across chunks, behave as the interpreted functions do.
+
+#include "klee/klee.h"
+
+#include <assert.h>
+#include <stdio.h>
+#include <string.h>
+
+#define N 10000
+
+char a[N], b[N];
+
+int main() {
+  unsigned char x;
+  klee_make_symbolic(&x, sizeof(x), "x");
+
+  for (int i = 0; i < N; ++i)
+    a[i] = i % 251;
+  a[5000] = x;
+
+  memcpy(b, a, N);
+  assert(b[4999] == 4999 % 251);
+  assert(b[5000] == (char) x);
+
+  // Overlapping, both ways.
+  memmove(b + 1, b, N - 1);
+  assert(b[5001] == (char) x && b[5000] == 4999 % 251);
+  memmove(b, b + 2, N - 2);
+  assert(b[4999] == (char) x && b[4998] == 4999 % 251);
+
+  memset(b + 100, 0, 8192);
+  assert(b[99] == 100 && b[100] == 0 && b[8291] == 0 && b[8292] != 0);
+  memset(b, x, 3);
+  assert(b[0] == (char) x && b[2] == (char) x && b[3] == 4);
+
+  if (x == 42)
+    printf("forty-two\n");
+  // CHECK: forty-two
+  // CHECK: KLEE: done: completed paths = 2
+  return 0;
+}
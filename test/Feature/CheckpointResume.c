@@ -0,0 +1,24 @@
+// RUN: %llvmgcc %s -emit-llvm -O0 -c -o %t.bc
+// RUN: rm -rf %t.klee-out
+// RUN: %klee --output-dir=%t.klee-out --checkpoint-interval=3600 --stop-after-n-instructions=100 --dump-states-on-halt=false %t.bc
+// RUN: test -f %t.klee-out/checkpoint
+
+// The resumed run explores the paths left by the first one, so that both
+// write one test per path between them, and leaves no checkpoint.
+// RUN: %klee --resume=%t.klee-out --checkpoint-interval=3600 %t.bc 2>&1 | FileCheck %s
+// RUN: ls %t.klee-out/ | grep .ktest | wc -l | grep 16
+// RUN: not test -f %t.klee-out/checkpoint
+// CHECK: resuming {{[0-9]+}} states
+
+#include "klee/klee.h"
+
+int main() {
+  unsigned char x;
+  klee_make_symbolic(&x, sizeof(x), "x");
+
+  int n = 0;
+  for (int i = 0; i < 4; ++i)
+    if (x & (1 << i))
+      n += i;
+  return n;
+}
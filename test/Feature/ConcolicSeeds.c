@@ -0,0 +1,31 @@
+// RUN: %llvmgcc -emit-llvm -c -g %s -o %t.bc
+// RUN: rm -rf %t.klee-out
+// RUN: %klee --output-dir=%t.klee-out %t.bc "initial"
+// RUN: test -f %t.klee-out/test000001.ktest
+// RUN: not test -f %t.klee-out/test000002.ktest
+
+// The seed takes the first branch, the solver provides one for the second.
+// RUN: rm -rf %t.klee-out-2
+// RUN: %klee --output-dir=%t.klee-out-2 --concolic-seeds --only-seed --seed-out %t.klee-out/test000001.ktest %t.bc > %t.log
+// RUN: grep -q "small" %t.log
+// RUN: grep -q "large" %t.log
+
+#include <stdio.h>
+#include <string.h>
+
+int main(int argc, char **argv) {
+  int a;
+
+  klee_make_symbolic(&a, sizeof a, "a");
+  if (argc == 2 && strcmp(argv[1], "initial") == 0) {
+    klee_assume(a == 3);
+    return 0;
+  }
+
+  if (a < 10)
+    printf("small\n");
+  else
+    printf("large\n");
+
+  return 0;
+}
@@ -0,0 +1,24 @@
+// RUN: %llvmgcc %s -emit-llvm -O0 -c -o %t.bc
+// RUN: rm -rf %t.klee-out
+// RUN: %klee --output-dir=%t.klee-out --allocate-determ --allocate-determ-size=1 --exit-on-error %t.bc 2>&1 | FileCheck %s
+// CHECK: KLEE: done: completed paths = 1
+
+// Ten times the space of the arena goes through it: freed blocks and page
+// ranges are reused.
+
+#include "klee/klee.h"
+
+#include <stdlib.h>
+
+int main() {
+  int i;
+  for (i = 0; i != 100; ++i) {
+    char *large = malloc(100000);
+    char *small = malloc(100);
+    klee_assert(large && small);
+    large[99999] = small[99] = 1;
+    free(large);
+    free(small);
+  }
+  return 0;
+}
@@ -0,0 +1,32 @@
+// RUN: %llvmgcc %s -emit-llvm -g -O0 -c -o %t.bc
+// RUN: rm -rf %t.klee-out
+// RUN: %klee --output-dir=%t.klee-out --search=directed --target=DirectedSearch.c:30 %t.bc 2>&1 | FileCheck %s
+// RUN: ls %t.klee-out/ | grep .assert.err | wc -l | grep 1
+// RUN: ls %t.klee-out/ | grep .early | wc -l | grep 2
+// CHECK: KLEE: done: completed paths = 3
+
+// The states which cannot reach the target any more, including the one
+// spinning in the loop, are terminated early.
+
+#include "klee/klee.h"
+
+int nd() {
+  int r;
+  klee_make_symbolic(&r, sizeof(r), "r");
+  return r;
+}
+
+int main() {
+  int x;
+  klee_make_symbolic(&x, sizeof(x), "x");
+
+  if (x > 100) {
+    while (nd())
+      ;
+    return 0;
+  }
+
+  if (x == 7)
+    klee_assert(0);
+  return 1;
+}
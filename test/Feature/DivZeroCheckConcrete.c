@@ -0,0 +1,28 @@
+// RUN: %llvmgcc %s -emit-llvm -g -O0 -c -o %t.bc
+// RUN: rm -rf %t.klee-out
+// RUN: %klee --output-dir=%t.klee-out -check-div-zero %t.bc 2> %t.log
+// RUN: FileCheck %s < %t.log
+// RUN: ls %t.klee-out | grep -c div.err | grep 1
+
+// The checks are done on the instructions themselves: a concrete divisor
+// is compared on the spot, and a symbolic one forks only where it may be
+// zero. A division which overflows is not an error.
+
+#include "klee/klee.h"
+
+#include <limits.h>
+
+int main() {
+  int d;
+  volatile int zero = 0;
+  volatile long long min = LLONG_MIN, minusOne = -1;
+  klee_make_symbolic(&d, sizeof(d), "d");
+
+  if (min / minusOne != min)
+    return 1;
+  if (d == 3)
+    // CHECK: DivZeroCheckConcrete.c:25: divide by zero
+    return 1 / zero;
+  // CHECK: KLEE: done: completed paths = 2
+  return 100 / (d | 1);
+}
@@ -10,6 +10,11 @@
 // RUN: diff %t3.log %t4.log
 // RUN: grep "^; Query" %t.klee-out/all-queries.smt2 | wc -l | grep -q 17
 // RUN: grep "^; Query" %t.klee-out/solver-queries.smt2 | wc -l | grep -q 17
+// The same logs, written on a separate thread.
+// RUN: rm -rf %t.bg.klee-out
+// RUN: %klee --output-dir=%t.bg.klee-out --use-cex-cache=false --use-query-log=all:kquery,all:smt2 --query-log-background-writes %t1.bc 2> %t5.log
+// RUN: diff %t.klee-out/all-queries.kquery %t.bg.klee-out/all-queries.kquery
+// RUN: grep "^; Query" %t.bg.klee-out/all-queries.smt2 | wc -l | grep -q 17
 
 #include <assert.h>
 
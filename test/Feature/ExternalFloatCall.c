@@ -0,0 +1,26 @@
+// RUN: %llvmgcc %s -emit-llvm -O0 -c -o %t.bc
+// RUN: rm -rf %t.klee-out
+// RUN: %klee --output-dir=%t.klee-out %t.bc > %t.log
+// RUN: FileCheck %s < %t.log
+
+#include <math.h>
+#include <stdio.h>
+
+int main() {
+  volatile double x = 2.0, y = 10.0;
+  volatile float f = 0.25f;
+  unsigned i;
+
+  // CHECK: 1024.0
+  printf("%.1f\n", pow(x, y));
+  // CHECK: 0.5
+  printf("%.1f\n", sqrtf(f));
+  // Call sites with the same signature share their trampolines.
+  // CHECK: 3 4 5
+  for (i = 3; i != 6; ++i)
+    printf("%u ", (unsigned) floor(i + 0.5));
+  printf("\n");
+  // CHECK: 1.0
+  printf("%.1f\n", hypot(0.6, 0.8));
+  return 0;
+}
@@ -0,0 +1,35 @@
+// RUN: %llvmgcc %s -emit-llvm -O0 -c -o %t.bc
+// RUN: rm -rf %t.klee-out
+// RUN: %klee --output-dir=%t.klee-out %t.bc > %t.log
+// RUN: FileCheck %s < %t.log
+
+// States sharing an object until they write to it each see their own
+// contents in native memory, and what native code writes to it is seen
+// when the state next copies its memory out.
+
+#include "klee/klee.h"
+#include <stdio.h>
+
+char buf[16];
+
+int main() {
+  int x;
+  klee_make_symbolic(&x, sizeof(x), "x");
+
+  sprintf(buf, "shared");
+  // CHECK-DAG: before shared
+  printf("before %s\n", buf);
+
+  if (x)
+    sprintf(buf, "then %d", 1);
+  else
+    buf[0] = 'S';
+
+  // CHECK-DAG: after then 1
+  // CHECK-DAG: after Shared
+  printf("after %s\n", buf);
+  // CHECK-DAG: again then 1
+  // CHECK-DAG: again Shared
+  printf("again %s\n", buf);
+  return 0;
+}
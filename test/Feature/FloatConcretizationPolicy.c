@@ -0,0 +1,35 @@
+// RUN: %llvmgcc %s -emit-llvm -O0 -c -o %t.bc
+// RUN: rm -rf %t.klee-out
+// RUN: %klee --output-dir=%t.klee-out %t.bc 2>&1 | FileCheck --check-prefix=NONE %s
+// RUN: echo "store main 4 # quotients, not plain copies" > %t.policy
+// RUN: echo "call check" >> %t.policy
+// RUN: rm -rf %t.klee-out
+// RUN: %klee --output-dir=%t.klee-out --float-concretization-policy=%t.policy %t.bc 2>&1 | FileCheck --check-prefix=POLICY %s
+// RUN: echo "size main" > %t.bad
+// RUN: rm -rf %t.klee-out
+// RUN: not %klee --output-dir=%t.klee-out --float-concretization-policy=%t.bad %t.bc 2>&1 | FileCheck --check-prefix=BAD %s
+
+// NONE: KLEE: done: completed paths = 4
+// POLICY: concretizing floating point value by policy
+// POLICY: KLEE: done: completed paths = 1
+// BAD: size rules need a size
+
+#include "klee/klee.h"
+
+int check(double d) {
+  return d > 0.0;
+}
+
+int main() {
+  double x, y;
+  klee_make_symbolic(&x, sizeof(x), "x");
+  klee_make_symbolic(&y, sizeof(y), "y");
+
+  // The quotient is stored, so it is concretized; the symbolic y is passed
+  // to check, so it is too.
+  volatile double q = x / 3.0;
+  int r = 0;
+  if (q > 1.0)
+    r = 1;
+  return r + check(y);
+}
@@ -0,0 +1,42 @@
+// RUN: %llvmgcc %s -emit-llvm -g -O0 -c -o %t.bc
+// RUN: rm -rf %t.klee-out
+// RUN: %klee --output-dir=%t.klee-out --float-coverage %t.bc 2>&1 | FileCheck --check-prefix=DONE %s
+// RUN: FileCheck --check-prefix=CONCRETE < %t.klee-out/fpcov.txt %s
+// RUN: rm -rf %t.klee-out
+// RUN: %klee --output-dir=%t.klee-out --float-coverage --float-coverage-queries %t.bc
+// RUN: FileCheck --check-prefix=QUERIES < %t.klee-out/fpcov.txt %s
+// RUN: rm -rf %t.klee-out
+// RUN: %klee --output-dir=%t.klee-out --search=nurs:fpcov %t.bc 2>&1 | FileCheck --check-prefix=DONE %s
+// RUN: test -f %t.klee-out/fpcov.txt
+
+// DONE: KLEE: done: completed paths = 2
+
+// CONCRETE-DAG: FloatCoverage.c:[[@LINE+19]] fmul main: +inf{{$}}
+// CONCRETE-DAG: FloatCoverage.c:[[@LINE+19]] fdiv main: subnormal{{$}}
+// CONCRETE-DAG: FloatCoverage.c:[[@LINE+19]] fmul main: -0{{$}}
+// CONCRETE-DAG: FloatCoverage.c:[[@LINE+19]] fsub main: nan{{$}}
+
+// Adding one to a finite float rounds to nearest, so it can only give +0 or
+// a normal number.
+// QUERIES: FloatCoverage.c:[[@LINE+16]] fadd main: +0 normal{{$}}
+
+#include "klee/klee.h"
+
+int main() {
+  volatile float big = 3e38f, tiny = 1e-38f, zero = 0.0f;
+  float a, b, c, d, x, y;
+
+  klee_make_symbolic(&x, sizeof(x), "x");
+  klee_assume(x == x);
+  klee_assume(x - x == 0.0f);
+
+  a = big * 10.0f;
+  b = tiny / 100.0f;
+  c = zero * -1.0f;
+  d = a - a;
+  y = x + 1.0f;
+
+  if (y > 2.0f)
+    return 1;
+  return 0;
+}
@@ -0,0 +1,41 @@
+// RUN: %llvmgcc %s -emit-llvm -O0 -c -o %t1.bc
+// RUN: rm -rf %t.klee-out
+// RUN: %klee --output-dir=%t.klee-out --exit-on-error %t1.bc
+
+#include <assert.h>
+#include <fenv.h>
+
+int main() {
+  fenv_t env;
+  fexcept_t flags;
+
+  feclearexcept(FE_ALL_EXCEPT);
+  feraiseexcept(FE_OVERFLOW | FE_INEXACT);
+  assert(fetestexcept(FE_ALL_EXCEPT) == (FE_OVERFLOW | FE_INEXACT));
+  fegetexceptflag(&flags, FE_OVERFLOW);
+  feclearexcept(FE_OVERFLOW);
+  assert(fetestexcept(FE_ALL_EXCEPT) == FE_INEXACT);
+  fesetexceptflag(&flags, FE_ALL_EXCEPT);
+  assert(fetestexcept(FE_ALL_EXCEPT) == FE_OVERFLOW);
+
+  assert(fesetround(FE_UPWARD) == 0);
+  assert(fesetround(-1) != 0);
+  assert(fegetround() == FE_UPWARD);
+
+  // Holding clears the exceptions, updating merges them back.
+  feholdexcept(&env);
+  assert(!fetestexcept(FE_ALL_EXCEPT));
+  fesetround(FE_TOWARDZERO);
+  feraiseexcept(FE_INVALID);
+  feupdateenv(&env);
+  assert(fegetround() == FE_UPWARD);
+  assert(fetestexcept(FE_ALL_EXCEPT) == (FE_OVERFLOW | FE_INVALID));
+
+  fesetenv(FE_DFL_ENV);
+  assert(fegetround() == FE_TONEAREST);
+  assert(!fetestexcept(FE_ALL_EXCEPT));
+  fesetenv(&env);
+  assert(fegetround() == FE_UPWARD);
+  assert(fetestexcept(FE_ALL_EXCEPT) == FE_OVERFLOW);
+  return 0;
+}
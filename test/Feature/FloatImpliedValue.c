@@ -0,0 +1,32 @@
+// RUN: %llvmgcc %s -emit-llvm -O0 -c -o %t1.bc
+// RUN: rm -rf %t.klee-out
+// RUN: %klee --output-dir=%t.klee-out --debug-check-for-implied-values %t1.bc
+// RUN: ls %t.klee-out | not grep .err
+
+#include <assert.h>
+#include <string.h>
+
+unsigned bits(float f) {
+  unsigned u;
+  memcpy(&u, &f, sizeof u);
+  return u;
+}
+
+int main() {
+  float x, y, z;
+  klee_make_symbolic(&x, sizeof x, "x");
+  klee_make_symbolic(&y, sizeof y, "y");
+  klee_make_symbolic(&z, sizeof z, "z");
+
+  if (x == 1.5f)
+    assert(!klee_is_symbolic(bits(x)));
+
+  if ((double) y == 2.25)
+    assert(!klee_is_symbolic(bits(y)));
+
+  // Either zero compares equal to 0.0.
+  if (z == 0.0f)
+    assert(klee_is_symbolic(bits(z)));
+
+  return 0;
+}
@@ -0,0 +1,24 @@
+// RUN: %llvmgcc %s -emit-llvm -O0 -c -o %t.bc
+// RUN: rm -rf %t.klee-out
+// RUN: %klee --output-dir=%t.klee-out --use-float-search-solver --float-search-steps=1024 --debug-validate-solver --exit-on-error %t.bc 2>&1 | FileCheck %s
+// CHECK: KLEE: done: completed paths = 4
+
+// Nonlinear float constraints whose models the local search looks for
+// before the core solver is asked; every answer it gives is validated.
+
+#include "klee/klee.h"
+
+int main() {
+  float x;
+  double y;
+  klee_make_symbolic(&x, sizeof(x), "x");
+  klee_make_symbolic(&y, sizeof(y), "y");
+
+  if (x * x > 2.0f && x < 2.0f)
+    return 1;
+  if (y * y - 3.0 * y == -2.0)
+    return 2;
+  if (x + 1.0f == x)
+    return 3;
+  return 0;
+}
@@ -0,0 +1,28 @@
+// RUN: %llvmgcc %s -emit-llvm -O0 -c -o %t.bc
+// RUN: rm -rf %t.klee-out %t.kpack
+// RUN: echo "x 8 f64@0" > %t.map
+// RUN: %gen-float-seeds -seed 1 -n 9 -pack %t.kpack %t.map
+// RUN: %klee --output-dir=%t.klee-out --seed-out=%t.kpack --only-replay-seeds --only-seed %t.bc 2>&1 | FileCheck %s
+
+// Nine tests draw every class once, so the seeds alone reach each branch.
+// CHECK: using 9 seeds
+// CHECK: KLEE: done: completed paths = 5
+
+#include "klee/klee.h"
+
+#include <float.h>
+#include <math.h>
+
+int main() {
+  double x;
+  klee_make_symbolic(&x, sizeof x, "x");
+  if (isnan(x))
+    return 4;
+  if (isinf(x))
+    return 3;
+  if (x == 0)
+    return 0;
+  if (fabs(x) < DBL_MIN)
+    return 1;
+  return 2;
+}
@@ -0,0 +1,25 @@
+// RUN: %llvmgcc %s -emit-llvm -g -O0 -c -o %t.bc
+// RUN: rm -rf %t.klee-out
+// RUN: %klee --output-dir=%t.klee-out --fork-controller %t.bc 2>&1 | FileCheck --check-prefix=DONE %s
+// RUN: FileCheck < %t.klee-out/forks.txt %s
+
+// A branch is forked until it has been seen to fork often enough to judge.
+// DONE: KLEE: done: completed paths = 8
+
+// CHECK: ForkController.c:[[@LINE+12]] main: fork=7 concretize=0 defer=0
+// CHECK: total fork: 7 decisions
+// CHECK: total concretize: 0 decisions
+// CHECK: total defer: 0 decisions
+
+#include "klee/klee.h"
+
+int main() {
+  unsigned char x[3];
+  int i, n = 0;
+
+  klee_make_symbolic(x, sizeof(x), "x");
+  for (i = 0; i != 3; ++i)
+    if (x[i] > 100)
+      ++n;
+  return n;
+}
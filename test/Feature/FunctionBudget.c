@@ -0,0 +1,29 @@
+// RUN: %llvmgcc -emit-llvm -c -g %s -o %t.bc
+// RUN: rm -rf %t.klee-out
+// RUN: %klee --output-dir=%t.klee-out --function-budget=count:0:0:4 --write-function-costs %t.bc 2>&1 | FileCheck %s
+// RUN: FileCheck --check-prefix=COSTS %s < %t.klee-out/function.costs
+
+// The first call forks on each bit of a, which puts count over its budget
+// of states before any of them gets to the second call, whose argument is
+// then concrete.
+// CHECK: count is over its budget
+// CHECK: KLEE: done: completed paths = 256
+
+// COSTS: count{{.*}}0:0:4 exceeded
+
+#include "klee/klee.h"
+
+unsigned count(unsigned char x) {
+  unsigned i, n = 0;
+  for (i = 0; i != 8; ++i)
+    if (x & (1 << i))
+      ++n;
+  return n;
+}
+
+int main() {
+  unsigned char a, b;
+  klee_make_symbolic(&a, sizeof a, "a");
+  klee_make_symbolic(&b, sizeof b, "b");
+  return count(a) + count(b);
+}
@@ -0,0 +1,34 @@
+// RUN: %llvmgcc %s -emit-llvm -O0 -c -o %t1.bc
+// RUN: rm -rf %t.klee-out
+// RUN: %klee --output-dir=%t.klee-out --random-seed=1 --search=random-state %t1.bc 2> %t.log
+// RUN: grep "completed paths = 2" %t.log
+// RUN: grep "generated tests = 2" %t.log
+// RUN: rm -rf %t.klee-out
+// RUN: %klee --output-dir=%t.klee-out --random-seed=1 --search=random-state --fuse-concrete-runs=0 %t1.bc 2> %t.log
+// RUN: grep "completed paths = 2" %t.log
+// RUN: grep "generated tests = 2" %t.log
+
+#include "klee/klee.h"
+
+#include <assert.h>
+
+int main() {
+  double a[4] = { 1.0, 2.0, 3.0, 4.0 }, b[4];
+  float f = 0.5f;
+  int i, x;
+
+  // Straight-line blocks on concrete values run without the searcher.
+  for (i = 0; i < 4; ++i)
+    b[i] = a[i] * a[i] + (double) f;
+  assert(b[3] == 16.5);
+
+  klee_make_symbolic(&x, sizeof(x), "x");
+  // A symbolic operand ends a run.
+  if (x > 0)
+    b[0] = b[1] * 2.0 - (double) x;
+  else
+    b[0] = b[2];
+  assert(b[0] < 9.0);
+
+  return 0;
+}
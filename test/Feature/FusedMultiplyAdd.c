@@ -0,0 +1,27 @@
+// REQUIRES: z3
+// RUN: %llvmgcc %s -emit-llvm -O0 -ffp-contract=on -c -o %t.bc
+// RUN: rm -rf %t.klee-out
+// RUN: %klee --output-dir=%t.klee-out --solver-backend=z3 --exit-on-error %t.bc 2>&1 | FileCheck %s
+// CHECK: KLEE: done: completed paths = 4
+
+// fma() and multiply-adds the compiler contracts into llvm.fmuladd are
+// rounded once.
+
+#include "klee/klee.h"
+
+#include <math.h>
+
+int main() {
+  double x;
+  klee_make_symbolic(&x, sizeof(x), "x");
+
+  // 0.1 * 10 rounds to 1 exactly, but 0.1 is not a tenth.
+  klee_assert(fma(0.1, 10.0, -1.0) != 0);
+
+  if (x >= 1 && x <= 2)
+    klee_assert(fma(x, 3.0, -x) == 2 * x);
+
+  if (x * 4.0 + 1.0 == 9.0)
+    klee_assert(x > 1.99 && x < 2.01);
+  return 0;
+}
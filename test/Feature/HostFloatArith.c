@@ -0,0 +1,32 @@
+// RUN: %llvmgcc %s -emit-llvm -O0 -c -o %t1.bc
+// RUN: rm -rf %t.klee-out
+// RUN: %klee --output-dir=%t.klee-out --exit-on-error %t1.bc
+// RUN: rm -rf %t.klee-out
+// RUN: %klee --output-dir=%t.klee-out --exit-on-error --host-float-arith=false %t1.bc
+
+#include <assert.h>
+#include <fenv.h>
+
+int main() {
+  volatile double one = 1.0, three = 3.0, zero = 0.0;
+  volatile float onef = 1.0f, threef = 3.0f;
+
+  fesetround(FE_UPWARD);
+  double up = one / three;
+  float upf = onef / threef;
+  fesetround(FE_DOWNWARD);
+  double down = one / three;
+  float downf = onef / threef;
+  fesetround(FE_TONEAREST);
+  assert(up > down);
+  assert(upf > downf);
+  assert(-one + one == 0.0);
+
+  feclearexcept(FE_ALL_EXCEPT);
+  double inf = one / zero;
+  assert(inf > 1e308);
+  // Only the host computation raises the exception.
+  if (fetestexcept(FE_DIVBYZERO))
+    assert(!fetestexcept(FE_INVALID));
+  return 0;
+}
@@ -0,0 +1,23 @@
+// RUN: %llvmgcc %s -emit-llvm -O0 -c -o %t1.bc
+// RUN: rm -rf %t.klee-out
+// RUN: %klee --output-dir=%t.klee-out --independent-solver-jobs=4 %t1.bc
+// RUN: ls %t.klee-out | grep -c ktest | grep 8
+
+#include "klee/klee.h"
+
+int main() {
+  int a, b, c;
+  klee_make_symbolic(&a, sizeof(a), "a");
+  klee_make_symbolic(&b, sizeof(b), "b");
+  klee_make_symbolic(&c, sizeof(c), "c");
+
+  // Every path has a factor per input.
+  int n = 0;
+  if (a > 10)
+    n += 1;
+  if (b * 3 == 21)
+    n += 2;
+  if (c < -5)
+    n += 4;
+  return n;
+}
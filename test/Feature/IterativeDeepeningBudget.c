@@ -0,0 +1,25 @@
+// RUN: %llvmgcc %s -emit-llvm -g -O0 -c -o %t.bc
+// RUN: rm -rf %t.klee-out
+// RUN: %klee --output-dir=%t.klee-out --search=dfs --use-iterative-deepening-budget-search --iterative-deepening-instructions=100 %t.bc 2>&1 | FileCheck %s
+// CHECK: increased budgets to {{[0-9]+}} instructions
+// CHECK: KLEE: done: completed paths = 3
+
+// The path spinning in the loop outgrows its instruction budget and is
+// paused until the short paths have completed, then resumes once the budget
+// has been doubled enough to cover what it used.
+
+#include "klee/klee.h"
+
+int main() {
+  int a, i;
+  volatile int sum = 0;
+  klee_make_symbolic(&a, sizeof(a), "a");
+  if (a == 0) {
+    for (i = 0; i < 1000; ++i)
+      sum += i;
+    return 0;
+  }
+  if (a > 0)
+    return 1;
+  return 2;
+}
@@ -0,0 +1,27 @@
+// RUN: %llvmgcc %s -emit-llvm -O0 -c -o %t1.bc
+// RUN: rm -rf %t.klee-out %t.klee-replay
+// RUN: %klee --output-dir=%t.klee-out --ktest-pack --ktest-pack-compress %t1.bc
+// RUN: ls %t.klee-out/ | grep .ktest | wc -l | grep 0
+// RUN: ktest-tool %t.klee-out/tests.kpack > %t.log
+// RUN: grep -c "ktest file" %t.log | grep 4
+// RUN: grep "tests.kpack:test000004.ktest" %t.log
+// RUN: %klee --output-dir=%t.klee-replay --replay-ktest-dir=%t.klee-out %t1.bc 2> %t.replay.log
+// RUN: grep -c "KLEE: replaying: .*tests.kpack:test" %t.replay.log | grep 4
+
+#include "klee/klee.h"
+
+int main() {
+  char buf[256];
+  int x;
+  klee_make_symbolic(buf, sizeof buf, "buf");
+  klee_make_symbolic(&x, sizeof x, "x");
+
+  if (x > 10) {
+    if (x > 20)
+      return 2;
+    return 1;
+  }
+  if (x < -10)
+    return -1;
+  return 0;
+}
@@ -0,0 +1,31 @@
+// RUN: %llvmgcc %s -emit-llvm -g -O0 -c -o %t.bc
+// RUN: rm -rf %t.klee-out %t.klee-out-bin
+// RUN: %klee --output-dir=%t.klee-out %t.bc
+// RUN: %klee --output-dir=%t.klee-out-bin --stats-format=binary %t.bc
+// RUN: %klee-summary -j 2 -tests -merge-istats=%t.istats %t.klee-out %t.klee-out-bin | FileCheck %s
+// RUN: FileCheck --check-prefix=ISTATS %s < %t.istats
+
+// Both runs, one of each statistics format, are summarized and their
+// instruction statistics merged.
+// CHECK: "path": "{{.*}}.klee-out", "tests": 3, "objects": 3, "objectBytes": 12, "errors": {"assert": 1}
+// CHECK: "stats": {"Instructions":
+// CHECK: "istats": {"instructions":
+// CHECK: "float": 2
+// CHECK: "path": "{{.*}}.klee-out-bin", "tests": 3
+// CHECK: "total": {"directories": 2, "tests": 6, "objects": 6, "objectBytes": 24, "errors": {"assert": 2}
+// CHECK: "istats": {"merged": 2, "notMerged": []
+
+// ISTATS: events:
+// ISTATS: fn=main
+
+#include "klee/klee.h"
+
+int main() {
+  float f;
+  klee_make_symbolic(&f, sizeof f, "f");
+  if (f > 1.0f) {
+    klee_assert(f != 2.0f);
+    return 1;
+  }
+  return 0;
+}
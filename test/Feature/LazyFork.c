@@ -0,0 +1,30 @@
+// RUN: %llvmgcc %s -emit-llvm -O0 -c -o %t.bc
+// RUN: rm -rf %t.klee-out
+// RUN: %klee --output-dir=%t.klee-out --lazy-fork %t.bc 2>&1 | FileCheck %s
+// RUN: ls %t.klee-out | grep .ktest | wc -l | grep 3
+// RUN: rm -rf %t.klee-out
+// RUN: %klee --output-dir=%t.klee-out --lazy-fork --use-auto-merge %t.bc 2>&1 | FileCheck --check-prefix=MERGE %s
+// CHECK-NOT: ASSERTION FAIL
+// CHECK: KLEE: done: completed paths = 3
+
+// The inner branches fork without the solver; their infeasible sides are
+// dropped when first selected, without a test case. States that merge
+// fork eagerly, as merging would drop the condition of a lazy child.
+// MERGE-NOT: ASSERTION FAIL
+
+#include "klee/klee.h"
+#include <assert.h>
+
+int main() {
+  int x;
+  klee_make_symbolic(&x, sizeof(x), "x");
+
+  if (x > 10) {
+    if (x < 5)
+      assert(0);
+    if (x > 20)
+      return 1;
+    return 2;
+  }
+  return 0;
+}
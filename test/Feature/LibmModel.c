@@ -0,0 +1,38 @@
+// RUN: %llvmgcc %s -emit-llvm -O0 -c -o %t.bc
+// RUN: rm -rf %t.klee-out
+// RUN: %klee --output-dir=%t.klee-out --libm-model=abstract %t.bc > %t.log
+// RUN: FileCheck %s < %t.log
+// RUN: ls %t.klee-out | not grep .err
+// RUN: rm -rf %t.klee-out
+// RUN: %klee --output-dir=%t.klee-out --libm-model=concretize %t.bc
+// RUN: ls %t.klee-out | not grep .err
+// RUN: rm -rf %t.klee-out
+// RUN: %klee --output-dir=%t.klee-out --libm-model=external %t.bc
+// RUN: ls %t.klee-out | grep .exec.err
+
+#include <assert.h>
+#include <math.h>
+#include <stdio.h>
+
+int main() {
+  volatile double c = 1.0;
+  double x, y;
+  klee_make_symbolic(&x, sizeof x, "x");
+  klee_make_symbolic(&y, sizeof y, "y");
+
+  // Concrete arguments are computed natively.
+  // CHECK: 2.718
+  printf("%.3f\n", exp(c));
+
+  double s = sin(x);
+  assert(!(s > 1.0) && !(s < -1.0));
+  if (x == 0.0)
+    assert(sin(x) == 0.0 && cos(x) == 1.0);
+  // The same arguments give the same result.
+  assert(!(s == s) || sin(x) == s);
+
+  if (!isnan(y) && y > 1.0)
+    assert(log(y) > 0.0 && exp(y) >= 1.0);
+  assert(pow(y, 0.0) == 1.0);
+  return 0;
+}
@@ -0,0 +1,32 @@
+// RUN: %llvmgcc %s -g -emit-llvm -O0 -c -o %t1.bc
+// RUN: rm -rf %t.klee-out
+// RUN: %klee --output-dir=%t.klee-out %t1.bc 2>&1 | FileCheck %s
+// RUN: test -f %t.klee-out/test000001.ptr.err
+
+// Small locals reuse the memory of those freed on return, and still get
+// their own bounds: an access one past a local does not reach the next one.
+
+#include <assert.h>
+
+float sum(int n) {
+  float values[4];
+  int i;
+  for (i = 0; i != 4; ++i)
+    values[i] = n + i;
+  return values[0] + values[1] + values[2] + values[3];
+}
+
+int main() {
+  volatile int past = 8;
+  float total = 0;
+  int n;
+  for (n = 0; n != 100; ++n)
+    total += sum(n);
+  assert(total == 4 * 4950 + 6 * 100);
+
+  char a[8], b[8];
+  b[0] = 0;
+  // CHECK: LocalObjectPool.c:[[@LINE+1]]: memory error: out of bound pointer
+  a[past] = 1;
+  return b[0];
+}
@@ -0,0 +1,31 @@
+// REQUIRES: z3
+// RUN: %llvmgcc %s -emit-llvm -O0 -c -o %t.bc
+// RUN: rm -rf %t.klee-out
+// RUN: %klee --output-dir=%t.klee-out --optimize --solver-backend=z3 --loop-summary-bound=16 --exit-on-error %t.bc 2>&1 | FileCheck %s
+// RUN: head -n 1 %t.klee-out/run.stats | grep LoopExitsSummarized
+// CHECK-NOT: ASSERTION FAIL
+// CHECK: KLEE: done: completed paths =
+
+// The state leaving the summarized loop has the sum of as many products as
+// the loop ran iterations.
+
+#include "klee/klee.h"
+
+double a[8] = { 1, 2, 3, 4, 5, 6, 7, 8 };
+double w[8] = { 0.5, 0.25, 2, 1, 4, 0.5, 1, 2 };
+
+int main() {
+  double sum = 0;
+  unsigned i, n;
+
+  klee_make_symbolic(&n, sizeof(n), "n");
+  klee_assume(n <= 8);
+  for (i = 0; i < n; ++i)
+    sum += a[i] * w[i];
+
+  if (n == 3)
+    klee_assert(sum == 7);
+  if (n == 5)
+    klee_assert(sum == 31);
+  return 0;
+}
@@ -0,0 +1,28 @@
+// RUN: %llvmgcc %s -emit-llvm -O0 -c -o %t.bc
+// RUN: rm -rf %t.klee-out
+// RUN: %klee --output-dir=%t.klee-out --exit-on-error %t.bc 2>&1 | FileCheck %s
+// CHECK: KLEE: done: completed paths = 2
+
+// Neither a NaN nor a value outside of the range is ever produced.
+
+#include "klee/klee.h"
+
+#include <math.h>
+
+int main() {
+  double d[2];
+  float f;
+  klee_make_symbolic_float(d, sizeof d, "d", KLEE_DOUBLE, KLEE_FP_RANGE,
+                           -1.5, 2.0);
+  klee_make_symbolic_float(&f, sizeof f, "f", KLEE_FLOAT,
+                           KLEE_FP_NO_NAN | KLEE_FP_NORMAL, 0, 0);
+
+  klee_assert(!isnan(d[0]) && d[0] >= -1.5 && d[0] <= 2.0);
+  klee_assert(!isnan(d[1]) && d[1] >= -1.5 && d[1] <= 2.0);
+  klee_assert(!isnan(f) && !isinf(f));
+  klee_assert(f == 0 || fabsf(f) >= 1.17549435e-38f);
+
+  if (d[0] > 1.0)
+    return 1;
+  return 0;
+}
@@ -0,0 +1,17 @@
+// RUN: %llvmgcc %s -emit-llvm -O0 -c -o %t1.bc
+// RUN: rm -rf %t.klee-out
+// RUN: %klee --output-dir=%t.klee-out --minimize-cex-time=1 --exit-on-error %t1.bc
+// RUN: ktest-tool %t.klee-out/test000001.ktest | FileCheck %s
+
+int main() {
+  float x;
+
+  klee_make_symbolic(&x, sizeof x, "x");
+  klee_assume(x > 2.5f);
+  klee_assume(x < 3.5f);
+
+  // The only integral float in range is 3.0f.
+  // CHECK: name: {{.*}}x
+  // CHECK: data: {{.*}}\x00\x00@@
+  return 0;
+}
@@ -0,0 +1,22 @@
+// RUN: %llvmgcc %s -emit-llvm -O0 -c -o %t.bc
+// RUN: rm -rf %t.klee-out
+// RUN: %klee --output-dir=%t.klee-out --minimize-tests %t.bc 2>&1 | FileCheck %s
+// RUN: ls %t.klee-out | grep -c ktest | FileCheck --check-prefix=KEPT %s
+
+// Any path taking both directions of the branch covers everything: the
+// others are not written, or removed, except for up to two paths taking
+// one direction each which came first.
+// CHECK: KLEE: done: completed paths = 16
+// CHECK: KLEE: done: suppressed tests = {{1[34]}}
+// KEPT: {{^[12]$}}
+
+#include "klee/klee.h"
+
+int main() {
+  int x[4], n = 0, i;
+  klee_make_symbolic(x, sizeof x, "x");
+  for (i = 0; i != 4; ++i)
+    if (x[i] > 0)
+      ++n;
+  return n;
+}
@@ -0,0 +1,40 @@
+// RUN: %llvmgcc %s -emit-llvm -g -O0 -c -o %t1.bc
+// RUN: rm -rf %t.klee-out
+// RUN: %klee --output-dir=%t.klee-out --native-concrete-calls %t1.bc 2> %t.log
+// RUN: FileCheck %s < %t.log
+// RUN: rm -rf %t.klee-out
+// RUN: %klee --output-dir=%t.klee-out %t1.bc 2> %t.log
+// RUN: FileCheck %s < %t.log
+
+#include <assert.h>
+#include <math.h>
+
+static double table[64];
+static int entries;
+
+// Runs natively: only memory and the C math library are touched.
+static void fill(int n) {
+  int i;
+  for (i = 0; i < n; ++i)
+    table[i] = sin(i / 8.0) * i;
+  entries = n;
+}
+
+static int divide(int a, int b) {
+  return a / b;
+}
+
+int main() {
+  int zero = 0;
+
+  fill(64);
+  assert(entries == 64);
+  assert(table[0] == 0.0);
+  assert(table[8] == sin(1.0) * 8);
+  assert(divide(entries, 2) == 32);
+
+  // Dividing by a variable, divide is left to the interpreter, which
+  // reports the error.
+  // CHECK: NativeConcreteCalls.c:24: divide by zero
+  return divide(1, zero);
+}
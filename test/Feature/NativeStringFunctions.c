@@ -0,0 +1,46 @@
+// RUN: %llvmgcc %s -emit-llvm -O0 -c -o %t.bc
+// RUN: rm -rf %t.klee-out
+// RUN: %klee --output-dir=%t.klee-out --libc=klee --native-string-functions --exit-on-error %t.bc 2>&1 | FileCheck %s
+// RUN: rm -rf %t.klee-out
+// RUN: %klee --output-dir=%t.klee-out --libc=klee --exit-on-error %t.bc 2>&1 | FileCheck %s
+
+// Native results match klee-libc's, and symbolic bytes are still compared
+// symbolically.
+
+#include "klee/klee.h"
+
+#include <assert.h>
+#include <stdio.h>
+#include <string.h>
+
+char text[1000];
+
+int main() {
+  for (int i = 0; i < 999; ++i)
+    text[i] = 'a' + i % 26;
+  text[999] = 0;
+
+  assert(strlen(text) == 999);
+  assert(strlen("") == 0);
+  assert(strcmp(text, text) == 0);
+  assert(strcmp("abc", "abd") == 'c' - 'd');
+  assert(strcmp("ab\xff", "ab") == (char) 0xff);
+  assert(strncmp(text, text + 26, 500) == 0);
+  assert(strncmp("ab\xff", "ab", 5) == 0xff);
+  assert(memcmp(text, text + 26, 900) == 0);
+  assert(memcmp(text, text + 1, 10) == -1);
+  assert(strchr(text, 'z') == text + 25);
+  assert(strchr(text, '!') == 0);
+  assert(strchr(text, 0) == text + 999);
+  assert(memchr(text, 'c', 2) == 0);
+  assert(memchr(text + 600, 'a', 400) == text + 624);
+
+  char c, s[4] = "ab";
+  klee_make_symbolic(&c, sizeof(c), "c");
+  s[1] = c;
+  if (strcmp(s, "ab") == 0)
+    printf("equal\n");
+  // CHECK: equal
+  // CHECK: KLEE: done: completed paths = 2
+  return 0;
+}
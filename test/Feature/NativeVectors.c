@@ -0,0 +1,31 @@
+// RUN: %llvmgcc %s -emit-llvm -O0 -c -o %t1.bc
+// RUN: rm -rf %t.klee-out
+// RUN: %klee --output-dir=%t.klee-out --exit-on-error --scalarize-vectors=false %t1.bc
+// RUN: rm -rf %t.klee-out
+// RUN: %klee --output-dir=%t.klee-out --exit-on-error %t1.bc
+
+#include "klee/klee.h"
+
+#include <assert.h>
+
+typedef float float4 __attribute__((vector_size(16)));
+typedef int int4 __attribute__((vector_size(16)));
+
+int main() {
+  float4 a = { 1.0f, 2.0f, 3.0f, 4.0f };
+  float4 b = { 0.5f, 0.5f, 0.5f, 0.5f };
+  float4 c = a * b + a;
+  assert(c[0] == 1.5f && c[1] == 3.0f && c[2] == 4.5f && c[3] == 6.0f);
+
+  int x;
+  klee_make_symbolic(&x, sizeof(x), "x");
+  int4 v = { x, 1, 2, 3 };
+  int4 w = v + v;
+  assert(w[1] == 2 && w[3] == 6);
+  if (w[0] == 8)
+    assert(x == 4 || x == (int) 0x80000004);
+
+  int4 m = a > b;
+  assert(m[0] == -1 && m[3] == -1);
+  return 0;
+}
@@ -0,0 +1,29 @@
+// RUN: %llvmgcc %s -emit-llvm -O0 -c -o %t.bc
+// RUN: rm -rf %t.klee-out %t.klee-seeded
+// RUN: %klee --output-dir=%t.klee-out %t.bc
+// RUN: ls %t.klee-out/ | grep .ktest | wc -l | grep 8
+
+// Every seed is given twice, to workers which differ, so that each path
+// is reached by two workers but written only once.
+// RUN: %klee --output-dir=%t.klee-seeded --seed-out-dir=%t.klee-out --seed-out-dir=%t.klee-out --only-replay-seeds --only-seed --parallel-workers=3 %t.bc 2>&1 | FileCheck %s
+// RUN: ls %t.klee-seeded/ | grep .ktest | wc -l | grep 8
+// CHECK: Splitting 16 seeds between 3 worker processes
+// CHECK: removed 8 duplicate tests
+
+#include "klee/klee.h"
+
+int main() {
+  unsigned char x;
+  klee_make_symbolic(&x, sizeof(x), "x");
+  klee_assume(x < 8);
+
+  int n = 0;
+  if (x & 1)
+    n++;
+  if (x & 2)
+    n++;
+  if (x & 4)
+    n++;
+
+  return n;
+}
@@ -0,0 +1,26 @@
+// RUN: %llvmgcc %s -emit-llvm -O0 -c -o %t.bc
+// RUN: rm -rf %t.klee-out
+// RUN: %klee --output-dir=%t.klee-out --parallel-workers=2 %t.bc 2>&1 | FileCheck %s
+// RUN: ls %t.klee-out/ | grep .ktest | wc -l | grep 8
+// RUN: test -f %t.klee-out/run.stats.1
+
+// Every path is explored exactly once between the two workers, and their
+// test ids do not clash.
+// CHECK: Splitting 2 states between 2 worker processes
+
+#include "klee/klee.h"
+
+int main() {
+  unsigned char x;
+  klee_make_symbolic(&x, sizeof(x), "x");
+
+  int n = 0;
+  if (x & 1)
+    n++;
+  if (x & 2)
+    n++;
+  if (x & 4)
+    n++;
+
+  return n;
+}
@@ -0,0 +1,25 @@
+// RUN: %llvmgcc %s -emit-llvm -g -O0 -c -o %t1.bc
+// RUN: rm -rf %t.cache %t.klee-out
+// RUN: mkdir %t.cache
+// RUN: %klee --output-dir=%t.klee-out --prepared-module-cache=%t.cache %t1.bc 2> %t.log
+// RUN: not grep "using the prepared module" %t.log
+// RUN: grep "completed paths = 2" %t.log
+// RUN: cp %t.klee-out/assembly.ll %t.ll
+// RUN: rm -rf %t.klee-out
+// RUN: %klee --output-dir=%t.klee-out --prepared-module-cache=%t.cache %t1.bc 2> %t.log
+// RUN: grep "using the prepared module" %t.log
+// RUN: grep "completed paths = 2" %t.log
+// RUN: cmp %t.ll %t.klee-out/assembly.ll
+// RUN: rm -rf %t.klee-out
+// RUN: %klee --output-dir=%t.klee-out --prepared-module-cache=%t.cache --optimize %t1.bc 2> %t.log
+// RUN: not grep "using the prepared module" %t.log
+
+#include "klee/klee.h"
+
+int main() {
+  int x;
+  klee_make_symbolic(&x, sizeof(x), "x");
+  if (x > 10)
+    return 100 / x;
+  return 0;
+}
@@ -0,0 +1,32 @@
+// RUN: %llvmgcc %s -emit-llvm -O0 -c -o %t.bc
+// RUN: rm -rf %t.klee-out
+// RUN: %klee --output-dir=%t.klee-out --profile-solver-chain %t.bc 2>&1 | FileCheck --check-prefix=DONE %s
+// RUN: head -n 1 %t.klee-out/run.stats | FileCheck %s
+// RUN: rm -rf %t.klee-out
+// RUN: %klee --output-dir=%t.klee-out %t.bc
+// RUN: head -n 1 %t.klee-out/run.stats | FileCheck --check-prefix=OFF %s
+
+// DONE: KLEE: done: completed paths = 4
+
+// Each layer gets its columns, from the core solver outwards.
+// CHECK: 'CoreValidityCalls','CoreValidityPassed','CoreValiditySelfTime','CoreValidityYes','CoreValidityNo','CoreValidityUnknown','CoreValidityFailed'
+// CHECK: 'CoreInitialValuesCalls'
+// CHECK: 'CexCacheTruthPassed'
+// CHECK: 'IndependentValueSelfTime'
+
+// OFF-NOT: Core
+
+#include "klee/klee.h"
+
+int main() {
+  float f;
+  unsigned char x;
+  klee_make_symbolic(&f, sizeof(f), "f");
+  klee_make_symbolic(&x, sizeof(x), "x");
+
+  if (f > 1.0f)
+    x++;
+  if (x > 10)
+    return 1;
+  return 0;
+}
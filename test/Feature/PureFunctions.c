@@ -0,0 +1,54 @@
+// RUN: %llvmgcc %s -emit-llvm -O0 -c -o %t.bc
+// RUN: rm -rf %t.klee-out
+// RUN: %klee --output-dir=%t.klee-out --exit-on-error %t.bc 2>&1 | FileCheck %s
+// RUN: head -n 1 %t.klee-out/run.stats | grep MemoizedCalls
+// RUN: echo "scale # writes through its argument" > %t.pure
+// RUN: rm -rf %t.klee-out
+// RUN: %klee --output-dir=%t.klee-out --pure-functions=%t.pure --exit-on-error %t.bc 2>&1 | FileCheck %s
+// CHECK: KLEE: done: completed paths = 8
+
+// A memoized call is reused only while the memory it read is unchanged, and
+// replays what it wrote.
+
+#include "klee/klee.h"
+
+static unsigned char buffer[16];
+
+static unsigned checksum(const unsigned char *p, unsigned n) {
+  unsigned sum = 0, i;
+  for (i = 0; i != n; ++i)
+    sum = sum * 31 + p[i];
+  return sum;
+}
+
+static void scale(double *out, const double *in, unsigned n, double factor) {
+  unsigned i;
+  for (i = 0; i != n; ++i)
+    out[i] = in[i] * factor;
+}
+
+int main() {
+  double in[4] = { 1, 2, 3, 4 }, out[4];
+  unsigned sum, i;
+  int x;
+
+  klee_mark_pure("checksum");
+  for (i = 0; i != sizeof(buffer); ++i)
+    buffer[i] = i;
+  sum = checksum(buffer, sizeof(buffer));
+
+  klee_make_symbolic(&x, sizeof(x), "x");
+  for (i = 0; i != 3; ++i) {
+    if (x & (1 << i)) {
+      buffer[i] = 0;
+      klee_assert(checksum(buffer, sizeof(buffer)) != sum);
+      buffer[i] = i;
+    }
+    klee_assert(checksum(buffer, sizeof(buffer)) == sum);
+
+    scale(out, in, 4, 0.5);
+    klee_assert(out[3] == 2 && out[0] == 0.5);
+    out[3] = 0;
+  }
+  return 0;
+}
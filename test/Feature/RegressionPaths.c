@@ -0,0 +1,36 @@
+// RUN: %llvmgcc %s -emit-llvm -O0 -c -o %t1.bc
+// RUN: %llvmgcc %s -emit-llvm -O0 -DCHANGED -c -o %t2.bc
+// RUN: rm -rf %t1.klee-out %t2.klee-out
+// RUN: %klee --output-dir=%t1.klee-out --write-regression-paths %t1.bc 2>&1 | FileCheck --check-prefix=CHECK-BASE %s
+// RUN: %klee --output-dir=%t2.klee-out --regression-baseline=%t1.klee-out/regression.paths %t2.bc 2>&1 | FileCheck --check-prefix=CHECK-CHANGED %s
+// RUN: grep -c "^p " %t2.klee-out/regression.paths | grep 3
+// CHECK-BASE: KLEE: done: completed paths = 2
+// CHECK-CHANGED: regression: 1 unchanged paths not explored again, exploring below 1 path prefixes
+// CHECK-CHANGED: KLEE: done: completed paths = 2
+
+// Only the paths entering the function which changed are explored again,
+// the other one being carried over to the new regression paths.
+
+#include "klee/klee.h"
+
+int unchanged(int x) {
+  if (x > 10)
+    return 1;
+  return 0;
+}
+
+int changed(int x) {
+#ifdef CHANGED
+  if (x == 3)
+    return 2;
+#endif
+  return 0;
+}
+
+int main() {
+  int x;
+  klee_make_symbolic(&x, sizeof(x), "x");
+  if (x < 0)
+    return unchanged(x);
+  return changed(x);
+}
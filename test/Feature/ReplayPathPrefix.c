@@ -0,0 +1,24 @@
+// RUN: %llvmgcc %s -emit-llvm -O0 -c -o %t.bc
+// RUN: rm -rf %t.klee-out
+// RUN: printf '1\n0\n' > %t.path
+// RUN: %klee --output-dir=%t.klee-out --replay-path=%t.path --replay-path-prefix --test-name-prefix=node1- %t.bc
+// RUN: ls %t.klee-out/ | grep node1-test | grep .ktest | wc -l | grep 2
+
+// Only the subtree below the first two decisions is explored.
+
+#include "klee/klee.h"
+
+int main() {
+  unsigned char x;
+  klee_make_symbolic(&x, sizeof(x), "x");
+
+  int n = 0;
+  if (x & 1)
+    n++;
+  if (x & 2)
+    n++;
+  if (x & 4)
+    n++;
+
+  return n;
+}
@@ -0,0 +1,23 @@
+// RUN: %llvmgcc %s -emit-llvm -O0 -c -o %t.bc
+// RUN: rm -rf %t.klee-out
+// RUN: %klee --output-dir=%t.klee-out --debug-validate-solver --debug-validate-solver-rate=2 --debug-validate-solver-jobs=2 --debug-validate-solver-log=%t.mismatches.kqlog %t.bc 2>&1 | FileCheck %s
+// RUN: %kleaver --replay-binary %t.mismatches.kqlog | FileCheck --check-prefix=LOG %s
+
+// Every other answer is checked in the background, and none is wrong, so
+// the mismatch log holds no query.
+// CHECK-NOT: invalid solver result
+// CHECK: KLEE: done: completed paths = 3
+// LOG: total queries = 0
+
+#include "klee/klee.h"
+
+int main() {
+  float f;
+  unsigned x;
+  klee_make_symbolic(&f, sizeof(f), "f");
+  klee_make_symbolic(&x, sizeof(x), "x");
+
+  if (f > 1.5f && x < 10)
+    return (int) f + x;
+  return 0;
+}
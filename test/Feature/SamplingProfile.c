@@ -0,0 +1,21 @@
+// RUN: %llvmgcc %s -emit-llvm -g -O0 -c -o %t.bc
+// RUN: rm -rf %t.klee-out
+// RUN: %klee --output-dir=%t.klee-out --profile-sample-rate=1000 %t.bc
+// RUN: test -f %t.klee-out/profile.folded
+
+// Every sample is charged to a stack ending in what klee was doing.
+// RUN: not grep -v "\[[a-z: ]*\] [0-9]*$" %t.klee-out/profile.folded
+
+#include "klee/klee.h"
+
+int main() {
+  unsigned x;
+  klee_make_symbolic(&x, sizeof(x), "x");
+
+  unsigned n = 0;
+  for (unsigned i = 0; i < 100000; ++i)
+    n += i * i;
+  if (x > n)
+    return 1;
+  return 0;
+}
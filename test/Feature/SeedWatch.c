@@ -0,0 +1,23 @@
+// RUN: %llvmgcc -emit-llvm -c -g %s -o %t.bc
+// RUN: rm -rf %t.klee-out %t.seeds %t.export
+// RUN: mkdir %t.seeds %t.export
+// RUN: printf '\170\126\064\022' > %t.seeds/id:000000,orig:magic
+// RUN: %klee --output-dir=%t.klee-out --seed-watch-dir=%t.seeds --only-replay-seeds --seed-export-dir=%t.export %t.bc 2>&1 | FileCheck %s
+// RUN: ls %t.export | FileCheck --check-prefix=EXPORT %s
+
+// The raw fuzzer input is the value of x, whose state follows it alone,
+// next to the two paths from the initial state.
+// CHECK: KLEE: imported 1 seeds from
+// CHECK: KLEE: done: completed paths = 3
+
+// EXPORT: id:{{[0-9]+}},src:klee
+
+#include "klee/klee.h"
+
+int main() {
+  unsigned x;
+  klee_make_symbolic(&x, sizeof x, "x");
+  if (x == 0x12345678)
+    return 1;
+  return 0;
+}
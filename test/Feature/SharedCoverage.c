@@ -0,0 +1,15 @@
+// RUN: %llvmgcc -emit-llvm -c -g %s -o %t.bc
+// RUN: rm -rf %t.klee-out %t.klee-out-2 %t.coverage
+// RUN: %klee --output-dir=%t.klee-out --shared-coverage-file=%t.coverage --only-output-states-covering-new %t.bc 2>&1 | FileCheck --check-prefix=FIRST %s
+// RUN: %klee --output-dir=%t.klee-out-2 --shared-coverage-file=%t.coverage --only-output-states-covering-new %t.bc 2>&1 | FileCheck --check-prefix=SECOND %s
+
+// The second instance finds all of the code covered by the first.
+// FIRST: KLEE: done: generated tests = 1
+// SECOND: KLEE: done: generated tests = 0
+
+int main() {
+  int i, sum = 0;
+  for (i = 0; i < 10; ++i)
+    sum += i;
+  return sum != 45;
+}
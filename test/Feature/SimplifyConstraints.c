@@ -0,0 +1,31 @@
+// REQUIRES: z3
+// RUN: %llvmgcc %s -emit-llvm -O0 -c -o %t.bc
+// RUN: rm -rf %t.klee-out
+// RUN: %klee --output-dir=%t.klee-out --solver-backend=z3 --simplify-constraints-interval=2 --exit-on-error %t.bc 2>&1 | FileCheck %s
+// RUN: rm -rf %t.klee-out
+// RUN: %klee --output-dir=%t.klee-out --solver-backend=z3 --simplify-constraints-interval=1 --simplify-constraints-timeout=0 --exit-on-error %t.bc 2>&1 | FileCheck %s
+// CHECK: KLEE: done: completed paths = 5
+
+// Dropping the bounds and classifications the tighter bounds imply leaves
+// the paths the same.
+
+#include "klee/klee.h"
+
+#include <math.h>
+
+int main() {
+  double x;
+  klee_make_symbolic(&x, sizeof(x), "x");
+
+  if (isnan(x))
+    return 0;
+  if (x < 10) {
+    if (x < 2) {
+      if (x >= 1)
+        klee_assert(isfinite(x) && x >= 1 && x < 2);
+      else
+        klee_assert(!isnan(x) && x < 1);
+    }
+  }
+  return 0;
+}
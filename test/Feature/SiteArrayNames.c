@@ -0,0 +1,22 @@
+// RUN: %llvmgcc %s -emit-llvm -O0 -c -o %t.bc
+// RUN: rm -rf %t.klee-out
+// RUN: %klee --output-dir=%t.klee-out --site-array-names --use-query-log=all:kquery %t.bc 2>&1 | FileCheck %s
+// RUN: grep -o "array v.site[0-9]*" %t.klee-out/all-queries.kquery | sort -u | wc -l | grep 2
+// RUN: head -n 1 %t.klee-out/run.stats | grep SharedSymbolicArrays
+// CHECK: KLEE: done: completed paths = 4
+
+// Only one path makes y symbolic, but both make z symbolic at the same
+// instruction, so both name its array alike and share it.
+
+#include "klee/klee.h"
+
+int main() {
+  int x, y = 0, z;
+  klee_make_symbolic(&x, sizeof(x), "x");
+  if (x > 0)
+    klee_make_symbolic(&y, sizeof(y), "v");
+  klee_make_symbolic(&z, sizeof(z), "v");
+  if (z == y + 3)
+    return 1;
+  return 0;
+}
@@ -0,0 +1,29 @@
+// RUN: %llvmgcc %s -emit-llvm -O0 -c -o %t.bc
+// RUN: rm -rf %t.klee-out
+// RUN: %klee --output-dir=%t.klee-out --use-float-triage-solver --use-fast-cex-solver --staged-solver-retry-interval=4 --debug-validate-solver --exit-on-error %t.bc 2>&1 | FileCheck %s
+// CHECK: KLEE: done: completed paths = 6
+
+// The float triage and fast counterexample stages share one pipeline in
+// front of the core solver, and every answer they give is validated.
+
+#include "klee/klee.h"
+
+int main() {
+  float f;
+  int i;
+  klee_make_symbolic(&f, sizeof(f), "f");
+  klee_make_symbolic(&i, sizeof(i), "i");
+
+  if (f != f)
+    return 1;
+  if (f > 2.0f && f < 1.0f)
+    klee_assert(0);
+  if (i > 10) {
+    if (i < 5)
+      klee_assert(0);
+    return 2;
+  }
+  if (f > 0.5f)
+    return 3;
+  return 0;
+}
@@ -0,0 +1,28 @@
+// RUN: %llvmgcc %s -emit-llvm -O0 -c -o %t.bc
+// RUN: rm -rf %t.klee-out
+// RUN: %klee --output-dir=%t.klee-out --state-models %t.bc 2>&1 | FileCheck %s
+// RUN: ls %t.klee-out/ | grep .ktest | wc -l | grep 9
+
+// Each side a model takes is known to be feasible, and the other side is
+// asked about once; infeasible sides are still pruned.
+// CHECK: KLEE: done: completed paths = 9
+
+#include "klee/klee.h"
+
+int main() {
+  float f;
+  unsigned char x;
+  klee_make_symbolic(&f, sizeof(f), "f");
+  klee_make_symbolic(&x, sizeof(x), "x");
+
+  int n = 0;
+  for (unsigned i = 0; i != 3; ++i)
+    if (x & (1 << i))
+      n++;
+  // Infeasible once any of the bits tested is set.
+  if (n > 0 && x == 0)
+    klee_assert(0);
+  if (n == 0 && f > 1.0f)
+    return 1;
+  return 0;
+}
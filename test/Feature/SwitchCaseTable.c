@@ -0,0 +1,63 @@
+// RUN: %llvmgcc %s -emit-llvm -g -O0 -c -o %t.bc
+// RUN: rm -rf %t.klee-out
+// RUN: %klee --output-dir=%t.klee-out --switch-type=internal --exit-on-error %t.bc 2>&1 | FileCheck %s
+// CHECK: KLEE: done: completed paths = 4
+
+// Concrete conditions are looked up in a table of the cases: dense cases
+// by their value, sparse ones, including negative and 64 bit values, in a
+// hash table.
+
+#include "klee/klee.h"
+
+#include <assert.h>
+
+static int dense(unsigned char op) {
+  switch (op) {
+  case 0: return 10;
+  case 1: return 11;
+  case 2: return 12;
+  case 4: return 14;
+  case 5: return 15;
+  default: return -1;
+  }
+}
+
+static int sparse(long long v) {
+  switch (v) {
+  case -1: return 1;
+  case 7: return 2;
+  case 1000: return 3;
+  case 0x7fffffffffffffffLL: return 4;
+  case -0x7fffffffffffffffLL - 1: return 5;
+  case 123456789012LL: return 6;
+  default: return 0;
+  }
+}
+
+int main() {
+  unsigned char op;
+  unsigned i;
+
+  for (i = 0; i != 8; ++i)
+    assert(dense(i) == (i < 6 && i != 3 ? 10 + (int)i : -1));
+  assert(dense(255) == -1);
+
+  assert(sparse(-1) == 1);
+  assert(sparse(7) == 2);
+  assert(sparse(1000) == 3);
+  assert(sparse(0x7fffffffffffffffLL) == 4);
+  assert(sparse(-0x7fffffffffffffffLL - 1) == 5);
+  assert(sparse(123456789012LL) == 6);
+  assert(sparse(0) == 0);
+  assert(sparse(8) == 0);
+  assert(sparse(-2) == 0);
+
+  // Symbolic conditions still fork, once per target.
+  klee_make_symbolic(&op, sizeof(op), "op");
+  switch (op) {
+  case 0: case 1: case 2: return 0;
+  case 4: return 1;
+  case 200: return 2;
+  default: return 3;
+  }
+}
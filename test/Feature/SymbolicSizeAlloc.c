@@ -0,0 +1,30 @@
+// RUN: %llvmgcc %s -emit-llvm -g -O0 -c -o %t.bc
+// RUN: rm -rf %t.klee-out
+// RUN: %klee --output-dir=%t.klee-out %t.bc 2>&1 | FileCheck %s
+// CHECK: KLEE: ERROR: {{.*}}concretized symbolic size
+// CHECK-NOT: memory error
+
+#include "klee/klee.h"
+
+#include <stdlib.h>
+
+int main() {
+  unsigned n, m;
+  char *p, *q;
+
+  klee_make_symbolic(&n, sizeof(n), "n");
+  klee_make_symbolic(&m, sizeof(m), "m");
+
+  // A size with exactly two values is allocated at both.
+  p = malloc(n ? 16 : 8);
+  p[7] = 0;
+  free(p);
+
+  // Otherwise the smallest size the path allows is picked.
+  klee_assume(m >= 10);
+  klee_assume(m <= 20);
+  q = malloc(m);
+  q[9] = 1;
+  free(q);
+  return 0;
+}
@@ -0,0 +1,24 @@
+// RUN: %llvmgcc %s -emit-llvm -g -O0 -c -o %t.bc
+// RUN: rm -rf %t.klee-out
+// RUN: %klee --output-dir=%t.klee-out --trace-queries %t.bc
+// RUN: klee-query-trace %t.klee-out | FileCheck %s
+// RUN: klee-query-trace --format=folded %t.klee-out | FileCheck --check-prefix=FOLDED %s
+
+// CHECK: Time of queries containing each operator:
+// CHECK: UDiv.32
+// CHECK: Time by source location:
+// CHECK: TraceQueries.c:
+
+// FOLDED: TraceQueries.c:{{[0-9]+}};{{[A-Za-z]+}};{{.*}}UDiv.32
+
+#include "klee/klee.h"
+
+int main() {
+  unsigned x, y;
+  klee_make_symbolic(&x, sizeof(x), "x");
+  klee_make_symbolic(&y, sizeof(y), "y");
+
+  if (y != 0 && x / y == 3)
+    return 1;
+  return 0;
+}
@@ -0,0 +1,37 @@
+// RUN: %llvmgcc %s -emit-llvm -O0 -c -o %t1.bc
+// RUN: rm -rf %t.klee-out
+// RUN: %klee --output-dir=%t.klee-out %t1.bc
+// RUN: ls %t.klee-out | not grep .err
+
+#include <assert.h>
+#include <string.h>
+
+int main() {
+  float a[4], x;
+  unsigned i;
+  klee_make_symbolic(&x, sizeof x, "x");
+  klee_make_symbolic(&i, sizeof i, "i");
+  klee_assume(x > 1.0f);
+  klee_assume(i < 4);
+
+  a[0] = x + 1.0f;
+  a[1] = 0.0f;
+  a[2] = 0.0f;
+  a[3] = 0.0f;
+  // A read at a symbolic offset flushes the bytes of the array.
+  if (a[i] > 100.0f)
+    assert(i == 0);
+  // The float written is read back.
+  assert(a[0] > 2.0f);
+
+  // Reading it at another width goes through its bytes.
+  unsigned u;
+  memcpy(&u, &a[0], sizeof u);
+  assert(u >> 31 == 0);
+
+  // So does reading it after one of its bytes was overwritten.
+  ((unsigned char *) &a[0])[3] = 0xbf;
+  assert(a[0] < 0.0f);
+
+  return 0;
+}
@@ -0,0 +1,34 @@
+// RUN: %llvmgcc %s -emit-llvm -O0 -c -o %t1.bc
+// RUN: rm -rf %t.klee-out
+// RUN: %klee --output-dir=%t.klee-out --update-list-compaction-size=4 %t1.bc
+// RUN: ls %t.klee-out | not grep .err
+
+#include <assert.h>
+
+int main() {
+  unsigned char buf[16];
+  unsigned i, j;
+  klee_make_symbolic(&i, sizeof i, "i");
+  klee_make_symbolic(&j, sizeof j, "j");
+  klee_assume(i < 8);
+  klee_assume(j < 16);
+
+  for (unsigned k = 0; k != 16; ++k)
+    buf[k] = k;
+  // Writes at symbolic offsets, each flushing the concrete bytes written
+  // in between, so that the update list is compacted several times.
+  for (unsigned k = 0; k != 4; ++k) {
+    buf[i + k] = 100 + k;
+    buf[15 - k] = 200 + k;
+  }
+
+  unsigned char c = buf[j];
+  if (j >= 12)
+    assert(c == 200 + (15 - j));
+  else if (j >= i && j < i + 4)
+    assert(c == 100 + (j - i));
+  else
+    assert(c == j);
+
+  return 0;
+}
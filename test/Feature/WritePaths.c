@@ -0,0 +1,31 @@
+// RUN: %llvmgcc %s -emit-llvm -O0 -c -o %t.bc
+// RUN: rm -rf %t.klee-out
+// RUN: %klee --output-dir=%t.klee-out --write-paths --write-sym-paths %t.bc 2>&1 | FileCheck %s
+// RUN: tr -d '\n' < %t.klee-out/test000001.path | FileCheck --check-prefix=PATH %s
+// RUN: tr -d '\n' < %t.klee-out/test000002.path | FileCheck --check-prefix=PATH %s
+// RUN: not cmp %t.klee-out/test000001.path %t.klee-out/test000002.path
+// RUN: cat %t.klee-out/test000001.sym.path | wc -l | grep -q 1
+// RUN: cat %t.klee-out/test000002.sym.path | wc -l | grep -q 1
+// CHECK: KLEE: done: completed paths = 2
+
+// Each path has the branch on y, then the condition of the loop and the
+// branch in its body on each iteration, which do not fork and go past the
+// first words of the branch history. Only the branch on y forks.
+// PATH: {{^[01]}}111011111011111011111011111011111011111011111011111011111011111011111011111011111011111011111011111011111011111011111011111011111011111011110{{$}}
+
+#include "klee/klee.h"
+
+int main() {
+  unsigned char x;
+  int y, i, n = 0;
+  klee_make_symbolic(&x, sizeof x, "x");
+  klee_make_symbolic(&y, sizeof y, "y");
+  klee_assume(x == 5);
+
+  if (y)
+    n = 100;
+  for (i = 0; i != 70; ++i)
+    if ((x >> (i % 3)) & 1)
+      ++n;
+  return n;
+}
@@ -0,0 +1,39 @@
+// REQUIRES: z3
+// RUN: %llvmgcc %s -emit-llvm -O0 -c -o %t.bc
+// RUN: rm -rf %t.klee-out
+// RUN: %klee --output-dir=%t.klee-out --solver-backend=z3 --z3-constant-table-size=64 --debug-validate-solver --exit-on-error %t.bc 2>&1 | FileCheck %s
+// CHECK: KLEE: done: completed paths = 4
+
+// Constant tables read at a symbolic index: one mostly zero, encoded as its
+// exceptions over a zero-filled array, and one dense, encoded as a tree on
+// the index bits. The solver validates every answer against the stores.
+
+#include "klee/klee.h"
+
+static const unsigned char sparse[256] = { [3] = 7, [200] = 9 };
+
+static const float dense[64] = {
+  0.0f,  1.0f,  2.0f,  3.0f,  4.0f,  5.0f,  6.0f,  7.0f,
+  8.0f,  9.0f,  10.0f, 11.0f, 12.0f, 13.0f, 14.0f, 15.0f,
+  16.0f, 17.0f, 18.0f, 19.0f, 20.0f, 21.0f, 22.0f, 23.0f,
+  24.0f, 25.0f, 26.0f, 27.0f, 28.0f, 29.0f, 30.0f, 31.0f,
+  32.0f, 33.0f, 34.0f, 35.0f, 36.0f, 37.0f, 38.0f, 39.0f,
+  40.0f, 41.0f, 42.0f, 43.0f, 44.0f, 45.0f, 46.0f, 47.0f,
+  48.0f, 49.0f, 50.0f, 51.0f, 52.0f, 53.0f, 54.0f, 55.0f,
+  56.0f, 57.0f, 58.0f, 59.0f, 60.0f, 61.0f, 62.0f, 63.0f
+};
+
+int main() {
+  unsigned char i;
+  unsigned j;
+  klee_make_symbolic(&i, sizeof(i), "i");
+  klee_make_symbolic(&j, sizeof(j), "j");
+
+  if (sparse[i] == 9)
+    klee_assert(i == 200);
+
+  j &= 63;
+  if (dense[j] > 40.5f)
+    klee_assert(j > 40);
+  return 0;
+}
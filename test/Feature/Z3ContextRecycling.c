@@ -0,0 +1,27 @@
+// REQUIRES: z3
+// RUN: %llvmgcc %s -emit-llvm -O0 -c -o %t.bc
+// RUN: rm -rf %t.klee-out
+// RUN: %klee --output-dir=%t.klee-out --solver-backend=z3 --z3-context-memory-budget=1 --exit-on-error %t.bc 2>&1 | FileCheck %s
+// CHECK: KLEE: done: completed paths = 32
+
+// Replacing the Z3 context every megabyte does not change the answers,
+// even for arrays with symbolic writes.
+
+#include "klee/klee.h"
+
+int main() {
+  unsigned char a[16];
+  unsigned i, j, k;
+  klee_make_symbolic(a, sizeof(a), "a");
+  klee_make_symbolic(&i, sizeof(i), "i");
+  klee_make_symbolic(&j, sizeof(j), "j");
+
+  a[i & 15] = 7;
+  for (k = 0; k != 4; ++k)
+    if (a[k] == 7)
+      a[(i + k) & 15] = 7;
+
+  if (a[j & 15] != 7)
+    klee_assert((j & 15) != (i & 15));
+  return 0;
+}
@@ -0,0 +1,23 @@
+// REQUIRES: z3
+// RUN: %llvmgcc %s -emit-llvm -O0 -c -o %t.bc
+// RUN: rm -rf %t.klee-out
+// RUN: %klee --output-dir=%t.klee-out --solver-backend=z3 --z3-cube-threshold=0.001 --exit-on-error %t.bc 2>&1 | FileCheck %s
+// CHECK: KLEE: done: completed paths = 4
+
+// Queries split into cubes once they take a millisecond get the answers
+// they would get whole.
+
+#include "klee/klee.h"
+
+int main() {
+  float x, y;
+  klee_make_symbolic(&x, sizeof(x), "x");
+  klee_make_symbolic(&y, sizeof(y), "y");
+
+  if (x * y == 6.0f && x + y == 5.0f) {
+    klee_assert((x > 1.99f && x < 3.01f) || (y > 1.99f && y < 3.01f));
+    if (x * x > y * y)
+      klee_assert(x > y);
+  }
+  return 0;
+}
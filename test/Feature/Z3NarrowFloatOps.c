@@ -0,0 +1,33 @@
+// REQUIRES: z3
+// RUN: %llvmgcc %s -emit-llvm -O0 -c -o %t.bc
+// RUN: rm -rf %t.klee-out
+// RUN: %klee --output-dir=%t.klee-out --solver-backend=z3 --z3-narrow-float-ops --debug-validate-solver --exit-on-error %t.bc 2>&1 | FileCheck %s
+// CHECK: KLEE: done: completed paths = 4
+
+// The solver validates every answer, and every model, of the narrowed
+// encoding against the expressions as they are.
+
+#include "klee/klee.h"
+
+#include <math.h>
+
+int main() {
+  float f;
+  double x, y;
+  klee_make_symbolic(&f, sizeof(f), "f");
+  klee_make_symbolic(&x, sizeof(x), "x");
+  klee_make_symbolic(&y, sizeof(y), "y");
+
+  // Computed in double and rounded back, the same as in float.
+  float s = (float)sqrt((double)f);
+  if (s == 2.0f)
+    klee_assert(f > 3.99f && f < 4.01f);
+
+  // Long doubles which only ever hold doubles compare as doubles.
+  long double lx = x, ly = y;
+  if (lx < ly)
+    klee_assert(x < y);
+  else
+    klee_assert(!(x < y));
+  return 0;
+}
@@ -0,0 +1,32 @@
+// REQUIRES: z3
+// RUN: %llvmgcc %s -emit-llvm -O0 -c -o %t.bc
+// RUN: rm -rf %t.klee-out
+// RUN: %klee --output-dir=%t.klee-out --solver-backend=z3 --exit-on-error %t.bc 2>&1 | FileCheck %s
+// RUN: rm -rf %t.klee-out
+// RUN: %klee --output-dir=%t.klee-out --solver-backend=z3 --z3-scalarize-reads=false --exit-on-error %t.bc 2>&1 | FileCheck %s
+// CHECK: KLEE: done: completed paths = 9
+
+// Bytes read at constant indices are plain bitvectors, and keep their
+// values once a symbolic index makes the array an array again.
+
+#include "klee/klee.h"
+
+int main() {
+  unsigned char bytes[4];
+  float f;
+  unsigned i;
+  klee_make_symbolic(bytes, sizeof(bytes), "bytes");
+  klee_make_symbolic(&f, sizeof(f), "f");
+  klee_make_symbolic(&i, sizeof(i), "i");
+
+  if (bytes[0] + bytes[3] == 300) {
+    klee_assert(bytes[0] >= 45 && bytes[3] >= 45);
+    if (f * 2.0f == 3.0f)
+      klee_assert(f == 1.5f);
+  }
+
+  if (i < 4 && bytes[i] == 7)
+    klee_assert(bytes[0] == 7 || bytes[1] == 7 || bytes[2] == 7 ||
+                bytes[3] == 7);
+  return 0;
+}
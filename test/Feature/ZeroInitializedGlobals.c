@@ -0,0 +1,31 @@
+// RUN: %llvmgcc %s -emit-llvm -O0 -c -o %t1.bc
+// RUN: rm -rf %t.klee-out
+// RUN: %klee --output-dir=%t.klee-out --exit-on-error %t1.bc 2> %t.log
+// RUN: grep "completed paths = 2" %t.log
+
+#include "klee/klee.h"
+
+#include <assert.h>
+
+// Only the chunks written to get contents of their own.
+static char table[256][1024 * 1024];
+static int counts[1024] = { 1 };
+
+int main() {
+  unsigned i, x;
+
+  for (i = 0; i < 256; ++i)
+    assert(table[i][i * 4093 % sizeof(table[i])] == 0);
+  assert(counts[0] == 1 && counts[1023] == 0);
+
+  klee_make_symbolic(&x, sizeof(x), "x");
+  if (x == 3) {
+    table[3][0] = 1;
+    assert(table[3][0] == 1 && table[3][1] == 0 && table[255][1] == 0);
+  } else {
+    table[255][1] = 2;
+    assert(table[3][0] == 0 && table[255][0] == 0 && table[255][1] == 2);
+  }
+
+  return 0;
+}
@@ -0,0 +1,25 @@
+// RUN: %llvmgcc %s -emit-llvm -g -O0 -c -o %t.bc
+// RUN: rm -rf %t.klee-out
+// RUN: %klee --output-dir=%t.klee-out --search=dfs %t.bc
+// RUN: test -f %t.klee-out/test000003.ktest
+
+// Replay all tests through a single fork server
+// RUN: %cc %s %libkleeruntest -Wl,-rpath %libkleeruntestdir -o %t_runner
+// RUN: klee-replay --fork-server=%t.results %t_runner %t.klee-out/*.ktest
+// RUN: FileCheck -input-file=%t.results %s
+
+#include "klee/klee.h"
+
+int main(int argc, char** argv) {
+  int x;
+  klee_make_symbolic(&x, sizeof(x), "x");
+
+  if (x == 1)
+    return 1;
+  if (x == 2)
+    return 2;
+  return 0;
+}
+// CHECK-DAG: test{{.*}}.ktest: EXIT STATUS: ABNORMAL 1
+// CHECK-DAG: test{{.*}}.ktest: EXIT STATUS: ABNORMAL 2
+// CHECK-DAG: test{{.*}}.ktest: EXIT STATUS: NORMAL
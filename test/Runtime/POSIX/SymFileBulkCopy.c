@@ -0,0 +1,33 @@
+// RUN: %llvmgcc %s -emit-llvm -O0 -c -o %t.bc
+// RUN: rm -rf %t.klee-out
+// RUN: %klee --output-dir=%t.klee-out --exit-on-error --posix-runtime %t.bc --sym-files 2 4096 2>&1 | FileCheck %s
+// RUN: rm -rf %t.klee-out
+// RUN: %klee --output-dir=%t.klee-out --exit-on-error --bulk-memory-functions=false --posix-runtime %t.bc --sym-files 2 4096 2>&1 | FileCheck %s
+// CHECK: KLEE: done: completed paths = 1
+
+// Reads and writes of symbolic files copy between the file and the buffer
+// in one go, and copy the same bytes as the model's byte by byte fallback.
+
+#include <assert.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+static char in[4096], out[4096];
+
+int main(int argc, char **argv) {
+  int a = open("A", O_RDONLY), b = open("B", O_RDWR);
+  unsigned i;
+  assert(a != -1 && b != -1);
+
+  for (i = 0; i != 4; ++i)
+    assert(read(a, in + i * 1024, 1024) == 1024);
+  assert(read(a, in, 1) == 0);
+
+  assert(write(b, in, sizeof in) == sizeof in);
+  assert(lseek(b, 0, SEEK_SET) == 0);
+  assert(read(b, out, sizeof out) == sizeof out);
+
+  for (i = 0; i != sizeof in; ++i)
+    assert(in[i] == out[i]);
+  return 0;
+}
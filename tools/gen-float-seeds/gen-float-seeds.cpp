@@ -0,0 +1,313 @@
+//===-- gen-float-seeds.cpp -------------------------------------*- C++ -*-===//
+//
+//                     The KLEE Symbolic Virtual Machine
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+//
+// gen-float-seeds generates seeds (see --seed-out) for programs taking
+// floating-point inputs. Random bytes are almost always huge or tiny
+// normal numbers, so the floating-point fields of the objects, given by a
+// type map, are drawn instead from IEEE 754 classes and magnitudes, each
+// field going through all of them once every NUM_CLASSES tests. The other
+// bytes are random, as with gen-random-bout.
+//
+// The type map has a line for each symbolic object, in the order the
+// program makes them:
+//
+//   <name> <size> [f32@<offset> | f64@<offset>]...
+//
+// with '#' starting a comment.
+//
+//===----------------------------------------------------------------------===//
+
+#include <assert.h>
+#include <errno.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "klee/Internal/ADT/KTest.h"
+
+namespace {
+  /// The classes and magnitudes the values of a field are drawn from.
+  enum FloatClass {
+    Zero,
+    Subnormal,
+    SmallInteger,   // an integer in [-16, 16]
+    NearOne,        // an exponent in [-4, 4]
+    NearMinNormal,  // one of the 16 smallest exponents of normal numbers
+    NearMax,        // one of the 16 largest exponents
+    AnyNormal,      // any exponent
+    Infinity,
+    NaN,
+    NUM_CLASSES
+  };
+
+  struct FloatField {
+    unsigned offset;
+    bool isDouble;
+    /// The classes left to draw in the current round, in random order.
+    std::vector<unsigned> round;
+  };
+
+  struct ObjectType {
+    std::string name;
+    unsigned size;
+    std::vector<FloatField> fields;
+  };
+}
+
+static uint64_t random64() {
+  return ((uint64_t) random() << 42) ^ ((uint64_t) random() << 21) ^
+         (uint64_t) random();
+}
+
+/// The bits of a value of class \a c, with \a exponentBits and
+/// \a mantissaBits bits.
+static uint64_t makeBits(FloatClass c, unsigned exponentBits,
+                         unsigned mantissaBits) {
+  uint64_t sign = (uint64_t) (random() & 1) << (exponentBits + mantissaBits);
+  uint64_t mantissaMask = ((uint64_t) 1 << mantissaBits) - 1;
+  uint64_t maxExponent = ((uint64_t) 1 << exponentBits) - 1;
+  uint64_t bias = maxExponent >> 1;
+  uint64_t mantissa = random64() & mantissaMask;
+  uint64_t exponent;
+
+  switch (c) {
+  case Zero:
+    return sign;
+  case Subnormal:
+    return sign | (mantissa ? mantissa : 1);
+  case SmallInteger: {
+    // Built from the value, its bits are not those of the others.
+    double d = (double) (random() % 33) - 16;
+    uint64_t bits;
+    if (mantissaBits == 52) {
+      memcpy(&bits, &d, sizeof bits);
+    } else {
+      float f = (float) d;
+      uint32_t fbits;
+      memcpy(&fbits, &f, sizeof fbits);
+      bits = fbits;
+    }
+    return bits;
+  }
+  case NearOne:
+    exponent = bias - 4 + random() % 9;
+    break;
+  case NearMinNormal:
+    exponent = 1 + random() % 16;
+    break;
+  case NearMax:
+    exponent = maxExponent - 16 + random() % 16;
+    break;
+  case AnyNormal:
+    exponent = 1 + random() % (maxExponent - 1);
+    break;
+  case Infinity:
+    return sign | (maxExponent << mantissaBits);
+  case NaN:
+    return sign | (maxExponent << mantissaBits) |
+           ((uint64_t) 1 << (mantissaBits - 1)) | mantissa;
+  default:
+    assert(0 && "invalid class");
+    return 0;
+  }
+  return sign | (exponent << mantissaBits) | mantissa;
+}
+
+/// Fill \a field of \a bytes with the next class of its round.
+static void fillField(FloatField &field, unsigned char *bytes) {
+  if (field.round.empty()) {
+    for (unsigned i = 0; i != NUM_CLASSES; ++i)
+      field.round.push_back(i);
+    for (unsigned i = NUM_CLASSES - 1; i != 0; --i)
+      std::swap(field.round[i], field.round[random() % (i + 1)]);
+  }
+  FloatClass c = (FloatClass) field.round.back();
+  field.round.pop_back();
+
+  // The values are in the byte order of the host, as KLEE reads them.
+  if (field.isDouble) {
+    uint64_t bits = makeBits(c, 11, 52);
+    memcpy(bytes + field.offset, &bits, sizeof bits);
+  } else {
+    uint32_t bits = makeBits(c, 8, 23);
+    memcpy(bytes + field.offset, &bits, sizeof bits);
+  }
+}
+
+static bool readTypeMap(const char *path, std::vector<ObjectType> &types) {
+  std::ifstream f(path);
+  if (!f.good()) {
+    fprintf(stderr, "unable to open %s\n", path);
+    return false;
+  }
+  std::string line;
+  for (unsigned lineNo = 1; std::getline(f, line); ++lineNo) {
+    std::string::size_type comment = line.find('#');
+    if (comment != std::string::npos)
+      line.erase(comment);
+    std::istringstream words(line);
+    ObjectType type;
+    if (!(words >> type.name))
+      continue;
+    if (!(words >> type.size) || !type.size) {
+      fprintf(stderr, "%s:%u: invalid size\n", path, lineNo);
+      return false;
+    }
+    std::string word;
+    while (words >> word) {
+      FloatField field;
+      bool isFloat = word.compare(0, 4, "f32@") == 0;
+      field.isDouble = word.compare(0, 4, "f64@") == 0;
+      const char *offset = word.c_str() + 4;
+      char *end = 0;
+      if (isFloat || field.isDouble)
+        field.offset = strtoul(offset, &end, 10);
+      if (!end || end == offset || *end ||
+          field.offset + (field.isDouble ? 8 : 4) > type.size) {
+        fprintf(stderr, "%s:%u: invalid field %s\n", path, lineNo,
+                word.c_str());
+        return false;
+      }
+      type.fields.push_back(field);
+    }
+    types.push_back(type);
+  }
+  if (types.empty()) {
+    fprintf(stderr, "%s: no objects\n", path);
+    return false;
+  }
+  return true;
+}
+
+static void usage(const char *name) {
+  fprintf(stderr, "Usage: %s [options] <type-map>\n", name);
+  fprintf(stderr, "  -seed <n>       random seed, 0 for time(NULL)*getpid() (default=0)\n");
+  fprintf(stderr, "  -n <n>          number of tests (default=%u)\n", (unsigned) NUM_CLASSES * 8);
+  fprintf(stderr, "  -o <dir>        write test<N>.ktest files to <dir> (default=.)\n");
+  fprintf(stderr, "  -pack <file>    write the tests to the .kpack archive <file> instead\n");
+  fprintf(stderr, "  -packs <k>      with -pack, spread the tests over <k> archives\n");
+  fprintf(stderr, "                  <file>.<i>.kpack, one for each parallel run\n");
+  fprintf(stderr, "  -compress       compress the archives (requires zlib)\n");
+  fprintf(stderr, "   Ex: echo 'x 8 f64@0' > map; %s -n 72 -pack seeds.kpack map\n", name);
+  exit(1);
+}
+
+int main(int argc, char *argv[]) {
+  unsigned seed = 0, numTests = NUM_CLASSES * 8, numPacks = 0;
+  const char *outputDir = ".", *packPath = 0, *mapPath = 0;
+  int compress = 0;
+
+  for (int i = 1; i < argc; i++) {
+    if (strcmp(argv[i], "-seed") == 0 && i + 1 < argc)
+      seed = atoi(argv[++i]);
+    else if (strcmp(argv[i], "-n") == 0 && i + 1 < argc)
+      numTests = atoi(argv[++i]);
+    else if (strcmp(argv[i], "-o") == 0 && i + 1 < argc)
+      outputDir = argv[++i];
+    else if (strcmp(argv[i], "-pack") == 0 && i + 1 < argc)
+      packPath = argv[++i];
+    else if (strcmp(argv[i], "-packs") == 0 && i + 1 < argc)
+      numPacks = atoi(argv[++i]);
+    else if (strcmp(argv[i], "-compress") == 0)
+      compress = 1;
+    else if (argv[i][0] == '-' || mapPath)
+      usage(argv[0]);
+    else
+      mapPath = argv[i];
+  }
+  if (!mapPath || (numPacks && !packPath))
+    usage(argv[0]);
+
+  if (seed)
+    srandom(seed);
+  else srandom(time(NULL) * getpid());
+
+  std::vector<ObjectType> types;
+  if (!readTypeMap(mapPath, types))
+    return 1;
+
+  std::vector<KTestPackWriter *> packs;
+  if (packPath) {
+    for (unsigned i = 0; i != std::max(numPacks, 1u); ++i) {
+      std::string path = packPath;
+      if (numPacks) {
+        std::ostringstream name;
+        name << packPath << "." << i << ".kpack";
+        path = name.str();
+      }
+      KTestPackWriter *pack = kTestPack_create(path.c_str(), compress);
+      if (!pack) {
+        fprintf(stderr, "unable to create %s\n", path.c_str());
+        return 1;
+      }
+      packs.push_back(pack);
+    }
+  }
+
+  KTest b;
+  b.numArgs = 0;
+  b.args = 0;
+  b.symArgvs = 0;
+  b.symArgvLen = 0;
+  b.numObjects = types.size();
+  b.objects = (KTestObject *) malloc(types.size() * sizeof *b.objects);
+  for (unsigned i = 0; i != types.size(); ++i) {
+    b.objects[i].name = const_cast<char *>(types[i].name.c_str());
+    b.objects[i].numBytes = types[i].size;
+    b.objects[i].bytes = (unsigned char *) malloc(types[i].size);
+  }
+
+  int status = 0;
+  for (unsigned t = 0; t != numTests && !status; ++t) {
+    for (unsigned i = 0; i != types.size(); ++i) {
+      KTestObject &o = b.objects[i];
+      for (unsigned j = 0; j != o.numBytes; ++j)
+        o.bytes[j] = random();
+      for (std::vector<FloatField>::iterator it = types[i].fields.begin(),
+             ie = types[i].fields.end(); it != ie; ++it)
+        fillField(*it, o.bytes);
+    }
+
+    char name[64];
+    sprintf(name, "test%06u.ktest", t + 1);
+    if (!packs.empty()) {
+      // Round robin, so that every archive gets all the classes.
+      if (!kTestPack_append(packs[t % packs.size()], &b, name)) {
+        fprintf(stderr, "unable to write %s\n", name);
+        status = 1;
+      }
+    } else {
+      std::string path = std::string(outputDir) + "/" + name;
+      if (!kTest_toFile(&b, path.c_str())) {
+        fprintf(stderr, "unable to write %s: %s\n", path.c_str(),
+                strerror(errno));
+        status = 1;
+      }
+    }
+  }
+
+  for (unsigned i = 0; i != packs.size(); ++i)
+    if (!kTestPack_close(packs[i])) {
+      fprintf(stderr, "unable to write the index of an archive\n");
+      status = 1;
+    }
+  for (unsigned i = 0; i != types.size(); ++i)
+    free(b.objects[i].bytes);
+  free(b.objects);
+  return status;
+}
@@ -22,7 +22,10 @@
 #include "klee/util/ExprPPrinter.h"
 #include "klee/util/ExprVisitor.h"
 #include "klee/util/ExprSMTLIBPrinter.h"
+#include "klee/util/ArrayCache.h"
+#include "klee/Internal/Support/BinaryQueryLog.h"
 #include "klee/Internal/Support/PrintVersion.h"
+#include "klee/Internal/System/Time.h"
 
 #include "llvm/ADT/StringExtras.h"
 #include "llvm/Support/CommandLine.h"
@@ -30,7 +33,12 @@
 #include "llvm/Support/MemoryBuffer.h"
 #include "llvm/Support/raw_ostream.h"
 
+#include <algorithm>
+#include <map>
+
+#include <stdio.h>
 #include <sys/stat.h>
+#include <sys/wait.h>
 #include <unistd.h>
 
 
@@ -54,7 +62,9 @@ namespace {
     PrintTokens,
     PrintAST,
     PrintSMTLIBv2,
-    Evaluate
+    Evaluate,
+    ReplayBinary,
+    Benchmark
   };
 
   static llvm::cl::opt<ToolActions> 
@@ -69,8 +79,49 @@ namespace {
                         "Print parsed AST nodes from the input file."),
              clEnumValN(Evaluate, "evaluate",
                         "Print parsed AST nodes from the input file."),
+             clEnumValN(ReplayBinary, "replay-binary",
+                        "Solve the queries of a binary query log, reporting "
+                        "the time of each."),
+             clEnumValN(Benchmark, "benchmark",
+                        "Solve the queries of a binary query log in "
+                        "-benchmark-jobs processes, reporting latency "
+                        "percentiles, cache hit rates, timeouts and answers "
+                        "which differ from the logged ones."),
              clEnumValEnd));
 
+  llvm::cl::opt<unsigned> BenchmarkJobs(
+      "benchmark-jobs",
+      llvm::cl::desc("Number of processes solving the queries of a "
+                     "-benchmark run, each with its own solver chain "
+                     "(default=1)"),
+      llvm::cl::init(1));
+
+  enum BenchmarkFormats {
+    BenchmarkCSV,
+    BenchmarkJSON
+  };
+
+  llvm::cl::opt<BenchmarkFormats> BenchmarkFormat(
+      "benchmark-format",
+      llvm::cl::desc("Format of the -benchmark report (default=csv)"),
+      llvm::cl::init(BenchmarkCSV),
+      llvm::cl::values(
+          clEnumValN(BenchmarkCSV, "csv", "One line per query type"),
+          clEnumValN(BenchmarkJSON, "json", "One object per query type"),
+          clEnumValEnd));
+
+  llvm::cl::list<std::string> BenchmarkVariants(
+      "benchmark-variant",
+      llvm::cl::desc("A solver chain for -benchmark to compare: a name, a "
+                     "colon and the options which build the chain, such as "
+                     "\"nocache:-use-cache=false -use-cex-cache=false\". "
+                     "Each variant solves the whole log in turn, and its "
+                     "answers are checked against the first variant's. The "
+                     "options must not be given on the command line too. "
+                     "Without any, the chain of the command line is "
+                     "benchmarked."),
+      llvm::cl::ZeroOrMore);
+
 
   enum BuilderKinds {
     DefaultBuilder,
@@ -100,6 +151,16 @@ namespace {
       llvm::cl::desc("We discard the previous array declarations after a query "
                      "is performed. Default: false"),
       llvm::cl::init(false));
+
+  llvm::cl::opt<bool> StreamQueries(
+      "stream-queries",
+      llvm::cl::desc("Solve each query of -evaluate as soon as it is parsed "
+                     "and free it afterwards, instead of parsing the whole "
+                     "input first. Memory use then stays flat on large logs "
+                     "if used with -clear-array-decls-after-query. A parse "
+                     "error stops the evaluation where it occurs. "
+                     "Default: false"),
+      llvm::cl::init(false));
 }
 
 static std::string getQueryLogPath(const char filename[])
@@ -194,14 +255,87 @@ static bool PrintInputAST(const char *Filename,
   return success;
 }
 
+/// EvaluateQueryCommand - Solve \a QC and print its answer as query \a Index.
+static void EvaluateQueryCommand(Solver *S, QueryCommand *QC, unsigned Index) {
+  llvm::outs() << "Query " << Index << ":\t";
+
+  assert("FIXME: Support counterexample query commands!");
+  if (QC->Values.empty() && QC->Objects.empty()) {
+    bool result;
+    if (S->mustBeTrue(Query(ConstraintManager(QC->Constraints), QC->Query),
+                      result)) {
+      llvm::outs() << (result ? "VALID" : "INVALID");
+    } else {
+      llvm::outs() << "FAIL (reason: "
+                << SolverImpl::getOperationStatusString(S->impl->getOperationStatusCode())
+                << ")";
+    }
+  } else if (!QC->Values.empty()) {
+    assert(QC->Objects.empty() && 
+           "FIXME: Support counterexamples for values and objects!");
+    assert(QC->Values.size() == 1 &&
+           "FIXME: Support counterexamples for multiple values!");
+    assert(QC->Query->isFalse() &&
+           "FIXME: Support counterexamples with non-trivial query!");
+    ref<Expr> result;
+    if (S->getValue(Query(ConstraintManager(QC->Constraints), 
+                          QC->Values[0]),
+                    result)) {
+      llvm::outs() << "INVALID\n";
+      llvm::outs() << "\tExpr 0:\t" << result;
+    } else {
+      llvm::outs() << "FAIL (reason: "
+                << SolverImpl::getOperationStatusString(S->impl->getOperationStatusCode())
+                << ")";
+    }
+  } else {
+    std::vector< std::vector<unsigned char> > result;
+    
+    if (S->getInitialValues(Query(ConstraintManager(QC->Constraints), 
+                                  QC->Query),
+                            QC->Objects, result)) {
+      llvm::outs() << "INVALID\n";
+
+      for (unsigned i = 0, e = result.size(); i != e; ++i) {
+        llvm::outs() << "\tArray " << i << ":\t"
+                   << QC->Objects[i]->name
+                   << "[";
+        for (unsigned j = 0; j != QC->Objects[i]->size; ++j) {
+          llvm::outs() << (unsigned) result[i][j];
+          if (j + 1 != QC->Objects[i]->size)
+            llvm::outs() << ", ";
+        }
+        llvm::outs() << "]";
+        if (i + 1 != e)
+          llvm::outs() << "\n";
+      }
+    } else {
+      SolverImpl::SolverRunStatus retCode = S->impl->getOperationStatusCode();
+      if (SolverImpl::SOLVER_RUN_STATUS_TIMEOUT == retCode) {
+        llvm::outs() << " FAIL (reason: "
+                  << SolverImpl::getOperationStatusString(retCode)
+                  << ")";
+      }           
+      else {
+        llvm::outs() << "VALID (counterexample request ignored)";
+      }
+    }
+  }
+
+  llvm::outs() << "\n";
+}
+
 static bool EvaluateInputAST(const char *Filename,
                              const MemoryBuffer *MB,
                              ExprBuilder *Builder) {
   std::vector<Decl*> Decls;
   Parser *P = Parser::Create(Filename, MB, Builder, ClearArrayAfterQuery);
   P->SetMaxErrors(20);
-  while (Decl *D = P->ParseTopLevelDecl()) {
-    Decls.push_back(D);
+  // Streamed queries are solved as they are parsed instead.
+  if (!StreamQueries) {
+    while (Decl *D = P->ParseTopLevelDecl()) {
+      Decls.push_back(D);
+    }
   }
 
   bool success = true;
@@ -225,83 +359,50 @@ static bool EvaluateInputAST(const char *Filename,
                                    getQueryLogPath(ALL_QUERIES_SMT2_FILE_NAME),
                                    getQueryLogPath(SOLVER_QUERIES_SMT2_FILE_NAME),
                                    getQueryLogPath(ALL_QUERIES_KQUERY_FILE_NAME),
-                                   getQueryLogPath(SOLVER_QUERIES_KQUERY_FILE_NAME));
+                                   getQueryLogPath(SOLVER_QUERIES_KQUERY_FILE_NAME),
+                                   getQueryLogPath(ALL_QUERIES_BINARY_FILE_NAME),
+                                   getQueryLogPath(SOLVER_QUERIES_BINARY_FILE_NAME));
 
   unsigned Index = 0;
-  for (std::vector<Decl*>::iterator it = Decls.begin(),
-         ie = Decls.end(); it != ie; ++it) {
-    Decl *D = *it;
-    if (QueryCommand *QC = dyn_cast<QueryCommand>(D)) {
-      llvm::outs() << "Query " << Index << ":\t";
-
-      assert("FIXME: Support counterexample query commands!");
-      if (QC->Values.empty() && QC->Objects.empty()) {
-        bool result;
-        if (S->mustBeTrue(Query(ConstraintManager(QC->Constraints), QC->Query),
-                          result)) {
-          llvm::outs() << (result ? "VALID" : "INVALID");
-        } else {
-          llvm::outs() << "FAIL (reason: "
-                    << SolverImpl::getOperationStatusString(S->impl->getOperationStatusCode())
-                    << ")";
-        }
-      } else if (!QC->Values.empty()) {
-        assert(QC->Objects.empty() && 
-               "FIXME: Support counterexamples for values and objects!");
-        assert(QC->Values.size() == 1 &&
-               "FIXME: Support counterexamples for multiple values!");
-        assert(QC->Query->isFalse() &&
-               "FIXME: Support counterexamples with non-trivial query!");
-        ref<Expr> result;
-        if (S->getValue(Query(ConstraintManager(QC->Constraints), 
-                              QC->Values[0]),
-                        result)) {
-          llvm::outs() << "INVALID\n";
-          llvm::outs() << "\tExpr 0:\t" << result;
-        } else {
-          llvm::outs() << "FAIL (reason: "
-                    << SolverImpl::getOperationStatusString(S->impl->getOperationStatusCode())
-                    << ")";
-        }
-      } else {
-        std::vector< std::vector<unsigned char> > result;
-        
-        if (S->getInitialValues(Query(ConstraintManager(QC->Constraints), 
-                                      QC->Query),
-                                QC->Objects, result)) {
-          llvm::outs() << "INVALID\n";
-
-          for (unsigned i = 0, e = result.size(); i != e; ++i) {
-            llvm::outs() << "\tArray " << i << ":\t"
-                       << QC->Objects[i]->name
-                       << "[";
-            for (unsigned j = 0; j != QC->Objects[i]->size; ++j) {
-              llvm::outs() << (unsigned) result[i][j];
-              if (j + 1 != QC->Objects[i]->size)
-                llvm::outs() << ", ";
-            }
-            llvm::outs() << "]";
-            if (i + 1 != e)
-              llvm::outs() << "\n";
-          }
-        } else {
-          SolverImpl::SolverRunStatus retCode = S->impl->getOperationStatusCode();
-          if (SolverImpl::SOLVER_RUN_STATUS_TIMEOUT == retCode) {
-            llvm::outs() << " FAIL (reason: "
-                      << SolverImpl::getOperationStatusString(retCode)
-                      << ")";
-          }           
-          else {
-            llvm::outs() << "VALID (counterexample request ignored)";
-          }
-        }
+  if (StreamQueries) {
+    // Each query is freed once solved. The array declarations stay alive as
+    // long as the parser may still refer to them, that is until a query
+    // clears them with -clear-array-decls-after-query.
+    std::vector<Decl*> Arrays;
+    while (Decl *D = P->ParseTopLevelDecl()) {
+      if (P->GetNumErrors()) {
+        delete D;
+        break;
+      }
+      QueryCommand *QC = dyn_cast<QueryCommand>(D);
+      if (!QC) {
+        Arrays.push_back(D);
+        continue;
       }
+      EvaluateQueryCommand(S, QC, Index++);
+      delete QC;
+      if (ClearArrayAfterQuery) {
+        for (unsigned i = 0, e = Arrays.size(); i != e; ++i)
+          delete Arrays[i];
+        Arrays.clear();
+      }
+    }
+    for (unsigned i = 0, e = Arrays.size(); i != e; ++i)
+      delete Arrays[i];
 
-      llvm::outs() << "\n";
-      ++Index;
+    if (unsigned N = P->GetNumErrors()) {
+      llvm::errs() << Filename << ": parse failure: " << N << " errors.\n";
+      success = false;
     }
   }
 
+  for (std::vector<Decl*>::iterator it = Decls.begin(),
+         ie = Decls.end(); it != ie; ++it) {
+    Decl *D = *it;
+    if (QueryCommand *QC = dyn_cast<QueryCommand>(D))
+      EvaluateQueryCommand(S, QC, Index++);
+  }
+
   for (std::vector<Decl*>::iterator it = Decls.begin(),
          ie = Decls.end(); it != ie; ++it)
     delete *it;
@@ -321,11 +422,533 @@ static bool EvaluateInputAST(const char *Filename,
       << *theStatisticManager->getStatisticByName("QueriesInvalid") << "\n"
       << "query cex = " 
       << *theStatisticManager->getStatisticByName("QueriesCEX") << "\n";
+
+    uint64_t prefixHits =
+        *theStatisticManager->getStatisticByName("QueryIncPrefixHits");
+    uint64_t prefixMisses =
+        *theStatisticManager->getStatisticByName("QueryIncPrefixMisses");
+    if (prefixHits + prefixMisses) {
+      llvm::outs() << "incremental prefix hits = " << prefixHits << "\n"
+                   << "incremental prefix misses = " << prefixMisses << "\n";
+    }
+
+    uint64_t constructHits =
+        *theStatisticManager->getStatisticByName("QueryConstructCacheHits");
+    uint64_t constructMisses =
+        *theStatisticManager->getStatisticByName("QueryConstructCacheMisses");
+    if (constructHits + constructMisses) {
+      llvm::outs() << "construct cache hits = " << constructHits << "\n"
+                   << "construct cache misses = " << constructMisses << "\n"
+                   << "construct cache evictions = "
+                   << *theStatisticManager->getStatisticByName(
+                          "QueryConstructCacheEvictions")
+                   << "\n";
+    }
+
+    uint64_t coreHits =
+        *theStatisticManager->getStatisticByName("QueryUnsatCoreHits");
+    uint64_t cores =
+        *theStatisticManager->getStatisticByName("QueryUnsatCores");
+    if (coreHits + cores) {
+      llvm::outs() << "unsat core hits = " << coreHits << "\n"
+                   << "unsat cores = " << cores << "\n";
+    }
+
+    uint64_t shapeBV =
+        *theStatisticManager->getStatisticByName("QueryShapeBitVector");
+    uint64_t shapeArray =
+        *theStatisticManager->getStatisticByName("QueryShapeArray");
+    uint64_t shapeFloat =
+        *theStatisticManager->getStatisticByName("QueryShapeFloat");
+    uint64_t shapeMixed =
+        *theStatisticManager->getStatisticByName("QueryShapeMixed");
+    if (shapeBV + shapeArray + shapeFloat + shapeMixed) {
+      llvm::outs() << "bit-vector queries = " << shapeBV << "\n"
+                   << "array queries = " << shapeArray << "\n"
+                   << "floating-point queries = " << shapeFloat << "\n"
+                   << "mixed queries = " << shapeMixed << "\n";
+    }
+
+    uint64_t hintFloatHits =
+        *theStatisticManager->getStatisticByName("QueryModelHintFloatHits");
+    uint64_t hintFloatMisses =
+        *theStatisticManager->getStatisticByName("QueryModelHintFloatMisses");
+    uint64_t hintMixedHits =
+        *theStatisticManager->getStatisticByName("QueryModelHintMixedHits");
+    uint64_t hintMixedMisses =
+        *theStatisticManager->getStatisticByName("QueryModelHintMixedMisses");
+    if (hintFloatHits + hintFloatMisses + hintMixedHits + hintMixedMisses) {
+      llvm::outs() << "floating-point model hint hits = " << hintFloatHits
+                   << "\n"
+                   << "floating-point model hint misses = " << hintFloatMisses
+                   << "\n"
+                   << "mixed model hint hits = " << hintMixedHits << "\n"
+                   << "mixed model hint misses = " << hintMixedMisses << "\n";
+    }
   }
 
   return success;
 }
 
+/// createReplaySolver - Build the solver chain the command line asks for;
+/// \a logSuffix is appended to the names of the query logs it writes.
+static Solver *createReplaySolver(const std::string &logSuffix = "") {
+  Solver *coreSolver = klee::createCoreSolver(CoreSolverToUse);
+
+  if (CoreSolverToUse != DUMMY_SOLVER) {
+    if (0 != MaxCoreSolverTime) {
+      coreSolver->setCoreSolverTimeout(MaxCoreSolverTime);
+    }
+  }
+
+  return constructSolverChain(
+      coreSolver,
+      getQueryLogPath(ALL_QUERIES_SMT2_FILE_NAME) + logSuffix,
+      getQueryLogPath(SOLVER_QUERIES_SMT2_FILE_NAME) + logSuffix,
+      getQueryLogPath(ALL_QUERIES_KQUERY_FILE_NAME) + logSuffix,
+      getQueryLogPath(SOLVER_QUERIES_KQUERY_FILE_NAME) + logSuffix,
+      getQueryLogPath(ALL_QUERIES_BINARY_FILE_NAME) + logSuffix,
+      getQueryLogPath(SOLVER_QUERIES_BINARY_FILE_NAME) + logSuffix);
+}
+
+static const char *getAnswerName(binlog::Answer answer) {
+  switch (answer) {
+  case binlog::False: return "false";
+  case binlog::True: return "true";
+  case binlog::Unknown: return "unknown";
+  default: return "-";
+  }
+}
+
+/// solveBinaryQuery - Solve a query read from a binary query log at the level
+/// of the solver chain it was logged at, returning its answer in \a answer.
+static bool solveBinaryQuery(Solver *S, const BinaryQuery &BQ,
+                             binlog::Answer &answer) {
+  ConstraintManager constraints(BQ.constraints);
+  Query query(constraints, BQ.expr);
+
+  bool success = false;
+  answer = binlog::NoAnswer;
+  switch (BQ.type) {
+  case binlog::Truth: {
+    bool isValid;
+    success = S->impl->computeTruth(query, isValid);
+    answer = isValid ? binlog::True : binlog::False;
+    break;
+  }
+  case binlog::Validity: {
+    Solver::Validity result;
+    success = S->impl->computeValidity(query, result);
+    answer = result == Solver::True
+                 ? binlog::True
+                 : result == Solver::False ? binlog::False : binlog::Unknown;
+    break;
+  }
+  case binlog::Value: {
+    ref<Expr> result;
+    success = S->impl->computeValue(query, result);
+    break;
+  }
+  case binlog::InitialValues: {
+    std::vector< std::vector<unsigned char> > values;
+    bool hasSolution;
+    success = S->impl->computeInitialValues(query, BQ.objects, values,
+                                            hasSolution);
+    answer = hasSolution ? binlog::True : binlog::False;
+    break;
+  }
+  }
+  if (!success)
+    answer = binlog::NoAnswer;
+  return success;
+}
+
+/// Solve the queries of a binary query log one at a time, as they are read,
+/// at the level of the solver chain they were logged at.
+static bool replayBinaryLog(const std::string &Filename) {
+  ArrayCache arrayCache;
+  BinaryQueryReader reader(arrayCache);
+  if (!reader.open(Filename)) {
+    llvm::errs() << Filename << ": error: " << reader.getError() << "\n";
+    return false;
+  }
+
+  Solver *S = createReplaySolver();
+
+  unsigned Index = 0, Mismatches = 0;
+  double TotalTime = 0, TotalLoggedTime = 0;
+  BinaryQuery BQ;
+  while (reader.readQuery(BQ)) {
+    binlog::Answer answer;
+    double start = util::getWallTime();
+    bool success = solveBinaryQuery(S, BQ, answer);
+    double elapsed = util::getWallTime() - start;
+    TotalTime += elapsed;
+
+    llvm::outs() << "Query " << Index++ << ":\t"
+                 << binlog::getQueryTypeName(BQ.type) << "\t"
+                 << (success ? getAnswerName(answer) : "FAIL") << "\t"
+                 << elapsed << "s";
+    if (BQ.hasResult) {
+      double logged = BQ.elapsed / 1000000.;
+      TotalLoggedTime += logged;
+      llvm::outs() << "\t(logged " << logged << "s)";
+      if (BQ.success && success && BQ.answer != answer) {
+        llvm::outs() << "\tMISMATCH (logged "
+                     << getAnswerName(BQ.answer) << ")";
+        ++Mismatches;
+      }
+    }
+    llvm::outs() << "\n";
+  }
+
+  delete S;
+
+  bool success = reader.getError().empty();
+  if (!success)
+    llvm::errs() << Filename << ": error: query " << Index << ": "
+                 << reader.getError() << "\n";
+
+  llvm::outs() << "--\n"
+               << "total queries = " << Index << "\n"
+               << "total time = " << TotalTime << "s\n"
+               << "total logged time = " << TotalLoggedTime << "s\n"
+               << "mismatches = " << Mismatches << "\n";
+  return success && !Mismatches;
+}
+
+namespace {
+  /// BenchmarkResult - What a benchmark job reports about each query it
+  /// solved, with the cache statistics the query changed.
+  struct BenchmarkResult {
+    uint32_t index;
+    uint8_t type;
+    uint8_t status;
+    /// The answer, and whether it differs from the logged one.
+    uint8_t answer;
+    uint8_t mismatch;
+    double elapsed;
+    uint32_t cacheHits, cacheMisses;
+    uint32_t cexCacheHits, cexCacheMisses;
+  };
+
+  enum BenchmarkStatus {
+    BenchmarkSolved,
+    BenchmarkTimeout,
+    BenchmarkFailure
+  };
+
+  /// BenchmarkSummary - The results of the queries of one type, or of all.
+  struct BenchmarkSummary {
+    std::vector<double> latencies;
+    uint64_t timeouts, failures, mismatches;
+    uint64_t cacheHits, cacheMisses;
+    uint64_t cexCacheHits, cexCacheMisses;
+
+    BenchmarkSummary()
+        : timeouts(0), failures(0), mismatches(0), cacheHits(0),
+          cacheMisses(0), cexCacheHits(0), cexCacheMisses(0) {}
+
+    void add(const BenchmarkResult &r) {
+      latencies.push_back(r.elapsed);
+      if (r.status == BenchmarkTimeout)
+        ++timeouts;
+      else if (r.status == BenchmarkFailure)
+        ++failures;
+      if (r.mismatch)
+        ++mismatches;
+      cacheHits += r.cacheHits;
+      cacheMisses += r.cacheMisses;
+      cexCacheHits += r.cexCacheHits;
+      cexCacheMisses += r.cexCacheMisses;
+    }
+  };
+}
+
+static uint64_t getStatisticValue(const char *name) {
+  Statistic *S = theStatisticManager->getStatisticByName(name);
+  return S ? S->getValue() : 0;
+}
+
+/// runBenchmarkJob - Solve every jobs-th query of the log, starting with
+/// query \a job, writing a BenchmarkResult for each to \a results.
+static bool runBenchmarkJob(const std::string &Filename, unsigned job,
+                            unsigned jobs, FILE *results) {
+  ArrayCache arrayCache;
+  BinaryQueryReader reader(arrayCache);
+  if (!reader.open(Filename)) {
+    llvm::errs() << Filename << ": error: " << reader.getError() << "\n";
+    return false;
+  }
+
+  Solver *S = createReplaySolver(jobs > 1 ? "." + llvm::utostr(job) : "");
+
+  unsigned Index = 0;
+  BinaryQuery BQ;
+  for (; reader.readQuery(BQ); ++Index) {
+    if (Index % jobs != job)
+      continue;
+
+    uint64_t hits = getStatisticValue("QueryCacheHits");
+    uint64_t misses = getStatisticValue("QueryCacheMisses");
+    uint64_t cexHits = getStatisticValue("QueryCexCacheHits");
+    uint64_t cexMisses = getStatisticValue("QueryCexCacheMisses");
+
+    binlog::Answer answer;
+    double start = util::getWallTime();
+    bool success = solveBinaryQuery(S, BQ, answer);
+
+    BenchmarkResult r;
+    r.elapsed = util::getWallTime() - start;
+    r.index = Index;
+    r.type = BQ.type;
+    r.answer = answer;
+    r.mismatch = BQ.hasResult && BQ.success && success &&
+                 BQ.answer != answer;
+    if (success)
+      r.status = BenchmarkSolved;
+    else if (S->impl->getOperationStatusCode() ==
+             SolverImpl::SOLVER_RUN_STATUS_TIMEOUT)
+      r.status = BenchmarkTimeout;
+    else
+      r.status = BenchmarkFailure;
+    r.cacheHits = getStatisticValue("QueryCacheHits") - hits;
+    r.cacheMisses = getStatisticValue("QueryCacheMisses") - misses;
+    r.cexCacheHits = getStatisticValue("QueryCexCacheHits") - cexHits;
+    r.cexCacheMisses = getStatisticValue("QueryCexCacheMisses") - cexMisses;
+    fwrite(&r, sizeof r, 1, results);
+  }
+
+  delete S;
+  fflush(results);
+
+  if (!reader.getError().empty()) {
+    llvm::errs() << Filename << ": error: query " << Index << ": "
+                 << reader.getError() << "\n";
+    return false;
+  }
+  return true;
+}
+
+/// getPercentile - The nearest rank \a p percentile of sorted \a values.
+static double getPercentile(const std::vector<double> &values, unsigned p) {
+  if (values.empty())
+    return 0;
+  size_t rank = (values.size() * p + 99) / 100;
+  return values[rank ? rank - 1 : 0];
+}
+
+static double getRate(uint64_t hits, uint64_t misses) {
+  return hits + misses ? (double) hits / (hits + misses) : 0;
+}
+
+static void printBenchmarkSummary(const std::string &variant,
+                                  const char *name, BenchmarkSummary &s,
+                                  bool first) {
+  std::sort(s.latencies.begin(), s.latencies.end());
+  double total = 0;
+  for (unsigned i = 0, e = s.latencies.size(); i != e; ++i)
+    total += s.latencies[i];
+
+  llvm::raw_ostream &os = llvm::outs();
+  if (BenchmarkFormat == BenchmarkCSV) {
+    if (!BenchmarkVariants.empty())
+      os << variant << ",";
+    os << name << "," << s.latencies.size() << "," << s.timeouts << ","
+       << s.failures << "," << total << ","
+       << getPercentile(s.latencies, 50) << ","
+       << getPercentile(s.latencies, 90) << ","
+       << getPercentile(s.latencies, 99) << ","
+       << (s.latencies.empty() ? 0 : s.latencies.back()) << ","
+       << getRate(s.cacheHits, s.cacheMisses) << ","
+       << getRate(s.cexCacheHits, s.cexCacheMisses) << ","
+       << s.mismatches << "\n";
+    return;
+  }
+
+  os << (first ? "" : ",\n") << "    {";
+  if (!BenchmarkVariants.empty())
+    os << "\"variant\": \"" << variant << "\", ";
+  os << "\"type\": \"" << name << "\", "
+     << "\"queries\": " << s.latencies.size() << ", "
+     << "\"timeouts\": " << s.timeouts << ", "
+     << "\"failures\": " << s.failures << ", "
+     << "\"total\": " << total << ", "
+     << "\"p50\": " << getPercentile(s.latencies, 50) << ", "
+     << "\"p90\": " << getPercentile(s.latencies, 90) << ", "
+     << "\"p99\": " << getPercentile(s.latencies, 99) << ", "
+     << "\"max\": " << (s.latencies.empty() ? 0 : s.latencies.back()) << ", "
+     << "\"query_cache_hit_rate\": " << getRate(s.cacheHits, s.cacheMisses)
+     << ", "
+     << "\"cex_cache_hit_rate\": "
+     << getRate(s.cexCacheHits, s.cexCacheMisses) << ", "
+     << "\"mismatches\": " << s.mismatches << "}";
+}
+
+/// applyVariantOptions - Parse the options of a -benchmark-variant, as if
+/// they had been given on the command line. Only benchmark jobs do this,
+/// after they are forked, so that every variant starts from the options of
+/// the command line.
+static void applyVariantOptions(const std::string &options) {
+  std::vector<std::string> args(1, "kleaver");
+  std::string::size_type pos = 0;
+  while ((pos = options.find_first_not_of(" \t", pos)) != std::string::npos) {
+    std::string::size_type end = options.find_first_of(" \t", pos);
+    args.push_back(options.substr(pos, end - pos));
+    pos = end;
+  }
+  std::vector<const char *> argv;
+  for (unsigned i = 0, e = args.size(); i != e; ++i)
+    argv.push_back(args[i].c_str());
+  llvm::cl::ParseCommandLineOptions(argv.size(), (char **) &argv[0]);
+}
+
+/// runBenchmark - Solve the queries of a binary query log in -benchmark-jobs
+/// processes, with the chain the command line and \a variantOptions ask
+/// for, and append the result of each query to \a results.
+static bool runBenchmark(const std::string &Filename,
+                         const std::string &variantOptions,
+                         std::vector<BenchmarkResult> &results) {
+  unsigned jobs = std::max(1u, (unsigned) BenchmarkJobs);
+  bool success = true;
+  std::vector<FILE *> files;
+  std::vector<pid_t> pids;
+  for (unsigned job = 0; job != jobs; ++job) {
+    FILE *f = tmpfile();
+    if (!f) {
+      llvm::errs() << "error: cannot create a benchmark result file\n";
+      success = false;
+      break;
+    }
+    files.push_back(f);
+
+    // A single job with the options of the command line runs in this
+    // process; variants need a process of their own to set their options.
+    if (jobs == 1 && BenchmarkVariants.empty()) {
+      success = runBenchmarkJob(Filename, job, jobs, f);
+      break;
+    }
+
+    // Flush before forking so that buffered output is not written twice.
+    llvm::outs().flush();
+    llvm::errs().flush();
+    pid_t pid = fork();
+    if (pid < 0) {
+      llvm::errs() << "error: fork failed\n";
+      success = false;
+      break;
+    }
+    if (pid == 0) {
+      applyVariantOptions(variantOptions);
+      _exit(runBenchmarkJob(Filename, job, jobs, f) ? 0 : 1);
+    }
+    pids.push_back(pid);
+  }
+
+  for (unsigned i = 0, e = pids.size(); i != e; ++i) {
+    int status;
+    if (waitpid(pids[i], &status, 0) < 0 || !WIFEXITED(status) ||
+        WEXITSTATUS(status) != 0) {
+      llvm::errs() << "error: benchmark job " << i << " failed\n";
+      success = false;
+    }
+  }
+
+  for (unsigned i = 0, e = files.size(); i != e; ++i) {
+    rewind(files[i]);
+    BenchmarkResult r;
+    while (fread(&r, sizeof r, 1, files[i]) == 1)
+      results.push_back(r);
+    fclose(files[i]);
+  }
+  return success;
+}
+
+static bool compareBenchmarkResultIndex(const BenchmarkResult &a,
+                                        const BenchmarkResult &b) {
+  return a.index < b.index;
+}
+
+/// Solve the queries of a binary query log in -benchmark-jobs processes,
+/// each with the solver chain the command line asks for, and report the
+/// latencies (in seconds), timeouts, cache hit rates and wrong answers of
+/// each query type. The jobs share the queries round robin.
+///
+/// With -benchmark-variant, each variant solves the whole log in turn, and
+/// an answer is also wrong where it differs from the first variant's.
+static bool benchmarkBinaryLog(const std::string &Filename) {
+  unsigned jobs = std::max(1u, (unsigned) BenchmarkJobs);
+  if ((jobs > 1 || BenchmarkVariants.size() > 1) && Filename == "-") {
+    llvm::errs() << "error: -benchmark-jobs and -benchmark-variant need a "
+                 << "file, not stdin\n";
+    return false;
+  }
+
+  std::vector<std::string> names, options;
+  if (BenchmarkVariants.empty()) {
+    names.push_back("");
+    options.push_back("");
+  }
+  for (unsigned i = 0, e = BenchmarkVariants.size(); i != e; ++i) {
+    const std::string &variant = BenchmarkVariants[i];
+    std::string::size_type colon = variant.find(':');
+    names.push_back(variant.substr(0, colon));
+    options.push_back(colon == std::string::npos ? variant
+                                                 : variant.substr(colon + 1));
+  }
+
+  bool success = true;
+  std::vector<double> elapsed;
+  std::vector<BenchmarkSummary> all(names.size());
+  std::vector<std::map<unsigned, BenchmarkSummary> > byType(names.size());
+  std::vector<BenchmarkResult> baseline;
+  for (unsigned v = 0, e = names.size(); v != e; ++v) {
+    double start = util::getWallTime();
+    std::vector<BenchmarkResult> results;
+    success &= runBenchmark(Filename, options[v], results);
+    elapsed.push_back(util::getWallTime() - start);
+
+    std::sort(results.begin(), results.end(), compareBenchmarkResultIndex);
+    if (v == 0)
+      baseline = results;
+    for (unsigned i = 0, ie = results.size(); i != ie; ++i) {
+      BenchmarkResult &r = results[i];
+      if (v && i < baseline.size() && baseline[i].index == r.index &&
+          baseline[i].status == BenchmarkSolved &&
+          r.status == BenchmarkSolved && baseline[i].answer != r.answer)
+        r.mismatch = true;
+      all[v].add(r);
+      byType[v][r.type].add(r);
+    }
+  }
+
+  if (BenchmarkFormat == BenchmarkCSV) {
+    if (!BenchmarkVariants.empty())
+      llvm::outs() << "variant,";
+    llvm::outs() << "type,queries,timeouts,failures,total,p50,p90,p99,max,"
+                 << "query_cache_hit_rate,cex_cache_hit_rate,mismatches\n";
+  } else {
+    double total = 0;
+    for (unsigned v = 0, e = elapsed.size(); v != e; ++v)
+      total += elapsed[v];
+    llvm::outs() << "{\n  \"jobs\": " << jobs << ",\n"
+                 << "  \"wall_time\": " << total << ",\n"
+                 << "  \"types\": [\n";
+  }
+  for (unsigned v = 0, e = names.size(); v != e; ++v) {
+    printBenchmarkSummary(names[v], "all", all[v], v == 0);
+    for (std::map<unsigned, BenchmarkSummary>::iterator
+             it = byType[v].begin(), ie = byType[v].end(); it != ie; ++it)
+      printBenchmarkSummary(
+          names[v], binlog::getQueryTypeName((binlog::QueryType) it->first),
+          it->second, false);
+  }
+  if (BenchmarkFormat == BenchmarkJSON)
+    llvm::outs() << "\n  ]\n}\n";
+
+  return success;
+}
+
 static bool printInputAsSMTLIBv2(const char *Filename,
                              const MemoryBuffer *MB,
                              ExprBuilder *Builder)
@@ -405,6 +1028,18 @@ int main(int argc, char **argv) {
   llvm::cl::ParseCommandLineOptions(argc, argv);
 
   std::string ErrorStr;
+
+  // The log is streamed rather than read into memory first.
+  if (ToolAction == ReplayBinary) {
+    success = replayBinaryLog(InputFile);
+    llvm::llvm_shutdown();
+    return success ? 0 : 1;
+  }
+  if (ToolAction == Benchmark) {
+    success = benchmarkBinaryLog(InputFile);
+    llvm::llvm_shutdown();
+    return success ? 0 : 1;
+  }
   
 #if LLVM_VERSION_CODE < LLVM_VERSION(3,5)
   OwningPtr<MemoryBuffer> MB;
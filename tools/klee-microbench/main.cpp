@@ -0,0 +1,564 @@
+//===-- main.cpp ------------------------------------------------*- C++ -*-===//
+//
+//                     The KLEE Symbolic Virtual Machine
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+//
+// klee-microbench times the hot paths of the expression library, the memory
+// model and the solver chain in isolation, so that changes to them can be
+// measured without running whole programs. Each benchmark runs for at least
+// -min-time seconds, doubling its iterations as it goes, and reports the
+// time of one iteration.
+//
+// The Z3 construction benchmark is run over the queries of the .kquery files
+// given on the command line.
+//
+//===----------------------------------------------------------------------===//
+
+#include "expr/Parser.h"
+
+#include "klee/Config/config.h"
+#include "klee/Constraints.h"
+#include "klee/Expr.h"
+#include "klee/ExprBuilder.h"
+#include "klee/Solver.h"
+#include "klee/SolverImpl.h"
+#include "klee/Internal/Support/PrintVersion.h"
+#include "klee/Internal/System/Time.h"
+#include "klee/util/ArrayCache.h"
+#include "klee/util/ExprHashMap.h"
+
+#include "Core/AddressSpace.h"
+#include "Core/Memory.h"
+#include "Core/MemoryManager.h"
+#ifdef ENABLE_Z3
+#include "Solver/Z3Builder.h"
+#endif
+
+#include "llvm/ADT/StringExtras.h"
+#include "llvm/Support/CommandLine.h"
+#include "llvm/Support/ManagedStatic.h"
+#include "llvm/Support/MemoryBuffer.h"
+#include "llvm/Support/Signals.h"
+#include "llvm/Support/raw_ostream.h"
+
+#if LLVM_VERSION_CODE < LLVM_VERSION(3, 5)
+#include "llvm/ADT/OwningPtr.h"
+#include "llvm/Support/system_error.h"
+#endif
+
+#include <algorithm>
+#include <stdint.h>
+#include <stdio.h>
+#include <vector>
+
+using namespace llvm;
+using namespace klee;
+using namespace klee::expr;
+
+namespace {
+  cl::list<std::string>
+  QueryFiles(cl::desc("<kquery files>"), cl::Positional, cl::ZeroOrMore);
+
+  cl::opt<std::string>
+  Filter("filter",
+         cl::desc("Only run the benchmarks whose name contains this string "
+                  "(default=all)"));
+
+  cl::opt<double>
+  MinTime("min-time",
+          cl::desc("Seconds each benchmark runs for at least (default=0.5)"),
+          cl::init(0.5));
+
+  cl::opt<bool>
+  ListBenchmarks("list", cl::desc("List the benchmarks and exit"));
+}
+
+/***/
+
+namespace {
+/// The iteration count and timer of one run of a benchmark. Benchmarks time
+/// their loop only, between startTiming and stopTiming, so that their setup
+/// is not counted.
+class BenchmarkState {
+  uint64_t iterations;
+  double start;
+  double elapsed;
+
+public:
+  explicit BenchmarkState(uint64_t _iterations)
+      : iterations(_iterations), start(0), elapsed(0) {}
+
+  uint64_t getIterations() const { return iterations; }
+  double getElapsed() const { return elapsed; }
+
+  void startTiming() { start = util::getWallTime(); }
+  void stopTiming() { elapsed += util::getWallTime() - start; }
+};
+
+typedef void (*BenchmarkFn)(BenchmarkState &state);
+
+struct Benchmark {
+  const char *name;
+  BenchmarkFn run;
+};
+
+/// Results are folded in here so the compiler cannot drop the work which
+/// computes them.
+volatile uintptr_t sink;
+
+inline void keep(const void *p) { sink ^= (uintptr_t)p; }
+inline void keep(uint64_t v) { sink ^= (uintptr_t)v; }
+
+ArrayCache arrayCache;
+
+const Array *getArray(const std::string &name, uint64_t size = 8) {
+  return arrayCache.CreateArray(name, size);
+}
+
+/// A sum of \a n terms, each reading a different 32 bit variable, which is
+/// rebuilt from scratch on every call.
+ref<Expr> buildSum(unsigned n) {
+  ref<Expr> sum = ConstantExpr::alloc(0, Expr::Int32);
+  for (unsigned i = 0; i != n; ++i) {
+    ref<Expr> read = Expr::createTempRead(getArray("v" + llvm::utostr(i)),
+                                          Expr::Int32);
+    sum = AddExpr::create(sum, MulExpr::create(read, ConstantExpr::alloc(
+                                                         i + 1, Expr::Int32)));
+  }
+  return sum;
+}
+
+ref<Expr> readFloat(const std::string &name, Expr::Width width) {
+  return ExplicitFloatExpr::create(
+      Expr::createTempRead(getArray(name), width), width);
+}
+
+/// A core solver which answers at once, so that the solvers in front of it
+/// are timed alone: nothing is valid and every variable is zero.
+class ZeroSolverImpl : public SolverImpl {
+public:
+  bool computeTruth(const Query &, bool &isValid) {
+    isValid = false;
+    return true;
+  }
+  bool computeValue(const Query &query, ref<Expr> &result) {
+    result = ConstantExpr::alloc(0, query.expr->getWidth());
+    return true;
+  }
+  bool computeInitialValues(const Query &,
+                            const std::vector<const Array *> &objects,
+                            std::vector<std::vector<unsigned char> > &values,
+                            bool &hasSolution) {
+    values.clear();
+    for (unsigned i = 0; i != objects.size(); ++i)
+      values.push_back(std::vector<unsigned char>(objects[i]->size));
+    hasSolution = true;
+    return true;
+  }
+  SolverRunStatus getOperationStatusCode() {
+    return SOLVER_RUN_STATUS_SUCCESS_SOLVABLE;
+  }
+};
+
+/***/
+
+void benchExprCreate(BenchmarkState &state) {
+  ref<Expr> x = Expr::createTempRead(getArray("x"), Expr::Int32);
+  state.startTiming();
+  for (uint64_t i = 0; i != state.getIterations(); ++i) {
+    ref<Expr> e = AddExpr::create(
+        x, ConstantExpr::alloc(i & 0xFFFF, Expr::Int32));
+    keep(SltExpr::create(e, x).get());
+  }
+  state.stopTiming();
+}
+
+void benchExprFold(BenchmarkState &state) {
+  ref<Expr> one = ConstantExpr::alloc(1, Expr::Int64);
+  state.startTiming();
+  for (uint64_t i = 0; i != state.getIterations(); ++i) {
+    ref<Expr> e = AddExpr::create(ConstantExpr::alloc(i, Expr::Int64), one);
+    keep(MulExpr::create(e, e).get());
+  }
+  state.stopTiming();
+}
+
+void benchExprCreateFloat(BenchmarkState &state) {
+  ref<Expr> x = readFloat("fx", Expr::Fl64);
+  ref<Expr> y = readFloat("fy", Expr::Fl64);
+  state.startTiming();
+  for (uint64_t i = 0; i != state.getIterations(); ++i) {
+    ref<Expr> e = FAddExpr::create(x, y, llvm::APFloat::rmNearestTiesToEven);
+    keep(FOltExpr::create(FMulExpr::create(
+                              e, x, llvm::APFloat::rmNearestTiesToEven),
+                          y).get());
+  }
+  state.stopTiming();
+}
+
+void benchExprCompare(BenchmarkState &state) {
+  // Equal but distinct expressions have to be compared all the way down.
+  ref<Expr> a = buildSum(32), b = buildSum(32);
+  state.startTiming();
+  for (uint64_t i = 0; i != state.getIterations(); ++i)
+    keep(a->compare(*b));
+  state.stopTiming();
+}
+
+void benchExprHash(BenchmarkState &state) {
+  ref<Expr> e = buildSum(32);
+  state.startTiming();
+  for (uint64_t i = 0; i != state.getIterations(); ++i)
+    keep(e->computeHash());
+  state.stopTiming();
+}
+
+void benchExprHashMapLookup(BenchmarkState &state) {
+  const unsigned n = 1024;
+  ExprHashMap<unsigned> map;
+  std::vector< ref<Expr> > keys;
+  ref<Expr> x = Expr::createTempRead(getArray("x"), Expr::Int32);
+  for (unsigned i = 0; i != n; ++i) {
+    ref<Expr> c = ConstantExpr::alloc(i, Expr::Int32);
+    map[AddExpr::create(x, c)] = i;
+    // Look up a copy, as the executor does, rather than the key itself.
+    keys.push_back(AddExpr::alloc(c, x));
+  }
+  state.startTiming();
+  for (uint64_t i = 0; i != state.getIterations(); ++i) {
+    ExprHashMap<unsigned>::iterator it = map.find(keys[i % n]);
+    keep(it == map.end() ? 0 : it->second);
+  }
+  state.stopTiming();
+}
+
+void benchObjectStateConcrete(BenchmarkState &state) {
+  MemoryManager memory(&arrayCache);
+  ObjectState *os =
+      new ObjectState(memory.allocate(4096, false, true, 0, 8));
+  os->initializeToZero();
+  state.startTiming();
+  for (uint64_t i = 0; i != state.getIterations(); ++i) {
+    unsigned offset = (i * 4) & 4095;
+    os->write32(offset, i);
+    keep(os->read(offset, Expr::Int32).get());
+  }
+  state.stopTiming();
+  delete os;
+}
+
+void benchObjectStateSymbolic(BenchmarkState &state) {
+  MemoryManager memory(&arrayCache);
+  ObjectState *os =
+      new ObjectState(memory.allocate(256, false, true, 0, 8));
+  os->initializeToZero();
+  ref<Expr> x = Expr::createTempRead(getArray("x"), Expr::Int32);
+  state.startTiming();
+  for (uint64_t i = 0; i != state.getIterations(); ++i) {
+    unsigned offset = (i * 4) & 255;
+    os->write(offset, x);
+    keep(os->read(offset, Expr::Int32).get());
+  }
+  state.stopTiming();
+  delete os;
+}
+
+void benchObjectStateSymbolicOffset(BenchmarkState &state) {
+  MemoryManager memory(&arrayCache);
+  ObjectState *os =
+      new ObjectState(memory.allocate(256, false, true, 0, 8));
+  os->initializeToZero();
+  ref<Expr> index = AndExpr::create(
+      Expr::createTempRead(getArray("i"), Expr::Int32),
+      ConstantExpr::alloc(0xFC, Expr::Int32));
+  state.startTiming();
+  for (uint64_t i = 0; i != state.getIterations(); ++i) {
+    // Rewrite the object now and then, so the update list stays short.
+    if ((i & 63) == 0)
+      os->initializeToZero();
+    os->write(index, ConstantExpr::alloc(i, Expr::Int32));
+    keep(os->read(index, Expr::Int32).get());
+  }
+  state.stopTiming();
+  delete os;
+}
+
+void benchObjectStateFloat(BenchmarkState &state) {
+  MemoryManager memory(&arrayCache);
+  ObjectState *os =
+      new ObjectState(memory.allocate(256, false, true, 0, 8));
+  os->initializeToZero();
+  ref<Expr> x = FAddExpr::create(readFloat("fx", Expr::Fl64),
+                                 readFloat("fy", Expr::Fl64),
+                                 llvm::APFloat::rmNearestTiesToEven);
+  state.startTiming();
+  for (uint64_t i = 0; i != state.getIterations(); ++i) {
+    unsigned offset = (i * 8) & 255;
+    os->write(offset, x);
+    keep(os->readFloat(offset, Expr::Fl64).get());
+  }
+  state.stopTiming();
+  delete os;
+}
+
+void benchResolveOne(BenchmarkState &state) {
+  const unsigned n = 1024;
+  MemoryManager memory(&arrayCache);
+  std::vector<uint64_t> addresses;
+  {
+    AddressSpace addressSpace;
+    for (unsigned i = 0; i != n; ++i) {
+      MemoryObject *mo = memory.allocate(16 + (i & 7) * 8, false, true, 0, 8);
+      addressSpace.bindObject(mo, new ObjectState(mo));
+      addresses.push_back(mo->address + (i & 15));
+    }
+    state.startTiming();
+    for (uint64_t i = 0; i != state.getIterations(); ++i) {
+      // Stride through the objects, so the lookups are not all repeats.
+      ObjectPair op;
+      addressSpace.resolveOne(
+          ConstantExpr::alloc(addresses[(i * 97) % n], Expr::Int64), op);
+      keep(op.first);
+    }
+    state.stopTiming();
+  }
+}
+
+void benchAddConstraint(BenchmarkState &state) {
+  const unsigned n = 32;
+  std::vector< ref<Expr> > constraints;
+  ref<Expr> x = Expr::createTempRead(getArray("x"), Expr::Int32);
+  for (unsigned i = 0; i != n; ++i) {
+    ref<Expr> y = Expr::createTempRead(getArray("y" + llvm::utostr(i)),
+                                       Expr::Int32);
+    constraints.push_back(UltExpr::create(AddExpr::create(x, y),
+                                          ConstantExpr::alloc(1000 + i,
+                                                              Expr::Int32)));
+  }
+  constraints.push_back(EqExpr::create(x, ConstantExpr::alloc(7,
+                                                              Expr::Int32)));
+
+  // Each iteration adds one constraint, to a manager which is started over
+  // once it has all of them.
+  ConstraintManager *cm = new ConstraintManager();
+  state.startTiming();
+  for (uint64_t i = 0; i != state.getIterations(); ++i) {
+    unsigned index = i % constraints.size();
+    if (index == 0) {
+      delete cm;
+      cm = new ConstraintManager();
+    }
+    cm->addConstraint(constraints[index]);
+  }
+  state.stopTiming();
+  delete cm;
+}
+
+/// Constraints on \a n unrelated variables, and a query on the first.
+Query buildIndependentQuery(ConstraintManager &cm, unsigned n,
+                            const std::string &prefix) {
+  for (unsigned i = 0; i != n; ++i) {
+    ref<Expr> v = Expr::createTempRead(getArray(prefix + llvm::utostr(i)),
+                                       Expr::Int32);
+    cm.addConstraint(UltExpr::create(v, ConstantExpr::alloc(100 + i,
+                                                            Expr::Int32)));
+  }
+  ref<Expr> first = Expr::createTempRead(getArray(prefix + "0"), Expr::Int32);
+  return Query(cm, EqExpr::create(first, ConstantExpr::alloc(5, Expr::Int32)));
+}
+
+void benchIndependentSolver(BenchmarkState &state) {
+  Solver *solver = createIndependentSolver(new Solver(new ZeroSolverImpl()));
+  ConstraintManager cm;
+  Query query = buildIndependentQuery(cm, 64, "ind");
+  state.startTiming();
+  for (uint64_t i = 0; i != state.getIterations(); ++i) {
+    bool result;
+    solver->mustBeTrue(query, result);
+    keep(result);
+  }
+  state.stopTiming();
+  delete solver;
+}
+
+void benchCexCachingSolverHit(BenchmarkState &state) {
+  Solver *solver = createCexCachingSolver(new Solver(new ZeroSolverImpl()));
+  ConstraintManager cm;
+  Query query = buildIndependentQuery(cm, 16, "cex");
+  bool result;
+  solver->mustBeTrue(query, result);
+  state.startTiming();
+  for (uint64_t i = 0; i != state.getIterations(); ++i) {
+    solver->mustBeTrue(query, result);
+    keep(result);
+  }
+  state.stopTiming();
+  delete solver;
+}
+
+void benchCexCachingSolverMiss(BenchmarkState &state) {
+  Solver *solver = createCexCachingSolver(new Solver(new ZeroSolverImpl()));
+  ConstraintManager cm;
+  Query base = buildIndependentQuery(cm, 16, "cex");
+  ref<Expr> first = Expr::createTempRead(getArray("cex0"), Expr::Int32);
+  // Every query asks about a value not seen before, so the cache has to
+  // look through its assignments rather than find the query itself.
+  state.startTiming();
+  for (uint64_t i = 0; i != state.getIterations(); ++i) {
+    bool result;
+    solver->mustBeTrue(base.withExpr(UgtExpr::create(
+                           first, ConstantExpr::alloc(i, Expr::Int32))),
+                       result);
+    keep(result);
+  }
+  state.stopTiming();
+  delete solver;
+}
+
+/// The constraints and expressions of the queries read from QueryFiles.
+std::vector< ref<Expr> > corpus;
+
+#ifdef ENABLE_Z3
+void benchZ3Construct(BenchmarkState &state) {
+  if (corpus.empty())
+    return;
+  Z3Builder builder;
+  state.startTiming();
+  for (uint64_t i = 0; i != state.getIterations(); ++i) {
+    // Each construction starts from an empty cache, as a new query does.
+    Z3ASTHandle ast = builder.construct(corpus[i % corpus.size()]);
+    keep((Z3_ast)ast);
+  }
+  state.stopTiming();
+}
+#endif
+
+const Benchmark benchmarks[] = {
+  { "Expr/Create", benchExprCreate },
+  { "Expr/CreateConstantFold", benchExprFold },
+  { "Expr/CreateFloat", benchExprCreateFloat },
+  { "Expr/Compare", benchExprCompare },
+  { "Expr/Hash", benchExprHash },
+  { "Expr/HashMapLookup", benchExprHashMapLookup },
+  { "Memory/ObjectStateConcrete", benchObjectStateConcrete },
+  { "Memory/ObjectStateSymbolic", benchObjectStateSymbolic },
+  { "Memory/ObjectStateSymbolicOffset", benchObjectStateSymbolicOffset },
+  { "Memory/ObjectStateFloat", benchObjectStateFloat },
+  { "Memory/ResolveOne", benchResolveOne },
+  { "Solver/AddConstraint", benchAddConstraint },
+  { "Solver/Independent", benchIndependentSolver },
+  { "Solver/CexCacheHit", benchCexCachingSolverHit },
+  { "Solver/CexCacheMiss", benchCexCachingSolverMiss },
+#ifdef ENABLE_Z3
+  { "Solver/Z3Construct", benchZ3Construct },
+#endif
+};
+
+/// Run \a benchmark with more and more iterations until it takes at least
+/// -min-time seconds, and report the time of one iteration.
+void runBenchmark(const Benchmark &benchmark) {
+  uint64_t iterations = 1;
+  double elapsed;
+  for (;;) {
+    BenchmarkState state(iterations);
+    benchmark.run(state);
+    elapsed = state.getElapsed();
+    if (elapsed >= MinTime || iterations >= (1ULL << 40))
+      break;
+    // Aim a little past the minimum, but grow by at most 100x at once as
+    // the first runs are too short to be measured well.
+    uint64_t next = iterations * 100;
+    if (elapsed > 0)
+      next = std::min<uint64_t>(next, iterations * (MinTime * 1.4 / elapsed)
+                                      + 1);
+    iterations = std::max(next, iterations + 1);
+  }
+
+  char line[128];
+  snprintf(line, sizeof(line), "%-36s %14llu %14.1f ns\n", benchmark.name,
+           (unsigned long long)iterations, elapsed * 1e9 / iterations);
+  llvm::outs() << line;
+  llvm::outs().flush();
+}
+
+bool loadCorpus(const std::string &path, ExprBuilder *builder,
+                std::vector<MemoryBuffer *> &buffers,
+                std::vector<Parser *> &parsers) {
+#if LLVM_VERSION_CODE < LLVM_VERSION(3, 5)
+  OwningPtr<MemoryBuffer> MB;
+  error_code ec = MemoryBuffer::getFileOrSTDIN(path.c_str(), MB);
+  if (ec) {
+    llvm::errs() << path << ": error: " << ec.message() << "\n";
+    return false;
+  }
+  MemoryBuffer *buffer = MB.take();
+#else
+  auto MBResult = MemoryBuffer::getFileOrSTDIN(path.c_str());
+  if (!MBResult) {
+    llvm::errs() << path << ": error: " << MBResult.getError().message()
+                 << "\n";
+    return false;
+  }
+  MemoryBuffer *buffer = MBResult->release();
+#endif
+
+  // The parsers are kept, as they own the arrays the expressions read.
+  buffers.push_back(buffer);
+  Parser *P = Parser::Create(path, buffer, builder, false);
+  parsers.push_back(P);
+  while (Decl *D = P->ParseTopLevelDecl()) {
+    if (QueryCommand *QC = dyn_cast<QueryCommand>(D)) {
+      corpus.insert(corpus.end(), QC->Constraints.begin(),
+                    QC->Constraints.end());
+      corpus.push_back(QC->Query);
+    }
+    delete D;
+  }
+  if (unsigned N = P->GetNumErrors()) {
+    llvm::errs() << path << ": parse failure: " << N << " errors.\n";
+    return false;
+  }
+  return true;
+}
+}
+
+int main(int argc, char **argv) {
+  llvm::sys::PrintStackTraceOnErrorSignal();
+  llvm::cl::SetVersionPrinter(klee::printVersion);
+  llvm::cl::ParseCommandLineOptions(argc, argv, "KLEE microbenchmarks\n");
+
+  const unsigned numBenchmarks = sizeof(benchmarks) / sizeof(benchmarks[0]);
+  if (ListBenchmarks) {
+    for (unsigned i = 0; i != numBenchmarks; ++i)
+      llvm::outs() << benchmarks[i].name << "\n";
+    return 0;
+  }
+
+  ExprBuilder *builder = createDefaultExprBuilder();
+  std::vector<MemoryBuffer *> buffers;
+  std::vector<Parser *> parsers;
+  bool success = true;
+  for (unsigned i = 0; i != QueryFiles.size(); ++i)
+    success &= loadCorpus(QueryFiles[i], builder, buffers, parsers);
+
+  if (success) {
+    llvm::outs() << "benchmark                            iterations"
+                    "           time\n";
+    for (unsigned i = 0; i != numBenchmarks; ++i)
+      if (StringRef(benchmarks[i].name).find(Filter) != StringRef::npos)
+        runBenchmark(benchmarks[i]);
+  }
+
+  corpus.clear();
+  for (unsigned i = 0; i != parsers.size(); ++i)
+    delete parsers[i];
+  for (unsigned i = 0; i != buffers.size(); ++i)
+    delete buffers[i];
+  delete builder;
+  llvm::llvm_shutdown();
+  return success ? 0 : 1;
+}
@@ -20,9 +20,11 @@
 #include <getopt.h>
 
 #include <errno.h>
+#include <poll.h>
 #include <time.h>
 #include <unistd.h>
 #include <sys/signal.h>
+#include <sys/time.h>
 #include <sys/wait.h>
 
 #ifdef HAVE_SYS_CAPABILITY_H
@@ -39,9 +41,11 @@ static unsigned monitored_pid = 0;
 static unsigned monitored_timeout;
 
 static char *rootdir = NULL;
+static char *fork_server_results = NULL;
 static struct option long_options[] = {
   {"create-files-only", required_argument, 0, 'f'},
   {"chroot-to-dir", required_argument, 0, 'r'},
+  {"fork-server", required_argument, 0, 's'},
   {"help", no_argument, 0, 'h'},
   {0, 0, 0, 0},
 };
@@ -244,17 +248,275 @@ void ensure_capsyschroot(const char *executable) {
 }
 #endif
 
+/* Fork server mode, for programs linked against libkleeRuntest: the
+   program is started once and forks a child per test before entering main
+   (see fork_server() in runtime/Runtest/intrinsics.c). Each test is written
+   to a file which the child maps, and the result of each test goes to a
+   single results file. */
+static struct {
+  pid_t pid;
+  int command_fd, status_fd;
+  FILE *input;
+  FILE *results;
+  unsigned num_tests;
+} fork_server;
+
+/* Reads n bytes from the fork server, giving up after timeout seconds if
+   timeout is not 0. Returns 1 on success, 0 on failure and -1 on timeout. */
+static int fork_server_read(void *buf, size_t n, unsigned timeout) {
+  char *p = buf;
+  while (n) {
+    ssize_t res;
+    if (timeout) {
+      struct pollfd pfd = { fork_server.status_fd, POLLIN, 0 };
+      int ready = poll(&pfd, 1, timeout * 1000);
+      if (ready < 0 && errno == EINTR)
+        continue;
+      if (ready == 0)
+        return -1;
+      if (ready < 0)
+        return 0;
+    }
+    res = read(fork_server.status_fd, p, n);
+    if (res < 0 && errno == EINTR)
+      continue;
+    if (res <= 0)
+      return 0;
+    p += res;
+    n -= res;
+  }
+  return 1;
+}
+
+static void fork_server_start(char *executable) {
+  int command[2], status[2];
+  int32_t hello;
+  char env[64];
+  char *argv[] = { executable, 0 };
+
+  if (pipe(command) < 0 || pipe(status) < 0) {
+    perror("pipe");
+    exit(1);
+  }
+  sprintf(env, "%d,%d,%d", command[0], status[1], fileno(fork_server.input));
+
+  fork_server.pid = fork();
+  if (fork_server.pid < 0) {
+    perror("fork");
+    exit(1);
+  } else if (fork_server.pid == 0) {
+    close(command[1]);
+    close(status[0]);
+    setenv("KLEE_REPLAY_FORK_SERVER", env, 1);
+    execv(executable, argv);
+    perror("execv");
+    _exit(66);
+  }
+
+  close(command[0]);
+  close(status[1]);
+  fork_server.command_fd = command[1];
+  fork_server.status_fd = status[0];
+  if (fork_server_read(&hello, sizeof hello, monitored_timeout) != 1) {
+    fprintf(stderr, "%s: error: %s does not run a fork server; is it linked "
+            "against libkleeRuntest?\n", progname, executable);
+    exit(1);
+  }
+}
+
+static void fork_server_stop(void) {
+  int status;
+  close(fork_server.command_fd);
+  close(fork_server.status_fd);
+  while (waitpid(fork_server.pid, &status, 0) < 0 && errno == EINTR)
+    ;
+}
+
+/* Replay the test in input through the fork server, restarting the server
+   if it fails. */
+static void fork_server_replay(char *executable, const char *input_fname,
+                               const char *test_name) {
+  uint32_t size;
+  int32_t pid, status;
+  struct timeval start, end;
+  int res;
+
+  rewind(fork_server.input);
+  if (!kTest_toStream(input, fork_server.input) ||
+      fflush(fork_server.input) != 0) {
+    fprintf(stderr, "%s: error: unable to write test input.\n", progname);
+    exit(1);
+  }
+  size = ftell(fork_server.input);
+
+  fprintf(fork_server.results, "%s%s%s: ", input_fname, test_name ? ":" : "",
+          test_name ? test_name : "");
+  ++fork_server.num_tests;
+
+  gettimeofday(&start, 0);
+  if (write(fork_server.command_fd, &size, sizeof size) != sizeof size ||
+      fork_server_read(&pid, sizeof pid, 0) != 1) {
+    fprintf(fork_server.results, "EXIT STATUS: NONE (fork server failed)\n");
+    fork_server_stop();
+    fork_server_start(executable);
+    return;
+  }
+
+  res = fork_server_read(&status, sizeof status, monitored_timeout);
+  if (res == -1) {
+    kill(pid, SIGKILL);
+    res = fork_server_read(&status, sizeof status, 0);
+    if (res == 1) {
+      fprintf(fork_server.results, "EXIT STATUS: TIMED OUT (%d seconds)\n",
+              monitored_timeout);
+      return;
+    }
+  }
+  if (res != 1) {
+    fprintf(fork_server.results, "EXIT STATUS: NONE (fork server failed)\n");
+    fork_server_stop();
+    fork_server_start(executable);
+    return;
+  }
+  gettimeofday(&end, 0);
+
+  double elapsed = (end.tv_sec - start.tv_sec) +
+                   (end.tv_usec - start.tv_usec) / 1000000.0;
+  if (WIFSIGNALED(status)) {
+    fprintf(fork_server.results, "EXIT STATUS: CRASHED signal %d (%.6f "
+            "seconds)\n", WTERMSIG(status), elapsed);
+  } else if (WIFEXITED(status) && WEXITSTATUS(status) == 0) {
+    fprintf(fork_server.results, "EXIT STATUS: NORMAL (%.6f seconds)\n",
+            elapsed);
+  } else if (WIFEXITED(status)) {
+    fprintf(fork_server.results, "EXIT STATUS: ABNORMAL %d (%.6f seconds)\n",
+            WEXITSTATUS(status), elapsed);
+  } else {
+    fprintf(fork_server.results, "EXIT STATUS: NONE (%.6f seconds)\n",
+            elapsed);
+  }
+}
+
+static void fork_server_init(char *executable) {
+  const char *tmpdir = getenv("TMPDIR");
+  char path[4096];
+  int fd;
+
+  const char *t = getenv("KLEE_REPLAY_TIMEOUT");
+  monitored_timeout = t ? atoi(t) : 0;
+
+  snprintf(path, sizeof path, "%s/klee-replay-input.XXXXXX",
+           tmpdir ? tmpdir : "/tmp");
+  fd = mkstemp(path);
+  if (fd < 0 || !(fork_server.input = fdopen(fd, "w+b"))) {
+    perror("mkstemp");
+    exit(1);
+  }
+  unlink(path);
+
+  fork_server.results = fopen(fork_server_results, "w");
+  if (!fork_server.results) {
+    fprintf(stderr, "%s: error: cannot open %s\n", progname,
+            fork_server_results);
+    exit(1);
+  }
+
+  /* A dying server is detected when reading from it. */
+  signal(SIGPIPE, SIG_IGN);
+  fork_server_start(executable);
+}
+
+static void fork_server_finish(void) {
+  fork_server_stop();
+  fclose(fork_server.input);
+  fclose(fork_server.results);
+  fprintf(stderr, "%s: replayed %u tests, results are in %s\n", progname,
+          fork_server.num_tests, fork_server_results);
+}
+
 static void usage(void) {
-  fprintf(stderr, "Usage: %s [option]... <executable> <ktest-file>...\n", progname);
+  fprintf(stderr, "Usage: %s [option]... <executable> <ktest-file|kpack-file>...\n", progname);
   fprintf(stderr, "   or: %s --create-files-only <ktest-file>\n", progname);
   fprintf(stderr, "\n");
   fprintf(stderr, "-r, --chroot-to-dir=DIR  use chroot jail, requires CAP_SYS_CHROOT\n");
+  fprintf(stderr, "-s, --fork-server=FILE   run a program linked against libkleeRuntest\n");
+  fprintf(stderr, "                         once, forking it for each test, and write\n");
+  fprintf(stderr, "                         the results to FILE\n");
   fprintf(stderr, "-h, --help               display this help and exit\n");
   fprintf(stderr, "\n");
   fprintf(stderr, "Use KLEE_REPLAY_TIMEOUT environment variable to set a timeout (in seconds).\n");
   exit(1);
 }
 
+/* Replay the test in input, which is test_name in input_fname or, if
+   test_name is NULL, all of input_fname. */
+static void replay_test(char *executable, char *prg_name,
+                        const char *input_fname, const char *test_name) {
+  static int first = 1;
+  int prg_argc;
+  char ** prg_argv;
+  char *arg0 = input->args[0];
+  unsigned i;
+
+  obj_index = 0;
+  prg_argc = input->numArgs;
+  prg_argv = input->args;
+  prg_argv[0] = prg_name;
+  klee_init_env(&prg_argc, &prg_argv);
+
+  if (!first)
+    fprintf(stderr, "\n");
+  first = 0;
+  if (test_name)
+    fprintf(stderr, "%s: TEST CASE: %s:%s\n", progname, input_fname, test_name);
+  else
+    fprintf(stderr, "%s: TEST CASE: %s\n", progname, input_fname);
+  fprintf(stderr, "%s: ARGS: ", progname);
+  for (i=0; i != (unsigned) prg_argc; ++i) {
+    char *s = prg_argv[i];
+    if (s[0]=='A' && s[1] && !s[2]) s[1] = '\0';
+    fprintf(stderr, "\"%s\" ", prg_argv[i]); 
+  }
+  fprintf(stderr, "\n");
+
+  /* Run the test case machinery in a subprocess, eventually this parent
+     process should be a script or something which shells out to the actual
+     execution tool. */
+  int pid = fork();
+  if (pid < 0) {
+    perror("fork");
+    _exit(66);
+  } else if (pid == 0) {
+    /* Create the input files, pipes, etc., and run the process. */
+    replay_create_files(&__exe_fs);
+    run_monitored(executable, prg_argc, prg_argv);
+    _exit(0);
+  } else {
+    /* Wait for the test case. */
+    int res, status;
+
+    do {
+      res = waitpid(pid, &status, 0);
+    } while (res < 0 && errno == EINTR);
+    
+    if (res < 0) {
+      perror("waitpid");
+      _exit(66);
+    }
+  }
+
+  /* so that the test can be freed */
+  input->args[0] = arg0;
+}
+
+static void run_test(char *executable, char *prg_name,
+                     const char *input_fname, const char *test_name) {
+  if (fork_server_results)
+    fork_server_replay(executable, input_fname, test_name);
+  else
+    replay_test(executable, prg_name, input_fname, test_name);
+}
+
 int main(int argc, char** argv) {
   int prg_argc;
   char ** prg_argv;  
@@ -265,7 +527,7 @@ int main(int argc, char** argv) {
     usage();
 
   int c, opt_index;
-  while ((c = getopt_long(argc, argv, "f:r:", long_options, &opt_index)) != -1) {
+  while ((c = getopt_long(argc, argv, "f:r:s:", long_options, &opt_index)) != -1) {
     switch (c) {
       case 'f': {
         /* Special case hack for only creating files and not actually executing
@@ -294,6 +556,9 @@ int main(int argc, char** argv) {
       case 'r':
         rootdir = optarg;
         break;
+      case 's':
+        fork_server_results = optarg;
+        break;
     }
   }
 
@@ -307,6 +572,11 @@ int main(int argc, char** argv) {
     ensure_capsyschroot(progname);
 #endif
   
+  if (rootdir && fork_server_results) {
+    fprintf(stderr, "Error: --fork-server cannot be used with --chroot-to-dir.\n");
+    exit(1);
+  }
+
   /* rootdir should be a prefix of executable's path. */
   if (rootdir && strstr(executable, rootdir) != executable) {
     fprintf(stderr, "Error: chroot: root dir should be a parent dir of executable.\n");
@@ -321,62 +591,48 @@ int main(int argc, char** argv) {
   }
   fclose(f);
 
+  if (fork_server_results)
+    fork_server_init(executable);
+
   int idx = 0;
   for (idx = optind + 1; idx != argc; ++idx) {
     char* input_fname = argv[idx];
-    unsigned i;
-    
+
+    if (kTest_isKTestPack(input_fname)) {
+      KTestPackReader *pack = kTestPack_open(input_fname);
+      unsigned i, e;
+      if (!pack) {
+        fprintf(stderr, "%s: error: input file %s not valid.\n", progname,
+                input_fname);
+        exit(1);
+      }
+      for (i = 0, e = kTestPack_numTests(pack); i != e; ++i) {
+        input = kTestPack_get(pack, i);
+        if (!input) {
+          fprintf(stderr, "%s: error: test %s in %s not valid.\n", progname,
+                  kTestPack_getName(pack, i), input_fname);
+          exit(1);
+        }
+        run_test(executable, argv[optind], input_fname,
+                 kTestPack_getName(pack, i));
+        kTest_free(input);
+      }
+      kTestPack_free(pack);
+      continue;
+    }
+
     input = kTest_fromFile(input_fname);
     if (!input) {
       fprintf(stderr, "%s: error: input file %s not valid.\n", progname, 
               input_fname);
       exit(1);
     }
-    
-    obj_index = 0;
-    prg_argc = input->numArgs;
-    prg_argv = input->args;
-    prg_argv[0] = argv[optind];
-    klee_init_env(&prg_argc, &prg_argv);
-
-    if (idx > 2)
-      fprintf(stderr, "\n");
-    fprintf(stderr, "%s: TEST CASE: %s\n", progname, input_fname);
-    fprintf(stderr, "%s: ARGS: ", progname);
-    for (i=0; i != (unsigned) prg_argc; ++i) {
-      char *s = prg_argv[i];
-      if (s[0]=='A' && s[1] && !s[2]) s[1] = '\0';
-      fprintf(stderr, "\"%s\" ", prg_argv[i]); 
-    }
-    fprintf(stderr, "\n");
-
-    /* Run the test case machinery in a subprocess, eventually this parent
-       process should be a script or something which shells out to the actual
-       execution tool. */
-    int pid = fork();
-    if (pid < 0) {
-      perror("fork");
-      _exit(66);
-    } else if (pid == 0) {
-      /* Create the input files, pipes, etc., and run the process. */
-      replay_create_files(&__exe_fs);
-      run_monitored(executable, prg_argc, prg_argv);
-      _exit(0);
-    } else {
-      /* Wait for the test case. */
-      int res, status;
-
-      do {
-        res = waitpid(pid, &status, 0);
-      } while (res < 0 && errno == EINTR);
-      
-      if (res < 0) {
-        perror("waitpid");
-        _exit(66);
-      }
-    }
+    run_test(executable, argv[optind], input_fname, NULL);
   }
 
+  if (fork_server_results)
+    fork_server_finish();
+
   return 0;
 }
 
@@ -0,0 +1,937 @@
+//===-- main.cpp ------------------------------------------------*- C++ -*-===//
+//
+//                     The KLEE Symbolic Virtual Machine
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+//
+// klee-summary scans many KLEE output directories at once and summarizes
+// them as JSON: their test cases and errors, the last line of their
+// statistics and the totals of their instruction statistics, then the
+// totals over all of them. It reads the text and binary statistics formats
+// (see -stats-format), and can merge the instruction statistics of runs of
+// the same program into one run.istats for KCachegrind, as
+// scripts/IStatsMerge.py does.
+//
+// The directories are scanned in parallel, by -j threads, with their files
+// mapped rather than read.
+//
+//===----------------------------------------------------------------------===//
+
+#include "klee/Config/Version.h"
+#include "klee/Internal/ADT/KTest.h"
+#include "klee/Internal/Support/PrintVersion.h"
+
+#include "llvm/Support/CommandLine.h"
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/Format.h"
+#include "llvm/Support/ManagedStatic.h"
+#include "llvm/Support/Signals.h"
+#include "llvm/Support/raw_ostream.h"
+
+#include <algorithm>
+#include <map>
+#include <string>
+#include <vector>
+
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <math.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+using namespace llvm;
+using namespace klee;
+
+namespace {
+  cl::list<std::string>
+  Directories(cl::desc("<klee output directories>"), cl::Positional,
+              cl::OneOrMore);
+
+  cl::opt<unsigned>
+  Jobs("j",
+       cl::desc("Number of directories scanned at once, 0 for one per "
+                "processor (default=0)"),
+       cl::init(0));
+
+  cl::opt<bool>
+  ListTests("tests",
+            cl::desc("List the objects of every test case, with those of 4 "
+                     "and 8 bytes also as floating-point values "
+                     "(default=off)"));
+
+  cl::opt<std::string>
+  MergeIStats("merge-istats",
+              cl::desc("Write the merged instruction statistics of the "
+                       "directories whose program is that of the first one "
+                       "to this file, in the callgrind format "
+                       "(default=off)"),
+              cl::value_desc("file"));
+}
+
+/***/
+
+namespace {
+  /// MappedFile - A file mapped read-only into memory.
+  class MappedFile {
+    void *data;
+    size_t size;
+
+    MappedFile(const MappedFile &);
+    void operator=(const MappedFile &);
+
+  public:
+    MappedFile() : data(0), size(0) {}
+    ~MappedFile() {
+      if (data)
+        munmap(data, size);
+    }
+
+    /// open - Map \a path, returning false if it cannot be.
+    bool open(const std::string &path) {
+      int fd = ::open(path.c_str(), O_RDONLY);
+      if (fd < 0)
+        return false;
+      struct stat st;
+      if (fstat(fd, &st) < 0) {
+        close(fd);
+        return false;
+      }
+      size = st.st_size;
+      if (size) {
+        data = mmap(0, size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (data == MAP_FAILED) {
+          data = 0;
+          size = 0;
+          close(fd);
+          return false;
+        }
+      }
+      close(fd);
+      return true;
+    }
+
+    const char *begin() const { return (const char *) data; }
+    const char *end() const { return (const char *) data + size; }
+    size_t getSize() const { return size; }
+  };
+
+  /// BinaryReader - Reads the little endian values of a binary statistics
+  /// file (see StatsTracker). Reads past the end fail, and leave the reader
+  /// failed.
+  class BinaryReader {
+    const unsigned char *pos, *end;
+    bool failed;
+
+    bool take(size_t n) {
+      if (failed || (size_t) (end - pos) < n)
+        failed = true;
+      return !failed;
+    }
+
+  public:
+    BinaryReader(const char *begin, const char *_end)
+      : pos((const unsigned char *) begin),
+        end((const unsigned char *) _end), failed(false) {}
+
+    bool atEnd() const { return pos == end; }
+    bool ok() const { return !failed; }
+    const char *position() const { return (const char *) pos; }
+
+    uint8_t read8() {
+      if (!take(1))
+        return 0;
+      return *pos++;
+    }
+
+    uint32_t read32() {
+      if (!take(4))
+        return 0;
+      uint32_t v = 0;
+      for (unsigned i = 0; i != 4; ++i)
+        v |= (uint32_t) *pos++ << (8 * i);
+      return v;
+    }
+
+    uint64_t read64() {
+      if (!take(8))
+        return 0;
+      uint64_t v = 0;
+      for (unsigned i = 0; i != 8; ++i)
+        v |= (uint64_t) *pos++ << (8 * i);
+      return v;
+    }
+
+    double readDouble() {
+      uint64_t bits = read64();
+      double v;
+      memcpy(&v, &bits, sizeof v);
+      return v;
+    }
+
+    std::string readString() {
+      uint32_t n = read32();
+      if (!take(n))
+        return "";
+      std::string s((const char *) pos, n);
+      pos += n;
+      return s;
+    }
+  };
+
+  /// StatsColumn - A column of the last line of run.stats.
+  struct StatsColumn {
+    std::string name;
+    bool isTime;
+    uint64_t count;
+    double time;
+  };
+
+  /// IStatsRow - The statistics of an instruction in run.istats.
+  struct IStatsRow {
+    unsigned file, function;
+    uint32_t assemblyLine, line;
+    std::vector<uint64_t> values;
+  };
+
+  /// IStats - The last instruction statistics of a run, without those of
+  /// call sites.
+  struct IStats {
+    std::string command, objectFile;
+    /// The short and long names of the events.
+    std::vector<std::pair<std::string, std::string> > events;
+    std::vector<std::string> files, functions;
+    std::vector<IStatsRow> rows;
+
+    int getEvent(const std::string &name) const {
+      for (unsigned i = 0; i != events.size(); ++i)
+        if (events[i].second == name)
+          return i;
+      return -1;
+    }
+  };
+
+  /// DirSummary - What was found in an output directory.
+  struct DirSummary {
+    std::string path;
+    /// The problems reading the directory, which are otherwise skipped.
+    std::vector<std::string> problems;
+
+    uint64_t tests, objects, objectBytes;
+    /// The errors by kind, from the names of the test<N>.<kind>.err files.
+    std::map<std::string, uint64_t> errors;
+    /// The test cases, in JSON, with -tests.
+    std::string testCases;
+
+    std::vector<StatsColumn> stats;
+    bool hasIStats;
+    IStats istats;
+
+    DirSummary() : tests(0), objects(0), objectBytes(0), hasIStats(false) {}
+  };
+}
+
+/***/
+
+static bool endsWith(const std::string &s, const char *suffix) {
+  size_t n = strlen(suffix);
+  return s.size() >= n && s.compare(s.size() - n, n, suffix) == 0;
+}
+
+static void writeJSONString(raw_ostream &os, const std::string &s) {
+  os << '"';
+  for (std::string::const_iterator it = s.begin(), ie = s.end(); it != ie;
+       ++it) {
+    unsigned char c = *it;
+    if (c == '"' || c == '\\')
+      os << '\\' << (char) c;
+    else if (c == '\n')
+      os << "\\n";
+    else if (c < 0x20)
+      os << format("\\u%04x", c);
+    else
+      os << (char) c;
+  }
+  os << '"';
+}
+
+/// Write \a v as a JSON number, or as a string if it is not finite, which
+/// JSON has no numbers for.
+static void writeJSONDouble(raw_ostream &os, double v) {
+  if (isnan(v))
+    os << "\"nan\"";
+  else if (isinf(v))
+    os << (v < 0 ? "\"-inf\"" : "\"inf\"");
+  else
+    os << format("%.17g", v);
+}
+
+/// Write the objects of \a test, as a JSON array, to \a os.
+static void writeTestObjects(raw_ostream &os, const KTest *test) {
+  os << "[";
+  for (unsigned i = 0; i != test->numObjects; ++i) {
+    const KTestObject &o = test->objects[i];
+    os << (i ? ", " : "") << "{\"name\": ";
+    writeJSONString(os, o.name);
+    os << ", \"size\": " << o.numBytes << ", \"hex\": \"";
+    for (unsigned j = 0; j != o.numBytes; ++j)
+      os << format("%02x", o.bytes[j]);
+    os << "\"";
+    // The objects hold the bytes of the host, which is that of the run.
+    if (o.numBytes == 4) {
+      int32_t i32;
+      float f;
+      memcpy(&i32, o.bytes, 4);
+      memcpy(&f, o.bytes, 4);
+      os << ", \"int\": " << i32 << ", \"float\": ";
+      writeJSONDouble(os, f);
+    } else if (o.numBytes == 8) {
+      int64_t i64;
+      double d;
+      memcpy(&i64, o.bytes, 8);
+      memcpy(&d, o.bytes, 8);
+      os << ", \"int\": " << i64 << ", \"double\": ";
+      writeJSONDouble(os, d);
+    }
+    os << "}";
+  }
+  os << "]";
+}
+
+static void addTest(DirSummary &summary, raw_ostream &testCases,
+                    const std::string &name, const KTest *test) {
+  ++summary.tests;
+  summary.objects += test->numObjects;
+  summary.objectBytes += kTest_numBytes(const_cast<KTest *>(test));
+  if (ListTests) {
+    testCases << (summary.tests == 1 ? "" : ", ") << "{\"name\": ";
+    writeJSONString(testCases, name);
+    testCases << ", \"objects\": ";
+    writeTestObjects(testCases, test);
+    testCases << "}";
+  }
+}
+
+/// Read the .ktest file \a name of \a summary, through a stream over its
+/// mapping.
+static void scanKTest(DirSummary &summary, raw_ostream &testCases,
+                      const std::string &name) {
+  std::string path = summary.path + "/" + name;
+  MappedFile file;
+  KTest *test = 0;
+  if (file.open(path) && file.getSize()) {
+    FILE *f = fmemopen(const_cast<char *>(file.begin()), file.getSize(),
+                       "rb");
+    if (f) {
+      test = kTest_fromStream(f);
+      fclose(f);
+    }
+  }
+  if (!test) {
+    summary.problems.push_back("unable to read " + path);
+    return;
+  }
+  addTest(summary, testCases, name, test);
+  kTest_free(test);
+}
+
+static void scanKTestPack(DirSummary &summary, raw_ostream &testCases,
+                          const std::string &name) {
+  std::string path = summary.path + "/" + name;
+  KTestPackReader *pack = kTestPack_open(path.c_str());
+  if (!pack) {
+    summary.problems.push_back("unable to read " + path);
+    return;
+  }
+  for (unsigned i = 0, e = kTestPack_numTests(pack); i != e; ++i) {
+    KTest *test = kTestPack_get(pack, i);
+    if (!test) {
+      summary.problems.push_back("unable to read a test of " + path);
+      continue;
+    }
+    addTest(summary, testCases, name + ":" + kTestPack_getName(pack, i),
+            test);
+    kTest_free(test);
+  }
+  kTestPack_free(pack);
+}
+
+/// Read the last complete line of the binary run.stats.bin.
+static bool readBinaryStats(const MappedFile &file,
+                            std::vector<StatsColumn> &stats) {
+  BinaryReader r(file.begin(), file.end());
+  if (file.getSize() < 4 || memcmp(file.begin(), "KSTB", 4) != 0)
+    return false;
+  r.read32();
+  r.read32(); // version
+  for (;;) {
+    uint8_t type = r.read8();
+    if (!r.ok())
+      return false;
+    if (type == 0)
+      break;
+    StatsColumn c;
+    c.name = r.readString();
+    c.isTime = type == 'F';
+    c.count = 0;
+    c.time = 0;
+    stats.push_back(c);
+  }
+  if (!r.ok())
+    return false;
+
+  // The lines have a fixed size, the last one may still be being written.
+  size_t lineSize = 8 * stats.size();
+  size_t rest = file.end() - r.position();
+  if (!lineSize || rest < lineSize)
+    return true;
+  const char *last = r.position() + (rest / lineSize - 1) * lineSize;
+  BinaryReader line(last, last + lineSize);
+  for (std::vector<StatsColumn>::iterator it = stats.begin(),
+         ie = stats.end(); it != ie; ++it) {
+    if (it->isTime)
+      it->time = line.readDouble();
+    else
+      it->count = line.read64();
+  }
+  return true;
+}
+
+/// Read the last line of the text run.stats, in which each line is a
+/// Python tuple. The columns of times are those named so.
+static bool readTextStats(const MappedFile &file,
+                          std::vector<StatsColumn> &stats) {
+  const char *begin = file.begin(), *end = file.end();
+  const char *headerEnd = std::find(begin, end, '\n');
+  if (begin == end || *begin != '(' || headerEnd == end)
+    return false;
+  for (const char *p = begin; p != headerEnd; ++p) {
+    if (*p != '\'')
+      continue;
+    const char *nameEnd = std::find(p + 1, headerEnd, '\'');
+    StatsColumn c;
+    c.name.assign(p + 1, nameEnd);
+    c.isTime = endsWith(c.name, "Time");
+    c.count = 0;
+    c.time = 0;
+    stats.push_back(c);
+    p = nameEnd == headerEnd ? nameEnd - 1 : nameEnd;
+  }
+
+  // Only complete lines are read.
+  const char *lastEnd = end;
+  while (lastEnd != headerEnd + 1 && lastEnd[-1] != '\n')
+    --lastEnd;
+  if (lastEnd == headerEnd + 1)
+    return true;
+  const char *last = lastEnd - 1;
+  while (last != headerEnd + 1 && last[-1] != '\n')
+    --last;
+  std::string line(last, lastEnd - 1);
+  const char *p = line.c_str();
+  if (*p++ != '(')
+    return false;
+  for (std::vector<StatsColumn>::iterator it = stats.begin(),
+         ie = stats.end(); it != ie; ++it) {
+    char *next;
+    if (it->isTime)
+      it->time = strtod(p, &next);
+    else
+      it->count = strtoull(p, &next, 10);
+    if (next == p)
+      return false;
+    p = next + 1;
+  }
+  return true;
+}
+
+static unsigned internName(std::map<std::string, unsigned> &ids,
+                           std::vector<std::string> &names,
+                           const std::string &name) {
+  std::map<std::string, unsigned>::iterator it = ids.find(name);
+  if (it != ids.end())
+    return it->second;
+  ids.insert(std::make_pair(name, (unsigned) names.size()));
+  names.push_back(name);
+  return names.size() - 1;
+}
+
+/// Read the last complete snapshot of the binary run.istats.bin.
+static bool readBinaryIStats(const MappedFile &file, IStats &istats) {
+  if (file.getSize() < 4 || memcmp(file.begin(), "KISB", 4) != 0)
+    return false;
+  BinaryReader r(file.begin() + 4, file.end());
+  r.read32(); // version
+  r.read32(); // pid
+  istats.command = r.readString();
+  istats.objectFile = r.readString();
+  for (uint32_t i = 0, e = r.read32(); i != e && r.ok(); ++i) {
+    std::string shortName = r.readString();
+    istats.events.push_back(std::make_pair(shortName, r.readString()));
+  }
+  for (uint32_t i = 0, e = r.read32(); i != e && r.ok(); ++i)
+    istats.files.push_back(r.readString());
+  for (uint32_t i = 0, e = r.read32(); i != e && r.ok(); ++i) {
+    istats.functions.push_back(r.readString());
+    r.read32(); // file
+    r.read32(); // assembly line
+    r.read32(); // line
+  }
+  unsigned nEvents = istats.events.size();
+  for (uint32_t i = 0, e = r.read32(); i != e && r.ok(); ++i) {
+    IStatsRow row;
+    row.function = r.read32();
+    row.file = r.read32();
+    row.assemblyLine = r.read32();
+    row.line = r.read32();
+    row.values.assign(nEvents, 0);
+    istats.rows.push_back(row);
+  }
+  if (!r.ok())
+    return false;
+
+  // The snapshots are applied once read completely, the last one may still
+  // be being written.
+  std::vector<std::pair<std::pair<uint32_t, uint32_t>, uint64_t> > changes;
+  while (!r.atEnd()) {
+    if (r.read8() != 'S')
+      return r.ok();
+    r.readDouble();
+    changes.clear();
+    for (uint32_t i = 0, e = r.read32(); i != e && r.ok(); ++i) {
+      uint32_t id = r.read32();
+      uint32_t event = r.read32();
+      changes.push_back(std::make_pair(std::make_pair(id, event),
+                                       r.read64()));
+    }
+    for (uint32_t i = 0, e = r.read32(); i != e && r.ok(); ++i) {
+      r.read32();
+      r.read32();
+      for (unsigned j = 0; j != nEvents + 1; ++j)
+        r.read64();
+    }
+    if (!r.ok())
+      break;
+    for (unsigned i = 0; i != changes.size(); ++i) {
+      uint32_t id = changes[i].first.first, event = changes[i].first.second;
+      if (id < istats.rows.size() && event < nEvents)
+        istats.rows[id].values[event] = changes[i].second;
+    }
+  }
+  return true;
+}
+
+/// Read the text run.istats, in the callgrind format, skipping the costs
+/// of calls.
+static bool readTextIStats(const MappedFile &file, IStats &istats) {
+  std::map<std::string, unsigned> fileIds, functionIds;
+  unsigned fileId = internName(fileIds, istats.files, "");
+  unsigned functionId = internName(functionIds, istats.functions, "");
+  bool skipCost = false;
+  const char *p = file.begin(), *end = file.end();
+  while (p != end) {
+    const char *lineEnd = std::find(p, end, '\n');
+    // The last line may still be being written.
+    if (lineEnd == end)
+      break;
+    std::string line(p, lineEnd);
+    p = lineEnd + 1;
+
+    if (line.empty())
+      continue;
+    if (isdigit((unsigned char) line[0])) {
+      if (skipCost) {
+        skipCost = false;
+        continue;
+      }
+      IStatsRow row;
+      row.file = fileId;
+      row.function = functionId;
+      const char *s = line.c_str();
+      char *next;
+      row.assemblyLine = strtoul(s, &next, 10);
+      row.line = strtoul(next, &next, 10);
+      for (unsigned i = 0; i != istats.events.size(); ++i)
+        row.values.push_back(strtoull(next, &next, 10));
+      istats.rows.push_back(row);
+    } else if (line.compare(0, 3, "fl=") == 0) {
+      fileId = internName(fileIds, istats.files, line.substr(3));
+    } else if (line.compare(0, 3, "fn=") == 0) {
+      functionId = internName(functionIds, istats.functions, line.substr(3));
+    } else if (line.compare(0, 6, "calls=") == 0) {
+      skipCost = true;
+    } else if (line.compare(0, 3, "ob=") == 0) {
+      istats.objectFile = line.substr(3);
+    } else if (line.compare(0, 5, "cmd: ") == 0) {
+      istats.command = line.substr(5);
+    } else if (line.compare(0, 7, "event: ") == 0) {
+      std::string::size_type colon = line.find(" : ");
+      if (colon == std::string::npos)
+        return false;
+      istats.events.push_back(std::make_pair(
+          line.substr(7, colon - 7), line.substr(colon + 3)));
+    }
+  }
+  return true;
+}
+
+/// Summarize the output directory of \a summary, whose path is set.
+static void scanDirectory(DirSummary &summary) {
+  DIR *d = opendir(summary.path.c_str());
+  if (!d) {
+    summary.problems.push_back("unable to open " + summary.path + ": " +
+                               strerror(errno));
+    return;
+  }
+  std::vector<std::string> names;
+  while (struct dirent *entry = readdir(d))
+    names.push_back(entry->d_name);
+  closedir(d);
+  std::sort(names.begin(), names.end());
+
+  raw_string_ostream testCases(summary.testCases);
+  for (std::vector<std::string>::iterator it = names.begin(),
+         ie = names.end(); it != ie; ++it) {
+    const std::string &name = *it;
+    if (endsWith(name, ".ktest")) {
+      scanKTest(summary, testCases, name);
+    } else if (endsWith(name, ".kpack")) {
+      scanKTestPack(summary, testCases, name);
+    } else if (endsWith(name, ".err")) {
+      std::string::size_type dot = name.find('.');
+      std::string kind = name.substr(dot + 1, name.size() - dot - 5);
+      ++summary.errors[kind];
+    }
+  }
+  testCases.flush();
+
+  MappedFile stats;
+  if (stats.open(summary.path + "/run.stats")) {
+    if (!readTextStats(stats, summary.stats))
+      summary.problems.push_back("invalid run.stats");
+  } else if (stats.open(summary.path + "/run.stats.bin")) {
+    if (!readBinaryStats(stats, summary.stats))
+      summary.problems.push_back("invalid run.stats.bin");
+  }
+
+  MappedFile istats;
+  if (istats.open(summary.path + "/run.istats")) {
+    summary.hasIStats = readTextIStats(istats, summary.istats);
+    if (!summary.hasIStats)
+      summary.problems.push_back("invalid run.istats");
+  } else if (istats.open(summary.path + "/run.istats.bin")) {
+    summary.hasIStats = readBinaryIStats(istats, summary.istats);
+    if (!summary.hasIStats)
+      summary.problems.push_back("invalid run.istats.bin");
+  }
+}
+
+namespace {
+  struct ScanWork {
+    std::vector<DirSummary> *summaries;
+    unsigned next;
+  };
+}
+
+static void *scanDirectories(void *arg) {
+  ScanWork *work = static_cast<ScanWork *>(arg);
+  for (;;) {
+    unsigned i = __sync_fetch_and_add(&work->next, 1);
+    if (i >= work->summaries->size())
+      return 0;
+    scanDirectory((*work->summaries)[i]);
+  }
+}
+
+/***/
+
+/// Whether \a b is the instruction statistics of the program of \a a.
+static bool isSameProgram(const IStats &a, const IStats &b) {
+  if (a.events != b.events || a.rows.size() != b.rows.size())
+    return false;
+  for (unsigned i = 0; i != a.rows.size(); ++i)
+    if (a.rows[i].assemblyLine != b.rows[i].assemblyLine ||
+        a.files[a.rows[i].file] != b.files[b.rows[i].file])
+      return false;
+  return true;
+}
+
+/// Merge \a from into \a into, a run of the same program: an instruction
+/// is covered if either run covered it, and its distance to uncovered code
+/// is the smallest of both. The other events are added.
+static void mergeIStats(IStats &into, const IStats &from) {
+  int covered = into.getEvent("CoveredInstructions");
+  int uncovered = into.getEvent("UncoveredInstructions");
+  int distance = into.getEvent("MinDistToUncovered");
+  for (unsigned i = 0; i != into.rows.size(); ++i) {
+    std::vector<uint64_t> &values = into.rows[i].values;
+    const std::vector<uint64_t> &fromValues = from.rows[i].values;
+    for (unsigned j = 0; j != values.size(); ++j) {
+      if ((int) j == covered)
+        values[j] = std::max(values[j], fromValues[j]);
+      else if ((int) j == uncovered || (int) j == distance)
+        values[j] = std::min(values[j], fromValues[j]);
+      else
+        values[j] += fromValues[j];
+    }
+  }
+}
+
+static void writeCallgrind(raw_ostream &os, const IStats &istats) {
+  os << "version: 1\ncreator: klee-summary\n";
+  os << "cmd: " << istats.command << "\n\n\n";
+  os << "positions: instr line\n";
+  for (unsigned i = 0; i != istats.events.size(); ++i)
+    os << "event: " << istats.events[i].first << " : "
+       << istats.events[i].second << "\n";
+  os << "events: ";
+  for (unsigned i = 0; i != istats.events.size(); ++i)
+    os << istats.events[i].first << " ";
+  os << "\n";
+  os << "ob=" << istats.objectFile << "\n";
+
+  int file = -1, function = -1;
+  for (std::vector<IStatsRow>::const_iterator it = istats.rows.begin(),
+         ie = istats.rows.end(); it != ie; ++it) {
+    if ((int) it->function != function) {
+      function = it->function;
+      if ((int) it->file != file) {
+        file = it->file;
+        os << "fl=" << istats.files[file] << "\n";
+      }
+      os << "fn=" << istats.functions[function] << "\n";
+    }
+    if ((int) it->file != file) {
+      file = it->file;
+      os << "fl=" << istats.files[file] << "\n";
+    }
+    os << it->assemblyLine << " " << it->line << " ";
+    for (unsigned i = 0; i != it->values.size(); ++i)
+      os << it->values[i] << " ";
+    os << "\n";
+  }
+}
+
+/// Write the number of instructions of \a istats, of those covered, and
+/// the totals of its events.
+static void writeIStatsSummary(raw_ostream &os, const IStats &istats) {
+  os << "{\"instructions\": " << istats.rows.size();
+  int covered = istats.getEvent("CoveredInstructions");
+  if (covered >= 0) {
+    uint64_t n = 0;
+    for (unsigned i = 0; i != istats.rows.size(); ++i)
+      n += istats.rows[i].values[covered] != 0;
+    os << ", \"covered\": " << n;
+  }
+  os << ", \"events\": {";
+  for (unsigned i = 0; i != istats.events.size(); ++i) {
+    uint64_t total = 0;
+    for (unsigned j = 0; j != istats.rows.size(); ++j)
+      total += istats.rows[j].values[i];
+    os << (i ? ", " : "");
+    writeJSONString(os, istats.events[i].second);
+    os << ": " << total;
+  }
+  os << "}}";
+}
+
+static void writeCounts(raw_ostream &os,
+                        const std::map<std::string, uint64_t> &counts) {
+  os << "{";
+  for (std::map<std::string, uint64_t>::const_iterator it = counts.begin(),
+         ie = counts.end(); it != ie; ++it) {
+    os << (it == counts.begin() ? "" : ", ");
+    writeJSONString(os, it->first);
+    os << ": " << it->second;
+  }
+  os << "}";
+}
+
+static void writeStats(raw_ostream &os,
+                       const std::vector<StatsColumn> &stats) {
+  os << "{";
+  for (std::vector<StatsColumn>::const_iterator it = stats.begin(),
+         ie = stats.end(); it != ie; ++it) {
+    os << (it == stats.begin() ? "" : ", ");
+    writeJSONString(os, it->name);
+    os << ": ";
+    if (it->isTime)
+      writeJSONDouble(os, it->time);
+    else
+      os << it->count;
+  }
+  os << "}";
+}
+
+int main(int argc, char **argv) {
+  llvm::sys::PrintStackTraceOnErrorSignal();
+  llvm::cl::SetVersionPrinter(klee::printVersion);
+  llvm::cl::ParseCommandLineOptions(argc, argv,
+                                    "Summarize KLEE output directories\n");
+
+  std::vector<DirSummary> summaries(Directories.size());
+  for (unsigned i = 0; i != Directories.size(); ++i)
+    summaries[i].path = Directories[i];
+
+  unsigned numThreads = Jobs;
+  if (!numThreads) {
+    long n = sysconf(_SC_NPROCESSORS_ONLN);
+    numThreads = n > 0 ? n : 1;
+  }
+  numThreads = std::min(numThreads, (unsigned) summaries.size());
+
+  // The main thread scans along with the others, and alone if they cannot
+  // be started.
+  ScanWork work;
+  work.summaries = &summaries;
+  work.next = 0;
+  std::vector<pthread_t> threads(numThreads - 1);
+  std::vector<bool> started(threads.size());
+  for (unsigned i = 0; i != threads.size(); ++i)
+    started[i] = !pthread_create(&threads[i], 0, scanDirectories, &work);
+  scanDirectories(&work);
+  for (unsigned i = 0; i != threads.size(); ++i)
+    if (started[i])
+      pthread_join(threads[i], 0);
+
+  // The totals, with the statistics of the first directory having them.
+  uint64_t tests = 0, objects = 0, objectBytes = 0;
+  std::map<std::string, uint64_t> errors;
+  std::vector<StatsColumn> statsSum, statsMax;
+  IStats merged;
+  bool hasMerged = false;
+  unsigned numMerged = 0;
+  std::vector<std::string> notMerged;
+  for (std::vector<DirSummary>::iterator it = summaries.begin(),
+         ie = summaries.end(); it != ie; ++it) {
+    tests += it->tests;
+    objects += it->objects;
+    objectBytes += it->objectBytes;
+    for (std::map<std::string, uint64_t>::iterator eit = it->errors.begin(),
+           eie = it->errors.end(); eit != eie; ++eit)
+      errors[eit->first] += eit->second;
+
+    if (statsSum.empty()) {
+      statsSum = statsMax = it->stats;
+    } else {
+      for (unsigned i = 0; i != statsSum.size(); ++i) {
+        for (unsigned j = 0; j != it->stats.size(); ++j) {
+          if (it->stats[j].name != statsSum[i].name)
+            continue;
+          statsSum[i].count += it->stats[j].count;
+          statsSum[i].time += it->stats[j].time;
+          statsMax[i].count = std::max(statsMax[i].count,
+                                       it->stats[j].count);
+          statsMax[i].time = std::max(statsMax[i].time, it->stats[j].time);
+          break;
+        }
+      }
+    }
+
+    if (!it->hasIStats)
+      continue;
+    if (!hasMerged) {
+      merged = it->istats;
+      hasMerged = true;
+      ++numMerged;
+    } else if (isSameProgram(merged, it->istats)) {
+      mergeIStats(merged, it->istats);
+      ++numMerged;
+    } else {
+      notMerged.push_back(it->path);
+    }
+  }
+
+  raw_ostream &os = outs();
+  os << "{\n  \"directories\": [";
+  for (std::vector<DirSummary>::iterator it = summaries.begin(),
+         ie = summaries.end(); it != ie; ++it) {
+    os << (it == summaries.begin() ? "\n" : ",\n") << "    {\"path\": ";
+    writeJSONString(os, it->path);
+    os << ", \"tests\": " << it->tests << ", \"objects\": " << it->objects
+       << ", \"objectBytes\": " << it->objectBytes << ", \"errors\": ";
+    writeCounts(os, it->errors);
+    if (!it->stats.empty()) {
+      os << ",\n     \"stats\": ";
+      writeStats(os, it->stats);
+    }
+    if (it->hasIStats) {
+      os << ",\n     \"istats\": ";
+      writeIStatsSummary(os, it->istats);
+    }
+    if (ListTests)
+      os << ",\n     \"testCases\": [" << it->testCases << "]";
+    if (!it->problems.empty()) {
+      os << ",\n     \"problems\": [";
+      for (unsigned i = 0; i != it->problems.size(); ++i) {
+        os << (i ? ", " : "");
+        writeJSONString(os, it->problems[i]);
+      }
+      os << "]";
+    }
+    os << "}";
+  }
+  os << "\n  ],\n";
+
+  os << "  \"total\": {\"directories\": " << summaries.size()
+     << ", \"tests\": " << tests << ", \"objects\": " << objects
+     << ", \"objectBytes\": " << objectBytes << ", \"errors\": ";
+  writeCounts(os, errors);
+  if (!statsSum.empty()) {
+    os << ",\n    \"stats\": {\"sum\": ";
+    writeStats(os, statsSum);
+    os << ",\n              \"max\": ";
+    writeStats(os, statsMax);
+    os << "}";
+  }
+  if (hasMerged) {
+    os << ",\n    \"istats\": {\"merged\": " << numMerged
+       << ", \"notMerged\": [";
+    for (unsigned i = 0; i != notMerged.size(); ++i) {
+      os << (i ? ", " : "");
+      writeJSONString(os, notMerged[i]);
+    }
+    os << "], \"summary\": ";
+    writeIStatsSummary(os, merged);
+    os << "}";
+  }
+  os << "}\n}\n";
+  os.flush();
+
+  int status = 0;
+  if (!MergeIStats.empty()) {
+    if (!hasMerged) {
+      errs() << "klee-summary: no instruction statistics to merge\n";
+      status = 1;
+    } else {
+      std::string error;
+#if LLVM_VERSION_CODE >= LLVM_VERSION(3, 5)
+      raw_fd_ostream out(MergeIStats.c_str(), error, sys::fs::F_None);
+#elif LLVM_VERSION_CODE >= LLVM_VERSION(3, 4)
+      raw_fd_ostream out(MergeIStats.c_str(), error, sys::fs::F_Binary);
+#else
+      raw_fd_ostream out(MergeIStats.c_str(), error,
+                         raw_fd_ostream::F_Binary);
+#endif
+      if (!error.empty()) {
+        errs() << "klee-summary: unable to open " << MergeIStats << ": "
+               << error << "\n";
+        status = 1;
+      } else {
+        writeCallgrind(out, merged);
+      }
+    }
+  }
+
+  llvm::llvm_shutdown();
+  return status;
+}
@@ -15,7 +15,6 @@
 #include "klee/Statistics.h"
 #include "klee/Config/Version.h"
 #include "klee/Internal/ADT/KTest.h"
-#include "klee/Internal/ADT/TreeStream.h"
 #include "klee/Internal/Support/Debug.h"
 #include "klee/Internal/Support/ModuleUtil.h"
 #include "klee/Internal/System/Time.h"
@@ -66,10 +65,13 @@
 #include <sys/stat.h>
 #include <sys/wait.h>
 
+#include <algorithm>
 #include <cerrno>
+#include <cstdio>
 #include <fstream>
 #include <iomanip>
 #include <iterator>
+#include <set>
 #include <sstream>
 
 
@@ -115,6 +117,16 @@ namespace {
   WriteSMT2s("write-smt2s",
             cl::desc("Write .smt2 (SMT-LIBv2) files for each test case"));
 
+  cl::opt<bool>
+  KTestPack("ktest-pack",
+            cl::desc("Write the .ktest files into a single tests.kpack "
+                     "archive, which stores identical objects once"));
+
+  cl::opt<bool>
+  KTestPackCompress("ktest-pack-compress",
+                    cl::desc("Compress the objects in tests.kpack (requires "
+                             "zlib)"));
+
   cl::opt<bool>
   WriteCov("write-cov",
            cl::desc("Write coverage information for each test case"));
@@ -162,12 +174,12 @@ namespace {
 
   cl::opt<bool>
   CheckDivZero("check-div-zero",
-               cl::desc("Inject checks for division-by-zero"),
+               cl::desc("Report divisions by zero as errors"),
                cl::init(true));
 
   cl::opt<bool>
   CheckOvershift("check-overshift",
-               cl::desc("Inject checks for overshift"),
+               cl::desc("Report overshifts as errors"),
                cl::init(true));
 
   cl::opt<std::string>
@@ -175,6 +187,11 @@ namespace {
             cl::desc("Directory to write results in (defaults to klee-out-N)"),
             cl::init(""));
 
+  cl::opt<std::string>
+  Resume("resume",
+         cl::desc("Continue the run in this output directory from its last checkpoint (see -checkpoint-interval), writing to the same directory. The program and its arguments must be given as before"),
+         cl::init(""));
+
   cl::opt<bool>
   ReplayKeepSymbolic("replay-keep-symbolic",
                      cl::desc("Replay the test cases only by asserting "
@@ -187,9 +204,17 @@ namespace {
 
   cl::list<std::string>
       ReplayKTestDir("replay-ktest-dir",
-                   cl::desc("Specify a directory to replay ktest files from"),
+                   cl::desc("Specify a directory to replay ktest files (and "
+                            ".kpack archives) from"),
                    cl::value_desc("output directory"));
 
+  cl::opt<std::string>
+  TestNamePrefix("test-name-prefix",
+                 cl::desc("Prefix the names of test case files, to keep them "
+                          "unique when runs on several machines contribute to "
+                          "one set of tests (default=none)"),
+                 cl::init(""));
+
   cl::opt<std::string>
   ReplayPathFile("replay-path",
                  cl::desc("Specify a path file to replay"),
@@ -201,6 +226,15 @@ namespace {
   cl::list<std::string>
   SeedOutDir("seed-out-dir");
 
+  cl::opt<std::string>
+  SeedExportDir("seed-export-dir",
+                cl::desc("Also write the inputs of the test cases covering "
+                         "new code to this directory, as the bytes of their "
+                         "objects one after the other, named as in the queue "
+                         "of an AFL fuzzer, for it to sync from when given "
+                         "<sync dir>/klee/queue (default=none)"),
+                cl::init(""));
+
   cl::list<std::string>
   LinkLibraries("link-llvm-lib",
 		cl::desc("Link the given libraries before execution"),
@@ -218,6 +252,30 @@ namespace {
 	     cl::desc("Stop execution after generating the given number of tests.  Extra tests corresponding to partially explored paths will also be dumped."),
 	     cl::init(0));
 
+  cl::opt<unsigned>
+  AsyncTestGen("async-test-gen",
+               cl::desc("Solve for and write up to this many test cases at a "
+                        "time in processes of their own, so that exploration "
+                        "continues meanwhile. Exploration waits when all of "
+                        "them are busy (default=0 (off))"),
+               cl::init(0));
+
+  cl::opt<bool>
+  MinimizeTests("minimize-tests",
+                cl::desc("Only write the test cases covering instructions or "
+                         "branch directions the tests kept do not, and every "
+                         "-minimize-tests-interval tests, remove the kept "
+                         "tests whose coverage the others have. Tests of "
+                         "errors are always written and kept (default=off)"));
+
+  cl::opt<unsigned>
+  MinimizeTestsInterval("minimize-tests-interval",
+                        cl::desc("Number of tests written between removals "
+                                 "of redundant tests with -minimize-tests, "
+                                 "0 to only remove them at the end "
+                                 "(default=100)"),
+                        cl::init(100));
+
   cl::opt<bool>
   Watchdog("watchdog",
            cl::desc("Use a watchdog process to enforce --max-time."),
@@ -228,10 +286,72 @@ extern cl::opt<double> MaxTime;
 
 /***/
 
+/// TestMinimizer - The coverage of the tests kept with -minimize-tests, a
+/// greedy cover of the coverage items of the paths explored (see
+/// Interpreter::getPathCoverage). A test is only written if it covers an
+/// item the kept tests do not, and the kept tests whose items the others
+/// all cover are retired.
+class TestMinimizer {
+  /// The number of kept tests covering each item.
+  std::vector<unsigned> counts;
+  /// The items of the kept tests which may be retired, by test id.
+  std::map<unsigned, std::vector<unsigned> > tests;
+
+public:
+  /// covers - Whether the kept tests cover all of \a items.
+  bool covers(const std::vector<unsigned> &items) const {
+    for (std::vector<unsigned>::const_iterator it = items.begin(),
+           ie = items.end(); it != ie; ++it)
+      if (*it >= counts.size() || !counts[*it])
+        return false;
+    return true;
+  }
+
+  /// add - Keep test \a id, which covers \a items. The items are taken.
+  void add(unsigned id, std::vector<unsigned> &items) {
+    for (std::vector<unsigned>::iterator it = items.begin(),
+           ie = items.end(); it != ie; ++it) {
+      if (*it >= counts.size())
+        counts.resize(*it + 1);
+      ++counts[*it];
+    }
+    tests[id].swap(items);
+  }
+
+  /// pin - Never retire the tests kept so far.
+  void pin() { tests.clear(); }
+
+  /// retire - Retire the tests whose items the other kept tests cover,
+  /// trying those covering the fewest first, and append their ids to
+  /// \a retired.
+  void retire(std::vector<unsigned> &retired) {
+    std::vector<std::pair<size_t, unsigned> > order;
+    for (std::map<unsigned, std::vector<unsigned> >::iterator
+           it = tests.begin(), ie = tests.end(); it != ie; ++it)
+      order.push_back(std::make_pair(it->second.size(), it->first));
+    std::sort(order.begin(), order.end());
+
+    for (std::vector<std::pair<size_t, unsigned> >::iterator
+           it = order.begin(), ie = order.end(); it != ie; ++it) {
+      std::vector<unsigned> &items = tests[it->second];
+      bool redundant = true;
+      for (std::vector<unsigned>::iterator iit = items.begin(),
+             iie = items.end(); iit != iie && redundant; ++iit)
+        redundant = counts[*iit] > 1;
+      if (!redundant)
+        continue;
+      for (std::vector<unsigned>::iterator iit = items.begin(),
+             iie = items.end(); iit != iie; ++iit)
+        --counts[*iit];
+      tests.erase(it->second);
+      retired.push_back(it->second);
+    }
+  }
+};
+
 class KleeHandler : public InterpreterHandler {
 private:
   Interpreter *m_interpreter;
-  TreeStreamWriter *m_pathWriter, *m_symPathWriter;
   llvm::raw_ostream *m_infoFile;
 
   SmallString<128> m_outputDirectory;
@@ -239,6 +359,27 @@ private:
   unsigned m_testIndex;  // number of tests written so far
   unsigned m_pathsExplored; // number of paths explored so far
 
+  // parallel workers write interleaved test ids, see setWorker()
+  unsigned m_workerIndex, m_workerCount;
+  unsigned m_testIndexAtSplit; // number of tests written before splitting
+
+  // processes writing test cases with --async-test-gen
+  std::vector<pid_t> m_testWriters;
+
+  KTestPackWriter *m_ktestPack; // with --ktest-pack
+
+  // with --minimize-tests
+  TestMinimizer m_minimizer;
+  unsigned m_testsSinceRetirement;
+  unsigned m_suppressedTests, m_retiredTests;
+
+  void writeTestCase(const ExecutionState &state, const char *errorMessage,
+                     const char *errorSuffix, unsigned id);
+  void reapTestWriters(bool block);
+  bool getOutputFiles(std::vector<std::string> &files);
+  void removeTestFiles(const std::vector<std::string> &files,
+                       const std::set<std::string> &prefixes);
+
   // used for writing .ktest files
   int m_argc;
   char **m_argv;
@@ -253,10 +394,16 @@ public:
   void incPathsExplored() { m_pathsExplored++; }
 
   void setInterpreter(Interpreter *i);
+  void setWorker(unsigned index, unsigned count);
 
   void processTestCase(const ExecutionState  &state,
                        const char *errorMessage,
                        const char *errorSuffix);
+  void waitForTestWriters();
+  void removeDuplicateTests();
+  void retireRedundantTests();
+  unsigned getNumSuppressedTests() const { return m_suppressedTests; }
+  unsigned getNumRetiredTests() const { return m_retiredTests; }
 
   std::string getOutputFilename(const std::string &filename);
   llvm::raw_fd_ostream *openOutputFile(const std::string &filename);
@@ -269,24 +416,35 @@ public:
 
   static void getKTestFilesInDir(std::string directoryPath,
                                  std::vector<std::string> &results);
+  static bool loadKTests(const std::string &path, std::vector<KTest *> &results);
+
+  void loadCheckpoints(std::vector<std::vector<bool> > &paths);
 
   static std::string getRunTimeLibraryPath(const char *argv0);
 };
 
 KleeHandler::KleeHandler(int argc, char **argv)
   : m_interpreter(0),
-    m_pathWriter(0),
-    m_symPathWriter(0),
     m_infoFile(0),
     m_outputDirectory(),
     m_testIndex(0),
     m_pathsExplored(0),
+    m_workerIndex(0),
+    m_workerCount(1),
+    m_testIndexAtSplit(0),
+    m_ktestPack(0),
+    m_testsSinceRetirement(0),
+    m_suppressedTests(0),
+    m_retiredTests(0),
     m_argc(argc),
     m_argv(argv) {
 
-  // create output directory (OutputDir or "klee-out-<i>")
-  bool dir_given = OutputDir != "";
-  SmallString<128> directory(dir_given ? OutputDir : InputFile);
+  // create output directory (OutputDir or "klee-out-<i>"), or reuse the
+  // one of a resumed run
+  bool resuming = Resume != "";
+  bool dir_given = OutputDir != "" || resuming;
+  SmallString<128> directory(resuming ? Resume : dir_given ? OutputDir
+                                                           : InputFile);
 
   if (!dir_given) sys::path::remove_filename(directory);
 #if LLVM_VERSION_CODE < LLVM_VERSION(3, 5)
@@ -298,7 +456,28 @@ KleeHandler::KleeHandler(int argc, char **argv)
     klee_error("unable to determine absolute path: %s", ec.message().c_str());
   }
 
-  if (dir_given) {
+  if (resuming) {
+    m_outputDirectory = directory;
+
+    // Go on numbering tests after those of the earlier run.
+#if LLVM_VERSION_CODE < LLVM_VERSION(3, 5)
+    error_code ec;
+#else
+    std::error_code ec;
+#endif
+    std::string prefix = TestNamePrefix + "test";
+    for (llvm::sys::fs::directory_iterator i(directory.str(), ec), e;
+         i != e && !ec; i.increment(ec)) {
+      std::string f = sys::path::filename((*i).path());
+      if (f.compare(0, prefix.size(), prefix) == 0)
+        m_testIndex = std::max(
+            m_testIndex,
+            (unsigned) strtoul(f.c_str() + prefix.size(), NULL, 10));
+    }
+    if (ec)
+      klee_error("cannot read \"%s\": %s", directory.c_str(),
+                 ec.message().c_str());
+  } else if (dir_given) {
     // OutputDir
     if (mkdir(directory.c_str(), 0775) < 0)
       klee_error("cannot create \"%s\": %s", directory.c_str(), strerror(errno));
@@ -340,21 +519,35 @@ KleeHandler::KleeHandler(int argc, char **argv)
 
   // open warnings.txt
   std::string file_path = getOutputFilename("warnings.txt");
-  if ((klee_warning_file = fopen(file_path.c_str(), "w")) == NULL)
+  if ((klee_warning_file = fopen(file_path.c_str(), resuming ? "a" : "w")) ==
+      NULL)
     klee_error("cannot open file \"%s\": %s", file_path.c_str(), strerror(errno));
 
   // open messages.txt
   file_path = getOutputFilename("messages.txt");
-  if ((klee_message_file = fopen(file_path.c_str(), "w")) == NULL)
+  if ((klee_message_file = fopen(file_path.c_str(), resuming ? "a" : "w")) ==
+      NULL)
     klee_error("cannot open file \"%s\": %s", file_path.c_str(), strerror(errno));
 
   // open info
   m_infoFile = openOutputFile("info");
+
+  if (KTestPack) {
+    file_path = getOutputFilename("tests.kpack");
+    m_ktestPack = kTestPack_create(file_path.c_str(), KTestPackCompress);
+    if (!m_ktestPack)
+      klee_error("cannot open file \"%s\": %s", file_path.c_str(),
+                 strerror(errno));
+    // The writers could not append to the pack of this process.
+    if (AsyncTestGen)
+      klee_warning("--async-test-gen is ignored with --ktest-pack");
+  }
 }
 
 KleeHandler::~KleeHandler() {
-  if (m_pathWriter) delete m_pathWriter;
-  if (m_symPathWriter) delete m_symPathWriter;
+  waitForTestWriters();
+  if (m_ktestPack && !kTestPack_close(m_ktestPack))
+    klee_warning("unable to write the index of tests.kpack");
   fclose(klee_warning_file);
   fclose(klee_message_file);
   delete m_infoFile;
@@ -362,17 +555,29 @@ KleeHandler::~KleeHandler() {
 
 void KleeHandler::setInterpreter(Interpreter *i) {
   m_interpreter = i;
+}
 
-  if (WritePaths) {
-    m_pathWriter = new TreeStreamWriter(getOutputFilename("paths.ts"));
-    assert(m_pathWriter->good());
-    m_interpreter->setPathWriter(m_pathWriter);
-  }
-
-  if (WriteSymPaths) {
-    m_symPathWriter = new TreeStreamWriter(getOutputFilename("symPaths.ts"));
-    assert(m_symPathWriter->good());
-    m_interpreter->setSymbolicPathWriter(m_symPathWriter);
+void KleeHandler::setWorker(unsigned index, unsigned count) {
+  m_workerIndex = index;
+  m_workerCount = count;
+  m_testIndexAtSplit = m_testIndex;
+  // Every worker counts on the tests written before, none may remove them.
+  if (count > 1)
+    m_minimizer.pin();
+  // The test writers are children of the first worker only.
+  if (index)
+    m_testWriters.clear();
+
+  // Every worker appends to a pack of its own.
+  if (index && m_ktestPack) {
+    kTestPack_abandon(m_ktestPack);
+    std::stringstream filename;
+    filename << "tests." << index << ".kpack";
+    std::string path = getOutputFilename(filename.str());
+    m_ktestPack = kTestPack_create(path.c_str(), KTestPackCompress);
+    if (!m_ktestPack)
+      klee_error("cannot open file \"%s\": %s", path.c_str(),
+                 strerror(errno));
   }
 }
 
@@ -407,7 +612,7 @@ llvm::raw_fd_ostream *KleeHandler::openOutputFile(const std::string &filename) {
 
 std::string KleeHandler::getTestFilename(const std::string &suffix, unsigned id) {
   std::stringstream filename;
-  filename << "test" << std::setfill('0') << std::setw(6) << id << '.' << suffix;
+  filename << TestNamePrefix << "test" << std::setfill('0') << std::setw(6) << id << '.' << suffix;
   return filename.str();
 }
 
@@ -426,125 +631,353 @@ void KleeHandler::processTestCase(const ExecutionState &state,
     exit(1);
   }
 
-  if (!NoOutput) {
-    std::vector< std::pair<std::string, std::vector<unsigned char> > > out;
-    bool success = m_interpreter->getSymbolicSolution(state, out);
-
-    if (!success)
-      klee_warning("unable to get symbolic solution, losing test case");
-
-    double start_time = util::getWallTime();
-
-    unsigned id = ++m_testIndex;
-
-    if (success) {
-      KTest b;
-      b.numArgs = m_argc;
-      b.args = m_argv;
-      b.symArgvs = 0;
-      b.symArgvLen = 0;
-      b.numObjects = out.size();
-      b.objects = new KTestObject[b.numObjects];
-      assert(b.objects);
-      for (unsigned i=0; i<b.numObjects; i++) {
-        KTestObject *o = &b.objects[i];
-        o->name = const_cast<char*>(out[i].first.c_str());
-        o->numBytes = out[i].second.size();
-        o->bytes = new unsigned char[o->numBytes];
-        assert(o->bytes);
-        std::copy(out[i].second.begin(), out[i].second.end(), o->bytes);
-      }
+  if (NoOutput)
+    return;
 
-      if (!kTest_toFile(&b, getOutputFilename(getTestFilename("ktest", id)).c_str())) {
-        klee_warning("unable to write output test case, losing it");
-      }
+  // Tests of errors are always written, and do not count for the others.
+  std::vector<unsigned> coverage;
+  if (MinimizeTests && !errorMessage) {
+    m_interpreter->getPathCoverage(state, coverage);
+    if (m_minimizer.covers(coverage)) {
+      ++m_suppressedTests;
+      return;
+    }
+  }
 
-      for (unsigned i=0; i<b.numObjects; i++)
-        delete[] b.objects[i].bytes;
-      delete[] b.objects;
+  unsigned id = ++m_testIndex;
+  if (m_workerCount > 1)
+    id = m_testIndexAtSplit +
+         (id - m_testIndexAtSplit - 1) * m_workerCount + m_workerIndex + 1;
+
+  if (MinimizeTests && !errorMessage) {
+    m_minimizer.add(id, coverage);
+    if (MinimizeTestsInterval &&
+        ++m_testsSinceRetirement == MinimizeTestsInterval) {
+      m_testsSinceRetirement = 0;
+      retireRedundantTests();
     }
+  }
 
-    if (errorMessage) {
-      llvm::raw_ostream *f = openTestFile(errorSuffix, id);
-      *f << errorMessage;
-      delete f;
+  if (m_testIndex == StopAfterNTests)
+    m_interpreter->setHaltExecution(true);
+
+  if (AsyncTestGen && !m_ktestPack) {
+    // Wait for a writer to finish if all of them are busy, which holds up
+    // exploration until test generation catches up.
+    reapTestWriters(/*block=*/false);
+    while (m_testWriters.size() >= AsyncTestGen)
+      reapTestWriters(/*block=*/true);
+
+    // Anything still buffered would otherwise be written by both processes.
+    fflush(NULL);
+    llvm::outs().flush();
+    llvm::errs().flush();
+    m_infoFile->flush();
+
+    pid_t pid = fork();
+    if (pid == 0) {
+      writeTestCase(state, errorMessage, errorSuffix, id);
+      fflush(NULL);
+      _exit(0);
+    }
+    if (pid > 0) {
+      m_testWriters.push_back(pid);
+      return;
     }
+    klee_warning("fork failed (for test case %u) - %s, writing it directly",
+                 id, llvm::sys::StrError(errno).c_str());
+  }
 
-    if (m_pathWriter) {
-      std::vector<unsigned char> concreteBranches;
-      m_pathWriter->readStream(m_interpreter->getPathStreamID(state),
-                               concreteBranches);
-      llvm::raw_fd_ostream *f = openTestFile("path", id);
-      for (std::vector<unsigned char>::iterator I = concreteBranches.begin(),
-                                                E = concreteBranches.end();
-           I != E; ++I) {
-        *f << *I << "\n";
-      }
-      delete f;
+  writeTestCase(state, errorMessage, errorSuffix, id);
+}
+
+/// reapTestWriters - Forget the test writers which have finished, waiting
+/// for the oldest one if \a block is set and none has.
+void KleeHandler::reapTestWriters(bool block) {
+  size_t running = m_testWriters.size();
+  for (std::vector<pid_t>::iterator it = m_testWriters.begin();
+       it != m_testWriters.end();) {
+    int status;
+    pid_t res = waitpid(*it, &status, WNOHANG);
+    if (res == 0 || (res < 0 && errno == EINTR)) {
+      ++it;
+      continue;
     }
+    if (res > 0 && !(WIFEXITED(status) && WEXITSTATUS(status) == 0))
+      klee_warning("test case writer %d failed, losing its test case", *it);
+    it = m_testWriters.erase(it);
+  }
 
-    if (errorMessage || WriteKQueries) {
-      std::string constraints;
-      m_interpreter->getConstraintLog(state, constraints,Interpreter::KQUERY);
-      llvm::raw_ostream *f = openTestFile("kquery", id);
-      *f << constraints;
-      delete f;
+  if (!block || m_testWriters.size() != running || m_testWriters.empty())
+    return;
+  int status;
+  pid_t res;
+  do {
+    res = waitpid(m_testWriters.front(), &status, 0);
+  } while (res < 0 && errno == EINTR);
+  if (res > 0 && !(WIFEXITED(status) && WEXITSTATUS(status) == 0))
+    klee_warning("test case writer %d failed, losing its test case",
+                 m_testWriters.front());
+  m_testWriters.erase(m_testWriters.begin());
+}
+
+void KleeHandler::waitForTestWriters() {
+  while (!m_testWriters.empty())
+    reapTestWriters(/*block=*/true);
+}
+
+/// removeDuplicateTests - Once all parallel workers are done, remove the
+/// tests whose inputs an earlier test already has, with all their files.
+/// Workers started from different seeds or states often reach the same
+/// paths.
+void KleeHandler::removeDuplicateTests() {
+  // Packs are left alone, they already store identical objects once.
+  if (m_workerIndex != 0 || m_workerCount <= 1 || m_ktestPack || NoOutput)
+    return;
+
+  std::vector<std::string> files;
+  if (!getOutputFiles(files))
+    return;
+
+  std::set<std::string> seen;
+  std::set<std::string> duplicates; // file name prefixes, "test000042."
+  for (std::vector<std::string>::iterator it = files.begin(),
+         ie = files.end(); it != ie; ++it) {
+    if (it->size() < 6 || it->substr(it->size() - 6) != ".ktest")
+      continue;
+    KTest *out = kTest_fromFile(getOutputFilename(*it).c_str());
+    if (!out)
+      continue;
+    std::string key;
+    for (unsigned i = 0; i < out->numObjects; ++i) {
+      KTestObject &o = out->objects[i];
+      key.append(o.name, strlen(o.name) + 1);
+      key.append((const char *) &o.numBytes, sizeof o.numBytes);
+      key.append((const char *) o.bytes, o.numBytes);
     }
+    kTest_free(out);
+    if (!seen.insert(key).second)
+      duplicates.insert(it->substr(0, it->size() - 5));
+  }
+  if (duplicates.empty())
+    return;
 
-    if (WriteCVCs) {
-      // FIXME: If using Z3 as the core solver the emitted file is actually
-      // SMT-LIBv2 not CVC which is a bit confusing
-      std::string constraints;
-      m_interpreter->getConstraintLog(state, constraints, Interpreter::STP);
-      llvm::raw_ostream *f = openTestFile("cvc", id);
-      *f << constraints;
-      delete f;
+  removeTestFiles(files, duplicates);
+  klee_message("removed %u duplicate tests of the parallel workers",
+               (unsigned) duplicates.size());
+}
+
+/// getOutputFiles - The names of the files in the output directory, sorted.
+/// Test ids have a fixed width, so this puts earlier tests first.
+bool KleeHandler::getOutputFiles(std::vector<std::string> &files) {
+#if LLVM_VERSION_CODE < LLVM_VERSION(3, 5)
+  error_code ec;
+#else
+  std::error_code ec;
+#endif
+  for (llvm::sys::fs::directory_iterator i(m_outputDirectory.str(), ec), e;
+       i != e && !ec; i.increment(ec))
+    files.push_back(sys::path::filename((*i).path()));
+  if (ec) {
+    klee_warning("unable to read output directory: %s", ec.message().c_str());
+    return false;
+  }
+  std::sort(files.begin(), files.end());
+  return true;
+}
+
+/// removeTestFiles - Remove the \a files of the output directory starting
+/// with one of \a prefixes, test file names up to their suffix, as
+/// "test000042.".
+void KleeHandler::removeTestFiles(const std::vector<std::string> &files,
+                                  const std::set<std::string> &prefixes) {
+  for (std::vector<std::string>::const_iterator it = files.begin(),
+         ie = files.end(); it != ie; ++it) {
+    // All prefixes have the same length, so one of them starts this file
+    // name iff the last one not greater than it does.
+    std::set<std::string>::const_iterator prefix = prefixes.upper_bound(*it);
+    if (prefix == prefixes.begin())
+      continue;
+    --prefix;
+    if (it->compare(0, prefix->size(), *prefix) == 0)
+      unlink(getOutputFilename(*it).c_str());
+  }
+}
+
+/// retireRedundantTests - With -minimize-tests, remove the tests kept whose
+/// coverage the other tests have, with all their files. The tests in a
+/// pack cannot be removed, they are only suppressed.
+void KleeHandler::retireRedundantTests() {
+  if (!MinimizeTests || NoOutput || m_ktestPack)
+    return;
+
+  std::vector<unsigned> retired;
+  m_minimizer.retire(retired);
+  if (retired.empty())
+    return;
+
+  // Their writers may still be writing them.
+  waitForTestWriters();
+  std::set<std::string> prefixes;
+  for (std::vector<unsigned>::iterator it = retired.begin(),
+         ie = retired.end(); it != ie; ++it)
+    prefixes.insert(getTestFilename("", *it));
+  std::vector<std::string> files;
+  if (getOutputFiles(files))
+    removeTestFiles(files, prefixes);
+  m_retiredTests += retired.size();
+}
+
+/// exportSeed - Write the bytes of the objects \a out of test case \a id
+/// to -seed-export-dir, under a hidden name until complete, since a fuzzer
+/// may read it at any time.
+static void exportSeed(
+    const std::vector<std::pair<std::string, std::vector<unsigned char> > >
+        &out,
+    unsigned id) {
+  std::stringstream name;
+  name << "id:" << std::setfill('0') << std::setw(6) << id << ",src:klee";
+  std::string path = SeedExportDir + "/" + name.str();
+  std::string tmpPath = SeedExportDir + "/." + name.str();
+  {
+    std::ofstream f(tmpPath.c_str(), std::ios::binary);
+    for (unsigned i = 0; i < out.size(); ++i)
+      if (!out[i].second.empty())
+        f.write((const char *) &out[i].second[0], out[i].second.size());
+    if (!f) {
+      klee_warning("unable to export test case %u to %s", id,
+                   SeedExportDir.c_str());
+      unlink(tmpPath.c_str());
+      return;
     }
+  }
+  if (rename(tmpPath.c_str(), path.c_str()) != 0) {
+    klee_warning("unable to export test case %u to %s", id,
+                 SeedExportDir.c_str());
+    unlink(tmpPath.c_str());
+  }
+}
 
-    if(WriteSMT2s) {
-      std::string constraints;
-        m_interpreter->getConstraintLog(state, constraints, Interpreter::SMTLIB2);
-        llvm::raw_ostream *f = openTestFile("smt2", id);
-        *f << constraints;
-        delete f;
+/// writeTestCase - Solve for the inputs of \a state and write the files of
+/// test case \a id.
+void KleeHandler::writeTestCase(const ExecutionState &state,
+                                const char *errorMessage,
+                                const char *errorSuffix, unsigned id) {
+  std::vector< std::pair<std::string, std::vector<unsigned char> > > out;
+  bool success = m_interpreter->getSymbolicSolution(state, out);
+
+  if (!success)
+    klee_warning("unable to get symbolic solution, losing test case");
+
+  double start_time = util::getWallTime();
+
+  if (success) {
+    KTest b;
+    b.numArgs = m_argc;
+    b.args = m_argv;
+    b.symArgvs = 0;
+    b.symArgvLen = 0;
+    b.numObjects = out.size();
+    b.objects = new KTestObject[b.numObjects];
+    assert(b.objects);
+    for (unsigned i=0; i<b.numObjects; i++) {
+      KTestObject *o = &b.objects[i];
+      o->name = const_cast<char*>(out[i].first.c_str());
+      o->numBytes = out[i].second.size();
+      o->bytes = new unsigned char[o->numBytes];
+      assert(o->bytes);
+      std::copy(out[i].second.begin(), out[i].second.end(), o->bytes);
     }
 
-    if (m_symPathWriter) {
-      std::vector<unsigned char> symbolicBranches;
-      m_symPathWriter->readStream(m_interpreter->getSymbolicPathStreamID(state),
-                                  symbolicBranches);
-      llvm::raw_fd_ostream *f = openTestFile("sym.path", id);
-      for (std::vector<unsigned char>::iterator I = symbolicBranches.begin(), E = symbolicBranches.end(); I!=E; ++I) {
-        *f << *I << "\n";
-      }
-      delete f;
+    std::string name = getTestFilename("ktest", id);
+    if (m_ktestPack ? !kTestPack_append(m_ktestPack, &b, name.c_str())
+                    : !kTest_toFile(&b, getOutputFilename(name).c_str())) {
+      klee_warning("unable to write output test case, losing it");
     }
 
-    if (WriteCov) {
-      std::map<const std::string*, std::set<unsigned> > cov;
-      m_interpreter->getCoveredLines(state, cov);
-      llvm::raw_ostream *f = openTestFile("cov", id);
-      for (std::map<const std::string*, std::set<unsigned> >::iterator
-             it = cov.begin(), ie = cov.end();
-           it != ie; ++it) {
-        for (std::set<unsigned>::iterator
-               it2 = it->second.begin(), ie = it->second.end();
-             it2 != ie; ++it2)
-          *f << *it->first << ":" << *it2 << "\n";
-      }
-      delete f;
+    for (unsigned i=0; i<b.numObjects; i++)
+      delete[] b.objects[i].bytes;
+    delete[] b.objects;
+
+    if (SeedExportDir != "" && state.coveredNew)
+      exportSeed(out, id);
+  }
+
+  if (errorMessage) {
+    llvm::raw_ostream *f = openTestFile(errorSuffix, id);
+    *f << errorMessage;
+    delete f;
+  }
+
+  if (WritePaths) {
+    std::vector<unsigned char> concreteBranches;
+    m_interpreter->getPath(state, concreteBranches);
+    llvm::raw_fd_ostream *f = openTestFile("path", id);
+    for (std::vector<unsigned char>::iterator I = concreteBranches.begin(),
+                                              E = concreteBranches.end();
+         I != E; ++I) {
+      *f << *I << "\n";
     }
+    delete f;
+  }
 
-    if (m_testIndex == StopAfterNTests)
-      m_interpreter->setHaltExecution(true);
+  if (errorMessage || WriteKQueries) {
+    std::string constraints;
+    m_interpreter->getConstraintLog(state, constraints,Interpreter::KQUERY);
+    llvm::raw_ostream *f = openTestFile("kquery", id);
+    *f << constraints;
+    delete f;
+  }
 
-    if (WriteTestInfo) {
-      double elapsed_time = util::getWallTime() - start_time;
-      llvm::raw_ostream *f = openTestFile("info", id);
-      *f << "Time to generate test case: "
-         << elapsed_time << "s\n";
+  if (WriteCVCs) {
+    // FIXME: If using Z3 as the core solver the emitted file is actually
+    // SMT-LIBv2 not CVC which is a bit confusing
+    std::string constraints;
+    m_interpreter->getConstraintLog(state, constraints, Interpreter::STP);
+    llvm::raw_ostream *f = openTestFile("cvc", id);
+    *f << constraints;
+    delete f;
+  }
+
+  if(WriteSMT2s) {
+    std::string constraints;
+      m_interpreter->getConstraintLog(state, constraints, Interpreter::SMTLIB2);
+      llvm::raw_ostream *f = openTestFile("smt2", id);
+      *f << constraints;
       delete f;
+  }
+
+  if (WriteSymPaths) {
+    std::vector<unsigned char> symbolicBranches;
+    m_interpreter->getSymbolicPath(state, symbolicBranches);
+    llvm::raw_fd_ostream *f = openTestFile("sym.path", id);
+    for (std::vector<unsigned char>::iterator I = symbolicBranches.begin(), E = symbolicBranches.end(); I!=E; ++I) {
+      *f << *I << "\n";
     }
+    delete f;
+  }
+
+  if (WriteCov) {
+    std::map<const std::string*, std::set<unsigned> > cov;
+    m_interpreter->getCoveredLines(state, cov);
+    llvm::raw_ostream *f = openTestFile("cov", id);
+    for (std::map<const std::string*, std::set<unsigned> >::iterator
+           it = cov.begin(), ie = cov.end();
+         it != ie; ++it) {
+      for (std::set<unsigned>::iterator
+             it2 = it->second.begin(), ie = it->second.end();
+           it2 != ie; ++it2)
+        *f << *it->first << ":" << *it2 << "\n";
+    }
+    delete f;
+  }
+
+  if (WriteTestInfo) {
+    double elapsed_time = util::getWallTime() - start_time;
+    llvm::raw_ostream *f = openTestFile("info", id);
+    *f << "Time to generate test case: "
+       << elapsed_time << "s\n";
+    delete f;
   }
 }
 
@@ -574,7 +1007,8 @@ void KleeHandler::getKTestFilesInDir(std::string directoryPath,
   for (llvm::sys::fs::directory_iterator i(directoryPath, ec), e; i != e && !ec;
        i.increment(ec)) {
     std::string f = (*i).path();
-    if (f.substr(f.size()-6,f.size()) == ".ktest") {
+    if (f.substr(f.size()-6,f.size()) == ".ktest" ||
+        f.substr(f.size()-6,f.size()) == ".kpack") {
           results.push_back(f);
     }
   }
@@ -586,6 +1020,75 @@ void KleeHandler::getKTestFilesInDir(std::string directoryPath,
   }
 }
 
+/// loadCheckpoints - Read the paths of the states left by the run being
+/// resumed, from the checkpoint files of all its workers. The files are
+/// renamed to *.resumed, as this run writes checkpoints of its own.
+void KleeHandler::loadCheckpoints(std::vector<std::vector<bool> > &paths) {
+#if LLVM_VERSION_CODE < LLVM_VERSION(3, 5)
+  error_code ec;
+#else
+  std::error_code ec;
+#endif
+  std::vector<std::string> files;
+  for (llvm::sys::fs::directory_iterator i(m_outputDirectory.str(), ec), e;
+       i != e && !ec; i.increment(ec)) {
+    std::string f = sys::path::filename((*i).path());
+    if (f == "checkpoint" ||
+        (f.compare(0, 11, "checkpoint.") == 0 &&
+         f.find_first_not_of("0123456789", 11) == std::string::npos))
+      files.push_back(getOutputFilename(f));
+  }
+  if (ec)
+    klee_error("cannot read \"%s\": %s", m_outputDirectory.c_str(),
+               ec.message().c_str());
+
+  for (std::vector<std::string>::iterator it = files.begin(),
+         ie = files.end(); it != ie; ++it) {
+    std::ifstream f(it->c_str());
+    if (!f.good())
+      klee_error("cannot open checkpoint \"%s\"", it->c_str());
+    std::string line;
+    while (std::getline(f, line)) {
+      if (!line.empty() && line[0] == '#')
+        continue;
+      paths.push_back(std::vector<bool>());
+      for (std::string::iterator c = line.begin(), ce = line.end(); c != ce;
+           ++c)
+        paths.back().push_back(*c == '1');
+    }
+    f.close();
+    if (rename(it->c_str(), (*it + ".resumed").c_str()) < 0)
+      klee_warning("cannot rename \"%s\": %s", it->c_str(), strerror(errno));
+  }
+}
+
+/// loadKTests - Read the test in the .ktest file \a path, or all tests in
+/// the .kpack archive \a path.
+bool KleeHandler::loadKTests(const std::string &path,
+                             std::vector<KTest *> &results) {
+  if (!kTest_isKTestPack(path.c_str())) {
+    KTest *out = kTest_fromFile(path.c_str());
+    if (!out)
+      return false;
+    results.push_back(out);
+    return true;
+  }
+
+  KTestPackReader *pack = kTestPack_open(path.c_str());
+  if (!pack)
+    return false;
+  bool success = true;
+  for (unsigned i = 0, e = kTestPack_numTests(pack); i != e && success; ++i) {
+    KTest *out = kTestPack_get(pack, i);
+    if (out)
+      results.push_back(out);
+    else
+      success = false;
+  }
+  kTestPack_free(pack);
+  return success;
+}
+
 std::string KleeHandler::getRunTimeLibraryPath(const char *argv0) {
   // allow specifying the path to the runtime library
   const char *env = getenv("KLEE_RUNTIME_LIBRARY_PATH");
@@ -758,6 +1261,7 @@ static const char *modelledExternals[] = {
   "klee_is_symbolic",
   "klee_make_symbolic",
   "klee_mark_global",
+  "klee_mark_pure",
   "klee_merge",
   "klee_prefer_cex",
   "klee_posix_prefer_cex",
@@ -1209,6 +1713,18 @@ int main(int argc, char **argv, char **envp) {
   parseArguments(argc, argv);
   sys::PrintStackTraceOnErrorSignal();
 
+  if (Resume != "") {
+    if (OutputDir != "")
+      klee_error("--resume writes to the directory it resumes, it cannot be "
+                 "used with --output-dir");
+    if (KTestPack)
+      klee_error("--resume cannot be used with --ktest-pack");
+    if (!SeedOutFile.empty() || !SeedOutDir.empty() ||
+        !ReplayKTestFile.empty() || !ReplayKTestDir.empty() ||
+        ReplayPathFile != "")
+      klee_error("--resume cannot be used with seeds or replay");
+  }
+
   if (Watchdog) {
     if (MaxTime==0) {
       klee_error("--watchdog used without --max-time");
@@ -1430,6 +1946,7 @@ int main(int argc, char **argv, char **envp) {
 
   Interpreter::InterpreterOptions IOpts;
   IOpts.MakeConcreteSymbolic = MakeConcreteSymbolic;
+  IOpts.TrackPathCoverage = MinimizeTests;
   KleeHandler *handler = new KleeHandler(pArgc, pArgv);
   Interpreter *interpreter =
     theInterpreter = Interpreter::create(ctx, IOpts, handler);
@@ -1443,11 +1960,23 @@ int main(int argc, char **argv, char **envp) {
   const Module *finalModule =
     interpreter->setModule(mainModule, Opts);
   externalsAndGlobalsCheck(finalModule);
+  // A module from -prepared-module-cache replaces the one loaded, along
+  // with its functions.
+  mainFn = finalModule->getFunction(EntryPoint);
+  assert(mainFn && "the entry point was prepared away");
 
   if (ReplayPathFile != "") {
     interpreter->setReplayPath(&replayPath);
   }
 
+  std::vector<std::vector<bool> > resumePaths;
+  if (Resume != "") {
+    handler->loadCheckpoints(resumePaths);
+    if (resumePaths.empty())
+      klee_error("no checkpoint to resume in \"%s\"", Resume.c_str());
+    interpreter->setResumePaths(&resumePaths);
+  }
+
   char buf[256];
   time_t t[2];
   t[0] = time(NULL);
@@ -1464,15 +1993,34 @@ int main(int argc, char **argv, char **envp) {
            it = ReplayKTestDir.begin(), ie = ReplayKTestDir.end();
          it != ie; ++it)
       KleeHandler::getKTestFilesInDir(*it, kTestFiles);
-    std::vector<KTest*> kTests;
+
+    // Tests are read one at a time while replaying, so that large archives
+    // need not fit in memory. Each entry is a .ktest file, or a test in a
+    // .kpack archive.
+    struct ReplayedTest {
+      std::string name;
+      KTestPackReader *pack;
+      unsigned index;
+    };
+    std::vector<ReplayedTest> replayed;
+    std::vector<KTestPackReader *> packs;
     for (std::vector<std::string>::iterator
            it = kTestFiles.begin(), ie = kTestFiles.end();
          it != ie; ++it) {
-      KTest *out = kTest_fromFile(it->c_str());
-      if (out) {
-        kTests.push_back(out);
-      } else {
+      if (!kTest_isKTestPack(it->c_str())) {
+        ReplayedTest test = { *it, 0, 0 };
+        replayed.push_back(test);
+        continue;
+      }
+      KTestPackReader *pack = kTestPack_open(it->c_str());
+      if (!pack) {
         klee_warning("unable to open: %s\n", (*it).c_str());
+        continue;
+      }
+      packs.push_back(pack);
+      for (unsigned i = 0, e = kTestPack_numTests(pack); i != e; ++i) {
+        ReplayedTest test = { *it + ":" + kTestPack_getName(pack, i), pack, i };
+        replayed.push_back(test);
       }
     }
 
@@ -1485,33 +2033,38 @@ int main(int argc, char **argv, char **envp) {
     }
 
     unsigned i=0;
-    for (std::vector<KTest*>::iterator
-           it = kTests.begin(), ie = kTests.end();
+    for (std::vector<ReplayedTest>::iterator
+           it = replayed.begin(), ie = replayed.end();
          it != ie; ++it) {
-      KTest *out = *it;
+      ++i;
+      KTest *out = it->pack ? kTestPack_get(it->pack, it->index)
+                            : kTest_fromFile(it->name.c_str());
+      if (!out) {
+        klee_warning("unable to open: %s\n", it->name.c_str());
+        continue;
+      }
       interpreter->setReplayKTest(out);
-      llvm::errs() << "KLEE: replaying: " << *it << " (" << kTest_numBytes(out)
-                   << " bytes)"
-                   << " (" << ++i << "/" << kTestFiles.size() << ")\n";
+      llvm::errs() << "KLEE: replaying: " << it->name << " ("
+                   << kTest_numBytes(out) << " bytes)"
+                   << " (" << i << "/" << replayed.size() << ")\n";
       // XXX should put envp in .ktest ?
       interpreter->runFunctionAsMain(mainFn, out->numArgs, out->args, pEnvp);
+      interpreter->setReplayKTest(0);
+      kTest_free(out);
       if (interrupted) break;
     }
-    interpreter->setReplayKTest(0);
-    while (!kTests.empty()) {
-      kTest_free(kTests.back());
-      kTests.pop_back();
+    while (!packs.empty()) {
+      kTestPack_free(packs.back());
+      packs.pop_back();
     }
   } else {
     std::vector<KTest *> seeds;
     for (std::vector<std::string>::iterator
            it = SeedOutFile.begin(), ie = SeedOutFile.end();
          it != ie; ++it) {
-      KTest *out = kTest_fromFile(it->c_str());
-      if (!out) {
+      if (!KleeHandler::loadKTests(*it, seeds)) {
         klee_error("unable to open: %s\n", (*it).c_str());
       }
-      seeds.push_back(out);
     }
     for (std::vector<std::string>::iterator
            it = SeedOutDir.begin(), ie = SeedOutDir.end();
@@ -1521,11 +2074,9 @@ int main(int argc, char **argv, char **envp) {
       for (std::vector<std::string>::iterator
              it2 = kTestFiles.begin(), ie = kTestFiles.end();
            it2 != ie; ++it2) {
-        KTest *out = kTest_fromFile(it2->c_str());
-        if (!out) {
+        if (!KleeHandler::loadKTests(*it2, seeds)) {
           klee_error("unable to open: %s\n", (*it2).c_str());
         }
-        seeds.push_back(out);
       }
       if (kTestFiles.empty()) {
         klee_error("seeds directory is empty: %s\n", (*it).c_str());
@@ -1551,6 +2102,10 @@ int main(int argc, char **argv, char **envp) {
     }
   }
 
+  handler->waitForTestWriters();
+  handler->retireRedundantTests();
+  handler->removeDuplicateTests();
+
   t[1] = time(NULL);
   strftime(buf, sizeof(buf), "Finished: %Y-%m-%d %H:%M:%S\n", localtime(&t[1]));
   handler->getInfoStream() << buf;
@@ -1604,6 +2159,11 @@ int main(int argc, char **argv, char **envp) {
         << handler->getNumPathsExplored() << "\n";
   stats << "KLEE: done: generated tests = "
         << handler->getNumTestCases() << "\n";
+  if (MinimizeTests)
+    stats << "KLEE: done: suppressed tests = "
+          << handler->getNumSuppressedTests() << "\n"
+          << "KLEE: done: removed tests = "
+          << handler->getNumRetiredTests() << "\n";
 
   bool useColors = llvm::errs().is_displayed();
   if (useColors)
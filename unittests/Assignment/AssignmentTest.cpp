@@ -1,6 +1,7 @@
 #include "klee/util/ArrayCache.h"
 #include "klee/util/Assignment.h"
 #include "gtest/gtest.h"
+#include <cstring>
 #include <iostream>
 #include <vector>
 
@@ -33,3 +34,69 @@ TEST(AssignmentTest, FoldNotOptimized)
   ASSERT_TRUE(asConstant != NULL);
   ASSERT_EQ(asConstant->getZExtValue(), (unsigned) 128);
 }
+
+TEST(AssignmentTest, FloatMatchesAPFloat)
+{
+  ArrayCache ac;
+  const Array* array = ac.CreateArray("float_array", /*size=*/ 8);
+  // Bind the array to the little-endian bit pattern of 1.0.
+  double one = 1.0;
+  uint64_t bits;
+  memcpy(&bits, &one, sizeof bits);
+  std::vector<const Array*> objects;
+  std::vector<unsigned char> value;
+  std::vector< std::vector<unsigned char> > values;
+  objects.push_back(array);
+  for (unsigned i = 0; i < 8; ++i)
+    value.push_back((bits >> (8 * i)) & 0xFF);
+  values.push_back(value);
+  Assignment assignment(objects, values);
+
+  ref<Expr> x = ExplicitFloatExpr::create(
+      Expr::createTempRead(array, Expr::Int64), Expr::Fl64);
+  ref<FConstantExpr> tiny = FConstantExpr::alloc(llvm::APFloat(1e-17));
+  ref<FConstantExpr> xValue = FConstantExpr::alloc(llvm::APFloat(one));
+
+  // Adding a value below half an ulp only changes the result when rounding
+  // up, so each mode has to be honoured.
+  llvm::APFloat::roundingMode modes[] = { llvm::APFloat::rmNearestTiesToEven,
+                                          llvm::APFloat::rmTowardNegative,
+                                          llvm::APFloat::rmTowardPositive,
+                                          llvm::APFloat::rmTowardZero };
+  for (unsigned i = 0; i < sizeof(modes) / sizeof(modes[0]); ++i) {
+    ref<Expr> sum = FAddExpr::create(x, tiny, modes[i]);
+    ref<Expr> evaluated =
+      assignment.evaluate(ExplicitIntExpr::create(sum, Expr::Int64));
+    ref<ConstantExpr> expected =
+      xValue->FAdd(tiny, modes[i])->ExplicitInt(Expr::Int64);
+    ASSERT_TRUE(isa<ConstantExpr>(evaluated));
+    ASSERT_EQ(expected->getZExtValue(),
+              cast<ConstantExpr>(evaluated)->getZExtValue());
+
+    // Narrowing rounds too.
+    ref<Expr> narrowed = FExtExpr::create(sum, Expr::Fl32, modes[i]);
+    evaluated =
+      assignment.evaluate(ExplicitIntExpr::create(narrowed, Expr::Int32));
+    expected = xValue->FAdd(tiny, modes[i])
+                 ->FExt(Expr::Fl32, modes[i])
+                 ->ExplicitInt(Expr::Int32);
+    ASSERT_TRUE(isa<ConstantExpr>(evaluated));
+    ASSERT_EQ(expected->getZExtValue(),
+              cast<ConstantExpr>(evaluated)->getZExtValue());
+  }
+
+  // Comparisons, classification and conversions.
+  ref<Expr> huge = FMulExpr::create(
+      x, FConstantExpr::alloc(llvm::APFloat(1e308)),
+      llvm::APFloat::rmNearestTiesToEven);
+  huge = FMulExpr::create(huge, huge, llvm::APFloat::rmNearestTiesToEven);
+  ASSERT_TRUE(assignment.evaluate(FOgtExpr::create(huge, x))->isTrue());
+  ASSERT_EQ((unsigned) 1, cast<ConstantExpr>(
+      assignment.evaluate(FIsInfExpr::create(huge)))->getZExtValue());
+  ref<Expr> three = FToSExpr::create(
+      FMulExpr::create(x, FConstantExpr::alloc(llvm::APFloat(-3.5)),
+                       llvm::APFloat::rmNearestTiesToEven),
+      Expr::Int32, llvm::APFloat::rmNearestTiesToEven);
+  ASSERT_EQ((uint64_t) (uint32_t) -3,
+            cast<ConstantExpr>(assignment.evaluate(three))->getZExtValue());
+}
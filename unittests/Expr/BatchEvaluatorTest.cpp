@@ -0,0 +1,122 @@
+//===-- BatchEvaluatorTest.cpp --------------------------------------------===//
+//
+//                     The KLEE Symbolic Virtual Machine
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+
+#include "gtest/gtest.h"
+
+#include "klee/Expr.h"
+#include "klee/util/ArrayCache.h"
+#include "klee/util/Assignment.h"
+#include "klee/util/BatchEvaluator.h"
+
+#include <cstring>
+
+using namespace klee;
+
+namespace {
+
+/// Check that the batch evaluator agrees with ExprEvaluator on \a e under
+/// assignments of \a array made of \a words.
+void checkAgainstEvaluator(const ref<Expr> &e, const Array *array,
+                           const uint64_t *words, unsigned numWords) {
+  BatchEvaluator be;
+  ASSERT_TRUE(be.add(e));
+
+  std::vector<Assignment*> assignments;
+  std::vector<const Array*> objects(1, array);
+  for (unsigned i = 0; i != BatchEvaluator::BatchSize; ++i) {
+    std::vector< std::vector<unsigned char> > values(
+      1, std::vector<unsigned char>(array->size));
+    for (unsigned j = 0; j != array->size / 8; ++j)
+      memcpy(&values[0][j * 8], &words[(i + j) % numWords], 8);
+    assignments.push_back(new Assignment(objects, values));
+  }
+  be.evaluate(&assignments[0], assignments.size());
+
+  for (unsigned i = 0; i != assignments.size(); ++i) {
+    ref<Expr> res = assignments[i]->evaluate(e);
+    uint64_t expected;
+    if (ConstantExpr *ce = dyn_cast<ConstantExpr>(res))
+      expected = ce->getZExtValue();
+    else
+      expected = cast<FConstantExpr>(res)->ExplicitInt(e->getWidth())
+                   ->getZExtValue();
+    EXPECT_EQ(expected, be.getValue(e, i)) << "lane " << i;
+    delete assignments[i];
+  }
+}
+
+TEST(BatchEvaluatorTest, Integers) {
+  ArrayCache ac;
+  const Array *array = ac.CreateArray("arr", 16);
+  ref<Expr> x = Expr::createTempRead(array, Expr::Int32);
+  ref<Expr> y = ExtractExpr::create(
+    ReadExpr::create(UpdateList(array, 0), ConstantExpr::alloc(9, 32)), 0,
+    Expr::Int8);
+  ref<Expr> y32 = SExtExpr::create(y, Expr::Int32);
+  const uint64_t words[] = { 0, 1, 0xFFFFFFFFULL, 0x80000000ULL,
+                             0x123456789ABCDEFULL, 0xFF00FF00FF00FF00ULL,
+                             37, 0x7F7F7F7F7F7F7F7FULL };
+  const unsigned numWords = sizeof(words) / sizeof(words[0]);
+
+  ref<Expr> exprs[] = {
+    AddExpr::create(x, y32),
+    MulExpr::create(x, SubExpr::create(x, y32)),
+    XorExpr::create(NotExpr::create(x), ShlExpr::create(x, ConstantExpr::alloc(3, 32))),
+    AShrExpr::create(x, ZExtExpr::create(y, Expr::Int32)),
+    LShrExpr::create(x, ZExtExpr::create(y, Expr::Int32)),
+    SelectExpr::create(SltExpr::create(x, y32), x, y32),
+    ConcatExpr::create(y, ExtractExpr::create(x, 4, Expr::Int16)),
+    AndExpr::create(UleExpr::create(y32, x), NeExpr::create(x, y32)),
+  };
+  for (unsigned i = 0; i != sizeof(exprs) / sizeof(exprs[0]); ++i)
+    checkAgainstEvaluator(exprs[i], array, words, numWords);
+}
+
+TEST(BatchEvaluatorTest, Floats) {
+  ArrayCache ac;
+  const Array *array = ac.CreateArray("arr", 16);
+  ref<Expr> d = ExplicitFloatExpr::create(
+    Expr::createTempRead(array, Expr::Int64), Expr::Fl64);
+  ref<Expr> f = FExtExpr::create(d, Expr::Fl32,
+                                 llvm::APFloat::rmNearestTiesToEven);
+  ref<Expr> one = FConstantExpr::alloc(llvm::APFloat(1.0f));
+  double values[] = { 0.0, -0.0, 1.5, -3.25, 1e300, 1e-310, 2.0 / 3.0, 7.0 };
+  uint64_t words[sizeof(values) / sizeof(values[0])];
+  memcpy(words, values, sizeof(values));
+  const unsigned numWords = sizeof(words) / sizeof(words[0]);
+
+  llvm::APFloat::roundingMode rne = llvm::APFloat::rmNearestTiesToEven;
+  ref<Expr> exprs[] = {
+    ExplicitIntExpr::create(FAddExpr::create(f, one, rne), Expr::Int32),
+    ExplicitIntExpr::create(FMulExpr::create(d, d, rne), Expr::Int64),
+    ExplicitIntExpr::create(
+      FSqrtExpr::create(FAbsExpr::create(d), rne), Expr::Int64),
+    ExplicitIntExpr::create(
+      FExtExpr::create(FDivExpr::create(one, f, rne), Expr::Fl64, rne),
+      Expr::Int64),
+    FOltExpr::create(FExtExpr::create(f, Expr::Fl64, rne), d),
+    FUeqExpr::create(f, one),
+    FIsInfExpr::create(f),
+  };
+  for (unsigned i = 0; i != sizeof(exprs) / sizeof(exprs[0]); ++i)
+    checkAgainstEvaluator(exprs[i], array, words, numWords);
+}
+
+TEST(BatchEvaluatorTest, Unsupported) {
+  ArrayCache ac;
+  const Array *array = ac.CreateArray("arr", 16);
+  ref<Expr> x = Expr::createTempRead(array, Expr::Int32);
+  BatchEvaluator be;
+  EXPECT_FALSE(be.add(UDivExpr::create(ConstantExpr::alloc(7, 32), x)));
+  EXPECT_FALSE(be.add(ReadExpr::create(UpdateList(array, 0),
+                                       ExtractExpr::create(x, 0, 32))));
+  EXPECT_TRUE(be.add(AddExpr::create(x, ConstantExpr::alloc(1, 32))));
+}
+
+}
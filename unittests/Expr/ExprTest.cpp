@@ -10,8 +10,12 @@
 #include <iostream>
 #include "gtest/gtest.h"
 
+#include "klee/Constraints.h"
 #include "klee/Expr.h"
 #include "klee/util/ArrayCache.h"
+#include "klee/util/FloatLowering.h"
+
+#include <limits>
 
 using namespace klee;
 
@@ -264,4 +268,418 @@ TEST(ExprTest, ReadExprFoldingSymbolicIndexUpdate) {
     EXPECT_EQ(Expr::Read, read.get()->getKind());
   }
 }
+
+TEST(ExprTest, Footprint) {
+  ArrayCache ac;
+  const Array *a = ac.CreateArray("a", 16);
+  const Array *b = ac.CreateArray("b", 16);
+  const Array *c = ac.CreateArray("c", 16);
+  ref<Expr> x = Expr::createTempRead(a, Expr::Int32);
+  ref<Expr> y = Expr::createTempRead(b, Expr::Int32);
+
+  // A symbolic write into c, read at an index taken from b.
+  UpdateList ul(c, 0);
+  ul.extend(ExtractExpr::create(x, 0, Expr::Int32),
+            ConstantExpr::create(1, Expr::Int8));
+  ref<Expr> read = ReadExpr::create(ul, y);
+  ref<Expr> e = AddExpr::create(ZExtExpr::create(read, Expr::Int32), x);
+
+  // The arrays come in the order of findSymbolicObjects: a through the
+  // update, then c, then b through the index.
+  const ArrayFootprint &fp = e->getFootprint();
+  ASSERT_EQ(3U, fp.arrays.size());
+  EXPECT_EQ(a, fp.arrays[0]);
+  EXPECT_EQ(c, fp.arrays[1]);
+  EXPECT_EQ(b, fp.arrays[2]);
+  EXPECT_EQ(&fp, &e->getFootprint());
+
+  // Kids reading the same arrays share their footprint.
+  ref<Expr> sum = AddExpr::create(x, MulExpr::create(x, x));
+  EXPECT_EQ(&x->getFootprint(), &sum->getFootprint());
+  EXPECT_TRUE(fp.intersects(y->getFootprint()));
+  EXPECT_FALSE(x->getFootprint().intersects(y->getFootprint()));
+  EXPECT_TRUE(ConstantExpr::create(3, Expr::Int8)->getFootprint().empty());
+}
+
+// Lower an unfolded floating-point operation on constants (the lowered
+// expression then folds to bits) and compare with folding it directly.
+void checkLowering(FloatLowering &fl, const ref<Expr> &unfolded,
+                   const ref<Expr> &folded) {
+  ref<Expr> lowered = fl.lower(unfolded);
+  ASSERT_EQ(Expr::Constant, lowered->getKind());
+  llvm::APInt got = cast<ConstantExpr>(lowered)->getAPValue();
+
+  if (FConstantExpr *fce = dyn_cast<FConstantExpr>(folded)) {
+    const llvm::APFloat &expected = fce->getAPValue();
+    // NaN payloads are not required to match.
+    if (expected.isNaN()) {
+      EXPECT_TRUE(llvm::APFloat(expected.getSemantics(), got).isNaN());
+      return;
+    }
+    EXPECT_EQ(expected.bitcastToAPInt(), got) << unfolded;
+  } else {
+    EXPECT_EQ(cast<ConstantExpr>(folded)->getAPValue(), got) << unfolded;
+  }
+}
+
+TEST(ExprTest, FloatLowering) {
+  const double values[] = { 0.0, -0.0, 1.0, -1.5, 2.5, 3.0, 0.1, 1e-310,
+                            -4.9e-324, 1e300, -1.7976931348623157e308,
+                            std::numeric_limits<double>::infinity(),
+                            -std::numeric_limits<double>::infinity(),
+                            std::numeric_limits<double>::quiet_NaN() };
+  const llvm::APFloat::roundingMode modes[] = {
+    llvm::APFloat::rmNearestTiesToEven, llvm::APFloat::rmTowardPositive,
+    llvm::APFloat::rmTowardNegative, llvm::APFloat::rmTowardZero
+  };
+  const unsigned numValues = sizeof(values) / sizeof(values[0]);
+  const unsigned numModes = sizeof(modes) / sizeof(modes[0]);
+  FloatLowering fl;
+
+  for (unsigned i = 0; i < numValues; ++i) {
+    for (unsigned j = 0; j < numValues; ++j) {
+      ref<Expr> ds[2] = { FConstantExpr::alloc(llvm::APFloat(values[i])),
+                          FConstantExpr::alloc(llvm::APFloat(values[j])) };
+      ref<Expr> fs[2] = {
+        FConstantExpr::alloc(llvm::APFloat((float)values[i])),
+        FConstantExpr::alloc(llvm::APFloat((float)values[j]))
+      };
+
+      for (unsigned k = 0; k < 2; ++k) {
+        ref<Expr> a = k ? fs[0] : ds[0], b = k ? fs[1] : ds[1];
+        checkLowering(fl, FOltExpr::alloc(a, b), FOltExpr::create(a, b));
+        checkLowering(fl, FUeqExpr::alloc(a, b), FUeqExpr::create(a, b));
+        checkLowering(fl, FOgeExpr::alloc(a, b), FOgeExpr::create(a, b));
+        checkLowering(fl, FMinExpr::alloc(a, b), FMinExpr::create(a, b));
+        checkLowering(fl, FMaxExpr::alloc(a, b), FMaxExpr::create(a, b));
+
+        for (unsigned m = 0; m < numModes; ++m) {
+          llvm::APFloat::roundingMode rm = modes[m];
+          checkLowering(fl, FAddExpr::alloc(a, b, rm),
+                        FAddExpr::create(a, b, rm));
+          checkLowering(fl, FSubExpr::alloc(a, b, rm),
+                        FSubExpr::create(a, b, rm));
+          checkLowering(fl, FMulExpr::alloc(a, b, rm),
+                        FMulExpr::create(a, b, rm));
+          checkLowering(fl, FDivExpr::alloc(a, b, rm),
+                        FDivExpr::create(a, b, rm));
+        }
+      }
+    }
+
+    ref<Expr> d = FConstantExpr::alloc(llvm::APFloat(values[i]));
+    ref<Expr> f = FConstantExpr::alloc(llvm::APFloat((float)values[i]));
+    for (unsigned m = 0; m < numModes; ++m) {
+      llvm::APFloat::roundingMode rm = modes[m];
+      checkLowering(fl, FSqrtExpr::alloc(d, rm), FSqrtExpr::create(d, rm));
+      checkLowering(fl, FNearbyIntExpr::alloc(f, rm),
+                    FNearbyIntExpr::create(f, rm));
+      checkLowering(fl, FExtExpr::alloc(d, Expr::Fl32, rm),
+                    FExtExpr::create(d, Expr::Fl32, rm));
+    }
+    checkLowering(fl, FExtExpr::alloc(f, Expr::Fl64, modes[0]),
+                  FExtExpr::create(f, Expr::Fl64, modes[0]));
+    checkLowering(fl, FToSExpr::alloc(d, Expr::Int32, modes[0]),
+                  FToSExpr::create(d, Expr::Int32, modes[0]));
+    checkLowering(fl, FToUExpr::alloc(f, Expr::Int16, modes[0]),
+                  FToUExpr::create(f, Expr::Int16, modes[0]));
+    checkLowering(fl, FpClassifyExpr::alloc(d), FpClassifyExpr::create(d));
+    checkLowering(fl, FIsInfExpr::alloc(f), FIsInfExpr::create(f));
+  }
+
+  const uint64_t ints[] = { 0, 1, 0x7fffffffull, 0x80000001ull,
+                            0xffffffffull, 0x1000001ull };
+  for (unsigned i = 0; i < sizeof(ints) / sizeof(ints[0]); ++i) {
+    ref<Expr> x = ConstantExpr::create(ints[i], Expr::Int32);
+    for (unsigned m = 0; m < numModes; ++m) {
+      llvm::APFloat::roundingMode rm = modes[m];
+      checkLowering(fl, UToFExpr::alloc(x, Expr::Fl32, rm),
+                    UToFExpr::create(x, Expr::Fl32, rm));
+      checkLowering(fl, SToFExpr::alloc(x, Expr::Fl32, rm),
+                    SToFExpr::create(x, Expr::Fl32, rm));
+    }
+  }
+
+  // x87 precision and FRem have no lowering.
+  ref<Expr> one = FConstantExpr::alloc(llvm::APFloat(1.0));
+  EXPECT_TRUE(FloatLowering::canLower(FOltExpr::alloc(one, one)));
+  EXPECT_FALSE(FloatLowering::canLower(
+      FOltExpr::alloc(FRemExpr::alloc(one, one, modes[0]), one)));
+  EXPECT_FALSE(FloatLowering::canLower(ExplicitIntExpr::alloc(
+      FExtExpr::alloc(one, Expr::Fl80, modes[0]), Expr::Int64)));
+}
+
+TEST(ExprTest, FConstantRepresentation) {
+  // Common values are shared, others are not.
+  ref<FConstantExpr> one = FConstantExpr::alloc(llvm::APFloat(1.0f));
+  EXPECT_EQ(one.get(), FConstantExpr::alloc(llvm::APFloat(1.0f)).get());
+  EXPECT_NE(one.get(), FConstantExpr::alloc(llvm::APFloat(1.0)).get());
+  ref<FConstantExpr> x = FConstantExpr::alloc(llvm::APFloat(1.5));
+  EXPECT_NE(x.get(), FConstantExpr::alloc(llvm::APFloat(1.5)).get());
+  EXPECT_EQ(ref<Expr>(x), ref<Expr>(FConstantExpr::alloc(llvm::APFloat(1.5))));
+
+  // The value round-trips through the stored bits.
+  EXPECT_EQ(Expr::Fl32, one->getWidth());
+  EXPECT_EQ(Expr::Fl64, x->getWidth());
+  EXPECT_EQ(1.5, x->getAPValue().convertToDouble());
+  ref<FConstantExpr> negZero = FConstantExpr::alloc(llvm::APFloat(-0.0));
+  EXPECT_TRUE(negZero->isZero());
+  EXPECT_TRUE(negZero->getAPValue().isNegative());
+  EXPECT_FALSE(x->isZero());
+  EXPECT_EQ(0x3FF8000000000000ULL,
+            x->ExplicitInt(Expr::Int64)->getZExtValue());
+}
+
+TEST(ExprTest, FusedMultiplyAdd) {
+  const llvm::APFloat::roundingMode modes[] = {
+    llvm::APFloat::rmNearestTiesToEven, llvm::APFloat::rmTowardPositive,
+    llvm::APFloat::rmTowardNegative, llvm::APFloat::rmTowardZero
+  };
+  // 0.1 * 10 - 1 is 2^-54 exactly, which separate operations round away.
+  const double args[][3] = { { 0.1, 10.0, -1.0 }, { 3.0, 1e308, -1e308 },
+                             { 1e-200, 1e-200, 0.0 }, { -0.0, 5.0, 0.0 } };
+  for (unsigned i = 0; i < sizeof(args) / sizeof(args[0]); ++i) {
+    for (unsigned m = 0; m < sizeof(modes) / sizeof(modes[0]); ++m) {
+      for (unsigned k = 0; k < 2; ++k) {
+        ref<Expr> ops[3];
+        llvm::APFloat expected = k ? llvm::APFloat((float) args[i][0])
+                                   : llvm::APFloat(args[i][0]);
+        for (unsigned j = 0; j < 3; ++j)
+          ops[j] = FConstantExpr::alloc(k ? llvm::APFloat((float) args[i][j])
+                                          : llvm::APFloat(args[i][j]));
+        expected.fusedMultiplyAdd(cast<FConstantExpr>(ops[1])->getAPValue(),
+                                  cast<FConstantExpr>(ops[2])->getAPValue(),
+                                  modes[m]);
+        ref<Expr> res = FFmaExpr::create(ops[0], ops[1], ops[2], modes[m]);
+        ASSERT_TRUE(isa<FConstantExpr>(res));
+        EXPECT_TRUE(cast<FConstantExpr>(res)->getAPValue().bitwiseIsEqual(
+            expected));
+      }
+    }
+  }
+
+  ref<Expr> tenth = FConstantExpr::alloc(llvm::APFloat(0.1));
+  ref<Expr> ten = FConstantExpr::alloc(llvm::APFloat(10.0));
+  ref<Expr> minusOne = FConstantExpr::alloc(llvm::APFloat(-1.0));
+  ref<Expr> fused = FFmaExpr::create(tenth, ten, minusOne, modes[0]);
+  EXPECT_FALSE(cast<FConstantExpr>(fused)->isZero());
+  EXPECT_TRUE(FAddExpr::create(FMulExpr::create(tenth, ten, modes[0]),
+                               minusOne, modes[0])->isZero());
+
+  // Nodes differ in their rounding mode, which rebuilding keeps.
+  ref<Expr> x = FAddExpr::alloc(tenth, ten, modes[0]);
+  ref<Expr> a = FFmaExpr::create(x, ten, minusOne, modes[0]);
+  ref<Expr> b = FFmaExpr::create(x, ten, minusOne, modes[1]);
+  ASSERT_TRUE(isa<FFmaExpr>(a));
+  EXPECT_NE(a, b);
+  EXPECT_EQ(a, FFmaExpr::create(x, ten, minusOne, modes[0]));
+  ref<Expr> kids[3] = { a->getKid(0), a->getKid(1), a->getKid(2) };
+  EXPECT_EQ(a, a->rebuild(kids));
+  EXPECT_EQ(modes[1], cast<FFmaExpr>(b->rebuild(kids))->getRoundingMode());
+  EXPECT_FALSE(FloatLowering::canLower(FOltExpr::alloc(a, ten)));
+}
+
+TEST(ExprTest, ConstraintRewriting) {
+  ArrayCache ac;
+  const Array *a = ac.CreateArray("a", 4);
+  const Array *b = ac.CreateArray("b", 4);
+  ref<Expr> x = Expr::createTempRead(a, 8);
+  ref<Expr> y = Expr::createTempRead(b, 8);
+  ref<Expr> c3 = getConstant(3, 8), c10 = getConstant(10, 8);
+
+  ConstraintManager cm;
+  cm.addConstraint(UltExpr::create(AddExpr::create(x, y), c10));
+  ref<Expr> yBound = UltExpr::create(y, c10);
+  cm.addConstraint(yBound);
+  ConstraintManager copy(cm);
+
+  // Only the constraint reading a is rewritten; the equality is kept.
+  cm.addConstraint(EqExpr::create(c3, x));
+  ASSERT_EQ(3U, cm.size());
+  ConstraintManager::constraint_iterator it = cm.begin();
+  EXPECT_EQ(UltExpr::create(AddExpr::create(c3, y), c10), *it++);
+  EXPECT_EQ(yBound, *it++);
+  EXPECT_EQ(EqExpr::create(c3, x), *it++);
+
+  EXPECT_EQ(c3, cm.simplifyExpr(x));
+  EXPECT_EQ(ref<Expr>(ConstantExpr::alloc(1, Expr::Bool)),
+            cm.simplifyExpr(yBound));
+
+  // Copies share the constraints until changed.
+  EXPECT_EQ(2U, copy.size());
+  EXPECT_EQ(x, copy.simplifyExpr(x));
+}
+
+TEST(ExprTest, ConstraintSimplifyCache) {
+  ArrayCache ac;
+  const Array *a = ac.CreateArray("a", 4);
+  const Array *b = ac.CreateArray("b", 4);
+  ref<Expr> x = Expr::createTempRead(a, 8);
+  ref<Expr> y = Expr::createTempRead(b, 8);
+  ref<Expr> xBound = UltExpr::create(x, getConstant(5, 8));
+  ref<Expr> yBound = UltExpr::create(y, getConstant(10, 8));
+  ref<Expr> t = ConstantExpr::alloc(1, Expr::Bool);
+
+  ConstraintManager cm;
+  cm.addConstraint(yBound);
+  EXPECT_EQ(xBound, cm.simplifyExpr(xBound));
+  EXPECT_EQ(t, cm.simplifyExpr(yBound));
+  ConstraintManager copy(cm);
+
+  // A new constraint changes what was cached for it, in this list only.
+  cm.addConstraint(xBound);
+  EXPECT_EQ(t, cm.simplifyExpr(xBound));
+  EXPECT_EQ(t, cm.simplifyExpr(yBound));
+  EXPECT_EQ(xBound, copy.simplifyExpr(xBound));
+  EXPECT_EQ(t, copy.simplifyExpr(yBound));
+}
+
+TEST(ExprTest, ConstraintSharing) {
+  ArrayCache ac;
+  const Array *a = ac.CreateArray("a", 4);
+  ref<Expr> x = Expr::createTempRead(a, 32);
+
+  ConstraintManager parent;
+  for (unsigned i = 0; i != 100; ++i)
+    parent.addConstraint(UgtExpr::create(x, getConstant(i, 32)));
+  ConstraintManager child(parent);
+
+  // Both sides of a fork add to the shared constraints independently.
+  parent.addConstraint(UltExpr::create(x, getConstant(1000, 32)));
+  child.addConstraint(UltExpr::create(x, getConstant(2000, 32)));
+  ASSERT_EQ(101U, parent.size());
+  ASSERT_EQ(101U, child.size());
+  EXPECT_FALSE(parent == child);
+  EXPECT_EQ(UltExpr::create(x, getConstant(1000, 32)), parent.back());
+  EXPECT_EQ(UltExpr::create(x, getConstant(2000, 32)), child.back());
+
+  unsigned i = 0;
+  for (ConstraintManager::const_iterator it = child.begin(),
+                                         ie = child.end();
+       it != ie; ++it, ++i)
+    if (i < 100)
+      EXPECT_EQ(UgtExpr::create(x, getConstant(i, 32)), *it);
+  EXPECT_EQ(101U, i);
+  EXPECT_EQ(UgtExpr::create(x, getConstant(70, 32)), *(child.begin() + 70));
+  EXPECT_TRUE(child.begin() + 101 == child.end());
+
+  ConstraintManager copy(child);
+  EXPECT_TRUE(copy == child);
+}
+
+TEST(ExprTest, ConstraintSimplify) {
+  ArrayCache ac;
+  const Array *a = ac.CreateArray("a", 8);
+  ref<Expr> x =
+      ExplicitFloatExpr::create(Expr::createTempRead(a, 64), Expr::Fl64);
+  ref<Expr> one = FConstantExpr::alloc(llvm::APFloat(1.0));
+  ref<Expr> two = FConstantExpr::alloc(llvm::APFloat(2.0));
+  ref<Expr> ten = FConstantExpr::alloc(llvm::APFloat(10.0));
+
+  ConstraintManager cm;
+  cm.addConstraint(Expr::createIsZero(FIsNanExpr::create(x)));
+  cm.addConstraint(FOltExpr::create(x, ten));
+  cm.addConstraint(FOltExpr::create(x, two));
+  cm.addConstraint(Expr::createIsZero(FOltExpr::create(x, one)));
+  cm.addConstraint(Expr::createIsZero(
+      Expr::createIsZero(FIsFiniteExpr::create(x))));
+  ASSERT_EQ(5U, cm.size());
+
+  // x < 2 subsumes x < 10 and makes x a number. As !(x < 1) holds for a
+  // NaN, it does not bound x from below, so x may still be infinite.
+  EXPECT_TRUE(cm.simplify());
+  ASSERT_EQ(3U, cm.size());
+  ConstraintManager::constraint_iterator it = cm.begin();
+  EXPECT_EQ(FOltExpr::create(x, two), *it++);
+  EXPECT_EQ(Expr::createIsZero(FOltExpr::create(x, one)), *it++);
+  EXPECT_FALSE(cm.simplify());
+
+  // With an ordered lower bound, x is finite.
+  cm.addConstraint(FOgeExpr::create(x, one));
+  EXPECT_TRUE(cm.simplify());
+  ASSERT_EQ(2U, cm.size());
+  EXPECT_EQ(FOltExpr::create(x, two), *cm.begin());
+  EXPECT_EQ(FOgeExpr::create(x, one), cm.back());
+}
+
+TEST(ExprTest, CompareSharedDAG) {
+  ArrayCache ac;
+  const Array *a = ac.CreateArray("a", 4);
+  ref<Expr> x = Expr::createTempRead(a, 32);
+
+  // Two separately built copies of x * 2^64, each a chain of 64 additions
+  // of a node to itself. Compared as trees they would take 2^64 steps.
+  ref<Expr> left = x, right = x;
+  for (unsigned i = 0; i != 64; ++i) {
+    left = AddExpr::alloc(left, left);
+    right = AddExpr::alloc(right, right);
+  }
+  EXPECT_EQ(0, left->compare(*right));
+  EXPECT_EQ(0, right->compare(*left));
+
+  // A different leaf orders the chains, the same way from either side.
+  ref<Expr> other = AddExpr::alloc(x, getConstant(1, 32));
+  for (unsigned i = 0; i != 64; ++i)
+    other = AddExpr::alloc(other, other);
+  int order = left->compare(*other);
+  EXPECT_NE(0, order);
+  EXPECT_EQ(-order, other->compare(*left));
+}
+
+TEST(ExprTest, HashDistinguishes) {
+  ArrayCache ac;
+  const Array *a = ac.CreateArray("a", 4);
+  ref<Expr> x = Expr::createTempRead(a, 32);
+
+  // Nodes which differ only in their kind, rounding mode or width.
+  EXPECT_NE(ZExtExpr::alloc(x, 64)->hash(), SExtExpr::alloc(x, 64)->hash());
+  ref<Expr> f = FConstantExpr::alloc(llvm::APFloat(1.5f));
+  ref<Expr> g = FConstantExpr::alloc(llvm::APFloat(0.1f));
+  EXPECT_NE(FAddExpr::alloc(f, g, llvm::APFloat::rmNearestTiesToEven)->hash(),
+            FAddExpr::alloc(f, g, llvm::APFloat::rmTowardZero)->hash());
+  EXPECT_NE(FExtExpr::alloc(f, Expr::Fl64,
+                            llvm::APFloat::rmNearestTiesToEven)->hash(),
+            FExtExpr::alloc(f, Expr::Fl80,
+                            llvm::APFloat::rmNearestTiesToEven)->hash());
+
+  // The same two writes, in either order.
+  UpdateList first(a, 0), second(a, 0);
+  first.extend(getConstant(0, 32), getConstant(1, 8));
+  first.extend(getConstant(1, 32), getConstant(2, 8));
+  second.extend(getConstant(1, 32), getConstant(2, 8));
+  second.extend(getConstant(0, 32), getConstant(1, 8));
+  EXPECT_NE(first.head->hash(), second.head->hash());
+  EXPECT_NE(ReadExpr::alloc(first, x)->hash(),
+            ReadExpr::alloc(second, x)->hash());
+}
+
+TEST(ExprTest, ArrayReclamation) {
+  ArrayCache ac;
+  const Array *a = ac.CreateArray("a", 4);
+  const Array *b = ac.CreateArray("b", 4);
+  std::vector<const Array *> unreferenced;
+
+  // An array not read yet is not taken for an unreferenced one.
+  ac.getUnreferencedArrays(unreferenced);
+  EXPECT_TRUE(unreferenced.empty());
+
+  ref<Expr> x = Expr::createTempRead(a, 32);
+  {
+    ref<Expr> y = Expr::createTempRead(b, 32);
+    ac.getUnreferencedArrays(unreferenced);
+    EXPECT_TRUE(unreferenced.empty());
+  }
+
+  // Only the array whose reads are gone is reclaimed.
+  ac.getUnreferencedArrays(unreferenced);
+  ASSERT_EQ(1u, unreferenced.size());
+  EXPECT_EQ(b, unreferenced[0]);
+  ac.reclaimArrays(unreferenced);
+  EXPECT_EQ(1u, ac.getNumSymbolicArrays());
+
+  // The name can be used again, and the cache still hands out the other.
+  EXPECT_EQ(a, ac.CreateArray("a", 4));
+  ac.CreateArray("b", 4);
+  EXPECT_EQ(2u, ac.getNumSymbolicArrays());
+}
 }
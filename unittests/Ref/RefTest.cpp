@@ -15,6 +15,10 @@
 #include "klee/util/Ref.h"
 using klee::ref;
 
+#ifdef KLEE_ATOMIC_REFCOUNT
+#include <pthread.h>
+#endif
+
 int finished = 0;
 
 struct Expr
@@ -38,3 +42,29 @@ TEST(RefTest, SelfAssign)
   EXPECT_EQ(r_e->refCount, 1);
   finished = 1;
 }
+
+#ifdef KLEE_ATOMIC_REFCOUNT
+struct SharedExpr {
+  unsigned refCount;
+  SharedExpr() : refCount(0) {}
+};
+
+static void *copyRefs(void *arg) {
+  const ref<SharedExpr> &r = *static_cast<ref<SharedExpr> *>(arg);
+  for (unsigned i = 0; i != 100000; ++i) {
+    ref<SharedExpr> copy(r);
+  }
+  return 0;
+}
+
+TEST(RefTest, SharedBetweenThreads)
+{
+  ref<SharedExpr> r(new SharedExpr());
+  pthread_t threads[4];
+  for (unsigned i = 0; i != 4; ++i)
+    ASSERT_EQ(pthread_create(&threads[i], 0, copyRefs, &r), 0);
+  for (unsigned i = 0; i != 4; ++i)
+    pthread_join(threads[i], 0);
+  EXPECT_EQ(r->refCount, 1u);
+}
+#endif
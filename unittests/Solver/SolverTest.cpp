@@ -8,12 +8,18 @@
 //===----------------------------------------------------------------------===//
 
 #include <iostream>
+#include <limits>
+#include <pthread.h>
+#include <stdlib.h>
+#include <unistd.h>
 #include "gtest/gtest.h"
 
 #include "klee/CommandLine.h"
+#include "klee/Config/config.h"
 #include "klee/Constraints.h"
 #include "klee/Expr.h"
 #include "klee/Solver.h"
+#include "klee/SolverImpl.h"
 #include "klee/util/ArrayCache.h"
 #include "llvm/ADT/StringExtras.h"
 
@@ -166,4 +172,590 @@ TEST(SolverTest, Evaluation) {
   delete solver;
 }
 
+TEST(SolverTest, FastCexFloat) {
+  // The dummy solver fails every query, so whatever is answered here is
+  // answered by the fast counterexample solver alone.
+  Solver *solver = createFastCexSolver(createDummySolver());
+  llvm::APFloat::roundingMode rm = llvm::APFloat::rmNearestTiesToEven;
+
+  const Array *array = ac.CreateArray("fastCexFloat", 4);
+  ref<Expr> x = ExplicitFloatExpr::create(Expr::createTempRead(array,
+                                                               Expr::Int32),
+                                          Expr::Fl32);
+  bool res;
+
+  // x < 1.5 does not imply x > 2.0.
+  ConstraintManager lessThan;
+  lessThan.addConstraint(
+      FOltExpr::create(x, FConstantExpr::alloc(llvm::APFloat(1.5f))));
+  bool success = solver->mustBeTrue(
+      Query(lessThan,
+            FOgtExpr::create(x, FConstantExpr::alloc(llvm::APFloat(2.0f)))),
+      res);
+  EXPECT_TRUE(success);
+  if (success)
+    EXPECT_FALSE(res);
+
+  // A NaN is not equal to itself.
+  ConstraintManager isNan;
+  isNan.addConstraint(EqExpr::create(ConstantExpr::create(1, Expr::Int32),
+                                     FIsNanExpr::create(x)));
+  success = solver->mustBeTrue(Query(isNan, FOeqExpr::create(x, x)), res);
+  EXPECT_TRUE(success);
+  if (success)
+    EXPECT_FALSE(res);
+
+  // An unsigned byte converted to float is never negative.
+  const Array *byte = ac.CreateArray("fastCexFloatByte", 1);
+  ref<Expr> u = UToFExpr::create(
+      ZExtExpr::create(Expr::createTempRead(byte, Expr::Int8), Expr::Int32),
+      Expr::Fl32, rm);
+  success = solver->mustBeTrue(
+      Query(ConstraintManager(),
+            FOgeExpr::create(u, FConstantExpr::alloc(llvm::APFloat(0.0f)))),
+      res);
+  EXPECT_TRUE(success);
+  if (success)
+    EXPECT_TRUE(res);
+
+  delete solver;
+}
+
+TEST(SolverTest, TruthMany) {
+  Solver *solver = klee::createCoreSolver(CoreSolverToUse);
+
+  const Array *array = ac.CreateArray("truthMany", 1);
+  ref<Expr> x = Expr::createTempRead(array, Expr::Int8);
+  ConstraintManager constraints;
+  constraints.addConstraint(
+      UltExpr::create(x, ConstantExpr::create(10, Expr::Int8)));
+
+  // One expression for each switch case target, plus constants, which the
+  // batch answers without the solver.
+  std::vector<ref<Expr> > exprs;
+  for (unsigned i = 8; i != 12; ++i)
+    exprs.push_back(EqExpr::create(x, ConstantExpr::create(i, Expr::Int8)));
+  exprs.push_back(UleExpr::create(x, ConstantExpr::create(9, Expr::Int8)));
+  exprs.push_back(ConstantExpr::alloc(1, Expr::Bool));
+  exprs.push_back(ConstantExpr::alloc(0, Expr::Bool));
+
+  std::vector<bool> may, must;
+  ASSERT_TRUE(solver->mayBeTrueMany(constraints, exprs, may));
+  ASSERT_TRUE(solver->mustBeTrueMany(constraints, exprs, must));
+  ASSERT_EQ(exprs.size(), may.size());
+  ASSERT_EQ(exprs.size(), must.size());
+  for (unsigned i = 0; i != exprs.size(); ++i) {
+    bool res;
+    ASSERT_TRUE(solver->mayBeTrue(Query(constraints, exprs[i]), res));
+    EXPECT_EQ(res, may[i]);
+    ASSERT_TRUE(solver->mustBeTrue(Query(constraints, exprs[i]), res));
+    EXPECT_EQ(res, must[i]);
+  }
+  EXPECT_TRUE(may[0] && may[1] && !may[2] && !may[3]);
+  EXPECT_TRUE(must[4]);
+
+  delete solver;
+}
+
+/// Forwards to another solver, counting the single truth queries and the
+/// batches that reach it.
+class CountingSolver : public SolverImpl {
+  Solver *solver;
+
+public:
+  unsigned queries, batches;
+
+  CountingSolver(Solver *_solver) : solver(_solver), queries(0), batches(0) {}
+  ~CountingSolver() { delete solver; }
+
+  bool computeTruth(const Query &query, bool &isValid) {
+    ++queries;
+    return solver->impl->computeTruth(query, isValid);
+  }
+  bool computeTruthMany(const ConstraintManager &constraints,
+                        const std::vector<ref<Expr> > &exprs,
+                        std::vector<bool> &isValid) {
+    ++batches;
+    return solver->impl->computeTruthMany(constraints, exprs, isValid);
+  }
+  bool computeValue(const Query &query, ref<Expr> &result) {
+    return solver->impl->computeValue(query, result);
+  }
+  bool computeInitialValues(const Query &query,
+                            const std::vector<const Array *> &objects,
+                            std::vector<std::vector<unsigned char> > &values,
+                            bool &hasSolution) {
+    return solver->impl->computeInitialValues(query, objects, values,
+                                              hasSolution);
+  }
+  SolverRunStatus getOperationStatusCode() {
+    return solver->impl->getOperationStatusCode();
+  }
+};
+
+TEST(SolverTest, TruthManyThroughCaches) {
+  CountingSolver *counter =
+      new CountingSolver(klee::createCoreSolver(CoreSolverToUse));
+  // The default chain below the executor's own solvers.
+  Solver *solver = createIndependentSolver(
+      createCachingSolver(createCexCachingSolver(new Solver(counter))));
+
+  const Array *xs = ac.CreateArray("truthManyX", 1);
+  const Array *ys = ac.CreateArray("truthManyY", 1);
+  ref<Expr> x = Expr::createTempRead(xs, Expr::Int8);
+  ref<Expr> y = Expr::createTempRead(ys, Expr::Int8);
+  ConstraintManager constraints;
+  constraints.addConstraint(
+      UltExpr::create(x, ConstantExpr::create(10, Expr::Int8)));
+  constraints.addConstraint(
+      EqExpr::create(y, ConstantExpr::create(3, Expr::Int8)));
+
+  std::vector<ref<Expr> > exprs;
+  for (unsigned i = 8; i != 12; ++i)
+    exprs.push_back(Expr::createIsZero(
+        EqExpr::create(x, ConstantExpr::create(i, Expr::Int8))));
+  exprs.push_back(UleExpr::create(x, ConstantExpr::create(9, Expr::Int8)));
+
+  // The expressions over x need the same constraints, and go down to the
+  // core solver as one batch.
+  std::vector<bool> must;
+  ASSERT_TRUE(solver->mustBeTrueMany(constraints, exprs, must));
+  ASSERT_EQ(exprs.size(), must.size());
+  EXPECT_TRUE(!must[0] && !must[1] && must[2] && must[3] && must[4]);
+  EXPECT_EQ(1u, counter->batches);
+  EXPECT_EQ(0u, counter->queries);
+
+  // The caches answer the same batch again.
+  std::vector<bool> again;
+  ASSERT_TRUE(solver->mustBeTrueMany(constraints, exprs, again));
+  EXPECT_EQ(must, again);
+  EXPECT_EQ(1u, counter->batches);
+  EXPECT_EQ(0u, counter->queries);
+
+  delete solver;
+}
+
+TEST(SolverTest, Range) {
+  Solver *oracle = klee::createCoreSolver(CoreSolverToUse);
+  Solver *solver =
+      createValidatingSolver(klee::createCoreSolver(CoreSolverToUse), oracle);
+  llvm::APFloat::roundingMode rm = llvm::APFloat::rmNearestTiesToEven;
+
+  const Array *array = ac.CreateArray("range", 2);
+  ref<Expr> a = Expr::createTempRead(array, Expr::Int16);
+  ConstraintManager constraints;
+  constraints.addConstraint(
+      UleExpr::create(ConstantExpr::create(3, Expr::Int16), a));
+  constraints.addConstraint(
+      UleExpr::create(a, ConstantExpr::create(1000, Expr::Int16)));
+
+  std::pair<ref<Expr>, ref<Expr> > range =
+      solver->getRange(Query(constraints, a));
+  ASSERT_TRUE(isa<ConstantExpr>(range.first) &&
+              isa<ConstantExpr>(range.second));
+  EXPECT_EQ(3u, cast<ConstantExpr>(range.first)->getZExtValue());
+  EXPECT_EQ(1000u, cast<ConstantExpr>(range.second)->getZExtValue());
+
+  // The conversion is exact, and negating it makes every value negative.
+  ref<Expr> ua = UToFExpr::create(a, Expr::Fl32, rm);
+  range = solver->getRange(Query(constraints, ua));
+  ASSERT_TRUE(isa<FConstantExpr>(range.first) &&
+              isa<FConstantExpr>(range.second));
+  EXPECT_EQ(3.0f, cast<FConstantExpr>(range.first)->getAPValue()
+                      .convertToFloat());
+  EXPECT_EQ(1000.0f, cast<FConstantExpr>(range.second)->getAPValue()
+                         .convertToFloat());
+
+  ref<Expr> negated = FSubExpr::create(
+      FConstantExpr::alloc(llvm::APFloat(-0.0f)), ua, rm);
+  range = solver->getRange(Query(constraints, negated));
+  ASSERT_TRUE(isa<FConstantExpr>(range.first) &&
+              isa<FConstantExpr>(range.second));
+  EXPECT_EQ(-1000.0f, cast<FConstantExpr>(range.first)->getAPValue()
+                          .convertToFloat());
+  EXPECT_EQ(-3.0f, cast<FConstantExpr>(range.second)->getAPValue()
+                       .convertToFloat());
+
+  delete solver;
+  delete oracle;
+}
+
+TEST(SolverTest, UniqueValue) {
+  Solver *oracle = klee::createCoreSolver(CoreSolverToUse);
+  Solver *solver =
+      createValidatingSolver(klee::createCoreSolver(CoreSolverToUse), oracle);
+
+  const Array *array = ac.CreateArray("unique", 2);
+  ref<Expr> a = Expr::createTempRead(array, Expr::Int16);
+  ConstraintManager constraints;
+  constraints.addConstraint(
+      UleExpr::create(ConstantExpr::create(3, Expr::Int16), a));
+  constraints.addConstraint(
+      UleExpr::create(a, ConstantExpr::create(1000, Expr::Int16)));
+
+  ref<Expr> value;
+  bool isUnique;
+  ASSERT_TRUE(solver->getUniqueValue(Query(constraints, a), value, isUnique));
+  EXPECT_FALSE(isUnique);
+
+  ref<Expr> low = UltExpr::create(a, ConstantExpr::create(4, Expr::Int16));
+  ASSERT_TRUE(solver->getUniqueValue(
+      Query(constraints, ZExtExpr::create(low, Expr::Int8)), value,
+      isUnique));
+  EXPECT_FALSE(isUnique);
+  ConstraintManager three(constraints);
+  three.addConstraint(low);
+  ASSERT_TRUE(solver->getUniqueValue(
+      Query(three, AddExpr::create(a, a)), value, isUnique));
+  ASSERT_TRUE(isUnique && isa<ConstantExpr>(value));
+  EXPECT_EQ(6u, cast<ConstantExpr>(value)->getZExtValue());
+
+  // -0 and +0 compare equal, but are different values; NaNs are all the
+  // same value.
+  ref<Expr> zero = FSelectExpr::create(
+      low, FConstantExpr::alloc(llvm::APFloat(0.0f)),
+      FConstantExpr::alloc(llvm::APFloat(-0.0f)));
+  ASSERT_TRUE(
+      solver->getUniqueValue(Query(constraints, zero), value, isUnique));
+  EXPECT_FALSE(isUnique);
+  float nan = std::numeric_limits<float>::quiet_NaN();
+  ref<Expr> nans =
+      FSelectExpr::create(low, FConstantExpr::alloc(llvm::APFloat(nan)),
+                          FConstantExpr::alloc(llvm::APFloat(-nan)));
+  ASSERT_TRUE(
+      solver->getUniqueValue(Query(constraints, nans), value, isUnique));
+  ASSERT_TRUE(isUnique && isa<FConstantExpr>(value));
+  EXPECT_TRUE(cast<FConstantExpr>(value)->getAPValue().isNaN());
+
+  delete solver;
+  delete oracle;
+}
+
+TEST(SolverTest, FloatSimplifying) {
+  Solver *solver =
+      createFloatSimplifyingSolver(klee::createCoreSolver(CoreSolverToUse));
+  llvm::APFloat::roundingMode rm = llvm::APFloat::rmNearestTiesToEven;
+  llvm::APFloat::roundingMode down = llvm::APFloat::rmTowardNegative;
+
+  const Array *array = ac.CreateArray("floatSimplifying", 4);
+  ref<Expr> a = Expr::createTempRead(array, Expr::Int16);
+  ref<Expr> b = ExtractExpr::create(Expr::createTempRead(array, Expr::Int32),
+                                    16, Expr::Int16);
+  ref<Expr> ua = UToFExpr::create(a, Expr::Fl32, rm);
+  ref<Expr> ub = UToFExpr::create(b, Expr::Fl32, rm);
+  bool res;
+
+  // The conversions are exact, so the float order is the integer order.
+  bool success = solver->mustBeTrue(
+      Query(ConstraintManager(),
+            EqExpr::create(FOltExpr::create(ua, ub), UltExpr::create(a, b))),
+      res);
+  EXPECT_TRUE(success);
+  if (success)
+    EXPECT_TRUE(res);
+
+  // x - x of a finite x is -0 when rounding downwards, and +0 otherwise.
+  ref<Expr> value;
+  ASSERT_TRUE(solver->getValue(
+      Query(ConstraintManager(), FSubExpr::create(ua, ua, down)), value));
+  ASSERT_TRUE(isa<FConstantExpr>(value));
+  EXPECT_TRUE(cast<FConstantExpr>(value)->getAPValue().bitwiseIsEqual(
+      llvm::APFloat(-0.0f)));
+  ASSERT_TRUE(solver->getValue(
+      Query(ConstraintManager(), FSubExpr::create(ua, ua, rm)), value));
+  ASSERT_TRUE(isa<FConstantExpr>(value));
+  EXPECT_TRUE(cast<FConstantExpr>(value)->getAPValue().bitwiseIsEqual(
+      llvm::APFloat(0.0f)));
+
+  // x + -0 keeps the sign of a zero x except when rounding downwards.
+  ref<Expr> zero = FSubExpr::create(ua, ua, rm);
+  ref<Expr> negZero = FConstantExpr::alloc(llvm::APFloat(-0.0f));
+  ASSERT_TRUE(solver->getValue(
+      Query(ConstraintManager(), FAddExpr::create(zero, negZero, down)),
+      value));
+  ASSERT_TRUE(isa<FConstantExpr>(value));
+  EXPECT_TRUE(cast<FConstantExpr>(value)->getAPValue().bitwiseIsEqual(
+      llvm::APFloat(-0.0f)));
+
+  delete solver;
+}
+
+TEST(SolverTest, FloatSimplifyingNarrow) {
+  // Every answer is checked against the core solver on the original query.
+  Solver *oracle = klee::createCoreSolver(CoreSolverToUse);
+  Solver *solver = createValidatingSolver(
+      createFloatSimplifyingSolver(klee::createCoreSolver(CoreSolverToUse)),
+      oracle);
+  llvm::APFloat::roundingMode rm = llvm::APFloat::rmNearestTiesToEven;
+
+  const Array *array = ac.CreateArray("floatSimplifyingNarrow", 16);
+  ref<Expr> read = Expr::createTempRead(array, 128);
+  ref<Expr> x = ExplicitFloatExpr::create(
+      ExtractExpr::create(read, 0, Expr::Int64), Expr::Fl64);
+  ref<Expr> y = ExplicitFloatExpr::create(
+      ExtractExpr::create(read, 64, Expr::Int64), Expr::Fl64);
+  ref<Expr> f = ExplicitFloatExpr::create(
+      ExtractExpr::create(read, 0, Expr::Int32), Expr::Fl32);
+  ref<Expr> lx = FExtExpr::create(x, Expr::Fl80, rm);
+  ref<Expr> ly = FExtExpr::create(y, Expr::Fl80, rm);
+  bool res;
+
+  // Long doubles which hold doubles compare as the doubles.
+  bool success = solver->mustBeTrue(
+      Query(ConstraintManager(),
+            EqExpr::create(FOltExpr::create(FAbsExpr::create(lx), ly),
+                           FOltExpr::create(FAbsExpr::create(x), y))),
+      res);
+  EXPECT_TRUE(success);
+  if (success)
+    EXPECT_TRUE(res);
+
+  // A float square root computed in double and rounded back is the float
+  // square root.
+  ref<Expr> viaDouble = FExtExpr::create(
+      FSqrtExpr::create(FExtExpr::create(f, Expr::Fl64, rm), rm), Expr::Fl32,
+      rm);
+  success = solver->mustBeTrue(
+      Query(ConstraintManager(),
+            FUeqExpr::create(viaDouble, FSqrtExpr::create(f, rm))),
+      res);
+  EXPECT_TRUE(success);
+  if (success)
+    EXPECT_TRUE(res);
+
+  delete solver;
+  delete oracle;
+}
+
+TEST(SolverTest, FloatTriage) {
+  // Every answer is checked against the core solver.
+  Solver *oracle = klee::createCoreSolver(CoreSolverToUse);
+  Solver *solver = createValidatingSolver(
+      createFloatTriageSolver(klee::createCoreSolver(CoreSolverToUse)),
+      oracle);
+  llvm::APFloat::roundingMode rm = llvm::APFloat::rmNearestTiesToEven;
+
+  const Array *array = ac.CreateArray("floatTriage", 8);
+  ref<Expr> read = Expr::createTempRead(array, Expr::Int64);
+  ref<Expr> x = ExplicitFloatExpr::create(
+      ExtractExpr::create(read, 0, Expr::Int32), Expr::Fl32);
+  ref<Expr> y = ExplicitFloatExpr::create(
+      ExtractExpr::create(read, 32, Expr::Int32), Expr::Fl32);
+  bool res;
+
+  // Nothing is less than itself, NaN included.
+  bool success = solver->mustBeFalse(
+      Query(ConstraintManager(), FOltExpr::create(x, x)), res);
+  EXPECT_TRUE(success);
+  if (success)
+    EXPECT_TRUE(res);
+
+  // The absolute value of a number is a number, and no less than zero.
+  ConstraintManager constraints;
+  constraints.addConstraint(Expr::createIsZero(FIsNanExpr::create(y)));
+  constraints.addConstraint(
+      FOgtExpr::create(y, FConstantExpr::alloc(llvm::APFloat(2.0f))));
+  success = solver->mustBeTrue(
+      Query(constraints,
+            Expr::createIsZero(FIsNanExpr::create(FAbsExpr::create(y)))),
+      res);
+  EXPECT_TRUE(success);
+  if (success)
+    EXPECT_TRUE(res);
+
+  // Neither is the sum of two numbers above 2 below 4.
+  ref<Expr> sum = FAddExpr::create(y, y, rm);
+  success = solver->mustBeTrue(
+      Query(constraints,
+            FOgtExpr::create(sum, FConstantExpr::alloc(llvm::APFloat(4.0f)))),
+      res);
+  EXPECT_TRUE(success);
+  if (success)
+    EXPECT_TRUE(res);
+
+  // Which the triage cannot tell, the core solver still answers.
+  success = solver->mayBeTrue(
+      Query(constraints,
+            FOgtExpr::create(x, FConstantExpr::alloc(llvm::APFloat(2.0f)))),
+      res);
+  EXPECT_TRUE(success);
+  if (success)
+    EXPECT_TRUE(res);
+
+  delete solver;
+  delete oracle;
+}
+
+TEST(SolverTest, PersistentCache) {
+  char path[] = "/tmp/klee-query-cache-XXXXXX";
+  int fd = mkstemp(path);
+  ASSERT_GE(fd, 0);
+  close(fd);
+
+  const Array *array = ac.CreateArray("persistentCache", 4);
+  ref<Expr> read = Expr::createTempRead(array, Expr::Int32);
+  // A NaN with a payload, which has to come back bit-exact.
+  ref<Expr> nanBits = ConstantExpr::create(0x7fc00123, Expr::Int32);
+  ConstraintManager constraints;
+  constraints.addConstraint(EqExpr::create(read, nanBits));
+  ref<Expr> sum = FAddExpr::create(
+      ExplicitFloatExpr::create(read, Expr::Fl32),
+      FConstantExpr::alloc(llvm::APFloat(1.0f)),
+      llvm::APFloat::rmTowardZero);
+  std::vector<const Array *> objects(1, array);
+
+  std::vector<std::vector<unsigned char> > values;
+  ref<Expr> value;
+  Solver *solver = createPersistentCachingSolver(
+      klee::createCoreSolver(CoreSolverToUse), path);
+  ASSERT_TRUE(solver->getInitialValues(
+      Query(constraints, ConstantExpr::alloc(0, Expr::Bool)), objects,
+      values));
+  ASSERT_TRUE(solver->getValue(Query(constraints, sum), value));
+  delete solver;
+
+  // The dummy solver fails every query, so only cached results are answered.
+  std::vector<std::vector<unsigned char> > cachedValues;
+  ref<Expr> cachedValue;
+  solver = createPersistentCachingSolver(createDummySolver(), path);
+  EXPECT_TRUE(solver->getInitialValues(
+      Query(constraints, ConstantExpr::alloc(0, Expr::Bool)), objects,
+      cachedValues));
+  EXPECT_EQ(values, cachedValues);
+  EXPECT_TRUE(solver->getValue(Query(constraints, sum), cachedValue));
+  ASSERT_TRUE(isa<FConstantExpr>(cachedValue));
+  EXPECT_TRUE(cast<FConstantExpr>(value)->getAPValue().bitwiseIsEqual(
+      cast<FConstantExpr>(cachedValue)->getAPValue()));
+
+  // A different rounding mode is a different query.
+  ref<Expr> otherSum = FAddExpr::create(
+      ExplicitFloatExpr::create(read, Expr::Fl32),
+      FConstantExpr::alloc(llvm::APFloat(1.0f)),
+      llvm::APFloat::rmNearestTiesToEven);
+  EXPECT_FALSE(solver->getValue(Query(constraints, otherSum), cachedValue));
+  delete solver;
+
+  unlink(path);
+}
+
+TEST(SolverTest, SharedMemoryCache) {
+  char path[] = "/tmp/klee-shared-cache-XXXXXX";
+  int fd = mkstemp(path);
+  ASSERT_GE(fd, 0);
+  close(fd);
+
+  // Less than a set, so the table has a single one of 8 slots.
+  Solver *solver = createSharedMemoryCachingSolver(
+      klee::createCoreSolver(CoreSolverToUse), path, 1);
+  Solver *cached = createSharedMemoryCachingSolver(createDummySolver(), path,
+                                                   1);
+
+  const Array *array = ac.CreateArray("sharedCache", 1);
+  ref<Expr> read = Expr::createTempRead(array, Expr::Int8);
+  ConstraintManager constraints;
+  std::vector<ref<Expr> > queries;
+  for (unsigned i = 0; i != 12; ++i)
+    queries.push_back(
+        UltExpr::create(read, ConstantExpr::create(i + 1, Expr::Int8)));
+
+  // The results of the other solver are there while it is alive.
+  bool result;
+  ASSERT_TRUE(solver->mayBeTrue(Query(constraints, queries[5]), result));
+  EXPECT_TRUE(cached->mayBeTrue(Query(constraints, queries[5]), result));
+  EXPECT_TRUE(result);
+  EXPECT_FALSE(cached->mayBeTrue(Query(constraints, queries[6]), result));
+
+  // Only the 8 entries which fit stay, the hit one among them.
+  for (unsigned i = 0; i != queries.size(); ++i) {
+    ASSERT_TRUE(solver->mayBeTrue(Query(constraints, queries[i]), result));
+    EXPECT_TRUE(cached->mayBeTrue(Query(constraints, queries[5]), result));
+  }
+  unsigned hits = 0;
+  for (unsigned i = 0; i != queries.size(); ++i)
+    hits += cached->mayBeTrue(Query(constraints, queries[i]), result);
+  EXPECT_EQ(8u, hits);
+  EXPECT_TRUE(cached->mayBeTrue(Query(constraints, queries[5]), result));
+
+  delete cached;
+  delete solver;
+  unlink(path);
+}
+
+
+#ifdef ENABLE_Z3
+TEST(SolverTest, Z3InitialValuesMany) {
+  Z3Solver solver;
+
+  // Each query pins its own array to a different value, and the last one
+  // has no solution.
+  std::vector<ConstraintManager> constraints(5);
+  std::vector<Query> queries;
+  std::vector<std::vector<const Array *> > objects;
+  for (unsigned i = 0; i != constraints.size(); ++i) {
+    const Array *array = ac.CreateArray("many" + llvm::utostr(i), 1);
+    ref<Expr> x = Expr::createTempRead(array, Expr::Int8);
+    constraints[i].addConstraint(
+        EqExpr::create(x, ConstantExpr::create(i + 1, Expr::Int8)));
+    if (i == constraints.size() - 1)
+      constraints[i].addConstraint(
+          UltExpr::create(x, ConstantExpr::create(i, Expr::Int8)));
+    queries.push_back(Query(constraints[i], ConstantExpr::alloc(0, Expr::Bool)));
+    objects.push_back(std::vector<const Array *>(1, array));
+  }
+
+  std::vector<std::vector<std::vector<unsigned char> > > values;
+  std::vector<bool> hasSolution;
+  ASSERT_TRUE(solver.getInitialValuesMany(queries, objects, values,
+                                          hasSolution));
+  ASSERT_EQ(queries.size(), hasSolution.size());
+  for (unsigned i = 0; i != queries.size() - 1; ++i) {
+    ASSERT_TRUE(hasSolution[i]);
+    EXPECT_EQ(i + 1, values[i][0][0]);
+  }
+  EXPECT_FALSE(hasSolution.back());
+}
+
+void *interruptSoon(void *solver) {
+  usleep(200000);
+  static_cast<Solver *>(solver)->interrupt();
+  return NULL;
+}
+
+TEST(SolverTest, Z3Interrupt) {
+  Z3Solver solver;
+
+  // Factoring the product of the two largest 32-bit primes takes Z3 far
+  // longer than the interrupt does to come.
+  ref<Expr> x = ZExtExpr::create(
+      Expr::createTempRead(ac.CreateArray("interruptX", 4), Expr::Int32),
+      Expr::Int64);
+  ref<Expr> y = ZExtExpr::create(
+      Expr::createTempRead(ac.CreateArray("interruptY", 4), Expr::Int32),
+      Expr::Int64);
+  ConstraintManager constraints;
+  constraints.addConstraint(
+      UltExpr::create(ConstantExpr::create(1, Expr::Int64), x));
+  constraints.addConstraint(
+      UltExpr::create(ConstantExpr::create(1, Expr::Int64), y));
+  ref<Expr> factors = EqExpr::create(
+      MulExpr::create(x, y),
+      ConstantExpr::create(18446743979220271189ULL, Expr::Int64));
+
+  pthread_t thread;
+  ASSERT_EQ(0, pthread_create(&thread, NULL, interruptSoon, &solver));
+  bool res;
+  EXPECT_FALSE(solver.mayBeTrue(Query(constraints, factors), res));
+  pthread_join(thread, NULL);
+
+  // Neither the interrupted query nor one between queries affects later
+  // ones.
+  solver.interrupt();
+  ASSERT_TRUE(solver.mayBeTrue(
+      Query(constraints,
+            EqExpr::create(x, ConstantExpr::create(2, Expr::Int64))),
+      res));
+  EXPECT_TRUE(res);
+}
+#endif
+
 }
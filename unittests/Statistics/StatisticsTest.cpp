@@ -0,0 +1,70 @@
+//===-- StatisticsTest.cpp --------------------------------------*- C++ -*-===//
+//
+//                     The KLEE Symbolic Virtual Machine
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+
+#include "gtest/gtest.h"
+
+#include "klee/Statistic.h"
+#include "klee/Statistics.h"
+
+#include <pthread.h>
+
+using namespace klee;
+
+namespace {
+
+Statistic testCount("TestCount", "Tc");
+
+const unsigned numThreads = 4;
+const unsigned numIncrements = 100000;
+
+void *countInShard(void *) {
+  theStatisticManager->attachThread();
+  for (unsigned i = 0; i != numIncrements; ++i)
+    ++testCount;
+  theStatisticManager->detachThread();
+  return 0;
+}
+
+TEST(StatisticsTest, ShardedTotals) {
+  uint64_t before = testCount.getValue();
+  pthread_t threads[numThreads];
+  for (unsigned i = 0; i != numThreads; ++i)
+    ASSERT_EQ(0, pthread_create(&threads[i], 0, countInShard, 0));
+
+  // Read while the shards are attached and being written.
+  uint64_t last = before;
+  for (unsigned i = 0; i != 1000; ++i) {
+    uint64_t value = testCount.getValue();
+    EXPECT_LE(before, value);
+    last = value;
+  }
+  EXPECT_LE(last, before + numThreads * numIncrements);
+
+  for (unsigned i = 0; i != numThreads; ++i)
+    ASSERT_EQ(0, pthread_join(threads[i], 0));
+
+  // Detached shards keep their counts.
+  EXPECT_EQ(before + numThreads * numIncrements, testCount.getValue());
+
+  // Increments of the main thread go to the primary shard.
+  ++testCount;
+  EXPECT_EQ(before + numThreads * numIncrements + 1, testCount.getValue());
+}
+
+TEST(StatisticsTest, ReusedShards) {
+  uint64_t before = testCount.getValue();
+  for (unsigned i = 0; i != 3; ++i) {
+    pthread_t thread;
+    ASSERT_EQ(0, pthread_create(&thread, 0, countInShard, 0));
+    ASSERT_EQ(0, pthread_join(thread, 0));
+  }
+  EXPECT_EQ(before + 3 * numIncrements, testCount.getValue());
+}
+
+}